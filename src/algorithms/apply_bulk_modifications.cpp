@@ -42,5 +42,36 @@ using namespace std;
             index++;
         });
     }
+    
+    vector<vector<handle_t>> apply_divisions(MutableHandleGraph* graph,
+                                             const vector<pair<id_t, vector<size_t>>>& divisions) {
+        
+        vector<vector<handle_t>> parts(divisions.size());
+        for (size_t i = 0; i < divisions.size(); i++) {
+            handle_t handle = graph->get_handle(divisions[i].first);
+            if (divisions[i].second.empty()) {
+                // Nothing to cut
+                parts[i].push_back(handle);
+            } else {
+                // Make all the cuts in one pass over the node's edges and paths
+                parts[i] = graph->divide_handle(handle, divisions[i].second);
+            }
+        }
+        return parts;
+    }
+    
+    void apply_removals(MutableHandleGraph* graph, const vector<edge_t>& edges, const vector<id_t>& nodes) {
+        
+        unordered_set<id_t> doomed(nodes.begin(), nodes.end());
+        
+        for (const auto& edge : edges) {
+            if (!doomed.count(graph->get_id(edge.first)) && !doomed.count(graph->get_id(edge.second))) {
+                graph->destroy_edge(edge.first, edge.second);
+            }
+        }
+        for (const auto& id : nodes) {
+            graph->destroy_handle(graph->get_handle(id));
+        }
+    }
 }
 }
@@ -26,6 +26,19 @@ using namespace std;
     /// Modifies underlying graph so that nodes occur in the same order as in the provided vector. Vector
     /// must contain exactly one handle for each node.
     void apply_ordering(MutableHandleGraph* graph, const vector<handle_t>& ordering);
+    
+    /// Modifies underlying graph so that each node whose ID is given is divided at all of the given
+    /// offsets along its forward strand at once, instead of by repeatedly dividing the remainder. Offsets
+    /// must be sorted and strictly inside the node. Returns the locally forward handles of the parts of
+    /// each node, in order, in the same order as the divisions. Nodes with no offsets are left alone and
+    /// are their own single part.
+    vector<vector<handle_t>> apply_divisions(MutableHandleGraph* graph,
+                                             const vector<pair<id_t, vector<size_t>>>& divisions);
+    
+    /// Modifies underlying graph by destroying all of the given edges and then all of the given nodes.
+    /// Edges may touch nodes that are also being destroyed; they are skipped, since destroying the node
+    /// takes them with it. Each edge and node must be in the graph and be given only once.
+    void apply_removals(MutableHandleGraph* graph, const vector<edge_t>& edges, const vector<id_t>& nodes);
 
 }
 }
@@ -1,16 +1,29 @@
 #include "count_walks.hpp"
+#include "../snarls.hpp"
+#include "../utility.hpp"
+
+#include <cmath>
 
 namespace vg {
 namespace algorithms {
 
 using namespace std;
 
-    size_t count_walks(const HandleGraph* graph) {
-        
-        vector<handle_t> sinks;
-        unordered_map<handle_t, size_t> count;
-        count.reserve(graph->node_size());
-        
+    /// Add two counts, saturating at the maximum.
+    static inline size_t saturating_add(size_t a, size_t b) {
+        return (numeric_limits<size_t>::max() - a < b ? numeric_limits<size_t>::max() : a + b);
+    }
+    
+    /// Multiply two counts, saturating at the maximum.
+    static inline size_t saturating_multiply(size_t a, size_t b) {
+        if (a != 0 && numeric_limits<size_t>::max() / a < b) {
+            return numeric_limits<size_t>::max();
+        }
+        return a * b;
+    }
+
+    /// Find the source and sink handles of a single-stranded DAG.
+    static void find_sources_and_sinks(const HandleGraph* graph, vector<handle_t>& sources, vector<handle_t>& sinks) {
         graph->for_each_handle([&](const handle_t& handle) {
             bool is_source = true, is_sink = true;
             graph->follow_edges(handle, true, [&](const handle_t& prev) {
@@ -23,12 +36,23 @@ using namespace std;
             });
             
             if (is_source) {
-                count[handle] = 1;
+                sources.emplace_back(handle);
             }
             if (is_sink) {
                 sinks.emplace_back(handle);
             }
         });
+    }
+
+    size_t count_walks(const HandleGraph* graph) {
+        
+        vector<handle_t> sources, sinks;
+        find_sources_and_sinks(graph, sources, sinks);
+        unordered_map<handle_t, size_t> count;
+        count.reserve(graph->node_size());
+        for (const handle_t& source : sources) {
+            count[source] = 1;
+        }
         
         bool overflowed = false;
         for (const handle_t& handle : lazier_topological_order(graph)) {
@@ -48,12 +72,175 @@ using namespace std;
             }
         }
         
+        // The sinks can still add up to too many
         size_t total_count = 0;
         for (handle_t& sink : sinks) {
-            total_count += count[sink];
+            total_count = saturating_add(total_count, count[sink]);
         }
         
         return total_count;
     }
+    
+    double log_count_walks(const HandleGraph* graph) {
+        
+        vector<handle_t> sources, sinks;
+        find_sources_and_sinks(graph, sources, sinks);
+        // Handles we haven't reached have no walks, so log count -infinity
+        unordered_map<handle_t, double> log_count;
+        log_count.reserve(graph->node_size());
+        for (const handle_t& source : sources) {
+            log_count[source] = 0.0;
+        }
+        
+        auto get_log_count = [&](const handle_t& handle) -> double& {
+            auto found = log_count.find(handle);
+            if (found == log_count.end()) {
+                found = log_count.emplace(handle, -numeric_limits<double>::infinity()).first;
+            }
+            return found->second;
+        };
+        
+        for (const handle_t& handle : lazier_topological_order(graph)) {
+            double log_count_here = get_log_count(handle);
+            if (log_count_here == -numeric_limits<double>::infinity()) {
+                continue;
+            }
+            graph->follow_edges(handle, false, [&](const handle_t& next) {
+                double& log_count_next = get_log_count(next);
+                log_count_next = (log_count_next == -numeric_limits<double>::infinity() ?
+                                  log_count_here : add_log(log_count_next, log_count_here));
+            });
+        }
+        
+        double total = -numeric_limits<double>::infinity();
+        for (handle_t& sink : sinks) {
+            double log_count_sink = get_log_count(sink);
+            if (log_count_sink != -numeric_limits<double>::infinity()) {
+                total = (total == -numeric_limits<double>::infinity() ? log_count_sink : add_log(total, log_count_sink));
+            }
+        }
+        return total;
+    }
+    
+    /// Count the start-to-end walks through one snarl, given the counts for
+    /// all its children. Child snarls are skipped over, multiplying by their
+    /// counts, so chains of children are handled one child at a time.
+    static size_t count_walks_through_snarl(const HandleGraph* graph, const SnarlManager& snarl_manager,
+                                            const Snarl* snarl, const unordered_map<const Snarl*, size_t>& counts) {
+        
+        handle_t start = graph->get_handle(snarl->start().node_id(), snarl->start().backward());
+        handle_t end = graph->get_handle(snarl->end().node_id(), snarl->end().backward());
+        handle_t leaving = graph->flip(start);
+        const size_t infinite = numeric_limits<size_t>::max();
+        
+        // The number of walks from each handle to the end, once it is known
+        unordered_map<handle_t, size_t> walks_from;
+        // Handles whose successors are being counted, to find cycles
+        unordered_set<handle_t> on_stack;
+        
+        // Get the handles a walk can go to from here, and the multiplier for
+        // getting there, if the handle enters a child.
+        auto successors = [&](const handle_t& here, size_t& multiplier) {
+            vector<handle_t> next_handles;
+            multiplier = 1;
+            const Snarl* child = (here == start ? nullptr :
+                                  snarl_manager.into_which_snarl(graph->get_id(here), graph->get_is_reverse(here)));
+            if (child != nullptr && child != snarl) {
+                // Skip to the other side of the child
+                if (child->start_end_reachable()) {
+                    multiplier = counts.at(child);
+                    handle_t child_start = graph->get_handle(child->start().node_id(), child->start().backward());
+                    handle_t child_end = graph->get_handle(child->end().node_id(), child->end().backward());
+                    next_handles.push_back(here == child_start ? child_end : graph->flip(child_start));
+                }
+            } else {
+                graph->follow_edges(here, false, [&](const handle_t& next) {
+                    next_handles.push_back(next);
+                });
+            }
+            return next_handles;
+        };
+        
+        // Post-order DFS from the start. Each frame has the handle, its
+        // multiplier, its successors, and the next successor to look at.
+        struct Frame {
+            handle_t handle;
+            size_t multiplier;
+            vector<handle_t> next_handles;
+            size_t next_index;
+            size_t walks;
+        };
+        vector<Frame> stack;
+        stack.push_back(Frame{start, 1, {}, 0, 0});
+        stack.back().next_handles = successors(start, stack.back().multiplier);
+        on_stack.insert(start);
+        
+        while (!stack.empty()) {
+            Frame& frame = stack.back();
+            if (frame.next_index == frame.next_handles.size()) {
+                // All the successors are counted
+                size_t walks = saturating_multiply(frame.multiplier, frame.walks);
+                walks_from[frame.handle] = walks;
+                on_stack.erase(frame.handle);
+                stack.pop_back();
+                if (!stack.empty()) {
+                    stack.back().walks = saturating_add(stack.back().walks, walks);
+                }
+                continue;
+            }
+            
+            handle_t next = frame.next_handles[frame.next_index++];
+            if (next == end) {
+                frame.walks = saturating_add(frame.walks, 1);
+            } else if (next == leaving) {
+                // Leaving through the start doesn't count
+            } else if (on_stack.count(next)) {
+                // A cycle means the walks can't be counted
+                return infinite;
+            } else {
+                auto found = walks_from.find(next);
+                if (found != walks_from.end()) {
+                    frame.walks = saturating_add(frame.walks, found->second);
+                } else {
+                    size_t multiplier;
+                    vector<handle_t> next_handles = successors(next, multiplier);
+                    on_stack.insert(next);
+                    // This invalidates frame
+                    stack.push_back(Frame{next, multiplier, move(next_handles), 0, 0});
+                }
+            }
+        }
+        
+        return walks_from.at(start);
+    }
+    
+    unordered_map<const Snarl*, size_t> count_walks_through_snarls(const HandleGraph* graph,
+                                                                   const SnarlManager& snarl_manager) {
+        
+        // Make all the entries first, so threads only write to existing ones
+        unordered_map<const Snarl*, size_t> counts;
+        snarl_manager.for_each_snarl_preorder([&](const Snarl* snarl) {
+            counts[snarl];
+        });
+        
+        snarl_manager.for_each_top_level_snarl_parallel([&](const Snarl* top_level) {
+            // Count each tree from the bottom up
+            vector<pair<const Snarl*, bool>> stack{make_pair(top_level, false)};
+            while (!stack.empty()) {
+                const Snarl* snarl = stack.back().first;
+                if (stack.back().second) {
+                    stack.pop_back();
+                    counts.at(snarl) = count_walks_through_snarl(graph, snarl_manager, snarl, counts);
+                } else {
+                    stack.back().second = true;
+                    for (const Snarl* child : snarl_manager.children_of(snarl)) {
+                        stack.emplace_back(child, false);
+                    }
+                }
+            }
+        });
+        
+        return counts;
+    }
 }
 }
@@ -14,6 +14,10 @@
 #include <vector>
 
 namespace vg {
+
+class Snarl;
+class SnarlManager;
+
 namespace algorithms {
 
 using namespace std;
@@ -24,6 +28,20 @@ using namespace std;
     /// Returns numeric_limits<size_t>::max() if the actual number of walks is larger
     /// than this.
     size_t count_walks(const HandleGraph* graph);
+    
+    /// Returns the natural log of the number of source-to-sink walks through
+    /// the graph, which does not overflow. Has the same assumptions as
+    /// count_walks(). Returns negative infinity if there are no walks.
+    double log_count_walks(const HandleGraph* graph);
+    
+    /// Returns the number of start-to-end walks through each snarl, counting
+    /// all the walks through its child snarls. Walks that would leave the
+    /// snarl through its start are not counted. Counts saturate at
+    /// numeric_limits<size_t>::max(), which is also the count for snarls with
+    /// a cycle reachable from the start. Top-level snarl trees are counted in
+    /// parallel with OMP threads.
+    unordered_map<const Snarl*, size_t> count_walks_through_snarls(const HandleGraph* graph,
+                                                                   const SnarlManager& snarl_manager);
 
 }
 }
@@ -0,0 +1,78 @@
+/**
+ * \file dijkstra.cpp
+ *
+ * Implementation for the bounded Dijkstra search shared by the graph distance helpers.
+ */
+
+#include "dijkstra.hpp"
+
+#include <queue>
+#include <unordered_set>
+
+//#define debug_vg_algorithms
+
+namespace vg {
+namespace algorithms {
+
+bool dijkstra(const HandleGraph* g, const vector<pair<handle_t, size_t>>& starts,
+              const function<bool(const handle_t&, size_t)>& reached_callback,
+              bool traverse_leftward, size_t max_distance) {
+    
+    // We put handles in the queue whenever we see them at a distance, and
+    // skip the copies that come out after the handle has been reached. That
+    // is cheaper than updating queue entries in place.
+    using Record = pair<size_t, handle_t>;
+    struct IsFirstGreater {
+        inline bool operator()(const Record& a, const Record& b) const {
+            return a.first > b.first;
+        }
+    };
+    priority_queue<Record, vector<Record>, IsFirstGreater> queue;
+    
+    // The handles we have already reached
+    unordered_set<handle_t> reached;
+    
+    for (auto& start : starts) {
+        if (start.second <= max_distance) {
+            queue.emplace(start.second, start.first);
+        }
+    }
+    
+    while (!queue.empty()) {
+        size_t distance;
+        handle_t current;
+        tie(distance, current) = queue.top();
+        queue.pop();
+        
+        if (!reached.insert(current).second) {
+            // We already got here by a shorter path
+            continue;
+        }
+        
+#ifdef debug_vg_algorithms
+        cerr << "[dijkstra] reached " << g->get_id(current) << (g->get_is_reverse(current) ? "-" : "+")
+            << " at distance " << distance << endl;
+#endif
+        
+        if (!reached_callback(current, distance)) {
+            return false;
+        }
+        
+        size_t next_distance = distance + g->get_length(current);
+        if (next_distance > max_distance) {
+            // Nothing past here is close enough
+            continue;
+        }
+        
+        g->follow_edges(current, traverse_leftward, [&](const handle_t& next) {
+            if (!reached.count(next)) {
+                queue.emplace(next_distance, next);
+            }
+        });
+    }
+    
+    return true;
+}
+
+}
+}
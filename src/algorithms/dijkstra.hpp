@@ -0,0 +1,36 @@
+#ifndef VG_ALGORITHMS_DIJKSTRA_HPP_INCLUDED
+#define VG_ALGORITHMS_DIJKSTRA_HPP_INCLUDED
+
+/**
+ * \file dijkstra.hpp
+ *
+ * Definitions for the bounded Dijkstra search shared by the graph distance helpers.
+ */
+
+#include <functional>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "../handle.hpp"
+
+namespace vg {
+namespace algorithms {
+
+using namespace std;
+
+    /// Walk out from the given start handles, each of which is entered at the given distance, with
+    /// Dijkstra's algorithm. Distances are measured to the start of each oriented handle, and moving
+    /// on from a handle to the next costs the handle's length. Calls reached_callback once for each
+    /// handle that can be reached, in order of increasing distance, with its final distance. Stops
+    /// when the callback returns false, and never visits handles farther than max_distance. Returns
+    /// false if the callback stopped the search, and true otherwise.
+    bool dijkstra(const HandleGraph* g, const vector<pair<handle_t, size_t>>& starts,
+                  const function<bool(const handle_t&, size_t)>& reached_callback,
+                  bool traverse_leftward = false,
+                  size_t max_distance = numeric_limits<size_t>::max());
+
+}
+}
+
+#endif
@@ -5,14 +5,12 @@
  */
  
 #include "extract_connecting_graph.hpp"
-#include <structures/updateable_priority_queue.hpp>
 
 //#define debug_vg_algorithms
 
 namespace vg {
 namespace algorithms {
 
-using namespace structures;
 
 unordered_map<id_t, id_t> extract_connecting_graph(const HandleGraph* source,
                                                    MutableHandleGraph* into,
@@ -21,6 +19,19 @@ unordered_map<id_t, id_t> extract_connecting_graph(const HandleGraph* source,
                                                    bool detect_terminal_cycles,
                                                    bool only_paths,
                                                    bool strict_max_len) {
+    ExtractionWorkspace workspace;
+    return extract_connecting_graph(source, into, max_len, pos_1, pos_2, workspace, detect_terminal_cycles,
+                                    only_paths, strict_max_len);
+}
+
+unordered_map<id_t, id_t> extract_connecting_graph(const HandleGraph* source,
+                                                   MutableHandleGraph* into,
+                                                   int64_t max_len,
+                                                   pos_t pos_1, pos_t pos_2,
+                                                   ExtractionWorkspace& workspace,
+                                                   bool detect_terminal_cycles,
+                                                   bool only_paths,
+                                                   bool strict_max_len) {
 #ifdef debug_vg_algorithms
     cerr << "[extract_connecting_graph] max len: " << max_len << ", pos 1: " << pos_1 << ", pos 2: " << pos_2 << endl;
 #endif
@@ -30,15 +41,11 @@ unordered_map<id_t, id_t> extract_connecting_graph(const HandleGraph* source,
         exit(1);
     }
     
-    // a local struct that packages a handle with its distance from the first position
-    struct Traversal {
-        Traversal(handle_t handle, int64_t dist) : handle(handle), dist(dist) {}
-        int64_t dist; // distance from pos to the right side of this node
-        handle_t handle; // Oriented node traversal
-        inline bool operator<(const Traversal& other) const {
-            return dist > other.dist; // opposite order so priority queue selects minimum
-        }
-    };
+    // a handle with its distance from the first position
+    using Traversal = ExtractionTraversal;
+    
+    // start from empty tables, but keep their memory from earlier calls
+    workspace.clear();
     
     // local enum to keep track of the cases where the positions are on the same node
     enum colocation_t {SeparateNodes, SharedNodeReachable, SharedNodeUnreachable, SharedNodeReverse};
@@ -72,7 +79,7 @@ unordered_map<id_t, id_t> extract_connecting_graph(const HandleGraph* source,
     unordered_map<id_t, id_t> id_trans;
     
     // the edges we have encountered in the traversal
-    unordered_set<edge_t> observed_edges;
+    unordered_set<edge_t>& observed_edges = workspace.observed_edges;
     
     // create nodes for the source positions in the new graph
     handle_t into_handle_1 = into->create_handle(source->get_sequence(source->forward(source_handle_1)), id(pos_1));
@@ -97,7 +104,8 @@ unordered_map<id_t, id_t> extract_connecting_graph(const HandleGraph* source,
     // keep track of whether we find a path or not
     bool found_target = false;
     
-    unordered_set<handle_t> skip_handles{source_handle_1};
+    unordered_set<handle_t>& skip_handles = workspace.skip_handles;
+    skip_handles.insert(source_handle_1);
     // mark final position for skipping so that we won't look for additional traversals unless that's
     // the only way to find terminal cycles
     if (!(colocation == SharedNodeReverse && detect_terminal_cycles)) {
@@ -105,9 +113,7 @@ unordered_map<id_t, id_t> extract_connecting_graph(const HandleGraph* source,
     }
     
     // initialize the queue
-    UpdateablePriorityQueue<Traversal, handle_t> queue([](const Traversal& item) {
-        return item.handle;
-    });
+    auto& queue = workspace.queue;
     
     // the distance to the ends of the starting nodes
     int64_t first_traversal_length = source->get_length(source_handle_1) - offset(pos_1);
@@ -533,8 +539,8 @@ unordered_map<id_t, id_t> extract_connecting_graph(const HandleGraph* source,
     // process of searching for the subgraph that has this guarantee
     
     // these will be filled by the pruning algorithms
-    unordered_set<handle_t> nodes_to_erase;
-    unordered_set<edge_t> edges_to_erase;
+    unordered_set<handle_t>& nodes_to_erase = workspace.nodes_to_erase;
+    unordered_set<edge_t>& edges_to_erase = workspace.edges_to_erase;
     
     if (strict_max_len) {
         // OPTION 1: PRUNE TO PATHS UNDER MAX LENGTH
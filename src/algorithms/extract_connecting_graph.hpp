@@ -16,6 +16,7 @@
 #include "../hash_map.hpp"
 
 #include "find_shortest_paths.hpp"
+#include "extraction_workspace.hpp"
 
 namespace vg {
 namespace algorithms {
@@ -49,6 +50,17 @@ namespace algorithms {
                                                        bool detect_terminal_cycles = false,
                                                        bool only_walks = false,
                                                        bool strict_max_len = false);
+    
+    /// Same as above, but keeps its search state in the given workspace, to avoid reallocating it when
+    /// extracting many subgraphs in a row.
+    unordered_map<id_t, id_t> extract_connecting_graph(const HandleGraph* source,
+                                                       MutableHandleGraph* into,
+                                                       int64_t max_len,
+                                                       pos_t pos_1, pos_t pos_2,
+                                                       ExtractionWorkspace& workspace,
+                                                       bool detect_terminal_cycles = false,
+                                                       bool only_walks = false,
+                                                       bool strict_max_len = false);
 
 }
 }
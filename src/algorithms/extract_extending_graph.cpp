@@ -5,17 +5,22 @@
  */
  
 #include "extract_extending_graph.hpp"
-#include <structures/updateable_priority_queue.hpp>
 
 //#define debug_vg_algorithms
 
 namespace vg {
 namespace algorithms {
 
-using namespace structures;
 
 unordered_map<id_t, id_t> extract_extending_graph(const HandleGraph* source, MutableHandleGraph* into, int64_t max_dist, pos_t pos,
                                                   bool backward, bool preserve_cycles_on_src_node) {
+    ExtractionWorkspace workspace;
+    return extract_extending_graph(source, into, max_dist, pos, backward, preserve_cycles_on_src_node, workspace);
+}
+
+unordered_map<id_t, id_t> extract_extending_graph(const HandleGraph* source, MutableHandleGraph* into, int64_t max_dist, pos_t pos,
+                                                  bool backward, bool preserve_cycles_on_src_node,
+                                                  ExtractionWorkspace& workspace) {
     
     if (into->node_size()) {
         cerr << "error:[extract_extending_graph] must extract into an empty graph" << endl;
@@ -26,17 +31,11 @@ unordered_map<id_t, id_t> extract_extending_graph(const HandleGraph* source, Mut
     cerr << "[extract_extending_graph] extracting exending graph from " << pos << " in " << (backward ? "backward" : "forward") << " direction with max search dist " << max_dist << endl;
 #endif
     
-    // TODO: struct is duplicative with extract_connecting_graph
+    // a handle with its distance from the position
+    using Traversal = ExtractionTraversal;
     
-    // a local struct that packages a handle with its distance from the first position
-    struct Traversal {
-        Traversal(handle_t handle, int64_t dist) : handle(handle), dist(dist) {}
-        int64_t dist; // distance from pos to the right side of this node
-        handle_t handle; // Oriented node traversal
-        inline bool operator<(const Traversal& other) const {
-            return dist > other.dist; // opposite order so priority queue selects minimum
-        }
-    };
+    // start from empty tables, but keep their memory from earlier calls
+    workspace.clear();
     
     // a map from node ids in the extracted graph to the node ids in the original graph
     unordered_map<id_t, id_t> id_trans;
@@ -52,9 +51,7 @@ unordered_map<id_t, id_t> extract_extending_graph(const HandleGraph* source, Mut
     handle_t start_handle;
     
     // initialize the queue for Dijkstra traversal.
-    UpdateablePriorityQueue<Traversal, handle_t> queue([](const Traversal& item) {
-        return item.handle;
-    });
+    auto& queue = workspace.queue;
     
     if (backward) {
         int64_t dist = offset(pos);
@@ -75,8 +72,9 @@ unordered_map<id_t, id_t> extract_extending_graph(const HandleGraph* source, Mut
     
     id_t max_id = id(pos);
     bool cycled_to_source = false;
-    unordered_set<edge_t> observed_edges;
-    unordered_set<id_t> observed_nodes{id(pos)};
+    unordered_set<edge_t>& observed_edges = workspace.observed_edges;
+    unordered_set<id_t>& observed_nodes = workspace.observed_nodes;
+    observed_nodes.insert(id(pos));
     
     while (!queue.empty()) {
         // get the next shortest distance traversal from either the init
@@ -129,7 +127,7 @@ unordered_map<id_t, id_t> extract_extending_graph(const HandleGraph* source, Mut
         });
     }
     
-    vector<edge_t> src_edges;
+    vector<edge_t>& src_edges = workspace.source_edges;
     
     // add the edges to the graph
     for (const pair<handle_t, handle_t>& edge : observed_edges) {
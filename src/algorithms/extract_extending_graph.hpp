@@ -14,6 +14,7 @@
 #include "../vg.pb.h"
 #include "../hash_map.hpp"
 #include "../handle.hpp"
+#include "extraction_workspace.hpp"
 
 namespace vg {
 namespace algorithms {
@@ -34,6 +35,12 @@ namespace algorithms {
     ///  preserve_cycles_on_src  if necessary, duplicate starting node to preserve cycles after cutting it
     unordered_map<id_t, id_t> extract_extending_graph(const HandleGraph* source, MutableHandleGraph* into, int64_t max_dist, pos_t pos,
                                                       bool backward, bool preserve_cycles_on_src_node);
+    
+    /// Same as above, but keeps its search state in the given workspace, to avoid reallocating it when
+    /// extracting many subgraphs in a row.
+    unordered_map<id_t, id_t> extract_extending_graph(const HandleGraph* source, MutableHandleGraph* into, int64_t max_dist, pos_t pos,
+                                                      bool backward, bool preserve_cycles_on_src_node,
+                                                      ExtractionWorkspace& workspace);
                                                       
 }
 }
@@ -0,0 +1,29 @@
+/**
+ * \file extraction_workspace.cpp
+ *
+ * Implementation for the scratch space shared by the subgraph extraction algorithms.
+ */
+ 
+#include "extraction_workspace.hpp"
+
+namespace vg {
+namespace algorithms {
+
+ExtractionWorkspace::ExtractionWorkspace() : queue([](const ExtractionTraversal& item) {
+    return item.handle;
+}) {
+    // Nothing else to do
+}
+
+void ExtractionWorkspace::clear() {
+    queue.clear();
+    observed_edges.clear();
+    observed_nodes.clear();
+    skip_handles.clear();
+    source_edges.clear();
+    nodes_to_erase.clear();
+    edges_to_erase.clear();
+}
+
+}
+}
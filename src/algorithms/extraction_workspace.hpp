@@ -0,0 +1,62 @@
+#ifndef VG_ALGORITHMS_EXTRACTION_WORKSPACE_HPP_INCLUDED
+#define VG_ALGORITHMS_EXTRACTION_WORKSPACE_HPP_INCLUDED
+
+/**
+ * \file extraction_workspace.hpp
+ *
+ * Definitions for the scratch space shared by the subgraph extraction algorithms.
+ */
+
+#include <unordered_set>
+#include <vector>
+
+#include "../handle.hpp"
+#include "../hash_map.hpp"
+
+#include <structures/updateable_priority_queue.hpp>
+
+namespace vg {
+namespace algorithms {
+
+    using namespace std;
+
+    /// A handle packaged with its distance from the position a search started at
+    struct ExtractionTraversal {
+        ExtractionTraversal(handle_t handle, int64_t dist) : handle(handle), dist(dist) {}
+        int64_t dist; // distance from pos to the right side of this node
+        handle_t handle; // Oriented node traversal
+        inline bool operator<(const ExtractionTraversal& other) const {
+            return dist > other.dist; // opposite order so priority queue selects minimum
+        }
+    };
+    
+    /// The queue and hash tables used by extract_connecting_graph() and extract_extending_graph().
+    /// A thread that extracts many subgraphs can keep one of these and pass it to every call, so the
+    /// containers hang on to their memory between calls instead of being allocated for each one. A
+    /// workspace must not be used by more than one call at a time.
+    class ExtractionWorkspace {
+    public:
+        ExtractionWorkspace();
+        
+        /// Empty out all the containers, keeping their memory. Extraction calls do this on entry.
+        void clear();
+        
+        /// Queue for the Dijkstra searches
+        structures::UpdateablePriorityQueue<ExtractionTraversal, handle_t> queue;
+        /// Edges seen in the source graph
+        unordered_set<edge_t> observed_edges;
+        /// Nodes seen in the source graph
+        unordered_set<id_t> observed_nodes;
+        /// Handles the searches should not enqueue
+        unordered_set<handle_t> skip_handles;
+        /// Edges in the source graph that touch the starting node
+        vector<edge_t> source_edges;
+        /// Nodes and edges to prune from the extracted graph
+        unordered_set<handle_t> nodes_to_erase;
+        unordered_set<edge_t> edges_to_erase;
+    };
+
+}
+}
+
+#endif
@@ -0,0 +1,35 @@
+#include "path_region_id_ranges.hpp"
+#include "sorted_id_ranges.hpp"
+#include "../subhandlegraph.hpp"
+
+#include <stdexcept>
+
+namespace vg {
+namespace algorithms {
+
+using namespace std;
+
+vector<pair<id_t, id_t>> path_region_id_ranges(const xg::XG& index, const Region& region, size_t context_steps) {
+
+    if (index.path_rank(region.seq) == 0) {
+        // Walking a nonexistent path would be undefined behavior
+        throw runtime_error("path_region_id_ranges: path " + region.seq + " not found in index");
+    }
+
+    // Collect the nodes along the path in a view
+    SubHandleGraph view(&index);
+    index.for_path_range(region.seq, max(region.start, (int64_t) 0), region.end, [&](int64_t id) {
+        view.add_node(index.get_handle(id, false));
+    });
+
+    if (context_steps > 0) {
+        // Pull in the surrounding nodes as well
+        index.expand_context(view, context_steps, true);
+    }
+
+    // The view knows its IDs, so sort and coalesce them
+    return sorted_id_ranges(&view);
+}
+
+}
+}
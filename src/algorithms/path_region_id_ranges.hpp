@@ -0,0 +1,33 @@
+#ifndef VG_ALGORITHMS_PATH_REGION_ID_RANGES_HPP_INCLUDED
+#define VG_ALGORITHMS_PATH_REGION_ID_RANGES_HPP_INCLUDED
+
+/**
+ * \file path_region_id_ranges.hpp
+ *
+ * Defines an algorithm to get the ranges of node IDs that a region of an
+ * embedded path visits, for looking up reads in a sorted GAM.
+ */
+
+#include <vector>
+#include <utility>
+
+#include "../handle.hpp"
+#include "../region.hpp"
+#include "../xg.hpp"
+
+namespace vg {
+namespace algorithms {
+
+using namespace std;
+
+/// Get a sorted list of inclusive ranges of the IDs of the nodes the given
+/// 0-based, inclusive region of a path in the index visits, expanded by the
+/// given number of context steps. A start or end of -1 means the start or end
+/// of the path. Throws if the path doesn't exist. Nothing is copied out of the
+/// index but a view of the touched nodes.
+vector<pair<id_t, id_t>> path_region_id_ranges(const xg::XG& index, const Region& region, size_t context_steps = 0);
+
+}
+}
+
+#endif
@@ -1,4 +1,9 @@
 #include "topological_sort.hpp"
+#include "weakly_connected_components.hpp"
+
+#include <omp.h>
+#include <limits>
+#include <queue>
 
 namespace vg {
 namespace algorithms {
@@ -49,11 +54,16 @@ vector<handle_t> tail_nodes(const HandleGraph* g) {
     
 }
 
-vector<handle_t> topological_order(const HandleGraph* g) {
-    
-    // Make a vector to hold the ordered and oriented nodes.
-    vector<handle_t> sorted;
-    sorted.reserve(g->node_size());
+/**
+ * Run the sort described for topological_order() over just the given nodes,
+ * which must be closed under following edges (i.e. be made of whole weakly
+ * connected components). Appends the ordered and oriented nodes to sorted. If
+ * restarts is set, also appends a code for how the sort came to each node: 0
+ * if it was a head or was freed up by the nodes before it, 1 if it was taken
+ * from the seeds to break into a cycle, and 2 if it was picked arbitrarily.
+ */
+static void topological_order_of_nodes(const HandleGraph* g, const vector<handle_t>& nodes,
+                                       vector<handle_t>& sorted, vector<uint8_t>* restarts) {
     
     // Instead of actually removing edges, we add them to this set of masked edges.
     unordered_set<pair<handle_t, handle_t>> masked_edges;
@@ -62,36 +72,36 @@ vector<handle_t> topological_order(const HandleGraph* g) {
     // using a map instead of a set ensures a stable sort across different systems
     map<id_t, handle_t> s;
 
-    // We find the head and tails, if there are any
-    vector<handle_t> heads{head_nodes(g)};
-    // No need to fetch the tails since we don't use them
-
-    
     // Maps from node ID to first orientation we suggested for it.
     map<id_t, handle_t> seeds;
     
-    
-    for(handle_t& head : heads) {
-        // Dump all the heads into the oriented set, rather than having them as
-        // seeds. We will only go for cycle-breaking seeds when we run out of
-        // heads. This is bad for contiguity/ordering consistency in cyclic
-        // graphs and reversing graphs, but makes sure we work out to just
-        // topological sort on DAGs. It mimics the effect we used to get when we
-        // joined all the head nodes to a new root head node and seeded that. We
-        // ignore tails since we only orient right from nodes we pick.
-        s[g->get_id(head)] = head;
-    }
-
     // We will use an ordered map handles by ID for nodes we have not visited
     // yet. This ensures a consistent sort order across systems.
     map<id_t, handle_t> unvisited;
-    g->for_each_handle([&](const handle_t& found) {
-        if (!s.count(g->get_id(found))) {
+    
+    for (const handle_t& found : nodes) {
+        bool no_left_edges = g->follow_edges(found, true, [&](const handle_t& ignored) {
+            return false;
+        });
+        
+        if (no_left_edges) {
+            // Dump all the heads into the oriented set, rather than having them as
+            // seeds. We will only go for cycle-breaking seeds when we run out of
+            // heads. This is bad for contiguity/ordering consistency in cyclic
+            // graphs and reversing graphs, but makes sure we work out to just
+            // topological sort on DAGs. It mimics the effect we used to get when we
+            // joined all the head nodes to a new root head node and seeded that. We
+            // ignore tails since we only orient right from nodes we pick.
+            s[g->get_id(found)] = found;
+        } else {
             // Only nodes that aren't yet in s are unvisited.
-            // Nodes in s are visited but just need to be added tot he ordering.
+            // Nodes in s are visited but just need to be added to the ordering.
             unvisited.emplace(g->get_id(found), found);
         }
-    });
+    }
+    
+    // How we came to the next node we will take out of s
+    uint8_t how_found = 0;
 
     while(!unvisited.empty() || !s.empty()) {
 
@@ -110,6 +120,7 @@ vector<handle_t> topological_order(const HandleGraph* g) {
 
                 s[g->get_id(first_seed)] = first_seed;
                 unvisited.erase(g->get_id(first_seed));
+                how_found = 1;
             }
             // Whether we used the seed or not, don't keep it around
             seeds.erase(seeds.begin());
@@ -125,6 +136,7 @@ vector<handle_t> topological_order(const HandleGraph* g) {
 
             s[unvisited.begin()->first] = unvisited.begin()->second;
             unvisited.erase(unvisited.begin()->first);
+            how_found = 2;
         }
 
         while (!s.empty()) {
@@ -133,6 +145,10 @@ vector<handle_t> topological_order(const HandleGraph* g) {
             s.erase(g->get_id(n));
             // Emit it
             sorted.push_back(n);
+            if (restarts) {
+                restarts->push_back(how_found);
+            }
+            how_found = 0;
 #ifdef debug
 #pragma omp critical (cerr)
             cerr << "Using oriented node " << g->get_id(n) << " orientation " << g->get_is_reverse(n) << endl;
@@ -254,15 +270,180 @@ vector<handle_t> topological_order(const HandleGraph* g) {
         }
     }
 
+}
+
+vector<handle_t> topological_order(const HandleGraph* g) {
+    
+    // Make a vector to hold the ordered and oriented nodes.
+    vector<handle_t> sorted;
+    sorted.reserve(g->node_size());
+    
+    vector<unordered_set<id_t>> components;
+    if (omp_get_max_threads() > 1 && !omp_in_parallel()) {
+        // There are threads to spare, so we can sort the components at the
+        // same time.
+        components = weakly_connected_components(g);
+    }
+    
+    if (components.size() <= 1) {
+        // Sort the whole graph in one go.
+        vector<handle_t> nodes;
+        nodes.reserve(g->node_size());
+        g->for_each_handle([&](const handle_t& found) {
+            nodes.push_back(found);
+        });
+        topological_order_of_nodes(g, nodes, sorted, nullptr);
+        
+        // Send away our sorted ordering.
+        return sorted;
+    }
+    
+    // No edges run between components, so each component's nodes come out of
+    // the whole-graph sort in the same order as they would if we sorted it on
+    // its own. We sort them separately and then interleave them the way the
+    // whole-graph sort would have.
+    vector<vector<handle_t>> component_sorted(components.size());
+    vector<vector<uint8_t>> component_restarts(components.size());
+    
+    // Start on the big components first so they don't hold everyone up at the end.
+    vector<size_t> by_size(components.size());
+    for (size_t i = 0; i < by_size.size(); i++) {
+        by_size[i] = i;
+    }
+    stable_sort(by_size.begin(), by_size.end(), [&](size_t a, size_t b) {
+        return components[a].size() > components[b].size();
+    });
+    
+#pragma omp parallel for schedule(dynamic, 1)
+    for (size_t i = 0; i < by_size.size(); i++) {
+        size_t c = by_size[i];
+        
+        vector<handle_t> nodes;
+        nodes.reserve(components[c].size());
+        for (const id_t& id : components[c]) {
+            nodes.push_back(g->get_handle(id));
+        }
+        // We don't need the IDs anymore
+        unordered_set<id_t>().swap(components[c]);
+        
+        component_sorted[c].reserve(nodes.size());
+        component_restarts[c].reserve(nodes.size());
+        topological_order_of_nodes(g, nodes, component_sorted[c], &component_restarts[c]);
+    }
+    
+    // The whole-graph sort always takes the lowest ID node out of s, so
+    // components whose next node came out of s take turns by ID. Once they
+    // are all stuck, it restarts with the lowest ID seed in any component,
+    // and only falls back on the lowest ID unvisited node if there are no
+    // seeds left anywhere. Components are queued by the ID of their next node
+    // according to which of those cases it came from.
+    typedef pair<id_t, size_t> next_node_t;
+    typedef priority_queue<next_node_t, vector<next_node_t>, greater<next_node_t>> component_queue_t;
+    component_queue_t ready;
+    component_queue_t seeded;
+    component_queue_t arbitrary;
+    vector<size_t> cursor(components.size(), 0);
+    
+    auto enqueue = [&](size_t c) {
+        if (cursor[c] == component_sorted[c].size()) {
+            // This component is done
+            return;
+        }
+        next_node_t next(g->get_id(component_sorted[c][cursor[c]]), c);
+        switch (component_restarts[c][cursor[c]]) {
+        case 0:
+            ready.push(next);
+            break;
+        case 1:
+            seeded.push(next);
+            break;
+        default:
+            arbitrary.push(next);
+            break;
+        }
+    };
+    
+    for (size_t c = 0; c < components.size(); c++) {
+        enqueue(c);
+    }
+    
+    while (!ready.empty() || !seeded.empty() || !arbitrary.empty()) {
+        component_queue_t& source = !ready.empty() ? ready : (!seeded.empty() ? seeded : arbitrary);
+        size_t c = source.top().second;
+        source.pop();
+        
+        sorted.push_back(component_sorted[c][cursor[c]]);
+        cursor[c]++;
+        enqueue(c);
+    }
+
     // Send away our sorted ordering.
     return sorted;
 }
     
+/**
+ * The remaining inward degrees of the oriented nodes in a lazy topological
+ * sort. When the node IDs are reasonably dense, they live in a flat array
+ * indexed by ID, and otherwise in a hash table.
+ */
+class InwardDegrees {
+public:
+    
+    /// Make space for the degrees of all the nodes in the graph
+    InwardDegrees(const HandleGraph* g) {
+        id_t min_id = numeric_limits<id_t>::max();
+        id_t max_id = numeric_limits<id_t>::min();
+        g->for_each_handle([&](const handle_t& handle) {
+            id_t id = g->get_id(handle);
+            min_id = min(min_id, id);
+            max_id = max(max_id, id);
+        });
+        
+        if (g->node_size() != 0 && max_id - min_id < 2 * (id_t) g->node_size()) {
+            // An array over the ID range won't waste too much space.
+            first_id = min_id;
+            dense.resize(max_id - min_id + 1, 0);
+            dense_is_reverse.resize(dense.size(), false);
+        } else {
+            sparse.reserve(g->node_size());
+        }
+    }
+    
+    /// Set the orientation for a node and get a reference to its degree.
+    inline int64_t& orient(const HandleGraph* g, const handle_t& handle) {
+        if (dense.empty()) {
+            return sparse[handle];
+        }
+        size_t i = g->get_id(handle) - first_id;
+        dense_is_reverse[i] = g->get_is_reverse(handle);
+        return dense[i];
+    }
+    
+    /// Get a reference to the degree of an already-oriented node.
+    inline int64_t& at(const HandleGraph* g, const handle_t& handle) {
+        if (dense.empty()) {
+            auto iter = sparse.find(handle);
+            // we should never be able to reach the opposite orientation of a node
+            assert(iter != sparse.end());
+            return iter->second;
+        }
+        size_t i = g->get_id(handle) - first_id;
+        // we should never be able to reach the opposite orientation of a node
+        assert(dense_is_reverse[i] == g->get_is_reverse(handle));
+        return dense[i];
+    }
+    
+private:
+    id_t first_id = 0;
+    vector<int64_t> dense;
+    vector<bool> dense_is_reverse;
+    unordered_map<handle_t, int64_t> sparse;
+};
+    
 vector<handle_t> lazy_topological_order_internal(const HandleGraph* g, bool lazier) {
     
-    // map that will contain the orientation and the in degree for each node
-    unordered_map<handle_t, int64_t> inward_degree;
-    inward_degree.reserve(g->node_size());
+    // the orientation and the in degree for each node
+    InwardDegrees inward_degree(g);
     
     // stack for the traversal
     vector<handle_t> stack;
@@ -270,7 +451,7 @@ vector<handle_t> lazy_topological_order_internal(const HandleGraph* g, bool lazi
     if (lazier) {
         // take the locally forward orientation as a single stranded orientation
         g->for_each_handle([&](const handle_t& handle) {
-            int64_t& degree = inward_degree[handle];
+            int64_t& degree = inward_degree.orient(g, handle);
             g->follow_edges(handle, true, [&](const handle_t& ignored) {
                 degree++;
             });
@@ -291,7 +472,7 @@ vector<handle_t> lazy_topological_order_internal(const HandleGraph* g, bool lazi
         
         // compute the degrees by following the edges backward
         for (auto& handle : orientation) {
-            int64_t& degree = inward_degree[handle];
+            int64_t& degree = inward_degree.orient(g, handle);
             g->follow_edges(handle, true, [&](const handle_t& ignored) {
                 degree++;
             });
@@ -316,13 +497,10 @@ vector<handle_t> lazy_topological_order_internal(const HandleGraph* g, bool lazi
         
         // remove its outgoing edges
         g->follow_edges(here, false, [&](const handle_t& next) {
-            
-            auto iter = inward_degree.find(next);
-            // we should never be able to reach the opposite orientation of a node
-            assert(iter != inward_degree.end());
             // implicitly remove the edge
-            iter->second--;
-            if (iter->second == 0) {
+            int64_t& degree = inward_degree.at(g, next);
+            degree--;
+            if (degree == 0) {
                 // after removing this edge, the node is now a head, add it to the queue
                 stack.push_back(next);
             }
@@ -57,6 +57,10 @@ vector<handle_t> tail_nodes(const HandleGraph* g);
  *                 put an oriented m on the list of arbitrary places to start when S is empty
  *                     (This helps start at natural entry points to cycles)
  *     return L (a topologically sorted order and orientation)
+ *
+ * When run with more than one OpenMP thread available, weakly connected
+ * components are sorted in parallel and then interleaved, giving the same
+ * order as a single-threaded sort.
  */
 vector<handle_t> topological_order(const HandleGraph* g);
 
@@ -1,5 +1,8 @@
 #include "weakly_connected_components.hpp"
 
+#include <algorithm>
+#include <atomic>
+
 namespace vg {
 namespace algorithms {
 
@@ -50,5 +53,89 @@ vector<unordered_set<id_t>> weakly_connected_components(const HandleGraph* graph
     return to_return;
 }
 
+vector<size_t> weakly_connected_component_labels(const HandleGraph* graph, vector<id_t>& ids,
+                                                 size_t* component_count_out,
+                                                 const function<bool(const handle_t&, const handle_t&)>& follow_edge) {
+    
+    ids.clear();
+    ids.reserve(graph->node_size());
+    graph->for_each_handle([&](const handle_t& handle) {
+        ids.push_back(graph->get_id(handle));
+    });
+    sort(ids.begin(), ids.end());
+    
+    auto rank_of = [&](id_t id) {
+        return lower_bound(ids.begin(), ids.end(), id) - ids.begin();
+    };
+    
+    // Union-find over node ranks. Each set's root is its lowest rank, so
+    // every link points down and no cycles can form no matter how the threads
+    // race.
+    vector<atomic<size_t>> parent(ids.size());
+    for (size_t i = 0; i < ids.size(); i++) {
+        parent[i].store(i, memory_order_relaxed);
+    }
+    
+    auto find = [&](size_t i) {
+        while (true) {
+            size_t p = parent[i].load();
+            if (p == i) {
+                return i;
+            }
+            // Path halving: skip over the parent if it has moved on
+            size_t grandparent = parent[p].load();
+            if (grandparent != p) {
+                parent[i].compare_exchange_weak(p, grandparent);
+            }
+            i = grandparent;
+        }
+    };
+    
+    auto unite = [&](size_t a, size_t b) {
+        while (true) {
+            a = find(a);
+            b = find(b);
+            if (a == b) {
+                return;
+            }
+            if (a < b) {
+                swap(a, b);
+            }
+            // a is the higher root; hang it under b unless someone else moved it first
+            size_t expected = a;
+            if (parent[a].compare_exchange_strong(expected, b)) {
+                return;
+            }
+        }
+    };
+    
+    graph->for_each_handle([&](const handle_t& handle) {
+        size_t here = rank_of(graph->get_id(handle));
+        graph->follow_edges(handle, false, [&](const handle_t& next) {
+            if (!follow_edge || follow_edge(handle, next)) {
+                unite(here, rank_of(graph->get_id(next)));
+            }
+        });
+        graph->follow_edges(handle, true, [&](const handle_t& prev) {
+            if (!follow_edge || follow_edge(prev, handle)) {
+                unite(here, rank_of(graph->get_id(prev)));
+            }
+        });
+    }, true);
+    
+    // Roots come before everything in their sets, so they get numbered first
+    vector<size_t> labels(ids.size());
+    size_t component_count = 0;
+    for (size_t i = 0; i < ids.size(); i++) {
+        size_t root = find(i);
+        labels[i] = (root == i) ? component_count++ : labels[root];
+    }
+    
+    if (component_count_out) {
+        *component_count_out = component_count;
+    }
+    return labels;
+}
+
 }
 }
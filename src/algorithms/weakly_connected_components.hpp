@@ -9,6 +9,7 @@
 
 #include "../handle.hpp"
 
+#include <functional>
 #include <unordered_set>
 #include <vector>
 
@@ -24,6 +25,18 @@ using namespace std;
 /// connected component is orientation-independent.
 vector<unordered_set<id_t>> weakly_connected_components(const HandleGraph* graph);
 
+/// Finds the same components as weakly_connected_components, but as compact
+/// labels instead of sets. Fills ids with all the node IDs in the graph, in
+/// sorted order, and returns the component number of each, numbering the
+/// components from 0 in order of their lowest node IDs. Edges are processed in
+/// parallel with a concurrent union-find. If component_count_out is not null,
+/// it is set to the number of components. If follow_edge is given, only edges
+/// (from, to) for which it returns true connect nodes; lets callers find the
+/// components a graph will have after some edges are removed.
+vector<size_t> weakly_connected_component_labels(const HandleGraph* graph, vector<id_t>& ids,
+                                                 size_t* component_count_out = nullptr,
+                                                 const function<bool(const handle_t&, const handle_t&)>& follow_edge = nullptr);
+
 
 }
 }
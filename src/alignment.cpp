@@ -1,7 +1,12 @@
 #include "alignment.hpp"
 #include "stream.hpp"
 
+#include "htslib/bgzf.h"
+
+#include <cctype>
 #include <regex>
+#include <cstring>
+#include <omp.h>
 
 namespace vg {
 
@@ -158,134 +163,189 @@ bool get_next_alignment_pair_from_fastqs(gzFile fp1, gzFile fp2, char* buffer, s
     return get_next_alignment_from_fastq(fp1, buffer, len, mate1) && get_next_alignment_from_fastq(fp2, buffer, len, mate2);
 }
 
-size_t unpaired_for_each_parallel(function<bool(Alignment&)> get_read_if_available, function<void(Alignment&)> lambda) {
+/**
+ * Reads text out of a plain, gzipped, or BGZF-compressed file a large block
+ * at a time, and cuts it into FASTQ or FASTA records. Lines are found with
+ * memchr(), which scans a vector at a time, instead of going through
+ * gzgets(). BGZF blocks are decompressed in background threads.
+ */
+class FastqRecordReader {
+public:
+    /// Open the given file, or standard input for "-". Exits with an error if
+    /// the file can't be opened.
+    FastqRecordReader(const string& filename, size_t decompression_threads);
+    ~FastqRecordReader();
+    
+    FastqRecordReader(const FastqRecordReader& other) = delete;
+    FastqRecordReader& operator=(const FastqRecordReader& other) = delete;
+    
+    /// Replace the given string with the lines of the next record, separated
+    /// by newlines. Returns false if there are no more records.
+    bool next_record(string& record);
+    
+private:
+    /// Append the next line, without its newline, to the given string.
+    /// Returns false if there is no next line.
+    bool next_line(string& append_to);
+    
+    /// Move any unread text to the front of the buffer and read more after
+    /// it. Returns false if no more text could be read.
+    bool fill();
+    
+    BGZF* fp;
+    vector<char> buffer;
+    size_t cursor = 0;
+    size_t filled = 0;
+};
+
+FastqRecordReader::FastqRecordReader(const string& filename, size_t decompression_threads) : buffer(1 << 22) {
+    fp = (filename != "-") ? bgzf_open(filename.c_str(), "r") : bgzf_dopen(fileno(stdin), "r");
+    if (!fp) {
+        cerr << "[vg::alignment.cpp] couldn't open " << filename << endl; exit(1);
+    }
+    if (decompression_threads > 1 && bgzf_compression(fp) == 2) {
+        // This is BGZF, which can be decompressed in parallel.
+        bgzf_mt(fp, decompression_threads, 256);
+    }
+}
 
-    size_t nLines = 0;
-    vector<Alignment> *batch = nullptr;
-    // number of batches currently being processed
-    uint64_t batches_outstanding = 0;
-#pragma omp parallel default(none) shared(batches_outstanding, batch, nLines, get_read_if_available, lambda)
-#pragma omp single
-    {
-        
-        // number of reads in each batch
-        const uint64_t batch_size = 1 << 9; // 512
-        // max # of such batches to be holding in memory
-        uint64_t max_batches_outstanding = 1 << 9; // 512
-        // max # we will ever increase the batch buffer to
-        const uint64_t max_max_batches_outstanding = 1 << 13; // 8192
+FastqRecordReader::~FastqRecordReader() {
+    bgzf_close(fp);
+}
+
+bool FastqRecordReader::fill() {
+    // Keep what we haven't used yet
+    memmove(buffer.data(), buffer.data() + cursor, filled - cursor);
+    filled -= cursor;
+    cursor = 0;
+    
+    ssize_t got = bgzf_read(fp, buffer.data() + filled, buffer.size() - filled);
+    if (got < 0) {
+        cerr << "[vg::alignment.cpp] error: could not read fastq/fasta input" << endl; exit(1);
+    }
+    filled += got;
+    return got > 0;
+}
+
+bool FastqRecordReader::next_line(string& append_to) {
+    bool found_any = false;
+    while (true) {
+        if (cursor == filled && !fill()) {
+            // Out of file. A last line without a newline still counts.
+            return found_any;
+        }
+        found_any = true;
         
-        // alignments to hold the incoming data
-        Alignment aln;
-        // did we find the end of the file yet?
-        bool more_data = true;
+        const char* start = buffer.data() + cursor;
+        const char* newline = (const char*) memchr(start, '\n', filled - cursor);
+        if (newline != nullptr) {
+            append_to.append(start, newline - start);
+            cursor += newline - start + 1;
+            return true;
+        }
         
-        while (more_data) {
-            // init a new batch
-            batch = new std::vector<Alignment>();
-            batch->reserve(batch_size);
-            
-            // load up to the batch-size number of reads
-            for (int i = 0; i < batch_size; i++) {
-                
-                more_data = get_read_if_available(aln);
-                
-                if (more_data) {
-                    batch->emplace_back(std::move(aln));
-                    nLines++;
-                }
-                else {
-                    break;
-                }
-            }
-            
-            // did we get a batch?
-            if (batch->size()) {
-                
-                // how many batch tasks are outstanding currently, including this one?
-                uint64_t current_batches_outstanding;
-#pragma omp atomic capture
-                current_batches_outstanding = ++batches_outstanding;
-                
-                if (current_batches_outstanding >= max_batches_outstanding) {
-                    // do this batch in the current thread because we've spawned the maximum number of
-                    // concurrent batch tasks
-                    for (auto& aln : *batch) {
-                        lambda(aln);
-                    }
-                    delete batch;
-#pragma omp atomic capture
-                    current_batches_outstanding = --batches_outstanding;
-                    
-                    if (4 * current_batches_outstanding / 3 < max_batches_outstanding
-                        && max_batches_outstanding < max_max_batches_outstanding) {
-                        // we went through at least 1/4 of the batch buffer while we were doing this thread's batch
-                        // this looks risky, since we want the batch buffer to stay populated the entire time we're
-                        // occupying this thread on compute, so let's increase the batch buffer size
-                        
-                        max_batches_outstanding *= 2;
-                    }
-                }
-                else {
-                    // spawn a new task to take care of this batch
-#pragma omp task default(none) firstprivate(batch) shared(batches_outstanding, lambda)
-                    {
-                        for (auto& aln : *batch) {
-                            lambda(aln);
-                        }
-                        delete batch;
-#pragma omp atomic update
-                        batches_outstanding--;
-                    }
-                }
-            }
+        // The line goes on past the buffer
+        append_to.append(start, filled - cursor);
+        cursor = filled;
+    }
+}
+
+bool FastqRecordReader::next_record(string& record) {
+    record.clear();
+    if (!next_line(record)) {
+        return false;
+    }
+    // FASTA records are a header and a sequence; FASTQ records also have a
+    // separator and a quality line.
+    size_t lines = record.empty() || record[0] != '@' ? 2 : 4;
+    for (size_t i = 1; i < lines; i++) {
+        record.push_back('\n');
+        if (!next_line(record)) {
+            cerr << "[vg::alignment.cpp] error: incomplete fastq record" << endl; exit(1);
         }
     }
-    return nLines;
+    return true;
 }
 
-size_t paired_for_each_parallel_after_wait(function<bool(Alignment&, Alignment&)> get_pair_if_available,
-                                           function<void(Alignment&, Alignment&)> lambda,
-                                           function<bool(void)> single_threaded_until_true) {
+/// Fill in an Alignment from the text of a record from a FastqRecordReader,
+/// the same way get_next_alignment_from_fastq() would.
+static void parse_fastq_record(const string& record, Alignment& alignment) {
+    alignment.Clear();
+    
+    size_t name_end = record.find('\n');
+    size_t sequence_end = record.find('\n', name_end + 1);
+    
+    if (record[0] != '@' && record[0] != '>') {
+        throw runtime_error("Found unexpected delimiter " + record.substr(0,1) + " in fastq/fasta input");
+    }
+    // trim off leading @ and things after the first whitespace
+    // keep trailing /1 /2
+    size_t space = record.find(' ');
+    alignment.set_name(record.substr(1, space < name_end ? space : name_end - 1));
     
+    alignment.mutable_sequence()->assign(record, name_end + 1, sequence_end - name_end - 1);
+    
+    if (record[0] == '@') {
+        // Skip the "+" separator
+        size_t quality_start = record.find('\n', sequence_end + 1) + 1;
+        alignment.set_quality(string_quality_char_to_short(record.substr(quality_start)));
+    }
+}
+
+/// How many threads should decompress input while the rest map reads?
+static size_t fastq_decompression_threads() {
+    return min(max(omp_get_max_threads() / 4, 1), 4);
+}
+
+/// Run batches of records from the given source through the given function in
+/// parallel OpenMP tasks, with one thread reading the records. Until
+/// single_threaded_until_true returns true, batches are all processed in the
+/// reading thread. Returns the number of records read.
+template<typename Record>
+static size_t batches_for_each_parallel(function<bool(Record&)> get_record_if_available,
+                                        function<void(vector<Record>&)> process_batch,
+                                        function<bool(void)> single_threaded_until_true) {
     
     size_t nLines = 0;
-    vector<pair<Alignment, Alignment> > *batch = nullptr;
+    vector<Record> *batch = nullptr;
     // number of batches currently being processed
     uint64_t batches_outstanding = 0;
     
-#pragma omp parallel default(none) shared(batches_outstanding, batch, nLines, get_pair_if_available, single_threaded_until_true, lambda)
+#pragma omp parallel default(none) shared(batches_outstanding, batch, nLines, get_record_if_available, single_threaded_until_true, process_batch)
 #pragma omp single
     {
         
-        // number of pairs in each batch
+        // number of records in each batch
         const uint64_t batch_size = 1 << 9; // 512
         // max # of such batches to be holding in memory
         uint64_t max_batches_outstanding = 1 << 9; // 512
         // max # we will ever increase the batch buffer to
         const uint64_t max_max_batches_outstanding = 1 << 13; // 8192
         
-        // alignments to hold the incoming data
-        Alignment mate1, mate2;
+        // record to hold the incoming data
+        Record record;
         // did we find the end of the file yet?
         bool more_data = true;
         
         while (more_data) {
             // init a new batch
-            batch = new std::vector<pair<Alignment, Alignment>>();
+            batch = new std::vector<Record>();
             batch->reserve(batch_size);
             
-            // load up to the batch-size number of pairs
-            for (int i = 0; i < batch_size; i++) {
-                
-                more_data = get_pair_if_available(mate1, mate2);
-                
-                if (more_data) {
-                    batch->emplace_back(std::move(mate1), std::move(mate2));
-                    nLines++;
-                }
-                else {
-                    break;
+            // load up to the batch-size number of records
+            {
+                VG_TIMELINE_SPAN("read batch");
+                for (int i = 0; i < batch_size; i++) {
+                    
+                    more_data = get_record_if_available(record);
+                    
+                    if (more_data) {
+                        batch->emplace_back(std::move(record));
+                        nLines++;
+                    }
+                    else {
+                        break;
+                    }
                 }
             }
             
@@ -300,9 +360,7 @@ size_t paired_for_each_parallel_after_wait(function<bool(Alignment&, Alignment&)
                 if (current_batches_outstanding >= max_batches_outstanding || do_single_threaded) {
                     // do this batch in the current thread because we've spawned the maximum number of
                     // concurrent batch tasks or because we are directed to work in a single thread
-                    for (auto& p : *batch) {
-                        lambda(p.first, p.second);
-                    }
+                    process_batch(*batch);
                     delete batch;
 #pragma omp atomic capture
                     current_batches_outstanding = --batches_outstanding;
@@ -321,11 +379,9 @@ size_t paired_for_each_parallel_after_wait(function<bool(Alignment&, Alignment&)
                 }
                 else {
                     // spawn a new task to take care of this batch
-#pragma omp task default(none) firstprivate(batch) shared(batches_outstanding, lambda)
+#pragma omp task default(none) firstprivate(batch) shared(batches_outstanding, process_batch)
                     {
-                        for (auto& p : *batch) {
-                            lambda(p.first, p.second);
-                        }
+                        process_batch(*batch);
                         delete batch;
 #pragma omp atomic update
                         batches_outstanding--;
@@ -338,27 +394,88 @@ size_t paired_for_each_parallel_after_wait(function<bool(Alignment&, Alignment&)
     return nLines;
 }
 
+size_t unpaired_for_each_parallel(function<bool(Alignment&)> get_read_if_available, function<void(Alignment&)> lambda) {
+    function<void(vector<Alignment>&)> process_batch = [&](vector<Alignment>& batch) {
+        for (auto& aln : batch) {
+            lambda(aln);
+        }
+    };
+    return batches_for_each_parallel(get_read_if_available, process_batch, [](void) {return true;});
+}
+
+size_t paired_for_each_parallel_after_wait(function<bool(Alignment&, Alignment&)> get_pair_if_available,
+                                           function<void(Alignment&, Alignment&)> lambda,
+                                           function<bool(void)> single_threaded_until_true) {
+    function<bool(pair<Alignment, Alignment>&)> get_pair = [&](pair<Alignment, Alignment>& mates) {
+        return get_pair_if_available(mates.first, mates.second);
+    };
+    function<void(vector<pair<Alignment, Alignment>>&)> process_batch = [&](vector<pair<Alignment, Alignment>>& batch) {
+        for (auto& p : batch) {
+            lambda(p.first, p.second);
+        }
+    };
+    return batches_for_each_parallel(get_pair, process_batch, single_threaded_until_true);
+}
+
+/// Process FASTQ records from the given reader in parallel, parsing them in
+/// the worker threads rather than the reading thread.
+static size_t fastq_unpaired_for_each_parallel(FastqRecordReader& reader, function<void(Alignment&)> lambda) {
+    function<bool(string&)> get_record = [&](string& record) {
+        return reader.next_record(record);
+    };
+    function<void(vector<string>&)> process_batch = [&](vector<string>& batch) {
+        // Reuse one Alignment, and its allocated fields, for the whole batch
+        Alignment aln;
+        for (auto& record : batch) {
+            parse_fastq_record(record, aln);
+            lambda(aln);
+        }
+    };
+    return batches_for_each_parallel(get_record, process_batch, [](void) {return true;});
+}
+
+/// Process pairs of FASTQ records in parallel, parsing them in the worker
+/// threads. Each mate is read from the corresponding reader, which may be the
+/// same reader for interleaved input.
+static size_t fastq_paired_for_each_parallel_after_wait(FastqRecordReader& reader1, FastqRecordReader& reader2,
+                                                        function<void(Alignment&, Alignment&)> lambda,
+                                                        function<bool(void)> single_threaded_until_true) {
+    function<bool(pair<string, string>&)> get_pair = [&](pair<string, string>& records) {
+        return reader1.next_record(records.first) && reader2.next_record(records.second);
+    };
+    function<void(vector<pair<string, string>>&)> process_batch = [&](vector<pair<string, string>>& batch) {
+        Alignment mate1, mate2;
+        for (auto& records : batch) {
+            parse_fastq_record(records.first, mate1);
+            parse_fastq_record(records.second, mate2);
+            lambda(mate1, mate2);
+        }
+    };
+    return batches_for_each_parallel(get_pair, process_batch, single_threaded_until_true);
+}
+
 size_t fastq_unpaired_for_each_parallel(const string& filename, function<void(Alignment&)> lambda) {
-    
-    gzFile fp = (filename != "-") ? gzopen(filename.c_str(), "r") : gzdopen(fileno(stdin), "r");
-    if (!fp) {
-        cerr << "[vg::alignment.cpp] couldn't open " << filename << endl; exit(1);
-    }
-    
-    size_t len = 2 << 22; // 4M
-    char* buf = new char[len];
-    
-    function<bool(Alignment&)> get_read = [&](Alignment& aln) {
-        return get_next_alignment_from_fastq(fp, buf, len, aln);;
+    FastqRecordReader reader(filename, fastq_decompression_threads());
+    return fastq_unpaired_for_each_parallel(reader, lambda);
+}
+
+size_t fastq_unpaired_for_each_batch_parallel(const string& filename, function<void(vector<Alignment>&)> lambda) {
+    FastqRecordReader reader(filename, fastq_decompression_threads());
+    function<bool(string&)> get_record = [&](string& record) {
+        return reader.next_record(record);
     };
-    
-    
-    size_t nLines = unpaired_for_each_parallel(get_read, lambda);
-    
-    delete[] buf;
-    gzclose(fp);
-    return nLines;
-    
+    function<void(vector<string>&)> process_batch = [&](vector<string>& batch) {
+        vector<Alignment> alns(batch.size());
+        {
+            VG_TIMELINE_SPAN("parse batch");
+            for (size_t i = 0; i < batch.size(); i++) {
+                parse_fastq_record(batch[i], alns[i]);
+            }
+        }
+        VG_TIMELINE_SPAN("process batch");
+        lambda(alns);
+    };
+    return batches_for_each_parallel(get_record, process_batch, [](void) {return true;});
 }
 
 size_t fastq_paired_interleaved_for_each_parallel(const string& filename, function<void(Alignment&, Alignment&)> lambda) {
@@ -372,52 +489,16 @@ size_t fastq_paired_two_files_for_each_parallel(const string& file1, const strin
 size_t fastq_paired_interleaved_for_each_parallel_after_wait(const string& filename,
                                                              function<void(Alignment&, Alignment&)> lambda,
                                                              function<bool(void)> single_threaded_until_true) {
-    
-    gzFile fp = (filename != "-") ? gzopen(filename.c_str(), "r") : gzdopen(fileno(stdin), "r");
-    if (!fp) {
-        cerr << "[vg::alignment.cpp] couldn't open " << filename << endl; exit(1);
-    }
-    
-    size_t len = 1 << 18; // 256k
-    char* buf = new char[len];
-    
-    function<bool(Alignment&, Alignment&)> get_pair = [&](Alignment& mate1, Alignment& mate2) {
-        return get_next_interleaved_alignment_pair_from_fastq(fp, buf, len, mate1, mate2);
-    };
-    
-    size_t nLines = paired_for_each_parallel_after_wait(get_pair, lambda, single_threaded_until_true);
-    
-    delete[] buf;
-    gzclose(fp);
-    return nLines;
+    FastqRecordReader reader(filename, fastq_decompression_threads());
+    return fastq_paired_for_each_parallel_after_wait(reader, reader, lambda, single_threaded_until_true);
 }
     
 size_t fastq_paired_two_files_for_each_parallel_after_wait(const string& file1, const string& file2,
                                                            function<void(Alignment&, Alignment&)> lambda,
                                                            function<bool(void)> single_threaded_until_true) {
-    
-    gzFile fp1 = (file1 != "-") ? gzopen(file1.c_str(), "r") : gzdopen(fileno(stdin), "r");
-    if (!fp1) {
-        cerr << "[vg::alignment.cpp] couldn't open " << file1 << endl; exit(1);
-    }
-    gzFile fp2 = (file2 != "-") ? gzopen(file2.c_str(), "r") : gzdopen(fileno(stdin), "r");
-    if (!fp2) {
-        cerr << "[vg::alignment.cpp] couldn't open " << file2 << endl; exit(1);
-    }
-    
-    size_t len = 1 << 18; // 256k
-    char* buf = new char[len];
-    
-    function<bool(Alignment&, Alignment&)> get_pair = [&](Alignment& mate1, Alignment& mate2) {
-        return get_next_alignment_pair_from_fastqs(fp1, fp2, buf, len, mate1, mate2);
-    };
-    
-    size_t nLines = paired_for_each_parallel_after_wait(get_pair, lambda, single_threaded_until_true);
-    
-    delete[] buf;
-    gzclose(fp1);
-    gzclose(fp2);
-    return nLines;
+    FastqRecordReader reader1(file1, fastq_decompression_threads());
+    FastqRecordReader reader2(file2, fastq_decompression_threads());
+    return fastq_paired_for_each_parallel_after_wait(reader1, reader2, lambda, single_threaded_until_true);
 }
 
 size_t fastq_unpaired_for_each(const string& filename, function<void(Alignment&)> lambda) {
@@ -579,6 +660,18 @@ string string_quality_char_to_short(const string& quality) {
     return buffer;
 }
 
+// Get the name to give a read in SAM/BAM output.
+static string sam_read_name(const Alignment& alignment, bool paired) {
+    const string& name = alignment.name();
+    if (paired && name.size() >= 2 && (name[name.size() - 2] == '/' || name[name.size() - 2] == '_')
+        && (name.back() == '1' || name.back() == '2')) {
+        // We need to strip the /1 and /2 or _1 and _2 from paired reads so the two ends have the same name.
+        return name.substr(0, name.size() - 2);
+    }
+    // Keep the alignment name as is because even if the name looks paired, the reads are semantically unpaired.
+    return name;
+}
+
 // Internal conversion function for both paired and unpaired codepaths
 string alignment_to_sam_internal(const Alignment& alignment,
                                  const string& refseq,
@@ -612,14 +705,7 @@ string alignment_to_sam_internal(const Alignment& alignment,
     
     stringstream sam;
     
-    string alignment_name;
-    if (paired) {
-        // We need to strip the /1 and /2 or _1 and _2 from paired reads so the two ends have the same name.
-        alignment_name = regex_replace(alignment.name(), regex("[/_][12]$"), "");
-    } else {
-        // Keep the alignment name as is because even if the name looks paired, the reads are semantically unpaired.
-        alignment_name = alignment.name();
-    }
+    string alignment_name = sam_read_name(alignment, paired);
     
     sam << (!alignment_name.empty() ? alignment_name : "*") << "\t"
         << flags << "\t"
@@ -673,7 +759,134 @@ string alignment_to_sam(const Alignment& alignment,
 
 }
 
-// Internal conversion function for both paired and unpaired codepaths
+// Internal conversion function for both paired and unpaired codepaths.
+// Builds the record directly, without going through SAM text.
+bam1_t* alignment_to_bam_internal(const bam_hdr_t* header,
+                                  const Alignment& alignment,
+                                  const string& refseq,
+                                  const int32_t refpos,
+                                  const bool refrev,
+                                  const string& cigar,
+                                  const string& mateseq,
+                                  const int32_t matepos,
+                                  const int32_t tlen,
+                                  bool paired) {
+    
+    assert(header != nullptr);
+    
+    // Determine flags, using orientation, next/prev fragments, and pairing status.
+    int32_t flags = sam_flag(alignment, refrev, paired);
+    bool mapped = !(flags & BAM_FUNMAP);
+    
+    if (mapped) {
+        // Make sure we have everything
+        assert(!refseq.empty());
+        assert(refpos != -1);
+        assert(!cigar.empty());
+        assert(alignment.has_path());
+        assert(alignment.path().mapping_size() > 0);
+    }
+    assert((bool)(flags & BAM_FUNMAP) != (alignment.has_path() && alignment.path().mapping_size()));
+    
+    // Parse the CIGAR string into BAM operations
+    vector<uint32_t> cigar_ops;
+    if (mapped) {
+        uint32_t length = 0;
+        for (char c : cigar) {
+            if (isdigit(c)) {
+                length = length * 10 + (c - '0');
+            } else {
+                // BAM_CIGAR_STR is the operations in the order of their codes
+                const char* op = strchr(BAM_CIGAR_STR, c);
+                if (op == nullptr || c == '\0') {
+                    cerr << "[vg::alignment] Unknown CIGAR operation " << c << " in " << cigar << endl;
+                    exit(1);
+                }
+                cigar_ops.push_back(bam_cigar_gen(length, op - BAM_CIGAR_STR));
+                length = 0;
+            }
+        }
+    }
+    
+    string name = sam_read_name(alignment, paired);
+    if (name.empty()) {
+        name = "*";
+    }
+    // Names are stored NUL-terminated and padded with NULs to keep the CIGAR aligned
+    size_t name_length = name.size() + 1;
+    size_t extra_nuls = (4 - name_length % 4) % 4;
+    if (name_length + extra_nuls > 255) {
+        cerr << "[vg::alignment] Read name " << name << " is too long for BAM" << endl;
+        exit(1);
+    }
+    
+    // Sequence and quality always come out in reference forward orientation
+    const string& sequence = alignment.sequence();
+    size_t seq_length = sequence.size();
+    
+    bam1_t* b = bam_init1();
+    bam1_core_t& core = b->core;
+    core.tid = mapped ? bam_name2id(const_cast<bam_hdr_t*>(header), refseq.c_str()) : -1;
+    core.pos = refpos;
+    core.qual = mapped ? alignment.mapping_quality() : 0;
+    core.l_qname = name_length + extra_nuls;
+    core.l_extranul = extra_nuls;
+    core.flag = flags;
+    core.n_cigar = cigar_ops.size();
+    core.l_qseq = seq_length;
+    core.mtid = mateseq.empty() ? -1 : bam_name2id(const_cast<bam_hdr_t*>(header), mateseq.c_str());
+    core.mpos = matepos;
+    core.isize = tlen;
+    // Unmapped reads are binned as if they covered one base, like htslib's SAM parser does
+    core.bin = hts_reg2bin(core.pos, core.pos + (mapped ? bam_cigar2rlen(core.n_cigar, cigar_ops.data()) : 1), 14, 5);
+    
+    size_t data_length = core.l_qname + 4 * core.n_cigar + (seq_length + 1) / 2 + seq_length;
+    b->data = (uint8_t*) malloc(data_length);
+    b->m_data = data_length;
+    b->l_data = data_length;
+    
+    uint8_t* data = b->data;
+    memcpy(data, name.c_str(), name_length);
+    memset(data + name_length, 0, extra_nuls);
+    data += core.l_qname;
+    
+    if (!cigar_ops.empty()) {
+        memcpy(data, cigar_ops.data(), 4 * cigar_ops.size());
+        data += 4 * cigar_ops.size();
+    }
+    
+    // Pack the bases two to a byte
+    memset(data, 0, (seq_length + 1) / 2);
+    for (size_t i = 0; i < seq_length; i++) {
+        char base = refrev ? reverse_complement(sequence[seq_length - i - 1]) : sequence[i];
+        data[i / 2] |= seq_nt16_table[(unsigned char) base] << ((~i & 1) << 2);
+    }
+    data += (seq_length + 1) / 2;
+    
+    // Qualities are stored raw, or as all 0xff if missing
+    const string& quality = alignment.quality();
+    if (quality.empty()) {
+        memset(data, 0xff, seq_length);
+    } else {
+        if (quality.size() != seq_length) {
+            cerr << "[vg::alignment] Read " << name << " has " << quality.size() << " qualities for "
+                 << seq_length << " bases" << endl;
+            exit(1);
+        }
+        for (size_t i = 0; i < seq_length; i++) {
+            data[i] = refrev ? quality[seq_length - i - 1] : quality[i];
+        }
+    }
+    
+    if (!alignment.read_group().empty()) {
+        const string& read_group = alignment.read_group();
+        bam_aux_append(b, "RG", 'Z', read_group.size() + 1, (uint8_t*) read_group.c_str());
+    }
+    
+    return b;
+}
+
+// Internal conversion function for callers that only have the header text
 bam1_t* alignment_to_bam_internal(const string& sam_header,
                                   const Alignment& alignment,
                                   const string& refseq,
@@ -687,22 +900,15 @@ bam1_t* alignment_to_bam_internal(const string& sam_header,
 
     assert(!sam_header.empty());
     
-    // Make a tiny SAM file. Remember to URL-encode it, since it may contain '%'
-    string sam_file = "data:," + percent_url_encode(sam_header +
-        alignment_to_sam_internal(alignment, refseq, refpos, refrev, cigar, mateseq, matepos, tlen, paired));
-    const char* sam = sam_file.c_str();
-    samFile *in = sam_open(sam, "r");
-    bam_hdr_t *header = sam_hdr_read(in);
-    bam1_t *aln = bam_init1();
-    if (sam_read1(in, header, aln) >= 0) {
-        bam_hdr_destroy(header);
-        sam_close(in); // clean up
-        return aln;
-    } else {
-        cerr << "[vg::alignment] Failure to parse SAM record" << endl
-             << sam << endl;
+    bam_hdr_t* header = sam_hdr_parse(sam_header.size(), sam_header.c_str());
+    if (header == nullptr) {
+        cerr << "[vg::alignment] Failure to parse SAM header" << endl
+             << sam_header << endl;
         exit(1);
     }
+    bam1_t* aln = alignment_to_bam_internal(header, alignment, refseq, refpos, refrev, cigar, mateseq, matepos, tlen, paired);
+    bam_hdr_destroy(header);
+    return aln;
 }
 
 bam1_t* alignment_to_bam(const string& sam_header,
@@ -730,6 +936,31 @@ bam1_t* alignment_to_bam(const string& sam_header,
 
 }
 
+bam1_t* alignment_to_bam(const bam_hdr_t* header,
+                        const Alignment& alignment,
+                        const string& refseq,
+                        const int32_t refpos,
+                        const bool refrev,
+                        const string& cigar,
+                        const string& mateseq,
+                        const int32_t matepos,
+                        const int32_t tlen) {
+    
+    return alignment_to_bam_internal(header, alignment, refseq, refpos, refrev, cigar, mateseq, matepos, tlen, true);
+
+}
+
+bam1_t* alignment_to_bam(const bam_hdr_t* header,
+                        const Alignment& alignment,
+                        const string& refseq,
+                        const int32_t refpos,
+                        const bool refrev,
+                        const string& cigar) {
+    
+    return alignment_to_bam_internal(header, alignment, refseq, refpos, refrev, cigar, "", -1, 0, false);
+
+}
+
 string cigar_string(vector<pair<int, char> >& cigar) {
     vector<pair<int, char> > cigar_comp;
     pair<int, char> cur = make_pair(0, '\0');
@@ -1048,63 +1279,90 @@ int alignment_from_length(const Alignment& a) {
     return l;
 }
 
+/// Clear everything but the name, score, sequence, and path, which are all a
+/// stripped alignment keeps. The kept fields are moved, not copied.
+static void clear_all_but_stripped_fields(Alignment* aln) {
+    string name;
+    string sequence;
+    name.swap(*aln->mutable_name());
+    sequence.swap(*aln->mutable_sequence());
+    auto score = aln->score();
+    Path* path = aln->has_path() ? aln->release_path() : nullptr;
+    aln->Clear();
+    aln->mutable_name()->swap(name);
+    aln->mutable_sequence()->swap(sequence);
+    aln->set_score(score);
+    if (path) {
+        aln->set_allocated_path(path);
+    }
+}
+
 Alignment strip_from_start(const Alignment& aln, size_t drop) {
-    if (!drop) return aln;
-    Alignment res;
-    res.set_name(aln.name());
-    res.set_score(aln.score());
-    res.set_sequence(aln.sequence().substr(drop));
-    if (!aln.has_path()) return res;
-    *res.mutable_path() = cut_path(aln.path(), drop).second;
-    assert(res.has_path());
-    if (alignment_to_length(res) != res.sequence().size()) {
+    Alignment res = aln;
+    strip_from_start_in_place(&res, drop);
+    return res;
+}
+
+Alignment strip_from_end(const Alignment& aln, size_t drop) {
+    Alignment res = aln;
+    strip_from_end_in_place(&res, drop);
+    return res;
+}
+
+void strip_from_start_in_place(Alignment* aln, size_t drop) {
+    if (!drop) return;
+    clear_all_but_stripped_fields(aln);
+    if (drop > aln->sequence().size()) {
+        throw out_of_range("cannot strip " + to_string(drop) + " bases from an alignment of " +
+                           to_string(aln->sequence().size()));
+    }
+    aln->mutable_sequence()->erase(0, drop);
+    if (!aln->has_path()) return;
+    keep_path_after(aln->mutable_path(), drop);
+    if (alignment_to_length(*aln) != aln->sequence().size()) {
         cerr << "failed!!! drop from start 轰" << endl;
-        cerr << "drop " << drop << " from start" << endl << pb2json(aln) << endl;
-        cerr << "wanted " << aln.sequence().size() - drop << " got " << alignment_to_length(res) << endl;
-        cerr << pb2json(res) << endl << endl;
+        cerr << "drop " << drop << " from start" << endl;
+        cerr << "wanted " << aln->sequence().size() << " got " << alignment_to_length(*aln) << endl;
+        cerr << pb2json(*aln) << endl << endl;
         assert(false);
     }
-    return res;
 }
 
-Alignment strip_from_end(const Alignment& aln, size_t drop) {
-    if (!drop) return aln;
-    Alignment res;
-    res.set_name(aln.name());
-    res.set_score(aln.score());
-    //cerr << "drop " << drop << " from end" << endl;
-    size_t cut_at = aln.sequence().size()-drop;
-    //cerr << "Cut at " << cut_at << endl;
-    res.set_sequence(aln.sequence().substr(0, cut_at));
-    if (!aln.has_path()) return res;
-    *res.mutable_path() = cut_path(aln.path(), cut_at).first;
-    assert(res.has_path());
-    if (alignment_to_length(res) != res.sequence().size()) {
+void strip_from_end_in_place(Alignment* aln, size_t drop) {
+    if (!drop) return;
+    clear_all_but_stripped_fields(aln);
+    size_t cut_at = aln->sequence().size()-drop;
+    if (cut_at < aln->sequence().size()) {
+        aln->mutable_sequence()->resize(cut_at);
+    }
+    if (!aln->has_path()) return;
+    keep_path_before(aln->mutable_path(), cut_at);
+    if (alignment_to_length(*aln) != aln->sequence().size()) {
         cerr << "failed!!! drop from end 轰" << endl;
-        cerr << pb2json(res) << endl << endl;
+        cerr << pb2json(*aln) << endl << endl;
         assert(false);
     }
-    return res;
 }
 
 Alignment trim_alignment(const Alignment& aln, const Position& pos1, const Position& pos2) {
-    // cut the alignment into 3 (possibly empty) pieces
-    auto p = cut_path(aln.path(), pos1);
-    auto path1 = p.first;
-    p = cut_path(p.second, pos2);
-    auto path2 = p.first;
-    auto path3 = p.second;
-    // measure the length of the left and right bits, and use this to trim the current alignment
     auto trimmed = aln;
-    if (path1.mapping_size()) {
-        trimmed = strip_from_start(trimmed, path_to_length(path1));
-    }
-    if (path3.mapping_size()) {
-        trimmed = strip_from_end(trimmed, path_to_length(path3));
-    }
+    trim_alignment_in_place(&trimmed, pos1, pos2);
     return trimmed;
 }
 
+void trim_alignment_in_place(Alignment* aln, const Position& pos1, const Position& pos2) {
+    // cut the alignment's path into 3 (possibly empty) pieces
+    auto p = cut_path(aln->path(), pos1);
+    auto& path1 = p.first;
+    auto q = cut_path(p.second, pos2);
+    auto& path3 = q.second;
+    // measure the length of the left and right bits, and use this to trim the current alignment
+    size_t left = path1.mapping_size() ? path_to_length(path1) : 0;
+    size_t right = path3.mapping_size() ? path_to_length(path3) : 0;
+    strip_from_start_in_place(aln, left);
+    strip_from_end_in_place(aln, right);
+}
+
 vector<Alignment> alignment_ends(const Alignment& aln, size_t len1, size_t len2) {
     vector<Alignment> ends;
     ends.push_back(strip_from_end(aln, aln.sequence().size()-len1));
@@ -1172,41 +1430,44 @@ Alignment merge_alignments(const vector<Alignment>& alns) {
 
     // execute a serial merge
     // buliding up the alignment
-    Alignment merged;
-    merged.set_name(alns.front().name());
+    Alignment merged = alns.front();
 
     size_t len = 0;
     for (size_t i = 0; i < alns.size(); ++i) {
         len += alns[i].sequence().size();
     }
     merged.mutable_sequence()->reserve(len);
-    if (alns.front().quality().size()) merged.mutable_quality()->reserve(len);
+    if (!merged.quality().empty()) merged.mutable_quality()->reserve(len);
 
-    // get the alignments ready for merge
-    for (size_t i = 0; i < alns.size(); ++i) {
-        Alignment aln = alns[i];
-        if (!aln.has_path()) {
-            Mapping m;
-            Edit* e = m.add_edit();
-            e->set_to_length(aln.sequence().size());
-            e->set_sequence(aln.sequence());
-            *aln.mutable_path()->add_mapping() = m;
-        }
-        if (i == 0) {
-            merged = aln;
-        } else {
-            if (!merged.quality().empty()) merged.mutable_quality()->append(aln.quality());
-            extend_path(*merged.mutable_path(), aln.path());
-            merged.mutable_sequence()->append(aln.sequence());
+    // an alignment without a path gets merged in as a softclip
+    Path softclip;
+    auto path_for = [&](const Alignment& aln) -> const Path& {
+        if (aln.has_path()) {
+            return aln.path();
         }
+        softclip.clear_mapping();
+        Edit* e = softclip.add_mapping()->add_edit();
+        e->set_to_length(aln.sequence().size());
+        e->set_sequence(aln.sequence());
+        return softclip;
+    };
+    if (!merged.has_path()) {
+        *merged.mutable_path() = path_for(merged);
+    }
+
+    for (size_t i = 1; i < alns.size(); ++i) {
+        auto& aln = alns[i];
+        if (!merged.quality().empty()) merged.mutable_quality()->append(aln.quality());
+        extend_path(*merged.mutable_path(), path_for(aln));
+        merged.mutable_sequence()->append(aln.sequence());
     }
     return merged;
 }
 
 Alignment& extend_alignment(Alignment& a1, const Alignment& a2, bool debug) {
     //if (debug) cerr << "extending alignment " << endl << pb2json(a1) << endl << pb2json(a2) << endl;
-    a1.set_sequence(a1.sequence() + a2.sequence());
-    if (!a1.quality().empty()) a1.set_quality(a1.quality() + a2.quality());
+    a1.mutable_sequence()->append(a2.sequence());
+    if (!a1.quality().empty()) a1.mutable_quality()->append(a2.quality());
     extend_path(*a1.mutable_path(), a2.path());
     //if (debug) cerr << "extended alignments, result is " << endl << pb2json(a1) << endl;
     return a1;
@@ -1358,13 +1619,19 @@ const string hash_alignment(const Alignment& aln) {
 
 Alignment simplify(const Alignment& a, bool trim_internal_deletions) {
     auto aln = a;
-    *aln.mutable_path() = simplify(aln.path(), trim_internal_deletions);
-    if (!aln.path().mapping_size()) {
-        aln.clear_path();
-    }
+    simplify_in_place(&aln, trim_internal_deletions);
     return aln;
 }
 
+void simplify_in_place(Alignment* a, bool trim_internal_deletions) {
+    Path simplified = simplify(a->path(), trim_internal_deletions);
+    if (simplified.mapping_size()) {
+        a->mutable_path()->Swap(&simplified);
+    } else {
+        a->clear_path();
+    }
+}
+
 void write_alignment_to_file(const Alignment& aln, const string& filename) {
     ofstream out(filename);
     vector<Alignment> alnz = { aln };
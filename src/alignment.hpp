@@ -35,6 +35,11 @@ size_t fastq_paired_two_files_for_each(const string& file1, const string& file2,
 size_t fastq_unpaired_for_each_parallel(const string& filename,
                                         function<void(Alignment&)> lambda);
     
+// Like fastq_unpaired_for_each_parallel, but hands over whole batches of reads
+// at once, so that the callback can share work between them.
+size_t fastq_unpaired_for_each_batch_parallel(const string& filename,
+                                              function<void(vector<Alignment>&)> lambda);
+    
 size_t fastq_paired_interleaved_for_each_parallel(const string& filename,
                                                   function<void(Alignment&, Alignment&)> lambda);
     
@@ -101,6 +106,36 @@ bam1_t* alignment_to_bam(const string& sam_header,
                         const bool refrev,
                         const string& cigar);
                          
+/**
+ * Convert a paired Alignment to a BAM record, against a parsed header, without
+ * going through SAM text. Otherwise the same as the version that takes the
+ * header text, which has to parse the header every time.
+ *
+ * Remember to clean up with bam_destroy1(b);
+ */
+bam1_t* alignment_to_bam(const bam_hdr_t* header,
+                         const Alignment& alignment,
+                         const string& refseq,
+                         const int32_t refpos,
+                         const bool refrev,
+                         const string& cigar,
+                         const string& mateseq,
+                         const int32_t matepos,
+                         const int32_t tlen);
+
+/**
+ * Convert an unpaired Alignment to a BAM record, against a parsed header,
+ * without going through SAM text.
+ *
+ * Remember to clean up with bam_destroy1(b);
+ */
+bam1_t* alignment_to_bam(const bam_hdr_t* header,
+                         const Alignment& alignment,
+                         const string& refseq,
+                         const int32_t refpos,
+                         const bool refrev,
+                         const string& cigar);
+                         
 /**
  * Convert a paired Alignment to a SAM record. If the alignment is unmapped,
  * refpos must be -1. Otherwise, refpos must be the position on the reference
@@ -153,6 +188,12 @@ Alignment merge_alignments(const Alignment& a1, const Alignment& a2, bool debug=
 Alignment strip_from_start(const Alignment& aln, size_t drop);
 Alignment strip_from_end(const Alignment& aln, size_t drop);
 Alignment trim_alignment(const Alignment& aln, const Position& pos1, const Position& pos2);
+/// Versions of the above that change the given alignment instead of copying
+/// it, reusing its string and mapping storage. Like the copying versions,
+/// anything that gets stripped keeps only its name, score, sequence, and path.
+void strip_from_start_in_place(Alignment* aln, size_t drop);
+void strip_from_end_in_place(Alignment* aln, size_t drop);
+void trim_alignment_in_place(Alignment* aln, const Position& pos1, const Position& pos2);
 vector<Alignment> alignment_ends(const Alignment& aln, size_t len1, size_t len2);
 Alignment alignment_middle(const Alignment& aln, int len);
 // generate a digest of the alignmnet
@@ -191,6 +232,9 @@ void flip_nodes(Alignment& a, const set<int64_t>& ids, const std::function<size_
 /// the start and end of Mappings, so code that handles simplified Alignments
 /// needs to handle offsets on internal Mappings.
 Alignment simplify(const Alignment& a, bool trim_internal_deletions = true);
+/// Simplifies the Path in the Alignment in place, without copying the rest of
+/// the Alignment.
+void simplify_in_place(Alignment* a, bool trim_internal_deletions = true);
 
 // quality information; a kind of poor man's pileup
 map<id_t, int> alignment_quality_per_node(const Alignment& aln);
@@ -0,0 +1,151 @@
+#include "alignment_stats.hpp"
+#include "stream.hpp"
+
+#include <set>
+
+#include <omp.h>
+
+/**
+ * \file alignment_stats.cpp: implementation of mergeable Alignment statistics
+ */
+
+namespace vg {
+
+using namespace std;
+
+AlignmentStats::AlignmentStats(bool record_edits, const map<id_t, pair<string, string>>* allele_path_for_node) :
+    record_edits(record_edits), allele_path_for_node(allele_path_for_node) {
+    // nothing to do
+}
+
+AlignmentStats AlignmentStats::empty_copy() const {
+    return AlignmentStats(record_edits, allele_path_for_node);
+}
+
+void AlignmentStats::add(const Alignment& aln) {
+    total_alignments++;
+    if (aln.is_secondary()) {
+        total_secondary++;
+        return;
+    }
+
+    total_primary++;
+    if (aln.score() > 0) {
+        // We only count aligned primary reads in "total aligned"; the primary
+        // can't be unaligned if the secondary is aligned.
+        total_aligned++;
+    }
+
+    // Which sites and alleles does this read support. TODO: if we hit unique
+    // nodes from multiple alleles of the same site, we should... do
+    // something. Discard the read? Not just count it on both sides like we do
+    // now.
+    set<pair<string, string>> alleles_supported;
+
+    auto& path = aln.path();
+    for (size_t i = 0; i < path.mapping_size(); i++) {
+        auto& mapping = path.mapping(i);
+        id_t node_id = mapping.position().node_id();
+
+        if (allele_path_for_node != nullptr) {
+            auto found = allele_path_for_node->find(node_id);
+            if (found != allele_path_for_node->end()) {
+                // We hit a unique node for this allele. Add it to the set, in
+                // case we hit another unique node for it later in the read.
+                alleles_supported.insert(found->second);
+            }
+        }
+
+        node_visit_counts[node_id]++;
+
+        for (size_t j = 0; j < mapping.edit_size(); j++) {
+            // Go through edits and look for each type.
+            auto& edit = mapping.edit(j);
+
+            if (edit.to_length() > edit.from_length()) {
+                if ((j == 0 && i == 0) || (j == mapping.edit_size() - 1 && i == path.mapping_size() - 1)) {
+                    // We're at the very end of the path, so this is a soft clip.
+                    total_softclipped_bases += edit.to_length() - edit.from_length();
+                    total_softclips++;
+                    if (record_edits) {
+                        softclips.push_back(make_pair(node_id, edit));
+                    }
+                } else {
+                    total_inserted_bases += edit.to_length() - edit.from_length();
+                    total_insertions++;
+                    if (record_edits) {
+                        insertions.push_back(make_pair(node_id, edit));
+                    }
+                }
+            } else if (edit.from_length() > edit.to_length()) {
+                total_deleted_bases += edit.from_length() - edit.to_length();
+                total_deletions++;
+                if (record_edits) {
+                    deletions.push_back(make_pair(node_id, edit));
+                }
+            } else if (!edit.sequence().empty()) {
+                // TODO: a substitution might also occur as part of a
+                // deletion/insertion above!
+                total_substituted_bases += edit.from_length();
+                total_substitutions++;
+                if (record_edits) {
+                    substitutions.push_back(make_pair(node_id, edit));
+                }
+            }
+        }
+    }
+
+    for (auto& site_and_allele : alleles_supported) {
+        // This read is informative for an allele of a site.
+        reads_on_allele[site_and_allele.first][site_and_allele.second]++;
+    }
+}
+
+void AlignmentStats::merge(const AlignmentStats& other) {
+    total_alignments += other.total_alignments;
+    total_aligned += other.total_aligned;
+    total_primary += other.total_primary;
+    total_secondary += other.total_secondary;
+
+    for (auto& id_and_count : other.node_visit_counts) {
+        node_visit_counts[id_and_count.first] += id_and_count.second;
+    }
+
+    total_insertions += other.total_insertions;
+    total_inserted_bases += other.total_inserted_bases;
+    total_deletions += other.total_deletions;
+    total_deleted_bases += other.total_deleted_bases;
+    total_substitutions += other.total_substitutions;
+    total_substituted_bases += other.total_substituted_bases;
+    total_softclips += other.total_softclips;
+    total_softclipped_bases += other.total_softclipped_bases;
+
+    insertions.insert(insertions.end(), other.insertions.begin(), other.insertions.end());
+    deletions.insert(deletions.end(), other.deletions.begin(), other.deletions.end());
+    substitutions.insert(substitutions.end(), other.substitutions.begin(), other.substitutions.end());
+    softclips.insert(softclips.end(), other.softclips.begin(), other.softclips.end());
+
+    for (auto& site_and_alleles : other.reads_on_allele) {
+        auto& ours = reads_on_allele[site_and_alleles.first];
+        for (auto& allele_and_count : site_and_alleles.second) {
+            ours[allele_and_count.first] += allele_and_count.second;
+        }
+    }
+}
+
+AlignmentStats accumulate_alignment_stats(istream& in, const AlignmentStats& prototype) {
+    vector<AlignmentStats> thread_stats(omp_get_max_threads(), prototype.empty_copy());
+
+    function<void(Alignment&)> lambda = [&](Alignment& aln) {
+        thread_stats[omp_get_thread_num()].add(aln);
+    };
+    stream::for_each_parallel(in, lambda);
+
+    AlignmentStats total = prototype;
+    for (auto& stats : thread_stats) {
+        total.merge(stats);
+    }
+    return total;
+}
+
+}
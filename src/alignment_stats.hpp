@@ -0,0 +1,92 @@
+#ifndef VG_ALIGNMENT_STATS_HPP_INCLUDED
+#define VG_ALIGNMENT_STATS_HPP_INCLUDED
+
+/** \file
+ * Mergeable accumulators for summary statistics over a set of Alignments, so
+ * each thread can count its own reads and the totals can be put together once
+ * at the end.
+ */
+
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "vg.pb.h"
+#include "types.hpp"
+#include "hash_map.hpp"
+
+namespace vg {
+
+using namespace std;
+
+/**
+ * Counts of reads, node visits, edits, and allele support for some
+ * Alignments. Nothing is shared between AlignmentStats objects, so different
+ * threads can each add to their own, and then merge them.
+ */
+class AlignmentStats {
+public:
+
+    /// Make empty stats. If record_edits is set, every insertion, deletion,
+    /// substitution, and softclip is kept along with the node it was on. If
+    /// allele_path_for_node is set, it maps the nodes unique to each allele
+    /// path to that path's site and allele names, and it must outlive this
+    /// object and anything it is merged into.
+    AlignmentStats(bool record_edits = false,
+                   const map<id_t, pair<string, string>>* allele_path_for_node = nullptr);
+
+    /// Count one Alignment.
+    void add(const Alignment& aln);
+
+    /// Add in all the counts from another AlignmentStats. Recorded edits from
+    /// the other stats go after ours.
+    void merge(const AlignmentStats& other);
+
+    /// Make another empty AlignmentStats with the same settings as this one.
+    AlignmentStats empty_copy() const;
+
+    size_t total_alignments = 0;
+    size_t total_aligned = 0;
+    size_t total_primary = 0;
+    size_t total_secondary = 0;
+
+    /// How many times primary alignments visit each node.
+    hash_map<id_t, size_t> node_visit_counts;
+
+    // Inserted bases don't count softclips, which are kept separately.
+    size_t total_insertions = 0;
+    size_t total_inserted_bases = 0;
+    size_t total_deletions = 0;
+    size_t total_deleted_bases = 0;
+    size_t total_substitutions = 0;
+    size_t total_substituted_bases = 0;
+    size_t total_softclips = 0;
+    size_t total_softclipped_bases = 0;
+
+    // Only filled in if we are recording edits.
+    vector<pair<id_t, Edit>> insertions;
+    vector<pair<id_t, Edit>> deletions;
+    vector<pair<id_t, Edit>> substitutions;
+    vector<pair<id_t, Edit>> softclips;
+
+    /// For each site and then allele, the number of primary reads that visit
+    /// a node unique to that allele. Only sites with reads are present.
+    map<string, map<string, size_t>> reads_on_allele;
+
+private:
+
+    bool record_edits;
+    const map<id_t, pair<string, string>>* allele_path_for_node;
+};
+
+/// Collect stats over a stream of Alignments on all OpenMP threads, with one
+/// AlignmentStats per thread, each made with prototype.empty_copy(). Returns
+/// the prototype with all the threads' stats merged into it.
+AlignmentStats accumulate_alignment_stats(istream& in, const AlignmentStats& prototype = AlignmentStats());
+
+}
+
+#endif
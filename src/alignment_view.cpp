@@ -0,0 +1,237 @@
+#include "alignment_view.hpp"
+
+#include <stdexcept>
+
+#include <google/protobuf/wire_format_lite.h>
+
+/**
+ * \file alignment_view.cpp: implementation of the field-selective Alignment view
+ */
+
+namespace vg {
+
+using namespace std;
+
+using ::google::protobuf::io::CodedInputStream;
+using ::google::protobuf::internal::WireFormatLite;
+
+// Field numbers from vg.proto
+static const int alignment_sequence_field = 1;
+static const int alignment_path_field = 2;
+static const int alignment_name_field = 3;
+static const int alignment_quality_field = 4;
+static const int alignment_mapping_quality_field = 5;
+static const int alignment_score_field = 6;
+static const int alignment_is_secondary_field = 15;
+static const int alignment_identity_field = 16;
+static const int alignment_refpos_field = 19;
+static const int alignment_correctly_mapped_field = 37;
+static const int path_mapping_field = 2;
+static const int mapping_position_field = 1;
+
+/// Complain if decoding failed.
+static void handle(bool ok) {
+    if (!ok) {
+        throw runtime_error("AlignmentView: could not decode serialized Alignment");
+    }
+}
+
+/// Read a length prefix and limit the stream to what it covers, run the body,
+/// and then lift the limit, leaving the stream after the value.
+static void descend(CodedInputStream& in, const function<void()>& body) {
+    uint32_t length;
+    handle(in.ReadVarint32(&length));
+    auto limit = in.PushLimit(length);
+    body();
+    // Skip anything the body didn't read
+    handle(in.Skip(in.BytesUntilLimit()));
+    in.PopLimit(limit);
+}
+
+AlignmentView::AlignmentView(const string& serialized) : serialized(serialized) {
+    // nothing to do
+}
+
+void AlignmentView::Clear() {
+    serialized.clear();
+}
+
+bool AlignmentView::ParseFromString(const string& serialized) {
+    this->serialized = serialized;
+    return true;
+}
+
+bool AlignmentView::SerializeToString(string* serialized) const {
+    *serialized = this->serialized;
+    return true;
+}
+
+const string& AlignmentView::data() const {
+    return serialized;
+}
+
+void AlignmentView::for_each_field(CodedInputStream& in, int field_number, int wire_type,
+                                   const function<void(CodedInputStream&)>& reader) {
+    uint32_t wanted = WireFormatLite::MakeTag(field_number, (WireFormatLite::WireType) wire_type);
+    uint32_t tag;
+    while ((tag = in.ReadTag()) != 0) {
+        if (tag == wanted) {
+            reader(in);
+        } else {
+            handle(WireFormatLite::SkipField(&in, tag));
+        }
+    }
+}
+
+void AlignmentView::for_each_field(int field_number, int wire_type,
+                                   const function<void(CodedInputStream&)>& reader) const {
+    CodedInputStream in((const uint8_t*) serialized.data(), serialized.size());
+    for_each_field(in, field_number, wire_type, reader);
+}
+
+uint64_t AlignmentView::varint_field(int field_number) const {
+    // Like Protobuf, the last value wins
+    uint64_t value = 0;
+    for_each_field(field_number, WireFormatLite::WIRETYPE_VARINT, [&](CodedInputStream& in) {
+        handle(in.ReadVarint64((::google::protobuf::uint64*) &value));
+    });
+    return value;
+}
+
+string AlignmentView::bytes_field(int field_number) const {
+    string value;
+    for_each_field(field_number, WireFormatLite::WIRETYPE_LENGTH_DELIMITED, [&](CodedInputStream& in) {
+        uint32_t length;
+        handle(in.ReadVarint32(&length));
+        handle(in.ReadString(&value, length));
+    });
+    return value;
+}
+
+string AlignmentView::name() const {
+    return bytes_field(alignment_name_field);
+}
+
+string AlignmentView::sequence() const {
+    return bytes_field(alignment_sequence_field);
+}
+
+size_t AlignmentView::sequence_length() const {
+    size_t length = 0;
+    for_each_field(alignment_sequence_field, WireFormatLite::WIRETYPE_LENGTH_DELIMITED, [&](CodedInputStream& in) {
+        uint32_t field_length;
+        handle(in.ReadVarint32(&field_length));
+        handle(in.Skip(field_length));
+        length = field_length;
+    });
+    return length;
+}
+
+string AlignmentView::quality() const {
+    return bytes_field(alignment_quality_field);
+}
+
+int32_t AlignmentView::mapping_quality() const {
+    // Negative int32s are sign extended to 64 bits on the wire
+    return (int32_t) varint_field(alignment_mapping_quality_field);
+}
+
+int32_t AlignmentView::score() const {
+    return (int32_t) varint_field(alignment_score_field);
+}
+
+bool AlignmentView::is_secondary() const {
+    return varint_field(alignment_is_secondary_field) != 0;
+}
+
+bool AlignmentView::correctly_mapped() const {
+    return varint_field(alignment_correctly_mapped_field) != 0;
+}
+
+double AlignmentView::identity() const {
+    double value = 0;
+    for_each_field(alignment_identity_field, WireFormatLite::WIRETYPE_FIXED64, [&](CodedInputStream& in) {
+        ::google::protobuf::uint64 bits;
+        handle(in.ReadLittleEndian64(&bits));
+        value = WireFormatLite::DecodeDouble(bits);
+    });
+    return value;
+}
+
+bool AlignmentView::has_path() const {
+    bool found = false;
+    for_each_field(alignment_path_field, WireFormatLite::WIRETYPE_LENGTH_DELIMITED, [&](CodedInputStream& in) {
+        found = true;
+        uint32_t length;
+        handle(in.ReadVarint32(&length));
+        handle(in.Skip(length));
+    });
+    return found;
+}
+
+void AlignmentView::for_each_mapping(const function<bool(CodedInputStream&)>& callback) const {
+    CodedInputStream in((const uint8_t*) serialized.data(), serialized.size());
+    bool keep_going = true;
+    for_each_field(in, alignment_path_field, WireFormatLite::WIRETYPE_LENGTH_DELIMITED, [&](CodedInputStream& in) {
+        descend(in, [&]() {
+            for_each_field(in, path_mapping_field, WireFormatLite::WIRETYPE_LENGTH_DELIMITED, [&](CodedInputStream& in) {
+                if (keep_going) {
+                    descend(in, [&]() {
+                        keep_going = callback(in);
+                    });
+                } else {
+                    // Just get past it
+                    uint32_t length;
+                    handle(in.ReadVarint32(&length));
+                    handle(in.Skip(length));
+                }
+            });
+        });
+    });
+}
+
+size_t AlignmentView::mapping_size() const {
+    size_t count = 0;
+    for_each_mapping([&](CodedInputStream& in) {
+        count++;
+        return true;
+    });
+    return count;
+}
+
+Position AlignmentView::first_position() const {
+    Position position;
+    for_each_mapping([&](CodedInputStream& in) {
+        for_each_field(in, mapping_position_field, WireFormatLite::WIRETYPE_LENGTH_DELIMITED, [&](CodedInputStream& in) {
+            // Positions are tiny, so just parse them.
+            uint32_t length;
+            handle(in.ReadVarint32(&length));
+            string position_bytes;
+            handle(in.ReadString(&position_bytes, length));
+            handle(position.ParseFromString(position_bytes));
+        });
+        return false;
+    });
+    return position;
+}
+
+vector<Position> AlignmentView::refpos() const {
+    vector<Position> positions;
+    string position_bytes;
+    for_each_field(alignment_refpos_field, WireFormatLite::WIRETYPE_LENGTH_DELIMITED, [&](CodedInputStream& in) {
+        uint32_t length;
+        handle(in.ReadVarint32(&length));
+        handle(in.ReadString(&position_bytes, length));
+        positions.emplace_back();
+        handle(positions.back().ParseFromString(position_bytes));
+    });
+    return positions;
+}
+
+Alignment AlignmentView::to_alignment() const {
+    Alignment alignment;
+    handle(alignment.ParseFromString(serialized));
+    return alignment;
+}
+
+}
@@ -0,0 +1,117 @@
+#ifndef VG_ALIGNMENT_VIEW_HPP_INCLUDED
+#define VG_ALIGNMENT_VIEW_HPP_INCLUDED
+
+/** \file
+ * A view of a serialized Alignment that only decodes the fields it is asked
+ * for, for scans of GAM files that only need a few fields of each read.
+ */
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <google/protobuf/io/coded_stream.h>
+
+#include "vg.pb.h"
+
+namespace vg {
+
+using namespace std;
+
+/**
+ * Holds an Alignment as its serialized bytes, and decodes individual fields
+ * on request by skipping over the others, without parsing the whole message
+ * or its Path. It can stand in for Alignment in stream::for_each,
+ * for_each_parallel and ProtobufIterator.
+ *
+ * Fields are decoded each time they are asked for, so callers wanting a field
+ * more than once should keep it. Accessors throw if the bytes are corrupt.
+ */
+class AlignmentView {
+public:
+
+    /// Make a view of an empty Alignment.
+    AlignmentView() = default;
+    
+    /// Make a view over a copy of the given serialized Alignment.
+    AlignmentView(const string& serialized);
+    
+    ////////////////////////////////////////////////////////////////////////////
+    // Protobuf message interface, for the stream readers and writers
+    ////////////////////////////////////////////////////////////////////////////
+    
+    /// Make this a view of an empty Alignment.
+    void Clear();
+    
+    /// Take a copy of the serialized Alignment. Doesn't decode or check it.
+    bool ParseFromString(const string& serialized);
+    
+    /// Get back the serialized Alignment.
+    bool SerializeToString(string* serialized) const;
+    
+    ////////////////////////////////////////////////////////////////////////////
+    // Fields
+    ////////////////////////////////////////////////////////////////////////////
+    
+    string name() const;
+    string sequence() const;
+    /// Get the length of the sequence without copying it.
+    size_t sequence_length() const;
+    string quality() const;
+    int32_t mapping_quality() const;
+    int32_t score() const;
+    bool is_secondary() const;
+    double identity() const;
+    bool correctly_mapped() const;
+    
+    /// Return true if the Alignment has a Path.
+    bool has_path() const;
+    
+    /// Count the Mappings in the Path.
+    size_t mapping_size() const;
+    
+    /// Get the Position of the first Mapping in the Path, or an empty
+    /// Position if there are no Mappings.
+    Position first_position() const;
+    
+    /// Get the positions of the Alignment along reference paths.
+    vector<Position> refpos() const;
+    
+    /// Decode the whole Alignment.
+    Alignment to_alignment() const;
+    
+    /// Get the serialized Alignment.
+    const string& data() const;
+    
+private:
+    
+    /// Call the reader for each occurrence of the field with the given field
+    /// number and wire type in the message in front of the stream, up to the
+    /// current limit, with the stream positioned at the field's value. The
+    /// reader must consume the value. Other fields are skipped.
+    static void for_each_field(google::protobuf::io::CodedInputStream& in, int field_number, int wire_type,
+                               const function<void(google::protobuf::io::CodedInputStream&)>& reader);
+    
+    /// Call the reader for each occurrence of the given field of the
+    /// Alignment itself.
+    void for_each_field(int field_number, int wire_type,
+                        const function<void(google::protobuf::io::CodedInputStream&)>& reader) const;
+    
+    /// Get the last value of a varint field of the Alignment, or 0.
+    uint64_t varint_field(int field_number) const;
+    
+    /// Get the last value of a length-delimited field of the Alignment, or "".
+    string bytes_field(int field_number) const;
+    
+    /// Call the callback with the stream limited to the contents of each
+    /// Mapping in the Path, until it returns false.
+    void for_each_mapping(const function<bool(google::protobuf::io::CodedInputStream&)>& callback) const;
+    
+    /// The serialized Alignment.
+    string serialized;
+};
+
+}
+
+#endif
@@ -6,6 +6,7 @@
 //
 
 #include "banded_global_aligner.hpp"
+#include "gssw_aligner.hpp"
 #include "json2pb.h"
 
 //#define debug_banded_aligner_objects
@@ -16,6 +17,57 @@
 
 using namespace vg;
 
+/// Scores for the banded DP taken from the aligner when it runs.
+struct RuntimeBandedScores {
+    static inline bool use_profile(const int8_t* qual_profile) {
+        return qual_profile != nullptr;
+    }
+    static inline int8_t score(const int8_t* score_mat, const int8_t* nt_table, char ref_char, char read_char) {
+        return score_mat[5 * nt_table[ref_char] + nt_table[read_char]];
+    }
+    static inline int8_t gap_open(int8_t gap_open) {
+        return gap_open;
+    }
+    static inline int8_t gap_extend(int8_t gap_extend) {
+        return gap_extend;
+    }
+};
+
+/// The default scores (see gssw_aligner.hpp) as constants, so the DP doesn't have to load them. Only
+/// for alignments that don't adjust for base quality.
+struct DefaultBandedScores {
+    static inline bool use_profile(const int8_t* qual_profile) {
+        return false;
+    }
+    static inline int8_t score(const int8_t* score_mat, const int8_t* nt_table, char ref_char, char read_char) {
+        int8_t ref_nt = nt_table[ref_char], read_nt = nt_table[read_char];
+        // N (4) is the only code with this bit set, and it scores 0 against anything
+        return ((ref_nt | read_nt) & 4) ? 0 : (ref_nt == read_nt ? default_match : -default_mismatch);
+    }
+    static inline int8_t gap_open(int8_t gap_open) {
+        return default_gap_open;
+    }
+    static inline int8_t gap_extend(int8_t gap_extend) {
+        return default_gap_extension;
+    }
+    
+    /// Do the given scores match the defaults, so that this can stand in for them?
+    static bool matches(const int8_t* score_mat, const int8_t* nt_table, int8_t gap_open, int8_t gap_extend) {
+        if (gap_open != default_gap_open || gap_extend != default_gap_extension) {
+            return false;
+        }
+        const char bases[5] = {'A', 'C', 'G', 'T', 'N'};
+        for (size_t i = 0; i < 5; i++) {
+            for (size_t j = 0; j < 5; j++) {
+                if (score_mat[5 * nt_table[bases[i]] + nt_table[bases[j]]] != score(score_mat, nt_table, bases[i], bases[j])) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+};
+
 template<class IntType>
 BandedGlobalAligner<IntType>::BABuilder::BABuilder(Alignment& alignment) :
                                                    alignment(alignment),
@@ -232,15 +284,46 @@ BandedGlobalAligner<IntType>::BAMatrix::~BAMatrix() {
         cerr << "[BAMatrix::~BAMatrix] destructing null matrix" << endl;
     }
 #endif
-    free(match);
-    free(insert_row);
-    free(insert_col);
+    // The DP matrices belong to the BandedGlobalAligner
     free(seeds);
 }
 
 template <class IntType>
-void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8_t* nt_table, int8_t gap_open,
-                                                         int8_t gap_extend, bool qual_adjusted, IntType min_inf) {
+int64_t BandedGlobalAligner<IntType>::BAMatrix::band_cell_count() const {
+    return max<int64_t>(bottom_diag - top_diag + 1, 0) * node->sequence().length();
+}
+
+template <class IntType>
+void BandedGlobalAligner<IntType>::BAMatrix::set_storage(IntType* storage) {
+    int64_t band_size = band_cell_count();
+    match = storage;
+    insert_col = storage + band_size;
+    insert_row = storage + 2 * band_size;
+}
+
+template <class IntType>
+bool BandedGlobalAligner<IntType>::BAMatrix::is_saturated() const {
+    return saturated;
+}
+
+template <class IntType>
+inline IntType BandedGlobalAligner<IntType>::BAMatrix::lead_gap_score(int64_t score, IntType min_inf) {
+    if (score < min_inf) {
+        // the gap is too long to score in IntType, so don't let it wrap around
+        saturated = true;
+        return min_inf;
+    }
+    return score;
+}
+
+template <class IntType>
+template <class Scores>
+void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8_t* nt_table, int8_t gap_open_in,
+                                                         int8_t gap_extend_in, const int8_t* qual_profile, IntType min_inf) {
+    
+    // with the default scores these are compile time constants, as are the match scores below
+    const int8_t gap_open = Scores::gap_open(gap_open_in);
+    const int8_t gap_extend = Scores::gap_extend(gap_extend_in);
     
 #ifdef debug_banded_aligner_fill_matrix
     cerr << "[BAMatrix::fill_matrix] beginning DP on matrix for node " << node->id() << endl;;
@@ -257,11 +340,7 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
     
     const string& node_seq = node->sequence();
     const string& read = alignment.sequence();
-    const string& base_quality = alignment.quality();
     
-    match = (IntType*) malloc(sizeof(IntType) * band_size);
-    insert_col = (IntType*) malloc(sizeof(IntType) * band_size);
-    insert_row = (IntType*) malloc(sizeof(IntType) * band_size);
     /* these represent a band in a matrix, but we store it as a rectangle with chopped
      * corners
      *
@@ -366,11 +445,11 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
         idx = (seed_next_top_diag_iter - top_diag) * ncols;
         
         IntType match_score;
-        if (qual_adjusted) {
-            match_score = score_mat[25 * base_quality[seed_next_top_diag_iter] + 5 * nt_table[node_seq[0]] + nt_table[read[seed_next_top_diag_iter]]];
+        if (Scores::use_profile(qual_profile)) {
+            match_score = qual_profile[5 * seed_next_top_diag_iter + nt_table[node_seq[0]]];
         }
         else {
-            match_score = score_mat[5 * nt_table[node_seq[0]] + nt_table[read[seed_next_top_diag_iter]]];
+            match_score = Scores::score(score_mat, nt_table, node_seq[0], read[seed_next_top_diag_iter]);
         }
         
         if (beyond_top_of_matrix) {
@@ -378,16 +457,19 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
             // paths through this node into both the match and insert row from a lead gap
             
             // match after implied gap along top edge
-            match[idx] = max<IntType>(match_score - gap_open - (extended_cumulative_seq_len - 1) * gap_extend, match[idx]);
+            match[idx] = max<IntType>(lead_gap_score(match_score - gap_open - (extended_cumulative_seq_len - 1) * gap_extend, min_inf),
+                                      match[idx]);
             // gap open after implied gap along top edge
-            insert_row[idx] = max<IntType>(-2 * gap_open - extended_cumulative_seq_len * gap_extend, insert_row[idx]);
+            insert_row[idx] = max<IntType>(lead_gap_score(-2 * gap_open - extended_cumulative_seq_len * gap_extend, min_inf),
+                                           insert_row[idx]);
         }
         else if (abutting_top_of_matrix) {
             // the implied cell above this cell is not in the extended band, but the one diagonal is, so we can extend
             // into match from a lead gap but not insert row
             
             // match after implied gap along top edge
-            match[idx] = max<IntType>(match_score - gap_open - (extended_cumulative_seq_len - 1) * gap_extend, match[idx]);
+            match[idx] = max<IntType>(lead_gap_score(match_score - gap_open - (extended_cumulative_seq_len - 1) * gap_extend, min_inf),
+                                      match[idx]);
             
         }
         else {
@@ -421,11 +503,11 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
             
             // extend a match
             diag_idx = (diag - seed_next_top_diag) * seed_node_seq_len + seed_node_seq_len - 1;
-            if (qual_adjusted) {
-                match_score = score_mat[25 * base_quality[diag] + 5 * nt_table[node_seq[0]] + nt_table[read[diag]]];
+            if (Scores::use_profile(qual_profile)) {
+                match_score = qual_profile[5 * diag + nt_table[node_seq[0]]];
             }
             else {
-                match_score = score_mat[5 * nt_table[node_seq[0]] + nt_table[read[diag]]];
+                match_score = Scores::score(score_mat, nt_table, node_seq[0], read[diag]);
             }
             
 #ifdef debug_banded_aligner_fill_matrix
@@ -461,11 +543,11 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
             // may only be able to extend a match on last iteration
             idx = (seed_next_bottom_diag_iter - top_diag) * ncols;
             diag_idx = (seed_next_bottom_diag_iter - seed_next_top_diag) * seed_node_seq_len + seed_node_seq_len - 1;
-            if (qual_adjusted) {
-                match_score = score_mat[25 * base_quality[seed_next_bottom_diag_iter] + 5 * nt_table[node_seq[0]] + nt_table[read[seed_next_bottom_diag_iter]]];
+            if (Scores::use_profile(qual_profile)) {
+                match_score = qual_profile[5 * seed_next_bottom_diag_iter + nt_table[node_seq[0]]];
             }
             else {
-                match_score = score_mat[5 * nt_table[node_seq[0]] + nt_table[read[seed_next_bottom_diag_iter]]];
+                match_score = Scores::score(score_mat, nt_table, node_seq[0], read[seed_next_bottom_diag_iter]);
             }
             
 #ifdef debug_banded_aligner_fill_matrix
@@ -509,39 +591,41 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
         int64_t iter_stop = bottom_diag > (int64_t) read.length() ? band_height + (int64_t) read.length() - bottom_diag - 1 : band_height;
         
         // match of first nucleotides
-        if (qual_adjusted) {
-            match[idx] = max<IntType>(score_mat[25 * base_quality[0] + 5 * nt_table[node_seq[0]] + nt_table[read[0]]], match[idx]);
+        if (Scores::use_profile(qual_profile)) {
+            match[idx] = max<IntType>(qual_profile[nt_table[node_seq[0]]], match[idx]);
             
 #ifdef debug_banded_aligner_fill_matrix
-            cerr << "[BAMatrix::fill_matrix]: set quality adjusted initial match cell to " << (int) match[idx] << " from node char " << node_seq[0] << ", read char " << read[0] << ", base qual " << (int) base_quality[0] << " for adjusted matrix index " << 25 * base_quality[0] + 5 * nt_table[node_seq[0]] + nt_table[read[0]] << " and score " << (int) score_mat[25 * base_quality[0] + 5 * nt_table[node_seq[0]] + nt_table[read[0]]] << endl;
+            cerr << "[BAMatrix::fill_matrix]: set quality adjusted initial match cell to " << (int) match[idx] << " from node char " << node_seq[0] << ", read char " << read[0] << ", base qual " << (int) alignment.quality()[0] << " and score " << (int) qual_profile[nt_table[node_seq[0]]] << endl;
 #endif
         }
         else {
-             match[idx] = max<IntType>(match[idx] = score_mat[5 * nt_table[node_seq[0]] + nt_table[read[0]]], match[idx]);
+             match[idx] = max<IntType>(Scores::score(score_mat, nt_table, node_seq[0], read[0]), match[idx]);
         }
         
         // only way to end an alignment in a gap here is to row and column gap
-        insert_row[idx] = max<IntType>(-2 * gap_open, insert_row[idx]);
-        insert_col[idx] = max<IntType>(-2 * gap_open, insert_col[idx]);
+        insert_row[idx] = max<IntType>(lead_gap_score(-2 * gap_open, min_inf), insert_row[idx]);
+        insert_col[idx] = max<IntType>(lead_gap_score(-2 * gap_open, min_inf), insert_col[idx]);
         
         for (int64_t i = iter_start + 1; i < iter_stop; i++) {
             idx = i * ncols;
             up_idx = idx - ncols;
             // score of a match in this cell
             IntType match_score;
-            if (qual_adjusted) {
-                match_score = score_mat[25 * base_quality[top_diag + i] + 5 * nt_table[node_seq[0]] + nt_table[read[top_diag + i]]];
+            if (Scores::use_profile(qual_profile)) {
+                match_score = qual_profile[5 * (top_diag + i) + nt_table[node_seq[0]]];
             }
             else {
-                match_score = score_mat[5 * nt_table[node_seq[0]] + nt_table[read[top_diag + i]]];
+                match_score = Scores::score(score_mat, nt_table, node_seq[0], read[top_diag + i]);
             }
             // must take one lead gap to get into first column
-            match[idx] = max<IntType>(match_score - gap_open - (top_diag + i - 1) * gap_extend, match[idx]);
+            match[idx] = max<IntType>(lead_gap_score(match_score - gap_open - (top_diag + i - 1) * gap_extend, min_inf),
+                                      match[idx]);
             // normal iteration along column
             insert_row[idx] = max<IntType>(max<IntType>(match[up_idx] - gap_open, insert_row[up_idx] - gap_extend),
                                            insert_col[up_idx] - gap_open);
             // must take two gaps to get into first column
-            insert_col[idx] = max<IntType>(-2 * gap_open - (top_diag + i) * gap_extend, insert_col[idx]);
+            insert_col[idx] = max<IntType>(lead_gap_score(-2 * gap_open - (top_diag + i) * gap_extend, min_inf),
+                                           insert_col[idx]);
 
 #ifdef debug_banded_aligner_fill_matrix
             cerr << "[BAMatrix::fill_matrix]: on left edge of matrix at rectangle coords (" << i << ", " << 0 << "), match score of node char " << 0 << " (" << node_seq[0] << ") and read char " << i + top_diag << " (" << read[i + top_diag] << ") is " << (int) match_score << ", leading gap length is " << top_diag + i << " for total match matrix score of " << (int) match[idx] << endl;
@@ -581,15 +665,15 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
         idx = iter_start * ncols + j;
         
         IntType match_score;
-        if (qual_adjusted) {
-            match_score = score_mat[25 * base_quality[iter_start + top_diag + j] + 5 * nt_table[node_seq[j]] + nt_table[read[iter_start + top_diag + j]]];
+        if (Scores::use_profile(qual_profile)) {
+            match_score = qual_profile[5 * (iter_start + top_diag + j) + nt_table[node_seq[j]]];
         }
         else {
-            match_score = score_mat[5 * nt_table[node_seq[j]] + nt_table[read[iter_start + top_diag + j]]];
+            match_score = Scores::score(score_mat, nt_table, node_seq[j], read[iter_start + top_diag + j]);
         }
         if (top_diag_outside || top_diag_abutting) {
             // match after implied gap along top edge
-            match[idx] = match_score - gap_open - (cumulative_seq_len + j - 1) * gap_extend;
+            match[idx] = lead_gap_score(match_score - gap_open - (cumulative_seq_len + j - 1) * gap_extend, min_inf);
             
 #ifdef debug_banded_aligner_fill_matrix
             cerr << "[BAMatrix::fill_matrix]: on upper edge of matrix at rectangle coords (" << iter_start << ", " << j << "), match score of node char " << j << " (" << node_seq[j] << ") and read char " << iter_start + top_diag + j << " (" << read[iter_start + top_diag + j] << ") is " << (int) match_score << ", leading gap length is " << cumulative_seq_len + j << " for total match matrix score of " << (int) match[idx] << endl;
@@ -603,7 +687,7 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
         
         if (top_diag_outside) {
             // gap open after implied gap along top edge
-            insert_row[idx] = -2 * gap_open - (cumulative_seq_len + j) * gap_extend;
+            insert_row[idx] = lead_gap_score(-2 * gap_open - (cumulative_seq_len + j) * gap_extend, min_inf);
         }
         else {
             // cannot reach this node with row insert (outside the diagonal)
@@ -628,11 +712,11 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
             diag_idx = i * ncols + (j - 1);
             left_idx = (i + 1) * ncols + (j - 1);
             
-            if (qual_adjusted) {
-                match_score = score_mat[25 * base_quality[i + top_diag + j] + 5 * nt_table[node_seq[j]] + nt_table[read[i + top_diag + j]]];
+            if (Scores::use_profile(qual_profile)) {
+                match_score = qual_profile[5 * (i + top_diag + j) + nt_table[node_seq[j]]];
             }
             else {
-                match_score = score_mat[5 * nt_table[node_seq[j]] + nt_table[read[i + top_diag + j]]];
+                match_score = Scores::score(score_mat, nt_table, node_seq[j], read[i + top_diag + j]);
             }
             
             match[idx] = match_score + max(max(match[diag_idx], insert_row[diag_idx]), insert_col[diag_idx]);
@@ -656,11 +740,11 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
             up_idx = (iter_stop - 2) * ncols + j;
             diag_idx = (iter_stop - 1) * ncols + (j - 1);
             
-            if (qual_adjusted) {
-                match_score = score_mat[25 * base_quality[iter_stop + top_diag + j - 1] + 5 * nt_table[node_seq[j]] + nt_table[read[iter_stop + top_diag + j - 1]]];
+            if (Scores::use_profile(qual_profile)) {
+                match_score = qual_profile[5 * (iter_stop + top_diag + j - 1) + nt_table[node_seq[j]]];
             }
             else {
-                match_score = score_mat[5 * nt_table[node_seq[j]] + nt_table[read[iter_stop + top_diag + j - 1]]];
+                match_score = Scores::score(score_mat, nt_table, node_seq[j], read[iter_stop + top_diag + j - 1]);
             }
             
             match[idx] = match_score + max(max(match[diag_idx], insert_row[diag_idx]), insert_col[diag_idx]);
@@ -682,6 +766,21 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
         }
     }
     
+    // a score that fell off the bottom of IntType wraps around to the top of its range, above any
+    // score that an alignment can actually reach, so look for those in every cell we just filled
+    IntType max_valid_score = numeric_limits<IntType>::max() - (min_inf - numeric_limits<IntType>::min());
+    for (int64_t j = 0; j < ncols && !saturated; j++) {
+        int64_t col_iter_start = top_diag + j < 0 ? -(top_diag + j) : 0;
+        int64_t col_iter_stop = bottom_diag + j >= (int64_t) read.length() ? band_height + (int64_t) read.length() - bottom_diag - j - 1 : band_height;
+        for (int64_t i = col_iter_start; i < col_iter_stop; i++) {
+            idx = i * ncols + j;
+            if (match[idx] > max_valid_score || insert_row[idx] > max_valid_score || insert_col[idx] > max_valid_score) {
+                saturated = true;
+                break;
+            }
+        }
+    }
+    
 #ifdef debug_banded_aligner_print_matrices
     print_full_matrices();
     print_rectangularized_bands();
@@ -691,7 +790,7 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
 template <class IntType>
 void BandedGlobalAligner<IntType>::BAMatrix::traceback(BABuilder& builder, AltTracebackStack& traceback_stack, matrix_t start_mat,
                                                        int8_t* score_mat, int8_t* nt_table, int8_t gap_open, int8_t gap_extend,
-                                                       bool qual_adjusted, IntType min_inf) {
+                                                       const int8_t* qual_profile, IntType min_inf) {
     
     // get coordinates of bottom right corner
     const string& read = alignment.sequence();
@@ -705,14 +804,14 @@ void BandedGlobalAligner<IntType>::BAMatrix::traceback(BABuilder& builder, AltTr
 #endif
     
     traceback_internal(builder, traceback_stack, row, col, start_mat, alignment.sequence().empty(), score_mat, nt_table, gap_open, gap_extend,
-                       qual_adjusted, min_inf);
+                       qual_profile, min_inf);
 }
 
 template <class IntType>
 void BandedGlobalAligner<IntType>::BAMatrix::traceback_internal(BABuilder& builder, AltTracebackStack& traceback_stack,
                                                                 int64_t start_row, int64_t start_col, matrix_t start_mat,
                                                                 bool in_lead_gap, int8_t* score_mat, int8_t* nt_table,
-                                                                int8_t gap_open, int8_t gap_extend, bool qual_adjusted,
+                                                                int8_t gap_open, int8_t gap_extend, const int8_t* qual_profile,
                                                                 IntType min_inf) {
     
 #ifdef debug_banded_aligner_traceback
@@ -720,7 +819,6 @@ void BandedGlobalAligner<IntType>::BAMatrix::traceback_internal(BABuilder& build
 #endif
     
     const string& read = alignment.sequence();
-    const string& base_quality = alignment.quality();
     
     int64_t band_height = bottom_diag - top_diag + 1;
     const char* node_seq = node->sequence().c_str();
@@ -803,8 +901,8 @@ void BandedGlobalAligner<IntType>::BAMatrix::traceback_internal(BABuilder& build
                 next_idx = i * ncols + j - 1;
                 
                 IntType match_score;
-                if (qual_adjusted) {
-                    match_score = score_mat[25 * base_quality[i + top_diag + j] + 5 * nt_table[node_seq[j]] + nt_table[read[i + top_diag + j]]];
+                if (qual_profile) {
+                    match_score = qual_profile[5 * (i + top_diag + j) + nt_table[node_seq[j]]];
                 }
                 else {
                     match_score = score_mat[5 * nt_table[node_seq[j]] + nt_table[read[i + top_diag + j]]];
@@ -1110,7 +1208,7 @@ void BandedGlobalAligner<IntType>::BAMatrix::traceback_internal(BABuilder& build
         
         // continue traceback in the next node
         seed->traceback_internal(builder, traceback_stack, traceback_seed_row, traceback_seed_col, deflect_matrix,
-                                 in_lead_gap, score_mat, nt_table, gap_open, gap_extend, qual_adjusted, min_inf);
+                                 in_lead_gap, score_mat, nt_table, gap_open, gap_extend, qual_profile, min_inf);
         return;
     }
     
@@ -1204,8 +1302,8 @@ void BandedGlobalAligner<IntType>::BAMatrix::traceback_internal(BABuilder& build
             case Match:
             {
                 curr_score = match[i * ncols];
-                if (qual_adjusted) {
-                    match_score = score_mat[25 * base_quality[i + top_diag] + 5 * nt_table[node_seq[j]] + nt_table[read[i + top_diag]]];
+                if (qual_profile) {
+                    match_score = qual_profile[5 * (i + top_diag) + nt_table[node_seq[j]]];
                 }
                 else {
                     match_score = score_mat[5 * nt_table[node_seq[j]] + nt_table[read[i + top_diag]]];
@@ -1510,8 +1608,8 @@ void BandedGlobalAligner<IntType>::BAMatrix::traceback_internal(BABuilder& build
                 case Match:
                 {
                     IntType match_score;
-                    if (qual_adjusted) {
-                        match_score = score_mat[25 * base_quality[i + top_diag + j] + 5 * nt_table[node_seq[j]] + nt_table[read[i + top_diag + j]]];
+                    if (qual_profile) {
+                        match_score = qual_profile[5 * (i + top_diag + j) + nt_table[node_seq[j]]];
                     }
                     else {
                         match_score = score_mat[5 * nt_table[node_seq[j]] + nt_table[read[i + top_diag + j]]];
@@ -1604,7 +1702,7 @@ void BandedGlobalAligner<IntType>::BAMatrix::traceback_internal(BABuilder& build
     
     // continue traceback in the next node
     traceback_seed->traceback_internal(builder, traceback_stack, traceback_seed_row, traceback_seed_col, traceback_mat,
-                                       in_lead_gap, score_mat, nt_table, gap_open, gap_extend, qual_adjusted, min_inf);
+                                       in_lead_gap, score_mat, nt_table, gap_open, gap_extend, qual_profile, min_inf);
 }
 
 template <class IntType>
@@ -1944,6 +2042,24 @@ BandedGlobalAligner<IntType>::BandedGlobalAligner(Alignment& alignment, Graph& g
             throw NoAlignmentInBandException();
         }
     }
+    
+    // lay out all the DP matrices in one block, reusing this thread's block from
+    // its last alignment if there is one
+    int64_t total_cells = 0;
+    for (BAMatrix* banded_matrix : banded_matrices) {
+        if (banded_matrix != nullptr) {
+            total_cells += 3 * banded_matrix->band_cell_count();
+        }
+    }
+    matrix_storage.swap(spare_matrix_storage());
+    matrix_storage.resize(total_cells);
+    IntType* next_storage = matrix_storage.data();
+    for (BAMatrix* banded_matrix : banded_matrices) {
+        if (banded_matrix != nullptr) {
+            banded_matrix->set_storage(next_storage);
+            next_storage += 3 * banded_matrix->band_cell_count();
+        }
+    }
 }
 
 template <class IntType>
@@ -1954,6 +2070,18 @@ BandedGlobalAligner<IntType>::~BandedGlobalAligner() {
             delete banded_matrix;
         }
     }
+    
+    // hand the matrix storage back for the thread's next alignment
+    vector<IntType>& spare = spare_matrix_storage();
+    if (matrix_storage.capacity() > spare.capacity()) {
+        spare.swap(matrix_storage);
+    }
+}
+
+template <class IntType>
+vector<IntType>& BandedGlobalAligner<IntType>::spare_matrix_storage() {
+    static thread_local vector<IntType> spare;
+    return spare;
 }
 
 // fills a vector with vectors ids that have edges to/from each node
@@ -2223,7 +2351,25 @@ void BandedGlobalAligner<IntType>::shortest_seq_paths(vector<vector<int64_t>>& n
 }
 
 template <class IntType>
-void BandedGlobalAligner<IntType>::align(int8_t* score_mat, int8_t* nt_table, int8_t gap_open, int8_t gap_extend) {
+void BandedGlobalAligner<IntType>::align(int8_t* score_mat, int8_t* nt_table, int8_t gap_open, int8_t gap_extend,
+                                         const int8_t* qual_profile) {
+    
+    // gather the quality adjusted scores for this read if the caller didn't already
+    vector<int8_t> own_qual_profile;
+    if (!adjust_for_base_quality) {
+        qual_profile = nullptr;
+    }
+    else if (!qual_profile) {
+        const string& read = alignment.sequence();
+        const string& base_quality = alignment.quality();
+        own_qual_profile.resize(5 * read.size());
+        for (size_t i = 0; i < read.size(); i++) {
+            for (size_t j = 0; j < 5; j++) {
+                own_qual_profile[5 * i + j] = score_mat[25 * base_quality[i] + 5 * j + nt_table[read[i]]];
+            }
+        }
+        qual_profile = own_qual_profile.data();
+    }
     
     // small enough number to never be accepted in alignment but also not trigger underflow
     IntType max_mismatch = numeric_limits<IntType>::max();
@@ -2232,6 +2378,9 @@ void BandedGlobalAligner<IntType>::align(int8_t* score_mat, int8_t* nt_table, in
     }
     IntType min_inf = numeric_limits<IntType>::min() + max<IntType>((IntType) -max_mismatch, max<IntType>(gap_open, gap_extend));
     
+    // use the DP kernel with the scores compiled in if we can
+    bool default_scores = !qual_profile && DefaultBandedScores::matches(score_mat, nt_table, gap_open, gap_extend);
+    
     
     // fill each nodes matrix in topological order
     for (int64_t i = 0; i < topological_order.size(); i++) {
@@ -2252,14 +2401,26 @@ void BandedGlobalAligner<IntType>::align(int8_t* score_mat, int8_t* nt_table, in
 #ifdef debug_banded_aligner_fill_matrix
         cerr << "[BandedGlobalAligner::align] node is not masked, filling matrix" << endl;
 #endif
-        band_matrix->fill_matrix(score_mat, nt_table, gap_open, gap_extend, adjust_for_base_quality, min_inf);
+        if (default_scores) {
+            band_matrix->template fill_matrix<DefaultBandedScores>(score_mat, nt_table, gap_open, gap_extend,
+                                                                   qual_profile, min_inf);
+        }
+        else {
+            band_matrix->template fill_matrix<RuntimeBandedScores>(score_mat, nt_table, gap_open, gap_extend,
+                                                                   qual_profile, min_inf);
+        }
+        if (band_matrix->is_saturated()) {
+            // the scores no longer mean anything, so the caller will have to use a wider IntType
+            throw BandedAlignmentOverflowException();
+        }
     }
     
-    traceback(score_mat, nt_table, gap_open, gap_extend, min_inf);
+    traceback(score_mat, nt_table, gap_open, gap_extend, qual_profile, min_inf);
 }
 
 template <class IntType>
-void BandedGlobalAligner<IntType>::traceback(int8_t* score_mat, int8_t* nt_table, int8_t gap_open, int8_t gap_extend, IntType min_inf) {
+void BandedGlobalAligner<IntType>::traceback(int8_t* score_mat, int8_t* nt_table, int8_t gap_open, int8_t gap_extend,
+                                             const int8_t* qual_profile, IntType min_inf) {
     
     // get the sink and source node matrices for alignment stack
     unordered_set<BAMatrix*> sink_node_matrices;
@@ -2317,7 +2478,7 @@ void BandedGlobalAligner<IntType>::traceback(int8_t* score_mat, int8_t* nt_table
             // do traceback
             BABuilder builder(*next_alignment);
             banded_matrices[end_node_idx]->traceback(builder, traceback_stack, end_matrix, score_mat, nt_table,
-                                                     gap_open, gap_extend, adjust_for_base_quality, min_inf);
+                                                     gap_open, gap_extend, qual_profile, min_inf);
             
             // construct the alignment path
             builder.finalize_alignment(traceback_stack.current_empty_prefix());
@@ -2679,4 +2840,10 @@ const char* NoAlignmentInBandException::what() const noexcept {
     return message.c_str();
 }
 
+const string BandedAlignmentOverflowException::message = "error:[BandedGlobalAligner] alignment scores overflowed the integer width of the DP matrices";
+
+const char* BandedAlignmentOverflowException::what() const noexcept {
+    return message.c_str();
+}
+
 
@@ -32,12 +32,23 @@ namespace vg {
         static const string message;
     };
     
+    /**
+     * This gets thrown when some score in the DP matrices doesn't fit in the
+     * integer type the aligner was made with. The alignment can be retried
+     * with a wider type.
+     */
+    class BandedAlignmentOverflowException : public exception {
+        virtual const char* what() const noexcept;
+        static const string message;
+    };
+    
     /**
      * The outward-facing interface for banded global graph alignment. It computes optimal alignment
      * of a DNA sequence to a DAG with POA. The alignment will start at any source node in the graph and
      * end at any sink node. It is also restricted to falling within a certain diagonal band from the
-     * start node. Any signed integer type can be used for the dynamic programming matrices, but there
-     * are no checks for overflow.
+     * start node. Any signed integer type can be used for the dynamic programming matrices. If the
+     * scores overflow the type, align() throws a BandedAlignmentOverflowException before producing an
+     * alignment.
      *
      */
     template <class IntType>
@@ -89,7 +100,14 @@ namespace vg {
         ///              use QualAdjAligner's scaled penalty)
         ///  gap_extend  gap extension penalty from Algner (if performing base quality adjusted alignment,
         ///              use QualAdjAligner's scaled penalty)
-        void align(int8_t* score_mat, int8_t* nt_table, int8_t gap_open, int8_t gap_extend);
+        ///  qual_profile  optional quality adjusted scores for each read base against each reference
+        ///              base, from QualAdjAligner::query_profile (if performing base quality adjusted
+        ///              alignment without one, it is gathered from score_mat here)
+        ///
+        /// Throws a BandedAlignmentOverflowException, leaving the alignment untouched, if the scores do
+        /// not fit in IntType.
+        void align(int8_t* score_mat, int8_t* nt_table, int8_t gap_open, int8_t gap_extend,
+                   const int8_t* qual_profile = nullptr);
         
         
     private:
@@ -112,6 +130,14 @@ namespace vg {
         
         /// Dynamic programming matrices for each node
         vector<BAMatrix*> banded_matrices;
+        /// Backing storage for all the nodes' DP matrices, so that filling
+        /// them takes one allocation instead of three per node
+        vector<IntType> matrix_storage;
+        
+        /// Get the calling thread's matrix storage left over from its last
+        /// alignment with this IntType. Most alignments are tiny, and reusing
+        /// the storage lets them skip allocation altogether.
+        static vector<IntType>& spare_matrix_storage();
         
         /// Map from node IDs to the index used in internal vectors
         unordered_map<int64_t, int64_t> node_id_to_idx;
@@ -129,7 +155,8 @@ namespace vg {
                             bool adjust_for_base_quality = false);
         
         /// Traceback through dynamic programming matrices to compute alignment
-        void traceback(int8_t* score_mat, int8_t* nt_table, int8_t gap_open, int8_t gap_extend, IntType min_inf);
+        void traceback(int8_t* score_mat, int8_t* nt_table, int8_t gap_open, int8_t gap_extend,
+                       const int8_t* qual_profile, IntType min_inf);
         
         /// Constructor helper function: converts Graph object into adjacency list representation
         void graph_edge_lists(Graph& g, bool outgoing_edges, vector<vector<int64_t>>& out_edge_list);
@@ -159,13 +186,25 @@ namespace vg {
                  BAMatrix** seeds, int64_t num_seeds, int64_t cumulative_seq_len);
         ~BAMatrix();
         
-        /// Use DP to fill the band with alignment scores
-        void fill_matrix(int8_t* score_mat, int8_t* nt_table, int8_t gap_open, int8_t gap_extend, bool qual_adjusted,
+        /// How many cells does each of the band's three DP matrices need?
+        int64_t band_cell_count() const;
+        
+        /// Use the given space, which is owned elsewhere and must hold three
+        /// times band_cell_count() cells, for the DP matrices.
+        void set_storage(IntType* storage);
+        
+        /// Use DP to fill the band with alignment scores, getting match scores and gap penalties through
+        /// the Scores policy (see banded_global_aligner.cpp)
+        template <class Scores>
+        void fill_matrix(int8_t* score_mat, int8_t* nt_table, int8_t gap_open, int8_t gap_extend, const int8_t* qual_profile,
                          IntType min_inf);
         
+        /// Did any score in the band get too big or too small for IntType while filling it?
+        bool is_saturated() const;
+        
         /// Traceback through the band after using DP to fill it
         void traceback(BABuilder& builder, AltTracebackStack& traceback_stack, matrix_t start_mat, int8_t* score_mat,
-                       int8_t* nt_table, int8_t gap_open, int8_t gap_extend, bool qual_adjusted, IntType min_inf);
+                       int8_t* nt_table, int8_t gap_open, int8_t gap_extend, const int8_t* qual_profile, IntType min_inf);
         
         /// Debugging function
         void print_full_matrices();
@@ -196,9 +235,16 @@ namespace vg {
         /// DP matrix
         IntType* insert_row;
         
+        /// Set when some score in the band could not be represented in IntType
+        bool saturated = false;
+        
+        /// Convert a lead gap score computed in full width to IntType, flagging the band as
+        /// saturated and returning min_inf if it doesn't fit
+        IntType lead_gap_score(int64_t score, IntType min_inf);
+        
         void traceback_internal(BABuilder& builder, AltTracebackStack& traceback_stack, int64_t start_row,
                                 int64_t start_col, matrix_t start_mat, bool in_lead_gap, int8_t* score_mat,
-                                int8_t* nt_table, int8_t gap_open, int8_t gap_extend, bool qual_adjusted,
+                                int8_t* nt_table, int8_t gap_open, int8_t gap_extend, const int8_t* qual_profile,
                                 IntType min_inf);
         
         /// Debugging function
@@ -5,6 +5,17 @@
 #include <numeric>
 #include <cmath>
 #include <iomanip>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <functional>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 
 /**
  * \file benchmark.hpp: implementations of benchmarking functions
@@ -13,6 +24,10 @@
 namespace vg {
 using namespace std;
 
+bool BenchmarkCounters::any() const {
+    return !isnan(cycles) || !isnan(instructions) || !isnan(llc_misses) || !isnan(branch_misses);
+}
+
 double BenchmarkResult::score() const {
     // We comnpute a score in points by comparing the experimental and control runtimes.
     // Higher is better.
@@ -73,6 +88,21 @@ ostream& operator<<(ostream& out, const BenchmarkResult& result) {
     out << "\t";
     out << result.score_error();
     out << "\t";
+    
+    if (result.counted) {
+        // Event counts are whole numbers, or missing
+        out << setprecision(0);
+        for (double count : {result.test_counters.cycles, result.test_counters.instructions,
+                             result.test_counters.llc_misses, result.test_counters.branch_misses}) {
+            if (isnan(count)) {
+                out << "NA";
+            } else {
+                out << count;
+            }
+            out << "\t";
+        }
+    }
+    
     out << result.name;
     
     out.precision(initial_precision);
@@ -81,6 +111,213 @@ ostream& operator<<(ostream& out, const BenchmarkResult& result) {
     return out;
 }
 
+/// Write a string as a JSON string literal
+static void write_json_string(ostream& out, const string& value) {
+    out << '"';
+    for (char c : value) {
+        switch (c) {
+        case '"':
+            out << "\\\"";
+            break;
+        case '\\':
+            out << "\\\\";
+            break;
+        case '\n':
+            out << "\\n";
+            break;
+        case '\t':
+            out << "\\t";
+            break;
+        default:
+            if ((unsigned char) c < 0x20) {
+                // Other control characters need to be escaped numerically
+                char escaped[7];
+                snprintf(escaped, sizeof(escaped), "\\u%04x", (unsigned char) c);
+                out << escaped;
+            } else {
+                out << c;
+            }
+        }
+    }
+    out << '"';
+}
+
+/// Write a number for JSON, which has no infinities or NaNs
+static void write_json_number(ostream& out, double value) {
+    if (isfinite(value)) {
+        out << value;
+    } else {
+        out << "null";
+    }
+}
+
+void write_benchmark_json(ostream& out, const vector<BenchmarkResult>& results, const string& version) {
+    using frac_secs = chrono::duration<double, std::micro>;
+    
+    // Save stream settings
+    auto initial_precision = out.precision();
+    auto initial_flags = out.flags();
+    out << setprecision(10) << defaultfloat;
+    
+    out << "{\"version\": ";
+    write_json_string(out, version);
+    out << ", \"results\": [";
+    for (size_t i = 0; i < results.size(); i++) {
+        auto& result = results[i];
+        out << (i == 0 ? "" : ",") << endl;
+        out << "  {\"name\": ";
+        write_json_string(out, result.name);
+        out << ", \"runs\": " << result.runs
+            << ", \"test_mean_us\": " << chrono::duration_cast<frac_secs>(result.test_mean).count()
+            << ", \"test_stddev_us\": " << chrono::duration_cast<frac_secs>(result.test_stddev).count()
+            << ", \"control_mean_us\": " << chrono::duration_cast<frac_secs>(result.control_mean).count()
+            << ", \"control_stddev_us\": " << chrono::duration_cast<frac_secs>(result.control_stddev).count()
+            << ", \"score\": ";
+        write_json_number(out, result.score());
+        out << ", \"score_error\": ";
+        write_json_number(out, result.score_error());
+        if (result.counted) {
+            out << ", \"cycles\": ";
+            write_json_number(out, result.test_counters.cycles);
+            out << ", \"instructions\": ";
+            write_json_number(out, result.test_counters.instructions);
+            out << ", \"llc_misses\": ";
+            write_json_number(out, result.test_counters.llc_misses);
+            out << ", \"branch_misses\": ";
+            write_json_number(out, result.test_counters.branch_misses);
+        }
+        out << "}";
+    }
+    out << endl << "]}" << endl;
+    
+    out.precision(initial_precision);
+    out.flags(initial_flags);
+}
+
+/// Should run_benchmark count hardware events?
+static bool count_hardware_events = false;
+
+void set_benchmark_counters(bool enabled) {
+    count_hardware_events = enabled;
+}
+
+/**
+ * Counts hardware events on the calling thread with perf_event_open. Each
+ * event has its own counter, so we still get the ones the kernel allows if
+ * some aren't available (as is common in VMs).
+ */
+class HardwareEventCounter {
+public:
+    HardwareEventCounter();
+    ~HardwareEventCounter();
+    
+    /// Start counting.
+    void start();
+    
+    /// Stop counting and add the counts since start() to the totals.
+    void stop();
+    
+    /// Get the mean counts over all the runs.
+    BenchmarkCounters means() const;
+    
+private:
+    static const size_t EVENT_COUNT = 4;
+    
+    /// The perf file descriptors for each event, or -1 if it couldn't be opened.
+    int fds[EVENT_COUNT];
+    /// The total count of each event.
+    double totals[EVENT_COUNT];
+    /// How many times we have been started and stopped.
+    size_t runs = 0;
+};
+
+HardwareEventCounter::HardwareEventCounter() {
+    for (size_t i = 0; i < EVENT_COUNT; i++) {
+        fds[i] = -1;
+        totals[i] = 0;
+    }
+#ifdef __linux__
+    uint64_t configs[EVENT_COUNT] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+    for (size_t i = 0; i < EVENT_COUNT; i++) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = configs[i];
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        // If the PMU is shared, we get told how long we were really counting for
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        // This thread, on any CPU
+        fds[i] = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+#endif
+}
+
+HardwareEventCounter::~HardwareEventCounter() {
+#ifdef __linux__
+    for (size_t i = 0; i < EVENT_COUNT; i++) {
+        if (fds[i] != -1) {
+            close(fds[i]);
+        }
+    }
+#endif
+}
+
+void HardwareEventCounter::start() {
+#ifdef __linux__
+    for (size_t i = 0; i < EVENT_COUNT; i++) {
+        if (fds[i] != -1) {
+            ioctl(fds[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(fds[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+#endif
+}
+
+void HardwareEventCounter::stop() {
+#ifdef __linux__
+    for (size_t i = 0; i < EVENT_COUNT; i++) {
+        if (fds[i] != -1) {
+            ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+        }
+    }
+    for (size_t i = 0; i < EVENT_COUNT; i++) {
+        if (fds[i] == -1) {
+            continue;
+        }
+        // The count, the time enabled, and the time actually counting
+        uint64_t values[3];
+        if (read(fds[i], values, sizeof(values)) != sizeof(values)) {
+            // Treat a counter we can't read like one we couldn't open
+            close(fds[i]);
+            fds[i] = -1;
+            continue;
+        }
+        if (values[2] > 0) {
+            // Scale up for the time the counter was multiplexed out
+            totals[i] += (double) values[0] * values[1] / values[2];
+        }
+    }
+#endif
+    runs++;
+}
+
+BenchmarkCounters HardwareEventCounter::means() const {
+    double means[EVENT_COUNT];
+    for (size_t i = 0; i < EVENT_COUNT; i++) {
+        means[i] = (fds[i] == -1 || runs == 0) ? NAN : totals[i] / runs;
+    }
+    BenchmarkCounters to_return;
+    to_return.cycles = means[0];
+    to_return.instructions = means[1];
+    to_return.llc_misses = means[2];
+    to_return.branch_misses = means[3];
+    return to_return;
+}
+
 void benchmark_control() {
     // We need to do something that takes time.
     
@@ -132,6 +369,12 @@ BenchmarkResult run_benchmark(const string& name, size_t iterations, const funct
     test_samples.reserve(iterations);
     control_samples.reserve(iterations);
     
+    // Count hardware events around the test runs, if we are asked to
+    unique_ptr<HardwareEventCounter> counter;
+    if (count_hardware_events) {
+        counter.reset(new HardwareEventCounter());
+    }
+    
     for (size_t i = 0; i < iterations; i++) {
         // For each iteration
         
@@ -139,9 +382,15 @@ BenchmarkResult run_benchmark(const string& name, size_t iterations, const funct
         setup();
         
         // Run the function under test
+        if (counter) {
+            counter->start();
+        }
         auto test_start = chrono::high_resolution_clock::now();
         under_test();
         auto test_stop = chrono::high_resolution_clock::now();
+        if (counter) {
+            counter->stop();
+        }
         
         // And run the control
         auto control_start = chrono::high_resolution_clock::now();
@@ -166,22 +415,30 @@ BenchmarkResult run_benchmark(const string& name, size_t iterations, const funct
     // And make a duration for the mean
     to_return.test_mean = benchtime(test_total / iterations);
     
-    // Then total up the squares of the tick counts
-    benchtime::rep test_square_total = inner_product(test_samples.begin(), test_samples.end(),
-        test_samples.begin(), benchtime::zero().count());
+    // Then total up the squares of the tick counts. We do this in floating
+    // point, since squared nanoseconds of long runs overflow integers.
+    double test_square_total = inner_product(test_samples.begin(), test_samples.end(),
+        test_samples.begin(), 0.0, plus<double>(), [](benchtime::rep a, benchtime::rep b) { return (double) a * b; });
     // Calculate the standard deviation in ticks, and represent it as a duration
-    to_return.test_stddev = benchtime((benchtime::rep) sqrt(test_square_total / iterations -
-        to_return.test_mean.count() * to_return.test_mean.count()));
+    double test_mean = (double) test_total / iterations;
+    to_return.test_stddev = benchtime((benchtime::rep) sqrt(max(test_square_total / iterations -
+        test_mean * test_mean, 0.0)));
     
     // Similarly for the control
     benchtime::rep control_total = accumulate(control_samples.begin(), control_samples.end(),
         benchtime::zero().count());
     to_return.control_mean = benchtime(control_total / iterations);
     
-    benchtime::rep control_square_total = inner_product(control_samples.begin(), control_samples.end(), 
-        control_samples.begin(), benchtime::zero().count());
-    to_return.control_stddev = benchtime((benchtime::rep) sqrt(control_square_total / iterations -
-        to_return.control_mean.count() * to_return.control_mean.count()));
+    double control_square_total = inner_product(control_samples.begin(), control_samples.end(), 
+        control_samples.begin(), 0.0, plus<double>(), [](benchtime::rep a, benchtime::rep b) { return (double) a * b; });
+    double control_mean = (double) control_total / iterations;
+    to_return.control_stddev = benchtime((benchtime::rep) sqrt(max(control_square_total / iterations -
+        control_mean * control_mean, 0.0)));
+    
+    if (counter) {
+        to_return.counted = true;
+        to_return.test_counters = counter->means();
+    }
     
     return to_return;
     
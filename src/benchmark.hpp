@@ -2,9 +2,11 @@
 #define VG_BENCHMARK_HPP_INCLUDED
 
 #include <chrono>
+#include <cmath>
 #include <functional>
 #include <iostream>
 #include <string>
+#include <vector>
 
 /** 
  * \file benchmark.hpp
@@ -18,6 +20,24 @@ using namespace std;
 /// We define a duration type for expressing benchmark times in.
 using benchtime = chrono::nanoseconds;
 
+/**
+ * Mean hardware event counts per run of a benchmark. Counts that couldn't be
+ * collected are NaN.
+ */
+struct BenchmarkCounters {
+    /// CPU cycles
+    double cycles = NAN;
+    /// Instructions retired
+    double instructions = NAN;
+    /// Last level cache misses
+    double llc_misses = NAN;
+    /// Mispredicted branches
+    double branch_misses = NAN;
+    
+    /// Return true if any of the counts were collected.
+    bool any() const;
+};
+
 /**
  * Represents the results of a benchmark run. Tracks the mean and standard
  * deviation of a number of runs of a function under test, interleaved with runs
@@ -36,6 +56,10 @@ struct BenchmarkResult {
     benchtime control_stddev;
     /// What was the name of the test being run
     string name;
+    /// Were hardware events counted?
+    bool counted = false;
+    /// What were the hardware event counts for each test run, if counted?
+    BenchmarkCounters test_counters;
     /// How many control-standardized "points" do we score?
     double score() const;
     /// What is the uncertainty on the score?
@@ -43,10 +67,26 @@ struct BenchmarkResult {
 };
 
 /**
- * Benchmark results can be output to streams
+ * Benchmark results can be output to streams. If hardware events were
+ * counted, their columns come just before the name.
  */
 ostream& operator<<(ostream& out, const BenchmarkResult& result);
 
+/**
+ * Write benchmark results out as a JSON object, recording the version of vg
+ * they were measured with, so runs from different releases can be compared by
+ * machine. Times are in microseconds.
+ */
+void write_benchmark_json(ostream& out, const vector<BenchmarkResult>& results, const string& version);
+
+/**
+ * Turn on or off counting hardware events (cycles, instructions, LLC misses
+ * and branch misses) with perf_event_open during benchmark test runs. Events
+ * are counted on the calling thread. Where the kernel doesn't allow it, or not
+ * on Linux, the counts come out as NaN.
+ */
+void set_benchmark_counters(bool enabled);
+
 /**
  * The benchmark control function, designed to take some amount of time that might vary with CPU load.
  */
@@ -11,8 +11,8 @@ namespace stream {
 
 using namespace std;
 
-BlockedGzipInputStream::BlockedGzipInputStream(std::istream& stream) : handle(nullptr), byte_count(0),
-    know_offset(false) {
+BlockedGzipInputStream::BlockedGzipInputStream(std::istream& stream, size_t decompression_threads) : handle(nullptr),
+    byte_count(0), know_offset(false), read_ahead(false) {
     
     // See where the stream is
     stream.clear();
@@ -44,6 +44,15 @@ BlockedGzipInputStream::BlockedGzipInputStream(std::istream& stream) : handle(nu
         // Remember the virtual offsets will be valid
         know_offset = true;
     }
+    
+    if (decompression_threads > 0 && bgzf_compression(handle) == 2) {
+        // Have htslib read ahead and decompress blocks on a thread pool. It
+        // hands them back to bgzf_read_block in order, with their addresses
+        // taken from the hFILE, which knows the true stream offset.
+        if (bgzf_mt(handle, decompression_threads, 256) == 0) {
+            read_ahead = true;
+        }
+    }
 }
 
 BlockedGzipInputStream::~BlockedGzipInputStream() {
@@ -216,6 +225,13 @@ int64_t BlockedGzipInputStream::Tell() const {
         if (handle->block_offset == handle->block_length) {
             // We need to know where the next block is
             
+            if (read_ahead) {
+                // The hFILE has been read past this block by the read-ahead
+                // threads, so work from the block's own address and
+                // compressed length instead.
+                return (handle->block_address + handle->block_clength) << 16;
+            }
+            
             // We don't have bgzf_htell so we fake it.
             // We also manually shift the block address to the right place.
             return htell(handle->fp) << 16;
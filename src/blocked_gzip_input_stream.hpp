@@ -23,8 +23,13 @@ public:
     
     /// Make a new stream reading from the given C++ std::istream, wrapping it
     /// in a BGZF. The stream must be at a BGZF block header, since the header
-    /// info is peeked.
-    BlockedGzipInputStream(std::istream& stream);
+    /// info is peeked. If decompression_threads is nonzero and the data is
+    /// blocked gzip, upcoming blocks are read ahead and decompressed on that
+    /// many background threads; they are still returned in order, with
+    /// correct virtual offsets. Read-ahead pulls data from the underlying
+    /// stream past what has been consumed, so only use it when the stream will
+    /// not be read by anything else.
+    BlockedGzipInputStream(std::istream& stream, size_t decompression_threads = 0);
 
     /// Destroy the stream.
     virtual ~BlockedGzipInputStream();
@@ -89,6 +94,9 @@ protected:
     /// Flag for whether our backing stream is tellable.
     bool know_offset;
     
+    /// Flag for whether htslib is decompressing blocks in the background.
+    bool read_ahead;
+    
 };
 
 }
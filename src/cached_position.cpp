@@ -1,4 +1,5 @@
 #include "cached_position.hpp"
+#include "xg_position.hpp"
 
 namespace vg {
 
@@ -115,45 +116,14 @@ map<pos_t, char> xg_cached_next_pos_chars(pos_t pos, xg::XG* xgidx, LRUCache<id_
         ++get_offset(pos);
         nexts[pos] = xg_cached_pos_char(pos, xgidx, node_cache);
     } else {
-        // helper
-        auto is_inverting = [](const Edge& e) {
-            return !(e.from_start() == e.to_end())
-            && (e.from_start() || e.to_end());
-        };
-        // check our cache
-        pair<vector<Edge>, bool> cached = edge_cache.retrieve(id(pos));
-        if(!cached.second) {
-            // If it's not in the cache, put it in
-            for (auto& edge : xgidx->edges_of(id(pos))) {
-                cached.first.push_back(edge);
-            }
-            edge_cache.put(id(pos), cached.first);
-        }
-        auto& edges = cached.first;
-        // look at the next positions we could reach
-        if (!is_rev(pos)) {
-            // we are on the forward strand, the next things from this node come off the end
-            for (auto& edge : edges) {
-                if((edge.to() == id(pos) && edge.to_end()) || (edge.from() == id(pos) && !edge.from_start())) {
-                    id_t nid = (edge.from() == id(pos) ?
-                                edge.to()
-                                : edge.from());
-                    pos_t p = make_pos_t(nid, is_inverting(edge), 0);
-                    nexts[p] = xg_cached_pos_char(p, xgidx, node_cache);
-                }
-            }
-        } else {
-            // we are on the reverse strand, the next things from this node come off the start
-            for (auto& edge : edges) {
-                if((edge.to() == id(pos) && !edge.to_end()) || (edge.from() == id(pos) && edge.from_start())) {
-                    id_t nid = (edge.to() == id(pos) ?
-                                edge.from()
-                                : edge.to());
-                    pos_t p = make_pos_t(nid, !is_inverting(edge), 0);
-                    nexts[p] = xg_cached_pos_char(p, xgidx, node_cache);
-                }
-            }
-        }
+        // Follow the edges off the side we are leaving by. Edges come
+        // straight from the index without being made into Edge objects, so
+        // the edge cache is no longer needed.
+        xgidx->follow_edges(xgidx->get_handle(id(pos), is_rev(pos)), false, [&](const handle_t& next) {
+            pos_t p = make_pos_t(xgidx->get_id(next), xgidx->get_is_reverse(next), 0);
+            nexts[p] = xg_cached_pos_char(p, xgidx, node_cache);
+            return true;
+        });
     }
     return nexts;
 }
@@ -173,78 +143,22 @@ set<pos_t> xg_cached_next_pos(pos_t pos, bool whole_node, xg::XG* xgidx, LRUCach
         ++get_offset(pos);
         nexts.insert(pos);
     } else {
-        // helper
-        auto is_inverting = [](const Edge& e) {
-            return !(e.from_start() == e.to_end())
-            && (e.from_start() || e.to_end());
-        };
-        // check our cache
-        pair<vector<Edge>, bool> cached = edge_cache.retrieve(id(pos));
-        if(!cached.second) {
-            // If it's not in the cache, put it in
-            for (auto& edge : xgidx->edges_of(id(pos))) {
-                cached.first.push_back(edge);
-            }
-            edge_cache.put(id(pos), cached.first);
-        }
-        auto& edges = cached.first;
-        // look at the next positions we could reach
-        if (!is_rev(pos)) {
-            // we are on the forward strand, the next things from this node come off the end
-            for (auto& edge : edges) {
-                if((edge.to() == id(pos) && edge.to_end()) || (edge.from() == id(pos) && !edge.from_start())) {
-                    id_t nid = (edge.from() == id(pos) ?
-                                edge.to()
-                                : edge.from());
-                    nexts.insert(make_pos_t(nid, is_inverting(edge), 0));
-                }
-            }
-        } else {
-            // we are on the reverse strand, the next things from this node come off the start
-            for (auto& edge : edges) {
-                if((edge.to() == id(pos) && !edge.to_end()) || (edge.from() == id(pos) && edge.from_start())) {
-                    id_t nid = (edge.to() == id(pos) ?
-                                edge.from()
-                                : edge.to());
-                    nexts.insert(make_pos_t(nid, !is_inverting(edge), 0));
-                }
-            }
-        }
+        // Follow the edges off the side we are leaving by. Edges come
+        // straight from the index without being made into Edge objects, so
+        // the edge cache is no longer needed.
+        xgidx->follow_edges(xgidx->get_handle(id(pos), is_rev(pos)), false, [&](const handle_t& next) {
+            pos_t p = make_pos_t(xgidx->get_id(next), xgidx->get_is_reverse(next), 0);
+            nexts.insert(p);
+            return true;
+        });
     }
     return nexts;
 }
 
 int64_t xg_cached_distance(pos_t pos1, pos_t pos2, int64_t maximum, xg::XG* xgidx, LRUCache<id_t, Node>& node_cache, LRUCache<id_t, vector<Edge> >& edge_cache) {
-    //cerr << "distance from " << pos1 << " to " << pos2 << endl;
-    if (pos1 == pos2) return 0;
-    int64_t adj = (offset(pos1) == xg_cached_node_length(id(pos1), xgidx, node_cache) ? 0 : 1);
-    set<pos_t> seen;
-    set<pos_t> nexts = xg_cached_next_pos(pos1, false, xgidx, node_cache, edge_cache);
-    int64_t distance = 0;
-    while (!nexts.empty()) {
-        set<pos_t> todo;
-        for (auto& next : nexts) {
-            if (!seen.count(next)) {
-                seen.insert(next);
-                if (next == pos2) {
-                    return distance+adj;
-                }
-                // handle the edge case that we are looking for the position after the end of this node
-                if (make_pos_t(id(next), is_rev(next), offset(next)+1) == pos2) {
-                    return distance+adj+1;
-                }
-                for (auto& x : xg_cached_next_pos(next, false, xgidx, node_cache, edge_cache)) {
-                    todo.insert(x);
-                }
-            }
-        }
-        if (distance == maximum) {
-            break;
-        }
-        nexts = todo;
-        ++distance;
-    }
-    return numeric_limits<int64_t>::max();
+    // The search runs over node lengths and edges straight from the index, so
+    // it doesn't need the caches.
+    return xg_distance(pos1, pos2, maximum, xgidx);
 }
 
 set<pos_t> xg_cached_positions_bp_from(pos_t pos, int64_t distance, bool rev, xg::XG* xgidx, LRUCache<id_t, Node>& node_cache, LRUCache<id_t, vector<Edge> >& edge_cache) {
@@ -292,5 +206,55 @@ set<pos_t> xg_cached_positions_bp_from(pos_t pos, int64_t distance, bool rev, xg
     }
 }
 
+string xg_cached_node_sequence(id_t id, xg::XG* xgidx, SharedSequenceCache& sequence_cache) {
+    pair<string, bool> cached = sequence_cache.retrieve(id);
+    if(!cached.second) {
+        cached.first = xgidx->node_sequence(id);
+        sequence_cache.put(id, cached.first);
+    }
+    return cached.first;
+}
+
+size_t xg_cached_node_length(id_t id, xg::XG* xgidx, SharedSequenceCache& sequence_cache) {
+    return xg_cached_node_sequence(id, xgidx, sequence_cache).size();
+}
+
+char xg_cached_pos_char(pos_t pos, xg::XG* xgidx, SharedSequenceCache& sequence_cache) {
+    string sequence = xg_cached_node_sequence(id(pos), xgidx, sequence_cache);
+    if (is_rev(pos)) {
+        return reverse_complement(sequence[offset(reverse(pos, sequence.size()))-1]);
+    } else {
+        return sequence.at(offset(pos));
+    }
+}
+
+vector<Edge> xg_cached_edges_of(id_t id, xg::XG* xgidx, SharedEdgeCache& edge_cache) {
+    pair<vector<Edge>, bool> cached = edge_cache.retrieve(id);
+    if(!cached.second) {
+        cached.first = xgidx->edges_of(id);
+        edge_cache.put(id, cached.first);
+    }
+    return cached.first;
+}
+
+map<pos_t, char> xg_cached_next_pos_chars(pos_t pos, xg::XG* xgidx, SharedSequenceCache& sequence_cache, SharedEdgeCache& edge_cache) {
+
+    map<pos_t, char> nexts;
+    size_t node_length = xg_cached_node_length(id(pos), xgidx, sequence_cache);
+    // if we are still in the node, return the next position and character
+    if (offset(pos) < node_length-1) {
+        ++get_offset(pos);
+        nexts[pos] = xg_cached_pos_char(pos, xgidx, sequence_cache);
+    } else {
+        // Follow the edges off the side we are leaving by, straight from
+        // the index, so the edge cache is no longer needed.
+        xgidx->follow_edges(xgidx->get_handle(id(pos), is_rev(pos)), false, [&](const handle_t& next) {
+            pos_t p = make_pos_t(xgidx->get_id(next), xgidx->get_is_reverse(next), 0);
+            nexts[p] = xg_cached_pos_char(p, xgidx, sequence_cache);
+            return true;
+        });
+    }
+    return nexts;
+}
 
 }
@@ -5,6 +5,7 @@
 #include "types.hpp"
 #include "xg.hpp"
 #include "lru_cache.h"
+#include "sharded_cache.hpp"
 #include "utility.hpp"
 #include "json2pb.h"
 #include <gcsa/gcsa.h>
@@ -38,6 +39,20 @@ vector<Edge> xg_cached_edges_of(id_t id, xg::XG* xgidx, LRUCache<id_t, vector<Ed
 vector<Edge> xg_cached_edges_on_start(id_t id, xg::XG* xgidx, LRUCache<id_t, vector<Edge> >& edge_cache);
 vector<Edge> xg_cached_edges_on_end(id_t id, xg::XG* xgidx, LRUCache<id_t, vector<Edge> >& edge_cache);
 
+// Versions of the helpers that use caches shared by all threads. Nodes are
+// cached as just their sequences, rather than as whole Node objects.
+
+/// Node sequences, keyed by node ID, safe to share between threads
+typedef ShardedCache<id_t, string> SharedSequenceCache;
+/// Node edge lists, keyed by node ID, safe to share between threads
+typedef ShardedCache<id_t, vector<Edge>> SharedEdgeCache;
+
+string xg_cached_node_sequence(id_t id, xg::XG* xgidx, SharedSequenceCache& sequence_cache);
+size_t xg_cached_node_length(id_t id, xg::XG* xgidx, SharedSequenceCache& sequence_cache);
+char xg_cached_pos_char(pos_t pos, xg::XG* xgidx, SharedSequenceCache& sequence_cache);
+map<pos_t, char> xg_cached_next_pos_chars(pos_t pos, xg::XG* xgidx, SharedSequenceCache& sequence_cache, SharedEdgeCache& edge_cache);
+vector<Edge> xg_cached_edges_of(id_t id, xg::XG* xgidx, SharedEdgeCache& edge_cache);
+
 }
 
 #endif
@@ -77,9 +77,9 @@ void PathChunker::extract_subgraph(const Region& region, int context, int length
     out_region.start = chunk_start_pos;
     out_region.end = out_region.start - 1;
     // Is there a better way to get path length? 
-    Path output_path = subgraph.paths.path(out_region.seq);
-    for (size_t j = 0; j < output_path.mapping_size(); ++j) {
-      int64_t op_node = output_path.mapping(j).position().node_id();
+    // (path is already the subgraph's copy of this path, so don't build it again)
+    for (size_t j = 0; j < path.mapping_size(); ++j) {
+      int64_t op_node = path.mapping(j).position().node_id();
       out_region.end += subgraph.get_node(op_node)->sequence().length();
     }
 }
@@ -4,6 +4,7 @@
 #include <cstring>
 
 #include "cluster.hpp"
+#include "xg_position.hpp"
 
 //#define debug_od_clusterer
 
@@ -83,7 +84,10 @@ MEMChainModel::MEMChainModel(
             for (auto& v1 : p->second) {
                 if (redundant_vertexes.count(v1)) continue;
                 auto q = p;
-                while (++q != c->second.end() && abs(p->first - q->first) < band_width) {
+                // a vertex can only be redundant with v1 if it overlaps v1 in the read at the same
+                // offset it has in the graph, so we only need to look as far as v1's length
+                while (++q != c->second.end() && abs(p->first - q->first) < band_width
+                       && abs(p->first - q->first) < v1->mem.length()) {
                     for (auto& v2 : q->second) {
                         if (redundant_vertexes.count(v2)) continue;
                         if (mems_overlap(v1->mem, v2->mem)
@@ -106,7 +110,8 @@ MEMChainModel::MEMChainModel(
             for (auto& v1 : p->second) {
                 if (redundant_vertexes.count(v1)) continue;
                 auto q = p;
-                while (++q != c->second.rend() && abs(p->first - q->first) < band_width) {
+                while (++q != c->second.rend() && abs(p->first - q->first) < band_width
+                       && abs(p->first - q->first) < v1->mem.length()) {
                     for (auto& v2 : q->second) {
                         if (redundant_vertexes.count(v2)) continue;
                         if (mems_overlap(v1->mem, v2->mem)
@@ -132,7 +137,10 @@ MEMChainModel::MEMChainModel(
                 if (redundant_vertexes.count(v1)) continue;
                 // ...that isn't redundant
                 auto q = p;
-                while (++q != c->second.end() && abs(p->first - q->first) < band_width) {
+                // once v1 has all the outbound connections it can take, nothing later in the band
+                // can be connected to it, so stop looking; in repeats the band can hold many hits
+                while (v1->next_cost.size() < max_connections
+                       && ++q != c->second.end() && abs(p->first - q->first) < band_width) {
                     for (auto& v2 : q->second) {
                         // For each other vertex...
                     
@@ -400,9 +408,11 @@ OrientedDistanceClusterer::OrientedDistanceClusterer(const Alignment& alignment,
                                                      bool unstranded,
                                                      paths_of_node_memo_t* paths_of_node_memo,
                                                      oriented_occurences_memo_t* oriented_occurences_memo,
-                                                     handle_memo_t* handle_memo) :
+                                                     handle_memo_t* handle_memo,
+                                                     DistanceIndex* distance_index) :
     OrientedDistanceClusterer(alignment, mems, nullptr, &aligner, xgindex, max_expected_dist_approx_error,
-                              min_mem_length, unstranded, paths_of_node_memo, oriented_occurences_memo, handle_memo) {
+                              min_mem_length, unstranded, paths_of_node_memo, oriented_occurences_memo, handle_memo,
+                              distance_index) {
     // nothing else to do
 }
 
@@ -415,9 +425,11 @@ OrientedDistanceClusterer::OrientedDistanceClusterer(const Alignment& alignment,
                                                      bool unstranded,
                                                      paths_of_node_memo_t* paths_of_node_memo,
                                                      oriented_occurences_memo_t* oriented_occurences_memo,
-                                                     handle_memo_t* handle_memo) :
+                                                     handle_memo_t* handle_memo,
+                                                     DistanceIndex* distance_index) :
     OrientedDistanceClusterer(alignment, mems, &aligner, nullptr, xgindex, max_expected_dist_approx_error,
-                              min_mem_length, unstranded, paths_of_node_memo, oriented_occurences_memo, handle_memo) {
+                              min_mem_length, unstranded, paths_of_node_memo, oriented_occurences_memo, handle_memo,
+                              distance_index) {
     // nothing else to do
 }
 
@@ -431,7 +443,8 @@ OrientedDistanceClusterer::OrientedDistanceClusterer(const Alignment& alignment,
                                                      bool unstranded,
                                                      paths_of_node_memo_t* paths_of_node_memo,
                                                      oriented_occurences_memo_t* oriented_occurences_memo,
-                                                     handle_memo_t* handle_memo) : aligner(aligner), qual_adj_aligner(qual_adj_aligner) {
+                                                     handle_memo_t* handle_memo,
+                                                     DistanceIndex* distance_index) : aligner(aligner), qual_adj_aligner(qual_adj_aligner) {
     
     // there generally will be at least as many nodes as MEMs, so we can speed up the reallocation
     nodes.reserve(mems.size());
@@ -474,7 +487,7 @@ OrientedDistanceClusterer::OrientedDistanceClusterer(const Alignment& alignment,
     
     // Get all the distances between nodes, in a forrest of unrooted trees of
     // nodes that we know are on a consistent strand.
-    unordered_map<pair<size_t, size_t>, int64_t> recorded_finite_dists = get_on_strand_distance_tree(nodes.size(), unstranded, xgindex,
+    distance_tree_t recorded_finite_dists = get_on_strand_distance_tree(nodes.size(), unstranded, xgindex,
                                                                                                      [&](size_t node_number) {
                                                                                                          return nodes[node_number].start_pos;
                                                                                                      },
@@ -483,10 +496,11 @@ OrientedDistanceClusterer::OrientedDistanceClusterer(const Alignment& alignment,
                                                                                                      },
                                                                                                      paths_of_node_memo,
                                                                                                      oriented_occurences_memo,
-                                                                                                     handle_memo);
+                                                                                                     handle_memo,
+                                                                                                     distance_index);
     
     // Flatten the trees to maps of relative position by node ID.
-    vector<unordered_map<size_t, int64_t>> strand_relative_position = flatten_distance_tree(nodes.size(), recorded_finite_dists);
+    vector<strand_positions_t> strand_relative_position = flatten_distance_tree(nodes.size(), recorded_finite_dists);
     
 #ifdef debug_od_clusterer
     for (const auto& strand : strand_relative_position) {
@@ -521,7 +535,7 @@ OrientedDistanceClusterer::OrientedDistanceClusterer(const Alignment& alignment,
     }
     
     int64_t forward_gap_length = max_gap + max_expected_dist_approx_error;
-    for (const unordered_map<size_t, int64_t>& relative_pos : strand_relative_position) {
+    for (const strand_positions_t& relative_pos : strand_relative_position) {
         
         // sort the nodes by relative position
         vector<pair<int64_t, size_t>> sorted_pos;
@@ -660,15 +674,16 @@ OrientedDistanceClusterer::OrientedDistanceClusterer(const Alignment& alignment,
     }
 }
 
-unordered_map<pair<size_t, size_t>, int64_t> OrientedDistanceClusterer::get_on_strand_distance_tree(size_t num_items, bool unstranded, xg::XG* xgindex,
+OrientedDistanceClusterer::distance_tree_t OrientedDistanceClusterer::get_on_strand_distance_tree(size_t num_items, bool unstranded, xg::XG* xgindex,
                                                                                                     const function<pos_t(size_t)>& get_position,
                                                                                                     const function<int64_t(size_t)>& get_offset,
                                                                                                     paths_of_node_memo_t* paths_of_node_memo,
                                                                                                     oriented_occurences_memo_t* oriented_occurences_memo,
-                                                                                                    handle_memo_t* handle_memo) {
+                                                                                                    handle_memo_t* handle_memo,
+                                                                                                    DistanceIndex* distance_index) {
     
     // for recording the distance of any pair that we check with a finite distance
-    unordered_map<pair<size_t, size_t>, int64_t> recorded_finite_dists;
+    distance_tree_t recorded_finite_dists;
     
     // for recording the number of times elements of a strand cluster have been compared
     // and found an infinite distance
@@ -697,9 +712,10 @@ unordered_map<pair<size_t, size_t>, int64_t> OrientedDistanceClusterer::get_on_s
     
     // a second pass that tries fill in the tree by traversing to the nearest shared path
     size_t nlogn = ceil(num_items * log(num_items));
+    DistanceIndex::AncestorMemo ancestor_memo;
     extend_dist_tree_by_permutations(max_failed_distance_probes, 50, nlogn, num_possible_merges_remaining, component_union_find,
                                      recorded_finite_dists, num_infinite_dists, unstranded, num_items, xgindex, get_position, get_offset, paths_of_node_memo,
-                                     oriented_occurences_memo, handle_memo);
+                                     oriented_occurences_memo, handle_memo, distance_index, &ancestor_memo);
     
     return recorded_finite_dists;
 }
@@ -785,7 +801,7 @@ void OrientedDistanceClusterer::exclude_dist_tree_merges_by_components(int64_t m
 void OrientedDistanceClusterer::extend_dist_tree_by_path_buckets(int64_t max_failed_distance_probes,
                                                                  size_t& num_possible_merges_remaining,
                                                                  UnionFind& component_union_find,
-                                                                 unordered_map<pair<size_t, size_t>, int64_t>& recorded_finite_dists,
+                                                                 distance_tree_t& recorded_finite_dists,
                                                                  map<pair<size_t, size_t>, size_t>& num_infinite_dists,
                                                                  size_t num_items,
                                                                  xg::XG* xgindex,
@@ -938,7 +954,7 @@ void OrientedDistanceClusterer::extend_dist_tree_by_path_buckets(int64_t max_fai
 void OrientedDistanceClusterer::extend_dist_tree_by_strand_buckets(int64_t max_failed_distance_probes,
                                                                    size_t& num_possible_merges_remaining,
                                                                    UnionFind& component_union_find,
-                                                                   unordered_map<pair<size_t, size_t>, int64_t>& recorded_finite_dists,
+                                                                   distance_tree_t& recorded_finite_dists,
                                                                    map<pair<size_t, size_t>, size_t>& num_infinite_dists,
                                                                    size_t num_items,
                                                                    xg::XG* xgindex,
@@ -1120,7 +1136,7 @@ void OrientedDistanceClusterer::extend_dist_tree_by_permutations(int64_t max_fai
                                                                  size_t decrement_frequency,
                                                                  size_t& num_possible_merges_remaining,
                                                                  UnionFind& component_union_find,
-                                                                 unordered_map<pair<size_t, size_t>, int64_t>& recorded_finite_dists,
+                                                                 distance_tree_t& recorded_finite_dists,
                                                                  map<pair<size_t, size_t>, size_t>& num_infinite_dists,
                                                                  bool unstranded,
                                                                  size_t num_items,
@@ -1129,7 +1145,34 @@ void OrientedDistanceClusterer::extend_dist_tree_by_permutations(int64_t max_fai
                                                                  const function<int64_t(size_t)>& get_offset,
                                                                  paths_of_node_memo_t* paths_of_node_memo,
                                                                  oriented_occurences_memo_t* oriented_occurences_memo,
-                                                                 handle_memo_t* handle_memo) {
+                                                                 handle_memo_t* handle_memo,
+                                                                 DistanceIndex* distance_index,
+                                                                 DistanceIndex::AncestorMemo* ancestor_memo) {
+    
+    // Before the permuted pairs, we probe each hit against the next one in the graph's linear
+    // order. Those are the pairs most likely to reach a shared path within the search distance,
+    // and every merge they make lets the permuted pairs between the merged groups be skipped
+    // without a probe.
+    vector<pair<size_t, size_t>> neighbor_pairs;
+    if (num_items > 1) {
+        vector<pair<int64_t, size_t>> linear_order(num_items);
+        for (size_t i = 0; i < num_items; i++) {
+            pos_t pos = get_position(i);
+            if (is_rev(pos)) {
+                pos = reverse(pos, xg_node_length(id(pos), xgindex));
+            }
+            linear_order[i] = make_pair(xg_node_start(id(pos), xgindex) + (int64_t) offset(pos), i);
+        }
+        sort(linear_order.begin(), linear_order.end());
+        neighbor_pairs.reserve(num_items - 1);
+        for (size_t i = 1; i < num_items; i++) {
+            neighbor_pairs.emplace_back(min(linear_order[i - 1].second, linear_order[i].second),
+                                        max(linear_order[i - 1].second, linear_order[i].second));
+        }
+    }
+    auto next_neighbor_pair = neighbor_pairs.begin();
+    // don't probe the same pair twice when the permutation comes back to it
+    unordered_set<pair<size_t, size_t>> neighbor_pairs_drawn;
     
     // We want to run through all possible pairsets of node numbers in a permuted order.
     ShuffledPairs shuffled_pairs(num_items);
@@ -1140,7 +1183,8 @@ void OrientedDistanceClusterer::extend_dist_tree_by_permutations(int64_t max_fai
     // to be connected with probability approaching 1
     size_t current_max_num_probes = max_failed_distance_probes;
     
-    while (num_possible_merges_remaining > 0 && current_pair != shuffled_pairs.end() && current_max_num_probes > 0) {
+    while (num_possible_merges_remaining > 0 && current_max_num_probes > 0
+           && (next_neighbor_pair != neighbor_pairs.end() || current_pair != shuffled_pairs.end())) {
         // slowly lower the number of distances we need to check before we believe that two clusters are on
         // separate strands
 #ifdef debug_od_clusterer
@@ -1167,8 +1211,22 @@ void OrientedDistanceClusterer::extend_dist_tree_by_permutations(int64_t max_fai
         }
         
         
-        pair<size_t, size_t> node_pair = *current_pair;
-        ++current_pair;
+        pair<size_t, size_t> node_pair;
+        if (next_neighbor_pair != neighbor_pairs.end()) {
+            node_pair = *next_neighbor_pair;
+            ++next_neighbor_pair;
+            neighbor_pairs_drawn.insert(node_pair);
+        }
+        else {
+            while (current_pair != shuffled_pairs.end() && neighbor_pairs_drawn.count(*current_pair)) {
+                ++current_pair;
+            }
+            if (current_pair == shuffled_pairs.end()) {
+                break;
+            }
+            node_pair = *current_pair;
+            ++current_pair;
+        }
         
         pairs_checked++;
         
@@ -1202,7 +1260,13 @@ void OrientedDistanceClusterer::extend_dist_tree_by_permutations(int64_t max_fai
         const pos_t& pos_2 = get_position(node_pair.second);
         
         int64_t oriented_dist;
-        if (unstranded) {
+        if (distance_index && distance_index->snarlOf(id(pos_1)) && distance_index->snarlOf(id(pos_2))
+            && distance_index->distance(pos_1, pos_2, ancestor_memo) == -1) {
+            // the snarl tree shows there is no path between these hits at all, so they can't be on
+            // the same strand and there's no point probing for a shared path
+            oriented_dist = numeric_limits<int64_t>::max();
+        }
+        else if (unstranded) {
             oriented_dist = xgindex->closest_shared_path_unstranded_distance(id(pos_1), offset(pos_1), is_rev(pos_1),
                                                                              id(pos_2), offset(pos_2), is_rev(pos_2),
                                                                              max_search_distance_to_path, paths_of_node_memo,
@@ -1409,8 +1473,8 @@ void OrientedDistanceClusterer::extend_dist_tree_by_permutations(int64_t max_fai
     }
 }
 
-vector<unordered_map<size_t, int64_t>> OrientedDistanceClusterer::flatten_distance_tree(size_t num_items,
-                                                                                        const unordered_map<pair<size_t, size_t>, int64_t>& recorded_finite_dists) {
+vector<OrientedDistanceClusterer::strand_positions_t> OrientedDistanceClusterer::flatten_distance_tree(size_t num_items,
+                                                                                        const distance_tree_t& recorded_finite_dists) {
     
 #ifdef debug_od_clusterer
     cerr << "constructing strand distance tree from " << num_items << " distances records:" << endl;
@@ -1429,7 +1493,7 @@ vector<unordered_map<size_t, int64_t>> OrientedDistanceClusterer::flatten_distan
     
     // now approximate the relative positions along the strand by traversing each tree and
     // treating the distances we estimated as transitive
-    vector<unordered_map<size_t, int64_t>> strand_relative_position;
+    vector<strand_positions_t> strand_relative_position;
     vector<bool> processed(num_items, false);
     for (size_t i = 0; i < num_items; i++) {
         if (processed[i]) {
@@ -1440,7 +1504,7 @@ vector<unordered_map<size_t, int64_t>> OrientedDistanceClusterer::flatten_distan
         cerr << "beginning a distance tree traversal at item " << i << endl;
 #endif
         strand_relative_position.emplace_back();
-        unordered_map<size_t, int64_t>& relative_pos = strand_relative_position.back();
+        strand_positions_t& relative_pos = strand_relative_position.back();
         
         // arbitrarily make this node the 0 point
         relative_pos[i] = 0;
@@ -1974,7 +2038,8 @@ vector<pair<pair<size_t, size_t>, int64_t>> OrientedDistanceClusterer::pair_clus
                                                                                      bool unstranded,
                                                                                      paths_of_node_memo_t* paths_of_node_memo,
                                                                                      oriented_occurences_memo_t* oriented_occurences_memo,
-                                                                                     handle_memo_t* handle_memo) {
+                                                                                     handle_memo_t* handle_memo,
+                                                                                     DistanceIndex* distance_index) {
     
 #ifdef debug_od_clusterer
     cerr << "beginning clustering of MEM cluster pairs for " << left_clusters.size() << " left clusters and " << right_clusters.size() << " right clusters" << endl;
@@ -1994,7 +2059,7 @@ vector<pair<pair<size_t, size_t>, int64_t>> OrientedDistanceClusterer::pair_clus
     size_t total_cluster_positions = total_clusters + total_alt_anchors;
     
     // Compute distance trees for sets of clusters that are distance-able on consistent strands.
-    unordered_map<pair<size_t, size_t>, int64_t> distance_tree = get_on_strand_distance_tree(total_cluster_positions, unstranded, xgindex,
+    distance_tree_t distance_tree = get_on_strand_distance_tree(total_cluster_positions, unstranded, xgindex,
          [&](size_t cluster_num) {
              // Assumes the clusters are nonempty.
              if (cluster_num < left_clusters.size()) {
@@ -2034,10 +2099,10 @@ vector<pair<pair<size_t, size_t>, int64_t>> OrientedDistanceClusterer::pair_clus
                  return alignment_2.sequence().end() - right_clusters[alt_anchor.first]->at(alt_anchor.second).first->begin;
              }
          },
-         paths_of_node_memo, oriented_occurences_memo, handle_memo);
+         paths_of_node_memo, oriented_occurences_memo, handle_memo, distance_index);
     
     // Flatten the distance tree to a set of linear spaces, one per tree.
-    vector<unordered_map<size_t, int64_t>> linear_spaces = flatten_distance_tree(total_cluster_positions, distance_tree);
+    vector<strand_positions_t> linear_spaces = flatten_distance_tree(total_cluster_positions, distance_tree);
     
 #ifdef debug_od_clusterer
     for (const auto& strand : linear_spaces) {
@@ -2062,7 +2127,7 @@ vector<pair<pair<size_t, size_t>, int64_t>> OrientedDistanceClusterer::pair_clus
     }
 #endif
     
-    for (const unordered_map<size_t, int64_t>& linear_space : linear_spaces) {
+    for (const strand_positions_t& linear_space : linear_spaces) {
         // For each linear space
         
         // The linear space may run forward or reverse relative to our read.
@@ -10,6 +10,8 @@
 #include "mem.hpp"
 #include "xg.hpp"
 #include "handle.hpp"
+#include "distance.hpp"
+#include "hash_map.hpp"
 
 #include <functional>
 #include <string>
@@ -168,7 +170,15 @@ public:
     /// A memo for the results of XG::get_handle
     using handle_memo_t = unordered_map<pair<int64_t, bool>, handle_t>;
     
-    /// Constructor using QualAdjAligner, optionally memoizing succinct data structure operations
+    /// Signed distances between items (lower number first) along a strand
+    using distance_tree_t = hot_hash_map<pair<size_t, size_t>, int64_t>;
+    
+    /// Positions of items relative to one item on a strand
+    using strand_positions_t = hot_hash_map<size_t, int64_t>;
+    
+    /// Constructor using QualAdjAligner, optionally memoizing succinct data structure operations.
+    /// If a DistanceIndex is given, it is used to skip distance probes between hits that the snarl
+    /// tree shows can't reach each other.
     OrientedDistanceClusterer(const Alignment& alignment,
                               const vector<MaximalExactMatch>& mems,
                               const QualAdjAligner& aligner,
@@ -178,9 +188,11 @@ public:
                               bool unstranded = false,
                               paths_of_node_memo_t* paths_of_node_memo = nullptr,
                               oriented_occurences_memo_t* oriented_occurences_memo = nullptr,
-                              handle_memo_t* handle_memo = nullptr);
+                              handle_memo_t* handle_memo = nullptr,
+                              DistanceIndex* distance_index = nullptr);
     
-    /// Constructor using Aligner, optionally memoizing succinct data structure operations
+    /// Constructor using Aligner, optionally memoizing succinct data structure operations and
+    /// using a DistanceIndex to skip distance probes
     OrientedDistanceClusterer(const Alignment& alignment,
                               const vector<MaximalExactMatch>& mems,
                               const Aligner& aligner,
@@ -190,7 +202,8 @@ public:
                               bool unstranded = false,
                               paths_of_node_memo_t* paths_of_node_memo = nullptr,
                               oriented_occurences_memo_t* oriented_occurences_memo = nullptr,
-                              handle_memo_t* handle_memo = nullptr);
+                              handle_memo_t* handle_memo = nullptr,
+                              DistanceIndex* distance_index = nullptr);
     
     /// Returns a vector of clusters. Each cluster is represented a vector of MEM hits. Each hit
     /// contains a pointer to the original MEM and the position of that particular hit in the graph.
@@ -217,7 +230,8 @@ public:
                                                                      bool unstranded,
                                                                      paths_of_node_memo_t* paths_of_node_memo = nullptr,
                                                                      oriented_occurences_memo_t* oriented_occurences_memo = nullptr,
-                                                                     handle_memo_t* handle_memo = nullptr);
+                                                                     handle_memo_t* handle_memo = nullptr,
+                                                                     DistanceIndex* distance_index = nullptr);
     
     //static size_t PRUNE_COUNTER;
     //static size_t CLUSTER_TOTAL;
@@ -244,7 +258,8 @@ private:
                               bool unstranded,
                               paths_of_node_memo_t* paths_of_node_memo,
                               oriented_occurences_memo_t* oriented_occurences_memo,
-                              handle_memo_t* handle_memo);
+                              handle_memo_t* handle_memo,
+                              DistanceIndex* distance_index);
     
     /**
      * Given a certain number of items, and a callback to get each item's
@@ -256,27 +271,34 @@ private:
      * the strand they fall on using the oriented distance estimation function
      * in xg.
      *
+     * If a DistanceIndex is given, pairs that it shows have no path between
+     * them are counted as infinitely far apart without probing for paths.
+     *
      * Returns a map from item pair (lower number first) to distance (which may
      * be negative) from the first to the second along the items' forward
      * strand.
      */
-    static unordered_map<pair<size_t, size_t>, int64_t> get_on_strand_distance_tree(size_t num_items, bool unstranded, xg::XG* xgindex,
+    static distance_tree_t get_on_strand_distance_tree(size_t num_items, bool unstranded, xg::XG* xgindex,
                                                                                     const function<pos_t(size_t)>& get_position,
                                                                                     const function<int64_t(size_t)>& get_offset,
                                                                                     paths_of_node_memo_t* paths_of_node_memo,
                                                                                     oriented_occurences_memo_t* oriented_occurences_memo,
-                                                                                    handle_memo_t* handle_memo);
+                                                                                    handle_memo_t* handle_memo,
+                                                                                    DistanceIndex* distance_index);
     
     /**
      * Adds edges into the distance tree by estimating the distance between pairs
-     * generated by a high entropy deterministic permutation
+     * generated by a high entropy deterministic permutation, after first trying
+     * each item against its neighbor in the graph's linear order. If there is a
+     * DistanceIndex, the snarl ancestors of the items are memoized across pairs
+     * in the given memo.
      */
     static void extend_dist_tree_by_permutations(int64_t max_failed_distance_probes,
                                                  int64_t max_search_distance_to_path,
                                                  size_t decrement_frequency,
                                                  size_t& num_possible_merges_remaining,
                                                  UnionFind& component_union_find,
-                                                 unordered_map<pair<size_t, size_t>, int64_t>& recorded_finite_dists,
+                                                 distance_tree_t& recorded_finite_dists,
                                                  map<pair<size_t, size_t>, size_t>& num_infinite_dists,
                                                  bool unstranded,
                                                  size_t num_items,
@@ -285,7 +307,9 @@ private:
                                                  const function<int64_t(size_t)>& get_offset,
                                                  paths_of_node_memo_t* paths_of_node_memo,
                                                  oriented_occurences_memo_t* oriented_occurences_memo,
-                                                 handle_memo_t* handle_memo);
+                                                 handle_memo_t* handle_memo,
+                                                 DistanceIndex* distance_index,
+                                                 DistanceIndex::AncestorMemo* ancestor_memo);
     
     
     /**
@@ -296,7 +320,7 @@ private:
     static void extend_dist_tree_by_strand_buckets(int64_t max_failed_distance_probes,
                                                    size_t& num_possible_merges_remaining,
                                                    UnionFind& component_union_find,
-                                                   unordered_map<pair<size_t, size_t>, int64_t>& recorded_finite_dists,
+                                                   distance_tree_t& recorded_finite_dists,
                                                    map<pair<size_t, size_t>, size_t>& num_infinite_dists,
                                                    size_t num_items,
                                                    xg::XG* xgindex,
@@ -312,7 +336,7 @@ private:
     static void extend_dist_tree_by_path_buckets(int64_t max_failed_distance_probes,
                                                  size_t& num_possible_merges_remaining,
                                                  UnionFind& component_union_find,
-                                                 unordered_map<pair<size_t, size_t>, int64_t>& recorded_finite_dists,
+                                                 distance_tree_t& recorded_finite_dists,
                                                  map<pair<size_t, size_t>, size_t>& num_infinite_dists,
                                                  size_t num_items,
                                                  xg::XG* xgindex,
@@ -347,8 +371,8 @@ private:
      * Assumes all the distances are transitive, even though this isn't quite
      * true in graph space.
      */
-    static vector<unordered_map<size_t, int64_t>> flatten_distance_tree(size_t num_items,
-                                                                        const unordered_map<pair<size_t, size_t>, int64_t>& recorded_finite_dists);
+    static vector<strand_positions_t> flatten_distance_tree(size_t num_items,
+                                                                        const distance_tree_t& recorded_finite_dists);
     
     /// Returns a vector containing the number of SMEM beginnings to the left and the number of SMEM
     /// endings to the right of each read position
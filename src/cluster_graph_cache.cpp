@@ -0,0 +1,64 @@
+#include "cluster_graph_cache.hpp"
+#include "graph.hpp"
+
+/**
+ * \file cluster_graph_cache.cpp: implementation of the cache of cluster subgraphs
+ */
+
+namespace vg {
+
+using namespace std;
+
+ClusterGraphCache::ClusterGraphCache(size_t capacity) : cache(capacity) {
+    // nothing to do
+}
+
+string ClusterGraphCache::key_for(const Alignment& aln, const vector<MaximalExactMatch>& mems) {
+    // The subgraph depends on how much read there is around each MEM, where
+    // each MEM starts in the graph, and what it spells, since that is used to
+    // walk it through the graph.
+    string key;
+    auto append_word = [&](int64_t word) {
+        key.append(reinterpret_cast<const char*>(&word), sizeof(word));
+    };
+    append_word(aln.sequence().size());
+    append_word(mems.size());
+    for (auto& mem : mems) {
+        append_word(mem.begin - aln.sequence().begin());
+        append_word(mem.end - mem.begin);
+        append_word(mem.nodes.empty() ? 0 : mem.nodes.front());
+        key.append(mem.begin, mem.end);
+    }
+    return key;
+}
+
+shared_ptr<const ClusterGraph> ClusterGraphCache::get(const Alignment& aln, const vector<MaximalExactMatch>& mems,
+                                                      const function<Graph()>& extract) {
+    string key = key_for(aln, mems);
+    auto cached = cache.retrieve(key);
+    if (cached.second) {
+        return cached.first;
+    }
+
+    // Other threads may be extracting the same subgraph right now; that's
+    // fine, they will all get the same graph.
+    shared_ptr<ClusterGraph> made = make_shared<ClusterGraph>();
+    made->graph = extract();
+    made->acyclic_and_sorted = is_id_sortable(made->graph) && !has_inversion(made->graph);
+    cache.put(key, made);
+    return made;
+}
+
+size_t ClusterGraphCache::hits() const {
+    return cache.hits();
+}
+
+size_t ClusterGraphCache::misses() const {
+    return cache.misses();
+}
+
+size_t ClusterGraphCache::size() const {
+    return cache.size();
+}
+
+}
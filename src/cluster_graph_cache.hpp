@@ -0,0 +1,72 @@
+#ifndef VG_CLUSTER_GRAPH_CACHE_HPP_INCLUDED
+#define VG_CLUSTER_GRAPH_CACHE_HPP_INCLUDED
+
+/** \file
+ * A cache of the subgraphs that clusters of MEMs are aligned against, so
+ * reads from the same locus (deep targeted sequencing, amplicons, collapsed
+ * repeats) don't each pull the same graph out of the xg again.
+ */
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "vg.pb.h"
+#include "mem.hpp"
+#include "sharded_cache.hpp"
+
+namespace vg {
+
+using namespace std;
+
+/**
+ * A subgraph ready to be aligned to, along with what we know about it.
+ */
+struct ClusterGraph {
+    /// The subgraph, sorted by ID and deduplicated
+    Graph graph;
+    /// Whether gssw can align to the graph directly, without unrolling it
+    /// into a DAG first
+    bool acyclic_and_sorted = false;
+};
+
+/**
+ * Remembers the cluster subgraph for each arrangement of MEMs in a read. The
+ * subgraph only depends on where the MEMs are in the read and in the graph,
+ * so every read with the same anchors shares one copy. Safe to share between
+ * threads.
+ */
+class ClusterGraphCache {
+public:
+
+    /// Make a cache holding about the given number of subgraphs.
+    ClusterGraphCache(size_t capacity);
+
+    /// Get the subgraph to align the given read's cluster to, calling extract
+    /// to make it if it isn't cached. The MEMs must point into the read's
+    /// sequence, and extract must only depend on the MEMs and the read's
+    /// length.
+    shared_ptr<const ClusterGraph> get(const Alignment& aln, const vector<MaximalExactMatch>& mems,
+                                       const function<Graph()>& extract);
+
+    /// Get the number of lookups that found their subgraph.
+    size_t hits() const;
+
+    /// Get the number of lookups that had to extract their subgraph.
+    size_t misses() const;
+
+    /// Get the number of subgraphs cached.
+    size_t size() const;
+
+private:
+
+    /// Get the key that identifies the subgraph for a cluster.
+    static string key_for(const Alignment& aln, const vector<MaximalExactMatch>& mems);
+
+    ShardedCache<string, shared_ptr<const ClusterGraph>, std::hash<string>> cache;
+};
+
+}
+
+#endif
@@ -0,0 +1,420 @@
+#include "compact_alignment.hpp"
+
+#include <stdexcept>
+#include <vector>
+
+/**
+ * \file compact_alignment.cpp: implementation of the compact reference-relative Alignment encoding
+ */
+
+namespace vg {
+
+using namespace std;
+
+/// Return true if a path can be stored as node steps and edits, and false if
+/// it has to be stored as it is.
+static bool path_is_compactable(const Path& path, const xg::XG& graph) {
+    if (!path.name().empty() || path.is_circular() || path.length() != 0) {
+        return false;
+    }
+    bool ranked = path.mapping_size() > 0 && path.mapping(0).rank() != 0;
+    for (size_t i = 0; i < path.mapping_size(); i++) {
+        auto& mapping = path.mapping(i);
+        auto& position = mapping.position();
+        if (mapping.rank() != (ranked ? i + 1 : 0) || !position.name().empty() || position.offset() < 0 ||
+            position.node_id() <= 0 || !graph.has_node(position.node_id())) {
+            return false;
+        }
+        // an edit count of 0 means something else
+        if (mapping.edit_size() == 0) {
+            return false;
+        }
+        for (auto& edit : mapping.edit()) {
+            if (edit.from_length() < 0 || edit.to_length() < 0) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+CompactAlignment compact_alignment(const Alignment& aln, const xg::XG& graph, bool bin_quality) {
+    CompactAlignment compact;
+    Alignment& rest = *compact.mutable_alignment();
+    rest = aln;
+    if (bin_quality) {
+        bin_qualities(*rest.mutable_quality());
+    }
+
+    const Path& path = aln.path();
+    if (path.mapping_size() == 0 || !path_is_compactable(path, graph)) {
+        return compact;
+    }
+    rest.clear_path();
+    compact.set_ranked(path.mapping(0).rank() != 0);
+
+    // the sequence the path spells, which may make the read's sequence redundant
+    string spelled;
+    bool spelled_ok = true;
+    id_t prev_id = 0;
+    for (auto& mapping : path.mapping()) {
+        auto& position = mapping.position();
+        compact.add_node_step((position.node_id() - prev_id) * 2 + (position.is_reverse() ? 1 : 0));
+        compact.add_offset(position.offset());
+        prev_id = position.node_id();
+
+        string node_seq = graph.get_sequence(graph.get_handle(position.node_id(), position.is_reverse()));
+        size_t node_offset = position.offset();
+
+        auto& first_edit = mapping.edit(0);
+        if (mapping.edit_size() == 1 && first_edit.sequence().empty() &&
+            first_edit.from_length() == first_edit.to_length() &&
+            node_offset + first_edit.from_length() == node_seq.size()) {
+            // the most common case by far: the read matches the rest of the node
+            compact.add_edit_count(0);
+            spelled.append(node_seq, node_offset, string::npos);
+            continue;
+        }
+
+        compact.add_edit_count(mapping.edit_size());
+        for (auto& edit : mapping.edit()) {
+            compact.add_from_length(edit.from_length());
+            compact.add_to_length(edit.to_length() * 2 + (edit.sequence().empty() ? 0 : 1));
+            if (!edit.sequence().empty()) {
+                compact.mutable_edit_sequence()->append(edit.sequence());
+                spelled.append(edit.sequence());
+            } else if (edit.to_length() > 0) {
+                if (edit.from_length() != edit.to_length() || node_offset + edit.to_length() > node_seq.size()) {
+                    // this isn't a match to the graph, so we can't tell what it spells
+                    spelled_ok = false;
+                } else {
+                    spelled.append(node_seq, node_offset, edit.to_length());
+                }
+            }
+            node_offset += edit.from_length();
+        }
+    }
+
+    if (spelled_ok && spelled == aln.sequence()) {
+        rest.clear_sequence();
+        compact.set_sequence_implied(true);
+    }
+
+    return compact;
+}
+
+Alignment expand_alignment(const CompactAlignment& compact, const xg::XG& graph) {
+    Alignment aln = compact.alignment();
+    if (aln.path().mapping_size() != 0 || compact.node_step_size() == 0) {
+        // the path was kept as it was, or there isn't one
+        if (compact.sequence_implied()) {
+            throw runtime_error("CompactAlignment for " + aln.name() + " implies a sequence but has no compact path");
+        }
+        return aln;
+    }
+
+    if (compact.offset_size() != compact.node_step_size() || compact.edit_count_size() != compact.node_step_size() ||
+        compact.from_length_size() != compact.to_length_size()) {
+        throw runtime_error("CompactAlignment for " + aln.name() + " has inconsistent mapping or edit counts");
+    }
+
+    Path& path = *aln.mutable_path();
+    bool spell = compact.sequence_implied();
+    string spelled;
+    size_t next_edit = 0;
+    size_t next_base = 0;
+    id_t node_id = 0;
+    for (size_t i = 0; i < compact.node_step_size(); i++) {
+        int64_t step = compact.node_step(i);
+        bool is_reverse = step & 1;
+        node_id += (step - (step & 1)) / 2;
+        if (!graph.has_node(node_id)) {
+            throw runtime_error("CompactAlignment for " + aln.name() + " visits node " + to_string(node_id) +
+                                ", which is not in the graph");
+        }
+        handle_t handle = graph.get_handle(node_id, is_reverse);
+
+        Mapping& mapping = *path.add_mapping();
+        Position& position = *mapping.mutable_position();
+        position.set_node_id(node_id);
+        position.set_offset(compact.offset(i));
+        position.set_is_reverse(is_reverse);
+        if (compact.ranked()) {
+            mapping.set_rank(i + 1);
+        }
+
+        string node_seq;
+        if (spell) {
+            node_seq = graph.get_sequence(handle);
+        }
+        size_t node_offset = compact.offset(i);
+
+        if (compact.edit_count(i) == 0) {
+            size_t node_length = graph.get_length(handle);
+            if (node_offset > node_length) {
+                throw runtime_error("CompactAlignment for " + aln.name() + " has an offset past the end of node " +
+                                    to_string(node_id));
+            }
+            Edit& edit = *mapping.add_edit();
+            edit.set_from_length(node_length - node_offset);
+            edit.set_to_length(node_length - node_offset);
+            if (spell) {
+                spelled.append(node_seq, node_offset, string::npos);
+            }
+            continue;
+        }
+
+        for (size_t j = 0; j < compact.edit_count(i); j++, next_edit++) {
+            if (next_edit >= compact.from_length_size()) {
+                throw runtime_error("CompactAlignment for " + aln.name() + " has fewer edits than its mappings need");
+            }
+            Edit& edit = *mapping.add_edit();
+            uint32_t to_length = compact.to_length(next_edit) / 2;
+            edit.set_from_length(compact.from_length(next_edit));
+            edit.set_to_length(to_length);
+            if (compact.to_length(next_edit) & 1) {
+                if (next_base + to_length > compact.edit_sequence().size()) {
+                    throw runtime_error("CompactAlignment for " + aln.name() + " has less edit sequence than its edits need");
+                }
+                edit.set_sequence(compact.edit_sequence().substr(next_base, to_length));
+                next_base += to_length;
+                if (spell) {
+                    spelled.append(edit.sequence());
+                }
+            } else if (spell && to_length > 0) {
+                spelled.append(node_seq, min(node_offset, node_seq.size()), to_length);
+            }
+            node_offset += edit.from_length();
+        }
+    }
+
+    if (next_edit != compact.from_length_size() || next_base != compact.edit_sequence().size()) {
+        throw runtime_error("CompactAlignment for " + aln.name() + " has edits left over after its mappings");
+    }
+
+    if (spell) {
+        aln.set_sequence(spelled);
+    }
+
+    return aln;
+}
+
+vector<int64_t> subpath_predecessors(const MultipathAlignment& multipath_aln) {
+    vector<int64_t> predecessors(multipath_aln.subpath_size(), -1);
+    for (size_t i = 0; i < multipath_aln.subpath_size(); i++) {
+        for (uint32_t next : multipath_aln.subpath(i).next()) {
+            if (next > i && next < predecessors.size() && predecessors[next] == -1) {
+                predecessors[next] = i;
+            }
+        }
+    }
+    return predecessors;
+}
+
+/// Get the number of read bases a path covers.
+static size_t read_length_of(const Path& path) {
+    size_t length = 0;
+    for (auto& mapping : path.mapping()) {
+        for (auto& edit : mapping.edit()) {
+            length += edit.to_length();
+        }
+    }
+    return length;
+}
+
+CompactMultipathAlignment compact_multipath_alignment(const MultipathAlignment& multipath_aln, const xg::XG& graph,
+                                                      bool bin_quality) {
+    CompactMultipathAlignment compact;
+    MultipathAlignment& rest = *compact.mutable_multipath_alignment();
+    rest = multipath_aln;
+    if (bin_quality) {
+        bin_qualities(*rest.mutable_quality());
+    }
+
+    const string& read = multipath_aln.sequence();
+    vector<int64_t> predecessors = subpath_predecessors(multipath_aln);
+    // where each subpath ends, in the read and in the graph
+    vector<size_t> read_end(multipath_aln.subpath_size(), 0);
+    vector<id_t> last_node(multipath_aln.subpath_size(), 0);
+    // the edit sequences, in case they can't all be copied from the read
+    string edit_sequence;
+    bool from_read = true;
+
+    for (size_t i = 0; i < multipath_aln.subpath_size(); i++) {
+        const Path& path = multipath_aln.subpath(i).path();
+        size_t read_offset = predecessors[i] >= 0 ? read_end[predecessors[i]] : 0;
+        id_t prev_id = predecessors[i] >= 0 ? last_node[predecessors[i]] : 0;
+
+        if (path.mapping_size() == 0 || !path_is_compactable(path, graph)) {
+            // keep the path as it is
+            compact.add_mapping_count(0);
+            read_end[i] = read_offset + read_length_of(path);
+            last_node[i] = path.mapping_size() != 0 ? path.mapping(path.mapping_size() - 1).position().node_id() : prev_id;
+            continue;
+        }
+        rest.mutable_subpath(i)->clear_path();
+        compact.add_mapping_count(path.mapping_size() * 2 + (path.mapping(0).rank() != 0 ? 1 : 0));
+
+        for (auto& mapping : path.mapping()) {
+            auto& position = mapping.position();
+            compact.add_node_step((position.node_id() - prev_id) * 2 + (position.is_reverse() ? 1 : 0));
+            compact.add_offset(position.offset());
+            prev_id = position.node_id();
+
+            auto& first_edit = mapping.edit(0);
+            if (mapping.edit_size() == 1 && first_edit.sequence().empty() &&
+                first_edit.from_length() == first_edit.to_length() &&
+                position.offset() + first_edit.from_length() == graph.get_length(graph.get_handle(position.node_id()))) {
+                // the read matches the rest of the node
+                compact.add_edit_count(0);
+                read_offset += first_edit.to_length();
+                continue;
+            }
+
+            compact.add_edit_count(mapping.edit_size());
+            for (auto& edit : mapping.edit()) {
+                compact.add_from_length(edit.from_length());
+                compact.add_to_length(edit.to_length() * 2 + (edit.sequence().empty() ? 0 : 1));
+                if (!edit.sequence().empty()) {
+                    edit_sequence.append(edit.sequence());
+                    if (from_read && (edit.sequence().size() != edit.to_length() ||
+                                      read_offset + edit.to_length() > read.size() ||
+                                      read.compare(read_offset, edit.to_length(), edit.sequence()) != 0)) {
+                        // this edit's bases aren't where we'd look for them
+                        from_read = false;
+                    }
+                }
+                read_offset += edit.to_length();
+            }
+        }
+        read_end[i] = read_offset;
+        last_node[i] = prev_id;
+    }
+
+    if (from_read) {
+        compact.set_edit_sequences_from_read(true);
+    } else {
+        compact.set_edit_sequence(edit_sequence);
+    }
+
+    return compact;
+}
+
+MultipathAlignment expand_multipath_alignment(const CompactMultipathAlignment& compact, const xg::XG& graph) {
+    MultipathAlignment multipath_aln = compact.multipath_alignment();
+    const string& name = multipath_aln.name();
+
+    if (compact.mapping_count_size() != multipath_aln.subpath_size() ||
+        compact.offset_size() != compact.node_step_size() || compact.edit_count_size() != compact.node_step_size() ||
+        compact.from_length_size() != compact.to_length_size()) {
+        throw runtime_error("CompactMultipathAlignment for " + name + " has inconsistent subpath, mapping, or edit counts");
+    }
+    if (compact.edit_sequences_from_read() && !compact.edit_sequence().empty()) {
+        throw runtime_error("CompactMultipathAlignment for " + name + " has edit sequences it says come from the read");
+    }
+
+    const string& read = multipath_aln.sequence();
+    const string& stored_bases = compact.edit_sequences_from_read() ? read : compact.edit_sequence();
+    vector<int64_t> predecessors = subpath_predecessors(multipath_aln);
+    vector<size_t> read_end(multipath_aln.subpath_size(), 0);
+    vector<id_t> last_node(multipath_aln.subpath_size(), 0);
+    size_t next_mapping = 0;
+    size_t next_edit = 0;
+    size_t next_base = 0;
+
+    for (size_t i = 0; i < multipath_aln.subpath_size(); i++) {
+        Path& path = *multipath_aln.mutable_subpath(i)->mutable_path();
+        size_t read_offset = predecessors[i] >= 0 ? read_end[predecessors[i]] : 0;
+        id_t node_id = predecessors[i] >= 0 ? last_node[predecessors[i]] : 0;
+
+        size_t mapping_count = compact.mapping_count(i) / 2;
+        bool ranked = compact.mapping_count(i) & 1;
+        if (mapping_count == 0) {
+            // the path was kept as it was
+            read_end[i] = read_offset + read_length_of(path);
+            last_node[i] = path.mapping_size() != 0 ? path.mapping(path.mapping_size() - 1).position().node_id() : node_id;
+            continue;
+        }
+        if (path.mapping_size() != 0) {
+            throw runtime_error("CompactMultipathAlignment for " + name + " has both a path and compact mappings for subpath " +
+                                to_string(i));
+        }
+
+        for (size_t j = 0; j < mapping_count; j++, next_mapping++) {
+            if (next_mapping >= compact.node_step_size()) {
+                throw runtime_error("CompactMultipathAlignment for " + name + " has fewer mappings than its subpaths need");
+            }
+            int64_t step = compact.node_step(next_mapping);
+            bool is_reverse = step & 1;
+            node_id += (step - (step & 1)) / 2;
+            if (!graph.has_node(node_id)) {
+                throw runtime_error("CompactMultipathAlignment for " + name + " visits node " + to_string(node_id) +
+                                    ", which is not in the graph");
+            }
+
+            Mapping& mapping = *path.add_mapping();
+            Position& position = *mapping.mutable_position();
+            position.set_node_id(node_id);
+            position.set_offset(compact.offset(next_mapping));
+            position.set_is_reverse(is_reverse);
+            if (ranked) {
+                mapping.set_rank(j + 1);
+            }
+
+            if (compact.edit_count(next_mapping) == 0) {
+                size_t node_length = graph.get_length(graph.get_handle(node_id, is_reverse));
+                if (position.offset() > node_length) {
+                    throw runtime_error("CompactMultipathAlignment for " + name + " has an offset past the end of node " +
+                                        to_string(node_id));
+                }
+                Edit& edit = *mapping.add_edit();
+                edit.set_from_length(node_length - position.offset());
+                edit.set_to_length(node_length - position.offset());
+                read_offset += edit.to_length();
+                continue;
+            }
+
+            for (size_t k = 0; k < compact.edit_count(next_mapping); k++, next_edit++) {
+                if (next_edit >= compact.from_length_size()) {
+                    throw runtime_error("CompactMultipathAlignment for " + name + " has fewer edits than its mappings need");
+                }
+                Edit& edit = *mapping.add_edit();
+                uint32_t to_length = compact.to_length(next_edit) / 2;
+                edit.set_from_length(compact.from_length(next_edit));
+                edit.set_to_length(to_length);
+                if (compact.to_length(next_edit) & 1) {
+                    // the bases come either from the read where the edit lands, or from the next stored bases
+                    size_t start = compact.edit_sequences_from_read() ? read_offset : next_base;
+                    if (start + to_length > stored_bases.size()) {
+                        throw runtime_error("CompactMultipathAlignment for " + name + " has less edit sequence than its edits need");
+                    }
+                    edit.set_sequence(stored_bases.substr(start, to_length));
+                    next_base += to_length;
+                }
+                read_offset += to_length;
+            }
+        }
+        read_end[i] = read_offset;
+        last_node[i] = node_id;
+    }
+
+    if (next_mapping != compact.node_step_size() || next_edit != compact.from_length_size() ||
+        (!compact.edit_sequences_from_read() && next_base != compact.edit_sequence().size())) {
+        throw runtime_error("CompactMultipathAlignment for " + name + " has mappings or edits left over after its subpaths");
+    }
+
+    return multipath_aln;
+}
+
+void bin_qualities(string& quality) {
+    for (char& q : quality) {
+        uint8_t value = q;
+        if (value < 2) {
+            // no-calls stay as they are
+            continue;
+        }
+        q = value < 10 ? 6 : value < 20 ? 15 : value < 25 ? 22 : value < 30 ? 27 : value < 35 ? 33 : value < 40 ? 37 : 40;
+    }
+}
+
+}
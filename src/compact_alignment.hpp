@@ -0,0 +1,125 @@
+#ifndef VG_COMPACT_ALIGNMENT_HPP_INCLUDED
+#define VG_COMPACT_ALIGNMENT_HPP_INCLUDED
+
+/** \file
+ * A compact, reference-relative encoding of Alignments as CompactAlignments,
+ * which store the path as small steps between nodes and leave out the read
+ * sequence when the graph and the edits already spell it. MultipathAlignments
+ * are stored the same way, as CompactMultipathAlignments.
+ */
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "vg.pb.h"
+#include "types.hpp"
+#include "xg.hpp"
+
+namespace vg {
+
+using namespace std;
+
+/// Compact an Alignment against the graph it was aligned to. Paths that can't
+/// be described as steps (because they carry names, lengths, or unusual
+/// ranks) are kept as they are, and the sequence is kept if the path doesn't
+/// spell it. If bin_quality is set, the base qualities are also binned with
+/// bin_qualities(), which loses information.
+CompactAlignment compact_alignment(const Alignment& aln, const xg::XG& graph, bool bin_quality = false);
+
+/// Expand a CompactAlignment back into an Alignment, using the graph it was
+/// compacted against. Throws a runtime_error if the encoding is malformed or
+/// visits nodes the graph doesn't have.
+Alignment expand_alignment(const CompactAlignment& compact, const xg::XG& graph);
+
+/// Bin base qualities into the 8 levels that Illumina's binned quality scores
+/// use, so that they compress better.
+void bin_qualities(string& quality);
+
+/// Compact a MultipathAlignment against the graph it was aligned to. Each
+/// subpath's path is compacted like a CompactAlignment's, unless it can't be,
+/// and edit sequences are left out when they can be copied from the read. If
+/// bin_quality is set, the base qualities are also binned with
+/// bin_qualities(), which loses information.
+CompactMultipathAlignment compact_multipath_alignment(const MultipathAlignment& multipath_aln, const xg::XG& graph,
+                                                      bool bin_quality = false);
+
+/// Expand a CompactMultipathAlignment back into a MultipathAlignment, using
+/// the graph it was compacted against. Throws a runtime_error if the encoding
+/// is malformed or visits nodes the graph doesn't have.
+MultipathAlignment expand_multipath_alignment(const CompactMultipathAlignment& compact, const xg::XG& graph);
+
+/// Get the subpath each subpath of a MultipathAlignment is reached from in a
+/// CompactMultipathAlignment: the first earlier subpath that has it as a
+/// next, or -1 if there isn't one.
+vector<int64_t> subpath_predecessors(const MultipathAlignment& multipath_aln);
+
+/// Call the given function with the ID of each node a CompactAlignment
+/// visits, in order, without needing the graph. An Alignment with no path
+/// visits node 0. Stops early if the function returns false.
+template<typename Iteratee>
+void for_each_node_id(const CompactAlignment& compact, const Iteratee& iteratee) {
+    if (compact.alignment().path().mapping_size() != 0) {
+        // The path couldn't be compacted
+        for (auto& mapping : compact.alignment().path().mapping()) {
+            if (!iteratee((id_t) mapping.position().node_id())) {
+                return;
+            }
+        }
+    } else if (compact.node_step_size() == 0) {
+        iteratee((id_t) 0);
+    } else {
+        id_t node_id = 0;
+        for (int64_t step : compact.node_step()) {
+            node_id += (step - (step & 1)) / 2;
+            if (!iteratee(node_id)) {
+                return;
+            }
+        }
+    }
+}
+
+/// Call the given function with the ID of each node a
+/// CompactMultipathAlignment visits, subpath by subpath, without needing the
+/// graph. A MultipathAlignment with no mappings visits node 0. Stops early if
+/// the function returns false.
+template<typename Iteratee>
+void for_each_node_id(const CompactMultipathAlignment& compact, const Iteratee& iteratee) {
+    const MultipathAlignment& rest = compact.multipath_alignment();
+    vector<int64_t> predecessors = subpath_predecessors(rest);
+    // the node each subpath ends on, for the subpaths that step from it
+    vector<id_t> last_node(rest.subpath_size(), 0);
+    bool visited = false;
+    size_t next_step = 0;
+    for (size_t i = 0; i < rest.subpath_size(); i++) {
+        id_t node_id = predecessors[i] >= 0 ? last_node[predecessors[i]] : 0;
+        const Path& path = rest.subpath(i).path();
+        if (path.mapping_size() != 0) {
+            // The path couldn't be compacted
+            for (auto& mapping : path.mapping()) {
+                node_id = mapping.position().node_id();
+                visited = true;
+                if (!iteratee(node_id)) {
+                    return;
+                }
+            }
+        } else if (i < compact.mapping_count_size()) {
+            for (size_t j = 0; j < compact.mapping_count(i) / 2 && next_step < compact.node_step_size(); j++) {
+                int64_t step = compact.node_step(next_step++);
+                node_id += (step - (step & 1)) / 2;
+                visited = true;
+                if (!iteratee(node_id)) {
+                    return;
+                }
+            }
+        }
+        last_node[i] = node_id;
+    }
+    if (!visited) {
+        iteratee((id_t) 0);
+    }
+}
+
+}
+
+#endif
@@ -1484,6 +1484,57 @@ namespace vg {
             callback(chunk.graph);
         };
 
+        // Chunks are constructed in batches. We gather the reference sequence
+        // and variants for each chunk in order, construct the whole batch in
+        // parallel, and then wire up and emit the results in order. Chunks are
+        // built with chunk-local IDs, so the output is the same as building
+        // them one at a time.
+        struct PendingChunk {
+            string reference_sequence;
+            vector<vcflib::Variant> variants;
+            size_t start;
+            size_t end;
+        };
+        vector<PendingChunk> pending_chunks;
+        size_t batch_size = max((size_t) 1, (size_t) (2 * get_thread_count()));
+
+        // Construct, wire up, and emit everything waiting
+        auto flush_pending_chunks = [&]() {
+            vector<ConstructedChunk> results(pending_chunks.size());
+            #pragma omp parallel for schedule(dynamic, 1)
+            for (size_t i = 0; i < pending_chunks.size(); i++) {
+                auto& pending = pending_chunks[i];
+                results[i] = construct_chunk(std::move(pending.reference_sequence), reference_contig,
+                                             std::move(pending.variants), pending.start);
+            }
+            
+            for (size_t i = 0; i < results.size(); i++) {
+                // Wire up and emit the chunk graph
+                wire_and_emit(results[i]);
+
+                // Say we've completed the chunk
+                update_progress(pending_chunks[i].end - leading_offset);
+            }
+            pending_chunks.clear();
+        };
+
+        // Queue up the chunk from chunk_start to chunk_end with the given
+        // variants, building the batch if it is full
+        auto queue_chunk = [&](size_t start, size_t end, vector<vcflib::Variant>& variants) {
+            pending_chunks.emplace_back();
+            auto& pending = pending_chunks.back();
+            // Get the ref sequence we need. The FASTA can only be read from
+            // one thread.
+            pending.reference_sequence = reference.getSubSequence(reference_contig, start, end - start);
+            swap(pending.variants, variants);
+            pending.start = start;
+            pending.end = end;
+            
+            if (pending_chunks.size() >= batch_size) {
+                flush_pending_chunks();
+            }
+        };
+
         bool do_external_insertions = false;
         FastaReference* insertion_fasta;
 
@@ -1615,17 +1666,8 @@ namespace vg {
                             min((size_t) reference_end,
                                 (size_t) (chunk_start + bases_per_chunk))));
 
-                // Get the ref sequence we need
-                auto chunk_ref = reference.getSubSequence(reference_contig, chunk_start, chunk_end - chunk_start);
-
-                // Call the construction
-                auto result = construct_chunk(chunk_ref, reference_contig, chunk_variants, chunk_start);
-
-                // Wire up and emit the chunk graph
-                wire_and_emit(result);
-
-                // Say we've completed the chunk
-                update_progress(chunk_end - leading_offset);
+                // Queue the chunk for construction
+                queue_chunk(chunk_start, chunk_end, chunk_variants);
 
                 // Set up a new chunk
                 chunk_start = chunk_end;
@@ -1647,17 +1689,8 @@ namespace vg {
                     min((size_t) reference_end,
                         (size_t) (chunk_start + bases_per_chunk)));
 
-            // Get the ref sequence we need
-            auto chunk_ref = reference.getSubSequence(reference_contig, chunk_start, chunk_end - chunk_start);
-
-            // Call the construction
-            auto result = construct_chunk(chunk_ref, reference_contig, chunk_variants, chunk_start);
-
-            // Wire up and emit the chunk graph
-            wire_and_emit(result);
-
-            // Say we've completed the chunk
-            update_progress(chunk_end - leading_offset);
+            // Queue the chunk for construction
+            queue_chunk(chunk_start, chunk_end, chunk_variants);
 
             // Set up a new chunk
             chunk_start = chunk_end;
@@ -1665,6 +1698,9 @@ namespace vg {
             chunk_variants.clear();
         }
 
+        // Build whatever is left in the last batch
+        flush_pending_chunks();
+
         // All the chunks have been wired and emitted.
         
         if (last_node_buffer.id() != 0) {
@@ -1,6 +1,11 @@
 #include "deconstructor.hpp"
 #include "traversal_finder.hpp"
 
+#include <algorithm>
+#include <memory>
+#include <tuple>
+#include <omp.h>
+
 using namespace std;
 
 
@@ -19,7 +24,8 @@ namespace vg {
     * string in the vector is the reference allele
     * otherwise, hasRef is set to false and all strings are alt alleles.
     */
-    pair<bool, vector<string> > Deconstructor::get_alleles(vector<SnarlTraversal> travs, string refpath, vg::VG* graph){
+    pair<bool, vector<string> > Deconstructor::get_alleles(const vector<SnarlTraversal>& travs, const string& refpath,
+                                                           const HandleGraph* graph) const {
         vector<string> ret;
         vector<SnarlTraversal> ordered_traversals;
         bool hasRef = false;
@@ -27,13 +33,14 @@ namespace vg {
         bool normalize_indels = false;
 
         // Check if we have a PathIndex for this path
-        bool path_indexed = pindexes.find(refpath) != pindexes.end();
-        for (auto t : travs){
+        auto found_index = pindexes.find(refpath);
+        bool path_indexed = found_index != pindexes.end();
+        for (auto& t : travs){
             stringstream t_allele;
 
             // Get ref path index
             if (path_indexed){
-                PathIndex* pind = pindexes[refpath];
+                PathIndex* pind = found_index->second;
                 // Check nodes of traversals Visits
                 // if they're all on the ref path,
                 // then this Snarltraversal is the ref allele.
@@ -53,7 +60,7 @@ namespace vg {
                     if (v.node_id() == 0){
                         continue;
                     }
-                    t_allele << graph->get_node(v.node_id())->sequence();
+                    t_allele << graph->get_sequence(graph->get_handle(v.node_id()));
                 }
 
                 string t_str = t_allele.str();
@@ -84,7 +91,7 @@ namespace vg {
                 end--;
                 for (; iter != end; iter++){
                     auto v = *iter;
-                    t_allele << graph->get_node(v.node_id())->sequence();
+                    t_allele << graph->get_sequence(graph->get_handle(v.node_id()));
                 }
                 ret.push_back(t_allele.str());
                 ordered_traversals.push_back(t);
@@ -99,15 +106,14 @@ namespace vg {
                 // If our empty allele is the reference (and we have a reference),
                 // put our new-found ref base in the 0th index of alleles vector.
                 // Then, prepend that base to each allele in our alleles vector.
-                    SnarlTraversal t = ordered_traversals[i];
+                    const SnarlTraversal& t = ordered_traversals[i];
                     id_t start_id = t.visit(0).node_id();
                     id_t end_id = t.visit(t.visit_size() - 1).node_id();
-                    pair<size_t, bool> pos_orientation_start = pindexes[refpath]->by_id[start_id];
-                    pair<size_t, bool> pos_orientation_end = pindexes[refpath]->by_id[end_id];
+                    pair<size_t, bool> pos_orientation_start = found_index->second->by_id.at(start_id);
+                    pair<size_t, bool> pos_orientation_end = found_index->second->by_id.at(end_id);
                     bool use_start = pos_orientation_start.first < pos_orientation_end.first;
                     bool rev = use_start ? pos_orientation_start.second : pos_orientation_end.second;
-                    string pre_node_seq = use_start ? graph->get_node(start_id)->sequence() :
-                                            graph->get_node(end_id)->sequence();
+                    string pre_node_seq = graph->get_sequence(graph->get_handle(use_start ? start_id : end_id));
                     string pre_variant_base = rev ? string(1, pre_node_seq[0]) : string(1, pre_node_seq[pre_node_seq.length() - 1]);
                     ret[i].insert(0, pre_variant_base);
                 }
@@ -116,15 +122,7 @@ namespace vg {
 
     }
 
-    void Deconstructor::deconstruct(string refpath, vg::VG* graph){
-        
-     
-
-        // Create path index for the contig if we don't have one.
-        if (pindexes.find(refpath) == pindexes.end()){
-            pindexes[refpath] = new PathIndex(*graph, refpath, false);
-        }
-
+    void Deconstructor::write_header() {
         // Spit header
         // Set contig to refpath
         // Set program field
@@ -144,36 +142,73 @@ namespace vg {
             cout << outvcf.header << endl;
             this->headered = true;
         }
+    }
 
-        // Find snarls
-        // Snarls are variant sites ("bubbles")
-        SnarlFinder* snarl_finder = new CactusSnarlFinder(*graph, refpath);
-        SnarlManager snarl_manager = snarl_finder->find_snarls();
-        vector<const Snarl*> snarl_roots = snarl_manager.top_level_snarls();
-        TraversalFinder* trav_finder = new ExhaustiveTraversalFinder(*graph, snarl_manager);
-        for (const Snarl* snarl: snarl_roots){
-            // For each top level snarl
+    void Deconstructor::deconstruct_snarls(const vector<string>& refpaths, const HandleGraph* graph,
+                                           const SnarlManager* snarl_manager) {
+        
+        write_header();
+        
+        const vector<const Snarl*>& snarl_roots = snarl_manager->top_level_snarls();
+        
+        // Each thread searches with its own traversal finder
+        vector<unique_ptr<TraversalFinder>> trav_finders;
+        for (int i = 0; i < get_thread_count(); i++) {
+            trav_finders.emplace_back(new ExhaustiveHandleTraversalFinder(*graph, *snarl_manager));
+        }
+        
+        // The VCF text for each snarl, if any, and where it goes in the
+        // output: the index of its path and its position on it
+        vector<string> records(snarl_roots.size());
+        vector<tuple<size_t, size_t, size_t>> order;
+        order.reserve(snarl_roots.size());
+        
+#pragma omp parallel for schedule(dynamic, 1)
+        for (size_t i = 0; i < snarl_roots.size(); i++) {
+            const Snarl* snarl = snarl_roots[i];
+            
+            // Find the first reference path the snarl is on
+            size_t path_num = 0;
+            const PathIndex* pind = nullptr;
+            for (; path_num < refpaths.size(); path_num++) {
+                auto found = pindexes.find(refpaths[path_num]);
+                if (found != pindexes.end() && found->second->by_id.count(snarl->start().node_id())
+                    && found->second->by_id.count(snarl->end().node_id())) {
+                    pind = found->second;
+                    break;
+                }
+            }
+            if (pind == nullptr) {
+                continue;
+            }
+            const string& refpath = refpaths[path_num];
+            
+            // SnarlTraversals are the (possible) alleles of our variant site.
+            vector<SnarlTraversal> travs = trav_finders[omp_get_thread_num()]->find_traversals(*snarl);
             
-            // Except the trivial ones
+            // Skip the trivial ones, with nothing but the boundary nodes
             if (snarl->type() == ULTRABUBBLE) {
-                auto contents = snarl_manager.shallow_contents(snarl, *graph, false);
-                if (contents.first.empty()) {
-                    // Nothing but the boundary nodes in this snarl
+                bool trivial = true;
+                for (auto& trav : travs) {
+                    if (trav.visit_size() > 2) {
+                        trivial = false;
+                        break;
+                    }
+                }
+                if (trivial) {
                     continue;
                 }
             }
             
             vcflib::Variant v;
-            // SnarlTraversals are the (possible) alleles of our variant site.
-            vector<SnarlTraversal> travs = trav_finder->find_traversals(*snarl);
             // write variant's sequenceName (VCF contig)
             v.sequenceName = refpath;
             // Set position based on the lowest position in the snarl.
-            pair<size_t, bool> pos_orientation_start = pindexes[refpath]->by_id[snarl->start().node_id()];
-            pair<size_t, bool> pos_orientation_end = pindexes[refpath]->by_id[snarl->end().node_id()];
+            pair<size_t, bool> pos_orientation_start = pind->by_id.at(snarl->start().node_id());
+            pair<size_t, bool> pos_orientation_end = pind->by_id.at(snarl->end().node_id());
             bool use_start = pos_orientation_start.first < pos_orientation_end.first;
             size_t node_pos = (use_start ? pos_orientation_start.first : pos_orientation_end.first);
-            v.position = node_pos +(use_start ? graph->get_node(snarl->start().node_id())->sequence().length() : graph->get_node(snarl->end().node_id())->sequence().length());
+            v.position = node_pos + graph->get_length(graph->get_handle(use_start ? snarl->start().node_id() : snarl->end().node_id()));
             std::pair<bool, vector<string> > t_alleles = get_alleles(travs, refpath, graph);
             if (t_alleles.first){
                 v.alleles.insert(v.alleles.begin(), t_alleles.second[0]);
@@ -184,6 +219,7 @@ namespace vg {
                 }
             }
             else{
+#pragma omp critical (cerr)
                 cerr << "NO REFERENCE ALLELE FOUND" << endl;
                 v.alleles.insert(v.alleles.begin(), ".");
                 for (int i = 0; i < t_alleles.second.size(); i++){
@@ -192,11 +228,35 @@ namespace vg {
                 }
             }
             v.updateAlleleIndexes();
-            cout << v << endl;
-
+            
+            stringstream record;
+            record << v;
+            records[i] = record.str();
+#pragma omp critical (order)
+            order.emplace_back(path_num, (size_t) v.position, i);
         }
         
+        // Put the records back in order
+        sort(order.begin(), order.end());
+        for (auto& entry : order) {
+            cout << records[get<2>(entry)] << "\n";
+        }
+        cout.flush();
+    }
+
+    void Deconstructor::deconstruct(string refpath, vg::VG* graph){
+
+        // Create path index for the contig if we don't have one.
+        if (pindexes.find(refpath) == pindexes.end()){
+            pindexes[refpath] = new PathIndex(*graph, refpath, false);
+        }
 
+        // Find snarls
+        // Snarls are variant sites ("bubbles")
+        CactusSnarlFinder snarl_finder(*graph, refpath);
+        SnarlManager snarl_manager = snarl_finder.find_snarls();
+        
+        deconstruct_snarls(vector<string>{refpath}, graph, &snarl_manager);
     }
 
     /**
@@ -209,5 +269,18 @@ namespace vg {
         }
 
     }
+    
+    void Deconstructor::deconstruct(vector<string> ref_paths, const xg::XG* graph, const SnarlManager* snarl_manager){
+        
+        for (auto& path : ref_paths) {
+            if (graph->path_rank(path) == 0) {
+                throw runtime_error("[Deconstructor] path " + path + " is not in the index");
+            }
+            if (pindexes.find(path) == pindexes.end()) {
+                pindexes[path] = new PathIndex(*graph, path, false);
+            }
+        }
+        
+        deconstruct_snarls(ref_paths, graph, snarl_manager);
+    }
 }
-
@@ -10,6 +10,7 @@
 #include "Variant.h"
 #include "path.hpp"
 #include "vg.hpp"
+#include "xg.hpp"
 #include "genotypekit.hpp"
 #include "vg.pb.h"
 #include "Fasta.h"
@@ -32,13 +33,30 @@ namespace vg{
 
             Deconstructor();
             ~Deconstructor();
-            pair<bool, vector<string> > get_alleles(vector<SnarlTraversal> travs, string refpath, vg::VG* graph);
+            pair<bool, vector<string> > get_alleles(const vector<SnarlTraversal>& travs, const string& refpath,
+                                                    const HandleGraph* graph) const;
 
             void deconstruct(string refpath, vg::VG* graph);
             void deconstruct(vector<string> refpaths, vg::VG* graph); 
+
+            /// Deconstruct the top-level snarls of an indexed graph against
+            /// the given paths, which must be in the index. Each snarl is
+            /// reported against the first of the paths that visits both its
+            /// boundary nodes, and snarls on none of them are skipped.
+            void deconstruct(vector<string> refpaths, const xg::XG* graph, const SnarlManager* snarl_manager);
             map<string, PathIndex*> pindexes;
 
         private:
+            /// Print the VCF header, if it hasn't been printed yet.
+            void write_header();
+
+            /// Write VCF records for the nontrivial top-level snarls that lie
+            /// on the indexed reference paths, in parallel, with one
+            /// traversal finder per thread. Records are sorted by path, in
+            /// the order given, and then by position.
+            void deconstruct_snarls(const vector<string>& refpaths, const HandleGraph* graph,
+                                    const SnarlManager* snarl_manager);
+
             bool headered = false;
     };
 }
@@ -15,21 +15,23 @@ DistanceIndex::DistanceIndex(VG* vg, SnarlManager* snarlManager){
         cerr << endl << "Creating distance index"<< endl;
     #endif
     const vector<const Snarl*> topSnarls = sm->top_level_snarls();
-//              calculateIndex(&topSnarls);
 
+    //Each top level chain and everything nested in it is indexed 
+    //independently of the others, so collect them and index them in parallel
+    vector<Chain> topChains;
     unordered_set<const Snarl*> seenSnarls;
     for (const Snarl* snarl : topSnarls) {
        if (seenSnarls.count(snarl) == 0){
           if (sm->in_nontrivial_chain(snarl)){
               const Chain* chain = sm->chain_of(snarl);
-              calculateIndex(chain);
+              topChains.push_back(*chain);
               for (auto s : *chain) {
                   seenSnarls.insert(s);
               }
            } else {
                Chain currChain;
                currChain.push_back(snarl);
-               calculateIndex(&currChain);
+               topChains.push_back(currChain);
                seenSnarls.insert(snarl);
            }
            
@@ -37,9 +39,46 @@ DistanceIndex::DistanceIndex(VG* vg, SnarlManager* snarlManager){
         
     }
 
+    vector<unique_ptr<DistanceIndex>> chainParts(topChains.size());
+#pragma omp parallel for schedule(dynamic, 1)
+    for (size_t i = 0; i < topChains.size(); i++) {
+        chainParts[i].reset(new DistanceIndex(graph, sm, &topChains[i]));
+    }
+
+    //Merge the parts in the order of the top level snarls so the index
+    //doesn't depend on the number of threads
+    for (auto& part : chainParts) {
+        for (auto& snarlDists : part->snarlIndex) {
+            snarlIndex.insert(std::move(snarlDists));
+        }
+        for (auto& chainDists : part->chainIndex) {
+            chainIndex.insert(std::move(chainDists));
+        }
+        part.reset();
+    }
+    indexNodeSnarls();
+
 };
 
 
+DistanceIndex::DistanceIndex(VG* vg, SnarlManager* snarlManager, 
+                             const Chain* topChain) {
+    /*Constructor for the part of a distance index covering one top level 
+      chain and everything nested inside it
+    */
+    graph = vg;
+    sm = snarlManager;
+
+    calculateIndex(topChain);
+
+    //This part is done, so pack the distance matrices into as few bits as
+    //their values need
+    for (auto& snarlDists : snarlIndex) {
+        util::bit_compress(snarlDists.second.distances);
+    }
+}
+
+
 DistanceIndex::DistanceIndex(VG* vg, SnarlManager* snarlManager, istream& in) {
 
     /*Constructor for the distance index given a VG, snarl manager, and a vector
@@ -64,10 +103,10 @@ DistanceIndex::DistanceIndex(VG* vg, SnarlManager* snarlManager, istream& in) {
     d3.load(in);
     d4.load(in);
 
+    //The snarl and chain contents are decoded straight out of d2 and d4 as
+    //each object is built, rather than expanding them to 64 bits first
     vector<int64_t> snarlNodes(d1.size(), 0); 
-    vector<int64_t> snarlVector(d2.size(), 0);
     vector<int64_t> chainNodes(d3.size(), 0);
-    vector<int64_t> chainVector(d4.size(), 0);
  
     for (size_t i = 0; i < d1.size(); i++) {
         uint64_t uval = d1[i];
@@ -75,19 +114,13 @@ DistanceIndex::DistanceIndex(VG* vg, SnarlManager* snarlManager, istream& in) {
         snarlNodes[i] = val;
     }
 
-    for (size_t i = 0; i < d2.size(); i++) {
-        snarlVector[i] = toInt(d2[i]);
-    }
     for (size_t i = 0; i < d3.size(); i++) {
         chainNodes[i] = toInt(d3[i]);
     }
-    for (size_t i = 0; i < d4.size(); i++) {
-        chainVector[i] = toInt(d4[i]);
-    }
 
   
     //Construct snarl index
-    size_t snarlI = 0;//Index into snarlVector
+    size_t snarlI = 0;//Index into d2
     for (size_t i = 0; i < snarlNodes.size()/2; i++) {
         int64_t snarlInt = snarlNodes[2*i];
   
@@ -100,7 +133,7 @@ DistanceIndex::DistanceIndex(VG* vg, SnarlManager* snarlManager, istream& in) {
         vector<int64_t> snarlv;//get subvector
         snarlv.resize(nextIndex - snarlI);
         for (size_t j = 0; j < nextIndex-snarlI; j++) {
-            snarlv[j] = snarlVector[snarlI + j]; 
+            snarlv[j] = toInt(d2[snarlI + j]); 
         }
          
 
@@ -112,7 +145,7 @@ DistanceIndex::DistanceIndex(VG* vg, SnarlManager* snarlManager, istream& in) {
     }
     
     
-    size_t chainI = 0; //Index into chainVector
+    size_t chainI = 0; //Index into d4
     //Construct chain index
     for (size_t i = 0; i < chainNodes.size()/2; i++) {
         id_t chainID = (id_t) chainNodes[2*i];
@@ -123,7 +156,7 @@ DistanceIndex::DistanceIndex(VG* vg, SnarlManager* snarlManager, istream& in) {
         chainv.resize(nextIndex - chainI);
         for ( size_t j = 0; j < nextIndex - chainI; j++) {
 
-            chainv[j] = chainVector[chainI + j];
+            chainv[j] = toInt(d4[chainI + j]);
         }
 
         //Create chaindistances object and assign in index
@@ -132,8 +165,39 @@ DistanceIndex::DistanceIndex(VG* vg, SnarlManager* snarlManager, istream& in) {
         chainI = nextIndex;
 
     }
+    indexNodeSnarls();
 };
 
+void DistanceIndex::indexNodeSnarls() {
+    /*Record the deepest snarl containing each node. Children are visited
+      after their parents, so they overwrite the parent's entries for the
+      nodes they contain, including their own boundary nodes
+    */
+    sm->for_each_snarl_preorder([&](const Snarl* snarl) {
+        auto contents = sm->shallow_contents(snarl, *graph, true);
+        for (Node* node : contents.first) {
+            nodeToSnarl[node->id()] = snarl;
+        }
+    });
+}
+
+const Snarl* DistanceIndex::snarlOf(id_t node) {
+    auto found = nodeToSnarl.find(node);
+    return found == nodeToSnarl.end() ? NULL : found->second;
+}
+
+const vector<const Snarl*>& DistanceIndex::ancestorsOf(const Snarl* snarl, 
+                  AncestorMemo* memo, vector<const Snarl*>& scratch) {
+    vector<const Snarl*>& ancestors = memo == nullptr ? scratch 
+                                                      : (*memo)[snarl];
+    if (ancestors.empty()) {
+        for (const Snarl* s = snarl; s != NULL; s = sm->parent_of(s)) {
+            ancestors.push_back(s);
+        }
+    }
+    return ancestors;
+}
+
 void DistanceIndex::serialize(ostream& out) {
 
     auto toUint = [](int64_t val) {
@@ -154,10 +218,19 @@ void DistanceIndex::serialize(ostream& out) {
     //Serialize snarls
     d1.resize(2*snarlIndex.size());
 
-    for (pair<pair<id_t, bool>, SnarlDistances> snarlPair : snarlIndex) {
-        int64_t nodeInt = snarlPair.first.second ? 
-            - (int64_t) snarlPair.first.first : (int64_t) snarlPair.first.first;
-        vector<int64_t> currVector = snarlPair.second.toVector();
+    //Write snarls and chains in order of their keys so the serialized index
+    //is the same however the hash tables were built
+    vector<pair<id_t, bool>> snarlKeys;
+    snarlKeys.reserve(snarlIndex.size());
+    for (auto& snarlPair : snarlIndex) {
+        snarlKeys.push_back(snarlPair.first);
+    }
+    sort(snarlKeys.begin(), snarlKeys.end());
+
+    for (auto& snarlKey : snarlKeys) {
+        int64_t nodeInt = snarlKey.second ? 
+            - (int64_t) snarlKey.first : (int64_t) snarlKey.first;
+        vector<int64_t> currVector = snarlIndex.at(snarlKey).toVector();
         
         d1[snarlNodesI++] = nodeInt;
         d1[snarlNodesI++] = (int64_t) currVector.size();
@@ -172,11 +245,18 @@ void DistanceIndex::serialize(ostream& out) {
     size_t chainNodesI = 0;
     size_t chainVectorI = 0;
     //Serialize chains
-    for (pair<id_t, ChainDistances> chainP: chainIndex) {
-        vector<int64_t> currVector = chainP.second.toVector();
+    vector<id_t> chainKeys;
+    chainKeys.reserve(chainIndex.size());
+    for (auto& chainP: chainIndex) {
+        chainKeys.push_back(chainP.first);
+    }
+    sort(chainKeys.begin(), chainKeys.end());
+
+    for (id_t chainKey : chainKeys) {
+        vector<int64_t> currVector = chainIndex.at(chainKey).toVector();
         
         d3.resize(d3.size() + 2 );
-        d3[chainNodesI++] = (int64_t) chainP.first;
+        d3[chainNodesI++] = (int64_t) chainKey;
         d3[chainNodesI++] = (int64_t) currVector.size();
         
         d4.resize(d4.size() + currVector.size()); 
@@ -865,8 +945,22 @@ int64_t DistanceIndex::calculateIndex(const Chain* chain) {
 
 //////////////////    Calculate distances
 
+int64_t DistanceIndex::distance(const pos_t& pos1, const pos_t& pos2, 
+                                AncestorMemo* memo) {
+    /*Find the distance between two positions in any snarls*/
+    const Snarl* snarl1 = snarlOf(get_id(pos1));
+    const Snarl* snarl2 = snarlOf(get_id(pos2));
+    if (snarl1 == NULL || snarl2 == NULL) {
+        //Nodes outside of every snarl aren't in the index
+        return -1;
+    }
+    pos_t p1 = pos1;
+    pos_t p2 = pos2;
+    return distance(snarl1, snarl2, p1, p2, memo);
+}
+
 int64_t DistanceIndex::distance(const Snarl* snarl1, const Snarl* snarl2, 
-                                                  pos_t& pos1, pos_t& pos2) {
+                                pos_t& pos1, pos_t& pos2, AncestorMemo* memo) {
     /*Find the distance between two positions
       pos1 and pos2 must be on nodes contained in snarl1/snarl2 */
     
@@ -921,43 +1015,32 @@ int64_t DistanceIndex::distance(const Snarl* snarl1, const Snarl* snarl2,
 
 
     //// Find common ancestor of the two snarls
-    unordered_set<const Snarl*> ancestors1;//set of all ancestor snarls of node1
-    const Snarl* ancestor1 = snarl1;
+    //Both ancestor lists end at a top level snarl, so they agree from the top
+    //down to the deepest common ancestor
+    vector<const Snarl*> scratch1;
+    vector<const Snarl*> scratch2;
+    const vector<const Snarl*>& ancestors1 = ancestorsOf(snarl1, memo, scratch1);
+    const vector<const Snarl*>& ancestors2 = ancestorsOf(snarl2, memo, scratch2);
+
+    auto iter1 = ancestors1.rbegin();
+    auto iter2 = ancestors2.rbegin();
+    while (iter1 != ancestors1.rend() && iter2 != ancestors2.rend() && 
+           *iter1 == *iter2) {
+        commonAncestor = *iter1;
+        ++iter1;
+        ++iter2;
+    }
 
 #ifdef printDistances
     cerr << "Ancestors of 1: ";
-#endif
-
-
-    while (ancestor1 != NULL) {
-#ifdef printDistances
-        cerr << ancestor1->start().node_id() << " ";
-#endif
-        ancestors1.emplace(ancestor1);
-        ancestor1 = sm->parent_of(ancestor1);
+    for (const Snarl* ancestor : ancestors1) {
+        cerr << ancestor->start().node_id() << " ";
     }
-
-
-#ifdef printDistances
-      cerr << endl << "ancestors of 2: ";
-#endif
-
-
-    const Snarl* ancestor2 = snarl2;
-    while (ancestor2 != NULL) {
-
-
-#ifdef printDistances
-         cerr << ancestor2->start().node_id() << " ";
-#endif
-
-
-        if (ancestors1.count(ancestor2) > 0) { 
-            commonAncestor = ancestor2;
-            break;
-        }
-        ancestor2 = sm->parent_of(ancestor2); 
+    cerr << endl << "ancestors of 2: ";
+    for (const Snarl* ancestor : ancestors2) {
+        cerr << ancestor->start().node_id() << " ";
     }
+#endif
 
 #ifdef printDistances 
     cerr << endl;
@@ -1456,8 +1539,8 @@ DistanceIndex::SnarlDistances::SnarlDistances(unordered_set<pair<id_t, bool>>&
     }
 
     int size = visitToIndex.size();
-    //Initialize all distances to -1
-    distances.assign(size*size, -1); 
+    //Initialize all distances to -1 (stored as 0)
+    util::assign(distances, int_vector<>(size*size, 0)); 
     snarlStart = start;
     snarlEnd = end;
 
@@ -1487,13 +1570,14 @@ DistanceIndex::SnarlDistances::SnarlDistances(vector<int64_t> v) {
     }
 
     //Get distance vector
-    distances.resize(numNodes * numNodes);
+    util::assign(distances, int_vector<>(numNodes * numNodes));
     size_t di = 0;
     for (size_t i = numNodes + 4; i < v.size(); i++) {
 
-        distances[di++] = v[i];
+        distances[di++] = v[i] + 1;
 
     }
+    util::bit_compress(distances);
 
 }
 
@@ -1523,14 +1607,19 @@ DistanceIndex::SnarlDistances::SnarlDistances(vector<int64_t> v) {
    
  
     size_t i = 4 + numNodes;   
-    for (int64_t d : distances) {
-        v[i++] = d;
+    for (size_t j = 0; j < distances.size(); j++) {
+        v[i++] = distanceAt(j);
     }
     return v;
 
 }
 
 
+int64_t DistanceIndex::SnarlDistances::distanceAt(size_t i) {
+    //Distances are stored shifted up by one so that -1 fits in unsigned bits
+    return (int64_t) distances[i] - 1;
+}
+
 size_t DistanceIndex::SnarlDistances::index(pair<id_t, bool> start, 
                                             pair<id_t, bool> end) {
     /*Get the index of dist from start to end in a snarl distance matrix
@@ -1545,7 +1634,7 @@ void DistanceIndex::SnarlDistances::insertDistance(pair<id_t, bool> start,
                                            pair<id_t, bool> end, int64_t dist) {
     //Assign distance between start and end
     size_t i = index(start, end);
-    distances.at(i) = dist;
+    distances[i] = dist + 1;
 }
    
 int64_t DistanceIndex::SnarlDistances::snarlDistance(pair<id_t, bool> start,
@@ -1553,7 +1642,7 @@ int64_t DistanceIndex::SnarlDistances::snarlDistance(pair<id_t, bool> start,
     /*Distance between beginnings of two nodes n1 and n2 in snarl
     */
     size_t i = index(start, end);
-    return distances.at(i); 
+    return distanceAt(i); 
 }
 
 int64_t DistanceIndex::SnarlDistances::snarlDistanceShort(VG* graph, 
@@ -1584,7 +1673,7 @@ int64_t DistanceIndex::SnarlDistances::snarlDistanceShortHelp(VG* graph,
        direction*/
 
     size_t i = index(start, end);
-    int64_t totalDist = distances.at(i); 
+    int64_t totalDist = distanceAt(i); 
 
     if (totalDist == -1 ) {//No path between two nodes
         return -1;
@@ -1621,7 +1710,7 @@ int64_t DistanceIndex::SnarlDistances::nodeLength(VG* graph,
     } else {
 
         size_t j = index(node, next); 
-        return distances.at(j);
+        return distanceAt(j);
     }
 }
 
@@ -1727,7 +1816,7 @@ void DistanceIndex::SnarlDistances::printSelf() {
             size_t i2 = visitToIndex.at(n2.first);
    
             size_t i = i1 * length + i2;;
-            cerr << distances.at(i)  << "   "; 
+            cerr << distanceAt(i)  << "   "; 
         }
         cerr << endl;
     }
@@ -1,3 +1,6 @@
+#ifndef VG_DISTANCE_HPP_INCLUDED
+#define VG_DISTANCE_HPP_INCLUDED
+
 #include "snarls.hpp"
 using namespace sdsl;
 namespace vg { 
@@ -7,23 +10,45 @@ class DistanceIndex {
     /*The distance index*/
 
     public: 
-    //Constructor 
+    //Constructor. Top level chains are indexed in parallel, using all the
+    //OpenMP threads
     DistanceIndex (VG* vg, SnarlManager* snarlManager);
 
     //Constructor to load index from serialization 
     DistanceIndex (VG* vg, SnarlManager* snarlManager, istream& in);
   
-    //Serialize object into out
+    //Serialize object into out. The output does not depend on the number of
+    //threads that built the index
     void serialize(ostream& out);
 
 
 
+    /*Memo of each snarl's ancestors, from the snarl up to the root of the
+      snarl tree. Keep one for a batch of queries in the same part of the 
+      graph (like all the hits of one read) so each ancestor walk is only
+      done once
+    */
+    using AncestorMemo = unordered_map<const Snarl*, vector<const Snarl*>>;
+
     /*Get the distance between two positions
       pos1 must be on a node contained in snarl1 and not on any children of
       snarl1. The same for pos2 and snarl2
     */
     int64_t distance( 
-         const Snarl* snarl1, const Snarl* snarl2, pos_t& pos1, pos_t& pos2);
+         const Snarl* snarl1, const Snarl* snarl2, pos_t& pos1, pos_t& pos2,
+         AncestorMemo* memo = nullptr);
+
+    /*Get the distance between two positions, looking up the snarls that
+      contain them. Returns -1 if there is no path between them or if either
+      is not in any snarl
+    */
+    int64_t distance(const pos_t& pos1, const pos_t& pos2, 
+                     AncestorMemo* memo = nullptr);
+
+    /*Get the deepest snarl containing the node, or NULL if the node is not
+      in any snarl
+    */
+    const Snarl* snarlOf(id_t node);
   
     //Helper function to find the minimum value that is not -1
     static int64_t minPos(vector<int64_t> vals);
@@ -91,7 +116,9 @@ class DistanceIndex {
              //For child snarls that are unary or only connected to one node
              //in the snarl, distances between that node leaving the snarl
              //and any other node is -1
-            vector<int64_t> distances;
+             //Each distance is stored plus one, bit compressed once the 
+             //index is built
+            int_vector<> distances;
 
             //ID of the first node in the snarl, also key for distance index 
             pair<id_t, bool> snarlStart;
@@ -105,6 +132,9 @@ class DistanceIndex {
             //The index into distances for distance start->end
             size_t index(pair<id_t, bool> start, pair<id_t, bool> end);
 
+            //The distance stored at an index into distances
+            int64_t distanceAt(size_t i);
+
         private: 
 
             int64_t snarlDistanceShortHelp(VG* graph,NetGraph* ng,
@@ -194,9 +224,26 @@ class DistanceIndex {
 
     SnarlManager* sm;
  
+    //map from each node to the deepest snarl containing it
+    hash_map<id_t, const Snarl*> nodeToSnarl;
+
+    //Constructor for the part of the index covering one top level chain,
+    //which the main constructor builds in parallel and merges
+    DistanceIndex (VG* vg, SnarlManager* snarlManager, const Chain* topChain);
+
     //Helper function for constructor
     int64_t calculateIndex(const Chain* chain); 
 
+    //Helper function for constructors to fill in nodeToSnarl
+    void indexNodeSnarls();
+
+    /*Helper function for distance calculation
+      Returns snarl and all its ancestors, ending with a top level snarl. The
+      list is kept in memo if there is one and in scratch otherwise
+    */
+    const vector<const Snarl*>& ancestorsOf(const Snarl* snarl, 
+               AncestorMemo* memo, vector<const Snarl*>& scratch);
+
     /*Helper function for distance calculation
       Returns the distance to the start of and end of the child snarl of
       common ancestor containing snarl, commonAncestor if snarl is
@@ -218,3 +265,5 @@ class DistanceIndex {
 };
  
 }
+
+#endif
@@ -0,0 +1,67 @@
+#include "duplicate_read_cache.hpp"
+
+/**
+ * \file duplicate_read_cache.cpp: implementation of the cache of duplicate read alignments
+ */
+
+namespace vg {
+
+using namespace std;
+
+DuplicateReadCache::DuplicateReadCache(size_t capacity) : cache(capacity) {
+    // nothing to do
+}
+
+string DuplicateReadCache::key_for(const Alignment& read, const string& parameters) {
+    // Sequence and qualities can't contain the separator, and the parameters
+    // come last, so no two different reads share a key.
+    string key = read.sequence();
+    key.push_back('\0');
+    key += read.quality();
+    key.push_back('\0');
+    key += parameters;
+    return key;
+}
+
+bool DuplicateReadCache::retrieve(const Alignment& read, const string& parameters, vector<Alignment>& alignments) {
+    auto cached = cache.retrieve(key_for(read, parameters));
+    if (!cached.second) {
+        return false;
+    }
+    
+    alignments = *cached.first;
+    for (auto& aln : alignments) {
+        // The alignments belong to the read we were asked about now
+        aln.set_name(read.name());
+        aln.set_sample_name(read.sample_name());
+        aln.set_read_group(read.read_group());
+        aln.clear_fragment_prev();
+        aln.clear_fragment_next();
+        if (read.has_fragment_prev()) {
+            *aln.mutable_fragment_prev() = read.fragment_prev();
+        }
+        if (read.has_fragment_next()) {
+            *aln.mutable_fragment_next() = read.fragment_next();
+        }
+        aln.set_time_used(0);
+    }
+    return true;
+}
+
+void DuplicateReadCache::put(const Alignment& read, const string& parameters, const vector<Alignment>& alignments) {
+    cache.put(key_for(read, parameters), make_shared<const vector<Alignment>>(alignments));
+}
+
+size_t DuplicateReadCache::hits() const {
+    return cache.hits();
+}
+
+size_t DuplicateReadCache::misses() const {
+    return cache.misses();
+}
+
+size_t DuplicateReadCache::size() const {
+    return cache.size();
+}
+
+}
@@ -0,0 +1,62 @@
+#ifndef VG_DUPLICATE_READ_CACHE_HPP_INCLUDED
+#define VG_DUPLICATE_READ_CACHE_HPP_INCLUDED
+
+/** \file
+ * A cache of the alignments of reads already mapped, so exact duplicates (PCR
+ * and optical duplicates, amplicons) anywhere in the input are mapped once.
+ */
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "vg.pb.h"
+#include "sharded_cache.hpp"
+
+namespace vg {
+
+using namespace std;
+
+/**
+ * Remembers the alignments a read's sequence and qualities mapped to, under
+ * a given set of mapping parameters. A later read with the same sequence,
+ * qualities and parameters gets copies of them, stamped with its own name,
+ * sample, read group and fragment links. Safe to share between threads, but
+ * only between mappers with the same settings, since those aren't part of
+ * the key.
+ */
+class DuplicateReadCache {
+public:
+
+    /// Make a cache holding the alignments of about the given number of
+    /// distinct reads.
+    DuplicateReadCache(size_t capacity);
+
+    /// If a read with the same sequence and qualities was put under the same
+    /// parameters, fill in the alignments it mapped to, stamped with this
+    /// read's identity, and return true. Otherwise return false.
+    bool retrieve(const Alignment& read, const string& parameters, vector<Alignment>& alignments);
+
+    /// Remember the alignments the read mapped to under the parameters.
+    void put(const Alignment& read, const string& parameters, const vector<Alignment>& alignments);
+
+    /// Get the number of reads that were found.
+    size_t hits() const;
+
+    /// Get the number of reads that had to be mapped.
+    size_t misses() const;
+
+    /// Get the number of distinct reads cached.
+    size_t size() const;
+
+private:
+
+    /// Get the key that identifies a read's alignments.
+    static string key_for(const Alignment& read, const string& parameters);
+
+    ShardedCache<string, shared_ptr<const vector<Alignment>>, std::hash<string>> cache;
+};
+
+}
+
+#endif
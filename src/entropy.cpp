@@ -1,5 +1,8 @@
 #include "entropy.hpp"
 
+#include <cstdint>
+#include <functional>
+
 namespace vg {
 
 using namespace std;
@@ -9,18 +12,141 @@ double entropy(const string& st) {
 }
 
 double entropy(const char* st, size_t len) {
-    map<char, int> freqs;
+    // Count in a flat table rather than a map, so the counting loop is just
+    // increments
+    uint64_t freqs[256] = {0};
     for (size_t i = 0; i < len; ++i) {
-        ++freqs[st[i]];
+        ++freqs[(unsigned char) st[i]];
     }
     double ent = 0;
     double ln2 = log(2);
-    for (auto& f : freqs) {
-        double freq = (double)f.second/len;
-        ent += freq * log(freq)/ln2;
+    for (size_t c = 0; c < 256; c++) {
+        if (freqs[c]) {
+            double freq = (double)freqs[c]/len;
+            ent += freq * log(freq)/ln2;
+        }
     }
     ent = -ent;
     return ent;
 }
 
+/// Code each character as A, C, G, T, or N
+static const uint8_t* base_codes() {
+    static uint8_t codes[256];
+    static bool filled = []() {
+        for (size_t i = 0; i < 256; i++) {
+            codes[i] = 4;
+        }
+        codes['A'] = codes['a'] = 0;
+        codes['C'] = codes['c'] = 1;
+        codes['G'] = codes['g'] = 2;
+        codes['T'] = codes['t'] = 3;
+        return true;
+    }();
+    (void) filled;
+    return codes;
+}
+
+LowComplexityMasker::LowComplexityMasker(size_t window_size, double min_base_entropy,
+                                         double min_dimer_entropy) :
+    window_size(window_size), min_base_entropy(min_base_entropy), min_dimer_entropy(min_dimer_entropy),
+    count_log_count(window_size + 1, 0.0) {
+    
+    for (size_t c = 1; c <= window_size; c++) {
+        count_log_count[c] = c * log2((double) c);
+    }
+}
+
+size_t LowComplexityMasker::for_each_low_complexity_window(const char* seq, size_t len,
+                                                           const function<void(size_t)>& iteratee) const {
+    
+    size_t window = min(window_size, len);
+    if (window < 2) {
+        // There's no dinucleotide composition to score
+        return window;
+    }
+    
+    const uint8_t* codes = base_codes();
+    size_t base_counts[5] = {0};
+    size_t dimer_counts[25] = {0};
+    // Running sums of c * log2(c) over the counts, so each entropy is
+    // log2(n) - sum / n
+    double base_sum = 0.0;
+    double dimer_sum = 0.0;
+    
+    auto add_base = [&](uint8_t code, int delta) {
+        size_t& count = base_counts[code];
+        base_sum -= count_log_count[count];
+        count += delta;
+        base_sum += count_log_count[count];
+    };
+    auto add_dimer = [&](uint8_t code, int delta) {
+        size_t& count = dimer_counts[code];
+        dimer_sum -= count_log_count[count];
+        count += delta;
+        dimer_sum += count_log_count[count];
+    };
+    
+    for (size_t i = 0; i < window; i++) {
+        add_base(codes[(unsigned char) seq[i]], 1);
+        if (i > 0) {
+            add_dimer(codes[(unsigned char) seq[i - 1]] * 5 + codes[(unsigned char) seq[i]], 1);
+        }
+    }
+    
+    // The thresholds in terms of the sums, which saves taking logs per window
+    double max_base_sum = (log2((double) window) - min_base_entropy) * window;
+    double max_dimer_sum = (log2((double) (window - 1)) - min_dimer_entropy) * (window - 1);
+    
+    for (size_t start = 0; ; start++) {
+        if (base_sum > max_base_sum || dimer_sum > max_dimer_sum) {
+            iteratee(start);
+        }
+        if (start + window >= len) {
+            break;
+        }
+        // Slide the window over by one
+        uint8_t leaving = codes[(unsigned char) seq[start]];
+        uint8_t after_leaving = codes[(unsigned char) seq[start + 1]];
+        uint8_t last = codes[(unsigned char) seq[start + window - 1]];
+        uint8_t entering = codes[(unsigned char) seq[start + window]];
+        add_base(leaving, -1);
+        add_base(entering, 1);
+        add_dimer(leaving * 5 + after_leaving, -1);
+        add_dimer(last * 5 + entering, 1);
+    }
+    
+    return window;
+}
+
+vector<bool> LowComplexityMasker::mask(const char* seq, size_t len) const {
+    vector<bool> masked(len, false);
+    // Windows come in order, so only the bases past the last masked one need
+    // marking
+    size_t masked_to = 0;
+    size_t window = min(window_size, len);
+    for_each_low_complexity_window(seq, len, [&](size_t start) {
+        for (size_t i = max(start, masked_to); i < start + window; i++) {
+            masked[i] = true;
+        }
+        masked_to = start + window;
+    });
+    return masked;
+}
+
+vector<bool> LowComplexityMasker::mask(const string& seq) const {
+    return mask(seq.c_str(), seq.size());
+}
+
+size_t LowComplexityMasker::masked_length(const char* seq, size_t len) const {
+    size_t masked = 0;
+    size_t masked_to = 0;
+    size_t window = min(window_size, len);
+    for_each_low_complexity_window(seq, len, [&](size_t start) {
+        masked += start + window - max(start, masked_to);
+        masked_to = start + window;
+    });
+    return masked;
+}
+
 }
@@ -7,6 +7,7 @@
 #include <string>
 #include <cmath>
 #include <map>
+#include <functional>
 
 namespace vg {
 
@@ -15,6 +16,48 @@ using namespace std;
 double entropy(const string& st);
 double entropy(const char* st, size_t len);
 
+/**
+ * Finds low-complexity stretches of DNA sequence. Every window of a fixed
+ * size is scored on the Shannon entropy (in bits) of its base composition and
+ * of its dinucleotide composition, in one pass that updates the counts and
+ * the entropy sums as the window slides. A window is low-complexity if either
+ * entropy is below its threshold; homopolymers and skewed runs fail the base
+ * test, and short tandem repeats like ATATAT fail the dinucleotide test.
+ * Characters other than ACGT (in either case) all count as N.
+ */
+class LowComplexityMasker {
+public:
+    
+    /// Make a masker with the given window size and minimum entropies. A
+    /// random window has base entropy near 2 and dinucleotide entropy near
+    /// the log2 of its number of dinucleotides, up to 4.
+    LowComplexityMasker(size_t window_size = 24, double min_base_entropy = 1.0,
+                        double min_dimer_entropy = 2.0);
+    
+    /// Get a mask with true for each base in a low-complexity window.
+    /// Sequences shorter than the window are scored as one window.
+    vector<bool> mask(const char* seq, size_t len) const;
+    vector<bool> mask(const string& seq) const;
+    
+    /// Get the number of bases in the sequence covered by low-complexity
+    /// windows.
+    size_t masked_length(const char* seq, size_t len) const;
+
+private:
+    
+    /// Call the iteratee with the start of each low-complexity window.
+    /// Returns the window size it used.
+    size_t for_each_low_complexity_window(const char* seq, size_t len,
+                                          const function<void(size_t)>& iteratee) const;
+    
+    size_t window_size;
+    double min_base_entropy;
+    double min_dimer_entropy;
+    
+    /// c * log2(c) for every count c a window can have
+    vector<double> count_log_count;
+};
+
 }
 
 #endif
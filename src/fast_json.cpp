@@ -0,0 +1,1074 @@
+#include "fast_json.hpp"
+
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+
+#include "vg.pb.h"
+
+/**
+ * \file fast_json.cpp
+ * Specialized JSON codec for the hot vg message types.
+ */
+
+namespace vg {
+
+namespace fast_json {
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////
+// Encoding
+////////////////////////////////////////////////////////////////////////////////
+
+/// Accumulates one JSON object, comma-separating its fields.
+class ObjectWriter {
+public:
+    ObjectWriter(string& out) : out(out) {
+        out.push_back('{');
+    }
+
+    /// Start a field, writing its key.
+    void key(const char* name) {
+        if (!first) {
+            out.push_back(',');
+        }
+        first = false;
+        out.push_back('"');
+        out.append(name);
+        out.append("\":");
+    }
+
+    void close() {
+        out.push_back('}');
+    }
+
+    string& out;
+private:
+    bool first = true;
+};
+
+static const char* hex_digits = "0123456789abcdef";
+
+/// Write a quoted, escaped string the way Protobuf does. Returns false for
+/// non-ASCII strings, since Protobuf validates those as UTF-8.
+static bool put_string(string& out, const string& s) {
+    out.push_back('"');
+    for (unsigned char c : s) {
+        if (c >= 0x80) {
+            return false;
+        }
+        switch (c) {
+        case '"':
+            out.append("\\\"");
+            break;
+        case '\\':
+            out.append("\\\\");
+            break;
+        case '\b':
+            out.append("\\b");
+            break;
+        case '\f':
+            out.append("\\f");
+            break;
+        case '\n':
+            out.append("\\n");
+            break;
+        case '\r':
+            out.append("\\r");
+            break;
+        case '\t':
+            out.append("\\t");
+            break;
+        default:
+            if (c < 0x20 || c == '<' || c == '>' || c == 0x7f) {
+                out.append("\\u00");
+                out.push_back(hex_digits[c >> 4]);
+                out.push_back(hex_digits[c & 0xf]);
+            } else {
+                out.push_back(c);
+            }
+        }
+    }
+    out.push_back('"');
+    return true;
+}
+
+static void put_int32(string& out, int32_t value) {
+    char buffer[16];
+    int length = snprintf(buffer, sizeof(buffer), "%d", value);
+    out.append(buffer, length);
+}
+
+/// 64-bit integers are quoted, since JSON numbers are doubles.
+static void put_int64(string& out, int64_t value) {
+    char buffer[24];
+    int length = snprintf(buffer, sizeof(buffer), "\"%lld\"", (long long) value);
+    out.append(buffer, length);
+}
+
+static void put_bool(string& out, bool value) {
+    out.append(value ? "true" : "false");
+}
+
+/// Write the shortest of 15 or 17 significant digits that reads back the
+/// same, as Protobuf's SimpleDtoa() does.
+static void put_double(string& out, double value) {
+    if (std::isnan(value)) {
+        out.append("\"NaN\"");
+    } else if (std::isinf(value)) {
+        out.append(value > 0 ? "\"Infinity\"" : "\"-Infinity\"");
+    } else {
+        char buffer[32];
+        int length = snprintf(buffer, sizeof(buffer), "%.15g", value);
+        if (strtod(buffer, nullptr) != value) {
+            length = snprintf(buffer, sizeof(buffer), "%.17g", value);
+        }
+        out.append(buffer, length);
+    }
+}
+
+/// Is a double field set, in proto3 terms? Negative zero counts.
+static bool double_set(double value) {
+    return value != 0 || std::signbit(value);
+}
+
+static const char* base64_digits = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static void put_bytes(string& out, const string& bytes) {
+    out.push_back('"');
+    size_t i = 0;
+    for (; i + 3 <= bytes.size(); i += 3) {
+        uint32_t group = ((uint8_t) bytes[i] << 16) | ((uint8_t) bytes[i + 1] << 8) | (uint8_t) bytes[i + 2];
+        out.push_back(base64_digits[(group >> 18) & 63]);
+        out.push_back(base64_digits[(group >> 12) & 63]);
+        out.push_back(base64_digits[(group >> 6) & 63]);
+        out.push_back(base64_digits[group & 63]);
+    }
+    if (i + 1 == bytes.size()) {
+        uint32_t group = (uint8_t) bytes[i] << 16;
+        out.push_back(base64_digits[(group >> 18) & 63]);
+        out.push_back(base64_digits[(group >> 12) & 63]);
+        out.append("==");
+    } else if (i + 2 == bytes.size()) {
+        uint32_t group = ((uint8_t) bytes[i] << 16) | ((uint8_t) bytes[i + 1] << 8);
+        out.push_back(base64_digits[(group >> 18) & 63]);
+        out.push_back(base64_digits[(group >> 12) & 63]);
+        out.push_back(base64_digits[(group >> 6) & 63]);
+        out.push_back('=');
+    }
+    out.push_back('"');
+}
+
+// Each message encoder writes the set fields in field number order, which is
+// the order Protobuf prints them in.
+
+static bool put_position(string& out, const Position& position) {
+    ObjectWriter obj(out);
+    if (position.node_id()) {
+        obj.key("node_id");
+        put_int64(out, position.node_id());
+    }
+    if (position.offset()) {
+        obj.key("offset");
+        put_int64(out, position.offset());
+    }
+    if (position.is_reverse()) {
+        obj.key("is_reverse");
+        put_bool(out, true);
+    }
+    if (!position.name().empty()) {
+        obj.key("name");
+        if (!put_string(out, position.name())) {
+            return false;
+        }
+    }
+    obj.close();
+    return true;
+}
+
+static bool put_edit(string& out, const Edit& edit) {
+    ObjectWriter obj(out);
+    if (edit.from_length()) {
+        obj.key("from_length");
+        put_int32(out, edit.from_length());
+    }
+    if (edit.to_length()) {
+        obj.key("to_length");
+        put_int32(out, edit.to_length());
+    }
+    if (!edit.sequence().empty()) {
+        obj.key("sequence");
+        if (!put_string(out, edit.sequence())) {
+            return false;
+        }
+    }
+    obj.close();
+    return true;
+}
+
+static bool put_mapping(string& out, const Mapping& mapping) {
+    ObjectWriter obj(out);
+    if (mapping.has_position()) {
+        obj.key("position");
+        if (!put_position(out, mapping.position())) {
+            return false;
+        }
+    }
+    if (mapping.edit_size()) {
+        obj.key("edit");
+        out.push_back('[');
+        for (size_t i = 0; i < mapping.edit_size(); i++) {
+            if (i) {
+                out.push_back(',');
+            }
+            if (!put_edit(out, mapping.edit(i))) {
+                return false;
+            }
+        }
+        out.push_back(']');
+    }
+    if (mapping.rank()) {
+        obj.key("rank");
+        put_int64(out, mapping.rank());
+    }
+    obj.close();
+    return true;
+}
+
+static bool put_path(string& out, const Path& path) {
+    ObjectWriter obj(out);
+    if (!path.name().empty()) {
+        obj.key("name");
+        if (!put_string(out, path.name())) {
+            return false;
+        }
+    }
+    if (path.mapping_size()) {
+        obj.key("mapping");
+        out.push_back('[');
+        for (size_t i = 0; i < path.mapping_size(); i++) {
+            if (i) {
+                out.push_back(',');
+            }
+            if (!put_mapping(out, path.mapping(i))) {
+                return false;
+            }
+        }
+        out.push_back(']');
+    }
+    if (path.is_circular()) {
+        obj.key("is_circular");
+        put_bool(out, true);
+    }
+    if (path.length()) {
+        obj.key("length");
+        put_int64(out, path.length());
+    }
+    obj.close();
+    return true;
+}
+
+static bool put_node(string& out, const Node& node) {
+    ObjectWriter obj(out);
+    if (!node.sequence().empty()) {
+        obj.key("sequence");
+        if (!put_string(out, node.sequence())) {
+            return false;
+        }
+    }
+    if (!node.name().empty()) {
+        obj.key("name");
+        if (!put_string(out, node.name())) {
+            return false;
+        }
+    }
+    if (node.id()) {
+        obj.key("id");
+        put_int64(out, node.id());
+    }
+    obj.close();
+    return true;
+}
+
+static bool put_edge(string& out, const Edge& edge) {
+    ObjectWriter obj(out);
+    if (edge.from()) {
+        obj.key("from");
+        put_int64(out, edge.from());
+    }
+    if (edge.to()) {
+        obj.key("to");
+        put_int64(out, edge.to());
+    }
+    if (edge.from_start()) {
+        obj.key("from_start");
+        put_bool(out, true);
+    }
+    if (edge.to_end()) {
+        obj.key("to_end");
+        put_bool(out, true);
+    }
+    if (edge.overlap()) {
+        obj.key("overlap");
+        put_int32(out, edge.overlap());
+    }
+    obj.close();
+    return true;
+}
+
+/// Write a repeated message field, if it has anything in it.
+template<typename Repeated, typename Put>
+static bool put_repeated(ObjectWriter& obj, const char* name, const Repeated& items, const Put& put) {
+    if (items.size() == 0) {
+        return true;
+    }
+    obj.key(name);
+    obj.out.push_back('[');
+    bool first = true;
+    for (auto& item : items) {
+        if (!first) {
+            obj.out.push_back(',');
+        }
+        first = false;
+        if (!put(obj.out, item)) {
+            return false;
+        }
+    }
+    obj.out.push_back(']');
+    return true;
+}
+
+static bool put_graph(string& out, const Graph& graph) {
+    ObjectWriter obj(out);
+    if (!put_repeated(obj, "node", graph.node(), put_node)
+        || !put_repeated(obj, "edge", graph.edge(), put_edge)
+        || !put_repeated(obj, "path", graph.path(), put_path)) {
+        return false;
+    }
+    obj.close();
+    return true;
+}
+
+/// Write a string field if it is set.
+static bool put_string_field(ObjectWriter& obj, const char* name, const string& value) {
+    if (value.empty()) {
+        return true;
+    }
+    obj.key(name);
+    return put_string(obj.out, value);
+}
+
+static void put_int32_field(ObjectWriter& obj, const char* name, int32_t value) {
+    if (value) {
+        obj.key(name);
+        put_int32(obj.out, value);
+    }
+}
+
+static void put_bool_field(ObjectWriter& obj, const char* name, bool value) {
+    if (value) {
+        obj.key(name);
+        put_bool(obj.out, true);
+    }
+}
+
+static void put_double_field(ObjectWriter& obj, const char* name, double value) {
+    if (double_set(value)) {
+        obj.key(name);
+        put_double(obj.out, value);
+    }
+}
+
+static bool put_alignment(string& out, const Alignment& aln) {
+    if (aln.locus_size() || aln.has_annotation()) {
+        // These need reflection
+        return false;
+    }
+    ObjectWriter obj(out);
+    if (!put_string_field(obj, "sequence", aln.sequence())) {
+        return false;
+    }
+    if (aln.has_path()) {
+        obj.key("path");
+        if (!put_path(out, aln.path())) {
+            return false;
+        }
+    }
+    if (!put_string_field(obj, "name", aln.name())) {
+        return false;
+    }
+    if (!aln.quality().empty()) {
+        obj.key("quality");
+        put_bytes(out, aln.quality());
+    }
+    put_int32_field(obj, "mapping_quality", aln.mapping_quality());
+    put_int32_field(obj, "score", aln.score());
+    put_int32_field(obj, "query_position", aln.query_position());
+    if (!put_string_field(obj, "sample_name", aln.sample_name())
+        || !put_string_field(obj, "read_group", aln.read_group())) {
+        return false;
+    }
+    if (aln.has_fragment_prev()) {
+        obj.key("fragment_prev");
+        if (!put_alignment(out, aln.fragment_prev())) {
+            return false;
+        }
+    }
+    if (aln.has_fragment_next()) {
+        obj.key("fragment_next");
+        if (!put_alignment(out, aln.fragment_next())) {
+            return false;
+        }
+    }
+    put_bool_field(obj, "is_secondary", aln.is_secondary());
+    put_double_field(obj, "identity", aln.identity());
+    if (!put_repeated(obj, "fragment", aln.fragment(), put_path)
+        || !put_repeated(obj, "refpos", aln.refpos(), put_position)) {
+        return false;
+    }
+    put_bool_field(obj, "read_paired", aln.read_paired());
+    put_bool_field(obj, "read_mapped", aln.read_mapped());
+    put_bool_field(obj, "mate_unmapped", aln.mate_unmapped());
+    put_bool_field(obj, "read_on_reverse_strand", aln.read_on_reverse_strand());
+    put_bool_field(obj, "mate_on_reverse_strand", aln.mate_on_reverse_strand());
+    put_bool_field(obj, "soft_clipped", aln.soft_clipped());
+    put_bool_field(obj, "discordant_insert_size", aln.discordant_insert_size());
+    put_double_field(obj, "uniqueness", aln.uniqueness());
+    put_double_field(obj, "correct", aln.correct());
+    if (aln.secondary_score_size()) {
+        obj.key("secondary_score");
+        out.push_back('[');
+        for (size_t i = 0; i < aln.secondary_score_size(); i++) {
+            if (i) {
+                out.push_back(',');
+            }
+            put_int32(out, aln.secondary_score(i));
+        }
+        out.push_back(']');
+    }
+    put_double_field(obj, "fragment_score", aln.fragment_score());
+    put_bool_field(obj, "mate_mapped_to_disjoint_subgraph", aln.mate_mapped_to_disjoint_subgraph());
+    if (!put_string_field(obj, "fragment_length_distribution", aln.fragment_length_distribution())) {
+        return false;
+    }
+    put_bool_field(obj, "haplotype_scored", aln.haplotype_scored());
+    put_double_field(obj, "haplotype_logprob", aln.haplotype_logprob());
+    put_double_field(obj, "time_used", aln.time_used());
+    if (aln.has_to_correct()) {
+        obj.key("to_correct");
+        if (!put_position(out, aln.to_correct())) {
+            return false;
+        }
+    }
+    put_bool_field(obj, "correctly_mapped", aln.correctly_mapped());
+    obj.close();
+    return true;
+}
+
+bool encode(const google::protobuf::Message& msg, string& out) {
+    const google::protobuf::Descriptor* type = msg.GetDescriptor();
+    string encoded;
+    bool ok;
+    if (type == Alignment::descriptor()) {
+        ok = put_alignment(encoded, static_cast<const Alignment&>(msg));
+    } else if (type == Graph::descriptor()) {
+        ok = put_graph(encoded, static_cast<const Graph&>(msg));
+    } else if (type == Path::descriptor()) {
+        ok = put_path(encoded, static_cast<const Path&>(msg));
+    } else if (type == Mapping::descriptor()) {
+        ok = put_mapping(encoded, static_cast<const Mapping&>(msg));
+    } else if (type == Node::descriptor()) {
+        ok = put_node(encoded, static_cast<const Node&>(msg));
+    } else if (type == Edge::descriptor()) {
+        ok = put_edge(encoded, static_cast<const Edge&>(msg));
+    } else if (type == Edit::descriptor()) {
+        ok = put_edit(encoded, static_cast<const Edit&>(msg));
+    } else if (type == Position::descriptor()) {
+        ok = put_position(encoded, static_cast<const Position&>(msg));
+    } else {
+        return false;
+    }
+    if (!ok) {
+        return false;
+    }
+    if (out.empty()) {
+        out.swap(encoded);
+    } else {
+        out.append(encoded);
+    }
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Decoding
+////////////////////////////////////////////////////////////////////////////////
+
+/// A cursor over the JSON being parsed. Every method returns false if the
+/// JSON isn't what we can handle.
+class Reader {
+public:
+    Reader(const char* buf, size_t size) : here(buf), end(buf + size) {
+        // Nothing to do
+    }
+
+    void skip_space() {
+        while (here != end && (*here == ' ' || *here == '\n' || *here == '\t' || *here == '\r')) {
+            ++here;
+        }
+    }
+
+    /// Skip whitespace and then the given character.
+    bool expect(char c) {
+        skip_space();
+        if (here == end || *here != c) {
+            return false;
+        }
+        ++here;
+        return true;
+    }
+
+    /// Skip whitespace and report if the next character is the given one,
+    /// consuming it if so.
+    bool next_is(char c) {
+        skip_space();
+        if (here != end && *here == c) {
+            ++here;
+            return true;
+        }
+        return false;
+    }
+
+    bool at_end() {
+        skip_space();
+        return here == end;
+    }
+
+    /// Parse a quoted string. Only ASCII is accepted.
+    bool get_string(string& value) {
+        if (!expect('"')) {
+            return false;
+        }
+        value.clear();
+        while (true) {
+            // Copy runs of plain characters at once
+            const char* run = here;
+            while (here != end && *here != '"' && *here != '\\' && (unsigned char) *here >= 0x20
+                   && (unsigned char) *here < 0x80) {
+                ++here;
+            }
+            value.append(run, here - run);
+            if (here == end) {
+                return false;
+            }
+            char c = *here++;
+            if (c == '"') {
+                return true;
+            }
+            if (c != '\\' || here == end) {
+                // A control character or non-ASCII
+                return false;
+            }
+            c = *here++;
+            switch (c) {
+            case '"':
+            case '\\':
+            case '/':
+                value.push_back(c);
+                break;
+            case 'b':
+                value.push_back('\b');
+                break;
+            case 'f':
+                value.push_back('\f');
+                break;
+            case 'n':
+                value.push_back('\n');
+                break;
+            case 'r':
+                value.push_back('\r');
+                break;
+            case 't':
+                value.push_back('\t');
+                break;
+            case 'u':
+                {
+                    if (end - here < 4) {
+                        return false;
+                    }
+                    unsigned code = 0;
+                    for (size_t i = 0; i < 4; i++) {
+                        char h = *here++;
+                        code <<= 4;
+                        if (h >= '0' && h <= '9') {
+                            code |= h - '0';
+                        } else if (h >= 'a' && h <= 'f') {
+                            code |= h - 'a' + 10;
+                        } else if (h >= 'A' && h <= 'F') {
+                            code |= h - 'A' + 10;
+                        } else {
+                            return false;
+                        }
+                    }
+                    if (code >= 0x80) {
+                        return false;
+                    }
+                    value.push_back((char) code);
+                }
+                break;
+            default:
+                return false;
+            }
+        }
+    }
+
+    /// Parse a bare integer, for an integer field.
+    bool get_bare_int64(int64_t& value) {
+        skip_space();
+        const char* start = here;
+        if (here != end && *here == '-') {
+            ++here;
+        }
+        const char* digits = here;
+        while (here != end && *here >= '0' && *here <= '9') {
+            ++here;
+        }
+        if (here == digits || (here != end && (*here == '.' || *here == 'e' || *here == 'E'))) {
+            // Not an integer in the form we write
+            return false;
+        }
+        errno = 0;
+        char* parsed_to;
+        long long parsed = strtoll(start, &parsed_to, 10);
+        if (errno || parsed_to != here) {
+            return false;
+        }
+        value = parsed;
+        return true;
+    }
+
+    /// Parse a 64-bit integer, quoted or not.
+    bool get_int64(int64_t& value) {
+        if (next_is('"')) {
+            return get_bare_int64(value) && here != end && *here++ == '"';
+        }
+        return get_bare_int64(value);
+    }
+
+    /// Parse a 32-bit integer, which we only take unquoted.
+    bool get_int32(int32_t& value) {
+        int64_t wide;
+        if (!get_bare_int64(wide) || wide < numeric_limits<int32_t>::min() || wide > numeric_limits<int32_t>::max()) {
+            return false;
+        }
+        value = (int32_t) wide;
+        return true;
+    }
+
+    bool get_bool(bool& value) {
+        skip_space();
+        if (end - here >= 4 && strncmp(here, "true", 4) == 0) {
+            here += 4;
+            value = true;
+            return true;
+        }
+        if (end - here >= 5 && strncmp(here, "false", 5) == 0) {
+            here += 5;
+            value = false;
+            return true;
+        }
+        return false;
+    }
+
+    bool get_double(double& value) {
+        skip_space();
+        if (here != end && *here == '"') {
+            string special;
+            if (!get_string(special)) {
+                return false;
+            }
+            if (special == "NaN") {
+                value = numeric_limits<double>::quiet_NaN();
+            } else if (special == "Infinity") {
+                value = numeric_limits<double>::infinity();
+            } else if (special == "-Infinity") {
+                value = -numeric_limits<double>::infinity();
+            } else {
+                return false;
+            }
+            return true;
+        }
+        if (here == end || !(*here == '-' || (*here >= '0' && *here <= '9'))) {
+            return false;
+        }
+        char* parsed_to;
+        value = strtod(here, &parsed_to);
+        if (parsed_to == here || parsed_to > end || !std::isfinite(value)
+            || memchr(here, 'x', parsed_to - here) || memchr(here, 'X', parsed_to - here)) {
+            // Not a plain decimal number
+            return false;
+        }
+        if (value == 0.0 && !memchr(here, '.', parsed_to - here)
+            && !memchr(here, 'e', parsed_to - here) && !memchr(here, 'E', parsed_to - here)) {
+            // Protobuf reads integer-looking numbers as integers, so "-0"
+            // comes back as positive zero.
+            value = 0.0;
+        }
+        here = parsed_to;
+        return true;
+    }
+
+    /// Parse base64, in either the standard or web-safe alphabet, with or
+    /// without padding.
+    bool get_bytes(string& value) {
+        string encoded;
+        if (!get_string(encoded)) {
+            return false;
+        }
+        while (!encoded.empty() && encoded.back() == '=') {
+            encoded.pop_back();
+        }
+        if (encoded.size() % 4 == 1) {
+            return false;
+        }
+        value.clear();
+        value.reserve(encoded.size() * 3 / 4);
+        uint32_t group = 0;
+        size_t bits = 0;
+        for (char c : encoded) {
+            uint32_t digit;
+            if (c >= 'A' && c <= 'Z') {
+                digit = c - 'A';
+            } else if (c >= 'a' && c <= 'z') {
+                digit = c - 'a' + 26;
+            } else if (c >= '0' && c <= '9') {
+                digit = c - '0' + 52;
+            } else if (c == '+' || c == '-') {
+                digit = 62;
+            } else if (c == '/' || c == '_') {
+                digit = 63;
+            } else {
+                return false;
+            }
+            group = (group << 6) | digit;
+            bits += 6;
+            if (bits >= 8) {
+                bits -= 8;
+                value.push_back((char) ((group >> bits) & 0xff));
+            }
+        }
+        return true;
+    }
+
+    /// Parse an object, calling the handler with each key after its colon.
+    /// The handler parses the value.
+    template<typename Handler>
+    bool get_object(const Handler& handle_field) {
+        if (!expect('{')) {
+            return false;
+        }
+        if (next_is('}')) {
+            return true;
+        }
+        string key;
+        do {
+            if (!get_string(key) || !expect(':') || !handle_field(key)) {
+                return false;
+            }
+        } while (next_is(','));
+        return expect('}');
+    }
+
+    /// Parse an array, calling the handler to parse each item.
+    template<typename Handler>
+    bool get_array(const Handler& handle_item) {
+        if (!expect('[')) {
+            return false;
+        }
+        if (next_is(']')) {
+            return true;
+        }
+        do {
+            if (!handle_item()) {
+                return false;
+            }
+        } while (next_is(','));
+        return expect(']');
+    }
+
+private:
+    const char* here;
+    const char* end;
+};
+
+// Each message decoder gives up on keys it doesn't know, which includes
+// camel-cased names, so reflection can deal with them.
+
+/// Parse a repeated message field with the given decoder.
+template<typename Repeated, typename Get>
+static bool get_repeated(Reader& in, Repeated* items, const Get& get) {
+    return in.get_array([&]() {
+        return get(in, *items->Add());
+    });
+}
+
+static bool get_position(Reader& in, Position& position) {
+    return in.get_object([&](const string& key) {
+        int64_t number;
+        bool flag;
+        if (key == "node_id") {
+            if (!in.get_int64(number)) return false;
+            position.set_node_id(number);
+        } else if (key == "offset") {
+            if (!in.get_int64(number)) return false;
+            position.set_offset(number);
+        } else if (key == "is_reverse") {
+            if (!in.get_bool(flag)) return false;
+            position.set_is_reverse(flag);
+        } else if (key == "name") {
+            return in.get_string(*position.mutable_name());
+        } else {
+            return false;
+        }
+        return true;
+    });
+}
+
+static bool get_edit(Reader& in, Edit& edit) {
+    return in.get_object([&](const string& key) {
+        int32_t number;
+        if (key == "from_length") {
+            if (!in.get_int32(number)) return false;
+            edit.set_from_length(number);
+        } else if (key == "to_length") {
+            if (!in.get_int32(number)) return false;
+            edit.set_to_length(number);
+        } else if (key == "sequence") {
+            return in.get_string(*edit.mutable_sequence());
+        } else {
+            return false;
+        }
+        return true;
+    });
+}
+
+static bool get_mapping(Reader& in, Mapping& mapping) {
+    return in.get_object([&](const string& key) {
+        if (key == "position") {
+            return get_position(in, *mapping.mutable_position());
+        } else if (key == "edit") {
+            return get_repeated(in, mapping.mutable_edit(), get_edit);
+        } else if (key == "rank") {
+            int64_t number;
+            if (!in.get_int64(number)) return false;
+            mapping.set_rank(number);
+            return true;
+        }
+        return false;
+    });
+}
+
+static bool get_path(Reader& in, Path& path) {
+    return in.get_object([&](const string& key) {
+        if (key == "name") {
+            return in.get_string(*path.mutable_name());
+        } else if (key == "mapping") {
+            return get_repeated(in, path.mutable_mapping(), get_mapping);
+        } else if (key == "is_circular") {
+            bool flag;
+            if (!in.get_bool(flag)) return false;
+            path.set_is_circular(flag);
+            return true;
+        } else if (key == "length") {
+            int64_t number;
+            if (!in.get_int64(number)) return false;
+            path.set_length(number);
+            return true;
+        }
+        return false;
+    });
+}
+
+static bool get_node(Reader& in, Node& node) {
+    return in.get_object([&](const string& key) {
+        if (key == "sequence") {
+            return in.get_string(*node.mutable_sequence());
+        } else if (key == "name") {
+            return in.get_string(*node.mutable_name());
+        } else if (key == "id") {
+            int64_t number;
+            if (!in.get_int64(number)) return false;
+            node.set_id(number);
+            return true;
+        }
+        return false;
+    });
+}
+
+static bool get_edge(Reader& in, Edge& edge) {
+    return in.get_object([&](const string& key) {
+        int64_t number;
+        bool flag;
+        if (key == "from") {
+            if (!in.get_int64(number)) return false;
+            edge.set_from(number);
+        } else if (key == "to") {
+            if (!in.get_int64(number)) return false;
+            edge.set_to(number);
+        } else if (key == "from_start") {
+            if (!in.get_bool(flag)) return false;
+            edge.set_from_start(flag);
+        } else if (key == "to_end") {
+            if (!in.get_bool(flag)) return false;
+            edge.set_to_end(flag);
+        } else if (key == "overlap") {
+            int32_t overlap;
+            if (!in.get_int32(overlap)) return false;
+            edge.set_overlap(overlap);
+        } else {
+            return false;
+        }
+        return true;
+    });
+}
+
+static bool get_graph(Reader& in, Graph& graph) {
+    return in.get_object([&](const string& key) {
+        if (key == "node") {
+            return get_repeated(in, graph.mutable_node(), get_node);
+        } else if (key == "edge") {
+            return get_repeated(in, graph.mutable_edge(), get_edge);
+        } else if (key == "path") {
+            return get_repeated(in, graph.mutable_path(), get_path);
+        }
+        return false;
+    });
+}
+
+static bool get_alignment(Reader& in, Alignment& aln) {
+    return in.get_object([&](const string& key) {
+        int32_t number;
+        bool flag;
+        double real;
+
+        // Set a bool field through its setter
+        auto bool_field = [&](void (Alignment::*setter)(bool)) {
+            if (!in.get_bool(flag)) return false;
+            (aln.*setter)(flag);
+            return true;
+        };
+        auto int32_field = [&](void (Alignment::*setter)(int32_t)) {
+            if (!in.get_int32(number)) return false;
+            (aln.*setter)(number);
+            return true;
+        };
+        auto double_field = [&](void (Alignment::*setter)(double)) {
+            if (!in.get_double(real)) return false;
+            (aln.*setter)(real);
+            return true;
+        };
+
+        switch (key.empty() ? 0 : key[0]) {
+        case 'c':
+            if (key == "correct") return double_field(&Alignment::set_correct);
+            if (key == "correctly_mapped") return bool_field(&Alignment::set_correctly_mapped);
+            break;
+        case 'd':
+            if (key == "discordant_insert_size") return bool_field(&Alignment::set_discordant_insert_size);
+            break;
+        case 'f':
+            if (key == "fragment_prev") return get_alignment(in, *aln.mutable_fragment_prev());
+            if (key == "fragment_next") return get_alignment(in, *aln.mutable_fragment_next());
+            if (key == "fragment") return get_repeated(in, aln.mutable_fragment(), get_path);
+            if (key == "fragment_score") return double_field(&Alignment::set_fragment_score);
+            if (key == "fragment_length_distribution") return in.get_string(*aln.mutable_fragment_length_distribution());
+            break;
+        case 'h':
+            if (key == "haplotype_scored") return bool_field(&Alignment::set_haplotype_scored);
+            if (key == "haplotype_logprob") return double_field(&Alignment::set_haplotype_logprob);
+            break;
+        case 'i':
+            if (key == "identity") return double_field(&Alignment::set_identity);
+            if (key == "is_secondary") return bool_field(&Alignment::set_is_secondary);
+            break;
+        case 'm':
+            if (key == "mapping_quality") return int32_field(&Alignment::set_mapping_quality);
+            if (key == "mate_unmapped") return bool_field(&Alignment::set_mate_unmapped);
+            if (key == "mate_on_reverse_strand") return bool_field(&Alignment::set_mate_on_reverse_strand);
+            if (key == "mate_mapped_to_disjoint_subgraph") return bool_field(&Alignment::set_mate_mapped_to_disjoint_subgraph);
+            break;
+        case 'n':
+            if (key == "name") return in.get_string(*aln.mutable_name());
+            break;
+        case 'p':
+            if (key == "path") return get_path(in, *aln.mutable_path());
+            break;
+        case 'q':
+            if (key == "quality") return in.get_bytes(*aln.mutable_quality());
+            if (key == "query_position") return int32_field(&Alignment::set_query_position);
+            break;
+        case 'r':
+            if (key == "read_group") return in.get_string(*aln.mutable_read_group());
+            if (key == "refpos") return get_repeated(in, aln.mutable_refpos(), get_position);
+            if (key == "read_paired") return bool_field(&Alignment::set_read_paired);
+            if (key == "read_mapped") return bool_field(&Alignment::set_read_mapped);
+            if (key == "read_on_reverse_strand") return bool_field(&Alignment::set_read_on_reverse_strand);
+            break;
+        case 's':
+            if (key == "sequence") return in.get_string(*aln.mutable_sequence());
+            if (key == "score") return int32_field(&Alignment::set_score);
+            if (key == "sample_name") return in.get_string(*aln.mutable_sample_name());
+            if (key == "soft_clipped") return bool_field(&Alignment::set_soft_clipped);
+            if (key == "secondary_score") {
+                return in.get_array([&]() {
+                    if (!in.get_int32(number)) return false;
+                    aln.add_secondary_score(number);
+                    return true;
+                });
+            }
+            break;
+        case 't':
+            if (key == "time_used") return double_field(&Alignment::set_time_used);
+            if (key == "to_correct") return get_position(in, *aln.mutable_to_correct());
+            break;
+        case 'u':
+            if (key == "uniqueness") return double_field(&Alignment::set_uniqueness);
+            break;
+        }
+        // Including locus and annotation, which need reflection
+        return false;
+    });
+}
+
+bool decode(const char* buf, size_t size, google::protobuf::Message& msg) {
+    const google::protobuf::Descriptor* type = msg.GetDescriptor();
+    Reader in(buf, size);
+    bool ok;
+    if (type == Alignment::descriptor()) {
+        ok = get_alignment(in, static_cast<Alignment&>(msg));
+    } else if (type == Graph::descriptor()) {
+        ok = get_graph(in, static_cast<Graph&>(msg));
+    } else if (type == Path::descriptor()) {
+        ok = get_path(in, static_cast<Path&>(msg));
+    } else if (type == Mapping::descriptor()) {
+        ok = get_mapping(in, static_cast<Mapping&>(msg));
+    } else if (type == Node::descriptor()) {
+        ok = get_node(in, static_cast<Node&>(msg));
+    } else if (type == Edge::descriptor()) {
+        ok = get_edge(in, static_cast<Edge&>(msg));
+    } else if (type == Edit::descriptor()) {
+        ok = get_edit(in, static_cast<Edit&>(msg));
+    } else if (type == Position::descriptor()) {
+        ok = get_position(in, static_cast<Position&>(msg));
+    } else {
+        return false;
+    }
+    return ok && in.at_end();
+}
+
+}
+
+}
@@ -0,0 +1,41 @@
+#ifndef VG_FAST_JSON_HPP_INCLUDED
+#define VG_FAST_JSON_HPP_INCLUDED
+
+/** \file
+ * Hand-written JSON encoding and decoding for the message types we convert
+ * the most (Alignment, Graph, and the Node, Edge, Path, Mapping, Edit, and
+ * Position messages inside them), so pb2json() and json2pb() don't have to go
+ * through Protobuf reflection for them.
+ *
+ * The encoder writes exactly what Protobuf's JSON printer writes with proto
+ * field names preserved. Anything it isn't sure to reproduce exactly
+ * (non-ASCII strings, Loci, annotations) makes it give up so the caller can
+ * use reflection instead. The decoder likewise only takes the JSON the
+ * encoder writes, plus insignificant whitespace, and gives up on anything
+ * else, like camel-cased names or nulls.
+ */
+
+#include <string>
+
+#include <google/protobuf/message.h>
+
+namespace vg {
+
+namespace fast_json {
+
+/// Append the JSON for the message to out, if it is one of the specialized
+/// types and only uses what we can encode. Returns false, leaving out
+/// unchanged, otherwise.
+bool encode(const google::protobuf::Message& msg, std::string& out);
+
+/// Parse the JSON in the NUL-terminated buffer into the cleared message, if
+/// it is one of the specialized types and the JSON only uses what we can
+/// decode. Returns false, leaving the message in an unspecified state,
+/// otherwise.
+bool decode(const char* buf, size_t size, google::protobuf::Message& msg);
+
+}
+
+}
+
+#endif
@@ -1,5 +1,6 @@
 #include "feature_set.hpp"
 
+#include <set>
 #include <sstream>
 
 namespace vg {
@@ -7,6 +8,9 @@ namespace vg {
 using namespace std;
 
 void FeatureSet::load_bed(istream& in) {
+    // Remember which paths got new features, so we can index them once at the end
+    set<string> loaded_paths;
+
     // We want to read the BED line by line
     string line;
     while (getline(in, line)) {
@@ -35,8 +39,13 @@ void FeatureSet::load_bed(istream& in) {
         // TODO: extra data
         
         features[feature.path_name].push_back(feature);
+        loaded_paths.insert(feature.path_name);
         
     }
+    
+    for (auto& path : loaded_paths) {
+        index_path(path);
+    }
 }
 
 void FeatureSet::save_bed(ostream& out) const {
@@ -147,11 +156,44 @@ void FeatureSet::on_path_edit(const string& path, size_t start, size_t old_lengt
 #endif
         }
     }
+    
+    // Features may have moved, shrunk, or gone away, so the index is stale
+    index_path(path);
 }
 
 const vector<FeatureSet::Feature>& FeatureSet::get_features(const string& path) const {
     return features.at(path);
 }
 
+vector<const FeatureSet::Feature*> FeatureSet::find_overlapping(const string& path, size_t first, size_t last) const {
+    vector<const Feature*> overlapping;
+    
+    auto found = feature_indexes.find(path);
+    if (found == feature_indexes.end()) {
+        // Nothing is on this path
+        return overlapping;
+    }
+    
+    auto& path_features = features.at(path);
+    found->second.for_each_overlapping(first, last + 1, [&](const IntervalIndex<size_t>::Interval& interval) {
+        overlapping.push_back(&path_features[interval.value]);
+    });
+    
+    return overlapping;
+}
+
+void FeatureSet::index_path(const string& path) {
+    auto& path_features = features[path];
+    
+    // Features store inclusive ends, but the index wants past-ends
+    vector<IntervalIndex<size_t>::Interval> intervals;
+    intervals.reserve(path_features.size());
+    for (size_t i = 0; i < path_features.size(); i++) {
+        intervals.push_back({path_features[i].first, path_features[i].last + 1, i});
+    }
+    
+    feature_indexes[path] = IntervalIndex<size_t>(std::move(intervals));
+}
+
 }
 
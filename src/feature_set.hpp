@@ -11,6 +11,8 @@
 #include <vector>
 #include <map>
 #include <iostream>
+
+#include "interval_index.hpp"
  
 namespace vg {
 
@@ -79,10 +81,25 @@ public:
      * Get the features on a path. Generally used for testing.
      */
     const vector<Feature>& get_features(const string& path) const;
+    
+    /**
+     * Get the features on a path that overlap the given inclusive range of
+     * path positions, in order of their first base. Uses an interval index
+     * over the path's features, so it doesn't scan all of them, and is safe
+     * to call from several threads as long as nothing edits the features.
+     */
+    vector<const Feature*> find_overlapping(const string& path, size_t first, size_t last) const;
 
 private:
     /// Stores all the loaded features by path name
     map<string, vector<Feature>> features;
+    
+    /// Indexes the features on each path by their ranges, with the index of
+    /// each feature in its path's vector as the value.
+    map<string, IntervalIndex<size_t>> feature_indexes;
+    
+    /// Rebuild the interval index for the features on a path.
+    void index_path(const string& path);
 
 };
 
@@ -103,9 +103,9 @@ class Filter{
 
         vg::VG* my_vg = NULL;
         xg::XG* my_xg_index = NULL;
-        gcsa::GCSA* gcsa_ind;
-        gcsa::LCPArray * lcp_ind;
-        Mapper* my_mapper;
+        gcsa::GCSA* gcsa_ind = NULL;
+        gcsa::LCPArray * lcp_ind = NULL;
+        Mapper* my_mapper = NULL;
         
         map<int64_t, int64_t> node_to_position;
         void fill_node_to_position(string pathname);
@@ -0,0 +1,499 @@
+#ifndef VG_FLAT_HASH_MAP_HPP_INCLUDED
+#define VG_FLAT_HASH_MAP_HPP_INCLUDED
+
+/** \file
+ * An open addressing hash map in flat arrays, for the hot lookups keyed on
+ * node IDs, handles, and pairs of them.
+ */
+
+#include <cstdint>
+#include <iterator>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace vg {
+
+using namespace std;
+
+/**
+ * A hash map from K to V that keeps its entries in one array of slots and
+ * resolves collisions by linear probing, so a lookup is a hash and a short
+ * run of adjacent slots rather than a chain of heap nodes. Erased entries
+ * leave tombstones, which insertions reuse and rehashing drops, so erasing
+ * never moves other entries and erase(iterator) is safe in a loop.
+ *
+ * The interface follows std::unordered_map, plus resize() and
+ * clear_no_resize() from sparsehash, so it can stand in for hash_map. Like
+ * hash_map, and unlike std::unordered_map, inserting can move entries, so
+ * references and iterators into the map don't survive an insertion. Keys and
+ * values must be default constructible and move assignable; the entries are
+ * pair<K, V> rather than pair<const K, V>, and their keys must not be changed
+ * in place.
+ *
+ * The hash should mix its bits well, as wang_hash does, because slots are
+ * picked from its low bits.
+ */
+template<typename K, typename V, typename Hash>
+class flat_hash_map {
+public:
+    using key_type = K;
+    using mapped_type = V;
+    using value_type = pair<K, V>;
+    using size_type = size_t;
+    using hasher = Hash;
+
+    /// Iterates over the occupied slots, in slot order.
+    template<bool Const>
+    class basic_iterator {
+    public:
+        using iterator_category = forward_iterator_tag;
+        using value_type = typename flat_hash_map::value_type;
+        using difference_type = ptrdiff_t;
+        using reference = typename conditional<Const, const value_type&, value_type&>::type;
+        using pointer = typename conditional<Const, const value_type*, value_type*>::type;
+
+        basic_iterator() = default;
+
+        /// Any iterator can be converted to a const_iterator.
+        template<bool OtherConst, typename = typename enable_if<Const || !OtherConst>::type>
+        basic_iterator(const basic_iterator<OtherConst>& other) : owner(other.owner), slot(other.slot) {
+            // Nothing to do
+        }
+
+        reference operator*() const {
+            return owner->slots[slot];
+        }
+
+        pointer operator->() const {
+            return &owner->slots[slot];
+        }
+
+        basic_iterator& operator++() {
+            slot = owner->next_full(slot + 1);
+            return *this;
+        }
+
+        basic_iterator operator++(int) {
+            basic_iterator old = *this;
+            ++*this;
+            return old;
+        }
+
+        template<bool OtherConst>
+        bool operator==(const basic_iterator<OtherConst>& other) const {
+            return slot == other.slot;
+        }
+
+        template<bool OtherConst>
+        bool operator!=(const basic_iterator<OtherConst>& other) const {
+            return slot != other.slot;
+        }
+
+    private:
+        using owner_type = typename conditional<Const, const flat_hash_map, flat_hash_map>::type;
+
+        basic_iterator(owner_type* owner, size_t slot) : owner(owner), slot(slot) {
+            // Nothing to do
+        }
+
+        owner_type* owner = nullptr;
+        size_t slot = 0;
+
+        friend class flat_hash_map;
+        template<bool> friend class basic_iterator;
+    };
+
+    using iterator = basic_iterator<false>;
+    using const_iterator = basic_iterator<true>;
+
+    /// Make an empty map, which allocates nothing until the first insertion.
+    flat_hash_map() = default;
+
+    /// Make an empty map with room for the given number of entries.
+    explicit flat_hash_map(size_t expected_size);
+
+    iterator begin();
+    iterator end();
+    const_iterator begin() const;
+    const_iterator end() const;
+    const_iterator cbegin() const;
+    const_iterator cend() const;
+
+    /// Get the number of entries.
+    size_t size() const;
+
+    /// Return true if there are no entries.
+    bool empty() const;
+
+    /// Get the number of slots.
+    size_t bucket_count() const;
+
+    /// Make room for at least the given number of entries without rehashing.
+    void reserve(size_t expected_size);
+
+    /// Make room for at least the given number of entries, as in sparsehash.
+    void resize(size_t expected_size);
+
+    /// Remove all the entries and free the slots.
+    void clear();
+
+    /// Remove all the entries but keep the slots for reuse.
+    void clear_no_resize();
+
+    /// Find the entry for a key, or end() if there is none.
+    iterator find(const K& key);
+    const_iterator find(const K& key) const;
+
+    /// Get the number of entries for a key, 0 or 1.
+    size_t count(const K& key) const;
+
+    /// Get the value for a key. Throws out_of_range if it is absent.
+    V& at(const K& key);
+    const V& at(const K& key) const;
+
+    /// Get the value for a key, inserting a default value if it is absent.
+    V& operator[](const K& key);
+
+    /// Insert an entry unless its key is present. Returns the entry for the
+    /// key and whether it was inserted.
+    pair<iterator, bool> insert(const value_type& entry);
+    pair<iterator, bool> insert(value_type&& entry);
+
+    /// Construct an entry from the arguments and insert it unless its key is
+    /// present.
+    template<typename... Args>
+    pair<iterator, bool> emplace(Args&&... args);
+
+    /// Remove the entry for a key, if any. Returns the number removed.
+    size_t erase(const K& key);
+
+    /// Remove the entry at an iterator. Returns an iterator to the next
+    /// entry.
+    iterator erase(const_iterator position);
+
+    /// Exchange contents with another map.
+    void swap(flat_hash_map& other);
+
+private:
+
+    /// What is in a slot.
+    enum slot_state : uint8_t {EMPTY = 0, FULL, DELETED};
+
+    /// The fewest slots to allocate.
+    static const size_t MIN_CAPACITY = 16;
+
+    /// Get the capacity to use for the given number of entries, keeping full
+    /// and deleted slots to at most 3/4 of them.
+    static size_t capacity_for(size_t wanted_entries);
+
+    /// Get the first full slot at or after the given one, or the capacity.
+    size_t next_full(size_t slot) const;
+
+    /// Get the slot holding a key, or the capacity if it is absent.
+    size_t locate(const K& key) const;
+
+    /// Get the slot holding a key and true, or the slot to insert it into
+    /// and false, rehashing first if an insertion would overfill the map.
+    pair<size_t, bool> locate_for_insert(const K& key);
+
+    /// Move the entries into the given number of slots, dropping tombstones.
+    void rehash(size_t new_capacity);
+
+    /// Move an entry into a slot found by locate_for_insert().
+    iterator fill(size_t slot, value_type&& entry);
+
+    vector<value_type> slots;
+    vector<uint8_t> states;
+    /// Number of full slots.
+    size_t entries = 0;
+    /// Number of full and deleted slots, which end probes if too many.
+    size_t used = 0;
+    Hash key_hash;
+};
+
+////////////////////////////////////////////////////////////////////////////
+// Template implementations
+////////////////////////////////////////////////////////////////////////////
+
+template<typename K, typename V, typename Hash>
+flat_hash_map<K, V, Hash>::flat_hash_map(size_t expected_size) {
+    reserve(expected_size);
+}
+
+template<typename K, typename V, typename Hash>
+auto flat_hash_map<K, V, Hash>::begin() -> iterator {
+    return iterator(this, next_full(0));
+}
+
+template<typename K, typename V, typename Hash>
+auto flat_hash_map<K, V, Hash>::end() -> iterator {
+    return iterator(this, states.size());
+}
+
+template<typename K, typename V, typename Hash>
+auto flat_hash_map<K, V, Hash>::begin() const -> const_iterator {
+    return const_iterator(this, next_full(0));
+}
+
+template<typename K, typename V, typename Hash>
+auto flat_hash_map<K, V, Hash>::end() const -> const_iterator {
+    return const_iterator(this, states.size());
+}
+
+template<typename K, typename V, typename Hash>
+auto flat_hash_map<K, V, Hash>::cbegin() const -> const_iterator {
+    return begin();
+}
+
+template<typename K, typename V, typename Hash>
+auto flat_hash_map<K, V, Hash>::cend() const -> const_iterator {
+    return end();
+}
+
+template<typename K, typename V, typename Hash>
+size_t flat_hash_map<K, V, Hash>::size() const {
+    return entries;
+}
+
+template<typename K, typename V, typename Hash>
+bool flat_hash_map<K, V, Hash>::empty() const {
+    return entries == 0;
+}
+
+template<typename K, typename V, typename Hash>
+size_t flat_hash_map<K, V, Hash>::bucket_count() const {
+    return states.size();
+}
+
+template<typename K, typename V, typename Hash>
+void flat_hash_map<K, V, Hash>::reserve(size_t expected_size) {
+    size_t wanted = capacity_for(expected_size);
+    if (wanted > states.size()) {
+        rehash(wanted);
+    }
+}
+
+template<typename K, typename V, typename Hash>
+void flat_hash_map<K, V, Hash>::resize(size_t expected_size) {
+    reserve(expected_size);
+}
+
+template<typename K, typename V, typename Hash>
+void flat_hash_map<K, V, Hash>::clear() {
+    vector<value_type>().swap(slots);
+    vector<uint8_t>().swap(states);
+    entries = 0;
+    used = 0;
+}
+
+template<typename K, typename V, typename Hash>
+void flat_hash_map<K, V, Hash>::clear_no_resize() {
+    for (size_t i = 0; i < states.size(); i++) {
+        if (states[i] == FULL) {
+            // Free whatever the entry owns now rather than when it is reused
+            slots[i] = value_type();
+        }
+        states[i] = EMPTY;
+    }
+    entries = 0;
+    used = 0;
+}
+
+template<typename K, typename V, typename Hash>
+auto flat_hash_map<K, V, Hash>::find(const K& key) -> iterator {
+    return iterator(this, locate(key));
+}
+
+template<typename K, typename V, typename Hash>
+auto flat_hash_map<K, V, Hash>::find(const K& key) const -> const_iterator {
+    return const_iterator(this, locate(key));
+}
+
+template<typename K, typename V, typename Hash>
+size_t flat_hash_map<K, V, Hash>::count(const K& key) const {
+    return locate(key) != states.size();
+}
+
+template<typename K, typename V, typename Hash>
+V& flat_hash_map<K, V, Hash>::at(const K& key) {
+    size_t slot = locate(key);
+    if (slot == states.size()) {
+        throw out_of_range("flat_hash_map::at: key not found");
+    }
+    return slots[slot].second;
+}
+
+template<typename K, typename V, typename Hash>
+const V& flat_hash_map<K, V, Hash>::at(const K& key) const {
+    size_t slot = locate(key);
+    if (slot == states.size()) {
+        throw out_of_range("flat_hash_map::at: key not found");
+    }
+    return slots[slot].second;
+}
+
+template<typename K, typename V, typename Hash>
+V& flat_hash_map<K, V, Hash>::operator[](const K& key) {
+    auto found = locate_for_insert(key);
+    if (found.second) {
+        return slots[found.first].second;
+    }
+    return fill(found.first, value_type(key, V()))->second;
+}
+
+template<typename K, typename V, typename Hash>
+auto flat_hash_map<K, V, Hash>::insert(const value_type& entry) -> pair<iterator, bool> {
+    auto found = locate_for_insert(entry.first);
+    if (found.second) {
+        return make_pair(iterator(this, found.first), false);
+    }
+    return make_pair(fill(found.first, value_type(entry)), true);
+}
+
+template<typename K, typename V, typename Hash>
+auto flat_hash_map<K, V, Hash>::insert(value_type&& entry) -> pair<iterator, bool> {
+    auto found = locate_for_insert(entry.first);
+    if (found.second) {
+        return make_pair(iterator(this, found.first), false);
+    }
+    return make_pair(fill(found.first, std::move(entry)), true);
+}
+
+template<typename K, typename V, typename Hash>
+template<typename... Args>
+auto flat_hash_map<K, V, Hash>::emplace(Args&&... args) -> pair<iterator, bool> {
+    return insert(value_type(std::forward<Args>(args)...));
+}
+
+template<typename K, typename V, typename Hash>
+size_t flat_hash_map<K, V, Hash>::erase(const K& key) {
+    size_t slot = locate(key);
+    if (slot == states.size()) {
+        return 0;
+    }
+    erase(const_iterator(this, slot));
+    return 1;
+}
+
+template<typename K, typename V, typename Hash>
+auto flat_hash_map<K, V, Hash>::erase(const_iterator position) -> iterator {
+    slots[position.slot] = value_type();
+    states[position.slot] = DELETED;
+    entries--;
+    return iterator(this, next_full(position.slot + 1));
+}
+
+template<typename K, typename V, typename Hash>
+void flat_hash_map<K, V, Hash>::swap(flat_hash_map& other) {
+    std::swap(slots, other.slots);
+    std::swap(states, other.states);
+    std::swap(entries, other.entries);
+    std::swap(used, other.used);
+    std::swap(key_hash, other.key_hash);
+}
+
+template<typename K, typename V, typename Hash>
+size_t flat_hash_map<K, V, Hash>::capacity_for(size_t wanted_entries) {
+    size_t capacity = MIN_CAPACITY;
+    while (capacity - capacity / 4 < wanted_entries) {
+        capacity *= 2;
+    }
+    return capacity;
+}
+
+template<typename K, typename V, typename Hash>
+size_t flat_hash_map<K, V, Hash>::next_full(size_t slot) const {
+    while (slot < states.size() && states[slot] != FULL) {
+        slot++;
+    }
+    return slot;
+}
+
+template<typename K, typename V, typename Hash>
+size_t flat_hash_map<K, V, Hash>::locate(const K& key) const {
+    if (entries == 0) {
+        return states.size();
+    }
+    // There is always an empty slot to stop at
+    size_t mask = states.size() - 1;
+    for (size_t slot = key_hash(key) & mask; states[slot] != EMPTY; slot = (slot + 1) & mask) {
+        if (states[slot] == FULL && slots[slot].first == key) {
+            return slot;
+        }
+    }
+    return states.size();
+}
+
+template<typename K, typename V, typename Hash>
+pair<size_t, bool> flat_hash_map<K, V, Hash>::locate_for_insert(const K& key) {
+    if (states.empty()) {
+        rehash(MIN_CAPACITY);
+    }
+    while (true) {
+        size_t mask = states.size() - 1;
+        size_t tombstone = states.size();
+        size_t slot = key_hash(key) & mask;
+        for (; states[slot] != EMPTY; slot = (slot + 1) & mask) {
+            if (states[slot] == FULL) {
+                if (slots[slot].first == key) {
+                    return make_pair(slot, true);
+                }
+            } else if (tombstone == states.size()) {
+                tombstone = slot;
+            }
+        }
+        if (tombstone != states.size()) {
+            // Reusing a tombstone never makes the probes longer
+            return make_pair(tombstone, false);
+        }
+        if (used + 1 <= states.size() - states.size() / 4) {
+            return make_pair(slot, false);
+        }
+        // Too full to take another entry. Grow, unless dropping the
+        // tombstones makes enough room.
+        rehash(capacity_for(entries + 1));
+    }
+}
+
+template<typename K, typename V, typename Hash>
+void flat_hash_map<K, V, Hash>::rehash(size_t new_capacity) {
+    vector<value_type> old_slots;
+    vector<uint8_t> old_states;
+    old_slots.swap(slots);
+    old_states.swap(states);
+    slots.resize(new_capacity);
+    states.assign(new_capacity, EMPTY);
+
+    size_t mask = new_capacity - 1;
+    for (size_t i = 0; i < old_states.size(); i++) {
+        if (old_states[i] == FULL) {
+            size_t slot = key_hash(old_slots[i].first) & mask;
+            while (states[slot] != EMPTY) {
+                slot = (slot + 1) & mask;
+            }
+            slots[slot] = std::move(old_slots[i]);
+            states[slot] = FULL;
+        }
+    }
+    used = entries;
+}
+
+template<typename K, typename V, typename Hash>
+auto flat_hash_map<K, V, Hash>::fill(size_t slot, value_type&& entry) -> iterator {
+    if (states[slot] == EMPTY) {
+        used++;
+    }
+    slots[slot] = std::move(entry);
+    states[slot] = FULL;
+    entries++;
+    return iterator(this, slot);
+}
+
+template<typename K, typename V, typename Hash>
+const size_t flat_hash_map<K, V, Hash>::MIN_CAPACITY;
+
+}
+
+#endif
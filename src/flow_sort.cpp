@@ -219,14 +219,16 @@ void FlowSort::flow_sort_nodes(list<NodeTraversal>& sorted_nodes,
 int FlowSort::get_node_degree(FlowSort::WeightedGraph& wg, id_t node_id)
 {
 
-    std::vector<Edge*> in_edges = wg.edges_in_nodes[node_id];
     int degree = 0;
-    for(auto const &edge : in_edges)
-        degree -= wg.edge_weight[edge];
+    auto in_edges = wg.edges_in_nodes.find(node_id);
+    if (in_edges != wg.edges_in_nodes.end())
+        for(auto const &edge : in_edges->second)
+            degree -= wg.edge_weight[edge];
 
-    std::vector<Edge*> out_edges = wg.edges_out_nodes[node_id];
-    for(auto const &edge : out_edges)
-        degree += wg.edge_weight[edge];
+    auto out_edges = wg.edges_out_nodes.find(node_id);
+    if (out_edges != wg.edges_out_nodes.end())
+        for(auto const &edge : out_edges->second)
+            degree += wg.edge_weight[edge];
 
     return degree;
 }
@@ -610,18 +612,14 @@ id_t FlowSort::get_next_node_recalc_degrees(WeightedGraph& wg, std::vector<std::
 }
 
 /*Find node with max degree*/
-id_t FlowSort::find_max_node(std::vector<std::set<id_t>> nodes_degree)
+id_t FlowSort::find_max_node(const std::vector<std::set<id_t>>& nodes_degree)
 {
-    int start_size = nodes_degree.size()-1;
-    int last_ind = start_size;
+    int last_ind = nodes_degree.size()-1;
     while(nodes_degree[last_ind].size() == 0)
     {
         last_ind--;
     }
-    if(last_ind != start_size)
-        nodes_degree.resize(last_ind + 1);
-    set<id_t>::iterator i_last_el = nodes_degree[last_ind].end();
-    return *(--i_last_el);
+    return *nodes_degree[last_ind].rbegin();
 }
 
 /*  Method finds min cut in a given set of nodes, then removes min cut edges,
@@ -673,7 +671,7 @@ void FlowSort::find_in_out_web(list<NodeTraversal>& sorted_nodes,
 
     EdgeMapping& edges_out_nodes = w_graph.edges_out_nodes;
     EdgeMapping& edges_in_nodes = w_graph.edges_in_nodes;
-    map<Edge*, int>& edge_weight = w_graph.edge_weight;
+    unordered_map<Edge*, int>& edge_weight = w_graph.edge_weight;
 
     //add source and sink nodes
     id_t source = vg.graph.node_size() + 1;
@@ -975,69 +973,16 @@ void FlowSort::mark_dfs(EdgeMapping& edges_to_nodes, id_t s,
 
 }
 
-/* Returns true if there is a path from source 's' to sink 't' in
-   residual graph. Also fills parent[] to store the path */
-bool FlowSort::bfs(set<id_t>& nodes, map<id_t, map<id_t, int>>& edge_weight, id_t s,
-            id_t t, map<id_t, id_t>& parent) 
+size_t FlowSort::FlowNetwork::number_of(id_t id)
 {
-    // Create a visited array and mark all vertices as not visited
-    set<id_t> visited;
-
-    // Create a queue, enqueue source vertex and mark source vertex
-    // as visited
-    std::queue<id_t> q({ s });
-    visited.insert(s);
-    parent[s] = -1;
-
-    // Standard BFS Loop
-    while (!q.empty())
+    auto found = number.find(id);
+    if (found != number.end())
     {
-        id_t u = q.front();
-        q.pop();
-        for (auto const &weight : edge_weight[u])
-        {
-            if (weight.second <= 0)
-            {
-                continue;
-            }
-            id_t v = weight.first;
-            if (!visited.count(v)) 
-            {
-                q.push(v);
-                parent[v] = u;
-                visited.insert(v);
-                  if (v == t) 
-                {
-                    return true;
-                }
-            }
-        }
-    }
-    // If we reached sink in BFS starting from source, then return
-    // true, else false
-    return (visited.count(t) != 0);
-
-}
-
-
-void FlowSort::dfs(set<id_t>& nodes, id_t s, set<id_t>& visited, 
-        map<id_t, map<id_t, int>>& edge_weight) 
-{
-    visited.insert(s);
-    std::stack<id_t> q({ s });
-    while (!q.empty()) {
-        s = q.top();
-        q.pop();
-        for (auto const &weight : edge_weight[s]) 
-        {
-            id_t to = weight.first;
-            if (weight.second && !visited.count(to)) 
-            {
-                visited.insert(to);
-                q.push(to);
-            }
-        }
+        return found->second;
     }
+    number.emplace(id, vertex.size());
+    vertex.push_back(id);
+    return vertex.size() - 1;
 }
 
 // Returns the minimum s-t cut
@@ -1047,49 +992,120 @@ vector<pair<id_t,id_t>> FlowSort::min_cut(map<id_t, map<id_t, int>>& graph_weigh
                 EdgeMapping& edges_out_nodes,
                 set<Edge*>& in_joins) 
 {
-    id_t u, v;
     nodes.insert(s);
     nodes.insert(t);
-    map<id_t, id_t> parent_map;
-
-    // Augment the flow while there is path from source to sink
-    while (bfs(nodes, graph_weight, s, t, parent_map)) 
+    
+    // Lay the capacities out as a residual graph over dense vertex numbers.
+    // Every capacity gets a forward arc and a reverse arc that starts empty.
+    FlowNetwork& net = flow_network;
+    net.number.clear();
+    net.vertex.clear();
+    size_t source = net.number_of(s);
+    size_t sink = net.number_of(t);
+    size_t arc_count = 0;
+    for (auto const &from : graph_weight) 
     {
-        // Find minimum residual capacity of the edges along the
-        // path filled by BFS. Or we can say find the maximum flow
-        // through the path found.
-        int path_flow = numeric_limits<int>::max();
-        for (v = t; v != s; v = parent_map[v]) 
+        net.number_of(from.first);
+        for (auto const &to : from.second) 
         {
-            u = parent_map[v];
-            if (!graph_weight.count(u) || !graph_weight[u].count(v)) 
-            {
-                graph_weight[u][v] = 0;
-            }
-            path_flow = min(path_flow, graph_weight[u][v]);
+            net.number_of(to.first);
+            arc_count += 2;
         }
-        // update residual capacities of the edges and reverse edges
-        // along the path
-        for (v = t; v != s; v = parent_map[v]) 
+    }
+    size_t vertex_count = net.vertex.size();
+    
+    net.arc_start.assign(vertex_count + 1, 0);
+    for (auto const &from : graph_weight) 
+    {
+        size_t u = net.number.at(from.first);
+        for (auto const &to : from.second) 
         {
-            u = parent_map[v];
-            if (!graph_weight.count(u) || !graph_weight[u].count(v)) 
-            {
-                graph_weight[u][v] = 0;
-            }
-             if (!graph_weight.count(v) || !graph_weight[v].count(u)) 
+            net.arc_start[u + 1]++;
+            net.arc_start[net.number.at(to.first) + 1]++;
+        }
+    }
+    for (size_t i = 0; i < vertex_count; i++) 
+    {
+        net.arc_start[i + 1] += net.arc_start[i];
+    }
+    net.arc_to.resize(arc_count);
+    net.arc_reverse.resize(arc_count);
+    net.arc_capacity.resize(arc_count);
+    // Use the parent buffer as the fill cursors for now
+    net.parent_arc.assign(net.arc_start.begin(), net.arc_start.end() - 1);
+    for (auto const &from : graph_weight) 
+    {
+        size_t u = net.number.at(from.first);
+        for (auto const &to : from.second) 
+        {
+            size_t v = net.number.at(to.first);
+            size_t forward = net.parent_arc[u]++;
+            size_t backward = net.parent_arc[v]++;
+            net.arc_to[forward] = v;
+            net.arc_capacity[forward] = to.second;
+            net.arc_reverse[forward] = backward;
+            net.arc_to[backward] = u;
+            net.arc_capacity[backward] = 0;
+            net.arc_reverse[backward] = forward;
+        }
+    }
+    
+    // Augment the flow along shortest paths while there is a path from
+    // source to sink. When this stops, the parent arcs mark exactly the
+    // vertices still reachable from the source, which is the source side of
+    // the minimum cut no matter which augmenting paths we took.
+    const size_t unreached = numeric_limits<size_t>::max();
+    while (true) 
+    {
+        net.parent_arc.assign(vertex_count, unreached);
+        net.parent_arc[source] = arc_count;
+        net.queue.clear();
+        net.queue.push_back(source);
+        bool found_sink = false;
+        for (size_t head = 0; head < net.queue.size() && !found_sink; head++) 
+        {
+            size_t u = net.queue[head];
+            for (size_t arc = net.arc_start[u]; arc < net.arc_start[u + 1]; arc++) 
             {
-                graph_weight[v][u] = 0;
+                size_t v = net.arc_to[arc];
+                if (net.arc_capacity[arc] <= 0 || net.parent_arc[v] != unreached) 
+                {
+                    continue;
+                }
+                net.parent_arc[v] = arc;
+                if (v == sink) 
+                {
+                    found_sink = true;
+                    break;
+                }
+                net.queue.push_back(v);
             }
-            graph_weight[u][v] -= path_flow;
-            graph_weight[v][u] += path_flow;
+        }
+        if (!found_sink) 
+        {
+            break;
+        }
+        
+        // Find minimum residual capacity of the arcs along the path, which is
+        // the flow we can push through it, and push it.
+        int path_flow = numeric_limits<int>::max();
+        for (size_t v = sink; v != source; v = net.arc_to[net.arc_reverse[net.parent_arc[v]]]) 
+        {
+            path_flow = min(path_flow, net.arc_capacity[net.parent_arc[v]]);
+        }
+        for (size_t v = sink; v != source; v = net.arc_to[net.arc_reverse[net.parent_arc[v]]]) 
+        {
+            net.arc_capacity[net.parent_arc[v]] -= path_flow;
+            net.arc_capacity[net.arc_reverse[net.parent_arc[v]]] += path_flow;
         }
     }
 
-    // Flow is maximum now, find vertices reachable from s
-
-    set<id_t> visited_set;
-    dfs(nodes, s, visited_set, graph_weight);
+    // Flow is maximum now, so see which vertices are reachable from s
+    auto reachable = [&](id_t id) 
+    {
+        auto found = net.number.find(id);
+        return found != net.number.end() && net.parent_arc[found->second] != unreached;
+    };
     vector<pair<id_t,id_t>> min_cut;
 
     nodes.erase(s);
@@ -1109,7 +1125,7 @@ vector<pair<id_t,id_t>> FlowSort::min_cut(map<id_t, map<id_t, int>>& graph_weigh
             {
                  to = t;
             }
-            if (visited_set.count(node_id) && !visited_set.count(to))
+            if (reachable(node_id) && !reachable(to))
             {
                 min_cut.push_back(pair<id_t, id_t>(node_id, to));
             }
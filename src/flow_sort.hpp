@@ -3,6 +3,9 @@
 
 #include "vg.pb.h"
 
+#include <unordered_map>
+#include <vector>
+
 namespace vg {
     
 typedef std::map<id_t, std::vector<Edge*>> EdgeMapping;
@@ -40,7 +43,7 @@ public:
     struct WeightedGraph {
         EdgeMapping edges_out_nodes;
         EdgeMapping edges_in_nodes;
-        map<Edge*, int> edge_weight;
+        unordered_map<Edge*, int> edge_weight;
         
         void construct(FlowSort& fs, const string& ref_name, bool isGrooming = true);
     };
@@ -79,10 +82,8 @@ public:
      * */
     id_t get_next_node_recalc_degrees(WeightedGraph& wg, std::vector<std::set<id_t>>& degrees,std::set<id_t> &sources,
                                          id_t node);
-    id_t find_max_node(std::vector<std::set<id_t>> nodes_degree);
+    id_t find_max_node(const std::vector<std::set<id_t>>& nodes_degree);
 
-    bool bfs(set<id_t>& nodes, map<id_t, map<id_t, int>>& edge_weight, id_t s, id_t t, map<id_t, id_t>& parent);
-    void dfs(set<id_t>& nodes, id_t s, set<id_t>& visited, map<id_t, map<id_t, int>>& edge_weight);
     void find_in_out_web(   list<NodeTraversal>& sorted_nodes, 
                             Growth& in_out_growth,
                             WeightedGraph& weighted_graph,
@@ -105,6 +106,24 @@ public:
     
 private:
     VG& vg;
+    
+    /// The residual graph for min_cut(), in compressed sparse row form over
+    /// dense vertex numbers. Kept between calls so the recursion doesn't have
+    /// to reallocate it for every growth.
+    struct FlowNetwork {
+        unordered_map<id_t, size_t> number;
+        vector<id_t> vertex;
+        vector<size_t> arc_start;
+        vector<size_t> arc_to;
+        vector<size_t> arc_reverse;
+        vector<int> arc_capacity;
+        vector<size_t> parent_arc;
+        vector<size_t> queue;
+        
+        /// Get the dense number for a vertex, numbering it if it is new.
+        size_t number_of(id_t id);
+    };
+    FlowNetwork flow_network;
 
 };
 }
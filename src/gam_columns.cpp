@@ -0,0 +1,129 @@
+#include "gam_columns.hpp"
+#include "stream.hpp"
+
+#include <stdexcept>
+
+/**
+ * \file gam_columns.cpp: implementation of AlignmentColumns sidecar reading and writing
+ */
+
+namespace vg {
+
+using namespace std;
+
+/// Append the refpos entries for one row.
+static void append_refpos(AlignmentColumns& columns, const vector<Position>& refpos) {
+    columns.add_refpos_count(refpos.size());
+    for (auto& position : refpos) {
+        columns.add_refpos_name(position.name());
+        columns.add_refpos_offset(position.offset());
+        columns.add_refpos_is_reverse(position.is_reverse());
+    }
+}
+
+void append_row(AlignmentColumns& columns, const Alignment& aln) {
+    columns.add_name(aln.name());
+    columns.add_score(aln.score());
+    columns.add_mapping_quality(aln.mapping_quality());
+    columns.add_identity(aln.identity());
+    columns.add_is_secondary(aln.is_secondary());
+    columns.add_correctly_mapped(aln.correctly_mapped());
+    columns.add_sequence_length(aln.sequence().size());
+    append_refpos(columns, vector<Position>(aln.refpos().begin(), aln.refpos().end()));
+}
+
+void append_row(AlignmentColumns& columns, const AlignmentView& aln) {
+    columns.add_name(aln.name());
+    columns.add_score(aln.score());
+    columns.add_mapping_quality(aln.mapping_quality());
+    columns.add_identity(aln.identity());
+    columns.add_is_secondary(aln.is_secondary());
+    columns.add_correctly_mapped(aln.correctly_mapped());
+    columns.add_sequence_length(aln.sequence_length());
+    append_refpos(columns, aln.refpos());
+}
+
+AlignmentColumns make_columns(const vector<Alignment>& group, int64_t virtual_offset) {
+    AlignmentColumns columns;
+    columns.set_virtual_offset(virtual_offset);
+    for (auto& aln : group) {
+        append_row(columns, aln);
+    }
+    return columns;
+}
+
+size_t row_count(const AlignmentColumns& columns) {
+    // Repeated field sizes are ints
+    int rows = columns.name_size();
+    if (columns.score_size() != rows || columns.mapping_quality_size() != rows ||
+        columns.identity_size() != rows || columns.is_secondary_size() != rows ||
+        columns.correctly_mapped_size() != rows || columns.sequence_length_size() != rows ||
+        columns.refpos_count_size() != rows) {
+        throw runtime_error("AlignmentColumns: columns have different lengths");
+    }
+    int refpos_total = 0;
+    for (auto& count : columns.refpos_count()) {
+        refpos_total += count;
+    }
+    if (columns.refpos_name_size() != refpos_total || columns.refpos_offset_size() != refpos_total ||
+        columns.refpos_is_reverse_size() != refpos_total) {
+        throw runtime_error("AlignmentColumns: refpos columns don't match refpos counts");
+    }
+    return rows;
+}
+
+void for_each_row(const AlignmentColumns& columns, const function<void(const AlignmentRow&)>& callback) {
+    size_t rows = row_count(columns);
+    AlignmentRow row;
+    size_t next_refpos = 0;
+    for (size_t i = 0; i < rows; i++) {
+        row.name = columns.name(i);
+        row.score = columns.score(i);
+        row.mapping_quality = columns.mapping_quality(i);
+        row.identity = columns.identity(i);
+        row.is_secondary = columns.is_secondary(i);
+        row.correctly_mapped = columns.correctly_mapped(i);
+        row.sequence_length = columns.sequence_length(i);
+        row.refpos.resize(columns.refpos_count(i));
+        for (auto& position : row.refpos) {
+            position.set_name(columns.refpos_name(next_refpos));
+            position.set_offset(columns.refpos_offset(next_refpos));
+            position.set_is_reverse(columns.refpos_is_reverse(next_refpos));
+            next_refpos++;
+        }
+        callback(row);
+    }
+}
+
+void for_each_row(istream& in, const function<void(const AlignmentRow&)>& callback) {
+    function<void(AlignmentColumns&)> lambda = [&](AlignmentColumns& columns) {
+        for_each_row(columns, callback);
+    };
+    stream::for_each(in, lambda);
+}
+
+GAMColumnWriter::GAMColumnWriter(ostream& out) : out(out) {
+    // nothing to do
+}
+
+GAMColumnWriter::~GAMColumnWriter() {
+    stream::finish(out);
+}
+
+void GAMColumnWriter::write_group(const vector<Alignment>& group, int64_t virtual_offset) {
+    if (group.empty()) {
+        return;
+    }
+    write_columns(make_columns(group, virtual_offset));
+}
+
+void GAMColumnWriter::write_columns(const AlignmentColumns& columns) {
+    // Each block goes out as its own group, so blocks from different threads
+    // don't get mixed.
+    vector<AlignmentColumns> buffer{columns};
+    if (!stream::write_buffered(out, buffer, 1)) {
+        throw runtime_error("GAMColumnWriter: I/O error writing AlignmentColumns");
+    }
+}
+
+}
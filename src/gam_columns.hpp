@@ -0,0 +1,91 @@
+#ifndef VG_GAM_COLUMNS_HPP_INCLUDED
+#define VG_GAM_COLUMNS_HPP_INCLUDED
+
+/** \file
+ * Sidecar files holding the most-scanned fields of the reads in a GAM as
+ * AlignmentColumns blocks, one per GAM group, so analyses that only want
+ * scores, mapping qualities, or reference positions don't have to read and
+ * decode whole Alignments.
+ */
+
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "vg.pb.h"
+#include "alignment_view.hpp"
+
+namespace vg {
+
+using namespace std;
+
+/**
+ * The fields of one Alignment that are kept in AlignmentColumns.
+ */
+struct AlignmentRow {
+    string name;
+    int32_t score = 0;
+    int32_t mapping_quality = 0;
+    double identity = 0;
+    bool is_secondary = false;
+    bool correctly_mapped = false;
+    size_t sequence_length = 0;
+    /// Only the path name, offset, and orientation are kept.
+    vector<Position> refpos;
+};
+
+/// Add the columns for an Alignment to the end of the block.
+void append_row(AlignmentColumns& columns, const Alignment& aln);
+
+/// Add the columns for a serialized Alignment to the end of the block,
+/// decoding only the fields that are kept.
+void append_row(AlignmentColumns& columns, const AlignmentView& aln);
+
+/// Make the block of columns for a group of Alignments that starts at the
+/// given virtual offset in its GAM.
+AlignmentColumns make_columns(const vector<Alignment>& group, int64_t virtual_offset = -1);
+
+/// Count the Alignments described by a block. Throws if the columns aren't
+/// all the same length.
+size_t row_count(const AlignmentColumns& columns);
+
+/// Call the callback with each row in the block, in order.
+void for_each_row(const AlignmentColumns& columns, const function<void(const AlignmentRow&)>& callback);
+
+/// Call the callback with each row in a stream of blocks, in order.
+void for_each_row(istream& in, const function<void(const AlignmentRow&)>& callback);
+
+/**
+ * Writes a stream of AlignmentColumns blocks, one for each group of
+ * Alignments it is given. Safe to use from multiple threads; blocks from
+ * different threads go out in whatever order they finish. Finishes the
+ * stream when destroyed.
+ */
+class GAMColumnWriter {
+public:
+
+    /// Make a writer writing to the given stream, which must outlive it.
+    GAMColumnWriter(ostream& out);
+
+    /// Finish the stream.
+    ~GAMColumnWriter();
+
+    GAMColumnWriter(const GAMColumnWriter& other) = delete;
+    GAMColumnWriter& operator=(const GAMColumnWriter& other) = delete;
+
+    /// Write the columns for a group of Alignments, which was written to the
+    /// GAM at the given virtual offset, if known. Throws on I/O errors.
+    void write_group(const vector<Alignment>& group, int64_t virtual_offset = -1);
+
+    /// Write an already-made block. Throws on I/O errors.
+    void write_columns(const AlignmentColumns& columns);
+
+private:
+    ostream& out;
+};
+
+}
+
+#endif
@@ -1,6 +1,9 @@
 #include "gam_index.hpp"
+#include "compact_alignment.hpp"
 
 #include <iostream>
+#include <algorithm>
+#include <mutex>
 
 namespace vg {
 
@@ -264,35 +267,85 @@ auto GAMIndex::find(id_t min_node, id_t max_node, const function<bool(int64_t, i
     }
 }
 
-auto GAMIndex::add_group(const vector<Alignment>& alns, int64_t virtual_start, int64_t virtual_past_end) -> void {
-    // Find the min and max ID visited by any of the alignments
+/// Call the given function with the ID of each node an Alignment visits, in
+/// order. Unmapped reads visit node 0. Stops early if the function returns
+/// false.
+template<typename Iteratee>
+static void for_each_visited_id(const Alignment& aln, const Iteratee& iteratee) {
+    if (aln.path().mapping_size() == 0) {
+        // The read is unmapped, so it belongs to node ID 0
+        iteratee((id_t)0);
+    } else {
+        for (auto& mapping : aln.path().mapping()) {
+            if (!iteratee((id_t)mapping.position().node_id())) {
+                return;
+            }
+        }
+    }
+}
+
+/// Call the given function with the ID of each node a CompactAlignment visits.
+template<typename Iteratee>
+static void for_each_visited_id(const CompactAlignment& aln, const Iteratee& iteratee) {
+    for_each_node_id(aln, iteratee);
+}
+
+/// Call the given function with the ID of each node a CompactMultipathAlignment visits.
+template<typename Iteratee>
+static void for_each_visited_id(const CompactMultipathAlignment& aln, const Iteratee& iteratee) {
+    for_each_node_id(aln, iteratee);
+}
+
+/// Find the min and max ID visited by any of the given Alignments or their compact forms.
+template<typename Message>
+static pair<id_t, id_t> visited_id_range(const vector<Message>& alns) {
     id_t min_id = numeric_limits<id_t>::max();
     id_t max_id = numeric_limits<id_t>::min();
     
     for (auto& aln : alns) {
-        // For each alignment
-        if (aln.path().mapping_size() == 0) {
-            // The read is unmapped, so it belongs to node ID 0
-            min_id = min(min_id, (id_t)0);
-            max_id = max(max_id, (id_t)0);
-        } else {
-            for (auto& mapping : aln.path().mapping()) {
-                // For each mapping in it, min/max in the ID
-                auto id = mapping.position().node_id();
-                min_id = min(min_id, id);
-                max_id = max(max_id, id);
-            }
-        }
+        for_each_visited_id(aln, [&](id_t id) {
+            min_id = min(min_id, id);
+            max_id = max(max_id, id);
+            return true;
+        });
     }
     
-    add_group(min_id, max_id, virtual_start, virtual_past_end);
+    return make_pair(min_id, max_id);
+}
+
+auto GAMIndex::add_group(const vector<Alignment>& alns, int64_t virtual_start, int64_t virtual_past_end) -> void {
+    auto id_range = visited_id_range(alns);
+    add_group(id_range.first, id_range.second, virtual_start, virtual_past_end);
+}
+
+auto GAMIndex::add_group(const vector<CompactAlignment>& alns, int64_t virtual_start, int64_t virtual_past_end) -> void {
+    auto id_range = visited_id_range(alns);
+    add_group(id_range.first, id_range.second, virtual_start, virtual_past_end);
+}
+
+auto GAMIndex::add_group(const vector<CompactMultipathAlignment>& alns, int64_t virtual_start, int64_t virtual_past_end) -> void {
+    auto id_range = visited_id_range(alns);
+    add_group(id_range.first, id_range.second, virtual_start, virtual_past_end);
 }
 
 auto GAMIndex::index(cursor_t& cursor) -> void {
+    index_messages(cursor);
+}
+
+auto GAMIndex::index(compact_cursor_t& cursor) -> void {
+    index_messages(cursor);
+}
+
+auto GAMIndex::index(compact_multipath_cursor_t& cursor) -> void {
+    index_messages(cursor);
+}
+
+template<typename Message>
+auto GAMIndex::index_messages(stream::ProtobufIterator<Message>& cursor) -> void {
     // Keep track of what group we are in 
     int64_t group_vo = cursor.tell_group();
     // And load all its alignments
-    vector<Alignment> group;
+    vector<Message> group;
     
     // We need to have seek support
     assert(group_vo != -1);
@@ -367,6 +420,22 @@ static bool is_in_range(const vector<pair<id_t, id_t>>& ranges, id_t id) {
 
 auto GAMIndex::find(cursor_t& cursor, const vector<pair<id_t, id_t>>& ranges,
     const function<void(const Alignment&)> handle_result, bool only_fully_contained) const -> void {
+    find_messages(cursor, ranges, handle_result, only_fully_contained);
+}
+
+auto GAMIndex::find(compact_cursor_t& cursor, const vector<pair<id_t, id_t>>& ranges,
+    const function<void(const CompactAlignment&)> handle_result, bool only_fully_contained) const -> void {
+    find_messages(cursor, ranges, handle_result, only_fully_contained);
+}
+
+auto GAMIndex::find(compact_multipath_cursor_t& cursor, const vector<pair<id_t, id_t>>& ranges,
+    const function<void(const CompactMultipathAlignment&)> handle_result, bool only_fully_contained) const -> void {
+    find_messages(cursor, ranges, handle_result, only_fully_contained);
+}
+
+template<typename Message>
+auto GAMIndex::find_messages(stream::ProtobufIterator<Message>& cursor, const vector<pair<id_t, id_t>>& ranges,
+    const function<void(const Message&)>& handle_result, bool only_fully_contained) const -> void {
     
 #ifdef debug
     cerr << "Begin a find query on ranges:" << endl;
@@ -439,7 +508,21 @@ auto GAMIndex::find(cursor_t& cursor, const vector<pair<id_t, id_t>>& ranges,
         next_unprocessed[start_vo] = past_end_vo;
     };
     
+    // Ranges that are close together are looked up as one, so a query made of
+    // many small ranges, like the nodes along a path, doesn't cost an index
+    // lookup and a seek for each of them. Ranges in the same linear index
+    // window couldn't start their scans anywhere different anyway. Reads are
+    // still only matched against the original ranges.
+    vector<pair<id_t, id_t>> lookup_ranges;
     for (auto& range : ranges) {
+        if (!lookup_ranges.empty() && range.first - lookup_ranges.back().second <= MAX_LOOKUP_GAP) {
+            lookup_ranges.back().second = max(lookup_ranges.back().second, range.second);
+        } else {
+            lookup_ranges.push_back(range);
+        }
+    }
+    
+    for (auto& range : lookup_ranges) {
         // For each range of IDs to look up
         
 #ifdef debug
@@ -542,33 +625,21 @@ auto GAMIndex::find(cursor_t& cursor, const vector<pair<id_t, id_t>>& ranges,
                 const auto& alignment = *cursor;
                 bool alignment_match = false;
                 
-                if (alignment.path().mapping_size() == 0) {
-                    // This read is unmapped, so count it as node 0.
-                    group_min_id = min(group_min_id, (id_t)0);
-                    if (is_in_range(ranges, 0)) {
-                        // We want unmapped reads.
+                // Look at each node that is visited (node 0 for unmapped reads)
+                for_each_visited_id(alignment, [&](id_t visited) {
+                    group_min_id = min(group_min_id, visited);
+                    if (is_in_range(ranges, visited)) {
+                        // We want this node.
                         alignment_match = true;
+                        // If all we care about is that any of the nodes match, we can stop
+                        return only_fully_contained;
+                    } else if (only_fully_contained) {
+                        // We need *all* of the nodes to match, and this one didn't.
+                        alignment_match = false;
+                        return false;
                     }
-                } else {
-                    // The read has mappings
-                    for (const auto& mapping : alignment.path().mapping()) {
-                        // Look at each node that is visited
-                        auto visited = mapping.position().node_id();
-                        group_min_id = min(group_min_id, visited);
-                        if (is_in_range(ranges, visited)) {
-                            // We want this node.
-                            alignment_match = true;
-                            if (!only_fully_contained) {
-                                // All we care about is that any of the nodes match
-                                break;
-                            }
-                        } else if (only_fully_contained) {
-                            // We need *all* of the nodes to match, and this one didn't.
-                            alignment_match = false;
-                            break;
-                        }
-                    }
-                }
+                    return true;
+                });
                 
                 if (alignment_match) {
                     // This alignment is one that matches the query. Yield it.
@@ -610,6 +681,127 @@ auto GAMIndex::find(cursor_t& cursor, const vector<pair<id_t, id_t>>& ranges,
     }
 }
 
+auto GAMIndex::find(vector<cursor_t>& cursors, const vector<vector<pair<id_t, id_t>>>& queries,
+    const function<void(size_t, const Alignment&)> handle_result, bool only_fully_contained) const -> void {
+    
+    assert(!cursors.empty());
+    
+    // Cut node ID space at every range boundary, so that each resulting
+    // segment is entirely in or out of each query's ranges.
+    vector<id_t> boundaries;
+    for (auto& query : queries) {
+        for (auto& range : query) {
+            boundaries.push_back(range.first);
+            boundaries.push_back(range.second + 1);
+        }
+    }
+    std::sort(boundaries.begin(), boundaries.end());
+    boundaries.erase(std::unique(boundaries.begin(), boundaries.end()), boundaries.end());
+    
+    if (boundaries.empty()) {
+        // Nothing to look up
+        return;
+    }
+    
+    // For each segment starting at a boundary (and ending before the next
+    // one), which queries want it?
+    vector<vector<size_t>> segment_queries(boundaries.size());
+    for (size_t i = 0; i < queries.size(); i++) {
+        for (auto& range : queries[i]) {
+            auto start = std::lower_bound(boundaries.begin(), boundaries.end(), range.first);
+            for (auto it = start; it != boundaries.end() && *it <= range.second; ++it) {
+                segment_queries[it - boundaries.begin()].push_back(i);
+            }
+        }
+    }
+    
+    // Get the queries that want a node
+    auto queries_of = [&](id_t node) -> const vector<size_t>* {
+        auto found = std::upper_bound(boundaries.begin(), boundaries.end(), node);
+        if (found == boundaries.begin()) {
+            return nullptr;
+        }
+        auto& wanting = segment_queries[found - boundaries.begin() - 1];
+        return wanting.empty() ? nullptr : &wanting;
+    };
+    
+    // Make the merged, coalesced ranges from the segments anyone wants.
+    vector<pair<id_t, id_t>> merged;
+    for (size_t i = 0; i + 1 < boundaries.size(); i++) {
+        if (segment_queries[i].empty()) {
+            continue;
+        }
+        if (!merged.empty() && merged.back().second + 1 == boundaries[i]) {
+            merged.back().second = boundaries[i + 1] - 1;
+        } else {
+            merged.emplace_back(boundaries[i], boundaries[i + 1] - 1);
+        }
+    }
+    
+    // Split the merged ranges into ID-contiguous blocks for the cursors.
+    size_t block_count = min(cursors.size(), merged.size());
+    
+    mutex result_lock;
+    
+#pragma omp parallel for num_threads(block_count) schedule(static, 1)
+    for (size_t block = 0; block < block_count; block++) {
+        vector<pair<id_t, id_t>> block_ranges(merged.begin() + merged.size() * block / block_count,
+                                              merged.begin() + merged.size() * (block + 1) / block_count);
+        id_t block_min = block_ranges.front().first;
+        id_t block_max = block_ranges.back().second;
+        
+        // For each query an alignment matches, track the lowest node in the
+        // query's ranges, and how many mappings were, to check containment.
+        unordered_map<size_t, pair<id_t, size_t>> matches;
+        
+        find(cursors[block], block_ranges, [&](const Alignment& alignment) {
+            matches.clear();
+            
+            auto visit = [&](id_t node) {
+                auto wanting = queries_of(node);
+                if (wanting == nullptr) {
+                    return;
+                }
+                for (auto& query : *wanting) {
+                    auto found = matches.find(query);
+                    if (found == matches.end()) {
+                        matches.emplace(query, make_pair(node, (size_t) 1));
+                    } else {
+                        found->second.first = min(found->second.first, node);
+                        found->second.second++;
+                    }
+                }
+            };
+            
+            size_t visits;
+            if (alignment.path().mapping_size() == 0) {
+                // This read is unmapped, so count it as node 0.
+                visit(0);
+                visits = 1;
+            } else {
+                for (const auto& mapping : alignment.path().mapping()) {
+                    visit(mapping.position().node_id());
+                }
+                visits = alignment.path().mapping_size();
+            }
+            
+            for (auto& match : matches) {
+                if (match.second.first < block_min || match.second.first > block_max) {
+                    // Another block can see this read's lowest node in this
+                    // query, and that block is responsible for reporting it.
+                    continue;
+                }
+                if (only_fully_contained && match.second.second != visits) {
+                    // Part of the read is outside this query.
+                    continue;
+                }
+                lock_guard<mutex> guard(result_lock);
+                handle_result(match.first, alignment);
+            }
+        });
+    }
+}
+
 auto GAMIndex::find(cursor_t& cursor, id_t node_id, const function<void(const Alignment&)> handle_result) const -> void {
     find(cursor, node_id, node_id, std::move(handle_result));
 }
@@ -67,6 +67,12 @@ public:
     // Methods that actually go get reads for you are going to need a cursor on an open, seekable GAM file.
     using cursor_t = stream::ProtobufIterator<Alignment>;
     
+    // GAMs of CompactAlignments can be indexed and searched too, without the graph.
+    using compact_cursor_t = stream::ProtobufIterator<CompactAlignment>;
+    
+    // And so can files of CompactMultipathAlignments.
+    using compact_multipath_cursor_t = stream::ProtobufIterator<CompactMultipathAlignment>;
+    
     // Bins are identified of unsigned integers of the same width as node IDs.
     using bin_t = make_unsigned<id_t>::type;
     
@@ -107,6 +113,20 @@ public:
     void find(cursor_t& cursor, const vector<pair<id_t, id_t>>& ranges, const function<void(const Alignment&)> handle_result,
         bool only_fully_contained = false) const;
     
+    /// Answer many queries at once. Each query is a sorted, coalesced vector
+    /// of inclusive ID ranges, like for the single-query find(). Calls the
+    /// callback with the number of the query and each Alignment that matches
+    /// it; an Alignment matching several queries is reported once for each.
+    ///
+    /// All the queries' ranges are merged, so each group of reads in the file
+    /// is decoded at most once per cursor no matter how many queries want it.
+    /// The merged ranges are split into ID-contiguous blocks, one for each of
+    /// the given cursors, which must all be open on the same file, and the
+    /// blocks are decoded in parallel. Calls to the callback are serialized,
+    /// but come in no particular order across queries.
+    void find(vector<cursor_t>& cursors, const vector<vector<pair<id_t, id_t>>>& queries,
+        const function<void(size_t, const Alignment&)> handle_result, bool only_fully_contained = false) const;
+    
     /// Given a cursor at the beginning of a sorted, readable file, index the file.
     void index(cursor_t& cursor);
     
@@ -114,6 +134,38 @@ public:
     /// Must be called in virtual offset order for successive groups.
     void add_group(const vector<Alignment>& alns, int64_t virtual_start, int64_t virtual_past_end);
     
+    ///////////////////
+    // CompactAlignment-based interface
+    ///////////////////
+    
+    /// Call the given callback with all the CompactAlignments in the index
+    /// that visit a node in any of the given sorted, coalesced inclusive
+    /// ranges, like the Alignment version.
+    void find(compact_cursor_t& cursor, const vector<pair<id_t, id_t>>& ranges,
+        const function<void(const CompactAlignment&)> handle_result, bool only_fully_contained = false) const;
+    
+    /// Given a cursor at the beginning of a sorted, readable file of CompactAlignments, index the file.
+    void index(compact_cursor_t& cursor);
+    
+    /// Add a group articulated as a vector of CompactAlignments, between the given virtual offsets.
+    void add_group(const vector<CompactAlignment>& alns, int64_t virtual_start, int64_t virtual_past_end);
+    
+    ///////////////////
+    // CompactMultipathAlignment-based interface
+    ///////////////////
+    
+    /// Call the given callback with all the CompactMultipathAlignments in the
+    /// index that visit a node in any of the given sorted, coalesced
+    /// inclusive ranges, like the Alignment version.
+    void find(compact_multipath_cursor_t& cursor, const vector<pair<id_t, id_t>>& ranges,
+        const function<void(const CompactMultipathAlignment&)> handle_result, bool only_fully_contained = false) const;
+    
+    /// Given a cursor at the beginning of a sorted, readable file of CompactMultipathAlignments, index the file.
+    void index(compact_multipath_cursor_t& cursor);
+    
+    /// Add a group articulated as a vector of CompactMultipathAlignments, between the given virtual offsets.
+    void add_group(const vector<CompactMultipathAlignment>& alns, int64_t virtual_start, int64_t virtual_past_end);
+    
     ///////////////////
     // Lower-level virtual-offset-based interface
     ///////////////////
@@ -184,9 +236,23 @@ public:
     
 protected:
     
+    /// Index a sorted file of Alignments or their compact forms.
+    template<typename Message>
+    void index_messages(stream::ProtobufIterator<Message>& cursor);
+    
+    /// Find the Alignments or their compact forms in a sorted file that visit
+    /// nodes in the given ranges.
+    template<typename Message>
+    void find_messages(stream::ProtobufIterator<Message>& cursor, const vector<pair<id_t, id_t>>& ranges,
+        const function<void(const Message&)>& handle_result, bool only_fully_contained) const;
+    
     // How many bits of a node ID do we truncate to get its linear index window?
     const static size_t WINDOW_SHIFT = 8;
     
+    /// How far apart, in node IDs, can the ranges of a query be and still be
+    /// looked up in the index as one range?
+    const static id_t MAX_LOOKUP_GAP = (id_t) 1 << WINDOW_SHIFT;
+    
     /// Maps from bin number to all the ranges of virtual offsets, in order, for runs that land in the given bin.
     /// A run lands in a bin if that bin is the most specific bin that includes both its lowest and highest nodes it uses.
     unordered_map<bin_t, vector<pair<int64_t, int64_t>>> bin_to_ranges;
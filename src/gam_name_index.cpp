@@ -0,0 +1,278 @@
+#include "gam_name_index.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <limits>
+#include <stdexcept>
+
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/io/gzip_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl.h>
+#include <google/protobuf/wire_format_lite.h>
+
+namespace vg {
+
+using namespace std;
+
+const string GAMNameIndex::MAGIC_BYTES = "GAN!";
+
+auto GAMNameIndex::fragment_name(const string& name) -> string {
+    if (name.size() >= 2 && name[name.size() - 2] == '/' &&
+        (name.back() == '1' || name.back() == '2')) {
+        return name.substr(0, name.size() - 2);
+    }
+    return name;
+}
+
+auto GAMNameIndex::hash_name(const string& fragment) -> uint64_t {
+    // 64-bit FNV-1a, which doesn't depend on the standard library's hash.
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (char c : fragment) {
+        hash ^= (uint8_t) c;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+auto GAMNameIndex::add_name(const string& name, int64_t virtual_start) -> void {
+    entries.emplace_back(hash_name(fragment_name(name)), virtual_start);
+    finished = false;
+}
+
+auto GAMNameIndex::add_group(const vector<Alignment>& alns, int64_t virtual_start, int64_t virtual_past_end) -> void {
+    for (auto& aln : alns) {
+        add_name(aln.name(), virtual_start);
+    }
+}
+
+auto GAMNameIndex::add_group(const vector<stream::RawMessage>& alns, int64_t virtual_start,
+    int64_t virtual_past_end) -> void {
+
+    using ::google::protobuf::io::CodedInputStream;
+    using ::google::protobuf::internal::WireFormatLite;
+
+    // Field number from vg.proto
+    const uint32_t name_tag = WireFormatLite::MakeTag(3, WireFormatLite::WIRETYPE_LENGTH_DELIMITED); // Alignment.name
+
+    auto handle = [](bool ok) {
+        if (!ok) {
+            throw runtime_error("GAMNameIndex::add_group: could not decode serialized Alignment");
+        }
+    };
+
+    string name;
+    for (auto& item : alns) {
+        CodedInputStream in((const uint8_t*) item.data.data(), item.data.size());
+        // An unnamed read has no name field at all
+        name.clear();
+        uint32_t tag;
+        while ((tag = in.ReadTag()) != 0) {
+            if (tag != name_tag) {
+                handle(WireFormatLite::SkipField(&in, tag));
+                continue;
+            }
+            // Singular fields can repeat on the wire, with the last one winning
+            uint32_t length;
+            handle(in.ReadVarint32(&length));
+            handle(in.ReadString(&name, length));
+        }
+        add_name(name, virtual_start);
+    }
+}
+
+auto GAMNameIndex::finish() -> void {
+    // Several reads with the same name key in a group only need one entry.
+    sort(entries.begin(), entries.end());
+    entries.erase(unique(entries.begin(), entries.end()), entries.end());
+    entries.shrink_to_fit();
+    finished = true;
+}
+
+auto GAMNameIndex::index(cursor_t& cursor) -> void {
+    // We need to have seek support
+    assert(cursor.tell_group() != -1);
+
+    while (cursor.has_next()) {
+        // Every read is indexed under the group it is in
+        add_name((*cursor).name(), cursor.tell_group());
+        cursor.get_next();
+    }
+
+    finish();
+}
+
+auto GAMNameIndex::size() const -> size_t {
+    return entries.size();
+}
+
+auto GAMNameIndex::find(const string& name) const -> vector<int64_t> {
+    if (!finished) {
+        throw runtime_error("GAMNameIndex::find called on an unfinished index");
+    }
+
+    uint64_t hash = hash_name(fragment_name(name));
+
+    // Entries for a hash are contiguous, and sorted by virtual offset.
+    auto found = lower_bound(entries.begin(), entries.end(), make_pair(hash, numeric_limits<int64_t>::min()));
+    vector<int64_t> to_return;
+    for (; found != entries.end() && found->first == hash; ++found) {
+        to_return.push_back(found->second);
+    }
+    return to_return;
+}
+
+auto GAMNameIndex::find(cursor_t& cursor, const vector<string>& names,
+    const function<void(size_t, const Alignment&)>& handle_result, bool with_mates) const -> void {
+
+    // Work out what each query will match against
+    vector<string> keys;
+    keys.reserve(names.size());
+    for (auto& name : names) {
+        keys.push_back(with_mates ? fragment_name(name) : name);
+    }
+
+    // Collect every group to visit, with the query that wants it.
+    vector<pair<int64_t, size_t>> group_queries;
+    for (size_t i = 0; i < names.size(); i++) {
+        for (auto& group_vo : find(names[i])) {
+            group_queries.emplace_back(group_vo, i);
+        }
+    }
+    // Sort by offset so groups are read front to back, and each only once.
+    sort(group_queries.begin(), group_queries.end());
+    group_queries.erase(unique(group_queries.begin(), group_queries.end()), group_queries.end());
+
+    for (auto it = group_queries.begin(); it != group_queries.end(); ) {
+        // Find all the queries that want this group
+        int64_t group_vo = it->first;
+        auto group_end = it;
+        while (group_end != group_queries.end() && group_end->first == group_vo) {
+            ++group_end;
+        }
+
+        if (!cursor.seek_group(group_vo)) {
+            throw runtime_error("GAMNameIndex::find could not seek to virtual offset " + to_string(group_vo) +
+                "; is the GAM file seekable and BGZF-compressed?");
+        }
+
+        while (cursor.has_next() && cursor.tell_group() == group_vo) {
+            // Check every read in the group against every query that wants it
+            const Alignment& aln = *cursor;
+            const string& key = with_mates ? fragment_name(aln.name()) : aln.name();
+            for (auto query = it; query != group_end; ++query) {
+                if (key == keys[query->second]) {
+                    handle_result(query->second, aln);
+                }
+            }
+            cursor.get_next();
+        }
+
+        it = group_end;
+    }
+}
+
+auto GAMNameIndex::find(cursor_t& cursor, const string& name, const function<void(const Alignment&)>& handle_result,
+    bool with_mates) const -> void {
+
+    find(cursor, vector<string>{name}, [&](size_t query, const Alignment& aln) {
+        handle_result(aln);
+    }, with_mates);
+}
+
+auto GAMNameIndex::save(ostream& to) const -> void {
+    if (!finished) {
+        throw runtime_error("GAMNameIndex::save called on an unfinished index");
+    }
+
+    // We aren't going to save as Protobuf messages; we're going to save as a bunch of varints.
+
+    // Format is
+    // Magic bytes
+    // Index version (varint32)
+    // Entry count (varint64)
+    // For each entry, in sorted order:
+    // Hash, minus the previous entry's hash (varint64)
+    // Group start virtual offset (varint64)
+
+    // All the integers are Protobuf variable-length values.
+    // The result is gzip-compressed.
+
+    ::google::protobuf::io::OstreamOutputStream raw_out(&to);
+    ::google::protobuf::io::GzipOutputStream gzip_out(&raw_out);
+    ::google::protobuf::io::CodedOutputStream coded_out(&gzip_out);
+
+    // Save the magic bytes
+    coded_out.WriteRaw((void*)MAGIC_BYTES.c_str(), MAGIC_BYTES.size());
+
+    // Save the version
+    coded_out.WriteVarint32(OUTPUT_VERSION);
+
+    // Save the entries, with the hashes as deltas, since they are dense
+    coded_out.WriteVarint64(entries.size());
+    uint64_t last_hash = 0;
+    for (auto& entry : entries) {
+        coded_out.WriteVarint64(entry.first - last_hash);
+        coded_out.WriteVarint64(entry.second);
+        last_hash = entry.first;
+    }
+}
+
+auto GAMNameIndex::load(istream& from) -> void {
+
+    ::google::protobuf::io::IstreamInputStream raw_in(&from);
+    ::google::protobuf::io::GzipInputStream gzip_in(&raw_in);
+
+    entries.clear();
+    finished = true;
+
+    // Define an error handling function
+    auto handle = [](bool ok) {
+        if (!ok) throw std::runtime_error("GAMNameIndex::load detected corrupt index file");
+    };
+
+    // Look for the magic value
+
+    // First read a bit of data
+    char* buffer;
+    int buffer_size = 0;
+    while (buffer_size == 0) {
+        // We must retry until we get some data, according to the ZeroCopyInputStream spec
+        handle(gzip_in.Next((const void**)&buffer, &buffer_size));
+    }
+
+    // Unlike the GAMIndex, we have no unversioned files to support.
+    handle(buffer_size >= MAGIC_BYTES.size() && std::equal(MAGIC_BYTES.begin(), MAGIC_BYTES.end(), buffer));
+
+    // Roll back to just after the magic bytes
+    gzip_in.BackUp(buffer_size - MAGIC_BYTES.size());
+
+    uint32_t input_version;
+    uint64_t entry_count;
+    {
+        ::google::protobuf::io::CodedInputStream coded_in(&gzip_in);
+        handle(coded_in.ReadVarint32(&input_version));
+        if (input_version > MAX_INPUT_VERSION) {
+            throw std::runtime_error("GAMNameIndex::load can understand only up to index version " +
+                to_string(MAX_INPUT_VERSION) + " and file is version " + to_string(input_version));
+        }
+        handle(coded_in.ReadVarint64(&entry_count));
+    }
+
+    entries.reserve(entry_count);
+    uint64_t last_hash = 0;
+    while (entries.size() < entry_count) {
+        // To avoid hitting the coded input stream's byte limit, we destroy and
+        // recreate it for every block of entries.
+        ::google::protobuf::io::CodedInputStream coded_in(&gzip_in);
+        for (size_t i = 0; i < 100000 && entries.size() < entry_count; i++) {
+            uint64_t hash_delta;
+            uint64_t group_vo;
+            handle(coded_in.ReadVarint64(&hash_delta));
+            handle(coded_in.ReadVarint64(&group_vo));
+            last_hash += hash_delta;
+            entries.emplace_back(last_hash, (int64_t) group_vo);
+        }
+    }
+}
+
+}
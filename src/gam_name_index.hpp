@@ -0,0 +1,130 @@
+#ifndef VG_GAM_NAME_INDEX_HPP_INCLUDED
+#define VG_GAM_NAME_INDEX_HPP_INCLUDED
+
+/**
+ * \file gam_name_index.hpp
+ * Contains the GAMNameIndex class, which allows retrieving reads from a (blocked) GAM file by name.
+ */
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <functional>
+
+#include "vg.pb.h"
+#include "stream.hpp"
+
+namespace vg {
+
+using namespace std;
+
+/**
+ * An index from read names to the groups of a seekable GAM file that hold
+ * reads with those names. Works on GAMs in any order, so it can be built
+ * alongside a GAMIndex while sorting.
+ *
+ * Names are keyed by their fragment name, which is the name with any trailing
+ * "/1" or "/2" removed, so that the mates of a read can be found along with
+ * it. Keys are stored as 64-bit hashes, each with the virtual offset of a
+ * group that holds at least one read with that key. A hash collision only
+ * costs an extra group read, since reads are checked against the query name
+ * once they are decoded.
+ *
+ * Lookups cost one group decode for each distinct group holding a match, not
+ * a scan of the file.
+ *
+ * All find operations are thread-safe with respect to each other. Simultaneous
+ * adds or finds and adds are prohibited.
+ */
+class GAMNameIndex {
+public:
+    GAMNameIndex() = default;
+
+    // Methods that actually go get reads for you are going to need a cursor on an open, seekable GAM file.
+    using cursor_t = stream::ProtobufIterator<Alignment>;
+
+    /// Load a GAMNameIndex from a file.
+    /// File holds the index, not the GAM.
+    void load(istream& from);
+
+    /// Save a GAMNameIndex to a file. The index must be finished.
+    void save(ostream& to) const;
+
+    /// What's the maximum GAM name index version number we can read with this code?
+    const static uint32_t MAX_INPUT_VERSION = 1;
+    /// What's the version we serialize?
+    const static uint32_t OUTPUT_VERSION = 1;
+    /// What magic value do we embed in the compressed gam name index data?
+    const static string MAGIC_BYTES;
+
+    ///////////////////
+    // Building
+    ///////////////////
+
+    /// Given a cursor at the beginning of a readable file, index the file.
+    /// Finishes the index.
+    void index(cursor_t& cursor);
+
+    /// Add a group articulated as a vector of alignments, starting at the given virtual offset.
+    void add_group(const vector<Alignment>& alns, int64_t virtual_start, int64_t virtual_past_end);
+
+    /// Add a group of serialized Alignments, starting at the given virtual
+    /// offset. Only the names are decoded from the wire format.
+    void add_group(const vector<stream::RawMessage>& alns, int64_t virtual_start, int64_t virtual_past_end);
+
+    /// Sort and deduplicate the added entries. Must be called after the last
+    /// add_group() and before find() or save().
+    void finish();
+
+    ///////////////////
+    // Lookup
+    ///////////////////
+
+    /// Answer many name queries at once. Calls the callback with the number of
+    /// the query and each Alignment named by it. If with_mates is set, also
+    /// finds Alignments with the same fragment name, so a query for either
+    /// "read/1" or "read" finds "read/1", "read/2", and "read". Each group in
+    /// the file is decoded at most once, and groups are visited in file
+    /// order, so results come in file order rather than query order.
+    void find(cursor_t& cursor, const vector<string>& names,
+        const function<void(size_t, const Alignment&)>& handle_result, bool with_mates = false) const;
+
+    /// Call the callback with the Alignment with the given name, and also
+    /// those with the same fragment name if with_mates is set.
+    void find(cursor_t& cursor, const string& name, const function<void(const Alignment&)>& handle_result,
+        bool with_mates = false) const;
+
+    /// Get the virtual offsets, in order, of the groups that may hold reads
+    /// with the given name's fragment name.
+    vector<int64_t> find(const string& name) const;
+
+    /// How many name hash to group entries are in the index?
+    size_t size() const;
+
+    ///////////////////
+    // Name handling
+    ///////////////////
+
+    /// Get the fragment name for a read name, by dropping any "/1" or "/2" mate suffix.
+    static string fragment_name(const string& name);
+
+    /// Hash a fragment name for the index. The hash is the same on all
+    /// platforms, since it gets saved.
+    static uint64_t hash_name(const string& fragment);
+
+protected:
+
+    /// Pairs of fragment name hash and group start virtual offset, sorted and
+    /// deduplicated once finished.
+    vector<pair<uint64_t, int64_t>> entries;
+
+    /// Have the entries been sorted since the last add?
+    bool finished = true;
+
+    /// Add an entry for a read name in the group starting at the given virtual offset.
+    void add_name(const string& name, int64_t virtual_start);
+};
+
+}
+
+#endif
@@ -3,10 +3,14 @@
 #include "json2pb.h"
 #include "position.hpp"
 #include "gam_index.hpp"
+#include "gam_name_index.hpp"
 
 #include <sys/time.h>
 #include <sys/resource.h>
 
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/wire_format_lite.h>
+
 /**
  * \file gamsorter.cpp
  * GAMSorter: sort a gam by position and offset.
@@ -60,13 +64,23 @@ GAMSorter::GAMSorter(bool show_progress) {
     }
 }
 
+void GAMSorter::set_memory_budget(size_t bytes) {
+    memory_budget = bytes;
+}
+
+void GAMSorter::set_max_fan_in(size_t fan_in) {
+    // We need to merge at least 2 files at a time to make progress.
+    max_fan_in = max(min(fan_in, max_fan_in), (size_t) 2);
+}
+
 void GAMSorter::sort(vector<Alignment>& alns) const {
+    VG_TIMELINE_SPAN("sort");
     std::sort(alns.begin(), alns.end(), [&](const Alignment& a, const Alignment& b) {
         return this->less_than(a, b);
     });
 }
 
-void GAMSorter::dumb_sort(istream& gam_in, ostream& gam_out, GAMIndex* index_to) {
+void GAMSorter::dumb_sort(istream& gam_in, ostream& gam_out, GAMIndex* index_to, GAMNameIndex* names_to) {
     std::vector<Alignment> sort_buffer;
 
     stream::for_each<Alignment>(gam_in, [&](Alignment &aln) {
@@ -89,6 +103,13 @@ void GAMSorter::dumb_sort(istream& gam_in, ostream& gam_out, GAMIndex* index_to)
         });
     }
     
+    if (names_to != nullptr) {
+        emitter.on_group([&names_to](const vector<Alignment>& group, int64_t start_vo, int64_t past_end_vo) {
+            // Record the names in each group too
+            names_to->add_group(group, start_vo, past_end_vo);
+        });
+    }
+    
     for (auto& aln : sort_buffer) {
         // Feed in all the sorted alignments
         emitter.write(std::move(aln));
@@ -99,7 +120,7 @@ void GAMSorter::dumb_sort(istream& gam_in, ostream& gam_out, GAMIndex* index_to)
 
 
 
-void GAMSorter::stream_sort(istream& gam_in, ostream& gam_out, GAMIndex* index_to) {
+void GAMSorter::stream_sort(istream& gam_in, ostream& gam_out, GAMIndex* index_to, GAMNameIndex* names_to) {
 
     // We want to work out the file size, if we can.
     size_t file_size = 0;
@@ -137,7 +158,10 @@ void GAMSorter::stream_sort(istream& gam_in, ostream& gam_out, GAMIndex* index_t
     // This cursor will read in the input file.
     cursor_t input_cursor(gam_in);
     
-    #pragma omp parallel shared(gam_in, input_cursor, outstanding_temp_files, reads_per_file, total_reads_read)
+    // Each thread makes its own sorted run, so they split the memory budget.
+    size_t max_buf_size = max(memory_budget / get_thread_count(), (size_t) 1);
+    
+    #pragma omp parallel shared(gam_in, input_cursor, outstanding_temp_files, reads_per_file, total_reads_read, max_buf_size)
     {
     
         while(true) {
@@ -166,11 +190,11 @@ void GAMSorter::stream_sort(istream& gam_in, ostream& gam_out, GAMIndex* index_t
             // Do a sort of the data we grabbed
             this->sort(thread_buffer);
             
-            // Save it to a temp file.
+            // Save it to a temp file. Other threads keep reading and sorting
+            // while this one compresses.
             string temp_name = temp_file::create();
             ofstream temp_stream(temp_name);
             // OK to save as one massive group here.
-            // TODO: This write could also be in a thread.
             stream::write_buffered(temp_stream, thread_buffer, 0);
             
             #pragma omp critical (outstanding_temp_files)
@@ -212,6 +236,13 @@ void GAMSorter::stream_sort(istream& gam_in, ostream& gam_out, GAMIndex* index_t
         });
     }
     
+    if (names_to != nullptr) {
+        emitter.on_group([&names_to](const vector<Alignment>& group, int64_t start_vo, int64_t past_end_vo) {
+            // Record the names in each group too
+            names_to->add_group(group, start_vo, past_end_vo);
+        });
+    }
+    
     // Merge the cursors into the emitter
     streaming_merge(temp_cursors, emitter, total_reads_read);
     
@@ -243,9 +274,13 @@ void GAMSorter::open_all(const vector<string>& filenames, list<ifstream>& stream
 
 }
 
-void GAMSorter::streaming_merge(list<cursor_t>& cursors, emitter_t& emitter, size_t expected_reads) {
+void GAMSorter::streaming_merge(list<cursor_t>& cursors, emitter_t& emitter, size_t expected_reads,
+                                bool track_progress) {
+    VG_TIMELINE_SPAN("merge");
 
-    create_progress("merge " + to_string(cursors.size()) + " files", expected_reads == 0 ? 1 : expected_reads);
+    if (track_progress) {
+        create_progress("merge " + to_string(cursors.size()) + " files", expected_reads == 0 ? 1 : expected_reads);
+    }
     // Count the reads we actually see
     size_t observed_reads = 0;
 
@@ -286,32 +321,54 @@ void GAMSorter::streaming_merge(list<cursor_t>& cursors, emitter_t& emitter, siz
         // TODO: Maybe keep it off the heap for the next loop somehow if it still wins
         
         observed_reads++;
-        if (expected_reads != 0) {
+        if (expected_reads != 0 && track_progress) {
             update_progress(observed_reads);
         }
     }
     
-    // We finished the files, so say we're done.
-    // TODO: Should we warn/fail if we expected the wrong number of reads?
-    update_progress(expected_reads == 0 ? 1 : expected_reads);
-    destroy_progress();
+    if (track_progress) {
+        // We finished the files, so say we're done.
+        // TODO: Should we warn/fail if we expected the wrong number of reads?
+        update_progress(expected_reads == 0 ? 1 : expected_reads);
+        destroy_progress();
+    }
 
 }
 
 vector<string> GAMSorter::streaming_merge(const vector<string>& temp_files_in, unordered_map<string, size_t>* reads_per_file) {
     
+    // We merge groups of files in parallel, so the threads have to share the
+    // open file budget.
+    size_t fan_in = max(max_fan_in / get_thread_count(), (size_t) 2);
+    size_t group_count = (temp_files_in.size() + fan_in - 1) / fan_in;
+    
     // What are the names of the merged files we create?
-    vector<string> temp_files_out;
+    vector<string> temp_files_out(group_count);
+    // And how many reads do we expect in each?
+    vector<size_t> reads_out(group_count, 0);
+    
+    // Work out how many reads to expect at this level
+    size_t level_reads = 0;
+    if (reads_per_file != nullptr) {
+        for (auto& filename : temp_files_in) {
+            level_reads += reads_per_file->at(filename);
+        }
+    }
+    create_progress("merge " + to_string(temp_files_in.size()) + " files into " + to_string(group_count),
+                    level_reads == 0 ? group_count : level_reads);
+    size_t merged = 0;
     
-    // We don't do this loop in parallel because the point of looping is to limit the total currently open files.
-    for (size_t start_file = 0; start_file < temp_files_in.size(); start_file += max_fan_in) {
+    #pragma omp parallel for schedule(dynamic, 1) shared(merged)
+    for (size_t group = 0; group < group_count; group++) {
         // For each range of sufficiently few files, starting at start_file and running for file_count
-        size_t file_count = min(max_fan_in, temp_files_in.size() - start_file);
+        size_t start_file = group * fan_in;
+        size_t file_count = min(fan_in, temp_files_in.size() - start_file);
     
         // Open up cursors into all the files.
         list<ifstream> temp_ifstreams;
         list<cursor_t> temp_cursors;
-        open_all(vector<string>(&temp_files_out[start_file], &temp_files_out[start_file + file_count]), temp_ifstreams, temp_cursors);
+        open_all(vector<string>(temp_files_in.begin() + start_file, temp_files_in.begin() + start_file + file_count),
+                 temp_ifstreams, temp_cursors);
         
         // Work out how many reads to expect
         size_t expected_reads = 0;
@@ -323,27 +380,42 @@ vector<string> GAMSorter::streaming_merge(const vector<string>& temp_files_in, u
         
         // Open an output file
         string out_file_name = temp_file::create();
-        ofstream out_stream(out_file_name);
-        temp_files_out.push_back(out_file_name);
+        temp_files_out[group] = out_file_name;
+        reads_out[group] = expected_reads;
         
-        // Make an output emitter
-        emitter_t emitter(out_stream);
-        
-        // Merge the cursors into the emitter
-        streaming_merge(temp_cursors, emitter, expected_reads);
-        
-        // The output file will be flushed and finished automatically when the emitter goes away.
+        {
+            ofstream out_stream(out_file_name);
+            
+            // Make an output emitter
+            emitter_t emitter(out_stream);
+            
+            // Merge the cursors into the emitter, without a progress bar of
+            // its own since other merges are running.
+            streaming_merge(temp_cursors, emitter, expected_reads, false);
+            
+            // The output file will be flushed and finished automatically when the emitter goes away.
+        }
         
         // Clean up the input files we used
         temp_cursors.clear();
         temp_ifstreams.clear();
-        for (size_t i = start_file; i < file_count; i++) {
+        for (size_t i = start_file; i < start_file + file_count; i++) {
             temp_file::remove(temp_files_in.at(i));
         }
         
-        if (reads_per_file != nullptr) {
+        #pragma omp critical (progress)
+        {
+            merged += (level_reads == 0 ? 1 : expected_reads);
+            update_progress(merged);
+        }
+    }
+    
+    destroy_progress();
+    
+    if (reads_per_file != nullptr) {
+        for (size_t group = 0; group < group_count; group++) {
             // Save the total reads that should be in the created file, in case we need to do another pass
-            (*reads_per_file)[out_file_name] = expected_reads;
+            (*reads_per_file)[temp_files_out[group]] = reads_out[group];
         }
     }
     
@@ -351,7 +423,7 @@ vector<string> GAMSorter::streaming_merge(const vector<string>& temp_files_in, u
         
 }
 
-void GAMSorter::benedict_sort(istream& gam_in, ostream& gam_out, GAMIndex* index_to) {
+void GAMSorter::benedict_sort(istream& gam_in, ostream& gam_out, GAMIndex* index_to, GAMNameIndex* names_to) {
     // Go to the end of the file
     gam_in.seekg(0, gam_in.end);
     // Get its position
@@ -415,6 +487,13 @@ void GAMSorter::benedict_sort(istream& gam_in, ostream& gam_out, GAMIndex* index
         });
     }
     
+    if (names_to != nullptr) {
+        emitter.on_group([&names_to](const vector<Alignment>& group, int64_t start_vo, int64_t past_end_vo) {
+            // Record the names in each group too
+            names_to->add_group(group, start_vo, past_end_vo);
+        });
+    }
+    
     // Actually do the shuffle
     for (auto& pos_and_vo : pos_to_vo) {
         // For each item in sorted order
@@ -431,6 +510,91 @@ void GAMSorter::benedict_sort(istream& gam_in, ostream& gam_out, GAMIndex* index
     destroy_progress();
 }
 
+void GAMSorter::key_sort(istream& gam_in, ostream& gam_out, GAMIndex* index_to, GAMNameIndex* names_to) {
+    // Go to the end of the file
+    gam_in.seekg(0, gam_in.end);
+    // Get its position
+    auto file_end = gam_in.tellg();
+    // Go to the start
+    gam_in.seekg(0);
+    
+    // This will have all the item VOs and let us sort them by position
+    vector<pair<pos_t, int64_t>> pos_to_vo;
+    
+    // Read the reads as raw bytes, so they are never parsed.
+    stream::ProtobufIterator<stream::RawMessage> cursor(gam_in);
+    
+    if (cursor.tell_raw() == -1) {
+        // This will catch non-blocked gzip files, as well as streaming streams.
+        cerr << "error:[vg gamsort]: Cannot sort an unseekable GAM" << endl;
+        exit(1);
+    }
+    
+    create_progress("load keys", file_end);
+    
+    size_t seen = 0;
+    
+    while(cursor.has_next()) {
+        // Save just the key with the alignment's virtual offset
+        pos_to_vo.emplace_back(get_key_and_max_id((*cursor).data).first, cursor.tell_item());
+        
+        cursor.get_next();
+        
+        if (seen % 1000 == 0) {
+            update_progress(gam_in.tellg());
+        }
+        seen++;
+    }
+    
+    update_progress(gam_in.tellg());
+    destroy_progress();
+    create_progress("sort keys", 1);
+    
+    std::sort(pos_to_vo.begin(), pos_to_vo.end(), [&](const pair<pos_t, int64_t>& a, const pair<pos_t, int64_t>& b) {
+        return this->less_than(a.first, b.first);
+    });
+    
+    update_progress(1);
+    destroy_progress();
+    create_progress("reorder reads", pos_to_vo.size());
+    
+    stream::ProtobufEmitter<stream::RawMessage> emitter(gam_out);
+    
+    if (index_to != nullptr) {
+        emitter.on_group([&index_to, this](const vector<stream::RawMessage>& group, int64_t start_vo, int64_t past_end_vo) {
+            // We don't have parsed Alignments to hand to the index, so work
+            // out the group's node ID range from the wire format again.
+            // Unmapped reads come out as node ID 0, as they do for the
+            // Alignment version of add_group().
+            id_t min_id = numeric_limits<id_t>::max();
+            id_t max_id = numeric_limits<id_t>::min();
+            for (auto& item : group) {
+                auto key = this->get_key_and_max_id(item.data);
+                min_id = min(min_id, id(key.first));
+                max_id = max(max_id, key.second);
+            }
+            index_to->add_group(min_id, max_id, start_vo, past_end_vo);
+        });
+    }
+    
+    if (names_to != nullptr) {
+        emitter.on_group([&names_to](const vector<stream::RawMessage>& group, int64_t start_vo, int64_t past_end_vo) {
+            // The name index can pull the names out of the wire format itself
+            names_to->add_group(group, start_vo, past_end_vo);
+        });
+    }
+    
+    for (auto& pos_and_vo : pos_to_vo) {
+        // Copy each read's bytes over in sorted order
+        cursor.seek_item_and_stop(pos_and_vo.second);
+        emitter.write(std::move(cursor.take()));
+        
+        increment_progress();
+    }
+    
+    destroy_progress();
+}
+
 
 bool GAMSorter::less_than(const Alignment &a, const Alignment &b) const {
     return less_than(get_min_position(a), get_min_position(b));
@@ -458,6 +622,77 @@ Position GAMSorter::get_min_position(const Path& path) const {
     return min;
 }
 
+pair<pos_t, id_t> GAMSorter::get_key_and_max_id(const string& serialized) const {
+    using ::google::protobuf::io::CodedInputStream;
+    using ::google::protobuf::internal::WireFormatLite;
+    
+    // Field numbers from vg.proto
+    const uint32_t path_tag = WireFormatLite::MakeTag(2, WireFormatLite::WIRETYPE_LENGTH_DELIMITED); // Alignment.path
+    const uint32_t mapping_tag = WireFormatLite::MakeTag(2, WireFormatLite::WIRETYPE_LENGTH_DELIMITED); // Path.mapping
+    const uint32_t position_tag = WireFormatLite::MakeTag(1, WireFormatLite::WIRETYPE_LENGTH_DELIMITED); // Mapping.position
+    
+    auto handle = [](bool ok) {
+        if (!ok) {
+            throw runtime_error("GAMSorter::get_key_and_max_id: could not decode serialized Alignment");
+        }
+    };
+    
+    CodedInputStream in((const uint8_t*) serialized.data(), serialized.size());
+    
+    // Descend into a length-delimited field, calling the callback with its
+    // contents' limit in place.
+    auto descend = [&](const function<void()>& body) {
+        uint32_t length;
+        handle(in.ReadVarint32(&length));
+        auto limit = in.PushLimit(length);
+        body();
+        in.PopLimit(limit);
+    };
+    
+    Position min_pos;
+    id_t max_id = 0;
+    bool first = true;
+    string position_bytes;
+    Position pos;
+    
+    uint32_t tag;
+    while ((tag = in.ReadTag()) != 0) {
+        if (tag != path_tag) {
+            handle(WireFormatLite::SkipField(&in, tag));
+            continue;
+        }
+        descend([&]() {
+            while ((tag = in.ReadTag()) != 0) {
+                if (tag != mapping_tag) {
+                    handle(WireFormatLite::SkipField(&in, tag));
+                    continue;
+                }
+                descend([&]() {
+                    while ((tag = in.ReadTag()) != 0) {
+                        if (tag != position_tag) {
+                            handle(WireFormatLite::SkipField(&in, tag));
+                            continue;
+                        }
+                        // Positions are tiny, so just parse them.
+                        uint32_t length;
+                        handle(in.ReadVarint32(&length));
+                        handle(in.ReadString(&position_bytes, length));
+                        handle(pos.ParseFromString(position_bytes));
+                        
+                        if (first || less_than(pos, min_pos)) {
+                            min_pos = pos;
+                            first = false;
+                        }
+                        max_id = max(max_id, (id_t) pos.node_id());
+                    }
+                });
+            }
+        });
+    }
+    
+    return make_pair(make_pos_t(min_pos), max_id);
+}
+
 bool GAMSorter::equal_to(const Position& a, const Position& b) const {
     return (a.node_id() == b.node_id() &&
             a.is_reverse() == b.is_reverse() &&
@@ -24,9 +24,10 @@ using namespace std;
 namespace vg {
 
 
-// We need to know about the GAMIndex, but we don't actually need to hold one.
-// So pre-declare it here.
+// We need to know about the GAMIndex and GAMNameIndex, but we don't actually
+// need to hold one. So pre-declare them here.
 class GAMIndex;
+class GAMNameIndex;
 
 /// Provides the ability to sort a GAM, either "dumbly" (in memory), or
 /// "streaming" into temporary files. Paired alignments are not necessarily
@@ -45,19 +46,36 @@ public:
     
     /// Sort a stream of GAM-format data, using temporary files, limiting the
     /// number of simultaneously open input files and the size of in-memory
-    /// data. Optionally index the sorted GAM file into the given GAMIndex.
-    void stream_sort(istream& gam_in, ostream& gam_out, GAMIndex* index_to = nullptr);
+    /// data. Optionally index the sorted GAM file into the given GAMIndex and GAMNameIndex.
+    void stream_sort(istream& gam_in, ostream& gam_out, GAMIndex* index_to = nullptr, GAMNameIndex* names_to = nullptr);
     
     /// Sort a stream of GAM-format data, loading it all into memory and doing
     /// a single giant sort operation.
-    /// Optionally index the sorted GAM file into the given GAMIndex.
-    void dumb_sort(istream& gam_in, ostream& gam_out, GAMIndex* index_to = nullptr);
+    /// Optionally index the sorted GAM file into the given GAMIndex and GAMNameIndex.
+    void dumb_sort(istream& gam_in, ostream& gam_out, GAMIndex* index_to = nullptr, GAMNameIndex* names_to = nullptr);
     
     /// Sort a seekable input stream by doing one pass to load all the
     /// positions, sorting all the positions in memory, and doing another pass
     /// of jumping around to re-order all the reads.
-    /// Optionally index the sorted GAM file into the given GAMIndex.
-    void benedict_sort(istream& gam_in, ostream& gam_out, GAMIndex* index_to = nullptr);
+    /// Optionally index the sorted GAM file into the given GAMIndex and GAMNameIndex.
+    void benedict_sort(istream& gam_in, ostream& gam_out, GAMIndex* index_to = nullptr, GAMNameIndex* names_to = nullptr);
+    
+    /// Sort a seekable input stream like benedict_sort, but without ever
+    /// parsing whole reads. Only the sort key is decoded from each serialized
+    /// read, only keys and virtual offsets are held in memory, and reads are
+    /// copied to the output as the same bytes they were read as.
+    /// Optionally index the sorted GAM file into the given GAMIndex and GAMNameIndex.
+    void key_sort(istream& gam_in, ostream& gam_out, GAMIndex* index_to = nullptr, GAMNameIndex* names_to = nullptr);
+    
+    /// Set the total size, in serialized uncompressed bytes, of reads to hold
+    /// in memory across all threads while making sorted runs in the
+    /// streaming sort.
+    void set_memory_budget(size_t bytes);
+    
+    /// Limit how many temp files are merged together at once in the streaming
+    /// sort. The limit can only be lowered from what the OS file descriptor
+    /// limit allows.
+    void set_max_fan_in(size_t fan_in);
     
     //////////////////
     // Supporting API
@@ -78,6 +96,11 @@ public:
 
     /// Determine the minimum position visited by a Path, as for an Alignment.
     Position get_min_position(const Path& path) const;
+    
+    /// Determine the minimum position (as for get_min_position()) and the
+    /// maximum node ID visited by a serialized Alignment, by decoding only the
+    /// mapping positions from the wire format.
+    pair<pos_t, id_t> get_key_and_max_id(const string& serialized) const;
 
     /// Return True if the given Position values are equal, and false otherwise.
     bool equal_to(const Position& a, const Position& b) const;
@@ -95,12 +118,13 @@ public:
 
   private:
     /// What's the maximum size of reads in serialized, uncompressed bytes to
-    /// load into memory for a single temp file chunk, during the streaming
-    /// sort?
+    /// load into memory for all the temp file chunks being made at once,
+    /// during the streaming sort? Each thread gets an equal share.
     /// For reference, a whole-genome GAM file is about 500 GB of uncompressed data
-    size_t max_buf_size = (512 * 1024 * 1024);
+    size_t memory_budget = (size_t) 4 * 512 * 1024 * 1024;
     /// What's the max fan-in when combining temp files, during the streaming sort?
     /// This will be computed based on the max file descriptor limit from the OS.
+    /// When merges run in parallel, they share this many open files.
     size_t max_fan_in;
     
     using cursor_t = stream::ProtobufIterator<Alignment>;
@@ -112,10 +136,14 @@ public:
     
     /// Merge all the reads from the given list of cursors into the given emitter.
     /// The total expected number of reads can be passed for progress bar purposes.
-    void streaming_merge(list<cursor_t>& cursors, emitter_t& emitter, size_t expected_reads = 0);
+    /// If track_progress is false, no progress bar is made, so the merge
+    /// can run alongside others.
+    void streaming_merge(list<cursor_t>& cursors, emitter_t& emitter, size_t expected_reads = 0,
+                         bool track_progress = true);
     
     /// Merge all the given temp input files into one or more temp output
-    /// files, opening no more than max_fan_in input files at a time. The input
+    /// files, opening no more than max_fan_in input files at a time across
+    /// all threads. Groups of input files are merged in parallel. The input
     /// files, which must be from temp_file::create(), will be deleted.
     ///
     /// If reads_per_file is specified, it will be used to show progress bars,
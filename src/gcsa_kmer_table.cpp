@@ -0,0 +1,199 @@
+#include "gcsa_kmer_table.hpp"
+
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+#include <omp.h>
+
+/**
+ * \file gcsa_kmer_table.cpp: implementation of the GCSA2 kmer range table
+ */
+
+namespace vg {
+
+using namespace std;
+
+const size_t GCSAKmerTable::MAX_KMER_LENGTH;
+const size_t GCSAKmerTable::DEFAULT_KMER_LENGTH;
+
+/// The bases in the order of their 2-bit codes.
+static const char KMER_TABLE_BASES[] = "ACGT";
+
+/// Magic bytes at the start of a serialized table.
+static const char KMER_TABLE_MAGIC[] = "VGKT";
+static const uint32_t KMER_TABLE_VERSION = 1;
+
+/// Get the 2-bit code for a base, or -1 if it isn't ACGT.
+static inline int kmer_table_code(char base) {
+    switch (base) {
+    case 'A':
+        return 0;
+    case 'C':
+        return 1;
+    case 'G':
+        return 2;
+    case 'T':
+        return 3;
+    default:
+        return -1;
+    }
+}
+
+/// Take one LF step from the suffix's range with the given base. Returns
+/// false if the extended range is empty.
+static bool extend_kmer_entry(const gcsa::GCSA& gcsa, const gcsa::LCPArray& lcp,
+                              const GCSAKmerTable::Entry& suffix, char base,
+                              GCSAKmerTable::Entry& extended) {
+    extended.range = gcsa.LF(suffix.range, gcsa.alpha.char2comp[base]);
+    if (gcsa::Range::empty(extended.range)) {
+        return false;
+    }
+    extended.min_count = min(suffix.min_count, (size_t) gcsa.count(extended.range));
+    extended.max_parent_lcp = max(suffix.max_parent_lcp, (uint32_t) lcp.parent(extended.range).lcp());
+    return true;
+}
+
+template<typename T>
+static void write_kmer_table_value(ostream& out, const T& value) {
+    out.write((const char*) &value, sizeof(T));
+}
+
+template<typename T>
+static void read_kmer_table_value(istream& in, T& value) {
+    in.read((char*) &value, sizeof(T));
+    if (!in) {
+        throw runtime_error("GCSAKmerTable: kmer table file is truncated");
+    }
+}
+
+GCSAKmerTable::GCSAKmerTable(const gcsa::GCSA& gcsa, const gcsa::LCPArray& lcp, size_t kmer_length) :
+    length(kmer_length), index_size(gcsa.size()) {
+
+    if (kmer_length == 0 || kmer_length > MAX_KMER_LENGTH || kmer_length > gcsa.order()) {
+        throw runtime_error("GCSAKmerTable: kmer length " + to_string(kmer_length) +
+                            " must be between 1 and " + to_string(min(MAX_KMER_LENGTH, (size_t) gcsa.order())));
+    }
+
+    Entry missing;
+    missing.range = gcsa::Range::empty_range();
+    missing.min_count = 0;
+    missing.max_parent_lcp = 0;
+    entries.assign((size_t) 1 << (2 * length), missing);
+
+    // Do the first couple of steps here, so there is enough to spread out
+    // over the threads.
+    Entry root;
+    root.range = gcsa::range_type(0, gcsa.size() - 1);
+    root.min_count = numeric_limits<size_t>::max();
+    root.max_parent_lcp = 0;
+    vector<pair<Entry, size_t>> seeds{make_pair(root, 0)};
+    size_t seed_length = 0;
+    for (; seed_length < min(length, (size_t) 2); seed_length++) {
+        vector<pair<Entry, size_t>> longer_seeds;
+        for (auto& seed : seeds) {
+            for (size_t code = 0; code < 4; code++) {
+                Entry extended;
+                if (extend_kmer_entry(gcsa, lcp, seed.first, KMER_TABLE_BASES[code], extended)) {
+                    longer_seeds.emplace_back(extended, (code << (2 * seed_length)) | seed.second);
+                }
+            }
+        }
+        seeds = move(longer_seeds);
+    }
+
+#pragma omp parallel for schedule(dynamic, 1)
+    for (size_t i = 0; i < seeds.size(); i++) {
+        fill(gcsa, lcp, seeds[i].first, seed_length, seeds[i].second);
+    }
+}
+
+void GCSAKmerTable::fill(const gcsa::GCSA& gcsa, const gcsa::LCPArray& lcp, const Entry& suffix,
+                         size_t suffix_length, size_t suffix_code) {
+    if (suffix_length == length) {
+        entries[suffix_code] = suffix;
+        return;
+    }
+    for (size_t code = 0; code < 4; code++) {
+        Entry extended;
+        if (extend_kmer_entry(gcsa, lcp, suffix, KMER_TABLE_BASES[code], extended)) {
+            // Kmers that don't occur are already empty.
+            fill(gcsa, lcp, extended, suffix_length + 1, (code << (2 * suffix_length)) | suffix_code);
+        }
+    }
+}
+
+size_t GCSAKmerTable::kmer_length() const {
+    return length;
+}
+
+size_t GCSAKmerTable::gcsa_size() const {
+    return index_size;
+}
+
+const GCSAKmerTable::Entry* GCSAKmerTable::find(string::const_iterator kmer_begin) const {
+    if (length == 0) {
+        return nullptr;
+    }
+    size_t kmer_code = 0;
+    for (size_t i = 0; i < length; i++) {
+        int code = kmer_table_code(kmer_begin[i]);
+        if (code < 0) {
+            return nullptr;
+        }
+        kmer_code = (kmer_code << 2) | code;
+    }
+    const Entry& entry = entries[kmer_code];
+    return gcsa::Range::empty(entry.range) ? nullptr : &entry;
+}
+
+void GCSAKmerTable::serialize(ostream& out) const {
+    out.write(KMER_TABLE_MAGIC, strlen(KMER_TABLE_MAGIC));
+    write_kmer_table_value(out, KMER_TABLE_VERSION);
+    write_kmer_table_value(out, (uint64_t) length);
+    write_kmer_table_value(out, (uint64_t) index_size);
+    for (auto& entry : entries) {
+        write_kmer_table_value(out, (uint64_t) entry.range.first);
+        write_kmer_table_value(out, (uint64_t) entry.range.second);
+        write_kmer_table_value(out, (uint64_t) entry.min_count);
+        write_kmer_table_value(out, entry.max_parent_lcp);
+    }
+    if (!out) {
+        throw runtime_error("GCSAKmerTable: I/O error writing kmer table");
+    }
+}
+
+void GCSAKmerTable::load(istream& in) {
+    char magic[sizeof(KMER_TABLE_MAGIC)] = {};
+    in.read(magic, strlen(KMER_TABLE_MAGIC));
+    if (!in || strcmp(magic, KMER_TABLE_MAGIC) != 0) {
+        throw runtime_error("GCSAKmerTable: not a kmer table file");
+    }
+    uint32_t version;
+    read_kmer_table_value(in, version);
+    if (version != KMER_TABLE_VERSION) {
+        throw runtime_error("GCSAKmerTable: unsupported kmer table version " + to_string(version));
+    }
+    uint64_t stored_length;
+    uint64_t stored_size;
+    read_kmer_table_value(in, stored_length);
+    read_kmer_table_value(in, stored_size);
+    if (stored_length == 0 || stored_length > MAX_KMER_LENGTH) {
+        throw runtime_error("GCSAKmerTable: bad kmer length " + to_string(stored_length));
+    }
+    length = stored_length;
+    index_size = stored_size;
+
+    entries.resize((size_t) 1 << (2 * length));
+    for (auto& entry : entries) {
+        uint64_t first, second, min_count;
+        read_kmer_table_value(in, first);
+        read_kmer_table_value(in, second);
+        read_kmer_table_value(in, min_count);
+        read_kmer_table_value(in, entry.max_parent_lcp);
+        entry.range = gcsa::range_type(first, second);
+        entry.min_count = min_count;
+    }
+}
+
+}
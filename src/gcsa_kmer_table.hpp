@@ -0,0 +1,85 @@
+#ifndef VG_GCSA_KMER_TABLE_HPP_INCLUDED
+#define VG_GCSA_KMER_TABLE_HPP_INCLUDED
+
+/** \file
+ * A table of the GCSA2 ranges of all short DNA kmers, so backward searches
+ * that start from the whole index can skip their first few LF steps.
+ */
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <gcsa/gcsa.h>
+#include <gcsa/lcp.h>
+
+namespace vg {
+
+using namespace std;
+
+/**
+ * Holds, for every kmer over ACGT of a fixed length, the GCSA2 range that a
+ * backward search for it from the full range would reach, along with what
+ * the search would have seen on the way there. Kept next to the GCSA2 index
+ * in a ".kmers" file.
+ */
+class GCSAKmerTable {
+public:
+
+    /// Everything a backward search learns while matching one kmer.
+    struct Entry {
+        /// The range matching the whole kmer. Empty if the kmer doesn't occur.
+        gcsa::range_type range;
+        /// The smallest gcsa->count() of the ranges for the kmer's suffixes.
+        size_t min_count;
+        /// The largest LCP of the parents of the ranges for the kmer's suffixes.
+        uint32_t max_parent_lcp;
+    };
+
+    /// The longest kmers we allow, to keep the table to a few GB.
+    static const size_t MAX_KMER_LENGTH = 13;
+    /// The kmer length tables are usually built with.
+    static const size_t DEFAULT_KMER_LENGTH = 10;
+
+    /// Make an empty table, which finds nothing, to load into.
+    GCSAKmerTable() = default;
+
+    /// Make a table of all kmers of the given length in the given index, on
+    /// all OpenMP threads. The kmer length can't be more than the index
+    /// order or MAX_KMER_LENGTH.
+    GCSAKmerTable(const gcsa::GCSA& gcsa, const gcsa::LCPArray& lcp, size_t kmer_length = DEFAULT_KMER_LENGTH);
+
+    /// Get the length of the kmers in the table, or 0 if the table is empty.
+    size_t kmer_length() const;
+
+    /// Get the size of the GCSA2 index the table was made from, so it can be
+    /// checked against the index it is used with.
+    size_t gcsa_size() const;
+
+    /// Look up the kmer starting at the given position. Returns null if it
+    /// has characters other than ACGT or doesn't occur in the index.
+    const Entry* find(string::const_iterator kmer_begin) const;
+
+    /// Write the table to a stream.
+    void serialize(ostream& out) const;
+
+    /// Replace the contents of the table with one read from a stream. Throws
+    /// if the stream doesn't hold a table.
+    void load(istream& in);
+
+private:
+
+    /// Fill in the entries for every kmer ending in the given suffix, which
+    /// has the given code in the low bits and matches the given range.
+    void fill(const gcsa::GCSA& gcsa, const gcsa::LCPArray& lcp, const Entry& suffix,
+              size_t suffix_length, size_t suffix_code);
+
+    size_t length = 0;
+    size_t index_size = 0;
+    vector<Entry> entries;
+};
+
+}
+
+#endif
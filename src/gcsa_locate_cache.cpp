@@ -0,0 +1,72 @@
+#include "gcsa_locate_cache.hpp"
+
+/**
+ * \file gcsa_locate_cache.cpp: implementation of the GCSA2 locate() cache
+ */
+
+namespace vg {
+
+using namespace std;
+
+GCSALocateCache::GCSALocateCache(const gcsa::GCSA& gcsa, size_t capacity, size_t min_range_length) :
+    gcsa(gcsa), min_range_length(max(min_range_length, (size_t) 1)), cache(capacity) {
+    // nothing to do
+}
+
+/// Ask the index for the positions in a range.
+static void locate_in_index(const gcsa::GCSA& gcsa, const gcsa::range_type& range, size_t max_results,
+                            vector<gcsa::node_type>& results) {
+    if (max_results) {
+        gcsa.locate(range, max_results, results);
+    } else {
+        gcsa.locate(range, results);
+    }
+}
+
+void GCSALocateCache::locate(const gcsa::range_type& range, size_t max_results, vector<gcsa::node_type>& results) {
+    if (gcsa::Range::empty(range) || gcsa::Range::length(range) < min_range_length) {
+        locate_in_index(gcsa, range, max_results, results);
+        return;
+    }
+
+    key_type key(range, max_results);
+    auto cached = cache.retrieve(key);
+    if (cached.second) {
+        results = *cached.first;
+        return;
+    }
+
+    // Other threads may be locating the same range right now; that's fine,
+    // they will all get the same answer.
+    locate_in_index(gcsa, range, max_results, results);
+    cache.put(key, make_shared<const vector<gcsa::node_type>>(results));
+}
+
+size_t GCSALocateCache::warm(const vector<string>& kmers, size_t max_results) {
+    size_t cached = 0;
+    vector<gcsa::node_type> results;
+    for (auto& kmer : kmers) {
+        gcsa::range_type range = gcsa.find(kmer);
+        if (gcsa::Range::empty(range) || gcsa::Range::length(range) < min_range_length) {
+            continue;
+        }
+        locate_in_index(gcsa, range, max_results, results);
+        cache.put(key_type(range, max_results), make_shared<const vector<gcsa::node_type>>(results));
+        cached++;
+    }
+    return cached;
+}
+
+size_t GCSALocateCache::hits() const {
+    return cache.hits();
+}
+
+size_t GCSALocateCache::misses() const {
+    return cache.misses();
+}
+
+size_t GCSALocateCache::size() const {
+    return cache.size();
+}
+
+}
@@ -0,0 +1,66 @@
+#ifndef VG_GCSA_LOCATE_CACHE_HPP_INCLUDED
+#define VG_GCSA_LOCATE_CACHE_HPP_INCLUDED
+
+/** \file
+ * A cache of GCSA2 locate() results for large ranges, so the positions of
+ * repetitive MEMs that show up in read after read are only decoded once.
+ */
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <gcsa/gcsa.h>
+
+#include "sharded_cache.hpp"
+
+namespace vg {
+
+using namespace std;
+
+/**
+ * Remembers the positions of GCSA2 ranges with many hits. Safe to share
+ * between threads. Small ranges are cheap to locate and would only push the
+ * repetitive ones out, so they go straight to the index.
+ */
+class GCSALocateCache {
+public:
+
+    /// Make a cache for the given index, which must outlive it, holding
+    /// about the given number of ranges. Only ranges of at least
+    /// min_range_length are cached.
+    GCSALocateCache(const gcsa::GCSA& gcsa, size_t capacity, size_t min_range_length = 8);
+
+    /// Fill results with the positions in the range, as gcsa.locate() would,
+    /// stopping at max_results if it is not 0.
+    void locate(const gcsa::range_type& range, size_t max_results, vector<gcsa::node_type>& results);
+
+    /// Cache the positions of each kmer, as found with the given result
+    /// limit, so repeats known in advance don't have to be missed once.
+    /// Returns the number of kmers that were cached.
+    size_t warm(const vector<string>& kmers, size_t max_results);
+
+    /// Get the number of lookups of cacheable ranges that were in the cache.
+    size_t hits() const;
+
+    /// Get the number of lookups of cacheable ranges that had to go to the
+    /// index.
+    size_t misses() const;
+
+    /// Get the number of ranges cached.
+    size_t size() const;
+
+private:
+
+    /// Ranges are cached separately for each result limit.
+    typedef pair<gcsa::range_type, size_t> key_type;
+
+    const gcsa::GCSA& gcsa;
+    size_t min_range_length;
+    ShardedCache<key_type, shared_ptr<const vector<gcsa::node_type>>> cache;
+};
+
+}
+
+#endif
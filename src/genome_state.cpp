@@ -2,6 +2,7 @@
 #include "utility.hpp"
 
 #include <signal.h>
+#include <exception>
 
 namespace vg {
 
@@ -375,128 +376,122 @@ ReplaceLocalHaplotypeCommand GenomeState::replace_local_haplotype(const ReplaceL
     ReplaceLocalHaplotypeCommand to_return;
     
     // We need to do all the deletions and create balancing insertions
-    // TODO: this code is duplicated with delete_haplotype
-    for (auto& kv : c.deletions) {
-        // We can handle each snarl independently.
-        // TODO: do this in parallel?
-        auto& snarl = kv.first;
-        auto& overall_lanes = kv.second;
-        
-        // Find where to log the deletions we need to do
-        auto& haplotype_insertions = to_return.insertions[snarl];
-        
-        for (auto& overall_lane : overall_lanes) {
-            // For each haplotype we want to remove from this snarl, in order...
-            
-#ifdef debug
-            cerr << "Delete " << overall_lane << " from " << kv.first->start() << " -> " << kv.first->end() << endl;
-#endif
-            
-            // Remove the haplotype and save a copy
-            auto removed = state.at(snarl).erase(overall_lane);  
-            
-            // Save the insertion to do by logging the haplotype with all its
-            // tagged lane assignments.
-            haplotype_insertions.emplace_back(removed); 
-        }
-        
-        // Flip the insertions around to happen in reverse order. Things need to
-        // get to the lanes we deleted them from.
-        reverse(haplotype_insertions.begin(), haplotype_insertions.end());
-    }
+    delete_lanes(c.deletions, to_return.insertions);
     
     // Then we need to do all the insertions and create balancing deletions
-    // TODO: this is duplicated with insert_haplotype
-    for (auto& kv : c.insertions) {
-        // We can handle each snarl independently.
-        // TODO: do this in parallel?
-        auto& snarl = kv.first;
-        auto& haplotypes = kv.second;
-        
-        // Find where to log the deletions we need to do
-        auto& haplotype_deletions = to_return.deletions[snarl];
-        
-        for (auto& haplotype : haplotypes) {
-            // For each haplotype we want to add to this snarl, in order...
-            
-            // Insert the haplotype
-            state.at(snarl).insert(haplotype);  
-            
-            // Save the deletion to do by logging the overall lane used.
-            haplotype_deletions.emplace_back(haplotype.front().second); 
-        }
-        
-        // Flip the deletions around to happen in reverse order. Things may not
-        // stay in the lane we put them in when we add later things.
-        reverse(haplotype_deletions.begin(), haplotype_deletions.end());
-    }
+    insert_lanes(c.insertions, to_return.deletions);
     
     return to_return;
 }
 
 DeleteHaplotypeCommand GenomeState::insert_haplotype(const InsertHaplotypeCommand& c) {
     DeleteHaplotypeCommand to_return;
-    
-    for (auto& kv : c.insertions) {
-        // We can handle each snarl independently.
-        // TODO: do this in parallel?
-        auto& snarl = kv.first;
-        auto& haplotypes = kv.second;
-        
+    insert_lanes(c.insertions, to_return.deletions);
+    return to_return;
+}
+
+InsertHaplotypeCommand GenomeState::delete_haplotype(const DeleteHaplotypeCommand& c) {
+    InsertHaplotypeCommand to_return;
+    delete_lanes(c.deletions, to_return.insertions);
+    return to_return;
+}
+
+void GenomeState::insert_lanes(const unordered_map<const Snarl*, vector<vector<pair<handle_t, size_t>>>>& insertions,
+    unordered_map<const Snarl*, vector<size_t>>& deletions_out) {
+    
+    // We can handle each snarl independently, since each SnarlState only
+    // touches its own lanes. Make all the output slots up front so the threads
+    // never modify the maps themselves.
+    vector<pair<const Snarl*, const vector<vector<pair<handle_t, size_t>>>*>> jobs;
+    vector<vector<size_t>*> outputs;
+    jobs.reserve(insertions.size());
+    outputs.reserve(insertions.size());
+    for (auto& kv : insertions) {
+        jobs.emplace_back(kv.first, &kv.second);
         // Find where to log the deletions we need to do
-        auto& haplotype_deletions = to_return.deletions[snarl];
-        
-        for (auto& haplotype : haplotypes) {
-            // For each haplotype we want to add to this snarl, in order...
+        outputs.push_back(&deletions_out[kv.first]);
+    }
+    
+    // Exceptions can't leave an OpenMP section, so carry them out.
+    exception_ptr error;
+    
+#pragma omp parallel for schedule(dynamic, 1) if(jobs.size() >= parallel_snarl_threshold)
+    for (size_t i = 0; i < jobs.size(); i++) {
+        try {
+            auto& snarl_state = state.at(jobs[i].first);
+            auto& haplotype_deletions = *outputs[i];
             
-            // Insert the haplotype
-            state.at(snarl).insert(haplotype);  
+            for (auto& haplotype : *jobs[i].second) {
+                // For each haplotype we want to add to this snarl, in order...
+                
+                // Insert the haplotype
+                snarl_state.insert(haplotype);
+                
+                // Save the deletion to do by logging the overall lane used.
+                haplotype_deletions.emplace_back(haplotype.front().second);
+            }
             
-            // Save the deletion to do by logging the overall lane used.
-            haplotype_deletions.emplace_back(haplotype.front().second); 
+            // Flip the deletions around to happen in reverse order. Things may not
+            // stay in the lane we put them in when we add later things.
+            reverse(haplotype_deletions.begin(), haplotype_deletions.end());
+        } catch (...) {
+#pragma omp critical (genome_state_error)
+            error = current_exception();
         }
-        
-        // Flip the deletions around to happen in reverse order. Things may not
-        // stay in the lane we put them in when we add later things.
-        reverse(haplotype_deletions.begin(), haplotype_deletions.end());
     }
     
-    return to_return;
+    if (error) {
+        rethrow_exception(error);
+    }
 }
 
-InsertHaplotypeCommand GenomeState::delete_haplotype(const DeleteHaplotypeCommand& c) {
-    InsertHaplotypeCommand to_return;
+void GenomeState::delete_lanes(const unordered_map<const Snarl*, vector<size_t>>& deletions,
+    unordered_map<const Snarl*, vector<vector<pair<handle_t, size_t>>>>& insertions_out) {
+    
+    // Like insert_lanes, every snarl is independent.
+    vector<pair<const Snarl*, const vector<size_t>*>> jobs;
+    vector<vector<vector<pair<handle_t, size_t>>>*> outputs;
+    jobs.reserve(deletions.size());
+    outputs.reserve(deletions.size());
+    for (auto& kv : deletions) {
+        jobs.emplace_back(kv.first, &kv.second);
+        // Find where to log the insertions we need to do
+        outputs.push_back(&insertions_out[kv.first]);
+    }
     
-    for (auto& kv : c.deletions) {
-        // We can handle each snarl independently.
-        // TODO: do this in parallel?
-        auto& snarl = kv.first;
-        auto& overall_lanes = kv.second;
-        
-        // Find where to log the deletions we need to do
-        auto& haplotype_insertions = to_return.insertions[snarl];
-        
-        for (auto& overall_lane : overall_lanes) {
-            // For each haplotype we want to remove from this snarl, in order...
+    exception_ptr error;
+    
+#pragma omp parallel for schedule(dynamic, 1) if(jobs.size() >= parallel_snarl_threshold)
+    for (size_t i = 0; i < jobs.size(); i++) {
+        try {
+            auto& snarl_state = state.at(jobs[i].first);
+            auto& haplotype_insertions = *outputs[i];
             
+            for (auto& overall_lane : *jobs[i].second) {
+                // For each haplotype we want to remove from this snarl, in order...
+                
 #ifdef debug
-            cerr << "Delete " << overall_lane << " from " << kv.first->start() << " -> " << kv.first->end() << endl;
+#pragma omp critical (cerr)
+                cerr << "Delete " << overall_lane << " from " << jobs[i].first->start() << " -> " << jobs[i].first->end() << endl;
 #endif
+                
+                // Remove the haplotype and save a copy, with all its tagged
+                // lane assignments, as the insertion to undo it.
+                haplotype_insertions.emplace_back(snarl_state.erase(overall_lane));
+            }
             
-            // Remove the haplotype and save a copy
-            auto removed = state.at(snarl).erase(overall_lane);  
-            
-            // Save the insertion to do by logging the haplotype with all its
-            // tagged lane assignments.
-            haplotype_insertions.emplace_back(removed); 
+            // Flip the insertions around to happen in reverse order. Things need to
+            // get to the lanes we deleted them from.
+            reverse(haplotype_insertions.begin(), haplotype_insertions.end());
+        } catch (...) {
+#pragma omp critical (genome_state_error)
+            error = current_exception();
         }
-        
-        // Flip the insertions around to happen in reverse order. Things need to
-        // get to the lanes we deleted them from.
-        reverse(haplotype_insertions.begin(), haplotype_insertions.end());
     }
     
-    return to_return;
+    if (error) {
+        rethrow_exception(error);
+    }
 }
 
 SwapHaplotypesCommand GenomeState::swap_haplotypes(const SwapHaplotypesCommand& c) {
@@ -278,6 +278,11 @@ public:
     /// Count the number of haplotypes within a given snarl
     size_t count_haplotypes(const Snarl* snarl) const;
     
+    /// Commands that touch at least this many snarls apply their per-snarl
+    /// insertions and deletions in parallel. Each snarl's state is
+    /// independent, so this doesn't change the result.
+    size_t parallel_snarl_threshold = 64;
+    
     /// Trace the haplotype starting at the given start telomere snarl with the
     /// given overall lane. Calls the callback with each backing HandleGraph
     /// handle.
@@ -314,6 +319,16 @@ protected:
     void insert_handles(const vector<handle_t>& to_add,
         unordered_map<const Snarl*, vector<size_t>>& lanes_added,
         size_t top_lane = numeric_limits<size_t>::max());
+    
+    /// Insert the given lane-annotated haplotypes into each snarl, in order,
+    /// and log the overall lanes to delete to undo it.
+    void insert_lanes(const unordered_map<const Snarl*, vector<vector<pair<handle_t, size_t>>>>& insertions,
+        unordered_map<const Snarl*, vector<size_t>>& deletions_out);
+        
+    /// Delete the given overall lanes from each snarl, in order, and log the
+    /// lane-annotated haplotypes to insert to undo it.
+    void delete_lanes(const unordered_map<const Snarl*, vector<size_t>>& deletions,
+        unordered_map<const Snarl*, vector<vector<pair<handle_t, size_t>>>>& insertions_out);
 
 };
 
@@ -298,28 +298,114 @@ void SupportAugmentedGraph::clear() {
     *this = SupportAugmentedGraph();
 }
 
+SupportAugmentedGraph::PackedSupport::PackedSupport(const Support& support) :
+    quality(support.quality()), forward(support.forward()), reverse(support.reverse()),
+    left(support.left()), right(support.right()) {
+    // Nothing to do
+}
+
+Support SupportAugmentedGraph::PackedSupport::unpack() const {
+    Support support;
+    support.set_quality(quality);
+    support.set_forward(forward);
+    support.set_reverse(reverse);
+    support.set_left(left);
+    support.set_right(right);
+    return support;
+}
+
+size_t SupportAugmentedGraph::node_support_slot(id_t id) {
+    if (node_supports.empty()) {
+        first_supported_id = id;
+    } else if (id < first_supported_id) {
+        // Grow down to fit the new ID
+        size_t shift = first_supported_id - id;
+        node_supports.insert(node_supports.begin(), shift, PackedSupport());
+        node_has_support.insert(node_has_support.begin(), shift, false);
+        first_supported_id = id;
+    }
+    size_t slot = id - first_supported_id;
+    if (slot >= node_supports.size()) {
+        node_supports.resize(slot + 1);
+        node_has_support.resize(slot + 1, false);
+    }
+    return slot;
+}
+
+void SupportAugmentedGraph::reserve_node_supports() {
+    if (graph.size() > 0) {
+        // Make the slots for the ends of the ID range, and so everything in between
+        node_support_slot(graph.min_node_id());
+        node_support_slot(graph.max_node_id());
+    }
+}
+
+void SupportAugmentedGraph::set_node_support(id_t id, const Support& support) {
+    size_t slot = node_support_slot(id);
+    if (!node_has_support[slot]) {
+        node_has_support[slot] = true;
+        supported_node_count++;
+    }
+    node_supports[slot] = PackedSupport(support);
+}
+
 bool SupportAugmentedGraph::has_supports() const {
-    return !node_supports.empty() || !edge_supports.empty();
+    return supported_node_count > 0 || !edge_supports.empty();
 }
 
 Support SupportAugmentedGraph::get_support(Node* node) {
-    return node_supports.count(node) ? node_supports.at(node) : Support();
+    return has_support(node) ? node_supports[node->id() - first_supported_id].unpack() : Support();
 }
 
 Support SupportAugmentedGraph::get_support(Edge* edge) {
-    return edge_supports.count(edge) ? edge_supports.at(edge) : Support();
+    if (edge == nullptr) {
+        return Support();
+    }
+    auto found = edge_supports.find(NodeSide::pair_from_edge(edge));
+    return found != edge_supports.end() ? found->second.unpack() : Support();
+}
+
+bool SupportAugmentedGraph::has_support(Node* node) const {
+    if (node == nullptr || node->id() < first_supported_id) {
+        return false;
+    }
+    size_t slot = node->id() - first_supported_id;
+    return slot < node_has_support.size() && node_has_support[slot];
+}
+
+bool SupportAugmentedGraph::has_support(Edge* edge) const {
+    return edge != nullptr && edge_supports.count(NodeSide::pair_from_edge(edge));
+}
+
+void SupportAugmentedGraph::set_support(Node* node, const Support& support) {
+    set_node_support(node->id(), support);
+}
+
+void SupportAugmentedGraph::set_support(Edge* edge, const Support& support) {
+    edge_supports[NodeSide::pair_from_edge(edge)] = PackedSupport(support);
+}
+
+void SupportAugmentedGraph::for_each_node_support(const function<void(Node*, const Support&)>& lambda) {
+    for (size_t slot = 0; slot < node_supports.size(); slot++) {
+        id_t id = first_supported_id + slot;
+        if (node_has_support[slot] && graph.has_node(id)) {
+            lambda(graph.get_node(id), node_supports[slot].unpack());
+        }
+    }
 }
 
 void SupportAugmentedGraph::load_supports(istream& in_file) {
-    node_supports.clear();
+    vector<PackedSupport>().swap(node_supports);
+    vector<bool>().swap(node_has_support);
+    supported_node_count = 0;
     edge_supports.clear();
+    // Supports are mostly for nodes in the graph, so lay out their slots up front
+    reserve_node_supports();
     function<void(LocationSupport&)> lambda = [&](LocationSupport& location_support) {
         if (location_support.oneof_location_case() == LocationSupport::kNodeId) {
-            node_supports[graph.get_node(location_support.node_id())] = location_support.support();
+            set_node_support(location_support.node_id(), location_support.support());
         } else {
-            const Edge& edge = location_support.edge();
-            edge_supports[graph.get_edge(NodeSide(edge.from(), !edge.from_start()),
-                                         NodeSide(edge.to(), edge.to_end()))] = location_support.support();
+            edge_supports[NodeSide::pair_from_edge(location_support.edge())] = PackedSupport(location_support.support());
         }
     };
     stream::for_each(in_file, lambda);    
@@ -327,17 +413,37 @@ void SupportAugmentedGraph::load_supports(istream& in_file) {
 
 void SupportAugmentedGraph::write_supports(ostream& out_file) {
     vector<LocationSupport> buffer;
-    for (auto& node_support : node_supports) {
+    for (size_t slot = 0; slot < node_supports.size(); slot++) {
+        if (!node_has_support[slot]) {
+            continue;
+        }
         LocationSupport location_support;
-        *location_support.mutable_support() = node_support.second;
-        location_support.set_node_id(node_support.first->id());
+        *location_support.mutable_support() = node_supports[slot].unpack();
+        location_support.set_node_id(first_supported_id + slot);
         buffer.push_back(location_support);
         stream::write_buffered(out_file, buffer, 500);
     }
+    // Write the edges in a stable order
+    vector<pair<NodeSide, NodeSide>> edge_sides;
+    edge_sides.reserve(edge_supports.size());
     for (auto& edge_support : edge_supports) {
+        edge_sides.push_back(edge_support.first);
+    }
+    std::sort(edge_sides.begin(), edge_sides.end());
+    for (auto& sides : edge_sides) {
         LocationSupport location_support;
-        *location_support.mutable_support() = edge_support.second;        
-        *location_support.mutable_edge() = *edge_support.first;
+        *location_support.mutable_support() = edge_supports[sides].unpack();
+        Edge* edge = graph.get_edge(sides);
+        if (edge != nullptr) {
+            *location_support.mutable_edge() = *edge;
+        } else {
+            // Describe the edge by the sides it connects
+            Edge* described = location_support.mutable_edge();
+            described->set_from(sides.first.node);
+            described->set_from_start(!sides.first.is_end);
+            described->set_to(sides.second.node);
+            described->set_to_end(sides.second.is_end);
+        }
         buffer.push_back(location_support);
         stream::write_buffered(out_file, buffer, 500);
     }
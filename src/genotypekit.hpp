@@ -259,13 +259,6 @@ protected:
 
 /// Augmented Graph that holds some Support annotation data specific to vg call
 struct SupportAugmentedGraph : public AugmentedGraph {
-        
-    // This holds support info for nodes. Note that we discard the "os" other
-    // support field from StrandSupport.
-    // Supports for nodes are minimum distinct reads that use the node.
-    map<Node*, Support> node_supports;
-    // And for edges
-    map<Edge*, Support> edge_supports;
     
     /**
      * Return true if we have support information, and false otherwise.
@@ -282,6 +275,32 @@ struct SupportAugmentedGraph : public AugmentedGraph {
      */
     virtual Support get_support(Edge* edge);    
     
+    /**
+     * Return true if the given node has recorded support.
+     */
+    bool has_support(Node* node) const;
+    
+    /**
+     * Return true if the given edge has recorded support.
+     */
+    bool has_support(Edge* edge) const;
+    
+    /**
+     * Record the support for a node, replacing any it had.
+     */
+    void set_support(Node* node, const Support& support);
+    
+    /**
+     * Record the support for an edge, replacing any it had.
+     */
+    void set_support(Edge* edge, const Support& support);
+    
+    /**
+     * Call the given function on each node with recorded support, in node ID
+     * order.
+     */
+    void for_each_node_support(const function<void(Node*, const Support&)>& lambda);
+    
     /**
      * Clear the contents.
      */
@@ -297,6 +316,47 @@ struct SupportAugmentedGraph : public AugmentedGraph {
      */
     void write_supports(ostream& out_file);
     
+protected:
+
+    /// A Support without the Protobuf message overhead, so supports can be
+    /// kept in flat arrays.
+    struct PackedSupport {
+        double quality = 0;
+        double forward = 0;
+        double reverse = 0;
+        double left = 0;
+        double right = 0;
+        
+        PackedSupport() = default;
+        PackedSupport(const Support& support);
+        Support unpack() const;
+    };
+    
+    /// Make room for node supports for all the IDs in the graph
+    void reserve_node_supports();
+    
+    /// Get the slot in node_supports for the given node ID, growing the
+    /// array to include it if needed.
+    size_t node_support_slot(id_t id);
+    
+    /// Record the support for the node with the given ID
+    void set_node_support(id_t id, const Support& support);
+    
+    // This holds support info for nodes, indexed by node ID less
+    // first_supported_id. Note that we discard the "os" other support field
+    // from StrandSupport. Supports for nodes are minimum distinct reads that
+    // use the node.
+    vector<PackedSupport> node_supports;
+    // Which slots in node_supports hold a support
+    vector<bool> node_has_support;
+    // The ID of the node whose support is first in node_supports
+    id_t first_supported_id = 0;
+    // How many nodes have a support
+    size_t supported_node_count = 0;
+    
+    // And for edges, by the sides they connect
+    hot_hash_map<pair<NodeSide, NodeSide>, PackedSupport> edge_supports;
+    
 };
 
 
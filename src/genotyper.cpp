@@ -112,11 +112,6 @@ void Genotyper::run(AugmentedGraph& augmented_graph,
     // We're going to count up all the affinities we compute
     size_t total_affinities = 0;
 
-    // We need a buffer for output
-    vector<vector<Locus>> buffer;
-    int thread_count = get_thread_count();
-    buffer.resize(thread_count);
-
     // If we're doing VCF output we need a VCF header
     vcflib::VariantCallFile* vcf = nullptr;
     // And a reference index tracking the primary path
@@ -130,9 +125,29 @@ void Genotyper::run(AugmentedGraph& augmented_graph,
         vcf = start_vcf(cout, *reference_index, sample_name, contig_name, length_override);
     }
 
-    manager.for_each_snarl_parallel([&](const Snarl* snarl) {
-        // For each snarl in parallel
+    // Each top-level snarl, with everything nested in it, is a unit of work.
+    // Put the units in reference order, so their results can be written out
+    // in order as soon as all the units before them are done.
+    vector<const Snarl*> units = manager.top_level_snarls();
+    if(reference_index != nullptr) {
+        vector<pair<int64_t, const Snarl*>> units_by_start;
+        for(const Snarl* unit : units) {
+            int64_t unit_start = get_snarl_reference_bounds(unit, *reference_index, &graph).first.first;
+            // Snarls off the reference won't make variants; do them last.
+            units_by_start.emplace_back(unit_start == -1 ? numeric_limits<int64_t>::max() : unit_start, unit);
+        }
+        stable_sort(units_by_start.begin(), units_by_start.end(),
+            [](const pair<int64_t, const Snarl*>& a, const pair<int64_t, const Snarl*>& b) {
+                return a.first < b.first;
+            });
+        for(size_t i = 0; i < units.size(); i++) {
+            units[i] = units_by_start[i].second;
+        }
+    }
 
+    // Genotype one snarl, adding its variants (for VCF output) or its locus
+    // (otherwise) to the given vectors.
+    auto genotype_one = [&](const Snarl* snarl, vector<vcflib::Variant>& variants_out, vector<Locus>& loci_out) {
         if (snarl->type() != ULTRABUBBLE) {
             // We only work on ultrabubbles right now
             return;
@@ -152,15 +167,13 @@ void Genotyper::run(AugmentedGraph& augmented_graph,
         if ((use_traversal_alg != TraversalAlg::Reads && !manager.is_leaf(snarl)) ||
             (use_traversal_alg == TraversalAlg::Reads && !manager.is_root(snarl))) {
             // Todo : support nesting hierarchy!
-            
+        
             return;
         }
-        
+    
         // Report the snarl to our statistics code
         report_snarl(snarl, manager, reference_index, graph, reference_index);
 
-        int tid = omp_get_thread_num();
-
         // Get the traverals
         vector<SnarlTraversal> paths = get_snarl_traversals(augmented_graph, manager, reads_by_name,
                                                             snarl, snarl_contents, reference_index,
@@ -212,7 +225,7 @@ void Genotyper::run(AugmentedGraph& augmented_graph,
                 total_affinities += alignment_and_affinities.second.size();
             }
         }
-        
+    
         // Get a genotyped locus in the original frame
         Locus genotyped = genotype_snarl(graph, snarl, paths, affinities);
 
@@ -232,8 +245,7 @@ void Genotyper::run(AugmentedGraph& augmented_graph,
                 }
                 variant.position += variant_offset;
 
-#pragma omp critical(cout)
-                cout << variant << endl;
+                variants_out.push_back(variant);
             }
         } else {
             // project into original graph (only need to do if we augmented with edit)
@@ -251,24 +263,70 @@ void Genotyper::run(AugmentedGraph& augmented_graph,
                                    .position());
             }
             genotyped.set_name(name.str());
-            if (output_json) {
-                // Dump in JSON
-#pragma omp critical (cout)
-                cout << pb2json(genotyped) << endl;
-            } else {
-                // Write out in Protobuf
-                buffer[tid].push_back(genotyped);
-                stream::write_buffered(cout, buffer[tid], 100);
+            loci_out.push_back(genotyped);
+        }
+    };
+
+    // Results of finished units, waiting for the units before them.
+    struct UnitOutput {
+        vector<vcflib::Variant> variants;
+        vector<Locus> loci;
+    };
+    map<size_t, UnitOutput> finished_units;
+    // The next unit to write out
+    size_t next_unit = 0;
+    // We need a buffer for Protobuf output
+    vector<Locus> buffer;
+
+#pragma omp parallel for schedule(dynamic, 1)
+    for(size_t i = 0; i < units.size(); i++) {
+        UnitOutput output;
+
+        // Genotype the whole snarl tree of the unit, parents first
+        function<void(const Snarl*)> genotype_tree = [&](const Snarl* snarl) {
+            genotype_one(snarl, output.variants, output.loci);
+            for(const Snarl* child : manager.children_of(snarl)) {
+                genotype_tree(child);
+            }
+        };
+        genotype_tree(units[i]);
+
+        // Nested snarls can come out of order within the unit
+        stable_sort(output.variants.begin(), output.variants.end(),
+            [](const vcflib::Variant& a, const vcflib::Variant& b) {
+                return a.position < b.position;
+            });
+
+#pragma omp critical (genotyper_output)
+        {
+            finished_units.emplace(i, std::move(output));
+
+            // Write out everything that now has nothing unfinished before it
+            while(!finished_units.empty() && finished_units.begin()->first == next_unit) {
+                UnitOutput& ready = finished_units.begin()->second;
+                for(auto& variant : ready.variants) {
+                    cout << variant << endl;
+                }
+                for(auto& locus : ready.loci) {
+                    if(output_json) {
+                        // Dump in JSON
+                        cout << pb2json(locus) << endl;
+                    } else {
+                        // Write out in Protobuf
+                        buffer.push_back(locus);
+                        stream::write_buffered(cout, buffer, 100);
+                    }
+                }
+                finished_units.erase(finished_units.begin());
+                next_unit++;
             }
         }
-    });
+    }
 
     if(!output_json && !output_vcf) {
-        // Flush the protobuf output buffers
-        for(int i = 0; i < buffer.size(); i++) {
-            stream::write_buffered(cout, buffer[i], 0);
-        }
-    } 
+        // Flush the protobuf output buffer
+        stream::write_buffered(cout, buffer, 0);
+    }
 
 
     if(show_progress) {
@@ -761,6 +819,10 @@ map<const Alignment*, vector<Genotyper::Affinity>>
         // read.
         auto path_seq = traversal_to_string(aug.graph, path);
 
+        // Reads with the same bases and qualities realign to this allele the
+        // same way, so only realign each distinct piece of evidence once.
+        unordered_map<pair<string, string>, Affinity> affinity_by_evidence;
+
         for(auto& name : relevant_read_names) {
             // For every read that touched the ultrabubble, grab its original
             // Alignment pointer.
@@ -801,6 +863,15 @@ map<const Alignment*, vector<Genotyper::Affinity>>
             }
 
             // If we get here, we know this read is informative as to the internal status of this ultrabubble.
+            
+            auto evidence = make_pair(read->sequence(), read->quality());
+            auto memoized = affinity_by_evidence.find(evidence);
+            if(memoized != affinity_by_evidence.end()) {
+                // We already scored an identical read against this allele
+                to_return[read].push_back(memoized->second);
+                continue;
+            }
+            
             Alignment aligned_fwd;
             Alignment aligned_rev;
             // We need a way to get graph node sizes to reverse these alignments
@@ -906,6 +977,7 @@ map<const Alignment*, vector<Genotyper::Affinity>>
 
             // Grab the identity and save it for this read and ultrabubble path
             to_return[read].push_back(affinity);
+            affinity_by_evidence.emplace(std::move(evidence), affinity);
 
         }
     }
@@ -986,6 +1058,11 @@ Genotyper::get_affinities_fast(AugmentedGraph& aug,
         allele_strings.push_back(traversal_to_string(aug.graph, path));
     }
 
+    // Reads that take the same walk through the snarl in the same
+    // orientation get the same affinities, so only work them out once per
+    // distinct walk.
+    map<pair<vector<pair<id_t, bool>>, bool>, vector<Affinity>> affinities_by_walk;
+
     for(Node* node : contents.first) {
         // For every node in the ultrabubble, what reads visit it?
         for (const Alignment* aln : aug.get_alignments(node->id())) {
@@ -1036,6 +1113,21 @@ Genotyper::get_affinities_fast(AugmentedGraph& aug,
             continue;
         }
 
+        pair<vector<pair<id_t, bool>>, bool> walk;
+        for (size_t i = 0; i < read_traversal.visit_size(); i++) {
+            walk.first.emplace_back(read_traversal.visit(i).node_id(), read_traversal.visit(i).backward());
+        }
+        walk.second = base_affinity.is_reverse;
+        
+        auto memoized = affinities_by_walk.find(walk);
+        if(memoized != affinities_by_walk.end()) {
+            // We already worked out the affinities for this walk
+            to_return[reads_by_name.at(name)] = memoized->second;
+            continue;
+        }
+        // Otherwise we fill this in for the first read with this walk
+        vector<Affinity>& walk_affinities = affinities_by_walk[walk];
+
         size_t total_supported = 0;
 
         // Get the string it spells out
@@ -1084,6 +1176,7 @@ Genotyper::get_affinities_fast(AugmentedGraph& aug,
             // Fake a weight
             affinity.affinity = (double)affinity.consistent;
             to_return[reads_by_name.at(name)].push_back(affinity);
+            walk_affinities.push_back(affinity);
 
             // Add in to the total if it supports this
             total_supported += affinity.consistent;
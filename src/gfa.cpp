@@ -1074,6 +1074,370 @@ bool gfa_to_graph(istream& in, VG* graph, bool only_perfect_match) {
     
 }
 
+/// A GFA line parsed on its own, before its names are translated to IDs.
+struct GFAStreamRecord {
+    /// 'S', 'L', or 'P', or 0 for lines that don't affect the graph
+    char type = 0;
+    /// The segment name of an S line, or the path name of a P line
+    string name;
+    /// The sequence of an S line
+    string sequence;
+    /// The ends of an L line
+    string from;
+    string to;
+    bool from_start = false;
+    bool to_end = false;
+    /// The segment names and orientations visited by a P line
+    vector<pair<string, bool>> steps;
+    /// The rank of the single step of an old-style (GFA 0.1) P line, or 0
+    int64_t rank = 0;
+    /// Set if the line has an overlap or containment we can't import
+    bool overlapping = false;
+    /// Describes what is wrong with the line, if anything
+    string error;
+};
+
+/// Split a GFA line on tabs, keeping empty fields. Unlike split_delims(),
+/// this is safe to run on many threads at once.
+static void split_gfa_fields(const string& line, vector<string>& fields) {
+    fields.clear();
+    size_t start = 0;
+    while (true) {
+        size_t tab = line.find('\t', start);
+        fields.push_back(line.substr(start, tab == string::npos ? string::npos : tab - start));
+        if (tab == string::npos) {
+            break;
+        }
+        start = tab + 1;
+    }
+}
+
+/// Does this CIGAR string describe no overlap at all?
+static bool gfa_overlap_is_blunt(const string& cigar) {
+    if (cigar.empty() || cigar == "*") {
+        return true;
+    }
+    for (char c : cigar) {
+        if (isdigit(c) && c != '0') {
+            return false;
+        }
+    }
+    return true;
+}
+
+/// Parse an orientation field, returning true for reverse. Sets the error
+/// in the record if it isn't + or -.
+static bool parse_gfa_orientation(const string& field, GFAStreamRecord& record) {
+    if (field != "+" && field != "-") {
+        record.error = "invalid orientation \"" + field + "\"";
+    }
+    return field == "-";
+}
+
+static void parse_gfa_stream_line(const string& line, GFAStreamRecord& record) {
+    if (line.empty()) {
+        return;
+    }
+    vector<string> fields;
+    switch (line[0]) {
+    case 'S':
+        split_gfa_fields(line, fields);
+        if (fields.size() < 3) {
+            record.error = "S line has too few fields";
+            return;
+        }
+        if (fields[2] == "*") {
+            record.error = "S line has no sequence";
+            return;
+        }
+        record.type = 'S';
+        record.name = move(fields[1]);
+        record.sequence = move(fields[2]);
+        break;
+    case 'L':
+        split_gfa_fields(line, fields);
+        if (fields.size() < 5) {
+            record.error = "L line has too few fields";
+            return;
+        }
+        record.type = 'L';
+        record.from = move(fields[1]);
+        record.from_start = parse_gfa_orientation(fields[2], record);
+        record.to = move(fields[3]);
+        record.to_end = parse_gfa_orientation(fields[4], record);
+        record.overlapping = fields.size() > 5 && !gfa_overlap_is_blunt(fields[5]);
+        break;
+    case 'C':
+        // Containments always overlap
+        record.overlapping = true;
+        break;
+    case 'P':
+        split_gfa_fields(line, fields);
+        if (fields.size() < 3) {
+            record.error = "P line has too few fields";
+            return;
+        }
+        record.type = 'P';
+        if (fields.size() >= 5 && is_number(fields[3]) && (fields[4] == "+" || fields[4] == "-")) {
+            // An old-style line for one step of a path
+            record.name = move(fields[2]);
+            record.rank = stol(fields[3]);
+            if (record.rank <= 0) {
+                record.error = "P line has a nonpositive rank";
+                return;
+            }
+            record.steps.emplace_back(move(fields[1]), fields[4] == "-");
+        } else {
+            record.name = move(fields[1]);
+        }
+        if (record.rank == 0 && fields[2] != "*" && !fields[2].empty()) {
+            size_t start = 0;
+            while (start <= fields[2].size()) {
+                size_t comma = fields[2].find(',', start);
+                size_t end = (comma == string::npos) ? fields[2].size() : comma;
+                if (end - start < 2) {
+                    record.error = "P line has an empty step";
+                    return;
+                }
+                char orientation = fields[2][end - 1];
+                if (orientation != '+' && orientation != '-') {
+                    record.error = "P line step has no orientation";
+                    return;
+                }
+                record.steps.emplace_back(fields[2].substr(start, end - 1 - start), orientation == '-');
+                start = end + 1;
+            }
+        }
+        break;
+    default:
+        // Headers, comments, and anything else we don't use
+        break;
+    }
+}
+
+bool gfa_to_graph_chunks(istream& in, const function<void(Graph&)>& chunk_callback, size_t chunk_size) {
+    
+    // Numeric names become their own IDs where possible
+    GFAToPinchTranslator gfa_to_id;
+    
+    // The segments, with all their sequences packed into one string
+    vector<id_t> ids;
+    vector<size_t> sequence_starts{0};
+    string sequences;
+    unordered_map<id_t, size_t> id_to_index;
+    
+    // The links, as from, from_start, to, to_end
+    vector<tuple<id_t, bool, id_t, bool>> edges;
+    
+    // And the paths, with the ranks of their steps if they came from
+    // old-style P lines
+    vector<string> path_names;
+    vector<vector<pair<id_t, bool>>> path_steps;
+    vector<vector<int64_t>> path_ranks;
+    unordered_map<string, size_t> path_index;
+    
+    // Parse batches of lines in parallel and then file them in order
+    const size_t batch_lines = 16384;
+    vector<string> lines;
+    vector<GFAStreamRecord> records;
+    size_t line_number = 0;
+    bool more = true;
+    while (more) {
+        lines.clear();
+        string line;
+        while (lines.size() < batch_lines) {
+            if (!getline(in, line)) {
+                more = false;
+                break;
+            }
+            lines.push_back(move(line));
+        }
+        records.clear();
+        records.resize(lines.size());
+#pragma omp parallel for schedule(dynamic, 256)
+        for (size_t i = 0; i < lines.size(); i++) {
+            parse_gfa_stream_line(lines[i], records[i]);
+        }
+        
+        for (auto& record : records) {
+            line_number++;
+            if (!record.error.empty()) {
+                cerr << "error:[gfa_to_graph_chunks]: GFA line " << line_number << ": " << record.error << endl;
+                return false;
+            }
+            if (record.overlapping) {
+                throw GFAOverlapError("GFA line " + to_string(line_number) + " has an overlap or containment");
+            }
+            if (record.type == 'S') {
+                id_t id = gfa_to_id.translate(record.name);
+                if (!id_to_index.emplace(id, ids.size()).second) {
+                    cerr << "error:[gfa_to_graph_chunks]: GFA line " << line_number << ": duplicate segment "
+                         << record.name << endl;
+                    return false;
+                }
+                ids.push_back(id);
+                sequences.append(record.sequence);
+                sequence_starts.push_back(sequences.size());
+            } else if (record.type == 'L') {
+                edges.emplace_back(gfa_to_id.translate(record.from), record.from_start,
+                                   gfa_to_id.translate(record.to), record.to_end);
+            } else if (record.type == 'P') {
+                auto found = path_index.find(record.name);
+                if (found != path_index.end() && (record.rank == 0 || path_ranks[found->second].empty())) {
+                    cerr << "error:[gfa_to_graph_chunks]: GFA line " << line_number << ": duplicate path "
+                         << record.name << endl;
+                    return false;
+                }
+                if (found == path_index.end()) {
+                    found = path_index.emplace(record.name, path_names.size()).first;
+                    path_names.push_back(record.name);
+                    path_steps.emplace_back();
+                    path_ranks.emplace_back();
+                    path_steps.back().reserve(record.steps.size());
+                }
+                for (auto& step : record.steps) {
+                    path_steps[found->second].emplace_back(gfa_to_id.translate(step.first), step.second);
+                }
+                if (record.rank != 0) {
+                    path_ranks[found->second].push_back(record.rank);
+                }
+            }
+        }
+    }
+    lines.clear();
+    records.clear();
+    
+    // Put the steps of old-style paths in rank order
+    for (size_t i = 0; i < path_steps.size(); i++) {
+        if (path_ranks[i].empty()) {
+            continue;
+        }
+        vector<size_t> order(path_steps[i].size());
+        for (size_t j = 0; j < order.size(); j++) {
+            order[j] = j;
+        }
+        auto& ranks = path_ranks[i];
+        stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+            return ranks[a] < ranks[b];
+        });
+        vector<pair<id_t, bool>> sorted_steps;
+        sorted_steps.reserve(order.size());
+        for (size_t j : order) {
+            sorted_steps.push_back(path_steps[i][j]);
+        }
+        path_steps[i] = move(sorted_steps);
+        vector<int64_t>().swap(ranks);
+    }
+    
+    // Drop links and paths that mention segments that aren't there, as the
+    // full importer does
+    auto dangling = [&](id_t id) {
+        return !id_to_index.count(id);
+    };
+    size_t kept_edges = 0;
+    for (auto& edge : edges) {
+        if (dangling(get<0>(edge)) || dangling(get<2>(edge))) {
+            cerr << "warning [gfa_to_graph_chunks]: dropping link from " << gfa_to_id.untranslate(get<0>(edge))
+                 << " to " << gfa_to_id.untranslate(get<2>(edge)) << " because it mentions a missing segment" << endl;
+        } else {
+            edges[kept_edges++] = edge;
+        }
+    }
+    edges.resize(kept_edges);
+    for (size_t i = 0; i < path_steps.size(); i++) {
+        for (auto& step : path_steps[i]) {
+            if (dangling(step.first)) {
+                cerr << "warning [gfa_to_graph_chunks]: dropping path " << path_names[i] << " because it visits missing segment "
+                     << gfa_to_id.untranslate(step.first) << endl;
+                path_steps[i].clear();
+                path_names[i].clear();
+                break;
+            }
+        }
+    }
+    
+    // A link and its reverse complement are the same edge
+    for (auto& edge : edges) {
+        tuple<id_t, bool, id_t, bool> flipped(get<2>(edge), !get<3>(edge), get<0>(edge), !get<1>(edge));
+        if (flipped < edge) {
+            edge = flipped;
+        }
+    }
+    sort(edges.begin(), edges.end());
+    edges.erase(unique(edges.begin(), edges.end()), edges.end());
+    
+    auto node_length = [&](id_t id) {
+        size_t index = id_to_index.at(id);
+        return sequence_starts[index + 1] - sequence_starts[index];
+    };
+    
+    Graph chunk;
+    auto ship = [&]() {
+        chunk_callback(chunk);
+        chunk.Clear();
+    };
+    
+    for (size_t i = 0; i < ids.size(); i++) {
+        Node* node = chunk.add_node();
+        node->set_id(ids[i]);
+        node->set_sequence(sequences.substr(sequence_starts[i], sequence_starts[i + 1] - sequence_starts[i]));
+        if (chunk.node_size() >= chunk_size) {
+            ship();
+        }
+    }
+    if (chunk.node_size()) {
+        ship();
+    }
+    // We don't need the sequences any more
+    string().swap(sequences);
+    
+    for (auto& edge : edges) {
+        Edge* e = chunk.add_edge();
+        e->set_from(get<0>(edge));
+        e->set_from_start(get<1>(edge));
+        e->set_to(get<2>(edge));
+        e->set_to_end(get<3>(edge));
+        if (chunk.edge_size() >= chunk_size) {
+            ship();
+        }
+    }
+    if (chunk.edge_size()) {
+        ship();
+    }
+    
+    size_t chunk_mappings = 0;
+    for (size_t i = 0; i < path_steps.size(); i++) {
+        if (path_names[i].empty()) {
+            // This path was dropped
+            continue;
+        }
+        Path* path = chunk.add_path();
+        path->set_name(path_names[i]);
+        for (size_t j = 0; j < path_steps[i].size(); j++) {
+            if (chunk_mappings >= chunk_size) {
+                ship();
+                chunk_mappings = 0;
+                path = chunk.add_path();
+                path->set_name(path_names[i]);
+            }
+            chunk_mappings++;
+            Mapping* mapping = path->add_mapping();
+            mapping->mutable_position()->set_node_id(path_steps[i][j].first);
+            mapping->mutable_position()->set_is_reverse(path_steps[i][j].second);
+            size_t length = node_length(path_steps[i][j].first);
+            Edit* edit = mapping->add_edit();
+            edit->set_from_length(length);
+            edit->set_to_length(length);
+            mapping->set_rank(j + 1);
+        }
+    }
+    if (chunk.path_size()) {
+        ship();
+    }
+    
+    return true;
+}
+
 void graph_to_gfa(const VG* graph, ostream& out) {
   GFAKluge gg;
   gg.set_version(1.0);
@@ -1131,4 +1495,82 @@ void graph_to_gfa(const VG* graph, ostream& out) {
     //gg.output_to_stream(cout);
 }
 
+
+/// Format lines for each range of chunk_nodes node ranks of the graph in
+/// parallel, and write them to the stream in rank order, holding at most a
+/// batch of ranges per thread in memory.
+static void write_rank_ranges_ordered(const xg::XG& graph, ostream& out, size_t chunk_nodes,
+                                      const function<void(size_t, size_t, string&)>& format_ranks) {
+    chunk_nodes = max<size_t>(chunk_nodes, 1);
+    size_t range_count = (graph.node_count + chunk_nodes - 1) / chunk_nodes;
+    size_t batch_ranges = 4 * get_thread_count();
+    vector<string> buffers(batch_ranges);
+    for (size_t batch_start = 0; batch_start < range_count; batch_start += batch_ranges) {
+        size_t batch_end = min(range_count, batch_start + batch_ranges);
+#pragma omp parallel for schedule(dynamic, 1)
+        for (size_t range = batch_start; range < batch_end; range++) {
+            string& buffer = buffers[range - batch_start];
+            buffer.clear();
+            // Ranks are 1-based
+            size_t first_rank = range * chunk_nodes + 1;
+            format_ranks(first_rank, min(graph.node_count + 1, first_rank + chunk_nodes), buffer);
+        }
+        for (size_t range = batch_start; range < batch_end; range++) {
+            out << buffers[range - batch_start];
+        }
+    }
+}
+
+void graph_to_gfa(const xg::XG& graph, ostream& out, size_t chunk_nodes) {
+    out << "H\tVN:Z:1.0" << endl;
+    
+    write_rank_ranges_ordered(graph, out, chunk_nodes, [&](size_t first_rank, size_t past_rank, string& buffer) {
+        for (size_t rank = first_rank; rank < past_rank; rank++) {
+            id_t id = graph.rank_to_id(rank);
+            buffer += "S\t" + to_string(id) + "\t" + graph.get_sequence(graph.get_handle(id, false)) + "\n";
+        }
+    });
+    
+    // Each path is written as we walk it, so no path is ever held in memory
+    for (size_t path_rank = 1; path_rank <= graph.max_path_rank(); path_rank++) {
+        string name = graph.path_name(path_rank);
+        const xg::XGPath& path = graph.get_path(name);
+        size_t steps = path.ids.size();
+        out << "P\t" << name << "\t";
+        if (steps == 0) {
+            out << "*";
+        }
+        for (size_t i = 0; i < steps; i++) {
+            out << (i ? "," : "") << path.node(i) << (path.is_reverse(i) ? "-" : "+");
+        }
+        out << "\t";
+        if (steps == 0) {
+            out << "*";
+        }
+        for (size_t i = 0; i < steps; i++) {
+            out << (i ? "," : "") << graph.get_length(graph.get_handle(path.node(i), false)) << "M";
+        }
+        out << "\n";
+    }
+    
+    write_rank_ranges_ordered(graph, out, chunk_nodes, [&](size_t first_rank, size_t past_rank, string& buffer) {
+        for (size_t rank = first_rank; rank < past_rank; rank++) {
+            handle_t forward = graph.get_handle(graph.rank_to_id(rank), false);
+            for (handle_t from : {forward, graph.flip(forward)}) {
+                graph.follow_edges(from, false, [&](const handle_t& to) {
+                    // Every edge is seen from both of its ends, except a
+                    // reversing self loop, so only write it out from the end
+                    // that reads it in canonical order
+                    edge_t edge = graph.edge_handle(from, to);
+                    if (edge.first == from && edge.second == to) {
+                        buffer += "L\t" + to_string(graph.get_id(from)) + (graph.get_is_reverse(from) ? "\t-\t" : "\t+\t")
+                            + to_string(graph.get_id(to)) + (graph.get_is_reverse(to) ? "\t-\t" : "\t+\t") + "0M\n";
+                    }
+                    return true;
+                });
+            }
+        }
+    });
+}
+
 }
@@ -12,6 +12,7 @@
  */
 
 #include "vg.hpp"
+#include "xg.hpp"
 
 namespace vg {
 
@@ -33,9 +34,42 @@ using namespace std;
  */
 bool gfa_to_graph(istream& in, VG* graph, bool only_perfect_match = false);
 
+/**
+ * Thrown by gfa_to_graph_chunks() when the GFA has links with overlaps or
+ * containments, which only gfa_to_graph() can resolve. Nothing has been sent
+ * to the callback when it is thrown.
+ */
+class GFAOverlapError : public runtime_error {
+public:
+    using runtime_error::runtime_error;
+};
+
+/**
+ * Import a GFA file whose links are all blunt (no overlap, or an all-zero
+ * CIGAR) without building a VG, by passing the graph to the callback in
+ * chunks of at most chunk_size nodes, edges, or path mappings. Lines are
+ * parsed in parallel batches, and the graph is held in flat arrays until it
+ * is emitted, so memory use is close to the size of the sequences. Names are
+ * translated to IDs the same way gfa_to_graph() does it.
+ *
+ * All the node chunks are sent first, then the edge chunks, then the path
+ * chunks, with path mappings ranked along their paths. Links and paths that
+ * mention missing segments are dropped with a warning.
+ *
+ * Returns true if the import was successful, and false if the GFA file is
+ * invalid. Throws a GFAOverlapError if the file needs gfa_to_graph().
+ */
+bool gfa_to_graph_chunks(istream& in, const function<void(Graph&)>& chunk_callback, size_t chunk_size = 1000);
+
 /// Export the given VG graph to the given GFA file.
 void graph_to_gfa(const VG* graph, ostream& out);
 
+/// Export the given XG graph to the given GFA file, with the same layout as
+/// the VG export, without building a VG. S and L lines are formatted in
+/// parallel over ranges of chunk_nodes node ranks and written in rank order,
+/// and P lines are written straight from the XG paths as they are walked.
+void graph_to_gfa(const xg::XG& graph, ostream& out, size_t chunk_nodes = 10000);
+
 
 }
 
@@ -89,4 +89,19 @@ void flip_doubly_reversed_edges(Graph& graph) {
     }
 }
 
+void translate_ids(Graph& graph, const function<id_t(id_t)>& translate) {
+    for (auto& node : *graph.mutable_node()) {
+        node.set_id(translate(node.id()));
+    }
+    for (auto& edge : *graph.mutable_edge()) {
+        edge.set_from(translate(edge.from()));
+        edge.set_to(translate(edge.to()));
+    }
+    for (auto& path : *graph.mutable_path()) {
+        for (auto& mapping : *path.mutable_mapping()) {
+            mapping.mutable_position()->set_node_id(translate(mapping.position().node_id()));
+        }
+    }
+}
+
 }
@@ -5,6 +5,7 @@
 #include "types.hpp"
 #include <set>
 #include <algorithm>
+#include <functional>
 
 namespace vg {
 
@@ -43,6 +44,9 @@ bool has_inversion(const Graph& graph);
 /// clean up doubly-reversed edges
 void flip_doubly_reversed_edges(Graph& graph);
 
+/// give every node ID in the graph's nodes, edges, and path mappings a new value
+void translate_ids(Graph& graph, const function<id_t(id_t)>& translate);
+
 }
 
 #endif
@@ -0,0 +1,251 @@
+#include "graph_stream_sorter.hpp"
+#include "packed_graph.hpp"
+#include "stream.hpp"
+#include "utility.hpp"
+#include "algorithms/topological_sort.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <memory>
+#include <tuple>
+
+/**
+ * \file graph_stream_sorter.cpp
+ * GraphStreamSorter: renumber a graph in topological order in two streaming passes.
+ */
+
+namespace vg {
+
+using namespace std;
+
+GraphStreamSorter::GraphStreamSorter(bool show_progress) {
+    this->show_progress = show_progress;
+}
+
+void GraphStreamSorter::set_range_size(size_t nodes) {
+    range_size = max(nodes, (size_t) 1);
+}
+
+void GraphStreamSorter::set_chunk_size(size_t nodes) {
+    chunk_size = max(nodes, (size_t) 1);
+}
+
+hot_hash_map<id_t, id_t> GraphStreamSorter::find_new_ids(istream& graph_in, id_t first_id) {
+
+    // Hold the topology in a graph with empty sequences
+    PackedGraph topology;
+    // Edges can come in chunks before the nodes they touch; hold just those
+    vector<tuple<id_t, bool, id_t, bool>> pending_edges;
+    auto add_edge = [&](id_t from, bool from_start, id_t to, bool to_end) {
+        topology.create_edge(topology.get_handle(from, from_start), topology.get_handle(to, to_end));
+    };
+
+    function<void(Graph&)> lambda = [&](Graph& g) {
+        for (auto& node : g.node()) {
+            if (!topology.has_node(node.id())) {
+                topology.create_handle("", node.id());
+            }
+        }
+        for (auto& edge : g.edge()) {
+            if (topology.has_node(edge.from()) && topology.has_node(edge.to())) {
+                add_edge(edge.from(), edge.from_start(), edge.to(), edge.to_end());
+            } else {
+                pending_edges.emplace_back(edge.from(), edge.from_start(), edge.to(), edge.to_end());
+            }
+        }
+    };
+    stream::for_each(graph_in, lambda);
+
+    for (auto& edge : pending_edges) {
+        for (id_t id : {get<0>(edge), get<2>(edge)}) {
+            if (!topology.has_node(id)) {
+                throw runtime_error("GraphStreamSorter: edge visits node " + to_string(id) +
+                                    ", which is not in the graph");
+            }
+        }
+        add_edge(get<0>(edge), get<1>(edge), get<2>(edge), get<3>(edge));
+    }
+    vector<tuple<id_t, bool, id_t, bool>>().swap(pending_edges);
+
+    vector<handle_t> order = algorithms::topological_order(&topology);
+    hot_hash_map<id_t, id_t> new_ids;
+    new_ids.reserve(order.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        new_ids[topology.get_id(order[i])] = first_id + i;
+    }
+    return new_ids;
+}
+
+void GraphStreamSorter::sort_ids(istream& graph_in, ostream& graph_out, id_t first_id) {
+
+    // We need to come back here for the second pass
+    auto start = graph_in.tellg();
+    if (!graph_in.good() || start == (streampos) -1) {
+        throw runtime_error("GraphStreamSorter: graph must come from a seekable stream");
+    }
+
+    hot_hash_map<id_t, id_t> new_ids = find_new_ids(graph_in, first_id);
+
+    graph_in.clear();
+    graph_in.seekg(start);
+    if (!graph_in.good()) {
+        throw runtime_error("GraphStreamSorter: could not rewind the graph for the second pass");
+    }
+
+    auto renumber = [&](id_t id) {
+        auto found = new_ids.find(id);
+        if (found == new_ids.end()) {
+            throw runtime_error("GraphStreamSorter: node " + to_string(id) + " is not in the graph");
+        }
+        return found->second;
+    };
+
+    // Spill each range of new IDs to its own temp file, with the edges from its nodes
+    size_t nodes_per_range = max(range_size, (new_ids.size() + max_ranges - 1) / max_ranges);
+    size_t range_count = new_ids.empty() ? 0 : (new_ids.size() - 1) / nodes_per_range + 1;
+    vector<string> range_names(range_count);
+    vector<unique_ptr<ofstream>> range_outs(range_count);
+    for (size_t r = 0; r < range_count; ++r) {
+        range_names[r] = temp_file::create("vg-sort-range-");
+        range_outs[r] = unique_ptr<ofstream>(new ofstream(range_names[r], std::ios_base::binary));
+    }
+    vector<Graph> range_buffers(range_count);
+    auto flush_range = [&](size_t r) {
+        vector<Graph> buffer(1);
+        buffer.front().Swap(&range_buffers[r]);
+        stream::write_buffered(*range_outs[r], buffer, 1);
+    };
+    auto range_of = [&](id_t new_id) {
+        return (size_t) (new_id - first_id) / nodes_per_range;
+    };
+
+    // Paths keep their chunking, and go out after all the nodes and edges
+    string path_name = temp_file::create("vg-sort-paths-");
+    ofstream path_out(path_name, std::ios_base::binary);
+    vector<Graph> path_buffer;
+
+    create_progress("renumber graph chunks", new_ids.size() == 0 ? 1 : new_ids.size());
+    size_t nodes_seen = 0;
+    function<void(Graph&)> lambda = [&](Graph& g) {
+        for (auto& node : *g.mutable_node()) {
+            id_t id = renumber(node.id());
+            size_t r = range_of(id);
+            Node* renumbered = range_buffers[r].add_node();
+            renumbered->Swap(&node);
+            renumbered->set_id(id);
+            if (range_buffers[r].node_size() + range_buffers[r].edge_size() >= chunk_size) {
+                flush_range(r);
+            }
+        }
+        for (auto& edge : *g.mutable_edge()) {
+            id_t from = renumber(edge.from());
+            size_t r = range_of(from);
+            Edge* renumbered = range_buffers[r].add_edge();
+            renumbered->Swap(&edge);
+            renumbered->set_from(from);
+            renumbered->set_to(renumber(renumbered->to()));
+            if (range_buffers[r].node_size() + range_buffers[r].edge_size() >= chunk_size) {
+                flush_range(r);
+            }
+        }
+        if (g.path_size()) {
+            path_buffer.emplace_back();
+            path_buffer.back().mutable_path()->Swap(g.mutable_path());
+            for (auto& path : *path_buffer.back().mutable_path()) {
+                for (auto& mapping : *path.mutable_mapping()) {
+                    mapping.mutable_position()->set_node_id(renumber(mapping.position().node_id()));
+                }
+            }
+            stream::write_buffered(path_out, path_buffer, 1);
+        }
+        nodes_seen += g.node_size();
+        update_progress(nodes_seen);
+    };
+    stream::for_each(graph_in, lambda);
+    for (size_t r = 0; r < range_count; ++r) {
+        if (range_buffers[r].node_size() + range_buffers[r].edge_size()) {
+            flush_range(r);
+        }
+        stream::finish(*range_outs[r]);
+        range_outs[r]->close();
+    }
+    range_outs.clear();
+    stream::finish(path_out);
+    path_out.close();
+    destroy_progress();
+
+    // Now sort each range in memory and write it out
+    create_progress("write sorted graph", range_count == 0 ? 1 : range_count);
+    vector<Graph> out_buffer;
+    for (size_t r = 0; r < range_count; ++r) {
+        vector<Node> nodes;
+        vector<Edge> edges;
+        {
+            ifstream range_in(range_names[r], std::ios_base::binary);
+            function<void(Graph&)> collect = [&](Graph& g) {
+                for (auto& node : *g.mutable_node()) {
+                    nodes.emplace_back();
+                    nodes.back().Swap(&node);
+                }
+                for (auto& edge : *g.mutable_edge()) {
+                    edges.emplace_back();
+                    edges.back().Swap(&edge);
+                }
+            };
+            stream::for_each(range_in, collect);
+        }
+        temp_file::remove(range_names[r]);
+
+        // A node or edge repeated in the input only goes out once
+        auto edge_key = [](const Edge& e) {
+            return make_tuple(e.from(), e.to(), e.from_start(), e.to_end());
+        };
+        std::sort(nodes.begin(), nodes.end(), [](const Node& a, const Node& b) {
+            return a.id() < b.id();
+        });
+        nodes.erase(std::unique(nodes.begin(), nodes.end(), [](const Node& a, const Node& b) {
+            return a.id() == b.id();
+        }), nodes.end());
+        std::sort(edges.begin(), edges.end(), [&](const Edge& a, const Edge& b) {
+            return edge_key(a) < edge_key(b);
+        });
+        edges.erase(std::unique(edges.begin(), edges.end(), [&](const Edge& a, const Edge& b) {
+            return edge_key(a) == edge_key(b);
+        }), edges.end());
+
+        // Each chunk gets the edges from its nodes
+        size_t e = 0;
+        for (size_t i = 0; i < nodes.size(); i += chunk_size) {
+            size_t end = min(i + chunk_size, nodes.size());
+            out_buffer.emplace_back();
+            Graph& chunk = out_buffer.back();
+            for (size_t j = i; j < end; ++j) {
+                chunk.add_node()->Swap(&nodes[j]);
+            }
+            bool last = end == nodes.size();
+            id_t last_id = chunk.node(chunk.node_size() - 1).id();
+            for (; e < edges.size() && (last || edges[e].from() <= last_id); ++e) {
+                chunk.add_edge()->Swap(&edges[e]);
+            }
+            stream::write_buffered(graph_out, out_buffer, 1);
+        }
+        update_progress(r + 1);
+    }
+    destroy_progress();
+
+    {
+        ifstream path_in(path_name, std::ios_base::binary);
+        function<void(Graph&)> copy_paths = [&](Graph& g) {
+            out_buffer.emplace_back();
+            out_buffer.back().Swap(&g);
+            stream::write_buffered(graph_out, out_buffer, 1);
+        };
+        stream::for_each(path_in, copy_paths);
+    }
+    temp_file::remove(path_name);
+
+    // End the stream
+    stream::write_buffered(graph_out, out_buffer, 0);
+}
+
+}
@@ -0,0 +1,65 @@
+#ifndef VG_GRAPH_STREAM_SORTER_HPP_INCLUDED
+#define VG_GRAPH_STREAM_SORTER_HPP_INCLUDED
+
+#include "vg.pb.h"
+#include "types.hpp"
+#include "progressive.hpp"
+#include "hash_map.hpp"
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+/**
+ * \file graph_stream_sorter.hpp
+ * Sort and renumber graphs too big to load, by streaming over their chunks.
+ */
+namespace vg {
+
+using namespace std;
+
+/// Gives the nodes of a stream of Graph chunks new IDs in (generalized)
+/// topological sort order, and writes the graph back out in ID order, the way
+/// sorting and then compacting the IDs of a VG would.
+///
+/// The input is read twice. The first pass keeps only the graph's topology
+/// (node IDs and edges, with no sequences or paths) to find the sort order. The
+/// second pass renumbers each chunk and spills its nodes and edges into
+/// temporary files, each holding a range of the new IDs, which are then sorted
+/// one at a time and written out, followed by the paths. So beyond the
+/// topology, only one range of nodes is ever held in memory.
+class GraphStreamSorter : public Progressive {
+public:
+
+    /// Create a sorter, showing progress on standard error if show_progress is true.
+    GraphStreamSorter(bool show_progress = false);
+
+    /// Sort the graph in the given seekable stream and write it to the given
+    /// output stream. The nodes are numbered in sort order from first_id up.
+    /// Throws if the input can't be rewound for the second pass, or if an
+    /// edge or path visits a node that isn't in the graph.
+    void sort_ids(istream& graph_in, ostream& graph_out, id_t first_id = 1);
+
+    /// Set the number of nodes to hold in memory at once when writing out the
+    /// sorted graph. May be raised to keep the number of temp files down.
+    void set_range_size(size_t nodes);
+
+    /// Set the number of nodes in each output chunk.
+    void set_chunk_size(size_t nodes);
+
+private:
+
+    /// The first pass: find the new ID of each node from the topology.
+    hot_hash_map<id_t, id_t> find_new_ids(istream& graph_in, id_t first_id);
+
+    /// How many nodes should be sorted in memory at once?
+    size_t range_size = 1000000;
+    /// Never use more temp files for the node ranges than this.
+    size_t max_ranges = 512;
+    /// How many nodes should go in each chunk written out?
+    size_t chunk_size = 1000;
+};
+
+}
+
+#endif
@@ -0,0 +1,316 @@
+#include "graph_stream_validator.hpp"
+#include "path.hpp"
+#include "stream.hpp"
+#include "utility.hpp"
+
+#include <omp.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <functional>
+#include <sstream>
+
+/**
+ * \file graph_stream_validator.cpp
+ * GraphStreamValidator: check the chunks of a graph in parallel.
+ */
+
+namespace vg {
+
+using namespace std;
+
+/// Run check on each index below count, on all the threads, and append the
+/// problems it finds to errors, in order of index.
+static void check_in_parallel(size_t count, const function<void(size_t, vector<string>&)>& check,
+                              vector<string>& errors) {
+    vector<vector<pair<size_t, string>>> found(omp_get_max_threads());
+#pragma omp parallel for schedule(dynamic, 1024)
+    for (size_t i = 0; i < count; i++) {
+        vector<string> item_errors;
+        check(i, item_errors);
+        auto& thread_found = found[omp_get_thread_num()];
+        for (auto& error : item_errors) {
+            thread_found.emplace_back(i, std::move(error));
+        }
+    }
+    vector<pair<size_t, string>> all_found;
+    for (auto& thread_found : found) {
+        std::move(thread_found.begin(), thread_found.end(), back_inserter(all_found));
+    }
+    // Items only report on one thread, so their own problems stay in order
+    std::stable_sort(all_found.begin(), all_found.end(),
+                     [](const pair<size_t, string>& a, const pair<size_t, string>& b) {
+                         return a.first < b.first;
+                     });
+    for (auto& error : all_found) {
+        errors.push_back(std::move(error.second));
+    }
+}
+
+GraphStreamValidator::EdgeKey GraphStreamValidator::edge_key(id_t id1, bool is_end1, id_t id2, bool is_end2) {
+    if (make_pair(id2, is_end2) < make_pair(id1, is_end1)) {
+        return make_tuple(id2, is_end2, id1, is_end1);
+    }
+    return make_tuple(id1, is_end1, id2, is_end2);
+}
+
+string GraphStreamValidator::describe(const Location& location, const string& item) {
+    return "chunk " + to_string(location.chunk) + ", " + item + " " + to_string(location.index);
+}
+
+static string describe_edge(id_t from, bool from_start, id_t to, bool to_end) {
+    stringstream s;
+    s << "edge " << from << (from_start ? " start" : " end") << " -> " << to << (to_end ? " end" : " start");
+    return s.str();
+}
+
+void GraphStreamValidator::add_chunk(const Graph& chunk) {
+    for (size_t i = 0; i < chunk.node_size(); i++) {
+        const Node& node = chunk.node(i);
+        nodes.push_back({node.id(), node.sequence().size(), {chunk_count, i}});
+    }
+    for (size_t i = 0; i < chunk.edge_size(); i++) {
+        const Edge& edge = chunk.edge(i);
+        edges.push_back({edge.from(), edge.to(), edge.from_start(), edge.to_end(), {chunk_count, i}});
+    }
+    for (auto& path : chunk.path()) {
+        auto& mappings = paths[path.name()];
+        for (size_t i = 0; i < path.mapping_size(); i++) {
+            const Mapping& mapping = path.mapping(i);
+            MappingRecord record;
+            record.node_id = mapping.position().node_id();
+            record.offset = mapping.position().offset();
+            record.from_length = mapping_from_length(mapping);
+            record.rank = mapping.rank();
+            record.has_position = mapping.has_position();
+            record.is_reverse = mapping.position().is_reverse();
+            record.has_edits = mapping.edit_size() > 0;
+            record.location = {chunk_count, i};
+            if (record.rank == 0) {
+                // Unranked mappings go after the mapping before them, the way
+                // they do when a VG is loaded.
+                if (mappings.empty()) {
+                    record.rank = 1;
+                } else if (mappings.back().rank != 0) {
+                    record.rank = mappings.back().rank + 1;
+                }
+            }
+            mappings.push_back(record);
+        }
+    }
+    chunk_count++;
+}
+
+void GraphStreamValidator::add_stream(istream& in) {
+    // Parse on all the threads, but take the chunks in order
+    function<void(int64_t, vector<Graph>&)> lambda = [&](int64_t, vector<Graph>& batch) {
+        for (auto& chunk : batch) {
+            add_chunk(chunk);
+        }
+    };
+    stream::for_each_in_batches(in, 4 * get_thread_count(), lambda);
+}
+
+void GraphStreamValidator::clear() {
+    chunk_count = 0;
+    vector<NodeRecord>().swap(nodes);
+    vector<EdgeRecord>().swap(edges);
+    vector<EdgeKey>().swap(edge_keys);
+    paths.clear();
+}
+
+const GraphStreamValidator::NodeRecord* GraphStreamValidator::find_node(id_t id) const {
+    auto found = std::lower_bound(nodes.begin(), nodes.end(), id, [](const NodeRecord& node, id_t id) {
+        return node.id < id;
+    });
+    return found != nodes.end() && found->id == id ? &*found : nullptr;
+}
+
+bool GraphStreamValidator::has_edge(id_t id1, bool is_end1, id_t id2, bool is_end2) const {
+    return std::binary_search(edge_keys.begin(), edge_keys.end(), edge_key(id1, is_end1, id2, is_end2));
+}
+
+void GraphStreamValidator::index_nodes(vector<string>& errors) {
+    std::stable_sort(nodes.begin(), nodes.end(), [](const NodeRecord& a, const NodeRecord& b) {
+        return a.id < b.id;
+    });
+    // Nodes can be repeated between chunks, but the copies have to agree
+    size_t kept = 0;
+    for (size_t i = 0; i < nodes.size(); i++) {
+        if (kept > 0 && nodes[kept - 1].id == nodes[i].id) {
+            if (check_nodes && nodes[kept - 1].length != nodes[i].length) {
+                errors.push_back("node " + to_string(nodes[i].id) + " (" + describe(nodes[i].location, "node") +
+                                 ") has " + to_string(nodes[i].length) + " bp, but its copy in " +
+                                 describe(nodes[kept - 1].location, "node") + " has " +
+                                 to_string(nodes[kept - 1].length) + " bp");
+            }
+            continue;
+        }
+        nodes[kept++] = nodes[i];
+    }
+    nodes.resize(kept);
+}
+
+void GraphStreamValidator::index_paths() {
+    vector<vector<MappingRecord>*> to_sort;
+    for (auto& path : paths) {
+        to_sort.push_back(&path.second);
+    }
+#pragma omp parallel for schedule(dynamic, 1)
+    for (size_t i = 0; i < to_sort.size(); i++) {
+        auto& mappings = *to_sort[i];
+        std::stable_sort(mappings.begin(), mappings.end(), [](const MappingRecord& a, const MappingRecord& b) {
+            return a.rank < b.rank;
+        });
+        // Later mappings with a rank we already have are dropped on loading
+        mappings.erase(std::unique(mappings.begin(), mappings.end(), [](const MappingRecord& a, const MappingRecord& b) {
+            return a.rank != 0 && a.rank == b.rank;
+        }), mappings.end());
+    }
+}
+
+void GraphStreamValidator::find_node_errors(vector<string>& errors) const {
+    check_in_parallel(nodes.size(), [&](size_t i, vector<string>& found) {
+        const NodeRecord& node = nodes[i];
+        if (node.id <= 0) {
+            found.push_back("node " + to_string(node.id) + " (" + describe(node.location, "node") +
+                            ") does not have a positive ID");
+        }
+    }, errors);
+}
+
+void GraphStreamValidator::find_edge_errors(vector<string>& errors) const {
+    check_in_parallel(edges.size(), [&](size_t i, vector<string>& found) {
+        const EdgeRecord& edge = edges[i];
+        for (id_t id : {edge.from, edge.to}) {
+            if (!find_node(id)) {
+                found.push_back(describe_edge(edge.from, edge.from_start, edge.to, edge.to_end) + " (" +
+                                describe(edge.location, "edge") + ") visits node " + to_string(id) +
+                                ", which is not in the graph");
+            }
+            if (edge.from == edge.to) {
+                break;
+            }
+        }
+    }, errors);
+}
+
+void GraphStreamValidator::find_orphan_errors(vector<string>& errors) const {
+    vector<id_t> attached;
+    attached.reserve(edges.size() * 2);
+    for (auto& edge : edges) {
+        attached.push_back(edge.from);
+        attached.push_back(edge.to);
+    }
+    std::sort(attached.begin(), attached.end());
+    attached.erase(std::unique(attached.begin(), attached.end()), attached.end());
+    check_in_parallel(nodes.size(), [&](size_t i, vector<string>& found) {
+        const NodeRecord& node = nodes[i];
+        if (!std::binary_search(attached.begin(), attached.end(), node.id)) {
+            found.push_back("node " + to_string(node.id) + " (" + describe(node.location, "node") +
+                            ") has no edges");
+        }
+    }, errors);
+}
+
+void GraphStreamValidator::find_path_errors(vector<string>& errors) const {
+    // Check all the mappings of all the paths as one range, so long paths get
+    // split between threads. first_mapping holds where each path starts.
+    vector<const string*> names;
+    vector<const vector<MappingRecord>*> path_mappings;
+    vector<size_t> first_mapping;
+    size_t total = 0;
+    for (auto& path : paths) {
+        names.push_back(&path.first);
+        path_mappings.push_back(&path.second);
+        first_mapping.push_back(total);
+        total += path.second.size();
+    }
+
+    check_in_parallel(total, [&](size_t i, vector<string>& found) {
+        size_t p = std::upper_bound(first_mapping.begin(), first_mapping.end(), i) - first_mapping.begin() - 1;
+        auto& mappings = *path_mappings[p];
+        size_t j = i - first_mapping[p];
+        const MappingRecord& m = mappings[j];
+
+        auto describe_mapping = [&](const MappingRecord& mapping) {
+            return "path '" + *names[p] + "' mapping rank " + to_string(mapping.rank) + " (" +
+                describe(mapping.location, "mapping") + ")";
+        };
+
+        if (!m.has_position) {
+            found.push_back(describe_mapping(m) + " has no position");
+            return;
+        }
+        const NodeRecord* node = find_node(m.node_id);
+        if (!node) {
+            found.push_back(describe_mapping(m) + " visits node " + to_string(m.node_id) +
+                            ", which is not in the graph");
+            return;
+        }
+        if (m.offset + m.from_length > node->length) {
+            found.push_back(describe_mapping(m) + " covers sequence outside of node " + to_string(m.node_id) +
+                            ": offset (" + to_string(m.offset) + ") + from_length (" + to_string(m.from_length) +
+                            ") > node length (" + to_string(node->length) + ")");
+        }
+
+        if (j == 0) {
+            return;
+        }
+        // Check the connection from the mapping before, if it is right before
+        const MappingRecord& prev = mappings[j - 1];
+        const NodeRecord* prev_node = prev.has_position ? find_node(prev.node_id) : nullptr;
+        if (!prev_node || abs(m.rank - prev.rank) != 1) {
+            return;
+        }
+        // We leave the previous node by its end if we read it forward, and
+        // enter this one by its start.
+        if (!has_edge(prev.node_id, !prev.is_reverse, m.node_id, m.is_reverse)) {
+            found.push_back(describe_mapping(m) + " follows " + to_string(prev.node_id) +
+                            (prev.is_reverse ? "-" : "+") + " and visits " + to_string(m.node_id) +
+                            (m.is_reverse ? "-" : "+") + ", but there is no edge between them");
+        }
+        // A mapping with no edits covers the rest of its node
+        size_t prev_length = prev.has_edits ? prev.from_length : prev_node->length;
+        if (prev.offset + prev_length != prev_node->length) {
+            found.push_back(describe_mapping(prev) + " is followed by another mapping, but does not reach the end of node " +
+                            to_string(prev.node_id) + ": offset (" + to_string(prev.offset) + ") + from_length (" +
+                            to_string(prev_length) + ") != node length (" + to_string(prev_node->length) + ")");
+        }
+        if (m.offset > 0) {
+            found.push_back(describe_mapping(m) + " follows another mapping, but starts at offset " +
+                            to_string(m.offset) + " instead of 0");
+        }
+    }, errors);
+}
+
+vector<string> GraphStreamValidator::validate() {
+    vector<string> errors;
+
+    index_nodes(errors);
+    if (check_paths) {
+        edge_keys.clear();
+        edge_keys.reserve(edges.size());
+        for (auto& edge : edges) {
+            edge_keys.push_back(edge_key(edge.from, !edge.from_start, edge.to, edge.to_end));
+        }
+        std::sort(edge_keys.begin(), edge_keys.end());
+        index_paths();
+    }
+
+    if (check_nodes) {
+        find_node_errors(errors);
+    }
+    if (check_edges) {
+        find_edge_errors(errors);
+    }
+    if (check_orphans) {
+        find_orphan_errors(errors);
+    }
+    if (check_paths) {
+        find_path_errors(errors);
+    }
+    return errors;
+}
+
+}
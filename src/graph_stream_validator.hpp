@@ -0,0 +1,134 @@
+#ifndef VG_GRAPH_STREAM_VALIDATOR_HPP_INCLUDED
+#define VG_GRAPH_STREAM_VALIDATOR_HPP_INCLUDED
+
+#include "vg.pb.h"
+#include "types.hpp"
+
+#include <iostream>
+#include <map>
+#include <string>
+#include <tuple>
+#include <vector>
+
+/**
+ * \file graph_stream_validator.hpp
+ * Check graphs for consistency as their chunks stream past.
+ */
+namespace vg {
+
+using namespace std;
+
+/// Checks that a graph, given as a series of Graph chunks, is well formed:
+/// that edges and paths only visit nodes in the graph, that nodes repeated
+/// between chunks agree, and that paths are connected by edges and cover the
+/// nodes they visit end to end, the way VG::is_valid() does for a loaded
+/// graph.
+///
+/// Chunks only have their node lengths, edges, and mapping positions kept, so
+/// validating takes much less memory than loading the graph. The checks run
+/// on all the OpenMP threads once every chunk has been seen, and every
+/// problem found is reported, with the chunk and item it was found in.
+class GraphStreamValidator {
+public:
+
+    /// Check that nodes have positive IDs and agree with their copies in
+    /// other chunks?
+    bool check_nodes = true;
+    /// Check that edges only visit nodes in the graph?
+    bool check_edges = true;
+    /// Check that paths only visit nodes in the graph, and are connected by
+    /// edges between the ends of the nodes they visit?
+    bool check_paths = true;
+    /// Check that every node has at least one edge?
+    bool check_orphans = false;
+
+    /// Keep what we need to check from the given chunk. The chunk is assumed
+    /// to come after all the chunks added before it.
+    void add_chunk(const Graph& chunk);
+
+    /// Read and keep all the chunks in the given stream.
+    void add_stream(istream& in);
+
+    /// Check everything added so far, and return a description of each
+    /// problem found. An empty result means the graph is valid.
+    vector<string> validate();
+
+    /// Forget all the chunks added so far.
+    void clear();
+
+private:
+
+    /// Where in the input stream something came from
+    struct Location {
+        size_t chunk;
+        size_t index;
+    };
+
+    struct NodeRecord {
+        id_t id;
+        size_t length;
+        Location location;
+    };
+
+    struct EdgeRecord {
+        id_t from;
+        id_t to;
+        bool from_start;
+        bool to_end;
+        Location location;
+    };
+
+    struct MappingRecord {
+        id_t node_id;
+        size_t offset;
+        /// Bases of the node covered, or 0 if the mapping has no edits
+        size_t from_length;
+        int64_t rank;
+        bool has_position;
+        bool is_reverse;
+        bool has_edits;
+        Location location;
+    };
+
+    /// A pair of node sides, in order, that an edge connects
+    using EdgeKey = tuple<id_t, bool, id_t, bool>;
+
+    /// Get the key for the edge connecting the given sides, which may be in
+    /// either order.
+    static EdgeKey edge_key(id_t id1, bool is_end1, id_t id2, bool is_end2);
+
+    /// Describe the given location
+    static string describe(const Location& location, const string& item);
+
+    /// Find the node with the given ID among the sorted nodes, or return null.
+    const NodeRecord* find_node(id_t id) const;
+
+    /// Is there an edge between the given sides? Looks in the sorted edge keys.
+    bool has_edge(id_t id1, bool is_end1, id_t id2, bool is_end2) const;
+
+    /// Sort and deduplicate the nodes, reporting any that disagree.
+    void index_nodes(vector<string>& errors);
+
+    /// Sort and deduplicate the mappings of each path by rank.
+    void index_paths();
+
+    /// The checks, each of which appends its problems in input order.
+    void find_node_errors(vector<string>& errors) const;
+    void find_edge_errors(vector<string>& errors) const;
+    void find_orphan_errors(vector<string>& errors) const;
+    void find_path_errors(vector<string>& errors) const;
+
+    /// How many chunks have been added?
+    size_t chunk_count = 0;
+
+    vector<NodeRecord> nodes;
+    vector<EdgeRecord> edges;
+    /// Sorted keys for all the edges, once validation starts
+    vector<EdgeKey> edge_keys;
+    /// The mappings of each path, in the order they arrived
+    map<string, vector<MappingRecord>> paths;
+};
+
+}
+
+#endif
@@ -1,29 +1,45 @@
 #include "graph_synchronizer.hpp"
 #include "algorithms/extract_connecting_graph.hpp"
 
+#include <algorithm>
 #include <iterator>
 
 namespace vg {
 
 using namespace std;
 
-GraphSynchronizer::GraphSynchronizer(VG& graph) : graph(graph) {
+const int GraphSynchronizer::REGION_BITS;
+const size_t GraphSynchronizer::SHARD_COUNT;
+
+GraphSynchronizer::GraphSynchronizer(VG& graph) : graph(graph), shards(SHARD_COUNT) {
     // Nothing to do!
 }
 
 void GraphSynchronizer::with_path_index(const string& path_name, const function<void(const PathIndex&)>& to_run) {
-    // Get a reader lock on the graph
-    std::lock_guard<std::mutex> guard(whole_graph_lock);
+    {
+        // If the index exists, we only need it not to change
+        std::lock_guard<std::mutex> guard(index_lock);
+        auto found = indexes.find(path_name);
+        if (found != indexes.end()) {
+            to_run(found->second);
+            return;
+        }
+    }
+    
+    // Otherwise we have to build it from the graph
+    std::lock_guard<std::mutex> graph_guard(whole_graph_lock);
+    std::lock_guard<std::mutex> guard(index_lock);
     to_run(get_path_index(path_name));
 }
 
 const string& GraphSynchronizer::get_path_sequence(const string& path_name) {
-    // Lock the whole graph
-    std::lock_guard<std::mutex> guard(whole_graph_lock);
-    
     // Get (and possibly generate from the graph) the index, and return its
     // sequence string (which won't change)
-    return get_path_index(path_name).sequence;
+    const string* sequence = nullptr;
+    with_path_index(path_name, [&](const PathIndex& index) {
+        sequence = &index.sequence;
+    });
+    return *sequence;
 }
 
     
@@ -35,17 +51,100 @@ PathIndex& GraphSynchronizer::get_path_index(const string& path_name) {
         indexes.emplace(piecewise_construct,
             forward_as_tuple(path_name), // Make the key
             forward_as_tuple(graph, path_name, true)); // Make the PathIndex
+        // It already has all the edits made so far to the graph, even the
+        // ones whose locks are still held.
+        index_edit_counts[path_name] = edit_count;
     }
     return indexes.at(path_name);
 }
 
-void GraphSynchronizer::update_path_indexes(const vector<Translation>& translations) {
+void GraphSynchronizer::update_path_indexes(const vector<pair<size_t, vector<Translation>>>& edits) {
     for (auto& kv : indexes) {
         // We need to touch every index (IN PLACE!)
+        size_t edits_included = index_edit_counts.at(kv.first);
         
-        // Feed each index all the translations, which it will parse into node-
-        // partitioning translations and then apply.
-        kv.second.apply_translations(translations);
+        for (auto& edit : edits) {
+            if (edit.first > edits_included) {
+                // Feed each index all the translations from each edit it
+                // doesn't have yet, which it will parse into node-partitioning
+                // translations and then apply.
+                kv.second.apply_translations(edit.second);
+            }
+        }
+    }
+}
+
+size_t GraphSynchronizer::shard_for(id_t id) const {
+    return ((size_t) id >> REGION_BITS) % shards.size();
+}
+
+bool GraphSynchronizer::claim_nodes(Lock& lock, const set<id_t>& ids, bool take) {
+    // Visit the nodes shard by shard, taking the shards in order so two
+    // threads claiming overlapping sets of shards can't deadlock.
+    vector<pair<size_t, id_t>> by_shard;
+    by_shard.reserve(ids.size());
+    for (id_t id : ids) {
+        by_shard.emplace_back(shard_for(id), id);
+    }
+    sort(by_shard.begin(), by_shard.end());
+    
+    vector<unique_lock<mutex>> held;
+    for (size_t i = 0; i < by_shard.size(); i++) {
+        RegionShard& shard = shards[by_shard[i].first];
+        if (i == 0 || by_shard[i].first != by_shard[i - 1].first) {
+            held.emplace_back(shard.lock);
+        }
+        
+        if (shard.locked_nodes.count(by_shard[i].second)) {
+            // Someone else already has this node. Ask to be woken up when
+            // something in this shard is released. We do this while still
+            // holding the shard, so we can't miss the release.
+            {
+                lock_guard<mutex> wait_guard(lock.wait_lock);
+                lock.released = false;
+            }
+            shard.waiting.push_back(&lock);
+            return false;
+        }
+    }
+    
+    if (take) {
+        // Everything is free, and we still hold all the shards, so take it all.
+        for (auto& shard_and_id : by_shard) {
+            shards[shard_and_id.first].locked_nodes.insert(shard_and_id.second);
+        }
+        lock.locked_nodes.insert(ids.begin(), ids.end());
+    }
+    
+    return true;
+}
+
+void GraphSynchronizer::release_nodes(const set<id_t>& ids) {
+    vector<vector<id_t>> by_shard(shards.size());
+    for (id_t id : ids) {
+        by_shard[shard_for(id)].push_back(id);
+    }
+    
+    // Only one shard is held at a time here
+    vector<Lock*> to_wake;
+    for (size_t i = 0; i < shards.size(); i++) {
+        if (by_shard[i].empty()) {
+            continue;
+        }
+        lock_guard<mutex> guard(shards[i].lock);
+        for (id_t id : by_shard[i]) {
+            shards[i].locked_nodes.erase(id);
+        }
+        to_wake.insert(to_wake.end(), shards[i].waiting.begin(), shards[i].waiting.end());
+        shards[i].waiting.clear();
+    }
+    
+    for (Lock* waiter : to_wake) {
+        // Notify while holding the waiter's mutex, so it can't wake up, get
+        // its lock, finish, and go away before we're done with it.
+        lock_guard<mutex> wait_guard(waiter->wait_lock);
+        waiter->released = true;
+        waiter->wait_for_release.notify_one();
     }
 }
 
@@ -71,200 +170,201 @@ void GraphSynchronizer::Lock::lock() {
         return;
     }
     
-    // What we do is, we lock the graph and wait on the condition variable, with
-    // the check code being that we find the subgraph and immediate neighbors
-    // and verify none of its nodes are locked
-    
-    // Lock the whole graph
-    std::unique_lock<std::mutex> lk(synchronizer.whole_graph_lock);
-    synchronizer.wait_for_region.wait(lk, [&]{
-        // Now we have exclusive use of the graph and indexes, and we need to
-        // see if anyone else is using any nodes we need.
-        
+    // What we do is, we lock the graph, find the subgraph and immediate
+    // neighbors, and try to claim all their nodes. If anyone else is using
+    // any of them, we go to sleep until they release some nodes in that part
+    // of the graph, and try again.
+    while (true) {
+        {
+            // Lock the whole graph
+            std::lock_guard<std::mutex> guard(synchronizer.whole_graph_lock);
+            if (try_lock()) {
+                break;
+            }
+        }
         
+        std::unique_lock<std::mutex> wait_guard(wait_lock);
+        wait_for_release.wait(wait_guard, [&]() {
+            return released;
+        });
+    }
+    
+    // We should have actually grabbed something.
+    if (locked_nodes.empty()) {
+        cerr << "error:[vg::GraphSynchronizer] No nodes locked for " << path_name << ":" << start << "-" << past_end << endl;
+        throw runtime_error("No nodes locked!");
+    }
+    
+    // Now we know nobody else can touch those nodes and we can safely release
+    // our lock on the main graph, which we already did.
+}
+
+bool GraphSynchronizer::Lock::try_lock() {
+    // Now we have exclusive use of the graph, and we need to see if anyone
+    // else is using any nodes we need.
+    
+    // Extract the context around that node
+    VG context;
+    
+    if (start != 0 || past_end != 0) {
+        // We want to extract a range
         
-        // Extract the context around that node
-        VG context;
+        {
+            // The path indexes don't have edits from locks that aren't
+            // released yet, so they can only be trusted on nodes that aren't
+            // locked.
+            std::lock_guard<std::mutex> guard(synchronizer.index_lock);
         
-        if (start != 0 || past_end != 0) {
-            // We want to extract a range
-            
             // Find the outer ends of this range
             NodeSide start_left = synchronizer.get_path_index(path_name).at_position(start);
             NodeSide end_right = synchronizer.get_path_index(path_name).at_position(past_end == 0 ? 0 : past_end - 1).flip();
             
             // Fill in the endpoints pair
             endpoints = make_pair(start_left, end_right);
-            
+        }
+        NodeSide& start_left = endpoints.first;
+        NodeSide& end_right = endpoints.second;
+        
+        if (!synchronizer.claim_nodes(*this, set<id_t>{start_left.node, end_right.node}, false)) {
+            // Someone is editing where the range starts or ends, so the
+            // index may be out of date there.
+            return false;
+        }
+        
 #ifdef debug
-            cerr << "Endpoints: " << start_left << ", " << end_right << endl;
-            
-            // Trace the path in the index to say what should be found
-            cerr << "Path: " << endl;
-            auto it = synchronizer.get_path_index(path_name).find_position(start);
-            while(it != synchronizer.get_path_index(path_name).end() && it->second.flip() != end_right) {
-                cerr << "\tVisit " << it->second;
-                auto it2 = it;
-                ++it2;
-                if (it2 != synchronizer.get_path_index(path_name).end()) {
-                    // Make sure we have an edge from this node to the next on the path
-                    assert(synchronizer.graph.has_edge(it->second.flip(), it2->second));
-                    cerr << " " << pb2json(*synchronizer.graph.get_edge(it->second.flip(), it2->second));
-                }
-                ++it;
-                cerr << endl;
+        cerr << "Endpoints: " << start_left << ", " << end_right << endl;
+        
+        // Trace the path in the index to say what should be found
+        cerr << "Path: " << endl;
+        auto it = synchronizer.get_path_index(path_name).find_position(start);
+        while(it != synchronizer.get_path_index(path_name).end() && it->second.flip() != end_right) {
+            cerr << "\tVisit " << it->second;
+            auto it2 = it;
+            ++it2;
+            if (it2 != synchronizer.get_path_index(path_name).end()) {
+                // Make sure we have an edge from this node to the next on the path
+                assert(synchronizer.graph.has_edge(it->second.flip(), it2->second));
+                cerr << " " << pb2json(*synchronizer.graph.get_edge(it->second.flip(), it2->second));
             }
+            ++it;
+            cerr << endl;
+        }
 #endif
+        
+        // Make them into pos_ts that point left to right, the way Jordan thinks.
+        pos_t left_pos = make_pos_t(start_left.node, start_left.is_end, 0);
+        pos_t right_pos = make_pos_t(end_right.node, !end_right.is_end,
+            synchronizer.graph.get_node(end_right.node)->sequence().size());
+        
+        // Since these are already at node ends, we don't need to worry about node cuts.
+        
+        // Extract paths out to the length we need to connect the ends, or a bit further.
+        // TODO: be sure to extract really big indels somehow...
+        auto translator = algorithms::extract_connecting_graph(&synchronizer.graph,
+            &context,
+            (past_end - start) * 2,
+            left_pos,
+            right_pos,
+            false, // Disallow terminal node cycles, so we don't duplicate nodes
+            true, // We don't want extraneous material that doesn't connect the positions
+            false); // But we don't care about being strictly less than the specified length
             
-            // Make them into pos_ts that point left to right, the way Jordan thinks.
-            pos_t left_pos = make_pos_t(start_left.node, start_left.is_end, 0);
-            pos_t right_pos = make_pos_t(end_right.node, !end_right.is_end,
-                synchronizer.graph.get_node(end_right.node)->sequence().size());
-            
-            // Since these are already at node ends, we don't need to worry about node cuts.
-            
-            // Extract paths out to the length we need to connect the ends, or a bit further.
-            // TODO: be sure to extract really big indels somehow...
-            auto translator = algorithms::extract_connecting_graph(&synchronizer.graph,
-                &context,
-                (past_end - start) * 2,
-                left_pos,
-                right_pos,
-                false, // Disallow terminal node cycles, so we don't duplicate nodes
-                true, // We don't want extraneous material that doesn't connect the positions
-                false); // But we don't care about being strictly less than the specified length
-                
 #ifdef debug
-            cerr << "Extracted " << context.graph.node_size() << " nodes and " << context.graph.edge_size() << " edges between " << path_name << ":" << start << "-" << past_end << endl;
+        cerr << "Extracted " << context.graph.node_size() << " nodes and " << context.graph.edge_size() << " edges between " << path_name << ":" << start << "-" << past_end << endl;
 #endif
-                
-            // Any ID mismatch is going to mess things up, since we need
-            // operations on the new graph to make sense in the original graph.
-            // We need all the entries in this translation map to be no-ops, so
-            // we translate all IDs back to their original (which is possible
-            // because we chose extraction paramters that never duplicate nodes).
-            for (auto& kv : translator) {
-                if (kv.first != kv.second) {
-                    context.swap_node_id(kv.first, kv.second);
-                }
-            }
-            
-        } else {
-            // We want to extract a radius
-            
-            // Find the center node, at the position we want to lock out from
-            NodeSide center = synchronizer.get_path_index(path_name).at_position(path_offset);
             
-            synchronizer.graph.nonoverlapping_node_context_without_paths(synchronizer.graph.get_node(center.node), context);
-            synchronizer.graph.expand_context_by_length(context, context_bases, false, reflect);
+        // Any ID mismatch is going to mess things up, since we need
+        // operations on the new graph to make sense in the original graph.
+        // We need all the entries in this translation map to be no-ops, so
+        // we translate all IDs back to their original (which is possible
+        // because we chose extraction paramters that never duplicate nodes).
+        for (auto& kv : translator) {
+            if (kv.first != kv.second) {
+                context.swap_node_id(kv.first, kv.second);
+            }
         }
         
-        // Also remember all the nodes connected to but not in the context,
-        // which also need to be locked.
-        periphery.clear();
-        peripheral_attachments.clear();
-        
-        // We set this to false if a node we want is taken
-        bool nodes_available = true;
+    } else {
+        // We want to extract a radius
         
-        context.for_each_node([&](Node* node) {
-            // For every node in the graph
-            
-            if (synchronizer.locked_nodes.count(node->id())) {
-                // Someone else already has this node. So our condition is false
-                // and we need to wait.
-                nodes_available = false;
-                return;
-            }
-            
-            for (auto* edge : synchronizer.graph.edges_from(node)) {
-                if (!context.has_node(edge->to())) {
-                    // This is connected but not in the actual context graph. So it's on the periphery.
-                    
-                    if (synchronizer.locked_nodes.count(edge->to())) {
-                        // Someone else already has this node. So our condition
-                        // is false and we need to wait.
-                        nodes_available = false;
-                        return;
-                    }
-                    
-                    // The destination of the edge is in the periphery
-                    periphery.insert(edge->to());
-                    // And you get to it from this side of this graph node.
-                    peripheral_attachments[NodeSide(edge->from(), !edge->from_start())].insert(
-                        NodeSide(edge->to(), edge->to_end()));
-                }
-            }
-            for (auto* edge : synchronizer.graph.edges_to(node)) {
-                if (!context.has_node(edge->from())) {
-                    // This is connected but not in the actual context graph. So it's on the periphery.
-                    
-                    if (synchronizer.locked_nodes.count(edge->from())) {
-                        // Someone else already has this node. So our condition
-                        // is false and we need to wait.
-                        nodes_available = false;
-                        return;
-                    }
-                    
-                    // The source of the edge is in the periphery
-                    periphery.insert(edge->from());
-                    // And you get to it from this side of this graph node.
-                    peripheral_attachments[NodeSide(edge->to(), edge->to_end())].insert(
-                        NodeSide(edge->from(), !edge->from_start()));
-                }
-            }
-        });
+        // Find the center node, at the position we want to lock out from
+        NodeSide center;
+        {
+            std::lock_guard<std::mutex> guard(synchronizer.index_lock);
+            center = synchronizer.get_path_index(path_name).at_position(path_offset);
+        }
         
-        if (nodes_available) {
-            // We can have the nodes we need. Remember what they are.
-            subgraph = std::move(context);
+        if (!synchronizer.claim_nodes(*this, set<id_t>{center.node}, false)) {
+            // Someone is editing here, so the index may be out of date.
+            return false;
         }
         
-        // Return whether we were successful
-        return nodes_available;
-    });
-
-    // Once we get here, we have a lock on the whole graph, and nobody else has
-    // claimed our nodes. Our graph and periphery have been filled in, so we
-    // just have to record our nodes as locked.
-    
-    for(id_t id : periphery) {
-        // Mark the periphery
-        synchronizer.locked_nodes.insert(id);
-        locked_nodes.insert(id);
+        synchronizer.graph.nonoverlapping_node_context_without_paths(synchronizer.graph.get_node(center.node), context);
+        synchronizer.graph.expand_context_by_length(context, context_bases, false, reflect);
     }
     
-    subgraph.for_each_node([&](Node* node) {
-        // Mark the actual graph
-        synchronizer.locked_nodes.insert(node->id());
-        locked_nodes.insert(node->id());
+    // Also remember all the nodes connected to but not in the context,
+    // which also need to be locked.
+    periphery.clear();
+    peripheral_attachments.clear();
+    
+    // Collect all the nodes we need
+    set<id_t> wanted;
+    
+    context.for_each_node([&](Node* node) {
+        // For every node in the graph
+        wanted.insert(node->id());
+        
+        for (auto* edge : synchronizer.graph.edges_from(node)) {
+            if (!context.has_node(edge->to())) {
+                // This is connected but not in the actual context graph. So it's on the periphery.
+                
+                // The destination of the edge is in the periphery
+                periphery.insert(edge->to());
+                // And you get to it from this side of this graph node.
+                peripheral_attachments[NodeSide(edge->from(), !edge->from_start())].insert(
+                    NodeSide(edge->to(), edge->to_end()));
+            }
+        }
+        for (auto* edge : synchronizer.graph.edges_to(node)) {
+            if (!context.has_node(edge->from())) {
+                // This is connected but not in the actual context graph. So it's on the periphery.
+                
+                // The source of the edge is in the periphery
+                periphery.insert(edge->from());
+                // And you get to it from this side of this graph node.
+                peripheral_attachments[NodeSide(edge->to(), edge->to_end())].insert(
+                    NodeSide(edge->from(), !edge->from_start()));
+            }
+        }
     });
+    wanted.insert(periphery.begin(), periphery.end());
     
-    // We should have actually grabbed something.
-    if (locked_nodes.empty()) {
-        cerr << "error:[vg::GraphSynchronizer] No nodes locked for " << path_name << ":" << start << "-" << past_end << endl;
-        throw runtime_error("No nodes locked!");
+    if (!synchronizer.claim_nodes(*this, wanted)) {
+        // Someone else already has one of these nodes. We need to wait.
+        return false;
     }
     
-    // Now we know nobody else can touch those nodes and we can safely release
-    // our lock on the main graph by letting it leave scope.
+    // We can have the nodes we need, and they are recorded as locked.
+    subgraph = std::move(context);
+    return true;
 }
 
 void GraphSynchronizer::Lock::unlock() {
-    // Get the main graph lock
-    std::unique_lock<std::mutex> lk(synchronizer.whole_graph_lock);
-    
-    // Release all the nodes
-    for (id_t locked : locked_nodes) {
-        synchronizer.locked_nodes.erase(locked);
+    if (!pending_translations.empty()) {
+        // Bring the path indexes up to date with all our edits at once, before
+        // anyone else can get at the nodes we edited.
+        std::lock_guard<std::mutex> guard(synchronizer.index_lock);
+        synchronizer.update_path_indexes(pending_translations);
+        pending_translations.clear();
     }
     
+    // Release all the nodes, and notify anyone waiting on them, so they can
+    // check to see if now they can go.
+    synchronizer.release_nodes(locked_nodes);
+    
     // Clear our locked nodes
     locked_nodes.clear();
-    
-    // Notify anyone waiting, so they can all check to see if now they can go.
-    lk.unlock();
-    synchronizer.wait_for_region.notify_all();
 }
 
 VG& GraphSynchronizer::Lock::get_subgraph() {
@@ -332,16 +432,19 @@ vector<Translation> GraphSynchronizer::Lock::apply_edit(const Path& path, set<No
             // For every mapping to a node on that path
             auto node_id = new_path.mapping(i).position().node_id();
             
-            if (!locked_nodes.count(i)) {
-                // If it's not already locked, lock it.
-                locked_nodes.insert(i);
-                synchronizer.locked_nodes.insert(i);
+            if (!locked_nodes.count(node_id)) {
+                // If it's not already locked, lock it. Nobody else can have
+                // it, so we don't need to check.
+                locked_nodes.insert(node_id);
+                auto& shard = synchronizer.shards[synchronizer.shard_for(node_id)];
+                std::lock_guard<std::mutex> shard_guard(shard.lock);
+                shard.locked_nodes.insert(node_id);
             }
         }
     }
     
-    // Apply the edits to the path indexes
-    synchronizer.update_path_indexes(translations);
+    // Save the edits to apply to the path indexes when we unlock
+    pending_translations.emplace_back(++synchronizer.edit_count, translations);
     
     // Spit out the translations to the caller. Maybe they can use them on their subgraph or something?
     return translations;
@@ -12,6 +12,7 @@
 #include <thread>
 #include <mutex>
 #include <condition_variable>
+#include <unordered_set>
 
 namespace vg {
 
@@ -26,6 +27,14 @@ using namespace std;
  * A thread may only hold a lock on a single subgraph at a time. Trying to lock
  * another subgraph while you already have a subgraph locked is likely to result
  * in a deadlock.
+ *
+ * Which nodes are locked is tracked in shards, each covering interleaved
+ * blocks of node IDs, so locks on different regions only meet at the graph
+ * itself. Subgraphs are claimed all at once, taking the shards in order, and a
+ * thread that finds its nodes taken sleeps until nodes in that shard are
+ * released, instead of every waiter retrying whenever anything is unlocked.
+ * Path indexes are brought up to date with a lock's edits all at once when
+ * the lock is released.
  */ 
 class GraphSynchronizer {
 
@@ -44,8 +53,9 @@ public:
     
     /**
      * We can actually let users run whatever function they want with an
-     * exclusive handle on a PathIndex, with the guarantee that the graph won't
-     * change while they're working.
+     * exclusive handle on a PathIndex, with the guarantee that the index won't
+     * change while they're working. It reflects the edits made under locks
+     * that have been released.
      */
     void with_path_index(const string& path_name, const function<void(const PathIndex&)>& to_run);
     
@@ -79,7 +89,8 @@ public:
         void lock();
         
         /**
-         * If a lock is held, unlock it.
+         * If a lock is held, update the path indexes with the edits made under
+         * it, and unlock it.
          */
         void unlock();
         
@@ -115,6 +126,8 @@ public:
          *
          * Any new nodes created are created already locked.
          *
+         * The path indexes are not updated until the lock is released.
+         *
          * Any new nodes created on the left of the alignment (and any existing
          * nodes visited) will be attached to the given "dangling" NodeSides.
          * The set will be populated with the NodeSides for the ends of nodes
@@ -143,6 +156,15 @@ public:
         
     protected:
     
+        friend class GraphSynchronizer;
+    
+        /**
+         * Try to extract our subgraph and claim all its nodes. Lock on the
+         * graph must be held already. If some node is taken, registers us to
+         * be woken when nodes in its shard are released, and returns false.
+         */
+        bool try_lock();
+    
         /// This points back to the synchronizer we synchronize with when we get locked.
         GraphSynchronizer& synchronizer;
         
@@ -175,33 +197,68 @@ public:
         
         /// This is the set of nodes that this lock has currently locked.
         set<id_t> locked_nodes;
+        
+        /// The translations from each edit made under this lock, in order,
+        /// with the number of each edit, waiting to be applied to the path
+        /// indexes on unlock.
+        vector<pair<size_t, vector<Translation>>> pending_translations;
+        
+        /// We sleep on this when our nodes are taken, until someone releases
+        /// nodes in the shard we ran into and sets released.
+        mutex wait_lock;
+        condition_variable wait_for_release;
+        bool released = false;
     };
     
 protected:
     
+    /// Node IDs are divided into blocks of 2^REGION_BITS IDs, which are
+    /// dealt out to the shards in turn. Nodes near each other usually have
+    /// nearby IDs, so a locked region usually touches only a few shards.
+    static const int REGION_BITS = 8;
+    /// How many shards we keep track of locked nodes in.
+    static const size_t SHARD_COUNT = 64;
+    
+    /// Tracks the locked nodes in one shard of the node ID space.
+    struct RegionShard {
+        mutex lock;
+        /// The locked nodes in this shard
+        unordered_set<id_t> locked_nodes;
+        /// The locks waiting for nodes in this shard to be released
+        vector<Lock*> waiting;
+    };
+    
     /// The graph we manage
     VG& graph;
     
     /// We use this to lock the whole graph, for when we're exploring and trying
-    /// to lock a context, or for when we're making an edit, or for when we're
-    /// trying to lock a context, or for when we're working with the
-    /// PathIndexes. It's only ever held during functions in this class or
-    /// internal classes (monitor-style), so we don't need it to be a recursive
-    /// mutex.
+    /// to lock a context, or for when we're making an edit. It's only ever held
+    /// during functions in this class or internal classes (monitor-style), so
+    /// we don't need it to be a recursive mutex. If it is needed along with
+    /// other locks, it is taken first, then index_lock, then the shards in
+    /// order.
     mutex whole_graph_lock;
     
-    /// We have one condition variable where we have blocked all the threads
-    /// that are waiting to lock subgraphs but couldn't the first time because
-    /// we ran into already locked nodes. When nodes get unlocked, we wake them
-    /// all up, and they each grab the mutex and check, one at a time, to see if
-    /// they can have all their nodes this time.
-    condition_variable wait_for_region;
+    /// This protects the PathIndexes. It can be held without the graph lock
+    /// while updating them.
+    mutex index_lock;
     
     /// We need indexes of all the paths that someone might want to use as a
     /// basis for locking. This holds a PathIndex for each path we touch by path
     /// name.
     map<string, PathIndex> indexes;
     
+    /// Each index was built from the graph after this many edits, and
+    /// already reflects them, even if their locks haven't been released.
+    map<string, size_t> index_edit_counts;
+    
+    /// How many edits have been made to the graph. Protected by the graph
+    /// lock.
+    size_t edit_count = 0;
+    
+    /// These hold all the node IDs that are currently locked by someone
+    vector<RegionShard> shards;
+    
     /**
      * Get the index for the given path name. Lock on the indexes and graph must
      * be held already.
@@ -209,13 +266,27 @@ protected:
     PathIndex& get_path_index(const string& path_name);
     
     /**
-     * Update all the path indexes according to the given translations. Lock on
-     * the indexes and graph must be held already.
+     * Update all the path indexes according to the given translations from
+     * each of several numbered edits, in order, skipping edits that happened
+     * before an index was built. Lock on the indexes must be held already.
+     */
+    void update_path_indexes(const vector<pair<size_t, vector<Translation>>>& edits);
+    
+    /// Get the shard that tracks whether the given node is locked.
+    size_t shard_for(id_t id) const;
+    
+    /**
+     * Claim all the given nodes for the given lock, if none of them are taken.
+     * If take is false, just check. Takes the shards in order. If a node is
+     * taken, registers the lock to be woken when nodes in its shard are
+     * released, and returns false.
      */
-    void update_path_indexes(const vector<Translation>& translations);
+    bool claim_nodes(Lock& lock, const set<id_t>& ids, bool take = true);
     
-    /// This holds all the node IDs that are currently locked by someone
-    set<id_t> locked_nodes;
+    /**
+     * Release all the given nodes, and wake up anyone waiting on their shards.
+     */
+    void release_nodes(const set<id_t>& ids);
 
 
 };
@@ -1,6 +1,7 @@
 #include "gssw_aligner.hpp"
 #include "xdrop_aligner.hpp"
 #include "json2pb.h"
+#include "algorithms/topological_sort.hpp"
 
 static const double quality_scale_factor = 10.0 / log(10.0);
 static const double exp_overflow_limit = log(std::numeric_limits<double>::max());
@@ -23,7 +24,7 @@ gssw_graph* BaseAligner::create_gssw_graph(Graph& g) {
         Node* n = g.mutable_node(i);
         // switch any non-ATGCN characters from the node sequence to N
         auto cleaned_seq = nonATGCNtoN(n->sequence());
-        gssw_node* node = (gssw_node*)gssw_node_create(n, n->id(),
+        gssw_node* node = (gssw_node*)gssw_node_create(n->mutable_sequence(), n->id(),
                                                        cleaned_seq.c_str(),
                                                        nt_table,
                                                        score_matrix);
@@ -68,6 +69,61 @@ gssw_graph* BaseAligner::create_gssw_graph(Graph& g) {
     
 }
 
+gssw_graph* BaseAligner::create_gssw_graph(const HandleGraph& g, const vector<handle_t>& order,
+                                           vector<string>& sequences) {
+    
+    gssw_graph* graph = gssw_graph_create(order.size());
+    // the gssw nodes point at these strings, so they can't move
+    sequences.clear();
+    sequences.reserve(order.size());
+    unordered_map<handle_t, pair<size_t, gssw_node*>> nodes;
+    nodes.reserve(order.size());
+    
+    for (size_t i = 0; i < order.size(); ++i) {
+        const handle_t& h = order[i];
+        sequences.emplace_back(g.get_sequence(h));
+        // switch any non-ATGCN characters from the node sequence to N
+        auto cleaned_seq = nonATGCNtoN(sequences.back());
+        gssw_node* node = (gssw_node*)gssw_node_create(&sequences.back(), g.get_id(h),
+                                                       cleaned_seq.c_str(),
+                                                       nt_table,
+                                                       score_matrix);
+        nodes[h] = make_pair(i, node);
+        gssw_graph_add_node(graph, node);
+    }
+    
+    for (size_t i = 0; i < order.size(); ++i) {
+        gssw_node* from = nodes[order[i]].second;
+        g.follow_edges(order[i], false, [&](const handle_t& next) {
+            auto found = nodes.find(next);
+            // only keep edges that go forward in the order between the strands we're aligning to
+            if (found != nodes.end() && found->second.first > i) {
+                gssw_nodes_add_edge(from, found->second.second);
+            }
+        });
+    }
+    
+    return graph;
+}
+
+void BaseAligner::orient_mappings(Alignment& alignment, const HandleGraph& g, const vector<handle_t>& order) {
+    unordered_set<id_t> reversed;
+    for (const handle_t& h : order) {
+        if (g.get_is_reverse(h)) {
+            reversed.insert(g.get_id(h));
+        }
+    }
+    if (reversed.empty()) {
+        return;
+    }
+    for (size_t i = 0; i < alignment.path().mapping_size(); i++) {
+        Position* position = alignment.mutable_path()->mutable_mapping(i)->mutable_position();
+        if (reversed.count(position->node_id())) {
+            position->set_is_reverse(true);
+        }
+    }
+}
+
 void BaseAligner::load_scoring_matrix(istream& matrix_stream) {
     if(score_matrix) free(score_matrix);
     score_matrix = (int8_t*)calloc(25, sizeof(int8_t));
@@ -119,8 +175,7 @@ void BaseAligner::gssw_mapping_to_alignment(gssw_graph* graph,
         if (l == 0) continue;
         gssw_cigar_element* e = c->elements;
         
-        Node* from_node = (Node*) ncs[i].node->data;
-        string& from_seq = *from_node->mutable_sequence();
+        string& from_seq = *(string*) ncs[i].node->data;
         Mapping* mapping = path->add_mapping();
         
         if (i > 0) {
@@ -319,8 +374,7 @@ string BaseAligner::graph_cigar(gssw_graph_mapping* gm) {
     s << from_pos << '@';
     for (int i = 0; i < gc->length; ++i, ++nc) {
         if (i > 0) from_pos = 0; // reset for each node after the first
-        Node* from_node = (Node*) nc->node->data;
-        s << from_node->id() << ':';
+        s << nc->node->id << ':';
         gssw_cigar* c = nc->cigar;
         int l = c->length;
         gssw_cigar_element* e = c->elements;
@@ -336,47 +390,159 @@ string BaseAligner::graph_cigar(gssw_graph_mapping* gm) {
 
 void BaseAligner::init_mapping_quality(double gc_content) {
     log_base = gssw_dna_recover_log_base(match, mismatch, gc_content, 1e-12);
+    
+    // tabulate the likelihood, relative to the best alignment, of an alignment that scores d less,
+    // so that exact mapping qualities of integer scores don't need an exp() per alignment
+    score_deficit_likelihoods.resize(max_tabulated_score_deficit + 1);
+    for (size_t d = 0; d <= max_tabulated_score_deficit; d++) {
+        score_deficit_likelihoods[d] = exp(-log_base * d);
+    }
 }
 
 int32_t BaseAligner::score_gap(size_t gap_length) {
     return gap_length ? -gap_open - (gap_length - 1) * gap_extension : 0;
 }
 
-double BaseAligner::maximum_mapping_quality_exact(vector<double>& scaled_scores, size_t* max_idx_out) {
+/// Find the first maximal score among the given scores, and the next best score and how many
+/// times it occurs. A single score is compared against a null alignment scoring 0, which is never
+/// reported as the maximum. Returns the index of the maximal score.
+template<typename Score>
+static size_t find_top_scores(const Score* scores, size_t count, Score& max_score, Score& next_score,
+                              int32_t& next_count, const char* caller) {
     
-    // if necessary, assume a null alignment of 0.0 for comparison since this is local
-    bool padded = false;
-    if (scaled_scores.size() == 1) {
-        scaled_scores.push_back(0.0);
-        padded = true;
-    }
+    // if necessary, assume a null alignment of 0 for comparison since this is local
+    bool padded = (count == 1);
+    size_t padded_count = padded ? 2 : count;
     
-    // work in log transformed values to avoid risk of overflow
-    double log_sum_exp = numeric_limits<double>::lowest();
-    double max_score = numeric_limits<double>::lowest();
-    // go in reverse order because this has fewer numerical problems when the scores are sorted (as usual)
-    for (int64_t i = scaled_scores.size() - 1; i >= 0; i--) {
-        log_sum_exp = add_log(log_sum_exp, scaled_scores[i]);
-        if (scaled_scores[i] >= max_score) {
-            // Since we are going in reverse order, make sure to break ties in favor of the earlier item.
-            *max_idx_out = i;
-            max_score = scaled_scores[i];
+    max_score = scores[0];
+    size_t max_idx = 0;
+    
+    next_score = std::numeric_limits<Score>::lowest();
+    next_count = 0;
+    
+    for (size_t i = 1; i < padded_count; ++i) {
+        Score score = i < count ? scores[i] : 0;
+        if (score > max_score) {
+            if (next_score == max_score) {
+                next_count++;
+            }
+            else {
+                next_score = max_score;
+                next_count = 1;
+            }
+            max_score = score;
+            max_idx = i;
+        }
+        else if (score > next_score) {
+            next_score = score;
+            next_count = 1;
+        }
+        else if (score == next_score) {
+            next_count++;
         }
     }
     
-    if (padded && *max_idx_out == 1) {
+    if (padded && max_idx == 1) {
         // Force us not to try to return the injected 0 as the winner.
         // TODO: doesn't this mean the score is negative?
-        cerr << "warning:[BaseAligner::maximum_mapping_quality_exact]: Max score of " << max_score
-            << " is the padding score; changing to " << scaled_scores[0] << endl;
-        max_score = scaled_scores[0];
-        *max_idx_out = 0;
+        cerr << "warning:[BaseAligner::" << caller << "]: Max score of " << max_score
+            << " is the padding score; changing to " << scores[0] << endl;
+        max_score = scores[0];
+        max_idx = 0;
     }
     
-    double direct_mapq = -quality_scale_factor * subtract_log(0.0, max_score - log_sum_exp);
+    return max_idx;
+}
+
+/// Find the index of the first maximal score.
+template<typename Score>
+static size_t find_max_score(const Score* scores, size_t count) {
+    size_t max_idx = 0;
+    for (size_t i = 1; i < count; i++) {
+        if (scores[i] > scores[max_idx]) {
+            max_idx = i;
+        }
+    }
+    return max_idx;
+}
+
+/// Convert the total likelihood of the alternatives to the best alignment, relative to the best
+/// alignment's, into the mapping quality of the best alignment.
+static double relative_likelihood_to_mapping_quality(double rest) {
+    // P(err) = rest / (1 + rest)
+    double direct_mapq = quality_scale_factor * (log1p(rest) - log(rest));
     return std::isinf(direct_mapq) ? (double) numeric_limits<int32_t>::max() : direct_mapq;
 }
 
+double BaseAligner::maximum_mapping_quality_exact(vector<double>& scaled_scores, size_t* max_idx_out) {
+    
+    size_t count = scaled_scores.size();
+    const double* scores = scaled_scores.data();
+    size_t max_idx = find_max_score(scores, count);
+    double max_score = scores[max_idx];
+    
+    // sum the likelihoods of everything but the best relative to the best, which keeps it in range
+    // without going through log space for every term, and leaves no dependencies between terms
+    double rest = 0.0;
+    if (count == 1) {
+        // assume a null alignment of 0.0 for comparison since this is local
+        if (max_score < 0.0) {
+            cerr << "warning:[BaseAligner::maximum_mapping_quality_exact]: Max score of 0"
+                << " is the padding score; changing to " << max_score << endl;
+        }
+        rest = exp(-max_score);
+    }
+    else {
+#pragma omp simd reduction(+:rest)
+        for (size_t i = 0; i < count; i++) {
+            rest += (i == max_idx) ? 0.0 : exp(scores[i] - max_score);
+        }
+    }
+    
+    *max_idx_out = max_idx;
+    return relative_likelihood_to_mapping_quality(rest);
+}
+
+double BaseAligner::maximum_mapping_quality_exact(const int32_t* scores, size_t count, size_t* max_idx_out) const {
+    
+    size_t max_idx = find_max_score(scores, count);
+    int64_t max_score = scores[max_idx];
+    
+    double rest = 0.0;
+    if (count == 1) {
+        // assume a null alignment of 0 for comparison since this is local
+        if (max_score < 0) {
+            cerr << "warning:[BaseAligner::maximum_mapping_quality_exact]: Max score of 0"
+                << " is the padding score; changing to " << max_score << endl;
+        }
+        rest = exp(-log_base * max_score);
+    }
+    else {
+        // look up the relative likelihood of each score's deficit from the best, which is a table
+        // lookup instead of an exp() for all but the most hopeless alignments
+        const double* table = score_deficit_likelihoods.data();
+        size_t untabulated = 0;
+#pragma omp simd reduction(+:rest,untabulated)
+        for (size_t i = 0; i < count; i++) {
+            int64_t deficit = max_score - scores[i];
+            bool tabulated = deficit <= (int64_t) max_tabulated_score_deficit;
+            rest += (i != max_idx && tabulated) ? table[tabulated ? deficit : 0] : 0.0;
+            untabulated += !tabulated;
+        }
+        if (untabulated) {
+            for (size_t i = 0; i < count; i++) {
+                int64_t deficit = max_score - scores[i];
+                if (deficit > (int64_t) max_tabulated_score_deficit) {
+                    rest += exp(-log_base * deficit);
+                }
+            }
+        }
+    }
+    
+    *max_idx_out = max_idx;
+    return relative_likelihood_to_mapping_quality(rest);
+}
+
 // TODO: this algorithm has numerical problems that would be difficult to solve without increasing the
 // time complexity: adding the probability of the maximum likelihood tends to erase the contribution
 // of the other terms so that when you subtract them off you get scores of 0 or infinity
@@ -414,53 +580,22 @@ double BaseAligner::maximum_mapping_quality_exact(vector<double>& scaled_scores,
 
 double BaseAligner::maximum_mapping_quality_approx(vector<double>& scaled_scores, size_t* max_idx_out) {
     
-    // if necessary, assume a null alignment of 0.0 for comparison since this is local
-    bool padded = false;
-    if (scaled_scores.size() == 1) {
-        scaled_scores.push_back(0.0);
-        padded = true;
-    }
+    double max_score, next_score;
+    int32_t next_count;
+    *max_idx_out = find_top_scores(scaled_scores.data(), scaled_scores.size(), max_score, next_score, next_count,
+                                   "maximum_mapping_quality_approx");
     
-    double max_score = scaled_scores[0];
-    size_t max_idx = 0;
+    return max(0.0, quality_scale_factor * (max_score - next_score - (next_count > 1 ? log(next_count) : 0.0)));
+}
+
+double BaseAligner::maximum_mapping_quality_approx(const int32_t* scores, size_t count, size_t* max_idx_out) const {
     
-    double next_score = std::numeric_limits<double>::lowest();
-    int32_t next_count = 0;
+    int32_t max_score, next_score;
+    int32_t next_count;
+    *max_idx_out = find_top_scores(scores, count, max_score, next_score, next_count, "maximum_mapping_quality_approx");
     
-    for (int32_t i = 1; i < scaled_scores.size(); ++i) {
-        double score = scaled_scores[i];
-        if (score > max_score) {
-            if (next_score == max_score) {
-                next_count++;
-            }
-            else {
-                next_score = max_score;
-                next_count = 1;
-            }
-            max_score = score;
-            max_idx = i;
-        }
-        else if (score > next_score) {
-            next_score = score;
-            next_count = 1;
-        }
-        else if (score == next_score) {
-            next_count++;
-        }
-    }
-   
-    if (padded && max_idx == 1) {
-        // Force us not to try to return the injected 0 as the winner.
-        // TODO: doesn't this mean the score is negative?
-        cerr << "warning:[BaseAligner::maximum_mapping_quality_approx]: Max score of " << max_score
-            << " is the padding score; changing to " << scaled_scores[0] << endl;
-        max_score = scaled_scores[0];
-        max_idx = 0;
-    }
-   
-    *max_idx_out = max_idx;
-
-    return max(0.0, quality_scale_factor * (max_score - next_score - (next_count > 1 ? log(next_count) : 0.0)));
+    double score_diff = log_base * ((double) max_score - (double) next_score);
+    return max(0.0, quality_scale_factor * (score_diff - (next_count > 1 ? log(next_count) : 0.0)));
 }
 
 double BaseAligner::group_mapping_quality_exact(vector<double>& scaled_scores, vector<size_t>& group) {
@@ -509,18 +644,20 @@ void BaseAligner::compute_mapping_quality(vector<Alignment>& alignments,
         return;
     }
     
-    vector<double> scaled_scores(alignments.size());
+    // gather the scores into a buffer that each thread reuses from read to read
+    static thread_local vector<int32_t> scores;
+    scores.resize(alignments.size());
     for (size_t i = 0; i < alignments.size(); i++) {
-        scaled_scores[i] = log_base * alignments[i].score();
+        scores[i] = alignments[i].score();
     }
 
     double mapping_quality;
     size_t max_idx;
     if (!fast_approximation) {
-        mapping_quality = maximum_mapping_quality_exact(scaled_scores, &max_idx);
+        mapping_quality = maximum_mapping_quality_exact(scores.data(), scores.size(), &max_idx);
     }
     else {
-        mapping_quality = maximum_mapping_quality_approx(scaled_scores, &max_idx);
+        mapping_quality = maximum_mapping_quality_approx(scores.data(), scores.size(), &max_idx);
     }
 
     if (use_cluster_mq) {
@@ -559,7 +696,8 @@ void BaseAligner::compute_mapping_quality(vector<Alignment>& alignments,
 
 int32_t BaseAligner::compute_mapping_quality(vector<double>& scores, bool fast_approximation) {
     
-    vector<double> scaled_scores(scores.size(), 0.0);
+    static thread_local vector<double> scaled_scores;
+    scaled_scores.resize(scores.size());
     for (size_t i = 0; i < scores.size(); i++) {
         scaled_scores[i] = log_base * scores[i];
     }
@@ -608,12 +746,13 @@ void BaseAligner::compute_paired_mapping_quality(pair<vector<Alignment>, vector<
         return;
     }
     
-    vector<double> scaled_scores(size);
+    static thread_local vector<int32_t> scores;
+    scores.resize(size);
     
     for (size_t i = 0; i < size; i++) {
         auto& aln1 = alignment_pairs.first[i];
         auto& aln2 = alignment_pairs.second[i];
-        scaled_scores[i] = log_base * (aln1.score() + aln2.score());
+        scores[i] = aln1.score() + aln2.score();
         // + frag_weights[i]);
         // ^^^ we could also incorporate the fragment weights, but this does not seem to help performance in the current form
     }
@@ -621,10 +760,10 @@ void BaseAligner::compute_paired_mapping_quality(pair<vector<Alignment>, vector<
     size_t max_idx;
     double mapping_quality;
     if (!fast_approximation) {
-        mapping_quality = maximum_mapping_quality_exact(scaled_scores, &max_idx);
+        mapping_quality = maximum_mapping_quality_exact(scores.data(), scores.size(), &max_idx);
     }
     else {
-        mapping_quality = maximum_mapping_quality_approx(scaled_scores, &max_idx);
+        mapping_quality = maximum_mapping_quality_approx(scores.data(), scores.size(), &max_idx);
     }
     
     if (use_cluster_mq) {
@@ -851,7 +990,8 @@ Aligner::Aligner(int8_t _match,
                  int8_t _full_length_bonus,
                  double gc_content,
                  uint32_t _max_gap_length)
-    : xdrop(_match, _mismatch, _gap_open, _gap_extension, _full_length_bonus, _max_gap_length)
+    : xdrop(_match, _mismatch, _gap_open, _gap_extension, _full_length_bonus, _max_gap_length),
+      xdrop_pool(make_shared<XdropPool>())
 {
     match = _match;
     mismatch = _mismatch;
@@ -1047,6 +1187,52 @@ void Aligner::align(Alignment& alignment, Graph& g, bool traceback_aln, bool pri
     align_internal(alignment, nullptr, g, false, false, 1, traceback_aln, print_score_matrices);
 }
 
+void Aligner::align(Alignment& alignment, const HandleGraph& g, bool traceback_aln, bool print_score_matrices,
+                   const vector<handle_t>* topological_order) {
+    
+    vector<handle_t> computed_order;
+    if (!topological_order) {
+        computed_order = algorithms::topological_order(&g);
+        topological_order = &computed_order;
+    }
+    
+    // convert into gssw graph
+    vector<string> sequences;
+    gssw_graph* graph = create_gssw_graph(g, *topological_order, sequences);
+    
+    // perform dynamic programming
+    gssw_graph_fill_pinned(graph, alignment.sequence().c_str(), nt_table, score_matrix,
+        gap_open, gap_extension, full_length_bonus, full_length_bonus, 15, 2, traceback_aln);
+    
+    if (traceback_aln) {
+        // trace back local alignment
+        gssw_graph_mapping* gm = gssw_graph_trace_back(graph,
+                                                 alignment.sequence().c_str(),
+                                                 alignment.sequence().size(),
+                                                 nt_table,
+                                                 score_matrix,
+                                                 gap_open,
+                                                 gap_extension,
+                                                 full_length_bonus,
+                                                 full_length_bonus);
+        
+        gssw_mapping_to_alignment(graph, gm, alignment, false, false, print_score_matrices);
+        gssw_graph_mapping_destroy(gm);
+    } else {
+        // get the alignment position and score
+        alignment.set_score(graph->max_node->alignment->score1);
+        Mapping* m = alignment.mutable_path()->add_mapping();
+        Position* p = m->mutable_position();
+        p->set_node_id(graph->max_node->id);
+        p->set_offset(graph->max_node->alignment->ref_end1); // mark end position; for de-duplication
+    }
+    
+    gssw_graph_destroy(graph);
+    
+    // the node IDs are right, but some of them may have been aligned to on their reverse strands
+    orient_mappings(alignment, g, *topological_order);
+}
+
 void Aligner::align_pinned(Alignment& alignment, Graph& g, bool pin_left) {
     
     align_internal(alignment, nullptr, g, true, pin_left, 1, true, false);
@@ -1063,117 +1249,102 @@ void Aligner::align_pinned_multi(Alignment& alignment, vector<Alignment>& alt_al
     align_internal(alignment, &alt_alignments, g, true, pin_left, max_alt_alns, true, false);
 }
 
-void Aligner::align_global_banded(Alignment& alignment, Graph& g,
-                                  int32_t band_padding, bool permissive_banding) {
-    
-    // We need to figure out what size ints we need to use.
-    // Get upper and lower bounds on the scores. TODO: if these overflow int64 we're out of luck
-    int64_t best_score = alignment.sequence().size() * match;
-    size_t total_bases = 0;
-    for(size_t i = 0; i < g.node_size(); i++) {
-        total_bases += g.node(i).sequence().size();
+/// Try banded global alignment with DP matrices of the given integer type. Returns false, without
+/// changing the alignment, if the scores overflowed the type.
+template<class IntType>
+static bool try_align_global_banded(Alignment& alignment, vector<Alignment>* alt_alignments, Graph& g,
+                                    int32_t max_alt_alns, int32_t band_padding, bool permissive_banding,
+                                    bool adjust_for_base_quality, int8_t* score_mat, int8_t* nt_table,
+                                    int8_t gap_open, int8_t gap_extension, const int8_t* qual_profile) {
+    try {
+        if (alt_alignments) {
+            BandedGlobalAligner<IntType> band_graph(alignment,
+                                                    g,
+                                                    *alt_alignments,
+                                                    max_alt_alns,
+                                                    band_padding,
+                                                    permissive_banding,
+                                                    adjust_for_base_quality);
+            
+            band_graph.align(score_mat, nt_table, gap_open, gap_extension, qual_profile);
+        }
+        else {
+            BandedGlobalAligner<IntType> band_graph(alignment,
+                                                    g,
+                                                    band_padding,
+                                                    permissive_banding,
+                                                    adjust_for_base_quality);
+            
+            band_graph.align(score_mat, nt_table, gap_open, gap_extension, qual_profile);
+        }
     }
-    int64_t worst_score = max(alignment.sequence().size(), total_bases) * -max(max(mismatch, gap_open), gap_extension);
-    
-    // TODO: put this all into another template somehow?
-    
-    if (best_score <= numeric_limits<int8_t>::max() && worst_score >= numeric_limits<int8_t>::min()) {
-        // We'll fit in int8
-        BandedGlobalAligner<int8_t> band_graph(alignment,
-                                               g,
-                                               band_padding,
-                                               permissive_banding,
-                                               false);
-        
-        band_graph.align(score_matrix, nt_table, gap_open, gap_extension);
-    } else if (best_score <= numeric_limits<int16_t>::max() && worst_score >= numeric_limits<int16_t>::min()) {
-        // We'll fit in int16
-        BandedGlobalAligner<int16_t> band_graph(alignment,
-                                                g,
-                                                band_padding,
-                                                permissive_banding,
-                                                false);
-        
-        band_graph.align(score_matrix, nt_table, gap_open, gap_extension);
-    } else if (best_score <= numeric_limits<int32_t>::max() && worst_score >= numeric_limits<int32_t>::min()) {
-        // We'll fit in int32
-        BandedGlobalAligner<int32_t> band_graph(alignment,
-                                                g,
-                                                band_padding,
-                                                permissive_banding,
-                                                false);
-        
-        band_graph.align(score_matrix, nt_table, gap_open, gap_extension);
-    } else {
-        // Fall back to int64
-        BandedGlobalAligner<int64_t> band_graph(alignment,
-                                                g,
-                                                band_padding,
-                                                permissive_banding,
-                                                false);
-        
-        band_graph.align(score_matrix, nt_table, gap_open, gap_extension);
+    catch (BandedAlignmentOverflowException& ex) {
+        return false;
     }
+    return true;
+}
 
+/// Can IntType hold the given best score, with enough room left above it that
+/// a score wrapping around from below can still be told apart?
+template<class IntType>
+static bool fits_banded_scores(int64_t best_score, int64_t max_penalty) {
+    return best_score <= (int64_t) numeric_limits<IntType>::max() - max_penalty;
+}
+
+/// Do banded global alignment in the narrowest integer type that can hold the best possible
+/// score, moving up to wider types only if the DP actually overflows (which it can for lopsided
+/// graphs with long gaps).
+static void align_global_banded_narrowest(Alignment& alignment, vector<Alignment>* alt_alignments, Graph& g,
+                                          int32_t max_alt_alns, int32_t band_padding, bool permissive_banding,
+                                          bool adjust_for_base_quality, int8_t* score_mat, size_t score_mat_size,
+                                          int8_t* nt_table, int8_t gap_open, int8_t gap_extension,
+                                          const int8_t* qual_profile = nullptr) {
+    
+    // Get a bound on the best score from the read length and the scoring matrix
+    int64_t best_match = 0;
+    int64_t max_penalty = max(gap_open, gap_extension);
+    for (size_t i = 0; i < score_mat_size; i++) {
+        best_match = max<int64_t>(best_match, score_mat[i]);
+        max_penalty = max<int64_t>(max_penalty, -score_mat[i]);
+    }
+    int64_t best_score = alignment.sequence().size() * best_match;
+    
+    if (fits_banded_scores<int8_t>(best_score, max_penalty)
+        && try_align_global_banded<int8_t>(alignment, alt_alignments, g, max_alt_alns, band_padding,
+                                           permissive_banding, adjust_for_base_quality, score_mat,
+                                           nt_table, gap_open, gap_extension, qual_profile)) {
+        return;
+    }
+    if (fits_banded_scores<int16_t>(best_score, max_penalty)
+        && try_align_global_banded<int16_t>(alignment, alt_alignments, g, max_alt_alns, band_padding,
+                                            permissive_banding, adjust_for_base_quality, score_mat,
+                                            nt_table, gap_open, gap_extension, qual_profile)) {
+        return;
+    }
+    if (fits_banded_scores<int32_t>(best_score, max_penalty)
+        && try_align_global_banded<int32_t>(alignment, alt_alignments, g, max_alt_alns, band_padding,
+                                            permissive_banding, adjust_for_base_quality, score_mat,
+                                            nt_table, gap_open, gap_extension, qual_profile)) {
+        return;
+    }
+    // Fall back to int64, which we can't overflow
+    try_align_global_banded<int64_t>(alignment, alt_alignments, g, max_alt_alns, band_padding,
+                                     permissive_banding, adjust_for_base_quality, score_mat,
+                                     nt_table, gap_open, gap_extension, qual_profile);
+}
+
+void Aligner::align_global_banded(Alignment& alignment, Graph& g,
+                                  int32_t band_padding, bool permissive_banding) {
+    
+    align_global_banded_narrowest(alignment, nullptr, g, 0, band_padding, permissive_banding, false,
+                                  score_matrix, 25, nt_table, gap_open, gap_extension);
 }
 
 void Aligner::align_global_banded_multi(Alignment& alignment, vector<Alignment>& alt_alignments, Graph& g,
                                         int32_t max_alt_alns, int32_t band_padding, bool permissive_banding) {
-                                        
-    // We need to figure out what size ints we need to use.
-    // Get upper and lower bounds on the scores. TODO: if these overflow int64 we're out of luck
-    int64_t best_score = alignment.sequence().size() * match;
-    size_t total_bases = 0;
-    for(size_t i = 0; i < g.node_size(); i++) {
-        total_bases += g.node(i).sequence().size();
-    }
-    int64_t worst_score = max(alignment.sequence().size(), total_bases) * -max(max(mismatch, gap_open), gap_extension);
-    
-    if (best_score <= numeric_limits<int8_t>::max() && worst_score >= numeric_limits<int8_t>::min()) {
-        // We'll fit in int8
-        BandedGlobalAligner<int8_t> band_graph(alignment,
-                                               g,
-                                               alt_alignments,
-                                               max_alt_alns,
-                                               band_padding,
-                                               permissive_banding,
-                                               false);
-        
-        band_graph.align(score_matrix, nt_table, gap_open, gap_extension);
-    } else if (best_score <= numeric_limits<int16_t>::max() && worst_score >= numeric_limits<int16_t>::min()) {
-        // We'll fit in int16
-        BandedGlobalAligner<int16_t> band_graph(alignment,
-                                                g,
-                                                alt_alignments,
-                                                max_alt_alns,
-                                                band_padding,
-                                                permissive_banding,
-                                                false);
-        
-        band_graph.align(score_matrix, nt_table, gap_open, gap_extension);
-    } else if (best_score <= numeric_limits<int32_t>::max() && worst_score >= numeric_limits<int32_t>::min()) {
-        // We'll fit in int32
-        BandedGlobalAligner<int32_t> band_graph(alignment,
-                                                g,
-                                                alt_alignments,
-                                                max_alt_alns,
-                                                band_padding,
-                                                permissive_banding,
-                                                false);
-        
-        band_graph.align(score_matrix, nt_table, gap_open, gap_extension);
-    } else {
-        // Fall back to int64
-        BandedGlobalAligner<int64_t> band_graph(alignment,
-                                                g,
-                                                alt_alignments,
-                                                max_alt_alns,
-                                                band_padding,
-                                                permissive_banding,
-                                                false);
-        
-        band_graph.align(score_matrix, nt_table, gap_open, gap_extension);
-    }
+    
+    align_global_banded_narrowest(alignment, &alt_alignments, g, max_alt_alns, band_padding, permissive_banding,
+                                  false, score_matrix, 25, nt_table, gap_open, gap_extension);
 }
 
 // X-drop aligner
@@ -1181,13 +1352,44 @@ void Aligner::align_xdrop(Alignment& alignment, Graph& g, const vector<MaximalEx
 {
     // cerr << "X-drop aligner" << endl;
     if (multithreaded) {
-        auto xdrop_copy = xdrop; // make thread safe
-        xdrop_copy.align(alignment, g, mems, reverse_complemented);
+        // Borrow a copy to be thread safe, instead of making a fresh one and
+        // setting up its buffers all over again for every read.
+        unique_ptr<XdropAligner> borrowed = borrow_xdrop();
+        borrowed->align(alignment, g, mems, reverse_complemented);
+        return_xdrop(std::move(borrowed));
     } else {
         xdrop.align(alignment, g, mems, reverse_complemented);
     }
 }
 
+void Aligner::align_xdrop(Alignment& alignment, const HandleGraph& g, const vector<MaximalExactMatch>& mems, bool multithreaded)
+{
+    if (multithreaded) {
+        unique_ptr<XdropAligner> borrowed = borrow_xdrop();
+        borrowed->align(alignment, g, mems);
+        return_xdrop(std::move(borrowed));
+    } else {
+        xdrop.align(alignment, g, mems);
+    }
+}
+
+unique_ptr<XdropAligner> Aligner::borrow_xdrop() {
+    {
+        lock_guard<mutex> guard(xdrop_pool->lock);
+        if (!xdrop_pool->idle.empty()) {
+            unique_ptr<XdropAligner> borrowed = std::move(xdrop_pool->idle.back());
+            xdrop_pool->idle.pop_back();
+            return borrowed;
+        }
+    }
+    return unique_ptr<XdropAligner>(new XdropAligner(xdrop));
+}
+
+void Aligner::return_xdrop(unique_ptr<XdropAligner>&& borrowed) {
+    lock_guard<mutex> guard(xdrop_pool->lock);
+    xdrop_pool->idle.emplace_back(std::move(borrowed));
+}
+
 void Aligner::align_xdrop_multi(Alignment& alignment, Graph& g, const vector<MaximalExactMatch>& mems, bool reverse_complemented, int32_t max_alt_alns)
 {
 }
@@ -1294,9 +1496,37 @@ QualAdjAligner::QualAdjAligner(int8_t _match,
     mismatch *= scale_factor;
     full_length_bonus *= scale_factor;
     
+    init_profile_blocks();
+    
     BaseAligner::init_mapping_quality(gc_content);
 }
 
+void QualAdjAligner::init_profile_blocks() {
+    profile_blocks.fill(0);
+    for (size_t qual = 0; qual <= max_qual_score; qual++) {
+        for (size_t read_nt = 0; read_nt < 5; read_nt++) {
+            for (size_t ref_nt = 0; ref_nt < 5; ref_nt++) {
+                profile_blocks[25 * qual + 5 * read_nt + ref_nt] = score_matrix[25 * qual + 5 * ref_nt + read_nt];
+            }
+        }
+    }
+}
+
+void QualAdjAligner::query_profile(const Alignment& alignment, vector<int8_t>& profile_out) const {
+    const string& sequence = alignment.sequence();
+    const string& base_quality = alignment.quality();
+    if (base_quality.size() != sequence.size()) {
+        profile_out.clear();
+        return;
+    }
+    profile_out.resize(5 * sequence.size());
+    for (size_t i = 0; i < sequence.size(); i++) {
+        // qualities above the top of the score matrix get the top quality's scores
+        size_t qual = min<size_t>((uint8_t) base_quality[i], max_qual_score);
+        memcpy(&profile_out[5 * i], &profile_blocks[25 * qual + 5 * nt_table[sequence[i]]], 5);
+    }
+}
+
 void QualAdjAligner::align_internal(Alignment& alignment, vector<Alignment>* multi_alignments, Graph& g,
                                     bool pinned, bool pin_left, int32_t max_alt_alns, bool traceback_aln, bool print_score_matrices) {
     
@@ -1480,6 +1710,58 @@ void QualAdjAligner::align(Alignment& alignment, Graph& g, bool traceback_aln, b
     align_internal(alignment, nullptr, g, false, false, 1, traceback_aln, print_score_matrices);
 }
 
+void QualAdjAligner::align(Alignment& alignment, const HandleGraph& g, bool traceback_aln, bool print_score_matrices,
+                          const vector<handle_t>* topological_order) {
+    
+    if (alignment.quality().length() != alignment.sequence().length()) {
+        cerr << "error:[QualAdjAligner] Read " << alignment.name() << " has sequence and quality strings with different lengths. Cannot perform base quality adjusted alignment. Consider toggling off base quality adjusted alignment at the command line." << endl;
+        exit(EXIT_FAILURE);
+    }
+    
+    vector<handle_t> computed_order;
+    if (!topological_order) {
+        computed_order = algorithms::topological_order(&g);
+        topological_order = &computed_order;
+    }
+    
+    // convert into gssw graph
+    vector<string> sequences;
+    gssw_graph* graph = create_gssw_graph(g, *topological_order, sequences);
+    
+    // perform dynamic programming
+    gssw_graph_fill_pinned_qual_adj(graph, alignment.sequence().c_str(), alignment.quality().c_str(), nt_table, score_matrix,
+        gap_open, gap_extension, full_length_bonus, full_length_bonus, 15, 2, traceback_aln);
+    
+    if (traceback_aln) {
+        // trace back local alignment
+        gssw_graph_mapping* gm = gssw_graph_trace_back_qual_adj(graph,
+                                                 alignment.sequence().c_str(),
+                                                 alignment.quality().c_str(),
+                                                 alignment.sequence().size(),
+                                                 nt_table,
+                                                 score_matrix,
+                                                 gap_open,
+                                                 gap_extension,
+                                                 full_length_bonus,
+                                                 full_length_bonus);
+        
+        gssw_mapping_to_alignment(graph, gm, alignment, false, false, print_score_matrices);
+        gssw_graph_mapping_destroy(gm);
+    } else {
+        // get the alignment position and score
+        alignment.set_score(graph->max_node->alignment->score1);
+        Mapping* m = alignment.mutable_path()->add_mapping();
+        Position* p = m->mutable_position();
+        p->set_node_id(graph->max_node->id);
+        p->set_offset(graph->max_node->alignment->ref_end1); // mark end position; for de-duplication
+    }
+    
+    gssw_graph_destroy(graph);
+    
+    // the node IDs are right, but some of them may have been aligned to on their reverse strands
+    orient_mappings(alignment, g, *topological_order);
+}
+
 void QualAdjAligner::align_pinned(Alignment& alignment, Graph& g, bool pin_left) {
 
     align_internal(alignment, nullptr, g, true, pin_left, 1, true, false);
@@ -1494,27 +1776,21 @@ void QualAdjAligner::align_pinned_multi(Alignment& alignment, vector<Alignment>&
 void QualAdjAligner::align_global_banded(Alignment& alignment, Graph& g,
                                          int32_t band_padding, bool permissive_banding) {
     
-    BandedGlobalAligner<int16_t> band_graph = BandedGlobalAligner<int16_t>(alignment,
-                                                                           g,
-                                                                           band_padding,
-                                                                           permissive_banding,
-                                                                           true);
-    
-    band_graph.align(score_matrix, nt_table, gap_open, gap_extension);
+    vector<int8_t> profile;
+    query_profile(alignment, profile);
+    align_global_banded_narrowest(alignment, nullptr, g, 0, band_padding, permissive_banding, true,
+                                  score_matrix, 25 * (max_qual_score + 1), nt_table, gap_open, gap_extension,
+                                  profile.empty() ? nullptr : profile.data());
 }
 
 void QualAdjAligner::align_global_banded_multi(Alignment& alignment, vector<Alignment>& alt_alignments, Graph& g,
                                                int32_t max_alt_alns, int32_t band_padding, bool permissive_banding) {
     
-    BandedGlobalAligner<int16_t> band_graph = BandedGlobalAligner<int16_t>(alignment,
-                                                                           g,
-                                                                           alt_alignments,
-                                                                           max_alt_alns,
-                                                                           band_padding,
-                                                                           permissive_banding,
-                                                                           true);
-    
-    band_graph.align(score_matrix, nt_table, gap_open, gap_extension);
+    vector<int8_t> profile;
+    query_profile(alignment, profile);
+    align_global_banded_narrowest(alignment, &alt_alignments, g, max_alt_alns, band_padding, permissive_banding,
+                                  true, score_matrix, 25 * (max_qual_score + 1), nt_table, gap_open, gap_extension,
+                                  profile.empty() ? nullptr : profile.data());
 }
 
 // X-drop aligner
@@ -1526,6 +1802,10 @@ void QualAdjAligner::align_xdrop_multi(Alignment& alignment, Graph& g, const vec
 {
 }
 
+void QualAdjAligner::align_xdrop(Alignment& alignment, const HandleGraph& g, const vector<MaximalExactMatch>& mems, bool multithreaded)
+{
+}
+
 int32_t QualAdjAligner::score_exact_match(const Alignment& aln, size_t read_offset, size_t length) const {
     auto& sequence = aln.sequence();
     auto& base_quality = aln.quality();
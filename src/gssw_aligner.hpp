@@ -2,6 +2,10 @@
 #define VG_GSSW_ALIGNER_HPP_INCLUDED
 
 #include <algorithm>
+#include <array>
+#include <cstring>
+#include <memory>
+#include <mutex>
 #include <utility>
 #include <vector>
 #include <set>
@@ -46,6 +50,13 @@ namespace vg {
         // for construction
         // needed when constructing an alignable graph from the nodes
         gssw_graph* create_gssw_graph(Graph& g);
+        // make a gssw graph straight from a handle graph, laying the nodes out in the given order and
+        // keeping the oriented node sequences in sequences
+        gssw_graph* create_gssw_graph(const HandleGraph& g, const vector<handle_t>& order,
+                                      vector<string>& sequences);
+        // mark the mappings on nodes that were aligned in reverse orientation after a traceback
+        // through a handle graph
+        void orient_mappings(Alignment& alignment, const HandleGraph& g, const vector<handle_t>& order);
         void visit_node(gssw_node* node,
                         list<gssw_node*>& sorted_nodes,
                         set<gssw_node*>& unmarked_nodes,
@@ -78,6 +89,14 @@ namespace vg {
         /// Sets max_idx_out to the index of that score in the vector. May
         /// modify the input vector.
         static double maximum_mapping_quality_approx(vector<double>& scaled_scores, size_t* max_idx_out);
+        /// Compute the mapping quality of the maximal score among count raw
+        /// (unscaled) integer alignment scores, without allocating. Sets
+        /// max_idx_out to the index of the first maximal score. Requires
+        /// log_base to have been set.
+        double maximum_mapping_quality_exact(const int32_t* scores, size_t count, size_t* max_idx_out) const;
+        /// Approximate the mapping quality of the maximal score among count raw
+        /// integer alignment scores, without allocating.
+        double maximum_mapping_quality_approx(const int32_t* scores, size_t count, size_t* max_idx_out) const;
     protected:
         double group_mapping_quality_exact(vector<double>& scaled_scores, vector<size_t>& group);
         double estimate_next_best_score(int length, double min_diffs);
@@ -98,6 +117,13 @@ namespace vg {
         /// Assumes that graph is topologically sorted by node index.
         virtual void align(Alignment& alignment, Graph& g, bool traceback_aln, bool print_score_matrices) = 0;
         
+        /// Store optimal local alignment against a handle graph in the Alignment object, without
+        /// converting it to a protobuf Graph. Nodes are visited in the given topological order (which
+        /// may visit nodes in reverse orientation), or in one computed here if none is given. Edges that
+        /// do not go forward in the order are ignored, so the graph should be acyclic.
+        virtual void align(Alignment& alignment, const HandleGraph& g, bool traceback_aln, bool print_score_matrices,
+                           const vector<handle_t>* topological_order = nullptr) = 0;
+        
         // store optimal alignment against a graph in the Alignment object with one end of the sequence
         // guaranteed to align to a source/sink node
         //
@@ -135,6 +161,8 @@ namespace vg {
         // xdrop aligner
         virtual void align_xdrop(Alignment& alignment, Graph& g, const vector<MaximalExactMatch>& mems, bool reverse_complemented, bool multithreaded) = 0;
         virtual void align_xdrop_multi(Alignment& alignment, Graph& g, const vector<MaximalExactMatch>& mems, bool reverse_complemented, int32_t max_alt_alns) = 0;
+        /// X-drop seed-and-extend from the longest MEM directly over a handle graph, without extracting a subgraph
+        virtual void align_xdrop(Alignment& alignment, const HandleGraph& g, const vector<MaximalExactMatch>& mems, bool multithreaded) = 0;
 
         /// Compute the score of an exact match in the given alignment, from the
         /// given offset, of the given length.
@@ -239,6 +267,14 @@ namespace vg {
         // log of the base of the logarithm underlying the log-odds interpretation of the scores
         double log_base = 0.0;
         
+    protected:
+        /// Score deficits from the best alignment beyond this are rare enough
+        /// not to be worth tabulating
+        static const size_t max_tabulated_score_deficit = 1023;
+        /// The likelihood of an alignment scoring d less than the best,
+        /// relative to the best, indexed by d. Filled in along with log_base.
+        vector<double> score_deficit_likelihoods;
+        
     };
     
     /**
@@ -255,6 +291,21 @@ namespace vg {
 
         // members
         XdropAligner xdrop;
+        
+        /// Copies of xdrop, with their own working buffers, that no thread is
+        /// using right now. Threads borrow one for each multithreaded X-drop
+        /// alignment, so the buffers persist between calls. Copies of the
+        /// Aligner share the pool.
+        struct XdropPool {
+            mutex lock;
+            vector<unique_ptr<XdropAligner>> idle;
+        };
+        shared_ptr<XdropPool> xdrop_pool;
+        
+        /// Get an idle copy of xdrop from the pool, or make one.
+        unique_ptr<XdropAligner> borrow_xdrop();
+        /// Put a copy of xdrop back in the pool.
+        void return_xdrop(unique_ptr<XdropAligner>&& borrowed);
         // bench_t bench;
     public:
         Aligner(int8_t _match = default_match,
@@ -278,6 +329,11 @@ namespace vg {
         /// Assumes that graph is topologically sorted by node index.
         void align(Alignment& alignment, Graph& g, bool traceback_aln, bool print_score_matrices);
         
+        /// Store optimal local alignment against a handle graph in the Alignment object, visiting
+        /// nodes in the given topological order, or in one computed here if none is given.
+        void align(Alignment& alignment, const HandleGraph& g, bool traceback_aln, bool print_score_matrices,
+                   const vector<handle_t>* topological_order = nullptr);
+        
         // store optimal alignment against a graph in the Alignment object with one end of the sequence
         // guaranteed to align to a source/sink node
         //
@@ -315,6 +371,7 @@ namespace vg {
         // xdrop aligner
         void align_xdrop(Alignment& alignment, Graph& g, const vector<MaximalExactMatch>& mems, bool reverse_complemented, bool multithreaded);
         void align_xdrop_multi(Alignment& alignment, Graph& g, const vector<MaximalExactMatch>& mems, bool reverse_complemented, int32_t max_alt_alns);
+        void align_xdrop(Alignment& alignment, const HandleGraph& g, const vector<MaximalExactMatch>& mems, bool multithreaded);
 
         int32_t score_exact_match(const Alignment& aln, size_t read_offset, size_t length) const;
         int32_t score_exact_match(const string& sequence, const string& base_quality) const;
@@ -346,6 +403,8 @@ namespace vg {
 
         // base quality adjusted counterparts to functions of same name from Aligner
         void align(Alignment& alignment, Graph& g, bool traceback_aln, bool print_score_matrices);
+        void align(Alignment& alignment, const HandleGraph& g, bool traceback_aln, bool print_score_matrices,
+                   const vector<handle_t>* topological_order = nullptr);
         void align_global_banded(Alignment& alignment, Graph& g,
                                  int32_t band_padding = 0, bool permissive_banding = true);
         void align_pinned(Alignment& alignment, Graph& g, bool pin_left);
@@ -356,6 +415,7 @@ namespace vg {
         // xdrop aligner
         void align_xdrop(Alignment& alignment, Graph& g, const vector<MaximalExactMatch>& mems, bool reverse_complemented, bool multithreaded);
         void align_xdrop_multi(Alignment& alignment, Graph& g, const vector<MaximalExactMatch>& mems, bool reverse_complemented, int32_t max_alt_alns);
+        void align_xdrop(Alignment& alignment, const HandleGraph& g, const vector<MaximalExactMatch>& mems, bool multithreaded);
 
         void init_mapping_quality(double gc_content);
         
@@ -367,10 +427,25 @@ namespace vg {
         int32_t score_partial_alignment(const Alignment& alignment, VG& graph, const Path& path,
                                         string::const_iterator seq_begin) const;
         
+        /// Fill profile_out with the quality adjusted score of each base of the read against each
+        /// reference base (ACGTN), 5 entries per read base, by gathering the precomputed blocks for
+        /// each base's quality. Leaves it empty if the read's qualities don't match its sequence.
+        void query_profile(const Alignment& alignment, vector<int8_t>& profile_out) const;
+        
         uint8_t max_qual_score;
         int8_t scale_factor;
         
     private:
+        
+        /// The most distinct base qualities there can be profile blocks for
+        static constexpr size_t max_profile_qualities = 256;
+        
+        /// Precompute the profile blocks from the score matrix.
+        void init_profile_blocks();
+        
+        /// For each base quality and read base, the 5 scores against ACGTN, so that profiles for
+        /// reads can be gathered instead of recomputed from the score matrix
+        array<int8_t, 25 * max_profile_qualities> profile_blocks;
 
         void align_internal(Alignment& alignment, vector<Alignment>* multi_alignments, Graph& g,
                             bool pinned, bool pin_left, int32_t max_alt_alns,
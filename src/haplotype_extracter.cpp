@@ -1,7 +1,10 @@
+#include <algorithm>
 #include <iostream>
+#include <iterator>
 #include "vg.hpp"
 #include "haplotype_extracter.hpp"
 #include "json2pb.h"
+#include "utility.hpp"
 #include "xg.hpp"
 
 namespace vg {
@@ -53,8 +56,8 @@ void output_haplotype_counts(ostream& annotation_ostream,
 
 Graph output_graph_with_embedded_paths(vector<pair<thread_t,int>>& haplotype_list, xg::XG& index) {
   Graph g;
-  set<int64_t> nodes;
-  set<pair<int,int> > edges;
+  vector<int64_t> nodes;
+  vector<pair<xg::side_t,xg::side_t> > edges;
   for(int i = 0; i < haplotype_list.size(); i++) {
     add_thread_nodes_to_set(haplotype_list[i].first, nodes);
     add_thread_edges_to_set(haplotype_list[i].first, edges);
@@ -82,52 +85,48 @@ void output_graph_with_embedded_paths(ostream& subgraph_ostream,
 }
 
 void thread_to_graph_spanned(thread_t& t, Graph& g, xg::XG& index) {
-  set<int64_t> nodes;
-  set<pair<int,int> > edges;
-  nodes.insert(t[0].node_id);
-  for(int i = 1; i < t.size(); i++) {
-    nodes.insert(t[i].node_id);
-    edges.insert(make_pair(xg::make_side(t[i-1].node_id,t[i-1].is_reverse), 
-              xg::make_side(t[i].node_id,t[i].is_reverse)));
-	}
- 	for (auto& n : nodes) {
-    *g.add_node() = index.node(n);
- 	}
-  for (auto& e : edges) {
-    Edge edge;
-    edge.set_from(xg::side_id(e.first));
-    edge.set_from_start(xg::side_is_end(e.first));
-    edge.set_to(xg::side_id(e.second));
-    edge.set_to_end(xg::side_is_end(e.second));
-    *g.add_edge() = edge;
-  }
+  vector<int64_t> nodes;
+  vector<pair<xg::side_t,xg::side_t> > edges;
+  add_thread_nodes_to_set(t, nodes);
+  add_thread_edges_to_set(t, edges);
+  construct_graph_from_nodes_and_edges(g, index, nodes, edges);
 }
 
-void add_thread_nodes_to_set(thread_t& t, set<int64_t>& nodes) {
+void add_thread_nodes_to_set(thread_t& t, vector<int64_t>& nodes) {
   for(int i = 0; i < t.size(); i++) {
-    nodes.insert(t[i].node_id);
+    nodes.push_back(t[i].node_id);
   }
 }
 
-void add_thread_edges_to_set(thread_t& t, set<pair<int,int> >& edges) {
+void add_thread_edges_to_set(thread_t& t, vector<pair<xg::side_t,xg::side_t> >& edges) {
   for(int i = 1; i < t.size(); i++) {
-    edges.insert(make_pair(xg::make_side(t[i-1].node_id,t[i-1].is_reverse), 
+    edges.push_back(make_pair(xg::make_side(t[i-1].node_id,t[i-1].is_reverse), 
               xg::make_side(t[i].node_id,t[i].is_reverse)));
   }
 }
 
 void construct_graph_from_nodes_and_edges(Graph& g, xg::XG& index,
-            set<int64_t>& nodes, set<pair<int,int> >& edges) {
+            vector<int64_t>& nodes, vector<pair<xg::side_t,xg::side_t> >& edges) {
+  // Make the flat sets into sets
+  sort(nodes.begin(), nodes.end());
+  nodes.erase(unique(nodes.begin(), nodes.end()), nodes.end());
+  sort(edges.begin(), edges.end());
+  edges.erase(unique(edges.begin(), edges.end()), edges.end());
+
+  g.mutable_node()->Reserve(g.node_size() + nodes.size());
   for (auto& n : nodes) {
-	   *g.add_node() = index.node(n);
- 	}
+    handle_t handle = index.get_handle(n, false);
+    Node* node = g.add_node();
+    node->set_id(n);
+    node->set_sequence(index.get_sequence(handle));
+  }
+  g.mutable_edge()->Reserve(g.edge_size() + edges.size());
   for (auto& e : edges) {
-    Edge edge;
-    edge.set_from(xg::side_id(e.first));
-    edge.set_from_start(xg::side_is_end(e.first));
-    edge.set_to(xg::side_id(e.second));
-    edge.set_to_end(xg::side_is_end(e.second));
-    *g.add_edge() = edge;
+    Edge* edge = g.add_edge();
+    edge->set_from(xg::side_id(e.first));
+    edge->set_from_start(xg::side_is_end(e.first));
+    edge->set_to(xg::side_id(e.second));
+    edge->set_to_end(xg::side_is_end(e.second));
   }
 }
 
@@ -154,65 +153,138 @@ Path path_from_thread_t(thread_t& t, xg::XG& index) {
     return toReturn;
 }
 
-vector<pair<thread_t,int> > list_haplotypes(xg::XG& index,
-            xg::XG::ThreadMapping start_node, int extend_distance) {
-  vector<pair<thread_t,xg::XG::ThreadSearchState> > search_intermediates;
-  vector<pair<thread_t,int> > search_results;
-  thread_t first_thread = {start_node};
-  xg::XG::ThreadSearchState first_state;
-  index.extend_search(first_state,first_thread);
-  vector<Edge> edges = start_node.is_reverse ?
-            index.edges_on_start(start_node.node_id) :
-            index.edges_on_end(start_node.node_id);
-  for(int i = 0; i < edges.size(); i++) {
-    xg::XG::ThreadMapping next_node;
-    next_node.node_id = edges[i].to();
-    next_node.is_reverse = edges[i].to_end();
-    xg::XG::ThreadSearchState new_state = first_state;
-    thread_t t = {next_node};
-    index.extend_search(new_state, t);
-    thread_t new_thread = first_thread;
-    new_thread.push_back(next_node);
-    if(!new_state.is_empty()) {
-      search_intermediates.push_back(make_pair(new_thread,new_state));
+/// Trace all the sub-haplotypes of at most extend_distance nodes starting at
+/// start_node, using extend to narrow a search state to the haplotypes
+/// continuing through a node, is_empty to tell if it has run out of
+/// haplotypes, and count to get how many are left. Independent branches are
+/// traced in parallel, and the results come out in the same order as tracing
+/// them one at a time, depth first.
+template<class State, class Extend, class IsEmpty, class Count>
+static vector<pair<thread_t,int> > trace_haplotypes(xg::XG& index, xg::XG::ThreadMapping start_node,
+                                                    const State& start_state, int extend_distance,
+                                                    const Extend& extend, const IsEmpty& is_empty,
+                                                    const Count& count) {
+
+  // A haplotype that is either done, with its count, or still to be
+  // extended, with its search state
+  struct Trace {
+    thread_t thread;
+    State state;
+    bool done;
+    int count;
+  };
+
+  // Extend a partial haplotype along each edge off its end, putting the finished
+  // ones in done and the ones to extend further in pending, in edge order.
+  // The start node gets no length check and can't be finished by itself.
+  auto step = [&](const thread_t& thread, const State& state, bool is_start,
+                  vector<Trace>& done, vector<Trace>& pending) {
+    vector<Edge> edges = thread.back().is_reverse ?
+              index.edges_on_start(thread.back().node_id) :
+              index.edges_on_end(thread.back().node_id);
+    if(edges.size() == 0 && !is_start) {
+      done.push_back({thread, state, true, count(state)});
+      return;
     }
-  }
-  while(search_intermediates.size() > 0) {
-    pair<thread_t,xg::XG::ThreadSearchState> last = search_intermediates.back();
-    search_intermediates.pop_back();
-    int check_size = search_intermediates.size();
-    vector<Edge> edges = last.first.back().is_reverse ?
-              index.edges_on_start(last.first.back().node_id) :
-              index.edges_on_end(last.first.back().node_id);
-    if(edges.size() == 0) {
-      search_results.push_back(make_pair(last.first,last.second.count()));
-    } else {
-      for(int i = 0; i < edges.size(); i++) {
-        xg::XG::ThreadMapping next_node;
-        next_node.node_id = edges[i].to();
-        next_node.is_reverse = edges[i].to_end();
-        xg::XG::ThreadSearchState new_state = last.second;
-        thread_t next_thread = {next_node};
-        index.extend_search(new_state,next_thread);
-        thread_t new_thread = last.first;
-        new_thread.push_back(next_node);
-        if(!new_state.is_empty()) {
-          if(new_thread.size() >= extend_distance) {
-            search_results.push_back(make_pair(new_thread,new_state.count()));
-          } else {
-            search_intermediates.push_back(make_pair(new_thread,new_state));
-          }
-        }
+    size_t pending_before = pending.size();
+    for(int i = 0; i < edges.size(); i++) {
+      xg::XG::ThreadMapping next_node;
+      next_node.node_id = edges[i].to();
+      next_node.is_reverse = edges[i].to_end();
+      State new_state = extend(state, next_node);
+      if(is_empty(new_state)) {
+        continue;
+      }
+      thread_t new_thread = thread;
+      new_thread.push_back(next_node);
+      if(!is_start && new_thread.size() >= extend_distance) {
+        done.push_back({move(new_thread), new_state, true, count(new_state)});
+      } else {
+        pending.push_back({move(new_thread), new_state, false, 0});
       }
-      if(check_size == search_intermediates.size() &&
-                last.first.size() < extend_distance - 1) {
-        search_results.push_back(make_pair(last.first,last.second.count()));
+    }
+    if(!is_start && pending.size() == pending_before &&
+              thread.size() < extend_distance - 1) {
+      done.push_back({thread, state, true, count(state)});
+    }
+  };
+
+  // Trace one partial haplotype to the end, depth first, the last branch first.
+  auto trace_from = [&](Trace& start, vector<pair<thread_t,int> >& results) {
+    vector<Trace> stack{start};
+    vector<Trace> done;
+    while(stack.size() > 0) {
+      Trace last = move(stack.back());
+      stack.pop_back();
+      done.clear();
+      step(last.thread, last.state, false, done, stack);
+      for(auto& trace : done) {
+        results.emplace_back(move(trace.thread), trace.count);
+      }
+    }
+  };
+
+  // Break the search up breadth first, in results order, until there are
+  // enough independent branches to keep all the threads busy.
+  vector<Trace> frontier;
+  {
+    vector<Trace> done;
+    step(thread_t{start_node}, start_state, true, done, frontier);
+    reverse(frontier.begin(), frontier.end());
+  }
+  size_t wanted = 4 * get_thread_count();
+  size_t pending_count = frontier.size();
+  while(pending_count > 0 && pending_count < wanted) {
+    vector<Trace> next_frontier;
+    vector<Trace> done;
+    vector<Trace> pending;
+    pending_count = 0;
+    for(auto& trace : frontier) {
+      if(trace.done) {
+        next_frontier.push_back(move(trace));
+        continue;
       }
+      done.clear();
+      pending.clear();
+      step(trace.thread, trace.state, false, done, pending);
+      pending_count += pending.size();
+      move(done.begin(), done.end(), back_inserter(next_frontier));
+      move(pending.rbegin(), pending.rend(), back_inserter(next_frontier));
     }
+    frontier = move(next_frontier);
+  }
+
+  vector<vector<pair<thread_t,int> > > branch_results(frontier.size());
+#pragma omp parallel for schedule(dynamic, 1)
+  for(size_t i = 0; i < frontier.size(); i++) {
+    if(frontier[i].done) {
+      branch_results[i].emplace_back(move(frontier[i].thread), frontier[i].count);
+    } else {
+      trace_from(frontier[i], branch_results[i]);
+    }
+  }
+
+  vector<pair<thread_t,int> > search_results;
+  for(auto& results : branch_results) {
+    move(results.begin(), results.end(), back_inserter(search_results));
   }
   return search_results;
 }
 
+vector<pair<thread_t,int> > list_haplotypes(xg::XG& index,
+            xg::XG::ThreadMapping start_node, int extend_distance) {
+  xg::XG::ThreadSearchState first_state;
+  index.extend_search(first_state, start_node);
+  return trace_haplotypes(index, start_node, first_state, extend_distance,
+                          [&](const xg::XG::ThreadSearchState& state, const xg::XG::ThreadMapping& next_node) {
+                            xg::XG::ThreadSearchState new_state = state;
+                            index.extend_search(new_state, next_node);
+                            return new_state;
+                          },
+                          [](xg::XG::ThreadSearchState state) { return state.is_empty(); },
+                          [](xg::XG::ThreadSearchState state) { return (int) state.count(); });
+}
+
 vector<pair<thread_t,int> > list_haplotypes(xg::XG& index, const gbwt::GBWT& haplotype_database,
             xg::XG::ThreadMapping start_node, int extend_distance) {
 
@@ -220,83 +292,19 @@ vector<pair<thread_t,int> > list_haplotypes(xg::XG& index, const gbwt::GBWT& hap
   cerr << "Extracting haplotypes from GBWT" << endl;
 #endif
 
-  vector<pair<thread_t,gbwt::SearchState> > search_intermediates;
-  vector<pair<thread_t,int> > search_results;
   // We still keep our data as thread_ts full of xg ThreadMappings and convert on the fly.
-  thread_t first_thread = {start_node};
   auto first_node = gbwt::Node::encode(start_node.node_id, start_node.is_reverse);
   gbwt::SearchState first_state = haplotype_database.find(first_node);
 #ifdef debug
   cerr << "Start with state " << first_state << " for node " << gbwt::Node::id(first_node) << endl;
 #endif
-  vector<Edge> edges = start_node.is_reverse ?
-            index.edges_on_start(start_node.node_id) :
-            index.edges_on_end(start_node.node_id);
-
-  // TODO: this is just most of the loop body repeated!
-  for(int i = 0; i < edges.size(); i++) {
-    xg::XG::ThreadMapping next_node;
-    next_node.node_id = edges[i].to();
-    next_node.is_reverse = edges[i].to_end();
-    auto extend_node = gbwt::Node::encode(next_node.node_id, next_node.is_reverse);
-    auto new_state = haplotype_database.extend(first_state, extend_node);
-#ifdef debug
-    cerr << "Extend state " << first_state << " to " << new_state << " with " << gbwt::Node::id(extend_node) << endl;
-#endif
-    thread_t new_thread = first_thread;
-    new_thread.push_back(next_node);
-    if(!new_state.empty()) {
-#ifdef debug
-      cerr << "\tGot " << new_state.size() << " results; extending more" << endl;
-#endif
-      search_intermediates.push_back(make_pair(new_thread,new_state));
-    }
-  }
-  while(search_intermediates.size() > 0) {
-    pair<thread_t,gbwt::SearchState> last = search_intermediates.back();
-    search_intermediates.pop_back();
-    int check_size = search_intermediates.size();
-    vector<Edge> edges = last.first.back().is_reverse ?
-              index.edges_on_start(last.first.back().node_id) :
-              index.edges_on_end(last.first.back().node_id);
-    if(edges.size() == 0) {
-#ifdef debug
-      cerr << "Hit end of graph on state " << last.second << endl;
-#endif
-      search_results.push_back(make_pair(last.first,last.second.size()));
-    } else {
-      for(int i = 0; i < edges.size(); i++) {
-        xg::XG::ThreadMapping next_node;
-        next_node.node_id = edges[i].to();
-        next_node.is_reverse = edges[i].to_end();
-        auto extend_node = gbwt::Node::encode(next_node.node_id, next_node.is_reverse);
-        auto new_state = haplotype_database.extend(last.second, extend_node);
-#ifdef debug
-        cerr << "Extend state " << last.second << " to " << new_state << " with " << gbwt::Node::id(extend_node) << endl;
-#endif
-        thread_t new_thread = last.first;
-        new_thread.push_back(next_node);
-        if(!new_state.empty()) {
-          if(new_thread.size() >= extend_distance) {
-#ifdef debug
-            cerr << "\tGot " << new_state.size() << " results at limit; emitting" << endl;
-#endif
-            search_results.push_back(make_pair(new_thread,new_state.size()));
-          } else {
-#ifdef debug
-            cerr << "\tGot " << new_state.size() << " results; extending more" << endl;
-#endif
-            search_intermediates.push_back(make_pair(new_thread,new_state));
-          }
-        }
-      }
-      if(check_size == search_intermediates.size() &&
-                last.first.size() < extend_distance - 1) {
-        search_results.push_back(make_pair(last.first,last.second.size()));
-      }
-    }
-  }
-  return search_results;
+  return trace_haplotypes(index, start_node, first_state, extend_distance,
+                          [&](const gbwt::SearchState& state, const xg::XG::ThreadMapping& next_node) {
+                            return haplotype_database.extend(state, gbwt::Node::encode(next_node.node_id,
+                                                                                       next_node.is_reverse));
+                          },
+                          [](const gbwt::SearchState& state) { return state.empty(); },
+                          [](const gbwt::SearchState& state) { return (int) state.size(); });
 }
 
 }
@@ -17,7 +17,8 @@ using namespace std;
 
 using thread_t = vector<xg::XG::ThreadMapping>;
 
-// Walk forward from a node, collecting all haplotypes.  Also do a regular
+// Walk forward from a node, collecting all haplotypes, tracing independent
+// branches in parallel.  Also do a regular
 // subgraph search for all the paths too.  Haplotype thread i will be embedded
 // as Paths a path with name thread_i.  Each path name (including threads) is
 // mapped to a frequency in out_thread_frequencies.  Haplotypes will be pulled
@@ -61,13 +62,15 @@ void output_haplotype_counts(ostream& annotation_ostream,
 
 // Adds to a Graph the nodes and edges touched by a thread_t
 void thread_to_graph_spanned(thread_t& t, Graph& graph, xg::XG& index);
-// Adds to a set of nodes all those touched by thread_t t
-void add_thread_nodes_to_set(thread_t& t, set<int64_t>& nodes);
-// Adds to a set of edges all those touched by thread_t t
-void add_thread_edges_to_set(thread_t& t, set<pair<int,int> >& edges);
-// Turns a set of nodes and a set of edges into a Graph
+// Adds to a flat set of nodes all those touched by thread_t t
+void add_thread_nodes_to_set(thread_t& t, vector<int64_t>& nodes);
+// Adds to a flat set of edges all those touched by thread_t t
+void add_thread_edges_to_set(thread_t& t, vector<pair<xg::side_t,xg::side_t> >& edges);
+// Turns a flat set of nodes and a flat set of edges into a Graph. The sets
+// are vectors that may hold duplicates; they are sorted and deduplicated in
+// place.
 void construct_graph_from_nodes_and_edges(Graph& g, xg::XG& index,
-            set<int64_t>& nodes, set<pair<int,int> >& edges);
+            vector<int64_t>& nodes, vector<pair<xg::side_t,xg::side_t> >& edges);
 
 }
 
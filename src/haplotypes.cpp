@@ -45,22 +45,8 @@ bool haplo_DP_edge_memo::is_null() const {
 }
 
 bool haplo_DP_edge_memo::has_edge(xg::XG& graph, xg::XG::ThreadMapping old_node, xg::XG::ThreadMapping new_node) {
-  vg::Edge edge_taken = xg::make_edge(old_node.node_id, old_node.is_reverse, new_node.node_id, new_node.is_reverse);
-
-  bool edge_found = false;
-
-  const vector<vg::Edge>& edges = old_node.is_reverse ? graph.edges_on_start(old_node.node_id) : 
-                                                   graph.edges_on_end(old_node.node_id);
-  
-  for(auto& edge : edges) {
-    // Look at every edge in order.
-    if(xg::edges_equivalent(edge, edge_taken)) {
-      // If we found the edge we're taking, break.
-      edge_found = true;
-      break;
-    }
-  }
-  return edge_found;  
+  return graph.has_edge(graph.get_handle(old_node.node_id, old_node.is_reverse),
+                        graph.get_handle(new_node.node_id, new_node.is_reverse));
 }
 
 /*******************************************************************************
@@ -147,6 +133,25 @@ size_t gbwt_thread_t::size() const {
   return nodes.size();
 }
 
+size_t gbwt_thread_t::common_prefix(const gbwt_thread_t& other) const {
+  size_t i = 0;
+  while(i < size() && i < other.size() && nodes[i] == other.nodes[i] && node_lengths[i] == other.node_lengths[i]) {
+    i++;
+  }
+  return i;
+}
+
+bool gbwt_thread_t::operator<(const gbwt_thread_t& other) const {
+  size_t i = common_prefix(other);
+  if(i == size() || i == other.size()) {
+    return size() < other.size();
+  }
+  if(nodes[i] != other.nodes[i]) {
+    return nodes[i] < other.nodes[i];
+  }
+  return node_lengths[i] < other.node_lengths[i];
+}
+
 gbwt_thread_t path_to_gbwt_thread_t(const vg::Path& path) {
   gbwt_thread_t t;
   for(size_t i = 0; i < path.mapping_size(); i++) {
@@ -295,12 +300,12 @@ void haplo_DP_column::update_score_vector(haploMath::RRMemo& memo) {
   } else {
     previous_sum = sum;
     int64_t offset = (int64_t)(entries.at(0)->is_new());
-    // TODO optimize by using arrays
-    vector<double> continuing_Rs(entries.size() - offset);
-    vector<int64_t> continuing_counts(entries.size() - offset);
+    size_t n_continuing = entries.size() - offset;
+    continuing_Rs.resize(n_continuing);
+    continuing_counts.resize(n_continuing);
     for(size_t i = offset; i < entries.size(); i++) {
-      continuing_Rs.at(i - offset) = previous_values[entries[i]->prev_idx()];
-      continuing_counts.at(i - offset) = entries[i]->I();
+      continuing_Rs[i - offset] = previous_values[entries[i]->prev_idx()];
+      continuing_counts[i - offset] = entries[i]->I();
     }
     
     double logpS1S2RRS = previous_sum + 
@@ -313,26 +318,38 @@ void haplo_DP_column::update_score_vector(haploMath::RRMemo& memo) {
       r_0->R = logpS1S2RRS;
       i = 1;
     }
+    // These are the same for every entry, so look them up once.
+    double logT_base = memo.logT_base;
+    double logT = memo.logT(length);
     if(length == 1) {
-      for(i; i < entries.size(); i++) {
-        double logLHS = memo.logT_base +
+      for(; i < entries.size(); i++) {
+        double logLHS = logT_base +
                         previous_R(i) +
-                        memo.logT(length);
+                        logT;
         entries[i]->R = haploMath::logsum(logLHS, logpS1S2RRS);
       }
     } else {
-      for(i; i < entries.size(); i++) {
-        double logLHS = memo.logT_base +
-                        haploMath::logsum(logS1RRD, previous_R(i) + memo.logT(length));
+      for(; i < entries.size(); i++) {
+        double logLHS = logT_base +
+                        haploMath::logsum(logS1RRD, previous_R(i) + logT);
         entries[i]->R = haploMath::logsum(logLHS, logpS1S2RRS);
       }
     }
   }
-  previous_values = get_scores();
-  previous_sizes = get_sizes();
+  save_previous();
   sum = haploMath::int_weighted_sum(previous_values, previous_sizes);
 }
 
+void haplo_DP_column::save_previous() {
+  // Refill in place, so we reuse the space from the last column.
+  previous_values.resize(entries.size());
+  previous_sizes.resize(entries.size());
+  for(size_t i = 0; i < entries.size(); i++) {
+    previous_values[i] = entries[i]->R;
+    previous_sizes[i] = entries[i]->I();
+  }
+}
+
 double haplo_DP_column::previous_R(size_t i) const {
   return previous_values[(entries.at(i))->prev_idx()];
 }
@@ -371,6 +388,14 @@ bool haplo_DP_column::is_empty() const {
   return entries.size() == 0;
 }
 
+haplo_DP_column haplo_DP_column::clone() const {
+  haplo_DP_column copy(*this);
+  for(auto& entry : copy.entries) {
+    entry = make_shared<haplo_DP_rectangle>(*entry);
+  }
+  return copy;
+}
+
 /*******************************************************************************
 haplo_DP
 *******************************************************************************/
@@ -411,6 +436,112 @@ haplo_score_type haplo_DP::score(const thread_t& thread, xg::XG& graph, haploMat
   return pair<double, bool>(hdp.DP_column.current_sum(), true);
 }
 
+vector<haplo_score_type> haplo_DP::score_batch(const vector<const vg::Path*>& paths, xg::XG& graph, haploMath::RRMemo& memo) {
+  vector<thread_t> threads;
+  threads.reserve(paths.size());
+  for(auto* path : paths) {
+    threads.push_back(path_to_thread_t(*path));
+  }
+  return score_batch(threads, graph, memo);
+}
+
+void haplo_DP::warn_score_fail(const thread_t& thread, size_t i, xg::XG& graph, haploMath::RRMemo& memo) {
+  if (!warn_on_score_fail) {
+    return;
+  }
+  // Say the same things that score() would for this thread
+  if (i == 0) {
+    cerr << "[WARNING] Initial node in path is visited by 0 reference haplotypes" << endl;
+    cerr << "Cannot compute a meaningful haplotype likelihood score" << endl;
+    hDP_graph_accessor(graph, thread[0], memo).print(cerr);
+  } else {
+    cerr << "[WARNING] Node " << i + 1 << " in path is visited by 0 reference haplotypes" << endl;
+    cerr << "Cannot compute a meaningful haplotype likelihood score" << endl;
+    hDP_graph_accessor(graph, thread[i-1], thread[i], memo).print(cerr);
+  }
+}
+
+vector<haplo_score_type> haplo_DP::score_batch(const vector<thread_t>& threads, xg::XG& graph, haploMath::RRMemo& memo) {
+  vector<haplo_score_type> scores(threads.size(), haplo_score_type(nan(""), false));
+  
+  // Visit the threads in sorted order, so that threads sharing a prefix are
+  // next to each other. This walks the trie of the threads depth first.
+  vector<size_t> order(threads.size());
+  iota(order.begin(), order.end(), 0);
+  stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    return threads[a] < threads[b];
+  });
+  
+  auto common_prefix = [](const thread_t& a, const thread_t& b) {
+    size_t i = 0;
+    while(i < a.size() && i < b.size() && a[i].node_id == b[i].node_id && a[i].is_reverse == b[i].is_reverse) {
+      i++;
+    }
+    return i;
+  };
+  
+  // columns[i] holds the DP column after entry i of the current thread, for
+  // each entry also in the next thread. Deeper columns are extended in place.
+  vector<haplo_DP_column> columns;
+  // The entry at which the previous thread could not be scored, if any.
+  size_t failed_at = numeric_limits<size_t>::max();
+  size_t shared = 0;
+  
+  for(size_t k = 0; k < order.size(); k++) {
+    const thread_t& thread = threads[order[k]];
+    // How much of this thread will the next one need?
+    size_t keep = k + 1 < order.size() ? common_prefix(thread, threads[order[k + 1]]) : 0;
+    
+    if(thread.size() == 0) {
+      // Nothing to score; it also sorts first and shares nothing.
+      shared = keep;
+      continue;
+    }
+    
+    if(failed_at < shared) {
+      // We go through the same entry that stopped the last thread.
+      warn_score_fail(thread, failed_at, graph, memo);
+    } else {
+      failed_at = numeric_limits<size_t>::max();
+      for(size_t i = columns.size(); i < thread.size(); i++) {
+        if(i == 0) {
+          hDP_graph_accessor ga_i(graph, thread[0], memo);
+          if(ga_i.new_height() == 0) {
+            failed_at = i;
+            break;
+          }
+          columns.emplace_back(ga_i);
+        } else {
+          hDP_graph_accessor ga(graph, thread[i-1], thread[i], memo);
+          if(ga.new_height() == 0) {
+            failed_at = i;
+            break;
+          }
+          if(i - 1 < keep) {
+            // The next thread needs the column we are extending.
+            columns.push_back(columns.back().clone());
+          }
+          columns.back().extend(ga);
+        }
+      }
+      
+      if(failed_at == numeric_limits<size_t>::max()) {
+        scores[order[k]] = haplo_score_type(columns.back().current_sum(), true);
+      } else {
+        warn_score_fail(thread, failed_at, graph, memo);
+      }
+    }
+    
+    // Drop the columns the next thread can't use.
+    if(columns.size() > keep) {
+      columns.erase(columns.begin() + keep, columns.end());
+    }
+    shared = keep;
+  }
+  
+  return scores;
+}
+
 haplo_DP_column* haplo_DP::get_current_column() {
   return &DP_column;
 }
@@ -809,6 +940,19 @@ haplo_score_type linear_haplo_structure::score(const vg::Path& path) const {
   return(to_return);
 }
 
+/*******************************************************************************
+ScoreProvider
+*******************************************************************************/
+
+vector<pair<double, bool>> ScoreProvider::score_batch(const vector<const vg::Path*>& paths, haploMath::RRMemo& memo) {
+  vector<pair<double, bool>> scores;
+  scores.reserve(paths.size());
+  for(auto* path : paths) {
+    scores.push_back(score(*path, memo));
+  }
+  return scores;
+}
+
 /*******************************************************************************
 XGScoreProvider
 *******************************************************************************/
@@ -821,6 +965,10 @@ pair<double, bool> XGScoreProvider::score(const vg::Path& path, haploMath::RRMem
   return haplo_DP::score(path, index, memo);
 }
 
+vector<pair<double, bool>> XGScoreProvider::score_batch(const vector<const vg::Path*>& paths, haploMath::RRMemo& memo) {
+  return haplo_DP::score_batch(paths, index, memo);
+}
+
 /*******************************************************************************
 LinearScoreProvider
 *******************************************************************************/
@@ -896,57 +1044,36 @@ double logsum(double a, double b) {
   return a + log1p(exp(b - a));
 }
 
-double int_weighted_sum(double* values, int64_t* counts, size_t n_values) {
+double int_weighted_sum(const double* values, const int64_t* counts, size_t n_values) {
   if(n_values == 0) {
     return 0;
   } else if(n_values == 1) {
     return values[0] + log(counts[0]);
   } else {
-    double max_summand = values[0] + log(counts[0]);
-    int max_index = 0;
-    vector<double> summands;
-    for(int i = 0; i < n_values; i++){
-      summands.push_back(values[i] + log(counts[i]));
-      if(summands.back() > max_summand) {
-        max_summand = summands.back();
+    vector<double> summands(n_values);
+    for(size_t i = 0; i < n_values; i++) {
+      summands[i] = values[i] + log(counts[i]);
+    }
+    size_t max_index = 0;
+    for(size_t i = 1; i < n_values; i++) {
+      if(summands[i] > summands[max_index]) {
         max_index = i;
       }
     }
+    double max_summand = summands[max_index];
+    // Leave the max out of the sum without a branch in the loop, so the loop
+    // can be vectorized. Adding exp(-inf) = 0 doesn't change the sum.
+    summands[max_index] = -numeric_limits<double>::infinity();
     double sum = 0;
-    for(int i = 0; i < summands.size(); i++) {
-      if(i != max_index) {
-        sum += exp(summands[i]-max_summand);
-      }
+    for(size_t i = 0; i < n_values; i++) {
+      sum += exp(summands[i] - max_summand);
     }
     return max_summand + log1p(sum);
   }
 }
 
-
-double int_weighted_sum(vector<double> values, vector<int64_t> counts) {
-  if(values.size() == 0) {
-    return 0;
-  } else if(values.size() == 1) {
-    return values[0] + log(counts[0]);
-  } else {
-    double max_summand = values[0] + log(counts[0]);
-    int max_index = 0;
-    vector<double> summands;
-    for(int i = 0; i < values.size(); i++){
-      summands.push_back(values[i] + log(counts[i]));
-      if(summands.back() > max_summand) {
-        max_summand = summands.back();
-        max_index = i;
-      }
-    }
-    double sum = 0;
-    for(int i = 0; i < summands.size(); i++) {
-      if(i != max_index) {
-        sum += exp(summands[i]-max_summand);
-      }
-    }
-    return max_summand + log1p(sum);
-  }
+double int_weighted_sum(const vector<double>& values, const vector<int64_t>& counts) {
+  return int_weighted_sum(values.data(), counts.data(), values.size());
 }
 
 double RRMemo::logT(int width) {
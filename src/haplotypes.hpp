@@ -1,7 +1,10 @@
 #ifndef HAPLOTYPE_FWD_ALG_H
 #define HAPLOTYPE_FWD_ALG_H
 
+#include <algorithm>
 #include <cmath>
+#include <limits>
+#include <numeric>
 #include <vector>
 #include <iostream>
 
@@ -67,8 +70,8 @@ using thread_t = vector<xg::XG::ThreadMapping>;
 namespace haploMath{
   double logsum(double a, double b);
   double logdiff(double a, double b);
-  double int_weighted_sum(vector<double> values, vector<int64_t> counts);
-  double int_weighted_sum(double* values, int64_t* counts, size_t n_entries);
+  double int_weighted_sum(const vector<double>& values, const vector<int64_t>& counts);
+  double int_weighted_sum(const double* values, const int64_t* counts, size_t n_entries);
 
   // ---------------------------------------------------------------------------
   //  RRMemo
@@ -183,6 +186,10 @@ public:
   const gbwt::vector_type::value_type& back() const;
   size_t nodelength(size_t i) const;
   size_t size() const;
+  // number of leading entries, by node and node length, shared with other
+  size_t common_prefix(const gbwt_thread_t& other) const;
+  // lexicographic order by node and then node length at each entry
+  bool operator<(const gbwt_thread_t& other) const;
 };
 
 gbwt_thread_t path_to_gbwt_thread_t(const vg::Path& path);
@@ -254,6 +261,9 @@ struct haplo_DP_column {
 private:
   vector<double> previous_values;
   vector<int64_t> previous_sizes;
+  // scratch space for update_score_vector, kept to avoid reallocating
+  vector<double> continuing_Rs;
+  vector<int64_t> continuing_counts;
   vector<shared_ptr<haplo_DP_rectangle>> entries;
   double previous_sum;
   double sum;
@@ -267,6 +277,8 @@ private:
   void standard_extend(accessorType& ga);
   void update_inner_values();
   void update_score_vector(haploMath::RRMemo& memo);
+  // copy the entries' scores and sizes into previous_values and previous_sizes
+  void save_previous();
   double previous_R(size_t i) const;
 public:
   template<class accessorType>
@@ -279,6 +291,9 @@ public:
   double current_sum() const;
   void print(ostream& out) const;
   bool is_empty() const;
+  // copy with its own rectangles, so that extending the copy leaves this
+  // column alone
+  haplo_DP_column clone() const;
 };
 
 thread_t path_to_thread_t(const vg::Path& path);
@@ -302,6 +317,11 @@ public:
   static haplo_score_type score(const vg::Path& path, xg::XG& graph, haploMath::RRMemo& memo);
   template<class GBWTType>
   static haplo_score_type score(const vg::Path& path, GBWTType& graph, haploMath::RRMemo& memo);
+  // Scores many paths at once, giving the same results as scoring them one at
+  // a time. Work on prefixes shared between paths is done once for them all.
+  template<class GBWTType>
+  static vector<haplo_score_type> score_batch(const vector<const vg::Path*>& paths, GBWTType& graph, haploMath::RRMemo& memo);
+  static vector<haplo_score_type> score_batch(const vector<const vg::Path*>& paths, xg::XG& graph, haploMath::RRMemo& memo);
 //------------------------------------------------------------------------------
 
 // public member functions which are not part of the API
@@ -309,8 +329,15 @@ public:
   haplo_DP(accessorType& ga);
   haplo_DP_column* get_current_column();
   static haplo_score_type score(const thread_t& thread, xg::XG& graph, haploMath::RRMemo& memo);
+  static vector<haplo_score_type> score_batch(const vector<thread_t>& threads, xg::XG& graph, haploMath::RRMemo& memo);
   template<class GBWTType>
   static haplo_score_type score(const gbwt_thread_t& thread, GBWTType& graph, haploMath::RRMemo& memo);
+  template<class GBWTType>
+  static vector<haplo_score_type> score_batch(const vector<gbwt_thread_t>& threads, GBWTType& graph, haploMath::RRMemo& memo);
+private:
+  template<class GBWTType>
+  static void warn_score_fail(const gbwt_thread_t& thread, size_t i, GBWTType& graph, haploMath::RRMemo& memo);
+  static void warn_score_fail(const thread_t& thread, size_t i, xg::XG& graph, haploMath::RRMemo& memo);
 };
 
 //------------------------------------------------------------------------------
@@ -380,6 +407,10 @@ public:
 class ScoreProvider {
 public:
   virtual pair<double, bool> score(const vg::Path&, haploMath::RRMemo& memo) = 0;
+  /// Score a batch of paths, returning the scores in the same order. The
+  /// default just scores them one at a time; implementations which can share
+  /// work between paths with common prefixes override it.
+  virtual vector<pair<double, bool>> score_batch(const vector<const vg::Path*>& paths, haploMath::RRMemo& memo);
   virtual ~ScoreProvider() = default;
 };
 
@@ -388,6 +419,7 @@ class XGScoreProvider : public ScoreProvider {
 public:
   XGScoreProvider(xg::XG& index);
   pair<double, bool> score(const vg::Path&, haploMath::RRMemo& memo);
+  vector<pair<double, bool>> score_batch(const vector<const vg::Path*>& paths, haploMath::RRMemo& memo);
 private:
   xg::XG& index;
 };
@@ -398,6 +430,7 @@ class GBWTScoreProvider : public ScoreProvider {
 public:
   GBWTScoreProvider(GBWTType& index);
   pair<double, bool> score(const vg::Path&, haploMath::RRMemo& memo);
+  vector<pair<double, bool>> score_batch(const vector<const vg::Path*>& paths, haploMath::RRMemo& memo);
 private:
   GBWTType& index;
 };
@@ -506,8 +539,7 @@ haplo_DP_column::haplo_DP_column(accessorType& ga) {
 
 template<class accessorType>
 void haplo_DP_column::standard_extend(accessorType& ga) {
-  previous_values = get_scores();
-  previous_sizes = get_sizes();
+  save_previous();
   haplo_DP_rectangle* new_rectangle = new haplo_DP_rectangle(ga.inclusive_interval());
   new_rectangle->extend(ga);
   decltype(entries) new_entries;
@@ -616,6 +648,118 @@ haplo_score_type haplo_DP::score(const gbwt_thread_t& thread, GBWTType& graph, h
   return pair<double, bool>(hdp.DP_column.current_sum(), true);
 }
 
+template<class GBWTType>
+vector<haplo_score_type> haplo_DP::score_batch(const vector<const vg::Path*>& paths, GBWTType& graph, haploMath::RRMemo& memo) {
+  vector<gbwt_thread_t> threads;
+  threads.reserve(paths.size());
+  for(auto* path : paths) {
+    threads.push_back(path_to_gbwt_thread_t(*path));
+  }
+  return score_batch(threads, graph, memo);
+}
+
+template<class GBWTType>
+void haplo_DP::warn_score_fail(const gbwt_thread_t& thread, size_t i, GBWTType& graph, haploMath::RRMemo& memo) {
+  if (!warn_on_score_fail) {
+    return;
+  }
+  // Say the same things that score() would for this thread
+  if (!graph.contains(thread[i])) {
+    if (i == 0) {
+      cerr << "[WARNING] Path starts outside of haplotype index and cannot be scored" << endl;
+    } else {
+      cerr << "[WARNING] Node " << i + 1 << " in path leaves haplotype index and cannot be scored" << endl;
+    }
+    cerr << "Cannot compute a meaningful haplotype likelihood score" << endl;
+  } else if (i == 0) {
+    cerr << "[WARNING] Initial node in path is visited by 0 reference haplotypes" << endl;
+    cerr << "Cannot compute a meaningful haplotype likelihood score" << endl;
+    hDP_gbwt_graph_accessor<GBWTType>(graph, thread[0], thread.nodelength(0), memo).print(cerr);
+  } else {
+    cerr << "[WARNING] Node " << i + 1 << " in path is visited by 0 reference haplotypes" << endl;
+    cerr << "Cannot compute a meaningful haplotype likelihood score" << endl;
+    hDP_gbwt_graph_accessor<GBWTType>(graph, thread[i-1], thread[i], thread.nodelength(i), memo).print(cerr);
+  }
+}
+
+template<class GBWTType>
+vector<haplo_score_type> haplo_DP::score_batch(const vector<gbwt_thread_t>& threads, GBWTType& graph, haploMath::RRMemo& memo) {
+  vector<haplo_score_type> scores(threads.size(), haplo_score_type(nan(""), false));
+  
+  // Visit the threads in sorted order, so that threads sharing a prefix are
+  // next to each other. This walks the trie of the threads depth first.
+  vector<size_t> order(threads.size());
+  iota(order.begin(), order.end(), 0);
+  stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    return threads[a] < threads[b];
+  });
+  
+  // columns[i] holds the DP column after entry i of the current thread, for
+  // each entry also in the next thread. Deeper columns are extended in place.
+  vector<haplo_DP_column> columns;
+  // The entry at which the previous thread could not be scored, if any.
+  size_t failed_at = numeric_limits<size_t>::max();
+  size_t shared = 0;
+  
+  for(size_t k = 0; k < order.size(); k++) {
+    const gbwt_thread_t& thread = threads[order[k]];
+    // How much of this thread will the next one need?
+    size_t keep = k + 1 < order.size() ? thread.common_prefix(threads[order[k + 1]]) : 0;
+    
+    if(thread.size() == 0) {
+      // Nothing to score; it also sorts first and shares nothing.
+      shared = keep;
+      continue;
+    }
+    
+    if(failed_at < shared) {
+      // We go through the same entry that stopped the last thread.
+      warn_score_fail(thread, failed_at, graph, memo);
+    } else {
+      failed_at = numeric_limits<size_t>::max();
+      for(size_t i = columns.size(); i < thread.size(); i++) {
+        if (!graph.contains(thread[i])) {
+          failed_at = i;
+          break;
+        }
+        if(i == 0) {
+          hDP_gbwt_graph_accessor<GBWTType> ga_i(graph, thread[0], thread.nodelength(0), memo);
+          if(ga_i.new_height() == 0) {
+            failed_at = i;
+            break;
+          }
+          columns.emplace_back(ga_i);
+        } else {
+          hDP_gbwt_graph_accessor<GBWTType> ga(graph, thread[i-1], thread[i], thread.nodelength(i), memo);
+          if(ga.new_height() == 0) {
+            failed_at = i;
+            break;
+          }
+          if(i - 1 < keep) {
+            // The next thread needs the column we are extending.
+            columns.push_back(columns.back().clone());
+          }
+          columns.back().extend(ga);
+        }
+      }
+      
+      if(failed_at == numeric_limits<size_t>::max()) {
+        scores[order[k]] = haplo_score_type(columns.back().current_sum(), true);
+      } else {
+        warn_score_fail(thread, failed_at, graph, memo);
+      }
+    }
+    
+    // Drop the columns the next thread can't use.
+    if(columns.size() > keep) {
+      columns.erase(columns.begin() + keep, columns.end());
+    }
+    shared = keep;
+  }
+  
+  return scores;
+}
+
 
 //------------------------------------------------------------------------------
 
@@ -629,6 +773,11 @@ pair<double, bool> GBWTScoreProvider<GBWTType>::score(const vg::Path& path, hapl
   return haplo_DP::score(path, index, memo);
 }
 
+template<class GBWTType>
+vector<pair<double, bool>> GBWTScoreProvider<GBWTType>::score_batch(const vector<const vg::Path*>& paths, haploMath::RRMemo& memo) {
+  return haplo_DP::score_batch(paths, index, memo);
+}
+
 
 } // namespace haplo
 
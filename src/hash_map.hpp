@@ -4,6 +4,9 @@
 #include <cstdint>
 #include <tuple>
 #include <type_traits>
+#include <unordered_map>
+
+#include "flat_hash_map.hpp"
 
 // Comment out to use sparse_hash_map and sparse_hash_set instead of
 // dense_hash_map and dense_hash_set.
@@ -263,6 +266,52 @@ public:
 };
 
 
+
+// Maps for the hottest lookups (node and edge indexes, path mappings,
+// clusterer distances), which are keyed on IDs, handles, or pairs of them.
+// They go through a policy, so another implementation can be tried for all
+// of them at once by building with -DVG_HOT_HASH_POLICY=<policy>.
+
+/// std::unordered_map, with the sparsehash calls the hot maps use.
+template<typename K, typename V, typename Hash>
+class unordered_hash_map : public std::unordered_map<K, V, Hash> {
+public:
+    void resize(size_t expected_size) {
+        this->reserve(expected_size);
+    }
+    void clear_no_resize() {
+        this->clear();
+    }
+};
+
+/// Open addressing in flat arrays. The default.
+struct flat_hash_policy {
+    template<typename K, typename V>
+    using map = flat_hash_map<K, V, wang_hash<K>>;
+};
+
+#ifndef USE_DENSE_HASH
+/// The sparse_hash_map that hash_map uses.
+struct sparse_hash_policy {
+    template<typename K, typename V>
+    using map = spp::sparse_hash_map<K, V, wang_hash<K>>;
+};
+#endif
+
+/// Chaining in std::unordered_map.
+struct unordered_hash_policy {
+    template<typename K, typename V>
+    using map = unordered_hash_map<K, V, wang_hash<K>>;
+};
+
+#ifndef VG_HOT_HASH_POLICY
+#define VG_HOT_HASH_POLICY flat_hash_policy
+#endif
+
+template<typename K, typename V, typename Policy = VG_HOT_HASH_POLICY>
+using hot_hash_map = typename Policy::template map<K, V>;
+
+
 }   // namespace vg
 
 #endif
@@ -1,9 +1,13 @@
 #include "homogenizer.hpp"
 
+#include <algorithm>
+#include <memory>
+#include <omp.h>
+
 using namespace std;
 using namespace vg;
 
-void Homogenizer::homogenize(vg::VG* o_graph, xg::XG* xindex, gcsa::GCSA* gcsa_index, gcsa::LCPArray* lcp_index, vg::Index reads_index){
+void Homogenizer::homogenize(vg::VG* o_graph, xg::XG* xindex, gcsa::GCSA* gcsa_index, gcsa::LCPArray* lcp_index, vg::Index& reads_index){
     /**
      * Pattern for SV homogenization
      * 1. Locate SV-indicating reads with Sift. Save them in a gam file
@@ -19,11 +23,13 @@ void Homogenizer::homogenize(vg::VG* o_graph, xg::XG* xindex, gcsa::GCSA* gcsa_i
     }
 
 
-void Homogenizer::homogenize(vg::VG* o_graph, xg::XG* xindex, gcsa::GCSA* gcsa_index, gcsa::LCPArray* lcp_index, Paths cached_paths, int kmer_size){
+void Homogenizer::homogenize(vg::VG* o_graph, xg::XG* xindex, gcsa::GCSA* gcsa_index, gcsa::LCPArray* lcp_index, Paths& cached_paths, int kmer_size){
 
     bool in_mem_path_only = true;
 
     vector<id_t> tips = find_non_ref_tips(o_graph);
+    // Tips are found in parallel; put them in a stable order
+    std::sort(tips.begin(), tips.end());
 
     /* TODO filter by whether a read is on the ref path
     // 2. Cache the reference path(s)
@@ -43,60 +49,71 @@ void Homogenizer::homogenize(vg::VG* o_graph, xg::XG* xindex, gcsa::GCSA* gcsa_i
 
     /* Generate edges/nodes to add to graph */
     //vector<MaximalExactMatch> find_smems(const string& seq);
-    Mapper* mapper;
-    mapper= new Mapper(xindex, gcsa_index, lcp_index);
+    // The indexes are a read-only snapshot of the graph for this whole pass,
+    // so each thread gets its own Mapper over them and tips are searched in
+    // parallel.
+    vector<unique_ptr<Mapper>> mappers(get_thread_count());
+    for (auto& mapper : mappers){
+        mapper = unique_ptr<Mapper>(new Mapper(xindex, gcsa_index, lcp_index));
+    }
 
-    map<vg::id_t, vector<MaximalExactMatch> > matches;
-    map<vg::id_t, string> ref_node_to_clip;
-    vector<string> seqs;
-    for (int i = 0; i < tips.size(); i++){
+    // Why >1? Because we need to match the node AND somewhere else in the graph.
+    vector<char> is_candidate(tips.size(), false);
+#pragma omp parallel for schedule(dynamic, 1)
+    for (size_t i = 0; i < tips.size(); i++){
         Node* n = o_graph->get_node(tips[i]);
         if (n->sequence().length() < 4 || (o_graph->paths).has_node_mapping(n->id())){
             continue;
         }
+        Mapper* mapper = mappers[omp_get_thread_num()].get();
         vector<MaximalExactMatch> m = mapper->find_mems_simple(n->sequence().begin(),
                                                                n->sequence().end(),
                                                                200,
                                                                mapper->min_mem_length);
-        // Why >1? Because we need to match the node AND somewhere else in the graph.
-        if (m.size() > 1){
-            cerr << "POTENTIAL NEW EDGE" << endl;
-            matches[tips[i]] = m;
-            // map<id_t, map<string, set<Mapping*>>> node_mapping;
-            // Get paths of tip
-            set<string> paths_of_tip = cached_paths.of_node(tips[i]);
-            // Find the closest reference node to the tip
-            vg::id_t ref_node = -1;
-
-            for (auto m : paths_of_tip){
-                cerr << m << endl;
-                Path path_of_tip = cached_paths.path(m);
-                if (m == ref_path){
-                    continue;     
-                }
-                else{
-                    bool on_ref = false;
-                    for (int j = 0; j < path_of_tip.mapping_size(); j++){
-                        Mapping nearby_mapping = path_of_tip.mapping(j);
-                        Position pos = nearby_mapping.position();
-                        vg::id_t n_id = pos.node_id();
-                        if (o_graph->paths.has_node_mapping(n_id)){
-                            ref_node = n_id;
-                            on_ref = true;
-                        }
-                        else if (on_ref == false && n_id != tips[i]){
-                            ref_node = n_id;
-                        }
-                        else{
-                            continue;
-                        }
+        is_candidate[i] = m.size() > 1;
+    }
 
+    // Paths aren't safe to share between threads, so find the nearby
+    // reference nodes for the candidates in tip order.
+    map<vg::id_t, string> ref_node_to_clip;
+    for (size_t i = 0; i < tips.size(); i++){
+        if (!is_candidate[i]){
+            continue;
+        }
+        cerr << "POTENTIAL NEW EDGE" << endl;
+        Node* n = o_graph->get_node(tips[i]);
+        // map<id_t, map<string, set<Mapping*>>> node_mapping;
+        // Get paths of tip
+        set<string> paths_of_tip = cached_paths.of_node(tips[i]);
+        // Find the closest reference node to the tip
+        vg::id_t ref_node = -1;
+
+        for (auto& m : paths_of_tip){
+            cerr << m << endl;
+            if (m == ref_path){
+                continue;     
+            }
+            else{
+                bool on_ref = false;
+                // Walk the stored mappings, rather than copying the path out
+                for (auto& nearby_mapping : cached_paths.get_path(m)){
+                    vg::id_t n_id = nearby_mapping.node_id();
+                    if (o_graph->paths.has_node_mapping(n_id)){
+                        ref_node = n_id;
+                        on_ref = true;
+                    }
+                    else if (on_ref == false && n_id != tips[i]){
+                        ref_node = n_id;
+                    }
+                    else{
+                        continue;
                     }
+
                 }
             }
-            if (ref_node != -1){
-                ref_node_to_clip[ref_node] = n->sequence();
-            }
+        }
+        if (ref_node != -1){
+            ref_node_to_clip[ref_node] = n->sequence();
         }
     }
 
@@ -105,38 +122,47 @@ void Homogenizer::homogenize(vg::VG* o_graph, xg::XG* xindex, gcsa::GCSA* gcsa_i
     //need to remove the tips sequences first.
     //cut_tips(tips, o_graph);
 
+    // Align all the clips at once, against the same snapshot
+    vector<const string*> clips;
+    for (auto& x : ref_node_to_clip){
+        clips.push_back(&x.second);
+    }
+    vector<Alignment> clip_alns(clips.size());
+#pragma omp parallel for schedule(dynamic, 1)
+    for (size_t i = 0; i < clips.size(); i++){
+        clip_alns[i] = mappers[omp_get_thread_num()]->align(*clips[i]);
+    }
+
+    // Collect every new path first, so the graph is edited in one batch
     vector<Path> new_p_vec;
-    for (auto x : ref_node_to_clip){
-        Alignment clip_aln;
-        cerr << "Length of softclip: " << x.second.size() << endl;
-        clip_aln = mapper->align(x.second);
+    for (size_t i = 0; i < clip_alns.size(); i++){
+        Alignment& clip_aln = clip_alns[i];
+        cerr << "Length of softclip: " << clips[i]->size() << endl;
         if (clip_aln.score() < 30){
             continue;
         }
         cerr << clip_aln.DebugString();
-        Path new_aln_p = clip_aln.path();
-        //new_p_vec.clear();
-        new_p_vec.push_back(new_aln_p);
+        new_p_vec.push_back(clip_aln.path());
         //for (int i = 0; i < new_aln_p.mapping_size(); i++){
-        //vector<Translation> tras = o_graph->edit(new_p_vec);
-        //translator.load(tras);
-        //o_graph->paths.rebuild_mapping_aux();
         //    Edge * e = o_graph->create_edge(x.first, new_aln_p.mapping(i).position().node_id(), false, false);
          //   o_graph->add_edge(*e);
          //   cerr << "Edge made from " << x.first << " to " << new_aln_p.mapping(i).position().node_id() << endl;
         //}
-        
-        /** Reindex graph and reset mapper **/
-        //delete xindex;
-        //xindex = new xg::XG(o_graph->graph);
-        //delete gcsa_index;
-        //delete lcp_index;
-        //o_graph->build_gcsa_lcp(gcsa_index, lcp_index, kmer_size, in_mem_path_only, false, 2);
-        //delete mapper;
-        //mapper = new Mapper(xindex, gcsa_index, lcp_index);
+    }
 
+    //vector<Translation> tras = o_graph->edit(new_p_vec);
+    //translator.load(tras);
+    //o_graph->paths.rebuild_mapping_aux();
 
-    }
+    /** Reindex graph and reset mappers, once for the whole batch of edits **/
+    //delete xindex;
+    //xindex = new xg::XG(o_graph->graph);
+    //delete gcsa_index;
+    //delete lcp_index;
+    //o_graph->build_gcsa_lcp(gcsa_index, lcp_index, kmer_size, in_mem_path_only, false, 2);
+    //for (auto& mapper : mappers){
+    //    mapper = unique_ptr<Mapper>(new Mapper(xindex, gcsa_index, lcp_index));
+    //}
 
     //vector<vg::id_t> after_tips = find_tips(o_graph);
     //cut_tips(after_tips, o_graph);
@@ -153,7 +179,19 @@ void Homogenizer::homogenize(vg::VG* o_graph, xg::XG* xindex, gcsa::GCSA* gcsa_i
 
 }
 
-void Homogenizer::cut_tips(vector<vg::id_t> tip_ids, vg::VG* graph){
+int Homogenizer::remap(const vector<Alignment>& reads, const vector<unique_ptr<Mapper>>& mappers){
+    // Realign the reads in parallel, each thread with its own Mapper over the
+    // same indexes, and total up their scores.
+    int total_score = 0;
+#pragma omp parallel for schedule(dynamic, 64) reduction(+:total_score)
+    for (size_t i = 0; i < reads.size(); i++){
+        total_score += mappers[omp_get_thread_num()]->align(reads[i].sequence()).score();
+    }
+    return total_score;
+}
+
+void Homogenizer::cut_tips(const vector<vg::id_t>& tip_ids, vg::VG* graph){
+    // Destroy all the nodes, and then clean up all their edges in one sweep
     for (auto i : tip_ids){
         graph->destroy_node(i);
     }
@@ -1,7 +1,8 @@
 #ifndef VG_HOMOGENIZER
-#define VG_HOMOGENIZEER
+#define VG_HOMOGENIZER
 #include <iostream>
 #include <vector>
+#include <memory>
 #include "vg.hpp"
 #include "translator.hpp"
 #include "filter.hpp"
@@ -23,8 +24,8 @@ namespace vg{
              * are remapped, and the process is repeated until the
              * graph becomes stable.
              */
-            void homogenize(vg::VG* graph, xg::XG* xindex, gcsa::GCSA* gcsa_index, gcsa::LCPArray* lcp_index, Paths p, int kmer_size);
-            void homogenize(vg::VG* graph, xg::XG* xindex, gcsa::GCSA* gcsa_index, gcsa::LCPArray* lcp_index, vg::Index reads_index);
+            void homogenize(vg::VG* graph, xg::XG* xindex, gcsa::GCSA* gcsa_index, gcsa::LCPArray* lcp_index, Paths& p, int kmer_size);
+            void homogenize(vg::VG* graph, xg::XG* xindex, gcsa::GCSA* gcsa_index, gcsa::LCPArray* lcp_index, vg::Index& reads_index);
         private:
 
             Translator translator;
@@ -34,13 +35,15 @@ namespace vg{
             /** Find non-ref tips */
             vector<vg::id_t> find_non_ref_tips(vg::VG* graph);
 
-            /** remap a set of Alignments to the graph */
-            int remap(vector<Alignment> reads, vg::VG graph);
+            /** remap a set of Alignments to the graph, in parallel with one
+             * Mapper per thread over the same indexes, and return their
+             * total score */
+            int remap(const vector<Alignment>& reads, const vector<unique_ptr<Mapper>>& mappers);
             /** Remove all tips from the graph.
              * WARNING: may cut head/tail nodes.*/
             void cut_tips(vg::VG* graph);
-            /** Remove specific nodes and their edges from the graph */
-            void cut_tips(vector<id_t> tip_ids, vg::VG* graph);
+            /** Remove specific nodes and their edges from the graph, in one batch */
+            void cut_tips(const vector<id_t>& tip_ids, vg::VG* graph);
             /** Remove non-reference tips from the graph. */
             void cut_nonref_tips(vg::VG* graph);
             
@@ -0,0 +1,90 @@
+#include "huge_pages.hpp"
+
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <sys/mman.h>
+
+// From the kernel's uapi/asm-generic/mman-common.h, for older C libraries
+#ifndef MADV_HUGEPAGE
+#define MADV_HUGEPAGE 14
+#endif
+#ifndef MADV_COLLAPSE
+#define MADV_COLLAPSE 25
+#endif
+
+namespace vg {
+
+using namespace std;
+
+/// The size of a transparent huge page on the platforms we run on
+static const uintptr_t huge_page_size = 2 * 1024 * 1024;
+
+size_t advise_huge_pages(size_t min_bytes) {
+    // Collect the regions first, since advising them may split the mappings
+    // we would be reading
+    vector<pair<uintptr_t, uintptr_t>> regions;
+    ifstream maps("/proc/self/maps");
+    string line;
+    while (getline(maps, line)) {
+        istringstream fields(line);
+        string range, permissions, offset, device, path;
+        uint64_t inode;
+        fields >> range >> permissions >> offset >> device >> inode >> path;
+        if (inode != 0 || permissions.size() < 2 || permissions[1] != 'w'
+            || (!path.empty() && path != "[heap]")) {
+            // Only private anonymous memory is where arrays get allocated
+            continue;
+        }
+        size_t dash = range.find('-');
+        uintptr_t start = stoull(range.substr(0, dash), nullptr, 16);
+        uintptr_t end = stoull(range.substr(dash + 1), nullptr, 16);
+        // Only whole huge pages inside the region can be huge
+        start = (start + huge_page_size - 1) & ~(huge_page_size - 1);
+        end &= ~(huge_page_size - 1);
+        if (end > start && end - start >= min_bytes) {
+            regions.emplace_back(start, end);
+        }
+    }
+
+    size_t advised = 0;
+    for (auto& region : regions) {
+        void* start = (void*) region.first;
+        size_t length = region.second - region.first;
+        if (madvise(start, length, MADV_HUGEPAGE) == 0) {
+            advised += length;
+            // Failure just means the kernel is too old, or it couldn't find
+            // free huge pages right now, in which case they come later.
+            madvise(start, length, MADV_COLLAPSE);
+        }
+    }
+    return advised;
+}
+
+HugePageUsage huge_page_usage() {
+    HugePageUsage usage;
+    ifstream smaps("/proc/self/smaps_rollup");
+    if (!smaps) {
+        smaps.open("/proc/self/smaps");
+    }
+    string line;
+    while (getline(smaps, line)) {
+        // Values are in kB, and smaps has one set per mapping to add up
+        istringstream fields(line);
+        string key;
+        size_t kilobytes = 0;
+        fields >> key >> kilobytes;
+        if (key == "Anonymous:") {
+            usage.anonymous_bytes += kilobytes * 1024;
+        } else if (key == "AnonHugePages:") {
+            usage.huge_page_bytes += kilobytes * 1024;
+        }
+    }
+    return usage;
+}
+
+}
@@ -0,0 +1,37 @@
+#ifndef VG_HUGE_PAGES_HPP_INCLUDED
+#define VG_HUGE_PAGES_HPP_INCLUDED
+
+/// \file huge_pages.hpp
+/// Backing loaded indexes with transparent huge pages, to cut the TLB misses
+/// of random access into large succinct structures.
+
+#include <cstddef>
+
+namespace vg {
+
+using namespace std;
+
+/**
+ * Mark every large anonymous memory region of the process, which is where
+ * loaded indexes keep their arrays, as wanting transparent huge pages, and
+ * where the kernel supports it (Linux 6.1 and up) collapse the pages already
+ * in them into huge pages right away instead of waiting for khugepaged.
+ * Regions smaller than min_bytes are left alone. Returns the number of bytes
+ * advised. Does nothing if transparent huge pages are disabled.
+ */
+size_t advise_huge_pages(size_t min_bytes = 2 * 1024 * 1024);
+
+/// How much of the process's anonymous memory is resident, and how much of
+/// that is in transparent huge pages, in bytes.
+struct HugePageUsage {
+    size_t anonymous_bytes = 0;
+    size_t huge_page_bytes = 0;
+};
+
+/// Measure the process's huge page use, from /proc/self/smaps_rollup or, on
+/// older kernels, /proc/self/smaps. Returns zeroes if neither can be read.
+HugePageUsage huge_page_usage();
+
+}
+
+#endif
@@ -0,0 +1,96 @@
+#include "id_translator.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+/**
+ * \file id_translator.cpp
+ * IDTranslator: renumber node IDs through sorted runs.
+ */
+
+namespace vg {
+
+using namespace std;
+
+void IDTranslator::add_range(id_t first, id_t last) {
+    built = false;
+    if (!runs.empty() && runs.back().second + 1 == first) {
+        // extending the last run is the common case in a dense chunk
+        runs.back().second = last;
+    } else {
+        runs.emplace_back(first, last);
+    }
+}
+
+void IDTranslator::add_ids(const Graph& graph) {
+    // sort the chunk's IDs first, so they collapse into as few runs as possible
+    vector<id_t> ids;
+    ids.reserve(graph.node_size());
+    for (auto& node : graph.node()) {
+        ids.push_back(node.id());
+    }
+    std::sort(ids.begin(), ids.end());
+    for (size_t i = 0; i < ids.size();) {
+        size_t j = i + 1;
+        while (j < ids.size() && ids[j] <= ids[j - 1] + 1) {
+            ++j;
+        }
+        add_range(ids[i], ids[j - 1]);
+        i = j;
+    }
+}
+
+void IDTranslator::add_ids(const IDTranslator& other) {
+    built = false;
+    runs.insert(runs.end(), other.runs.begin(), other.runs.end());
+}
+
+void IDTranslator::build(id_t first_id) {
+    std::sort(runs.begin(), runs.end());
+    // merge runs that overlap or touch
+    size_t merged = 0;
+    for (size_t i = 0; i < runs.size(); ++i) {
+        if (merged > 0 && runs[i].first <= runs[merged - 1].second + 1) {
+            runs[merged - 1].second = max(runs[merged - 1].second, runs[i].second);
+        } else {
+            runs[merged++] = runs[i];
+        }
+    }
+    runs.resize(merged);
+    runs.shrink_to_fit();
+    run_starts.resize(runs.size());
+    id_t next = first_id;
+    for (size_t i = 0; i < runs.size(); ++i) {
+        run_starts[i] = next;
+        next += runs[i].second - runs[i].first + 1;
+    }
+    built = true;
+}
+
+id_t IDTranslator::translate(id_t id) const {
+    if (!built) {
+        throw runtime_error("IDTranslator: translating before the translator is built");
+    }
+    // find the last run starting at or before the ID
+    auto run = std::upper_bound(runs.begin(), runs.end(), make_pair(id, numeric_limits<id_t>::max()));
+    if (run == runs.begin() || (--run)->second < id) {
+        throw runtime_error("IDTranslator: node " + to_string(id) + " is not in the set");
+    }
+    return run_starts[run - runs.begin()] + (id - run->first);
+}
+
+size_t IDTranslator::size(void) const {
+    size_t total = 0;
+    for (auto& run : runs) {
+        total += run.second - run.first + 1;
+    }
+    return total;
+}
+
+size_t IDTranslator::run_count(void) const {
+    return runs.size();
+}
+
+}
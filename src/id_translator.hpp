@@ -0,0 +1,60 @@
+#ifndef VG_ID_TRANSLATOR_HPP_INCLUDED
+#define VG_ID_TRANSLATOR_HPP_INCLUDED
+
+#include "vg.pb.h"
+#include "types.hpp"
+
+#include <utility>
+#include <vector>
+
+/**
+ * \file id_translator.hpp
+ * A compact table for renumbering a set of node IDs into a dense range.
+ */
+namespace vg {
+
+using namespace std;
+
+/// Maps a set of node IDs onto consecutive new IDs, keeping their order. The
+/// set is held as sorted runs of consecutive IDs rather than one entry per
+/// ID, so graphs whose IDs are nearly dense already take almost no space.
+/// Lookups are binary searches over the runs.
+class IDTranslator {
+public:
+
+    /// Add all the IDs in [first, last] to the set. Ranges can be added in
+    /// any order, and can overlap.
+    void add_range(id_t first, id_t last);
+
+    /// Add the IDs of all the nodes in a graph chunk.
+    void add_ids(const Graph& graph);
+
+    /// Add all the IDs from another translator, such as one filled in on
+    /// another thread.
+    void add_ids(const IDTranslator& other);
+
+    /// Merge the runs and number the IDs from first_id up. Must be called
+    /// after adding the IDs and before translating any.
+    void build(id_t first_id = 1);
+
+    /// Get the new ID for an ID in the set. Throws if it isn't in the set.
+    id_t translate(id_t id) const;
+
+    /// How many IDs are in the set, once built?
+    size_t size(void) const;
+
+    /// How many runs of consecutive IDs are they stored as?
+    size_t run_count(void) const;
+
+private:
+
+    /// Inclusive ranges of IDs, sorted and disjoint once built
+    vector<pair<id_t, id_t>> runs;
+    /// The new ID of the first ID in each run
+    vector<id_t> run_starts;
+    bool built = false;
+};
+
+}
+
+#endif
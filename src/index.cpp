@@ -7,6 +7,46 @@ using namespace std;
 // convenience macro for RocksDB error handling
 #define S(x) { rocksdb::Status __s = (x); if (!__s.ok()) throw std::runtime_error("RocksDB operation failed: " + __s.ToString()); }
 
+/**
+ * Extracts the table and ID from keys of the tables that start their keys
+ * with a big-endian ID after the table separator, so that all the records for
+ * one node (or alignment) share a prefix.
+ */
+class IndexKeyPrefixTransform : public rocksdb::SliceTransform {
+public:
+    // separator, table, separator, ID
+    static const size_t prefix_length = 3 + sizeof(int64_t);
+
+    virtual const char* Name() const {
+        return "vg.IndexKeyPrefix.1";
+    }
+
+    virtual rocksdb::Slice Transform(const rocksdb::Slice& key) const {
+        return rocksdb::Slice(key.data(), prefix_length);
+    }
+
+    virtual bool InDomain(const rocksdb::Slice& key) const {
+        if (key.size() < prefix_length) {
+            return false;
+        }
+        switch (key[1]) {
+        case 'g': // graph elements
+        case 's': // mappings
+        case 'a': // alignments
+        case 'b': // base-alignments
+        case 't': // traversals
+            return true;
+        default:
+            // kmers, paths, and metadata are looked up by other prefixes
+            return false;
+        }
+    }
+
+    virtual bool InRange(const rocksdb::Slice& key) const {
+        return key.size() == prefix_length && InDomain(key);
+    }
+};
+
 Index::Index(void) {
 
     start_sep = '\x00';
@@ -16,6 +56,7 @@ Index::Index(void) {
     // in the event of power failure etc. which is not really relevant to our use case.
     write_options.disableWAL = true;
     db = nullptr;
+    prefix_extractor = make_shared<IndexKeyPrefixTransform>();
 
     threads = 1;
 #pragma omp parallel
@@ -28,7 +69,6 @@ Index::Index(void) {
 
 rocksdb::Options Index::GetOptions(bool read_only) {
     // TODO: make the following configurable
-    const size_t block_cache_bytes = 1<<30;
     const size_t memtable_bytes = 4 * size_t(1<<30);
 
     rocksdb::Options options;
@@ -48,10 +88,17 @@ rocksdb::Options Index::GetOptions(bool read_only) {
     // set up table format
     rocksdb::BlockBasedTableOptions topt;
     topt.format_version = 2;
-    topt.block_size = 4 << 20;
-    topt.filter_policy.reset(rocksdb::NewBloomFilterPolicy(10, true));
+    topt.block_size = block_bytes;
+    // full (not per-block) filters, holding both whole keys for point
+    // lookups and key prefixes for scans over one node
+    topt.filter_policy.reset(rocksdb::NewBloomFilterPolicy(10, false));
+    topt.whole_key_filtering = true;
     topt.block_cache = rocksdb::NewLRUCache(block_cache_bytes);
+    // keep the filters and indexes in the cache, so lookups don't read them from disk
+    topt.cache_index_and_filter_blocks = true;
+    topt.pin_l0_filter_and_index_blocks_in_cache = true;
     options.table_factory.reset(NewBlockBasedTableFactory(topt));
+    options.prefix_extractor = prefix_extractor;
 
     // set up concurrency
     options.IncreaseParallelism(threads);
@@ -131,6 +178,19 @@ void Index::open(const std::string& dir, bool read_only) {
         }
     }
 
+    s = get_metadata("key_schema", data);
+    if (s.ok()) {
+        if (strtoll(data.c_str(), nullptr, 10) > key_schema_version) {
+            throw indexOpenException("index uses key schema " + data + ", but only " + to_string(key_schema_version)
+                                     + " is supported");
+        }
+    } else if (!s.IsNotFound()) {
+        throw indexOpenException("couldn't read metadata");
+    } else if (!read_only) {
+        // indexes from before the schema was recorded use the first schema
+        put_metadata("key_schema", to_string(key_schema_version));
+    }
+
     next_nonce = 42; // arbitrary initial value
     s = get_metadata("next_nonce", data);
     if (s.ok()) {
@@ -166,6 +226,9 @@ Index::~Index(void) {
 }
 
 void Index::close(void) {
+    if (ingesting) {
+        finish_bulk_ingest();
+    }
     flush();
     string dirty_key = key_for_metadata("DIRTY"), data;
     if (db->Get(rocksdb::ReadOptions(), dirty_key, &data).ok()) {
@@ -206,10 +269,104 @@ void Index::flush(void) {
     }
 }
 
+rocksdb::ReadOptions Index::range_read_options(const string& key_start, const string& key_end) {
+    rocksdb::ReadOptions options;
+    if (prefix_extractor->InDomain(key_start) && prefix_extractor->InDomain(key_end)
+        && prefix_extractor->Transform(key_start) == prefix_extractor->Transform(key_end)) {
+        // only look in files that might have this prefix
+        options.prefix_same_as_start = true;
+    } else {
+        options.total_order_seek = true;
+    }
+    return options;
+}
+
 void Index::compact(void) {
     db->CompactRange(rocksdb::CompactRangeOptions(), NULL, NULL);
 }
 
+void Index::start_bulk_ingest(size_t buffer_bytes) {
+    // split the budget over the threads that will be writing
+    int max_threads = omp_get_max_threads();
+    ingest_buffer_bytes = max(buffer_bytes / max_threads, (size_t) 1);
+    ingest_buffers.clear();
+    ingest_buffers.resize(max_threads);
+    ingest_buffered_bytes.clear();
+    ingest_buffered_bytes.resize(max_threads, 0);
+    ingesting = true;
+}
+
+void Index::finish_bulk_ingest(void) {
+    if (!ingesting) {
+        return;
+    }
+#pragma omp parallel for schedule(dynamic, 1)
+    for (size_t i = 0; i < ingest_buffers.size(); ++i) {
+        ingest_buffer(ingest_buffers[i]);
+        ingest_buffered_bytes[i] = 0;
+    }
+    ingest_buffers.clear();
+    ingest_buffered_bytes.clear();
+    ingesting = false;
+}
+
+void Index::put(const string& key, const string& value) {
+    if (!ingesting) {
+        S(db->Put(write_options, key, value));
+        return;
+    }
+    int tid = omp_get_thread_num();
+    assert(tid < ingest_buffers.size());
+    auto& buffer = ingest_buffers[tid];
+    buffer.emplace_back(key, value);
+    // count some overhead for each record so tiny ones don't pile up forever
+    ingest_buffered_bytes[tid] += key.size() + value.size() + 2 * sizeof(string);
+    if (ingest_buffered_bytes[tid] >= ingest_buffer_bytes) {
+        ingest_buffer(buffer);
+        ingest_buffered_bytes[tid] = 0;
+    }
+}
+
+void Index::ingest_buffer(vector<pair<string, string>>& buffer) {
+    if (buffer.empty()) {
+        return;
+    }
+    // SST files need their keys in strictly increasing bytewise order. A
+    // later put of the same key should win, as it would in the memtable.
+    std::stable_sort(buffer.begin(), buffer.end(), [](const pair<string, string>& a, const pair<string, string>& b) {
+        return a.first < b.first;
+    });
+
+    // write a file for each key type (the character after the leading
+    // separator), so the files we ingest together don't overlap
+    vector<string> files;
+    size_t i = 0;
+    while (i < buffer.size()) {
+        char key_type = buffer[i].first.size() > 1 ? buffer[i].first[1] : 0;
+        string file_name = temp_file::create("vg-index-ingest-") + ".sst";
+        files.push_back(file_name);
+        rocksdb::SstFileWriter writer(rocksdb::EnvOptions(), db_options);
+        S(writer.Open(file_name));
+        for (; i < buffer.size() && (buffer[i].first.size() > 1 ? buffer[i].first[1] : 0) == key_type; ++i) {
+            if (i + 1 < buffer.size() && buffer[i + 1].first == buffer[i].first) {
+                // overwritten by a later put
+                continue;
+            }
+            S(writer.Put(buffer[i].first, buffer[i].second));
+        }
+        S(writer.Finish());
+    }
+    buffer.clear();
+
+    rocksdb::IngestExternalFileOptions ingest_options;
+    ingest_options.move_files = true;
+    S(db->IngestExternalFile(files, ingest_options));
+    for (auto& file_name : files) {
+        // the database has its own link to the data now
+        temp_file::remove(file_name);
+    }
+}
+
 // todo: replace with union / struct
 const string Index::key_for_node(int64_t id) {
     string key;
@@ -799,7 +956,9 @@ string Index::traversal_entry_to_string(const string& key, const string& value)
 }
 
 void Index::dump(ostream& out) {
-    rocksdb::Iterator* it = db->NewIterator(rocksdb::ReadOptions());
+    rocksdb::ReadOptions read_options;
+    read_options.total_order_seek = true;
+    rocksdb::Iterator* it = db->NewIterator(read_options);
     for (it->SeekToFirst(); it->Valid(); it->Next()) {
         out << entry_to_string(it->key().ToString(), it->value().ToString()) << endl;
     }
@@ -907,25 +1066,25 @@ void Index::put_path_position(int64_t path_id, int64_t path_pos, bool backward,
 void Index::put_mapping(const Mapping& mapping) {
     string data;
     mapping.SerializeToString(&data);
-    S(db->Put(write_options, key_for_mapping(mapping), data));
+    put(key_for_mapping(mapping), data);
 }
 
 void Index::put_alignment(const Alignment& alignment) {
     static std::atomic<bool> warned_unmapped(false);
     string data;
     alignment.SerializeToString(&data);
-    S(db->Put(write_options, key_for_alignment(alignment), data));
+    put(key_for_alignment(alignment), data);
 }
 
 void Index::put_base(int64_t aln_id, const Alignment& alignment) {
     string data;
     alignment.SerializeToString(&data);
-    S(db->Put(write_options, key_for_base(aln_id), data));
+    put(key_for_base(aln_id), data);
 }
 
 void Index::put_traversal(int64_t aln_id, const Mapping& mapping) {
     string data; // empty data
-    S(db->Put(write_options, key_for_traversal(aln_id, mapping), data));
+    put(key_for_traversal(aln_id, mapping), data);
 }
 
 void Index::cross_alignment(int64_t aln_id, const Alignment& alignment) {
@@ -953,8 +1112,20 @@ void Index::load_graph(VG& graph) {
     graph.for_each_node_parallel([this, &batch](Node* n) { batch_node(n, batch); });
     graph.preload_progress("indexing edges of " + graph.name);
     graph.for_each_edge_parallel([this, &batch](Edge* e) { batch_edge(e, batch); });
-    rocksdb::Status s = db->Write(write_options, &batch);
     omp_set_num_threads(thread_count);
+    if (ingesting) {
+        // send the records to the SST files instead of the memtables
+        struct IngestHandler : public rocksdb::WriteBatch::Handler {
+            Index* index;
+            IngestHandler(Index* index) : index(index) {}
+            virtual void Put(const rocksdb::Slice& key, const rocksdb::Slice& value) {
+                index->put(key.ToString(), value.ToString());
+            }
+        } handler(this);
+        S(batch.Iterate(&handler));
+    } else {
+        S(db->Write(write_options, &batch));
+    }
 }
 
 void Index::load_paths(VG& graph) {
@@ -1517,7 +1688,7 @@ map<string, int64_t> Index::paths_by_id(void) {
 pair<int64_t, bool> Index::path_first_node(int64_t path_id) {
     string k = key_for_path_position(path_id, 0, false, 0);
     k = k.substr(0, 4 + sizeof(int64_t));
-    rocksdb::Iterator* it = db->NewIterator(rocksdb::ReadOptions());
+    rocksdb::Iterator* it = db->NewIterator(range_read_options(k, k+end_sep));
     rocksdb::Slice start = rocksdb::Slice(k);
     rocksdb::Slice end = rocksdb::Slice(k+end_sep);
     int64_t node_id = 0;
@@ -1537,7 +1708,7 @@ pair<int64_t, bool> Index::path_last_node(int64_t path_id, int64_t& path_length)
     // we aim to seek to the first item in the next path, then step back
     string key_start = key_for_path_position(path_id, 0, false, 0);
     string key_end = key_for_path_position(path_id+1, 0, false, 0);
-    rocksdb::Iterator* it = db->NewIterator(rocksdb::ReadOptions());
+    rocksdb::Iterator* it = db->NewIterator(range_read_options(key_start, key_end));
     //rocksdb::Slice start = rocksdb::Slice(key_start);
     rocksdb::Slice end = rocksdb::Slice(key_end);
     int64_t node_id = 0;
@@ -1633,10 +1804,10 @@ void Index::get_connected_nodes(VG& graph) {
 }
 
 void Index::get_context(int64_t id, VG& graph) {
-    rocksdb::Iterator* it = db->NewIterator(rocksdb::ReadOptions());
     string key_start = key_for_node(id).substr(0,3+sizeof(int64_t));
     rocksdb::Slice start = rocksdb::Slice(key_start);
     string key_end = key_start+end_sep;
+    rocksdb::Iterator* it = db->NewIterator(range_read_options(key_start, key_end));
     rocksdb::Slice end = rocksdb::Slice(key_end);
     for (it->Seek(start);
          it->Valid() && it->key().ToString() < key_end;
@@ -1810,10 +1981,10 @@ void Index::get_edges_of(int64_t node, vector<Edge>& edges) {
 }
 
 void Index::get_edges_on_start(int64_t node_id, vector<Edge>& edges) {
-    rocksdb::Iterator* it = db->NewIterator(rocksdb::ReadOptions());
     string key_start = key_prefix_for_edges_on_node_start(node_id);
     rocksdb::Slice start = rocksdb::Slice(key_start);
     string key_end = key_start+end_sep;
+    rocksdb::Iterator* it = db->NewIterator(range_read_options(key_start, key_end));
     rocksdb::Slice end = rocksdb::Slice(key_end);
     for (it->Seek(start);
          it->Valid() && it->key().ToString() < key_end;
@@ -1867,10 +2038,10 @@ void Index::get_edges_on_start(int64_t node_id, vector<Edge>& edges) {
 }
 
 void Index::get_edges_on_end(int64_t node_id, vector<Edge>& edges) {
-    rocksdb::Iterator* it = db->NewIterator(rocksdb::ReadOptions());
     string key_start = key_prefix_for_edges_on_node_end(node_id);
     rocksdb::Slice start = rocksdb::Slice(key_start);
     string key_end = key_start+end_sep;
+    rocksdb::Iterator* it = db->NewIterator(range_read_options(key_start, key_end));
     rocksdb::Slice end = rocksdb::Slice(key_end);
     for (it->Seek(start);
          it->Valid() && it->key().ToString() < key_end;
@@ -2059,7 +2230,7 @@ void Index::for_all(std::function<void(string&, string&)> lambda) {
 
 void Index::for_range(string& key_start, string& key_end,
                       std::function<void(string&, string&)> lambda) {
-    rocksdb::Iterator* it = db->NewIterator(rocksdb::ReadOptions());
+    rocksdb::Iterator* it = db->NewIterator(range_read_options(key_start, key_end));
     rocksdb::Slice start = rocksdb::Slice(key_start);
     rocksdb::Slice end = rocksdb::Slice(key_end);
     for (it->Seek(start);
@@ -16,6 +16,7 @@
 #include "rocksdb/slice_transform.h"
 #include "rocksdb/table.h"
 #include "rocksdb/filter_policy.h"
+#include "rocksdb/sst_file_writer.h"
 
 #include "json2pb.h"
 #include "vg.hpp"
@@ -114,6 +115,41 @@ public:
     bool bulk_load;
     std::atomic<uint64_t> next_nonce;
 
+    // Table settings used by GetOptions(). Change them before opening.
+    size_t block_cache_bytes = 1<<30;
+    size_t block_bytes = 4<<20;
+
+    // The version of the key layout this code reads and writes. It is stored
+    // in the metadata, and an index with a newer one is refused.
+    static const int64_t key_schema_version = 1;
+
+    // Keys for graph elements, mappings, alignments, and traversals start
+    // with their table and a big-endian ID, which RocksDB uses as the prefix
+    // for its bloom filters.
+    shared_ptr<const rocksdb::SliceTransform> prefix_extractor;
+    // Get options for iterating over keys from key_start up to key_end, which
+    // can skip files using the prefix bloom filters if the whole range is in
+    // one prefix and otherwise scan in total order.
+    rocksdb::ReadOptions range_read_options(const string& key_start, const string& key_end);
+
+    // Bulk ingestion. Between start_bulk_ingest() and finish_bulk_ingest(),
+    // records written with put() (including by load_graph(),
+    // put_alignment(), cross_alignment(), and put_mapping()) are buffered
+    // per thread instead of going through the memtables. Full buffers are
+    // sorted and written out as SST files, one per key type so they don't
+    // overlap, and handed to RocksDB with IngestExternalFile. Call from
+    // outside any parallel region.
+    void start_bulk_ingest(size_t buffer_bytes = 256 * size_t(1<<20));
+    void finish_bulk_ingest(void);
+    // write a record, to the database or to the bulk ingestion buffers
+    void put(const string& key, const string& value);
+    bool ingesting = false;
+    size_t ingest_buffer_bytes;
+    vector<vector<pair<string, string>>> ingest_buffers;
+    vector<size_t> ingest_buffered_bytes;
+    // sort, write, and ingest one buffer, and clear it
+    void ingest_buffer(vector<pair<string, string>>& buffer);
+
     void load_graph(VG& graph);
     void dump(std::ostream& out);
     void for_all(std::function<void(string&, string&)> lambda);
@@ -0,0 +1,186 @@
+#ifndef VG_INTERVAL_INDEX_HPP_INCLUDED
+#define VG_INTERVAL_INDEX_HPP_INCLUDED
+
+/** \file
+ * A static index of intervals on one coordinate axis (such as a path), for
+ * finding all the intervals that overlap a query without scanning them all.
+ */
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace vg {
+
+using namespace std;
+
+/**
+ * Holds a fixed collection of half-open intervals, each carrying a value, and
+ * finds the ones overlapping a query interval. The intervals are kept in one
+ * array sorted by start, which doubles as an implicit binary search tree: the
+ * element at the middle of each power-of-two block is the root of the block,
+ * and is augmented with the greatest end in the block, so whole blocks that
+ * end before the query are skipped. There are no tree nodes or pointers to
+ * chase. Read-only after construction, so it can be shared between threads.
+ */
+template<typename Value>
+class IntervalIndex {
+public:
+
+    /// An interval from start to past-end, and the value it carries.
+    struct Interval {
+        size_t start;
+        size_t end;
+        Value value;
+    };
+
+    /// Make an empty index.
+    IntervalIndex() = default;
+
+    /// Index the given intervals, in any order.
+    IntervalIndex(vector<Interval> intervals);
+
+    /// Call the callback with each indexed Interval that overlaps the start to
+    /// past-end query interval, in order of start position. An empty query
+    /// overlaps the intervals that strictly contain its position.
+    template<typename Lambda>
+    void for_each_overlapping(size_t start, size_t end, const Lambda& lambda) const;
+
+    /// Get the number of intervals indexed.
+    size_t size() const;
+
+    /// Return true if no intervals are indexed.
+    bool empty() const;
+
+private:
+
+    /// Subtrees at or below this level are scanned instead of descended into.
+    static const int SCAN_LEVEL = 3;
+
+    /// The intervals, sorted by start.
+    vector<Interval> intervals;
+    /// The greatest end in the subtree rooted at each interval.
+    vector<size_t> max_end;
+    /// The level of the root of the implicit tree.
+    int root_level = 0;
+};
+
+////////////////////////////////////////////////////////////////////////////
+// Template implementations
+////////////////////////////////////////////////////////////////////////////
+
+template<typename Value>
+IntervalIndex<Value>::IntervalIndex(vector<Interval> intervals) : intervals(std::move(intervals)) {
+    auto& sorted = this->intervals;
+    stable_sort(sorted.begin(), sorted.end(), [](const Interval& a, const Interval& b) {
+        return a.start < b.start;
+    });
+
+    size_t n = sorted.size();
+    if (n == 0) {
+        return;
+    }
+
+    // Leaves, at the even indexes, are their own subtrees.
+    max_end.resize(n);
+    size_t last_index = 0;
+    size_t last_end = 0;
+    for (size_t i = 0; i < n; i += 2) {
+        last_index = i;
+        max_end[i] = last_end = sorted[i].end;
+    }
+    for (size_t i = 1; i < n; i += 2) {
+        max_end[i] = sorted[i].end;
+    }
+
+    // Each level up, the roots are at the odd multiples of 2^level, less one,
+    // with children half a block to either side. A right child past the end of
+    // the array stands for the partial block holding the last element, so we
+    // carry that block's maximum up along with it.
+    int level = 1;
+    for (; ((size_t) 1 << level) <= n; level++) {
+        size_t half = (size_t) 1 << (level - 1);
+        size_t first_root = (half << 1) - 1;
+        size_t step = half << 2;
+        for (size_t i = first_root; i < n; i += step) {
+            size_t left_end = max_end[i - half];
+            size_t right_end = i + half < n ? max_end[i + half] : last_end;
+            max_end[i] = max(max_end[i], max(left_end, right_end));
+        }
+        last_index = ((last_index >> level) & 1) ? last_index - half : last_index + half;
+        if (last_index < n && max_end[last_index] > last_end) {
+            last_end = max_end[last_index];
+        }
+    }
+    root_level = level - 1;
+}
+
+template<typename Value>
+template<typename Lambda>
+void IntervalIndex<Value>::for_each_overlapping(size_t start, size_t end, const Lambda& lambda) const {
+    size_t n = intervals.size();
+    if (n == 0) {
+        return;
+    }
+
+    // Does an interval overlap the query? Empty queries still hit the
+    // intervals around them.
+    auto overlaps = [&](const Interval& interval) {
+        return interval.end > start && (interval.start < end || (start == end && interval.start < start));
+    };
+    // Past this start, nothing can overlap.
+    size_t start_limit = start == end ? start : end;
+
+    // Walk the implicit tree in order with an explicit stack of subtrees. A
+    // subtree is visited once to descend to its left, and again to report its
+    // root and descend to its right.
+    struct Visit {
+        int level;
+        size_t root;
+        bool left_done;
+    };
+    Visit stack[64];
+    size_t depth = 0;
+    stack[depth++] = Visit{root_level, ((size_t) 1 << root_level) - 1, false};
+    while (depth > 0) {
+        Visit visit = stack[--depth];
+        if (visit.level <= SCAN_LEVEL) {
+            // Small subtree. Just scan it.
+            size_t first = visit.root >> visit.level << visit.level;
+            size_t past_last = min(first + ((size_t) 1 << (visit.level + 1)) - 1, n);
+            for (size_t i = first; i < past_last && intervals[i].start <= start_limit; i++) {
+                if (overlaps(intervals[i])) {
+                    lambda(intervals[i]);
+                }
+            }
+        } else if (!visit.left_done) {
+            // Come back for the root and the right side later.
+            size_t left = visit.root - ((size_t) 1 << (visit.level - 1));
+            stack[depth++] = Visit{visit.level, visit.root, true};
+            if (left >= n || max_end[left] > start) {
+                // Something on the left might reach the query.
+                stack[depth++] = Visit{visit.level - 1, left, false};
+            }
+        } else if (visit.root < n && intervals[visit.root].start <= start_limit) {
+            if (overlaps(intervals[visit.root])) {
+                lambda(intervals[visit.root]);
+            }
+            stack[depth++] = Visit{visit.level - 1, visit.root + ((size_t) 1 << (visit.level - 1)), false};
+        }
+    }
+}
+
+template<typename Value>
+size_t IntervalIndex<Value>::size() const {
+    return intervals.size();
+}
+
+template<typename Value>
+bool IntervalIndex<Value>::empty() const {
+    return intervals.empty();
+}
+
+}
+
+#endif
@@ -11,6 +11,7 @@
  */
 
 #include <json2pb.h>
+#include "fast_json.hpp"
 
 #include <string>
 #include <cassert>
@@ -60,6 +61,14 @@ void json2pb(Message &msg, FILE* fp) {
 }
 
 void json2pb(Message &msg, const std::string& buf) {
+    // The hot types have their own parser, which leaves anything unusual to
+    // Protobuf
+    msg.Clear();
+    if (vg::fast_json::decode(buf.c_str(), buf.size(), msg)) {
+        return;
+    }
+    msg.Clear();
+    
     auto status = google::protobuf::util::JsonStringToMessage(buf, &msg);
     
     if (!status.ok()) {
@@ -75,11 +84,15 @@ void json2pb(Message &msg, const char *buf, size_t size) {
 }
 
 std::string pb2json(const Message &msg) {
+    std::string buffer;
+    if (vg::fast_json::encode(msg, buffer)) {
+        return buffer;
+    }
+    
     // Set options to preserve field names and not camel case them
     google::protobuf::util::JsonPrintOptions opts;
     opts.preserve_proto_field_names = true;
 
-	std::string buffer;
     auto status = google::protobuf::util::MessageToJsonString(msg, &buffer, opts);
     
     if (!status.ok()) {
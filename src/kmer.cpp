@@ -1,7 +1,86 @@
 #include "kmer.hpp"
 
+#include <algorithm>
+#include <sstream>
+#include <tuple>
+
 namespace vg {
 
+/// Point a kmer that starts at the forward head or reverse tail, and so has
+/// nothing before it, to the end of the opposite node
+static void add_head_tail_prev(const HandleGraph& graph, kmer_t& kmer, id_t head_id, id_t tail_id) {
+    if (id(kmer.begin) == head_id) {
+        kmer.prev_pos.emplace_back(tail_id, false, 0);
+        kmer.prev_char.emplace_back(graph.get_sequence(graph.get_handle(tail_id, false))[0]);
+    } else if (id(kmer.begin) == tail_id) {
+        kmer.prev_pos.emplace_back(head_id, true, 0);
+        kmer.prev_char.emplace_back(graph.get_sequence(graph.get_handle(head_id, true))[0]);
+    }
+}
+
+/// Point a kmer on the head or tail that has nothing after it to the start of
+/// the opposite node
+static void add_head_tail_next(const HandleGraph& graph, kmer_t& kmer, id_t head_id, id_t tail_id) {
+    if (id(kmer.begin) == head_id) {
+        kmer.next_pos.emplace_back(tail_id, true, 0);
+        kmer.next_char.emplace_back(graph.get_sequence(graph.get_handle(tail_id, true))[0]);
+    } else if (id(kmer.begin) == tail_id) {
+        kmer.next_pos.emplace_back(head_id, false, 0);
+        kmer.next_char.emplace_back(graph.get_sequence(graph.get_handle(head_id, false))[0]);
+    }
+}
+
+/// Pass a finished kmer to the callback. If we have head and tail ids set,
+/// first flip the reverse strands of the head and tail onto the forward
+/// strands of their opposites, and skip the kmers that only go between them.
+static void emit_kmer(kmer_t& kmer, id_t head_id, id_t tail_id, const function<void(const kmer_t&)>& lambda) {
+    if (head_id + tail_id > 0) {
+        // flip the beginning
+        if (id(kmer.begin) == head_id && is_rev(kmer.begin)) {
+            get_id(kmer.begin) = tail_id;
+            get_is_rev(kmer.begin) = false;
+        } else if (id(kmer.begin) == tail_id && is_rev(kmer.begin)) {
+            get_id(kmer.begin) = head_id;
+            get_is_rev(kmer.begin) = false;
+        }
+        // flip the nexts
+        for (auto& pos : kmer.next_pos) {
+            if (id(pos) == head_id && is_rev(pos)) {
+                get_id(pos) = tail_id;
+                get_is_rev(pos) = false;
+            } else if (id(pos) == tail_id && is_rev(pos)) {
+                get_id(pos) = head_id;
+                get_is_rev(pos) = false;
+            }
+        }
+        // if we aren't both from and to a head/tail node, emit
+        /*
+        if (!((offset(kmer.begin) == 0
+               && id(kmer.begin) == head_id
+               && kmer.next_pos.size() == 1
+               && id(kmer.next_pos.front()) == tail_id)
+              || (offset(kmer.begin) == 0
+                  && id(kmer.begin) == tail_id
+                  && kmer.next_pos.size() == 1
+                  && id(kmer.next_pos.front()) == head_id))) {
+            lambda(kmer);
+        }
+        */
+        if (kmer.prev_pos.size() == 1 && kmer.next_pos.size() == 1
+            && (offset(kmer.begin) == 0)
+            && (id(kmer.begin) == head_id || id(kmer.begin) == tail_id)
+            && (id(kmer.prev_pos.front()) == head_id || id(kmer.prev_pos.front()) == tail_id)
+            && (id(kmer.next_pos.front()) == head_id || id(kmer.next_pos.front()) == tail_id)) {
+            // skip
+        } else {
+            lambda(kmer);
+        }
+    } else {
+        // now pass the kmer and its context to our callback
+        lambda(kmer);
+    }
+}
+
 void for_each_kmer(const HandleGraph& graph, size_t k,
                    const function<void(const kmer_t&)>& lambda,
                    id_t head_id, id_t tail_id) {
@@ -35,13 +114,7 @@ void for_each_kmer(const HandleGraph& graph, size_t k,
                             });
                         // if we're on the forward head or reverse tail, we need to point to the end of the opposite node
                         if (kmer.prev_pos.empty() && using_head_tail) {
-                            if (id(begin) == head_id) {
-                                kmer.prev_pos.emplace_back(tail_id, false, 0);
-                                kmer.prev_char.emplace_back(graph.get_sequence(graph.get_handle(tail_id, false))[0]);
-                            } else if (id(begin) == tail_id) {
-                                kmer.prev_pos.emplace_back(head_id, true, 0);
-                                kmer.prev_char.emplace_back(graph.get_sequence(graph.get_handle(head_id, true))[0]);
-                            }
+                            add_head_tail_prev(graph, kmer, head_id, tail_id);
                         }
                     } else {
                         // the previous is in this node
@@ -80,66 +153,15 @@ void for_each_kmer(const HandleGraph& graph, size_t k,
                                         kmer.next_char.emplace_back(graph.get_sequence(next)[0]);
                                     });
                                 if (kmer.next_pos.empty() && using_head_tail) {
-                                    if (id(kmer.begin) == head_id) {
-                                        kmer.next_pos.emplace_back(tail_id, true, 0);
-                                        kmer.next_char.emplace_back(graph.get_sequence(graph.get_handle(tail_id, true))[0]);
-                                    } else if (id(kmer.begin) == tail_id) {
-                                        kmer.next_pos.emplace_back(head_id, false, 0);
-                                        kmer.next_char.emplace_back(graph.get_sequence(graph.get_handle(head_id, false))[0]);
-                                    }
-                                    //cerr << "done head or tail" << endl;
+                                    add_head_tail_next(graph, kmer, head_id, tail_id);
                                 }
                             } else {
                                 // on node
                                 kmer.next_pos.push_back(kmer.end);
                                 kmer.next_char.push_back(graph.get_sequence(end_handle)[offset(kmer.end)]);
                             }
-                            // if we have head and tail ids set, iterate through our positions and do the flip
-                            if (using_head_tail) {
-                                // flip the beginning
-                                if (id(kmer.begin) == head_id && is_rev(kmer.begin)) {
-                                    get_id(kmer.begin) = tail_id;
-                                    get_is_rev(kmer.begin) = false;
-                                } else if (id(kmer.begin) == tail_id && is_rev(kmer.begin)) {
-                                    get_id(kmer.begin) = head_id;
-                                    get_is_rev(kmer.begin) = false;
-                                }
-                                // flip the nexts
-                                for (auto& pos : kmer.next_pos) {
-                                    if (id(pos) == head_id && is_rev(pos)) {
-                                        get_id(pos) = tail_id;
-                                        get_is_rev(pos) = false;
-                                    } else if (id(pos) == tail_id && is_rev(pos)) {
-                                        get_id(pos) = head_id;
-                                        get_is_rev(pos) = false;
-                                    }
-                                }
-                                // if we aren't both from and to a head/tail node, emit
-                                /*
-                                if (!((offset(kmer.begin) == 0
-                                       && id(kmer.begin) == head_id
-                                       && kmer.next_pos.size() == 1
-                                       && id(kmer.next_pos.front()) == tail_id)
-                                      || (offset(kmer.begin) == 0
-                                          && id(kmer.begin) == tail_id
-                                          && kmer.next_pos.size() == 1
-                                          && id(kmer.next_pos.front()) == head_id))) {
-                                    lambda(kmer);
-                                }
-                                */
-                                if (kmer.prev_pos.size() == 1 && kmer.next_pos.size() == 1
-                                    && (offset(kmer.begin) == 0)
-                                    && (id(kmer.begin) == head_id || id(kmer.begin) == tail_id)
-                                    && (id(kmer.prev_pos.front()) == head_id || id(kmer.prev_pos.front()) == tail_id)
-                                    && (id(kmer.next_pos.front()) == head_id || id(kmer.next_pos.front()) == tail_id)) {
-                                    // skip
-                                } else {
-                                    lambda(kmer);
-                                }
-                            } else {
-                                // now pass the kmer and its context to our callback
-                                lambda(kmer);
-                            }
+                            // now fix up the head and tail and pass the kmer and its context to our callback
+                            emit_kmer(kmer, head_id, tail_id, lambda);
                             q = kmers.erase(q);
                         } else {
                             // do we finish in the current node?
@@ -219,7 +241,141 @@ gcsa::byte_type encode_chars(const vector<char>& chars, const gcsa::Alphabet& al
     return val;
 }
 
-void write_gcsa_kmers(const HandleGraph& graph, int kmer_size, ostream& out, size_t& size_limit, id_t head_id, id_t tail_id) {
+void for_each_haplotype_kmer(const HandleGraph& graph, const gbwt::GBWT& haplotypes, size_t k,
+                             const function<void(const kmer_t&)>& lambda,
+                             id_t head_id, id_t tail_id) {
+    bool using_head_tail = head_id + tail_id > 0;
+    
+    // The head and tail aren't on any haplotype, so walks go through them freely
+    auto is_free = [&](const handle_t& handle) {
+        id_t handle_id = graph.get_id(handle);
+        return using_head_tail && (handle_id == head_id || handle_id == tail_id);
+    };
+    
+    // Narrow down the haplotypes along a walk to the ones that go on to the
+    // given handle. An empty state means the walk hasn't been on a haplotype
+    // node yet. Returns false if no haplotype goes there.
+    auto advance = [&](const gbwt::SearchState& state, const handle_t& next, gbwt::SearchState& advanced) {
+        if (is_free(next)) {
+            advanced = state;
+            return true;
+        }
+        gbwt::node_type node = gbwt::Node::encode(graph.get_id(next), graph.get_is_reverse(next));
+        advanced = state.empty() ? haplotypes.find(node) : haplotypes.extend(state, node);
+        return !advanced.empty();
+    };
+    
+    // Check if some haplotype visits prev and then the whole walk, by searching
+    // back along the walk on the reverse strand. The GBWT must have both
+    // orientations of its threads, as vg index builds it.
+    auto can_precede = [&](const vector<handle_t>& walk, const handle_t& prev) {
+        gbwt::SearchState state;
+        for (auto iter = walk.rbegin(); iter != walk.rend(); ++iter) {
+            if (!advance(state, graph.flip(*iter), state)) {
+                return false;
+            }
+        }
+        return advance(state, graph.flip(prev), state);
+    };
+    
+    // A walk along haplotypes from the handle we are starting kmers on
+    struct walk_t {
+        vector<handle_t> handles;
+        /// the haplotypes that follow the whole walk
+        gbwt::SearchState state;
+        /// the number of bases before the last handle
+        size_t before_last;
+        string seq;
+    };
+    
+    graph.for_each_handle([&](const handle_t& h) {
+            for (auto handle_is_rev : { false, true }) {
+                handle_t handle = handle_is_rev ? graph.flip(h) : h;
+                walk_t start;
+                if (!advance(gbwt::SearchState(), handle, start.state)) {
+                    // no haplotype visits this node
+                    continue;
+                }
+                id_t handle_id = graph.get_id(handle);
+                size_t handle_length = graph.get_length(handle);
+                string handle_seq = graph.get_sequence(handle);
+                start.handles.push_back(handle);
+                start.before_last = 0;
+                start.seq = handle_seq;
+                
+                // walk out far enough to finish every kmer that starts on the handle
+                vector<walk_t> walks{start};
+                while (!walks.empty()) {
+                    walk_t walk = std::move(walks.back());
+                    walks.pop_back();
+                    handle_t last = walk.handles.back();
+                    size_t last_length = graph.get_length(last);
+                    size_t walk_length = walk.seq.size();
+                    
+                    // emit the kmers that end on the last handle
+                    size_t first_start = walk.before_last + 1 > k ? walk.before_last + 1 - k : 0;
+                    for (size_t i = first_start; i < handle_length && i + k <= walk_length; i++) {
+                        size_t end_offset = i + k - walk.before_last;
+                        kmer_t kmer(walk.seq.substr(i, k), make_pos_t(handle_id, handle_is_rev, i),
+                                    make_pos_t(graph.get_id(last), graph.get_is_reverse(last), end_offset), last);
+                        
+                        // determine the previous context, along the haplotypes
+                        if (i == 0) {
+                            graph.follow_edges(handle, true, [&](const handle_t& prev) {
+                                    if (can_precede(walk.handles, prev)) {
+                                        size_t prev_length = graph.get_length(prev);
+                                        kmer.prev_pos.emplace_back(graph.get_id(prev), graph.get_is_reverse(prev), prev_length-1);
+                                        kmer.prev_char.emplace_back(graph.get_sequence(prev)[prev_length-1]);
+                                    }
+                                });
+                            if (kmer.prev_pos.empty() && using_head_tail) {
+                                add_head_tail_prev(graph, kmer, head_id, tail_id);
+                            }
+                        } else {
+                            kmer.prev_pos.emplace_back(handle_id, handle_is_rev, i-1);
+                            kmer.prev_char.emplace_back(handle_seq[i-1]);
+                        }
+                        
+                        // and the next context
+                        if (end_offset < last_length) {
+                            kmer.next_pos.push_back(kmer.end);
+                            kmer.next_char.push_back(walk.seq[i+k]);
+                        } else {
+                            graph.follow_edges(last, false, [&](const handle_t& next) {
+                                    gbwt::SearchState advanced;
+                                    if (advance(walk.state, next, advanced)) {
+                                        kmer.next_pos.emplace_back(graph.get_id(next), graph.get_is_reverse(next), 0);
+                                        kmer.next_char.emplace_back(graph.get_sequence(next)[0]);
+                                    }
+                                });
+                            if (kmer.next_pos.empty() && using_head_tail) {
+                                add_head_tail_next(graph, kmer, head_id, tail_id);
+                            }
+                        }
+                        
+                        emit_kmer(kmer, head_id, tail_id, lambda);
+                    }
+                    
+                    // keep going along the haplotypes if some kmer hasn't ended yet
+                    if (walk_length < handle_length - 1 + k) {
+                        graph.follow_edges(last, false, [&](const handle_t& next) {
+                                walk_t extended;
+                                if (advance(walk.state, next, extended.state)) {
+                                    extended.handles = walk.handles;
+                                    extended.handles.push_back(next);
+                                    extended.before_last = walk_length;
+                                    extended.seq = walk.seq + graph.get_sequence(next);
+                                    walks.emplace_back(std::move(extended));
+                                }
+                            });
+                    }
+                }
+            }
+        }, true);
+}
+
+void write_gcsa_kmers(const HandleGraph& graph, int kmer_size, ostream& out, size_t& size_limit, id_t head_id, id_t tail_id,
+                      bool show_progress, const gbwt::GBWT* haplotypes) {
 
     // We need an alphabet to parse the internal string format
     const gcsa::Alphabet alpha;
@@ -236,17 +392,42 @@ void write_gcsa_kmers(const HandleGraph& graph, int kmer_size, ostream& out, siz
     // This handles the buffered writing for each thread
     size_t buffer_limit = 1e5; // max 100k kmers per buffer
     size_t total_bytes = 0;
+    // We count kmers generated and kept, for progress and error reporting
+    size_t total_kmers = 0;
+    size_t kept_kmers = 0;
+    // Report progress every this many bytes
+    const size_t progress_step = 1 << 30;
     auto handle_kmers = [&](vector<gcsa::KMer>& kmers, bool more) {
         if (!more || kmers.size() > buffer_limit) {
-            size_t bytes_required = kmers.size() * sizeof(gcsa::KMer) + sizeof(gcsa::GraphFileHeader);
+            // The same kmer can come out of the walks from more than one
+            // start. Sort so the copies are together, and drop them.
+            size_t generated = kmers.size();
+            sort(kmers.begin(), kmers.end(), [](const gcsa::KMer& a, const gcsa::KMer& b) {
+                    return make_tuple(a.key, a.from, a.to) < make_tuple(b.key, b.from, b.to);
+                });
+            kmers.erase(unique(kmers.begin(), kmers.end(), [](const gcsa::KMer& a, const gcsa::KMer& b) {
+                        return a.key == b.key && a.from == b.from && a.to == b.to;
+                    }), kmers.end());
+            // Serialize the run here, so threads only wait on each other to
+            // copy out finished bytes
+            stringstream run;
+            gcsa::writeBinary(run, kmers, kmer_size);
+            string bytes = run.str();
 #pragma omp critical (gcsa_kmer_out)
             {
-                if (total_bytes + bytes_required > size_limit) {
-                    cerr << "error: [write_gcsa_kmers()] size limit exceeded" << endl;
+                total_kmers += generated;
+                kept_kmers += kmers.size();
+                if (total_bytes + bytes.size() > size_limit) {
+                    cerr << "error: [write_gcsa_kmers()] size limit of " << size_limit << " bytes exceeded after "
+                         << kept_kmers << " unique kmers" << endl;
                     exit(EXIT_FAILURE);
                 }
-                gcsa::writeBinary(out, kmers, kmer_size);
-                total_bytes += bytes_required;
+                out.write(bytes.data(), bytes.size());
+                if (show_progress && (total_bytes + bytes.size()) / progress_step > total_bytes / progress_step) {
+                    cerr << "[write_gcsa_kmers()] " << kept_kmers << " unique kmers of " << total_kmers
+                         << " generated, " << gcsa::inGigabytes(total_bytes + bytes.size()) << " GB written" << endl;
+                }
+                total_bytes += bytes.size();
             }
             kmers.clear();
         }
@@ -260,21 +441,29 @@ void write_gcsa_kmers(const HandleGraph& graph, int kmer_size, ostream& out, siz
         handle_kmers(thread_output, true);
     };
     // Run on each KmerPosition. This populates start_end_id, if it was 0, before calling convert_kmer.
-    for_each_kmer(graph, kmer_size, convert_kmer, head_id, tail_id);
+    if (haplotypes != nullptr) {
+        for_each_haplotype_kmer(graph, *haplotypes, kmer_size, convert_kmer, head_id, tail_id);
+    } else {
+        for_each_kmer(graph, kmer_size, convert_kmer, head_id, tail_id);
+    }
     for(auto& thread_output : thread_outputs) {
         // Flush our buffers
         handle_kmers(thread_output, false);
     }
+    if (show_progress) {
+        cerr << "[write_gcsa_kmers()] wrote " << kept_kmers << " unique kmers of " << total_kmers
+             << " generated, " << gcsa::inGigabytes(total_bytes) << " GB" << endl;
+    }
     size_limit = total_bytes;
 }
 
 string write_gcsa_kmers_to_tmpfile(const HandleGraph& graph, int kmer_size, size_t& size_limit, id_t head_id, id_t tail_id,
-                                   const string& base_file_name) {
+                                   const string& base_file_name, bool show_progress, const gbwt::GBWT* haplotypes) {
     // open a temporary file for the kmers
     string tmpfile = temp_file::create(base_file_name);
     ofstream out(tmpfile);
     // write the kmers to the temporary file
-    write_gcsa_kmers(graph, kmer_size, out, size_limit, head_id, tail_id);
+    write_gcsa_kmers(graph, kmer_size, out, size_limit, head_id, tail_id, show_progress, haplotypes);
     out.close();
     return tmpfile;
 }
@@ -7,6 +7,7 @@
 #include "handle.hpp"
 #include "position.hpp"
 #include "gcsa/gcsa.h"
+#include <gbwt/gbwt.h>
 
 /** \file 
  * Functions for working with `kmers_t`'s in HandleGraphs.
@@ -45,6 +46,15 @@ void for_each_kmer(const HandleGraph& graph, size_t k,
                    const function<void(const kmer_t&)>& lambda,
                    id_t head_id = 0, id_t tail_id = 0);
 
+/// Iterate over the kmers that occur along haplotypes in the GBWT, running
+/// lambda on each. Only walks that some haplotype takes are followed, and the
+/// previous and next positions are limited to the ones haplotypes go to. The
+/// head and tail nodes, if set, are walked through freely. The GBWT must index
+/// both orientations of its threads. Runs in parallel over the graph's nodes.
+void for_each_haplotype_kmer(const HandleGraph& graph, const gbwt::GBWT& haplotypes, size_t k,
+                             const function<void(const kmer_t&)>& lambda,
+                             id_t head_id = 0, id_t tail_id = 0);
+
 /// Print a kmer_t to a stream.
 ostream& operator<<(ostream& out, const kmer_t& kmer);
 
@@ -58,13 +68,20 @@ gcsa::byte_type encode_chars(const vector<char>& chars, const gcsa::Alphabet& al
  * Write GCSA2 formatted binary KMers to the given ostream.
  * size_limit is the maximum size of the kmer file in bytes. When the function
  * returns, size_limit is the size of the kmer file in bytes.
+ *
+ * Each thread sorts its buffered kmers and drops duplicates before writing
+ * them as a run, so repeated walks don't use up disk. If show_progress is set,
+ * reports kmer counts and bytes written. If haplotypes is set, only the kmers
+ * along its haplotypes are written.
  */
-void write_gcsa_kmers(const HandleGraph& graph, int kmer_size, ostream& out, size_t& size_limit, id_t head_id, id_t tail_id);
+void write_gcsa_kmers(const HandleGraph& graph, int kmer_size, ostream& out, size_t& size_limit, id_t head_id, id_t tail_id,
+                      bool show_progress = false, const gbwt::GBWT* haplotypes = nullptr);
 
 /// Open a tempfile and write the kmers to it. The calling context should remove it
 /// with temp_file::remove().
 string write_gcsa_kmers_to_tmpfile(const HandleGraph& graph, int kmer_size, size_t& size_limit, id_t head_id, id_t tail_id,
-                                   const string& base_file_name = "vg-kmers-tmp-");
+                                   const string& base_file_name = "vg-kmers-tmp-", bool show_progress = false,
+                                   const gbwt::GBWT* haplotypes = nullptr);
 
 }
 
@@ -13,6 +13,7 @@
 #include "version.hpp"
 #include "utility.hpp"
 #include "crash.hpp"
+#include "timeline.hpp"
 
 // New subcommand system provides all the subcommands that used to live here
 #include "subcommand/subcommand.hpp"
@@ -49,6 +50,11 @@ int main(int argc, char *argv[])
 
     // set a higher value for tcmalloc warnings
     setenv("TCMALLOC_LARGE_ALLOC_REPORT_THRESHOLD", "1000000000000000", 1);
+    
+    // Record what the threads do, if asked, and write it out on exit
+    if (getenv("VG_TIMELINE") != nullptr && *getenv("VG_TIMELINE") != '\0') {
+        vg::timeline::start(getenv("VG_TIMELINE"));
+    }
 
     if (argc == 1) {
         vg_help(argv);
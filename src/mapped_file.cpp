@@ -0,0 +1,106 @@
+#include "mapped_file.hpp"
+
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace vg {
+
+using namespace std;
+
+MappedFile::MappedFile(const string& filename) {
+    fd = open(filename.c_str(), O_RDONLY);
+    if (fd == -1) {
+        throw runtime_error("Could not open " + filename + " for mapping: " + strerror(errno));
+    }
+
+    struct stat file_stats;
+    if (fstat(fd, &file_stats) == -1) {
+        int error = errno;
+        close(fd);
+        throw runtime_error("Could not stat " + filename + ": " + strerror(error));
+    }
+    length = file_stats.st_size;
+
+    if (length == 0) {
+        // mmap() refuses zero-length mappings; there is nothing to read anyway.
+        return;
+    }
+
+    void* mapped = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+    if (mapped == MAP_FAILED) {
+        int error = errno;
+        close(fd);
+        throw runtime_error("Could not map " + filename + ": " + strerror(error));
+    }
+    mapping = (char*) mapped;
+}
+
+MappedFile::~MappedFile() {
+    if (mapping != nullptr) {
+        munmap(mapping, length);
+    }
+    if (fd != -1) {
+        close(fd);
+    }
+}
+
+const char* MappedFile::data() const {
+    return mapping;
+}
+
+size_t MappedFile::size() const {
+    return length;
+}
+
+void MappedFile::advise(int advice) const {
+    if (mapping != nullptr) {
+        madvise(mapping, length, advice);
+    }
+}
+
+MappedFileStreamBuffer::MappedFileStreamBuffer(const MappedFile& file) {
+    // The get area is the whole file. We never write through these pointers.
+    char* start = const_cast<char*>(file.data());
+    setg(start, start, start + file.size());
+}
+
+MappedFileStreamBuffer::pos_type MappedFileStreamBuffer::seekoff(off_type off, ios_base::seekdir dir,
+                                                                 ios_base::openmode which) {
+    if (!(which & ios_base::in)) {
+        return pos_type(off_type(-1));
+    }
+
+    off_type target;
+    switch (dir) {
+    case ios_base::beg:
+        target = off;
+        break;
+    case ios_base::cur:
+        target = (gptr() - eback()) + off;
+        break;
+    case ios_base::end:
+        target = (egptr() - eback()) + off;
+        break;
+    default:
+        return pos_type(off_type(-1));
+    }
+
+    if (target < 0 || target > egptr() - eback()) {
+        return pos_type(off_type(-1));
+    }
+
+    setg(eback(), eback() + target, egptr());
+    return pos_type(target);
+}
+
+MappedFileStreamBuffer::pos_type MappedFileStreamBuffer::seekpos(pos_type pos, ios_base::openmode which) {
+    return seekoff(off_type(pos), ios_base::beg, which);
+}
+
+}
@@ -0,0 +1,67 @@
+#ifndef VG_MAPPED_FILE_HPP_INCLUDED
+#define VG_MAPPED_FILE_HPP_INCLUDED
+
+/// \file mapped_file.hpp
+/// Read-only memory-mapped files, and a std::streambuf that reads from them.
+
+#include <streambuf>
+#include <string>
+
+namespace vg {
+
+using namespace std;
+
+/**
+ * A read-only, shared memory mapping of an entire file. Pages are faulted in
+ * from the page cache on demand, so several processes mapping the same file
+ * share one copy of its contents.
+ */
+class MappedFile {
+public:
+    /// Map the given file. Throws a runtime_error if the file cannot be opened
+    /// or mapped.
+    MappedFile(const string& filename);
+
+    /// Unmap the file.
+    ~MappedFile();
+
+    // The mapping is owned by exactly one object.
+    MappedFile(const MappedFile& other) = delete;
+    MappedFile& operator=(const MappedFile& other) = delete;
+    MappedFile(MappedFile&& other) = delete;
+    MappedFile& operator=(MappedFile&& other) = delete;
+
+    /// Get the start of the mapped data. May be null if the file is empty.
+    const char* data() const;
+
+    /// Get the size of the mapped file in bytes.
+    size_t size() const;
+
+    /// Pass an madvise() hint (MADV_SEQUENTIAL, MADV_WILLNEED, ...) for the
+    /// whole mapping. Failures are ignored, since hints are optional.
+    void advise(int advice) const;
+
+private:
+    int fd = -1;
+    char* mapping = nullptr;
+    size_t length = 0;
+};
+
+/**
+ * A read-only, seekable std::streambuf that serves bytes directly out of a
+ * MappedFile, so that stream-based loaders avoid read(2) calls and the extra
+ * copy through an ifstream's buffer. The MappedFile must outlive the buffer.
+ */
+class MappedFileStreamBuffer : public std::streambuf {
+public:
+    MappedFileStreamBuffer(const MappedFile& file);
+
+protected:
+    virtual pos_type seekoff(off_type off, ios_base::seekdir dir,
+                             ios_base::openmode which = ios_base::in);
+    virtual pos_type seekpos(pos_type pos, ios_base::openmode which = ios_base::in);
+};
+
+}
+
+#endif
@@ -2,6 +2,7 @@
 #include "mapper.hpp"
 #include "haplotypes.hpp"
 #include "algorithms/extract_containing_graph.hpp"
+#include "stage_profile.hpp"
 
 //#define debug_mapper
 
@@ -114,8 +115,20 @@ BaseMapper::find_mems_simple(string::const_iterator seq_begin,
     auto full_range = gcsa::range_type(0, gcsa->size() - 1);
     MaximalExactMatch match(cursor, cursor, full_range);
     gcsa::range_type last_range = match.range;
+    // can we take the first steps of a search from the kmer table?
+    bool use_kmer_table = gcsa_kmers && (!max_mem_length || gcsa_kmers->kmer_length() <= max_mem_length);
     --cursor; // start off looking at the last character in the query
     while (cursor >= seq_begin) {
+        if (use_kmer_table && match.range == full_range && match.end == cursor + 1) {
+            // we're starting a new search, so jump over the first kmer if it matches
+            auto kmer = find_kmer_range(seq_begin, cursor + 1);
+            if (kmer) {
+                match.range = kmer->range;
+                cursor -= gcsa_kmers->kmer_length();
+                match.begin = cursor + 1;
+                continue;
+            }
+        }
         // hold onto our previous range
         last_range = match.range;
         // execute one step of LF mapping
@@ -200,11 +213,7 @@ BaseMapper::find_mems_simple(string::const_iterator seq_begin,
     for (auto& mem : mems) {
         if (mem.length() >= min_mem_length) {
             mem.match_count = gcsa->count(mem.range);
-            if (hit_max) {
-                gcsa->locate(mem.range, hit_max, mem.nodes);
-            } else {
-                gcsa->locate(mem.range, mem.nodes);
-            }
+            locate_hits(mem.range, mem.nodes);
         }
     }
     
@@ -270,6 +279,7 @@ vector<MaximalExactMatch> BaseMapper::find_mems_deep(string::const_iterator seq_
                                                      bool include_parent_in_sub_mem_count,
                                                      bool record_max_lcp,
                                                      int reseed_below) {
+    VG_PROFILE_STAGE(MEM_SEARCH);
 #ifdef debug_mapper
 #pragma omp critical
     {
@@ -282,6 +292,11 @@ vector<MaximalExactMatch> BaseMapper::find_mems_deep(string::const_iterator seq_
     }
 #endif
 
+    if (minimizer_index) {
+        longest_lcp = 0;
+        return find_minimizer_mems(seq_begin, seq_end, fraction_filtered);
+    }
+
     if (!gcsa) {
         cerr << "error:[vg::Mapper] a GCSA2 index is required to query MEMs" << endl;
         exit(1);
@@ -291,13 +306,194 @@ vector<MaximalExactMatch> BaseMapper::find_mems_deep(string::const_iterator seq_
         cerr << "error:[vg::Mapper] minimimum reseed length for MEMs cannot be less than minimum MEM length" << endl;
         exit(1);
     }
+    
+    SMEMSearch search;
+    start_smem_search(search, seq_begin, seq_end, max_mem_length, min_mem_length, record_max_lcp);
+    while (advance_smem_search(search)) {
+        // keep stepping until we run off the start of the sequence
+    }
+    finish_smem_search(search);
+    
+    return complete_mems_deep(search, longest_lcp, fraction_filtered, reseed_length, use_lcp_reseed_heuristic,
+                              use_diff_based_fast_reseed, include_parent_in_sub_mem_count, reseed_below);
+}
+
+vector<vector<MaximalExactMatch>>
+BaseMapper::find_mems_deep_batch(const vector<pair<string::const_iterator, string::const_iterator>>& seqs,
+                                 vector<double>& longest_lcps,
+                                 vector<double>& fractions_filtered,
+                                 int max_mem_length,
+                                 int min_mem_length,
+                                 int reseed_length,
+                                 bool use_lcp_reseed_heuristic,
+                                 bool use_diff_based_fast_reseed,
+                                 bool include_parent_in_sub_mem_count,
+                                 bool record_max_lcp,
+                                 int reseed_below) {
+    VG_PROFILE_STAGE(MEM_SEARCH);
+    
+    if (minimizer_index) {
+        longest_lcps.assign(seqs.size(), 0.0);
+        fractions_filtered.assign(seqs.size(), 0.0);
+        vector<vector<MaximalExactMatch>> mems;
+        mems.reserve(seqs.size());
+        for (size_t i = 0; i < seqs.size(); i++) {
+            mems.emplace_back(find_minimizer_mems(seqs[i].first, seqs[i].second, fractions_filtered[i]));
+        }
+        return mems;
+    }
+    
+    if (!gcsa) {
+        cerr << "error:[vg::Mapper] a GCSA2 index is required to query MEMs" << endl;
+        exit(1);
+    }
+    
+    if (min_mem_length > reseed_length && reseed_length) {
+        cerr << "error:[vg::Mapper] minimimum reseed length for MEMs cannot be less than minimum MEM length" << endl;
+        exit(1);
+    }
+    
+    vector<SMEMSearch> searches(seqs.size());
+    // the searches that still have steps to take
+    vector<size_t> active;
+    active.reserve(seqs.size());
+    for (size_t i = 0; i < seqs.size(); i++) {
+        start_smem_search(searches[i], seqs[i].first, seqs[i].second, max_mem_length, min_mem_length, record_max_lcp);
+        active.push_back(i);
+    }
+    
+    // take one step of each search in turn, so the BWT accesses of different
+    // searches don't have to wait on each other
+    while (!active.empty()) {
+        for (size_t i = 0; i < active.size(); ) {
+            if (advance_smem_search(searches[active[i]])) {
+                i++;
+            }
+            else {
+                active[i] = active.back();
+                active.pop_back();
+            }
+        }
+    }
+    
+    longest_lcps.assign(seqs.size(), 0.0);
+    fractions_filtered.assign(seqs.size(), 0.0);
+    vector<vector<MaximalExactMatch>> mems;
+    mems.reserve(seqs.size());
+    for (size_t i = 0; i < seqs.size(); i++) {
+        finish_smem_search(searches[i]);
+        mems.emplace_back(complete_mems_deep(searches[i], longest_lcps[i], fractions_filtered[i], reseed_length,
+                                             use_lcp_reseed_heuristic, use_diff_based_fast_reseed,
+                                             include_parent_in_sub_mem_count, reseed_below));
+    }
+    return mems;
+}
+
+vector<MaximalExactMatch> BaseMapper::find_minimizer_mems(string::const_iterator seq_begin,
+                                                          string::const_iterator seq_end,
+                                                          double& fraction_filtered) {
     vector<MaximalExactMatch> mems;
+    size_t k = minimizer_index->k();
+    size_t filtered_hits = 0;
+    size_t total_hits = 0;
+    for (auto& minimizer : minimizer_index->minimizers(seq_begin, seq_end)) {
+        auto hits = minimizer_index->find(minimizer.key);
+        size_t count = hits.second - hits.first;
+        if (count == 0) {
+            continue;
+        }
+        mems.emplace_back(seq_begin + minimizer.offset, seq_begin + minimizer.offset + k,
+                          gcsa::range_type(0, 0), count);
+        MaximalExactMatch& mem = mems.back();
+        mem.primary = true;
+        if (hit_max && count > (size_t) hit_max) {
+            // like a capped locate, take a sample of the hits spread over all of them
+            for (size_t i = 0; i < (size_t) hit_max; i++) {
+                mem.nodes.push_back(hits.first[i * count / hit_max]);
+            }
+        } else {
+            mem.nodes.assign(hits.first, hits.second);
+        }
+        mem.queried_count = mem.nodes.size();
+        filter_hits_by_haplotypes(mem);
+        filtered_hits += count - mem.nodes.size();
+        total_hits += mem.nodes.size();
+    }
+    // minimizers come out in read order, and so already sorted like MEMs
+    fraction_filtered = total_hits ? (double) filtered_hits / (double) total_hits : 0.0;
+    return mems;
+}
+
+void BaseMapper::filter_hits_by_haplotypes(MaximalExactMatch& mem) const {
+    if (!haplotype_filter) {
+        return;
+    }
+    mem.nodes.erase(std::remove_if(mem.nodes.begin(), mem.nodes.end(), [&](const gcsa::node_type& node) {
+        return !haplotypes_follow(make_pos_t(node), mem.begin, mem.end);
+    }), mem.nodes.end());
+}
+
+bool BaseMapper::haplotypes_follow(pos_t start, string::const_iterator seq_begin, string::const_iterator seq_end) const {
+    handle_t handle = xindex->get_handle(id(start), is_rev(start));
+    size_t on_first_node = xindex->get_length(handle) - offset(start);
+    if (seq_end - seq_begin <= (int64_t) on_first_node) {
+        // there is no combination of nodes to check
+        return true;
+    }
     
-    gcsa::range_type full_range = gcsa::range_type(0, gcsa->size() - 1);
+    // Follow the walks that spell the rest of the sequence, which are usually
+    // just one, until one of them is on a haplotype
+    function<bool(const handle_t&, const gbwt::SearchState&, string::const_iterator)> follow;
+    follow = [&](const handle_t& handle, const gbwt::SearchState& state, string::const_iterator cursor) {
+        if (state.empty()) {
+            return false;
+        }
+        if (cursor == seq_end) {
+            return true;
+        }
+        bool followed = false;
+        xindex->follow_edges(handle, false, [&](const handle_t& next) {
+            string next_seq = xindex->get_sequence(next);
+            size_t length = min(next_seq.size(), (size_t) (seq_end - cursor));
+            if (!equal(cursor, cursor + length, next_seq.begin())) {
+                // the sequence doesn't go this way
+                return true;
+            }
+            gbwt::node_type next_node = gbwt::Node::encode(xindex->get_id(next), xindex->get_is_reverse(next));
+            followed = follow(next, haplotype_filter->extend(state, next_node), cursor + length);
+            return !followed;
+        });
+        return followed;
+    };
+    return follow(handle, haplotype_filter->find(gbwt::Node::encode(id(start), is_rev(start))),
+                  seq_begin + on_first_node);
+}
 
+size_t BaseMapper::seed_order() const {
+    return minimizer_index ? minimizer_index->k() : gcsa->order();
+}
+
+void BaseMapper::start_smem_search(SMEMSearch& search,
+                                   string::const_iterator seq_begin,
+                                   string::const_iterator seq_end,
+                                   int max_mem_length,
+                                   int min_mem_length,
+                                   bool record_max_lcp) {
+    
+    search.seq_begin = seq_begin;
+    search.seq_end = seq_end;
+    search.max_mem_length = max_mem_length;
+    search.min_mem_length = min_mem_length;
+    search.record_max_lcp = record_max_lcp;
+    search.use_kmer_table = gcsa_kmers && (!max_mem_length || gcsa_kmers->kmer_length() <= max_mem_length);
+    
+    search.full_range = gcsa::range_type(0, gcsa->size() - 1);
+    search.mems.clear();
+    search.lcp_maxima.clear();
+    
     // an empty sequence matches the entire bwt
     if (seq_begin == seq_end) {
-        mems.push_back(MaximalExactMatch(seq_begin, seq_end, full_range));
+        search.mems.push_back(MaximalExactMatch(seq_begin, seq_end, search.full_range));
     }
     
     // find SMEMs using GCSA+LCP array
@@ -315,37 +511,133 @@ vector<MaximalExactMatch> BaseMapper::find_mems_deep(string::const_iterator seq_
     //           and calculate the new end point using the LCP of the parent node
     // emit the final MEM, if we finished in a matching state
     
-    // next position we will extend matches to
-    string::const_iterator cursor = seq_end - 1;
-    
-    // range of the last iteration
-    gcsa::range_type last_range = full_range;
+    search.cursor = seq_end - 1;
+    search.last_range = search.full_range;
+    search.match = MaximalExactMatch(search.cursor, seq_end, search.full_range);
+    search.prev_iter_jumped_lcp = false;
+    search.max_lcp = 0;
+    search.mem_length = 0;
+}
+
+bool BaseMapper::advance_smem_search(SMEMSearch& search) {
+    
+    // work on the search's state in place
+    string::const_iterator& cursor = search.cursor;
+    gcsa::range_type& last_range = search.last_range;
+    const gcsa::range_type& full_range = search.full_range;
+    MaximalExactMatch& match = search.match;
+    bool& prev_iter_jumped_lcp = search.prev_iter_jumped_lcp;
+    int& max_lcp = search.max_lcp;
+    size_t& mem_length = search.mem_length;
+    vector<MaximalExactMatch>& mems = search.mems;
+    vector<int>& lcp_maxima = search.lcp_maxima;
+    const int max_mem_length = search.max_mem_length;
+    const int min_mem_length = search.min_mem_length;
+    const bool record_max_lcp = search.record_max_lcp;
+    const bool use_kmer_table = search.use_kmer_table;
     
-    // the temporary MEM we'll build up in this process
-    MaximalExactMatch match(cursor, seq_end, full_range);
+    // loop maintains invariant that match.range contains the hits for seq[cursor+1:match.end]
+    if (cursor < search.seq_begin) {
+        return false;
+    }
     
-    // did we move the cursor or the end of the match last iteration?
-    bool prev_iter_jumped_lcp = false;
+    // break the MEM on N; which for DNA we assume is non-informative
+    // this *will* match many places in assemblies, but it isn't helpful
+    if (*cursor == 'N') {
+        match.begin = cursor + 1;
+        
+        mem_length = match.length();
+        
+        if (mem_length >= min_mem_length) {
 
-    int filtered_mems = 0;
-    int total_mems = 0;
-    int max_lcp = 0;
-    size_t mem_length = 0;
-    vector<int> lcp_maxima;
-    
+            mems.push_back(match);
+            lcp_maxima.push_back(max_lcp);
+            
+#ifdef debug_mapper
+#pragma omp critical
+            {
+                vector<gcsa::node_type> locations;
+                if (hit_max) {
+                    gcsa->locate(match.range, hit_max, locations);
+                } else {
+                    gcsa->locate(match.range, locations);
+                }
+                cerr << "adding MEM " << match.sequence() << " at positions ";
+                for (auto nt : locations) {
+                    cerr << make_pos_t(nt) << " ";
+                }
+                cerr << endl;
+            }
+#endif
+        }
+        
+        match.end = cursor;
+        match.range = full_range;
+        --cursor;
+        
+        prev_iter_jumped_lcp = false;
 
-    // loop maintains invariant that match.range contains the hits for seq[cursor+1:match.end]
-    while (cursor >= seq_begin) {
+        max_lcp = 0;
+
+        // skip looking for matches since they are non-informative
+        return cursor >= search.seq_begin;
+    }
+    
+    if (use_kmer_table && match.range == full_range && match.end == cursor + 1) {
+        // we're starting a new search, so if the first kmer matches, take
+        // all of its LF steps at once
+        auto kmer = find_kmer_range(search.seq_begin, cursor + 1);
+        if (kmer) {
+            match.range = kmer->range;
+            if (record_max_lcp) max_lcp = max(max_lcp, (int)kmer->max_parent_lcp);
+            mem_length += gcsa_kmers->kmer_length();
+            cursor -= gcsa_kmers->kmer_length();
+            prev_iter_jumped_lcp = false;
+            return cursor >= search.seq_begin;
+        }
+    }
+    
+    // hold onto our previous range
+    last_range = match.range;
+    
+    // execute one step of LF mapping
+    match.range = gcsa->LF(match.range, gcsa->alpha.char2comp[*cursor]);
+    
+    if (gcsa::Range::empty(match.range)
+        || (max_mem_length && match.end - cursor > max_mem_length)
+        || match.end - cursor > gcsa->order()) {
         
-        // break the MEM on N; which for DNA we assume is non-informative
-        // this *will* match many places in assemblies, but it isn't helpful
-        if (*cursor == 'N') {
+        // we've exhausted our BWT range, so the last match range was maximal
+        // or: we have exceeded the order of the graph (FPs if we go further)
+        // or: we have run over our parameter-defined MEM limit
+        
+        if (cursor + 1 == match.end) {
+            // avoid getting caught in infinite loop when a single character mismatches
+            // entire index (b/c then advancing the LCP doesn't move the search forward
+            // at all, need to move the cursor instead)
             match.begin = cursor + 1;
+            match.range = last_range;
             
-            mem_length = match.length();
+            if (match.end - match.begin >= min_mem_length) {
+                mems.push_back(match);
+                lcp_maxima.push_back(max_lcp);
+            }
             
-            if (mem_length >= min_mem_length) {
-
+            match.end = cursor;
+            match.range = full_range;
+            --cursor;
+            
+            // don't reseed in empty MEMs
+            prev_iter_jumped_lcp = false;
+            max_lcp = 0;
+        }
+        else {
+            match.begin = cursor + 1;
+            match.range = last_range;
+            mem_length = match.end - match.begin;
+            // record the last MEM, but check to make sure were not actually still searching
+            // for the end of the next MEM
+            if (mem_length >= min_mem_length && !prev_iter_jumped_lcp) {
                 mems.push_back(match);
                 lcp_maxima.push_back(max_lcp);
                 
@@ -367,99 +659,39 @@ vector<MaximalExactMatch> BaseMapper::find_mems_deep(string::const_iterator seq_
 #endif
             }
             
-            match.end = cursor;
-            match.range = full_range;
-            --cursor;
-            
-            prev_iter_jumped_lcp = false;
-
-            max_lcp = 0;
-
-            // skip looking for matches since they are non-informative
-            continue;
-        }
-        
-        // hold onto our previous range
-        last_range = match.range;
-        
-        // execute one step of LF mapping
-        match.range = gcsa->LF(match.range, gcsa->alpha.char2comp[*cursor]);
-        
-        if (gcsa::Range::empty(match.range)
-            || (max_mem_length && match.end - cursor > max_mem_length)
-            || match.end - cursor > gcsa->order()) {
-            
-            // we've exhausted our BWT range, so the last match range was maximal
-            // or: we have exceeded the order of the graph (FPs if we go further)
-            // or: we have run over our parameter-defined MEM limit
-            
-            if (cursor + 1 == match.end) {
-                // avoid getting caught in infinite loop when a single character mismatches
-                // entire index (b/c then advancing the LCP doesn't move the search forward
-                // at all, need to move the cursor instead)
-                match.begin = cursor + 1;
-                match.range = last_range;
-                
-                if (match.end - match.begin >= min_mem_length) {
-                    mems.push_back(match);
-                    lcp_maxima.push_back(max_lcp);
-                }
-                
-                match.end = cursor;
-                match.range = full_range;
-                --cursor;
-                
-                // don't reseed in empty MEMs
-                prev_iter_jumped_lcp = false;
-                max_lcp = 0;
-            }
-            else {
-                match.begin = cursor + 1;
-                match.range = last_range;
-                mem_length = match.end - match.begin;
-                // record the last MEM, but check to make sure were not actually still searching
-                // for the end of the next MEM
-                if (mem_length >= min_mem_length && !prev_iter_jumped_lcp) {
-                    mems.push_back(match);
-                    lcp_maxima.push_back(max_lcp);
-                    
-#ifdef debug_mapper
-#pragma omp critical
-                    {
-                        vector<gcsa::node_type> locations;
-                        if (hit_max) {
-                            gcsa->locate(match.range, hit_max, locations);
-                        } else {
-                            gcsa->locate(match.range, locations);
-                        }
-                        cerr << "adding MEM " << match.sequence() << " at positions ";
-                        for (auto nt : locations) {
-                            cerr << make_pos_t(nt) << " ";
-                        }
-                        cerr << endl;
-                    }
-#endif
-                }
-                
-                // get the parent suffix tree node corresponding to the parent of the last MEM's STNode
-                gcsa::STNode parent = lcp->parent(last_range);
-                // set the MEM to be the longest prefix that is shared with another MEM
-                match.end = match.begin + parent.lcp();
-                // and set up the next MEM using the parent node range
-                match.range = parent.range();
-                // record our max lcp
-                if (record_max_lcp) max_lcp = (int)parent.lcp();
-                prev_iter_jumped_lcp = true;
-            }
-        }
-        else {
-            prev_iter_jumped_lcp = false;
-            if (record_max_lcp) max_lcp = max(max_lcp, (int)lcp->parent(match.range).lcp());
-            ++mem_length;
-            // just step to the next position
-            --cursor;
+            // get the parent suffix tree node corresponding to the parent of the last MEM's STNode
+            gcsa::STNode parent = lcp->parent(last_range);
+            // set the MEM to be the longest prefix that is shared with another MEM
+            match.end = match.begin + parent.lcp();
+            // and set up the next MEM using the parent node range
+            match.range = parent.range();
+            // record our max lcp
+            if (record_max_lcp) max_lcp = (int)parent.lcp();
+            prev_iter_jumped_lcp = true;
         }
     }
+    else {
+        prev_iter_jumped_lcp = false;
+        if (record_max_lcp) max_lcp = max(max_lcp, (int)lcp->parent(match.range).lcp());
+        ++mem_length;
+        // just step to the next position
+        --cursor;
+    }
+    
+    return cursor >= search.seq_begin;
+}
+
+void BaseMapper::finish_smem_search(SMEMSearch& search) {
+    
+    MaximalExactMatch& match = search.match;
+    int& max_lcp = search.max_lcp;
+    size_t& mem_length = search.mem_length;
+    vector<MaximalExactMatch>& mems = search.mems;
+    vector<int>& lcp_maxima = search.lcp_maxima;
+    const int min_mem_length = search.min_mem_length;
+    const bool record_max_lcp = search.record_max_lcp;
+    const string::const_iterator seq_begin = search.seq_begin;
+    
     // TODO: is this where the bug with the duplicated MEMs is occurring? (when the prefix of a read
     // contains multiple non SMEM hits so that the iteration will loop through the LCP routine multiple
     // times before escaping out of the loop?
@@ -488,7 +720,27 @@ vector<MaximalExactMatch> BaseMapper::find_mems_deep(string::const_iterator seq_
         }
 #endif
     }
+}
 
+vector<MaximalExactMatch> BaseMapper::complete_mems_deep(SMEMSearch& search,
+                                                         double& longest_lcp,
+                                                         double& fraction_filtered,
+                                                         int reseed_length,
+                                                         bool use_lcp_reseed_heuristic,
+                                                         bool use_diff_based_fast_reseed,
+                                                         bool include_parent_in_sub_mem_count,
+                                                         int reseed_below) {
+    
+    string::const_iterator seq_begin = search.seq_begin;
+    string::const_iterator seq_end = search.seq_end;
+    int min_mem_length = search.min_mem_length;
+    bool record_max_lcp = search.record_max_lcp;
+    vector<MaximalExactMatch>& mems = search.mems;
+    vector<int>& lcp_maxima = search.lcp_maxima;
+    
+    int filtered_mems = 0;
+    int total_mems = 0;
+    
     if (record_max_lcp) longest_lcp = lcp_maxima.empty() ? 0 : *max_element(lcp_maxima.begin(), lcp_maxima.end());
 
     assert(!record_max_lcp || lcp_maxima.size() == mems.size());
@@ -554,15 +806,19 @@ vector<MaximalExactMatch> BaseMapper::find_mems_deep(string::const_iterator seq_
                     
                     // reseed using the technique indicated by the mapper's parameters
                     vector<pair<MaximalExactMatch, vector<size_t>>> sub_mems;
-                    if (fast_reseed) {
-                        find_sub_mems_fast(mems, layer_begin, layer_end, i,
-                                           possible_containment_boundary, seed_boundary,
-                                           min_sub_mem_length, sub_mems);
-                    }
-                    else {
-                        find_sub_mems(mems, layer_begin, layer_end, i, seed_boundary,
-                                      min_sub_mem_length, sub_mems);
+                    {
+                        VG_PROFILE_STAGE(SUB_MEM_RESEED);
+                        if (fast_reseed) {
+                            find_sub_mems_fast(mems, layer_begin, layer_end, i,
+                                               possible_containment_boundary, seed_boundary,
+                                               min_sub_mem_length, sub_mems);
+                        }
+                        else {
+                            find_sub_mems(mems, layer_begin, layer_end, i, seed_boundary,
+                                          min_sub_mem_length, sub_mems);
+                        }
                     }
+                    VG_PROFILE_COUNT(SUB_MEMS, sub_mems.size());
                     
                     for (pair<MaximalExactMatch, vector<size_t>>& sub_mem_and_parents : sub_mems) {
                         // move the MEM to the return vector and the parents to the containment graph
@@ -584,6 +840,19 @@ vector<MaximalExactMatch> BaseMapper::find_mems_deep(string::const_iterator seq_
         }
     }
     
+    // find the low-complexity stretches of the read, as prefix sums of the
+    // masked bases, so we can avoid locating repetitive hits that are found
+    // only because of them
+    vector<size_t> masked_before;
+    if (low_complexity_window && seq_end > seq_begin) {
+        LowComplexityMasker masker(low_complexity_window, low_complexity_base_entropy, low_complexity_dimer_entropy);
+        vector<bool> mask = masker.mask(&(*seq_begin), seq_end - seq_begin);
+        masked_before.resize(mask.size() + 1, 0);
+        for (size_t i = 0; i < mask.size(); i++) {
+            masked_before[i + 1] = masked_before[i] + mask[i];
+        }
+    }
+    
     // query the locations of the hits
     // note: iterate in reverse so we remove the parent count from the children MEMs before decrementing
     // the parent count itself
@@ -598,16 +867,22 @@ vector<MaximalExactMatch> BaseMapper::find_mems_deep(string::const_iterator seq_
             }
         }
         
+        if (!masked_before.empty() && mem.match_count > 1
+            && mem.begin >= seq_begin && mem.end <= seq_end
+            && 2 * (masked_before[mem.end - seq_begin] - masked_before[mem.begin - seq_begin]) >= mem.length()) {
+            // the hits are probably just the low-complexity sequence, so
+            // leave them unlocated, as if over the hit cap
+            filtered_mems += mem.match_count;
+            continue;
+        }
+        
         if (mem.match_count > 0) {
-            if (hit_max) {
-                gcsa->locate(mem.range, hit_max, mem.nodes);
-                
-            } else {
-                gcsa->locate(mem.range, mem.nodes);
-            }
+            locate_hits(mem.range, mem.nodes);
             // keep track of the initial number of hits we query in case the nodes vector is
             // modified later (e.g. by prefiltering)
             mem.queried_count = mem.nodes.size();
+            // hits along walks that no haplotype follows count as filtered
+            filter_hits_by_haplotypes(mem);
             
             filtered_mems += mem.match_count - mem.nodes.size();
             total_mems += mem.nodes.size();
@@ -655,6 +930,7 @@ vector<MaximalExactMatch> BaseMapper::find_mems_deep(string::const_iterator seq_
         precollapse_order_length_runs(seq_begin, mems);
     }
 
+    VG_PROFILE_COUNT(MEMS, mems.size());
     return mems;
 }
 
@@ -690,7 +966,8 @@ void BaseMapper::find_sub_mems(const vector<MaximalExactMatch>& mems,
     string::const_iterator sub_mem_end = mem.end;
     
     // the range that matches search_start:sub_mem_end
-    gcsa::range_type range = gcsa::range_type(0, gcsa->size() - 1);
+    gcsa::range_type full_range = gcsa::range_type(0, gcsa->size() - 1);
+    gcsa::range_type range = full_range;
     
     // did we move the cursor or the end of the match last iteration?
     bool prev_iter_jumped_lcp = false;
@@ -701,6 +978,18 @@ void BaseMapper::find_sub_mems(const vector<MaximalExactMatch>& mems,
         // routine (unlike the SMEM routine) since they should never make it into a parent
         // SMEM in the first place
         
+        if (range == full_range && sub_mem_end == cursor + 1) {
+            // we're starting a new search, so if every suffix of the first kmer has
+            // hits outside the parent, take all of its LF steps at once
+            auto kmer = find_kmer_range(mem.begin, cursor + 1);
+            if (kmer && kmer->min_count > parent_count) {
+                range = kmer->range;
+                cursor -= gcsa_kmers->kmer_length();
+                prev_iter_jumped_lcp = false;
+                continue;
+            }
+        }
+        
         // hold onto our previous range
         gcsa::range_type last_range = range;
         // execute one step of LF mapping
@@ -1298,6 +1587,11 @@ void BaseMapper::precollapse_order_length_runs(string::const_iterator seq_begin,
 void BaseMapper::rescue_high_count_order_length_mems(vector<MaximalExactMatch>& mems,
                                                      size_t max_rescue_hit_count) {
     
+    if (!gcsa) {
+        // minimizer hits are never left unfilled
+        return;
+    }
+    
     vector<pair<size_t, size_t>> unfilled_mem_ranges;
     
     // identify the ranges of MEMs that are unfilled
@@ -1333,11 +1627,7 @@ void BaseMapper::rescue_high_count_order_length_mems(vector<MaximalExactMatch>&
             cerr << "found unfilled order length tract from MEM indexes " << mem_range.first << ":" << mem_range.second << ", filling with representative " << mems[min_hit_mem] << " with " << min_hit_count << " hits" << endl;
 #endif
 
-            if (hit_max) {
-                gcsa->locate(mems[min_hit_mem].range, hit_max, mems[min_hit_mem].nodes);
-            } else {
-                gcsa->locate(mems[min_hit_mem].range, mems[min_hit_mem].nodes);
-            }
+            locate_hits(mems[min_hit_mem].range, mems[min_hit_mem].nodes);
         }
     }
 }
@@ -1587,6 +1877,60 @@ bool BaseMapper::has_fixed_fragment_length_distr() {
     return fragment_length_distr.is_finalized();
 }
 
+void BaseMapper::set_gcsa_kmer_table(const GCSAKmerTable* table) {
+    if (table && (!gcsa || table->gcsa_size() != gcsa->size())) {
+        throw runtime_error("BaseMapper: kmer table was not made from this GCSA2 index");
+    }
+    gcsa_kmers = table;
+}
+
+void BaseMapper::set_locate_cache(GCSALocateCache* cache) {
+    locate_cache = cache;
+}
+
+void BaseMapper::set_cluster_graph_cache(ClusterGraphCache* cache) {
+    cluster_graph_cache = cache;
+}
+
+void BaseMapper::set_path_position_index(const PathPositionIndex* index) {
+    path_positions = index;
+}
+
+void BaseMapper::set_minimizer_index(const MinimizerIndex* index) {
+    minimizer_index = index;
+}
+
+void BaseMapper::set_haplotype_filter(const gbwt::GBWT* haplotypes) {
+    haplotype_filter = haplotypes;
+}
+
+map<string, vector<pair<size_t, bool> > > BaseMapper::offsets_in_paths(pos_t pos) const {
+    return path_positions ? path_positions->offsets_in_paths(pos) : xindex->offsets_in_paths(pos);
+}
+
+map<string, vector<pair<size_t, bool> > > BaseMapper::nearest_offsets_in_paths(pos_t pos, int64_t max_search) const {
+    return path_positions ? path_positions->nearest_offsets_in_paths(pos, max_search)
+        : xindex->nearest_offsets_in_paths(pos, max_search);
+}
+
+void BaseMapper::locate_hits(const gcsa::range_type& range, vector<gcsa::node_type>& nodes) {
+    if (locate_cache) {
+        locate_cache->locate(range, hit_max, nodes);
+    } else if (hit_max) {
+        gcsa->locate(range, hit_max, nodes);
+    } else {
+        gcsa->locate(range, nodes);
+    }
+}
+
+const GCSAKmerTable::Entry* BaseMapper::find_kmer_range(string::const_iterator search_begin,
+                                                        string::const_iterator end) const {
+    if (!gcsa_kmers || end - search_begin < (int64_t) gcsa_kmers->kmer_length()) {
+        return nullptr;
+    }
+    return gcsa_kmers->find(end - gcsa_kmers->kmer_length());
+}
+
 void BaseMapper::force_fragment_length_distr(double mean, double stddev) {
     fragment_length_distr.force_parameters(mean, stddev);
 }
@@ -1668,33 +2012,37 @@ void BaseMapper::apply_haplotype_consistency_scores(const vector<Alignment*>& al
     // count from the XG index that was generated alongside the GBWT.
     haplo::haploMath::RRMemo haplo_memo(recombination_penalty, haplotype_count);
     
+    // Alignments with no actual mappings don't need scoring. But we don't
+    // want to treat them as scoring failures, because we expect some due to
+    // e.g. read pair mapping locations where one read maps and the other
+    // needs rescue. We will skip them but continue on with the rescoring, and
+    // also skip them when applying the scores.
+    vector<const Path*> to_score;
+    to_score.reserve(alns.size());
+    for (auto* aln : alns) {
+        if (aln->path().mapping_size() != 0) {
+            to_score.push_back(&aln->path());
+        }
+    }
+    
+    // Score all the paths together, since candidates mostly share their nodes.
+    // Each score is a logprob (so, negative), and expresses the probability of
+    // the haplotype path being followed.
+    auto scored = haplo_score_provider->score_batch(to_score, haplo_memo);
+    
     // This holds all the computed haplotype logprobs
     vector<double> haplotype_logprobs;
     haplotype_logprobs.reserve(alns.size());
     
+    auto next_scored = scored.begin();
     for (auto* aln : alns) {
-        // On a first pass through, compute all the scores and make sure they all can be computed
-        
         if (aln->path().mapping_size() == 0) {
-            // Alignments with no actual mappings don't need scoring. But we
-            // don't want to treat them as scoring failures, because we expect
-            // some due to e.g. read pair mapping locations where one read maps
-            // and the other needs rescue. We will skip them but continue on
-            // with the rescoring, and also skip them when applying the scores.
-            
             // Do a no-op adjustment
             haplotype_logprobs.push_back(0);
-            
             continue;
         }
         
-        // Score the path
-        // This is a logprob (so, negative), and expresses the probability of the haplotype path being followed
-        double haplotype_logprob;
-        bool path_valid;
-        std::tie(haplotype_logprob, path_valid) = haplo_score_provider->score(aln->path(), haplo_memo);
-        
-        if (!path_valid) {
+        if (!next_scored->second) {
             // Our path does something the scorer doesn't like.
             // Bail out of applying haplotype scores.
             if (debug) {
@@ -1704,7 +2052,8 @@ void BaseMapper::apply_haplotype_consistency_scores(const vector<Alignment*>& al
         }
         
         // Otherwise we haven't had a scoring failure yet, so keep going
-        haplotype_logprobs.push_back(haplotype_logprob);
+        haplotype_logprobs.push_back(next_scored->first);
+        ++next_scored;
     }
     
     if (debug) {
@@ -1796,6 +2145,9 @@ Mapper::Mapper(xg::XG* xidex,
     , thread_extension(10)
     , max_multimaps(1)
     , min_multimaps(4)
+    , prune_clusters_by_score_bound(false)
+    , max_ungapped_mismatches(-1)
+    , xdrop_extend_in_graph(false)
     , max_attempts(0)
     , min_cluster_length(0)
     , softclip_threshold(0)
@@ -1987,7 +2339,9 @@ pos_t Mapper::likely_mate_position(const Alignment& aln, bool is_first_mate) {
 }
 
 map<string, vector<pair<size_t, bool> > > Mapper::alignment_path_offsets(const Alignment& aln, bool just_min, bool nearby) const {
-    return xg_alignment_path_offsets(aln, just_min, nearby, xindex);
+    return vg::alignment_path_offsets(aln, just_min, nearby,
+                                      [&](pos_t pos) { return offsets_in_paths(pos); },
+                                      [&](pos_t pos, int64_t max_search) { return nearest_offsets_in_paths(pos, max_search); });
 }
 
 vector<pos_t> Mapper::likely_mate_positions(const Alignment& aln, bool is_first_mate) {
@@ -1997,7 +2351,7 @@ vector<pos_t> Mapper::likely_mate_positions(const Alignment& aln, bool is_first_
     }
     map<string, vector<pair<size_t, bool> > > offsets;
     for (auto& mapping : aln.path().mapping()) {
-        auto pos_offs = xindex->nearest_offsets_in_paths(make_pos_t(mapping.position()), aln.sequence().size());
+        auto pos_offs = nearest_offsets_in_paths(make_pos_t(mapping.position()), aln.sequence().size());
         for (auto& p : pos_offs) {
             if (offsets.find(p.first)  == offsets.end()) {
                 offsets[p.first] = p.second;
@@ -2062,7 +2416,9 @@ vector<pos_t> Mapper::likely_mate_positions(const Alignment& aln, bool is_first_
 
 pair<bool, bool> Mapper::pair_rescue(Alignment& mate1, Alignment& mate2,
                                      bool& tried1, bool& tried2,
-                                     int match_score, int full_length_bonus, bool traceback, bool xdrop_alignment) {
+                                     int match_score, int full_length_bonus, bool traceback, bool xdrop_alignment,
+                                     PairRescueCache* cache) {
+    VG_PROFILE_STAGE(PAIR_RESCUE);
     auto pair_sig = signature(mate1, mate2);
     // bail out if we can't figure out how far to go
     bool rescued1 = false;
@@ -2107,36 +2463,80 @@ pair<bool, bool> Mapper::pair_rescue(Alignment& mate1, Alignment& mate2,
         return make_pair(false, false);
     }
     if (mate_positions.empty()) return make_pair(false, false); // can't rescue because the selected mate is unaligned
-    Graph graph;
     set<bool> orientations;
 #ifdef debug_rescue
     if (debug) cerr << "got " << mate_positions.size() << " mate positions" << endl;
 #endif
     for (auto& mate_pos : mate_positions) {
+        orientations.insert(is_rev(mate_pos));
+    }
+    int get_at_least = (!frag_stats.cached_fragment_length_mean ? frag_stats.fragment_max
+                        : min(frag_stats.fragment_max/2,
+                              (int64_t)max((double)frag_stats.cached_fragment_length_stdev * 10.0,
+                                           mate1.sequence().size() * 3.0)));
+    
+    // get the subgraph overlapping the mate positions, unless we've already extracted it for this read pair
+    Graph local_graph;
+    bool local_acyclic_and_sorted = false;
+    Graph* graph_ptr = &local_graph;
+    bool* acyclic_and_sorted_ptr = &local_acyclic_and_sorted;
+    bool extract = true;
+    if (cache) {
+        auto inserted = cache->subgraphs.emplace(make_pair(mate_positions, get_at_least), make_pair(Graph(), false));
+        graph_ptr = &inserted.first->second.first;
+        acyclic_and_sorted_ptr = &inserted.first->second.second;
+        extract = inserted.second;
+    }
+    Graph& graph = *graph_ptr;
+    if (extract) {
+        for (auto& mate_pos : mate_positions) {
 #ifdef debug_rescue
-        if (debug) cerr << "aiming for " << mate_pos << endl;
+            if (debug) cerr << "aiming for " << mate_pos << endl;
 #endif
-        orientations.insert(is_rev(mate_pos));
-        int get_at_least = (!frag_stats.cached_fragment_length_mean ? frag_stats.fragment_max
-                            : min(frag_stats.fragment_max/2,
-                                  (int64_t)max((double)frag_stats.cached_fragment_length_stdev * 10.0,
-                                               mate1.sequence().size() * 3.0)));
-        //cerr << "Getting at least " << get_at_least << endl;
-        graph.MergeFrom(xindex->graph_context_id(mate_pos, get_at_least/2));
-        graph.MergeFrom(xindex->graph_context_id(reverse(mate_pos, get_node_length(id(mate_pos))), get_at_least/2));
-        //if (debug) cerr << "rescue got graph " << pb2json(graph) << endl;
-        // if we're reversed, align the reverse sequence and flip it back
-        // align against it
-    }
-    sort_by_id_dedup_and_clean(graph);
-    bool acyclic_and_sorted = is_id_sortable(graph) && !has_inversion(graph);
+            //cerr << "Getting at least " << get_at_least << endl;
+            graph.MergeFrom(xindex->graph_context_id(mate_pos, get_at_least/2));
+            graph.MergeFrom(xindex->graph_context_id(reverse(mate_pos, get_node_length(id(mate_pos))), get_at_least/2));
+            //if (debug) cerr << "rescue got graph " << pb2json(graph) << endl;
+            // if we're reversed, align the reverse sequence and flip it back
+            // align against it
+        }
+        sort_by_id_dedup_and_clean(graph);
+        *acyclic_and_sorted_ptr = is_id_sortable(graph) && !has_inversion(graph);
+    }
+    bool acyclic_and_sorted = *acyclic_and_sorted_ptr;
     //VG g; g.extend(graph);string h = g.hash();
     //g.serialize_to_file("rescue-" + h + ".vg");
+    
+    // different mate positions often land in the same window, so rescues are shared by the nodes they align to
+    vector<id_t> window_nodes;
+    if (cache) {
+        window_nodes.reserve(graph.node_size());
+        for (auto& node : graph.node()) {
+            window_nodes.push_back(node.id());
+        }
+    }
+    // align a mate to the rescue subgraph, or reuse the alignment from an earlier rescue into the same window
+    auto align_rescue = [&](const Alignment& mate, bool is_first, bool orientation, bool with_traceback) -> Alignment {
+        if (!cache) {
+            return align_maybe_flip(mate, graph, orientation, with_traceback, acyclic_and_sorted, false, xdrop_alignment);
+        }
+        auto key = make_tuple(is_first, orientation, with_traceback, window_nodes);
+        auto found = cache->alignments.find(key);
+        if (found == cache->alignments.end()) {
+            found = cache->alignments.emplace(key, align_maybe_flip(mate, graph, orientation, with_traceback,
+                                                                    acyclic_and_sorted, false, xdrop_alignment)).first;
+        }
+        else {
+            VG_PROFILE_COUNT(RESCUE_CACHE_HITS, 1);
+        }
+        return found->second;
+    };
+    
     int max_mate1_score = mate1.score();
     int max_mate2_score = mate2.score();
     for (auto& orientation : orientations) {
         if (rescue_off_first) {
-            Alignment aln2 = align_maybe_flip(mate2, graph, orientation, traceback, acyclic_and_sorted, false, xdrop_alignment);
+            Alignment aln2 = align_rescue(mate2, false, orientation, traceback);
             tried2 = true;
             //write_alignment_to_file(aln2, "rescue-" + h + ".gam");
 #ifdef debug_rescue
@@ -2145,7 +2545,7 @@ pair<bool, bool> Mapper::pair_rescue(Alignment& mate1, Alignment& mate2,
 #endif
             if (aln2.score() > max_mate2_score && (double)aln2.score()/perfect_score > min_threshold && pair_consistent(mate1, aln2, accept_pval)) {
                 if (!traceback) { // now get the traceback
-                    aln2 = align_maybe_flip(mate2, graph, orientation, true, acyclic_and_sorted, false, xdrop_alignment);
+                    aln2 = align_rescue(mate2, false, orientation, true);
                 }
 #ifdef debug_rescue
                 if (debug) cerr << "rescued aln2 " << pb2json(aln2) << endl;
@@ -2156,7 +2556,7 @@ pair<bool, bool> Mapper::pair_rescue(Alignment& mate1, Alignment& mate2,
                 rescued2 = true;
             }
         } else if (rescue_off_second) {
-            Alignment aln1 = align_maybe_flip(mate1, graph, orientation, traceback, acyclic_and_sorted, false, xdrop_alignment);
+            Alignment aln1 = align_rescue(mate1, true, orientation, traceback);
             tried1 = true;
             //write_alignment_to_file(aln1, "rescue-" + h + ".gam");
 #ifdef debug_rescue
@@ -2165,7 +2565,7 @@ pair<bool, bool> Mapper::pair_rescue(Alignment& mate1, Alignment& mate2,
 #endif
             if (aln1.score() > max_mate1_score && (double)aln1.score()/perfect_score > min_threshold && pair_consistent(aln1, mate2, accept_pval)) {
                 if (!traceback) { // now get the traceback
-                    aln1 = align_maybe_flip(mate1, graph, orientation, true, acyclic_and_sorted, false, xdrop_alignment);
+                    aln1 = align_rescue(mate1, true, orientation, true);
                 }
 #ifdef debug_rescue
                 if (debug) cerr << "rescued aln1 " << pb2json(aln1) << endl;
@@ -2177,6 +2577,7 @@ pair<bool, bool> Mapper::pair_rescue(Alignment& mate1, Alignment& mate2,
             }
         }
     }
+    VG_PROFILE_COUNT(RESCUES, rescued1 + rescued2);
     // if the new alignment is better
     // set the old alignment to it
     return make_pair(rescued1, rescued2);
@@ -2280,6 +2681,10 @@ pair<vector<Alignment>, vector<Alignment>> Mapper::align_paired_multi(
     bool retrying,
     bool xdrop_alignment) {
 
+    VG_PROFILE_READ(first_mate, &second_mate);
+    VG_TIMELINE_SPAN("map pair");
+    VG_PROFILE_COUNT(READS, 2);
+
     chrono::high_resolution_clock::time_point t1 = chrono::high_resolution_clock::now();
 
     Alignment read1;
@@ -2320,25 +2725,20 @@ pair<vector<Alignment>, vector<Alignment>> Mapper::align_paired_multi(
     }
 
     pair<vector<Alignment>, vector<Alignment>> results;
-    double longest_lcp1, longest_lcp2, fraction_filtered1, fraction_filtered2;
-    // find the MEMs for the alignments
-    vector<MaximalExactMatch> mems1 = find_mems_deep(read1.sequence().begin(),
-                                                     read1.sequence().end(),
-                                                     longest_lcp1,
-                                                     fraction_filtered1,
-                                                     max_mem_length,
-                                                     min_mem_length,
-                                                     mem_reseed_length,
-                                                     false, true, true, false);
-
-    vector<MaximalExactMatch> mems2 = find_mems_deep(read2.sequence().begin(),
-                                                     read2.sequence().end(),
-                                                     longest_lcp2,
-                                                     fraction_filtered2,
-                                                     max_mem_length,
-                                                     min_mem_length,
-                                                     mem_reseed_length,
-                                                     false, true, true, false);
+    // find the MEMs for both alignments at once
+    vector<double> longest_lcps, fractions_filtered;
+    vector<vector<MaximalExactMatch>> mems_by_read = find_mems_deep_batch({make_pair(read1.sequence().begin(), read1.sequence().end()),
+                                                                           make_pair(read2.sequence().begin(), read2.sequence().end())},
+                                                                          longest_lcps,
+                                                                          fractions_filtered,
+                                                                          max_mem_length,
+                                                                          min_mem_length,
+                                                                          mem_reseed_length,
+                                                                          false, true, true, false);
+    vector<MaximalExactMatch>& mems1 = mems_by_read[0];
+    vector<MaximalExactMatch>& mems2 = mems_by_read[1];
+    double longest_lcp1 = longest_lcps[0], longest_lcp2 = longest_lcps[1];
+    double fraction_filtered1 = fractions_filtered[0], fraction_filtered2 = fractions_filtered[1];
 
     double mq_cap1, mq_cap2;
     mq_cap1 = mq_cap2 = max_mapping_quality;
@@ -2350,7 +2750,7 @@ pair<vector<Alignment>, vector<Alignment>> Mapper::align_paired_multi(
     double mem_read_ratio1 = min(1.0, (double)total_mem_length1 / (double)read1.sequence().size());
     double mem_read_ratio2 = min(1.0, (double)total_mem_length2 / (double)read2.sequence().size());
 
-    int basis_length = min((int)read1.sequence().size(), (int)gcsa->order());
+    int basis_length = min((int)read1.sequence().size(), (int)seed_order());
     double max_possible_mq = max_possible_mapping_quality(basis_length);
 
     int mem_max_length1 = 0;
@@ -2447,6 +2847,7 @@ pair<vector<Alignment>, vector<Alignment>> Mapper::align_paired_multi(
     // build the paired-read MEM markov model
     vector<vector<MaximalExactMatch> > clusters;
     if (total_multimaps) {
+        VG_PROFILE_STAGE(CLUSTERING);
         // We're going to run the chainer because we want to calculate alignments
         
         // What band width during the alignment should the chainer plan for?
@@ -2469,12 +2870,14 @@ pair<vector<Alignment>, vector<Alignment>> Mapper::align_paired_multi(
                                   return approx_position(n);
                               },
                               [&](pos_t n) -> map<string, vector<pair<size_t, bool> > > {
-                                  return xindex->offsets_in_paths(n);
+                                  return offsets_in_paths(n);
                               },
                               transition_weight,
                               band_width);
         clusters = chainer.traceback(total_multimaps, false, debug);
     }
+    VG_PROFILE_COUNT(CLUSTERS, clusters.size());
+    VG_PROFILE_COUNT(CLUSTERED_MEMS, stage_profile::total_cluster_size(clusters));
 
     auto show_clusters = [&](void) {
         cerr << "clusters: " << endl;
@@ -2733,6 +3136,8 @@ pair<vector<Alignment>, vector<Alignment>> Mapper::align_paired_multi(
         // go through the pairs and see if we need to rescue one side off the other
         bool rescued = false;
         int j = 0;
+        // rescues of one mate off different alignments of the other often aim at the same window
+        PairRescueCache rescue_cache;
         for (auto& p : aln_ptrs) {
             if (j > mate_rescues) break;
             auto& aln1 = p->first;
@@ -2740,7 +3145,8 @@ pair<vector<Alignment>, vector<Alignment>> Mapper::align_paired_multi(
             int score1 = aln1.score();
             int score2 = aln2.score();
             bool tried1 = false; bool tried2 = false;
-            pair<bool, bool> rescues = pair_rescue(aln1, aln2, tried1, tried2, match, full_length_bonus, true, xdrop_alignment);
+            pair<bool, bool> rescues = pair_rescue(aln1, aln2, tried1, tried2, match, full_length_bonus, true, xdrop_alignment,
+                                                     &rescue_cache);
             if (tried1) ++j;
             if (tried2) ++j;
             rescued_aln[&aln1] = rescues.first;
@@ -3115,7 +3521,7 @@ Mapper::align_mem_multi(const Alignment& aln,
     int total_mem_length = 0;
     for (auto& mem : mems) total_mem_length += mem.length(); // * mem.nodes.size();
     double mem_read_ratio = min(1.0, (double)total_mem_length / (double)aln.sequence().size());
-    int basis_length = min((int)aln.sequence().size(), (int)gcsa->order());
+    int basis_length = min((int)aln.sequence().size(), (int)seed_order());
     double max_possible_mq = max_possible_mapping_quality(basis_length);
 
     // Estimate the maximum mapping quality we can get if the alignments based on the good MEMs are the best ones.
@@ -3164,17 +3570,20 @@ Mapper::align_mem_multi(const Alignment& aln,
     // establish the chains
     vector<vector<MaximalExactMatch> > clusters;
     if (total_multimaps) {
+        VG_PROFILE_STAGE(CLUSTERING);
         MEMChainModel chainer({ aln.sequence().size() }, { mems },
                               [&](pos_t n) {
                                   return approx_position(n);
                               },
                               [&](pos_t n) -> map<string, vector<pair<size_t, bool> > > {
-                                  return xindex->offsets_in_paths(n);
+                                  return offsets_in_paths(n);
                               },
                               transition_weight,
                               aln.sequence().size());
         clusters = chainer.traceback(total_multimaps, false, debug);
     }
+    VG_PROFILE_COUNT(CLUSTERS, clusters.size());
+    VG_PROFILE_COUNT(CLUSTERED_MEMS, stage_profile::total_cluster_size(clusters));
     
     /*
     map<const vector<MaximalExactMatch>*, int> cluster_cov;
@@ -3231,6 +3640,36 @@ Mapper::align_mem_multi(const Alignment& aln,
 #endif
     auto to_drop = clusters_to_drop(clusters);
 
+    // The score bounds only hold for the unadjusted scores we align with
+    bool use_score_bounds = prune_clusters_by_score_bound
+        && !(adjust_alignments_for_base_quality && !aln.quality().empty())
+        && haplo_score_provider == nullptr;
+    // a secondary alignment this many points below the best one can't change its mapping quality
+    double mq_score_margin = use_score_bounds ? mq_cap / (aligner->log_base * (10.0 / log(10.0))) : 0.0;
+    
+    // the order to try the clusters in, best score bound first if we are going to prune
+    vector<vector<MaximalExactMatch>*> cluster_order;
+    vector<int32_t> score_bounds;
+    for (auto& cluster : clusters) {
+        cluster_order.push_back(&cluster);
+    }
+    if (use_score_bounds) {
+        unordered_map<vector<MaximalExactMatch>*, int32_t> bound_of;
+        for (auto cluster : cluster_order) {
+            bound_of[cluster] = cluster_score_bound(aln, *cluster);
+        }
+        // keep the chain order among equal bounds
+        stable_sort(cluster_order.begin(), cluster_order.end(),
+                    [&](vector<MaximalExactMatch>* c1, vector<MaximalExactMatch>* c2) {
+                        return bound_of[c1] > bound_of[c2];
+                    });
+        for (auto cluster : cluster_order) {
+            score_bounds.push_back(bound_of[cluster]);
+        }
+    }
+    // the scores of the real alignments we have made, best first
+    vector<int32_t> aligned_scores;
+
     // for up to our required number of multimaps
     // make the perfect-match alignment for the SMEM cluster
     // then fix it up with DP on the little bits between the alignments
@@ -3239,8 +3678,19 @@ Mapper::align_mem_multi(const Alignment& aln,
     set<string> seen_alignments;
     int multimaps = 0;
     int filled = 0;
-    for (auto& cluster : clusters) {
+    for (size_t i = 0; i < cluster_order.size(); i++) {
+        auto& cluster = *cluster_order[i];
         if (alns.size() >= total_multimaps) { break; }
+        if (use_score_bounds && filled >= min_multimaps && aligned_scores.size() >= (size_t) max(keep_multimaps, 1)) {
+            // the rest of the clusters are bounded by this one, so if it can't make it into the kept
+            // alignments or move the mapping quality of the best one, none of them can
+            int32_t bound = score_bounds[i];
+            if (bound < aligned_scores[max(keep_multimaps, 1) - 1]
+                && aligned_scores.front() - bound >= mq_score_margin) {
+                if (debug) cerr << "pruning " << cluster_order.size() - i << " clusters with score bound " << bound << endl;
+                break;
+            }
+        }
         // skip if we've filtered the cluster
         if (to_drop.count(&cluster) && filled >= min_multimaps) {
             alns.push_back(aln);
@@ -3262,6 +3712,10 @@ Mapper::align_mem_multi(const Alignment& aln,
 #endif
 
         if (!seen_alignments.count(sig)) {
+            if (use_score_bounds) {
+                aligned_scores.insert(upper_bound(aligned_scores.begin(), aligned_scores.end(), candidate.score(),
+                                                  greater<int32_t>()), candidate.score());
+            }
             alns.push_back(candidate);
             used_clusters.push_back(&cluster);
             seen_alignments.insert(sig);
@@ -3341,6 +3795,45 @@ Mapper::align_mem_multi(const Alignment& aln,
     return alns;
 }
 
+int32_t Mapper::cluster_score_bound(const Alignment& aln, const vector<MaximalExactMatch>& cluster) const {
+    auto aligner = get_aligner(!aln.quality().empty());
+    const string& seq = aln.sequence();
+    // mark the read bases the cluster covers, in read coordinates
+    vector<pair<int64_t, int64_t>> covered;
+    for (auto& mem : cluster) {
+        if (mem.begin < seq.begin() || mem.end > seq.end()) {
+            // these MEMs were found on some other string
+            return numeric_limits<int32_t>::max();
+        }
+        covered.emplace_back(mem.begin - seq.begin(), mem.end - seq.begin());
+    }
+    if (covered.empty()) {
+        return numeric_limits<int32_t>::max();
+    }
+    sort(covered.begin(), covered.end());
+    
+    int32_t match = aligner->match;
+    // the cheapest way to break off an exact match
+    int32_t break_cost = match + min<int32_t>(aligner->mismatch, aligner->gap_open);
+    int32_t bound = match * seq.size() + 2 * aligner->full_length_bonus;
+    int64_t covered_to = 0;
+    for (auto& interval : covered) {
+        if (interval.first > covered_to) {
+            if (covered_to == 0) {
+                // an uncovered start of the read can also be soft clipped
+                bound -= min<int32_t>(break_cost, interval.first * match + aligner->full_length_bonus);
+            } else {
+                bound -= break_cost;
+            }
+        }
+        covered_to = max(covered_to, interval.second);
+    }
+    if (covered_to < (int64_t) seq.size()) {
+        bound -= min<int32_t>(break_cost, (seq.size() - covered_to) * match + aligner->full_length_bonus);
+    }
+    return bound;
+}
+
 Alignment Mapper::align_maybe_flip(const Alignment& base, Graph& graph, bool flip, bool traceback, bool acyclic_and_sorted, bool banded_global, bool xdrop_alignment) {
     // do not use X-drop alignment when seed position is not available
     vector<MaximalExactMatch> mems;
@@ -3370,6 +3863,8 @@ Alignment Mapper::align_maybe_flip(const Alignment& base, Graph& graph, const ve
     bool pinned_alignment = false;
     bool pinned_reverse = false;
 
+    VG_PROFILE_STAGE(DP);
+    VG_PROFILE_COUNT(DP_CELLS, aln.sequence().size() * stage_profile::sequence_length(graph));
     aln = align_to_graph(aln,
                          graph,
                          mems,
@@ -3387,8 +3882,8 @@ Alignment Mapper::align_maybe_flip(const Alignment& base, Graph& graph, const ve
         aln.set_score(get_aligner()->remove_bonuses(aln));
     }
     if (flip) {
-        aln = reverse_complement_alignment(
-            aln,
+        reverse_complement_alignment_in_place(
+            &aln,
             (function<int64_t(int64_t)>) ([&](int64_t id) {
                     return node_length[id];
                 }));
@@ -3423,6 +3918,36 @@ Alignment Mapper::align_cluster(const Alignment& aln, const vector<MaximalExactM
         return walked;
     }
     */
+    // exact and near-exact reads that follow a single walk don't need DP
+    if (max_ungapped_mismatches >= 0
+        && !(adjust_alignments_for_base_quality && !aln.quality().empty())) {
+        Alignment ungapped;
+        bool aligned;
+        {
+            VG_PROFILE_STAGE(UNGAPPED);
+            aligned = align_cluster_ungapped(aln, mems, ungapped);
+        }
+        if (aligned) {
+            VG_PROFILE_COUNT(UNGAPPED_ALIGNMENTS, 1);
+            return ungapped;
+        }
+    }
+    if (xdrop_alignment && xdrop_extend_in_graph) {
+        // extend the best anchor straight through the xg; the band only
+        // touches the nodes it reaches, so we skip extracting the subgraph
+        Alignment aligned = aln;
+        {
+            VG_PROFILE_STAGE(DP);
+            get_regular_aligner()->align_xdrop(aligned, *xindex, mems, alignment_threads > 1);
+        }
+        if (traceback && !include_full_length_bonuses && aligned.score()) {
+            remove_full_length_bonuses(aligned);
+        }
+        if (strip_bonuses && traceback) {
+            aligned.set_score(get_aligner()->remove_bonuses(aligned));
+        }
+        return aligned;
+    }
     // poll the mems to see if we should flip
     int count_fwd = 0, count_rev = 0;
     for (auto& mem : mems) {
@@ -3434,8 +3959,23 @@ Alignment Mapper::align_cluster(const Alignment& aln, const vector<MaximalExactM
         }
     }
     // get the graph with cluster.hpp's cluster_subgraph
-    Graph graph = cluster_subgraph_walk(*xindex, aln, mems, 1);
-    bool acyclic_and_sorted = is_id_sortable(graph) && !has_inversion(graph);
+    Graph graph;
+    bool acyclic_and_sorted;
+    {
+        VG_PROFILE_STAGE(SUBGRAPH_EXTRACTION);
+        if (cluster_graph_cache) {
+            // reads with the same anchors share a subgraph; we copy it
+            // because the aligners want to hold on to mutable nodes
+            auto cached = cluster_graph_cache->get(aln, mems, [&]() {
+                return cluster_subgraph_walk(*xindex, aln, mems, 1);
+            });
+            graph = cached->graph;
+            acyclic_and_sorted = cached->acyclic_and_sorted;
+        } else {
+            graph = cluster_subgraph_walk(*xindex, aln, mems, 1);
+            acyclic_and_sorted = is_id_sortable(graph) && !has_inversion(graph);
+        }
+    }
     // and test each direction for which we have MEM hits
     Alignment aln_fwd;
     Alignment aln_rev;
@@ -3462,6 +4002,247 @@ Alignment Mapper::align_cluster(const Alignment& aln, const vector<MaximalExactM
     }
 }
 
+bool Mapper::align_cluster_ungapped(const Alignment& aln, const vector<MaximalExactMatch>& mems, Alignment& out) {
+    const string& seq = aln.sequence();
+    if (mems.empty() || seq.empty() || seq.find('N') != string::npos) {
+        return false;
+    }
+    vector<const MaximalExactMatch*> sorted_mems;
+    for (auto& mem : mems) {
+        if (mem.begin < seq.begin() || mem.end > seq.end() || mem.begin >= mem.end || mem.nodes.empty()) {
+            // these MEMs were found on some other string
+            return false;
+        }
+        sorted_mems.push_back(&mem);
+    }
+    sort(sorted_mems.begin(), sorted_mems.end(), [](const MaximalExactMatch* a, const MaximalExactMatch* b) {
+        return a->begin < b->begin;
+    });
+    int64_t first_begin = sorted_mems.front()->begin - seq.begin();
+    int64_t last_end = 0;
+    for (auto mem : sorted_mems) {
+        last_end = max<int64_t>(last_end, mem->end - seq.begin());
+    }
+    
+    // the MEMs starting at each read offset, for choosing among branches
+    unordered_map<int64_t, vector<pos_t>> mem_starts;
+    for (auto mem : sorted_mems) {
+        mem_starts[mem->begin - seq.begin()].push_back(make_pos_t(mem->nodes.front()));
+    }
+    
+    // the handle, offset on it, and graph base under each read base we walk over
+    vector<handle_t> handles(seq.size());
+    vector<size_t> offsets(seq.size());
+    string ref(seq.size(), 'N');
+    
+    pos_t anchor = make_pos_t(sorted_mems.front()->nodes.front());
+    handle_t handle = xindex->get_handle(id(anchor), is_rev(anchor));
+    string node_seq = xindex->get_sequence(handle);
+    if (offset(anchor) >= node_seq.size()) {
+        return false;
+    }
+    handles[first_begin] = handle;
+    offsets[first_begin] = offset(anchor);
+    ref[first_begin] = node_seq[offset(anchor)];
+    
+    // pick the one neighbor the walk should step onto, preferring one a MEM
+    // starts on, then the only one whose base matches the read, and then the
+    // only one there is
+    auto choose_neighbor = [&](const handle_t& from, bool go_left, int64_t i, handle_t& chosen) {
+        vector<handle_t> neighbors;
+        xindex->follow_edges(from, go_left, [&](const handle_t& next) {
+            neighbors.push_back(next);
+            return true;
+        });
+        if (neighbors.empty()) {
+            return false;
+        }
+        if (!go_left && mem_starts.count(i)) {
+            for (auto& next : neighbors) {
+                for (auto& pos : mem_starts[i]) {
+                    if (id(pos) == xindex->get_id(next) && is_rev(pos) == xindex->get_is_reverse(next) && offset(pos) == 0) {
+                        chosen = next;
+                        return true;
+                    }
+                }
+            }
+        }
+        size_t matching = 0;
+        for (auto& next : neighbors) {
+            size_t length = xindex->get_length(next);
+            if (length && xindex->pos_char(xindex->get_id(next), xindex->get_is_reverse(next),
+                                           go_left ? length - 1 : 0) == seq[i]) {
+                chosen = next;
+                ++matching;
+            }
+        }
+        if (matching == 1) {
+            return true;
+        }
+        if (matching == 0 && neighbors.size() == 1) {
+            chosen = neighbors.front();
+            return true;
+        }
+        // we can't tell which way to go without aligning
+        return false;
+    };
+    
+    // walk right to the end of the read or the graph
+    int64_t walk_end = first_begin + 1;
+    {
+        handle_t h = handle;
+        size_t off = offset(anchor);
+        string h_seq = node_seq;
+        for (; walk_end < (int64_t) seq.size(); ++walk_end) {
+            ++off;
+            while (off == h_seq.size()) {
+                handle_t next;
+                if (!choose_neighbor(h, false, walk_end, next)) {
+                    break;
+                }
+                h = next;
+                h_seq = xindex->get_sequence(h);
+                off = 0;
+            }
+            if (off >= h_seq.size()) {
+                break;
+            }
+            handles[walk_end] = h;
+            offsets[walk_end] = off;
+            ref[walk_end] = h_seq[off];
+        }
+    }
+    if (walk_end < last_end) {
+        return false;
+    }
+    
+    // and walk left to the start of the read or the graph
+    int64_t walk_begin = first_begin;
+    {
+        handle_t h = handle;
+        size_t off = offset(anchor);
+        string h_seq = node_seq;
+        while (walk_begin > 0) {
+            bool stepped = true;
+            while (off == 0) {
+                handle_t prev;
+                if (!choose_neighbor(h, true, walk_begin - 1, prev)) {
+                    stepped = false;
+                    break;
+                }
+                h = prev;
+                h_seq = xindex->get_sequence(h);
+                off = h_seq.size();
+            }
+            if (!stepped) {
+                break;
+            }
+            --off;
+            --walk_begin;
+            handles[walk_begin] = h;
+            offsets[walk_begin] = off;
+            ref[walk_begin] = h_seq[off];
+        }
+    }
+    
+    // every MEM has to land where the walk puts it, or there's a gap somewhere
+    for (auto mem : sorted_mems) {
+        int64_t b = mem->begin - seq.begin();
+        pos_t pos = make_pos_t(mem->nodes.front());
+        if (xindex->get_id(handles[b]) != id(pos) || xindex->get_is_reverse(handles[b]) != is_rev(pos)
+            || offsets[b] != offset(pos)) {
+            return false;
+        }
+        for (int64_t i = b; i < b + (mem->end - mem->begin); ++i) {
+            if (ref[i] != seq[i]) {
+                return false;
+            }
+        }
+    }
+    
+    auto aligner = get_aligner(!aln.quality().empty());
+    auto base_score = [&](int64_t i) {
+        return ref[i] == seq[i] ? (int32_t) aligner->match : -(int32_t) aligner->mismatch;
+    };
+    int32_t end_bonus = include_full_length_bonuses ? aligner->full_length_bonus : 0;
+    
+    // soft clip the tails past the outermost MEMs if that scores better
+    int64_t clip_begin = first_begin;
+    {
+        int32_t running = 0, best = 0;
+        for (int64_t i = first_begin - 1; i >= walk_begin; --i) {
+            running += base_score(i);
+            int32_t total = running + (i == 0 ? end_bonus : 0);
+            if (total > best) {
+                best = total;
+                clip_begin = i;
+            }
+        }
+    }
+    int64_t clip_end = last_end;
+    {
+        int32_t running = 0, best = 0;
+        for (int64_t i = last_end; i < walk_end; ++i) {
+            running += base_score(i);
+            int32_t total = running + (i + 1 == (int64_t) seq.size() ? end_bonus : 0);
+            if (total > best) {
+                best = total;
+                clip_end = i + 1;
+            }
+        }
+    }
+    
+    int mismatches = 0;
+    for (int64_t i = clip_begin; i < clip_end; ++i) {
+        if (ref[i] != seq[i]) {
+            ++mismatches;
+        }
+    }
+    if (mismatches > max_ungapped_mismatches) {
+        return false;
+    }
+    
+    // build the path, one mapping per node visit
+    Path path;
+    Mapping* mapping = nullptr;
+    for (int64_t i = clip_begin; i < clip_end; ++i) {
+        if (mapping == nullptr || handles[i] != handles[i - 1] || offsets[i] != offsets[i - 1] + 1) {
+            mapping = path.add_mapping();
+            Position* position = mapping->mutable_position();
+            position->set_node_id(xindex->get_id(handles[i]));
+            position->set_is_reverse(xindex->get_is_reverse(handles[i]));
+            position->set_offset(offsets[i]);
+            mapping->set_rank(path.mapping_size());
+            if (i == clip_begin && clip_begin > 0) {
+                Edit* clip = mapping->add_edit();
+                clip->set_to_length(clip_begin);
+                clip->set_sequence(seq.substr(0, clip_begin));
+            }
+        }
+        bool is_match = ref[i] == seq[i];
+        Edit* edit = mapping->edit_size() ? mapping->mutable_edit(mapping->edit_size() - 1) : nullptr;
+        if (edit == nullptr || edit->from_length() == 0 || edit_is_match(*edit) != is_match) {
+            edit = mapping->add_edit();
+        }
+        edit->set_from_length(edit->from_length() + 1);
+        edit->set_to_length(edit->to_length() + 1);
+        if (!is_match) {
+            edit->mutable_sequence()->push_back(seq[i]);
+        }
+    }
+    if (clip_end < (int64_t) seq.size()) {
+        Edit* clip = mapping->add_edit();
+        clip->set_to_length(seq.size() - clip_end);
+        clip->set_sequence(seq.substr(clip_end));
+    }
+    
+    out = aln;
+    *out.mutable_path() = path;
+    out.set_score(aligner->score_ungapped_alignment(out, strip_bonuses || !include_full_length_bonuses));
+    out.set_identity(identity(out.path()));
+    return out.score() > 0;
+}
+
 VG Mapper::cluster_subgraph_strict(const Alignment& aln, const vector<MaximalExactMatch>& mems) {
 #ifdef debug_mapper
 #pragma omp critical
@@ -3814,18 +4595,21 @@ bool Mapper::check_alignment(const Alignment& aln) {
     // use the graph to extract the sequence
     // assert that this == the alignment
     if (aln.path().mapping_size()) {
-        // get the graph corresponding to the alignment path
-        Graph sub;
+        // get the view of the graph corresponding to the alignment path
+        SubHandleGraph sub(xindex);
         for (int i = 0; i < aln.path().mapping_size(); ++ i) {
             auto& m = aln.path().mapping(i);
             if (m.has_position() && m.position().node_id()) {
                 auto id = aln.path().mapping(i).position().node_id();
-                // XXXXXX this is single-threaded!
                 xindex->neighborhood(id, 2, sub);
             }
         }
-        VG g; g.extend(sub);
-        auto seq = g.path_string(aln.path());
+        string seq;
+        for (int i = 0; i < aln.path().mapping_size(); ++i) {
+            auto& m = aln.path().mapping(i);
+            id_t id = m.position().node_id();
+            seq.append(mapping_sequence(m, sub.has_node(id) ? sub.get_sequence(sub.get_handle(id, false)) : string()));
+        }
         //if (aln.sequence().find('N') == string::npos && seq != aln.sequence()) {
         if (aln.quality().size() && aln.quality().size() != aln.sequence().size()) {
             cerr << "alignment quality is not the same length as its sequence" << endl
@@ -3840,8 +4624,10 @@ bool Mapper::check_alignment(const Alignment& aln) {
             // save alignment
             write_alignment_to_file(aln, "fail-" + hash_alignment(aln) + ".gam");
             // save graph, bigger fragment
-            xindex->expand_context(sub, 5, true);
-            VG gn; gn.extend(sub);
+            Graph fragment;
+            sub.to_graph(fragment);
+            xindex->expand_context(fragment, 5, true);
+            VG gn; gn.extend(fragment);
             gn.serialize_to_file("fail-" + gn.hash() + ".vg");
             return false;
         }
@@ -3955,16 +4741,16 @@ vector<Alignment> Mapper::align_banded(const Alignment& read, int kmer_size, int
             bool above_threshold = false;
             if (aln.score() > 0) {
                 // strip overlaps and re-score the part of the alignment we keep
-                aln = strip_from_start(aln, to_strip[i].first);
-                aln = strip_from_end(aln, to_strip[i].second);
+                strip_from_start_in_place(&aln, to_strip[i].first);
+                strip_from_end_in_place(&aln, to_strip[i].second);
                 aln.set_identity(identity(aln.path()));
                 above_threshold = aln.identity() >= min_identity && mapqual >= min_banded_mq;
             }
             if (!above_threshold) {
                 // treat as unmapped
                 aln = bands[i];
-                aln = strip_from_start(aln, to_strip[i].first);
-                aln = strip_from_end(aln, to_strip[i].second);
+                strip_from_start_in_place(&aln, to_strip[i].first);
+                strip_from_end_in_place(&aln, to_strip[i].second);
             }
         }
     };
@@ -4059,25 +4845,33 @@ bool Mapper::adjacent_positions(const Position& pos1, const Position& pos2) {
         return true;
     }
     // otherwise, we're going to need to check via the index
-    VG graph;
-    // pick up a graph that's just the neighborhood of the start and end positions
-    int64_t id1 = pos1.node_id();
-    int64_t id2 = pos2.node_id();
-    if(xindex) {
-        // Grab the node sequence only from the XG index and get its size.
-        xindex->get_id_range(id1, id1, graph.graph);
-        xindex->get_id_range(id2, id2, graph.graph);
-        xindex->expand_context(graph.graph, 1, false);
-        graph.rebuild_indexes();
-    } else {
+    if (!xindex) {
         throw runtime_error("No index to get nodes from.");
     }
-    // now look in the graph to figure out if we are adjacent
-    return graph.adjacent(pos1, pos2);
+    // pick up a view that's just the neighborhood of the start and end positions
+    int64_t id1 = pos1.node_id();
+    int64_t id2 = pos2.node_id();
+    SubHandleGraph graph(xindex);
+    xindex->get_id_range(id1, id1, graph);
+    xindex->get_id_range(id2, id2, graph);
+    xindex->expand_context(graph, 1);
+    // now look in the view to figure out if we are adjacent
+    if (id1 == id2) {
+        // the offsets weren't adjacent
+        return false;
+    }
+    // the first has to be at the end of its node and the second at the start
+    // of its node, and then they are adjacent iff we have an edge
+    handle_t h1 = graph.get_handle(id1, false);
+    handle_t h2 = graph.get_handle(id2, false);
+    return pos1.offset() == graph.get_length(h1) - 1
+        && pos2.offset() == 0
+        && graph.has_edge(h1, h2);
 }
 
 void Mapper::compute_mapping_qualities(vector<Alignment>& alns, double cluster_mq, double mq_estimate, double mq_cap) {
     if (alns.empty()) return;
+    VG_PROFILE_STAGE(MAPQ);
     double max_mq = min(mq_cap, (double)max_mapping_quality);
     BaseAligner* aligner = get_aligner();
     int sub_overlaps = sub_overlaps_of_first_aln(alns, mq_overlap);
@@ -4095,6 +4889,7 @@ void Mapper::compute_mapping_qualities(vector<Alignment>& alns, double cluster_m
     
 void Mapper::compute_mapping_qualities(pair<vector<Alignment>, vector<Alignment>>& pair_alns, double cluster_mq, double mq_estimate1, double mq_estimate2, double mq_cap1, double mq_cap2) {
     if (pair_alns.first.empty() || pair_alns.second.empty()) return;
+    VG_PROFILE_STAGE(MAPQ);
     double max_mq1 = min(mq_cap1, (double)max_mapping_quality);
     double max_mq2 = min(mq_cap2, (double)max_mapping_quality);
     BaseAligner* aligner = get_aligner();
@@ -4192,13 +4987,62 @@ void Mapper::filter_and_process_multimaps(vector<Alignment>& sorted_unique_align
 }
     
 vector<Alignment> Mapper::align_multi(const Alignment& aln, int kmer_size, int stride, int max_mem_length, int band_width, int band_overlap, bool xdrop_alignment) {
+    VG_PROFILE_READ(aln);
+    VG_TIMELINE_SPAN("map read");
+    VG_PROFILE_COUNT(READS, 1);
     double cluster_mq = 0;
     Alignment clean_aln;
     clean_aln.set_name(aln.name());
     clean_aln.set_sequence(aln.sequence());
     clean_aln.set_quality(aln.quality());
     clean_aln.clear_refpos();
-    return align_multi_internal(true, clean_aln, kmer_size, stride, max_mem_length, band_width, band_overlap, cluster_mq, max_multimaps, extra_multimaps, nullptr, xdrop_alignment);
+    
+    string parameters;
+    if (duplicate_read_cache) {
+        // The same read can be mapped differently through different arguments
+        for (int arg : {kmer_size, stride, max_mem_length, band_width, band_overlap, (int) xdrop_alignment}) {
+            parameters.append(reinterpret_cast<const char*>(&arg), sizeof(arg));
+        }
+        vector<Alignment> alignments;
+        if (duplicate_read_cache->retrieve(aln, parameters, alignments)) {
+            return alignments;
+        }
+    }
+    
+    vector<Alignment> alignments = align_multi_internal(true, clean_aln, kmer_size, stride, max_mem_length, band_width, band_overlap, cluster_mq, max_multimaps, extra_multimaps, nullptr, xdrop_alignment);
+    if (duplicate_read_cache) {
+        duplicate_read_cache->put(aln, parameters, alignments);
+    }
+    return alignments;
+}
+    
+vector<vector<Alignment>> Mapper::align_multi_batch(const vector<Alignment>& reads, int kmer_size, int stride, int max_mem_length, int band_width, int band_overlap, bool xdrop_alignment) {
+    vector<vector<Alignment>> results(reads.size());
+    
+    // Mapping only looks at the name, sequence, and qualities, and the name
+    // doesn't change anything but the output name. So reads that agree on
+    // the rest map identically.
+    unordered_map<string, size_t> first_with_key;
+    string key;
+    for (size_t i = 0; i < reads.size(); i++) {
+        key = reads[i].sequence();
+        key.push_back('\0');
+        key += reads[i].quality();
+        
+        auto found = first_with_key.find(key);
+        if (found == first_with_key.end()) {
+            first_with_key.emplace(key, i);
+            results[i] = align_multi(reads[i], kmer_size, stride, max_mem_length, band_width, band_overlap, xdrop_alignment);
+        } else {
+            // We have aligned this read already
+            results[i] = results[found->second];
+            for (auto& aln : results[i]) {
+                aln.set_name(reads[i].name());
+            }
+        }
+    }
+    
+    return results;
 }
     
 vector<Alignment> Mapper::align_multi_internal(bool compute_unpaired_quality,
@@ -4386,8 +5230,15 @@ id_t Mapper::node_approximately_at(int64_t approx_pos) {
             (size_t)max(approx_pos, (int64_t)1)));
 }
 
+void Mapper::set_duplicate_read_cache(DuplicateReadCache* cache) {
+    duplicate_read_cache = cache;
+}
+
 // use LRU caching to get the most-recent node positions
 map<string, vector<size_t> > Mapper::node_positions_in_paths(gcsa::node_type node) {
+    if (path_positions) {
+        return path_positions->position_in_paths(gcsa::Node::id(node), gcsa::Node::rc(node), gcsa::Node::offset(node));
+    }
     return xindex->position_in_paths(gcsa::Node::id(node), gcsa::Node::rc(node), gcsa::Node::offset(node));
 }
 
@@ -4662,9 +5513,9 @@ Alignment Mapper::patch_alignment(const Alignment& aln, int max_patch_length, bo
 #endif
                     assert(band.sequence().size() > to_strip[k].first + to_strip[k].second);
                     if (band.path().mapping_size() == 0) { band.clear_path(); } // failed alignment
-                    band = strip_from_start(band, to_strip[k].first);
-                    band = strip_from_end(band, to_strip[k].second);
-                    band = simplify(band);
+                    strip_from_start_in_place(&band, to_strip[k].first);
+                    strip_from_end_in_place(&band, to_strip[k].second);
+                    simplify_in_place(&band);
                     band.set_identity(identity(band.path()));
                     // update the reference end position
                     if (band.has_path()) {
@@ -4735,7 +5586,8 @@ Alignment Mapper::patch_alignment(const Alignment& aln, int max_patch_length, bo
                     cerr << "band: " << pb2json(band) << endl;
                 }
                 */
-                patch = simplify(merge_alignments(bands));
+                patch = merge_alignments(bands);
+                simplify_in_place(&patch);
                 if (patch.sequence() != edit.sequence()) {
                     cerr << "sequence mismatch" << endl;
                     cerr << "seq_expect: " << edit.sequence() << endl;
@@ -4786,7 +5638,7 @@ Alignment Mapper::patch_alignment(const Alignment& aln, int max_patch_length, bo
         }
     };
     clear_positions(patched);
-    patched = simplify(patched, trim_internal_deletions);
+    simplify_in_place(&patched, trim_internal_deletions);
     // set the identity
     patched.set_identity(identity(patched.path()));
     // recompute the score
@@ -4855,10 +5707,10 @@ Alignment Mapper::mems_to_alignment(const Alignment& aln, const vector<MaximalEx
             // use the end of the last mem we touched (we may have skipped several)
             int overlap = last_end - mem.begin;
             if (overlap > 0) {
-                aln = strip_from_start(aln, overlap);
+                strip_from_start_in_place(&aln, overlap);
             }
         }
-        alns.push_back(aln);
+        alns.push_back(std::move(aln));
         last_end = mem.end;
     }
     // handle unaligned portion at end of read
@@ -4868,7 +5720,8 @@ Alignment Mapper::mems_to_alignment(const Alignment& aln, const vector<MaximalEx
     alns.emplace_back();
     alns.back().set_sequence(aln.sequence().substr(start, length));
 
-    auto alnm = simplify(merge_alignments(alns));
+    auto alnm = merge_alignments(alns);
+    simplify_in_place(&alnm);
     *alnm.mutable_quality() = aln.quality();
     alnm.set_name(aln.name());
     alnm.set_score(score_alignment(alnm));
@@ -4944,21 +5797,21 @@ AlignmentChainModel::AlignmentChainModel(
         ++idx;
     }
     for (vector<AlignmentChainModelVertex>::iterator v = model.begin(); v != model.end(); ++v) {
-        for (auto u = v+1; u != model.end(); ++u) {
-            if (v->next_cost.size() < max_connections && u->prev_cost.size() < max_connections) {
-                if (v->band_idx + vertex_band_width >= u->band_idx) {
-                    // bench_start(mapper->bench[2]);
-                    double weight = transition_weight(*v->aln, *u->aln, v->positions, u->positions,
-                                                      u->band_begin - v->band_begin+v->aln->sequence().size());
-                    // bench_end(mapper->bench[2]);
-                    if (weight > -std::numeric_limits<double>::max()) {
-                        v->next_cost.push_back(make_pair(&*u, weight));
-                        u->prev_cost.push_back(make_pair(&*v, weight));
-                    }
-                    // mapper->counter[2]++;
-                } else {
-                    break;
+        // the vertexes are in band order, so we can stop as soon as we leave v's band, or once v
+        // can't take any more connections, instead of scanning the rest of the read
+        for (auto u = v+1; u != model.end()
+                 && v->next_cost.size() < max_connections
+                 && v->band_idx + vertex_band_width >= u->band_idx; ++u) {
+            if (u->prev_cost.size() < max_connections) {
+                // bench_start(mapper->bench[2]);
+                double weight = transition_weight(*v->aln, *u->aln, v->positions, u->positions,
+                                                  u->band_begin - v->band_begin+v->aln->sequence().size());
+                // bench_end(mapper->bench[2]);
+                if (weight > -std::numeric_limits<double>::max()) {
+                    v->next_cost.push_back(make_pair(&*u, weight));
+                    u->prev_cost.push_back(make_pair(&*v, weight));
                 }
+                // mapper->counter[2]++;
             }
         }
     }
@@ -5070,7 +5923,8 @@ vector<Alignment> AlignmentChainModel::traceback(const Alignment& read, int alt_
     for (auto& trace : traces) {
         alns.emplace_back();
         Alignment& merged = alns.back();
-        merged = simplify(merge_alignments(trace));
+        merged = merge_alignments(trace);
+        simplify_in_place(&merged);
         merged.set_identity(identity(merged.path()));
         merged.set_quality(read.quality());
         merged.set_name(read.name());
@@ -5108,6 +5962,10 @@ FragmentLengthDistribution::FragmentLengthDistribution(size_t maximum_sample_siz
     robust_estimation_fraction(robust_estimation_fraction)
 {
     assert(0.0 < robust_estimation_fraction && robust_estimation_fraction < 1.0);
+    // give each thread a buffer, sized so that a full set of buffers is about
+    // half of a reestimation interval
+    pending.resize(omp_get_max_threads());
+    batch_size = max<size_t>(1, reestimation_frequency / (2 * pending.size()));
 }
 
 FragmentLengthDistribution::FragmentLengthDistribution() : FragmentLengthDistribution(0, 1, 0.5)
@@ -5131,34 +5989,59 @@ void FragmentLengthDistribution::register_fragment_length(int64_t length) {
     if (is_fixed) {
         return;
     }
-#pragma omp critical
-    {
-        // in case the distribution became fixed while this thread was waiting
-        // to execute the critical block
-        if (!is_fixed) {
-            lengths.insert((double) length);
-            if (lengths.size() == maximum_sample_size) {
-                // we've reached the maximum sample we wanted, so fix the estimation
-                estimate_distribution();
-                is_fixed = true;
-            }
-            else if (lengths.size() % reestimation_frequency == 0) {
-                estimate_distribution();
-            }
+    size_t thread_num = omp_get_thread_num();
+    if (thread_num >= pending.size()) {
+        // we have more threads than when we were made, so this one gets no
+        // buffer and merges its measurement right away
+        vector<double> batch(1, (double) length);
+#pragma omp critical (fragment_length_distr)
+        merge_measurements(batch);
+        return;
+    }
+    vector<double>& buffer = pending[thread_num];
+    buffer.push_back((double) length);
+    if (buffer.size() >= batch_size) {
+#pragma omp critical (fragment_length_distr)
+        merge_measurements(buffer);
+    }
+}
+
+void FragmentLengthDistribution::flush() {
+    for (vector<double>& buffer : pending) {
+#pragma omp critical (fragment_length_distr)
+        merge_measurements(buffer);
+    }
+}
+
+void FragmentLengthDistribution::merge_measurements(vector<double>& batch) {
+    // in case the distribution became fixed while this thread was waiting
+    // to execute the critical block
+    if (!is_fixed && !batch.empty()) {
+        if (maximum_sample_size && lengths.size() + batch.size() > maximum_sample_size) {
+            // only take as many as we need to fill out the sample
+            batch.resize(maximum_sample_size - lengths.size());
+        }
+        size_t prev_size = lengths.size();
+        sort(batch.begin(), batch.end());
+        lengths.insert(lengths.end(), batch.begin(), batch.end());
+        inplace_merge(lengths.begin(), lengths.begin() + prev_size, lengths.end());
+        if (lengths.size() == maximum_sample_size) {
+            // we've reached the maximum sample we wanted, so fix the estimation
+            estimate_distribution();
+            is_fixed = true;
+        }
+        else if (lengths.size() / reestimation_frequency != prev_size / reestimation_frequency) {
+            estimate_distribution();
         }
     }
+    batch.clear();
 }
     
 void FragmentLengthDistribution::estimate_distribution() {
     // remove the tails from the estimation
     size_t to_skip = (size_t) (lengths.size() * (1.0 - robust_estimation_fraction) * 0.5);
-    auto begin = lengths.begin();
-    auto end = lengths.end();
-    for (size_t i = 0; i < to_skip; i++) {
-        begin++;
-        end--;
-        
-    }
+    auto begin = lengths.begin() + to_skip;
+    auto end = lengths.end() - to_skip;
     // compute cumulants
     double count = 0.0;
     double sum = 0.0;
@@ -5196,11 +6079,11 @@ size_t FragmentLengthDistribution::curr_sample_size() const {
     return lengths.size();
 }
     
-multiset<double>::const_iterator FragmentLengthDistribution::measurements_begin() const {
+vector<double>::const_iterator FragmentLengthDistribution::measurements_begin() const {
     return lengths.begin();
 }
 
-multiset<double>::const_iterator FragmentLengthDistribution::measurements_end() const {
+vector<double>::const_iterator FragmentLengthDistribution::measurements_end() const {
     return lengths.end();
 }
 }
@@ -24,6 +24,12 @@
 #include "cluster.hpp"
 #include "graph.hpp"
 #include "translator.hpp"
+#include "gcsa_kmer_table.hpp"
+#include "minimizer_index.hpp"
+#include "gcsa_locate_cache.hpp"
+#include "cluster_graph_cache.hpp"
+#include "duplicate_read_cache.hpp"
+#include "path_position_index.hpp"
 // TODO: pull out ScoreProvider into its own file
 #include "haplotypes.hpp"
 #include "algorithms/topological_sort.hpp"
@@ -42,6 +48,24 @@ enum MappingQualityMethod { Approx, Exact, Adaptive, None };
 
 class Mapper;
 
+/**
+ * The rescue work already done for one read pair's alignments. Many of the
+ * candidate pairs considered for a read pair try to rescue the same unaligned
+ * mate off anchors that point it at the same window, so the subgraphs and
+ * alignments are kept here to be reused instead of being extracted and aligned
+ * again.
+ */
+struct PairRescueCache {
+    /// Rescue subgraphs, and whether they're acyclic and sorted, by the mate
+    /// positions and context length they were extracted around
+    map<pair<vector<pos_t>, int>, pair<Graph, bool>> subgraphs;
+    /// Rescue alignments, by whether they are of the first mate, their
+    /// orientation, whether they have a traceback, and the nodes of the
+    /// subgraph they were aligned to. The mate being rescued is unaligned, so
+    /// every rescue of a mate starts from the same read.
+    map<tuple<bool, bool, bool, vector<id_t>>, Alignment> alignments;
+};
+
 // for banded long read alignment resolution
 
 class AlignmentChainModelVertex {
@@ -86,6 +110,10 @@ public:
 /*
  * A class that keeps a running estimation of a fragment length distribution
  * using a robust estimation formula in order to be insensitive to outliers.
+ *
+ * Measurements are collected in a per-thread buffer and merged into the
+ * sorted sample a batch at a time, so threads registering lengths in
+ * parallel only synchronize once per batch.
  */
 class FragmentLengthDistribution {
 public:
@@ -106,8 +134,14 @@ public:
     /// Instead of estimating anything, just use these parameters.
     void force_parameters(double mean, double stddev);
     
-    /// Record an observed fragment length
+    /// Record an observed fragment length. Safe to call from several threads
+    /// at once. The length may stay in the calling thread's buffer, and out
+    /// of the estimate, until that buffer fills or flush() is called.
     void register_fragment_length(int64_t length);
+    
+    /// Merge all buffered measurements into the estimate. Must not be called
+    /// while other threads are registering fragment lengths.
+    void flush();
 
     /// Robust mean of the distribution observed so far
     double mean() const;
@@ -123,19 +157,24 @@ public:
     /// parameters
     size_t max_sample_size() const;
     
-    /// Returns the number of samples that have been collected so far
+    /// Returns the number of samples that have been merged into the estimate so far
     size_t curr_sample_size() const;
     
     /// Begin iterator to the measurements that the distribution has used to estimate the
-    /// parameters
-    multiset<double>::const_iterator measurements_begin() const;
+    /// parameters, in sorted order
+    vector<double>::const_iterator measurements_begin() const;
     
     /// End iterator to the measurements that the distribution has used to estimate the
     /// parameters
-    multiset<double>::const_iterator measurements_end() const;
+    vector<double>::const_iterator measurements_end() const;
     
 private:
-    multiset<double> lengths;
+    /// The measurements merged so far, kept sorted
+    vector<double> lengths;
+    /// Measurements not yet merged, by OpenMP thread number
+    vector<vector<double>> pending;
+    /// Merge a thread's buffer once it holds this many measurements
+    size_t batch_size = 1;
     bool is_fixed = false;
     
     double robust_estimation_fraction;
@@ -146,6 +185,10 @@ private:
     double sigma = 1.0;
     
     void estimate_distribution();
+    
+    /// Merge a batch of measurements into the sample and update the
+    /// estimate. Must be called in the fragment length critical section.
+    void merge_measurements(vector<double>& batch);
 };
     
 class BaseMapper : public Progressive {
@@ -180,6 +223,37 @@ public:
     /// Returns true if fragment length distribution has been fixed
     bool has_fixed_fragment_length_distr();
     
+    /// Use the given table of kmer ranges, which must outlive the mapper, to
+    /// skip the first LF steps of MEM searches. Pass null to stop using one.
+    /// Throws if the table wasn't made from this mapper's GCSA2 index.
+    void set_gcsa_kmer_table(const GCSAKmerTable* table);
+    
+    /// Look up the positions of MEM hits through the given cache, which must
+    /// be for this mapper's GCSA2 index and outlive the mapper. Pass null to
+    /// go straight to the index.
+    void set_locate_cache(GCSALocateCache* cache);
+    
+    /// Share the subgraphs that MEM clusters are aligned to through the given
+    /// cache, which must be for this mapper's xg index and outlive the
+    /// mapper. Pass null to extract every subgraph from the xg.
+    void set_cluster_graph_cache(ClusterGraphCache* cache);
+    
+    /// Look up the path positions of nodes in the given index, which must be
+    /// for this mapper's xg index and outlive the mapper, instead of in the
+    /// xg paths. Only the indexed paths are reported. Pass null to use the xg.
+    void set_path_position_index(const PathPositionIndex* index);
+    
+    /// Seed from the minimizers of reads in the given index, which must be
+    /// for this mapper's xg index and outlive the mapper, instead of from MEMs
+    /// in the GCSA2 index, which then isn't needed. Pass null to use GCSA2.
+    void set_minimizer_index(const MinimizerIndex* index);
+    
+    /// Drop the hits of MEMs that span several nodes along a walk that no
+    /// haplotype in the given GBWT follows, as soon as they are located, so
+    /// they are never clustered or aligned. The GBWT must be for this
+    /// mapper's xg index and outlive the mapper. Pass null to keep all hits.
+    void set_haplotype_filter(const gbwt::GBWT* haplotypes);
+    
     /// Use the given fragment length distribution parameters instead of
     /// estimating them.
     void force_fragment_length_distr(double mean, double stddev);
@@ -206,6 +280,23 @@ public:
                    bool record_max_lcp = false,
                    int reseed_below_count = 0);
     
+    /// Find MEMs as in find_mems_deep for several sequences at once, taking
+    /// turns stepping each sequence's backward search so that their random
+    /// accesses into the index overlap. Fills in a longest LCP and filtered
+    /// fraction for each sequence, and returns the MEMs for each sequence.
+    vector<vector<MaximalExactMatch>>
+    find_mems_deep_batch(const vector<pair<string::const_iterator, string::const_iterator>>& seqs,
+                         vector<double>& longest_lcps,
+                         vector<double>& fractions_filtered,
+                         int max_mem_length = 0,
+                         int min_mem_length = 1,
+                         int reseed_length = 0,
+                         bool use_lcp_reseed_heuristic = false,
+                         bool use_diff_based_fast_reseed = false,
+                         bool include_parent_in_sub_mem_count = false,
+                         bool record_max_lcp = false,
+                         int reseed_below_count = 0);
+    
     // Use the GCSA2 index to find super-maximal exact matches.
     vector<MaximalExactMatch>
     find_mems_simple(string::const_iterator seq_begin,
@@ -244,6 +335,11 @@ public:
     int max_sub_mem_recursion_depth = 2;
     int unpaired_penalty = 17;
     bool precollapse_order_length_hits = true;
+    // if nonzero, don't locate the hits of MEMs with more than one hit that
+    // are at least half covered by low-complexity windows of this size
+    size_t low_complexity_window = 0;
+    double low_complexity_base_entropy = 1.0; // windows below this base entropy (bits) are low-complexity
+    double low_complexity_dimer_entropy = 2.0; // and so are those below this dinucleotide entropy
     
     // The recombination rate (negative log per-base recombination probability) for haplotype-aware mapping
     double recombination_penalty = 20.7; // 9 * 2.3 = 20.7
@@ -261,6 +357,60 @@ public:
     bool debug = false;
     
 protected:
+    
+    /// The state of the SMEM pass of find_mems_deep over one sequence, so
+    /// that the passes over several sequences can be interleaved.
+    struct SMEMSearch {
+        string::const_iterator seq_begin;
+        string::const_iterator seq_end;
+        int max_mem_length;
+        int min_mem_length;
+        bool record_max_lcp;
+        // can we take the first steps of a search from the kmer table?
+        bool use_kmer_table;
+        gcsa::range_type full_range;
+        // next position we will extend matches to
+        string::const_iterator cursor;
+        // range of the last iteration
+        gcsa::range_type last_range;
+        // the temporary MEM we'll build up in this process
+        MaximalExactMatch match;
+        // did we move the cursor or the end of the match last iteration?
+        bool prev_iter_jumped_lcp;
+        int max_lcp;
+        size_t mem_length;
+        // the SMEMs found so far, and the max LCP for each
+        vector<MaximalExactMatch> mems;
+        vector<int> lcp_maxima;
+    };
+    
+    /// Set up an SMEM search over a sequence.
+    void start_smem_search(SMEMSearch& search,
+                           string::const_iterator seq_begin,
+                           string::const_iterator seq_end,
+                           int max_mem_length,
+                           int min_mem_length,
+                           bool record_max_lcp);
+    
+    /// Take one step of an SMEM search. Returns false once the search has
+    /// reached the start of its sequence.
+    bool advance_smem_search(SMEMSearch& search);
+    
+    /// Record the MEM at the start of the sequence, if any, once the search
+    /// has no more steps to take.
+    void finish_smem_search(SMEMSearch& search);
+    
+    /// Do the rest of find_mems_deep on the SMEMs from a finished search:
+    /// count and locate them, and look for sub-MEMs. Returns the MEMs.
+    vector<MaximalExactMatch> complete_mems_deep(SMEMSearch& search,
+                                                 double& longest_lcp,
+                                                 double& fraction_filtered,
+                                                 int reseed_length,
+                                                 bool use_lcp_reseed_heuristic,
+                                                 bool use_diff_based_fast_reseed,
+                                                 bool include_parent_in_sub_mem_count,
+                                                 int reseed_below);
+    
     /// Locate the sub-MEMs contained in the last MEM of the mems vector that have ending positions
     /// before the end the next SMEM, label each of the sub-MEMs with the indices of all of the SMEMs
     /// that contain it
@@ -300,6 +450,43 @@ protected:
     void mem_positions_by_index(MaximalExactMatch& mem, pos_t hit_pos,
                                 vector<set<pos_t>>& positions_by_index_out);
     
+    /// Fill in the positions of the hits in a GCSA2 range, up to hit_max if
+    /// set, using the locate cache if we have one.
+    void locate_hits(const gcsa::range_type& range, vector<gcsa::node_type>& nodes);
+    
+    /// Find the minimizers of the sequence in the minimizer index, as MEMs of
+    /// the minimizer kmer length with their hits filled in up to hit_max,
+    /// sorted by read interval, for the same clustering as GCSA2 MEMs.
+    vector<MaximalExactMatch> find_minimizer_mems(string::const_iterator seq_begin,
+                                                  string::const_iterator seq_end,
+                                                  double& fraction_filtered);
+    
+    /// Remove the hits of the MEM that no haplotype in the haplotype filter
+    /// follows, if there is a filter.
+    void filter_hits_by_haplotypes(MaximalExactMatch& mem) const;
+    
+    /// Is there a walk spelling the sequence from the start position that
+    /// some haplotype in the haplotype filter follows?
+    bool haplotypes_follow(pos_t start, string::const_iterator seq_begin, string::const_iterator seq_end) const;
+    
+    /// Get the longest seed the index can report, GCSA2 order or minimizer
+    /// length, for capping mapping qualities.
+    size_t seed_order() const;
+    
+    /// Look up the kmer ending just before end in the kmer table, if it fits
+    /// after search_begin. Returns null if there is no table, the kmer doesn't
+    /// fit, or it doesn't occur in the index.
+    const GCSAKmerTable::Entry* find_kmer_range(string::const_iterator search_begin,
+                                                string::const_iterator end) const;
+    
+    /// Get the offsets of a position on each path, and whether the path runs
+    /// the other way, from the path position index if we have one.
+    map<string, vector<pair<size_t, bool> > > offsets_in_paths(pos_t pos) const;
+    
+    /// Like offsets_in_paths(), but for the nearest path position within
+    /// max_search bases.
+    map<string, vector<pair<size_t, bool> > > nearest_offsets_in_paths(pos_t pos, int64_t max_search) const;
+    
     // use the xg index to get a character at a particular position (rc or foward)
     char pos_char(pos_t pos);
     
@@ -337,6 +524,24 @@ protected:
     gcsa::GCSA* gcsa = nullptr;
     gcsa::LCPArray* lcp = nullptr;
     
+    // Ranges of short kmers in the GCSA index, if any
+    const GCSAKmerTable* gcsa_kmers = nullptr;
+    
+    // Shared cache of the positions of repetitive MEMs, if any
+    GCSALocateCache* locate_cache = nullptr;
+    
+    // Shared cache of the subgraphs clusters are aligned to, if any
+    ClusterGraphCache* cluster_graph_cache = nullptr;
+    
+    // Node positions on the paths we report, if indexed separately from the xg
+    const PathPositionIndex* path_positions = nullptr;
+    
+    // Minimizer seed index to use instead of GCSA2, if any
+    const MinimizerIndex* minimizer_index = nullptr;
+    
+    // Haplotypes that MEM hits spanning several nodes must follow, if any
+    const gbwt::GBWT* haplotype_filter = nullptr;
+    
     // Haplotype score provider, if any, for determining haplotype concordance
     haplo::ScoreProvider* haplo_score_provider = nullptr;
     
@@ -480,6 +685,9 @@ protected:
     
     // make the bands used in banded alignment
     vector<Alignment> make_bands(const Alignment& read, int band_width, int band_overlap, vector<pair<int, int>>& to_strip);
+    
+    // Alignments of reads already mapped, if any
+    DuplicateReadCache* duplicate_read_cache = nullptr;
 public:
     // Make a Mapper that pulls from an XG succinct graph, a GCSA2 kmer index +
     // LCP array, and an optional haplotype score provider.
@@ -489,6 +697,13 @@ public:
 
     map<string, vector<size_t> > node_positions_in_paths(gcsa::node_type node);
     
+    /// Look up the alignments of reads in the given cache before mapping
+    /// them with align_multi(), and remember them there after, so exact
+    /// duplicates anywhere in the input are only mapped once. The cache must
+    /// outlive the mapper, and only be shared with mappers that have the
+    /// same settings. Pass null to map every read.
+    void set_duplicate_read_cache(DuplicateReadCache* cache);
+    
     // a collection of read pairs which we'd like to realign once we have estimated the fragment_size
     vector<pair<Alignment, Alignment> > imperfect_pairs_to_retry;
 
@@ -509,7 +724,9 @@ public:
                          double pval);
 
     /// use the fragment configuration statistics to rescue more precisely
-    pair<bool, bool> pair_rescue(Alignment& mate1, Alignment& mate2, bool& tried1, bool& tried2, int match_score, int full_length_bonus, bool traceback, bool xdrop_alignment);
+    /// if a cache is given, reuse the subgraphs and alignments of earlier rescues of this read pair that it holds
+    pair<bool, bool> pair_rescue(Alignment& mate1, Alignment& mate2, bool& tried1, bool& tried2, int match_score, int full_length_bonus, bool traceback, bool xdrop_alignment,
+                                 PairRescueCache* cache = nullptr);
 
     set<MaximalExactMatch*> resolve_paired_mems(vector<MaximalExactMatch>& mems1,
                                                 vector<MaximalExactMatch>& mems2);
@@ -519,6 +736,14 @@ public:
 
     // use mapper parameters to determine which clusters we should drop
     set<const vector<MaximalExactMatch>* > clusters_to_drop(const vector<vector<MaximalExactMatch> >& clusters);
+    
+    /// Estimate an upper bound on the score of aligning the read to the
+    /// cluster: every base matches, except that each run of read bases the
+    /// cluster's MEMs don't cover has to start or end with a mismatch or gap,
+    /// since the MEMs next to it are maximal, or else be soft clipped if it is
+    /// at the end of the read. Returns the max int32_t if the MEMs aren't in
+    /// the read's sequence.
+    int32_t cluster_score_bound(const Alignment& aln, const vector<MaximalExactMatch>& cluster) const;
 
     // takes the input alignment (with seq, etc) so we have reference to the base sequence
     // for reconstruction the alignments from the SMEMs
@@ -542,6 +767,14 @@ public:
     VG cluster_subgraph_strict(const Alignment& aln, const vector<MaximalExactMatch>& mems);
     // for aligning to a particular MEM cluster
     Alignment align_cluster(const Alignment& aln, const vector<MaximalExactMatch>& mems, bool traceback, bool xdrop_alignment = false);
+    /// Try to align the read to a cluster without dynamic programming, by
+    /// walking the graph from the first MEM's hit and checking that every
+    /// other MEM's hit lies on the same walk at its read offset, so nothing
+    /// but mismatches can separate them. The read's ends past the outermost
+    /// MEMs are soft clipped wherever that scores better. Returns false,
+    /// leaving out unspecified, if the walk is ambiguous, a MEM is off it,
+    /// or there are more than max_ungapped_mismatches mismatches.
+    bool align_cluster_ungapped(const Alignment& aln, const vector<MaximalExactMatch>& mems, Alignment& out);
     // compute the uniqueness metric based on the MEMs in the cluster
     double compute_uniqueness(const Alignment& aln, const vector<MaximalExactMatch>& mems);
     // wraps align_to_graph with flipping
@@ -581,6 +814,19 @@ public:
                                   int max_mem_length = 0,
                                   int band_width = 1000,
                                   int band_overlap = 500,
+    // Align a batch of reads with multi-mapping, as align_multi() would align
+    // each one, returning their alignments in the same order. Reads in the
+    // batch with the same sequence and qualities are only aligned once, and
+    // the rest get renamed copies of the result, which pays off for amplicon
+    // and targeted panels where many reads are duplicates.
+    vector<vector<Alignment>> align_multi_batch(const vector<Alignment>& reads,
+                                                int kmer_size = 0,
+                                                int stride = 0,
+                                                int max_mem_length = 0,
+                                                int band_width = 1000,
+                                                int band_overlap = 500,
+                                                bool xdrop_alignment = false);
+    
                                   bool xdrop_alignment = false);
     
     // paired-end based
@@ -661,6 +907,9 @@ public:
     // paired-end consistency enforcement
     int extra_multimaps; // Extra mappings considered
     int min_multimaps; // Minimum number of multimappings
+    bool prune_clusters_by_score_bound; // align clusters best bound first, and stop when the rest can't change the results
+    int max_ungapped_mismatches; // align clusters along a single walk with at most this many mismatches without DP (-1 for never)
+    bool xdrop_extend_in_graph; // with X-drop alignment, extend from the best MEM over the xg instead of a cluster subgraph
     int band_multimaps; // the number of multimaps for to attempt for each band in a banded alignment
     bool patch_alignments; // should we attempt alignment patching to resolve unaligned regions in banded alignment
     
@@ -5,6 +5,7 @@
 #include <sstream>
 
 #include "mem.hpp"
+#include "sequence_ops.hpp"
 
 namespace vg {
     
@@ -25,7 +26,7 @@ int MaximalExactMatch::length(void) const {
 
 // counts Ns in the MEM
 size_t MaximalExactMatch::count_Ns(void) const {
-    return std::count(begin, end, 'N');
+    return begin == end ? 0 : vg::count_Ns(&*begin, end - begin);
 }
 
 size_t MaximalExactMatch::filter_hits_to(int limit) {
@@ -0,0 +1,42 @@
+#include "memory_report.hpp"
+
+#include <algorithm>
+#include <functional>
+
+/**
+ * \file memory_report.cpp: implementation of index memory accounting
+ */
+
+namespace vg {
+
+using namespace std;
+
+MemoryComponent memory_component(const sdsl::structure_tree_node& node) {
+    MemoryComponent component;
+    component.name = node.name;
+    component.type = node.type;
+    component.bytes = node.size;
+    for (auto& child : node.children) {
+        component.parts.push_back(memory_component(*child.second));
+    }
+    sort(component.parts.begin(), component.parts.end(), [](const MemoryComponent& a, const MemoryComponent& b) {
+        return a.bytes > b.bytes || (a.bytes == b.bytes && a.name < b.name);
+    });
+    return component;
+}
+
+void write_memory_report(const MemoryComponent& component, ostream& out, size_t max_depth) {
+    double total = max(component.bytes, (size_t) 1);
+    function<void(const MemoryComponent&, const string&, size_t)> write_part;
+    write_part = [&](const MemoryComponent& part, const string& path, size_t depth) {
+        out << path << "\t" << part.type << "\t" << part.bytes << "\t" << 100.0 * part.bytes / total << endl;
+        if (depth < max_depth) {
+            for (auto& subpart : part.parts) {
+                write_part(subpart, path + "/" + subpart.name, depth + 1);
+            }
+        }
+    };
+    write_part(component, component.name, 0);
+}
+
+}
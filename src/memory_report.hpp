@@ -0,0 +1,71 @@
+#ifndef VG_MEMORY_REPORT_HPP_INCLUDED
+#define VG_MEMORY_REPORT_HPP_INCLUDED
+
+/** \file
+ * Accounting of the memory used by the parts of loaded indexes, from the
+ * SDSL structure trees their serialize() methods fill in, so we can see which
+ * component of an XG, GCSA2, GBWT or Packer is taking up the space.
+ */
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <sdsl/io.hpp>
+#include <sdsl/structure_tree.hpp>
+
+namespace vg {
+
+using namespace std;
+
+/**
+ * The bytes used by one component of an index, including its parts.
+ */
+struct MemoryComponent {
+    string name;
+    string type;
+    size_t bytes = 0;
+    /// The parts the component is made of, largest first
+    vector<MemoryComponent> parts;
+};
+
+/// Measure the components of anything with an SDSL-style
+/// serialize(ostream&, sdsl::structure_tree_node*, string) method, by
+/// serializing it to nowhere. Succinct structures take up the same space in
+/// memory as serialized, so this is their memory use; caches and other
+/// structures that aren't serialized aren't counted.
+template<typename Structure>
+MemoryComponent measure_memory(Structure& structure, const string& name);
+
+/// Convert a filled-in SDSL structure tree node into a MemoryComponent.
+MemoryComponent memory_component(const sdsl::structure_tree_node& node);
+
+/// Write a component and its parts, down to max_depth levels below it, as
+/// tab-separated lines of the slash-separated path of the part, its type, its
+/// bytes, and its percentage of the total.
+void write_memory_report(const MemoryComponent& component, ostream& out, size_t max_depth);
+
+////////////////////////////////////////////////////////////////////////////
+// Template implementations
+////////////////////////////////////////////////////////////////////////////
+
+template<typename Structure>
+MemoryComponent measure_memory(Structure& structure, const string& name) {
+    unique_ptr<sdsl::structure_tree_node> root(new sdsl::structure_tree_node("root", "root"));
+    sdsl::nullstream nowhere;
+    size_t written = structure.serialize(nowhere, root.get(), name);
+    
+    // the structure hangs its own node off the root
+    MemoryComponent measured = memory_component(*root);
+    if (measured.parts.size() == 1) {
+        measured = std::move(measured.parts.front());
+    }
+    measured.name = name;
+    measured.bytes = written;
+    return measured;
+}
+
+}
+
+#endif
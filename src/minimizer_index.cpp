@@ -0,0 +1,404 @@
+#include "minimizer_index.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <stdexcept>
+
+#include <omp.h>
+
+#include "utility.hpp"
+
+/**
+ * \file minimizer_index.cpp: implementation of the minimizer seed index
+ */
+
+namespace vg {
+
+using namespace std;
+
+const size_t MinimizerIndex::MAX_KMER_LENGTH;
+const size_t MinimizerIndex::DEFAULT_KMER_LENGTH;
+const size_t MinimizerIndex::DEFAULT_WINDOW_LENGTH;
+const size_t MinimizerIndex::DEFAULT_MAX_WALKS;
+const uint64_t MinimizerIndex::EMPTY_KEY;
+
+/// Magic bytes at the start of a serialized index.
+static const char MINIMIZER_INDEX_MAGIC[] = "VGMZ";
+static const uint32_t MINIMIZER_INDEX_VERSION = 1;
+/// The header is the magic, the version, and then 5 64-bit fields, which
+/// keeps the arrays after it 8-byte aligned in a mapping.
+static const size_t MINIMIZER_INDEX_HEADER_SIZE = 8 + 5 * sizeof(uint64_t);
+
+/// Walks are indexed in pieces of about this many bases.
+static const size_t MINIMIZER_PIECE_LENGTH = 1 << 20;
+
+static_assert(sizeof(gcsa::node_type) == sizeof(uint64_t), "GCSA2 positions must be 64 bits to be mapped");
+
+/// Get the 2-bit code for a base, or -1 if it isn't ACGT.
+static inline int minimizer_base_code(char base) {
+    switch (base) {
+    case 'A':
+        return 0;
+    case 'C':
+        return 1;
+    case 'G':
+        return 2;
+    case 'T':
+        return 3;
+    default:
+        return -1;
+    }
+}
+
+/// Scramble a packed kmer, so minimizers aren't biased towards poly-A and so
+/// keys spread over the hash table. Invertible, so distinct kmers never tie.
+static inline uint64_t minimizer_hash(uint64_t key) {
+    key ^= key >> 30;
+    key *= 0xbf58476d1ce4e5b9ull;
+    key ^= key >> 27;
+    key *= 0x94d049bb133111ebull;
+    key ^= key >> 31;
+    return key;
+}
+
+template<typename T>
+static void write_minimizer_value(ostream& out, const T& value) {
+    out.write((const char*) &value, sizeof(T));
+}
+
+MinimizerIndex::MinimizerIndex(size_t k, size_t w) : kmer_length(k), window_length(w) {
+    if (k == 0 || k > MAX_KMER_LENGTH) {
+        throw runtime_error("MinimizerIndex: kmer length " + to_string(k) +
+                            " must be between 1 and " + to_string(MAX_KMER_LENGTH));
+    }
+    if (w == 0) {
+        throw runtime_error("MinimizerIndex: window length must be at least 1");
+    }
+}
+
+void MinimizerIndex::add_graph(const HandleGraph& graph, size_t max_walks) {
+    vector<vector<pair<uint64_t, gcsa::node_type>>> thread_hits(get_thread_count());
+    // Every window that starts on a node lies in a walk from the start of
+    // the node that is this much longer than the node, or ends at a tip.
+    size_t context = kmer_length + window_length - 2;
+    graph.for_each_handle([&](const handle_t& handle) {
+        auto& hits = thread_hits[omp_get_thread_num()];
+        for (handle_t start : {handle, graph.flip(handle)}) {
+            size_t needed = graph.get_length(start) + context;
+            vector<handle_t> walk{start};
+            size_t walks = 0;
+            function<void(size_t)> extend = [&](size_t length) {
+                if (length >= needed) {
+                    add_walk(graph, walk, hits);
+                    walks++;
+                    return;
+                }
+                bool extended = false;
+                // Copy the end, since extending the walk can move it
+                handle_t last = walk.back();
+                graph.follow_edges(last, false, [&](const handle_t& next) {
+                    extended = true;
+                    walk.push_back(next);
+                    extend(length + graph.get_length(next));
+                    walk.pop_back();
+                    return walks < max_walks;
+                });
+                if (!extended) {
+                    // We ran into a tip
+                    add_walk(graph, walk, hits);
+                    walks++;
+                }
+            };
+            extend(graph.get_length(start));
+        }
+        return true;
+    }, true);
+    merge_pending(thread_hits);
+}
+
+void MinimizerIndex::add_paths(const xg::XG& xg_index) {
+    vector<vector<pair<uint64_t, gcsa::node_type>>> thread_hits(get_thread_count());
+#pragma omp parallel for schedule(dynamic, 1)
+    for (size_t rank = 1; rank <= xg_index.max_path_rank(); rank++) {
+        auto& hits = thread_hits[omp_get_thread_num()];
+        auto& path = xg_index.get_path(xg_index.path_name(rank));
+        vector<handle_t> walk;
+        walk.reserve(path.positions.size());
+        for (size_t i = 0; i < path.positions.size(); i++) {
+            walk.push_back(xg_index.get_handle(path.node(i), path.directions[i]));
+        }
+        add_walk(xg_index, walk, hits);
+        reverse(walk.begin(), walk.end());
+        for (auto& handle : walk) {
+            handle = xg_index.flip(handle);
+        }
+        add_walk(xg_index, walk, hits);
+    }
+    merge_pending(thread_hits);
+}
+
+void MinimizerIndex::add_haplotypes(const HandleGraph& graph, const gbwt::GBWT& haplotypes) {
+    vector<vector<pair<uint64_t, gcsa::node_type>>> thread_hits(get_thread_count());
+#pragma omp parallel for schedule(dynamic, 1)
+    for (gbwt::size_type id = 0; id < haplotypes.sequences(); id += 2) { // Ignore reverse complements.
+        auto& hits = thread_hits[omp_get_thread_num()];
+        gbwt::vector_type sequence = haplotypes.extract(id);
+        vector<handle_t> walk;
+        walk.reserve(sequence.size());
+        for (auto node : sequence) {
+            walk.push_back(graph.get_handle(gbwt::Node::id(node), gbwt::Node::is_reverse(node)));
+        }
+        add_walk(graph, walk, hits);
+        reverse(walk.begin(), walk.end());
+        for (auto& handle : walk) {
+            handle = graph.flip(handle);
+        }
+        add_walk(graph, walk, hits);
+    }
+    merge_pending(thread_hits);
+}
+
+void MinimizerIndex::add_walk(const HandleGraph& graph, const vector<handle_t>& walk,
+                              vector<pair<uint64_t, gcsa::node_type>>& hits) const {
+    // Consecutive pieces overlap by all but the last base of a window, so
+    // every window is in one of them.
+    size_t context = kmer_length + window_length - 2;
+    string sequence;
+    vector<gcsa::node_type> positions;
+    bool flushed = false;
+    for (auto& handle : walk) {
+        string node_sequence = graph.get_sequence(handle);
+        id_t id = graph.get_id(handle);
+        bool is_reverse = graph.get_is_reverse(handle);
+        sequence += node_sequence;
+        for (size_t i = 0; i < node_sequence.size(); i++) {
+            positions.push_back(gcsa::Node::encode(id, i, is_reverse));
+        }
+        if (sequence.size() >= MINIMIZER_PIECE_LENGTH + context) {
+            add_sequence(sequence, positions, hits);
+            sequence.erase(0, sequence.size() - context);
+            positions.erase(positions.begin(), positions.end() - context);
+            flushed = true;
+        }
+    }
+    if (!flushed || sequence.size() > context) {
+        add_sequence(sequence, positions, hits);
+    }
+}
+
+void MinimizerIndex::add_sequence(const string& sequence, const vector<gcsa::node_type>& positions,
+                                  vector<pair<uint64_t, gcsa::node_type>>& hits) const {
+    for (auto& minimizer : minimizers(sequence.begin(), sequence.end())) {
+        hits.emplace_back(minimizer.key, positions[minimizer.offset]);
+    }
+}
+
+void MinimizerIndex::merge_pending(vector<vector<pair<uint64_t, gcsa::node_type>>>& thread_hits) {
+    for (auto& hits : thread_hits) {
+        pending.insert(pending.end(), hits.begin(), hits.end());
+        vector<pair<uint64_t, gcsa::node_type>>().swap(hits);
+    }
+}
+
+void MinimizerIndex::build() {
+    if (kmer_length == 0) {
+        throw runtime_error("MinimizerIndex: cannot build an index with no kmer length");
+    }
+
+    // Walks overlap, so the same hit is usually found many times
+    sort(pending.begin(), pending.end());
+    pending.erase(unique(pending.begin(), pending.end()), pending.end());
+
+    // Find where each key's hits start
+    vector<size_t> group_starts;
+    for (size_t i = 0; i < pending.size(); i++) {
+        if (i == 0 || pending[i].first != pending[i - 1].first) {
+            group_starts.push_back(i);
+        }
+    }
+    distinct_keys = group_starts.size();
+    total_hits = pending.size();
+
+    // Keep the table at most half full, so probes stay short
+    capacity = 2;
+    while (capacity < 2 * distinct_keys) {
+        capacity <<= 1;
+    }
+    own_keys.assign(capacity, EMPTY_KEY);
+    keys = own_keys.data();
+    vector<size_t> slots(distinct_keys);
+    vector<uint64_t> counts(capacity, 0);
+    for (size_t i = 0; i < distinct_keys; i++) {
+        size_t group_end = i + 1 < distinct_keys ? group_starts[i + 1] : pending.size();
+        uint64_t key = pending[group_starts[i]].first;
+        slots[i] = slot_of(key);
+        own_keys[slots[i]] = key;
+        counts[slots[i]] = group_end - group_starts[i];
+    }
+
+    own_offsets.resize(capacity + 1);
+    own_offsets[0] = 0;
+    for (size_t slot = 0; slot < capacity; slot++) {
+        own_offsets[slot + 1] = own_offsets[slot] + counts[slot];
+    }
+    own_hits.resize(total_hits);
+    for (size_t i = 0; i < distinct_keys; i++) {
+        size_t group_end = i + 1 < distinct_keys ? group_starts[i + 1] : pending.size();
+        size_t cursor = own_offsets[slots[i]];
+        for (size_t j = group_starts[i]; j < group_end; j++) {
+            own_hits[cursor++] = pending[j].second;
+        }
+    }
+    vector<pair<uint64_t, gcsa::node_type>>().swap(pending);
+
+    offsets = own_offsets.data();
+    hits = own_hits.data();
+}
+
+size_t MinimizerIndex::k() const {
+    return kmer_length;
+}
+
+size_t MinimizerIndex::w() const {
+    return window_length;
+}
+
+size_t MinimizerIndex::size() const {
+    return distinct_keys;
+}
+
+size_t MinimizerIndex::hit_count() const {
+    return total_hits;
+}
+
+vector<MinimizerIndex::Minimizer> MinimizerIndex::minimizers(string::const_iterator begin,
+                                                             string::const_iterator end) const {
+    vector<Minimizer> found;
+    size_t length = end - begin;
+    if (kmer_length == 0 || length < kmer_length) {
+        return found;
+    }
+    size_t window = min(window_length, length - kmer_length + 1);
+    uint64_t mask = ((uint64_t) 1 << (2 * kmer_length)) - 1;
+
+    // The kmers that could still be the minimizer of a later window, with
+    // increasing hashes. Of equal hashes we keep the leftmost first, so ties
+    // always go to the leftmost kmer of the window, on the read and the graph.
+    struct Candidate {
+        uint64_t hash;
+        uint64_t key;
+        size_t offset;
+    };
+    deque<Candidate> candidates;
+    uint64_t key = 0;
+    size_t valid_bases = 0;
+    for (size_t i = 0; i < length; i++) {
+        int code = minimizer_base_code(begin[i]);
+        if (code < 0) {
+            valid_bases = 0;
+            key = 0;
+        } else {
+            key = ((key << 2) | code) & mask;
+            valid_bases++;
+        }
+        if (i + 1 < kmer_length) {
+            continue;
+        }
+        size_t kmer_start = i + 1 - kmer_length;
+        if (valid_bases >= kmer_length) {
+            uint64_t hash = minimizer_hash(key);
+            while (!candidates.empty() && candidates.back().hash > hash) {
+                candidates.pop_back();
+            }
+            candidates.push_back(Candidate{hash, key, kmer_start});
+        }
+        if (kmer_start + 1 >= window) {
+            // The window ending with this kmer is complete
+            size_t window_start = kmer_start + 1 - window;
+            while (!candidates.empty() && candidates.front().offset < window_start) {
+                candidates.pop_front();
+            }
+            if (!candidates.empty() && (found.empty() || found.back().offset != candidates.front().offset)) {
+                found.push_back(Minimizer{candidates.front().key, candidates.front().offset});
+            }
+        }
+    }
+    return found;
+}
+
+size_t MinimizerIndex::slot_of(uint64_t key) const {
+    size_t mask = capacity - 1;
+    size_t slot = minimizer_hash(key) & mask;
+    while (keys[slot] != EMPTY_KEY && keys[slot] != key) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+pair<const gcsa::node_type*, const gcsa::node_type*> MinimizerIndex::find(uint64_t key) const {
+    if (capacity == 0) {
+        return make_pair(nullptr, nullptr);
+    }
+    size_t slot = slot_of(key);
+    // Empty slots have no hits
+    return make_pair(hits + offsets[slot], hits + offsets[slot + 1]);
+}
+
+void MinimizerIndex::serialize(ostream& out) const {
+    if (capacity == 0) {
+        throw runtime_error("MinimizerIndex: cannot serialize an index that isn't built");
+    }
+    out.write(MINIMIZER_INDEX_MAGIC, strlen(MINIMIZER_INDEX_MAGIC));
+    write_minimizer_value(out, MINIMIZER_INDEX_VERSION);
+    write_minimizer_value(out, (uint64_t) kmer_length);
+    write_minimizer_value(out, (uint64_t) window_length);
+    write_minimizer_value(out, (uint64_t) capacity);
+    write_minimizer_value(out, (uint64_t) total_hits);
+    write_minimizer_value(out, (uint64_t) distinct_keys);
+    out.write((const char*) keys, capacity * sizeof(uint64_t));
+    out.write((const char*) offsets, (capacity + 1) * sizeof(uint64_t));
+    out.write((const char*) hits, total_hits * sizeof(gcsa::node_type));
+    if (!out) {
+        throw runtime_error("MinimizerIndex: I/O error writing minimizer index");
+    }
+}
+
+void MinimizerIndex::load(const string& file_name) {
+    unique_ptr<MappedFile> file(new MappedFile(file_name));
+    const char* data = file->data();
+    if (file->size() < MINIMIZER_INDEX_HEADER_SIZE || memcmp(data, MINIMIZER_INDEX_MAGIC, strlen(MINIMIZER_INDEX_MAGIC)) != 0) {
+        throw runtime_error("MinimizerIndex: " + file_name + " is not a minimizer index");
+    }
+    uint32_t version;
+    memcpy(&version, data + 4, sizeof(version));
+    if (version != MINIMIZER_INDEX_VERSION) {
+        throw runtime_error("MinimizerIndex: unsupported minimizer index version " + to_string(version));
+    }
+    uint64_t fields[5];
+    memcpy(fields, data + 8, sizeof(fields));
+    uint64_t stored_capacity = fields[2];
+    uint64_t stored_hits = fields[3];
+    if (fields[0] == 0 || fields[0] > MAX_KMER_LENGTH || fields[1] == 0
+        || stored_capacity == 0 || (stored_capacity & (stored_capacity - 1)) != 0
+        || file->size() != MINIMIZER_INDEX_HEADER_SIZE + (2 * stored_capacity + 1 + stored_hits) * sizeof(uint64_t)) {
+        throw runtime_error("MinimizerIndex: " + file_name + " is truncated or corrupt");
+    }
+
+    kmer_length = fields[0];
+    window_length = fields[1];
+    capacity = stored_capacity;
+    total_hits = stored_hits;
+    distinct_keys = fields[4];
+    keys = (const uint64_t*) (data + MINIMIZER_INDEX_HEADER_SIZE);
+    offsets = keys + capacity;
+    hits = (const gcsa::node_type*) (offsets + capacity + 1);
+    own_keys.clear();
+    own_offsets.clear();
+    own_hits.clear();
+    pending.clear();
+    mapped = move(file);
+}
+
+}
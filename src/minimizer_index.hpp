@@ -0,0 +1,167 @@
+#ifndef VG_MINIMIZER_INDEX_HPP_INCLUDED
+#define VG_MINIMIZER_INDEX_HPP_INCLUDED
+
+/** \file
+ * A (w,k)-minimizer seed index over the walks of a graph, as a much smaller
+ * and faster to build alternative to GCSA2 for finding seeds.
+ */
+
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <gcsa/gcsa.h>
+#include <gbwt/gbwt.h>
+
+#include "handle.hpp"
+#include "mapped_file.hpp"
+#include "xg.hpp"
+
+namespace vg {
+
+using namespace std;
+
+/**
+ * Maps the (w,k)-minimizers of sequences spelled by walks through a graph to
+ * the graph positions they start at. A minimizer of a window of w consecutive
+ * kmers is its kmer with the smallest hash, so any read that shares a window
+ * with a walk also shares that window's minimizer, and finds the walk's
+ * position for it.
+ *
+ * Walks are added from the graph itself, from embedded paths, or from GBWT
+ * haplotypes, on all OpenMP threads, and then build() packs the hits into an
+ * open addressing hash table. Positions are stored as GCSA2 node_type values,
+ * as in MaximalExactMatch::nodes, and on both strands, so reads are only ever
+ * looked up forward. The serialized table is laid out as flat arrays, so it
+ * can be memory-mapped and used without being read in. Read-only after
+ * build() or load(), so it can be shared between threads.
+ */
+class MinimizerIndex {
+public:
+
+    /// A minimizer of a sequence: the packed kmer and where it starts.
+    struct Minimizer {
+        uint64_t key;
+        size_t offset;
+    };
+
+    /// The longest kmers we can pack into a key.
+    static const size_t MAX_KMER_LENGTH = 31;
+    /// The default kmer length and window length, in kmers.
+    static const size_t DEFAULT_KMER_LENGTH = 21;
+    static const size_t DEFAULT_WINDOW_LENGTH = 11;
+    /// The default limit on walks followed out of each node by add_graph().
+    static const size_t DEFAULT_MAX_WALKS = 64;
+
+    /// Make an empty index, which finds nothing, to load into.
+    MinimizerIndex() = default;
+
+    /// Make an empty index of the minimizers of windows of w kmers of length
+    /// k, to add walks to. Throws if k is more than MAX_KMER_LENGTH or either
+    /// is 0.
+    MinimizerIndex(size_t k, size_t w);
+
+    // Hits may live in a memory mapping owned by the index.
+    MinimizerIndex(const MinimizerIndex& other) = delete;
+    MinimizerIndex& operator=(const MinimizerIndex& other) = delete;
+    MinimizerIndex(MinimizerIndex&& other) = default;
+    MinimizerIndex& operator=(MinimizerIndex&& other) = default;
+
+    /// Add the minimizers of all the walks through the graph, in both
+    /// orientations, following at most max_walks walks out of each node.
+    /// Windows that are only spelled by walks past the limit are missed.
+    void add_graph(const HandleGraph& graph, size_t max_walks = DEFAULT_MAX_WALKS);
+
+    /// Add the minimizers of the embedded paths of the XG, in both
+    /// orientations.
+    void add_paths(const xg::XG& xg_index);
+
+    /// Add the minimizers of the haplotypes in the GBWT, over the given
+    /// graph, in both orientations.
+    void add_haplotypes(const HandleGraph& graph, const gbwt::GBWT& haplotypes);
+
+    /// Pack the hits added so far into the hash table, so they can be looked
+    /// up. Must be called once, after all the walks are added.
+    void build();
+
+    /// Get the kmer length, or 0 for an empty index.
+    size_t k() const;
+
+    /// Get the window length in kmers, or 0 for an empty index.
+    size_t w() const;
+
+    /// Get the number of distinct minimizers indexed.
+    size_t size() const;
+
+    /// Get the total number of positions indexed.
+    size_t hit_count() const;
+
+    /// Find the minimizers of the sequence, in order. Kmers with characters
+    /// other than ACGT are never minimizers. A sequence shorter than a window
+    /// but at least k long is taken as one window.
+    vector<Minimizer> minimizers(string::const_iterator begin, string::const_iterator end) const;
+
+    /// Get the positions where a minimizer key occurs, as a begin and end
+    /// pointer. They are empty if it doesn't occur.
+    pair<const gcsa::node_type*, const gcsa::node_type*> find(uint64_t key) const;
+
+    /// Write the index to a stream. Must be built.
+    void serialize(ostream& out) const;
+
+    /// Replace the contents of the index with the one in the given file,
+    /// which is memory-mapped rather than read. Throws if the file doesn't
+    /// hold an index.
+    void load(const string& file_name);
+
+private:
+
+    /// Marks empty slots in the hash table. Not a packed kmer for any k.
+    static const uint64_t EMPTY_KEY = ~(uint64_t) 0;
+
+    /// Add the minimizers of the sequence spelled by the walk to the thread's
+    /// pending hits, a piece of the walk at a time so long paths don't need
+    /// one position per base in memory at once.
+    void add_walk(const HandleGraph& graph, const vector<handle_t>& walk,
+                  vector<pair<uint64_t, gcsa::node_type>>& hits) const;
+
+    /// Add the minimizers of a sequence, and their positions from the
+    /// position of each base, to the pending hits.
+    void add_sequence(const string& sequence, const vector<gcsa::node_type>& positions,
+                      vector<pair<uint64_t, gcsa::node_type>>& hits) const;
+
+    /// Merge hits found by the OpenMP threads into the pending hits.
+    void merge_pending(vector<vector<pair<uint64_t, gcsa::node_type>>>& thread_hits);
+
+    /// Get the slot a key belongs in, or the empty slot where it would go.
+    size_t slot_of(uint64_t key) const;
+
+    size_t kmer_length = 0;
+    size_t window_length = 0;
+    size_t capacity = 0;
+    size_t total_hits = 0;
+    size_t distinct_keys = 0;
+
+    /// Key in each slot of the hash table, EMPTY_KEY for empty slots.
+    const uint64_t* keys = nullptr;
+    /// Start of each slot's hits, with one past the end at the end, so that
+    /// slot i's hits are hits[offsets[i]] up to hits[offsets[i + 1]].
+    const uint64_t* offsets = nullptr;
+    /// The positions of all the keys, by slot.
+    const gcsa::node_type* hits = nullptr;
+
+    /// Storage for a built index. A loaded one points into the mapping.
+    vector<uint64_t> own_keys;
+    vector<uint64_t> own_offsets;
+    vector<gcsa::node_type> own_hits;
+    unique_ptr<MappedFile> mapped;
+
+    /// Hits added but not yet built into the table.
+    vector<pair<uint64_t, gcsa::node_type>> pending;
+};
+
+}
+
+#endif
@@ -36,6 +36,44 @@ using namespace std;
             return tokens;
         };
         
+        // the rows of the alignment block we're reading, in the order they
+        // appear, until we pack them into the block
+        vector<string> names;
+        vector<string> seqs;
+        unordered_map<string, size_t> row_of_name;
+        
+        // add a row to the block we're reading
+        auto add_row = [&](const string& name) {
+            row_of_name[name] = names.size();
+            names.push_back(name);
+            seqs.emplace_back();
+            return names.size() - 1;
+        };
+        
+        // pack the rows we've read into a new alignment block
+        auto finish_block = [&]() {
+            if (names.empty()) {
+                return;
+            }
+            alignments.emplace_back();
+            AlignmentBlock& block = alignments.back();
+            block.length = seqs.front().size();
+            block.rows.reserve(block.length * seqs.size());
+            for (string& seq : seqs) {
+                if (seq.size() != block.length) {
+                    cerr << "error:[MSAConverter] aligned sequences must be the same length, any unaligned sequences must be fully specified with '-' characters" << endl;
+                    exit(1);
+                }
+                block.rows.append(seq);
+                // free each row as we go so we never hold two copies of the block
+                string().swap(seq);
+            }
+            block.names = move(names);
+            names.clear();
+            seqs.clear();
+            row_of_name.clear();
+        };
+        
         if (format == "maf") {
             
             auto get_next_sequence_line = [&](istream& in) {
@@ -44,7 +82,7 @@ using namespace std;
                 while (got_data && (next.empty() ? true : next[0] != 's')) {
                     // are we starting a new alignment block?
                     if (next.empty() ? false : next[0] == 'a') {
-                        alignments.emplace_back();
+                        finish_block();
                     }
                     got_data = getline(in, next).good();
                 }
@@ -59,12 +97,11 @@ using namespace std;
                     exit(1);
                 }
                 
-                auto& alignment = alignments.back();
-                if (alignment.count(tokens[1])) {
+                if (row_of_name.count(tokens[1])) {
                     cerr << "error:[MSAConverter] repeated sequence name '" << tokens[1] << "' within an alignment, names must be unique" << endl;
                     exit(1);
                 }
-                alignment[tokens[1]] = tokens[6];
+                seqs[add_row(tokens[1])] = move(tokens[6]);
             }
         }
         else if (format == "clustal") {
@@ -108,10 +145,6 @@ using namespace std;
                 return next;
             };
             
-            // make an alignment block
-            alignments.emplace_back();
-            auto& alignment = alignments.back();
-            
             // skip the header line
             get_next_sequence_line(in);
             
@@ -123,12 +156,12 @@ using namespace std;
                     continue;
                 }
                 
-                auto iter = alignment.find(tokens[0]);
-                if (iter != alignment.end()) {
-                    iter->second.append(tokens[1]);
+                auto iter = row_of_name.find(tokens[0]);
+                if (iter != row_of_name.end()) {
+                    seqs[iter->second].append(tokens[1]);
                 }
                 else {
-                    alignment[tokens[0]] = tokens[1];
+                    seqs[add_row(tokens[0])] = tokens[1];
                 }
                 
                 line = get_next_sequence_line(in);
@@ -136,24 +169,25 @@ using namespace std;
         }
         else if (format == "fasta") {
             
-            // make an alignment block
-            alignments.emplace_back();
-            auto& alignment = alignments.back();
-            
-            string curr_seq_name;
+            size_t curr_row = 0;
             string line;
             
             bool got_data = getline(in, line).good();
             while (got_data && !line.empty()) {
                 if (line[0] == '>') {
-                    curr_seq_name = tokenize(line)[0].substr(1, line.size() - 1);
-                    if (alignment.count(curr_seq_name)) {
+                    string curr_seq_name = tokenize(line)[0].substr(1, line.size() - 1);
+                    if (row_of_name.count(curr_seq_name)) {
                         cerr << "error:[MSAConverter] repeated sequence name '" << curr_seq_name << "' within an alignment, sequence names must be unique" << endl;
                         exit(1);
                     }
+                    curr_row = add_row(curr_seq_name);
                 }
                 else {
-                    alignment[curr_seq_name].append(line);
+                    if (seqs.empty()) {
+                        // sequence before any name, keep it under an empty name like we used to
+                        curr_row = add_row("");
+                    }
+                    seqs[curr_row].append(line);
                 }
                 got_data = getline(in, line).good();
             }
@@ -164,233 +198,296 @@ using namespace std;
         }
         
         
+        finish_block();
+
 #ifdef debug_msa_converter
         cerr << "alignments:" << endl;
         for (const auto& aln : alignments) {
-            for (const auto& seq : aln) {
-                cerr << seq.first << "\t" << seq.second << endl;
+            for (size_t i = 0; i < aln.names.size(); i++) {
+                cerr << aln.names[i] << "\t" << aln.rows.substr(i * aln.length, aln.length) << endl;
             }
             cerr << endl;
         }
 #endif
         
-        for (const auto& aln : alignments) {
-            size_t aln_len = aln.begin()->second.size();
-            for (const auto& seq : aln) {
-                if (seq.second.size() != aln_len) {
-                    cerr << "error:[MSAConverter] aligned sequences must be the same length, any unaligned sequences must be fully specified with '-' characters" << endl;
-                    exit(1);
-                }
-            }
-        }
-        
         increment_progress();
         destroy_progress();
     }
     
-    VG MSAConverter::make_graph(bool keep_paths, size_t max_node_length) {
-        
+    void MSAConverter::build_column_range(const AlignmentBlock& alignment, size_t begin, size_t end,
+                                          bool keep_paths, size_t max_node_length,
+                                          ColumnRangeGraph& built) const {
         
         unordered_set<char> alphabet{'A', 'C', 'T', 'G', 'N', '-'};
         
-        VG graph;
+        VG& graph = built.graph;
+        size_t num_rows = alignment.names.size();
+        built.first_node.assign(num_rows, 0);
+        built.last_node.assign(num_rows, 0);
+        built.path_nodes.assign(keep_paths ? num_rows : 0, vector<id_t>());
         
-        // detect sequences with duplicate names and determine the size of the conversion
-        bool contains_duplicate_seq_names = false;
-        size_t total_size = 0;
-        unordered_map<string, pair<size_t, size_t>> seq_name_count;
-        for (const unordered_map<string, string>& alignment : alignments) {
-            for (const pair<string, string>& sequence : alignment) {
-                total_size += sequence.second.size();
-                seq_name_count[sequence.first].first++;
-                contains_duplicate_seq_names |= (seq_name_count[sequence.first].first > 1);
-            }
-        }
+        // start all of the alignments on a dummy node
+        Node* dummy_node = graph.create_node("N");
         
-        create_progress("converting to graph", total_size);
+        // the node that each input sequence is extending
+        vector<Node*> current_node(num_rows, dummy_node);
         
-        // append a number to each duplicate name
-        if (contains_duplicate_seq_names) {
-            for (unordered_map<string, string>& alignment : alignments) {
+        // nodes that we don't want to extend any more
+        // (we never want to extend the dummy node)
+        unordered_set<Node*> completed_nodes{dummy_node};
+        
+        for (size_t i = begin; i < end; i++) {
+#ifdef debug_msa_converter
+            cerr << "## beginning column " << i << endl;
+#endif
+            unordered_map<Node*, char> forward_transitions;
+            unordered_map<char, pair<unordered_set<Node*>, vector<size_t>>> transitions;
+            for (size_t row = 0; row < num_rows; row++) {
+                char aln_char = toupper(alignment.at(row, i));
                 
-                // collect the names in this block that have duplicates
-                vector<string> duplicate_names;
-                for (const pair<string, string>& sequence : alignment) {
-                    if (seq_name_count[sequence.first].first > 1) {
-                        duplicate_names.push_back(sequence.first);
-                    }
-                }
+                if (!alphabet.count(aln_char)) {
+                    cerr << "error:[MSAConverter] MSA contains non-nucleotide characters" << endl;
+                    exit(1);
                 
-                // TODO: it's technically possible that the new key might collide with one already
-                // in the map, although this would have required some weird naming
-                // swap the key in the map for the modified one
-                for (string& seq_name : duplicate_names) {
-                    size_t name_num = ++seq_name_count[seq_name].second;
-                    stringstream sstrm;
-                    sstrm << seq_name << "." << name_num;
-                    alignment[sstrm.str()] = move(alignment[seq_name]);
-                    alignment.erase(seq_name);
                 }
-            }
-        }
-        
-        for (const unordered_map<string, string>& alignment : alignments) {
-            
-            // the node that each input sequence is extending
-            unordered_map<string, Node*> current_node;
-            
-            // the path we're building for each aligned sequence
-            unordered_map<string, Path*> aln_path;
-            
-            // start all of the alignments on a dummy node
-            Node* dummy_node = graph.create_node("N");
-            for (const auto& seq : alignment) {
-                current_node[seq.first] = dummy_node;
                 
-                if (keep_paths) {
-                    Path* path = graph.graph.add_path();
-                    aln_path[seq.first] = path;
-                    path->set_name(seq.first);
+                Node* node_here = current_node[row];
+                
+                if (aln_char != '-') {
+                    // this alignment is transitioning to a new aligned character
+                    transitions[aln_char].first.insert(node_here);
+                    transitions[aln_char].second.push_back(row);
+                    
+                    auto iter = forward_transitions.find(node_here);
+                    if (iter != forward_transitions.end()) {
+                        if (iter->second != aln_char) {
+                            // this node splits in the current column, so don't extend it anymore
+                            completed_nodes.insert(node_here);
+                        }
+                    }
+                    else {
+                        forward_transitions[node_here] = aln_char;
+                    }
+                }
+                else {
+                    // this alignment isn't transitioning anywhere yet
+                    
+                    // we don't want to extend nodes where we'll need to attach a gap edge later
+                    completed_nodes.insert(node_here);
                 }
             }
             
-            // nodes that we don't want to extend any more
-            // (we never want to extend the dummy node)
-            unordered_set<Node*> completed_nodes{dummy_node};
-            
-            size_t aln_len = alignment.begin()->second.size();
-            for (size_t i = 0; i < aln_len; i++) {
+            for (const auto& transition : transitions) {
 #ifdef debug_msa_converter
-                cerr << "## beginning column " << i << endl;
+                cerr << "transition to " << transition.first << endl;
+                cerr << "from nodes:" << endl;
+                for (const Node* n : transition.second.first) {
+                    cerr << "\t" << n->id() << ": " << n->sequence() << endl;
+                }
+                cerr << "on sequences:" << endl;
+                for (size_t row : transition.second.second) {
+                    cerr << "\t" << alignment.names[row] << endl;
+                }
 #endif
-                unordered_map<Node*, char> forward_transitions;
-                unordered_map<char, pair<unordered_set<Node*>, vector<string>>> transitions;
-                for (const auto& seq : alignment) {
-                    char aln_char = toupper(seq.second[i]);
+                Node* at_node;
+                
+                if (transition.second.first.size() > 1) {
+                    Node* new_node = graph.create_node(string(1, transition.first));
                     
-                    if (!alphabet.count(aln_char)) {
-                        cerr << "error:[MSAConverter] MSA contains non-nucleotide characters" << endl;
-                        exit(1);
-                        
+                    for (Node* attaching_node : transition.second.first) {
+                        graph.create_edge(attaching_node, new_node);
+                        // we don't want to extend nodes that already have edges out of their ends
+                        completed_nodes.insert(attaching_node);
                     }
                     
-                    Node* node_here = current_node[seq.first];
-                    
-                    if (aln_char != '-') {
-                        // this alignment is transitioning to a new aligned character
-                        transitions[aln_char].first.insert(node_here);
-                        transitions[aln_char].second.push_back(seq.first);
-                        
-                        auto iter = forward_transitions.find(node_here);
-                        if (iter != forward_transitions.end()) {
-                            if (iter->second != aln_char) {
-                                // this node splits in the current column, so don't extend it anymore
-                                completed_nodes.insert(node_here);
-                            }
-                        }
-                        else {
-                            forward_transitions[node_here] = aln_char;
-                        }
-                    }
-                    else {
-                        // this alignment isn't transitioning anywhere yet
-                        
-                        // we don't want to extend nodes where we'll need to attach a gap edge later
-                        completed_nodes.insert(node_here);
-                    }
-                }
+                    // keep track of the fact that now we are on the new node
+                    at_node = new_node;
                 
-                for (const auto& transition : transitions) {
-#ifdef debug_msa_converter
-                    cerr << "transition to " << transition.first << endl;
-                    cerr << "from nodes:" << endl;
-                    for (const Node* n : transition.second.first) {
-                        cerr << "\t" << n->id() << ": " << n->sequence() << endl;
-                    }
-                    cerr << "on sequences:" << endl;
-                    for (const string& s : transition.second.second) {
-                        cerr << "\t" << s << endl;
-                    }
-#endif
-                    Node* at_node;
+                }
+                else {
+                    // there's only one node that wants to transition to this
+                    // character, so we might be able to just extend the node
+                    at_node = *transition.second.first.begin();
                     
-                    if (transition.second.first.size() > 1) {
+                    if (at_node->sequence().size() >= max_node_length ||
+                        completed_nodes.count(at_node)) {
+                        // we either want to split this node just because of length or because
+                        // we've already marked it as unextendable
+                        
                         Node* new_node = graph.create_node(string(1, transition.first));
                         
-                        for (Node* attaching_node : transition.second.first) {
-                            graph.create_edge(attaching_node, new_node);
-                            // we don't want to extend nodes that already have edges out of their ends
-                            completed_nodes.insert(attaching_node);
-                        }
+                        graph.create_edge(at_node, new_node);
+                        completed_nodes.insert(at_node);
                         
                         // keep track of the fact that now we are on the new node
                         at_node = new_node;
-                        
                     }
                     else {
-                        // there's only one node that wants to transition to this
-                        // character, so we might be able to just extend the node
-                        at_node = *transition.second.first.begin();
-                        
-                        if (at_node->sequence().size() >= max_node_length ||
-                            completed_nodes.count(at_node)) {
-                            // we either want to split this node just because of length or because
-                            // we've already marked it as unextendable
-                            
-                            Node* new_node = graph.create_node(string(1, transition.first));
-                            
-                            graph.create_edge(at_node, new_node);
-                            completed_nodes.insert(at_node);
-                            
-                            // keep track of the fact that now we are on the new node
-                            at_node = new_node;
-                        }
-                        else {
-                            at_node->mutable_sequence()->append(1, transition.first);
-                        }
+                        at_node->mutable_sequence()->append(1, transition.first);
+                    }
+                }
+                
+                // update which node the paths are currently extending
+                for (size_t row : transition.second.second) {
+                    current_node[row] = at_node;
+                    if (built.first_node[row] == 0) {
+                        built.first_node[row] = at_node->id();
                     }
                     
-                    // update which node the paths are currently extending
-                    for (const string& name : transition.second.second) {
-                        current_node[name] = at_node;
-                        
-                        if (keep_paths) {
-                            Path* path = aln_path[name];
-                            if (path->mapping_size() == 0 ? true :
-                                at_node->id() != path->mapping(path->mapping_size() - 1).position().node_id()) {
-                                Mapping* mapping = path->add_mapping();
-                                mapping->mutable_position()->set_node_id(at_node->id());
-                                mapping->set_rank(path->mapping_size());
-                            }
+                    if (keep_paths) {
+                        vector<id_t>& path = built.path_nodes[row];
+                        if (path.empty() || at_node->id() != path.back()) {
+                            path.push_back(at_node->id());
                         }
                     }
                 }
-                
-                update_progress(alignment.size());
-                
-#ifdef debug_msa_converter
-                cerr << "graph: " << pb2json(graph.graph) << endl;
-                cerr << "node locations of sequences:" << endl;
-                for (const auto& curr : current_node) {
-                    cerr << "\t" << curr.first << " " << curr.second->id() << endl;
+            }
+        }
+        
+        for (size_t row = 0; row < num_rows; row++) {
+            if (current_node[row] != dummy_node) {
+                built.last_node[row] = current_node[row]->id();
+            }
+        }
+        
+        graph.destroy_node(dummy_node);
+    }
+    
+    VG MSAConverter::make_graph(bool keep_paths, size_t max_node_length) {
+        
+        VG graph;
+        
+        // detect sequences with duplicate names and determine the size of the conversion
+        bool contains_duplicate_seq_names = false;
+        size_t total_size = 0;
+        unordered_map<string, pair<size_t, size_t>> seq_name_count;
+        for (const AlignmentBlock& alignment : alignments) {
+            total_size += alignment.rows.size();
+            for (const string& name : alignment.names) {
+                seq_name_count[name].first++;
+                contains_duplicate_seq_names |= (seq_name_count[name].first > 1);
+            }
+        }
+        
+        create_progress("converting to graph", total_size);
+        
+        // append a number to each duplicate name
+        if (contains_duplicate_seq_names) {
+            for (AlignmentBlock& alignment : alignments) {
+                // TODO: it's technically possible that the new name might collide with one already
+                // in the block, although this would have required some weird naming
+                for (string& seq_name : alignment.names) {
+                    if (seq_name_count[seq_name].first > 1) {
+                        size_t name_num = ++seq_name_count[seq_name].second;
+                        stringstream sstrm;
+                        sstrm << seq_name << "." << name_num;
+                        seq_name = sstrm.str();
+                    }
                 }
-#endif
+            }
+        }
+        
+        // split the blocks into ranges of columns that we can build independently,
+        // as (block, first column, past-last column)
+        vector<tuple<size_t, size_t, size_t>> jobs;
+        size_t range_length = max<size_t>(parallel_block_length, 1);
+        for (size_t i = 0; i < alignments.size(); i++) {
+            size_t begin = 0;
+            do {
+                jobs.emplace_back(i, begin, min(begin + range_length, alignments[i].length));
+                begin += range_length;
+            } while (begin < alignments[i].length);
+        }
+        
+        // build the ranges in waves, in parallel, and join each wave onto the
+        // graph in order, so we only ever hold a few of them at a time
+        size_t wave_size = 2 * get_thread_count();
+        vector<ColumnRangeGraph> built;
+        
+        // the last node in the graph that each row of the current block is on,
+        // and the nodes its path has visited so far
+        vector<id_t> last_node;
+        vector<vector<id_t>> path_nodes;
+        
+        // the largest node ID in the graph so far
+        id_t max_id = 0;
+        
+        for (size_t wave_begin = 0; wave_begin < jobs.size(); wave_begin += wave_size) {
+            size_t wave_end = min(wave_begin + wave_size, jobs.size());
+            built.clear();
+            built.resize(wave_end - wave_begin);
+
+#pragma omp parallel for schedule(dynamic, 1)
+            for (size_t i = wave_begin; i < wave_end; i++) {
+                build_column_range(alignments[get<0>(jobs[i])], get<1>(jobs[i]), get<2>(jobs[i]),
+                                   keep_paths, max_node_length, built[i - wave_begin]);
             }
             
-            for (pair<const string, Path*> path_record : aln_path) {
-                Path* path = path_record.second;
-                for (size_t i = 0; i < path->mapping_size(); i++) {
-                    Mapping* mapping = path->mutable_mapping(i);
-                    assert(mapping->edit_size() == 0);
-                    Edit* edit = mapping->add_edit();
+            for (size_t i = wave_begin; i < wave_end; i++) {
+                const AlignmentBlock& alignment = alignments[get<0>(jobs[i])];
+                ColumnRangeGraph& range = built[i - wave_begin];
+                size_t num_rows = alignment.names.size();
+                
+                if (get<1>(jobs[i]) == 0) {
+                    // this is the start of a new block
+                    last_node.assign(num_rows, 0);
+                    path_nodes.assign(keep_paths ? num_rows : 0, vector<id_t>());
+                }
+                
+                // move the range's node IDs past the ones already in the graph
+                id_t id_offset = max_id;
+                max_id += range.graph.max_node_id();
+                for (size_t j = 0; j < range.graph.graph.node_size(); j++) {
+                    Node node = range.graph.graph.node(j);
+                    node.set_id(node.id() + id_offset);
+                    graph.add_node(node);
+                }
+                for (size_t j = 0; j < range.graph.graph.edge_size(); j++) {
+                    Edge edge = range.graph.graph.edge(j);
+                    edge.set_from(edge.from() + id_offset);
+                    edge.set_to(edge.to() + id_offset);
+                    graph.add_edge(edge);
+                }
+                
+                // join each row onto where it left off in the previous range
+                for (size_t row = 0; row < num_rows; row++) {
+                    if (range.first_node[row] == 0) {
+                        // the row is all gaps in this range
+                        continue;
+                    }
+                    if (last_node[row] != 0) {
+                        graph.create_edge(last_node[row], range.first_node[row] + id_offset);
+                    }
+                    last_node[row] = range.last_node[row] + id_offset;
                     
-                    size_t node_length = graph.get_node(mapping->position().node_id())->sequence().size();
-                    edit->set_from_length(node_length);
-                    edit->set_to_length(node_length);
+                    if (keep_paths) {
+                        for (id_t node_id : range.path_nodes[row]) {
+                            path_nodes[row].push_back(node_id + id_offset);
+                        }
+                    }
+                }
+                
+                update_progress(num_rows * (get<2>(jobs[i]) - get<1>(jobs[i])));
+                range = ColumnRangeGraph();
+                
+                if (keep_paths && (i + 1 == jobs.size() || get<0>(jobs[i + 1]) != get<0>(jobs[i]))) {
+                    // this is the end of the block, so we can make its paths
+                    for (size_t row = 0; row < num_rows; row++) {
+                        Path* path = graph.graph.add_path();
+                        path->set_name(alignment.names[row]);
+                        for (id_t node_id : path_nodes[row]) {
+                            Mapping* mapping = path->add_mapping();
+                            mapping->mutable_position()->set_node_id(node_id);
+                            mapping->set_rank(path->mapping_size());
+                            
+                            Edit* edit = mapping->add_edit();
+                            size_t node_length = graph.get_node(node_id)->sequence().size();
+                            edit->set_from_length(node_length);
+                            edit->set_to_length(node_length);
+                        }
+                    }
                 }
             }
-            
-            graph.destroy_node(dummy_node);
         }
         
         destroy_progress();
@@ -399,5 +496,3 @@ using namespace std;
     }
 
 }
-
-
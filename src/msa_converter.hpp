@@ -28,11 +28,46 @@ using namespace std;
         
         void load_alignments(istream& in, string format = "fasta");
         
+        /// Build the graph. Alignments longer than parallel_block_length
+        /// columns are split into ranges of that many columns, which are
+        /// built on separate OMP threads and then joined, so the graph may
+        /// have extra node boundaries between the ranges.
         VG make_graph(bool keep_paths = true, size_t max_node_length = numeric_limits<size_t>::max());
         
+        /// The number of columns of an alignment built as one unit
+        size_t parallel_block_length = 1 << 16;
+        
     private:
         
-        vector<unordered_map<string, string>> alignments;
+        /// One alignment, with the equal-length aligned rows packed into a
+        /// single buffer
+        struct AlignmentBlock {
+            vector<string> names;
+            size_t length = 0;
+            string rows;
+            
+            /// Get the character of a row in a column
+            inline char at(size_t row, size_t column) const {
+                return rows[row * length + column];
+            }
+        };
+        
+        /// The graph built from a range of columns of an alignment, with node
+        /// IDs starting at 1, and the nodes each row starts on, ends on, and
+        /// visits in the range (0 if none)
+        struct ColumnRangeGraph {
+            VG graph;
+            vector<id_t> first_node;
+            vector<id_t> last_node;
+            vector<vector<id_t>> path_nodes;
+        };
+        
+        /// Build the graph for a range of columns of an alignment, as if it
+        /// were the whole alignment.
+        void build_column_range(const AlignmentBlock& alignment, size_t begin, size_t end,
+                                bool keep_paths, size_t max_node_length, ColumnRangeGraph& built) const;
+        
+        vector<AlignmentBlock> alignments;
         
     };
 
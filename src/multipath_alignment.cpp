@@ -352,22 +352,25 @@ namespace vg {
         // And the optimal score
         int32_t& opt_score = get<2>(dp_result);
         
-        // Keep lists of DP steps, which are subpath numbers to visit.
-        // Even going to the end subpath (where prefix length + subpath length = read length) is a DP step
-        // We never deal with empty lists; we always seed with the traceback start node.
-        using step_list_t = ImmutableList<int64_t>;
+        // Partial tracebacks are kept as steps in a shared buffer, each of which is a subpath and the
+        // index of the step after it (toward the end of the read), or -1 at the end. A partial
+        // traceback is the index of its first step, so extending one never copies anything.
+        vector<pair<int64_t, int64_t>> steps;
         
-        // Put them in a size-limited priority queue by score difference (positive) from optimal
-        MinMaxHeap<pair<int32_t, step_list_t>> queue;
+        // Put them in a size-limited priority queue by score difference (positive) from optimal. Each
+        // item stands for the best alignment that ends with its partial traceback, which we get by
+        // following the optimal predecessors from its first step.
+        MinMaxHeap<pair<int32_t, int64_t>> queue;
         
         // We define a function to put stuff in the queue and limit its size to
         // the (count - to_return.size()) items with lowest penalty.
-        auto try_enqueue = [&](const pair<int32_t, step_list_t>& item) {
+        auto try_enqueue = [&](int32_t penalty, int64_t subpath, int64_t next_step) {
             auto max_size = count - to_return.size();
-            if (queue.size() < max_size || item < queue.max()) {
+            if (queue.size() < max_size || penalty < queue.max().first) {
                 // The item belongs in the queue because it fits or it beats
                 // the current worst thing.
-                queue.push(item);
+                steps.emplace_back(subpath, next_step);
+                queue.push(make_pair(penalty, (int64_t) steps.size() - 1));
             } else {
 #ifdef debug_multiple_tracebacks
                 cerr << "Rejected! Queue is full!" << endl;
@@ -430,111 +433,88 @@ namespace vg {
                 // The score penalty for starting here is the optimal score minus the optimal score starting here
                 auto penalty = opt_score - (problem.prefix_score[i] + multipath_aln.subpath(i).score());
                 
-                // The path is just to be here
-                step_list_t starting_path{i};
-                
 #ifdef debug_multiple_tracebacks
                 cerr << "Could end at subpath " << i << " with penalty " << penalty << endl;
 #endif
                 
-                try_enqueue(make_pair(penalty, starting_path));
+                try_enqueue(penalty, i, -1);
             }
         }
         
+        vector<int64_t> traceback;
         while (!queue.empty() && to_return.size() < count) {
             // Each iteration
             
-            // Grab the best list as our basis
+            // Grab the best partial traceback as our basis
             int32_t basis_score_difference;
-            step_list_t basis;
+            int64_t basis;
             tie(basis_score_difference, basis) = queue.min();
             queue.pop_min();
             
-            assert(!basis.empty());
-            
 #ifdef debug_multiple_tracebacks
-            size_t basis_size = 0;
-            for (auto& i : basis) {
-                basis_size++;
-            }
-            cerr << "Consider " << basis_size << " element traceback to " << basis.front() << " with penalty "
-                 << basis_score_difference << endl;
-            cerr << "\t" << pb2json(multipath_aln.subpath(basis.front()).path()) << endl;
+            cerr << "Consider traceback to " << steps[basis].first << " with penalty " << basis_score_difference << endl;
+            cerr << "\t" << pb2json(multipath_aln.subpath(steps[basis].first).path()) << endl;
 #endif
             
-            if (problem.prev_subpath[basis.front()] == -1) {
-                // If it leads all the way to a subpath that is optimal as a start
-                
-                // Make an Alignment to emit it in
-                to_return.emplace_back();
-                Alignment& aln_out = to_return.back();
-                
-                // Set up read info and MAPQ
-                // TODO: MAPQ on secondaries?
-                transfer_read_metadata(multipath_aln, aln_out);
-                aln_out.set_mapping_quality(multipath_aln.mapping_quality());
-                
-                // Populate path
-                populate_path_from_traceback(multipath_aln, problem, basis.begin(), basis.end(), aln_out.mutable_path());
+            // Follow the optimal predecessors back to a subpath that is optimal as a start, which costs
+            // nothing more. Every other predecessor along the way is a deviation that makes a worse
+            // alignment, so we queue those up to extend later. Note that each subpath we pass through
+            // here is only offered with the deviations of this one traceback.
+            int64_t step = basis;
+            while (problem.prev_subpath[steps[step].first] != -1) {
                 
-                // Set score
-                aln_out.set_score(opt_score - basis_score_difference);
-                
-#ifdef debug_multiple_tracebacks
-                cerr << "Traceback reaches start; emit with score " << aln_out.score() << endl;
-#endif
-                
-            } else {
-                // The path does not lead all the way to a source
-                
-                // Find out all the places we can come from, and the score
-                // penalties, relative to the optimal score for an alignment
-                // visiting the basis's lead subpath, that we would take if we
-                // came from each.
-                // Note that we will only do this once per subpath, when we are
-                // working on the optimal alignment going through that subpath.
-                list<pair<int64_t, int32_t>> destinations;
-                
-                // The destinations will be all places we could have arrived here from
-                auto& here = basis.front();
+                int64_t here = steps[step].first;
+                int64_t opt_prev = problem.prev_subpath[here];
                 
                 // To compute the additional score difference, we need to know what our optimal prefix score was.
                 auto& best_prefix_score = problem.prefix_score[here];
                 
                 for (auto& prev : prev_subpaths[here]) {
+                    if (prev == opt_prev) {
+                        continue;
+                    }
+                    
                     // For each, compute the score of the optimal alignment ending at that predecessor
                     auto prev_opt_score = problem.prefix_score[prev] + multipath_aln.subpath(prev).score();
                     
-                    // What's the difference we would take if we went with this predecessor?
-                    auto additional_penalty = best_prefix_score - prev_opt_score;
-                    
-                    destinations.emplace_back(prev, additional_penalty);
-                }
-                
-                // TODO: unify loops!
-                
-                for (auto& destination : destinations) {
-                    // Prepend each of the things that can be prepended
-                    
-                    // Unpack
-                    auto& prev = destination.first;
-                    auto& additional_penalty = destination.second;
-                    
-                    // Make an extended path
-                    auto extended_path = basis.push_front(prev);
-                    
-                    // Calculate the score differences from optimal
-                    auto total_penalty = basis_score_difference + additional_penalty;
+                    // Calculate the score differences from optimal if we went with this predecessor
+                    auto total_penalty = basis_score_difference + (best_prefix_score - prev_opt_score);
                     
 #ifdef debug_multiple_tracebacks
-                    cerr << "\tAugment with " << prev << " to penalty " << total_penalty << endl;
+                    cerr << "\tAugment " << here << " with " << prev << " to penalty " << total_penalty << endl;
 #endif
                     
-                    // Put them in the priority queue
-                    try_enqueue(make_pair(total_penalty, extended_path));
+                    try_enqueue(total_penalty, prev, step);
                 }
                 
+                steps.emplace_back(opt_prev, step);
+                step = steps.size() - 1;
             }
+            
+            // Now the traceback leads all the way to a subpath that is optimal as a start
+            traceback.clear();
+            for (int64_t i = step; i != -1; i = steps[i].second) {
+                traceback.push_back(steps[i].first);
+            }
+            
+            // Make an Alignment to emit it in
+            to_return.emplace_back();
+            Alignment& aln_out = to_return.back();
+            
+            // Set up read info and MAPQ
+            // TODO: MAPQ on secondaries?
+            transfer_read_metadata(multipath_aln, aln_out);
+            aln_out.set_mapping_quality(multipath_aln.mapping_quality());
+            
+            // Populate path
+            populate_path_from_traceback(multipath_aln, problem, traceback.begin(), traceback.end(), aln_out.mutable_path());
+            
+            // Set score
+            aln_out.set_score(opt_score - basis_score_difference);
+            
+#ifdef debug_multiple_tracebacks
+            cerr << "Traceback reaches start; emit with score " << aln_out.score() << endl;
+#endif
         }
         
         return to_return;
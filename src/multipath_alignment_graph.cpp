@@ -2582,57 +2582,64 @@ namespace vg {
         // We can only remove edges when the edges are present
         assert(has_reachability_edges);
         
-        // algorithm assumes edges are also sorted in topological order, which guarantees that we will
-        // traverse a path that reveals an edge as transitive before actually traversing the transitive edge
+        // algorithm assumes edges are also sorted in topological order, so that any other target
+        // that can reach an edge's target comes before it in the adjacency list
         reorder_adjacency_lists(topological_order);
         
-        for (size_t i : topological_order) {
-            vector<pair<size_t, size_t>>& edges = path_nodes[i].edges;
-            
-            // if there is only one edge out of a node, that edge can never be transitive
-            // (this optimization covers most cases)
-            if (edges.size() <= 1) {
-                continue;
-            }
-            
-            vector<bool> keep(edges.size(), true);
-            unordered_set<size_t> traversed;
-            
-            for (size_t j = 0; j < edges.size(); j++) {
-                const pair<size_t, size_t>& edge = edges[j];
-                if (traversed.count(edge.first)) {
-                    // we can reach the target of this edge by another path, so it is transitive
-                    keep[j] = false;
-                    continue;
-                }
-                
-                // DFS to mark all reachable nodes from this edge
-                vector<size_t> stack{edge.first};
-                traversed.insert(edge.first);
-                while (!stack.empty()) {
-                    size_t idx = stack.back();
-                    stack.pop_back();
-                    for (const pair<size_t, size_t>& edge_from : path_nodes[idx].edges) {
-                        if (!traversed.count(edge_from.first)) {
-                            stack.push_back(edge_from.first);
-                            traversed.insert(edge_from.first);
+        size_t num_nodes = topological_order.size();
+        vector<size_t> rank(num_nodes);
+        for (size_t r = 0; r < num_nodes; r++) {
+            rank[topological_order[r]] = r;
+        }
+        
+        // we record the nodes that each node can reach as bitsets over topological ranks, a chunk of
+        // ranks at a time so that big graphs don't need quadratic memory
+        const size_t max_reachability_words = 1 << 20;
+        size_t total_words = (num_nodes + 63) / 64;
+        size_t chunk_words = max<size_t>(1, min(total_words, max_reachability_words / max<size_t>(num_nodes, 1)));
+        size_t chunk_ranks = chunk_words * 64;
+        vector<uint64_t> reachable;
+        
+        for (size_t chunk_begin = 0; chunk_begin < num_nodes; chunk_begin += chunk_ranks) {
+            size_t chunk_end = min(num_nodes, chunk_begin + chunk_ranks);
+            
+            // only nodes before the end of the chunk can reach into it
+            reachable.assign(chunk_end * chunk_words, 0);
+            
+            for (size_t r = chunk_end; r > 0; r--) {
+                uint64_t* reachable_here = &reachable[(r - 1) * chunk_words];
+                if (r - 1 >= chunk_begin) {
+                    reachable_here[(r - 1 - chunk_begin) / 64] |= uint64_t(1) << ((r - 1 - chunk_begin) % 64);
+                }
+                
+                // an edge is transitive if its target can be reached from one of the targets before it,
+                // so we check the edges' targets as we accumulate what they can reach
+                vector<pair<size_t, size_t>>& edges = path_nodes[topological_order[r - 1]].edges;
+                size_t next_idx = 0;
+                for (size_t j = 0; j < edges.size(); j++) {
+                    size_t target_rank = rank[edges[j].first];
+                    if (target_rank < chunk_end) {
+                        if (target_rank >= chunk_begin) {
+                            size_t bit = target_rank - chunk_begin;
+                            if (reachable_here[bit / 64] & (uint64_t(1) << (bit % 64))) {
+                                // we can reach the target of this edge by another path, so it is transitive
+                                continue;
+                            }
+                        }
+                        const uint64_t* reachable_there = &reachable[target_rank * chunk_words];
+                        for (size_t w = 0; w < chunk_words; w++) {
+                            reachable_here[w] |= reachable_there[w];
                         }
                     }
-                }
-            }
-            
-            // remove the transitive edges we found
-            size_t next_idx = 0;
-            for (size_t j = 0; j < edges.size(); j++) {
-                if (keep[j] && j != next_idx) {
-                    edges[next_idx] = edges[j];
-                    next_idx++;
-                }
-                else if (keep[j]) {
+                    // removing transitive edges never changes what can be reached, so the edges we keep
+                    // stay valid for the remaining chunks
+                    if (j != next_idx) {
+                        edges[next_idx] = edges[j];
+                    }
                     next_idx++;
                 }
+                edges.resize(next_idx);
             }
-            edges.resize(next_idx);
         }
         
         
@@ -2811,6 +2818,10 @@ namespace vg {
         // Can only align if edges are present.
         assert(has_reachability_edges);
         
+        // Subgraphs between and around the anchors get extracted many times per read, so keep the
+        // search state from one call to the next in each thread.
+        static thread_local algorithms::ExtractionWorkspace extraction_workspace;
+        
         // transfer over data from alignment
         transfer_read_metadata(alignment, multipath_aln_out);
         
@@ -2894,6 +2905,7 @@ namespace vg {
                                                                                                max_dist,          // longest distance necessary
                                                                                                src_pos,           // end of earlier match
                                                                                                dest_pos,          // beginning of later match
+                                                                                               extraction_workspace, // reused search state
                                                                                                false,             // do not bother finding all cycles (it's a DAG)
                                                                                                true,              // only include nodes on connecting paths
                                                                                                true);             // enforce max distance strictly
@@ -3044,7 +3056,8 @@ namespace vg {
                                                                                                target_length,
                                                                                                end_pos,
                                                                                                false,         // search forward
-                                                                                               false);        // no need to preserve cycles (in a DAG)
+                                                                                               false,         // no need to preserve cycles (in a DAG)
+                                                                                               extraction_workspace); // reused search state
                     
                     size_t num_alt_alns = dynamic_alt_alns ? min(max_alt_alns, algorithms::count_walks(&tail_graph_extractor)) : max_alt_alns;
                     
@@ -3158,7 +3171,8 @@ namespace vg {
                                                                                                target_length,
                                                                                                begin_pos,
                                                                                                true,          // search backward
-                                                                                               false);        // no need to preserve cycles (in a DAG)
+                                                                                               false,         // no need to preserve cycles (in a DAG)
+                                                                                               extraction_workspace); // reused search state
                     
                     size_t num_alt_alns = dynamic_alt_alns ? min(max_alt_alns, algorithms::count_walks(&tail_graph_extractor)) : max_alt_alns;
                     
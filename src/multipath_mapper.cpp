@@ -15,6 +15,11 @@
 
 #include "algorithms/topological_sort.hpp"
 #include "annotation.hpp"
+#include "stage_profile.hpp"
+
+#include <iomanip>
+#include <map>
+#include <sstream>
 
 namespace vg {
     
@@ -36,6 +41,82 @@ namespace vg {
         
     }
     
+    void MultipathMapper::set_dagify_cache_capacity(size_t capacity) {
+        if (capacity == 0) {
+            dagify_cache.reset();
+        }
+        else {
+            dagify_cache.reset(new ShardedCache<string, shared_ptr<const DagifiedGraph>, std::hash<string>>(capacity));
+        }
+    }
+    
+    string MultipathMapper::dagify_cache_key(const VG& graph, int strand_mode, size_t target_length) {
+        // the unrolled graph only depends on the nodes and edges, so that's what we record
+        vector<int64_t> nodes;
+        nodes.reserve(3 * graph.graph.node_size());
+        for (const Node& node : graph.graph.node()) {
+            nodes.push_back(node.id());
+            nodes.push_back(node.sequence().size());
+            nodes.push_back(std::hash<string>()(node.sequence()));
+        }
+        vector<tuple<int64_t, bool, int64_t, bool>> edges;
+        edges.reserve(graph.graph.edge_size());
+        for (const Edge& edge : graph.graph.edge()) {
+            edges.emplace_back(edge.from(), edge.from_start(), edge.to(), edge.to_end());
+        }
+        // the order doesn't matter to the unrolling
+        vector<size_t> node_order(graph.graph.node_size());
+        for (size_t i = 0; i < node_order.size(); i++) {
+            node_order[i] = i;
+        }
+        sort(node_order.begin(), node_order.end(), [&](size_t a, size_t b) {
+            return nodes[3 * a] < nodes[3 * b];
+        });
+        sort(edges.begin(), edges.end());
+        
+        vector<int64_t> words;
+        words.reserve(4 + nodes.size() + 2 * edges.size());
+        words.push_back(strand_mode);
+        words.push_back(target_length);
+        words.push_back(node_order.size());
+        for (size_t i : node_order) {
+            words.push_back(nodes[3 * i]);
+            words.push_back(nodes[3 * i + 1]);
+            words.push_back(nodes[3 * i + 2]);
+        }
+        words.push_back(edges.size());
+        for (auto& edge : edges) {
+            words.push_back(get<0>(edge) * 2 + get<1>(edge));
+            words.push_back(get<2>(edge) * 2 + get<3>(edge));
+        }
+        return string(reinterpret_cast<const char*>(words.data()), words.size() * sizeof(int64_t));
+    }
+    
+    bool MultipathMapper::retrieve_dagified(const string& key, VG& align_graph,
+                                            unordered_map<id_t, pair<id_t, bool>>& node_trans) const {
+        if (!dagify_cache) {
+            return false;
+        }
+        auto cached = dagify_cache->retrieve(key);
+        if (!cached.second) {
+            return false;
+        }
+        align_graph = VG(cached.first->graph);
+        node_trans = cached.first->node_trans;
+        return true;
+    }
+    
+    void MultipathMapper::store_dagified(const string& key, const VG& align_graph,
+                                         const unordered_map<id_t, pair<id_t, bool>>& node_trans) const {
+        if (!dagify_cache) {
+            return;
+        }
+        shared_ptr<DagifiedGraph> dagified = make_shared<DagifiedGraph>();
+        dagified->graph = align_graph.graph;
+        dagified->node_trans = node_trans;
+        dagify_cache->put(key, dagified);
+    }
+    
     void MultipathMapper::multipath_map(const Alignment& alignment,
                                         vector<MultipathAlignment>& multipath_alns_out,
                                         size_t max_alt_mappings) {
@@ -47,6 +128,31 @@ namespace vg {
                                                  vector<MultipathAlignment>& multipath_alns_out,
                                                  size_t max_alt_mappings) {
         
+        VG_PROFILE_READ(alignment);
+        VG_TIMELINE_SPAN("map read");
+        VG_PROFILE_COUNT(READS, 1);
+        vector<MaximalExactMatch> mems = find_multipath_mems(alignment);
+        vector<clustergraph_t> cluster_graphs = cluster_and_extract(alignment, mems);
+        align_and_finish(alignment, mapq_method, cluster_graphs, multipath_alns_out, max_alt_mappings);
+    }
+    
+    void MultipathMapper::find_staged_mems(StagedRead& read) {
+        VG_PROFILE_COUNT(READS, 1);
+        read.mems = find_multipath_mems(read.alignment);
+    }
+    
+    void MultipathMapper::cluster_staged_mems(StagedRead& read) {
+        read.cluster_graphs = cluster_and_extract(read.alignment, read.mems);
+    }
+    
+    void MultipathMapper::align_staged_read(StagedRead& read, size_t max_alt_mappings) {
+        read.multipath_alns.clear();
+        align_and_finish(read.alignment, mapping_quality_method, read.cluster_graphs, read.multipath_alns, max_alt_mappings);
+        read.cluster_graphs.clear();
+    }
+    
+    vector<MaximalExactMatch> MultipathMapper::find_multipath_mems(const Alignment& alignment) {
+        
 #ifdef debug_multipath_mapper
         cerr << "multipath mapping read " << pb2json(alignment) << endl;
         cerr << "querying MEMs..." << endl;
@@ -54,8 +160,12 @@ namespace vg {
     
         // query MEMs using GCSA2
         double dummy1; double dummy2;
-        vector<MaximalExactMatch> mems = find_mems_deep(alignment.sequence().begin(), alignment.sequence().end(), dummy1, dummy2,
-                                                        0, min_mem_length, mem_reseed_length, false, true, true, false);
+        return find_mems_deep(alignment.sequence().begin(), alignment.sequence().end(), dummy1, dummy2,
+                              0, min_mem_length, mem_reseed_length, false, true, true, false);
+    }
+    
+    vector<MultipathMapper::clustergraph_t> MultipathMapper::cluster_and_extract(const Alignment& alignment,
+                                                                                 const vector<MaximalExactMatch>& mems) {
         
 #ifdef debug_multipath_mapper
         cerr << "obtained MEMs:" << endl;
@@ -69,22 +179,27 @@ namespace vg {
         
         // cluster the MEMs
         vector<memcluster_t> clusters;
-        // memos for the results of expensive succinct operations that we may need to do multiple times
-        OrientedDistanceClusterer::paths_of_node_memo_t paths_of_node_memo;
-        OrientedDistanceClusterer::oriented_occurences_memo_t oriented_occurences_memo;
-        OrientedDistanceClusterer::handle_memo_t handle_memo;
-        // TODO: Making OrientedDistanceClusterers is the only place we actually
-        // need to distinguish between regular_aligner and qual_adj_aligner
-        if (adjust_alignments_for_base_quality) {
-            OrientedDistanceClusterer clusterer(alignment, mems, *get_qual_adj_aligner(), xindex, max_expected_dist_approx_error,
-                                                min_clustering_mem_length, unstranded_clustering, &paths_of_node_memo, &oriented_occurences_memo, &handle_memo);
-            clusters = clusterer.clusters(alignment, max_mapping_quality, log_likelihood_approx_factor, min_median_mem_coverage_for_split);
-        }
-        else {
-            OrientedDistanceClusterer clusterer(alignment, mems, *get_regular_aligner(), xindex, max_expected_dist_approx_error,
-                                                min_clustering_mem_length, unstranded_clustering, &paths_of_node_memo, &oriented_occurences_memo, &handle_memo);
-            clusters = clusterer.clusters(alignment, max_mapping_quality, log_likelihood_approx_factor, min_median_mem_coverage_for_split);
+        {
+            VG_PROFILE_STAGE(CLUSTERING);
+            // memos for the results of expensive succinct operations that we may need to do multiple times
+            OrientedDistanceClusterer::paths_of_node_memo_t paths_of_node_memo;
+            OrientedDistanceClusterer::oriented_occurences_memo_t oriented_occurences_memo;
+            OrientedDistanceClusterer::handle_memo_t handle_memo;
+            // TODO: Making OrientedDistanceClusterers is the only place we actually
+            // need to distinguish between regular_aligner and qual_adj_aligner
+            if (adjust_alignments_for_base_quality) {
+                OrientedDistanceClusterer clusterer(alignment, mems, *get_qual_adj_aligner(), xindex, max_expected_dist_approx_error,
+                                                    min_clustering_mem_length, unstranded_clustering, &paths_of_node_memo, &oriented_occurences_memo, &handle_memo);
+                clusters = clusterer.clusters(alignment, max_mapping_quality, log_likelihood_approx_factor, min_median_mem_coverage_for_split);
+            }
+            else {
+                OrientedDistanceClusterer clusterer(alignment, mems, *get_regular_aligner(), xindex, max_expected_dist_approx_error,
+                                                    min_clustering_mem_length, unstranded_clustering, &paths_of_node_memo, &oriented_occurences_memo, &handle_memo);
+                clusters = clusterer.clusters(alignment, max_mapping_quality, log_likelihood_approx_factor, min_median_mem_coverage_for_split);
+            }
         }
+        VG_PROFILE_COUNT(CLUSTERS, clusters.size());
+        VG_PROFILE_COUNT(CLUSTERED_MEMS, stage_profile::total_cluster_size(clusters));
         
         
 #ifdef debug_multipath_mapper
@@ -99,7 +214,15 @@ namespace vg {
 #endif
         
         // extract graphs around the clusters
-        auto cluster_graphs = query_cluster_graphs(alignment, mems, clusters);
+        VG_PROFILE_STAGE(SUBGRAPH_EXTRACTION);
+        return query_cluster_graphs(alignment, mems, clusters);
+    }
+    
+    void MultipathMapper::align_and_finish(const Alignment& alignment,
+                                           MappingQualityMethod mapq_method,
+                                           vector<clustergraph_t>& cluster_graphs,
+                                           vector<MultipathAlignment>& multipath_alns_out,
+                                           size_t max_alt_mappings) {
         
         // actually perform the alignments and post-process to meet MultipathAlignment invariants
         vector<size_t> cluster_idxs = range_vector(cluster_graphs.size());
@@ -251,6 +374,41 @@ namespace vg {
         
     }
     
+    bool MultipathMapper::estimate_fragment_length_distr(const vector<pair<Alignment, Alignment>>& read_pairs) {
+        
+        auto measure_pairs = [&]() {
+            for (size_t i = 0; i < read_pairs.size(); i++) {
+#pragma omp task firstprivate(i) shared(read_pairs)
+                {
+                    if (!fragment_length_distr.is_finalized()) {
+                        // the unambiguous pairs register their fragment lengths, and we throw away all
+                        // the mappings
+                        vector<pair<MultipathAlignment, MultipathAlignment>> multipath_aln_pairs;
+                        vector<pair<Alignment, Alignment>> ambiguous_pairs;
+                        attempt_unpaired_multipath_map_of_pair(read_pairs[i].first, read_pairs[i].second,
+                                                               multipath_aln_pairs, ambiguous_pairs);
+                    }
+                }
+            }
+#pragma omp taskwait
+        };
+        
+        if (omp_in_parallel()) {
+            // probably the reading thread of a parallel loop, so hand the pairs off to the team
+            measure_pairs();
+        }
+        else {
+#pragma omp parallel
+#pragma omp single
+            measure_pairs();
+        }
+        
+        // pick up the measurements still sitting in the thread buffers
+        fragment_length_distr.flush();
+        
+        return fragment_length_distr.is_finalized();
+    }
+    
     void MultipathMapper::attempt_unpaired_multipath_map_of_pair(const Alignment& alignment1, const Alignment& alignment2,
                                                                  vector<pair<MultipathAlignment, MultipathAlignment>>& multipath_aln_pairs_out,
                                                                  vector<pair<Alignment, Alignment>>& ambiguous_pair_buffer) {
@@ -354,6 +512,8 @@ namespace vg {
     bool MultipathMapper::attempt_rescue(const MultipathAlignment& multipath_aln, const Alignment& other_aln,
                                          bool rescue_forward, MultipathAlignment& rescue_multipath_aln) {
         
+        VG_PROFILE_STAGE(PAIR_RESCUE);
+        
 #ifdef debug_multipath_mapper
         cerr << "attemping pair rescue in " << (rescue_forward ? "forward" : "backward") << " direction from " << pb2json(multipath_aln) << endl;
 #endif
@@ -395,15 +555,22 @@ namespace vg {
         
         // convert from bidirected to directed
         VG align_graph;
-        unordered_map<id_t, pair<id_t, bool> > node_trans = algorithms::split_strands(&rescue_graph, &align_graph);
-        // if necessary, convert from cyclic to acylic
-        if (!algorithms::is_directed_acyclic(&rescue_graph)) {
-            unordered_map<id_t, pair<id_t, bool> > dagify_trans;
-            align_graph = align_graph.dagify(target_length, // high enough that num SCCs is never a limiting factor
-                                             dagify_trans,
-                                             target_length,
-                                             0); // no maximum on size of component
-            node_trans = align_graph.overlay_node_translations(dagify_trans, node_trans);
+        unordered_map<id_t, pair<id_t, bool> > node_trans;
+        bool cyclic = !algorithms::is_directed_acyclic(&rescue_graph);
+        // we may have unrolled this graph for another read already
+        string dagify_key = (cyclic && dagify_cache) ? dagify_cache_key(rescue_graph, 0, target_length) : "";
+        if (!cyclic || !retrieve_dagified(dagify_key, align_graph, node_trans)) {
+            node_trans = algorithms::split_strands(&rescue_graph, &align_graph);
+            // if necessary, convert from cyclic to acylic
+            if (cyclic) {
+                unordered_map<id_t, pair<id_t, bool> > dagify_trans;
+                align_graph = align_graph.dagify(target_length, // high enough that num SCCs is never a limiting factor
+                                                 dagify_trans,
+                                                 target_length,
+                                                 0); // no maximum on size of component
+                node_trans = align_graph.overlay_node_translations(dagify_trans, node_trans);
+                store_dagified(dagify_key, align_graph, node_trans);
+            }
         }
         
         // put local alignment here
@@ -463,6 +630,7 @@ namespace vg {
             return false;
         }
         
+        VG_PROFILE_COUNT(RESCUES, 1);
         return true;
     }
     
@@ -631,6 +799,69 @@ namespace vg {
         adjust_alignments_for_base_quality = reset_quality_adjustments;
     }
     
+    map<string, string> MultipathMapper::mismapping_calibration_settings(size_t num_simulations,
+                                                                         size_t simulated_read_length) const {
+        const Aligner* aligner = get_regular_aligner();
+        
+        stringstream matrix;
+        for (size_t i = 0; i < 25; i++) {
+            matrix << (i ? "," : "") << (int) aligner->score_matrix[i];
+        }
+        
+        map<string, string> settings;
+        settings["graph_length"] = to_string(xindex->seq_length);
+        settings["graph_nodes"] = to_string(xindex->node_count);
+        settings["simulations"] = to_string(num_simulations);
+        settings["read_length"] = to_string(simulated_read_length);
+        settings["score_matrix"] = matrix.str();
+        settings["gap_open"] = to_string((int) aligner->gap_open);
+        settings["gap_extension"] = to_string((int) aligner->gap_extension);
+        settings["full_length_bonus"] = to_string((int) aligner->full_length_bonus);
+        settings["min_clustering_mem_length"] = to_string(min_clustering_mem_length);
+        return settings;
+    }
+    
+    void MultipathMapper::save_mismapping_calibration(ostream& out, size_t num_simulations,
+                                                      size_t simulated_read_length) const {
+        for (auto& setting : mismapping_calibration_settings(num_simulations, simulated_read_length)) {
+            out << setting.first << "\t" << setting.second << "\n";
+        }
+        // write enough digits to get back exactly the same double
+        out << "pseudo_length_multiplier\t" << setprecision(17) << pseudo_length_multiplier << endl;
+    }
+    
+    bool MultipathMapper::load_mismapping_calibration(istream& in, size_t num_simulations,
+                                                      size_t simulated_read_length) {
+        map<string, string> loaded;
+        string line;
+        while (getline(in, line)) {
+            size_t tab = line.find('\t');
+            if (tab != string::npos) {
+                loaded[line.substr(0, tab)] = line.substr(tab + 1);
+            }
+        }
+        
+        auto iter = loaded.find("pseudo_length_multiplier");
+        if (iter == loaded.end()) {
+            return false;
+        }
+        double multiplier = strtod(iter->second.c_str(), nullptr);
+        if (!(multiplier > 0.0)) {
+            return false;
+        }
+        loaded.erase(iter);
+        
+        if (loaded != mismapping_calibration_settings(num_simulations, simulated_read_length)) {
+            // calibrated for something else
+            return false;
+        }
+        
+        pseudo_length_multiplier = multiplier;
+        // p-values computed with the old multiplier are no longer right
+        p_value_memo.clear();
+        return true;
+    }
+    
     int64_t MultipathMapper::distance_between(const MultipathAlignment& multipath_aln_1,
                                               const MultipathAlignment& multipath_aln_2,
                                               bool full_fragment, bool forward_strand) const {
@@ -1227,6 +1458,9 @@ namespace vg {
                                                vector<pair<Alignment, Alignment>>& ambiguous_pair_buffer,
                                                size_t max_alt_mappings) {
         
+        VG_PROFILE_READ(alignment1, &alignment2);
+        VG_TIMELINE_SPAN("map pair");
+        VG_PROFILE_COUNT(READS, 2);
 #ifdef debug_multipath_mapper
         cerr << "multipath mapping paired reads " << pb2json(alignment1) << " and " << pb2json(alignment2) << endl;
 #endif
@@ -1250,11 +1484,13 @@ namespace vg {
         // the fragment length distribution has been estimated, so we can do full-fledged paired mode
     
         // query MEMs using GCSA2
-        double dummy1, dummy2;
-        vector<MaximalExactMatch> mems1 = find_mems_deep(alignment1.sequence().begin(), alignment1.sequence().end(), dummy1, dummy2,
-                                                         0, min_mem_length, mem_reseed_length, false, true, true, false);
-        vector<MaximalExactMatch> mems2 = find_mems_deep(alignment2.sequence().begin(), alignment2.sequence().end(), dummy1, dummy2,
-                                                         0, min_mem_length, mem_reseed_length, false, true, true, false);
+        vector<double> dummy1, dummy2;
+        vector<vector<MaximalExactMatch>> mems_by_read = find_mems_deep_batch({make_pair(alignment1.sequence().begin(), alignment1.sequence().end()),
+                                                                               make_pair(alignment2.sequence().begin(), alignment2.sequence().end())},
+                                                                              dummy1, dummy2, 0, min_mem_length, mem_reseed_length,
+                                                                              false, true, true, false);
+        vector<MaximalExactMatch>& mems1 = mems_by_read[0];
+        vector<MaximalExactMatch>& mems2 = mems_by_read[1];
         
 #ifdef debug_multipath_mapper
         cerr << "obtained read1 MEMs:" << endl;
@@ -1412,8 +1648,19 @@ namespace vg {
             }
             
             // extract graphs around the clusters and get the assignments of MEMs to these graphs
-            cluster_graphs1 = query_cluster_graphs(alignment1, mems1, clusters1);
-            cluster_graphs2 = query_cluster_graphs(alignment2, mems2, clusters2);
+            if (share_fragment_graphs) {
+                // pull the graph for both mates' clusters out of the index at once, so that the regions
+                // they share (usually most of them, for a proper pair) are only walked in the index once,
+                // and then take each cluster's graph out of that
+                VG* fragment_graph = extract_fragment_graph(alignment1, clusters1, alignment2, clusters2);
+                cluster_graphs1 = query_cluster_graphs(alignment1, mems1, clusters1, fragment_graph);
+                cluster_graphs2 = query_cluster_graphs(alignment2, mems2, clusters2, fragment_graph);
+                delete fragment_graph;
+            }
+            else {
+                cluster_graphs1 = query_cluster_graphs(alignment1, mems1, clusters1);
+                cluster_graphs2 = query_cluster_graphs(alignment2, mems2, clusters2);
+            }
         }
         
 #ifdef debug_multipath_mapper
@@ -2514,13 +2761,59 @@ namespace vg {
         
     }
     
-    auto MultipathMapper::query_cluster_graphs(const Alignment& alignment,
-                                               const vector<MaximalExactMatch>& mems,
-                                               const vector<memcluster_t>& clusters) -> vector<clustergraph_t> {
+    void MultipathMapper::cluster_search_bounds(const Alignment& alignment, const memcluster_t& cluster,
+                                                vector<pos_t>& positions, vector<size_t>& forward_max_dist,
+                                                vector<size_t>& backward_max_dist) const {
         
         // Figure out the aligner to use
         BaseAligner* aligner = get_aligner();
         
+        positions.reserve(positions.size() + cluster.size());
+        forward_max_dist.reserve(forward_max_dist.size() + cluster.size());
+        backward_max_dist.reserve(backward_max_dist.size() + cluster.size());
+        
+        for (auto& mem_hit : cluster) {
+            // get the start position of the MEM
+            positions.push_back(mem_hit.second);
+            // search far enough away to get any hit detectable without soft clipping
+            forward_max_dist.push_back(aligner->longest_detectable_gap(alignment, mem_hit.first->end)
+                                       + (alignment.sequence().end() - mem_hit.first->begin));
+            backward_max_dist.push_back(aligner->longest_detectable_gap(alignment, mem_hit.first->begin)
+                                        + (mem_hit.first->begin - alignment.sequence().begin()));
+        }
+    }
+    
+    VG* MultipathMapper::extract_fragment_graph(const Alignment& alignment1, const vector<memcluster_t>& clusters1,
+                                                const Alignment& alignment2, const vector<memcluster_t>& clusters2) const {
+        
+        vector<pos_t> positions;
+        vector<size_t> forward_max_dist;
+        vector<size_t> backward_max_dist;
+        for (const memcluster_t& cluster : clusters1) {
+            cluster_search_bounds(alignment1, cluster, positions, forward_max_dist, backward_max_dist);
+        }
+        for (const memcluster_t& cluster : clusters2) {
+            cluster_search_bounds(alignment2, cluster, positions, forward_max_dist, backward_max_dist);
+        }
+        
+        // a search from all the hits at once takes in everything any of the searches from the individual
+        // clusters would, but only walks the parts the mates share once
+        VG* fragment_graph = new VG();
+        algorithms::extract_containing_graph(xindex, fragment_graph, positions, forward_max_dist,
+                                             backward_max_dist);
+        return fragment_graph;
+    }
+    
+    auto MultipathMapper::query_cluster_graphs(const Alignment& alignment,
+                                               const vector<MaximalExactMatch>& mems,
+                                               const vector<memcluster_t>& clusters,
+                                               const HandleGraph* source) -> vector<clustergraph_t> {
+        
+        // extract from the whole graph unless we were given a subgraph that has everything we need
+        if (source == nullptr) {
+            source = xindex;
+        }
+        
         // We populate this with all the cluster graphs.
         vector<clustergraph_t> cluster_graphs_out;
         
@@ -2550,21 +2843,7 @@ namespace vg {
             vector<pos_t> positions;
             vector<size_t> forward_max_dist;
             vector<size_t> backward_max_dist;
-            
-            positions.reserve(cluster.size());
-            forward_max_dist.reserve(cluster.size());
-            backward_max_dist.reserve(cluster.size());
-            
-            for (auto& mem_hit : cluster) {
-                // get the start position of the MEM
-                positions.push_back(mem_hit.second);
-                // search far enough away to get any hit detectable without soft clipping
-                forward_max_dist.push_back(aligner->longest_detectable_gap(alignment, mem_hit.first->end)
-                                           + (alignment.sequence().end() - mem_hit.first->begin));
-                backward_max_dist.push_back(aligner->longest_detectable_gap(alignment, mem_hit.first->begin)
-                                            + (mem_hit.first->begin - alignment.sequence().begin()));
-            }
-            
+            cluster_search_bounds(alignment, cluster, positions, forward_max_dist, backward_max_dist);
             
             // TODO: a progressive expansion of the subgraph if the MEM hit is already contained in
             // a cluster graph somewhere?
@@ -2572,7 +2851,7 @@ namespace vg {
             // extract the subgraph within the search distance
             
             VG* cluster_graph = new VG();
-            algorithms::extract_containing_graph(xindex, cluster_graph, positions, forward_max_dist,
+            algorithms::extract_containing_graph(source, cluster_graph, positions, forward_max_dist,
                                                  backward_max_dist);
             Graph& graph = cluster_graph->graph;
 
@@ -2869,6 +3148,9 @@ namespace vg {
                                           memcluster_t& graph_mems,
                                           MultipathAlignment& multipath_aln_out) const {
 
+        VG_PROFILE_STAGE(DP);
+        VG_PROFILE_COUNT(DP_CELLS, alignment.sequence().size() * vg->length());
+
 #ifdef debug_multipath_mapper_alignment
         cerr << "constructing alignment graph" << endl;
 #endif
@@ -2897,30 +3179,39 @@ namespace vg {
 #ifdef debug_multipath_mapper_alignment
         cerr << "use_single_stranded: " << use_single_stranded << " mem_strand: " << mem_strand << endl;
 #endif
-        if (use_single_stranded) {
-            if (mem_strand) {
-                align_graph = vg->reverse_complement_graph(node_trans);
+        bool cyclic = !algorithms::is_directed_acyclic(vg);
+        // we may have unrolled this graph for another read already
+        string dagify_key;
+        if (cyclic && dagify_cache) {
+            dagify_key = dagify_cache_key(*vg, use_single_stranded ? (mem_strand ? 2 : 1) : 0, target_length);
+        }
+        if (!cyclic || !retrieve_dagified(dagify_key, align_graph, node_trans)) {
+            if (use_single_stranded) {
+                if (mem_strand) {
+                    align_graph = vg->reverse_complement_graph(node_trans);
+                }
+                else {
+                    // if we are using only the forward strand of the current graph, a make trivial node translation so
+                    // the later code's expectations are met
+                    // TODO: can we do this without the copy constructor?
+                    align_graph = *vg;
+                    vg->identity_translation(node_trans);
+                }
             }
             else {
-                // if we are using only the forward strand of the current graph, a make trivial node translation so
-                // the later code's expectations are met
-                // TODO: can we do this without the copy constructor?
-                align_graph = *vg;
-                vg->identity_translation(node_trans);
+                node_trans = algorithms::split_strands(vg, &align_graph);
+            }
+            
+            // if necessary, convert from cyclic to acylic
+            if (cyclic) {
+                unordered_map<id_t, pair<id_t, bool> > dagify_trans;
+                align_graph = align_graph.dagify(target_length, // high enough that num SCCs is never a limiting factor
+                                                 dagify_trans,
+                                                 target_length,
+                                                 0); // no maximum on size of component
+                node_trans = align_graph.overlay_node_translations(dagify_trans, node_trans);
+                store_dagified(dagify_key, align_graph, node_trans);
             }
-        }
-        else {
-            node_trans = algorithms::split_strands(vg, &align_graph);
-        }
-
-        // if necessary, convert from cyclic to acylic
-        if (!algorithms::is_directed_acyclic(vg)) {
-            unordered_map<id_t, pair<id_t, bool> > dagify_trans;
-            align_graph = align_graph.dagify(target_length, // high enough that num SCCs is never a limiting factor
-                                             dagify_trans,
-                                             target_length,
-                                             0); // no maximum on size of component
-            node_trans = align_graph.overlay_node_translations(dagify_trans, node_trans);
         }
         
         // put the internal graph in topological order for the MultipathAlignmentGraph algorithm
@@ -3138,6 +3429,7 @@ namespace vg {
         if (multipath_alns.empty()) {
             return;
         }
+        VG_PROFILE_STAGE(MAPQ);
         
         // only do the population MAPQ if it might disambiguate two paths (since it's not
         // as cheap as just using the score)
@@ -3338,6 +3630,7 @@ namespace vg {
                                                            vector<pair<pair<size_t, size_t>, int64_t>>& cluster_pairs,
                                                            vector<pair<size_t, size_t>>* duplicate_pairs_out) const {
         
+        VG_PROFILE_STAGE(MAPQ);
 #ifdef debug_multipath_mapper
         cerr << "Sorting and computing mapping qualities for paired reads" << endl;
 #endif
@@ -20,6 +20,7 @@
 #include "edit.hpp"
 #include "snarls.hpp"
 #include "haplotypes.hpp"
+#include "sharded_cache.hpp"
 
 #include "algorithms/extract_containing_graph.hpp"
 #include "algorithms/extract_connecting_graph.hpp"
@@ -66,6 +67,13 @@ namespace vg {
                                   vector<pair<MultipathAlignment, MultipathAlignment>>& multipath_aln_pairs_out,
                                   vector<pair<Alignment, Alignment>>& ambiguous_pair_buffer,
                                   size_t max_alt_mappings);
+        
+        /// Estimate the fragment length distribution from a sample of read pairs ahead of mapping
+        /// them, by mapping each pair single ended, in parallel, and measuring the pairs that map
+        /// unambiguously. No alignments are kept, so the pairs still need to be mapped afterward.
+        /// Inside a parallel region, the pairs are run as tasks for the thread team. Returns true
+        /// if the distribution is now finalized.
+        bool estimate_fragment_length_distr(const vector<pair<Alignment, Alignment>>& read_pairs);
                                   
         /// Given a mapped MultipathAlignment, reduce it to up to
         /// max_alt_mappings + 1 nonoverlapping single path alignments, with
@@ -82,9 +90,22 @@ namespace vg {
         /// when mappings are likely to have occurred by chance
         void calibrate_mismapping_detection(size_t num_simulations = 1000, size_t simulated_read_length = 150);
         
+        /// Write the result of calibrate_mismapping_detection to a stream, along with the graph and settings
+        /// it was computed under, so later runs can skip the simulations
+        void save_mismapping_calibration(ostream& out, size_t num_simulations, size_t simulated_read_length) const;
+        
+        /// Read a calibration written by save_mismapping_calibration. If it was computed for a different graph,
+        /// scoring, minimum clustering length, or simulations than the ones given, returns false and changes
+        /// nothing. Call after the graph, scores, and clustering length are set.
+        bool load_mismapping_calibration(istream& in, size_t num_simulations, size_t simulated_read_length);
+        
         /// Should be called once after construction, or any time the band padding multiplier is changed
         void init_band_padding_memo();
         
+        /// Keep up to this many cyclic cluster and rescue graphs unrolled into DAGs, shared between
+        /// threads, so reads in the same tandem repeat don't unroll it again. 0 turns the cache off.
+        void set_dagify_cache_capacity(size_t capacity);
+        
         // parameters
         
         int64_t max_snarl_cut_size = 5;
@@ -118,6 +139,7 @@ namespace vg {
         int32_t secondary_rescue_subopt_diff = 10;
         size_t min_median_mem_coverage_for_split = 0;
         bool suppress_cluster_merging = false;
+        bool share_fragment_graphs = true;
         size_t alt_anchor_max_length_diff = 5;
         bool dynamic_max_alt_alns = false;
         bool simplify_topologies = false;
@@ -137,6 +159,29 @@ namespace vg {
         /// as a priority).
         using clustergraph_t = tuple<VG*, memcluster_t, size_t>;
         
+        /// A read part way through multipath_map(), so that the stages of
+        /// mapping can be run separately, on different threads. The cluster
+        /// graphs point into the MEMs, so the MEMs must not be modified once
+        /// they are clustered (moving the whole StagedRead is fine).
+        struct StagedRead {
+            Alignment alignment;
+            vector<MaximalExactMatch> mems;
+            vector<clustergraph_t> cluster_graphs;
+            vector<MultipathAlignment> multipath_alns;
+        };
+        
+        /// The first stage of multipath_map(): find the MEMs for the read.
+        void find_staged_mems(StagedRead& read);
+        
+        /// The second stage of multipath_map(): cluster the read's MEMs and
+        /// extract graphs around the clusters.
+        void cluster_staged_mems(StagedRead& read);
+        
+        /// The last stage of multipath_map(): align the read to its cluster
+        /// graphs and fill in its multipath alignments. Frees the cluster
+        /// graphs.
+        void align_staged_read(StagedRead& read, size_t max_alt_mappings);
+        
     protected:
         
         /// Wrapped internal function that allows some code paths to circumvent the current
@@ -146,6 +191,24 @@ namespace vg {
                                     vector<MultipathAlignment>& multipath_alns_out,
                                     size_t max_alt_mappings);
         
+        /// Find the MEMs to use for multipath mapping a read.
+        vector<MaximalExactMatch> find_multipath_mems(const Alignment& alignment);
+        
+        /// Cluster a read's MEMs and extract graphs around the clusters.
+        vector<clustergraph_t> cluster_and_extract(const Alignment& alignment,
+                                                   const vector<MaximalExactMatch>& mems);
+        
+        /// Align a read to its cluster graphs and post-process the multipath
+        /// alignments for output. Frees the cluster graphs.
+        void align_and_finish(const Alignment& alignment,
+                              MappingQualityMethod mapq_method,
+                              vector<clustergraph_t>& cluster_graphs,
+                              vector<MultipathAlignment>& multipath_alns_out,
+                              size_t max_alt_mappings);
+        
+        /// Describe the graph and settings that a mismapping calibration depends on, by name
+        map<string, string> mismapping_calibration_settings(size_t num_simulations, size_t simulated_read_length) const;
+        
         /// Before the fragment length distribution has been estimated, look for an unambiguous mapping of
         /// the reads using the single ended routine. If we find one record the fragment length and report
         /// the pair, if we don't find one, add the read pair to a buffer instead of the output vector.
@@ -228,10 +291,25 @@ namespace vg {
         /// are merged into one subgraph. Returns a vector of all the merged
         /// cluster subgraphs, their MEMs assigned from the mems vector
         /// according to the MEMs' hits, and their read coverages in bp. The
-        /// caller must delete the VG objects produced!
+        /// subgraphs come from source if it is given, which must then contain
+        /// everything they would reach in the xg index (such as a graph from
+        /// extract_fragment_graph()). The caller must delete the VG objects
+        /// produced!
         vector<clustergraph_t> query_cluster_graphs(const Alignment& alignment,
                                                     const vector<MaximalExactMatch>& mems,
-                                                    const vector<memcluster_t>& clusters);
+                                                    const vector<memcluster_t>& clusters,
+                                                    const HandleGraph* source = nullptr);
+        
+        /// Get the positions to extract a cluster's subgraph around, and how far to search from each in
+        /// each direction, and append them to the vectors.
+        void cluster_search_bounds(const Alignment& alignment, const memcluster_t& cluster,
+                                   vector<pos_t>& positions, vector<size_t>& forward_max_dist,
+                                   vector<size_t>& backward_max_dist) const;
+        
+        /// Extract the subgraph that query_cluster_graphs() would search for all the clusters of both
+        /// reads in a pair, in one search of the xg index. The caller must delete the VG produced!
+        VG* extract_fragment_graph(const Alignment& alignment1, const vector<memcluster_t>& clusters1,
+                                   const Alignment& alignment2, const vector<memcluster_t>& clusters2) const;
         
         /// If there are any MultipathAlignments with multiple connected components, split them
         /// up and add them to the return vector
@@ -336,6 +414,26 @@ namespace vg {
         /// Get a thread_local RRMemo with these parameters
         haploMath::RRMemo& get_rr_memo(double recombination_penalty, size_t population_size) const;;
         
+        /// A cyclic graph unrolled into the DAG we align to, with the translation of its nodes back
+        /// to the graph it was made from
+        struct DagifiedGraph {
+            Graph graph;
+            unordered_map<id_t, pair<id_t, bool>> node_trans;
+        };
+        
+        /// Get the key that identifies unrolling the given graph to the given length. The strand mode says
+        /// whether both strands were split out (0), or only the forward (1) or reverse (2) strand was used.
+        static string dagify_cache_key(const VG& graph, int strand_mode, size_t target_length);
+        
+        /// Look for an unrolled graph in the dagify cache. If it is there, replaces the alignment graph and
+        /// node translation with it and returns true.
+        bool retrieve_dagified(const string& key, VG& align_graph,
+                               unordered_map<id_t, pair<id_t, bool>>& node_trans) const;
+        
+        /// Record an unrolled graph in the dagify cache, if there is one.
+        void store_dagified(const string& key, const VG& align_graph,
+                            const unordered_map<id_t, pair<id_t, bool>>& node_trans) const;
+        
         /// Detects if each pair can be assigned to a consistent strand of a path, and if not removes them. Also
         /// inverts the distances in the cluster pairs vector according to the strand
         void establish_strand_consistency(vector<pair<MultipathAlignment, MultipathAlignment>>& multipath_aln_pairs,
@@ -354,6 +452,9 @@ namespace vg {
         
         // a memo for transcendental band padidng function (gets initialized at construction)
         vector<size_t> band_padding_memo;
+        
+        // unrolled cyclic graphs, shared between threads
+        unique_ptr<ShardedCache<string, shared_ptr<const DagifiedGraph>, std::hash<string>>> dagify_cache;
     };
         
 }
@@ -185,7 +185,7 @@ Support NestedTraversalFinder::min_support_in_path(const vector<Visit>& path) {
             Node* node = augmented.graph.get_node(v.node_id());
             
             // Return the support for it, or 0 if it's not in the map.
-            return augmented.node_supports.count(node) ? augmented.node_supports.at(node) : Support();
+            return augmented.get_support(node);
         } else {
             // It's a snarl visit. We assume it goes in one side and out the
             // other.
@@ -207,7 +207,7 @@ Support NestedTraversalFinder::min_support_in_path(const vector<Visit>& path) {
         // check the edge support
         Edge* edge = augmented.graph.get_edge(to_left_side(*cur), to_right_side(*next));
         assert(edge != NULL);
-        Support edge_support = augmented.edge_supports.count(edge) ? augmented.edge_supports.at(edge) : Support();
+        Support edge_support = augmented.get_support(edge);
         min_support = support_min(min_support, edge_support);
     }
 
@@ -281,7 +281,7 @@ set<pair<size_t, list<Visit>>> NestedTraversalFinder::search_left(const Visit& r
                 // Check the edge to it to make sure it has coverage
                 Edge* edge = augmented.graph.get_edge(to_right_side(extension), to_left_side(to_extend_from));
                 
-                if (!augmented.edge_supports.count(edge) || total(augmented.edge_supports.at(edge)) == 0) {
+                if (!augmented.has_support(edge) || total(augmented.get_support(edge)) == 0) {
                     // This edge is not supported, so don't explore this extension.
                     continue;
                 }
@@ -291,7 +291,7 @@ set<pair<size_t, list<Visit>>> NestedTraversalFinder::search_left(const Visit& r
                 // sure it has coverage.
                 Node* node = augmented.graph.get_node(to_right_side(extension).node);
                 
-                if (!augmented.node_supports.count(node) || total(augmented.node_supports.at(node)) == 0) {
+                if (!augmented.has_support(node) || total(augmented.get_support(node)) == 0) {
                     // This node is not supported, so don't explore this extension.
                     continue;
                 }
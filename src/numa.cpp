@@ -0,0 +1,140 @@
+#include "numa.hpp"
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <omp.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+namespace vg {
+
+using namespace std;
+
+// Memory policy modes from the kernel's uapi/linux/mempolicy.h, so we don't
+// need libnuma's headers
+static const int MEMORY_POLICY_DEFAULT = 0;
+static const int MEMORY_POLICY_INTERLEAVE = 3;
+
+/// Parse a kernel list of CPUs or nodes, like "0-3,8,10-11". Returns an empty
+/// list if the file can't be read.
+static vector<int> read_id_list(const string& file_name) {
+    vector<int> ids;
+    ifstream in(file_name);
+    string list;
+    if (!in || !getline(in, list)) {
+        return ids;
+    }
+    size_t start = 0;
+    while (start < list.size()) {
+        size_t end = list.find(',', start);
+        if (end == string::npos) {
+            end = list.size();
+        }
+        string range = list.substr(start, end - start);
+        size_t dash = range.find('-');
+        try {
+            int first = stoi(range.substr(0, dash));
+            int last = dash == string::npos ? first : stoi(range.substr(dash + 1));
+            for (int id = first; id <= last; id++) {
+                ids.push_back(id);
+            }
+        } catch (const exception& e) {
+            // Not a range we understand
+        }
+        start = end + 1;
+    }
+    return ids;
+}
+
+static vector<int> online_nodes() {
+    return read_id_list("/sys/devices/system/node/online");
+}
+
+size_t numa_node_count() {
+    return max<size_t>(online_nodes().size(), 1);
+}
+
+NUMAInterleaveScope::NUMAInterleaveScope() {
+    vector<int> nodes = online_nodes();
+    if (nodes.size() < 2) {
+        return;
+    }
+    const size_t bits_per_word = 8 * sizeof(unsigned long);
+    vector<unsigned long> mask(nodes.back() / bits_per_word + 1, 0);
+    for (int node : nodes) {
+        mask[node / bits_per_word] |= 1UL << (node % bits_per_word);
+    }
+    interleaving = syscall(SYS_set_mempolicy, MEMORY_POLICY_INTERLEAVE, mask.data(),
+                           mask.size() * bits_per_word + 1) == 0;
+}
+
+NUMAInterleaveScope::~NUMAInterleaveScope() {
+    if (interleaving) {
+        syscall(SYS_set_mempolicy, MEMORY_POLICY_DEFAULT, nullptr, 0);
+    }
+}
+
+bool NUMAInterleaveScope::active() const {
+    return interleaving;
+}
+
+size_t pin_omp_threads() {
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        return 0;
+    }
+
+    // Group the CPUs we may use by node, and then deal them out a node at a
+    // time so that consecutive threads land on different sockets
+    vector<vector<int>> node_cpus;
+    for (int node : online_nodes()) {
+        node_cpus.emplace_back();
+        for (int cpu : read_id_list("/sys/devices/system/node/node" + to_string(node) + "/cpulist")) {
+            if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed)) {
+                node_cpus.back().push_back(cpu);
+            }
+        }
+    }
+    vector<int> order;
+    for (size_t i = 0; ; i++) {
+        bool any = false;
+        for (auto& cpus : node_cpus) {
+            if (i < cpus.size()) {
+                order.push_back(cpus[i]);
+                any = true;
+            }
+        }
+        if (!any) {
+            break;
+        }
+    }
+    if (order.empty()) {
+        // No node information, so just use the CPUs in order
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &allowed)) {
+                order.push_back(cpu);
+            }
+        }
+    }
+    if (order.empty()) {
+        return 0;
+    }
+
+    size_t pinned = 0;
+#pragma omp parallel reduction(+:pinned)
+    {
+        cpu_set_t mine;
+        CPU_ZERO(&mine);
+        CPU_SET(order[omp_get_thread_num() % order.size()], &mine);
+        if (sched_setaffinity(0, sizeof(mine), &mine) == 0) {
+            pinned++;
+        }
+    }
+    return pinned;
+}
+
+}
@@ -0,0 +1,52 @@
+#ifndef VG_NUMA_HPP_INCLUDED
+#define VG_NUMA_HPP_INCLUDED
+
+/// \file numa.hpp
+/// Placement of shared indexes and worker threads on multi-socket machines.
+
+#include <cstddef>
+
+namespace vg {
+
+using namespace std;
+
+/// Get the number of NUMA nodes that are online, or 1 if that can't be told.
+size_t numa_node_count();
+
+/**
+ * While one of these is alive, memory that the thread that made it touches for
+ * the first time is spread page by page across all the NUMA nodes, instead of
+ * all landing on the node the thread runs on. Loading read-only indexes under
+ * one means threads on every socket see the same mix of local and remote
+ * accesses, rather than half of them going remote for everything.
+ *
+ * Only pages not yet in memory are placed; a file that is already in the page
+ * cache stays where it is. Does nothing on machines with a single node, or
+ * where the kernel doesn't support memory policies.
+ */
+class NUMAInterleaveScope {
+public:
+    NUMAInterleaveScope();
+    /// Go back to allocating on the local node.
+    ~NUMAInterleaveScope();
+
+    NUMAInterleaveScope(const NUMAInterleaveScope& other) = delete;
+    NUMAInterleaveScope& operator=(const NUMAInterleaveScope& other) = delete;
+
+    /// Return true if allocations are actually being interleaved.
+    bool active() const;
+
+private:
+    bool interleaving = false;
+};
+
+/// Pin each thread of an OpenMP team of the default size to its own CPU,
+/// dealing the threads out to the NUMA nodes in turn so each socket gets an
+/// equal share. The runtime keeps its threads between parallel regions, so the
+/// pinning holds for later regions of up to that size. Returns the number of
+/// threads pinned, which is 0 if the CPUs available couldn't be determined.
+size_t pin_omp_threads();
+
+}
+
+#endif
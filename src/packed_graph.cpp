@@ -0,0 +1,553 @@
+#include "packed_graph.hpp"
+#include "stream.hpp"
+#include "utility.hpp"
+
+#include <algorithm>
+#include <set>
+#include <stdexcept>
+#include <tuple>
+
+namespace vg {
+
+using namespace std;
+
+PackedGraph::PackedGraph() {
+    // Keep record 0 as the null record.
+    edge_records.push_back(EdgeRecord{as_handle((int64_t) 0), 0});
+}
+
+PackedGraph::PackedGraph(istream& in) : PackedGraph() {
+    // Edges and paths may come in chunks before the nodes they touch, so we
+    // hold them until we have all the nodes.
+    vector<tuple<id_t, bool, id_t, bool>> edges;
+
+    struct PendingStep {
+        int64_t rank;
+        id_t id;
+        bool is_reverse;
+        // How much of the node the mapping covers, or -1 if it isn't all
+        // matches from the start of the node.
+        int64_t length;
+    };
+    map<string, vector<PendingStep>> pending_paths;
+    set<string> circular;
+
+    function<void(Graph&)> lambda = [&](Graph& g) {
+        for (auto& node : g.node()) {
+            if (!has_node(node.id())) {
+                size_t start = sequence_data.size();
+                sequence_data.append(node.sequence());
+                add_node(node.id(), start, node.sequence().size());
+            }
+        }
+        for (auto& edge : g.edge()) {
+            edges.emplace_back(edge.from(), edge.from_start(), edge.to(), edge.to_end());
+        }
+        for (auto& path : g.path()) {
+            auto& steps = pending_paths[path.name()];
+            if (path.is_circular()) {
+                circular.insert(path.name());
+            }
+            for (auto& mapping : path.mapping()) {
+                int64_t length = mapping.position().offset() == 0 ? 0 : -1;
+                for (auto& edit : mapping.edit()) {
+                    if (length == -1 || edit.from_length() != edit.to_length() || !edit.sequence().empty()) {
+                        length = -1;
+                        break;
+                    }
+                    length += edit.from_length();
+                }
+                steps.push_back(PendingStep{mapping.rank(), mapping.position().node_id(),
+                                            mapping.position().is_reverse(), length});
+            }
+        }
+    };
+    stream::for_each(in, lambda);
+
+    for (auto& edge : edges) {
+        create_edge(get_handle(get<0>(edge), get<1>(edge)), get_handle(get<2>(edge), get<3>(edge)));
+    }
+    vector<tuple<id_t, bool, id_t, bool>>().swap(edges);
+
+    for (auto& named : pending_paths) {
+        auto& steps = named.second;
+        bool ranked = all_of(steps.begin(), steps.end(), [](const PendingStep& s) { return s.rank != 0; });
+        if (ranked) {
+            // Chunks can hold parts of a path in any order.
+            stable_sort(steps.begin(), steps.end(), [](const PendingStep& a, const PendingStep& b) {
+                    return a.rank < b.rank;
+                });
+        }
+        create_path(named.first, circular.count(named.first));
+        auto& path = paths[named.first].steps;
+        path.reserve(steps.size());
+        for (auto& step : steps) {
+            handle_t handle = get_handle(step.id, step.is_reverse);
+            // An empty edit list means a full-length match.
+            if (step.length > 0 && (size_t) step.length != get_length(handle)) {
+                step.length = -1;
+            }
+            if (step.length == -1) {
+                throw runtime_error("PackedGraph can only hold paths of whole nodes, but path " +
+                                    named.first + " visits only part of node " + to_string(step.id));
+            }
+            path.push_back(handle);
+        }
+        vector<PendingStep>().swap(steps);
+    }
+}
+
+handle_t PackedGraph::get_handle(const id_t& node_id, bool is_reverse) const {
+    auto found = id_to_rank.find(node_id);
+    if (found == id_to_rank.end()) {
+        throw runtime_error("No node " + to_string(node_id) + " in PackedGraph");
+    }
+    return handle_of(found->second, is_reverse);
+}
+
+id_t PackedGraph::get_id(const handle_t& handle) const {
+    return rank_to_id[rank_of(handle)];
+}
+
+bool PackedGraph::get_is_reverse(const handle_t& handle) const {
+    return as_integer(handle) & 1;
+}
+
+handle_t PackedGraph::flip(const handle_t& handle) const {
+    return as_handle(as_integer(handle) ^ 1);
+}
+
+size_t PackedGraph::get_length(const handle_t& handle) const {
+    return sequence_length[rank_of(handle)];
+}
+
+string PackedGraph::get_sequence(const handle_t& handle) const {
+    uint64_t rank = rank_of(handle);
+    string sequence = sequence_data.substr(sequence_start[rank], sequence_length[rank]);
+    return get_is_reverse(handle) ? reverse_complement(sequence) : sequence;
+}
+
+bool PackedGraph::follow_edges(const handle_t& handle, bool go_left, const function<bool(const handle_t&)>& iteratee) const {
+    // Going left from a handle is going right from its flip, and flipping
+    // what we find.
+    size_t side = right_side(go_left ? flip(handle) : handle);
+    for (uint64_t i = edge_lists[side]; i != 0; i = edge_records[i].next) {
+        const handle_t& target = edge_records[i].target;
+        if (!iteratee(go_left ? flip(target) : target)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void PackedGraph::for_each_handle(const function<bool(const handle_t&)>& iteratee, bool parallel) const {
+    if (parallel) {
+#pragma omp parallel for schedule(dynamic,1)
+        for (size_t i = 0; i < order.size(); ++i) {
+            // We can't stop early if we want to run this in parallel
+            iteratee(handle_of(order[i], false));
+        }
+    } else {
+        // Check the size each time, since the iteratee may swap or destroy
+        // handles.
+        for (size_t i = 0; i < order.size(); ++i) {
+            if (!iteratee(handle_of(order[i], false))) {
+                return;
+            }
+        }
+    }
+}
+
+size_t PackedGraph::node_size() const {
+    return order.size();
+}
+
+uint64_t PackedGraph::add_node(id_t id, uint64_t start, uint64_t length) {
+    uint64_t rank = rank_to_id.size();
+    rank_to_id.push_back(id);
+    sequence_start.push_back(start);
+    sequence_length.push_back(length);
+    edge_lists.push_back(0);
+    edge_lists.push_back(0);
+    rank_to_order.push_back(order.size());
+    order.push_back(rank);
+    id_to_rank[id] = rank;
+    max_id = max(max_id, id);
+    return rank;
+}
+
+handle_t PackedGraph::create_handle(const string& sequence) {
+    return create_handle(sequence, max_id + 1);
+}
+
+handle_t PackedGraph::create_handle(const string& sequence, const id_t& id) {
+    if (has_node(id)) {
+        throw runtime_error("Node " + to_string(id) + " already exists in PackedGraph");
+    }
+    uint64_t start = sequence_data.size();
+    sequence_data.append(sequence);
+    return handle_of(add_node(id, start, sequence.size()), false);
+}
+
+void PackedGraph::incident_edges(const handle_t& handle, vector<handle_t>& left, vector<handle_t>& right) const {
+    follow_edges(handle, true, [&](const handle_t& other) {
+        left.push_back(other);
+    });
+    follow_edges(handle, false, [&](const handle_t& other) {
+        right.push_back(other);
+    });
+}
+
+void PackedGraph::destroy_handle(const handle_t& handle) {
+    handle_t node = forward(handle);
+    vector<handle_t> left, right;
+    incident_edges(node, left, right);
+    // Self loops show up twice, but the second destroy is ignored.
+    for (auto& other : left) {
+        destroy_edge(other, node);
+    }
+    for (auto& other : right) {
+        destroy_edge(node, other);
+    }
+
+    uint64_t rank = rank_of(node);
+    for (auto& named : paths) {
+        auto& steps = named.second.steps;
+        steps.erase(remove_if(steps.begin(), steps.end(), [&](const handle_t& step) {
+                    return rank_of(step) == rank;
+                }), steps.end());
+    }
+
+    id_to_rank.erase(rank_to_id[rank]);
+    rank_to_id[rank] = 0;
+    sequence_length[rank] = 0;
+
+    // Fill the node's place in the order with the last node.
+    uint64_t moved = order.back();
+    order[rank_to_order[rank]] = moved;
+    rank_to_order[moved] = rank_to_order[rank];
+    order.pop_back();
+}
+
+void PackedGraph::link(size_t side, const handle_t& target) {
+    uint64_t record;
+    if (free_edge_records != 0) {
+        record = free_edge_records;
+        free_edge_records = edge_records[record].next;
+    } else {
+        record = edge_records.size();
+        edge_records.emplace_back();
+    }
+    edge_records[record].target = target;
+    edge_records[record].next = edge_lists[side];
+    edge_lists[side] = record;
+}
+
+bool PackedGraph::unlink(size_t side, const handle_t& target) {
+    uint64_t* incoming = &edge_lists[side];
+    while (*incoming != 0) {
+        uint64_t record = *incoming;
+        if (edge_records[record].target == target) {
+            *incoming = edge_records[record].next;
+            edge_records[record].next = free_edge_records;
+            free_edge_records = record;
+            return true;
+        }
+        incoming = &edge_records[record].next;
+    }
+    return false;
+}
+
+void PackedGraph::create_edge(const handle_t& left, const handle_t& right) {
+    bool exists = !follow_edges(left, false, [&](const handle_t& other) {
+        return other != right;
+    });
+    if (exists) {
+        return;
+    }
+    link(right_side(left), right);
+    if (right != flip(left)) {
+        // Unless the edge is its own reverse, it must be findable from the
+        // other end too.
+        link(right_side(flip(right)), flip(left));
+    }
+}
+
+void PackedGraph::destroy_edge(const handle_t& left, const handle_t& right) {
+    if (unlink(right_side(left), right) && right != flip(left)) {
+        unlink(right_side(flip(right)), flip(left));
+    }
+}
+
+void PackedGraph::clear() {
+    rank_to_id.clear();
+    sequence_start.clear();
+    sequence_length.clear();
+    sequence_data.clear();
+    edge_lists.clear();
+    edge_records.resize(1);
+    free_edge_records = 0;
+    order.clear();
+    rank_to_order.clear();
+    id_to_rank.clear();
+    max_id = 0;
+    // Handles in paths would point to nodes that don't exist.
+    paths.clear();
+}
+
+void PackedGraph::swap_handles(const handle_t& a, const handle_t& b) {
+    uint64_t rank_a = rank_of(a);
+    uint64_t rank_b = rank_of(b);
+    swap(order[rank_to_order[rank_a]], order[rank_to_order[rank_b]]);
+    swap(rank_to_order[rank_a], rank_to_order[rank_b]);
+}
+
+handle_t PackedGraph::apply_orientation(const handle_t& handle) {
+    if (!get_is_reverse(handle)) {
+        // Nothing to do!
+        return handle;
+    }
+
+    // Find all the edges, seen from the orientation that will be forward
+    vector<handle_t> left, right;
+    incident_edges(handle, left, right);
+    for (auto& other : left) {
+        destroy_edge(other, handle);
+    }
+    for (auto& other : right) {
+        destroy_edge(handle, other);
+    }
+
+    uint64_t rank = rank_of(handle);
+    auto begin = sequence_data.begin() + sequence_start[rank];
+    auto end = begin + sequence_length[rank];
+    reverse(begin, end);
+    for (auto it = begin; it != end; ++it) {
+        *it = reverse_complement(*it);
+    }
+
+    // Now the handle we were given is the node's forward orientation, so
+    // anything on this node flips.
+    handle_t new_handle = flip(handle);
+    auto reoriented = [&](const handle_t& other) {
+        return rank_of(other) == rank ? flip(other) : other;
+    };
+    for (auto& other : left) {
+        create_edge(reoriented(other), new_handle);
+    }
+    for (auto& other : right) {
+        create_edge(new_handle, reoriented(other));
+    }
+    return new_handle;
+}
+
+vector<handle_t> PackedGraph::divide_handle(const handle_t& handle, const vector<size_t>& offsets) {
+    handle_t node = forward(handle);
+    uint64_t rank = rank_of(node);
+    uint64_t length = sequence_length[rank];
+
+    // Work out the cut points along the forward strand
+    vector<uint64_t> cuts{0};
+    for (auto offset : offsets) {
+        cuts.push_back(get_is_reverse(handle) ? length - offset : offset);
+    }
+    cuts.push_back(length);
+    sort(cuts.begin(), cuts.end());
+
+    // The edges off the end of the node will move to the last part.
+    vector<handle_t> right;
+    follow_edges(node, false, [&](const handle_t& other) {
+        right.push_back(other);
+    });
+    for (auto& other : right) {
+        destroy_edge(node, other);
+    }
+
+    // The parts share the node's stored sequence, and the first part keeps
+    // the node's rank and ID.
+    vector<handle_t> parts{node};
+    uint64_t start = sequence_start[rank];
+    sequence_length[rank] = cuts[1];
+    for (size_t i = 1; i + 1 < cuts.size(); i++) {
+        parts.push_back(handle_of(add_node(max_id + 1, start + cuts[i], cuts[i + 1] - cuts[i]), false));
+        create_edge(parts[i - 1], parts[i]);
+    }
+
+    for (auto& other : right) {
+        if (other == node) {
+            // A loop from the end to the start
+            create_edge(parts.back(), parts.front());
+        } else if (other == flip(node)) {
+            // A loop from the end back into the end
+            create_edge(parts.back(), flip(parts.back()));
+        } else {
+            create_edge(parts.back(), other);
+        }
+    }
+
+    for (auto& named : paths) {
+        auto& steps = named.second.steps;
+        bool visits = any_of(steps.begin(), steps.end(), [&](const handle_t& step) {
+            return rank_of(step) == rank;
+        });
+        if (!visits) {
+            continue;
+        }
+        vector<handle_t> divided;
+        divided.reserve(steps.size() + parts.size() - 1);
+        for (auto& step : steps) {
+            if (rank_of(step) != rank) {
+                divided.push_back(step);
+            } else if (!get_is_reverse(step)) {
+                divided.insert(divided.end(), parts.begin(), parts.end());
+            } else {
+                for (auto it = parts.rbegin(); it != parts.rend(); ++it) {
+                    divided.push_back(flip(*it));
+                }
+            }
+        }
+        steps = std::move(divided);
+    }
+
+    if (get_is_reverse(handle)) {
+        // Give the parts back in the orientation we were asked about.
+        reverse(parts.begin(), parts.end());
+        for (auto& part : parts) {
+            part = flip(part);
+        }
+    }
+    return parts;
+}
+
+bool PackedGraph::has_node(id_t node_id) const {
+    return id_to_rank.count(node_id);
+}
+
+id_t PackedGraph::max_node_id() const {
+    return max_id;
+}
+
+size_t PackedGraph::edge_count() const {
+    size_t count = 0;
+    for (auto rank : order) {
+        for (auto is_reverse : {false, true}) {
+            handle_t left = handle_of(rank, is_reverse);
+            follow_edges(left, false, [&](const handle_t& right) {
+                // Every edge is stored from both ends, except for edges that
+                // are their own reverse.
+                count += (right == flip(left)) ? 2 : 1;
+            });
+        }
+    }
+    return count / 2;
+}
+
+void PackedGraph::create_path(const string& name, bool is_circular) {
+    auto& path = paths[name];
+    path.is_circular = path.is_circular || is_circular;
+}
+
+void PackedGraph::append_step(const string& name, const handle_t& handle) {
+    paths[name].steps.push_back(handle);
+}
+
+bool PackedGraph::has_path(const string& name) const {
+    return paths.count(name);
+}
+
+const vector<handle_t>& PackedGraph::get_path(const string& name) const {
+    return paths.at(name).steps;
+}
+
+void PackedGraph::for_each_path_name(const function<void(const string&)>& lambda) const {
+    for (auto& named : paths) {
+        lambda(named.first);
+    }
+}
+
+void PackedGraph::clear_paths() {
+    paths.clear();
+}
+
+void PackedGraph::serialize(ostream& out, size_t chunk_size) const {
+
+    function<Graph(size_t, size_t)> node_chunk = [&](size_t element_start, size_t element_length) -> Graph {
+        Graph g;
+        for (size_t i = element_start; i < element_start + element_length && i < order.size(); i++) {
+            uint64_t rank = order[i];
+            Node* node = g.add_node();
+            node->set_id(rank_to_id[rank]);
+            node->set_sequence(sequence_data.substr(sequence_start[rank], sequence_length[rank]));
+            for (auto is_reverse : {false, true}) {
+                handle_t left = handle_of(rank, is_reverse);
+                follow_edges(left, false, [&](const handle_t& right) {
+                    // Each edge is stored from both ends; only write it from
+                    // the end that matches its canonical orientation.
+                    if (edge_handle(left, right) != make_pair(left, right)) {
+                        return;
+                    }
+                    Edge* edge = g.add_edge();
+                    edge->set_from(get_id(left));
+                    edge->set_from_start(get_is_reverse(left));
+                    edge->set_to(get_id(right));
+                    edge->set_to_end(get_is_reverse(right));
+                });
+            }
+        }
+        return g;
+    };
+    stream::write(out, order.size(), chunk_size, node_chunk);
+
+    // Lay the paths out end to end, so they can be chunked like nodes.
+    vector<pair<const string*, const PackedPath*>> all_paths;
+    vector<size_t> path_ends;
+    size_t total_steps = 0;
+    Graph empty_paths;
+    for (auto& named : paths) {
+        if (named.second.steps.empty()) {
+            Path* path = empty_paths.add_path();
+            path->set_name(named.first);
+            path->set_is_circular(named.second.is_circular);
+        } else {
+            all_paths.emplace_back(&named.first, &named.second);
+            total_steps += named.second.steps.size();
+            path_ends.push_back(total_steps);
+        }
+    }
+    if (empty_paths.path_size() > 0) {
+        function<Graph(size_t)> empty_chunk = [&](size_t) { return empty_paths; };
+        stream::write(out, 1, empty_chunk);
+    }
+
+    function<Graph(size_t, size_t)> path_chunk = [&](size_t element_start, size_t element_length) -> Graph {
+        Graph g;
+        size_t path_number = upper_bound(path_ends.begin(), path_ends.end(), element_start) - path_ends.begin();
+        Path* path = nullptr;
+        for (size_t i = element_start; i < element_start + element_length && i < total_steps; i++) {
+            while (i >= path_ends[path_number]) {
+                path_number++;
+                path = nullptr;
+            }
+            if (path == nullptr) {
+                path = g.add_path();
+                path->set_name(*all_paths[path_number].first);
+                path->set_is_circular(all_paths[path_number].second->is_circular);
+            }
+            size_t index = i - (path_number == 0 ? 0 : path_ends[path_number - 1]);
+            const handle_t& step = all_paths[path_number].second->steps[index];
+            Mapping* mapping = path->add_mapping();
+            mapping->mutable_position()->set_node_id(get_id(step));
+            mapping->mutable_position()->set_is_reverse(get_is_reverse(step));
+            Edit* edit = mapping->add_edit();
+            edit->set_from_length(get_length(step));
+            edit->set_to_length(get_length(step));
+            mapping->set_rank(index + 1);
+        }
+        return g;
+    };
+    stream::write(out, total_steps, chunk_size, path_chunk);
+
+    stream::finish(out);
+}
+
+}
@@ -0,0 +1,253 @@
+#ifndef VG_PACKED_GRAPH_HPP_INCLUDED
+#define VG_PACKED_GRAPH_HPP_INCLUDED
+
+/** \file
+ * A compact, mutable graph that supports only the handle graph interface, for
+ * working on graphs too big to hold as Protobuf objects.
+ */
+
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "handle.hpp"
+#include "hash_map.hpp"
+#include "vg.pb.h"
+
+namespace vg {
+
+using namespace std;
+
+/**
+ * A MutableHandleGraph that keeps its nodes in dense vectors indexed by node
+ * rank rather than in Protobuf objects and hash tables of pointers:
+ *
+ * - All node sequences live back to back in one string.
+ * - Edges are singly linked lists of target handles, threaded through one
+ *   shared vector, with the head of the list for each side of each node in a
+ *   vector indexed by rank.
+ * - Paths are vectors of handles, so they can only visit whole nodes.
+ *
+ * Handles are node ranks with the orientation in the low bit, so they stay
+ * valid until their node is destroyed. Space from destroyed nodes and changed
+ * sequences is not reclaimed until the graph is cleared.
+ */
+class PackedGraph : public MutableHandleGraph {
+
+public:
+
+    /// Make an empty graph.
+    PackedGraph();
+
+    /// Load a graph from a stream of Protobuf Graph chunks, as written by VG.
+    /// Throws if the stream has paths that don't visit whole nodes.
+    PackedGraph(istream& in);
+
+    ////////////////////////////////////////////////////////////////////////////
+    // Handle-based interface
+    ////////////////////////////////////////////////////////////////////////////
+
+    /// Look up the handle for the node with the given ID in the given orientation
+    virtual handle_t get_handle(const id_t& node_id, bool is_reverse = false) const;
+
+    // Copy over the visit version which would otherwise be shadowed.
+    using HandleGraph::get_handle;
+
+    /// Get the ID from a handle
+    virtual id_t get_id(const handle_t& handle) const;
+
+    /// Get the orientation of a handle
+    virtual bool get_is_reverse(const handle_t& handle) const;
+
+    /// Invert the orientation of a handle (potentially without getting its ID)
+    virtual handle_t flip(const handle_t& handle) const;
+
+    /// Get the length of a node
+    virtual size_t get_length(const handle_t& handle) const;
+
+    /// Get the sequence of a node, presented in the handle's local forward
+    /// orientation.
+    virtual string get_sequence(const handle_t& handle) const;
+
+    /// Loop over all the handles to next/previous (right/left) nodes. Passes
+    /// them to a callback which returns false to stop iterating and true to
+    /// continue. Returns true if we finished and false if we stopped early.
+    virtual bool follow_edges(const handle_t& handle, bool go_left, const function<bool(const handle_t&)>& iteratee) const;
+
+    // Copy over the template for nice calls
+    using HandleGraph::follow_edges;
+
+    /// Loop over all the nodes in the graph in their local forward
+    /// orientations, in their internal stored order. Stop if the iteratee returns false.
+    virtual void for_each_handle(const function<bool(const handle_t&)>& iteratee, bool parallel = false) const;
+
+    // Copy over the template for nice calls
+    using HandleGraph::for_each_handle;
+
+    /// Return the number of nodes in the graph
+    virtual size_t node_size() const;
+
+    ////////////////////////////////////////////////////////////////////////////
+    // Mutable handle-based interface
+    ////////////////////////////////////////////////////////////////////////////
+
+    /// Create a new node with the given sequence and return the handle.
+    virtual handle_t create_handle(const string& sequence);
+
+    /// Create a new node with the given id and sequence, then return the handle.
+    virtual handle_t create_handle(const string& sequence, const id_t& id);
+
+    /// Remove the node belonging to the given handle and all of its edges.
+    /// Steps on the node are dropped from stored paths, since they would
+    /// otherwise be left pointing at nothing.
+    virtual void destroy_handle(const handle_t& handle);
+
+    /// Create an edge connecting the given handles in the given order and orientations.
+    /// Ignores existing edges.
+    virtual void create_edge(const handle_t& left, const handle_t& right);
+
+    // Copy over the edge_t version
+    using MutableHandleGraph::create_edge;
+
+    /// Remove the edge connecting the given handles in the given order and orientations.
+    /// Ignores nonexistent edges.
+    /// Does not update any stored paths.
+    virtual void destroy_edge(const handle_t& left, const handle_t& right);
+
+    // Copy over the edge_t version
+    using MutableHandleGraph::destroy_edge;
+
+    /// Remove all nodes, edges, and paths.
+    virtual void clear();
+
+    /// Swap the nodes corresponding to the given handles, in the ordering used
+    /// by for_each_handle when looping over the graph.
+    virtual void swap_handles(const handle_t& a, const handle_t& b);
+
+    /// Alter the node that the given handle corresponds to so the orientation
+    /// indicated by the handle becomes the node's local forward orientation.
+    /// The node keeps its ID. Does not update any stored paths.
+    virtual handle_t apply_orientation(const handle_t& handle);
+
+    /// Split a handle's underlying node at the given offsets in the handle's
+    /// orientation. The first part keeps the node's ID, and the others get new
+    /// IDs. Updates stored paths.
+    virtual vector<handle_t> divide_handle(const handle_t& handle, const vector<size_t>& offsets);
+
+    // Copy over the single offset version
+    using MutableHandleGraph::divide_handle;
+
+    ////////////////////////////////////////////////////////////////////////////
+    // Other graph operations
+    ////////////////////////////////////////////////////////////////////////////
+
+    /// Return true if a node with the given ID exists.
+    bool has_node(id_t node_id) const;
+
+    /// Get the largest ID given to any node so far, or 0 if there never were
+    /// any nodes.
+    id_t max_node_id() const;
+
+    /// Count the edges in the graph.
+    size_t edge_count() const;
+
+    /// Create an empty path, or do nothing if the path exists.
+    void create_path(const string& name, bool is_circular = false);
+
+    /// Add a visit to the end of a path, creating the path if needed.
+    void append_step(const string& name, const handle_t& handle);
+
+    /// Return true if the path exists.
+    bool has_path(const string& name) const;
+
+    /// Get the visits along a path, which must exist.
+    const vector<handle_t>& get_path(const string& name) const;
+
+    /// Call the lambda with the name of every path, in name order.
+    void for_each_path_name(const function<void(const string&)>& lambda) const;
+
+    /// Remove all the paths.
+    void clear_paths();
+
+    /// Write the graph out as a stream of Protobuf Graph chunks that VG can
+    /// read. Nodes go in chunks of about chunk_size, in for_each_handle()
+    /// order, followed by the paths. Finishes the stream.
+    void serialize(ostream& out, size_t chunk_size = 1000) const;
+
+private:
+
+    /// Add a node with the given ID, whose sequence is already stored at the
+    /// given place in sequence_data, and return its rank.
+    uint64_t add_node(id_t id, uint64_t start, uint64_t length);
+
+    /// Get the rank of the node a handle is on.
+    inline uint64_t rank_of(const handle_t& handle) const {
+        return as_integer(handle) >> 1;
+    }
+
+    /// Make a handle to the node at the given rank.
+    inline handle_t handle_of(uint64_t rank, bool is_reverse) const {
+        return as_handle((int64_t) ((rank << 1) | (is_reverse ? 1 : 0)));
+    }
+
+    /// Get the index in edge_lists of the list of edges leaving the right
+    /// side of the given handle.
+    inline size_t right_side(const handle_t& handle) const {
+        return (rank_of(handle) << 1) | (get_is_reverse(handle) ? 0 : 1);
+    }
+
+    /// Add a target to the list for a side of a node.
+    void link(size_t side, const handle_t& target);
+
+    /// Remove a target from the list for a side of a node. Returns false if it
+    /// wasn't there.
+    bool unlink(size_t side, const handle_t& target);
+
+    /// Get all the edges touching a node, as left and right handles in the
+    /// node's forward orientation.
+    void incident_edges(const handle_t& handle, vector<handle_t>& left, vector<handle_t>& right) const;
+
+    /// A list element holding an edge target, and the index of the next
+    /// element in the list, or 0 at the end of the list.
+    struct EdgeRecord {
+        handle_t target;
+        uint64_t next;
+    };
+
+    /// The IDs of the nodes by rank, or 0 for destroyed nodes.
+    vector<id_t> rank_to_id;
+    /// Where each node's sequence starts in sequence_data, by rank.
+    vector<uint64_t> sequence_start;
+    /// How long each node's sequence is, by rank.
+    vector<uint64_t> sequence_length;
+    /// All the node sequences, concatenated.
+    string sequence_data;
+
+    /// The first edge record for each side of each node, indexed by rank * 2
+    /// for node starts and by rank * 2 + 1 for node ends.
+    vector<uint64_t> edge_lists;
+    /// All the edge records. The first one is a placeholder, so 0 can mean no
+    /// record.
+    vector<EdgeRecord> edge_records;
+    /// Records freed by destroying edges, linked through their next fields.
+    uint64_t free_edge_records = 0;
+
+    /// The ranks of the live nodes, in for_each_handle() order.
+    vector<uint64_t> order;
+    /// Where each rank is in order.
+    vector<uint64_t> rank_to_order;
+    /// Translate node IDs to ranks.
+    hash_map<id_t, uint64_t> id_to_rank;
+    id_t max_id = 0;
+
+    struct PackedPath {
+        vector<handle_t> steps;
+        bool is_circular = false;
+    };
+    map<string, PackedPath> paths;
+};
+
+}
+
+#endif
@@ -1,12 +1,18 @@
 #include "packer.hpp"
+#include "mapped_file.hpp"
+
+#include <sys/mman.h>
 
 namespace vg {
 
 Packer::Packer(void) : xgidx(nullptr) { }
 
 Packer::Packer(xg::XG* xidx, size_t binsz) : xgidx(xidx), bin_size(binsz) {
-    coverage_dynamic = gcsa::CounterArray(xgidx->seq_length, 8);
+    coverage_dynamic = vector<atomic<uint32_t>>(xgidx->seq_length);
     if (binsz) n_bins = xgidx->seq_length / bin_size + 1;
+    // open the bins now, so that add() never has to
+    ensure_edit_tmpfiles_open();
+    edit_buffers.resize(get_thread_count());
 }
 
 Packer::~Packer(void) {
@@ -15,7 +21,19 @@ Packer::~Packer(void) {
 }
 
 void Packer::load_from_file(const string& file_name) {
-    ifstream in(file_name);
+    unique_ptr<MappedFile> mapped;
+    try {
+        mapped = unique_ptr<MappedFile>(new MappedFile(file_name));
+    } catch (runtime_error& e) {
+        // fall back on reading it as a stream (e.g. for a pipe)
+        ifstream in(file_name);
+        load(in);
+        return;
+    }
+    // read the pack straight out of the page cache
+    mapped->advise(MADV_SEQUENTIAL);
+    MappedFileStreamBuffer buffer(*mapped);
+    istream in(&buffer);
     load(in);
 }
 
@@ -28,12 +46,15 @@ void Packer::load(istream& in) {
     sdsl::read_member(bin_size, in);
     sdsl::read_member(n_bins, in);
     coverage_civ.load(in);
-    edit_csas.resize(n_bins);
-    for (size_t i = 0; i < n_bins; ++i) {
-        edit_csas[i].load(in);
-    }
+    edit_positions.load(in);
+    edit_position_starts.load(in);
+    edit_ids.load(in);
+    edit_dictionary.load(in);
+    edit_dictionary_starts.load(in);
+    init_edit_support();
     // We can only load compacted.
     is_compacted = true;
+    index_coverage(coverage_sample_rate);
 }
 
 void Packer::merge_from_files(const vector<string>& file_names) {
@@ -41,24 +62,35 @@ void Packer::merge_from_files(const vector<string>& file_names) {
     cerr << "Merging " << file_names.size() << " pack files" << endl;
 #endif
     
-    // load into our dynamic structures, then compact
-    bool first = true;
-    for (auto& file_name : file_names) {
-        Packer c;
-        ifstream f(file_name);
-        c.load(f);
-        // take bin size and counts from the first, assume they are all the same
-        if (first) {
-            bin_size = c.get_bin_size();
-            n_bins = c.get_n_bins();
-            ensure_edit_tmpfiles_open();
-            first = false;
-        } else {
-            assert(bin_size == c.get_bin_size());
-            assert(n_bins == c.get_n_bins());
+    // load into our dynamic structures, then compact; we load a thread's worth
+    // of packs at once, and fold each one in using all the threads
+    size_t batch_size = get_thread_count();
+    for (size_t batch = 0; batch < file_names.size(); batch += batch_size) {
+        size_t batch_end = min(batch + batch_size, file_names.size());
+        vector<unique_ptr<Packer>> loaded(batch_end - batch);
+#pragma omp parallel for schedule(dynamic, 1)
+        for (size_t i = batch; i < batch_end; ++i) {
+            loaded[i - batch] = unique_ptr<Packer>(new Packer());
+            // we only scan the coverage once, so don't sample it
+            loaded[i - batch]->index_coverage(0);
+            loaded[i - batch]->load_from_file(file_names[i]);
+        }
+        for (size_t i = 0; i < loaded.size(); ++i) {
+            auto& c = loaded[i];
+            // take bin size and counts from the first, assume they are all the same
+            if (batch == 0 && i == 0) {
+                bin_size = c->get_bin_size();
+                n_bins = c->get_n_bins();
+                ensure_edit_tmpfiles_open();
+            } else {
+                assert(bin_size == c->get_bin_size());
+                assert(n_bins == c->get_n_bins());
+            }
+            c->write_edits(tmpfstreams);
+            collect_coverage(*c);
+            // free each pack as soon as it is folded in
+            c.reset();
         }
-        c.write_edits(tmpfstreams);
-        collect_coverage(c);
     }
 }
 
@@ -100,6 +132,8 @@ size_t Packer::bin_for_position(size_t i) const {
 }
 
 void Packer::write_edits(vector<ofstream*>& out) const {
+    // each bin has its own stream, so the bins can be written at once
+#pragma omp parallel for schedule(dynamic, 1)
     for (size_t i = 0; i < n_bins; ++i) {
         write_edits(*out[i], i);
     }
@@ -107,21 +141,52 @@ void Packer::write_edits(vector<ofstream*>& out) const {
 
 void Packer::write_edits(ostream& out, size_t bin) const {
     if (is_compacted) {
-        out << extract(edit_csas[bin], 0, edit_csas[bin].size()-2) << delim1; // chomp trailing null, add back delim        
+        // stream out the records for this bin's range, already in order and
+        // still serialized, straight from the dictionary
+        size_t start = bin_size ? bin * bin_size : 0;
+        size_t end = bin_size ? start + bin_size : graph_length();
+        for (auto& record : edit_records_in_range(start, end)) {
+            write_edit_record(out, record.first, record.second);
+        }
     } else {
         // uncompacted, so just cat the edit file for this bin onto out
         if (edit_tmpfile_names.size()) {
             ifstream edits(edit_tmpfile_names[bin], std::ios_base::binary);
-            out << edits.rdbuf() << delim1;
+            if (edits.peek() != EOF) {
+                // copying nothing would set failbit on out
+                out << edits.rdbuf();
+            }
         }
     }
 }
 
+void Packer::write_edit_record(ostream& out, size_t pos, const string& edit_repr) const {
+    uint32_t length = edit_repr.size();
+    out.write((const char*) &pos, sizeof(pos));
+    out.write((const char*) &length, sizeof(length));
+    out.write(edit_repr.data(), length);
+}
+
+vector<pair<size_t, string>> Packer::read_edit_records(const string& file_name) const {
+    vector<pair<size_t, string>> records;
+    ifstream in(file_name, std::ios_base::binary);
+    size_t pos;
+    uint32_t length;
+    while (in.read((char*) &pos, sizeof(pos)) && in.read((char*) &length, sizeof(length))) {
+        string edit_repr(length, '\0');
+        in.read(&edit_repr[0], length);
+        records.emplace_back(pos, std::move(edit_repr));
+    }
+    return records;
+}
+
 void Packer::collect_coverage(const Packer& c) {
     // assume the same basis vector
     assert(!is_compacted);
+    // every position is its own counter, so split the basis between the threads
+#pragma omp parallel for
     for (size_t i = 0; i < c.graph_length(); ++i) {
-        coverage_dynamic.increment(i, c.coverage_at_position(i));
+        coverage_dynamic[i] += c.coverage_at_position(i);
     }
 }
 
@@ -132,11 +197,13 @@ size_t Packer::serialize(std::ostream& out,
     sdsl::structure_tree_node* child = sdsl::structure_tree::add_child(s, name, sdsl::util::class_name(*this));
     size_t written = 0;
     written += sdsl::write_member(bin_size, out, child, "bin_size_" + name);
-    written += sdsl::write_member(edit_csas.size(), out, child, "n_bins_" + name);
+    written += sdsl::write_member(n_bins, out, child, "n_bins_" + name);
     written += coverage_civ.serialize(out, child, "graph_coverage_" + name);
-    for (auto& edit_csa : edit_csas) {
-        written += edit_csa.serialize(out, child, "edit_csa_" + name);
-    }
+    written += edit_positions.serialize(out, child, "edit_positions_" + name);
+    written += edit_position_starts.serialize(out, child, "edit_position_starts_" + name);
+    written += edit_ids.serialize(out, child, "edit_ids_" + name);
+    written += edit_dictionary.serialize(out, child, "edit_dictionary_" + name);
+    written += edit_dictionary_starts.serialize(out, child, "edit_dictionary_starts_" + name);
     sdsl::structure_tree::add_size(child, written);
     return written;
 }
@@ -159,19 +226,75 @@ void Packer::make_compact(void) {
     size_t basis_length = coverage_dynamic.size();
     int_vector<> coverage_iv;
     util::assign(coverage_iv, int_vector<>(basis_length));
+    // full width entries, so the threads never share a word
+#pragma omp parallel for
     for (size_t i = 0; i < coverage_dynamic.size(); ++i) {
         coverage_iv[i] = coverage_dynamic[i];
     }
-    edit_csas.resize(edit_tmpfile_names.size());
+    vector<atomic<uint32_t>>().swap(coverage_dynamic);
     util::assign(coverage_civ, coverage_iv);
-    construct_config::byte_algo_sa = SE_SAIS;
+    // read and sort the edits in each bin; the bins cover increasing ranges
+    // of positions, so the sorted bins concatenate into sorted order
+    vector<vector<pair<size_t, string>>> bin_edits(edit_tmpfile_names.size());
 #pragma omp parallel for
     for (size_t i = 0; i < edit_tmpfile_names.size(); ++i) {
-        construct(edit_csas[i], edit_tmpfile_names[i], 1);
+        bin_edits[i] = read_edit_records(edit_tmpfile_names[i]);
+        std::sort(bin_edits[i].begin(), bin_edits[i].end());
     }
-    // construct the record marker bitvector
     remove_edit_tmpfiles();
+    // number the distinct edits and lay out the positions
+    size_t total_edits = 0;
+    for (auto& edits : bin_edits) total_edits += edits.size();
+    unordered_map<string, size_t> dictionary_ids;
+    vector<size_t> dictionary_starts(1, 0);
+    vector<size_t> distinct_positions;
+    vector<size_t> position_starts;
+    util::assign(edit_ids, int_vector<>(total_edits));
+    size_t k = 0;
+    for (auto& edits : bin_edits) {
+        for (auto& pos_edit : edits) {
+            if (distinct_positions.empty() || distinct_positions.back() != pos_edit.first) {
+                distinct_positions.push_back(pos_edit.first);
+                position_starts.push_back(k);
+            }
+            auto found = dictionary_ids.find(pos_edit.second);
+            if (found == dictionary_ids.end()) {
+                found = dictionary_ids.emplace(pos_edit.second, dictionary_ids.size()).first;
+                dictionary_starts.push_back(dictionary_starts.back() + pos_edit.second.size());
+            }
+            edit_ids[k++] = found->second;
+        }
+        // free each bin as we go
+        vector<pair<size_t, string>>().swap(edits);
+    }
+    position_starts.push_back(k);
+    util::assign(edit_dictionary, int_vector<8>(dictionary_starts.back()));
+    for (auto& edit_and_id : dictionary_ids) {
+        size_t start = dictionary_starts[edit_and_id.second];
+        for (size_t j = 0; j < edit_and_id.first.size(); ++j) {
+            edit_dictionary[start + j] = (uint8_t) edit_and_id.first[j];
+        }
+    }
+    util::assign(edit_dictionary_starts, int_vector<>(dictionary_starts.size()));
+    for (size_t j = 0; j < dictionary_starts.size(); ++j) {
+        edit_dictionary_starts[j] = dictionary_starts[j];
+    }
+    util::assign(edit_position_starts, int_vector<>(position_starts.size()));
+    for (size_t j = 0; j < position_starts.size(); ++j) {
+        edit_position_starts[j] = position_starts[j];
+    }
+    util::bit_compress(edit_ids);
+    util::bit_compress(edit_dictionary_starts);
+    util::bit_compress(edit_position_starts);
+    util::assign(edit_positions, sd_vector<>(distinct_positions.begin(), distinct_positions.end()));
+    init_edit_support();
     is_compacted = true;
+    index_coverage(coverage_sample_rate);
+}
+
+void Packer::init_edit_support(void) {
+    util::init_support(edit_positions_rank, &edit_positions);
+    util::init_support(edit_positions_select, &edit_positions);
 }
 
 void Packer::make_dynamic(void) {
@@ -186,7 +309,10 @@ bool Packer::is_dynamic(void) {
 }
 
 void Packer::ensure_edit_tmpfiles_open(void) {
-    if (tmpfstreams.empty()) {
+    if (tmpfstreams.size() != n_bins) {
+        // we may have opened them for a different number of bins
+        close_edit_tmpfiles();
+        remove_edit_tmpfiles();
         string base = "vg-pack_";
         string edit_tmpfile_name = temp_file::create(base);
         temp_file::remove(edit_tmpfile_name); // remove this; we'll use it as a base name
@@ -199,13 +325,16 @@ void Packer::ensure_edit_tmpfiles_open(void) {
             tmpfstreams[i]->open(edit_tmpfile_names[i], std::ios_base::binary);
             assert(tmpfstreams[i]->is_open());
         }
+        tmpfstream_locks = vector<mutex>(n_bins);
     }
 }
 
 void Packer::close_edit_tmpfiles(void) {
     if (!tmpfstreams.empty()) {
+        for (size_t i = 0; i < edit_buffers.size(); ++i) {
+            flush_edit_buffer(i);
+        }
         for (auto& tmpfstream : tmpfstreams) {
-            *tmpfstream << delim1; // pad
             tmpfstream->close();
             delete tmpfstream;
         }
@@ -222,9 +351,41 @@ void Packer::remove_edit_tmpfiles(void) {
     }
 }
 
+void Packer::buffer_edit(size_t pos, const string& edit_repr) {
+    size_t thread = omp_get_thread_num();
+    if (thread >= edit_buffers.size()) {
+        // more threads than we planned for, so write straight to the bin
+        size_t bin = bin_for_position(pos);
+        lock_guard<mutex> guard(tmpfstream_locks[bin]);
+        write_edit_record(*tmpfstreams[bin], pos, edit_repr);
+        return;
+    }
+    auto& buffer = edit_buffers[thread];
+    buffer.emplace_back(pos, edit_repr);
+    if (buffer.size() >= edit_buffer_size) {
+        flush_edit_buffer(thread);
+    }
+}
+
+void Packer::flush_edit_buffer(size_t thread) {
+    auto& buffer = edit_buffers[thread];
+    // group the edits by bin so we take each bin's lock once
+    std::sort(buffer.begin(), buffer.end());
+    auto run_start = buffer.begin();
+    while (run_start != buffer.end()) {
+        size_t bin = bin_for_position(run_start->first);
+        auto run_end = run_start;
+        lock_guard<mutex> guard(tmpfstream_locks[bin]);
+        while (run_end != buffer.end() && bin_for_position(run_end->first) == bin) {
+            write_edit_record(*tmpfstreams[bin], run_end->first, run_end->second);
+            ++run_end;
+        }
+        run_start = run_end;
+    }
+    buffer.clear();
+}
+
 void Packer::add(const Alignment& aln, bool record_edits) {
-    // open tmpfile if needed
-    ensure_edit_tmpfiles_open();
     // count the nodes, edges, and edits
     for (auto& mapping : aln.path().mapping()) {
         if (!mapping.has_position()) {
@@ -245,19 +406,16 @@ void Packer::add(const Alignment& aln, bool record_edits) {
 #endif
                 if (mapping.position().is_reverse()) {
                     for (size_t j = 0; j < edit.from_length(); ++j) {
-                        coverage_dynamic.increment(i-j);
+                        coverage_dynamic[i-j].fetch_add(1, memory_order_relaxed);
                     }
                 } else {
                     for (size_t j = 0; j < edit.from_length(); ++j) {
-                        coverage_dynamic.increment(i+j);
+                        coverage_dynamic[i+j].fetch_add(1, memory_order_relaxed);
                     }
                 }
             } else if (record_edits) {
                 // we represent things on the forward strand
-                string pos_repr = pos_key(i);
-                string edit_repr = edit_value(edit, mapping.position().is_reverse());
-                size_t bin = bin_for_position(i);
-                *tmpfstreams[bin] << pos_repr << edit_repr;
+                buffer_edit(i, edit_value(edit, mapping.position().is_reverse()));
             }
             if (mapping.position().is_reverse()) {
                 i -= edit.from_length();
@@ -279,17 +437,6 @@ size_t Packer::position_in_basis(const Position& pos) const {
     }
 }
 
-string Packer::pos_key(size_t i) const {
-    Position pos;
-    size_t offset = 2;
-    pos.set_node_id(i+offset);
-    string pos_repr;
-    pos.SerializeToString(&pos_repr);
-    stringstream s;
-    s << delim1 << delim2 << delim1 << escape_delims(pos_repr);
-    return s.str();
-}
-
 string Packer::edit_value(const Edit& edit, bool revcomp) const {
     string edit_repr;
     if (revcomp) {
@@ -297,42 +444,17 @@ string Packer::edit_value(const Edit& edit, bool revcomp) const {
     } else {
         edit.SerializeToString(&edit_repr);
     }
-    stringstream s;
-    s << delim1 << escape_delims(edit_repr);
-    return s.str();
-}
-
-string Packer::escape_delims(const string& s) const {
-    return escape_delim(escape_delim(s, delim1), delim2);
-}
-
-string Packer::unescape_delims(const string& s) const {
-    return unescape_delim(unescape_delim(s, delim1), delim2);
-}
-
-string Packer::escape_delim(const string& s, char d) const {
-    string escaped; escaped.reserve(s.size());
-    for (size_t i = 0; i < s.size(); ++i) {
-        char c = s[i];
-        escaped.push_back(c);
-        if (c == d) escaped.push_back(c);
-    }
-    return escaped;
+    return edit_repr;
 }
 
-string Packer::unescape_delim(const string& s, char d) const {
-    string unescaped; unescaped.reserve(s.size());
-    for (size_t i = 0; i < s.size()-1; ++i) {
-        char c = s[i];
-        char b = s[i+1];
-        if (c == d && b == d) {
-            unescaped.push_back(c);
-        } else {
-            unescaped.push_back(c);
-            if (i == s.size()-2) unescaped.push_back(b);
-        }
+string Packer::dictionary_edit(size_t edit_id) const {
+    size_t start = edit_dictionary_starts[edit_id];
+    size_t end = edit_dictionary_starts[edit_id + 1];
+    string edit_repr(end - start, '\0');
+    for (size_t j = start; j < end; ++j) {
+        edit_repr[j - start] = (char) edit_dictionary[j];
     }
-    return unescaped;
+    return edit_repr;
 }
 
 size_t Packer::graph_length(void) const {
@@ -351,38 +473,97 @@ size_t Packer::coverage_at_position(size_t i) const {
     }
 }
 
+void Packer::index_coverage(size_t sample_rate) {
+    coverage_sample_rate = sample_rate;
+    util::clear(coverage_samples);
+    if (!sample_rate || !is_compacted) {
+        // nothing to sample yet, or no samples wanted
+        return;
+    }
+    util::assign(coverage_samples, int_vector<>(coverage_civ.size() / sample_rate + 1));
+    size_t total = 0;
+    for (size_t i = 0; i < coverage_civ.size(); ++i) {
+        if (i % sample_rate == 0) coverage_samples[i / sample_rate] = total;
+        total += coverage_civ[i];
+    }
+    if (coverage_civ.size() % sample_rate == 0) {
+        coverage_samples[coverage_civ.size() / sample_rate] = total;
+    }
+    util::bit_compress(coverage_samples);
+}
+
+size_t Packer::coverage_prefix(size_t i) const {
+    // start from the last sample at or before i
+    size_t sample = i / coverage_sample_rate;
+    size_t total = coverage_samples[sample];
+    for (size_t j = sample * coverage_sample_rate; j < i; ++j) {
+        total += coverage_civ[j];
+    }
+    return total;
+}
+
+size_t Packer::coverage_in_range(size_t start, size_t end) const {
+    end = min(end, graph_length());
+    if (start >= end) return 0;
+    if (is_compacted && !coverage_samples.empty()) {
+        return coverage_prefix(end) - coverage_prefix(start);
+    }
+    size_t total = 0;
+    for (size_t i = start; i < end; ++i) {
+        total += coverage_at_position(i);
+    }
+    return total;
+}
+
+double Packer::average_node_coverage(id_t node_id) const {
+    size_t start = xgidx->node_start(node_id);
+    size_t length = xgidx->node_length(node_id);
+    return length ? (double) coverage_in_range(start, start + length) / length : 0;
+}
+
+vector<double> Packer::average_node_coverages(void) const {
+    vector<double> averages(xgidx->max_node_rank());
+#pragma omp parallel for
+    for (size_t i = 0; i < averages.size(); ++i) {
+        averages[i] = average_node_coverage(xgidx->rank_to_id(i + 1));
+    }
+    return averages;
+}
+
 vector<Edit> Packer::edits_at_position(size_t i) const {
     vector<Edit> edits;
-    if (i == 0) return edits;
-    string key = pos_key(i);
-    size_t bin = bin_for_position(i);
-    auto& edit_csa = edit_csas[bin];
-    auto occs = locate(edit_csa, key);
-    for (size_t i = 0; i < occs.size(); ++i) {
-        // walk from after the key and delim1 to the next end-sep
-        size_t b = occs[i] + key.size() + 1;
-        size_t e = b;
-        // look for an odd number of delims
-        // run until we find a delim
-        while (true) {
-            while (extract(edit_csa, e, e)[0] != delim1) ++e;
-            // now we are matching the delim... count them
-            size_t f = e;
-            while (extract(edit_csa, f, f)[0] == delim1) ++f;
-            size_t c = f - e;
-            e = f; // set pointer to last delim
-            if (c % 2 != 0) {
-                break;
-            }
-        }
-        string value = unescape_delims(extract(edit_csa, b, e));
-        Edit edit;
-        edit.ParseFromString(value);
-        edits.push_back(edit);
+    for (auto& pos_edit : edits_in_range(i, i + 1)) {
+        edits.push_back(pos_edit.second);
+    }
+    return edits;
+}
+
+vector<pair<size_t, Edit>> Packer::edits_in_range(size_t start, size_t end) const {
+    vector<pair<size_t, Edit>> edits;
+    for (auto& record : edit_records_in_range(start, end)) {
+        edits.emplace_back(record.first, Edit());
+        edits.back().second.ParseFromString(record.second);
     }
     return edits;
 }
 
+vector<pair<size_t, string>> Packer::edit_records_in_range(size_t start, size_t end) const {
+    vector<pair<size_t, string>> records;
+    if (!is_compacted || edit_ids.empty()) return records;
+    // the positions past the last edit aren't in the bit vector
+    start = min(start, (size_t) edit_positions.size());
+    end = min(end, (size_t) edit_positions.size());
+    if (start >= end) return records;
+    // ranks of the first marked positions at or after start and end
+    for (size_t r = edit_positions_rank(start); r < edit_positions_rank(end); ++r) {
+        size_t pos = edit_positions_select(r + 1);
+        for (size_t k = edit_position_starts[r]; k < edit_position_starts[r + 1]; ++k) {
+            records.emplace_back(pos, dictionary_edit(edit_ids[k]));
+        }
+    }
+    return records;
+}
+
 ostream& Packer::as_table(ostream& out, bool show_edits) {
 #ifdef debug
     cerr << "Packer table of " << coverage_civ.size() << " rows:" << endl;
@@ -400,8 +581,9 @@ ostream& Packer::as_table(ostream& out, bool show_edits) {
         size_t offset = i - xgidx->node_start(node_id);
         out << i << "\t" << node_id << "\t" << offset << "\t" << coverage_civ[i];
         if (show_edits) {
-            out << "\t" << count(edit_csas[bin_for_position(i)], pos_key(i));
-            for (auto& edit : edits_at_position(i)) out << " " << pb2json(edit);
+            auto edits = edits_at_position(i);
+            out << "\t" << edits.size();
+            for (auto& edit : edits) out << " " << pb2json(edit);
         }
         out << endl;
     }
@@ -410,11 +592,8 @@ ostream& Packer::as_table(ostream& out, bool show_edits) {
 
 ostream& Packer::show_structure(ostream& out) {
     out << coverage_civ << endl; // graph coverage (compacted coverage_dynamic)
-    for (auto& edit_csa : edit_csas) {
-        out << edit_csa << endl;
-    }
-    //out << " i SA ISA PSI LF BWT    T[SA[i]..SA[i]-1]" << endl;
-    //csXprintf(cout, "%2I %2S %3s %3P %2p %3B   %:3T", edit_csa);
+    out << edit_position_starts << endl; // where each edited position's edits start
+    out << edit_ids << endl; // dictionary number of each edit
     return out;
 }
 
@@ -3,6 +3,8 @@
 
 #include <iostream>
 #include <map>
+#include <atomic>
+#include <mutex>
 #include <chrono>
 #include <ctime>
 #include "omp.h"
@@ -12,7 +14,6 @@
 #include "position.hpp"
 #include "json2pb.h"
 #include "graph.hpp"
-#include "gcsa/internal.h"
 #include "xg_position.hpp"
 #include "utility.hpp"
 
@@ -36,13 +37,25 @@ public:
                      std::string name = "");
     void make_compact(void);
     void make_dynamic(void);
+    // safe to call from many threads at once
     void add(const Alignment& aln, bool record_edits = true);
     size_t graph_length(void) const;
     size_t position_in_basis(const Position& pos) const;
-    string pos_key(size_t i) const;
     string edit_value(const Edit& edit, bool revcomp) const;
     vector<Edit> edits_at_position(size_t i) const;
+    // all the edits at positions in [start, end), in position order
+    vector<pair<size_t, Edit>> edits_in_range(size_t start, size_t end) const;
     size_t coverage_at_position(size_t i) const;
+    // total coverage over the positions in [start, end); once compacted this
+    // only scans from the nearest coverage sample
+    size_t coverage_in_range(size_t start, size_t end) const;
+    // mean coverage over the bases of the node
+    double average_node_coverage(id_t node_id) const;
+    // mean coverage of every node in the basis graph, indexed by node rank - 1
+    vector<double> average_node_coverages(void) const;
+    // sample the coverage prefix sums every sample_rate positions, or drop the samples for 0;
+    // make_compact and load sample at the last rate set here (64 by default)
+    void index_coverage(size_t sample_rate);
     void collect_coverage(const Packer& c);
     ostream& as_table(ostream& out, bool show_edits = true);
     ostream& show_structure(ostream& out); // debugging
@@ -54,13 +67,31 @@ public:
     size_t coverage_size(void);
 private:
     void ensure_edit_tmpfiles_open(void);
+    // add an edit to this thread's buffer, flushing it to the bins if it is full
+    void buffer_edit(size_t pos, const string& edit_repr);
+    // write out one thread's buffered edits
+    void flush_edit_buffer(size_t thread);
     void close_edit_tmpfiles(void);
     void remove_edit_tmpfiles(void);
+    // write one edit record to a temp file or merge stream
+    void write_edit_record(ostream& out, size_t pos, const string& edit_repr) const;
+    // read all the edit records written to a temp file
+    vector<pair<size_t, string>> read_edit_records(const string& file_name) const;
+    // all the edits at positions in [start, end), still serialized, in position order
+    vector<pair<size_t, string>> edit_records_in_range(size_t start, size_t end) const;
+    // get the serialized edit with the given number in the dictionary
+    string dictionary_edit(size_t edit_id) const;
+    // point the rank and select supports at the edit positions after loading or building them
+    void init_edit_support(void);
     bool is_compacted = false;
     // dynamic model
-    gcsa::CounterArray coverage_dynamic;
+    vector<atomic<uint32_t>> coverage_dynamic;
     vector<string> edit_tmpfile_names;
     vector<ofstream*> tmpfstreams;
+    vector<mutex> tmpfstream_locks; // one per bin
+    // each thread's edits waiting to be written, as a position and an edit
+    vector<vector<pair<size_t, string>>> edit_buffers;
+    size_t edit_buffer_size = 1024;
     // which bin should we use
     size_t bin_for_position(size_t i) const;
     size_t n_bins = 1;
@@ -68,17 +99,20 @@ private:
     size_t edit_length = 0;
     size_t edit_count = 0;
     dac_vector<> coverage_civ; // graph coverage (compacted coverage_dynamic)
-    //
-    vector<csa_sada<enc_vector<>, 32, 32, sa_order_sa_sampling<>, isa_sampling<>, succinct_byte_alphabet<> > > edit_csas;
-    // make separators that are somewhat unusual, as we escape these
-    char delim1 = '\xff';
-    char delim2 = '\xfe';
-    // double the delimiter in the string
-    string escape_delim(const string& s, char d) const;
-    string escape_delims(const string& s) const;
-    // take each double delimiter back to a single
-    string unescape_delim(const string& s, char d) const;
-    string unescape_delims(const string& s) const;
+    // coverage summed over [0, k * coverage_sample_rate) for each k, not serialized
+    size_t coverage_sample_rate = 64;
+    int_vector<> coverage_samples;
+    // total coverage over [0, i)
+    size_t coverage_prefix(size_t i) const;
+    // compacted edits, sorted by position
+    sd_vector<> edit_positions; // marks each position with at least one edit
+    sd_vector<>::rank_1_type edit_positions_rank;
+    sd_vector<>::select_1_type edit_positions_select;
+    int_vector<> edit_position_starts; // where each marked position's edits start in edit_ids
+    int_vector<> edit_ids; // the number of each edit in the dictionary
+    // each distinct edit, as a serialized Edit, concatenated
+    int_vector<8> edit_dictionary;
+    int_vector<> edit_dictionary_starts; // where each edit starts, plus the end
 };
 
 // for making a combined matrix output and maybe doing other fun operations
@@ -55,6 +55,18 @@ Paths::Paths(void) {
     // noop
 }
 
+void Paths::swap(Paths& other) {
+    std::swap(_paths, other._paths);
+    std::swap(max_path_id, other.max_path_id);
+    std::swap(name_to_id, other.name_to_id);
+    std::swap(id_to_name, other.id_to_name);
+    std::swap(mapping_itr, other.mapping_itr);
+    std::swap(mappings_by_rank, other.mappings_by_rank);
+    std::swap(node_mapping, other.node_mapping);
+    std::swap(head_tail_nodes, other.head_tail_nodes);
+    std::swap(circular, other.circular);
+}
+
 void Paths::load(istream& in) {
     function<void(Path&)> lambda = [this](Path& p) {
         this->extend(p);
@@ -162,9 +174,9 @@ void Paths::extend(const Path& p, bool warn_on_duplicates) {
     if (p.is_circular()) {
         make_circular(name);
     }
-    // re-sort?
-    sort_by_mapping_rank();
-    rebuild_mapping_aux();
+    // re-sort? Only this path can have changed.
+    sort_by_mapping_rank(name);
+    rebuild_mapping_aux(name);
 }
 
 // one of these should go away
@@ -181,8 +193,10 @@ void Paths::extend(const Paths& p, bool warn_on_duplicates) {
             make_circular(name);
         }
     }
-    sort_by_mapping_rank();
-    rebuild_mapping_aux();
+    for (auto& l : p._paths) {
+        sort_by_mapping_rank(l.first);
+        rebuild_mapping_aux(l.first);
+    }
 }
 
 void Paths::append(const Paths& paths, bool warn_on_duplicates) {
@@ -198,8 +212,10 @@ void Paths::append(const Paths& paths, bool warn_on_duplicates) {
             make_circular(name);
         }
     }
-    sort_by_mapping_rank();
-    rebuild_mapping_aux();
+    for (auto& p : paths._paths) {
+        sort_by_mapping_rank(p.first);
+        rebuild_mapping_aux(p.first);
+    }
 }
 
 void Paths::append(const Graph& g, bool warn_on_duplicates) {
@@ -435,7 +451,14 @@ void Paths::increment_node_ids(id_t inc) {
             m.set_node_id(m.node_id()+inc);
         }
     }
-    rebuild_node_mapping();
+    // The mappings themselves haven't moved, so we only need to move each
+    // node's entry in the index to its new ID.
+    hot_hash_map<id_t, map<int64_t, set<mapping_t*>>> rekeyed;
+    rekeyed.reserve(node_mapping.size());
+    for (auto& entry : node_mapping) {
+        rekeyed[entry.first + inc] = std::move(entry.second);
+    }
+    node_mapping = std::move(rekeyed);
 }
 
 void Paths::swap_node_ids(hash_map<id_t, id_t>& id_mapping) {
@@ -451,7 +474,22 @@ void Paths::swap_node_ids(hash_map<id_t, id_t>& id_mapping) {
             }
         }
     }
-    rebuild_node_mapping();
+    // Move each node's entry in the index to its new ID, merging it with
+    // whatever is already there.
+    hot_hash_map<id_t, map<int64_t, set<mapping_t*>>> rekeyed;
+    rekeyed.reserve(node_mapping.size());
+    for (auto& entry : node_mapping) {
+        auto replacement = id_mapping.find(entry.first);
+        auto& dest = rekeyed[replacement != id_mapping.end() ? replacement->second : entry.first];
+        if (dest.empty()) {
+            dest = std::move(entry.second);
+        } else {
+            for (auto& path_mappings : entry.second) {
+                dest[path_mappings.first].insert(path_mappings.second.begin(), path_mappings.second.end());
+            }
+        }
+    }
+    node_mapping = std::move(rekeyed);
 }
 
 void Paths::reassign_node(id_t new_id, mapping_t* m) {
@@ -478,13 +516,20 @@ void Paths::rebuild_node_mapping(void) {
 // attempt to sort the paths based on the recorded ranks of the mappings
 void Paths::sort_by_mapping_rank(void) {
     for (auto p = _paths.begin(); p != _paths.end(); ++p) {
-        list<mapping_t>& path = p->second;
-        path.sort([](const mapping_t& m1, const mapping_t& m2) {
-                return m1.rank < m2.rank;
-            });
+        sort_by_mapping_rank(p->first);
     }
 }
 
+void Paths::sort_by_mapping_rank(const string& name) {
+    auto found = _paths.find(name);
+    if (found == _paths.end()) {
+        return;
+    }
+    found->second.sort([](const mapping_t& m1, const mapping_t& m2) {
+            return m1.rank < m2.rank;
+        });
+}
+
 // compact the ranks preserving the relative rank order
 void Paths::compact_ranks(void) {
     // first ensure the storage order of the mappings is correct
@@ -500,35 +545,45 @@ void Paths::rebuild_mapping_aux(void) {
     mapping_itr.clear();
     mappings_by_rank.clear();
     for (auto& p : _paths) {
-        const string& path_name = p.first;
-        list<mapping_t>& path = p.second;
-        size_t order_in_path = 0;
-        for (list<mapping_t>::iterator i = path.begin(); i != path.end(); ++i) {
-            auto& mitr = mapping_itr[&*i];
-            mitr.first = i;
-            mitr.second = get_path_id(path_name);
-            
-            if(i->rank > order_in_path + 1) {
-                // Make sure that if we have to assign a rank to a node after
-                // this one, it is greater than this node's rank. TODO: should
-                // we just uniformly re-rank all the nodes starting at 0? Or
-                // will we ever want to cut and paste things back together using
-                // the old preserved ranks?
-                order_in_path = i->rank - 1;
-            }
-            
-            if (i->rank == 0 || i->rank < order_in_path + 1) {
-                // If we don't already have a rank, or if we see a rank that
-                // can't be correct given the ranks we have already seen, we set
-                // the rank based on what we've built
-                i->rank = order_in_path+1;
-            }
-            
-            // Save the mapping as being at the given rank in its path.
-            mappings_by_rank[path_name][i->rank] = &*i;
-            
-            ++order_in_path;
+        rebuild_mapping_aux(p.first);
+    }
+}
+
+void Paths::rebuild_mapping_aux(const string& name) {
+    auto found = _paths.find(name);
+    if (found == _paths.end()) {
+        return;
+    }
+    const string& path_name = found->first;
+    list<mapping_t>& path = found->second;
+    int64_t path_id = get_path_id(path_name);
+    mappings_by_rank.erase(path_name);
+    size_t order_in_path = 0;
+    for (list<mapping_t>::iterator i = path.begin(); i != path.end(); ++i) {
+        auto& mitr = mapping_itr[&*i];
+        mitr.first = i;
+        mitr.second = path_id;
+        
+        if(i->rank > order_in_path + 1) {
+            // Make sure that if we have to assign a rank to a node after
+            // this one, it is greater than this node's rank. TODO: should
+            // we just uniformly re-rank all the nodes starting at 0? Or
+            // will we ever want to cut and paste things back together using
+            // the old preserved ranks?
+            order_in_path = i->rank - 1;
         }
+        
+        if (i->rank == 0 || i->rank < order_in_path + 1) {
+            // If we don't already have a rank, or if we see a rank that
+            // can't be correct given the ranks we have already seen, we set
+            // the rank based on what we've built
+            i->rank = order_in_path+1;
+        }
+        
+        // Save the mapping as being at the given rank in its path.
+        mappings_by_rank[path_name][i->rank] = &*i;
+        
+        ++order_in_path;
     }
 }
 
@@ -624,21 +679,27 @@ list<mapping_t>& Paths::get_path(const string& name) {
 
 void Paths::remove_paths(const set<string>& names) {
     for (auto& name : names) {
-        _paths.erase(name);
+        if (has_path(name)) {
+            remove_path(name);
+        }
     }
-    rebuild_node_mapping();
-    rebuild_mapping_aux();
 }
 
 void Paths::remove_path(const string& name) {
     auto& path = _paths[name];
+    int64_t path_id = get_path_id(name);
     
     for(auto& mapping : path) {
         // Unindex all the mappings
         mapping_itr.erase(&mapping);
-        if(node_mapping.count(mapping.node_id())) {
+        auto found = node_mapping.find(mapping.node_id());
+        if(found != node_mapping.end()) {
             // Throw out all the mappings for this path on this node
-            node_mapping[mapping.node_id()].erase(get_path_id(name));
+            found->second.erase(path_id);
+            if (found->second.empty()) {
+                // Don't leave the node looking like it has mappings
+                node_mapping.erase(found);
+            }
         }
     }
 
@@ -689,9 +750,14 @@ map<int64_t, set<mapping_t*>>& Paths::get_node_mapping(Node* n) {
 }
 
 map<string, set<mapping_t*>> Paths::get_node_mapping_by_path_name(id_t id) {
-    auto& nm = node_mapping[id];
     map<string, set<mapping_t*>> mm;
-    for (auto& p : nm) {
+    // Don't add an empty entry for an unmapped node, so this can be used from
+    // many threads at once.
+    auto found = node_mapping.find(id);
+    if (found == node_mapping.end()) {
+        return mm;
+    }
+    for (auto& p : found->second) {
         mm[get_path_name(p.first)] = p.second;
     }
     return mm;
@@ -703,7 +769,13 @@ map<string, set<mapping_t*>> Paths::get_node_mapping_by_path_name(Node* n) {
 
 map<string, map<int, mapping_t*>> Paths::get_node_mappings_by_rank(id_t id) {
     map<string, map<int, mapping_t*>> by_ranks;
-    for (auto& p : get_node_mapping(id)) {
+    // Don't add an empty entry for an unmapped node, as for
+    // get_node_mapping_by_path_name().
+    auto found = node_mapping.find(id);
+    if (found == node_mapping.end()) {
+        return by_ranks;
+    }
+    for (auto& p : found->second) {
         auto& name = get_path_name(p.first);
         auto& mp = p.second;
         for (auto* m : mp) by_ranks[name][m->rank] = m;
@@ -713,7 +785,11 @@ map<string, map<int, mapping_t*>> Paths::get_node_mappings_by_rank(id_t id) {
 
 map<string, map<int, mapping_t>> Paths::get_node_mapping_copies_by_rank(id_t id) {
     map<string, map<int, mapping_t>> by_ranks;
-    for (auto& p : get_node_mapping(id)) {
+    auto found = node_mapping.find(id);
+    if (found == node_mapping.end()) {
+        return by_ranks;
+    }
+    for (auto& p : found->second) {
         auto& name = get_path_name(p.first);
         auto& mp = p.second;
         for (auto* m : mp) by_ranks[name][m->rank] = *m;
@@ -1688,7 +1764,7 @@ void reverse_complement_path_in_place(Path* path,
         m1->set_rank(m2->rank());
         m2->set_rank(rank_tmp);
         
-        std::swap(*m1, *m2);
+        path->mutable_mapping()->SwapElements(i, j);
     }
     
     if (path->mapping_size() % 2) {
@@ -2025,6 +2101,62 @@ pair<Path, Path> cut_path(const Path& path, size_t offset) {
     return make_pair(p1, p2);
 }
 
+// cut_path() makes fresh paths, so the pieces have nothing but mappings
+static void clear_all_but_mappings(Path* path) {
+    path->clear_name();
+    path->clear_is_circular();
+    path->clear_length();
+}
+
+void keep_path_before(Path* path, size_t offset) {
+    if (!path->mapping_size()) {
+        return;
+    }
+    size_t seen = 0;
+    size_t i = 0;
+    for ( ; i < path->mapping_size() && seen < offset; ++i) {
+        size_t length = mapping_to_length(path->mapping(i));
+        if (seen + length > offset) {
+            auto mappings = cut_mapping(path->mapping(i), offset - seen);
+            path->mutable_mapping(i)->Swap(&mappings.first);
+            ++i;
+            break;
+        }
+        seen += length;
+    }
+    // RemoveLast() keeps the cleared mappings around to be reused
+    while (path->mapping_size() > i) {
+        path->mutable_mapping()->RemoveLast();
+    }
+    clear_all_but_mappings(path);
+}
+
+void keep_path_after(Path* path, size_t offset) {
+    if (!path->mapping_size()) {
+        return;
+    }
+    size_t seen = 0;
+    size_t i = 0;
+    for ( ; i < path->mapping_size() && seen < offset; ++i) {
+        size_t length = mapping_to_length(path->mapping(i));
+        if (seen + length > offset) {
+            auto mappings = cut_mapping(path->mapping(i), offset - seen);
+            path->mutable_mapping(i)->Swap(&mappings.second);
+            break;
+        }
+        seen += length;
+    }
+    // shift the kept mappings down by swapping pointers, then drop the rest
+    auto* mappings = path->mutable_mapping();
+    for (size_t j = i; j < mappings->size(); ++j) {
+        mappings->SwapElements(j - i, j);
+    }
+    for (size_t j = 0; j < i; ++j) {
+        mappings->RemoveLast();
+    }
+    clear_all_but_mappings(path);
+}
+
 bool maps_to_node(const Path& p, id_t id) {
     for (size_t i = 0; i < p.mapping_size(); ++i) {
         if (p.mapping(i).position().node_id() == id) return true;
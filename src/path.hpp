@@ -48,15 +48,17 @@ public:
     // copy
     Paths(const Paths& other) {
         if (this != &other) {
+            max_path_id = 0;
             _paths = other._paths;
+            circular = other.circular;
             rebuild_node_mapping();
+            rebuild_mapping_aux();
         }
     }
     // move constructor
-    Paths(Paths&& other) noexcept {
-        _paths = other._paths;
-        other.clear();
-        rebuild_node_mapping();
+    // The list nodes don't move, so the indexes stay valid and come along too.
+    Paths(Paths&& other) noexcept : max_path_id(0) {
+        swap(other);
     }
 
     // copy assignment operator
@@ -68,10 +70,13 @@ public:
 
     // move assignment operator
     Paths& operator=(Paths&& other) noexcept {
-        std::swap(_paths, other._paths);
-        rebuild_node_mapping();
+        swap(other);
         return *this;
     }
+    
+    /// Exchange paths and indexes with another Paths, without rebuilding
+    /// anything.
+    void swap(Paths& other);
 
     // This maps from path name to the list of Mappings for that path.
     map<string, list<mapping_t> > _paths;
@@ -88,15 +93,21 @@ public:
     // This maps from mapping_t* pointer to the name of the path it belongs to
     // (which can then be used to get the list its iterator belongs to).
     void sort_by_mapping_rank(void);
+    /// Sort just the named path by its recorded ranks. Since std::list sorts by
+    /// relinking, the index entries for its mappings stay valid.
+    void sort_by_mapping_rank(const string& name);
     /// Reassign ranks and rebuild indexes, treating the mapping lists in _paths as the truth.
     void rebuild_mapping_aux(void);
+    /// Reassign ranks and rebuild the iterator and rank indexes for just the
+    /// named path, leaving the other paths alone.
+    void rebuild_mapping_aux(const string& name);
     // We need this in order to make sure we aren't adding duplicate mappings
     // with the same rank in the same path. Maps from path name and rank to
     // Mapping pointer.
     map<string, hash_map<size_t, mapping_t*>> mappings_by_rank;
     // This maps from node ID, then path name, then rank and orientation, to
     // Mapping pointers for the mappings on that path to that node.
-    hash_map<id_t, map<int64_t, set<mapping_t*>>> node_mapping;
+    hot_hash_map<id_t, map<int64_t, set<mapping_t*>>> node_mapping;
     // record which head nodes we have
     // we'll use this when determining path edge crossings--- all paths implicitly cross these nodes
     set<id_t> head_tail_nodes;
@@ -125,7 +136,7 @@ public:
     pair<mapping_t*, mapping_t*> divide_mapping(mapping_t* m, size_t offset);
     // replace the mapping with two others in the order provided
     pair<mapping_t*, mapping_t*> replace_mapping(mapping_t* m, pair<mapping_t, mapping_t> n);
-    // Note that this clears and rebuilds all the indexes
+    // Unthreads each named path from the indexes, leaving the rest alone.
     void remove_paths(const set<string>& names);
     // This one actually unthreads the path from the indexes. It's O(path
     // length), but you can do several calls without thrashing the index
@@ -294,6 +305,10 @@ pair<mapping_t, mapping_t> cut_mapping(const mapping_t& m, size_t offset);
 pair<Path, Path> cut_path(const Path& path, const Position& pos);
 // divide the path at a path-relative offset as measured in to_length from start
 pair<Path, Path> cut_path(const Path& path, size_t offset);
+// keep only the first piece cut_path(path, offset) would make, reusing the path's storage
+void keep_path_before(Path* path, size_t offset);
+// keep only the second piece cut_path(path, offset) would make, reusing the path's storage
+void keep_path_after(Path* path, size_t offset);
 bool maps_to_node(const Path& p, id_t id);
 // the position that starts just after the path ends
 Position path_start(const Path& path);
@@ -1,5 +1,8 @@
 #include "path_index.hpp"
 
+#include <algorithm>
+#include <tuple>
+
 namespace vg {
 
 PathIndex::PathIndex(const Path& path) {
@@ -266,12 +269,100 @@ PathIndex::PathIndex(const xg::XG& index, const string& path_name, bool extract_
     // Make sure the path is present
     assert(index.path_rank(path_name) != 0);
     
+    // Walk the XGPath's own arrays instead of extracting the path as Mappings
+    // first. Building the path is most of the cost on a chromosome.
+    const xg::XGPath& xgpath = index.get_path(path_name);
+    size_t total_nodes = xgpath.ids.size();
+    
+    // We're going to build the sequence string, if we want it
+    std::stringstream seq_stream;
+    
+    // What base are we at in the path?
+    size_t path_base = 0;
+    
+    // The first visit to each node, as node ID, visit number, start base, and
+    // orientation, so we can fill in by_id and node_occurrences in ID order at
+    // the end instead of searching the maps for every visit.
+    vector<tuple<int64_t, size_t, size_t, bool>> visits;
+    visits.reserve(total_nodes);
+    
+    // The by_start entry for each visit, in path order
+    vector<iterator> occurrences;
+    occurrences.reserve(total_nodes);
+    
+    for (size_t i = 0; i < total_nodes; i++) {
+        int64_t node_id = xgpath.node(i);
+        bool is_reverse = xgpath.is_reverse(i);
+        
+        // Say that this node appears here along the reference in this
+        // orientation. Starts only go up, so we can always add at the end.
+        occurrences.push_back(by_start.emplace_hint(by_start.end(), path_base, NodeSide(node_id, is_reverse)));
+        visits.emplace_back(node_id, i, path_base, is_reverse);
+        
+        if (extract_sequence) {
+            // Find the node's sequence
+            std::string node_sequence = index.node_sequence(node_id);
+            
+            while(path_base == 0 && node_sequence.size() > 0 &&
+                (node_sequence[0] != 'A' && node_sequence[0] != 'T' && node_sequence[0] != 'C' &&
+                node_sequence[0] != 'G' && node_sequence[0] != 'N')) {
+                
+                // If the path leads with invalid characters (like "X"), throw them
+                // out when computing path positions.
+                
+                // TODO: this is a hack to deal with the debruijn-brca1-k63 graph,
+                // which leads with an X.
+                #pragma omp critical (cerr)
+                std::cerr << "Warning: dropping invalid leading character "
+                    << node_sequence[0] << " from node " << node_id
+                    << std::endl;
+                    
+                node_sequence.erase(node_sequence.begin());
+            }
+            
+            if (is_reverse) {
+                // Put the reverse sequence in the path
+                seq_stream << reverse_complement(node_sequence);
+            } else {
+                // Put the forward sequence in the path
+                seq_stream << node_sequence;
+            }
+            
+            path_base += node_sequence.size();
+        } else {
+            // The XGPath already knows where the next visit starts
+            path_base += (i + 1 < total_nodes ? xgpath.positions[i + 1] : xgpath.offsets.size()) - xgpath.positions[i];
+        }
+    }
+    
+    // Record the length of the last mapping's node, since there's no next mapping to work it out from
+    last_node_length = total_nodes > 0 ? index.node_length(xgpath.node(total_nodes - 1)) : 0;
+    
     if (extract_sequence) {
-        // Constructor dispatch hack
-        *this = PathIndex(index.path(path_name), index);
-    } else {
-        *this = PathIndex(index.path(path_name));
+        // Create the actual reference sequence we will use
+        sequence = seq_stream.str();
+    }
+    
+    // Group the visits by node, keeping them in path order within each node,
+    // and fill in the per-node indexes in ID order so every insert is at the end.
+    std::sort(visits.begin(), visits.end());
+    for (size_t i = 0; i < visits.size(); i++) {
+        int64_t node_id = get<0>(visits[i]);
+        if (i == 0 || get<0>(visits[i - 1]) != node_id) {
+            // This is the first time we visited this node in the path.
+            by_id.emplace_hint(by_id.end(), node_id, std::make_pair(get<2>(visits[i]), get<3>(visits[i])));
+            node_occurrences.emplace_hint(node_occurrences.end(), node_id, vector<iterator>());
+        }
+        
+        // Remember that occurrence by node ID.
+        node_occurrences.rbegin()->second.push_back(occurrences[get<1>(visits[i])]);
     }
+
+#ifdef debug
+    // Announce progress.
+    #pragma omp critical (cerr)
+    std::cerr << "Traced " << path_base << " bp path of " << total_nodes << " visits." << std::endl;
+#endif
 }
 
 void PathIndex::update_mapping_positions(VG& vg, const string& path_name) {
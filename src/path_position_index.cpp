@@ -0,0 +1,168 @@
+#include "path_position_index.hpp"
+
+#include <algorithm>
+
+/**
+ * \file path_position_index.cpp: implementation of the node-to-path-position index
+ */
+
+namespace vg {
+
+using namespace std;
+
+const uint32_t PathPositionIndex::MULTIPLE;
+
+PathPositionIndex::PathPositionIndex(const xg::XG& xgidx, const vector<string>& path_names) :
+    xgidx(xgidx), names(xgidx.max_path_rank() + 1), lengths(xgidx.max_path_rank() + 1),
+    single_path(xgidx.node_count + 1, 0), single_position(xgidx.node_count + 1, 0) {
+
+    vector<size_t> ranks;
+    if (path_names.empty()) {
+        for (size_t rank = 1; rank <= xgidx.max_path_rank(); rank++) {
+            ranks.push_back(rank);
+        }
+    } else {
+        for (auto& name : path_names) {
+            size_t rank = xgidx.path_rank(name);
+            if (rank == 0) {
+                throw runtime_error("PathPositionIndex: path \"" + name + "\" not found in xg index");
+            }
+            ranks.push_back(rank);
+        }
+        // Occurrences have to go in path rank order
+        sort(ranks.begin(), ranks.end());
+        ranks.erase(unique(ranks.begin(), ranks.end()), ranks.end());
+    }
+
+    for (auto rank : ranks) {
+        names[rank] = xgidx.path_name(rank);
+        lengths[rank] = xgidx.path_length(rank);
+        indexed_paths++;
+
+        // Walk the path once instead of selecting each node's occurrences
+        auto& path = xgidx.get_path(names[rank]);
+        for (size_t i = 0; i < path.positions.size(); i++) {
+            id_t id = path.node(i);
+            size_t node_rank = xgidx.id_to_rank(id);
+            Occurrence occurrence{rank, (size_t) path.positions[i], (bool) path.directions[i]};
+
+            if (single_path[node_rank] == 0) {
+                single_path[node_rank] = rank;
+                single_position[node_rank] = (occurrence.offset << 1) | occurrence.is_reverse;
+            } else {
+                auto& occurrences = multiple[id];
+                if (single_path[node_rank] != MULTIPLE) {
+                    // Move the first occurrence over now that there are two
+                    uint64_t packed = single_position[node_rank];
+                    occurrences.push_back(Occurrence{single_path[node_rank], (size_t) (packed >> 1), (bool) (packed & 1)});
+                    single_path[node_rank] = MULTIPLE;
+                    single_position[node_rank] = 0;
+                }
+                occurrences.push_back(occurrence);
+            }
+        }
+    }
+}
+
+void PathPositionIndex::for_each_occurrence(id_t id, const function<void(const Occurrence&)>& lambda) const {
+    size_t node_rank = xgidx.id_to_rank(id);
+    uint32_t rank = single_path[node_rank];
+    if (rank == 0) {
+        // Not on any indexed path
+        return;
+    }
+    if (rank != MULTIPLE) {
+        uint64_t packed = single_position[node_rank];
+        lambda(Occurrence{rank, (size_t) (packed >> 1), (bool) (packed & 1)});
+        return;
+    }
+    for (auto& occurrence : multiple.at(id)) {
+        lambda(occurrence);
+    }
+}
+
+bool PathPositionIndex::on_indexed_path(id_t id) const {
+    return single_path[xgidx.id_to_rank(id)] != 0;
+}
+
+map<string, vector<pair<size_t, bool>>> PathPositionIndex::offsets_in_paths(pos_t pos) const {
+    map<string, vector<pair<size_t, bool>>> positions;
+    for_each_occurrence(id(pos), [&](const Occurrence& occurrence) {
+        // relative direction to this traversal
+        positions[names[occurrence.path_rank]].emplace_back(occurrence.offset + offset(pos),
+                                                            occurrence.is_reverse != is_rev(pos));
+    });
+    return positions;
+}
+
+map<string, vector<pair<size_t, bool>>> PathPositionIndex::nearest_offsets_in_paths(pos_t pos, int64_t max_search) const {
+    // Look at the neighbors on either side the same way XG::next_path_position() does
+    handle_t h_fwd = xgidx.get_handle(id(pos), is_rev(pos));
+    handle_t h_rev = xgidx.get_handle(id(pos), !is_rev(pos));
+    int64_t fwd_seen = offset(pos);
+    int64_t rev_seen = xgidx.node_length(id(pos)) - offset(pos);
+    pair<pos_t, int64_t> fwd_next = make_pair(make_pos_t(0, false, 0), numeric_limits<int64_t>::max());
+    pair<pos_t, int64_t> rev_next = make_pair(make_pos_t(0, false, 0), numeric_limits<int64_t>::max());
+    xgidx.follow_edges(h_fwd, false, [&](const handle_t& n) {
+        id_t next_id = xgidx.get_id(n);
+        if (on_indexed_path(next_id)) {
+            fwd_next = make_pair(make_pos_t(next_id, xgidx.get_is_reverse(n), 0), fwd_seen);
+            return false;
+        } else {
+            fwd_seen += xgidx.node_length(next_id);
+            return fwd_seen < max_search;
+        }
+    });
+    xgidx.follow_edges(h_rev, false, [&](const handle_t& n) {
+        id_t next_id = xgidx.get_id(n);
+        if (on_indexed_path(next_id)) {
+            rev_next = make_pair(make_pos_t(next_id, !xgidx.get_is_reverse(n), 0), rev_seen);
+            return false;
+        } else {
+            rev_seen += xgidx.node_length(next_id);
+            return rev_seen < max_search;
+        }
+    });
+    pair<pos_t, int64_t> next = fwd_next;
+    if (fwd_next.second > rev_next.second) {
+        next = rev_next;
+        next.second = -next.second;
+    }
+
+    if (!id(next.first)) {
+        return map<string, vector<pair<size_t, bool>>>();
+    }
+    auto offsets = offsets_in_paths(next.first);
+    for (auto& o : offsets) {
+        for (auto& p : o.second) {
+            p.first += next.second;
+        }
+    }
+    return offsets;
+}
+
+map<string, vector<size_t>> PathPositionIndex::position_in_paths(id_t id, bool is_rev, size_t offset) const {
+    map<string, vector<size_t>> positions;
+    size_t length = 0;
+    for_each_occurrence(id, [&](const Occurrence& occurrence) {
+        size_t pos = occurrence.offset;
+        if (is_rev) {
+            if (!length) {
+                length = xgidx.node_length(id);
+            }
+            pos = lengths[occurrence.path_rank] - occurrence.offset - length;
+        }
+        positions[names[occurrence.path_rank]].push_back(pos + offset);
+    });
+    return positions;
+}
+
+size_t PathPositionIndex::path_count() const {
+    return indexed_paths;
+}
+
+size_t PathPositionIndex::multiple_occurrence_count() const {
+    return multiple.size();
+}
+
+}
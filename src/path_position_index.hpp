@@ -0,0 +1,104 @@
+#ifndef VG_PATH_POSITION_INDEX_HPP_INCLUDED
+#define VG_PATH_POSITION_INDEX_HPP_INCLUDED
+
+/** \file
+ * A node-to-path-position index over the embedded paths of an XG, so that
+ * looking up where a node falls on the reference paths doesn't have to go
+ * through the path's wavelet tree for every occurrence.
+ */
+
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "xg.hpp"
+
+namespace vg {
+
+using namespace std;
+
+/**
+ * Remembers the offset and orientation of every node occurrence on a set of
+ * XG paths. Nodes that occur exactly once, which is most nodes on reference
+ * paths, are looked up with one access to a dense vector by node rank; the
+ * rest go through a hash table. Lookups give the same answers as the XG
+ * queries of the same name, restricted to the indexed paths. Read-only after
+ * construction, so it can be shared between threads.
+ */
+class PathPositionIndex {
+public:
+
+    /// One visit of a path to a node.
+    struct Occurrence {
+        /// XG rank of the path
+        size_t path_rank;
+        /// Offset of the start of the node in the path
+        size_t offset;
+        /// True if the path visits the node in reverse
+        bool is_reverse;
+    };
+
+    /// Index the given paths of the XG, which must outlive the index. With no
+    /// path names, all paths are indexed. Throws if a path isn't in the XG.
+    PathPositionIndex(const xg::XG& xgidx, const vector<string>& path_names = {});
+
+    /// Call the callback for each occurrence of the node on an indexed path,
+    /// in order of path rank and then offset.
+    void for_each_occurrence(id_t id, const function<void(const Occurrence&)>& lambda) const;
+
+    /// Get the offsets of the position on each indexed path, and whether the
+    /// path runs in the opposite direction, as XG::offsets_in_paths() would.
+    map<string, vector<pair<size_t, bool>>> offsets_in_paths(pos_t pos) const;
+
+    /// Like offsets_in_paths(), but for the nearest node on an indexed path
+    /// next to the position's node, found within max_search bases, and
+    /// adjusted by the distance to it, as XG::nearest_offsets_in_paths()
+    /// would.
+    map<string, vector<pair<size_t, bool>>> nearest_offsets_in_paths(pos_t pos, int64_t max_search) const;
+
+    /// Get the positions of the given offset on the node in each indexed path,
+    /// measured on the reverse strand of the path if is_rev is set, as
+    /// XG::position_in_paths() would.
+    map<string, vector<size_t>> position_in_paths(id_t id, bool is_rev, size_t offset) const;
+
+    /// Get the number of paths indexed.
+    size_t path_count() const;
+
+    /// Get the number of nodes that have more than one occurrence on the
+    /// indexed paths.
+    size_t multiple_occurrence_count() const;
+
+private:
+
+    /// Marks nodes in single_path that occur more than once.
+    static const uint32_t MULTIPLE = numeric_limits<uint32_t>::max();
+
+    const xg::XG& xgidx;
+
+    /// Names and lengths of the paths by XG rank, with empty names for paths
+    /// that aren't indexed.
+    vector<string> names;
+    vector<size_t> lengths;
+    size_t indexed_paths = 0;
+
+    /// By node rank, the rank of the only path visiting the node, 0 if there
+    /// is none, or MULTIPLE if there are several occurrences.
+    vector<uint32_t> single_path;
+    /// By node rank, the offset of the only occurrence shifted up one bit,
+    /// with the low bit set if it is reverse.
+    vector<uint64_t> single_position;
+    /// The occurrences of the nodes that occur more than once.
+    unordered_map<id_t, vector<Occurrence>> multiple;
+
+    /// Is the position on a node that an indexed path visits?
+    bool on_indexed_path(id_t id) const;
+};
+
+}
+
+#endif
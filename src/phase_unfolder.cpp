@@ -15,11 +15,71 @@ PhaseUnfolder::PhaseUnfolder(const xg::XG& xg_index, const gbwt::GBWT& gbwt_inde
 
 void PhaseUnfolder::unfold(VG& graph, bool show_progress) {
     std::list<VG> components = this->complement_components(graph, show_progress);
+    std::vector<VG*> pending;
+    pending.reserve(components.size());
+    for (VG& component : components) {
+        pending.push_back(&component);
+    }
+
+    /*
+      Unfold the components in parallel, each with its own PhaseUnfolder that
+      numbers its duplicates from the same first free id. Then renumber the
+      duplicates component by component, in order, so that the mapping and
+      the graph do not depend on the number of threads. Batches of components
+      bound the memory used by the unfolded components waiting to be merged.
+    */
+    const vg::id_t first_free = this->mapping.end();
+    const size_t batch_size = 256 * get_thread_count();
+    std::vector<VG> local_unfolded;
+    std::vector<std::vector<vg::id_t>> local_originals;
+    std::vector<size_t> local_paths;
 
     size_t haplotype_paths = 0;
     VG unfolded;
-    for (VG& component : components) {
-        haplotype_paths += this->unfold_component(component, graph, unfolded);
+    for (size_t batch_start = 0; batch_start < pending.size(); batch_start += batch_size) {
+        size_t batch_end = std::min(batch_start + batch_size, pending.size());
+        local_unfolded.clear();
+        local_unfolded.resize(batch_end - batch_start);
+        local_originals.assign(batch_end - batch_start, std::vector<vg::id_t>());
+        local_paths.assign(batch_end - batch_start, 0);
+
+        #pragma omp parallel for schedule(dynamic, 1)
+        for (size_t i = batch_start; i < batch_end; i++) {
+            PhaseUnfolder local(this->xg_index, this->gbwt_index, first_free);
+            local_paths[i - batch_start] = local.unfold_component(*pending[i], graph, local_unfolded[i - batch_start]);
+            std::vector<vg::id_t>& originals = local_originals[i - batch_start];
+            originals.reserve(local.mapping.size());
+            for (gcsa::size_type duplicate = local.mapping.begin(); duplicate < local.mapping.end(); duplicate++) {
+                originals.push_back(local.mapping(duplicate));
+            }
+            pending[i]->clear();
+        }
+
+        for (size_t i = 0; i < batch_end - batch_start; i++) {
+            // Duplicates numbered from first_free move to the ids the serial
+            // algorithm would have given them.
+            vg::id_t shift = this->mapping.end() - first_free;
+            for (vg::id_t original : local_originals[i]) {
+                this->mapping.insert(original);
+            }
+            auto renumber = [&](vg::id_t id) -> vg::id_t {
+                return (id >= first_free ? id + shift : id);
+            };
+            Graph& part = local_unfolded[i].graph;
+            for (size_t j = 0; j < part.node_size(); j++) {
+                Node node = part.node(j);
+                node.set_id(renumber(node.id()));
+                unfolded.add_node(node);
+            }
+            for (size_t j = 0; j < part.edge_size(); j++) {
+                Edge edge = part.edge(j);
+                edge.set_from(renumber(edge.from()));
+                edge.set_to(renumber(edge.to()));
+                unfolded.add_edge(edge);
+            }
+            local_unfolded[i].clear();
+            haplotype_paths += local_paths[i];
+        }
     }
     if (show_progress) {
         std::cerr << "Unfolded graph: "
@@ -55,6 +55,10 @@ public:
      * and suffixes.
      *
      * - Extend the input graph with the unfolded components.
+     *
+     * Uses OMP threads. The components are unfolded independently, and the
+     * duplicates get the same identifiers regardless of the number of
+     * threads.
      */
     void unfold(VG& graph, bool show_progress = false);
 
@@ -8,41 +8,96 @@ using namespace std;
 
 namespace vg {
     
-    PhasedGenome::HaplotypeNode::HaplotypeNode(NodeTraversal node_traversal, HaplotypeNode* next, HaplotypeNode* prev) :
-                                               node_traversal(node_traversal), next(next), prev(prev) {
-        // nothing to do
-    }
+    const size_t PhasedGenome::no_segment;
     
-    PhasedGenome::HaplotypeNode::~HaplotypeNode() {
+    PhasedGenome::PhasedGenome(SnarlManager& snarl_manager) : snarl_manager(snarl_manager) {
         // nothing to do
     }
     
-    PhasedGenome::Haplotype::Haplotype(NodeTraversal node_traversal) {
-        // construct seed node
-        left_telomere_node = new HaplotypeNode(node_traversal, nullptr, nullptr);
-        right_telomere_node = left_telomere_node;
+    PhasedGenome::~PhasedGenome() {
+        // nothing to do
     }
     
-    PhasedGenome::Haplotype::~Haplotype() {
-        // destruct nodes
-        HaplotypeNode* haplo_node = this->left_telomere_node;
-        while (haplo_node) {
-            HaplotypeNode* next = haplo_node->next;
-            delete haplo_node;
-            haplo_node = next;
+    size_t PhasedGenome::new_segment() {
+        if (!free_segments.empty()) {
+            size_t segment = free_segments.back();
+            free_segments.pop_back();
+            segments[segment].next = no_segment;
+            segments[segment].prev = no_segment;
+            return segment;
         }
+        segments.emplace_back();
+        return segments.size() - 1;
     }
     
-    PhasedGenome::PhasedGenome(SnarlManager& snarl_manager) : snarl_manager(snarl_manager) {
-        // nothing to do
+    pair<size_t, size_t> PhasedGenome::make_segments(const vector<NodeTraversal>& walk) {
+        size_t first = no_segment;
+        size_t last = no_segment;
+        // the segment we are adding to, if we can keep adding to one
+        size_t current = no_segment;
+        for (const NodeTraversal& node_traversal : walk) {
+            int64_t node_id = node_traversal.node->id();
+            bool boundary = site_starts.count(node_id) || site_ends.count(node_id);
+            if (boundary || current == no_segment) {
+                // start a new segment and link it onto the end
+                current = new_segment();
+                if (last == no_segment) {
+                    first = current;
+                }
+                else {
+                    segments[last].next = current;
+                    segments[current].prev = last;
+                }
+                last = current;
+            }
+            
+#ifdef debug_phased_genome
+            cerr << "[PhasedGenome::make_segments]: recording node " << node_id << " in segment " << current << endl;
+#endif
+            
+            node_locations[node_id].emplace_back(current, segments[current].traversals.size());
+            segments[current].traversals.push_back(node_traversal);
+            
+            if (boundary) {
+                // site boundaries get a segment to themselves
+                current = no_segment;
+            }
+        }
+        return make_pair(first, last);
     }
     
-    PhasedGenome::~PhasedGenome() {
-        
-        for (Haplotype* haplotype : haplotypes) {
-            delete haplotype;
+    void PhasedGenome::free_segment(size_t segment, Haplotype& haplotype) {
+        vector<NodeTraversal>& traversals = segments[segment].traversals;
+        for (size_t i = 0; i < traversals.size(); i++) {
+            int64_t node_id = traversals[i].node->id();
+            
+            // don't need to worry about erasing the same site twice (once on start and
+            // once on end) since unordered_map.erase is defined in both cases
+            if (site_starts.count(node_id)) {
+#ifdef debug_phased_genome
+                cerr << "[PhasedGenome::free_segment]: deleting nested site starting at node " << node_id << " from index" << endl;
+#endif
+                haplotype.sites.erase(site_starts[node_id]);
+            }
+            else if (site_ends.count(node_id)) {
+#ifdef debug_phased_genome
+                cerr << "[PhasedGenome::free_segment]: deleting nested site ending at node " << node_id << " from index" << endl;
+#endif
+                haplotype.sites.erase(site_ends[node_id]);
+            }
+            
+            // remove the node from the node locations index
+            vector<Step>& node_occurrences = node_locations[node_id];
+            for (size_t j = 0; j < node_occurrences.size(); j++) {
+                if (node_occurrences[j] == Step(segment, i)) {
+                    node_occurrences[j] = node_occurrences.back();
+                    node_occurrences.pop_back();
+                    break;
+                }
+            }
         }
-        
+        traversals.clear();
+        free_segments.push_back(segment);
     }
     
     void PhasedGenome::build_indices() {
@@ -56,75 +111,97 @@ namespace vg {
         }
         
 #ifdef debug_phased_genome
-        cerr << "[PhasedGenome::build_indices]: building site to haplotype node index" << endl;
+        cerr << "[PhasedGenome::build_indices]: splitting haplotypes at site boundaries" << endl;
 #endif
         
-        // label the sites on each haplotype
-        for (Haplotype* haplotype : haplotypes) {
-#ifdef debug_phased_genome
-            cerr << "[PhasedGenome::build_indices]: traversing haplotype at " << haplotype << endl;
-#endif
-            // keep track of where we enter and leave sites
-            unordered_map<const Snarl*, HaplotypeNode*> site_start_sides;
-            unordered_map<const Snarl*, HaplotypeNode*> site_end_sides;
-            
-            // iterate along the node path of the haplotype
-            HaplotypeNode* haplo_node = haplotype->left_telomere_node;
-            while (haplo_node != nullptr) {
-                int64_t node_id = haplo_node->node_traversal.node->id();
+        // now that we know where the sites are, split up the haplotypes so site boundaries
+        // sit in segments of their own
+        node_locations.clear();
+        for (Haplotype& haplotype : haplotypes) {
+            vector<NodeTraversal> walk;
+            size_t segment = haplotype.left_telomere_segment;
+            while (segment != no_segment) {
+                vector<NodeTraversal>& traversals = segments[segment].traversals;
+                walk.insert(walk.end(), traversals.begin(), traversals.end());
+                traversals.clear();
+                free_segments.push_back(segment);
+                segment = segments[segment].next;
+            }
+            tie(haplotype.left_telomere_segment, haplotype.right_telomere_segment) = make_segments(walk);
+        }
+        
 #ifdef debug_phased_genome
-                cerr << "[PhasedGenome::build_indices]: recording an instance of node " << node_id << " in a haplotype node at " << haplo_node << endl;
+        cerr << "[PhasedGenome::build_indices]: building site to haplotype segment index" << endl;
 #endif
-                // mark this instance of the node in the node location index
-                node_locations[node_id].push_back(haplo_node);
-                
+        
+        // label the sites on each haplotype
+        for (Haplotype& haplotype : haplotypes) {
+            haplotype.sites.clear();
+            index_sites(haplotype, haplotype.left_telomere_segment, haplotype.right_telomere_segment);
+        }
+    }
+    
+    void PhasedGenome::index_sites(Haplotype& haplotype, size_t first_segment, size_t last_segment) {
+        if (first_segment == no_segment) {
+            return;
+        }
+        
+        // keep track of where we enter and leave sites
+        unordered_map<const Snarl*, size_t> site_start_sides;
+        unordered_map<const Snarl*, size_t> site_end_sides;
+        
+        // iterate along the segments of the haplotype
+        for (size_t segment = first_segment; ; segment = segments[segment].next) {
+            for (const NodeTraversal& node_traversal : segments[segment].traversals) {
+                int64_t node_id = node_traversal.node->id();
                 
                 // are we at the start of a site?
                 if (site_starts.count(node_id)) {
                     const Snarl* site = site_starts[node_id];
-
+                    
                     // are we leaving or entering the site?
                     if (site_start_sides.count(site)) {
 #ifdef debug_phased_genome
-                        cerr << "[PhasedGenome::build_indices]: leaving at start of site " << site->start.node->id() << "->" << site->end.node->id() << endl;
+                        cerr << "[PhasedGenome::index_sites]: leaving at start of site " << site->start().node_id() << "->" << site->end().node_id() << endl;
 #endif
                         // leaving: put the site in the index in the orientation of haplotype travesal
-                        HaplotypeNode* other_side_node = site_start_sides[site];
+                        size_t other_side_segment = site_start_sides[site];
                         site_start_sides.erase(site);
-                        haplotype->sites[site] = make_pair(other_side_node, haplo_node);
+                        haplotype.sites[site] = make_pair(other_side_segment, segment);
                     }
                     else {
 #ifdef debug_phased_genome
-                        cerr << "[PhasedGenome::build_indices]: entering at start of site " << site->start.node->id() << "->" << site->end.node->id() << endl;
+                        cerr << "[PhasedGenome::index_sites]: entering at start of site " << site->start().node_id() << "->" << site->end().node_id() << endl;
 #endif
-                        // entering: mark the node in the haplotype path where we entered
-                        site_end_sides[site] = haplo_node;
+                        // entering: mark the segment in the haplotype where we entered
+                        site_end_sides[site] = segment;
                     }
                 }
-                // are we at the start of a site?
+                // are we at the end of a site?
                 if (site_ends.count(node_id)) {
                     const Snarl* site = site_ends[node_id];
                     // are we leaving or entering the site?
                     if (site_end_sides.count(site)) {
 #ifdef debug_phased_genome
-                        cerr << "[PhasedGenome::build_indices]: leaving at end of site " << site->start.node->id() << "->" << site->end.node->id() << endl;
+                        cerr << "[PhasedGenome::index_sites]: leaving at end of site " << site->start().node_id() << "->" << site->end().node_id() << endl;
 #endif
                         // leaving: put the site in the index in the orientation of haplotype travesal
-                        HaplotypeNode* other_side_node = site_end_sides[site];
+                        size_t other_side_segment = site_end_sides[site];
                         site_end_sides.erase(site);
-                        haplotype->sites[site] = make_pair(other_side_node, haplo_node);
+                        haplotype.sites[site] = make_pair(other_side_segment, segment);
                     }
                     else {
 #ifdef debug_phased_genome
-                        cerr << "[PhasedGenome::build_indices]: entering at end of site " << site->start.node->id() << "->" << site->end.node->id() << endl;
+                        cerr << "[PhasedGenome::index_sites]: entering at end of site " << site->start().node_id() << "->" << site->end().node_id() << endl;
 #endif
-                        // entering: mark the node in the haplotype path where we entered
-                        site_start_sides[site] = haplo_node;
+                        // entering: mark the segment in the haplotype where we entered
+                        site_start_sides[site] = segment;
                     }
                 }
-                
-                // advance to next node in haplotype path
-                haplo_node = haplo_node->next;
+            }
+            
+            if (segment == last_segment) {
+                break;
             }
         }
     }
@@ -192,30 +269,30 @@ namespace vg {
     }
     
     PhasedGenome::iterator PhasedGenome::begin(int which_haplotype) {
-        return iterator(1, which_haplotype, haplotypes[which_haplotype]->left_telomere_node);
+        return iterator(1, which_haplotype, Step(haplotypes[which_haplotype].left_telomere_segment, 0), &segments);
     }
     
     PhasedGenome::iterator PhasedGenome::end(int which_haplotype) {
-        return iterator(0, which_haplotype, nullptr);
+        return iterator(0, which_haplotype, Step(no_segment, 0), &segments);
     }
     
     vector<NodeTraversal> PhasedGenome::get_allele(const Snarl& site, int which_haplotype) {
         
-        Haplotype& haplotype = *haplotypes[which_haplotype];
+        Haplotype& haplotype = haplotypes[which_haplotype];
         
         // can only get the allele of a site that already is in the haplotype
         assert(haplotype.sites.count(&site));
         
         // get the allele
-        pair<HaplotypeNode*, HaplotypeNode*> haplo_site = haplotype.sites[&site];
+        pair<size_t, size_t> haplo_site = haplotype.sites[&site];
         vector<NodeTraversal> allele;
-        for (HaplotypeNode* haplo_node = haplo_site.first->next; haplo_node != haplo_site.second;
-             haplo_node = haplo_node->next) {
-            allele.push_back(haplo_node->node_traversal);
+        for (size_t segment = segments[haplo_site.first].next; segment != haplo_site.second;
+             segment = segments[segment].next) {
+            allele.insert(allele.end(), segments[segment].traversals.begin(), segments[segment].traversals.end());
         }
         
         // is site in the reverse direction on haplotype?
-        if (haplo_site.first->node_traversal.node->id() != site.start().node_id()) {
+        if (traversal_at(Step(haplo_site.first, 0)).node->id() != site.start().node_id()) {
             // reverse the allele
             reverse(allele.begin(), allele.end());
             // swap the orientation
@@ -226,49 +303,99 @@ namespace vg {
         return allele;
     }
     
+    void PhasedGenome::replace_allele(const Snarl& site, const vector<NodeTraversal>& allele, int which_haplotype) {
+        Haplotype& haplotype = haplotypes[which_haplotype];
+        
+        // can only set the allele of a site that already is in the haplotype
+        assert(haplotype.sites.count(&site));
+        
+        pair<size_t, size_t> haplo_site = haplotype.sites[&site];
+        
+#ifdef debug_phased_genome
+        cerr << "[PhasedGenome::set_allele]: deleting allele at site " << traversal_at(Step(haplo_site.first, 0)).node->id() << "->" << traversal_at(Step(haplo_site.second, 0)).node->id() << endl;
+#endif
+        
+        // cut out the current allele
+        size_t segment = segments[haplo_site.first].next;
+        while (segment != haplo_site.second) {
+            size_t next_segment = segments[segment].next;
+            free_segment(segment, haplotype);
+            segment = next_segment;
+        }
+        segments[haplo_site.first].next = haplo_site.second;
+        segments[haplo_site.second].prev = haplo_site.first;
+        
+        if (allele.empty()) {
+            return;
+        }
+        
+        // is site in forward or reverse direction on haplotype? the allele is inserted
+        // outward from the site start
+        bool forward = (traversal_at(Step(haplo_site.first, 0)).node->id() == site.start().node_id());
+        vector<NodeTraversal> walk(allele);
+        if (!forward) {
+            reverse(walk.begin(), walk.end());
+        }
+        
+        // splice in the new allele
+        pair<size_t, size_t> new_segments = make_segments(walk);
+        segments[haplo_site.first].next = new_segments.first;
+        segments[new_segments.first].prev = haplo_site.first;
+        segments[new_segments.second].next = haplo_site.second;
+        segments[haplo_site.second].prev = new_segments.second;
+        
+        // and find the sites nested in it
+        index_sites(haplotype, new_segments.first, new_segments.second);
+    }
+    
     void PhasedGenome::swap_alleles(const Snarl& site, int haplotype_1, int haplotype_2) {
-        Haplotype& haplo_1 = *haplotypes[haplotype_1];
-        Haplotype& haplo_2 = *haplotypes[haplotype_2];
+        Haplotype& haplo_1 = haplotypes[haplotype_1];
+        Haplotype& haplo_2 = haplotypes[haplotype_2];
         
-        pair<HaplotypeNode*, HaplotypeNode*> haplo_nodes_1 = haplo_1.sites[&site];
-        pair<HaplotypeNode*, HaplotypeNode*> haplo_nodes_2 = haplo_2.sites[&site];
+        pair<size_t, size_t> haplo_segments_1 = haplo_1.sites[&site];
+        pair<size_t, size_t> haplo_segments_2 = haplo_2.sites[&site];
         
 #ifdef debug_phased_genome
-        cerr << "[PhasedGenome::swap_alleles]: swapping allele at site " << site.start().node_id() << "->" << site.end().node_id() << " between chromosomes " << haplotype_1 << " and " << haplotype_2 << " with haplotype nodes " << haplo_nodes_1.first << "->" << haplo_nodes_1.second << " and " << haplo_nodes_2.first << "->" << haplo_nodes_2.second << endl;
+        cerr << "[PhasedGenome::swap_alleles]: swapping allele at site " << site.start().node_id() << "->" << site.end().node_id() << " between chromosomes " << haplotype_1 << " and " << haplotype_2 << " with segments " << haplo_segments_1.first << "->" << haplo_segments_1.second << " and " << haplo_segments_2.first << "->" << haplo_segments_2.second << endl;
 #endif
         
-        bool is_deletion_1 = (haplo_nodes_1.first->next == haplo_nodes_1.second);
-        bool is_deletion_2 = (haplo_nodes_2.first->next == haplo_nodes_2.second);
+        Segment& left_1 = segments[haplo_segments_1.first];
+        Segment& right_1 = segments[haplo_segments_1.second];
+        Segment& left_2 = segments[haplo_segments_2.first];
+        Segment& right_2 = segments[haplo_segments_2.second];
+        
+        bool is_deletion_1 = (left_1.next == haplo_segments_1.second);
+        bool is_deletion_2 = (left_2.next == haplo_segments_2.second);
         
         if (is_deletion_1 && !is_deletion_2) {
-            haplo_nodes_2.first->next->prev = haplo_nodes_1.first;
-            haplo_nodes_2.second->prev->next = haplo_nodes_1.second;
+            segments[left_2.next].prev = haplo_segments_1.first;
+            segments[right_2.prev].next = haplo_segments_1.second;
             
-            haplo_nodes_1.first->next = haplo_nodes_2.first->next;
-            haplo_nodes_1.second->prev = haplo_nodes_2.second->prev;
+            left_1.next = left_2.next;
+            right_1.prev = right_2.prev;
             
-            haplo_nodes_2.first->next = haplo_nodes_2.second;
-            haplo_nodes_2.second->prev = haplo_nodes_2.first;
+            left_2.next = haplo_segments_2.second;
+            right_2.prev = haplo_segments_2.first;
         }
         else if (is_deletion_2 && !is_deletion_1) {
-            haplo_nodes_1.first->next->prev = haplo_nodes_2.first;
-            haplo_nodes_1.second->prev->next = haplo_nodes_2.second;
+            segments[left_1.next].prev = haplo_segments_2.first;
+            segments[right_1.prev].next = haplo_segments_2.second;
             
-            haplo_nodes_2.first->next = haplo_nodes_1.first->next;
-            haplo_nodes_2.second->prev = haplo_nodes_1.second->prev;
+            left_2.next = left_1.next;
+            right_2.prev = right_1.prev;
             
-            haplo_nodes_1.first->next = haplo_nodes_1.second;
-            haplo_nodes_1.second->prev = haplo_nodes_1.first;
+            left_1.next = haplo_segments_1.second;
+            right_1.prev = haplo_segments_1.first;
         }
         else if (!is_deletion_1 && !is_deletion_2) {
-            haplo_nodes_2.first->next->prev = haplo_nodes_1.first;
-            haplo_nodes_2.second->prev->next = haplo_nodes_1.second;
+            segments[left_2.next].prev = haplo_segments_1.first;
+            segments[right_2.prev].next = haplo_segments_1.second;
             
-            haplo_nodes_1.first->next->prev = haplo_nodes_2.first;
-            haplo_nodes_1.second->prev->next = haplo_nodes_2.second;
+            segments[left_1.next].prev = haplo_segments_2.first;
+            segments[right_1.prev].next = haplo_segments_2.second;
             
-            std::swap(haplo_nodes_1.first->next, haplo_nodes_2.first->next);
-            std::swap(haplo_nodes_1.second->prev, haplo_nodes_2.second->prev);
+            std::swap(left_1.next, left_2.next);
+            std::swap(right_1.prev, right_2.prev);
         }
         // else two deletions and nothing will change
         
@@ -287,14 +414,10 @@ namespace vg {
         // must have identified start subpaths before computing optimal score   
         assert(multipath_aln.start_size() > 0);
         
-        // iteration functions to facilitate iterating on forward/reverse strands
-        auto move_right = [](HaplotypeNode*& path_node) { path_node = path_node->next; };
-        auto move_left = [](HaplotypeNode*& path_node) { path_node = path_node->prev; };
-        
         int32_t optimal_score = 0;
         
         // find the places in the path where the alignment might start
-        unordered_map< pair<HaplotypeNode*, bool>, vector<int>> candidate_start_positions;
+        map<pair<Step, bool>, vector<int>> candidate_start_positions;
         for (int i = 0; i < multipath_aln.start_size(); i++) {
             // a starting subpath in the multipath alignment
             const Subpath& start_subpath = multipath_aln.subpath(multipath_aln.start(i));
@@ -304,48 +427,54 @@ namespace vg {
             cerr << "[PhasedGenome::optimal_score_on_genome]: looking for candidate start positions for subpath " << multipath_aln.start(i) << " on node " << start_pos.node_id() << endl;
 #endif
             
+            auto locations = node_locations.find(start_pos.node_id());
+            if (locations == node_locations.end()) {
+                continue;
+            }
+            
             // add each location the start nodes occur in the path to the candidate starts
-            for ( HaplotypeNode* haplo_node : node_locations[start_pos.node_id()] ) {
+            for (const Step& step : locations->second) {
 #ifdef debug_phased_genome
-                cerr << "[PhasedGenome::optimal_score_on_genome]: marking candidate start position at " << haplo_node->node_traversal.node->id() << " on haplotype node at " << haplo_node << endl;
+                cerr << "[PhasedGenome::optimal_score_on_genome]: marking candidate start position at " << traversal_at(step).node->id() << " in segment " << step.first << endl;
 #endif
                 // mark the start locations orientation relative to the start node
-                candidate_start_positions[make_pair(haplo_node, haplo_node->node_traversal.backward == start_pos.is_reverse())].push_back(i);
+                candidate_start_positions[make_pair(step, traversal_at(step).backward == start_pos.is_reverse())].push_back(i);
             }
         }
         
         // check alignments starting at each node in the path that has a source subpath starting on it
-        for (pair< pair<HaplotypeNode*, bool>, vector<int> > path_starts : candidate_start_positions) {
+        for (const pair<const pair<Step, bool>, vector<int> >& path_starts : candidate_start_positions) {
             
 #ifdef debug_phased_genome
-            cerr << "[PhasedGenome::optimal_score_on_genome]: checking for an alignment at candidate start position on node " << path_starts.first.first->node_traversal.node->id() << " on " << (path_starts.first.second ? "forward" : "reverse" ) << " strand of haplotype" << endl;
+            cerr << "[PhasedGenome::optimal_score_on_genome]: checking for an alignment at candidate start position on node " << traversal_at(path_starts.first.first).node->id() << " on " << (path_starts.first.second ? "forward" : "reverse" ) << " strand of haplotype" << endl;
 #endif
             
-            HaplotypeNode* path_start_node = path_starts.first.first;
+            const Step& path_start_step = path_starts.first.first;
             bool oriented_forward = path_starts.first.second;
             const vector<int>& aln_starts = path_starts.second;
             
             // match up forward and backward traversal on the path to forward and backward traversal through
             // the multipath alignment
-            auto move_forward = oriented_forward ? move_right : move_left;
-            auto move_backward = oriented_forward ? move_left : move_right;
+            auto move_forward = [&](const Step& step) {
+                return oriented_forward ? step_right(step) : step_left(step);
+            };
             
             // initialize dynamic programming structures:
-            // pointer to place in haplotype path corresponding to the beginning of a subpath
-            vector<HaplotypeNode*> subpath_nodes = vector<HaplotypeNode*>(multipath_aln.subpath_size(), nullptr);
+            // place in haplotype path corresponding to the beginning of a subpath
+            vector<Step> subpath_steps = vector<Step>(multipath_aln.subpath_size(), Step(no_segment, 0));
             // score of the best preceding path before this subpath
             vector<int32_t> subpath_prefix_score = vector<int32_t>(multipath_aln.subpath_size(), 0);
             
             // set DP base case with the subpaths that start at this path node
             for (int i : aln_starts) {
-                subpath_nodes[multipath_aln.start(i)] = path_start_node;
+                subpath_steps[multipath_aln.start(i)] = path_start_step;
             }
             
             for (int i = 0; i < multipath_aln.subpath_size(); i++) {
-                HaplotypeNode* subpath_node = subpath_nodes[i];
+                Step subpath_step = subpath_steps[i];
                 
                 // this subpath may be unreachable from subpaths consistent with the path
-                if (subpath_node == nullptr) {
+                if (subpath_step.first == no_segment) {
 #ifdef debug_phased_genome
                     cerr << "[PhasedGenome::optimal_score_on_genome]: subpath " << i << " is unreachable through consistent paths" << endl;
 #endif
@@ -360,17 +489,21 @@ namespace vg {
                 
                 // iterate through mappings in this subpath (assumes one mapping per node)
                 bool subpath_follows_path = true;
-                for (int j = 0; j < subpath.path().mapping_size(); j++, move_forward(subpath_node)) {
+                Step last_step = subpath_step;
+                for (int j = 0; j < subpath.path().mapping_size(); j++) {
                     // check if mapping corresponds to the next node in the path in the correct orientation
                     const Position& position = subpath.path().mapping(j).position();
-                    if (position.node_id() != subpath_node->node_traversal.node->id()
-                        || ((position.is_reverse() == subpath_node->node_traversal.backward) != oriented_forward)) {
-                        subpath_follows_path = false;
-                        break;
+                    if (subpath_step.first == no_segment
+                        || position.node_id() != traversal_at(subpath_step).node->id()
+                        || ((position.is_reverse() == traversal_at(subpath_step).backward) != oriented_forward)) {
 #ifdef debug_phased_genome
                         cerr << "[PhasedGenome::optimal_score_on_genome]: subpath " << i << " is inconsistent with haplotype" << endl;
 #endif
+                        subpath_follows_path = false;
+                        break;
                     }
+                    last_step = subpath_step;
+                    subpath_step = move_forward(subpath_step);
                 }
                 
                 // if subpath followed haplotype path, extend to subsequent subpaths or record completed alignment
@@ -393,20 +526,23 @@ namespace vg {
 #ifdef debug_phased_genome
                         cerr << "[PhasedGenome::optimal_score_on_genome]: non sink path, extending score of " << extended_prefix_score << endl;
 #endif
-                        // edge case: check if subpath_node was improperly incremented from a mapping that ended in the
-                        // middle of a node
+                        // edge case: if the last mapping ended in the middle of a node, the next subpath
+                        // starts on that same node
                         Position end_pos = last_path_position(subpath.path());
-                        if (end_pos.offset() != graph.get_node(end_pos.node_id())->sequence().length()) {
-                            move_backward(subpath_node);
+                        if (end_pos.offset() != traversal_at(last_step).node->sequence().length()) {
+                            subpath_step = last_step;
+                        }
+                        
+                        // if we ran off the end of the chromosome, nothing can follow
+                        if (subpath_step.first == no_segment) {
+                            continue;
                         }
-                        // TODO: this could be a problem if the next node is the end of a chromosome (will seg fault
-                        // because can't get the previous node from nullptr)
                         
                         // mark which node the next subpath starts at
                         for (int j = 0; j < subpath.next_size(); j++) {
                             if (subpath_prefix_score[subpath.next(j)] < extended_prefix_score) {
                                 subpath_prefix_score[subpath.next(j)] = extended_prefix_score;
-                                subpath_nodes[subpath.next(j)] = subpath_node;
+                                subpath_steps[subpath.next(j)] = subpath_step;
                             }
                         }
                     }
@@ -417,19 +553,30 @@ namespace vg {
         return optimal_score;
     }
     
+    vector<int32_t> PhasedGenome::optimal_score_on_genome(const vector<MultipathAlignment>& multipath_alns, VG& graph) {
+        vector<int32_t> scores(multipath_alns.size(), 0);
+        // scoring only reads from the genome, so the alignments are independent
+#pragma omp parallel for schedule(dynamic, 64)
+        for (size_t i = 0; i < multipath_alns.size(); i++) {
+            scores[i] = optimal_score_on_genome(multipath_alns[i], graph);
+        }
+        return scores;
+    }
+    
     
-    PhasedGenome::iterator::iterator() : rank(0), haplotype_number(-1), haplo_node(nullptr) {
+    PhasedGenome::iterator::iterator() : rank(0), haplotype_number(-1), step(PhasedGenome::no_segment, 0),
+                                         segments(nullptr) {
     
     }
     
-    PhasedGenome::iterator::iterator(size_t rank, int haplotype_number, HaplotypeNode* haplo_node) :
-                                    rank(rank), haplotype_number(haplotype_number), haplo_node(haplo_node) {
+    PhasedGenome::iterator::iterator(size_t rank, int haplotype_number, Step step, const vector<Segment>* segments) :
+                                    rank(rank), haplotype_number(haplotype_number), step(step), segments(segments) {
         
     }
     
     PhasedGenome::iterator::iterator(const iterator& other) : rank(other.rank),
                                                               haplotype_number(other.haplotype_number),
-                                                              haplo_node(other.haplo_node) {
+                                                              step(other.step), segments(other.segments) {
         
     }
     
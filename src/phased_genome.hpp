@@ -13,6 +13,9 @@
 #include <cassert>
 #include <list>
 #include <algorithm>
+#include <limits>
+#include <map>
+#include <tuple>
 #include "vg.pb.h"
 #include "vg.hpp"
 #include "nodetraversal.hpp"
@@ -31,6 +34,11 @@ namespace vg {
      * phasing) as walks through a variation graph. Designed for fast editing at a site level,
      * so it maintains indices of sites for that purpose.
      *
+     * Each haplotype is stored as a chain of segments, which are arrays of node traversals.
+     * Once the indices are built, every node at a site boundary is a segment of its own, so the
+     * allele at any site is an unbroken run of whole segments that can be spliced out, in, or
+     * between haplotypes without touching the rest of the genome.
+     *
      */
     class PhasedGenome {
         
@@ -112,20 +120,37 @@ namespace vg {
         /// Note: assumes that MultipathAlignment has 'start' field filled in
         int32_t optimal_score_on_genome(const MultipathAlignment& multipath_aln, VG& graph);
         
+        /// Returns the optimal score on the genome of each of a batch of multipath alignments, in
+        /// order, scoring them in parallel. The genome must not be edited while this runs.
+        ///
+        /// Note: assumes that each MultipathAlignment has 'start' field filled in
+        vector<int32_t> optimal_score_on_genome(const vector<MultipathAlignment>& multipath_alns, VG& graph);
+        
         // TODO: make a local subalignment optimal score function (main obstacle is scoring partial subpaths)
         
     private:
         
-        struct HaplotypeNode;
-        class Haplotype;
+        struct Segment;
+        struct Haplotype;
+        
+        /// A place along a haplotype: the segment and the offset in it
+        typedef pair<size_t, size_t> Step;
+        
+        /// Segment number used for the ends of haplotypes
+        static const size_t no_segment = numeric_limits<size_t>::max();
         
         SnarlManager& snarl_manager;
         
+        /// The segments of all the haplotypes, so that they can move between haplotypes
+        vector<Segment> segments;
+        /// Segments that were cut out of haplotypes and can be reused
+        vector<size_t> free_segments;
+        
         /// All haplotypes in the genome (generally 2 per chromosome)
-        vector<Haplotype*> haplotypes;
+        vector<Haplotype> haplotypes;
         
         /// Index of where nodes from the graph occur in the phased genome
-        unordered_map<int64_t, list<HaplotypeNode*> > node_locations;
+        unordered_map<int64_t, vector<Step> > node_locations;
         
         /// Index of which nodes are starts of Snarls
         unordered_map<int64_t, const Snarl*> site_starts;
@@ -137,20 +162,34 @@ namespace vg {
         // Helper function
         void build_site_indices_internal(const Snarl* snarl);
         
-        // Editing methods:
-        // note: no safety checks that the adjacent nodes aren't null (should only be used in interior
-        // of haplotype) these operations maintain the node location indices but no others
+        /// Get an empty segment that is not in any haplotype
+        size_t new_segment();
+        
+        /// Turn a walk into a chain of segments, giving each site boundary node its own segment,
+        /// and record the node locations. Returns the first and last segments of the chain, which
+        /// are no_segment if the walk is empty.
+        pair<size_t, size_t> make_segments(const vector<NodeTraversal>& walk);
+        
+        /// Cut a segment out of the node location index and the haplotype's site index, and put
+        /// it up for reuse. Does not unlink it from its neighbors.
+        void free_segment(size_t segment, Haplotype& haplotype);
         
-        /// Insert a node traversal to the left of this haplotype node and update indices.
-        inline void insert_left(NodeTraversal node_traversal, HaplotypeNode* haplo_node);
-        /// Insert a node traversal to the right of this haplotype node and update indices.
-        inline void insert_right(NodeTraversal node_traversal, HaplotypeNode* haplo_node);
-        /// Remove this haplotype node from its haplotype and update indices.
-        inline void remove(HaplotypeNode* haplo_node);
+        /// Record the sites entered and left between two segments of a haplotype, inclusive.
+        void index_sites(Haplotype& haplotype, size_t first_segment, size_t last_segment);
+        
+        /// Replace the allele at a site, given in the order of the Snarl
+        void replace_allele(const Snarl& site, const vector<NodeTraversal>& allele, int which_haplotype);
         
         /// Update a subsite's location in indices after swapping its parent allele
         void swap_label(const Snarl& site, Haplotype& haplotype_1, Haplotype& haplotype_2);
         
+        /// The step after this one along the haplotype (segment no_segment at the end)
+        inline Step step_right(const Step& step) const;
+        /// The step before this one along the haplotype (segment no_segment at the end)
+        inline Step step_left(const Step& step) const;
+        /// The node traversal at a step
+        inline const NodeTraversal& traversal_at(const Step& step) const;
+        
     };
     
     /*
@@ -158,80 +197,33 @@ namespace vg {
      */
     
     /**
-     * A node in walk through the graph taken by a haplotype.
+     * A run of the walk through the graph taken by a haplotype.
      *
      */
-    struct PhasedGenome::HaplotypeNode {
-    public:
-        
-        /// Node and strand
-        NodeTraversal node_traversal;
-        /// Next node in walk
-        HaplotypeNode* next;
-        /// Previous node in walk
-        HaplotypeNode* prev;
-        
-        /// Constructor
-        HaplotypeNode(NodeTraversal node_traversal, HaplotypeNode* next, HaplotypeNode* prev);
-        /// Destructor
-        ~HaplotypeNode();
-        
+    struct PhasedGenome::Segment {
+        /// Nodes and strands, left to right along the haplotype
+        vector<NodeTraversal> traversals;
+        /// Next segment along the haplotype
+        size_t next = PhasedGenome::no_segment;
+        /// Previous segment along the haplotype
+        size_t prev = PhasedGenome::no_segment;
     };
     
-//    /// Hash function for node traversals for use in indices
-//    struct HashNodeTraversal {
-//        size_t operator()(const NodeTraversal& node_traversal) const {
-//            return hash(make_pair(node_traversal.node, node_traversal.backward));
-//        }
-//    };
-//    
-//    /// Hash function for sites for use in indices
-//    struct HashSite {
-//        size_t operator()(const NestedSite& site) const {
-//            return hash(make_pair(make_pair(site.start.node, site.start.backward),
-//                                  make_pair(site.end.node, site.end.backward)));
-//        }
-//    };
-    
     /**
-     * Specialized linked list that tracks a walk through the variation graph and maintains
-     * an index of sites.
+     * A walk through the variation graph, as a chain of segments, with an index of sites.
      *
      */
-    class PhasedGenome::Haplotype {
-        
-    private:
-        /// Leftmost node in walk
-        PhasedGenome::HaplotypeNode* left_telomere_node;
-        /// Rightmost node in walk
-        PhasedGenome::HaplotypeNode* right_telomere_node;
+    struct PhasedGenome::Haplotype {
+        /// Leftmost segment in walk
+        size_t left_telomere_segment = PhasedGenome::no_segment;
+        /// Rightmost segment in walk
+        size_t right_telomere_segment = PhasedGenome::no_segment;
         
         /// Index of the location in the haplotype of nested sites. Locations of sites are stored
-        /// as the nodes on haplotype that correspond to the start and end node of the site. The pair
-        /// of haplotype nodes is stored in left-to-right order along the haplotype (i.e. .first->prev
-        /// and .second->next are outside the bubble).
-        unordered_map<const Snarl*, pair<HaplotypeNode*, HaplotypeNode*> > sites;
-        
-    public:
-        /// Construct a haplotype with a single node
-        Haplotype(NodeTraversal node_traversal);
-        
-        /// Construct a haplotype with an iterator that yields NodeTraversals
-        template <typename NodeTraversalIterator>
-        Haplotype(NodeTraversalIterator first, NodeTraversalIterator last);
-        
-        ~Haplotype();
-        
-        /// Add a haplotype node for this node traversal to left end of haplotye and return new node.
-        /// Does not maintain indices; intended for use by the PhasedGenome for initial haplotype build.
-        inline HaplotypeNode* append_left(NodeTraversal node_traversal);
-        /// Add a haplotype node for this node traversal to right end of haplotye and return new node.
-        /// Does not maintain indices; intended for use by the PhasedGenome for initial haplotype build.
-        inline HaplotypeNode* append_right(NodeTraversal node_traversal);
-        
-        friend class PhasedGenome;
-        friend class HaplotypeNode;
-        
+        /// as the segments holding the start and end node of the site, which hold only that node.
+        /// The pair of segments is stored in left-to-right order along the haplotype (i.e. the
+        /// segments between them make the allele).
+        unordered_map<const Snarl*, pair<size_t, size_t> > sites;
     };
     
     /**
@@ -247,9 +239,11 @@ namespace vg {
         /// The ID of the haplotype
         int haplotype_number;
         /// The position along the haplotype
-        HaplotypeNode* haplo_node;
+        Step step;
+        /// The segments the haplotype is made of
+        const vector<Segment>* segments;
         
-        iterator(size_t rank, int haplotype_number, HaplotypeNode* haplo_node);
+        iterator(size_t rank, int haplotype_number, Step step, const vector<Segment>* segments);
         
     public:
         
@@ -265,7 +259,8 @@ namespace vg {
         inline iterator& operator=(const iterator& other) {
             rank = other.rank;
             haplotype_number = other.haplotype_number;
-            haplo_node = other.haplo_node;
+            step = other.step;
+            segments = other.segments;
             return *this;
         }
         
@@ -278,20 +273,18 @@ namespace vg {
         }
         
         inline iterator operator++() {
-            haplo_node = haplo_node->next;
-            rank = (haplo_node == nullptr) ? 0 : rank + 1;
+            advance();
             return *this;
         }
         
         inline iterator operator++( int ) {
             iterator temp = *this;
-            haplo_node = haplo_node->next;
-            rank = (haplo_node == nullptr) ? 0 : rank + 1;
+            advance();
             return temp;
         }
         
         inline NodeTraversal operator*(){
-            return haplo_node->node_traversal;
+            return (*segments)[step.first].traversals[step.second];
         }
         
         inline int which_haplotype() {
@@ -299,7 +292,19 @@ namespace vg {
         }
         
         friend class PhasedGenome;
-        friend class Haplotype;
+        
+    private:
+        
+        inline void advance() {
+            const Segment& segment = (*segments)[step.first];
+            if (step.second + 1 < segment.traversals.size()) {
+                step.second++;
+            }
+            else {
+                step = Step(segment.next, 0);
+            }
+            rank = (step.first == PhasedGenome::no_segment) ? 0 : rank + 1;
+        }
     };
     
     /*
@@ -313,236 +318,57 @@ namespace vg {
         cerr << "[PhasedGenome::add_haplotype]: adding haplotype number " << haplotypes.size() << endl;
 #endif
         
-        Haplotype* haplotype = new Haplotype(first, last);
-        haplotypes.push_back(haplotype);
+        if (first == last) {
+            cerr << "error:[PhasedGenome] cannot construct haplotype with 0 nodes" << endl;
+            assert(0);
+        }
+        
+        vector<NodeTraversal> walk;
+        for (; first != last; first++) {
+            walk.push_back(*first);
+        }
+        
+        haplotypes.emplace_back();
+        tie(haplotypes.back().left_telomere_segment, haplotypes.back().right_telomere_segment) = make_segments(walk);
         
         return haplotypes.size() - 1;
     }
     
-    // TODO: it seems like there should be a better way to do this than completely erasing
-    // and then rewriting the site (especially at long sites)
     template <typename NodeTraversalIterator>
     void PhasedGenome::set_allele(const Snarl& site, NodeTraversalIterator first, NodeTraversalIterator last,
                                   int which_haplotype) {
 #ifdef debug_phased_genome
         cerr << "[PhasedGenome::set_allele]: setting allele on haplotype " << which_haplotype << endl;
 #endif
-        Haplotype& haplotype = *haplotypes[which_haplotype];
-        
-        // can only set the allele of a site that already is in the haplotype
-        assert(haplotype.sites.count(&site));
-        
-        pair<HaplotypeNode*, HaplotypeNode*> haplo_site = haplotype.sites[&site];
-        
-#ifdef debug_phased_genome
-        cerr << "[PhasedGenome::set_allele]: deleting allele at site " << haplo_site.first->node_traversal.node->id() << "->" << haplo_site.second->node_traversal.node->id() << endl;
-#endif
-        
-        // remove the current site
-        HaplotypeNode* haplo_node = haplo_site.first->next;
-        while (haplo_node != haplo_site.second) {
-            // don't need to worry about erasing the same site twice (once on start and
-            // once on end) since unordered_map.erase is defined in both cases
-            int64_t node_id = haplo_node->node_traversal.node->id();
-            if (site_starts.count(node_id)) {
-#ifdef debug_phased_genome
-                cerr << "[PhasedGenome::set_allele]: deleting nested site starting at node " << node_id << " from index" << endl;
-#endif
-                const Snarl* subsite = site_starts[node_id];
-                haplotype.sites.erase(subsite);
-            }
-            else if (site_ends.count(node_id)) {
-#ifdef debug_phased_genome
-                cerr << "[PhasedGenome::set_allele]: deleting nested site ending at node " << node_id << " from index" << endl;
-#endif
-                const Snarl* subsite = site_ends[node_id];
-                haplotype.sites.erase(subsite);
-            }
-#ifdef debug_phased_genome
-            cerr << "[PhasedGenome::set_allele]: deleting haplotype node " << node_id << endl;
-#endif
-            // cut out each node and iterate to next node
-            HaplotypeNode* next_haplo_node = haplo_node->next;
-            remove(haplo_node);
-            haplo_node = next_haplo_node;
-        }
-        
-        // is site in forward or reverse direction on haplotype?
-        bool forward = (haplo_site.first->node_traversal.node->id() == site.start().node_id());
-        
-        // orient traversal through the allele to traversal along the haplotype
-        haplo_node = forward ? haplo_site.first : haplo_site.second;
-        
-        // keeps track of the haplotype node where we entered a site and thereby also
-        // indicates whether we have entered the site yet
-        unordered_map<const Snarl*, HaplotypeNode*> subsite_start_side;
-        unordered_map<const Snarl*, HaplotypeNode*> subsite_end_side;
-        
-        // start inserting nodes from the first position in the allele
-        for (; first != last; first++) {
-            
-            // create the next node in the allele and move the pointer onto the new node
-            if (forward) {
-#ifdef debug_phased_genome
-                cerr << "[PhasedGenome::set_allele]: inserting in forward direction " << (*first).node->id() << ((*first).backward ? "-" : "+") << endl;
-#endif
-                insert_right(*first, haplo_node);
-                haplo_node = haplo_node->next;
-            }
-            else {
-#ifdef debug_phased_genome
-                cerr << "[PhasedGenome::set_allele]: inserting in reverse direction " << (*first).node->id() << ((*first).backward ? "-" : "+") << endl;
-#endif
-                insert_left(*first, haplo_node);
-                haplo_node = haplo_node->prev;
-            }
-            
-            int64_t node_id = haplo_node->node_traversal.node->id();
-            
-            // does a site start here?
-            if (site_starts.count(node_id)) {
-                const Snarl* subsite = site_starts[node_id];
-                // are we entering or leaving this site?
-                if (subsite_end_side.count(subsite)) {
-#ifdef debug_phased_genome
-                    cerr << "[PhasedGenome::set_allele]: detected leaving a site in its reverse orientation" << endl;
-#endif
-                    // add this site into the haplotype's site index
-                    HaplotypeNode* other_side_node = subsite_end_side[subsite];
-                    // the site sides should always be entered in the order that
-                    // they occur in the haplotype
-                    haplotype.sites[subsite] = forward ? make_pair(other_side_node, haplo_node)
-                                                        : make_pair(haplo_node, other_side_node);
-                }
-                else {
-#ifdef debug_phased_genome
-                    cerr << "[PhasedGenome::set_allele]: detected entering a site in its forward orientation" << endl;
-#endif
-                    // we are entering a site, mark the location of the entrance
-                    subsite_start_side[subsite] = haplo_node;
-                }
-            }
-            
-            // does a site end here?
-            if (site_ends.count(node_id)) {
-                const Snarl* subsite = site_ends[node_id];
-                // are we entering or leaving this site?
-                if (subsite_start_side.count(subsite)) {
-#ifdef debug_phased_genome
-                    cerr << "[PhasedGenome::set_allele]: detected leaving a site in its forward orientation" << endl;
-#endif
-                    // add this site into the haplotype's site index
-                    HaplotypeNode* other_side_node = subsite_start_side[subsite];
-                    // the site sides should always be entered in the order that
-                    // they occur in the haplotype
-                    haplotype.sites[subsite] = forward ? make_pair(other_side_node, haplo_node)
-                                                        : make_pair(haplo_node, other_side_node);
-                }
-                else {
-#ifdef debug_phased_genome
-                    cerr << "[PhasedGenome::set_allele]: detected entering a site in its reverse orientation" << endl;
-#endif
-                    // we are entering a site, mark the location of the entrance
-                    subsite_end_side[subsite] = haplo_node;
-                }
-            }
-        }
-    }
-    
-    template <typename NodeTraversalIterator>
-    PhasedGenome::Haplotype::Haplotype(NodeTraversalIterator first, NodeTraversalIterator last) {
-        
-#ifdef debug_phased_genome
-        cerr << "[Haplotype::Haplotype]: constructing Haplotype at " << this << endl;
-#endif
-        
-        if (first == last) {
-            cerr << "error:[PhasedGenome] cannot construct haplotype with 0 nodes" << endl;
-            assert(0);
-        }
-        
-        // construct seed node
-        left_telomere_node = new HaplotypeNode(*first, nullptr, nullptr);
-        right_telomere_node = left_telomere_node;
-        first++;
-        
-#ifdef debug_phased_genome
-        cerr << "[Haplotype::Haplotype]: initialized haplotype with node " << right_telomere_node->node_traversal.node->id() << " with sequence " << right_telomere_node->node_traversal.node->sequence() << " in " << (right_telomere_node->node_traversal.backward ? "reverse" : "forward") << " orientation at memory location " << right_telomere_node << endl;
-#endif
-        
-        // add each subsequent node
+        vector<NodeTraversal> allele;
         for (; first != last; first++) {
-            append_right(*first);
+            allele.push_back(*first);
         }
+        replace_allele(site, allele, which_haplotype);
     }
     
     /*
      *   INLINE FUNCTIONS
      */
     
-    inline PhasedGenome::HaplotypeNode* PhasedGenome::Haplotype::append_left(NodeTraversal node_traversal) {
-        left_telomere_node = new HaplotypeNode(node_traversal, left_telomere_node, nullptr);
-        left_telomere_node->next->prev = left_telomere_node;
-        return left_telomere_node;
-    }
-    
-    inline PhasedGenome::HaplotypeNode* PhasedGenome::Haplotype::append_right(NodeTraversal node_traversal) {
-        right_telomere_node = new HaplotypeNode(node_traversal, nullptr, right_telomere_node);
-        right_telomere_node->prev->next = right_telomere_node;
-        
-#ifdef debug_phased_genome
-        cerr << "[Haplotype::append_right]: appended to right side node " << node_traversal.node->id() << " with sequence " << node_traversal.node->sequence() << " in " << (node_traversal.backward ? "reverse" : "forward") << " orientation at memory location " << right_telomere_node << endl;
-#endif
-        
-        return right_telomere_node;
-    }
-    
-    inline void PhasedGenome::insert_left(NodeTraversal node_traversal, HaplotypeNode* haplo_node) {
-        
-        HaplotypeNode* new_node = new HaplotypeNode(node_traversal, haplo_node, haplo_node->prev);
-        haplo_node->prev->next = new_node;
-        haplo_node->prev = new_node;
-        
-#ifdef debug_phased_genome
-        cerr << "[PhasedGenome::insert_left]: recording inserted node " << node_traversal.node->id() << " in haplotype node at " << haplo_node << endl;
-#endif
-        
-        node_locations[node_traversal.node->id()].push_back(new_node);
+    inline PhasedGenome::Step PhasedGenome::step_right(const Step& step) const {
+        const Segment& segment = segments[step.first];
+        if (step.second + 1 < segment.traversals.size()) {
+            return Step(step.first, step.second + 1);
+        }
+        return Step(segment.next, 0);
     }
     
-    inline void PhasedGenome::insert_right(NodeTraversal node_traversal, HaplotypeNode* haplo_node) {
-        
-        HaplotypeNode* new_node = new HaplotypeNode(node_traversal, haplo_node->next, haplo_node);
-        haplo_node->next->prev = new_node;
-        haplo_node->next = new_node;
-        
-#ifdef debug_phased_genome
-        cerr << "[PhasedGenome::insert_right]: recording inserted node " << node_traversal.node->id() << " in haplotype node at " << haplo_node << endl;
-#endif
-        node_locations[node_traversal.node->id()].push_back(new_node);
+    inline PhasedGenome::Step PhasedGenome::step_left(const Step& step) const {
+        if (step.second > 0) {
+            return Step(step.first, step.second - 1);
+        }
+        size_t prev = segments[step.first].prev;
+        return Step(prev, prev == no_segment ? 0 : segments[prev].traversals.size() - 1);
     }
     
-    inline void PhasedGenome::remove(HaplotypeNode* haplo_node) {
-        // note: updating site indices is handled outside this function
-        
-        haplo_node->next->prev = haplo_node->prev;
-        haplo_node->prev->next = haplo_node->next;
-        
-        // remove the node from the node locations index
-        int64_t node_id = haplo_node->node_traversal.node->id();
-        
-        list<HaplotypeNode*>& node_occurrences = node_locations[node_id];
-#ifdef debug_phased_genome
-        cerr << "[PhasedGenome::remove]: node " << node_id << " occurs in " << node_occurrences.size() << " places, must search through each to find which to delete from indices" << endl;
-#endif
-        for (auto iter = node_occurrences.begin(); iter != node_occurrences.end(); iter++) {
-            if (*iter == haplo_node) {
-                node_occurrences.erase(iter);
-                break;
-            }
-        }
-        
-        delete haplo_node;
+    inline const NodeTraversal& PhasedGenome::traversal_at(const Step& step) const {
+        return segments[step.first].traversals[step.second];
     }
 }
 
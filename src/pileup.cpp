@@ -53,36 +53,174 @@ void Pileups::load(istream& in) {
 
 void Pileups::write(ostream& out, size_t chunk_size) {
 
-    int64_t count = max(_node_pileups.size(), _edge_pileups.size()) / chunk_size;
-    if (max(_node_pileups.size(), _edge_pileups.size()) % chunk_size != 0) {
+    vector<NodePileup*> node_pileups;
+    node_pileups.reserve(_node_pileups.size());
+    for (auto& p : _node_pileups) {
+        node_pileups.push_back(p.second);
+    }
+    vector<EdgePileup*> edge_pileups;
+    edge_pileups.reserve(_edge_pileups.size());
+    for (auto& p : _edge_pileups) {
+        edge_pileups.push_back(p.second);
+    }
+
+    write_chunks(out, node_pileups, edge_pileups, chunk_size);
+    stream::finish(out);
+}
+
+void Pileups::write_chunks(ostream& out, const vector<NodePileup*>& node_pileups,
+                           const vector<EdgePileup*>& edge_pileups, size_t chunk_size) {
+
+    int64_t count = max(node_pileups.size(), edge_pileups.size()) / chunk_size;
+    if (max(node_pileups.size(), edge_pileups.size()) % chunk_size != 0) {
         ++count;
     }
 
-    NodePileupHash::iterator node_it = _node_pileups.begin();
-    EdgePileupHash::iterator edge_it = _edge_pileups.begin();
+    auto node_it = node_pileups.begin();
+    auto edge_it = edge_pileups.begin();
     Pileup pileup;
 
     // note: this won't work at all in parallel but write is single threaded...
     function<Pileup&(size_t)> lambda = [&](size_t i) -> Pileup& {
         pileup.clear_node_pileups();
         pileup.clear_edge_pileups();
-        for (size_t j = 0; j < chunk_size && node_it != _node_pileups.end(); ++j, ++node_it) {
+        for (size_t j = 0; j < chunk_size && node_it != node_pileups.end(); ++j, ++node_it) {
             NodePileup* np = pileup.add_node_pileups();
-            *np = *node_it->second;
+            *np = **node_it;
         }
         // unlike for Graph, we don't bother to try to group edges with nodes they attach
-        for (size_t j = 0; j < chunk_size && edge_it != _edge_pileups.end(); ++j, ++edge_it) {
+        for (size_t j = 0; j < chunk_size && edge_it != edge_pileups.end(); ++j, ++edge_it) {
             EdgePileup* ep = pileup.add_edge_pileups();
-            *ep = *edge_it->second;
+            *ep = **edge_it;
         }
 
         return pileup;
     };
 
     stream::write(out, count, lambda);
+}
+
+void Pileups::take_below(int64_t node_id, vector<NodePileup*>& node_pileups, vector<EdgePileup*>& edge_pileups) {
+
+    node_pileups.clear();
+    edge_pileups.clear();
+    for (auto& p : _node_pileups) {
+        if (p.first < node_id) {
+            node_pileups.push_back(p.second);
+        }
+    }
+    // a read crossing an edge touches both its nodes, so an edge is done once
+    // either end is
+    vector<pair<pair<NodeSide, NodeSide>, EdgePileup*>> keyed_edge_pileups;
+    for (auto& p : _edge_pileups) {
+        if (min(p.first.first.node, p.first.second.node) < node_id) {
+            keyed_edge_pileups.push_back(make_pair(p.first, p.second));
+        }
+    }
+
+    // emit in ID order, so the output is sorted like the input was
+    sort(node_pileups.begin(), node_pileups.end(), [](const NodePileup* a, const NodePileup* b) {
+            return a->node_id() < b->node_id();
+        });
+    sort(keyed_edge_pileups.begin(), keyed_edge_pileups.end());
+    edge_pileups.reserve(keyed_edge_pileups.size());
+    for (auto& p : keyed_edge_pileups) {
+        edge_pileups.push_back(p.second);
+    }
+
+    for (NodePileup* p : node_pileups) {
+        _node_pileups.erase(p->node_id());
+    }
+    for (auto& p : keyed_edge_pileups) {
+        _edge_pileups.erase(p.first);
+    }
+}
+
+void Pileups::flush_below(int64_t node_id, ostream& out, size_t chunk_size) {
+
+    vector<NodePileup*> node_pileups;
+    vector<EdgePileup*> edge_pileups;
+    take_below(node_id, node_pileups, edge_pileups);
+
+    write_chunks(out, node_pileups, edge_pileups, chunk_size);
+
+    for (NodePileup* p : node_pileups) {
+        delete p;
+    }
+    for (EdgePileup* p : edge_pileups) {
+        delete p;
+    }
+}
+
+void Pileups::compute_from_sorted_windows(istream& in, int64_t flush_interval,
+                                          const function<void(int64_t)>& flush) {
+
+    // lowest node ID of the last placed read, and where we last flushed
+    int64_t last_min_id = numeric_limits<int64_t>::min();
+    int64_t last_flush_id = numeric_limits<int64_t>::min();
+
+    function<void(Alignment&)> lambda = [&](Alignment& alignment) {
+        int64_t min_id = numeric_limits<int64_t>::max();
+        for (int i = 0; i < alignment.path().mapping_size(); ++i) {
+            int64_t id = alignment.path().mapping(i).position().node_id();
+            if (id != 0) {
+                min_id = min(min_id, id);
+            }
+        }
+        if (min_id == numeric_limits<int64_t>::max()) {
+            // unplaced reads don't contribute to any pileup
+            return;
+        }
+        if (min_id < last_min_id) {
+            throw runtime_error("[vg::Pileups] alignment " + alignment.name() + " at node " + to_string(min_id) +
+                                " follows one at node " + to_string(last_min_id) + "; GAM must be sorted");
+        }
+        last_min_id = min_id;
+
+        if (last_flush_id == numeric_limits<int64_t>::min()) {
+            last_flush_id = min_id;
+        } else if (min_id - last_flush_id >= flush_interval) {
+            // this read and everything after it only touch nodes at or past
+            // min_id, so everything before it is done
+            flush(min_id);
+            last_flush_id = min_id;
+        }
+
+        compute_from_alignment(alignment);
+    };
+    stream::for_each(in, lambda);
+
+    flush(numeric_limits<int64_t>::max());
+}
+
+void Pileups::compute_from_sorted_alignments(istream& in, ostream& out, int64_t flush_interval,
+                                             size_t chunk_size) {
+
+    compute_from_sorted_windows(in, flush_interval, [&](int64_t node_id) {
+            flush_below(node_id, out, chunk_size);
+        });
     stream::finish(out);
 }
 
+void Pileups::compute_from_sorted_alignments(istream& in, const function<void(NodePileup&)>& node_lambda,
+                                             const function<void(EdgePileup&)>& edge_lambda,
+                                             int64_t flush_interval) {
+
+    vector<NodePileup*> node_pileups;
+    vector<EdgePileup*> edge_pileups;
+    compute_from_sorted_windows(in, flush_interval, [&](int64_t node_id) {
+            take_below(node_id, node_pileups, edge_pileups);
+            for (NodePileup* p : node_pileups) {
+                node_lambda(*p);
+                delete p;
+            }
+            for (EdgePileup* p : edge_pileups) {
+                edge_lambda(*p);
+                delete p;
+            }
+        });
+}
+
 void Pileups::for_each_node_pileup(const function<void(NodePileup&)>& lambda) {
     for (auto& p : _node_pileups) {
         lambda(*p.second);
@@ -585,8 +723,9 @@ BasePileup& Pileups::merge_base_pileups(BasePileup& p1, BasePileup& p2) {
         p1.mutable_bases()->append(p2.bases());
         p1.mutable_qualities()->append(p2.qualities());
     } else if (merge_size > 0) {
+        // we only need to find where the last merged token ends
         vector<pair<int64_t, int64_t> > offsets;
-        parse_base_offsets(p2, offsets);
+        parse_base_offsets(p2, offsets, merge_size + 1);
         int merge_length = offsets[merge_size].first;
         p1.mutable_bases()->append(p2.bases().substr(0, merge_length));
         if (!p2.qualities().empty()) {
@@ -635,7 +774,8 @@ EdgePileup& Pileups::merge_edge_pileups(EdgePileup& p1, EdgePileup& p2) {
 }
 
 void Pileups::parse_base_offsets(const BasePileup& bp,
-                                 vector<pair<int64_t, int64_t> >& offsets) {
+                                 vector<pair<int64_t, int64_t> >& offsets,
+                                 int64_t max_offsets) {
     offsets.clear();
     
     const string& quals = bp.qualities();
@@ -644,7 +784,8 @@ void Pileups::parse_base_offsets(const BasePileup& bp,
     // we can use i to index the quality for the ith row of pileup, but
     // need base_offset to get position of appropriate token in bases string
     int64_t base_offset = 0;
-    for (int i = 0; i < bp.num_bases(); ++i) {
+    int64_t num_offsets = max_offsets < 0 ? bp.num_bases() : min((int64_t)bp.num_bases(), max_offsets);
+    for (int i = 0; i < num_offsets; ++i) {
         // insert
         if (bases[base_offset] == '+') {
             offsets.push_back(make_pair(base_offset, i < quals.length() ? i : -1));
@@ -678,7 +819,7 @@ void Pileups::parse_base_offsets(const BasePileup& bp,
             ++base_offset;
         }
     }
-    assert(base_offset == bases.length());
+    assert(num_offsets < bp.num_bases() || base_offset == bases.length());
 }
 
 // transform case of every character in string
@@ -131,6 +131,44 @@ public:
     /// write to protobuf, with EOF marker
     void write(ostream& out, size_t buffer_size = 5);
 
+    /// write out and delete every node pileup with an ID below node_id, and
+    /// every edge pileup whose lower node ID is below node_id, in ID order.
+    /// No EOF marker is written, so this can be called repeatedly on a stream.
+    void flush_below(int64_t node_id, ostream& out, size_t chunk_size = 5);
+
+    /// write the given pileups out as Pileup records of up to chunk_size
+    /// node and edge pileups each, without an EOF marker
+    static void write_chunks(ostream& out, const vector<NodePileup*>& node_pileups,
+                             const vector<EdgePileup*>& edge_pileups, size_t chunk_size);
+
+    /// Compute pileups from a GAM sorted by lowest node ID (as by vg gamsort),
+    /// writing them to out as soon as no later read can touch them. Finished
+    /// pileups are flushed whenever the reads have moved flush_interval node
+    /// IDs past the last flush, so only a window of the graph is ever held in
+    /// memory. Throws if the reads are out of order. Writes the EOF marker.
+    void compute_from_sorted_alignments(istream& in, ostream& out, int64_t flush_interval = 1000,
+                                        size_t chunk_size = 5);
+
+    /// Compute pileups from a GAM sorted by lowest node ID, like above, but
+    /// hand each pileup to node_lambda or edge_lambda (in ID order, and then
+    /// delete it) as soon as no later read can touch it, instead of
+    /// serializing it.
+    void compute_from_sorted_alignments(istream& in, const function<void(NodePileup&)>& node_lambda,
+                                        const function<void(EdgePileup&)>& edge_lambda,
+                                        int64_t flush_interval = 1000);
+
+    /// remove every node pileup with an ID below node_id, and every edge
+    /// pileup whose lower node ID is below node_id, from the tables, and
+    /// return them in ID order. The caller takes ownership.
+    void take_below(int64_t node_id, vector<NodePileup*>& node_pileups, vector<EdgePileup*>& edge_pileups);
+
+    /// run through a GAM sorted by lowest node ID, adding each read to the
+    /// pileups and calling flush with a node ID whenever the reads have moved
+    /// flush_interval node IDs past the last flush. No later read can touch a
+    /// node below that ID. Throws if the reads are out of order.
+    void compute_from_sorted_windows(istream& in, int64_t flush_interval,
+                                     const function<void(int64_t)>& flush);
+
     /// apply function to each pileup in table
     void for_each_node_pileup(const function<void(NodePileup&)>& lambda);
 
@@ -246,8 +284,10 @@ public:
     /// the bases string in BasePileup doesn't allow random access.  This function
     /// will parse out all the offsets of snps, insertions, and deletions
     /// into one array, each offset is a pair of indexes in the bases and qualities arrays
+    /// (if max_offsets is not negative, stop after that many)
     static void parse_base_offsets(const BasePileup& bp,
-                                   vector<pair<int64_t, int64_t> >& offsets);
+                                   vector<pair<int64_t, int64_t> >& offsets,
+                                   int64_t max_offsets = -1);
 
     /// transform case of every character in string
     static void casify(string& seq, bool is_reverse);
@@ -899,9 +899,11 @@ void PileupAugmenter::create_node_calls(const NodePileup& np) {
 
 void PileupAugmenter::annotate_augmented_node(Node* node, char call, StrandSupport support, int64_t orig_id, int orig_offset)
 {
-    _augmented_graph.node_supports[node].set_forward(support.fs);
-    _augmented_graph.node_supports[node].set_reverse(support.rs);
-    _augmented_graph.node_supports[node].set_quality(support.qual);
+    Support node_support;
+    node_support.set_forward(support.fs);
+    node_support.set_reverse(support.rs);
+    node_support.set_quality(support.qual);
+    _augmented_graph.set_support(node, node_support);
     
     if (orig_id != 0 && call != 'S' && call != 'I') {
         // Add translations for preserved parts
@@ -924,9 +926,11 @@ void PileupAugmenter::annotate_augmented_node(Node* node, char call, StrandSuppo
 
 void PileupAugmenter::annotate_augmented_edge(Edge* edge, char call, StrandSupport support)
 {
-    _augmented_graph.edge_supports[edge].set_forward(support.fs);
-    _augmented_graph.edge_supports[edge].set_reverse(support.rs);
-    _augmented_graph.edge_supports[edge].set_quality(support.qual);
+    Support edge_support;
+    edge_support.set_forward(support.fs);
+    edge_support.set_reverse(support.rs);
+    edge_support.set_quality(support.qual);
+    _augmented_graph.set_support(edge, edge_support);
 }
 
 void PileupAugmenter::annotate_augmented_nodes()
@@ -1,11 +1,44 @@
 #include "progressive.hpp"
 
+#include <chrono>
 #include <iostream>
 
 namespace vg {
 
 using namespace std;
 
+const long Progressive::INCREMENT_BATCH;
+const int Progressive::REDRAW_MILLISECONDS;
+
+/// Hands out the generations of all progress bars.
+static atomic<size_t> next_generation{1};
+
+Progressive::Progressive(const Progressive& other) : show_progress(other.show_progress) {
+    // We don't take over the other object's progress bar
+}
+
+Progressive::Progressive(Progressive&& other) : show_progress(other.show_progress) {
+    // We don't take over the other object's progress bar
+}
+
+Progressive& Progressive::operator=(const Progressive& other) {
+    show_progress = other.show_progress;
+    return *this;
+}
+
+Progressive& Progressive::operator=(Progressive&& other) {
+    show_progress = other.show_progress;
+    return *this;
+}
+
+Progressive::~Progressive() {
+    stop_reporter();
+    if (progress) {
+        delete progress;
+        progress = nullptr;
+    }
+}
+
 void Progressive::create_progress(const string& message, long count) {
     if (show_progress) {
         progress_message = message;
@@ -15,9 +48,11 @@ void Progressive::create_progress(const string& message, long count) {
 
 void Progressive::create_progress(long count) {
     if (show_progress) {
+        stop_reporter();
         progress_count = count;
         last_progress = 0;
-        progress_seen = 0;
+        progress_seen.store(0);
+        progress_generation.store(next_generation.fetch_add(1));
         if (progress) {
             // Get rid of the old one.
             delete progress;
@@ -25,6 +60,9 @@ void Progressive::create_progress(long count) {
         progress_message.resize(30, ' ');
         progress = new ProgressBar(progress_count, progress_message.c_str());
         progress->Progressed(0);
+        
+        reporter_stopping = false;
+        reporter = thread(&Progressive::report_loop, this);
     }
 }
 
@@ -39,52 +77,57 @@ void Progressive::preload_progress(const string& message) {
 
 void Progressive::update_progress(long i) {
     if (show_progress && progress) {
-        if ((i <= progress_count
-             && (long double) (i - last_progress) / (long double) progress_count >= 0.001)
-            || i == progress_count) {
-#pragma omp critical (progress)
-            {
-                progress->Progressed(i);
-                last_progress = i;
-            }
+        // The reporter will draw it
+        progress_seen.store(i, memory_order_relaxed);
+    }
+}
+
+void Progressive::increment_progress() {
+    if (show_progress && progress) {
+        // Each thread holds on to its increments for one bar at a time. If it
+        // moves on to another bar, increments held for the last one are lost,
+        // which only makes that bar lag behind.
+        thread_local size_t batch_generation = 0;
+        thread_local long batch_count = 0;
+        size_t generation = progress_generation.load(memory_order_relaxed);
+        if (batch_generation != generation) {
+            batch_generation = generation;
+            batch_count = 0;
         }
-#pragma omp critical (progress_seen)
-        {
-            // Remember the amout of progress we have seen.
-            progress_seen = i;
+        if (++batch_count >= INCREMENT_BATCH) {
+            progress_seen.fetch_add(batch_count, memory_order_relaxed);
+            batch_count = 0;
         }
     }
 }
 
-void Progressive::increment_progress() {
-#pragma omp critical (increment_progress)
-    {
-        // Only one increment can happen at a time, so we don't get lower values
-        // coming after higher values because the increments and the displays
-        // interleaved.
-
-        // What should we set the progress bar to?
-        size_t new_progress;
-
-#pragma omp critical (progress_seen)
-        {   
-            // We need to synchronize with update calls.
-            
-            // Bump up whatever we have to 1 more than that.
-            new_progress = progress_seen + 1;
+void Progressive::report_loop() {
+    unique_lock<mutex> guard(reporter_lock);
+    while (!reporter_stopping) {
+        reporter_wake.wait_for(guard, chrono::milliseconds(REDRAW_MILLISECONDS));
+        long seen = min(progress_seen.load(memory_order_relaxed), progress_count);
+        if (seen != last_progress) {
+            progress->Progressed(seen);
+            last_progress = seen;
         }
-        
-        // TODO: interleaving updates and increments from different threads will
-        // be weird, and progress may go backward. But that makes no real sense
-        // anyway, so we just have to not explode/deadlock when it happens.
-    
-        update_progress(new_progress);
+    }
+}
+
+void Progressive::stop_reporter() {
+    if (reporter.joinable()) {
+        {
+            lock_guard<mutex> guard(reporter_lock);
+            reporter_stopping = true;
+        }
+        reporter_wake.notify_one();
+        reporter.join();
     }
 }
 
 void Progressive::destroy_progress(void) {
+    stop_reporter();
     if (show_progress && progress) {
-        update_progress(progress_count);
+        progress->Progressed(progress_count);
         cerr << endl;
         progress_message = "progress";
         progress_count = 0;
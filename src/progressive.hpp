@@ -4,7 +4,11 @@
 // progressive.hpp: defines a Progressive mixin class that gives any object a
 // progress bar that can be turned on and off.
 
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
 #include <string>
+#include <thread>
 
 #include "progress_bar.hpp"
 
@@ -17,7 +21,12 @@ using namespace std;
  * update_progress(), and destroy_progress() methods, and a public show_progress
  * field that can be toggled on and off.
  *
- * Must not be destroyed while a progress bar is active.
+ * Progress is counted in an atomic, with increments batched up per thread,
+ * and the bar is drawn a few times a second by a separate reporter thread, so
+ * the update and increment methods are cheap enough to call on every item of
+ * a hot parallel loop.
+ *
+ * Copies get the show_progress setting, but not any progress bar in use.
  */
 class Progressive {
 
@@ -25,6 +34,14 @@ public:
     // Should progress bars be shown when the progress methods are called?
     bool show_progress = false;
     
+    Progressive() = default;
+    Progressive(const Progressive& other);
+    Progressive(Progressive&& other);
+    Progressive& operator=(const Progressive& other);
+    Progressive& operator=(Progressive&& other);
+    /// Stops the progress bar, if one is displayed.
+    ~Progressive();
+    
     /**
      * If no progress bar is currently displayed, set the message to use for
      * the next progress bar to be created. Does nothing if show_progress is
@@ -49,12 +66,14 @@ public:
     void create_progress(long count);
     /**
      * Update the progress bar, noting that the given number of items have been
-     * processed. Does nothing if no progress bar is displayed.
+     * processed. Does nothing if no progress bar is displayed. Thread safe.
      */
     void update_progress(long i);
     /**
      * Update the progress bar, noting that one additional item has been
-     * processed. Does nothing if no progress bar is displayed.
+     * processed. Does nothing if no progress bar is displayed. Thread safe.
+     * Increments are only passed on once a thread has made a batch of them,
+     * so the bar can lag a little behind.
      */
     void increment_progress();
     /**
@@ -63,16 +82,36 @@ public:
     void destroy_progress(void);
     
 private:
+    /// How many increments a thread makes before passing them on.
+    static const long INCREMENT_BATCH = 256;
+    /// How often the reporter thread redraws the bar.
+    static const int REDRAW_MILLISECONDS = 100;
+    
+    /// Draw the bar whenever progress has been made, until we are stopped.
+    void report_loop();
+    
+    /// Stop the reporter thread, if it is running.
+    void stop_reporter();
+    
     string progress_message = "progress";
     // How many total ticks of progress are there?
-    long progress_count;
+    long progress_count = 0;
     // What's the last progress value we displayed?
-    long last_progress;
+    long last_progress = 0;
     // What's the last progress value we've actually seen, either through an
     // explicit update or an increment?
-    long progress_seen;
-    // What;s the actual progress bar renderer we're using?
+    atomic<long> progress_seen{0};
+    // Identifies the current progress bar, so threads can tell if increments
+    // they are holding are for it. Unique across all Progressives.
+    atomic<size_t> progress_generation{0};
+    // What's the actual progress bar renderer we're using?
     ProgressBar* progress = nullptr;
+    
+    // The thread drawing the bar, and how to tell it to stop
+    thread reporter;
+    mutex reporter_lock;
+    condition_variable reporter_wake;
+    bool reporter_stopping = false;
 };
 
 }
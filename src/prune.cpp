@@ -1,100 +1,199 @@
 #include "prune.hpp"
+#include "algorithms/weakly_connected_components.hpp"
+#include "algorithms/apply_bulk_modifications.hpp"
+
+#include <algorithm>
+#include <tuple>
+#include <unordered_set>
+
+#include <omp.h>
 
 namespace vg {
 
-vector<edge_t> find_edges_to_prune(const HandleGraph& graph, size_t k, size_t edge_max) {
-    // for each position on the forward and reverse of the graph
-    //unordered_set<edge_t> edges_to_prune;
-    vector<vector<edge_t> > edges_to_prune;
-    edges_to_prune.resize(get_thread_count());
-    graph.for_each_handle([&](const handle_t& h) {
-            // for the forward and reverse of this handle
-            // walk k bases from the end, so that any kmer starting on the node will be represented in the tree we build
-            for (auto handle_is_rev : { false, true }) {
-                //cerr << "###########################################" << endl;
-                handle_t handle = handle_is_rev ? graph.flip(h) : h;
-                list<walk_t> walks;
-                // for each position in the node, set up a kmer with that start position and the node end or kmer length as the end position
-                // determine next positions
-                id_t handle_id = graph.get_id(handle);
-                size_t handle_length = graph.get_length(handle);
-                string handle_seq = graph.get_sequence(handle);
-                for (size_t i = 0; i < handle_length;  ++i) {
-                    pos_t begin = make_pos_t(handle_id, handle_is_rev, handle_length);
-                    pos_t end = make_pos_t(handle_id, handle_is_rev, min(handle_length, i+k));
-                    walk_t walk = walk_t(offset(end)-offset(begin), begin, end, handle, 0);
-                    if (walk.length < k) {
-                        // are we branching over more than one edge?
-                        size_t next_count = 0;
-                        graph.follow_edges(walk.curr, false, [&](const handle_t& next) { ++next_count; });
-                        graph.follow_edges(walk.curr, false, [&](const handle_t& next) {
-                                if (next_count > 1 && edge_max == walk.forks) { // our next step takes us over the max
-                                    int tid = omp_get_thread_num();
-                                    edges_to_prune[tid].push_back(graph.edge_handle(walk.curr, next));
-                                } else {
-                                    walks.push_back(walk);
-                                    auto& todo = walks.back();
-                                    todo.curr = next;
-                                    if (next_count > 1) {
-                                        ++todo.forks;
-                                    }
-                                }
-                            });
-                    } else {
+/// Walk out up to k bases from the end of the given handle, adding any edges
+/// that would take a walk over more than edge_max branching edge crossings to
+/// edges_to_prune. The seen set is scratch space, used to avoid extending the
+/// same (handle, length, forks) state twice when walks reconverge.
+static void find_edges_to_prune_from(const HandleGraph& graph, const handle_t& handle, size_t k, size_t edge_max,
+                                     unordered_set<tuple<int64_t, uint16_t, uint16_t>>& seen,
+                                     vector<edge_t>& edges_to_prune) {
+    // Every kmer starting on the node that leaves the node has the node's end
+    // in it, and walks the rest of its length from there. So we can start one
+    // walk at the end of the handle and know it covers all of them.
+    id_t handle_id = graph.get_id(handle);
+    bool handle_is_rev = graph.get_is_reverse(handle);
+    size_t handle_length = graph.get_length(handle);
+    pos_t handle_end = make_pos_t(handle_id, handle_is_rev, handle_length);
+
+    seen.clear();
+    vector<walk_t> walks;
+
+    // Take the walk over the edges out of its current handle, or prune those
+    // edges if they would put it over the branching limit.
+    auto follow = [&](const walk_t& walk) {
+        size_t next_count = 0;
+        graph.follow_edges(walk.curr, false, [&](const handle_t& next) { ++next_count; });
+        graph.follow_edges(walk.curr, false, [&](const handle_t& next) {
+                if (next_count > 1 && edge_max == walk.forks) { // our next step takes us over the max
+                    edges_to_prune.push_back(graph.edge_handle(walk.curr, next));
+                } else {
+                    uint16_t forks = walk.forks + (next_count > 1 ? 1 : 0);
+                    if (seen.emplace(as_integer(next), walk.length, forks).second) {
+                        // Nobody else has been here with this much of the kmer left to go.
                         walks.push_back(walk);
+                        walks.back().curr = next;
+                        walks.back().forks = forks;
                     }
                 }
-                // now expand the kmers until they reach k
-                while (!walks.empty()) {
-                    // first we check which ones have reached length k in the current handle; for each of these we run lambda and remove them from our list
-                    auto walks_end = walks.end();
-                    for (list<walk_t>::iterator q = walks.begin(); q != walks_end; ++q) {
-                        auto& walk = *q;
-                        // did we reach our target length?
-                        if (walk.length >= k) {
-                            q = walks.erase(q);
-                        } else {
-                            id_t curr_id = graph.get_id(walk.curr);
-                            size_t curr_length = graph.get_length(walk.curr);
-                            bool curr_is_rev = graph.get_is_reverse(walk.curr);
-                            size_t take = min(curr_length, k-walk.length);
-                            walk.end = make_pos_t(curr_id, curr_is_rev, take);
-                            walk.length += take;
-                            if (walk.length < k) {
-                                // if not, we need to expand through the node then follow on
-                                size_t next_count = 0;
-                                graph.follow_edges(walk.curr, false, [&](const handle_t& next) { ++next_count; });
-                                graph.follow_edges(walk.curr, false, [&](const handle_t& next) {
-                                        if (next_count > 1 && edge_max == walk.forks) { // our next step takes us over the max
-                                            int tid = omp_get_thread_num();
-                                            edges_to_prune[tid].push_back(graph.edge_handle(walk.curr, next));
-                                        } else {
-                                            walks.push_back(walk);
-                                            auto& todo = walks.back();
-                                            todo.curr = next;
-                                            if (next_count > 1) {
-                                                ++todo.forks;
-                                            }
-                                        }
-                                    });
-                                q = walks.erase(q);
-                            } else {
-                                // nothing, we'll remove it next time around
-                            }
-                        }
-                    }
-                }
-            }
-        }, true);
+            });
+    };
+
+    follow(walk_t(0, handle_end, handle_end, handle, 0));
+
+    // now expand the kmers until they reach k
+    while (!walks.empty()) {
+        walk_t walk = walks.back();
+        walks.pop_back();
+        id_t curr_id = graph.get_id(walk.curr);
+        size_t curr_length = graph.get_length(walk.curr);
+        bool curr_is_rev = graph.get_is_reverse(walk.curr);
+        size_t take = min(curr_length, k - walk.length);
+        walk.end = make_pos_t(curr_id, curr_is_rev, take);
+        walk.length += take;
+        if (walk.length < k) {
+            // if not, we need to expand through the node then follow on
+            follow(walk);
+        }
+    }
+}
+
+/// Sort the edges found by all the threads into one list without duplicates.
+static vector<edge_t> merge_edges_to_prune(vector<vector<edge_t>>& edges_to_prune) {
     uint64_t total_edges = 0;
     for (auto& v : edges_to_prune) total_edges += v.size();
     vector<edge_t> merged; merged.reserve(total_edges);
     for (auto& v : edges_to_prune) {
         merged.insert(merged.end(), v.begin(), v.end());
+        vector<edge_t>().swap(v);
     }
-    // duplicates are assumed to be dealt with externally
+    auto edge_integers = [](const edge_t& e) {
+        return make_pair(as_integer(e.first), as_integer(e.second));
+    };
+    sort(merged.begin(), merged.end(), [&](const edge_t& a, const edge_t& b) {
+            return edge_integers(a) < edge_integers(b);
+        });
+    merged.erase(unique(merged.begin(), merged.end()), merged.end());
     return merged;
 }
 
+vector<edge_t> find_edges_to_prune(const HandleGraph& graph, size_t k, size_t edge_max) {
+    // Each thread collects edges and keeps walk scratch space of its own.
+    vector<vector<edge_t>> edges_to_prune(get_thread_count());
+    vector<unordered_set<tuple<int64_t, uint16_t, uint16_t>>> seen(get_thread_count());
+    graph.for_each_handle([&](const handle_t& h) {
+            int tid = omp_get_thread_num();
+            // for the forward and reverse of this handle
+            for (auto handle_is_rev : { false, true }) {
+                handle_t handle = handle_is_rev ? graph.flip(h) : h;
+                find_edges_to_prune_from(graph, handle, k, edge_max, seen[tid], edges_to_prune[tid]);
+            }
+        }, true);
+    return merge_edges_to_prune(edges_to_prune);
+}
+
+void for_each_component_edges_to_prune(const HandleGraph& graph, size_t k, size_t edge_max,
+                                       const function<void(const vector<edge_t>&)>& lambda) {
+    vector<unordered_set<tuple<int64_t, uint16_t, uint16_t>>> seen(get_thread_count());
+    for (auto& component : algorithms::weakly_connected_components(&graph)) {
+        // OpenMP wants random access, so lay the component's nodes out in order.
+        vector<id_t> ids(component.begin(), component.end());
+        unordered_set<id_t>().swap(component);
+        sort(ids.begin(), ids.end());
+
+        vector<vector<edge_t>> edges_to_prune(get_thread_count());
+#pragma omp parallel for schedule(dynamic, 128)
+        for (size_t i = 0; i < ids.size(); i++) {
+            int tid = omp_get_thread_num();
+            for (auto handle_is_rev : { false, true }) {
+                handle_t handle = graph.get_handle(ids[i], handle_is_rev);
+                find_edges_to_prune_from(graph, handle, k, edge_max, seen[tid], edges_to_prune[tid]);
+            }
+        }
+        lambda(merge_edges_to_prune(edges_to_prune));
+    }
+}
+
+PruningPlan plan_pruning(const HandleGraph& graph, size_t k, size_t edge_max, size_t max_degree,
+                         size_t min_component_length) {
+    PruningPlan plan;
+    
+    // Look at each node once, taking its degree and its walks together
+    vector<vector<edge_t>> edges_to_prune(get_thread_count());
+    vector<vector<id_t>> high_degree(get_thread_count());
+    vector<unordered_set<tuple<int64_t, uint16_t, uint16_t>>> seen(get_thread_count());
+    graph.for_each_handle([&](const handle_t& h) {
+            int tid = omp_get_thread_num();
+            if (max_degree) {
+                size_t degree = 0;
+                graph.follow_edges(h, false, [&](const handle_t& ignored) { ++degree; });
+                graph.follow_edges(h, true, [&](const handle_t& ignored) { ++degree; });
+                if (degree > max_degree) {
+                    high_degree[tid].push_back(graph.get_id(h));
+                }
+            }
+            for (auto handle_is_rev : { false, true }) {
+                handle_t handle = handle_is_rev ? graph.flip(h) : h;
+                find_edges_to_prune_from(graph, handle, k, edge_max, seen[tid], edges_to_prune[tid]);
+            }
+        }, true);
+    plan.complex_edges = merge_edges_to_prune(edges_to_prune);
+    for (auto& ids : high_degree) {
+        plan.high_degree_nodes.insert(plan.high_degree_nodes.end(), ids.begin(), ids.end());
+    }
+    sort(plan.high_degree_nodes.begin(), plan.high_degree_nodes.end());
+    
+    if (min_component_length) {
+        // Find the components that will be left, without making the graph they will be left in
+        auto edge_integers = [](const edge_t& e) {
+            return make_pair(as_integer(e.first), as_integer(e.second));
+        };
+        auto removed = [&](id_t id) {
+            return binary_search(plan.high_degree_nodes.begin(), plan.high_degree_nodes.end(), id);
+        };
+        vector<id_t> ids;
+        size_t component_count;
+        vector<size_t> labels = algorithms::weakly_connected_component_labels(&graph, ids, &component_count,
+            [&](const handle_t& from, const handle_t& to) {
+                if (removed(graph.get_id(from)) || removed(graph.get_id(to))) {
+                    return false;
+                }
+                edge_t edge = graph.edge_handle(from, to);
+                return !binary_search(plan.complex_edges.begin(), plan.complex_edges.end(), edge,
+                                      [&](const edge_t& a, const edge_t& b) {
+                                          return edge_integers(a) < edge_integers(b);
+                                      });
+            });
+        
+        vector<size_t> component_length(component_count, 0);
+        for (size_t i = 0; i < ids.size(); i++) {
+            component_length[labels[i]] += graph.get_length(graph.get_handle(ids[i]));
+        }
+        for (size_t i = 0; i < ids.size(); i++) {
+            if (component_length[labels[i]] < min_component_length && !removed(ids[i])) {
+                plan.small_component_nodes.push_back(ids[i]);
+            }
+        }
+    }
+    
+    return plan;
+}
+
+void apply_pruning(MutableHandleGraph& graph, const PruningPlan& plan) {
+    vector<id_t> nodes;
+    nodes.reserve(plan.high_degree_nodes.size() + plan.small_component_nodes.size());
+    nodes.insert(nodes.end(), plan.high_degree_nodes.begin(), plan.high_degree_nodes.end());
+    nodes.insert(nodes.end(), plan.small_component_nodes.begin(), plan.small_component_nodes.end());
+    algorithms::apply_removals(&graph, plan.complex_edges, nodes);
+}
 
 }
@@ -3,6 +3,8 @@
 
 #include "vg.pb.h"
 #include <iostream>
+#include <functional>
+#include <vector>
 #include "json2pb.h"
 #include "handle.hpp"
 #include "position.hpp"
@@ -31,9 +33,43 @@ struct walk_t {
     uint16_t length; /// how far we've been
 };
 
-/// Iterate over all the walks up to length k, adding edges which 
+/// Iterate over all the walks up to length k, adding edges which would take a
+/// walk over more than edge_max branching edge crossings. Works on the nodes
+/// in parallel. Each edge is reported once.
 vector<edge_t> find_edges_to_prune(const HandleGraph& graph, size_t k, size_t edge_max);
 
+/// Like find_edges_to_prune(), but goes through the weakly connected
+/// components of the graph one at a time, calling the lambda with the edges
+/// to prune in each before moving on to the next. Only one component's edges
+/// are held at once, and the lambda may destroy them, since no later
+/// component can reach them.
+void for_each_component_edges_to_prune(const HandleGraph& graph, size_t k, size_t edge_max,
+                                       const function<void(const vector<edge_t>&)>& lambda);
+
+/// Everything to remove from a graph to prune it, found in one pass.
+struct PruningPlan {
+    /// Nodes with more edges than the degree limit
+    vector<id_t> high_degree_nodes;
+    /// Edges that would take a kmer walk over more than edge_max branching
+    /// edge crossings
+    vector<edge_t> complex_edges;
+    /// Nodes in components with less than the minimum amount of sequence once
+    /// the nodes and edges above are gone
+    vector<id_t> small_component_nodes;
+};
+
+/// Find the high-degree nodes, complex edges, and small components to prune
+/// from the graph in one parallel pass over its nodes, instead of one pass
+/// per pruning step. Each node's degree is measured and its kmer walks are
+/// taken in the same visit, both on the unpruned graph, so walks can pass
+/// through the high-degree nodes; set max_degree to 0 to keep all nodes, and
+/// min_component_length to 0 to keep all components.
+PruningPlan plan_pruning(const HandleGraph& graph, size_t k, size_t edge_max, size_t max_degree,
+                         size_t min_component_length);
+
+/// Remove everything in the plan from the graph in one batch.
+void apply_pruning(MutableHandleGraph& graph, const PruningPlan& plan);
+
 }
 
 #endif
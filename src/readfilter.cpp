@@ -518,6 +518,11 @@ int ReadFilter::filter(istream* alignment_stream, xg::XG* xindex) {
         return 1;
     }
     
+    if (drop_split && xindex != nullptr) {
+        // Checking for splits looks up every edge every read crosses
+        xindex->index_edges();
+    }
+    
     if (regions.empty()) {
         // empty region, do everything
         // we handle empty intervals as special case when looking up, otherwise,
@@ -592,12 +597,9 @@ int ReadFilter::filter(istream* alignment_stream, xg::XG* xindex) {
         }
     };
 
-    // buffered output (one buffer per chunk), one set of chunks per thread
-    // buffer[THREAD][CHUNK] = vector<Alignment>
-    vector<vector<vector<Alignment> > > buffer(threads);
-    for (int i = 0; i < buffer.size(); ++i) {
-        buffer[i].resize(chunk_names.size());
-    }
+    // buffered output (one buffer per chunk). Records are kept as their
+    // serialized bytes, so the ones we don't change are never re-encoded.
+    vector<vector<stream::RawMessage> > buffer(chunk_names.size());
     
     static const int buffer_size = 1000; // we let this be off by 1
 
@@ -606,49 +608,34 @@ int ReadFilter::filter(istream* alignment_stream, xg::XG* xindex) {
 
     // flush a buffer specified by cur_buffer to target in chunk_names, and clear it.
     // if end is true, write an EOF marker
-    function<void(int, int, bool)> flush_buffer = [&buffer, &chunk_names, &chunk_append](int tid, int cur_buffer, bool end) {
+    function<void(int, bool)> flush_buffer = [&buffer, &chunk_names, &chunk_append](int cur_buffer, bool end) {
         ofstream outfile;
         auto& outbuf = chunk_names[cur_buffer] == "-" ? cout : outfile;
         if (chunk_names[cur_buffer] != "-") {
             outfile.open(chunk_names[cur_buffer], chunk_append[cur_buffer] ? ios::app : ios_base::out);
             chunk_append[cur_buffer] = true;
         }
-        function<Alignment&(size_t)> write_buffer = [&buffer, &tid, &cur_buffer](size_t i) -> Alignment& {
-            return buffer[tid][cur_buffer][i];
+        function<stream::RawMessage&(size_t)> write_buffer = [&buffer, &cur_buffer](size_t i) -> stream::RawMessage& {
+            return buffer[cur_buffer][i];
         };
-        stream::write(outbuf, buffer[tid][cur_buffer].size(), write_buffer);
+        stream::write(outbuf, buffer[cur_buffer].size(), write_buffer);
         if (end) {
             stream::finish(outbuf);
         }
-        buffer[tid][cur_buffer].clear();
-    };
-
-    // add alignment to all appropriate buffers, flushing as necessary
-    function<void(int, Alignment&, const vector<int>&)> update_buffers = [
-        &buffer, &region_map, &get_chunks, &flush_buffer](int tid, Alignment& aln,
-                                                          const vector<int>& aln_chunks) {
-        for (auto chunk : aln_chunks) {
-            buffer[tid][chunk].push_back(aln);
-            if (buffer[tid][chunk].size() >= buffer_size) {
-                // flush buffer (could get fancier and allow parallel writes to different
-                // files, but unlikely to be worth effort as we're mostly trying to
-                // speed up defray and not write IO)
-#pragma omp critical (ReadFilter_flush_buffer)
-                {
-                    flush_buffer(tid, chunk, false);
-                }
-            }
-        }
+        buffer[cur_buffer].clear();
     };
 
     // keep counts of what's filtered to report (in verbose mode)
-    vector<Counts> counts_vec(threads);
+    vector<Counts> counts_vec(max(threads, omp_get_max_threads()));
             
+    // decide whether to keep an alignment, and find the chunks it goes to.
+    // modified is set if the alignment was changed and needs to be re-serialized.
     // we assume that every primary alignment has 0 or 1 secondary alignment
     // immediately following in the stream
-    function<void(Alignment&)> lambda = [&](Alignment& aln) {
-        int tid = omp_get_thread_num();        
-        Counts& counts = counts_vec[tid];
+    function<bool(Alignment&, Counts&, vector<int>&, bool&)> check_alignment = [&](Alignment& aln, Counts& counts,
+                                                                                   vector<int>& aln_chunks,
+                                                                                   bool& modified) {
+        modified = false;
         double score = (double)aln.score();
         double denom = aln.sequence().length();
         // toggle substitution score
@@ -662,7 +649,9 @@ int ReadFilter::filter(istream* alignment_stream, xg::XG* xindex) {
             BaseAligner* aligner = (BaseAligner*)&unadjusted;
             
             // Rescore and assign the score
-            aln.set_score(aligner->score_ungapped_alignment(aln));
+            int32_t new_score = aligner->score_ungapped_alignment(aln);
+            modified = modified || new_score != aln.score();
+            aln.set_score(new_score);
             // Also use the score
             score = aln.score();
         }
@@ -774,7 +763,6 @@ int ReadFilter::filter(istream* alignment_stream, xg::XG* xindex) {
         }
 
         // do region check before heavier filters
-        vector<int> aln_chunks;
         if (keep || verbose) {
             get_chunks(aln, aln_chunks);
             if (aln_chunks.empty()) {
@@ -793,6 +781,7 @@ int ReadFilter::filter(istream* alignment_stream, xg::XG* xindex) {
         if ((keep || verbose) && defray_length && trim_ambiguous_ends(xindex, aln, defray_length)) {
             ++counts.defray[co];
             // We keep these, because the alignments get modified.
+            modified = true;
         }
         if ((keep || verbose) && downsample_probability != 1.0 && !sample_read(aln)) {
             ++counts.random[co];
@@ -802,19 +791,65 @@ int ReadFilter::filter(istream* alignment_stream, xg::XG* xindex) {
             ++counts.filtered[co];
         }
 
-        // add to write buffer
-        if (keep) {
-            update_buffers(tid, aln, aln_chunks);
-        }
+        return keep;
     };
-    stream::for_each_parallel(*alignment_stream, lambda);
-
-    for (int tid = 0; tid < buffer.size(); ++tid) {
-        for (int chunk = 0; chunk < buffer[tid].size(); ++chunk) {
-            // Give every chunk, even those going to standard out or with no buffered reads, an EOF marker.
-            // This also makes sure empty chunks exist.
-            flush_buffer(tid, chunk, true);
+    
+    // Read the records in batches, check each batch on all the threads, and
+    // then write out the survivors in their input order.
+    size_t batch_size = 1000 * max(threads, 1);
+    vector<Alignment> alns;
+    vector<vector<int> > batch_chunks;
+    stream::for_each_in_batches<stream::RawMessage>(*alignment_stream, batch_size,
+                                                    [&](int64_t virtual_offset, vector<stream::RawMessage>& batch) {
+        alns.resize(batch.size());
+        batch_chunks.resize(batch.size());
+        // vector<bool> elements can't be written from different threads
+        vector<char> keep(batch.size());
+        bool parsed = true;
+#pragma omp parallel for schedule(dynamic, 64)
+        for (size_t i = 0; i < batch.size(); i++) {
+            Alignment& aln = alns[i];
+            aln.Clear();
+            if (!batch[i].data.empty() && !aln.ParseFromString(batch[i].data)) {
+#pragma omp atomic write
+                parsed = false;
+                continue;
+            }
+            batch_chunks[i].clear();
+            bool modified;
+            keep[i] = check_alignment(aln, counts_vec[omp_get_thread_num()], batch_chunks[i], modified);
+            if (keep[i] && modified) {
+                // Only changed records get encoded again
+                aln.SerializeToString(&batch[i].data);
+            }
+        }
+        if (!parsed) {
+            throw runtime_error("[vg filter] obsolete, invalid, or corrupt GAM input");
         }
+        
+        // add to write buffers, flushing as necessary
+        for (size_t i = 0; i < batch.size(); i++) {
+            if (!keep[i]) {
+                continue;
+            }
+            for (size_t j = 0; j < batch_chunks[i].size(); j++) {
+                int chunk = batch_chunks[i][j];
+                if (j + 1 == batch_chunks[i].size()) {
+                    buffer[chunk].emplace_back(move(batch[i]));
+                } else {
+                    buffer[chunk].push_back(batch[i]);
+                }
+                if (buffer[chunk].size() >= buffer_size) {
+                    flush_buffer(chunk, false);
+                }
+            }
+        }
+    });
+
+    for (int chunk = 0; chunk < buffer.size(); ++chunk) {
+        // Give every chunk, even those going to standard out or with no buffered reads, an EOF marker.
+        // This also makes sure empty chunks exist.
+        flush_buffer(chunk, true);
     }
 
     if (verbose) {
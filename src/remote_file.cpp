@@ -0,0 +1,266 @@
+#include "remote_file.hpp"
+
+#include <unistd.h>
+
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+/**
+ * \file remote_file.cpp: implementation of streams over remote files
+ */
+
+namespace vg {
+
+using namespace std;
+
+bool is_remote_file(const string& file_name) {
+    size_t scheme_end = file_name.find("://");
+    if (scheme_end == string::npos || scheme_end == 0) {
+        return false;
+    }
+    for (size_t i = 0; i < scheme_end; i++) {
+        char c = file_name[i];
+        if (!isalnum(c) && c != '+' && c != '-' && c != '.') {
+            return false;
+        }
+    }
+    return file_name.compare(0, scheme_end, "file") != 0;
+}
+
+/// Get the remote cache directory setting, which is read from the environment
+/// the first time it is needed.
+static string& remote_cache_dir() {
+    static string dir = getenv("VG_REMOTE_CACHE") == nullptr ? "" : getenv("VG_REMOTE_CACHE");
+    return dir;
+}
+
+/// Guards the remote cache directory setting
+static mutex remote_cache_dir_mutex;
+
+void set_remote_cache_dir(const string& dir) {
+    lock_guard<mutex> lock(remote_cache_dir_mutex);
+    remote_cache_dir() = dir;
+}
+
+string get_remote_cache_dir() {
+    lock_guard<mutex> lock(remote_cache_dir_mutex);
+    return remote_cache_dir();
+}
+
+RemoteFileBuf::RemoteFileBuf(const string& url, size_t parallel_parts, size_t block_size) :
+    url(url), parallel_parts(max(parallel_parts, (size_t) 1)), block_size(block_size) {
+
+    file = hopen(url.c_str(), "r");
+
+    string cache_dir = get_remote_cache_dir();
+    if (!cache_dir.empty()) {
+        // Blocks are filed under a hash of the URL
+        stringstream prefix;
+        prefix << cache_dir << "/" << hex << std::hash<string>()(url) << ".";
+        cache_prefix = prefix.str();
+    }
+}
+
+RemoteFileBuf::~RemoteFileBuf() {
+    // Wait for the background fetches before their handles go away
+    read_ahead.clear();
+    if (file != nullptr) {
+        hclose(file);
+    }
+}
+
+bool RemoteFileBuf::is_open() const {
+    return file != nullptr;
+}
+
+hFILE* RemoteFileBuf::open_handle() const {
+    hFILE* handle = hopen(url.c_str(), "r");
+    if (handle == nullptr) {
+        throw runtime_error("could not open remote file " + url);
+    }
+    return handle;
+}
+
+vector<char> RemoteFileBuf::fetch_block(hFILE* from, size_t block) const {
+    string cache_name = cache_prefix.empty() ? "" : cache_prefix + to_string(block);
+    if (!cache_name.empty()) {
+        ifstream cached(cache_name, ios::binary);
+        if (cached) {
+            return vector<char>((istreambuf_iterator<char>(cached)), istreambuf_iterator<char>());
+        }
+    }
+
+    if (hseek(from, (off_t) (block * block_size), SEEK_SET) < 0) {
+        throw runtime_error("could not seek to block " + to_string(block) + " of remote file " + url);
+    }
+    vector<char> data(block_size);
+    size_t fetched = 0;
+    while (fetched < block_size) {
+        ssize_t read = hread(from, data.data() + fetched, block_size - fetched);
+        if (read < 0) {
+            throw runtime_error("could not read block " + to_string(block) + " of remote file " + url);
+        }
+        if (read == 0) {
+            // We hit the end of the file
+            break;
+        }
+        fetched += read;
+    }
+    data.resize(fetched);
+
+    if (!cache_name.empty() && !data.empty()) {
+        // Write the block under a name of our own and move it into place, so
+        // nobody ever reads a partial block
+        stringstream temp_name;
+        temp_name << cache_name << ".part." << getpid() << "." << std::hash<thread::id>()(this_thread::get_id());
+        ofstream cache_out(temp_name.str(), ios::binary);
+        cache_out.write(data.data(), data.size());
+        cache_out.close();
+        if (!cache_out || rename(temp_name.str().c_str(), cache_name.c_str()) != 0) {
+            // The cache is just an optimization
+            remove(temp_name.str().c_str());
+        }
+    }
+
+    return data;
+}
+
+int64_t RemoteFileBuf::length() {
+    if (file_length == -2) {
+        // Fetches always seek first, so we don't need to go back
+        off_t end = hseek(file, 0, SEEK_END);
+        file_length = end < 0 ? -1 : end;
+    }
+    return file_length;
+}
+
+bool RemoteFileBuf::load_block(size_t block) {
+    bool sequential = have_block ? block == current_block + 1 : block == 0;
+
+    // Forget about fetches we're not going to get to
+    for (auto it = read_ahead.begin(); it != read_ahead.end();) {
+        if (it->first < block || it->first >= block + parallel_parts) {
+            it = read_ahead.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    vector<char> data;
+    auto fetching = read_ahead.find(block);
+    if (fetching != read_ahead.end()) {
+        data = fetching->second.get();
+        read_ahead.erase(fetching);
+    } else {
+        data = fetch_block(file, block);
+    }
+
+    if (sequential && parallel_parts > 1) {
+        // Keep the next blocks coming, each over its own connection
+        int64_t file_length = length();
+        for (size_t next = block + 1; next < block + parallel_parts; next++) {
+            if (file_length >= 0 && next * block_size >= (size_t) file_length) {
+                break;
+            }
+            if (!read_ahead.count(next)) {
+                read_ahead[next] = async(launch::async, [this, next]() {
+                    hFILE* handle = open_handle();
+                    try {
+                        vector<char> fetched = fetch_block(handle, next);
+                        hclose(handle);
+                        return fetched;
+                    } catch (...) {
+                        hclose(handle);
+                        throw;
+                    }
+                });
+            }
+        }
+    }
+
+    buffer = move(data);
+    current_block = block;
+    have_block = true;
+    setg(buffer.data(), buffer.data(), buffer.data() + buffer.size());
+    return !buffer.empty();
+}
+
+RemoteFileBuf::int_type RemoteFileBuf::underflow() {
+    if (gptr() < egptr()) {
+        return traits_type::to_int_type(*gptr());
+    }
+    if (file == nullptr || (have_block && buffer.size() < block_size)) {
+        // A short block is the last one
+        return traits_type::eof();
+    }
+    if (!load_block(have_block ? current_block + 1 : 0)) {
+        return traits_type::eof();
+    }
+    return traits_type::to_int_type(*gptr());
+}
+
+RemoteFileBuf::pos_type RemoteFileBuf::seekoff(off_type off, ios_base::seekdir dir, ios_base::openmode which) {
+    off_type position;
+    if (dir == ios_base::beg) {
+        position = off;
+    } else if (dir == ios_base::cur) {
+        position = (have_block ? current_block * block_size + (gptr() - eback()) : 0) + off;
+    } else {
+        int64_t file_length = length();
+        if (file_length < 0) {
+            return pos_type(off_type(-1));
+        }
+        position = file_length + off;
+    }
+    return seekpos(pos_type(position), which);
+}
+
+RemoteFileBuf::pos_type RemoteFileBuf::seekpos(pos_type pos, ios_base::openmode which) {
+    off_type position = pos;
+    if (!(which & ios_base::in) || position < 0 || file == nullptr) {
+        return pos_type(off_type(-1));
+    }
+    size_t block = position / block_size;
+    size_t offset = position % block_size;
+    if (!have_block || block != current_block) {
+        try {
+            load_block(block);
+        } catch (const runtime_error& e) {
+            return pos_type(off_type(-1));
+        }
+    }
+    if (offset > buffer.size()) {
+        // Past the end of the file
+        return pos_type(off_type(-1));
+    }
+    setg(buffer.data(), buffer.data() + offset, buffer.data() + buffer.size());
+    return pos;
+}
+
+RemoteInputStream::RemoteInputStream(const string& url, size_t parallel_parts) :
+    istream(nullptr), buf(url, parallel_parts) {
+    rdbuf(&buf);
+    if (!buf.is_open()) {
+        setstate(ios::failbit);
+    }
+}
+
+bool RemoteInputStream::is_open() const {
+    return buf.is_open();
+}
+
+unique_ptr<istream> open_input_file(const string& file_name, size_t parallel_parts) {
+    if (is_remote_file(file_name)) {
+        return unique_ptr<istream>(new RemoteInputStream(file_name, parallel_parts));
+    }
+    return unique_ptr<istream>(new ifstream(file_name));
+}
+
+}
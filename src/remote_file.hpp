@@ -0,0 +1,126 @@
+#ifndef VG_REMOTE_FILE_HPP_INCLUDED
+#define VG_REMOTE_FILE_HPP_INCLUDED
+
+/** \file
+ * Input streams over files in object storage or on web servers, read through
+ * htslib's hFILE layer, so that indexes and GAMs can be loaded without first
+ * copying them to local disk.
+ */
+
+#include <cstdint>
+#include <future>
+#include <istream>
+#include <map>
+#include <memory>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+#include <htslib/hfile.h>
+
+namespace vg {
+
+using namespace std;
+
+/// Return true if the given file name is a URL that htslib has to fetch
+/// (like s3://, gs://, or https://), and false if it is a local file.
+bool is_remote_file(const string& file_name);
+
+/// Set the directory in which blocks of remote files are cached, or "" to not
+/// cache them. Defaults to the VG_REMOTE_CACHE environment variable. Cached
+/// blocks are assumed to stay valid, so remote files must not change.
+void set_remote_cache_dir(const string& dir);
+
+/// Get the directory in which blocks of remote files are cached, or "" if they
+/// aren't cached.
+string get_remote_cache_dir();
+
+/**
+ * A read-only, seekable stream buffer over a file that htslib can open. The
+ * file is read in blocks. Reading sequentially fetches the next few blocks
+ * in parallel in the background, so whole indexes load at the speed of
+ * several connections. Seeking to a position fetches only the block there,
+ * so queries through a GAMIndex only download the parts of the GAM they
+ * need. Blocks are kept in the remote cache directory, if there is one.
+ */
+class RemoteFileBuf : public streambuf {
+public:
+    /// The default size of the blocks fetched at a time
+    static const size_t DEFAULT_BLOCK_SIZE = 4 * 1024 * 1024;
+
+    /// Open the file at the given URL. Reading sequentially will keep up to
+    /// parallel_parts blocks downloading at once.
+    RemoteFileBuf(const string& url, size_t parallel_parts = 1, size_t block_size = DEFAULT_BLOCK_SIZE);
+
+    ~RemoteFileBuf();
+
+    RemoteFileBuf(const RemoteFileBuf& other) = delete;
+    RemoteFileBuf& operator=(const RemoteFileBuf& other) = delete;
+
+    /// Return true if the file could be opened.
+    bool is_open() const;
+
+protected:
+    int_type underflow();
+    pos_type seekoff(off_type off, ios_base::seekdir dir, ios_base::openmode which);
+    pos_type seekpos(pos_type pos, ios_base::openmode which);
+
+private:
+    /// Get the data of a block, from the cache if it is there. Uses the given
+    /// hFILE if it has to fetch it. Throws a runtime_error on read errors.
+    vector<char> fetch_block(hFILE* from, size_t block) const;
+
+    /// Open a new handle to fetch blocks in the background on. Throws a
+    /// runtime_error if the file can't be opened.
+    hFILE* open_handle() const;
+
+    /// Make the given block the current one, starting background fetches of
+    /// the blocks after it if we are reading sequentially. Returns false if
+    /// the block is past the end of the file.
+    bool load_block(size_t block);
+
+    /// Get the file's length, or -1 if it can't be determined.
+    int64_t length();
+
+    string url;
+    size_t parallel_parts;
+    size_t block_size;
+    /// Where we cache blocks for this file, or "" if we don't
+    string cache_prefix;
+
+    /// Handle for fetches on the reading thread
+    hFILE* file = nullptr;
+    /// The length of the file, -1 if it is unknown, or -2 if not yet checked
+    int64_t file_length = -2;
+
+    /// The block in buffer, and whether there is one
+    size_t current_block = 0;
+    bool have_block = false;
+    vector<char> buffer;
+
+    /// Blocks being fetched ahead of the reader
+    map<size_t, future<vector<char>>> read_ahead;
+};
+
+/**
+ * An input stream reading a remote file through a RemoteFileBuf. Fails to
+ * open, like an ifstream, if the file isn't there.
+ */
+class RemoteInputStream : public istream {
+public:
+    RemoteInputStream(const string& url, size_t parallel_parts = 1);
+
+    bool is_open() const;
+
+private:
+    RemoteFileBuf buf;
+};
+
+/// Open an input file, local or remote. The stream is in a failed state if
+/// the file can't be opened. Remote files being read from start to finish
+/// should be given several parallel_parts.
+unique_ptr<istream> open_input_file(const string& file_name, size_t parallel_parts = 1);
+
+}
+
+#endif
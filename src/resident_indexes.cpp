@@ -0,0 +1,103 @@
+#include "resident_indexes.hpp"
+
+#include <climits>
+#include <cstdlib>
+#include <fstream>
+#include <stdexcept>
+
+namespace vg {
+
+using namespace std;
+
+ResidentIndexes& ResidentIndexes::get() {
+    static ResidentIndexes* registry = new ResidentIndexes();
+    return *registry;
+}
+
+string ResidentIndexes::key(const string& file_name) {
+    char resolved[PATH_MAX];
+    if (realpath(file_name.c_str(), resolved) != nullptr) {
+        return resolved;
+    }
+    return file_name;
+}
+
+/// Look up an index in one of the registry's tables
+template<typename Index>
+static Index* find_index(const map<string, unique_ptr<Index>>& table, const string& key) {
+    auto found = table.find(key);
+    return found == table.end() ? nullptr : found->second.get();
+}
+
+void ResidentIndexes::load_xg(const string& file_name) {
+    ifstream test(file_name);
+    if (!test) {
+        throw runtime_error("Could not open XG index " + file_name);
+    }
+    unique_ptr<xg::XG> index(new xg::XG());
+    index->load_mapped(file_name);
+    xgs[key(file_name)] = move(index);
+}
+
+void ResidentIndexes::load_gcsa(const string& file_name) {
+    ifstream gcsa_in(file_name);
+    if (!gcsa_in) {
+        throw runtime_error("Could not open GCSA2 index " + file_name);
+    }
+    ifstream lcp_in(file_name + ".lcp");
+    if (!lcp_in) {
+        throw runtime_error("Could not open LCP array " + file_name + ".lcp");
+    }
+    unique_ptr<gcsa::GCSA> index(new gcsa::GCSA());
+    index->load(gcsa_in);
+    unique_ptr<gcsa::LCPArray> lcp_array(new gcsa::LCPArray());
+    lcp_array->load(lcp_in);
+
+    string gcsa_key = key(file_name);
+    gcsas[gcsa_key] = move(index);
+    lcps[gcsa_key] = move(lcp_array);
+
+    // The kmer table is optional
+    ifstream kmer_table_in(file_name + ".kmers");
+    if (kmer_table_in) {
+        unique_ptr<GCSAKmerTable> table(new GCSAKmerTable());
+        table->load(kmer_table_in);
+        kmer_tables[gcsa_key] = move(table);
+    }
+}
+
+void ResidentIndexes::load_gbwt(const string& file_name) {
+    ifstream in(file_name);
+    if (!in) {
+        throw runtime_error("Could not open GBWT index " + file_name);
+    }
+    unique_ptr<gbwt::GBWT> index(new gbwt::GBWT());
+    index->load(in);
+    gbwts[key(file_name)] = move(index);
+}
+
+xg::XG* ResidentIndexes::xg(const string& file_name) const {
+    return xgs.empty() ? nullptr : find_index(xgs, key(file_name));
+}
+
+gcsa::GCSA* ResidentIndexes::gcsa(const string& file_name) const {
+    return gcsas.empty() ? nullptr : find_index(gcsas, key(file_name));
+}
+
+gcsa::LCPArray* ResidentIndexes::lcp(const string& gcsa_file_name) const {
+    return lcps.empty() ? nullptr : find_index(lcps, key(gcsa_file_name));
+}
+
+GCSAKmerTable* ResidentIndexes::kmer_table(const string& gcsa_file_name) const {
+    return kmer_tables.empty() ? nullptr : find_index(kmer_tables, key(gcsa_file_name));
+}
+
+gbwt::GBWT* ResidentIndexes::gbwt(const string& file_name) const {
+    return gbwts.empty() ? nullptr : find_index(gbwts, key(file_name));
+}
+
+bool ResidentIndexes::empty() const {
+    return xgs.empty() && gcsas.empty() && gbwts.empty();
+}
+
+}
@@ -0,0 +1,74 @@
+#ifndef VG_RESIDENT_INDEXES_HPP_INCLUDED
+#define VG_RESIDENT_INDEXES_HPP_INCLUDED
+
+/** \file
+ * Indexes kept loaded by a long-lived vg process, so that the mapping jobs it
+ * runs can share them instead of each loading their own copies.
+ */
+
+#include <map>
+#include <memory>
+#include <string>
+
+#include <gcsa/gcsa.h>
+#include <gcsa/lcp.h>
+#include <gbwt/gbwt.h>
+
+#include "xg.hpp"
+#include "gcsa_kmer_table.hpp"
+
+namespace vg {
+
+using namespace std;
+
+/**
+ * A registry of indexes that stay loaded for the life of the process, looked
+ * up by the file they came from. vg server fills it in before forking off
+ * jobs, and vg map and vg mpmap check it before loading an index from disk.
+ * Anything gotten from here is owned by the registry and must not be freed.
+ */
+class ResidentIndexes {
+public:
+    /// Get the process's registry. It is never destroyed, so that processes
+    /// forked off from one that filled it don't free its indexes on exit.
+    static ResidentIndexes& get();
+
+    /// Load and keep the XG index in the given file. Throws a runtime_error if
+    /// the file can't be read.
+    void load_xg(const string& file_name);
+    /// Load and keep the GCSA2 index in the given file, along with its LCP
+    /// array and, if present, its kmer table. Throws a runtime_error if the
+    /// GCSA2 or LCP files can't be read.
+    void load_gcsa(const string& file_name);
+    /// Load and keep the GBWT index in the given file. Throws a runtime_error
+    /// if the file can't be read.
+    void load_gbwt(const string& file_name);
+
+    /// Get the index loaded from the given file, or null if there isn't one.
+    xg::XG* xg(const string& file_name) const;
+    gcsa::GCSA* gcsa(const string& file_name) const;
+    /// Look up the LCP array and kmer table by the name of the GCSA2 file.
+    gcsa::LCPArray* lcp(const string& gcsa_file_name) const;
+    GCSAKmerTable* kmer_table(const string& gcsa_file_name) const;
+    gbwt::GBWT* gbwt(const string& file_name) const;
+
+    /// Return true if no indexes have been loaded.
+    bool empty() const;
+
+private:
+    ResidentIndexes() = default;
+
+    /// Get the key to file an index under, which is the file's canonical path
+    /// if it exists, so the same file reached by different paths matches.
+    static string key(const string& file_name);
+
+    map<string, unique_ptr<xg::XG>> xgs;
+    map<string, unique_ptr<gcsa::GCSA>> gcsas;
+    map<string, unique_ptr<gcsa::LCPArray>> lcps;
+    map<string, unique_ptr<GCSAKmerTable>> kmer_tables;
+    map<string, unique_ptr<gbwt::GBWT>> gbwts;
+};
+
+}
+
+#endif
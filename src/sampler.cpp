@@ -4,20 +4,82 @@
 
 namespace vg {
 
+AliasTable::AliasTable(const vector<double>& weights) : keep_probability(weights.size()), alias(weights.size()) {
+    double total = 0;
+    for (auto& weight : weights) {
+        total += weight;
+    }
+    if (weights.empty() || total <= 0) {
+        throw runtime_error("AliasTable: need at least one positive weight");
+    }
+    
+    // Scale the weights so the average slot is full, and sort the slots into
+    // ones with room to spare and ones with too much.
+    vector<size_t> underfull;
+    vector<size_t> overfull;
+    for (size_t i = 0; i < weights.size(); i++) {
+        keep_probability[i] = weights[i] * weights.size() / total;
+        alias[i] = i;
+        (keep_probability[i] < 1.0 ? underfull : overfull).push_back(i);
+    }
+    
+    // Fill each underfull slot with some of an overfull one's weight.
+    while (!underfull.empty() && !overfull.empty()) {
+        size_t small = underfull.back();
+        underfull.pop_back();
+        size_t large = overfull.back();
+        alias[small] = large;
+        keep_probability[large] -= 1.0 - keep_probability[small];
+        if (keep_probability[large] < 1.0) {
+            overfull.pop_back();
+            underfull.push_back(large);
+        }
+    }
+    
+    // Whatever is left is full, up to rounding error.
+    for (auto i : underfull) {
+        keep_probability[i] = 1.0;
+    }
+    for (auto i : overfull) {
+        keep_probability[i] = 1.0;
+    }
+}
+
+size_t AliasTable::size() const {
+    return alias.size();
+}
+
 /// Make a path sampling distribution based on relative lengths
 void Sampler::set_source_paths(const vector<string>& source_paths) {
     this->source_paths = source_paths;
     if (!source_paths.empty()) {
-        vector<size_t> path_lengths;
+        vector<double> path_lengths;
         for (auto& source_path : source_paths) {
             path_lengths.push_back(xgidx->path_length(source_path));
         }
-        path_sampler = discrete_distribution<>(path_lengths.begin(), path_lengths.end());
+        path_sampler = AliasTable(path_lengths);
     } else {
-        path_sampler = discrete_distribution<>();
+        path_sampler = AliasTable();
     }
 }
 
+void Sampler::reseed(int seed, int64_t first_nonce) {
+    rng.seed(seed);
+    nonce = first_nonce;
+}
+
+size_t substream_seed(size_t base_seed, size_t stream_number) {
+    // Mix the stream number into the seed with the SplitMix64 finalizer, so
+    // nearby stream numbers get unrelated seeds.
+    uint64_t z = (uint64_t) base_seed + ((uint64_t) stream_number + 1) * 0x9E3779B97F4A7C15ull;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    z = z ^ (z >> 31);
+    // Our RNGs take 32-bit seeds, and 0 means to pick one at random.
+    uint32_t seed = (uint32_t) (z ^ (z >> 32));
+    return seed ? seed : 1;
+}
+
 /// We have a helper function to convert path positions and orientations to
 /// pos_t values.
 pos_t position_at(xg::XG* xgidx, const string& path_name, const size_t& path_offset, bool is_reverse) {
@@ -356,34 +418,49 @@ Alignment Sampler::alignment_to_path(const string& source_path, size_t length) {
     Alignment aln;
     Path* path = aln.mutable_path();
     
+    size_t path_length = xgidx->path_length(source_path);
     while (seq.size() < length) {
-
-        // Make a pos_t for where we are, on the appropriate strand
-        pos_t pos = position_at(xgidx, source_path, path_offset, rev);
-
-        // Add that character to the sequence
-        seq.push_back(pos_char(pos));
+        // Look up the node visit we are in once, and take as much of it as we
+        // can, instead of looking up every base.
+        Mapping path_mapping = xgidx->mapping_at_path_position(source_path, path_offset);
+        id_t id = path_mapping.position().node_id();
+        size_t visit_offset = path_offset - xgidx->node_start_at_path_position(source_path, path_offset);
+        string node_sequence = xg_cached_node_sequence(id, xgidx, node_cache);
         
-        // Add a perfect match edit for 1 base
+        // Make a pos_t for where we are, on the appropriate strand. Reads
+        // always go forward along the strand they are on.
+        bool on_reverse = path_mapping.position().is_reverse() != rev;
+        size_t node_offset = rev ? node_sequence.size() - visit_offset - 1 : visit_offset;
+        size_t available = rev ? visit_offset + 1 : node_sequence.size() - visit_offset;
+        size_t taken = min(available, length - seq.size());
+        
+        // Add those characters to the sequence
+        if (on_reverse) {
+            reverse_complement_in_place(node_sequence);
+        }
+        seq.append(node_sequence, node_offset, taken);
+        
+        // Add a perfect match edit for them
         Mapping* mapping = path->add_mapping();
-        *mapping->mutable_position() = make_position(pos);
+        *mapping->mutable_position() = make_position(make_pos_t(id, on_reverse, node_offset));
         Edit* edit = mapping->add_edit();
-        edit->set_from_length(1);
-        edit->set_to_length(1);
+        edit->set_from_length(taken);
+        edit->set_to_length(taken);
         
-        // Advance along the path in the appropriate direction
+        // Advance along the path in the appropriate direction, to just past
+        // the last base we took
         if (rev) {
-            if (path_offset == 0) {
+            if (path_offset + 1 == taken) {
                 // Out of path!
                 break;
             }
-            path_offset--;
+            path_offset -= taken;
         } else {
-            if (path_offset == xgidx->path_length(source_path) - 1) {
+            if (path_offset + taken == path_length) {
                 // Out of path!
                 break;
             }
-            path_offset++;
+            path_offset += taken;
         }
     }
     
@@ -582,12 +659,12 @@ NGSSimulator::NGSSimulator(xg::XG& xg_index,
     if (source_paths.empty()) {
         start_pos_samplers.emplace_back(1, xg_index.seq_length);
     } else {
-        vector<size_t> path_sizes;
+        vector<double> path_sizes;
         for (const auto& source_path : source_paths) {
             path_sizes.push_back(xg_index.path_length(source_path));
             start_pos_samplers.emplace_back(0, path_sizes.back() - 1);
         }
-        path_sampler = discrete_distribution<>(path_sizes.begin(), path_sizes.end());
+        path_sampler = AliasTable(path_sizes);
     }
     
     if (substition_polymorphism_rate < 0.0 || substition_polymorphism_rate > 1.0
@@ -686,6 +763,22 @@ NGSSimulator::NGSSimulator(xg::XG& xg_index,
 #endif
 }
 
+void NGSSimulator::reseed(size_t stream_seed, size_t first_fragment) {
+    // Seed everything the way the constructor does, but from the new seed.
+    prng.seed(stream_seed);
+    for (size_t i = 0; i < transition_distrs_1.size(); i++) {
+        transition_distrs_1[i].reseed(stream_seed + i + 1);
+    }
+    for (size_t i = 0; i < transition_distrs_2.size(); i++) {
+        transition_distrs_2[i].reseed(stream_seed + i + 1);
+    }
+    joint_initial_distr.reseed(stream_seed - 1);
+    // Distributions can hold on to values made from the old stream.
+    insert_sampler.reset();
+    prob_sampler.reset();
+    sample_counter = first_fragment;
+}
+
 Alignment NGSSimulator::sample_read() {
     
     
@@ -1432,6 +1525,11 @@ NGSSimulator::MarkovDistribution<From, To>::MarkovDistribution(size_t seed) : pr
     // nothing to do
 }
 
+template<class From, class To>
+void NGSSimulator::MarkovDistribution<From, To>::reseed(size_t seed) {
+    prng.seed(seed);
+}
+
 template<class From, class To>
 void NGSSimulator::MarkovDistribution<From, To>::record_transition(From from, To to) {
     if (!cond_distrs.count(from)) {
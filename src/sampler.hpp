@@ -29,6 +29,47 @@ using namespace std;
 /// forward version of the path.
 pos_t position_at(xg::XG* xgidx, const string& path_name, const size_t& path_offset, bool is_reverse);
 
+/// Get the seed for one of many independent random number streams made from
+/// a base seed, so that work split into numbered pieces can be simulated in
+/// any order, on any thread, and still come out the same. Never returns 0.
+size_t substream_seed(size_t base_seed, size_t stream_number);
+
+/**
+ * Draws indexes at random in proportion to their weights in constant time,
+ * using Vose's alias method: each index owns a slot, and each slot is split
+ * between its own index and one other "alias" index, so a draw is one slot
+ * choice and one coin flip.
+ */
+class AliasTable {
+public:
+    
+    /// Make a table with no indexes to draw.
+    AliasTable() = default;
+    
+    /// Make a table for drawing indexes into the given weights. Weights must
+    /// not be negative, and at least one must be positive.
+    AliasTable(const vector<double>& weights);
+    
+    /// Draw an index.
+    template<typename URNG>
+    size_t operator()(URNG& rng) const;
+    
+    /// Get the number of indexes that can be drawn.
+    size_t size() const;
+    
+private:
+    /// The chance of keeping each slot's own index rather than its alias.
+    vector<double> keep_probability;
+    /// The other index sharing each slot.
+    vector<size_t> alias;
+};
+
+template<typename URNG>
+size_t AliasTable::operator()(URNG& rng) const {
+    size_t slot = uniform_int_distribution<size_t>(0, alias.size() - 1)(rng);
+    return uniform_real_distribution<double>(0.0, 1.0)(rng) < keep_probability[slot] ? slot : alias[slot];
+}
+
 /**
  * Generate Alignments (with or without mutations, and in pairs or alone) from
  * an XG index.
@@ -51,7 +92,7 @@ public:
     bool no_Ns;
     // A vector which, if nonempty, gives the names of the paths to restrict simulated reads to.
     vector<string> source_paths;
-    discrete_distribution<> path_sampler; // draw an index in source_paths
+    AliasTable path_sampler; // draw an index in source_paths, weighted by length
     inline Sampler(xg::XG* x,
             int seed = 0,
             bool forward_only = false,
@@ -72,6 +113,10 @@ public:
     }
 
     void set_source_paths(const vector<string>& source_paths);
+    
+    /// Restart random number generation from the given seed, and count reads
+    /// made from now on, for naming them, from the given nonce.
+    void reseed(int seed, int64_t first_nonce);
 
     pos_t position(void);
     string sequence(size_t length);
@@ -155,6 +200,11 @@ public:
     /// Sample a pair of reads an alignments
     pair<Alignment, Alignment> sample_read_pair();
     
+    /// Restart random number generation from the given seed, and number the
+    /// reads or pairs sampled from now on from the given fragment number.
+    /// Read names still use the seed the simulator was made with.
+    void reseed(size_t stream_seed, size_t first_fragment);
+    
 private:
     template<class From, class To>
     class MarkovDistribution {
@@ -167,6 +217,8 @@ private:
         void finalize();
         /// sample according to the training data
         To sample_transition(From from);
+        /// restart random number generation from the given seed
+        void reseed(size_t seed);
         
     private:
         
@@ -273,7 +325,7 @@ private:
     LRUCache<id_t, vector<Edge> > edge_cache;
     
     default_random_engine prng;
-    discrete_distribution<> path_sampler;
+    AliasTable path_sampler;
     vector<uniform_int_distribution<size_t> > start_pos_samplers;
     uniform_int_distribution<uint8_t> strand_sampler;
     uniform_int_distribution<size_t> background_sampler;
@@ -0,0 +1,419 @@
+#include "sequence_ops.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+/**
+ * \file sequence_ops.cpp
+ * Vectorized DNA string kernels, with scalar fallbacks.
+ */
+
+namespace vg {
+
+using namespace std;
+
+static const char complement[256] = {'N', 'N', 'N', 'N', 'N', 'N', 'N', 'N', // 8
+                                     'N', 'N', 'N', 'N', 'N', 'N', 'N', 'N', // 16
+                                     'N', 'N', 'N', 'N', 'N', 'N', 'N', 'N', // 24
+                                     'N', 'N', 'N', 'N', 'N', 'N', 'N', 'N', // 32
+                                     'N', 'N', 'N', '$', '#', 'N', 'N', 'N', // 40 GCSA stop/start characters
+                                     'N', 'N', 'N', 'N', 'N', '-', 'N', 'N', // 48
+                                     'N', 'N', 'N', 'N', 'N', 'N', 'N', 'N', // 56
+                                     'N', 'N', 'N', 'N', 'N', 'N', 'N', 'N', // 64
+                                     'N', 'T', 'V', 'G', 'H', 'N', 'N', 'C', // 72
+                                     'D', 'N', 'N', 'M', 'N', 'K', 'N', 'N', // 80
+                                     'N', 'Q', 'Y', 'W', 'A', 'A', 'B', 'S', // 88
+                                     'N', 'R', 'N', 'N', 'N', 'N', 'N', 'N', // 96
+                                     'N', 't', 'v', 'g', 'h', 'N', 'N', 'c', // 104
+                                     'd', 'N', 'N', 'm', 'N', 'k', 'n', 'N', // 112
+                                     'N', 'q', 'y', 'w', 'a', 'a', 'b', 's', // 120
+                                     'N', 'r', 'N', 'N', 'N', 'N', 'N', 'N', // 128
+                                     'N', 'N', 'N', 'N', 'N', 'N', 'N', 'N', // 136
+                                     'N', 'N', 'N', 'N', 'N', 'N', 'N', 'N', // 144
+                                     'N', 'N', 'N', 'N', 'N', 'N', 'N', 'N', // 152
+                                     'N', 'N', 'N', 'N', 'N', 'N', 'N', 'N', // 160
+                                     'N', 'N', 'N', 'N', 'N', 'N', 'N', 'N', // 168
+                                     'N', 'N', 'N', 'N', 'N', 'N', 'N', 'N', // 176
+                                     'N', 'N', 'N', 'N', 'N', 'N', 'N', 'N', // 184
+                                     'N', 'N', 'N', 'N', 'N', 'N', 'N', 'N', // 192
+                                     'N', 'N', 'N', 'N', 'N', 'N', 'N', 'N', // 200
+                                     'N', 'N', 'N', 'N', 'N', 'N', 'N', 'N', // 208
+                                     'N', 'N', 'N', 'N', 'N', 'N', 'N', 'N', // 216
+                                     'N', 'N', 'N', 'N', 'N', 'N', 'N', 'N', // 224
+                                     'N', 'N', 'N', 'N', 'N', 'N', 'N', 'N', // 232
+                                     'N', 'N', 'N', 'N', 'N', 'N', 'N', 'N', // 240
+                                     'N', 'N', 'N', 'N', 'N', 'N', 'N', 'N', // 248
+                                     'N', 'N', 'N', 'N', 'N', 'N', 'N', 'N'};// 256
+
+char complement_of(char c) {
+    return complement[(unsigned char) c];
+}
+
+/// Get the 2-bit code of a base, or -1 if it isn't A, C, G, or T.
+static inline int base_code(char c) {
+    switch (c) {
+    case 'A': case 'a': return 0;
+    case 'C': case 'c': return 1;
+    case 'G': case 'g': return 2;
+    case 'T': case 't': return 3;
+    default: return -1;
+    }
+}
+
+static inline bool is_ACGT(char c) {
+    return c == 'A' || c == 'C' || c == 'G' || c == 'T';
+}
+
+#if defined(__AVX2__)
+
+/// Complement 32 characters at once, if they are all A, C, G, T, or N of
+/// either case. Returns false, leaving complemented alone, if they aren't.
+static inline bool complement_avx2(__m256i chars, __m256i& complemented) {
+    __m256i case_bit = _mm256_set1_epi8(0x20);
+    __m256i upper = _mm256_andnot_si256(case_bit, chars);
+    __m256i is_a = _mm256_cmpeq_epi8(upper, _mm256_set1_epi8('A'));
+    __m256i is_c = _mm256_cmpeq_epi8(upper, _mm256_set1_epi8('C'));
+    __m256i is_g = _mm256_cmpeq_epi8(upper, _mm256_set1_epi8('G'));
+    __m256i is_t = _mm256_cmpeq_epi8(upper, _mm256_set1_epi8('T'));
+    __m256i is_n = _mm256_cmpeq_epi8(upper, _mm256_set1_epi8('N'));
+    __m256i valid = _mm256_or_si256(_mm256_or_si256(is_a, is_c), _mm256_or_si256(_mm256_or_si256(is_g, is_t), is_n));
+    if (_mm256_movemask_epi8(valid) != -1) {
+        return false;
+    }
+    __m256i result = _mm256_or_si256(_mm256_and_si256(is_a, _mm256_set1_epi8('T')),
+                                     _mm256_and_si256(is_c, _mm256_set1_epi8('G')));
+    result = _mm256_or_si256(result, _mm256_and_si256(is_g, _mm256_set1_epi8('C')));
+    result = _mm256_or_si256(result, _mm256_and_si256(is_t, _mm256_set1_epi8('A')));
+    result = _mm256_or_si256(result, _mm256_and_si256(is_n, _mm256_set1_epi8('N')));
+    complemented = _mm256_or_si256(result, _mm256_and_si256(chars, case_bit));
+    return true;
+}
+
+/// Reverse the order of 32 characters.
+static inline __m256i reverse_avx2(__m256i chars) {
+    const __m256i reverse_lanes = _mm256_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0,
+                                                   15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+    chars = _mm256_shuffle_epi8(chars, reverse_lanes);
+    return _mm256_permute2x128_si256(chars, chars, 1);
+}
+
+/// Get a mask of which of 32 characters are upper case A, C, G, or T, and
+/// also N if with_n is set.
+static inline __m256i acgt_mask_avx2(__m256i chars, bool with_n) {
+    __m256i mask = _mm256_or_si256(_mm256_cmpeq_epi8(chars, _mm256_set1_epi8('A')),
+                                   _mm256_cmpeq_epi8(chars, _mm256_set1_epi8('C')));
+    mask = _mm256_or_si256(mask, _mm256_cmpeq_epi8(chars, _mm256_set1_epi8('G')));
+    mask = _mm256_or_si256(mask, _mm256_cmpeq_epi8(chars, _mm256_set1_epi8('T')));
+    if (with_n) {
+        mask = _mm256_or_si256(mask, _mm256_cmpeq_epi8(chars, _mm256_set1_epi8('N')));
+    }
+    return mask;
+}
+
+#endif
+
+#if defined(__SSE2__)
+
+/// Complement 16 characters at once, like complement_avx2().
+static inline bool complement_sse2(__m128i chars, __m128i& complemented) {
+    __m128i case_bit = _mm_set1_epi8(0x20);
+    __m128i upper = _mm_andnot_si128(case_bit, chars);
+    __m128i is_a = _mm_cmpeq_epi8(upper, _mm_set1_epi8('A'));
+    __m128i is_c = _mm_cmpeq_epi8(upper, _mm_set1_epi8('C'));
+    __m128i is_g = _mm_cmpeq_epi8(upper, _mm_set1_epi8('G'));
+    __m128i is_t = _mm_cmpeq_epi8(upper, _mm_set1_epi8('T'));
+    __m128i is_n = _mm_cmpeq_epi8(upper, _mm_set1_epi8('N'));
+    __m128i valid = _mm_or_si128(_mm_or_si128(is_a, is_c), _mm_or_si128(_mm_or_si128(is_g, is_t), is_n));
+    if (_mm_movemask_epi8(valid) != 0xFFFF) {
+        return false;
+    }
+    __m128i result = _mm_or_si128(_mm_and_si128(is_a, _mm_set1_epi8('T')),
+                                  _mm_and_si128(is_c, _mm_set1_epi8('G')));
+    result = _mm_or_si128(result, _mm_and_si128(is_g, _mm_set1_epi8('C')));
+    result = _mm_or_si128(result, _mm_and_si128(is_t, _mm_set1_epi8('A')));
+    result = _mm_or_si128(result, _mm_and_si128(is_n, _mm_set1_epi8('N')));
+    complemented = _mm_or_si128(result, _mm_and_si128(chars, case_bit));
+    return true;
+}
+
+/// Reverse the order of 16 characters, with only SSE2 shuffles.
+static inline __m128i reverse_sse2(__m128i chars) {
+    chars = _mm_shuffle_epi32(chars, _MM_SHUFFLE(0, 1, 2, 3));
+    chars = _mm_shufflelo_epi16(chars, _MM_SHUFFLE(2, 3, 0, 1));
+    chars = _mm_shufflehi_epi16(chars, _MM_SHUFFLE(2, 3, 0, 1));
+    return _mm_or_si128(_mm_slli_epi16(chars, 8), _mm_srli_epi16(chars, 8));
+}
+
+/// Get a mask of which of 16 characters are upper case A, C, G, or T, and
+/// also N if with_n is set.
+static inline __m128i acgt_mask_sse2(__m128i chars, bool with_n) {
+    __m128i mask = _mm_or_si128(_mm_cmpeq_epi8(chars, _mm_set1_epi8('A')),
+                                _mm_cmpeq_epi8(chars, _mm_set1_epi8('C')));
+    mask = _mm_or_si128(mask, _mm_cmpeq_epi8(chars, _mm_set1_epi8('G')));
+    mask = _mm_or_si128(mask, _mm_cmpeq_epi8(chars, _mm_set1_epi8('T')));
+    if (with_n) {
+        mask = _mm_or_si128(mask, _mm_cmpeq_epi8(chars, _mm_set1_epi8('N')));
+    }
+    return mask;
+}
+
+#endif
+
+/// Swap and complement count pairs of characters working in from left and
+/// right, one at a time.
+static inline void swap_complement(char* seq, size_t left, size_t right, size_t count) {
+    for (size_t k = 0; k < count; k++) {
+        char tmp = seq[left + k];
+        seq[left + k] = complement_of(seq[right - 1 - k]);
+        seq[right - 1 - k] = complement_of(tmp);
+    }
+}
+
+void reverse_complement_in_place(char* seq, size_t length) {
+    size_t left = 0;
+    size_t right = length;
+    // Take a block from each end, and swap them complemented and reversed
+#if defined(__AVX2__)
+    for (; right - left >= 64; left += 32, right -= 32) {
+        __m256i left_chars = _mm256_loadu_si256((const __m256i*) (seq + left));
+        __m256i right_chars = _mm256_loadu_si256((const __m256i*) (seq + right - 32));
+        __m256i left_complement, right_complement;
+        if (complement_avx2(left_chars, left_complement) && complement_avx2(right_chars, right_complement)) {
+            _mm256_storeu_si256((__m256i*) (seq + left), reverse_avx2(right_complement));
+            _mm256_storeu_si256((__m256i*) (seq + right - 32), reverse_avx2(left_complement));
+        } else {
+            swap_complement(seq, left, right, 32);
+        }
+    }
+#endif
+#if defined(__SSE2__)
+    for (; right - left >= 32; left += 16, right -= 16) {
+        __m128i left_chars = _mm_loadu_si128((const __m128i*) (seq + left));
+        __m128i right_chars = _mm_loadu_si128((const __m128i*) (seq + right - 16));
+        __m128i left_complement, right_complement;
+        if (complement_sse2(left_chars, left_complement) && complement_sse2(right_chars, right_complement)) {
+            _mm_storeu_si128((__m128i*) (seq + left), reverse_sse2(right_complement));
+            _mm_storeu_si128((__m128i*) (seq + right - 16), reverse_sse2(left_complement));
+        } else {
+            swap_complement(seq, left, right, 16);
+        }
+    }
+#endif
+    size_t middle = right - left;
+    swap_complement(seq, left, right, middle / 2);
+    if (middle % 2) {
+        seq[left + middle / 2] = complement_of(seq[left + middle / 2]);
+    }
+}
+
+void reverse_complement_into(const char* from, size_t length, char* to) {
+    size_t i = 0;
+#if defined(__AVX2__)
+    for (; i + 32 <= length; i += 32) {
+        __m256i chars = _mm256_loadu_si256((const __m256i*) (from + length - i - 32));
+        __m256i complemented;
+        if (complement_avx2(chars, complemented)) {
+            _mm256_storeu_si256((__m256i*) (to + i), reverse_avx2(complemented));
+        } else {
+            for (size_t k = i; k < i + 32; k++) {
+                to[k] = complement_of(from[length - 1 - k]);
+            }
+        }
+    }
+#endif
+#if defined(__SSE2__)
+    for (; i + 16 <= length; i += 16) {
+        __m128i chars = _mm_loadu_si128((const __m128i*) (from + length - i - 16));
+        __m128i complemented;
+        if (complement_sse2(chars, complemented)) {
+            _mm_storeu_si128((__m128i*) (to + i), reverse_sse2(complemented));
+        } else {
+            for (size_t k = i; k < i + 16; k++) {
+                to[k] = complement_of(from[length - 1 - k]);
+            }
+        }
+    }
+#endif
+    for (; i < length; i++) {
+        to[i] = complement_of(from[length - 1 - i]);
+    }
+}
+
+void to_uppercase_in_place(char* seq, size_t length) {
+    size_t i = 0;
+    // Subtract 0x20 from everything between 'a' and 'z'. Bytes over 0x7F
+    // compare as negative, so they are left alone.
+#if defined(__AVX2__)
+    for (; i + 32 <= length; i += 32) {
+        __m256i chars = _mm256_loadu_si256((const __m256i*) (seq + i));
+        __m256i lower = _mm256_and_si256(_mm256_cmpgt_epi8(chars, _mm256_set1_epi8('a' - 1)),
+                                         _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), chars));
+        chars = _mm256_sub_epi8(chars, _mm256_and_si256(lower, _mm256_set1_epi8(0x20)));
+        _mm256_storeu_si256((__m256i*) (seq + i), chars);
+    }
+#endif
+#if defined(__SSE2__)
+    for (; i + 16 <= length; i += 16) {
+        __m128i chars = _mm_loadu_si128((const __m128i*) (seq + i));
+        __m128i lower = _mm_and_si128(_mm_cmpgt_epi8(chars, _mm_set1_epi8('a' - 1)),
+                                      _mm_cmplt_epi8(chars, _mm_set1_epi8('z' + 1)));
+        chars = _mm_sub_epi8(chars, _mm_and_si128(lower, _mm_set1_epi8(0x20)));
+        _mm_storeu_si128((__m128i*) (seq + i), chars);
+    }
+#endif
+    for (; i < length; i++) {
+        if (seq[i] >= 'a' && seq[i] <= 'z') {
+            seq[i] -= 'a' - 'A';
+        }
+    }
+}
+
+/// Check that all the characters are upper case A, C, G, or T, and N if with_n is set.
+static bool all_bases(const char* seq, size_t length, bool with_n) {
+    size_t i = 0;
+#if defined(__AVX2__)
+    for (; i + 32 <= length; i += 32) {
+        __m256i chars = _mm256_loadu_si256((const __m256i*) (seq + i));
+        if (_mm256_movemask_epi8(acgt_mask_avx2(chars, with_n)) != -1) {
+            return false;
+        }
+    }
+#endif
+#if defined(__SSE2__)
+    for (; i + 16 <= length; i += 16) {
+        __m128i chars = _mm_loadu_si128((const __m128i*) (seq + i));
+        if (_mm_movemask_epi8(acgt_mask_sse2(chars, with_n)) != 0xFFFF) {
+            return false;
+        }
+    }
+#endif
+    for (; i < length; i++) {
+        if (!is_ACGT(seq[i]) && !(with_n && seq[i] == 'N')) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool all_ACGT(const char* seq, size_t length) {
+    return all_bases(seq, length, false);
+}
+
+bool all_ACGTN(const char* seq, size_t length) {
+    return all_bases(seq, length, true);
+}
+
+void non_ACGTN_to_N_in_place(char* seq, size_t length) {
+    size_t i = 0;
+#if defined(__AVX2__)
+    for (; i + 32 <= length; i += 32) {
+        __m256i chars = _mm256_loadu_si256((const __m256i*) (seq + i));
+        __m256i valid = acgt_mask_avx2(chars, true);
+        chars = _mm256_or_si256(_mm256_and_si256(valid, chars), _mm256_andnot_si256(valid, _mm256_set1_epi8('N')));
+        _mm256_storeu_si256((__m256i*) (seq + i), chars);
+    }
+#endif
+#if defined(__SSE2__)
+    for (; i + 16 <= length; i += 16) {
+        __m128i chars = _mm_loadu_si128((const __m128i*) (seq + i));
+        __m128i valid = acgt_mask_sse2(chars, true);
+        chars = _mm_or_si128(_mm_and_si128(valid, chars), _mm_andnot_si128(valid, _mm_set1_epi8('N')));
+        _mm_storeu_si128((__m128i*) (seq + i), chars);
+    }
+#endif
+    for (; i < length; i++) {
+        if (!is_ACGT(seq[i]) && seq[i] != 'N') {
+            seq[i] = 'N';
+        }
+    }
+}
+
+size_t count_Ns(const char* seq, size_t length, bool lowercase_too) {
+    size_t count = 0;
+    size_t i = 0;
+    // With the case bit cleared, n looks like N
+    char case_mask = lowercase_too ? ~0x20 : ~0;
+#if defined(__AVX2__)
+    for (; i + 32 <= length; i += 32) {
+        __m256i chars = _mm256_and_si256(_mm256_loadu_si256((const __m256i*) (seq + i)), _mm256_set1_epi8(case_mask));
+        count += __builtin_popcount((uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(chars, _mm256_set1_epi8('N'))));
+    }
+#endif
+#if defined(__SSE2__)
+    for (; i + 16 <= length; i += 16) {
+        __m128i chars = _mm_and_si128(_mm_loadu_si128((const __m128i*) (seq + i)), _mm_set1_epi8(case_mask));
+        count += __builtin_popcount(_mm_movemask_epi8(_mm_cmpeq_epi8(chars, _mm_set1_epi8('N'))));
+    }
+#endif
+    for (; i < length; i++) {
+        count += (seq[i] & case_mask) == 'N';
+    }
+    return count;
+}
+
+bool pack_2bit(const char* seq, size_t length, uint8_t* packed) {
+    bool all_valid = true;
+    size_t i = 0;
+#if defined(__SSE2__)
+    // Make each base's code from compare masks, then fold 16 codes into 4
+    // bytes with shifts within 16 and 32 bit lanes.
+    for (; i + 16 <= length; i += 16) {
+        __m128i chars = _mm_andnot_si128(_mm_set1_epi8(0x20), _mm_loadu_si128((const __m128i*) (seq + i)));
+        __m128i is_a = _mm_cmpeq_epi8(chars, _mm_set1_epi8('A'));
+        __m128i is_c = _mm_cmpeq_epi8(chars, _mm_set1_epi8('C'));
+        __m128i is_g = _mm_cmpeq_epi8(chars, _mm_set1_epi8('G'));
+        __m128i is_t = _mm_cmpeq_epi8(chars, _mm_set1_epi8('T'));
+        __m128i valid = _mm_or_si128(_mm_or_si128(is_a, is_c), _mm_or_si128(is_g, is_t));
+        if (_mm_movemask_epi8(valid) != 0xFFFF) {
+            all_valid = false;
+        }
+        __m128i codes = _mm_or_si128(_mm_and_si128(is_c, _mm_set1_epi8(1)), _mm_and_si128(is_g, _mm_set1_epi8(2)));
+        codes = _mm_or_si128(codes, _mm_and_si128(is_t, _mm_set1_epi8(3)));
+        __m128i pairs = _mm_and_si128(_mm_or_si128(codes, _mm_srli_epi16(codes, 6)), _mm_set1_epi16(0x00FF));
+        __m128i quads = _mm_and_si128(_mm_or_si128(pairs, _mm_srli_epi32(pairs, 12)), _mm_set1_epi32(0x000000FF));
+        __m128i bytes = _mm_packus_epi16(_mm_packs_epi32(quads, _mm_setzero_si128()), _mm_setzero_si128());
+        uint32_t word = _mm_cvtsi128_si32(bytes);
+        memcpy(packed + i / 4, &word, 4);
+    }
+#endif
+    for (; i < length; i += 4) {
+        uint8_t byte = 0;
+        for (size_t k = 0; k < 4 && i + k < length; k++) {
+            int code = base_code(seq[i + k]);
+            if (code == -1) {
+                all_valid = false;
+                code = 0;
+            }
+            byte |= code << (2 * k);
+        }
+        packed[i / 4] = byte;
+    }
+    return all_valid;
+}
+
+void unpack_2bit(const uint8_t* packed, size_t length, char* seq) {
+    // Look up all 4 bases in a byte at once
+    static const struct ByteTable {
+        char bases[256][4];
+        ByteTable() {
+            for (size_t byte = 0; byte < 256; byte++) {
+                for (size_t k = 0; k < 4; k++) {
+                    bases[byte][k] = "ACGT"[(byte >> (2 * k)) & 3];
+                }
+            }
+        }
+    } table;
+    size_t i = 0;
+    for (; i + 4 <= length; i += 4) {
+        memcpy(seq + i, table.bases[packed[i / 4]], 4);
+    }
+    for (; i < length; i++) {
+        seq[i] = table.bases[packed[i / 4]][i % 4];
+    }
+}
+
+}
@@ -0,0 +1,61 @@
+#ifndef VG_SEQUENCE_OPS_HPP_INCLUDED
+#define VG_SEQUENCE_OPS_HPP_INCLUDED
+
+/** \file
+ * Kernels for the DNA string operations that sit on hot paths: reverse
+ * complementing, upper-casing, checking and cleaning bases, counting Ns, and
+ * 2-bit packing. Each one works on raw character buffers, a vector register
+ * at a time where it can. AVX2 and SSE2 versions are chosen when the compiler
+ * targets them, and a scalar loop handles everything else, including the
+ * ends of buffers and any block with characters the vector code doesn't
+ * handle, so all versions give the same results.
+ */
+
+#include <cstddef>
+#include <cstdint>
+
+namespace vg {
+
+/// Get the complement of a single base. IUPAC codes are complemented, case is
+/// kept, the GCSA2 start/stop characters swap, and anything else becomes N.
+char complement_of(char c);
+
+/// Reverse complement the length characters at seq in place. A, C, G, T, and
+/// N of either case are complemented with vector instructions; IUPAC codes
+/// and the GCSA2 start/stop characters go through the same table as
+/// reverse_complement(char), and anything else becomes N.
+void reverse_complement_in_place(char* seq, size_t length);
+
+/// Write the reverse complement of the length characters at from to to,
+/// which must not overlap it.
+void reverse_complement_into(const char* from, size_t length, char* to);
+
+/// Convert the ASCII letters among the length characters at seq to upper case.
+void to_uppercase_in_place(char* seq, size_t length);
+
+/// Return true if all length characters at seq are upper case A, C, G, or T.
+bool all_ACGT(const char* seq, size_t length);
+
+/// Return true if all length characters at seq are upper case A, C, G, T, or N.
+bool all_ACGTN(const char* seq, size_t length);
+
+/// Replace any characters at seq that aren't upper case A, C, G, T, or N with N.
+void non_ACGTN_to_N_in_place(char* seq, size_t length);
+
+/// Count the upper case Ns among the length characters at seq, and the lower
+/// case ones too if lowercase_too is set.
+size_t count_Ns(const char* seq, size_t length, bool lowercase_too = false);
+
+/// Pack length bases at seq into (length + 3) / 4 bytes at packed, 4 to a
+/// byte, with base i in bits 2 * (i % 4) and up of byte i / 4. A, C, G, and T
+/// of either case are coded 0 through 3, so the complement of a code c is
+/// 3 - c. Returns false if any other character was seen; those are packed as
+/// A, so the caller has to keep track of them.
+bool pack_2bit(const char* seq, size_t length, uint8_t* packed);
+
+/// Unpack length upper case bases from 2-bit codes packed by pack_2bit().
+void unpack_2bit(const uint8_t* packed, size_t length, char* seq);
+
+}
+
+#endif
@@ -0,0 +1,129 @@
+#include "shard_router.hpp"
+#include "algorithms/weakly_connected_components.hpp"
+
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+
+/**
+ * \file shard_router.cpp: implementation of the index from node IDs to graph shards
+ */
+
+namespace vg {
+
+using namespace std;
+
+ShardRouter::ShardRouter(const HandleGraph& graph, size_t shard_count) : lengths(max<size_t>(shard_count, 1), 0) {
+
+    vector<unordered_set<id_t>> components = algorithms::weakly_connected_components(&graph);
+
+    // Measure each component
+    vector<pair<size_t, size_t>> component_lengths;
+    component_lengths.reserve(components.size());
+    for (size_t i = 0; i < components.size(); i++) {
+        size_t length = 0;
+        for (id_t id : components[i]) {
+            length += graph.get_length(graph.get_handle(id));
+        }
+        component_lengths.emplace_back(length, i);
+    }
+
+    // Place the biggest components first, each into the shard with the least
+    // sequence so far
+    sort(component_lengths.begin(), component_lengths.end(), greater<pair<size_t, size_t>>());
+    vector<pair<id_t, size_t>> id_shards;
+    for (auto& component_length : component_lengths) {
+        size_t shard = min_element(lengths.begin(), lengths.end()) - lengths.begin();
+        lengths[shard] += component_length.first;
+        for (id_t id : components[component_length.second]) {
+            id_shards.emplace_back(id, shard);
+        }
+    }
+
+    // Collapse IDs that are next to each other and in the same shard into runs
+    sort(id_shards.begin(), id_shards.end());
+    for (auto& id_shard : id_shards) {
+        if (!ranges.empty() && ranges.back().shard == id_shard.second) {
+            ranges.back().last = id_shard.first;
+        }
+        else {
+            ranges.push_back(IDRange{id_shard.first, id_shard.first, id_shard.second});
+        }
+    }
+}
+
+size_t ShardRouter::shard_count() const {
+    return lengths.size();
+}
+
+size_t ShardRouter::shard_of(id_t id) const {
+    // Find the last run starting at or before the ID
+    auto it = upper_bound(ranges.begin(), ranges.end(), id, [](id_t id, const IDRange& range) {
+        return id < range.first;
+    });
+    if (it == ranges.begin()) {
+        return shard_count();
+    }
+    --it;
+    // Runs cover all the IDs between their ends, since the IDs in the gaps
+    // aren't in the graph
+    return id <= it->last ? it->shard : shard_count();
+}
+
+vector<size_t> ShardRouter::shards_of(const vector<id_t>& ids) const {
+    vector<size_t> shards;
+    for (id_t id : ids) {
+        size_t shard = shard_of(id);
+        if (shard < shard_count()) {
+            shards.push_back(shard);
+        }
+    }
+    sort(shards.begin(), shards.end());
+    shards.erase(unique(shards.begin(), shards.end()), shards.end());
+    return shards;
+}
+
+size_t ShardRouter::shard_length(size_t shard) const {
+    return lengths.at(shard);
+}
+
+void ShardRouter::serialize(ostream& out) const {
+    out << "#shards";
+    for (size_t length : lengths) {
+        out << "\t" << length;
+    }
+    out << "\n";
+    for (auto& range : ranges) {
+        out << range.first << "\t" << range.last << "\t" << range.shard << "\n";
+    }
+}
+
+void ShardRouter::load(istream& in) {
+    ranges.clear();
+    lengths.clear();
+
+    string line;
+    if (!getline(in, line) || line.compare(0, 7, "#shards") != 0) {
+        throw runtime_error("ShardRouter::load: missing shard header");
+    }
+    stringstream header(line.substr(7));
+    size_t length;
+    while (header >> length) {
+        lengths.push_back(length);
+    }
+
+    while (getline(in, line)) {
+        if (line.empty()) {
+            continue;
+        }
+        stringstream fields(line);
+        IDRange range;
+        if (!(fields >> range.first >> range.last >> range.shard) || range.shard >= lengths.size() ||
+            range.last < range.first || (!ranges.empty() && range.first <= ranges.back().last)) {
+            throw runtime_error("ShardRouter::load: bad ID range line: " + line);
+        }
+        ranges.push_back(range);
+    }
+}
+
+}
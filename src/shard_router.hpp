@@ -0,0 +1,76 @@
+#ifndef VG_SHARD_ROUTER_HPP_INCLUDED
+#define VG_SHARD_ROUTER_HPP_INCLUDED
+
+/** \file
+ * A small index saying which shard of a split-up graph each node ID lives in,
+ * so a whole-pangenome index can be built and mapped against a piece at a
+ * time on machines that can't hold all of it.
+ */
+
+#include <iostream>
+#include <vector>
+
+#include "handle.hpp"
+
+namespace vg {
+
+using namespace std;
+
+/**
+ * Splits a graph into shards along its weakly connected components (and so
+ * along its component path sets), keeping the graph's node IDs so that all
+ * the shards share one ID space. Remembers the shard of every node as runs of
+ * IDs, which stays small when the IDs of each component are contiguous, as
+ * they are after vg ids -j.
+ */
+class ShardRouter {
+public:
+
+    /// Make an empty router with no shards.
+    ShardRouter() = default;
+
+    /// Divide the components of the given graph between the given number of
+    /// shards, balancing the amount of sequence in each.
+    ShardRouter(const HandleGraph& graph, size_t shard_count);
+
+    /// Get the number of shards.
+    size_t shard_count() const;
+
+    /// Get the shard holding the node with the given ID, or shard_count() if
+    /// the node is not in any shard.
+    size_t shard_of(id_t id) const;
+
+    /// Get the distinct shards holding any of the given node IDs, in order.
+    /// These are the shards a read with seeds on the nodes should be sent to.
+    vector<size_t> shards_of(const vector<id_t>& ids) const;
+
+    /// Get the total sequence length in the given shard.
+    size_t shard_length(size_t shard) const;
+
+    /// Write the router as TSV: a header line with the shard lengths, then a
+    /// line of first ID, last ID, and shard per run.
+    void serialize(ostream& out) const;
+
+    /// Replace this router with one read from the given stream, as written by
+    /// serialize().
+    void load(istream& in);
+
+private:
+
+    /// A run of IDs that are all in the same shard
+    struct IDRange {
+        id_t first;
+        id_t last;
+        size_t shard;
+    };
+
+    /// Runs of IDs, sorted and non-overlapping
+    vector<IDRange> ranges;
+
+    /// Amount of sequence in each shard
+    vector<size_t> lengths;
+};
+
+}
+
+#endif
@@ -0,0 +1,162 @@
+#ifndef VG_SHARDED_CACHE_HPP_INCLUDED
+#define VG_SHARDED_CACHE_HPP_INCLUDED
+
+/** \file
+ * A thread-safe LRU cache, split into independently locked shards, that can
+ * be shared by all the threads working against one index.
+ */
+
+#include <atomic>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "hash_map.hpp"
+
+namespace vg {
+
+using namespace std;
+
+/**
+ * An LRU cache safe to use from many threads at once. Keys are hashed to one
+ * of a fixed number of shards, each an ordinary LRU cache behind its own lock,
+ * so threads only contend when they touch the same shard at the same moment.
+ * Capacity is divided evenly among the shards. Hit and miss counts are kept
+ * so the cache can be sized.
+ *
+ * Has the same retrieve()/put() interface as LRUCache, so it can be swapped
+ * in where a cache is shared between threads.
+ */
+template<typename Key, typename Value, typename Hash = wang_hash<Key>>
+class ShardedCache {
+public:
+
+    /// Make a cache holding about the given number of items in total, spread
+    /// over the given number of shards.
+    ShardedCache(size_t capacity, size_t shard_count = 64);
+
+    // Shards hold mutexes, so the cache can't be moved or copied.
+    ShardedCache(const ShardedCache& other) = delete;
+    ShardedCache& operator=(const ShardedCache& other) = delete;
+
+    /// Look up a key. Returns the value and true if it is cached, or a default
+    /// value and false if it is not.
+    pair<Value, bool> retrieve(const Key& key);
+
+    /// Cache a value for a key, evicting the least recently used item in the
+    /// key's shard if the shard is full.
+    void put(const Key& key, const Value& value);
+
+    /// Get the number of successful retrieve() calls so far.
+    size_t hits() const;
+
+    /// Get the number of unsuccessful retrieve() calls so far.
+    size_t misses() const;
+
+    /// Get the number of items currently cached.
+    size_t size() const;
+
+private:
+
+    struct Shard {
+        mutex lock;
+        // Most recently used items are at the front.
+        list<pair<Key, Value>> items;
+        unordered_map<Key, typename list<pair<Key, Value>>::iterator, Hash> index;
+    };
+
+    /// Get the shard responsible for a key.
+    Shard& shard_for(const Key& key);
+
+    vector<Shard> shards;
+    size_t shard_capacity;
+    Hash hasher;
+
+    atomic<size_t> hit_count;
+    atomic<size_t> miss_count;
+};
+
+////////////////////////////////////////////////////////////////////////////
+// Template implementations
+////////////////////////////////////////////////////////////////////////////
+
+template<typename Key, typename Value, typename Hash>
+ShardedCache<Key, Value, Hash>::ShardedCache(size_t capacity, size_t shard_count) :
+    shards(max(shard_count, (size_t) 1)), hit_count(0), miss_count(0) {
+    // Round up so we never have a shard that can't hold anything.
+    shard_capacity = max((capacity + shards.size() - 1) / shards.size(), (size_t) 1);
+}
+
+template<typename Key, typename Value, typename Hash>
+typename ShardedCache<Key, Value, Hash>::Shard& ShardedCache<Key, Value, Hash>::shard_for(const Key& key) {
+    // Hash again by a different amount than the shard's own map uses, so the
+    // keys in one shard still spread out over its buckets.
+    return shards[(hasher(key) >> 7) % shards.size()];
+}
+
+template<typename Key, typename Value, typename Hash>
+pair<Value, bool> ShardedCache<Key, Value, Hash>::retrieve(const Key& key) {
+    Shard& shard = shard_for(key);
+    lock_guard<mutex> guard(shard.lock);
+
+    auto found = shard.index.find(key);
+    if (found == shard.index.end()) {
+        miss_count.fetch_add(1, memory_order_relaxed);
+        return make_pair(Value(), false);
+    }
+
+    // Move the item to the front, since it was just used.
+    shard.items.splice(shard.items.begin(), shard.items, found->second);
+    hit_count.fetch_add(1, memory_order_relaxed);
+    return make_pair(found->second->second, true);
+}
+
+template<typename Key, typename Value, typename Hash>
+void ShardedCache<Key, Value, Hash>::put(const Key& key, const Value& value) {
+    Shard& shard = shard_for(key);
+    lock_guard<mutex> guard(shard.lock);
+
+    auto found = shard.index.find(key);
+    if (found != shard.index.end()) {
+        // Another thread may have beaten us to it. Just refresh the item.
+        found->second->second = value;
+        shard.items.splice(shard.items.begin(), shard.items, found->second);
+        return;
+    }
+
+    if (shard.items.size() >= shard_capacity) {
+        // Evict the least recently used item.
+        shard.index.erase(shard.items.back().first);
+        shard.items.pop_back();
+    }
+
+    shard.items.emplace_front(key, value);
+    shard.index[key] = shard.items.begin();
+}
+
+template<typename Key, typename Value, typename Hash>
+size_t ShardedCache<Key, Value, Hash>::hits() const {
+    return hit_count.load(memory_order_relaxed);
+}
+
+template<typename Key, typename Value, typename Hash>
+size_t ShardedCache<Key, Value, Hash>::misses() const {
+    return miss_count.load(memory_order_relaxed);
+}
+
+template<typename Key, typename Value, typename Hash>
+size_t ShardedCache<Key, Value, Hash>::size() const {
+    size_t total = 0;
+    for (auto& shard : shards) {
+        // We don't lock here, so this is only approximate while other threads
+        // are writing.
+        total += shard.items.size();
+    }
+    return total;
+}
+
+}
+
+#endif
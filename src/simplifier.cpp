@@ -24,47 +24,39 @@ pair<size_t, size_t> Simplifier::simplify_once(size_t iteration) {
         exit(1);
     }
 
-    // Make a list of leaf sites
-    list<const Snarl*> leaves;
-    
-    if (show_progress) {
-        cerr << "Iteration " << iteration << ": Scanning " << graph.node_count() << " nodes and "
-            << graph.edge_count() << " edges for sites..." << endl;
-    }
-    
-    for (const Snarl* top_level_site : site_manager.top_level_snarls()) {
-        list<const Snarl*> queue {top_level_site};
-        
-        while (queue.size()) {
-            const Snarl* site = queue.front();
-            queue.pop_front();
+    if (!worklist_started) {
+        // Start from all the leaf sites in the decomposition. We never
+        // decompose the graph again: popping a leaf only deletes material
+        // strictly inside it, so every other snarl stays a snarl.
+        for (const Snarl* top_level_site : site_manager.top_level_snarls()) {
+            list<const Snarl*> queue {top_level_site};
             
-            if (site_manager.is_leaf(site)) {
-                // It's a leaf. Filter it out if it is trivial
+            while (queue.size()) {
+                const Snarl* site = queue.front();
+                queue.pop_front();
                 
-                if (site->type() == ULTRABUBBLE) {
-                    auto contents = site_manager.shallow_contents(site, graph, false);
-                    if (contents.first.empty()) {
-                        // Nothing but the boundary nodes in this snarl
-                        continue;
-                    }
+                if (site_manager.is_leaf(site)) {
+                    worklist.push_back(site);
                 }
-            
-                // Not trivial. Keep it.
-                leaves.push_back(site);
-            }
-            else {
-                for (const Snarl* child_site : site_manager.children_of(site)) {
-                    queue.push_back(child_site);
+                else {
+                    for (const Snarl* child_site : site_manager.children_of(site)) {
+                        queue.push_back(child_site);
+                    }
                 }
             }
         }
+        worklist_started = true;
     }
     
     if (show_progress) {
-        cerr << "Found " << leaves.size() << " leaves" << endl;
+        cerr << "Iteration " << iteration << ": Scanning " << worklist.size() << " sites in "
+            << graph.node_count() << " nodes and " << graph.edge_count() << " edges..." << endl;
     }
     
+    // Take the sites to look at on this pass
+    vector<const Snarl*> leaves;
+    std::swap(leaves, worklist);
+    
     // Index all the graph paths
     map<string, unique_ptr<PathIndex>> path_indexes;
     graph.paths.for_each_name([&](const string& name) {
@@ -77,25 +69,28 @@ pair<size_t, size_t> Simplifier::simplify_once(size_t iteration) {
     
     // We can't use the SnarlManager after we modify the graph, so we load the
     // contents of all the leaves we're going to modify first.
-    map<const Snarl*, pair<unordered_set<Node*>, unordered_set<Edge*>>> leaf_contents;
+    vector<pair<unordered_set<Node*>, unordered_set<Edge*>>> leaf_contents(leaves.size());
     
     // How big is each leaf in bp
-    map<const Snarl*, size_t> leaf_sizes;
+    vector<size_t> leaf_sizes(leaves.size(), 0);
     
     // We also need to pre-calculate the traversals for the snarls that are the
     // right size, since the traversal finder uses the snarl manager amd might
     // not work if we modify the graph.
-    map<const Snarl*, vector<SnarlTraversal>> leaf_traversals;
+    vector<vector<SnarlTraversal>> leaf_traversals(leaves.size());
     
-    for (const Snarl* leaf : leaves) {
+    // None of this modifies the graph, so we can look at all the leaves at once.
+#pragma omp parallel for schedule(dynamic, 1)
+    for (size_t i = 0; i < leaves.size(); i++) {
         // Look at all the leaves
+        const Snarl* leaf = leaves[i];
         
         // Get the contents of the bubble, excluding the boundary nodes
-        leaf_contents[leaf] = site_manager.deep_contents(leaf, graph, false);
+        leaf_contents[i] = site_manager.deep_contents(leaf, graph, false);
         
         // For each leaf, calculate its total size.
-        unordered_set<Node*>& nodes = leaf_contents[leaf].first;
-        size_t& total_size = leaf_sizes[leaf];
+        unordered_set<Node*>& nodes = leaf_contents[i].first;
+        size_t& total_size = leaf_sizes[i];
         for (Node* node : nodes) {
             // For each node include it in the size figure
             total_size += node->sequence().size();
@@ -114,28 +109,31 @@ pair<size_t, size_t> Simplifier::simplify_once(size_t iteration) {
         
         // Identify the replacement traversal for the bubble if it's the right size.
         // We can't necessarily do this after we've modified the graph.
-        vector<SnarlTraversal>& traversals = leaf_traversals[leaf];
-        traversals = traversal_finder.find_traversals(*leaf);
+        leaf_traversals[i] = traversal_finder.find_traversals(*leaf);
     }
     
-    for (const Snarl* leaf : leaves) {
+    for (size_t leaf_number = 0; leaf_number < leaves.size(); leaf_number++) {
         // Look at all the leaves
+        const Snarl* leaf = leaves[leaf_number];
         
         // Get the contents of the bubble, excluding the boundary nodes
-        unordered_set<Node*>& nodes = leaf_contents[leaf].first;
-        unordered_set<Edge*>& edges = leaf_contents[leaf].second;
+        unordered_set<Node*>& nodes = leaf_contents[leaf_number].first;
+        unordered_set<Edge*>& edges = leaf_contents[leaf_number].second;
         
         // For each leaf, grab its total size.
-        size_t& total_size = leaf_sizes[leaf];
+        size_t& total_size = leaf_sizes[leaf_number];
         
         if (total_size == 0) {
             // This site is just the start and end nodes, so it doesn't make
-            // sense to try and remove it.
+            // sense to try and remove it. Its parent may still be poppable.
+            cleared.insert(leaf);
+            increment_progress();
             continue;
         }
         
         if (total_size >= min_size) {
             // This site is too big to remove
+            increment_progress();
             continue;
         }
         
@@ -149,10 +147,11 @@ pair<size_t, size_t> Simplifier::simplify_once(size_t iteration) {
         // Otherwise we want to simplify this site away
         
         // Grab the replacement traversal for the bubble
-        vector<SnarlTraversal>& traversals = leaf_traversals[leaf];
+        vector<SnarlTraversal>& traversals = leaf_traversals[leaf_number];
         
         if (traversals.empty()) {
             // We couldn't find any paths through the site.
+            increment_progress();
             continue;
         }
         
@@ -302,6 +301,7 @@ pair<size_t, size_t> Simplifier::simplify_once(size_t iteration) {
             if (found_hairpin) {
                 // We found a hairpin, so we want to skip the site.
                 cerr << "warning:[vg simplify] Site " << to_node_traversal(leaf->start(), graph) << " - " << to_node_traversal(leaf->end(), graph) << " skipped due to hairpin path." << endl;
+                increment_progress();
                 continue;
             }
             
@@ -735,11 +735,36 @@ pair<size_t, size_t> Simplifier::simplify_once(size_t iteration) {
         }
         
         // OK we finished a leaf
+        cleared.insert(leaf);
         increment_progress();
     }
     
     destroy_progress();
     
+    // A snarl whose children have all been popped (or had nothing to pop) is
+    // now a leaf, so look at it on the next pass.
+    unordered_set<const Snarl*> queued;
+    for (const Snarl* leaf : leaves) {
+        if (!cleared.count(leaf)) {
+            continue;
+        }
+        const Snarl* parent = site_manager.parent_of(leaf);
+        if (parent == nullptr || parent->type() != ULTRABUBBLE || cleared.count(parent) || queued.count(parent)) {
+            continue;
+        }
+        bool all_cleared = true;
+        for (const Snarl* child : site_manager.children_of(parent)) {
+            if (!cleared.count(child)) {
+                all_cleared = false;
+                break;
+            }
+        }
+        if (all_cleared) {
+            worklist.push_back(parent);
+            queued.insert(parent);
+        }
+    }
+    
     // Reset the ranks in the graph, since we rewrote paths
     graph.paths.clear_mapping_ranks();
     
@@ -758,9 +783,9 @@ void Simplifier::simplify() {
                 << " nodes and " << deleted_elements.second << " edges" << endl;
         }
         
-        if (deleted_elements.first == 0 && deleted_elements.second == 0) {
-            // If nothing gets deleted, stop because trying again won't change
-            // things
+        if (worklist.empty()) {
+            // If there are no more snarls that could have become poppable,
+            // stop because trying again won't change things
             break;
         }
     }
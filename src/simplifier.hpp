@@ -37,8 +37,8 @@ public:
     /// messages.
     pair<size_t, size_t> simplify_once(size_t iteration = 0);
     
-    /// Simplify the graph until material stops being deleted or the maximum
-    /// iteration count is reached.
+    /// Simplify the graph until no more snarls can have become poppable or the
+    /// maximum iteration count is reached.
     void simplify();
     
     /// What's the miniumum size of a bubble to keep, in involved bases?
@@ -68,6 +68,16 @@ protected:
     /// This is used to find traversals of those sites
     TrivialTraversalFinder traversal_finder;
     
+    /// The sites to look at on the next simplify_once() pass. Starts as all
+    /// the leaves, and then gets the parents whose children are all cleared.
+    vector<const Snarl*> worklist;
+    
+    /// Have we filled in the worklist from the snarl decomposition yet?
+    bool worklist_started = false;
+    
+    /// Sites that have been popped, or that had nothing inside them to pop.
+    unordered_set<const Snarl*> cleared;
+    
     
 };
 
@@ -9,6 +9,7 @@
 #include "json2pb.h"
 #include "algorithms/topological_sort.hpp"
 #include "algorithms/is_acyclic.hpp"
+#include "algorithms/weakly_connected_components.hpp"
 
 namespace vg {
 
@@ -68,6 +69,81 @@ SnarlManager CactusSnarlFinder::find_snarls() {
     
 }
 
+SnarlManager CactusSnarlFinder::find_snarls_parallel() {
+    
+    // We'll fill this with all the snarls
+    SnarlManager snarl_manager;
+    
+    if (graph.size() == 0) {
+        // No snarls here!
+        return snarl_manager;
+    }
+    
+    vector<unordered_set<id_t>> weak_components = algorithms::weakly_connected_components(&graph);
+    
+    // Work out which paths go with which component, so each component can
+    // pick its telomeres from its own paths.
+    vector<vector<string>> component_paths(weak_components.size());
+    {
+        unordered_map<id_t, size_t> node_to_component;
+        for (size_t i = 0; i < weak_components.size(); i++) {
+            for (auto& id : weak_components[i]) {
+                node_to_component[id] = i;
+            }
+        }
+        graph.paths.for_each_name([&](const string& name) {
+            auto& path_mappings = graph.paths.get_path(name);
+            if (!path_mappings.empty()) {
+                component_paths[node_to_component[path_mappings.front().node_id()]].push_back(name);
+            }
+        });
+    }
+    
+#pragma omp parallel for schedule(dynamic, 1)
+    for (size_t i = 0; i < weak_components.size(); i++) {
+        if (weak_components[i].size() == 1) {
+            // Cactus can't handle these, and they can't contain snarls anyway.
+            continue;
+        }
+        
+        // Copy out just this component's part of the graph
+        VG component;
+#pragma omp critical (cactus_component_extract)
+        {
+            for (auto& id : weak_components[i]) {
+                component.add_node(*graph.get_node(id));
+            }
+            for (auto& id : weak_components[i]) {
+                for (Edge* edge : graph.edges_of(graph.get_node(id))) {
+                    component.add_edge(*edge);
+                }
+            }
+            for (auto& name : component_paths[i]) {
+                component.paths.extend(graph.paths.path(name));
+            }
+        }
+        // Make sure it is sorted, like the whole graph is.
+        algorithms::sort(&component);
+        
+        // Decompose it
+        pair<stCactusGraph*, stList*> cac_pair = vg_to_cactus(component, hint_paths);
+        stSnarlDecomposition *snarls = stCactusGraph_getSnarlDecomposition(cac_pair.first, cac_pair.second);
+        
+        // Add its snarls, as root chains, to the manager. Connectivity is
+        // worked out against the whole graph, which nobody is modifying.
+#pragma omp critical (cactus_snarl_emit)
+        recursively_emit_snarls(Visit(), Visit(), Visit(), Visit(), snarls->topLevelChains,
+                                snarls->topLevelUnarySnarls, snarl_manager);
+        
+        // Free everything Cactus made for this component before moving on
+        stSnarlDecomposition_destruct(snarls);
+        stList_destruct(cac_pair.second);
+        stCactusGraph_destruct(cac_pair.first);
+    }
+    
+    return snarl_manager;
+}
+
 const Snarl* CactusSnarlFinder::recursively_emit_snarls(const Visit& start, const Visit& end,
                                                         const Visit& parent_start, const Visit& parent_end,
                                                         stList* chains_list, stList* unary_snarls_list, SnarlManager& destination) {
@@ -583,11 +659,11 @@ const vector<const Snarl*>& SnarlManager::children_of(const Snarl* snarl) const
         // Looking for top level snarls
         return roots;
     }
-    return children.at(key_form(snarl));
+    return record_of(snarl).children;
 }
     
 const Snarl* SnarlManager::parent_of(const Snarl* snarl) const {
-    return parent.at(key_form(snarl));
+    return record_of(snarl).parent;
 }
     
 const Snarl* SnarlManager::snarl_sharing_start(const Snarl* here) const {
@@ -608,7 +684,7 @@ const Snarl* SnarlManager::snarl_sharing_end(const Snarl* here) const {
 }
     
 const Chain* SnarlManager::chain_of(const Snarl* snarl) const {
-    return parent_chain.at(key_form(snarl));
+    return record_of(snarl).parent_chain;
 }
     
 bool SnarlManager::in_nontrivial_chain(const Snarl* here) const {
@@ -657,7 +733,7 @@ const deque<Chain>& SnarlManager::chains_of(const Snarl* snarl) const {
     }
         
     // Otherwise, go look up the child chains of this snarl.
-    return child_chains.at(key_form(snarl));
+    return record_of(snarl).child_chains;
 }
     
 NetGraph SnarlManager::net_graph_of(const Snarl* snarl, const HandleGraph* graph, bool use_internal_connectivity) const {
@@ -667,11 +743,11 @@ NetGraph SnarlManager::net_graph_of(const Snarl* snarl, const HandleGraph* graph
 }
     
 bool SnarlManager::is_leaf(const Snarl* snarl) const {
-    return children.at(key_form(snarl)).size() == 0;
+    return record_of(snarl).children.size() == 0;
 }
     
 bool SnarlManager::is_root(const Snarl* snarl) const {
-    return parent.at(key_form(snarl)) == nullptr;
+    return record_of(snarl).parent == nullptr;
 }
     
 const vector<const Snarl*>& SnarlManager::top_level_snarls() const {
@@ -730,8 +806,8 @@ void SnarlManager::flip(const Snarl* snarl) {
     auto old_key = key_form(snarl);
         
     // Get a non-const reference to the cannonical snarl.
-    // TODO: Can't we use a const cast and save a lookup?
-    Snarl& to_flip = *self[key_form(snarl)];
+    size_t number = self.at(old_key);
+    Snarl& to_flip = *records[number].snarl;
         
     // swap and reverse the start and end Visits
     int64_t start_id = to_flip.start().node_id();
@@ -743,25 +819,10 @@ void SnarlManager::flip(const Snarl* snarl) {
     to_flip.mutable_end()->set_node_id(start_id);
     to_flip.mutable_end()->set_backward(!start_orientation);
         
-    // update parent index
-    parent[key_form(snarl)] = parent[old_key];
-    parent.erase(old_key);
-        
-    // update children index
-    children[key_form(snarl)] = std::move(children[old_key]);
-    children.erase(old_key);
-        
-    // And the child chain index
-    child_chains[key_form(snarl)] = std::move(child_chains[old_key]);
-    child_chains.erase(old_key);
-        
-    // And the parent chain index
-    parent_chain[key_form(snarl)] = std::move(parent_chain[old_key]);
-    parent_chain.erase(old_key);
-        
-    // Update self index
-    self[key_form(snarl)] = std::move(self[old_key]);
+    // Only the key index depends on the orientation; the tree records are
+    // found by snarl number.
     self.erase(old_key);
+    self[key_form(&to_flip)] = number;
         
     // note: snarl_into index is invariant to flipping
 }
@@ -776,13 +837,9 @@ const Snarl* SnarlManager::add_snarl(const Snarl& new_snarl) {
          << new_snarl.end().node_id() << " " << new_snarl.end().backward() << endl;
 #endif
         
-    // Remember where each snarl is
-    self[key_form(snarl)] = snarl;
-        
-    // It has an empty vector of children
-    children[key_form(snarl)] = vector<const Snarl*>();
-    // It has an empty list of child chains.
-    child_chains[key_form(snarl)] = deque<Chain>();
+    // Remember where each snarl is. It starts with no children and no
+    // child chains.
+    number_snarl(snarl);
         
     // We will set the parent later when we add the snarl's chain.
     // Every snarl has to be in a chain. Even the unary ones, in trivial chains.
@@ -809,12 +866,9 @@ void SnarlManager::add_chain(const Chain& new_chain, const Snarl* chain_parent)
             // Save it as a root snarl
             roots.push_back(child);
                 
-            // Save its parent, which is null
-            parent.emplace(key_form(child), nullptr);
-                
-            // Save its chain. Relies on the Chain in root_chains never
-            // moving.
-            parent_chain.emplace(key_form(child), &root_chains.back());
+            // Its parent stays null. Save its chain. Relies on the Chain in
+            // root_chains never moving.
+            record_of(child).parent_chain = &root_chains.back();
                 
 #ifdef debug
             cerr << "Stored parent of " << child << endl;
@@ -831,18 +885,18 @@ void SnarlManager::add_chain(const Chain& new_chain, const Snarl* chain_parent)
 #endif
         
         // Save a copy of the chain as a child chain
-        child_chains[key_form(chain_parent)].push_back(new_chain);
+        SnarlRecord& parent_record = record_of(chain_parent);
+        parent_record.child_chains.push_back(new_chain);
             
         for (const Snarl* child : new_chain) {
             // Save it as a child of the parent
-            children[key_form(chain_parent)].push_back(child);
-                
-            // Save its parent
-            parent.emplace(key_form(child), chain_parent);
+            parent_record.children.push_back(child);
                 
-            // Save its chain. Relies on the Chain in child_chains never
-            // moving.
-            parent_chain.emplace(key_form(child), &child_chains[key_form(chain_parent)].back());
+            // Save its parent, and its chain. Relies on the Chain in
+            // child_chains never moving.
+            SnarlRecord& child_record = record_of(child);
+            child_record.parent = chain_parent;
+            child_record.parent_chain = &parent_record.child_chains.back();
                 
 #ifdef debug
             cerr << "Stored parent of " << child << endl;
@@ -852,7 +906,7 @@ void SnarlManager::add_chain(const Chain& new_chain, const Snarl* chain_parent)
     }
         
 #ifdef debug
-    cerr << "Now have " << parent_chain.size() << " chain index entries for " << snarls.size() << " snarls" << endl;
+    cerr << "Now have " << records.size() << " records for " << snarls.size() << " snarls" << endl;
 #endif
 }
     
@@ -894,6 +948,28 @@ inline SnarlManager::key_t SnarlManager::key_form(const Snarl* snarl) const {
     return make_pair(make_pair(snarl->start().node_id(), snarl->start().backward()),
                      make_pair(snarl->end().node_id(), snarl->end().backward()));
 }
+
+inline const SnarlManager::SnarlRecord& SnarlManager::record_of(const Snarl* snarl) const {
+    auto found = snarl_number.find(snarl);
+    if (found != snarl_number.end()) {
+        // This is one of ours
+        return records[found->second];
+    }
+    // Otherwise look it up by its boundaries
+    return records[self.at(key_form(snarl))];
+}
+
+inline SnarlManager::SnarlRecord& SnarlManager::record_of(const Snarl* snarl) {
+    return const_cast<SnarlRecord&>(static_cast<const SnarlManager*>(this)->record_of(snarl));
+}
+
+void SnarlManager::number_snarl(Snarl* snarl) {
+    size_t number = records.size();
+    records.emplace_back();
+    records.back().snarl = snarl;
+    snarl_number[snarl] = number;
+    self[key_form(snarl)] = number;
+}
     
 
 void SnarlManager::build_indexes() {
@@ -902,14 +978,17 @@ void SnarlManager::build_indexes() {
     cerr << "Building SnarlManager index of " << snarls.size() << " snarls" << endl;
 #endif
         
+    for (Snarl& snarl : snarls) {
+        // Give every snarl its number first, so parents can be found
+        // whatever order the snarls came in.
+        number_snarl(&snarl);
+    }
+        
     for (Snarl& snarl : snarls) {
             
 #ifdef debug
         cerr << pb2json(snarl) << endl;
 #endif
-            
-        // Remember where each snarl is
-        self[key_form(&snarl)] = &snarl;
         
         // is this a top-level snarl?
         if (snarl.has_parent()) {
@@ -917,11 +996,11 @@ void SnarlManager::build_indexes() {
 #ifdef debug
             cerr << "\tSnarl is a child" << endl;
 #endif
-            if (!children.count(key_form(&(snarl.parent()))) ) {
-                children.insert(make_pair(key_form(&snarl.parent()), vector<const Snarl*>(1, &snarl)));
-            }
-            else {
-                children[key_form(&(snarl.parent()))].push_back(&snarl);
+            auto parent_number = self.find(key_form(&snarl.parent()));
+            if (parent_number != self.end()) {
+                SnarlRecord& parent_record = records[parent_number->second];
+                parent_record.children.push_back(&snarl);
+                records[snarl_number.at(&snarl)].parent = parent_record.snarl;
             }
         }
         else {
@@ -930,7 +1009,6 @@ void SnarlManager::build_indexes() {
             cerr << "\tSnarl is top-level" << endl;
 #endif
             roots.push_back(&snarl);
-            parent[key_form(&snarl)] = nullptr;
         }
             
         // add the boundaries into the indices
@@ -938,50 +1016,29 @@ void SnarlManager::build_indexes() {
         snarl_into[make_pair(snarl.end().node_id(), !snarl.end().backward())] = &snarl;
     }
         
-    for (Snarl& snarl : snarls) {
-        if (children.count(key_form(&snarl))) {
-            // mark this snarl as the parent in child-to-parent map
-            for (const Snarl* child : children[key_form(&snarl)]) {
-                parent[key_form(child)] = &snarl;
-            }
-        }
-        else {
-            // ensure that all snarls are in the parent-to-children map
-            children.insert(make_pair(key_form(&snarl), vector<const Snarl*>()));
+    // Chains were not provided already.
+    // Now compute the chains using the into and out-of indexes.
+    
+    // Compute the chains for the root level snarls
+    root_chains = compute_chains(roots);
+        
+    // Build the back index from root snarl to containing chain
+    for (auto& chain : root_chains) {
+        for (const Snarl* snarl : chain) {
+            record_of(snarl).parent_chain = &chain;
         }
     }
-        
-    if (root_chains.empty() || child_chains.empty()) {
-        // Chains were not provided already.
-        // Now compute the chains using the into and out-of indexes.
-        
-        // Compute the chains for the root level snarls
-        root_chains = compute_chains(roots);
+    
+    for (auto& record : records) {
+        // For each parent snarl, compute chains of its children and store
+        // them under the parent.
+        record.child_chains = compute_chains(record.children);
             
-        // Build the back index from root snarl to containing chain
-        for (auto& chain : root_chains) {
+        // Build the back index from child snarl to containing chain
+        for (auto& chain : record.child_chains) {
             for (const Snarl* snarl : chain) {
-                parent_chain.emplace(key_form(snarl), &chain);
-            }
-        }
-        
-        for (auto& kv : children) {
-            // For each parent snarl
-            const key_t& parent_key = kv.first;
-            // And its children
-            vector<const Snarl*>& snarl_children = kv.second;
-                
-            // Compute chains of the children and store it under the parent.
-            // Keep the iterator.
-            auto inserted = child_chains.emplace(make_pair(parent_key, compute_chains(snarl_children))).first;
-                
-            // Build the back index from child snarl to containing chain
-            for (auto& chain : inserted->second) {
-                for (const Snarl* snarl : chain) {
-                    parent_chain.emplace(key_form(snarl), &chain);
-                }
+                record_of(snarl).parent_chain = &chain;
             }
-                
         }
     }
 }
@@ -1340,7 +1397,23 @@ const Snarl* SnarlManager::manage(const Snarl& not_owned) const {
     }
         
     // Return the official copy of that snarl
-    return it->second;
+    return records[it->second].snarl;
+}
+    
+size_t SnarlManager::num_snarls() const {
+    return records.size();
+}
+    
+size_t SnarlManager::number_of(const Snarl* snarl) const {
+    auto found = snarl_number.find(snarl);
+    if (found != snarl_number.end()) {
+        return found->second;
+    }
+    return self.at(key_form(snarl));
+}
+    
+const Snarl* SnarlManager::snarl_by_number(size_t number) const {
+    return records.at(number).snarl;
 }
     
 vector<Visit> SnarlManager::visits_right(const Visit& visit, VG& graph, const Snarl* in_snarl) const {
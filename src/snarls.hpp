@@ -87,6 +87,17 @@ public:
      */
     virtual SnarlManager find_snarls();
     
+    /**
+     * Find all the snarls with Cactus, decomposing each weakly connected
+     * component of the graph separately on the available OpenMP threads.
+     * Each component's snarls are added to the SnarlManager as soon as it is
+     * done and its Cactus graph is freed, so only one Cactus graph per thread
+     * is ever in memory. Components consisting of a single node have no
+     * snarls and are skipped. The order of the top-level snarls depends on
+     * which components finish first.
+     */
+    SnarlManager find_snarls_parallel();
+    
 };
 
 /**
@@ -517,36 +528,70 @@ public:
     /// pointer to the managed copy of that Snarl.
     const Snarl* manage(const Snarl& not_owned) const;
         
+    /// Get the number of snarls in the manager
+    size_t num_snarls() const;
+        
+    /// Get the dense number, from 0 to num_snarls() - 1, of the given snarl.
+    /// Snarls are numbered in the order they were added, so the numbers can
+    /// be used to index per-snarl vectors instead of hashing snarls.
+    size_t number_of(const Snarl* snarl) const;
+        
+    /// Get the managed snarl with the given number
+    const Snarl* snarl_by_number(size_t number) const;
+        
 private:
     
     /// Define the key type
     using key_t = pair<pair<int64_t, bool>, pair<int64_t, bool>>;
+    
+    /// Everything we know about where a snarl sits in the snarl tree. Each
+    /// snarl gets a record, at the index of its snarl number.
+    struct SnarlRecord {
+        /// The managed copy of the snarl. Is non-const so we can do flip nicely.
+        Snarl* snarl = nullptr;
+        /// The snarl's parent, or null for a root snarl
+        const Snarl* parent = nullptr;
+        /// The chain the snarl appears in
+        const Chain* parent_chain = nullptr;
+        /// The child snarls the snarl contains
+        vector<const Snarl*> children;
+        /// The child chains the snarl contains.
+        /// Uses a deque so Chain* pointers don't get invalidated.
+        deque<Chain> child_chains;
+    };
         
     /// Master list of the snarls in the graph.
     /// Use a deque so pointers never get invalidated but we still have some locality.
     deque<Snarl> snarls;
+    
+    /// Tree records for the snarls, indexed by snarl number. Uses a deque so
+    /// the Chains in the records never move.
+    deque<SnarlRecord> records;
         
     /// Roots of snarl trees
     vector<const Snarl*> roots;
     /// Chains of root-level snarls. Uses a deque so Chain* pointers don't get invalidated.
     deque<Chain> root_chains;
+    
+    /// Map from the managed copy of each snarl to its snarl number. Looking
+    /// up a pointer is much cheaper than hashing a snarl's boundaries.
+    unordered_map<const Snarl*, size_t> snarl_number;
         
-    /// Map of snarls to the child snarls they contain
-    unordered_map<key_t, vector<const Snarl*>> children;
-    /// Map of snarls to the child chains they contain
-    /// Uses a deque so Chain* pointers don't get invalidated.
-    unordered_map<key_t, deque<Chain>> child_chains;
-    /// Map of snarls to their parent snarls
-    unordered_map<key_t, const Snarl*> parent;
-    /// Map of snarls to the chain each appears in
-    unordered_map<key_t, const Chain*> parent_chain;
-        
-    /// Map of snarl keys to the pointer to the managed copy in the snarls vector.
-    /// Is non-const so we can do flip nicely.
-    unordered_map<key_t, Snarl*> self;
+    /// Map of snarl keys to snarl numbers, for finding the managed copy of a
+    /// snarl we don't own.
+    unordered_map<key_t, size_t> self;
         
     /// Map of node traversals to the snarls they point into
     unordered_map<pair<int64_t, bool>, const Snarl*> snarl_into;
+    
+    /// Get the tree record for a snarl, which may be the managed copy or any
+    /// other snarl with the same boundaries. Throws std::out_of_range if the
+    /// snarl isn't in the manager.
+    inline const SnarlRecord& record_of(const Snarl* snarl) const;
+    inline SnarlRecord& record_of(const Snarl* snarl);
+    
+    /// Make a record for a snarl newly added to the snarls deque
+    void number_snarl(Snarl* snarl);
         
     /// Converts Snarl to the form used as keys in internal data structures
     inline key_t key_form(const Snarl* snarl) const;
@@ -1,8 +1,134 @@
 #include "srpe.hpp"
+#include "stream.hpp"
+
+#include <cstring>
+#include <cerrno>
+#include <exception>
+
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 using namespace std;
 namespace vg{
 
+    const uint8_t DepthMap::max_depth;
+
+    DepthMap::DepthMap(int64_t sz, bool on_disk) : length(sz) {
+        allocate(on_disk);
+    }
+
+    DepthMap::DepthMap(vg::VG* graph, bool on_disk) {
+        // Lay the nodes' counters out in the order the graph stores them
+        for (size_t i = 0; i < graph->graph.node_size(); i++) {
+            const Node& node = graph->graph.node(i);
+            node_range[node.id()] = make_pair(length, node.sequence().size());
+            length += node.sequence().size();
+        }
+        allocate(on_disk);
+    }
+
+    void DepthMap::allocate(bool on_disk) {
+        if (!on_disk) {
+            // Value initialization zeroes the counters
+            depths = new atomic<uint8_t>[length]();
+            return;
+        }
+        
+        // A new file reads as all zeroes, so the counters start out empty
+        backing_file = temp_file::create("vg-depth-");
+        backing_fd = open(backing_file.c_str(), O_RDWR);
+        if (backing_fd == -1 || ftruncate(backing_fd, max<uint64_t>(length, 1)) == -1) {
+            throw runtime_error("[DepthMap] could not make depth file " + backing_file + ": " + strerror(errno));
+        }
+        void* mapped = mmap(nullptr, max<uint64_t>(length, 1), PROT_READ | PROT_WRITE, MAP_SHARED, backing_fd, 0);
+        if (mapped == MAP_FAILED) {
+            throw runtime_error("[DepthMap] could not map depth file " + backing_file + ": " + strerror(errno));
+        }
+        // Lock-free byte atomics are laid out as plain bytes
+        static_assert(sizeof(atomic<uint8_t>) == 1, "depth counters must be one byte each");
+        depths = (atomic<uint8_t>*) mapped;
+    }
+
+    DepthMap::~DepthMap() {
+        if (backing_fd == -1) {
+            delete[] depths;
+        } else {
+            if (depths != nullptr) {
+                munmap(depths, max<uint64_t>(length, 1));
+            }
+            close(backing_fd);
+            temp_file::remove(backing_file);
+        }
+    }
+
+    void DepthMap::fill_depth(const vg::Path& p) {
+        for (size_t i = 0; i < p.mapping_size(); i++) {
+            const Mapping& m = p.mapping(i);
+            int64_t node_id = m.position().node_id();
+            bool is_reverse = m.position().is_reverse();
+            int64_t len = node_length(node_id);
+            int64_t offset = m.position().offset();
+            for (size_t j = 0; j < m.edit_size(); j++) {
+                const Edit& e = m.edit(j);
+                if (e.from_length() == e.to_length()) {
+                    for (int64_t x = 0; x < e.from_length(); x++) {
+                        // Count on the forward strand, if we know how long the node is
+                        int64_t along = offset + x;
+                        increment_depth(node_id, is_reverse && len != 0 ? len - along - 1 : along);
+                    }
+                }
+                offset += e.from_length();
+            }
+        }
+    }
+
+    void DepthMap::fill_depth(istream& gam_stream) {
+        // Exceptions can't leave the threads, so carry the first one out
+        exception_ptr failure;
+        function<void(Alignment&)> count_alignment = [&](Alignment& aln) {
+            try {
+                fill_depth(aln.path());
+            } catch (...) {
+#pragma omp critical (depth_failure)
+                if (!failure) {
+                    failure = current_exception();
+                }
+            }
+        };
+        stream::for_each_parallel(gam_stream, count_alignment);
+        if (failure) {
+            rethrow_exception(failure);
+        }
+    }
+
+    double DepthMap::mean_depth(int64_t node_id, int64_t offset, int64_t window) const {
+        int64_t len = node_length(node_id);
+        int64_t end = offset + window;
+        if (len != 0) {
+            end = min(end, len);
+        }
+        offset = max<int64_t>(offset, 0);
+        if (end <= offset) {
+            return 0.0;
+        }
+        uint64_t total = 0;
+        for (int64_t i = offset; i < end; i++) {
+            total += get_depth(node_id, i);
+        }
+        return (double) total / (end - offset);
+    }
+
+    vector<double> DepthMap::window_depths(int64_t node_id, int64_t window_size) const {
+        vector<double> to_return;
+        int64_t len = node_length(node_id);
+        window_size = max<int64_t>(window_size, 1);
+        for (int64_t start = 0; start < len; start += window_size) {
+            to_return.push_back(mean_depth(node_id, start, window_size));
+        }
+        return to_return;
+    }
+
     double SRPE::discordance_score(vector<Alignment> alns, VG* subgraph){
         // Sum up the mapping scores
         // subtract the soft clips
@@ -2,6 +2,8 @@
 #define VG_SRPE
 #include <string>
 #include <cstdint>
+#include <atomic>
+#include <unordered_map>
 #include <Variant.h>
 #include "filter.hpp"
 #include "index.hpp"
@@ -84,54 +86,86 @@ namespace vg{
           
 class DepthMap {
     /**
-    *  Map <node_id : offset : depth>
-    *  or
-    *  Map <SnarlTraversal : support count>
+    *  Read depth at every base of a graph, as saturating 8-bit counters laid
+    *  out node by node. Counters can be bumped from many threads at once, and
+    *  for graphs too big to hold in memory they can live in a memory-mapped
+    *  temporary file instead.
     */
 public:
-  int8_t* depths;
-  uint64_t size;
-  map<int64_t, uint64_t> node_pos;
-  vg::VG* g_graph;
-  inline DepthMap(int64_t sz) { depths = new int8_t[sz]; };
-  inline DepthMap() {};
-  inline DepthMap(vg::VG* graph){
-    g_graph = graph;
-    int64_t tot_size = 0;
-    std::function<void(Node*)> count_size = [&](Node* n){
-        #pragma omp critical
-        {
-            node_pos[n->id()] = tot_size;
-            tot_size += n->sequence().length();
-        }
-    };
-    graph->for_each_node(count_size);
-    size = tot_size;
-    depths = new int8_t(size);
+  /// The deepest a counter goes; depths stay there once they reach it
+  static const uint8_t max_depth = 255;
+
+  /// Make sz counters not tied to a graph, where a node's ID is taken as the
+  /// position of its first base
+  DepthMap(int64_t sz, bool on_disk = false);
+  /// Make counters for every base of every node in the graph
+  DepthMap(vg::VG* graph, bool on_disk = false);
+  ~DepthMap();
+
+  DepthMap(const DepthMap& other) = delete;
+  DepthMap& operator=(const DepthMap& other) = delete;
+
+  /// Get the number of counters
+  inline uint64_t size() const { return length; };
+
+  /// Get the depth at an offset along the forward strand of a node
+  inline uint8_t get_depth(int64_t node_id, int64_t offset) const {
+    return depths[index_of(node_id, offset)].load(std::memory_order_relaxed);
   };
-  inline int8_t get_depth(int64_t node_id, int64_t offset) { return depths[node_id + offset]; };
-  inline void set_depth(int64_t node_id, int64_t offset, int8_t d) { depths[node_id + offset] = d; };
+  inline void set_depth(int64_t node_id, int64_t offset, uint8_t d) {
+    depths[index_of(node_id, offset)].store(d, std::memory_order_relaxed);
+  };
+  /// Add one to the depth at an offset along the forward strand of a node,
+  /// unless it is already at max_depth. Safe to call from many threads.
   inline void increment_depth(int64_t node_id, int64_t offset) {
-    
-    depths[node_pos [node_id] + offset] += 1;
-};
-  inline void fill_depth(const vg::Path& p){
-    for (int i = 0; i < p.mapping_size(); i++){
-        Mapping m = p.mapping(i);
-        Position p = m.position();
-        int64_t nodeid = p.node_id();
-        int offset = p.offset();
-        for (int j = 0; j < m.edit_size(); j++){
-            Edit e = m.edit(j);
-            if (e.from_length() == e.to_length() && e.sequence().empty()){
-                for (int x = 0; x < e.from_length(); ++x){
-                    increment_depth(nodeid, offset + x);
-                }
-            }
-        }
+    std::atomic<uint8_t>& counter = depths[index_of(node_id, offset)];
+    uint8_t d = counter.load(std::memory_order_relaxed);
+    while (d < max_depth && !counter.compare_exchange_weak(d, d + 1, std::memory_order_relaxed)) {
+      // d now holds the value someone else got in first; try again
     }
   };
 
+  /// Count the bases that the path matches or mismatches against. Safe to
+  /// call from many threads.
+  void fill_depth(const vg::Path& p);
+  /// Count the bases covered by every alignment in a GAM stream, in parallel
+  void fill_depth(istream& gam_stream);
+
+  /// Get the mean depth over the window bases of a node starting at offset on
+  /// its forward strand. The window is clipped to the node.
+  double mean_depth(int64_t node_id, int64_t offset, int64_t window) const;
+  /// Get the mean depth of each successive window of window_size bases along
+  /// a node
+  vector<double> window_depths(int64_t node_id, int64_t window_size) const;
+
+private:
+  /// Find the counter for an offset in a node. Throws a runtime_error for
+  /// nodes not in the graph.
+  inline uint64_t index_of(int64_t node_id, int64_t offset) const {
+    if (node_range.empty()) {
+      return node_id + offset;
+    }
+    auto found = node_range.find(node_id);
+    if (found == node_range.end()) {
+      throw runtime_error("[DepthMap] node " + std::to_string(node_id) + " is not in the graph");
+    }
+    return found->second.first + offset;
+  };
+  /// Get the length of a node, or 0 if we aren't tied to a graph
+  inline int64_t node_length(int64_t node_id) const {
+    auto found = node_range.find(node_id);
+    return found == node_range.end() ? 0 : found->second.second;
+  };
+  /// Allocate the counters, in memory or in a temporary file
+  void allocate(bool on_disk);
+
+  std::atomic<uint8_t>* depths = nullptr;
+  uint64_t length = 0;
+  /// The first counter and length of each node
+  unordered_map<int64_t, pair<uint64_t, uint64_t>> node_range;
+  /// The backing file and its descriptor, when on disk
+  string backing_file;
+  int backing_fd = -1;
 };
 
     class SRPE{
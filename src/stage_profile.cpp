@@ -0,0 +1,279 @@
+#include "stage_profile.hpp"
+#include "annotation.hpp"
+#include "stream.hpp"
+#include "utility.hpp"
+
+#include <algorithm>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/**
+ * \file stage_profile.cpp: implementations of the mapping stage profiler
+ */
+
+namespace vg {
+
+namespace stage_profile {
+
+using namespace std;
+
+bool is_enabled = false;
+
+/// The number of read latency histogram buckets. Bucket i holds latencies of
+/// 2^i to 2^(i + 1) microseconds, except that bucket 0 starts at 0.
+static const size_t LATENCY_BUCKETS = 32;
+
+static const char* stage_names[STAGE_COUNT] = {"mem_search", "sub_mem_reseed", "clustering",
+    "subgraph_extraction", "ungapped", "dp", "mapq", "pair_rescue"};
+static const char* counter_names[COUNTER_COUNT] = {"reads", "mems", "sub_mems", "clusters",
+    "clustered_mems", "dp_cells", "rescues", "rescue_cache_hits",
+    "ungapped_alignments"};
+
+/// What one thread has collected.
+struct ThreadTotals {
+    uint64_t nanoseconds[STAGE_COUNT] = {};
+    uint64_t calls[STAGE_COUNT] = {};
+    uint64_t counts[COUNTER_COUNT] = {};
+    uint64_t latencies[LATENCY_BUCKETS] = {};
+    uint64_t max_latency = 0;
+    uint64_t slow_reads = 0;
+};
+
+/// The peak RSS at each checkpoint so far.
+static vector<pair<string, size_t>> rss_checkpoints;
+
+/// Reads at least this slow go to the slow read callback.
+static uint64_t slow_read_threshold = 0;
+static SlowReadCallback slow_read_callback;
+
+/// Guards the list of per-thread totals.
+static mutex registry_lock;
+
+/// Get the totals for every thread that has collected anything. We never
+/// free them, so threads that finish before the report still count.
+static vector<unique_ptr<ThreadTotals>>& registry() {
+    static vector<unique_ptr<ThreadTotals>>* all_totals = new vector<unique_ptr<ThreadTotals>>();
+    return *all_totals;
+}
+
+/// Get this thread's totals, making them on first use.
+static ThreadTotals& local_totals() {
+    thread_local ThreadTotals* mine = nullptr;
+    if (mine == nullptr) {
+        lock_guard<mutex> guard(registry_lock);
+        registry().emplace_back(new ThreadTotals());
+        mine = registry().back().get();
+    }
+    return *mine;
+}
+
+void enable() {
+    is_enabled = true;
+}
+
+void add_time(Stage stage, uint64_t nanoseconds) {
+    ThreadTotals& totals = local_totals();
+    totals.nanoseconds[stage] += nanoseconds;
+    totals.calls[stage]++;
+}
+
+void add_count(Counter counter, uint64_t amount) {
+    local_totals().counts[counter] += amount;
+}
+
+void record_peak_rss(const string& checkpoint) {
+    if (enabled()) {
+        lock_guard<mutex> guard(registry_lock);
+        rss_checkpoints.emplace_back(checkpoint, get_peak_rss());
+    }
+}
+
+void set_slow_read_callback(uint64_t threshold_nanoseconds, const SlowReadCallback& callback) {
+    slow_read_threshold = threshold_nanoseconds;
+    slow_read_callback = callback;
+}
+
+void annotate(Alignment& read, const ReadTrace& trace) {
+    set_annotation(read, "latency_us", trace.nanoseconds / 1e3);
+    for (size_t i = 0; i < STAGE_COUNT; i++) {
+        set_annotation(read, string(stage_names[i]) + "_us", trace.stage_nanoseconds[i] / 1e3);
+    }
+    for (size_t i = 0; i < COUNTER_COUNT; i++) {
+        set_annotation(read, counter_names[i], (double) trace.counts[i]);
+    }
+}
+
+/// Where slow reads are being saved, if anywhere.
+static ostream* slow_reads_out = nullptr;
+
+void save_slow_reads(ostream& out, uint64_t threshold_nanoseconds) {
+    slow_reads_out = &out;
+    set_slow_read_callback(threshold_nanoseconds, [](const Alignment& read1, const Alignment* read2,
+                                                     const ReadTrace& trace) {
+        vector<Alignment> saved(1, read1);
+        if (read2 != nullptr) {
+            saved.push_back(*read2);
+        }
+        for (auto& read : saved) {
+            annotate(read, trace);
+        }
+        // Slow reads are rare, so they can go out as soon as we have them
+        stream::write_buffered(*slow_reads_out, saved, 1);
+    });
+}
+
+void finish_slow_reads() {
+    if (slow_reads_out != nullptr) {
+        stream::finish(*slow_reads_out);
+        slow_reads_out = nullptr;
+    }
+    set_slow_read_callback(0, nullptr);
+}
+
+/// How many tracers are live on this thread.
+static thread_local size_t tracer_depth = 0;
+
+ReadTracer::ReadTracer(const Alignment& read1, const Alignment* read2) : read1(read1), read2(read2),
+    entered(enabled()), running(false) {
+    if (entered) {
+        running = tracer_depth++ == 0;
+    }
+    if (running) {
+        ThreadTotals& totals = local_totals();
+        copy(begin(totals.nanoseconds), end(totals.nanoseconds), before.stage_nanoseconds);
+        copy(begin(totals.counts), end(totals.counts), before.counts);
+        start = chrono::steady_clock::now();
+    }
+}
+
+ReadTracer::~ReadTracer() {
+    if (entered) {
+        tracer_depth--;
+    }
+    if (!running) {
+        return;
+    }
+    
+    ReadTrace trace;
+    trace.nanoseconds = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+    
+    ThreadTotals& totals = local_totals();
+    size_t bucket = 0;
+    for (uint64_t microseconds = trace.nanoseconds / 1000; microseconds > 1 && bucket + 1 < LATENCY_BUCKETS;
+         microseconds >>= 1) {
+        bucket++;
+    }
+    totals.latencies[bucket]++;
+    totals.max_latency = max(totals.max_latency, trace.nanoseconds);
+    
+    if (slow_read_callback && trace.nanoseconds >= slow_read_threshold) {
+        totals.slow_reads++;
+        for (size_t i = 0; i < STAGE_COUNT; i++) {
+            trace.stage_nanoseconds[i] = totals.nanoseconds[i] - before.stage_nanoseconds[i];
+        }
+        for (size_t i = 0; i < COUNTER_COUNT; i++) {
+            trace.counts[i] = totals.counts[i] - before.counts[i];
+        }
+        slow_read_callback(read1, read2, trace);
+    }
+}
+
+size_t sequence_length(const Graph& graph) {
+    size_t length = 0;
+    for (auto& node : graph.node()) {
+        length += node.sequence().size();
+    }
+    return length;
+}
+
+void write_json(ostream& out) {
+    ThreadTotals sum;
+    size_t thread_count;
+    {
+        lock_guard<mutex> guard(registry_lock);
+        thread_count = registry().size();
+        for (auto& totals : registry()) {
+            for (size_t i = 0; i < STAGE_COUNT; i++) {
+                sum.nanoseconds[i] += totals->nanoseconds[i];
+                sum.calls[i] += totals->calls[i];
+            }
+            for (size_t i = 0; i < COUNTER_COUNT; i++) {
+                sum.counts[i] += totals->counts[i];
+            }
+            for (size_t i = 0; i < LATENCY_BUCKETS; i++) {
+                sum.latencies[i] += totals->latencies[i];
+            }
+            sum.max_latency = max(sum.max_latency, totals->max_latency);
+            sum.slow_reads += totals->slow_reads;
+        }
+    }
+    
+    // Report averages per read, and per cluster for the cluster size
+    double reads = max(sum.counts[READS], (uint64_t) 1);
+    
+    out << "{\"threads\": " << thread_count << "," << endl;
+    out << " \"stages\": {";
+    for (size_t i = 0; i < STAGE_COUNT; i++) {
+        out << (i == 0 ? "" : ",") << endl;
+        out << "  \"" << stage_names[i] << "\": {\"calls\": " << sum.calls[i]
+            << ", \"seconds\": " << sum.nanoseconds[i] / 1e9
+            << ", \"us_per_read\": " << sum.nanoseconds[i] / 1e3 / reads << "}";
+    }
+    out << endl << " }," << endl;
+    out << " \"counters\": {";
+    for (size_t i = 0; i < COUNTER_COUNT; i++) {
+        out << (i == 0 ? "" : ",") << endl;
+        out << "  \"" << counter_names[i] << "\": {\"total\": " << sum.counts[i]
+            << ", \"per_read\": " << sum.counts[i] / reads << "}";
+    }
+    out << endl << " }," << endl;
+    
+    // Latency quantiles are only known to within a bucket, so report the top
+    // of the bucket they fall in
+    uint64_t traced = 0;
+    size_t last_bucket = 0;
+    for (size_t i = 0; i < LATENCY_BUCKETS; i++) {
+        traced += sum.latencies[i];
+        if (sum.latencies[i] > 0) {
+            last_bucket = i;
+        }
+    }
+    auto quantile_us = [&](double quantile) {
+        uint64_t seen = 0;
+        for (size_t i = 0; i < LATENCY_BUCKETS; i++) {
+            seen += sum.latencies[i];
+            if (seen > 0 && seen >= quantile * traced) {
+                return (uint64_t) 2 << i;
+            }
+        }
+        return (uint64_t) 0;
+    };
+    out << " \"read_latency\": {\"traced\": " << traced
+        << ", \"slow\": " << sum.slow_reads
+        << ", \"p50_us_at_most\": " << quantile_us(0.5)
+        << ", \"p99_us_at_most\": " << quantile_us(0.99)
+        << ", \"p999_us_at_most\": " << quantile_us(0.999)
+        << ", \"max_us\": " << sum.max_latency / 1e3 << "," << endl;
+    out << "  \"log2_us_histogram\": [";
+    for (size_t i = 0; i <= last_bucket && traced > 0; i++) {
+        out << (i == 0 ? "" : ", ") << sum.latencies[i];
+    }
+    out << "]}," << endl;
+    
+    out << " \"peak_rss_bytes\": {";
+    {
+        lock_guard<mutex> guard(registry_lock);
+        for (auto& checkpoint : rss_checkpoints) {
+            out << "\"" << checkpoint.first << "\": " << checkpoint.second << ", ";
+        }
+    }
+    out << "\"end\": " << get_peak_rss() << "}," << endl;
+    out << " \"mean_cluster_size\": " << sum.counts[CLUSTERED_MEMS] / (double) max(sum.counts[CLUSTERS], (uint64_t) 1)
+        << "}" << endl;
+}
+
+}
+
+}
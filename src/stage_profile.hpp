@@ -0,0 +1,205 @@
+#ifndef VG_STAGE_PROFILE_HPP_INCLUDED
+#define VG_STAGE_PROFILE_HPP_INCLUDED
+
+/** \file
+ * Low-overhead, per-thread timers and counters for the stages of read
+ * mapping, so we can see where the time in vg map and vg mpmap goes.
+ *
+ * Collection is off until enable() is called, and costs one branch per
+ * instrumented call when off. Building with VG_NO_STAGE_PROFILE defined
+ * compiles the instrumentation out entirely. While collecting, each read's
+ * latency also goes into a histogram, and reads slower than a threshold can
+ * be handed off, with what went into mapping them, to be saved and rerun.
+ */
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "vg.pb.h"
+
+namespace vg {
+
+namespace stage_profile {
+
+using namespace std;
+
+/// The stages of mapping we time. Stage times include the time of any
+/// stages run inside them (sub-MEM reseeding happens during MEM search).
+enum Stage : size_t {
+    MEM_SEARCH,
+    SUB_MEM_RESEED,
+    CLUSTERING,
+    SUBGRAPH_EXTRACTION,
+    UNGAPPED,
+    DP,
+    MAPQ,
+    PAIR_RESCUE,
+    STAGE_COUNT
+};
+
+/// The things we count. Reads are counted each time they go through the
+/// mapper, so pairs that are put off and mapped again count twice.
+enum Counter : size_t {
+    READS,
+    MEMS,
+    SUB_MEMS,
+    CLUSTERS,
+    CLUSTERED_MEMS,
+    DP_CELLS,
+    RESCUES,
+    RESCUE_CACHE_HITS,
+    UNGAPPED_ALIGNMENTS,
+    COUNTER_COUNT
+};
+
+/// Set if collection is on. Read it through enabled().
+extern bool is_enabled;
+
+/// Start collecting. Should be called before any mapping threads start.
+void enable();
+
+/// Return true if we are collecting.
+inline bool enabled() {
+    return is_enabled;
+}
+
+/// Add time spent in a stage by this thread.
+void add_time(Stage stage, uint64_t nanoseconds);
+
+/// Add to a counter for this thread.
+void add_count(Counter counter, uint64_t amount);
+
+/// Get the total length of all the node sequences in a graph, for counting
+/// DP cells.
+size_t sequence_length(const Graph& graph);
+
+/// Get the total number of hits in a collection of clusters.
+template<typename Clusters>
+size_t total_cluster_size(const Clusters& clusters) {
+    size_t total = 0;
+    for (auto& cluster : clusters) {
+        total += cluster.size();
+    }
+    return total;
+}
+
+/// Note the peak resident memory so far, at a named point in the run such as
+/// when the indexes are loaded, for the report, which also gives the peak at
+/// the end. Does nothing unless collection is on.
+void record_peak_rss(const string& checkpoint);
+
+/// Sum up what all the threads have collected and write it as a JSON
+/// report. Must not be called while mapping threads are still working.
+void write_json(ostream& out);
+
+/// What went into mapping one read, or one pair: how long it took, and the
+/// time spent in and counts of each stage while it was mapped.
+struct ReadTrace {
+    uint64_t nanoseconds = 0;
+    uint64_t stage_nanoseconds[STAGE_COUNT] = {};
+    uint64_t counts[COUNTER_COUNT] = {};
+};
+
+/// Gets reads that took at least the slow read threshold, with their trace.
+/// The second read is null unless a pair was mapped together. Called on the
+/// mapping thread, so it must be thread safe.
+using SlowReadCallback = function<void(const Alignment& read1, const Alignment* read2, const ReadTrace& trace)>;
+
+/// Pass every read that takes at least the given time to map to the callback.
+/// Should be called before any mapping threads start, and only does anything
+/// while collection is on.
+void set_slow_read_callback(uint64_t threshold_nanoseconds, const SlowReadCallback& callback);
+
+/// Annotate a read with its trace, in microseconds for the times, so it
+/// carries its breakdown when it is saved.
+void annotate(Alignment& read, const ReadTrace& trace);
+
+/// Save every read that takes at least the given time to map to the stream,
+/// as annotated GAM with a group per read or pair, through the slow read
+/// callback. The stream must stay open until finish_slow_reads() is called.
+void save_slow_reads(ostream& out, uint64_t threshold_nanoseconds);
+
+/// Stop saving slow reads, and end the GAM stream they were saved to. Must
+/// not be called while mapping threads are still working.
+void finish_slow_reads();
+
+/**
+ * Traces the mapping of a read or pair from construction to destruction, if
+ * collection is on, adding its latency to the histogram and handing it to
+ * the slow read callback if it was slow. Only the outermost tracer on a
+ * thread counts, so mapping that calls back into mapping isn't counted twice.
+ */
+class ReadTracer {
+public:
+    ReadTracer(const Alignment& read1, const Alignment* read2 = nullptr);
+    ~ReadTracer();
+    
+private:
+    const Alignment& read1;
+    const Alignment* read2;
+    /// Whether we count towards the nesting depth
+    bool entered;
+    /// Whether we are the outermost tracer, timing the read
+    bool running;
+    chrono::steady_clock::time_point start;
+    /// This thread's totals when we started
+    ReadTrace before;
+};
+
+/**
+ * Times a stage from construction to destruction, if collection is on.
+ */
+class StageTimer {
+public:
+    inline StageTimer(Stage stage) : stage(stage), running(enabled()) {
+        if (running) {
+            start = chrono::steady_clock::now();
+        }
+    }
+    
+    inline ~StageTimer() {
+        if (running) {
+            add_time(stage, chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count());
+        }
+    }
+    
+private:
+    Stage stage;
+    bool running;
+    chrono::steady_clock::time_point start;
+};
+
+}
+
+}
+
+#define VG_STAGE_PROFILE_CONCAT_INNER(a, b) a##b
+#define VG_STAGE_PROFILE_CONCAT(a, b) VG_STAGE_PROFILE_CONCAT_INNER(a, b)
+
+#ifndef VG_NO_STAGE_PROFILE
+/// Time the named stage until the end of the current scope.
+#define VG_PROFILE_STAGE(stage) \
+    ::vg::stage_profile::StageTimer VG_STAGE_PROFILE_CONCAT(stage_profile_timer_, __LINE__)(::vg::stage_profile::stage)
+/// Add to the named counter. The amount is only evaluated if collection is on.
+#define VG_PROFILE_COUNT(counter, amount) \
+    do { \
+        if (::vg::stage_profile::enabled()) { \
+            ::vg::stage_profile::add_count(::vg::stage_profile::counter, (amount)); \
+        } \
+    } while (false)
+/// Trace the mapping of the given read or reads until the end of the current
+/// scope.
+#define VG_PROFILE_READ(...) \
+    ::vg::stage_profile::ReadTracer VG_STAGE_PROFILE_CONCAT(stage_profile_tracer_, __LINE__)(__VA_ARGS__)
+#else
+#define VG_PROFILE_STAGE(stage)
+#define VG_PROFILE_COUNT(counter, amount) do {} while (false)
+#define VG_PROFILE_READ(...)
+#endif
+
+#endif
@@ -0,0 +1,310 @@
+#ifndef VG_STAGED_PIPELINE_HPP_INCLUDED
+#define VG_STAGED_PIPELINE_HPP_INCLUDED
+
+/** \file
+ * Run batches of work items through a series of stages, each with its own
+ * threads, connected by bounded queues, so each stage's working set can stay
+ * in its threads' caches.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <omp.h>
+
+namespace vg {
+
+using namespace std;
+
+/**
+ * A queue of limited size for handing things between threads. Pushing waits
+ * while the queue is full, and popping waits while it is empty but still
+ * open.
+ */
+template<typename T>
+class BoundedQueue {
+public:
+
+    /// Make a queue that holds at most the given number of items.
+    BoundedQueue(size_t capacity);
+
+    // Queues hold a mutex, so they can't be moved or copied.
+    BoundedQueue(const BoundedQueue& other) = delete;
+    BoundedQueue& operator=(const BoundedQueue& other) = delete;
+
+    /// Add an item, waiting for space if needed.
+    void push(T&& item);
+
+    /// Take the oldest item, waiting for one if needed. Returns false if the
+    /// queue has been closed and has nothing left in it.
+    bool pop(T& item);
+
+    /// Mark that nothing more will be pushed, and wake any waiting poppers.
+    void close();
+
+private:
+
+    size_t capacity;
+    deque<T> items;
+    bool closed = false;
+    mutex lock;
+    condition_variable not_empty;
+    condition_variable not_full;
+};
+
+/**
+ * Runs items through a series of stages. One thread reads items in batches,
+ * and each stage has its own threads that take batches from the queue before
+ * them, work on each item in the batch, and put the batch on the queue after
+ * them. The time each stage spends working and waiting for input is counted,
+ * so the thread allotments can be tuned.
+ *
+ * Everything runs in one OpenMP parallel region, so the stage functions see
+ * thread numbers below thread_count().
+ */
+template<typename Item>
+class StagedPipeline {
+public:
+
+    /// Make a pipeline that moves the given number of items at a time, and
+    /// lets up to queue_batches batches per thread wait before each stage.
+    StagedPipeline(size_t batch_size = 64, size_t queue_batches = 2);
+
+    /// Add a stage after all the others, to run on the given number of
+    /// threads (at least one).
+    void add_stage(const string& name, size_t threads, const function<void(Item&)>& work);
+
+    /// Get the number of threads run() will use: one to read, and the
+    /// threads for all the stages.
+    size_t thread_count() const;
+
+    /// Run all the items from the source through all the stages. The source
+    /// is called once, on one thread, and should pass each item to the
+    /// function it is given, which takes the item's contents. Returns the
+    /// number of items run.
+    size_t run(const function<void(const function<void(Item&)>&)>& source);
+
+    /// Describe, one line per stage, how many items each stage has done and
+    /// how long it has spent working and waiting.
+    void report(ostream& out) const;
+
+private:
+
+    struct Stage {
+        string name;
+        size_t threads;
+        function<void(Item&)> work;
+        atomic<size_t> items;
+        atomic<uint64_t> busy_nanoseconds;
+        atomic<uint64_t> wait_nanoseconds;
+    };
+
+    /// Send one batch through all the stages on this thread, for when we
+    /// can't get enough threads to run the stages separately.
+    void run_batch_serially(vector<Item>& batch);
+
+    /// Get the nanoseconds since the given time.
+    static uint64_t nanoseconds_since(const chrono::steady_clock::time_point& start);
+
+    vector<unique_ptr<Stage>> stages;
+    size_t batch_size;
+    size_t queue_batches;
+};
+
+////////////////////////////////////////////////////////////////////////////
+// Template implementations
+////////////////////////////////////////////////////////////////////////////
+
+template<typename T>
+BoundedQueue<T>::BoundedQueue(size_t capacity) : capacity(max(capacity, (size_t) 1)) {
+    // nothing to do
+}
+
+template<typename T>
+void BoundedQueue<T>::push(T&& item) {
+    unique_lock<mutex> guard(lock);
+    not_full.wait(guard, [&]() { return items.size() < capacity; });
+    items.emplace_back(move(item));
+    guard.unlock();
+    not_empty.notify_one();
+}
+
+template<typename T>
+bool BoundedQueue<T>::pop(T& item) {
+    unique_lock<mutex> guard(lock);
+    not_empty.wait(guard, [&]() { return !items.empty() || closed; });
+    if (items.empty()) {
+        // Closed and drained
+        return false;
+    }
+    item = move(items.front());
+    items.pop_front();
+    guard.unlock();
+    not_full.notify_one();
+    return true;
+}
+
+template<typename T>
+void BoundedQueue<T>::close() {
+    {
+        lock_guard<mutex> guard(lock);
+        closed = true;
+    }
+    not_empty.notify_all();
+}
+
+template<typename Item>
+StagedPipeline<Item>::StagedPipeline(size_t batch_size, size_t queue_batches) :
+    batch_size(max(batch_size, (size_t) 1)), queue_batches(max(queue_batches, (size_t) 1)) {
+    // nothing to do
+}
+
+template<typename Item>
+void StagedPipeline<Item>::add_stage(const string& name, size_t threads, const function<void(Item&)>& work) {
+    stages.emplace_back(new Stage());
+    Stage& stage = *stages.back();
+    stage.name = name;
+    stage.threads = max(threads, (size_t) 1);
+    stage.work = work;
+    stage.items = 0;
+    stage.busy_nanoseconds = 0;
+    stage.wait_nanoseconds = 0;
+}
+
+template<typename Item>
+size_t StagedPipeline<Item>::thread_count() const {
+    size_t total = 1;
+    for (auto& stage : stages) {
+        total += stage->threads;
+    }
+    return total;
+}
+
+template<typename Item>
+uint64_t StagedPipeline<Item>::nanoseconds_since(const chrono::steady_clock::time_point& start) {
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+}
+
+template<typename Item>
+void StagedPipeline<Item>::run_batch_serially(vector<Item>& batch) {
+    for (auto& stage : stages) {
+        auto start = chrono::steady_clock::now();
+        for (Item& item : batch) {
+            stage->work(item);
+        }
+        stage->busy_nanoseconds += nanoseconds_since(start);
+        stage->items += batch.size();
+    }
+}
+
+template<typename Item>
+size_t StagedPipeline<Item>::run(const function<void(const function<void(Item&)>&)>& source) {
+
+    // Queue i feeds stage i
+    vector<unique_ptr<BoundedQueue<vector<Item>>>> queues;
+    // How many threads are still working on each stage
+    vector<atomic<size_t>> running(stages.size());
+    for (size_t i = 0; i < stages.size(); i++) {
+        queues.emplace_back(new BoundedQueue<vector<Item>>(queue_batches * stages[i]->threads));
+        running[i] = stages[i]->threads;
+    }
+
+    size_t total_threads = thread_count();
+    size_t item_count = 0;
+
+#pragma omp parallel num_threads(total_threads)
+    {
+        size_t thread_num = omp_get_thread_num();
+        bool separate_stages = ((size_t) omp_get_num_threads() == total_threads);
+
+        if (thread_num == 0) {
+            // We are the reader.
+            vector<Item> batch;
+            batch.reserve(batch_size);
+            auto send = [&]() {
+                if (separate_stages && !stages.empty()) {
+                    queues.front()->push(move(batch));
+                    batch = vector<Item>();
+                    batch.reserve(batch_size);
+                } else {
+                    // We didn't get a thread for every stage, so do them all here.
+                    run_batch_serially(batch);
+                    batch.clear();
+                }
+            };
+            source([&](Item& item) {
+                batch.emplace_back(move(item));
+                item_count++;
+                if (batch.size() == batch_size) {
+                    send();
+                }
+            });
+            if (!batch.empty()) {
+                send();
+            }
+            if (separate_stages && !stages.empty()) {
+                queues.front()->close();
+            }
+        } else if (separate_stages) {
+            // Work out which stage we are on
+            size_t s = 0;
+            size_t first_thread = 1;
+            while (thread_num >= first_thread + stages[s]->threads) {
+                first_thread += stages[s]->threads;
+                s++;
+            }
+            Stage& stage = *stages[s];
+
+            vector<Item> batch;
+            while (true) {
+                auto wait_start = chrono::steady_clock::now();
+                bool got_batch = queues[s]->pop(batch);
+                stage.wait_nanoseconds += nanoseconds_since(wait_start);
+                if (!got_batch) {
+                    break;
+                }
+
+                auto work_start = chrono::steady_clock::now();
+                for (Item& item : batch) {
+                    stage.work(item);
+                }
+                stage.busy_nanoseconds += nanoseconds_since(work_start);
+                stage.items += batch.size();
+
+                if (s + 1 < stages.size()) {
+                    queues[s + 1]->push(move(batch));
+                    batch = vector<Item>();
+                }
+            }
+
+            if (--running[s] == 0 && s + 1 < stages.size()) {
+                // We were the last one on this stage, so the next stage has
+                // everything it is going to get.
+                queues[s + 1]->close();
+            }
+        }
+    }
+
+    return item_count;
+}
+
+template<typename Item>
+void StagedPipeline<Item>::report(ostream& out) const {
+    for (auto& stage : stages) {
+        out << stage->name << ": " << stage->threads << " threads, " << stage->items << " items, "
+            << stage->busy_nanoseconds / 1e9 << " s working, "
+            << stage->wait_nanoseconds / 1e9 << " s waiting for input" << endl;
+    }
+}
+
+}
+
+#endif
@@ -1,5 +1,7 @@
 #include "stream.hpp"
 
+#include <limits>
+
 namespace vg {
 
 namespace stream {
@@ -12,6 +14,111 @@ void finish(std::ostream& out) {
     bgzip_out.EndFile();
 }
 
+OutputQueue::OutputQueue(std::ostream& out, size_t max_pending) : out(out), max_pending(max(max_pending, (size_t) 1)),
+    head(nullptr), next_sequence(0), closing(false), failed(false) {
+    writer = thread(&OutputQueue::write_loop, this);
+}
+
+OutputQueue::~OutputQueue() {
+    if (writer.joinable()) {
+        closing.store(true);
+        writer.join();
+    }
+}
+
+void OutputQueue::push(std::string&& chunk) {
+    enqueue(new Chunk{numeric_limits<size_t>::max(), std::move(chunk), nullptr});
+}
+
+void OutputQueue::push(size_t sequence, std::string&& chunk) {
+    // Don't let the reorder buffer grow without bound while an early chunk is slow
+    while (sequence >= next_sequence.load() + max_pending) {
+        this_thread::sleep_for(chrono::microseconds(100));
+    }
+    enqueue(new Chunk{sequence, std::move(chunk), nullptr});
+}
+
+void OutputQueue::enqueue(Chunk* chunk) {
+    chunk->next = head.load();
+    while (!head.compare_exchange_weak(chunk->next, chunk)) {
+        // chunk->next has been updated to the new head; try again
+    }
+}
+
+void OutputQueue::close() {
+    if (writer.joinable()) {
+        closing.store(true);
+        writer.join();
+    }
+    if (failed.load()) {
+        throw runtime_error("stream::OutputQueue: I/O error writing output");
+    }
+}
+
+void OutputQueue::write_loop() {
+    // Chunks that came in ahead of their turn, by sequence number
+    map<size_t, string> pending;
+    
+    auto write_chunk = [&](const string& data) {
+        VG_TIMELINE_SPAN("write");
+        out.write(data.data(), data.size());
+        if (!out.good()) {
+            failed.store(true);
+        }
+    };
+    
+    while (true) {
+        // Check before taking the list, so nothing pushed before close() is missed
+        bool done = closing.load();
+        
+        // Take everything pushed so far, and put it back in push order
+        Chunk* taken = head.exchange(nullptr);
+        Chunk* in_order = nullptr;
+        while (taken) {
+            Chunk* next = taken->next;
+            taken->next = in_order;
+            in_order = taken;
+            taken = next;
+        }
+        
+        if (!in_order) {
+            if (done) {
+                break;
+            }
+            // Nothing to do yet
+            this_thread::sleep_for(chrono::microseconds(100));
+            continue;
+        }
+        
+        while (in_order) {
+            Chunk* chunk = in_order;
+            in_order = chunk->next;
+            if (chunk->sequence == numeric_limits<size_t>::max()) {
+                write_chunk(chunk->data);
+            }
+            else {
+                pending[chunk->sequence] = std::move(chunk->data);
+            }
+            delete chunk;
+        }
+        
+        // Write out whatever is now next in line
+        size_t next = next_sequence.load();
+        while (!pending.empty() && pending.begin()->first == next) {
+            write_chunk(pending.begin()->second);
+            pending.erase(pending.begin());
+            next++;
+        }
+        next_sequence.store(next);
+    }
+    
+    // Anything still waiting is missing a chunk before it; write it in order anyway
+    for (auto& chunk : pending) {
+        write_chunk(chunk.second);
+    }
+    out.flush();
+}
+
 }
 
 }
@@ -8,11 +8,21 @@
 #include <iostream>
 #include <istream>
 #include <fstream>
+#include <sstream>
 #include <functional>
 #include <vector>
 #include <list>
+#include <chrono>
+#include <algorithm>
+#include <type_traits>
+#include <atomic>
+#include <thread>
+#include <map>
+#include <omp.h>
 
 #include <google/protobuf/stubs/common.h>
+#include <google/protobuf/arena.h>
+#include <google/protobuf/message.h>
 #include <google/protobuf/io/zero_copy_stream.h>
 #include <google/protobuf/io/zero_copy_stream_impl.h>
 #include <google/protobuf/io/gzip_stream.h>
@@ -20,6 +30,7 @@
 
 #include "blocked_gzip_output_stream.hpp"
 #include "blocked_gzip_input_stream.hpp"
+#include "timeline.hpp"
 
 namespace vg {
 
@@ -232,19 +243,44 @@ bool write(std::ostream& out, size_t count, const std::function<T(size_t)>& lamb
     }));
 }
 
+/// Serialize and compress a buffer of objects as one group, ready to be
+/// copied to a stream. BGZF blocks are self-contained, so groups compressed
+/// separately can be concatenated in any order.
+template <typename T>
+std::string serialize_group(const std::vector<T>& buffer) {
+    VG_TIMELINE_SPAN("serialize");
+    std::function<T(size_t)> lambda = [&buffer](size_t n) { return buffer.at(n); };
+    std::stringstream compressed;
+    if (!write(compressed, buffer.size(), lambda)) {
+        throw std::runtime_error("stream::serialize_group: could not serialize all objects");
+    }
+    return compressed.str();
+}
+
 /// Start, continue, or finish a buffered stream of objects.
 /// If the length of the buffer is greater than the limit, writes the buffer out.
 /// Otherwise, leaves the objects in the buffer.
 /// Must be called with a buffer limit of 0 after all the objects have been produced, to flush the buffer.
 /// When called with a buffer limit of 0, automatically appends an EOF marker.
 /// Returns true unless an error occurs.
+/// Safe to call from multiple threads writing to the same stream: the buffer
+/// is serialized and compressed on the calling thread, and only the copy of
+/// the finished data to the stream is done one thread at a time.
 template <typename T>
 bool write_buffered(std::ostream& out, std::vector<T>& buffer, size_t buffer_limit) {
     bool wrote = false;
     if (buffer.size() >= buffer_limit) {
-        std::function<T(size_t)> lambda = [&buffer](size_t n) { return buffer.at(n); };
+        std::string data = serialize_group(buffer);
+        wrote = true;
+        if (!data.empty()) {
+            // Includes the time spent waiting for the lock
+            VG_TIMELINE_SPAN("write (stream_out)");
 #pragma omp critical (stream_out)
-        wrote = write(out, buffer.size(), lambda);
+            {
+                out.write(data.data(), data.size());
+                wrote = out.good();
+            }
+        }
         buffer.clear();
     }
     if (buffer_limit == 0) {
@@ -254,6 +290,70 @@ bool write_buffered(std::ostream& out, std::vector<T>& buffer, size_t buffer_lim
     return wrote;
 }
 
+/**
+ * An output stage for many threads writing to one stream. Threads push
+ * finished chunks of output (compressed GAM groups, JSON or SAM text) onto a
+ * lock-free list, and a dedicated writer thread copies them to the stream, so
+ * that no thread waits on another to finish writing.
+ *
+ * Chunks can be pushed with sequence numbers, in which case they are written
+ * in sequence order, starting at 0, regardless of which threads finish
+ * first. Producers that get more than max_pending chunks ahead of the writer
+ * wait for it to catch up, so memory stays bounded. Ordered and unordered
+ * pushes can't be mixed, and every sequence number must eventually be pushed.
+ *
+ * Does not write an EOF marker; call finish() on the stream after close() if
+ * the output is GAM.
+ */
+class OutputQueue {
+public:
+    /// Start writing to the given stream, which must outlive the queue.
+    OutputQueue(std::ostream& out, size_t max_pending = 1024);
+    
+    /// Write everything still queued and stop the writer thread.
+    ~OutputQueue();
+    
+    // Can't be copied or moved, since the writer thread points at us
+    OutputQueue(const OutputQueue& other) = delete;
+    OutputQueue& operator=(const OutputQueue& other) = delete;
+    
+    /// Queue a chunk to be written whenever the writer gets to it. Thread safe.
+    void push(std::string&& chunk);
+    
+    /// Queue the chunk with the given sequence number to be written after all
+    /// the chunks before it. Waits if the writer is too far behind. Thread safe.
+    void push(size_t sequence, std::string&& chunk);
+    
+    /// Wait for everything queued to be written and stop the writer. Nothing
+    /// may be pushed after this. Throws if writing to the stream failed.
+    void close();
+    
+private:
+    
+    struct Chunk {
+        size_t sequence;
+        std::string data;
+        Chunk* next;
+    };
+    
+    /// Push a chunk onto the list the writer takes from
+    void enqueue(Chunk* chunk);
+    
+    /// Body of the writer thread
+    void write_loop();
+    
+    std::ostream& out;
+    size_t max_pending;
+    
+    /// Most recently pushed chunk; each chunk points to the one pushed before it
+    std::atomic<Chunk*> head;
+    /// Sequence number of the next chunk to write, in ordered mode
+    std::atomic<size_t> next_sequence;
+    std::atomic<bool> closing;
+    std::atomic<bool> failed;
+    std::thread writer;
+};
+
 /// Deserialize the input stream into the objects. Skips over groups of objects
 /// with count 0. Takes a callback function to be called on the objects, with
 /// the object and the blocked gzip virtual offset of its group (or -1 if the
@@ -380,6 +480,90 @@ void for_each(std::istream& in,
     }));
 }
 
+/// Read objects in batches of about batch_size. Each batch is parsed on all
+/// the OpenMP threads, and then the lambda is called on it, on the calling
+/// thread, with the objects in stream order. Also passes the virtual offset
+/// of the last group started when the batch was finished, or -1 if the
+/// stream can't tell. Meant for readers whose work on each object has to
+/// happen in order, but which don't want to parse on one thread.
+template <typename T>
+void for_each_in_batches(std::istream& in, size_t batch_size,
+                         const std::function<void(int64_t, std::vector<T>&)>& lambda) {
+
+    auto handle = [](bool ok) {
+        if (!ok) {
+            throw std::runtime_error("[stream::for_each_in_batches] obsolete, invalid, or corrupt protobuf input");
+        }
+    };
+
+    // Nothing else reads the stream while we work, so upcoming blocks can be
+    // decompressed in the background.
+    size_t decompression_threads = omp_get_max_threads() > 1 ? std::min(omp_get_max_threads() / 4 + 1, 4) : 0;
+    BlockedGzipInputStream bgzip_in(in, decompression_threads);
+
+    std::vector<std::string> raw;
+    raw.reserve(batch_size);
+    std::vector<T> objects;
+    int64_t virtual_offset = -1;
+
+    auto flush = [&]() {
+        objects.resize(raw.size());
+        // We can't throw out of a parallel loop, so note failures for later.
+        bool parsed = true;
+#pragma omp parallel for schedule(dynamic, 1)
+        for (size_t i = 0; i < raw.size(); i++) {
+            // Empty messages are all-default objects.
+            objects[i].Clear();
+            if (!raw[i].empty() && !objects[i].ParseFromString(raw[i])) {
+#pragma omp atomic write
+                parsed = false;
+            }
+        }
+        handle(parsed);
+        raw.clear();
+        lambda(virtual_offset, objects);
+    };
+
+    while (true) {
+        virtual_offset = bgzip_in.Tell();
+
+        size_t count;
+        {
+            ::google::protobuf::io::CodedInputStream coded_in(&bgzip_in);
+            if (!coded_in.ReadVarint64((::google::protobuf::uint64*) &count)) {
+                // EOF (probably)
+                break;
+            }
+        }
+
+        for (size_t i = 0; i < count; ++i) {
+            // Each CodedInputStream thinks it is reading a single message,
+            // so use a new one every time.
+            ::google::protobuf::io::CodedInputStream coded_in(&bgzip_in);
+            coded_in.SetTotalBytesLimit(MAX_PROTOBUF_SIZE * 2, MAX_PROTOBUF_SIZE * 2);
+
+            uint32_t msgSize = 0;
+            handle(coded_in.ReadVarint32(&msgSize));
+            if (msgSize > MAX_PROTOBUF_SIZE) {
+                throw std::runtime_error("[stream::for_each_in_batches] protobuf message of " +
+                    std::to_string(msgSize) + " bytes is too long");
+            }
+
+            raw.emplace_back();
+            if (msgSize > 0) {
+                handle(coded_in.ReadString(&raw.back(), msgSize));
+            }
+            if (raw.size() >= batch_size) {
+                flush();
+            }
+        }
+    }
+
+    if (!raw.empty()) {
+        flush();
+    }
+}
+
 // Parallelized versions of for_each
 
 // First, an internal implementation underlying several variants below.
@@ -387,6 +571,31 @@ void for_each(std::istream& in,
 // elements of each pair are in order, but the overall order in which lambda2
 // is invoked on pairs is undefined (concurrent). lambda1 is invoked on an odd
 // last element of the stream, if any.
+/// Get the options for the arenas that batches of parsed messages live on.
+/// Blocks start big enough for a handful of reads and grow quickly, since a
+/// batch can hold thousands of messages.
+inline ::google::protobuf::ArenaOptions batch_arena_options() {
+    ::google::protobuf::ArenaOptions options;
+    options.start_block_size = 64 * 1024;
+    options.max_block_size = 4 * 1024 * 1024;
+    return options;
+}
+
+/// Make a new, empty Protobuf message owned by the given arena.
+template <typename T>
+typename std::enable_if<std::is_base_of<::google::protobuf::Message, T>::value, T*>::type
+new_on_arena(::google::protobuf::Arena& arena) {
+    return ::google::protobuf::Arena::CreateMessage<T>(&arena);
+}
+
+/// Make a new object owned by the given arena, for message stand-ins that
+/// aren't generated Protobuf types.
+template <typename T>
+typename std::enable_if<!std::is_base_of<::google::protobuf::Message, T>::value, T*>::type
+new_on_arena(::google::protobuf::Arena& arena) {
+    return ::google::protobuf::Arena::Create<T>(&arena);
+}
+
 template <typename T>
 void for_each_parallel_impl(std::istream& in,
                             const std::function<void(T&,T&)>& lambda2,
@@ -394,29 +603,78 @@ void for_each_parallel_impl(std::istream& in,
                             const std::function<void(size_t)>& handle_count,
                             const std::function<bool(void)>& single_threaded_until_true) {
 
-    // objects will be handed off to worker threads in batches of this many
-    const size_t batch_size = 256;
-    static_assert(batch_size % 2 == 0, "stream::for_each_parallel::batch_size must be even");
-    // max # of such batches to be holding in memory
-    size_t max_batches_outstanding = 256;
+    // Objects will be handed off to worker threads in batches. The batch size
+    // adapts to the measured per-object processing cost, aiming for batches
+    // that take about target_batch_nanos each: cheap objects get big batches,
+    // to amortize task overhead, and expensive ones get small batches, so a
+    // few slow objects can't leave the other threads idle at the end.
+    const size_t min_batch_size = 16;
+    const size_t max_batch_size = 4096;
+    const double target_batch_nanos = 5e6;
+    static_assert(min_batch_size % 2 == 0, "stream::for_each_parallel::min_batch_size must be even");
+    static_assert(max_batch_size % 2 == 0, "stream::for_each_parallel::max_batch_size must be even");
+    // max # of objects to be holding in memory in batches
+    size_t max_items_outstanding = 256 * 256;
     // max # we will ever increase the batch buffer to
-    const size_t max_max_batches_outstanding = 1 << 13; // 8192
-    // number of batches currently being processed
-    size_t batches_outstanding = 0;
+    const size_t max_max_items_outstanding = 256 * (1 << 13);
+    // number of objects in batches currently being processed
+    size_t items_outstanding = 0;
 
     // this loop handles a chunked file with many pieces
     // such as we might write in a multithreaded process
-    #pragma omp parallel default(none) shared(in, lambda1, lambda2, handle_count, batches_outstanding, max_batches_outstanding, single_threaded_until_true)
+    #pragma omp parallel default(none) shared(in, lambda1, lambda2, handle_count, items_outstanding, max_items_outstanding, single_threaded_until_true)
     #pragma omp single
     {
         auto handle = [](bool retval) -> void {
             if (!retval) throw std::runtime_error("obsolete, invalid, or corrupt protobuf input");
         };
 
-        BlockedGzipInputStream bgzip_in(in);
+        // Total time spent processing batches, and the number of objects in
+        // them, across all threads. Used to pick the next batch size.
+        size_t nanos_spent = 0;
+        size_t items_timed = 0;
+        size_t batch_size = 256;
+        
+        // Parse the objects in a full batch, run the lambda on them in pairs,
+        // and record how long it took. Deletes the batch.
+        auto process_batch = [&](std::vector<std::string>* batch) {
+            VG_TIMELINE_SPAN("process batch");
+            auto start = std::chrono::steady_clock::now();
+            {
+                // Everything parsed out of the batch lives on one arena, and
+                // is freed all at once instead of field by field
+                ::google::protobuf::Arena arena(batch_arena_options());
+                for (size_t i = 0; i < batch->size(); i += 2) {
+                    // parse protobuf objects and invoke lambda on the pair
+                    T* obj1 = new_on_arena<T>(arena);
+                    T* obj2 = new_on_arena<T>(arena);
+                    handle(obj1->ParseFromString(batch->at(i)));
+                    handle(obj2->ParseFromString(batch->at(i+1)));
+                    lambda2(*obj1, *obj2);
+                }
+            } // scope arena
+            size_t nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start).count();
+            size_t items = batch->size();
+            delete batch;
+#pragma omp atomic update
+            nanos_spent += nanos;
+#pragma omp atomic update
+            items_timed += items;
+#pragma omp atomic update
+            items_outstanding -= items;
+        };
+
+        // Decompress upcoming blocks in the background, so the reader thread
+        // only has to split out messages. A few threads are enough to keep
+        // ahead of the parsing and processing on the rest.
+        size_t decompression_threads = omp_get_num_threads() > 1 ? std::min(omp_get_num_threads() / 4 + 1, 4) : 0;
+        BlockedGzipInputStream bgzip_in(in, decompression_threads);
         ::google::protobuf::io::CodedInputStream coded_in(&bgzip_in);
 
         std::vector<std::string> *batch = nullptr;
+        // when we started reading the current batch, for the timeline
+        uint64_t batch_read_start = 0;
         
         // process chunks prefixed by message count
         size_t count;
@@ -424,8 +682,22 @@ void for_each_parallel_impl(std::istream& in,
             handle_count(count);
             for (size_t i = 0; i < count; ++i) {
                 if (!batch) {
-                     batch = new std::vector<std::string>();
-                     batch->reserve(batch_size);
+                    size_t nanos, items;
+#pragma omp atomic read
+                    nanos = nanos_spent;
+#pragma omp atomic read
+                    items = items_timed;
+                    if (items > 0 && nanos > 0) {
+                        // Size this batch to take about the target time.
+                        double wanted = target_batch_nanos * items / nanos;
+                        batch_size = (size_t) std::min(std::max(wanted, (double) min_batch_size), (double) max_batch_size);
+                        // Batches must hold whole pairs
+                        batch_size += batch_size % 2;
+                    }
+                    
+                    batch = new std::vector<std::string>();
+                    batch->reserve(batch_size);
+                    batch_read_start = timeline::enabled() ? timeline::now() : 0;
                 }
                 
                 // Reconstruct the CodedInputStream in place to reset its maximum-
@@ -457,56 +729,40 @@ void for_each_parallel_impl(std::istream& in,
                 }
 
                 if (batch->size() == batch_size) {
+                    if (timeline::enabled()) {
+                        timeline::record("read batch", batch_read_start);
+                    }
                     // time to enqueue this batch for processing. first, block if
-                    // we've hit max_batches_outstanding.
-                    size_t b;
+                    // we've hit max_items_outstanding.
+                    size_t o;
 #pragma omp atomic capture
-                    b = ++batches_outstanding;
+                    o = items_outstanding += batch_size;
                     
                     bool do_single_threaded = !single_threaded_until_true();
-                    if (b >= max_batches_outstanding || do_single_threaded) {
+                    if (o >= max_items_outstanding || do_single_threaded) {
                         
                         // process this batch in the current thread
-                        {
-                            T obj1, obj2;
-                            for (int i = 0; i<batch_size; i+=2) {
-                                // parse protobuf objects and invoke lambda on the pair
-                                handle(obj1.ParseFromString(batch->at(i)));
-                                handle(obj2.ParseFromString(batch->at(i+1)));
-                                lambda2(obj1,obj2);
-                            }
-                        } // scope obj1 & obj2
-                        delete batch;
-#pragma omp atomic capture
-                        b = --batches_outstanding;
+                        process_batch(batch);
+                        
+#pragma omp atomic read
+                        o = items_outstanding;
                         
-                        if (4 * b / 3 < max_batches_outstanding
-                            && max_batches_outstanding < max_max_batches_outstanding
+                        if (4 * o / 3 < max_items_outstanding
+                            && max_items_outstanding < max_max_items_outstanding
                             && !do_single_threaded) {
                             // we went through at least 1/4 of the batch buffer while we were doing this thread's batch
                             // this looks risky, since we want the batch buffer to stay populated the entire time we're
                             // occupying this thread on compute, so let's increase the batch buffer size
                             // (skip this adjustment if you're in single-threaded mode and thus expect the buffer to be
                             // empty)
-                            max_batches_outstanding *= 2;
+                            max_items_outstanding *= 2;
                         }
                     }
                     else {
                         // spawn a task in another thread to process this batch
-#pragma omp task default(none) firstprivate(batch) shared(batches_outstanding, lambda2, handle, single_threaded_until_true)
+#pragma omp task default(none) firstprivate(batch) shared(process_batch)
                         {
-                            {
-                                T obj1, obj2;
-                                for (int i = 0; i<batch_size; i+=2) {
-                                    // parse protobuf objects and invoke lambda on the pair
-                                    handle(obj1.ParseFromString(batch->at(i)));
-                                    handle(obj2.ParseFromString(batch->at(i+1)));
-                                    lambda2(obj1,obj2);
-                                }
-                            } // scope obj1 & obj2
-                            delete batch;
-#pragma omp atomic update
-                            batches_outstanding--;
+                            process_batch(batch);
                         }
                     }
 
@@ -519,18 +775,21 @@ void for_each_parallel_impl(std::istream& in,
         // process final batch
         if (batch) {
             {
-                T obj1, obj2;
+                ::google::protobuf::Arena arena(batch_arena_options());
                 int i = 0;
                 for (; i < batch->size()-1; i+=2) {
-                    handle(obj1.ParseFromString(batch->at(i)));
-                    handle(obj2.ParseFromString(batch->at(i+1)));
-                    lambda2(obj1, obj2);
+                    T* obj1 = new_on_arena<T>(arena);
+                    T* obj2 = new_on_arena<T>(arena);
+                    handle(obj1->ParseFromString(batch->at(i)));
+                    handle(obj2->ParseFromString(batch->at(i+1)));
+                    lambda2(*obj1, *obj2);
                 }
                 if (i == batch->size()-1) { // odd last object
-                    handle(obj1.ParseFromString(batch->at(i)));
-                    lambda1(obj1);
+                    T* obj1 = new_on_arena<T>(arena);
+                    handle(obj1->ParseFromString(batch->at(i)));
+                    lambda1(*obj1);
                 }
-            } // scope obj1 & obj2
+            } // scope arena
             delete batch;
         }
     }
@@ -577,6 +836,30 @@ void for_each_parallel(std::istream& in,
 }
 
 
+/**
+ * A Protobuf message kept only as its serialized bytes. It can stand in for a
+ * real message type in ProtobufIterator and ProtobufEmitter, so that messages
+ * can be moved between files without being parsed or re-encoded.
+ */
+struct RawMessage {
+    /// The serialized message
+    std::string data;
+    
+    inline void Clear() {
+        data.clear();
+    }
+    
+    inline bool ParseFromString(const std::string& serialized) {
+        data = serialized;
+        return true;
+    }
+    
+    inline bool SerializeToString(std::string* serialized) const {
+        *serialized = data;
+        return true;
+    }
+};
+
 /**
  *
  * Class that wraps an output stream and allows emitting groups of Protobuf
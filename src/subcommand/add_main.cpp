@@ -153,6 +153,8 @@ int main_add(int argc, char** argv) {
         // Open it
         vcfs.emplace_back(new vcflib::VariantCallFile());
         auto& vcf = *vcfs.back();
+        // The windowed buffer parses just the genotypes itself, when it needs them
+        vcf.parseSamples = false;
         vcf.open(vcf_filename);
         if (!vcf.is_open()) {
             cerr << "error:[vg add] could not open " << vcf_filename << endl;
@@ -5,9 +5,12 @@
 #include "../stream.hpp"
 #include "../alignment.hpp"
 #include "../annotation.hpp"
+#include "../interval_index.hpp"
+#include "../path_position_index.hpp"
 
 #include <unistd.h>
 #include <getopt.h>
+#include <sstream>
 
 using namespace vg;
 using namespace vg::subcommand;
@@ -50,25 +53,59 @@ static pair<size_t, size_t> mapping_to_range(const xg::XG* xg_index, const Mappi
     return node_range;
 }
 
-using feature_t = pair<pair<size_t, size_t>, const string*>;
+using feature_t = IntervalIndex<const string*>::Interval;
 
-/// Look up all ranges in the vector of features that overlap the start to past-end search interval.
-/// Return their unique string* interned feature names.
-static unordered_set<const string*> find_overlapping(const vector<feature_t>& ranges, pair<size_t, size_t> search_interval) {
-    // TODO: We expect at most a few features per node, so just do a linear scan
-    
-    unordered_set<const string*> to_return;
-    
-    for (auto& feature : ranges) {
-        auto& feature_range = feature.first;
+/// Load the regions from a BED file as start to past-end ranges on the paths they are on, bucketed by XG path rank,
+/// with interned feature names. Skips the same lines that parse_bed_regions() would. Regions that wrap around the end
+/// of a circular path become two ranges.
+static void load_bed_features(istream& bed_stream, const xg::XG* xg_index,
+                              const function<const string*(const string&)>& intern,
+                              vector<vector<feature_t>>& features_by_path) {
+    string row;
+    for (int line = 1; getline(bed_stream, row); ++line) {
+        if (row.size() < 2 || row[0] == '#') {
+            continue;
+        }
+        istringstream ss(row);
+        string seq;
+        size_t start;
+        size_t end;
+        string name;
+        ss >> seq;
+        
+        size_t rank = xg_index->path_rank(seq);
+        if (rank == 0) {
+            cerr << "warning: path \"" << seq << "\" not found in index, skipping" << endl;
+            continue;
+        }
+        
+        ss >> start;
+        ss >> end;
+        
+        if (ss.fail()) {
+            cerr << "Error parsing bed line " << line << ": " << row << endl;
+            continue;
+        }
+        
+        if (start >= end && !xg_index->path_is_circular(seq)) {
+            cerr << "warning: path \"" << seq << "\" is not circular, skipping end-spanning region on line "
+                << line << ": " << row << endl;
+            continue;
+        }
+        
+        // The name is optional, and may be ""
+        ss >> name;
+        const string* interned_name = intern(name);
         
-        if (feature_range.second > search_interval.first && feature_range.first < search_interval.second) {
-            // There is overlap
-            to_return.insert(feature.second);
+        auto& path_features = features_by_path[rank];
+        if (start < end) {
+            path_features.push_back(feature_t{start, end, interned_name});
+        } else {
+            // Go around the end of the circular path
+            path_features.push_back(feature_t{start, xg_index->path_length(rank), interned_name});
+            path_features.push_back(feature_t{0, end, interned_name});
         }
     }
-    
-    return to_return;
 }
 
 int main_annotate(int argc, char** argv) {
@@ -231,35 +268,39 @@ int main_annotate(int argc, char** argv) {
                 return feature_names[value].get();
             };
             
-            // This will hold, for each graph node, the start to past-end
-            // regions occupied by BED features, and the names of those
-            // features.
-            // TODO: To enable better than linear search within a node, we ought to sort these.
-            unordered_map<vg::id_t, vector<feature_t>> features_on_node;
-            // TODO: We can't use a Paths object because we lack unique names 
+            // This will hold, for each path by XG rank, an index of the start
+            // to past-end path ranges occupied by BED features, and the names
+            // of those features.
+            vector<IntervalIndex<const string*>> features_on_path(xg_index->max_path_rank() + 1);
+            // And these are the names of the paths that have any
+            vector<string> feature_paths;
             
-            for (auto& bed_name : bed_names) {
-                // If there are BED files, load them up
+            if (!bed_names.empty()) {
+                vector<vector<feature_t>> features_by_path(features_on_path.size());
+                for (auto& bed_name : bed_names) {
+                    // If there are BED files, load them up
+                    get_input_file(bed_name, [&](istream& bed_stream) {
+                        load_bed_features(bed_stream, xg_index, intern, features_by_path);
+                    });
+                }
                 
-                get_input_file(bed_name, [&](istream& bed_stream) {
-                    // Load all the BED regions as Alignments embedded in the graph.
-                    vector<Alignment> bed_regions;
-                    parse_bed_regions(bed_stream, xg_index, &bed_regions);
-                    
-                    for (auto& region : bed_regions) {
-                        // For each region in the BED
-                        
-                        // Get the cannonical copy of its name (which may be "")
-                        const string* interned_name = intern(region.name());
-                        
-                        for (auto& mapping : region.path().mapping()) {
-                            // Scan the Mappings. We know each Mapping will be all perfect matches.
-                            
-                            // Record that the alignment covers the given region on the given node.
-                            features_on_node[mapping.position().node_id()].emplace_back(mapping_to_range(xg_index, mapping), interned_name);
-                        }
+                for (size_t rank = 1; rank < features_by_path.size(); rank++) {
+                    if (!features_by_path[rank].empty()) {
+                        features_on_path[rank] = IntervalIndex<const string*>(std::move(features_by_path[rank]));
+                        feature_paths.push_back(xg_index->path_name(rank));
                     }
-                });
+                }
+            }
+            
+            // Find where nodes are on the paths once, up front, instead of
+            // asking the xg for every mapping. Positions need all the paths,
+            // but features only need the ones they are on.
+            unique_ptr<PathPositionIndex> path_positions;
+            if (add_positions && xg_index->max_path_rank() > 0) {
+                path_positions = unique_ptr<PathPositionIndex>(new PathPositionIndex(*xg_index));
+                mapper.set_path_position_index(path_positions.get());
+            } else if (!feature_paths.empty()) {
+                path_positions = unique_ptr<PathPositionIndex>(new PathPositionIndex(*xg_index, feature_paths));
             }
             
             get_input_file(gam_name, [&](istream& in) {
@@ -272,25 +313,46 @@ int main_annotate(int argc, char** argv) {
                         mapper.annotate_with_initial_path_positions(aln);
                     }
                     
-                    if (!features_on_node.empty()) {
+                    if (!feature_paths.empty()) {
                         // We want to annotate with BED feature overlaps as well.
-                        unordered_set<const string*> touched_features;
+                        vector<const string*> touched_features;
                         
                         for (auto& mapping : aln.path().mapping()) {
-                            // For each mapping
-                            
+                            // For each mapping, look at each place its node is on a path with features
                             auto node_id = mapping.position().node_id();
-                            auto features = features_on_node.find(node_id);
-                            if (features != features_on_node.end()) {
-                                // Some things occur on this node. Find the overlaps with the part of the node touched by this read.
-                                auto overlapping = find_overlapping(features->second, mapping_to_range(xg_index, mapping));
-                                // Save them all to the set (to remove duplicates)
-                                copy(overlapping.begin(), overlapping.end(), inserter(touched_features, touched_features.begin()));
-                            }
+                            path_positions->for_each_occurrence(node_id, [&](const PathPositionIndex::Occurrence& occurrence) {
+                                auto& features = features_on_path[occurrence.path_rank];
+                                if (features.empty()) {
+                                    return;
+                                }
+                                
+                                // Work out what part of the path the read touches here
+                                size_t node_length = xg_index->node_length(node_id);
+                                auto node_range = mapping_to_range(xg_index, mapping);
+                                pair<size_t, size_t> path_range;
+                                if (occurrence.is_reverse) {
+                                    path_range.first = occurrence.offset + node_length - node_range.second;
+                                    path_range.second = occurrence.offset + node_length - node_range.first;
+                                } else {
+                                    path_range.first = occurrence.offset + node_range.first;
+                                    path_range.second = occurrence.offset + node_range.second;
+                                }
+                                
+                                if (path_range.second <= occurrence.offset || path_range.first >= occurrence.offset + node_length) {
+                                    // An empty range at the very edge of the node
+                                    // doesn't touch anything on it.
+                                    return;
+                                }
+                                
+                                features.for_each_overlapping(path_range.first, path_range.second, [&](const feature_t& feature) {
+                                    touched_features.push_back(feature.value);
+                                });
+                            });
                         }
                         
                         // Convert the string pointers to actual string copies, for annotation API.
                         // Make sure to use an ordered set here to sort, to make output deterministic.
+                        // This also removes duplicates.
                         set<string> feature_names;
                         for (const string* name : touched_features) {
                             feature_names.insert(*name);
@@ -37,10 +37,25 @@ static Pileups* compute_pileups(VG* graph, const string& gam_file_name, int thre
                                 int max_mismatches, int window_size, int max_depth, bool use_mapq,
                                 bool show_progress);
 
+// stream pileups from a sorted gam to a file, without holding them all in memory
+static void stream_pileups(VG* graph, const string& gam_file_name, const string& pileup_file_name,
+                           int min_quality, int max_mismatches, int window_size, int max_depth,
+                           bool use_mapq, bool show_progress);
+
 // this used to be the first half of call_main()
 static void augment_with_pileups(PileupAugmenter& augmenter, Pileups& pileups, bool expect_subgraph,
                                  bool show_progress);
 
+// same as above, but reading the pileups back from a file a chunk at a time
+static void augment_with_pileup_file(PileupAugmenter& augmenter, const string& pileup_file_name,
+                                     bool expect_subgraph, bool show_progress);
+
+// same as above, but computing the pileups from a sorted gam in the same pass,
+// so they never have to be written out
+static void augment_with_sorted_gam(PileupAugmenter& augmenter, const string& gam_file_name,
+                                    int min_quality, int max_mismatches, int window_size, int max_depth,
+                                    bool use_mapq, bool expect_subgraph, bool show_progress);
+
 void help_augment(char** argv, ConfigurableParser& parser) {
     cerr << "usage: " << argv[0] << " augment [options] <graph.vg> <alignment.gam> > augmented_graph.vg" << endl
          << "Embed GAM alignments into a graph to facilitate variant calling" << endl
@@ -56,6 +71,7 @@ void help_augment(char** argv, ConfigurableParser& parser) {
          << "pileup options:" << endl
          << "    -P, --pileup FILE           save pileups to FILE" << endl
          << "    -S, --support FILE          save supports to FILE" << endl                
+         << "    -s, --sorted-gam            input GAM is sorted (by vg gamsort): stream pileups in bounded memory, augmenting in one pass" << endl
          << "    -g, --min-aug-support N     minimum support to augment graph ["
          << PileupAugmenter::Default_min_aug_support << "]" << endl
          << "    -U, --subgraph              expect a subgraph and ignore extra pileup entries outside it" << endl
@@ -82,6 +98,9 @@ int main_augment(int argc, char** argv) {
     // Should we expect a subgraph and ignore pileups for missing nodes/edges?
     bool expect_subgraph = false;
 
+    // Is the input GAM sorted, so pileups can be streamed out as they finish?
+    bool sorted_gam = false;
+
     // Write the translations (as protobuf) to this path
     string translation_file_name;
 
@@ -139,9 +158,10 @@ int main_augment(int argc, char** argv) {
         {"ignore-mapq", no_argument, 0, 'M'},
         {"min-aug-support", required_argument, 0, 'g'},
         {"subgraph", no_argument, 0, 'U'},
+        {"sorted-gam", no_argument, 0, 's'},
         {0, 0, 0, 0}
     };
-    static const char* short_options = "a:Z:A:hpvt:P:S:q:m:w:Mg:U";
+    static const char* short_options = "a:Z:A:hpvt:P:S:q:m:w:Mg:Us";
     optind = 2; // force optind past command positional arguments
 
     // This is our command-line parser
@@ -200,6 +220,9 @@ int main_augment(int argc, char** argv) {
         case 'U':
             expect_subgraph = true;
             break;
+        case 's':
+            sorted_gam = true;
+            break;
             
         default:
           abort ();
@@ -266,8 +289,18 @@ int main_augment(int argc, char** argv) {
     
     
     Pileups* pileups = nullptr;
+
+    // When streaming to a requested file, the pileups only ever exist there
+    string streamed_pileup_file_name;
     
-    if (!pileup_file_name.empty() || augmentation_mode == "pileup") {
+    if (sorted_gam && !pileup_file_name.empty()) {
+        // write the pileups out as we go
+        streamed_pileup_file_name = pileup_file_name;
+        stream_pileups(graph, gam_in_file_name, streamed_pileup_file_name, min_quality, max_mismatches,
+                       window_size, max_depth, use_mapq, show_progress);
+    } else if (sorted_gam) {
+        // Any pileups we need will go straight from the reads to the augmenter
+    } else if (!pileup_file_name.empty() || augmentation_mode == "pileup") {
         // We will need the computed pileups
         
         // compute the pileups from the graph and gam
@@ -275,7 +308,7 @@ int main_augment(int argc, char** argv) {
                                   window_size, max_depth, use_mapq, show_progress);
     }
         
-    if (!pileup_file_name.empty()) {
+    if (!pileup_file_name.empty() && pileups != nullptr) {
         // We want to write out pileups.
         if (show_progress) {
             cerr << "Writing pileups" << endl;
@@ -385,9 +418,16 @@ int main_augment(int argc, char** argv) {
         // compute the augmented graph from the pileup
         // Note: we can save a fair bit of memory by clearing pileups, and re-reading off of
         //       pileup_file_name
-        augment_with_pileups(augmenter, *pileups, expect_subgraph, show_progress);
-        delete pileups;
-        pileups = nullptr;
+        if (pileups != nullptr) {
+            augment_with_pileups(augmenter, *pileups, expect_subgraph, show_progress);
+            delete pileups;
+            pileups = nullptr;
+        } else if (!streamed_pileup_file_name.empty()) {
+            augment_with_pileup_file(augmenter, streamed_pileup_file_name, expect_subgraph, show_progress);
+        } else {
+            augment_with_sorted_gam(augmenter, gam_in_file_name, min_quality, max_mismatches, window_size,
+                                    max_depth, use_mapq, expect_subgraph, show_progress);
+        }
 
         // write the augmented graph
         if (show_progress) {
@@ -498,39 +538,69 @@ Pileups* compute_pileups(VG* graph, const string& gam_file_name, int thread_coun
     return pileups[0];
 }
 
-void augment_with_pileups(PileupAugmenter& augmenter, Pileups& pileups, bool expect_subgraph,
-                          bool show_progress) {
-    
-    if (show_progress) {
-        cerr << "Computing augmented graph from the pileup" << endl;
+void stream_pileups(VG* graph, const string& gam_file_name, const string& pileup_file_name,
+                    int min_quality, int max_mismatches, int window_size, int max_depth,
+                    bool use_mapq, bool show_progress) {
+
+    ofstream pileup_file(pileup_file_name);
+    if (!pileup_file) {
+        cerr << "[vg augment] error: unable to open output pileup file: " << pileup_file_name << endl;
+        exit(1);
     }
 
+    // single-threaded, since pileups can only be flushed once every read
+    // before them is in
+    Pileups pileups(graph, min_quality, max_mismatches, window_size, max_depth, use_mapq);
+    get_input_file(gam_file_name, [&](istream& alignment_stream) {
+        if (show_progress) {
+            cerr << "Streaming pileups from sorted GAM" << endl;
+        }
+        pileups.compute_from_sorted_alignments(alignment_stream, pileup_file);
+    });
+}
+
+// send a node pileup to the augmenter, if it belongs in the graph
+static void call_node_pileup(PileupAugmenter& augmenter, const NodePileup& node_pileup, bool expect_subgraph) {
+    if (!augmenter._graph->has_node(node_pileup.node_id())) {
+        // This pileup doesn't belong in this graph
+        if(!expect_subgraph) {
+            throw runtime_error("Found pileup for nonexistent node " + to_string(node_pileup.node_id()));
+        }
+        // If that's expected, just skip it
+        return;
+    }
+    // Send approved pileups to the augmenter
+    augmenter.call_node_pileup(node_pileup);
+}
+
+// send an edge pileup to the augmenter, if it belongs in the graph
+static void call_edge_pileup(PileupAugmenter& augmenter, const EdgePileup& edge_pileup, bool expect_subgraph) {
+    if (!augmenter._graph->has_edge(edge_pileup.edge())) {
+        // This pileup doesn't belong in this graph
+        if(!expect_subgraph) {
+            throw runtime_error("Found pileup for nonexistent edge " + pb2json(edge_pileup.edge()));
+        }
+        // If that's expected, just skip it
+        return;
+    }
+    // Send approved pileups to the augmenter
+    augmenter.call_edge_pileup(edge_pileup);
+}
+
+// send all the pileups that belong in the graph to the augmenter
+static void call_pileups(PileupAugmenter& augmenter, Pileups& pileups, bool expect_subgraph) {
+
     pileups.for_each_node_pileup([&](const NodePileup& node_pileup) {
-            if (!augmenter._graph->has_node(node_pileup.node_id())) {
-                // This pileup doesn't belong in this graph
-                if(!expect_subgraph) {
-                    throw runtime_error("Found pileup for nonexistent node " + to_string(node_pileup.node_id()));
-                }
-                // If that's expected, just skip it
-                return;
-            }
-            // Send approved pileups to the augmenter
-            augmenter.call_node_pileup(node_pileup);
-            
+            call_node_pileup(augmenter, node_pileup, expect_subgraph);
         });
 
     pileups.for_each_edge_pileup([&](const EdgePileup& edge_pileup) {
-            if (!augmenter._graph->has_edge(edge_pileup.edge())) {
-                // This pileup doesn't belong in this graph
-                if(!expect_subgraph) {
-                    throw runtime_error("Found pileup for nonexistent edge " + pb2json(edge_pileup.edge()));
-                }
-                // If that's expected, just skip it
-                return;
-            }
-            // Send approved pileups to the augmenter
-            augmenter.call_edge_pileup(edge_pileup);            
+            call_edge_pileup(augmenter, edge_pileup, expect_subgraph);
         });
+}
+
+// finish the augmented graph once all the pileups are in
+static void finish_augmentation(PileupAugmenter& augmenter, bool show_progress) {
 
     // map the edges from original graph
     if (show_progress) {
@@ -545,5 +615,60 @@ void augment_with_pileups(PileupAugmenter& augmenter, Pileups& pileups, bool exp
     augmenter.map_paths();
 }
 
+void augment_with_pileups(PileupAugmenter& augmenter, Pileups& pileups, bool expect_subgraph,
+                          bool show_progress) {
+    
+    if (show_progress) {
+        cerr << "Computing augmented graph from the pileup" << endl;
+    }
+    call_pileups(augmenter, pileups, expect_subgraph);
+    finish_augmentation(augmenter, show_progress);
+}
+
+void augment_with_pileup_file(PileupAugmenter& augmenter, const string& pileup_file_name,
+                              bool expect_subgraph, bool show_progress) {
+
+    if (show_progress) {
+        cerr << "Computing augmented graph from the streamed pileup" << endl;
+    }
+    ifstream pileup_file(pileup_file_name);
+    if (!pileup_file) {
+        cerr << "[vg augment] error: unable to open pileup file: " << pileup_file_name << endl;
+        exit(1);
+    }
+
+    // only ever hold one chunk of the pileups
+    Pileups chunk(augmenter._graph);
+    function<void(Pileup&)> lambda = [&](Pileup& pileup) {
+        chunk.extend(pileup);
+        call_pileups(augmenter, chunk, expect_subgraph);
+        chunk.clear();
+    };
+    stream::for_each(pileup_file, lambda);
+
+    finish_augmentation(augmenter, show_progress);
+}
+
+void augment_with_sorted_gam(PileupAugmenter& augmenter, const string& gam_file_name,
+                             int min_quality, int max_mismatches, int window_size, int max_depth,
+                             bool use_mapq, bool expect_subgraph, bool show_progress) {
+
+    // single-threaded, since each window of pileups is only done once every
+    // read before it is in
+    Pileups pileups(augmenter._graph, min_quality, max_mismatches, window_size, max_depth, use_mapq);
+    get_input_file(gam_file_name, [&](istream& alignment_stream) {
+        if (show_progress) {
+            cerr << "Computing augmented graph from sorted GAM" << endl;
+        }
+        pileups.compute_from_sorted_alignments(alignment_stream, [&](NodePileup& node_pileup) {
+                call_node_pileup(augmenter, node_pileup, expect_subgraph);
+            }, [&](EdgePileup& edge_pileup) {
+                call_edge_pileup(augmenter, edge_pileup, expect_subgraph);
+            });
+    });
+
+    finish_augmentation(augmenter, show_progress);
+}
+
 // Register subcommand
 static Subcommand vg_augment("augment", "augment a graph from an alignment", PIPELINE, 5, main_augment);
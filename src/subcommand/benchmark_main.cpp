@@ -8,14 +8,25 @@
 #include <getopt.h>
 
 #include <iostream>
+#include <random>
+#include <sstream>
 
 #include "subcommand.hpp"
 
 #include "../benchmark.hpp"
 #include "../version.hpp"
 
+#include "../hash_map.hpp"
 #include "../vg.hpp"
 #include "../xg.hpp"
+#include "../gssw_aligner.hpp"
+#include "../xdrop_aligner.hpp"
+#include "../build_index.hpp"
+#include "../multipath_mapper.hpp"
+#include "../sampler.hpp"
+#include "../gamsorter.hpp"
+#include "../packer.hpp"
+#include "../stream.hpp"
 #include "../algorithms/extract_connecting_graph.hpp"
 #include "../algorithms/topological_sort.hpp"
 #include "../algorithms/weakly_connected_components.hpp"
@@ -29,12 +40,163 @@ using namespace vg::subcommand;
 void help_benchmark(char** argv) {
     cerr << "usage: " << argv[0] << " benchmark [options] >report.tsv" << endl
          << "options:" << endl
+         << "    -m, --macro            also run the macro benchmarks of real mapping steps on a synthetic genome" << endl
+         << "    -f, --filter STR       only run benchmarks with STR in their names" << endl
+         << "    -j, --json             report results as JSON instead of TSV" << endl
+         << "    -c, --counters         also count cycles, instructions, LLC misses and branch misses with perf" << endl
          << "    -p, --progress         show progress" << endl;
 }
 
+/// Build the fixed reference graph for the macro benchmarks: a random
+/// reference path, embedded as "ref", with a SNP or a short deletion after
+/// each segment. Node IDs are in topological order.
+static void make_macro_graph(VG& graph, size_t sites, uint32_t seed) {
+    mt19937 rng(seed);
+    uniform_int_distribution<int> base(0, 3);
+    uniform_int_distribution<int> segment_length(20, 60);
+    uniform_int_distribution<int> deletion_length(1, 3);
+    const string bases = "ACGT";
+    auto random_sequence = [&](size_t length) {
+        string seq(length, 'A');
+        for (auto& c : seq) {
+            c = bases[base(rng)];
+        }
+        return seq;
+    };
+    
+    id_t next_id = 1;
+    size_t rank = 1;
+    // The nodes the next reference node attaches to
+    vector<Node*> ends;
+    auto add_reference = [&](Node* node) {
+        for (Node* end : ends) {
+            graph.create_edge(end, node);
+        }
+        graph.paths.append_mapping("ref", node->id(), false, node->sequence().size(), rank++);
+    };
+    
+    for (size_t i = 0; i < sites; i++) {
+        Node* segment = graph.create_node(random_sequence(segment_length(rng)), next_id++);
+        add_reference(segment);
+        ends = {segment};
+        if (i % 2 == 0) {
+            // A SNP
+            size_t ref_base = base(rng);
+            Node* ref = graph.create_node(string(1, bases[ref_base]), next_id++);
+            Node* alt = graph.create_node(string(1, bases[(ref_base + 1 + base(rng) % 3) % 4]), next_id++);
+            add_reference(ref);
+            graph.create_edge(segment, alt);
+            ends = {ref, alt};
+        } else {
+            // A deletion we can skip
+            Node* deleted = graph.create_node(random_sequence(deletion_length(rng)), next_id++);
+            add_reference(deleted);
+            ends = {segment, deleted};
+        }
+    }
+    add_reference(graph.create_node(random_sequence(segment_length(rng)), next_id++));
+    
+    graph.paths.to_graph(graph.graph);
+}
+
+/// Runs one benchmark and records its result.
+using benchmark_adder_t = function<void(const string&, size_t, const function<void(void)>&, const function<void(void)>&)>;
+
+/// Add benchmarks of building and querying the hot hash maps under one
+/// policy, keyed on the node IDs, edge sides, and handles of a graph, and
+/// queried in the order the reads visit them.
+template<typename Policy>
+static void add_hash_map_benchmarks(const string& policy_name, const VG& graph, const xg::XG& xg_index,
+                                    const vector<Alignment>& reads, const benchmark_adder_t& add_benchmark) {
+    
+    vector<id_t> read_ids;
+    vector<pair<NodeSide, NodeSide>> read_sides;
+    vector<handle_t> read_handles;
+    for (auto& read : reads) {
+        for (int i = 0; i < read.path().mapping_size(); i++) {
+            const Position& here = read.path().mapping(i).position();
+            read_ids.push_back(here.node_id());
+            read_handles.push_back(xg_index.get_handle(here.node_id(), here.is_reverse()));
+            if (i > 0) {
+                const Position& prev = read.path().mapping(i - 1).position();
+                Edge crossed;
+                crossed.set_from(prev.node_id());
+                crossed.set_from_start(prev.is_reverse());
+                crossed.set_to(here.node_id());
+                crossed.set_to_end(here.is_reverse());
+                read_sides.push_back(NodeSide::pair_from_edge(crossed));
+            }
+        }
+    }
+    
+    // Lookups are repeated so they take about as long as the insertions
+    const size_t lookup_passes = 20;
+    auto no_setup = []() {};
+    
+    hot_hash_map<id_t, const Node*, Policy> by_id;
+    add_benchmark("macro " + policy_name + " hot_hash_map insert node IDs", 10, [&]() {
+        by_id.clear();
+    }, [&]() {
+        for (auto& node : graph.graph.node()) {
+            by_id[node.id()] = &node;
+        }
+    });
+    add_benchmark("macro " + policy_name + " hot_hash_map find node IDs", 10, no_setup, [&]() {
+        size_t found = 0;
+        for (size_t pass = 0; pass < lookup_passes; pass++) {
+            for (id_t id : read_ids) {
+                found += by_id.count(id);
+            }
+        }
+        assert(found == read_ids.size() * lookup_passes);
+    });
+    
+    hot_hash_map<pair<NodeSide, NodeSide>, const Edge*, Policy> by_sides;
+    add_benchmark("macro " + policy_name + " hot_hash_map insert edge sides", 10, [&]() {
+        by_sides.clear();
+    }, [&]() {
+        for (auto& edge : graph.graph.edge()) {
+            by_sides[NodeSide::pair_from_edge(edge)] = &edge;
+        }
+    });
+    add_benchmark("macro " + policy_name + " hot_hash_map find edge sides", 10, no_setup, [&]() {
+        size_t found = 0;
+        for (size_t pass = 0; pass < lookup_passes; pass++) {
+            for (auto& sides : read_sides) {
+                found += by_sides.count(sides);
+            }
+        }
+        assert(found <= read_sides.size() * lookup_passes);
+    });
+    
+    hot_hash_map<handle_t, size_t, Policy> by_handle;
+    add_benchmark("macro " + policy_name + " hot_hash_map insert handles", 10, [&]() {
+        by_handle.clear();
+    }, [&]() {
+        size_t rank = 0;
+        for (auto& node : graph.graph.node()) {
+            by_handle[xg_index.get_handle(node.id(), false)] = rank++;
+            by_handle[xg_index.get_handle(node.id(), true)] = rank++;
+        }
+    });
+    add_benchmark("macro " + policy_name + " hot_hash_map find handles", 10, no_setup, [&]() {
+        size_t found = 0;
+        for (size_t pass = 0; pass < lookup_passes; pass++) {
+            for (handle_t handle : read_handles) {
+                found += by_handle.count(handle);
+            }
+        }
+        assert(found == read_handles.size() * lookup_passes);
+    });
+}
+
 int main_benchmark(int argc, char** argv) {
 
     bool show_progress = false;
+    bool run_macro = false;
+    bool output_json = false;
+    bool count_events = false;
+    string filter;
     
     int c;
     optind = 2; // force optind past command positional argument
@@ -42,12 +204,16 @@ int main_benchmark(int argc, char** argv) {
         static struct option long_options[] =
             {
                 {"progress",  no_argument, 0, 'p'},
+                {"macro", no_argument, 0, 'm'},
+                {"filter", required_argument, 0, 'f'},
+                {"json", no_argument, 0, 'j'},
+                {"counters", no_argument, 0, 'c'},
                 {"help", no_argument, 0, 'h'},
                 {0, 0, 0, 0}
             };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "ph?",
+        c = getopt_long (argc, argv, "pmf:jch?",
                          long_options, &option_index);
 
         /* Detect the end of the options. */
@@ -61,6 +227,22 @@ int main_benchmark(int argc, char** argv) {
             show_progress = true;
             break;
             
+        case 'm':
+            run_macro = true;
+            break;
+            
+        case 'f':
+            filter = optarg;
+            break;
+            
+        case 'j':
+            output_json = true;
+            break;
+            
+        case 'c':
+            count_events = true;
+            break;
+            
         case 'h':
         case '?':
             /* getopt_long already printed an error message. */
@@ -109,41 +291,56 @@ int main_benchmark(int argc, char** argv) {
     // And a test XG of it
     const xg::XG xg_index(vg_mut.graph);
     
+    set_benchmark_counters(count_events);
+    
     vector<BenchmarkResult> results;
     
-    results.push_back(run_benchmark("vg::algorithms topological_order", 1000, [&]() {
+    // Run a benchmark and save its result, unless it is filtered out
+    auto add_benchmark = [&](const string& name, size_t iterations, const function<void(void)>& setup,
+                             const function<void(void)>& under_test) {
+        if (!filter.empty() && name.find(filter) == string::npos) {
+            return;
+        }
+        if (show_progress) {
+            cerr << "Running " << name << "..." << endl;
+        }
+        results.push_back(run_benchmark(name, iterations, setup, under_test));
+    };
+    auto no_setup = []() {};
+    
+    add_benchmark("vg::algorithms topological_order", 1000, no_setup, [&]() {
         vector<handle_t> order = algorithms::topological_order(&vg);
         assert(order.size() == vg.node_size());
-    }));
+    });
     
-    results.push_back(run_benchmark("vg::algorithms sort", 1000, [&]() {
+    add_benchmark("vg::algorithms sort", 1000, [&]() {
         vg_mut = vg;
     }, [&]() {
         algorithms::sort(&vg_mut);
-    }));
+    });
     
-    results.push_back(run_benchmark("vg::algorithms orient_nodes_forward", 1000, [&]() {
+    add_benchmark("vg::algorithms orient_nodes_forward", 1000, [&]() {
         vg_mut = vg;
     }, [&]() {
         algorithms::orient_nodes_forward(&vg_mut);
-    }));
+    });
     
     
-    results.push_back(run_benchmark("vg::algorithms weakly_connected_components", 1000, [&]() {
+    add_benchmark("vg::algorithms weakly_connected_components", 1000, no_setup, [&]() {
         auto components = algorithms::weakly_connected_components(&vg);
         assert(components.size() == 1);
         assert(components.front().size() == vg.node_size());
-    }));
+    });
     
-    results.push_back(run_benchmark("VG::get_node", 1000, [&]() {
+    add_benchmark("VG::get_node", 1000, no_setup, [&]() {
         for (size_t rep = 0; rep < 100; rep++) {
             for (size_t i = 1; i < 101; i++) {
                 vg_mut.get_node(i);
             }
         }
-    }));
+    });
     
-    results.push_back(run_benchmark("algorithms::extract_connecting_graph on xg", 1000, [&]() {
+    add_benchmark("algorithms::extract_connecting_graph on xg", 1000, no_setup, [&]() {
         pos_t pos_1 = make_pos_t(55, false, 0);
         pos_t pos_2 = make_pos_t(32, false, 0);
         
@@ -153,9 +350,9 @@ int main_benchmark(int argc, char** argv) {
         
         auto trans = algorithms::extract_connecting_graph(&xg_index, &extractor, max_len, pos_1, pos_2, true, true);
     
-    }));
+    });
     
-    results.push_back(run_benchmark("algorithms::extract_connecting_graph on vg", 1000, [&]() {
+    add_benchmark("algorithms::extract_connecting_graph on vg", 1000, no_setup, [&]() {
         pos_t pos_1 = make_pos_t(55, false, 0);
         pos_t pos_2 = make_pos_t(32, false, 0);
         
@@ -165,16 +362,235 @@ int main_benchmark(int argc, char** argv) {
         
         auto trans = algorithms::extract_connecting_graph(&vg, &extractor, max_len, pos_1, pos_2, true, true);
     
-    }));
+    });
+    
+    // Make a linear graph and a read with a couple of mismatches for the X-drop aligner
+    Graph linear;
+    string linear_seq;
+    for (size_t i = 1; i < 11; i++) {
+        Node* node = linear.add_node();
+        node->set_id(i);
+        node->set_sequence(i % 2 ? "ACGTTGCAGATTACAG" : "TTGACCATGCAGGTAC");
+        linear_seq += node->sequence();
+        if (i > 1) {
+            Edge* edge = linear.add_edge();
+            edge->set_from(i - 1);
+            edge->set_to(i);
+        }
+    }
+    Alignment xdrop_aln;
+    xdrop_aln.set_sequence(linear_seq);
+    (*xdrop_aln.mutable_sequence())[40] = 'A';
+    (*xdrop_aln.mutable_sequence())[100] = 'C';
+    vector<MaximalExactMatch> xdrop_mems;
+    xdrop_mems.emplace_back(xdrop_aln.sequence().begin(), xdrop_aln.sequence().begin() + 16, gcsa::range_type(0, 0), 1);
+    xdrop_mems.back().nodes.push_back(gcsa::Node::encode(1, 0));
+    
+    XdropAligner xdrop(default_match, default_mismatch, default_gap_open, default_gap_extension,
+                       default_full_length_bonus, default_max_gap_length);
+    // Let the aligner size its working buffers before we count allocations
+    Alignment warm_up = xdrop_aln;
+    xdrop.align(warm_up, linear, xdrop_mems, false);
+    uint64_t xdrop_growths_before = XdropAligner::working_buffer_growths();
+    
+    add_benchmark("XdropAligner::align", 1000, no_setup, [&]() {
+        Alignment aln = xdrop_aln;
+        xdrop.align(aln, linear, xdrop_mems, false);
+    });
+    
+    uint64_t xdrop_growths = XdropAligner::working_buffer_growths() - xdrop_growths_before;
+    
+    if (run_macro) {
+        // Build a synthetic genome with real indexes, so we can time the
+        // mapping steps on it without downloading anything.
+        if (show_progress) {
+            cerr << "Building macro benchmark genome and indexes..." << endl;
+        }
+        VG macro_graph;
+        make_macro_graph(macro_graph, 2000, 1234);
+        xg::XG macro_xg(macro_graph.graph);
+        
+        gcsa::TempFile::setDirectory(temp_file::get_dir());
+        gcsa::Verbosity::set(gcsa::Verbosity::SILENT);
+        gcsa::GCSA* gcsa_index = nullptr;
+        gcsa::LCPArray* lcp_array = nullptr;
+        build_gcsa_lcp(macro_graph, gcsa_index, lcp_array, 16, 3);
+        
+        // Simulate reads with their true paths
+        Sampler sampler(&macro_xg, 5678, true);
+        vector<Alignment> true_reads;
+        for (size_t i = 0; i < 500; i++) {
+            true_reads.push_back(sampler.alignment_with_error(150, 0.01, 0.002));
+        }
+        vector<MultipathMapper::StagedRead> unmapped(true_reads.size());
+        for (size_t i = 0; i < true_reads.size(); i++) {
+            unmapped[i].alignment.set_sequence(true_reads[i].sequence());
+        }
+        
+        // Cut out the part of the graph each read came from
+        vector<Graph> read_graphs(true_reads.size());
+        for (size_t i = 0; i < true_reads.size(); i++) {
+            id_t min_id = numeric_limits<id_t>::max();
+            id_t max_id = 0;
+            for (auto& mapping : true_reads[i].path().mapping()) {
+                min_id = min(min_id, (id_t) mapping.position().node_id());
+                max_id = max(max_id, (id_t) mapping.position().node_id());
+            }
+            for (id_t id = min_id; id <= max_id; id++) {
+                *read_graphs[i].add_node() = *macro_graph.get_node(id);
+            }
+            for (auto& edge : macro_graph.graph.edge()) {
+                if (edge.from() >= min_id && edge.from() <= max_id && edge.to() >= min_id && edge.to() <= max_id) {
+                    *read_graphs[i].add_edge() = edge;
+                }
+            }
+        }
+        
+        // Seed the X-drop aligner with the first exact match on each read's true path
+        vector<size_t> seeded_reads;
+        vector<vector<MaximalExactMatch>> read_seeds(true_reads.size());
+        for (size_t i = 0; i < true_reads.size(); i++) {
+            const Mapping& first = true_reads[i].path().mapping(0);
+            if (first.edit_size() == 0 || !edit_is_match(first.edit(0)) || first.edit(0).from_length() < 8) {
+                continue;
+            }
+            const string& seq = true_reads[i].sequence();
+            read_seeds[i].emplace_back(seq.begin(), seq.begin() + first.edit(0).from_length(), gcsa::range_type(0, 0), 1);
+            read_seeds[i].back().nodes.push_back(gcsa::Node::encode(first.position().node_id(), first.position().offset()));
+            seeded_reads.push_back(i);
+        }
+        
+        add_hash_map_benchmarks<flat_hash_policy>("flat", macro_graph, macro_xg, true_reads, add_benchmark);
+#ifndef USE_DENSE_HASH
+        add_hash_map_benchmarks<sparse_hash_policy>("sparse", macro_graph, macro_xg, true_reads, add_benchmark);
+#endif
+        add_hash_map_benchmarks<unordered_hash_policy>("unordered", macro_graph, macro_xg, true_reads, add_benchmark);
+        
+        MultipathMapper mapper(&macro_xg, gcsa_index, lcp_array);
+        
+        add_benchmark("macro MultipathMapper MEM finding", 5, no_setup, [&]() {
+            for (auto read : unmapped) {
+                mapper.find_staged_mems(read);
+            }
+        });
+        
+        vector<MultipathMapper::StagedRead> with_mems = unmapped;
+        for (auto& read : with_mems) {
+            mapper.find_staged_mems(read);
+        }
+        vector<MultipathMapper::StagedRead> clustered;
+        auto free_cluster_graphs = [&]() {
+            for (auto& read : clustered) {
+                for (auto& cluster_graph : read.cluster_graphs) {
+                    delete get<0>(cluster_graph);
+                }
+            }
+            clustered.clear();
+        };
+        add_benchmark("macro MultipathMapper clustering", 5, [&]() {
+            free_cluster_graphs();
+            clustered = with_mems;
+        }, [&]() {
+            for (auto& read : clustered) {
+                mapper.cluster_staged_mems(read);
+            }
+        });
+        free_cluster_graphs();
+        
+        Aligner aligner;
+        add_benchmark("macro Aligner::align local", 5, no_setup, [&]() {
+            for (size_t i = 0; i < true_reads.size(); i++) {
+                Alignment aln;
+                aln.set_sequence(true_reads[i].sequence());
+                aligner.align(aln, read_graphs[i], true, false);
+            }
+        });
+        
+        add_benchmark("macro Aligner::align_global_banded", 5, no_setup, [&]() {
+            for (size_t i = 0; i < true_reads.size(); i++) {
+                Alignment aln;
+                aln.set_sequence(true_reads[i].sequence());
+                aligner.align_global_banded(aln, read_graphs[i], 1, true);
+            }
+        });
+        
+        add_benchmark("macro XdropAligner::align", 5, no_setup, [&]() {
+            for (size_t i : seeded_reads) {
+                Alignment aln;
+                aln.set_sequence(true_reads[i].sequence());
+                xdrop.align(aln, read_graphs[i], read_seeds[i], false);
+            }
+        });
+        
+        size_t ref_length = macro_xg.path_length("ref");
+        add_benchmark("macro XG::node_at_path_position", 10, no_setup, [&]() {
+            for (size_t pos = 0; pos < ref_length; pos += 7) {
+                macro_xg.node_at_path_position("ref", pos);
+            }
+        });
+        
+        // Stream lots of reads to and from a GAM in memory
+        vector<Alignment> many_reads;
+        for (size_t i = 0; i < 20; i++) {
+            many_reads.insert(many_reads.end(), true_reads.begin(), true_reads.end());
+        }
+        string gam_data;
+        add_benchmark("macro GAM writing", 5, no_setup, [&]() {
+            stringstream out;
+            vector<Alignment> buffer;
+            for (auto& aln : many_reads) {
+                buffer.push_back(aln);
+                stream::write_buffered(out, buffer, 1000);
+            }
+            stream::write_buffered(out, buffer, 0);
+            stream::finish(out);
+            gam_data = out.str();
+        });
+        
+        add_benchmark("macro GAM reading", 5, no_setup, [&]() {
+            stringstream in(gam_data);
+            size_t read_count = 0;
+            stream::for_each<Alignment>(in, [&](Alignment& aln) {
+                read_count++;
+            });
+            assert(read_count == many_reads.size());
+        });
+        
+        GAMSorter gam_sorter;
+        vector<Alignment> to_sort;
+        add_benchmark("macro GAMSorter::sort", 5, [&]() {
+            to_sort = many_reads;
+        }, [&]() {
+            gam_sorter.sort(to_sort);
+        });
+        
+        add_benchmark("macro Packer::add", 5, no_setup, [&]() {
+            Packer packer(&macro_xg);
+            for (auto& aln : many_reads) {
+                packer.add(aln);
+            }
+        });
+        
+        delete gcsa_index;
+        delete lcp_array;
+    }
     
     // Do the control against itself
-    results.push_back(run_benchmark("control", 1000, benchmark_control));
+    add_benchmark("control", 1000, no_setup, benchmark_control);
+
+    if (output_json) {
+        write_benchmark_json(cout, results, Version::get_short());
+        return 0;
+    }
 
     cout << "# Benchmark results for vg " << Version::get_short() << endl;
-    cout << "# runs\ttest(us)\tstddev(us)\tcontrol(us)\tstddev(us)\tscore\terr\tname" << endl;
+    cout << "# runs\ttest(us)\tstddev(us)\tcontrol(us)\tstddev(us)\tscore\terr\t"
+         << (count_events ? "cycles\tinstructions\tllc_misses\tbranch_misses\t" : "") << "name" << endl;
     for (auto& result : results) {
         cout << result << endl;
     }
+    // This should be 0: alignment in steady state shouldn't need to allocate DP buffers
+    cout << "# XdropAligner working buffer growths after warm-up: " << xdrop_growths << endl;
 
     return 0;
 }
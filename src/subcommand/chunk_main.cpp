@@ -5,6 +5,8 @@
 #include <omp.h>
 #include <unistd.h>
 #include <getopt.h>
+#include <sys/time.h>
+#include <sys/resource.h>
 
 #include <string>
 #include <vector>
@@ -29,6 +31,8 @@ using namespace xg;
 static int split_gam(istream& gam_stream, size_t chunk_size, const string& out_prefix,
                      size_t gam_buffer_size = 100);
 
+static size_t gam_chunks_per_pass(size_t wanted, size_t extra_fds);
+
 void help_chunk(char** argv) {
     cerr << "usage: " << argv[0] << " chunk [options] > [chunk.vg]" << endl
          << "Splits a graph and/or alignment into smaller chunks" << endl
@@ -467,6 +471,10 @@ int main_chunk(int argc, char** argv) {
     // chunks are going to cover larger regions that what was asked for.
     // we return this in a bed file. 
     vector<Region> output_regions(num_regions);
+    
+    // When chunking GAMs, we work out the ID ranges for each chunk here, and
+    // look them all up together once the graph chunks are done.
+    vector<vector<pair<vg::id_t, vg::id_t>>> gam_queries(chunk_gam ? num_regions : 0);
 
     // initialize chunkers
     vector<PathChunker> chunkers(threads);
@@ -494,8 +502,9 @@ int main_chunk(int argc, char** argv) {
     }
     
 
-    // extract chunks in parallel
-#pragma omp parallel for
+    // extract chunks in parallel. Chunks can differ a lot in how much graph
+    // they pull in, so hand them out one at a time.
+#pragma omp parallel for schedule(dynamic, 1)
     for (int i = 0; i < num_regions; ++i) {
         int tid = omp_get_thread_num();
         Region& region = regions[i];
@@ -567,27 +576,14 @@ int main_chunk(int argc, char** argv) {
         
         // optional gam chunking
         if (chunk_gam) {
-            assert(gam_index.get() != nullptr);
-            GAMIndex::cursor_t& cursor = cursors[tid];
-            
-            string gam_name = chunk_name(i, output_regions[i], ".gam");
-            ofstream out_gam_file(gam_name);
-            if (!out_gam_file) {
-                cerr << "error[vg chunk]: can't open output gam file " << gam_name << endl;
-                exit(1);
-            }
-            
             // Work out the ID ranges to look up
-            vector<pair<vg::id_t, vg::id_t>> region_id_ranges;
             if (subgraph != NULL) {
                 // Use the regions from the graph
-                region_id_ranges = vg::algorithms::sorted_id_ranges(subgraph);
+                gam_queries[i] = vg::algorithms::sorted_id_ranges(subgraph);
             } else {
                 // Use the region we were asked for
-                region_id_ranges = {{region.start, region.end}};
+                gam_queries[i] = {{region.start, region.end}};
             }
-            
-            gam_index->find(cursor, region_id_ranges, stream::emit_to<Alignment>(out_gam_file), fully_contained);
         }
 
         // trace annotations
@@ -608,6 +604,40 @@ int main_chunk(int argc, char** argv) {
         delete subgraph;
     }
         
+    if (chunk_gam) {
+        assert(gam_index.get() != nullptr);
+        
+        // Look up the reads for as many chunks at a time as we can have
+        // output files open for, so that reads wanted by several chunks are
+        // only decoded once. Usually that is all of them, and the GAM is
+        // streamed in one pass.
+        size_t batch_size = gam_chunks_per_pass(num_regions, threads + 16);
+        for (size_t batch_start = 0; batch_start < num_regions; batch_start += batch_size) {
+            size_t batch_end = min(batch_start + batch_size, (size_t) num_regions);
+            
+            list<ofstream> out_gam_files;
+            vector<unique_ptr<stream::ProtobufEmitter<Alignment>>> emitters;
+            for (size_t i = batch_start; i < batch_end; i++) {
+                string gam_name = chunk_name(i, output_regions[i], ".gam");
+                out_gam_files.emplace_back(gam_name);
+                if (!out_gam_files.back()) {
+                    cerr << "error[vg chunk]: can't open output gam file " << gam_name << endl;
+                    exit(1);
+                }
+                emitters.emplace_back(new stream::ProtobufEmitter<Alignment>(out_gam_files.back()));
+            }
+            
+            vector<vector<pair<vg::id_t, vg::id_t>>> batch_queries(gam_queries.begin() + batch_start,
+                                                                   gam_queries.begin() + batch_end);
+            gam_index->find(cursors, batch_queries, [&](size_t query, const Alignment& aln) {
+                emitters[query]->write_copy(aln);
+            }, fully_contained);
+            
+            // Finish the chunk files before closing them.
+            emitters.clear();
+        }
+    }
+        
     // write a bed file if asked giving a more explicit linking of chunks to files
     if (!out_bed_file.empty()) {
         ofstream obed(out_bed_file);
@@ -632,6 +662,37 @@ int main_chunk(int argc, char** argv) {
 // Register subcommand
 static Subcommand vg_chunk("chunk", "split graph or alignment into chunks", main_chunk);
 
+// Work out how many GAM chunk files we can have open at once, raising our open
+// file limit toward what we want if we are allowed. Leaves extra_fds free for
+// other uses.
+size_t gam_chunks_per_pass(size_t wanted, size_t extra_fds) {
+    // We always need to be able to make some progress.
+    size_t min_per_pass = 16;
+    wanted = max(wanted, (size_t) 1);
+    
+    struct rlimit fd_limit;
+    if (getrlimit(RLIMIT_NOFILE, &fd_limit) != 0) {
+        // We don't know; choose a conservative default.
+        return min(wanted, (size_t) 256);
+    }
+    
+    if (fd_limit.rlim_cur != RLIM_INFINITY && fd_limit.rlim_cur < wanted + extra_fds) {
+        // Max out our FD limit
+        rlim_t old_limit = fd_limit.rlim_cur;
+        fd_limit.rlim_cur = fd_limit.rlim_max == RLIM_INFINITY ? wanted + extra_fds :
+            min<rlim_t>(wanted + extra_fds, fd_limit.rlim_max);
+        if (setrlimit(RLIMIT_NOFILE, &fd_limit) != 0) {
+            // Keep the limit we had
+            fd_limit.rlim_cur = old_limit;
+        }
+    }
+    
+    if (fd_limit.rlim_cur == RLIM_INFINITY || fd_limit.rlim_cur >= wanted + extra_fds) {
+        return wanted;
+    }
+    return min(wanted, max((size_t) fd_limit.rlim_cur - min((size_t) fd_limit.rlim_cur, extra_fds), min_per_pass));
+}
+
 // Split out every chunk_size reads into a different file
 int split_gam(istream& gam_stream, size_t chunk_size, const string& out_prefix, size_t gam_buffer_size) {
     ofstream out_file;
@@ -9,10 +9,12 @@
 #include <getopt.h>
 
 #include <iostream>
+#include <algorithm>
 
 #include "subcommand.hpp"
 
 #include "../vg.hpp"
+#include "../vg_set.hpp"
 
 using namespace std;
 using namespace vg;
@@ -62,6 +64,22 @@ int main_concat(int argc, char** argv) {
         }
     }
 
+    vector<string> graph_file_names;
+    for (int i = optind; i < argc; ++i) {
+        graph_file_names.push_back(argv[i]);
+    }
+    if (std::find(graph_file_names.begin(), graph_file_names.end(), "-") == graph_file_names.end()) {
+        // Stream the files, which we can read more than once
+        VGset graphs(graph_file_names);
+        try {
+            graphs.write_concatenated(std::cout);
+        } catch (exception& e) {
+            cerr << "error:[vg concat]: " << e.what() << endl;
+            return 1;
+        }
+        return 0;
+    }
+
     list<VG*> graphs;
 
     while (optind < argc) {
@@ -13,6 +13,8 @@
 #include "subcommand.hpp"
 
 #include "../vg.hpp"
+#include "../xg.hpp"
+#include "../snarls.hpp"
 #include "../deconstructor.hpp"
 
 using namespace std;
@@ -20,10 +22,13 @@ using namespace vg;
 using namespace vg::subcommand;
 
 void help_deconstruct(char** argv){
-    cerr << "usage: " << argv[0] << " deconstruct [options] -p <PATH> <my_graph>.vg" << endl
+    cerr << "usage: " << argv[0] << " deconstruct [options] -p <PATH> [<my_graph>.vg]" << endl
          << "Outputs VCF records for Snarls present in a graph (relative to a chosen reference path)." << endl
          << "options: " << endl
          << "--path / -p     REQUIRED: A reference path to deconstruct against." << endl
+         << "--xg / -x FILE  Deconstruct this xg index instead of a vg graph (requires -r)." << endl
+         << "--snarls / -r FILE  Use the snarls in this file (for -x)." << endl
+         << "--threads / -t N    Use N threads [all available]." << endl
          << endl;
 }
 
@@ -36,6 +41,8 @@ int main_deconstruct(int argc, char** argv){
 
     vector<string> refpaths;
     string graphname;
+    string xg_name;
+    string snarls_name;
     string outfile = "";
     
     int c;
@@ -45,12 +52,15 @@ int main_deconstruct(int argc, char** argv){
             {
                 {"help", no_argument, 0, 'h'},
                 {"path", required_argument, 0, 'p'},
+                {"xg", required_argument, 0, 'x'},
+                {"snarls", required_argument, 0, 'r'},
+                {"threads", required_argument, 0, 't'},
                 {0, 0, 0, 0}
 
             };
 
             int option_index = 0;
-            c = getopt_long (argc, argv, "hp:",
+            c = getopt_long (argc, argv, "hp:x:r:t:",
                     long_options, &option_index);
 
             // Detect the end of the options.
@@ -62,6 +72,15 @@ int main_deconstruct(int argc, char** argv){
                 case 'p':
                     refpaths = split(optarg, ",");
                     break;
+                case 'x':
+                    xg_name = optarg;
+                    break;
+                case 'r':
+                    snarls_name = optarg;
+                    break;
+                case 't':
+                    omp_set_num_threads(parse<int>(optarg));
+                    break;
                 case '?':
                 case 'h':
                     help_deconstruct(argv);
@@ -72,18 +91,56 @@ int main_deconstruct(int argc, char** argv){
             }
 
         }
-        graphname = argv[optind];
-        vg::VG* graph;
-        if (!graphname.empty()){
-            ifstream gstream(graphname);
-            graph = new vg::VG(gstream);
+        if (refpaths.empty()) {
+            cerr << "error:[vg deconstruct] a reference path (-p) is required" << endl;
+            return 1;
+        }
+
+        if (!snarls_name.empty() && xg_name.empty()) {
+            cerr << "error:[vg deconstruct] a snarls file (-r) can only be used with an xg index (-x)" << endl;
+            return 1;
         }
 
-        // load graph
+        if (!xg_name.empty()) {
+            // Work from the index, without loading the graph
+            if (snarls_name.empty()) {
+                cerr << "error:[vg deconstruct] deconstructing an xg index requires a snarls file (-r)" << endl;
+                return 1;
+            }
+            xg::XG xg_index;
+            get_input_file(xg_name, [&](istream& in) {
+                xg_index.load(in);
+            });
+            SnarlManager* snarl_manager = nullptr;
+            get_input_file(snarls_name, [&](istream& in) {
+                snarl_manager = new SnarlManager(in);
+            });
+            
+            Deconstructor dd;
+            try {
+                dd.deconstruct(refpaths, &xg_index, snarl_manager);
+            } catch (const runtime_error& e) {
+                cerr << "error:[vg deconstruct] " << e.what() << endl;
+                return 1;
+            }
+            delete snarl_manager;
+            return 0;
+        }
+
+        if (optind >= argc) {
+            help_deconstruct(argv);
+            return 1;
+        }
+        graphname = get_input_file_name(optind, argc, argv);
+        vg::VG* graph;
+        get_input_file(graphname, [&](istream& in) {
+            graph = new vg::VG(in);
+        });
 
         // Deconstruct
         Deconstructor dd;
         dd.deconstruct(refpaths, graph);
+        delete graph;
     return 0;
 }
 
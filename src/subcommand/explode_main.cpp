@@ -11,6 +11,8 @@
 #include "../vg.hpp"
 #include "../stream.hpp"
 #include "../utility.hpp"
+#include "../shard_router.hpp"
+#include "../algorithms/weakly_connected_components.hpp"
 
 
 using namespace std;
@@ -22,6 +24,8 @@ void help_explode(char** argv) {
          << "Breaks a graph into connected components in their own files in the given directory" << endl
          << endl
          << "options:" << endl
+         << "    -s, --shards N           instead group the components into N shards of about equal sequence length," << endl
+         << "                             keeping node IDs, and write shards.tsv saying which shard each ID is in" << endl
          << "general:" << endl
          << "    -t, --threads N          for tasks that can be done in parallel, use this many threads [1]" << endl
          << "    -h, --help" << endl;
@@ -35,6 +39,7 @@ int main_explode(int argc, char** argv) {
     }
 
     int threads = 1;
+    size_t shard_count = 0;
     
     int c;
     optind = 2; // force optind past command positional argument
@@ -43,11 +48,12 @@ int main_explode(int argc, char** argv) {
         {
             {"help", no_argument, 0, 'h'},
             {"threads", required_argument, 0, 't'},
+            {"shards", required_argument, 0, 's'},
             {0, 0, 0, 0}
         };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "ht:",
+        c = getopt_long (argc, argv, "ht:s:",
                 long_options, &option_index);
 
 
@@ -62,6 +68,14 @@ int main_explode(int argc, char** argv) {
             omp_set_num_threads(parse<int>(optarg));
             break;
 
+        case 's':
+            shard_count = parse<size_t>(optarg);
+            if (shard_count == 0) {
+                cerr << "error:[vg explode] number of shards must be at least 1" << endl;
+                return 1;
+            }
+            break;
+
         case 'h':
         case '?':
         default:
@@ -83,72 +97,110 @@ int main_explode(int argc, char** argv) {
     mkdir(output_dir.c_str(), 0755);
     // Ignore failure
     
+    // Copy a node, its edges, and the parts of paths on it into a part of the graph, noting the paths
+    auto copy_node = [&](Node* n, VG& part, set<string>& path_names) {
+        part.create_node(n->sequence(), n->id());
+        for (auto* e : graph->edges_of(n)) {
+            part.add_edge(*e);
+        }
+        for (auto& path : graph->paths.get_node_mapping_by_path_name(n)) {
+            // Some paths might not actually touch this node at all.
+            bool nonempty = false;
+            for (auto& m : path.second) {
+                part.paths.append_mapping(path.first, *m);
+                nonempty = true;
+            }
+            if (nonempty) {
+                path_names.insert(path.first);
+            }
+        }
+    };
+    
+    // Sort the copied path mappings by rank and save the part. Returns a line reporting what paths went
+    // into it in parseable TSV.
+    auto save_part = [&](VG& part, const set<string>& path_names, const string& filename) {
+        part.paths.sort_by_mapping_rank();
+        part.paths.rebuild_mapping_aux();
+        
+        string report = filename;
+        for (auto& path_name : path_names) {
+            report += "\t" + path_name;
+        }
+        
+        part.serialize_to_file(filename);
+        return report;
+    };
+    
+    if (shard_count > 0) {
+        // Group the components into shards that share the graph's ID space
+        ShardRouter router(*graph, shard_count);
+        
+        vector<VG> shards(shard_count);
+        vector<set<string>> shard_path_names(shard_count);
+        graph->for_each_node([&](Node* n) {
+            size_t shard = router.shard_of(n->id());
+            copy_node(n, shards[shard], shard_path_names[shard]);
+        });
+        
+        for (size_t i = 0; i < shard_count; i++) {
+            cout << save_part(shards[i], shard_path_names[i], output_dir + "/shard" + to_string(i) + ".vg") << endl;
+        }
+        
+        ofstream router_out(output_dir + "/shards.tsv");
+        if (!router_out) {
+            cerr << "error:[vg explode] could not write " << output_dir << "/shards.tsv" << endl;
+            return 1;
+        }
+        router.serialize(router_out);
+        
+        delete graph;
+        return 0;
+    }
+    
     // Now we explode the VG
     
-    // Count through the components we build
-    size_t component_index = 0;
+    // Label every node with its component, numbered in order of their lowest IDs
+    vector<id_t> ids;
+    size_t component_count;
+    vector<size_t> labels = algorithms::weakly_connected_component_labels(graph, ids, &component_count);
     
-    // Track all the nodes we've already assigned to subgraphs
-    set<Node*> used;
+    // Bucket the node IDs by component
+    vector<size_t> component_start(component_count + 1, 0);
+    for (size_t label : labels) {
+        component_start[label + 1]++;
+    }
+    for (size_t i = 0; i < component_count; i++) {
+        component_start[i + 1] += component_start[i];
+    }
+    vector<id_t> component_ids(ids.size());
+    {
+        vector<size_t> next = component_start;
+        for (size_t i = 0; i < ids.size(); i++) {
+            component_ids[next[labels[i]]++] = ids[i];
+        }
+    }
+    vector<id_t>().swap(ids);
+    vector<size_t>().swap(labels);
     
-    graph->for_each_node([&](Node* start) {
-        if (!used.count(start)) {
-            // It's a new connected component!
-            VG component;
-            
-            // We want to track the path names in each component
-            set<string> path_names;
-            
-            graph->for_each_connected_node(start, [&](Node* n) {
-                // Mark this connected node as used in a component.
-                used.insert(n);
-                
-                // Copy node over
-                component.create_node(n->sequence(), n->id());
-                
-                // Copy over its edges
-                for (auto* e : graph->edges_of(n)) {
-                    component.add_edge(*e);
-                }
-                
-                // Copy paths over
-                for (auto& path : graph->paths.get_node_mapping_by_path_name(n)) {
-                    // Some paths might not actually touch this node at all.
-                    bool nonempty = false;
-                    for (auto& m : path.second) {
-                        component.paths.append_mapping(path.first, *m);
-                        nonempty = true;
-                    }
-                    if (nonempty) {
-                        // This path had mappings, so it qualifies for the component
-                        path_names.insert(path.first);
-                    }
-                }
-            });
-            
-            // We inserted mappings into the component in more or less arbitrary
-            // order, so sort them by rank.
-            component.paths.sort_by_mapping_rank();
-            // Then rebuild the other path indexes
-            component.paths.rebuild_mapping_aux();
-            
-            // Save the component
-            string filename = output_dir + "/component" + to_string(component_index) + ".vg";
-            
-            // Now report what paths went into the component in parseable TSV
-            cout << filename;
-            for (auto& path_name : path_names) {
-                cout << "\t" << path_name;
-            }
-            cout << endl;
-            
-            component.serialize_to_file(filename);
-            
-            
-            
-            component_index++;
+    // Build and write the components in parallel, holding only the ones being worked on
+    vector<string> reports(component_count);
+#pragma omp parallel for schedule(dynamic, 1)
+    for (size_t i = 0; i < component_count; i++) {
+        VG component;
+        
+        // We want to track the path names in each component
+        set<string> path_names;
+        
+        for (size_t j = component_start[i]; j < component_start[i + 1]; j++) {
+            copy_node(graph->get_node(component_ids[j]), component, path_names);
         }
-    });
+        
+        reports[i] = save_part(component, path_names, output_dir + "/component" + to_string(i) + ".vg");
+    }
+    
+    for (auto& report : reports) {
+        cout << report << endl;
+    }
     
     if (graph != nullptr) {
         delete graph;
@@ -5,10 +5,14 @@
 #include "../stream.hpp"
 #include "../region.hpp"
 #include "../gam_index.hpp"
+#include "../gam_name_index.hpp"
 #include "../algorithms/sorted_id_ranges.hpp"
+#include "../algorithms/path_region_id_ranges.hpp"
 
 #include <unistd.h>
 #include <getopt.h>
+#include <list>
+#include <fstream>
 
 using namespace vg;
 using namespace vg::subcommand;
@@ -26,6 +30,10 @@ void help_find(char** argv) {
          << "    -c, --context STEPS    expand the context of the subgraph this many steps" << endl
          << "    -L, --use-length       treat STEPS in -c or M in -r as a length in bases" << endl
          << "    -p, --path TARGET      find the node(s) in the specified path range(s) TARGET=path[:pos1[-pos2]]" << endl
+         << "    -b, --bed FILE         find the node(s) in the path regions in this BED file (requires -x)" << endl
+         << "    --per-query            with -x, write the context of each -n node and each -p/-b region as its own" << endl
+         << "                           graph, in input order, instead of their union" << endl
+         << "    --threads N            use N threads for --per-query (defaults to numCPUs)" << endl
          << "    -P, --position-in PATH find the position of the node (specified by -n) in the given path" << endl
          << "    -R, --rank-in PATH     find the rank of the node (specified by -n) in the given path" << endl
          << "    -I, --list-paths       write out the path names in the index" << endl
@@ -34,10 +42,16 @@ void help_find(char** argv) {
          << "    -G, --gam GAM          accumulate the graph touched by the alignments in the GAM" << endl
          << "alignments:" << endl
          << "    -d, --db-name DIR      use this RocksDB database to retrieve alignments" << endl
+         << "    --db-cache-mb N        use this many MB of block cache for the RocksDB database [1024]" << endl
          << "    -l, --sorted-gam FILE  use this sorted, indexed GAM file" << endl
          << "    -a, --alignments       write all alignments from input sorted GAM or RocksDB" << endl
          << "    -o, --alns-on N:M      write alignments which align to any of the nodes between N and M (inclusive)" << endl
          << "    -A, --to-graph VG      get alignments to the provided subgraph" << endl
+         << "    -O, --alns-in TARGET   write alignments on the nodes in path range(s) TARGET=path[:pos1[-pos2]]," << endl
+         << "                           expanded by -c steps, from the sorted GAM (requires -x and -l)" << endl
+         << "    --fully-contained      with -O, only write alignments with all their nodes in the path ranges" << endl
+         << "    -F, --read-names FILE  get alignments with the names listed one per line in FILE, using the sorted GAM's .gan" << endl
+         << "    --with-mates           also get the mates of the named reads, whose names differ only by a /1 or /2" << endl
          << "sequences:" << endl
          << "    -g, --gcsa FILE        use this GCSA2 index of the sequence space of the graph" << endl
          << "    -z, --kmer-size N      split up --sequence into kmers of size N" << endl
@@ -61,6 +75,82 @@ void help_find(char** argv) {
 
 }
 
+/// Get the context of the given nodes, with one expansion out from all of
+/// them at once, so nodes and edges in overlapping contexts are only visited
+/// once. With no context, keeps the edges between the given nodes.
+static void node_context(const xg::XG& xindex, const vector<vg::id_t>& node_ids, int context_size,
+                         bool use_length, Graph& g) {
+    unordered_set<vg::id_t> ids;
+    for (auto node_id : node_ids) {
+        if (ids.insert(node_id).second) {
+            *g.add_node() = xindex.node(node_id);
+        }
+    }
+    xindex.expand_context(g, context_size, true, !use_length);
+    if (context_size == 0) {
+        for (auto node_id : ids) {
+            for (auto& edge : xindex.edges_of(node_id)) {
+                // if both ends of the edge are in our targets, keep them
+                if (ids.count(edge.to()) && ids.count(edge.from())) {
+                    *g.add_edge() = edge;
+                }
+            }
+        }
+    }
+}
+
+/// Get the nodes in the given path regions, the edges touching them, and the
+/// paths through them, and then expand the context around all of them at
+/// once. Each node only goes in once, however many regions it is in.
+static void region_context(const xg::XG& xindex, const vector<Region>& regions, int context_size,
+                           bool use_length, Graph& g) {
+    set<vg::id_t> ids;
+    for (auto& region : regions) {
+        xindex.for_path_range(region.seq, region.start, region.end, [&](int64_t id) {
+            ids.insert(id);
+        });
+    }
+    
+    map<int64_t, Node*> nodes;
+    set<tuple<vg::id_t, bool, vg::id_t, bool>> edges;
+    for (auto id : ids) {
+        Node* node = g.add_node();
+        *node = xindex.node(id);
+        nodes[id] = node;
+        for (auto& edge : xindex.edges_of(id)) {
+            if (edges.emplace(edge.from(), edge.from_start(), edge.to(), edge.to_end()).second) {
+                *g.add_edge() = edge;
+            }
+        }
+    }
+    
+    if (context_size > 0) {
+        xindex.expand_context(g, context_size, true, !use_length);
+    } else {
+        xindex.add_paths_to_graph(nodes, g);
+    }
+}
+
+/// Tidy up an extracted graph and serialize it as one Graph message, or an
+/// empty Graph if it has no nodes, so each query has exactly one message.
+static string serialize_context(Graph& g, bool remove_orphans) {
+    VG result_graph;
+    result_graph.extend(g);
+    if (remove_orphans) {
+        result_graph.remove_orphan_edges();
+    }
+    // Order the mappings by rank. TODO: how do we handle breaks between
+    // different sections of a path with a single name?
+    result_graph.paths.sort_by_mapping_rank();
+    
+    if (result_graph.graph.node_size() == 0) {
+        return stream::serialize_group(vector<Graph>(1));
+    }
+    stringstream serialized;
+    result_graph.serialize_to_ostream_as_part(serialized, result_graph.graph.node_size());
+    return serialized.str();
+}
+
 int main_find(int argc, char** argv) {
 
     if (argc == 2) {
@@ -80,6 +170,8 @@ int main_find(int argc, char** argv) {
     bool count_kmers = false;
     bool kmer_table = false;
     vector<string> targets;
+    string bed_name;
+    bool per_query = false;
     string path_name;
     bool position_in = false;
     bool rank_in = false;
@@ -101,12 +193,22 @@ int main_find(int argc, char** argv) {
     int max_mem_length = 0;
     int min_mem_length = 1;
     string to_graph_file;
+    string read_names_file;
+    vector<string> aln_path_targets;
+    bool fully_contained = false;
+    bool with_mates = false;
     bool extract_threads = false;
     vector<string> extract_thread_patterns;
     bool extract_paths = false;
     vector<string> extract_path_patterns;
     vg::id_t approx_id = 0;
     bool list_path_names = false;
+    #define OPT_DB_CACHE_MB 1000
+    #define OPT_PER_QUERY 1001
+    #define OPT_THREADS 1002
+    #define OPT_WITH_MATES 1003
+    #define OPT_FULLY_CONTAINED 1004
+    size_t db_cache_mb = 1024;
 
     int c;
     optind = 2; // force optind past command positional argument
@@ -144,6 +246,10 @@ int main_find(int argc, char** argv) {
                 {"haplotypes", required_argument, 0, 'H'},
                 {"gam", required_argument, 0, 'G'},
                 {"to-graph", required_argument, 0, 'A'},
+                {"read-names", required_argument, 0, 'F'},
+                {"with-mates", no_argument, 0, OPT_WITH_MATES},
+                {"alns-in", required_argument, 0, 'O'},
+                {"fully-contained", no_argument, 0, OPT_FULLY_CONTAINED},
                 {"max-mem", required_argument, 0, 'Y'},
                 {"min-mem", required_argument, 0, 'Z'},
                 {"extract-threads", no_argument, 0, 't'},
@@ -151,11 +257,15 @@ int main_find(int argc, char** argv) {
                 {"paths-named", required_argument, 0, 'Q'},
                 {"approx-pos", required_argument, 0, 'X'},
                 {"list-paths", no_argument, 0, 'I'},
+                {"db-cache-mb", required_argument, 0, OPT_DB_CACHE_MB},
+                {"bed", required_argument, 0, 'b'},
+                {"per-query", no_argument, 0, OPT_PER_QUERY},
+                {"threads", required_argument, 0, OPT_THREADS},
                 {0, 0, 0, 0}
             };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "d:x:n:e:s:o:k:hc:LS:z:j:CTp:P:r:l:amg:M:R:B:fDH:G:N:A:Y:Z:tq:X:IQ:",
+        c = getopt_long (argc, argv, "d:x:n:e:s:o:k:hc:LS:z:j:CTp:b:P:r:l:amg:M:R:B:fDH:G:N:A:F:O:Y:Z:tq:X:IQ:",
                          long_options, &option_index);
 
         // Detect the end of the options.
@@ -221,6 +331,10 @@ int main_find(int argc, char** argv) {
             targets.push_back(optarg);
             break;
 
+        case 'b':
+            bed_name = optarg;
+            break;
+
         case 'P':
             path_name = optarg;
             position_in = true;
@@ -275,6 +389,18 @@ int main_find(int argc, char** argv) {
             list_path_names = true;
             break;
 
+        case OPT_DB_CACHE_MB:
+            db_cache_mb = parse<size_t>(optarg);
+            break;
+
+        case OPT_PER_QUERY:
+            per_query = true;
+            break;
+
+        case OPT_THREADS:
+            omp_set_num_threads(parse<int>(optarg));
+            break;
+
         case 'm':
             get_mappings = true;
             break;
@@ -317,6 +443,22 @@ int main_find(int argc, char** argv) {
             to_graph_file = optarg;
             break;
 
+        case 'F':
+            read_names_file = optarg;
+            break;
+
+        case OPT_WITH_MATES:
+            with_mates = true;
+            break;
+
+        case 'O':
+            aln_path_targets.push_back(optarg);
+            break;
+
+        case OPT_FULLY_CONTAINED:
+            fully_contained = true;
+            break;
+
         case 'h':
         case '?':
             help_find(argv);
@@ -342,6 +484,11 @@ int main_find(int argc, char** argv) {
         exit(1);
     }
     
+    if (xg_name.empty() && (!bed_name.empty() || per_query)) {
+        cerr << "error:[vg find] -b and --per-query require an XG index. Provide XG index with -x." << endl;
+        exit(1);
+    }
+    
     if (xg_name.empty() && mem_reseed_length) {
         cerr << "error:[vg find] SMEM reseeding requires an XG index. Provide XG index with -x." << endl;
         exit(1);
@@ -368,6 +515,7 @@ int main_find(int argc, char** argv) {
     unique_ptr<Index> vindex;
     if (!db_name.empty()) {
         vindex = unique_ptr<Index>(new Index());
+        vindex->block_cache_bytes = db_cache_mb * size_t(1<<20);
         vindex->open_read_only(db_name);
     }
 
@@ -507,30 +655,151 @@ int main_find(int argc, char** argv) {
         
     }
 
+    if (!aln_path_targets.empty()) {
+        // Find alignments on path regions
+        if (xg_name.empty() || gam_index.get() == nullptr) {
+            cerr << "error [vg find]: Cannot find alignments on path regions without an xg index and a sorted GAM" << endl;
+            exit(1);
+        }
+        
+        // Turn all the regions into one set of node ID ranges, so reads in
+        // several regions are only written once
+        vector<pair<vg::id_t, vg::id_t>> ranges;
+        for (auto& target : aln_path_targets) {
+            Region region;
+            parse_region(target, region.seq, region.start, region.end);
+            if (xindex.path_rank(region.seq) == 0) {
+                cerr << "[vg find] error, path " << region.seq << " not found in index" << endl;
+                exit(1);
+            }
+            auto region_ranges = vg::algorithms::path_region_id_ranges(xindex, region, context_size);
+            ranges.insert(ranges.end(), region_ranges.begin(), region_ranges.end());
+        }
+        sort(ranges.begin(), ranges.end());
+        vector<pair<vg::id_t, vg::id_t>> coalesced;
+        for (auto& range : ranges) {
+            if (!coalesced.empty() && range.first <= coalesced.back().second + 1) {
+                coalesced.back().second = max(coalesced.back().second, range.second);
+            } else {
+                coalesced.push_back(range);
+            }
+        }
+        
+        // Give every thread its own cursor into the GAM, so the ranges can be
+        // scanned in parallel
+        list<ifstream> gam_streams;
+        vector<GAMIndex::cursor_t> cursors;
+        int threads = get_thread_count();
+        cursors.reserve(threads);
+        for (int i = 0; i < threads; i++) {
+            gam_streams.emplace_back(sorted_gam_name);
+            if (!gam_streams.back()) {
+                cerr << "error [vg find]: could not open sorted GAM " << sorted_gam_name << endl;
+                exit(1);
+            }
+            cursors.emplace_back(gam_streams.back());
+        }
+        
+        auto emit = stream::emit_to<Alignment>(cout);
+        gam_index->find(cursors, vector<vector<pair<vg::id_t, vg::id_t>>>{coalesced}, [&](size_t query, const Alignment& found) {
+            emit(found);
+        }, fully_contained);
+    }
+
+    if (!read_names_file.empty()) {
+        // Find alignments by name
+        if (sorted_gam_name.empty()) {
+            cerr << "error [vg find]: Cannot find alignments by name without a sorted GAM" << endl;
+            exit(1);
+        }
+        
+        // Read the names to look for
+        vector<string> names;
+        get_input_file(read_names_file, [&](istream& in) {
+            string line;
+            while (getline(in, line)) {
+                if (!line.empty()) {
+                    // Asking for both mates of a pair is the same as asking for either
+                    names.push_back(with_mates ? GAMNameIndex::fragment_name(line) : line);
+                }
+            }
+        });
+        // Don't write any read twice
+        sort(names.begin(), names.end());
+        names.erase(unique(names.begin(), names.end()), names.end());
+        
+        // Load the name index, which vg gamsort -n makes alongside the .gai
+        GAMNameIndex name_index;
+        get_input_file(sorted_gam_name + ".gan", [&](istream& in) {
+            name_index.load(in);
+        });
+        
+        get_input_file(sorted_gam_name, [&](istream& in) {
+            // Make a cursor for input
+            stream::ProtobufIterator<Alignment> cursor(in);
+            
+            // Look up all the names in one pass through the file and send the alignments to cout
+            auto emit = stream::emit_to<Alignment>(cout);
+            name_index.find(cursor, names, [&](size_t query, const Alignment& found) {
+                emit(found);
+            }, with_mates);
+        });
+    }
+
     if (!xg_name.empty()) {
-        if (!node_ids.empty() && path_name.empty() && !pairwise_distance) {
-            // get the context of the node
-            vector<Graph> graphs;
-            set<vg::id_t> ids;
-            for (auto node_id : node_ids) ids.insert(node_id);
-            for (auto node_id : node_ids) {
+        // Collect the path regions to look up
+        vector<Region> regions;
+        for (auto& target : targets) {
+            // Grab each target region
+            Region region;
+            parse_region(target, region.seq, region.start, region.end);
+            // no coordinates given, we do whole thing (0,-1)
+            if (region.start < 0 && region.end < 0) {
+                region.start = 0;
+            }
+            regions.push_back(region);
+        }
+        if (!bed_name.empty()) {
+            vector<Region> bed_regions;
+            parse_bed_regions(bed_name, bed_regions);
+            regions.insert(regions.end(), bed_regions.begin(), bed_regions.end());
+        }
+        for (auto& region : regions) {
+            if (xindex.path_rank(region.seq) == 0) {
+                // Passing a nonexistent path to get_path_range produces Undefined Behavior
+                cerr << "[vg find] error, path " << region.seq << " not found in index" << endl;
+                exit(1);
+            }
+        }
+        
+        bool find_node_contexts = !node_ids.empty() && path_name.empty() && !pairwise_distance;
+        if (per_query && (find_node_contexts || !regions.empty())) {
+            // Look up each node and then each region on its own, in parallel,
+            // but write them in order, without holding more than a few at once.
+            size_t query_count = (find_node_contexts ? node_ids.size() : 0) + regions.size();
+            stream::OutputQueue output(cout);
+#pragma omp parallel for schedule(dynamic, 1)
+            for (size_t i = 0; i < query_count; i++) {
                 Graph g;
-                xindex.neighborhood(node_id, context_size, g, !use_length);
-                if (context_size == 0) {
-                    for (auto& edge : xindex.edges_of(node_id)) {
-                        // if both ends of the edge are in our targets, keep them
-                        if (ids.count(edge.to()) && ids.count(edge.from())) {
-                            *g.add_edge() = edge;
-                        }
-                    }
+                if (find_node_contexts && i < node_ids.size()) {
+                    node_context(xindex, vector<vg::id_t>{node_ids[i]}, context_size, use_length, g);
+                    output.push(i, serialize_context(g, true));
+                } else {
+                    size_t region_number = find_node_contexts ? i - node_ids.size() : i;
+                    region_context(xindex, vector<Region>{regions[region_number]}, context_size, use_length, g);
+                    output.push(i, serialize_context(g, false));
                 }
-                graphs.push_back(g);
             }
+            output.close();
+            stream::finish(cout);
+            // We handled the regions already
+            regions.clear();
+        } else if (find_node_contexts) {
+            // get the context of all the nodes together
+            Graph g;
+            node_context(xindex, node_ids, context_size, use_length, g);
             VG result_graph;
-            for (auto& graph : graphs) {
-                // Allow duplicate nodes and edges (from e.g. multiple -n options); silently collapse them.
-                result_graph.extend(graph);
-            }
+            result_graph.extend(g);
             result_graph.remove_orphan_edges();
             
             // Order the mappings by rank. TODO: how do we handle breaks between
@@ -587,27 +856,10 @@ int main_find(int argc, char** argv) {
                 cout << xindex.path_name(i) << endl;
             }
         }
-        if (!targets.empty()) {
+        if (!regions.empty()) {
+            // Get all the regions, and the context around them, at once
             Graph graph;
-            for (auto& target : targets) {
-                // Grab each target region
-                string name;
-                int64_t start, end;
-                parse_region(target, name, start, end);
-                if(xindex.path_rank(name) == 0) {
-                    // Passing a nonexistent path to get_path_range produces Undefined Behavior
-                    cerr << "[vg find] error, path " << name << " not found in index" << endl;
-                    exit(1);
-                }
-                // no coordinates given, we do whole thing (0,-1)
-                if (start < 0 && end < 0) {
-                    start = 0;
-                }
-                xindex.get_path_range(name, start, end, graph);
-            }
-            if (context_size > 0) {
-                xindex.expand_context(graph, context_size, true, !use_length);
-            }
+            region_context(xindex, regions, context_size, use_length, graph);
             VG vgg; vgg.extend(graph); // removes dupes
             
             // Order the mappings by rank. TODO: how do we handle breaks between
@@ -7,24 +7,85 @@
 #include <string>
 #include <vector>
 #include <set>
+#include <memory>
+#include <functional>
 
 #include <subcommand.hpp>
 
 #include "../alignment.hpp"
 #include "../vg.hpp"
 #include "../stream.hpp"
+#include "../alignment_view.hpp"
+#include "../gam_columns.hpp"
 
 using namespace std;
 using namespace vg;
 using namespace vg::subcommand;
 
+/// The true positions of a read, as lists of offsets and orientations by path name
+using TruePositions = map<string, vector<pair<size_t, bool> > >;
+
+/// Collect the true positions out of a read's refpos entries
+template<typename Positions>
+static TruePositions to_true_positions(const Positions& refpos) {
+    TruePositions val;
+    for (auto& pos : refpos) {
+        val[pos.name()].push_back(make_pair(pos.offset(), pos.is_reverse()));
+    }
+    return val;
+}
+
+/// Counts of correct and total reads at each mapping quality. Each thread
+/// fills in its own, and they can be merged together at the end.
+struct MapqTable {
+    vector<size_t> correct;
+    vector<size_t> total;
+    
+    /// Count a read with the given mapping quality
+    void add(int mapq, bool is_correct) {
+        size_t i = max(mapq, 0);
+        if (i >= total.size()) {
+            correct.resize(i + 1, 0);
+            total.resize(i + 1, 0);
+        }
+        correct[i] += is_correct;
+        total[i]++;
+    }
+    
+    /// Add in the counts from another table
+    void merge(const MapqTable& other) {
+        if (other.total.size() > total.size()) {
+            correct.resize(other.total.size(), 0);
+            total.resize(other.total.size(), 0);
+        }
+        for (size_t i = 0; i < other.total.size(); i++) {
+            correct[i] += other.correct[i];
+            total[i] += other.total[i];
+        }
+    }
+    
+    /// Write the table as TSV, one line per mapping quality seen
+    void write(ostream& out) const {
+        out << "mq\tcorrect\ttotal" << endl;
+        for (size_t i = 0; i < total.size(); i++) {
+            if (total[i] != 0) {
+                out << i << "\t" << correct[i] << "\t" << total[i] << endl;
+            }
+        }
+    }
+};
+
 void help_gamcompare(char** argv) {
     cerr << "usage: " << argv[0] << " gamcompare aln.gam truth.gam >output.gam" << endl
          << endl
          << "options:" << endl
          << "    -r, --range N            distance within which to consider reads correct" << endl
+         << "    -C, --truth-columns      truth.gam is a column file from vg view -O or vg map --columns" << endl
          << "    -T, --tsv                output TSV (correct, mq, aligner, read) comaptible with plot-qq.R instead of GAM" << endl
          << "    -a, --aligner            aligner name for TSV output [\"vg\"]" << endl
+         << "    -m, --mapq-table FILE    write correct and total read counts per mapping quality to FILE (needs -r)" << endl
+         << "    -s, --sorted             both inputs are sorted by read name; stream them instead of loading the truth" << endl
+         << "    -p, --partitions N       hash reads by name into N temporary partitions and compare one at a time" << endl
          << "    -t, --threads N          number of threads to use" << endl;
 }
 
@@ -39,6 +100,10 @@ int main_gamcompare(int argc, char** argv) {
     int64_t range = -1;
     bool output_tsv = false;
     string aligner_name = "vg";
+    bool truth_columns = false;
+    string mapq_table_name;
+    bool sorted_input = false;
+    size_t partitions = 0;
 
     int c;
     optind = 2;
@@ -47,14 +112,18 @@ int main_gamcompare(int argc, char** argv) {
         {
             {"help", no_argument, 0, 'h'},
             {"range", required_argument, 0, 'r'},
+            {"truth-columns", no_argument, 0, 'C'},
             {"tsv", no_argument, 0, 'T'},
             {"aligner", required_argument, 0, 'a'},
             {"threads", required_argument, 0, 't'},
+            {"mapq-table", required_argument, 0, 'm'},
+            {"sorted", no_argument, 0, 's'},
+            {"partitions", required_argument, 0, 'p'},
             {0, 0, 0, 0}
         };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "hr:Ta:t:",
+        c = getopt_long (argc, argv, "hr:CTa:t:m:sp:",
                          long_options, &option_index);
 
         // Detect the end of the options.
@@ -67,6 +136,10 @@ int main_gamcompare(int argc, char** argv) {
             range = parse<int>(optarg);
             break;
             
+        case 'C':
+            truth_columns = true;
+            break;
+
         case 'T':
             output_tsv = true;
             break;
@@ -80,6 +153,18 @@ int main_gamcompare(int argc, char** argv) {
             omp_set_num_threads(threads);
             break;
 
+        case 'm':
+            mapq_table_name = optarg;
+            break;
+            
+        case 's':
+            sorted_input = true;
+            break;
+            
+        case 'p':
+            partitions = parse<size_t>(optarg);
+            break;
+
         case 'h':
         case '?':
             help_gamcompare(argv);
@@ -93,22 +178,27 @@ int main_gamcompare(int argc, char** argv) {
 
     string test_file_name = get_input_file_name(optind, argc, argv);
     string truth_file_name = get_input_file_name(optind, argc, argv);
-
-    // We will collect all the truth positions
-    string_hash_map<string, map<string ,vector<pair<size_t, bool> > > > true_positions;
-    function<void(Alignment&)> record_truth = [&true_positions](Alignment& aln) {
-        auto val = alignment_refpos_to_path_offsets(aln);
-#pragma omp critical (truth_table)
-        true_positions[aln.name()] = val;
-    };
-    if (truth_file_name == "-") {
-        assert(test_file_name != "-");
-        stream::for_each_parallel(std::cin, record_truth);
-    } else {
-        ifstream truth_file_in(truth_file_name);
-        stream::for_each_parallel(truth_file_in, record_truth);
+    
+    if (test_file_name == "-" && truth_file_name == "-") {
+        cerr << "error[vg gamcompare]: only one of the inputs can come from standard input" << endl;
+        exit(1);
+    }
+    if (!mapq_table_name.empty() && range == -1) {
+        cerr << "error[vg gamcompare]: a mapping quality table needs a --range to call reads correct" << endl;
+        exit(1);
+    }
+    if (sorted_input && partitions != 0) {
+        cerr << "error[vg gamcompare]: --sorted and --partitions cannot be used together" << endl;
+        exit(1);
+    }
+    if (sorted_input && truth_columns) {
+        cerr << "error[vg gamcompare]: --sorted needs the truth as GAM, not columns" << endl;
+        exit(1);
     }
 
+    // Each thread counts up its own reads by mapping quality
+    vector<MapqTable> mapq_tables(get_thread_count());
+
     // We have a buffer for annotated alignments
     vector<Alignment> buf;
     
@@ -140,40 +230,202 @@ int main_gamcompare(int argc, char** argv) {
         buf.clear();
     };
     
-    // This function annotates every read with distance and correctness, and batch-outputs them.
-    function<void(Alignment&)> annotate_test = [&buf,&flush_buffer,&true_positions,&range](Alignment& aln) {
-        auto f = true_positions.find(aln.name());
-        if (f != true_positions.end()) {
-            auto& true_position = f->second;
-            alignment_set_distance_to_correct(aln, true_position);
-            
-            if (range != -1) {
-                // We are flagging reads correct/incorrect.
-                // It is correct if there is a path for its minimum distance and it is in range on that path.
-                aln.set_correctly_mapped(aln.to_correct().name() != "" && aln.to_correct().offset() <= range);
-            }
-            
-        }
-#pragma omp critical (buf)
-        {
-            buf.push_back(aln);
-            if (buf.size() > 1000) {
-                flush_buffer();
-            }
+    // This function annotates a read with its distance to its true position and its correctness
+    auto annotate = [&mapq_tables,&range](Alignment& aln, const TruePositions& true_position) {
+        alignment_set_distance_to_correct(aln, true_position);
+        
+        if (range != -1) {
+            // We are flagging reads correct/incorrect.
+            // It is correct if there is a path for its minimum distance and it is in range on that path.
+            aln.set_correctly_mapped(aln.to_correct().name() != "" && aln.to_correct().offset() <= range);
+            mapq_tables[omp_get_thread_num()].add(aln.mapping_quality(), aln.correctly_mapped());
         }
     };
 
-    if (test_file_name == "-") {
-        assert(truth_file_name != "-");
-        stream::for_each_parallel(std::cin, annotate_test);
+    if (sorted_input) {
+        // Both inputs list their reads in the same order, so we can walk the
+        // truth alongside the test reads and never hold more than a batch of
+        // either. Test reads whose name sorts before the current truth read
+        // have no truth.
+        size_t batch_size = 1000 * get_thread_count();
+        get_input_file(truth_file_name, [&](istream& truth_in) {
+            get_input_file(test_file_name, [&](istream& test_in) {
+                stream::ProtobufIterator<Alignment> truth_it(truth_in);
+                stream::ProtobufIterator<Alignment> test_it(test_in);
+                
+                vector<Alignment> batch;
+                vector<TruePositions> batch_truth;
+                vector<bool> batch_has_truth;
+                while (test_it.has_next()) {
+                    // Pair up a batch of test reads with their truth
+                    while (test_it.has_next() && batch.size() < batch_size) {
+                        batch.emplace_back(test_it.take());
+                        const string& name = batch.back().name();
+                        while (truth_it.has_next() && (*truth_it).name() < name) {
+                            truth_it.get_next();
+                        }
+                        // We don't advance past a match, in case the next test read has the same name
+                        bool found = truth_it.has_next() && (*truth_it).name() == name;
+                        batch_truth.emplace_back(found ? to_true_positions((*truth_it).refpos()) : TruePositions());
+                        batch_has_truth.push_back(found);
+                    }
+                    
+#pragma omp parallel for
+                    for (size_t i = 0; i < batch.size(); i++) {
+                        if (batch_has_truth[i]) {
+                            annotate(batch[i], batch_truth[i]);
+                        }
+                    }
+                    
+                    // Send the batch out in order
+                    for (auto& aln : batch) {
+                        buf.emplace_back(std::move(aln));
+                    }
+                    flush_buffer();
+                    batch.clear();
+                    batch_truth.clear();
+                    batch_has_truth.clear();
+                }
+            });
+        });
     } else {
-        ifstream test_file_in(test_file_name);
-        stream::for_each_parallel(test_file_in, annotate_test);
+        // We will collect all the truth positions. We only need the names and
+        // refpos fields, so we don't decode the rest of the truth reads.
+        string_hash_map<string, TruePositions> true_positions;
+        function<void(AlignmentView&)> record_truth = [&true_positions](AlignmentView& aln) {
+            TruePositions val = to_true_positions(aln.refpos());
+            string name = aln.name();
+#pragma omp critical (truth_table)
+            true_positions[name] = val;
+        };
+        // Or we can get them from columns, which are smaller still.
+        function<void(const AlignmentRow&)> record_truth_row = [&true_positions](const AlignmentRow& row) {
+            true_positions[row.name] = to_true_positions(row.refpos);
+        };
+        
+        // This function annotates every read that has a truth, and batch-outputs them.
+        function<void(Alignment&)> annotate_test = [&buf,&flush_buffer,&true_positions,&annotate](Alignment& aln) {
+            auto f = true_positions.find(aln.name());
+            if (f != true_positions.end()) {
+                annotate(aln, f->second);
+            }
+#pragma omp critical (buf)
+            {
+                buf.push_back(aln);
+                if (buf.size() > 1000) {
+                    flush_buffer();
+                }
+            }
+        };
+        
+        if (partitions == 0) {
+            // Hold the whole truth in memory
+            get_input_file(truth_file_name, [&](istream& truth_in) {
+                if (truth_columns) {
+                    for_each_row(truth_in, record_truth_row);
+                } else {
+                    stream::for_each_parallel(truth_in, record_truth);
+                }
+            });
+            get_input_file(test_file_name, [&](istream& test_in) {
+                stream::for_each_parallel(test_in, annotate_test);
+            });
+        } else {
+            // Split both inputs up on disk by a hash of the read name, so that
+            // we only need to hold one partition's truth in memory at a time.
+            vector<string> truth_parts;
+            vector<string> test_parts;
+            for (size_t i = 0; i < partitions; i++) {
+                truth_parts.push_back(temp_file::create("vg-gamcompare-truth-"));
+                test_parts.push_back(temp_file::create("vg-gamcompare-test-"));
+            }
+            
+            // Run the given function to send reads to the partitions in the given files
+            auto split = [&partitions](const vector<string>& part_names,
+                                       const function<void(function<void(Alignment&&)>)>& iteratee) {
+                vector<unique_ptr<ofstream>> part_files;
+                vector<unique_ptr<stream::ProtobufEmitter<Alignment>>> part_emitters;
+                for (auto& part_name : part_names) {
+                    part_files.emplace_back(new ofstream(part_name));
+                    part_emitters.emplace_back(new stream::ProtobufEmitter<Alignment>(*part_files.back()));
+                }
+                
+                iteratee([&](Alignment&& aln) {
+                    size_t part = std::hash<string>()(aln.name()) % partitions;
+#pragma omp critical (partitions)
+                    part_emitters[part]->write(std::move(aln));
+                });
+                
+                // Finish the emitters before their files
+                part_emitters.clear();
+                part_files.clear();
+            };
+            
+            // The truth partitions only keep the names and refpos fields
+            get_input_file(truth_file_name, [&](istream& truth_in) {
+                split(truth_parts, [&](function<void(Alignment&&)> send) {
+                    if (truth_columns) {
+                        for_each_row(truth_in, [&](const AlignmentRow& row) {
+                            Alignment truth;
+                            truth.set_name(row.name);
+                            for (auto& pos : row.refpos) {
+                                *truth.add_refpos() = pos;
+                            }
+                            send(std::move(truth));
+                        });
+                    } else {
+                        function<void(AlignmentView&)> send_view = [&](AlignmentView& aln) {
+                            Alignment truth;
+                            truth.set_name(aln.name());
+                            for (auto& pos : aln.refpos()) {
+                                *truth.add_refpos() = pos;
+                            }
+                            send(std::move(truth));
+                        };
+                        stream::for_each_parallel(truth_in, send_view);
+                    }
+                });
+            });
+            get_input_file(test_file_name, [&](istream& test_in) {
+                split(test_parts, [&](function<void(Alignment&&)> send) {
+                    function<void(Alignment&)> send_aln = [&](Alignment& aln) {
+                        send(std::move(aln));
+                    };
+                    stream::for_each_parallel(test_in, send_aln);
+                });
+            });
+            
+            // Then join each partition on its own
+            for (size_t i = 0; i < partitions; i++) {
+                true_positions.clear();
+                ifstream truth_in(truth_parts[i]);
+                stream::for_each_parallel(truth_in, record_truth);
+                ifstream test_in(test_parts[i]);
+                stream::for_each_parallel(test_in, annotate_test);
+                
+                temp_file::remove(truth_parts[i]);
+                temp_file::remove(test_parts[i]);
+            }
+        }
     }
 
     // Save whatever's in the buffer at the end.
     flush_buffer();
     cout.flush();
+    
+    if (!mapq_table_name.empty()) {
+        // Merge the threads' counts and report them
+        MapqTable mapq_table;
+        for (auto& thread_table : mapq_tables) {
+            mapq_table.merge(thread_table);
+        }
+        ofstream mapq_out(mapq_table_name);
+        if (!mapq_out) {
+            cerr << "error[vg gamcompare]: could not open " << mapq_table_name << " for writing" << endl;
+            exit(1);
+        }
+        mapq_table.write(mapq_out);
+    }
 
     return 0;
 }
@@ -0,0 +1,183 @@
+/** \file gamcompress_main.cpp
+ *
+ * Defines the "vg gamcompress" subcommand, which converts GAMs to and from
+ * the compact reference-relative CompactAlignment encoding, and multipath
+ * alignments to and from CompactMultipathAlignments.
+ */
+
+#include <omp.h>
+#include <unistd.h>
+#include <getopt.h>
+
+#include <string>
+#include <vector>
+
+#include "subcommand.hpp"
+
+#include "../compact_alignment.hpp"
+#include "../stream.hpp"
+#include "../utility.hpp"
+#include "../xg.hpp"
+
+using namespace std;
+using namespace vg;
+using namespace vg::subcommand;
+
+void help_gamcompress(char** argv) {
+    cerr << "usage: " << argv[0] << " gamcompress [options] -x graph.xg input.gam > output.cgam" << endl
+         << "       " << argv[0] << " gamcompress [options] -x graph.xg -d input.cgam > output.gam" << endl
+         << "Store alignments as node steps and edits against the graph, leaving out read sequences the graph spells." << endl
+         << endl
+         << "options:" << endl
+         << "    -x, --xg-name FILE       the graph the reads were aligned to (required)" << endl
+         << "    -d, --decompress         expand compact alignments back into GAM" << endl
+         << "    -m, --multipath          convert multipath alignments (from vg mpmap) instead of GAM" << endl
+         << "    -q, --bin-qualities      bin base qualities into 8 levels (lossy)" << endl
+         << "    -t, --threads N          number of threads to use [1]" << endl;
+}
+
+/// Convert each batch of messages from the input stream in parallel, and write
+/// the results in the order they came in.
+template<typename In, typename Out>
+static void convert_stream(istream& in, const function<Out(const In&)>& convert) {
+    // Keep the groups the size vg map writes, so sorted files stay as finely indexable
+    const size_t group_size = 1000;
+    vector<Out> buffer;
+    function<void(int64_t, vector<In>&)> convert_batch = [&](int64_t virtual_offset, vector<In>& batch) {
+        vector<Out> converted(batch.size());
+        // exceptions can't leave the parallel loop, so hold on to the first one
+        string error;
+#pragma omp parallel for
+        for (size_t i = 0; i < batch.size(); i++) {
+            try {
+                converted[i] = convert(batch[i]);
+            } catch (const runtime_error& e) {
+#pragma omp critical (error)
+                if (error.empty()) {
+                    error = e.what();
+                }
+            }
+        }
+        if (!error.empty()) {
+            throw runtime_error(error);
+        }
+        for (auto& item : converted) {
+            buffer.emplace_back(move(item));
+            stream::write_buffered(cout, buffer, group_size);
+        }
+    };
+    stream::for_each_in_batches(in, group_size * get_thread_count(), convert_batch);
+    stream::write_buffered(cout, buffer, 0);
+    cout.flush();
+}
+
+int main_gamcompress(int argc, char** argv) {
+
+    if (argc == 2) {
+        help_gamcompress(argv);
+        return 1;
+    }
+
+    string xg_name;
+    bool decompress = false;
+    bool multipath = false;
+    bool bin_quality = false;
+    omp_set_num_threads(1);
+
+    int c;
+    optind = 2; // force optind past command positional argument
+    while (true) {
+        static struct option long_options[] =
+        {
+            {"help", no_argument, 0, 'h'},
+            {"xg-name", required_argument, 0, 'x'},
+            {"decompress", no_argument, 0, 'd'},
+            {"multipath", no_argument, 0, 'm'},
+            {"bin-qualities", no_argument, 0, 'q'},
+            {"threads", required_argument, 0, 't'},
+            {0, 0, 0, 0}
+        };
+
+        int option_index = 0;
+        c = getopt_long (argc, argv, "hx:dmqt:",
+                         long_options, &option_index);
+
+        // Detect the end of the options.
+        if (c == -1)
+            break;
+
+        switch (c)
+        {
+        case 'x':
+            xg_name = optarg;
+            break;
+        case 'd':
+            decompress = true;
+            break;
+        case 'm':
+            multipath = true;
+            break;
+        case 'q':
+            bin_quality = true;
+            break;
+        case 't':
+            omp_set_num_threads(parse<int>(optarg));
+            break;
+        case 'h':
+        case '?':
+            help_gamcompress(argv);
+            exit(1);
+            break;
+        default:
+            abort ();
+        }
+    }
+
+    if (xg_name.empty()) {
+        cerr << "error:[vg gamcompress] the graph the reads were aligned to must be given with -x" << endl;
+        return 1;
+    }
+    if (decompress && bin_quality) {
+        cerr << "error:[vg gamcompress] qualities can only be binned when compressing" << endl;
+        return 1;
+    }
+    if (optind >= argc) {
+        help_gamcompress(argv);
+        return 1;
+    }
+
+    xg::XG xg_index;
+    get_input_file(xg_name, [&](istream& in) {
+        xg_index.load(in);
+    });
+
+    try {
+        get_input_file(get_input_file_name(optind, argc, argv), [&](istream& in) {
+            if (multipath && decompress) {
+                convert_stream<CompactMultipathAlignment, MultipathAlignment>(in, [&](const CompactMultipathAlignment& compact) {
+                    return expand_multipath_alignment(compact, xg_index);
+                });
+            } else if (multipath) {
+                convert_stream<MultipathAlignment, CompactMultipathAlignment>(in, [&](const MultipathAlignment& multipath_aln) {
+                    return compact_multipath_alignment(multipath_aln, xg_index, bin_quality);
+                });
+            } else if (decompress) {
+                convert_stream<CompactAlignment, Alignment>(in, [&](const CompactAlignment& compact) {
+                    return expand_alignment(compact, xg_index);
+                });
+            } else {
+                convert_stream<Alignment, CompactAlignment>(in, [&](const Alignment& aln) {
+                    return compact_alignment(aln, xg_index, bin_quality);
+                });
+            }
+        });
+    } catch (const runtime_error& e) {
+        cerr << "error:[vg gamcompress] " << e.what() << endl;
+        return 1;
+    }
+
+    return 0;
+}
+
+// Register subcommand
+static Subcommand vg_gamcompress("gamcompress", "store alignments compactly against the graph", main_gamcompress);
@@ -1,5 +1,6 @@
 #include "../gamsorter.hpp"
 #include "../gam_index.hpp"
+#include "../gam_name_index.hpp"
 #include "../stream.hpp"
 #include <getopt.h>
 #include "subcommand.hpp"
@@ -19,9 +20,13 @@ void help_gamsort(char **argv)
          << "Options:" << endl
          << "  -s / --sorted           Input GAM is already sorted." << endl
          << "  -i / --index FILE       produce an index of the sorted GAM file" << endl
+         << "  -n / --name-index FILE  produce an index of the read names in the sorted GAM file" << endl
          << "  -d / --dumb-sort        use naive sorting algorithm (no tmp files, faster for small GAMs)" << endl
+         << "  -k / --key-sort         sort a seekable, BGZF-compressed GAM by reading only sort keys (no tmp files, low memory)" << endl
          << "  -r / --rocks DIR        Just use the old RocksDB-style indexing scheme for sorting, using the given database name." << endl
          << "  -a / --aln-index        Create the old RocksDB-style node-to-alignment index." << endl
+         << "  -m / --memory MB        hold about this many MB of reads in memory while sorting [2048]" << endl
+         << "  -f / --fan-in N         merge at most N temp files at a time [limited by open file limit]" << endl
          << "  -p / --progress         Show progress." << endl
          << "  -t / --threads          Use the specified number of threads." << endl
          << endl;
@@ -30,11 +35,15 @@ void help_gamsort(char **argv)
 int main_gamsort(int argc, char **argv)
 {
     string index_filename;
+    string name_index_filename;
     string rocksdb_filename;
     bool dumb_sort = false;
+    bool key_sort = false;
     bool is_sorted = false;
     bool do_aln_index = false;
     bool show_progress = false;
+    size_t memory_mb = 0;
+    size_t fan_in = 0;
     // We limit the max threads, and only allow thread count to be lowered, to
     // prevent tcmalloc from giving each thread a very large heap for many
     // threads.
@@ -47,15 +56,19 @@ int main_gamsort(int argc, char **argv)
         static struct option long_options[] =
             {
                 {"index", required_argument, 0, 'i'},
+                {"name-index", required_argument, 0, 'n'},
                 {"dumb-sort", no_argument, 0, 'd'},
+                {"key-sort", no_argument, 0, 'k'},
                 {"rocks", required_argument, 0, 'r'},
                 {"aln-index", no_argument, 0, 'a'},
                 {"is-sorted", no_argument, 0, 's'},
                 {"progress", no_argument, 0, 'p'},
                 {"threads", required_argument, 0, 't'},
+                {"memory", required_argument, 0, 'm'},
+                {"fan-in", required_argument, 0, 'f'},
                 {0, 0, 0, 0}};
         int option_index = 0;
-        c = getopt_long(argc, argv, "i:dhr:aspt:",
+        c = getopt_long(argc, argv, "i:n:dkhr:aspt:m:f:",
                         long_options, &option_index);
 
         // Detect the end of the options.
@@ -67,9 +80,15 @@ int main_gamsort(int argc, char **argv)
         case 'i':
             index_filename = optarg;
             break;
+        case 'n':
+            name_index_filename = optarg;
+            break;
         case 'd':
             dumb_sort = true;
             break;
+        case 'k':
+            key_sort = true;
+            break;
         case 's':
             is_sorted = true;
             break;
@@ -85,6 +104,12 @@ int main_gamsort(int argc, char **argv)
         case 't':
             num_threads = min(parse<size_t>(optarg), num_threads);
             break;
+        case 'm':
+            memory_mb = parse<size_t>(optarg);
+            break;
+        case 'f':
+            fan_in = parse<size_t>(optarg);
+            break;
         case 'h':
         case '?':
         default:
@@ -104,6 +129,12 @@ int main_gamsort(int argc, char **argv)
     get_input_file(optind, argc, argv, [&](istream& gam_in) {
 
         GAMSorter gs(show_progress);
+        if (memory_mb != 0) {
+            gs.set_memory_budget(memory_mb * 1024 * 1024);
+        }
+        if (fan_in != 0) {
+            gs.set_max_fan_in(fan_in);
+        }
 
         if (!rocksdb_filename.empty()) {
             // Do the sort the old way - write a big ol'
@@ -116,6 +147,12 @@ int main_gamsort(int argc, char **argv)
                 // Make a new-style GAM index also
                 index = unique_ptr<GAMIndex>(new GAMIndex());
             }
+            
+            unique_ptr<GAMNameIndex> names;
+            if (!name_index_filename.empty()) {
+                // And a read name index
+                names = unique_ptr<GAMNameIndex>(new GAMNameIndex());
+            }
 
             // Index the alignments in RocksDB
             rocks.open_for_bulk_load(rocksdb_filename);
@@ -125,22 +162,33 @@ int main_gamsort(int argc, char **argv)
             };
             stream::for_each_parallel(gam_in, lambda_reader);
             
-            // Set up the emitter
-            stream::ProtobufEmitter<Alignment> output(cout);
-            if (index.get() != nullptr) {
-                output.on_group([&index](const vector<Alignment>& group, int64_t start_vo, int64_t past_end_vo) {
-                    // If we are making a sorted GAM index, record the group.
-                    // The index will outlive the emitter so this is safe to call in the emitter's destructor.
-                    index->add_group(group, start_vo, past_end_vo);
-                });
+            {
+                // Set up the emitter
+                stream::ProtobufEmitter<Alignment> output(cout);
+                if (index.get() != nullptr) {
+                    output.on_group([&index](const vector<Alignment>& group, int64_t start_vo, int64_t past_end_vo) {
+                        // If we are making a sorted GAM index, record the group.
+                        // The index will outlive the emitter so this is safe to call in the emitter's destructor.
+                        index->add_group(group, start_vo, past_end_vo);
+                    });
+                }
+                if (names.get() != nullptr) {
+                    output.on_group([&names](const vector<Alignment>& group, int64_t start_vo, int64_t past_end_vo) {
+                        // Likewise for the read names
+                        names->add_group(group, start_vo, past_end_vo);
+                    });
+                }
+                
+                // Print them out again in order
+                auto lambda_writer = [&output](const Alignment& aln) {
+                    output.write_copy(aln);
+                };
+                rocks.for_each_alignment(lambda_writer);
+                
+                // The emitter indexes its last group as it is destroyed here,
+                // so the indexes can't be saved until afterward.
             }
             
-            // Print them out again in order
-            auto lambda_writer = [&output](const Alignment& aln) {
-                output.write_copy(aln);
-            };
-            rocks.for_each_alignment(lambda_writer);
-            
             rocks.flush();
             rocks.close();
             
@@ -150,6 +198,13 @@ int main_gamsort(int argc, char **argv)
                 index->save(index_out);
             }
             
+            if (names.get() != nullptr) {
+                // Sort the names and save them
+                names->finish();
+                ofstream names_out(name_index_filename);
+                names->save(names_out);
+            }
+            
         } else {
             // Do a normal GAMSorter sort
             unique_ptr<GAMIndex> index;
@@ -159,12 +214,21 @@ int main_gamsort(int argc, char **argv)
                 index = unique_ptr<GAMIndex>(new GAMIndex());
             }
             
+            unique_ptr<GAMNameIndex> names;
+            if (!name_index_filename.empty()) {
+                // And a read name index
+                names = unique_ptr<GAMNameIndex>(new GAMNameIndex());
+            }
+            
             if (dumb_sort) {
                 // Sort in a single pass in memory
-                gs.dumb_sort(gam_in, cout, index.get());
+                gs.dumb_sort(gam_in, cout, index.get(), names.get());
+            } else if (key_sort) {
+                // Sort by seeking around in the input, never parsing whole reads
+                gs.key_sort(gam_in, cout, index.get(), names.get());
             } else {
                 // Sort using fan-in-limited temp file merging 
-                gs.stream_sort(gam_in, cout, index.get());
+                gs.stream_sort(gam_in, cout, index.get(), names.get());
             }
             
             if (index.get() != nullptr) {
@@ -172,6 +236,13 @@ int main_gamsort(int argc, char **argv)
                 ofstream index_out(index_filename);
                 index->save(index_out);
             }
+            
+            if (names.get() != nullptr) {
+                // Sort the names and save them
+                names->finish();
+                ofstream names_out(name_index_filename);
+                names->save(names_out);
+            }
         }
     });
 
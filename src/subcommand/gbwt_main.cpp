@@ -9,6 +9,7 @@
 
 #include <list>
 #include <fstream>
+#include <thread>
 
 #include "subcommand.hpp"
 
@@ -147,17 +148,29 @@ int main_gbwt(int argc, char** argv)
 
         if(fast_merging)
         {
+            // Load all the inputs at once, then merge them in one pass.
             vector<gbwt::GBWT> indexes(argc - optind);
+#pragma omp parallel for schedule(dynamic, 1)
+            for(int i = optind; i < argc; i++)
+            {
+                sdsl::load_from_file(indexes[i - optind], string(argv[i]));
+            }
             for(int i = optind; i < argc; i++)
             {
-                string input_name = argv[i];
-                sdsl::load_from_file(indexes[i - optind], input_name);
                 if (show_progress) {
-                    gbwt::printStatistics(indexes[i - optind], input_name);
+                    gbwt::printStatistics(indexes[i - optind], argv[i]);
                 }
                 total_inserted += indexes[i - optind].size();
             }
+            if (show_progress) {
+                cout << "Loaded " << input_files << " inputs in " << (gbwt::readTimer() - start) << " seconds" << endl;
+            }
+            double merge_start = gbwt::readTimer();
             gbwt::GBWT merged(indexes);
+            indexes.clear();
+            if (show_progress) {
+                cout << "Merged in " << (gbwt::readTimer() - merge_start) << " seconds" << endl;
+            }
             sdsl::store_to_file(merged, gbwt_output);
             if (show_progress) {
                 gbwt::printStatistics(merged, gbwt_output);
@@ -166,6 +179,11 @@ int main_gbwt(int argc, char** argv)
         else
         {
             gbwt::DynamicGBWT index;
+            gbwt::GBWT next;
+            // Load the next input while the current one is being merged.
+            thread loader([&]() {
+                sdsl::load_from_file(next, string(argv[optind + 1]));
+            });
             {
                 string input_name = argv[optind];
                 sdsl::load_from_file(index, input_name);
@@ -176,13 +194,24 @@ int main_gbwt(int argc, char** argv)
             for (int curr = optind + 1; curr < argc; curr++)
             {
                 string input_name = argv[curr];
-                gbwt::GBWT next;
-                sdsl::load_from_file(next, input_name);
+                loader.join();
+                gbwt::GBWT current;
+                current.swap(next);
+                if (curr + 1 < argc) {
+                    loader = thread([&, curr]() {
+                        sdsl::load_from_file(next, string(argv[curr + 1]));
+                    });
+                }
+                if (show_progress) {
+                    gbwt::printStatistics(current, input_name);
+                }
+                double merge_start = gbwt::readTimer();
+                index.merge(current, batch_size);
+                total_inserted += current.size();
                 if (show_progress) {
-                    gbwt::printStatistics(next, input_name);
+                    cout << "Merged " << input_name << " in " << (gbwt::readTimer() - merge_start) << " seconds; memory usage "
+                         << gbwt::inGigabytes(gbwt::memoryUsage()) << " GB" << endl;
                 }
-                index.merge(next, batch_size);
-                total_inserted += next.size();
             }
             sdsl::store_to_file(index, gbwt_output);
             if (show_progress) { 
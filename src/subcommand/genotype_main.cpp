@@ -21,7 +21,8 @@ void help_genotype(char** argv) {
          << "options:" << endl
          << "    -j, --json              output in JSON" << endl
          << "    -v, --vcf               output in VCF" << endl
-         << "    -G, --gam   GAM         a GAM file to use with variant recall (or in place of index)" << endl
+         << "    -G, --gam   GAM         a GAM file to use with variant recall (or in place of index);" << endl
+         << "                            if GAM.gai exists, reads are looked up region by region" << endl
          << "    -V, --recall-vcf VCF    recall variants in a specific VCF file." << endl
          << "    -F, --fasta  FASTA" << endl
          << "    -I, --insertions INS" << endl
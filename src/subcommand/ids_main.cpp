@@ -14,6 +14,7 @@
 
 #include "../vg.hpp"
 #include "../vg_set.hpp"
+#include "../graph_stream_sorter.hpp"
 #include "../algorithms/topological_sort.hpp"
 
 #include <gcsa/support.h>
@@ -26,13 +27,17 @@ void help_ids(char** argv) {
     cerr << "usage: " << argv[0] << " ids [options] <graph1.vg> [graph2.vg ...] >new.vg" << endl
         << "options:" << endl
         << "    -c, --compact        minimize the space of integers used by the ids" << endl
+        << "                         (jointly across all the graphs given, written out as one)" << endl
         << "    -i, --increment N    increase ids by N" << endl
         << "    -d, --decrement N    decrease ids by N" << endl
         << "    -j, --join           make a joint id space for all the graphs that are supplied" << endl
         << "                         by iterating through the supplied graphs and incrementing" << endl
         << "                         their ids to be non-conflicting (modifies original files)" << endl
         << "    -m, --mapping FILE   create an empty node mapping for vg prune" << endl
-        << "    -s, --sort           assign new node IDs in (generalized) topological sort order" << endl;
+        << "    -s, --sort           assign new node IDs in (generalized) topological sort order" << endl
+        << "    -e, --external       with -s, sort by streaming over a graph file twice, holding only" << endl
+        << "                         its topology and one range of nodes in memory" << endl
+        << "    -p, --progress       show progress" << endl;
 }
 
 int main_ids(int argc, char** argv) {
@@ -45,6 +50,8 @@ int main_ids(int argc, char** argv) {
     bool join = false;
     bool compact = false;
     bool sort = false;
+    bool external = false;
+    bool show_progress = false;
     int64_t increment = 0;
     int64_t decrement = 0;
     std::string mapping_name;
@@ -60,12 +67,14 @@ int main_ids(int argc, char** argv) {
             {"join", no_argument, 0, 'j'},
             {"mapping", required_argument, 0, 'm'},
             {"sort", no_argument, 0, 's'},
+            {"external", no_argument, 0, 'e'},
+            {"progress", no_argument, 0, 'p'},
             {"help", no_argument, 0, 'h'},
             {0, 0, 0, 0}
         };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "hci:d:jm:s",
+        c = getopt_long (argc, argv, "hci:d:jm:sep",
                 long_options, &option_index);
 
         // Detect the end of the options.
@@ -98,6 +107,14 @@ int main_ids(int argc, char** argv) {
                 sort = true;
                 break;
 
+            case 'e':
+                external = true;
+                break;
+
+            case 'p':
+                show_progress = true;
+                break;
+
             case 'h':
             case '?':
                 help_ids(argv);
@@ -109,7 +126,43 @@ int main_ids(int argc, char** argv) {
         }
     }
 
-    if (!join && mapping_name.empty()) {
+    if (external) {
+        if (!sort || join || !mapping_name.empty()) {
+            cerr << "error:[vg ids]: --external only works with --sort" << endl;
+            return 1;
+        }
+        string file_name = get_input_file_name(optind, argc, argv);
+        if (file_name == "-") {
+            cerr << "error:[vg ids]: --external reads the graph twice, so it can't come from standard input" << endl;
+            return 1;
+        }
+        ifstream in(file_name, std::ios_base::binary);
+        if (!in) {
+            cerr << "error:[vg ids]: could not open " << file_name << endl;
+            return 1;
+        }
+        GraphStreamSorter sorter(show_progress);
+        sorter.sort_ids(in, std::cout, 1 + increment - decrement);
+    } else if (!join && mapping_name.empty() && !sort
+               && (!compact || (optind < argc && string(argv[optind]) != "-"))) {
+        // Compacting and shifting IDs only need a chunk of the graphs at a
+        // time, but compacting reads them twice, so they have to be files
+        vector<string> graph_file_names;
+        while (optind < argc) {
+            graph_file_names.push_back(get_input_file_name(optind, argc, argv));
+        }
+        VGset graphs(graph_file_names);
+        try {
+            if (compact) {
+                graphs.write_compacted(std::cout, 1 + increment - decrement);
+            } else {
+                graphs.write_incremented(std::cout, increment - decrement);
+            }
+        } catch (exception& e) {
+            cerr << "error:[vg ids]: " << e.what() << endl;
+            return 1;
+        }
+    } else if (!join && mapping_name.empty()) {
         VG* graph;
         get_input_file(optind, argc, argv, [&](istream& in) {
             graph = new VG(in);
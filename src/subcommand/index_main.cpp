@@ -4,7 +4,10 @@
 #include <unistd.h>
 #include <getopt.h>
 
+#include <exception>
+#include <memory>
 #include <random>
+#include <sstream>
 #include <string>
 #include <vector>
 
@@ -17,6 +20,7 @@
 #include "../vg_set.hpp"
 #include "../utility.hpp"
 #include "../region.hpp"
+#include "../gcsa_kmer_table.hpp"
 
 #include <gcsa/gcsa.h>
 #include <gcsa/algorithms.h>
@@ -37,6 +41,7 @@ void help_index(char** argv) {
          << "    -p, --progress         show progress" << endl
          << "xg options:" << endl
          << "    -x, --xg-name FILE     use this file to store a succinct, queryable version of the graph(s)" << endl
+         << "                           (graphs named *.gfa are imported from GFA)" << endl
          << "    -F, --thread-db FILE   read thread database from FILE (may repeat)" << endl
          << "gbwt options:" << endl
          << "    -v, --vcf-phasing FILE generate threads from the haplotypes in the VCF file FILE" << endl
@@ -61,8 +66,10 @@ void help_index(char** argv) {
          << "    -X, --doubling-steps N use this number of doubling steps for GCSA2 construction (default " << gcsa::ConstructionParameters::DOUBLING_STEPS << ")" << endl
          << "    -Z, --size-limit N     limit temporary disk space usage to N gigabytes (default " << gcsa::ConstructionParameters::SIZE_LIMIT << ")" << endl
          << "    -V, --verify-index     validate the GCSA2 index using the input kmers (important for testing)" << endl
+         << "    -K, --kmer-table N     also store the GCSA2 ranges of all N-mers in FILE.kmers, to speed up MEM search (N <= " << GCSAKmerTable::MAX_KMER_LENGTH << ", usually " << GCSAKmerTable::DEFAULT_KMER_LENGTH << ")" << endl
          << "gam indexing options:" << endl
          << "    -l, --index-sorted-gam input is sorted .gam format alignments, store a GAI index of the sorted GAM in INPUT.gam.gai" << endl
+         << "    --compact-gam          with -l, the sorted alignments are compact (from vg gamcompress)" << endl
          << "rocksdb options:" << endl
          << "    -d, --db-name  <X>     store the RocksDB index in <X>" << endl
          << "    -m, --store-mappings   input is .gam format, store the mappings in alignments by node" << endl
@@ -120,6 +127,68 @@ std::vector<std::string> parseGenotypes(const std::string& vcf_line, size_t num_
 void write_thread_db(const std::string& filename, const std::vector<std::string>& thread_names, size_t haplotype_count);
 void read_thread_db(const std::vector<std::string>& filenames, std::vector<std::string>& thread_names, size_t& haplotype_count);
 
+// Merge GBWTs of threads over different parts of the graph into one and write
+// it to filename. Returns the thread names in the order of the merged
+// sequences. If the parts cover disjoint node ranges, they are merged all at
+// once; otherwise they are inserted into the first one in turn.
+std::vector<std::string> merge_gbwt_parts(std::vector<gbwt::GBWT>& parts, std::vector<std::vector<std::string>>& part_names,
+                                          const std::string& filename, bool show_progress) {
+    double start = gbwt::readTimer();
+
+    // Visit the parts in node order, skipping empty ones.
+    std::vector<size_t> order;
+    for (size_t i = 0; i < parts.size(); i++) {
+        if (!parts[i].empty()) {
+            order.push_back(i);
+        }
+    }
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return parts[a].firstNode() < parts[b].firstNode();
+    });
+    bool disjoint = true;
+    for (size_t i = 1; i < order.size(); i++) {
+        if (parts[order[i - 1]].sigma() > parts[order[i]].firstNode()) {
+            disjoint = false;
+            break;
+        }
+    }
+
+    std::vector<std::string> thread_names;
+    for (size_t i : order) {
+        thread_names.insert(thread_names.end(), part_names[i].begin(), part_names[i].end());
+    }
+
+    if (order.empty()) {
+        gbwt::DynamicGBWT empty;
+        sdsl::store_to_file(empty, filename);
+    } else if (disjoint) {
+        std::vector<gbwt::GBWT> sources;
+        sources.reserve(order.size());
+        for (size_t i : order) {
+            sources.emplace_back();
+            sources.back().swap(parts[i]);
+        }
+        gbwt::GBWT merged(sources);
+        sources.clear();
+        sdsl::store_to_file(merged, filename);
+    } else {
+        gbwt::DynamicGBWT merged(parts[order.front()]);
+        for (size_t i = 1; i < order.size(); i++) {
+            merged.merge(parts[order[i]]);
+            gbwt::GBWT().swap(parts[order[i]]);
+        }
+        sdsl::store_to_file(merged, filename);
+    }
+
+    if (show_progress) {
+        cerr << "Merged " << order.size() << " partial GBWTs (" << (disjoint ? "fast" : "insert") << ") in "
+             << (gbwt::readTimer() - start) << " seconds; memory usage "
+             << gbwt::inGigabytes(gbwt::memoryUsage()) << " GB" << endl;
+    }
+
+    return thread_names;
+}
+
 int main_index(int argc, char** argv) {
 
     if (argc == 2) {
@@ -150,15 +219,16 @@ int main_index(int argc, char** argv) {
     map<string, string> path_to_vcf; // Path name conversion from --rename.
     map<string, pair<size_t, size_t>> regions; // Region restrictions for contigs, in VCF name space, as 0-based exclusive-end ranges.
     unordered_set<string> excluded_samples; // Excluded sample names from --exclude.
-    std::set<std::pair<gbwt::size_type, gbwt::size_type>> overlaps; // Unresolved overlaps in the haplotypes.
 
     // GCSA
     gcsa::size_type kmer_size = gcsa::Key::MAX_LENGTH;
     gcsa::ConstructionParameters params;
     bool verify_gcsa = false;
+    size_t kmer_table_length = 0;
     
     // Gam index (GAI)
     bool build_gam_index = false;
+    bool compact_gam = false;
 
     // RocksDB
     bool dump_index = false;
@@ -170,6 +240,8 @@ int main_index(int argc, char** argv) {
     // Unused?
     bool compact = false;
 
+    #define OPT_COMPACT_GAM 1000
+
     int c;
     optind = 2; // force optind past command positional argument
     while (true) {
@@ -207,9 +279,11 @@ int main_index(int argc, char** argv) {
             {"doubling-steps", required_argument, 0, 'X'},
             {"size-limit", required_argument, 0, 'Z'},
             {"verify-index", no_argument, 0, 'V'},
+            {"kmer-table", required_argument, 0, 'K'},
             
             // GAM index (GAI)
             {"index-sorted-gam", no_argument, 0, 'l'},
+            {"compact-gam", no_argument, 0, OPT_COMPACT_GAM},
 
             // RocksDB
             {"db-name", required_argument, 0, 'd'},
@@ -223,7 +297,7 @@ int main_index(int argc, char** argv) {
         };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "b:t:px:F:v:TM:G:H:PoOB:R:r:I:E:g:i:f:k:X:Z:Vld:maANDCh",
+        c = getopt_long (argc, argv, "b:t:px:F:v:TM:G:H:PoOB:R:r:I:E:g:i:f:k:X:Z:VK:ld:maANDCh",
                 long_options, &option_index);
 
         // Detect the end of the options.
@@ -359,11 +433,17 @@ int main_index(int argc, char** argv) {
         case 'V':
             verify_gcsa = true;
             break;
+        case 'K':
+            kmer_table_length = parse<size_t>(optarg);
+            break;
             
         // Gam index (GAI)
         case 'l':
             build_gam_index = true;
             break;
+        case OPT_COMPACT_GAM:
+            compact_gam = true;
+            break;
 
         // RocksDB
         case 'd':
@@ -430,6 +510,11 @@ int main_index(int argc, char** argv) {
         cerr << "error: [vg index] GCSA2 cannot index with kmer size greater than " << gcsa::Key::MAX_LENGTH << endl;
         return 1;
     }
+    
+    if (kmer_table_length > GCSAKmerTable::MAX_KMER_LENGTH) {
+        cerr << "error: [vg index] kmer table cannot have kmers longer than " << GCSAKmerTable::MAX_KMER_LENGTH << endl;
+        return 1;
+    }
 
     if ((build_gbwt || write_threads) && thread_db_names.size() > 1) {
         cerr << "error: [vg index] cannot use multiple thread database files with -G or -H" << endl;
@@ -495,8 +580,11 @@ int main_index(int argc, char** argv) {
         vector<xg::XG::thread_t> all_phase_threads; // Store all threads if building gPBWT.
         size_t haplotype_count = 0;
 
-        // Do we build GBWT?
+        // Do we build GBWT? Haplotypes are built in parts, to be merged at
+        // the end along with the names of their threads.
         gbwt::GBWTBuilder* gbwt_builder = 0;
+        vector<gbwt::GBWT> gbwt_parts;
+        vector<vector<string>> gbwt_part_names;
         if (build_gbwt) {
             if (show_progress) { cerr << "Building GBWT index" << endl; }
             gbwt::Verbosity::set(gbwt::Verbosity::SILENT);  // Make the construction thread silent.
@@ -528,8 +616,9 @@ int main_index(int argc, char** argv) {
             thread_names.push_back(thread_name);
         };
 
-        // Convert paths to threads
-        if (index_paths & !build_gpbwt) {
+        // Convert paths to threads. With haplotypes, each path is stored
+        // along with the haplotypes of its contig instead.
+        if (index_paths & !build_gpbwt & !index_haplotypes) {
             if (show_progress) {
                 cerr << "Converting paths to threads..." << endl;
             }
@@ -577,8 +666,6 @@ int main_index(int argc, char** argv) {
             } else if (show_progress) {
                 cerr << "Opened variant file " << vcf_name << endl;
             }
-            std::mt19937 rng(0xDEADBEEF);
-            std::uniform_int_distribution<std::mt19937::result_type> random_bit(0, 1);
 
             // How many samples are there?
             size_t num_samples = variant_file.sampleNames.size();
@@ -597,26 +684,73 @@ int main_index(int argc, char** argv) {
                 cerr << "Processing samples " << sample_range.first << " to " << (sample_range.second - 1) << " with batch size " << samples_in_batch << endl;
             }
 
-            // Process each VCF contig corresponding to an XG path.
+            // Process each VCF contig corresponding to an XG path, each on
+            // its own thread and into its own part of the GBWT.
             size_t max_path_rank = xg_index->max_path_rank();
+            if (index_paths & !build_gpbwt) {
+                haplotype_count++; // We assume that the XG index contains the reference paths.
+            }
+            struct ContigThreads {
+                gbwt::GBWT index;                     // The threads as GBWT, if building one.
+                vector<gbwt::vector_type> threads;    // The threads themselves, if we need them.
+                vector<string> names;                 // Thread names in insertion order.
+            };
+            vector<ContigThreads> contig_threads(max_path_rank);
+            std::exception_ptr contig_error;
+#pragma omp parallel for schedule(dynamic, 1)
             for (size_t path_rank = 1; path_rank <= max_path_rank; path_rank++) {
+              try {
+                double contig_start = gbwt::readTimer();
+                ContigThreads& contig = contig_threads[path_rank - 1];
+                stringstream progress;
                 string path_name = xg_index->path_name(path_rank);
-                string vcf_contig_name = path_to_vcf.count(path_name) ? path_to_vcf[path_name] : path_name;
+                string vcf_contig_name = path_to_vcf.count(path_name) ? path_to_vcf.at(path_name) : path_name;
                 if (show_progress) {
-                    cerr << "Processing path " << path_name << " as VCF contig " << vcf_contig_name << endl;
+                    progress << "Processing path " << path_name << " as VCF contig " << vcf_contig_name << endl;
+                }
+
+                // Each contig gets its own reader, RNG, and GBWT builder.
+                vcflib::VariantCallFile variant_file;
+                variant_file.parseSamples = false;
+                variant_file.open(vcf_name);
+                if (!variant_file.is_open()) {
+                    throw runtime_error("could not open " + vcf_name);
+                }
+                std::mt19937 rng(0xDEADBEEF + path_rank - 1);
+                std::uniform_int_distribution<std::mt19937::result_type> random_bit(0, 1);
+                std::set<std::pair<gbwt::size_type, gbwt::size_type>> overlaps; // Unresolved overlaps in the haplotypes.
+                unique_ptr<gbwt::GBWTBuilder> contig_builder;
+                if (build_gbwt) {
+                    contig_builder.reset(new gbwt::GBWTBuilder(id_width));
                 }
+                auto store_contig_thread = [&](const gbwt::vector_type& to_save, const std::string& thread_name) {
+                    if (build_gbwt) {
+                        contig_builder->insert(to_save, true); // Insert in both orientations.
+                    }
+                    if (write_threads || build_gpbwt) {
+                        contig.threads.push_back(to_save);
+                    }
+                    contig.names.push_back(thread_name);
+                };
 
                 // Structures to parse the VCF file into.
                 const xg::XGPath& path = xg_index->get_path(path_name);
                 gbwt::VariantPaths variants(path.ids.size());
                 std::vector<gbwt::PhasingInformation> phasings;
 
-                // Add the reference to VariantPaths.
+                // Add the reference to VariantPaths, and to the threads if we
+                // are indexing paths.
                 for (size_t i = 0; i < path.ids.size(); i++) {
                     variants.appendToReference(gbwt::Node::encode(path.node(i), path.is_reverse(i)));
                 }
                 variants.indexReference();
-
+                if (index_paths & !build_gpbwt && path.ids.size() != 0) {
+                    gbwt::vector_type buffer(path.ids.size());
+                    for (size_t i = 0; i < path.ids.size(); i++) {
+                        buffer[i] = gbwt::Node::encode(path.node(i), path.is_reverse(i));
+                    }
+                    store_contig_thread(buffer, path_name);
+                }
                 // Create a PhasingInformation for each batch.
                 for (size_t batch_start = sample_range.first; batch_start < sample_range.second; batch_start += samples_in_batch) {
                     phasings.emplace_back(batch_start, std::min(samples_in_batch, sample_range.second - batch_start));
@@ -624,9 +758,9 @@ int main_index(int argc, char** argv) {
 
                 // Set the VCF region or process the entire contig.
                 if (regions.count(vcf_contig_name)) {
-                    auto region = regions[vcf_contig_name];
+                    auto region = regions.at(vcf_contig_name);
                     if (show_progress) {
-                        cerr << "- Setting region " << region.first << " to " << region.second << endl;
+                        progress << "- Setting region " << region.first << " to " << region.second << endl;
                     }
                     variant_file.setRegion(vcf_contig_name, region.first, region.second);
                 } else {
@@ -662,7 +796,7 @@ int main_index(int argc, char** argv) {
                         ref_path = path_to_gbwt(ref_path_iter->second);
                         ref_pos = variants.firstOccurrence(ref_path.front());
                         if (ref_pos == variants.invalid_position()) {
-                            cerr << "warning: [vg index] Invalid ref path for " << var_name << " at "
+                            progress << "warning: [vg index] Invalid ref path for " << var_name << " at "
                                  << var.sequenceName << ":" << var.position << endl;
                             continue;
                         }
@@ -692,7 +826,7 @@ int main_index(int argc, char** argv) {
                             }
                         }
                         if (!found) {
-                            cerr << "warning: [vg index] Alt and ref paths for " << var_name
+                            progress << "warning: [vg index] Alt and ref paths for " << var_name
                                  << " at " << var.sequenceName << ":" << var.position
                                  << " missing/empty! Was the variant skipped during construction?" << endl;
                             continue;
@@ -730,28 +864,18 @@ int main_index(int argc, char** argv) {
                     variants_processed++;
                 } // End of variants.
                 if (show_progress) {
-                    cerr << "- Parsed " << variants_processed << " variants" << endl;
+                    progress << "- Parsed " << variants_processed << " variants" << endl;
                     size_t phasing_bytes = 0;
                     for (size_t batch = 0; batch < phasings.size(); batch++) {
                         phasing_bytes += phasings[batch].bytes();
                     }
-                    cerr << "- Phasing information: " << gbwt::inMegabytes(phasing_bytes) << " MB" << endl;
+                    progress << "- Phasing information: " << gbwt::inMegabytes(phasing_bytes) << " MB" << endl;
                 }
                 if (check_overlaps) {
-                    gbwt::checkOverlaps(variants, cerr, true);
+                    gbwt::checkOverlaps(variants, progress, true);
                 }
 
-                // Save memory:
-                // - Delete the alt paths if we no longer need them.
-                // - Delete the XG index if we no longer need it.
-                // - Close the phasings files.
-                if (path_rank == max_path_rank) {
-                    alt_paths.clear();
-                    if (xg_name.empty()) {
-                        delete xg_index;
-                        xg_index = nullptr;
-                    }
-                }
+                // Save memory by closing the phasings files.
                 for (size_t batch = 0; batch < phasings.size(); batch++) {
                     phasings[batch].close();
                 }
@@ -768,7 +892,7 @@ int main_index(int argc, char** argv) {
                                 << "_" << path_name
                                 << "_" << haplotype.phase
                                 << "_" << haplotype.count;
-                            store_thread(haplotype.path, sn.str());
+                            store_contig_thread(haplotype.path, sn.str());
                         },
                         [&](gbwt::size_type site, gbwt::size_type allele) -> bool {
                             if (check_overlaps) {
@@ -777,24 +901,106 @@ int main_index(int argc, char** argv) {
                             return discard_overlaps;
                         });
                     if (show_progress) {
-                        cerr << "- Processed samples " << phasings[batch].offset() << " to " << (phasings[batch].offset() + phasings[batch].size() - 1) << endl;
+                        progress << "- Processed samples " << phasings[batch].offset() << " to " << (phasings[batch].offset() + phasings[batch].size() - 1) << endl;
                     }
                 }
                 if (check_overlaps && !overlaps.empty()) {
-                    cerr << overlaps.size() << " unresolved overlaps:" << endl;
+                    progress << overlaps.size() << " unresolved overlaps:" << endl;
                     for (auto overlap : overlaps) {
-                        cerr << "- site " << overlap.first << ", allele " << overlap.second << endl;
+                        progress << "- site " << overlap.first << ", allele " << overlap.second << endl;
                     }
                     overlaps.clear();
                 }
+
+                if (build_gbwt) {
+                    contig_builder->finish();
+                    contig.index = gbwt::GBWT(contig_builder->index);
+                }
+                if (show_progress) {
+                    progress << "- Traced " << contig.names.size() << " threads in "
+                             << (gbwt::readTimer() - contig_start) << " seconds" << endl;
+                }
+                // Report progress and warnings for the contig all together.
+                string report = progress.str();
+                if (!report.empty()) {
+#pragma omp critical (cerr)
+                    cerr << report;
+                }
+              } catch (...) {
+#pragma omp critical (contig_error)
+                if (!contig_error) {
+                    contig_error = std::current_exception();
+                }
+              }
             } // End of contigs.
+            if (contig_error) {
+                try {
+                    std::rethrow_exception(contig_error);
+                } catch (const std::exception& e) {
+                    cerr << "error: [vg index] " << e.what() << endl;
+                    return 1;
+                }
+            }
+            if (show_progress) {
+                cerr << "Memory usage after tracing haplotypes: " << gbwt::inGigabytes(gbwt::memoryUsage()) << " GB" << endl;
+            }
+
+            // Save memory:
+            // - Delete the alt paths since we no longer need them.
+            // - Delete the XG index if we no longer need it.
+            alt_paths.clear();
+            if (xg_name.empty() && !build_gpbwt) {
+                delete xg_index;
+                xg_index = nullptr;
+            }
+
+            // Collect the threads we need one by one, in contig order.
+            for (auto& contig : contig_threads) {
+                if (write_threads) {
+                    for (auto& thread : contig.threads) {
+                        for (auto node : thread) { binary_file.push_back(node); }
+                        binary_file.push_back(gbwt::ENDMARKER);
+                    }
+                }
+                if (build_gpbwt) {
+                    for (auto& thread : contig.threads) {
+                        xg::XG::thread_t temp;
+                        temp.reserve(thread.size());
+                        for (auto node : thread) { temp.push_back(gbwt_to_thread_mapping(node)); }
+                        all_phase_threads.push_back(temp);
+                    }
+                }
+                contig.threads.clear();
+                if (!build_gbwt) {
+                    thread_names.insert(thread_names.end(), contig.names.begin(), contig.names.end());
+                }
+            }
+            if (build_gbwt) {
+                // The contigs' parts are merged with what we already stored.
+                gbwt_builder->finish();
+                gbwt_parts.emplace_back(gbwt_builder->index);
+                gbwt_part_names.emplace_back();
+                swap(gbwt_part_names.back(), thread_names);
+                delete gbwt_builder; gbwt_builder = nullptr;
+                for (auto& contig : contig_threads) {
+                    gbwt_parts.emplace_back();
+                    gbwt_parts.back().swap(contig.index);
+                    gbwt_part_names.emplace_back();
+                    swap(gbwt_part_names.back(), contig.names);
+                }
+            }
         } // End of haplotypes.
 
         // Store the thread database. Write it to disk if a filename is given,
         // or store it in the XG index if building gPBWT or if the XG index
         // will be written to disk.
         alt_paths.clear();
-        if (build_gbwt) {
+        if (build_gbwt && !gbwt_parts.empty()) {
+            if (show_progress) { cerr << "Merging and saving GBWT to disk..." << endl; }
+            thread_names = merge_gbwt_parts(gbwt_parts, gbwt_part_names, gbwt_name, show_progress);
+            gbwt_parts.clear();
+            gbwt_part_names.clear();
+        } else if (build_gbwt) {
             gbwt_builder->finish();
             if (show_progress) { cerr << "Saving GBWT to disk..." << endl; }
             sdsl::store_to_file(gbwt_builder->index, gbwt_name);
@@ -896,6 +1102,14 @@ int main_index(int argc, char** argv) {
         }
         sdsl::store_to_file(gcsa_index, gcsa_name);
         sdsl::store_to_file(lcp_array, gcsa_name + ".lcp");
+        if (kmer_table_length > 0) {
+            if (show_progress) {
+                cerr << "Building the table of " << kmer_table_length << "-mer ranges..." << endl;
+            }
+            GCSAKmerTable kmer_table(gcsa_index, lcp_array, min(kmer_table_length, (size_t) gcsa_index.order()));
+            ofstream kmer_table_out(gcsa_name + ".kmers");
+            kmer_table.serialize(kmer_table_out);
+        }
 
         // Verify the index
         if (verify_gcsa) {
@@ -920,12 +1134,15 @@ int main_index(int argc, char** argv) {
         GAMIndex index;
         
         get_input_file(file_names.at(0), [&](istream& in) {
-            // Grab the input GAM stream and wrap it in a cursor
-            stream::ProtobufIterator<Alignment> cursor(in);
-            
-            // Index the file
+            // Grab the input GAM stream and wrap it in a cursor, and index the file
             GAMIndex index;
-            index.index(cursor);
+            if (compact_gam) {
+                GAMIndex::compact_cursor_t cursor(in);
+                index.index(cursor);
+            } else {
+                GAMIndex::cursor_t cursor(in);
+                index.index(cursor);
+            }
  
             // Save the GAM index in the appropriate place.
             // TODO: Do we really like this enforced naming convention just beacuse samtools does it?
@@ -952,6 +1169,8 @@ int main_index(int argc, char** argv) {
 
         if (store_node_alignments && file_names.size() > 0) {
             index.open_for_bulk_load(rocksdb_name);
+            // write sorted SST files and ingest them, instead of going through the memtables
+            index.start_bulk_ingest();
             int64_t aln_idx = 0;
             function<void(Alignment&)> lambda = [&index,&aln_idx](Alignment& aln) {
                 index.cross_alignment(aln_idx++, aln);
@@ -961,12 +1180,14 @@ int main_index(int argc, char** argv) {
                     stream::for_each_parallel(in, lambda);
                 });
             }
+            index.finish_bulk_ingest();
             index.flush();
             index.close();
         }
 
         if (store_alignments && file_names.size() > 0) {
             index.open_for_bulk_load(rocksdb_name);
+            index.start_bulk_ingest();
             function<void(Alignment&)> lambda = [&index](Alignment& aln) {
                 index.put_alignment(aln);
             };
@@ -975,6 +1196,7 @@ int main_index(int argc, char** argv) {
                     stream::for_each_parallel(in, lambda);
                 });
             }
+            index.finish_bulk_ingest();
             index.flush();
             index.close();
         }
@@ -993,6 +1215,7 @@ int main_index(int argc, char** argv) {
 
         if (store_mappings && file_names.size() > 0) {
             index.open_for_bulk_load(rocksdb_name);
+            index.start_bulk_ingest();
             function<void(Alignment&)> lambda = [&index](Alignment& aln) {
                 const Path& path = aln.path();
                 for (int i = 0; i < path.mapping_size(); ++i) {
@@ -1004,6 +1227,7 @@ int main_index(int argc, char** argv) {
                     stream::for_each_parallel(in, lambda);
                 });
             }
+            index.finish_bulk_ingest();
             index.flush();
             index.close();
         }
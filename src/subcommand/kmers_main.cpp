@@ -9,6 +9,7 @@
 #include <getopt.h>
 
 #include <iostream>
+#include <memory>
 
 #include "subcommand.hpp"
 
@@ -38,6 +39,7 @@ void help_kmers(char** argv) {
          << "    -B, --gcsa-binary     Write the GCSA graph in binary format." << endl
          << "    -F, --forward-only    When producing GCSA2 output, don't describe the reverse strand" << endl
          << "    -P, --path-only       Only consider kmers if they occur in a path embedded in the graph" << endl
+         << "    -G, --gbwt-name FILE  only consider kmers along the haplotypes in this GBWT index" << endl
          << "    -H, --head-id N       use the specified ID for the GCSA2 head sentinel node" << endl
          << "    -T, --tail-id N       use the specified ID for the GCSA2 tail sentinel node" << endl
          << "    -p, --progress        show progress" << endl;
@@ -64,6 +66,7 @@ int main_kmers(int argc, char** argv) {
     bool forward_only = false;
     bool gcsa_binary = false;
     bool handle_alg = false;
+    string gbwt_name;
 
     int c;
     optind = 2; // force optind past command positional argument
@@ -85,11 +88,12 @@ int main_kmers(int argc, char** argv) {
             {"forward-only", no_argument, 0, 'F'},
             {"gcsa-binary", no_argument, 0, 'B'},
             {"path-only", no_argument, 0, 'P'},
+            {"gbwt-name", required_argument, 0, 'G'},
             {0, 0, 0, 0}
         };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "hk:j:pt:e:gdnH:T:FBP",
+        c = getopt_long (argc, argv, "hk:j:pt:e:gdnH:T:FBPG:",
                 long_options, &option_index);
 
         // Detect the end of the options.
@@ -152,6 +156,10 @@ int main_kmers(int argc, char** argv) {
                 gcsa_binary = true;
                 break;
 
+            case 'G':
+                gbwt_name = optarg;
+                break;
+
             case 'h':
             case '?':
                 help_kmers(argv);
@@ -172,6 +180,19 @@ int main_kmers(int argc, char** argv) {
     VGset graphs(graph_file_names);
 
     graphs.show_progress = show_progress;
+    
+    // Load the haplotypes, if we are only following them
+    unique_ptr<gbwt::GBWT> haplotypes;
+    if (!gbwt_name.empty()) {
+        ifstream in(gbwt_name);
+        if (!in) {
+            cerr << "error:[vg kmers] unable to load gbwt index file " << gbwt_name << endl;
+            exit(1);
+        }
+        haplotypes = unique_ptr<gbwt::GBWT>(new gbwt::GBWT());
+        haplotypes->load(in);
+        graphs.haplotypes = haplotypes.get();
+    }
 
     if (gcsa_out) {
         if (edge_max != 0) {
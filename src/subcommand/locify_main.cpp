@@ -9,6 +9,10 @@
 #include <getopt.h>
 
 #include <iostream>
+#include <algorithm>
+#include <iterator>
+#include <limits>
+#include <unordered_map>
 
 #include "subcommand.hpp"
 
@@ -24,18 +28,21 @@ using namespace vg::subcommand;
 void help_locify(char** argv){
     cerr << "usage: " << argv[0] << " locify [options] " << endl
          << "    -l, --loci FILE      input loci over which to locify the alignments" << endl
-         << "    -a, --aln-idx DIR    use this rocksdb alignment index (from vg index -N)" << endl
+         << "    -g, --gam-idx DIR    use this rocksdb alignment index (from vg index -N)" << endl
+         << "    -G, --gam FILE       stream the alignments from this GAM instead (- for stdin)" << endl
          << "    -x, --xg-idx FILE    use this xg index" << endl
          << "    -n, --name-alleles   generate names for each allele rather than using full Paths" << endl
          << "    -f, --forwardize     flip alignments on the reverse strand to the forward" << endl
          << "    -s, --sorted-loci FILE  write the non-nested loci out in their sorted order" << endl
          << "    -b, --n-best N       keep only the N-best alleles by alignment support" << endl
-         << "    -o, --out-loci FILE  rewrite the loci with only N-best alleles kept" << endl;
+         << "    -o, --out-loci FILE  rewrite the loci with only N-best alleles kept" << endl
+         << "    -t, --threads N      number of threads to use" << endl;
         // TODO -- add some basic filters that are useful downstream in whatshap
 }
 
 int main_locify(int argc, char** argv){
     string gam_idx_name;
+    string gam_name;
     string loci_file;
     Index gam_idx;
     string xg_idx_name;
@@ -56,6 +63,7 @@ int main_locify(int argc, char** argv){
         {
             {"help", no_argument, 0, 'h'},
             {"gam-idx", required_argument, 0, 'g'},
+            {"gam", required_argument, 0, 'G'},
             {"loci", required_argument, 0, 'l'},
             {"xg-idx", required_argument, 0, 'x'},
             {"name-alleles", no_argument, 0, 'n'},
@@ -63,11 +71,12 @@ int main_locify(int argc, char** argv){
             {"sorted-loci", required_argument, 0, 's'},
             {"loci-out", required_argument, 0, 'o'},
             {"n-best", required_argument, 0, 'b'},
+            {"threads", required_argument, 0, 't'},
             {0, 0, 0, 0}
         };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "hl:x:g:nfo:b:s:",
+        c = getopt_long (argc, argv, "hl:x:g:G:nfo:b:s:t:",
                 long_options, &option_index);
 
         // Detect the end of the options.
@@ -80,6 +89,10 @@ int main_locify(int argc, char** argv){
             gam_idx_name = optarg;
             break;
 
+        case 'G':
+            gam_name = optarg;
+            break;
+
         case 'l':
             loci_file = optarg;
             break;
@@ -109,6 +122,10 @@ int main_locify(int argc, char** argv){
             name_alleles = true;
             break;
 
+        case 't':
+            omp_set_num_threads(parse<int>(optarg));
+            break;
+
         case 'h':
         case '?':
             help_locify(argv);
@@ -120,6 +137,11 @@ int main_locify(int argc, char** argv){
         }
     }
 
+    if (!gam_idx_name.empty() && !gam_name.empty()) {
+        cerr << "[vg locify] Error: alignments can come from a RocksDB index (-g) or a GAM (-G), but not both" << endl;
+        return 1;
+    }
+
     if (!gam_idx_name.empty()) {
         gam_idx.open_read_only(gam_idx_name);
     }
@@ -131,136 +153,269 @@ int main_locify(int argc, char** argv){
     ifstream xgstream(xg_idx_name);
     xg::XG xgidx(xgstream);
 
-    std::function<vector<string>(string, char)> strsplit = [&](string x, char delim){
+    // Load all the loci. Each distinct allele of a locus gets a number, from
+    // 1, in the order the alleles first appear, so alleles can be named and
+    // counted compactly.
+    vector<Locus> loci;
+    // Where each locus's alleles start in the flat per-allele tables
+    vector<size_t> allele_start {0};
+    // The number of each allele of each locus
+    vector<int> allele_number;
+    if (!loci_file.empty()){
+        ifstream ifi(loci_file);
+        std::function<void(Locus&)> add_locus = [&](Locus& l){
+            map<string, int> numbers;
+            for (int i = 0; i < l.allele_size(); ++i) {
+                string s;
+                l.allele(i).SerializeToString(&s);
+                auto f = numbers.find(s);
+                if (f == numbers.end()) {
+                    int next_number = numbers.size() + 1;
+                    f = numbers.emplace(s, next_number).first;
+                }
+                allele_number.push_back(f->second);
+            }
+            allele_start.push_back(allele_number.size());
+            loci.emplace_back(std::move(l));
+        };
+        stream::for_each(ifi, add_locus);
+    } else {
+        cerr << "[vg locify] Warning: empty locus file given, could not annotate alignments with loci." << endl;
+    }
 
-        vector<string> ret;
-        stringstream ss;
-        std::string tok;
-        while (getline(ss, tok, delim)){
-            ret.push_back(tok);
+    // Get the distinct nodes each locus's alleles visit
+    auto nodes_of = [](const Locus& l) {
+        vector<vg::id_t> nodes;
+        for (int i = 0; i < l.allele_size(); ++i) {
+            for (auto& mapping : l.allele(i).mapping()) {
+                nodes.push_back(mapping.position().node_id());
+            }
         }
-        return ret;
-
+        sort(nodes.begin(), nodes.end());
+        nodes.erase(unique(nodes.begin(), nodes.end()), nodes.end());
+        return nodes;
     };
 
-    vector<string> locus_names;
-    map<string, map<string, int > > locus_allele_names;
-    map<string, Alignment> alignments_with_loci;
-    map<pos_t, set<string> > pos_to_loci;
-    map<string, set<pos_t> > locus_to_pos;
-    map<string, map<int, int> > locus_allele_support;
-    map<string, vector<int> > locus_to_best_n_alleles;
-    map<string, set<int> > locus_to_keep;
-    int count = 0;
-
-    std::function<void(Locus&)> lambda = [&](Locus& l){
-        locus_names.push_back(l.name());
-        set<vg::id_t> nodes_in_locus;
-        for (int i = 0; i < l.allele_size(); ++i) {
-            auto& allele = l.allele(i);
-            for (int j = 0; j < allele.mapping_size(); ++j) {
-                auto& position = allele.mapping(j).position();
-                nodes_in_locus.insert(position.node_id());
+    // Build a dense map from each node in the range the loci cover to the
+    // loci that visit it: node_loci[node_offsets[id - min_locus_node]] and on.
+    vg::id_t min_locus_node = numeric_limits<vg::id_t>::max();
+    vg::id_t max_locus_node = numeric_limits<vg::id_t>::min();
+    for (auto& l : loci) {
+        for (auto& id : nodes_of(l)) {
+            min_locus_node = min(min_locus_node, id);
+            max_locus_node = max(max_locus_node, id);
+        }
+    }
+    vector<uint32_t> node_offsets;
+    vector<uint32_t> node_loci;
+    if (min_locus_node <= max_locus_node) {
+        node_offsets.resize(max_locus_node - min_locus_node + 2, 0);
+        size_t total = 0;
+        for (auto& l : loci) {
+            for (auto& id : nodes_of(l)) {
+                node_offsets[id - min_locus_node + 1]++;
+                total++;
+            }
+        }
+        if (total > numeric_limits<uint32_t>::max()) {
+            cerr << "[vg locify] Error: too many locus visits to nodes to index" << endl;
+            return 1;
+        }
+        for (size_t i = 1; i < node_offsets.size(); i++) {
+            node_offsets[i] += node_offsets[i - 1];
+        }
+        node_loci.resize(total);
+        vector<uint32_t> filled(node_offsets.begin(), node_offsets.end() - 1);
+        for (size_t i = 0; i < loci.size(); i++) {
+            for (auto& id : nodes_of(loci[i])) {
+                node_loci[filled[id - min_locus_node]++] = i;
             }
-            // for position in mapping
-            map<pos_t, int> ref_positions;
-            map<pos_t, Edit> edits;
-            decompose(allele, ref_positions, edits);
-            // warning: uses only reference positions!!!
-            for (auto& pos : ref_positions) {
-                pos_to_loci[pos.first].insert(l.name());
-                locus_to_pos[l.name()].insert(pos.first);
+        }
+    }
+
+    // Every thread annotates its own alignments, and counts its own allele
+    // support, all of which are merged at the end.
+    int thread_count = get_thread_count();
+    vector<vector<Alignment>> thread_alignments(thread_count);
+    vector<vector<uint32_t>> thread_support(thread_count);
+
+    // Annotate an alignment with the best-matching allele of each locus it
+    // touches, in the order of the loci in the file, if it touches any.
+    auto annotate = [&](const Alignment& a) {
+        vector<uint32_t> touched;
+        for (auto& mapping : a.path().mapping()) {
+            vg::id_t id = mapping.position().node_id();
+            if (id < min_locus_node || id > max_locus_node) {
+                continue;
             }
+            touched.insert(touched.end(), node_loci.begin() + node_offsets[id - min_locus_node],
+                           node_loci.begin() + node_offsets[id - min_locus_node + 1]);
         }
-        // void for_alignment_in_range(int64_t id1, int64_t id2, std::function<void(const Alignment&)> lambda);
-        std::function<void(const Alignment&)> fill_alns = [&](const Alignment& a){
+        if (touched.empty()) {
+            return;
+        }
+        sort(touched.begin(), touched.end());
+        touched.erase(unique(touched.begin(), touched.end()), touched.end());
+
+        int tid = omp_get_thread_num();
+        thread_alignments[tid].push_back(a);
+        Alignment& aln = thread_alignments[tid].back();
+        for (auto& i : touched) {
             // TODO reverse complementing alleles ?
             // overlap is stranded
-            //matching
-            // find the most-matching allele
-            map<double, vector<int> > matches;
-            for (int i = 0; i < l.allele_size(); ++i) {
-                auto& allele = l.allele(i);
-                matches[overlap(a.path(), allele)].push_back(i);
-            }
+            // find the most-matching allele, taking the first of any ties
+            auto& l = loci[i];
             assert(l.allele_size());
-            int best = matches.rbegin()->second.front();
-            Locus matching;
-            matching.set_name(l.name());
-            if (name_alleles) {
-                //map<string, map<string, int > > locus_allele_names;
-                auto& allele = l.allele(best);
-                string s;
-                allele.SerializeToString(&s);
-                auto& l_names = locus_allele_names[l.name()];
-                auto f = l_names.find(s);
-                int name_int = 0;
-                if (f == l_names.end()) {
-                    int next_id = l_names.size() + 1;
-                    l_names[s] = next_id;
-                    name_int = next_id;
-                } else {
-                    name_int = f->second;
+            int best = 0;
+            double best_overlap = overlap(a.path(), l.allele(0));
+            for (int j = 1; j < l.allele_size(); ++j) {
+                double allele_overlap = overlap(a.path(), l.allele(j));
+                if (allele_overlap > best_overlap) {
+                    best = j;
+                    best_overlap = allele_overlap;
                 }
-                string allele_name = vg::convert(name_int);
-                Path p;
-                p.set_name(allele_name);
-                *matching.add_allele() = p;
+            }
+            Locus* matching = aln.add_locus();
+            matching->set_name(l.name());
+            if (name_alleles) {
+                int number = allele_number[allele_start[i] + best];
+                matching->add_allele()->set_name(vg::convert(number));
                 if (n_best) {
                     // record support for this allele
                     // we'll use to filter the locus records later
-                    locus_allele_support[l.name()][name_int]++;
+                    auto& support = thread_support[tid];
+                    if (support.empty()) {
+                        support.resize(allele_number.size(), 0);
+                    }
+                    support[allele_start[i] + number - 1]++;
                 }
             } else {
-                *matching.add_allele() = l.allele(best);
+                *matching->add_allele() = l.allele(best);
                 // TODO get quality score relative to this specific allele / alignment
                 // record in the alignment we'll save
             }
-            if (alignments_with_loci.find(a.name()) == alignments_with_loci.end()) {
-                alignments_with_loci[a.name()] = a;
+        }
+    };
+
+    if (!gam_name.empty()) {
+        // Stream the alignments and annotate them in parallel
+        get_input_file(gam_name, [&](istream& in) {
+            std::function<void(Alignment&)> lambda = [&](Alignment& a) {
+                annotate(a);
+            };
+            stream::for_each_parallel(in, lambda);
+        });
+    } else if (!gam_idx_name.empty() && !node_offsets.empty()) {
+        // Get the alignments touching loci from the index in one query, and
+        // annotate them in parallel a batch at a time
+        vector<vg::id_t> nodes;
+        for (size_t i = 0; i + 1 < node_offsets.size(); i++) {
+            if (node_offsets[i] != node_offsets[i + 1]) {
+                nodes.push_back(min_locus_node + i);
+            }
+        }
+        vector<Alignment> batch;
+        auto annotate_batch = [&]() {
+#pragma omp parallel for schedule(dynamic, 64)
+            for (size_t i = 0; i < batch.size(); i++) {
+                annotate(batch[i]);
             }
-            Alignment& aln = alignments_with_loci[a.name()];
-            *aln.add_locus() = matching;
+            batch.clear();
         };
-        vector<vg::id_t> nodes_vec;
-        for (auto& id : nodes_in_locus) nodes_vec.push_back(id);
-        gam_idx.for_alignment_to_nodes(nodes_vec, fill_alns);
-    };
+        gam_idx.for_alignment_to_nodes(nodes, [&](const Alignment& a) {
+            batch.push_back(a);
+            if (batch.size() >= 10000) {
+                annotate_batch();
+            }
+        });
+        annotate_batch();
+    }
 
-    if (!loci_file.empty()){
-        ifstream ifi(loci_file);
-        stream::for_each(ifi, lambda);
-    } else {
-        cerr << "[vg locify] Warning: empty locus file given, could not annotate alignments with loci." << endl;
+    // Merge the alignments from all the threads, combining the loci of any
+    // with the same name, as the first one with the name.
+    vector<Alignment> alignments_with_loci;
+    for (auto& alignments : thread_alignments) {
+        std::move(alignments.begin(), alignments.end(), back_inserter(alignments_with_loci));
+        vector<Alignment>().swap(alignments);
     }
+    stable_sort(alignments_with_loci.begin(), alignments_with_loci.end(), [](const Alignment& a, const Alignment& b) {
+        return a.name() < b.name();
+    });
+    size_t kept_alignments = 0;
+    for (size_t i = 0; i < alignments_with_loci.size(); i++) {
+        if (kept_alignments > 0 && alignments_with_loci[kept_alignments - 1].name() == alignments_with_loci[i].name()) {
+            auto& into = alignments_with_loci[kept_alignments - 1];
+            for (auto& l : *alignments_with_loci[i].mutable_locus()) {
+                into.add_locus()->Swap(&l);
+            }
+        } else {
+            if (kept_alignments != i) {
+                alignments_with_loci[kept_alignments].Swap(&alignments_with_loci[i]);
+            }
+            kept_alignments++;
+        }
+    }
+    alignments_with_loci.resize(kept_alignments);
 
-    // find the non-nested loci
+    // find the non-nested loci, by the reference positions of their alleles
     vector<string> non_nested_loci;
-    for (auto& name : locus_names) {
-        // is it nested?
-        auto& positions = locus_to_pos[name];
-        int min_loci = 0;
-        for (auto& pos : positions) {
-            auto& loci = pos_to_loci[pos];
-            min_loci = (min_loci == 0 ? (int)loci.size() : min(min_loci, (int)loci.size()));
+    if (!sorted_loci.empty()) {
+        vector<set<pos_t>> locus_to_pos(loci.size());
+        map<pos_t, int> pos_locus_count;
+        for (size_t i = 0; i < loci.size(); i++) {
+            for (auto& allele : loci[i].allele()) {
+                map<pos_t, int> ref_positions;
+                map<pos_t, Edit> edits;
+                decompose(allele, ref_positions, edits);
+                // warning: uses only reference positions!!!
+                for (auto& pos : ref_positions) {
+                    if (locus_to_pos[i].insert(pos.first).second) {
+                        pos_locus_count[pos.first]++;
+                    }
+                }
+            }
         }
-        if (min_loci == 1) {
-            // not fully contained in any other locus
-            non_nested_loci.push_back(name);
+        vector<size_t> non_nested;
+        for (size_t i = 0; i < loci.size(); i++) {
+            // is it nested?
+            int min_loci = 0;
+            for (auto& pos : locus_to_pos[i]) {
+                int loci_here = pos_locus_count[pos];
+                min_loci = (min_loci == 0 ? loci_here : min(min_loci, loci_here));
+            }
+            if (min_loci == 1) {
+                // not fully contained in any other locus
+                non_nested.push_back(i);
+            }
+        }
+        // sort them using... ? ids?
+        stable_sort(non_nested.begin(), non_nested.end(), [&locus_to_pos](size_t a, size_t b) {
+            return *locus_to_pos[a].begin() < *locus_to_pos[b].begin();
+        });
+        for (auto& i : non_nested) {
+            non_nested_loci.push_back(loci[i].name());
         }
     }
 
     // filter out the non-best alleles
+    vector<set<int>> locus_to_keep(n_best ? loci.size() : 0);
     if (n_best) {
+        // add up the support from all the threads
+        vector<uint32_t> support(allele_number.size(), 0);
+        for (auto& counts : thread_support) {
+            for (size_t j = 0; j < counts.size(); j++) {
+                support[j] += counts[j];
+            }
+        }
         // find the n-best
-        for (auto& supp : locus_allele_support) {
-            auto& name = supp.first;
-            auto& alleles = supp.second;
-            map<int, int> ranked;
-            for (auto& allele : alleles) {
-                ranked[allele.second] = allele.first;
+        for (size_t i = 0; i < loci.size(); i++) {
+            map<uint32_t, int> ranked;
+            for (size_t j = allele_start[i]; j < allele_start[i + 1]; j++) {
+                if (support[j]) {
+                    ranked[support[j]] = j - allele_start[i] + 1;
+                }
             }
-            auto& to_keep = locus_to_keep[name];
+            auto& to_keep = locus_to_keep[i];
             for (auto r = ranked.rbegin(); r != ranked.rend(); ++r) {
                 to_keep.insert(r->second);
                 if (to_keep.size() == n_best) {
@@ -269,12 +424,15 @@ int main_locify(int argc, char** argv){
             }
         }
         // filter out non-n-best from the alignments
-        for (auto& a : alignments_with_loci) {
-            auto& aln = a.second;
+        unordered_map<string, size_t> locus_index;
+        for (size_t i = 0; i < loci.size(); i++) {
+            locus_index[loci[i].name()] = i;
+        }
+        for (auto& aln : alignments_with_loci) {
             vector<Locus> kept;
             for (int i = 0; i < aln.locus_size(); ++i) {
                 auto& allele = aln.locus(i).allele(0);
-                if (locus_to_keep[aln.locus(i).name()].count(atoi(allele.name().c_str()))) {
+                if (locus_to_keep[locus_index[aln.locus(i).name()]].count(atoi(allele.name().c_str()))) {
                     kept.push_back(aln.locus(i));
                 }
             }
@@ -290,19 +448,16 @@ int main_locify(int argc, char** argv){
         if (!loci_file.empty()){
             ofstream outloci(loci_out);
             vector<Locus> buffer;
-            std::function<void(Locus&)> lambda = [&](Locus& l){
+            for (size_t i = 0; i < loci.size(); i++) {
                 // remove the alleles which are to filter
-                //map<string, map<string, int > > locus_allele_names;
-                auto& allele_names = locus_allele_names[l.name()];
-                auto& to_keep = locus_to_keep[l.name()];
+                auto& l = loci[i];
+                auto& to_keep = locus_to_keep[i];
                 vector<Path> alleles_to_keep;
-                for (int i = 0; i < l.allele_size(); ++i) {
-                    auto allele = l.allele(i);
-                    string s; allele.SerializeToString(&s);
-                    auto& name = allele_names[s];
-                    if (to_keep.count(name)) {
-                        allele.set_name(vg::convert(name));
-                        alleles_to_keep.push_back(allele);
+                for (int j = 0; j < l.allele_size(); ++j) {
+                    int number = allele_number[allele_start[i] + j];
+                    if (to_keep.count(number)) {
+                        alleles_to_keep.push_back(l.allele(j));
+                        alleles_to_keep.back().set_name(vg::convert(number));
                     }
                 }
                 l.clear_allele();
@@ -311,9 +466,7 @@ int main_locify(int argc, char** argv){
                 }
                 buffer.push_back(l);
                 stream::write_buffered(outloci, buffer, 100);
-            };
-            ifstream ifi(loci_file);
-            stream::for_each(ifi, lambda);
+            }
             stream::write_buffered(outloci, buffer, 0);
             outloci.close();
         } else {
@@ -321,12 +474,6 @@ int main_locify(int argc, char** argv){
         }
     }
 
-    // sort them using... ? ids?
-    sort(non_nested_loci.begin(), non_nested_loci.end(),
-         [&locus_to_pos](const string& s1, const string& s2) {
-             return *locus_to_pos[s1].begin() < *locus_to_pos[s2].begin();
-         });
-
     if (!sorted_loci.empty()) {
         ofstream outsorted(sorted_loci);
         for (auto& name : non_nested_loci) {
@@ -339,14 +486,14 @@ int main_locify(int argc, char** argv){
     for (auto& aln : alignments_with_loci) {
         // TODO order the loci by their order in the alignments
         if (forwardize) {
-            if (aln.second.path().mapping_size() && aln.second.path().mapping(0).position().is_reverse()) {
-                output_buf.push_back(reverse_complement_alignment(aln.second,
+            if (aln.path().mapping_size() && aln.path().mapping(0).position().is_reverse()) {
+                output_buf.push_back(reverse_complement_alignment(aln,
                                                                   [&xgidx](int64_t id) { return xgidx.node_length(id); }));
             } else {
-                output_buf.push_back(aln.second);
+                output_buf.push_back(std::move(aln));
             }
         } else {
-            output_buf.push_back(aln.second);
+            output_buf.push_back(std::move(aln));
         }
         stream::write_buffered(cout, output_buf, 100);
     }
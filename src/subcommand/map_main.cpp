@@ -4,6 +4,12 @@
 #include "../mapper.hpp"
 #include "../surjector.hpp"
 #include "../stream.hpp"
+#include "../stage_profile.hpp"
+#include "../gam_columns.hpp"
+#include "../resident_indexes.hpp"
+#include "../numa.hpp"
+#include "../huge_pages.hpp"
+#include "../remote_file.hpp"
 
 #include <unistd.h>
 #include <getopt.h>
@@ -20,12 +26,20 @@ void help_map(char** argv) {
          << "    -x, --xg-name FILE            use this xg index (defaults to <graph>.vg.xg)" << endl
          << "    -g, --gcsa-name FILE          use this GCSA2 index (defaults to <graph>" << gcsa::GCSA::EXTENSION << ")" << endl
          << "    -1, --gbwt-name FILE          use this GBWT haplotype index (defaults to <graph>"<<gbwt::GBWT::EXTENSION << ")" << endl
+         << "    --minimizer-name FILE         seed from this minimizer index (see vg minimizer) instead of GCSA2," << endl
+         << "                                  which is then not loaded" << endl
+         << "    --haplotype-filter            drop MEM hits spanning nodes along walks no GBWT haplotype follows" << endl
          << "algorithm:" << endl
          << "    -t, --threads N               number of compute threads to use" << endl
+         << "    --numa-interleave             spread the pages of the indexes across all NUMA nodes as they are loaded" << endl
+         << "    --pin-threads                 pin each thread to its own CPU, alternating between NUMA nodes" << endl
+         << "    --huge-pages                  back the loaded indexes with transparent huge pages, and report how much is" << endl
+         << "                                  in huge pages to stderr" << endl
          << "    -k, --min-mem INT             minimum MEM length (if 0 estimate via -e) [0]" << endl
          << "    -e, --mem-chance FLOAT        set {-k} such that this fraction of {-k} length hits will by chance [5e-4]" << endl
          << "    -c, --hit-max N               ignore MEMs who have >N hits in our index (0 for no limit) [2048]" << endl
          << "    -Y, --max-mem INT             ignore mems longer than this length (unset if 0) [0]" << endl
+         << "    --low-complexity-window INT   ignore repetitive MEMs at least half in low-complexity windows of this size [off]" << endl
          << "    -r, --reseed-x FLOAT          look for internal seeds inside a seed longer than FLOAT*--min-seed [1.5]" << endl
          << "    -u, --try-up-to INT           attempt to align up to the INT best candidate chains of seeds (1/2 for paired) [128]" << endl
          << "    -l, --try-at-least INT        attempt to align at least the INT best candidate chains of seeds [1]" << endl
@@ -53,6 +67,12 @@ void help_map(char** argv) {
          << "    --no-patch-aln                do not patch banded alignments by locally aligning unaligned regions" << endl
          << "    --xdrop-alignment             use X-drop heuristic (much faster for long-read alignment)" << endl
          << "    --max-gap-length              maximum gap length allowed in each contiguous alignment (for X-drop alignment) [40]" << endl
+         << "    --xdrop-extend                with --xdrop-alignment, extend each cluster's longest MEM directly through the" << endl
+         << "                                  graph, instead of aligning to the cluster's extracted subgraph" << endl
+         << "    --prune-clusters              align clusters best score bound first, and skip the rest once they can't beat the" << endl
+         << "                                  kept alignments or change the mapping quality" << endl
+         << "    --ungapped-mismatches INT     build alignments for clusters whose MEMs chain along one walk with at most INT" << endl
+         << "                                  mismatches directly, without dynamic programming [off]" << endl
          << "scoring:" << endl
          << "    -q, --match INT               use this match score [1]" << endl
          << "    -z, --mismatch INT            use this mismatch penalty [4]" << endl
@@ -84,7 +104,23 @@ void help_map(char** argv) {
          << "    -K, --keep-secondary          produce alignments for secondary input alignments in addition to primary ones" << endl
          << "    -M, --max-multimaps INT       produce up to INT alignments for each read [1]" << endl
          << "    -Q, --mq-max INT              cap the mapping quality at INT [60]" << endl
-         << "    -D, --debug                   print debugging information about alignment to stderr" << endl;
+         << "    -D, --debug                   print debugging information about alignment to stderr" << endl
+         << "    --profile FILE                write a JSON report of the time spent in and work done by each mapping stage to FILE" << endl
+         << "                                  (with a histogram of the time taken by each read)" << endl
+         << "    --slow-reads FILE             write reads that take at least --slow-read-ms to map to FILE as GAM, annotated with" << endl
+         << "                                  the time and work of each stage of mapping them" << endl
+         << "    --slow-read-ms INT            reads taking at least INT milliseconds are slow [100]" << endl
+         << "    --columns FILE                also write the scores, mapping qualities, and reference positions of the output" << endl
+         << "                                  GAM to FILE as column blocks, one per GAM group (see vg view -O)" << endl
+         << "    --locate-cache INT            cache the hit positions of up to INT repetitive GCSA2 ranges, shared by all threads [0]" << endl
+         << "    --locate-warm FILE            fill the locate cache with the hits of the kmers in FILE, one per line, before mapping" << endl
+         << "                                  (the cache's hit rate is reported to stderr with --profile)" << endl
+         << "    --cluster-graph-cache INT     reuse the subgraphs of up to INT MEM clusters for reads with the same anchors," << endl
+         << "                                  shared by all threads, for deep targeted data [0]" << endl
+         << "    --duplicate-cache INT         reuse the alignments of up to INT distinct unpaired reads for later reads with the" << endl
+         << "                                  same sequence and qualities, shared by all threads, for amplicon data [0]" << endl
+         << "    --path-positions NAMES        index node positions on the comma-separated paths, or \"all\", up front and report" << endl
+         << "                                  only those paths in refpos annotations and pair consistency checks" << endl;
 
 }
 
@@ -97,7 +133,36 @@ int main_map(int argc, char** argv) {
 
     #define OPT_SCORE_MATRIX 1000
     #define OPT_RECOMBINATION_PENALTY 1001
+    #define OPT_PROFILE 1002
+    #define OPT_COLUMNS 1003
+    #define OPT_LOCATE_CACHE 1004
+    #define OPT_LOCATE_WARM 1005
+    #define OPT_PATH_POSITIONS 1006
+    #define OPT_PRUNE_CLUSTERS 1007
+    #define OPT_UNGAPPED_MISMATCHES 1008
+    #define OPT_LOW_COMPLEXITY_WINDOW 1009
+    #define OPT_NUMA_INTERLEAVE 1010
+    #define OPT_PIN_THREADS 1011
+    #define OPT_HUGE_PAGES 1012
+    #define OPT_CLUSTER_GRAPH_CACHE 1013
+    #define OPT_XDROP_EXTEND 1014
+    #define OPT_MINIMIZER_NAME 1015
+    #define OPT_HAPLOTYPE_FILTER 1016
+    #define OPT_DUPLICATE_CACHE 1017
+    #define OPT_SLOW_READS 1018
+    #define OPT_SLOW_READ_MS 1019
     string matrix_file_name;
+    string profile_name;
+    string slow_reads_name;
+    size_t slow_read_ms = 100;
+    string columns_name;
+    size_t locate_cache_size = 0;
+    size_t cluster_graph_cache_size = 0;
+    size_t duplicate_cache_size = 0;
+    string locate_warm_name;
+    string path_positions_names;
+    string minimizer_name;
+    bool haplotype_filter = false;
     string seq;
     string qual;
     string seq_name;
@@ -173,6 +238,13 @@ int main_map(int argc, char** argv) {
     int min_banded_mq = 0;
     int max_sub_mem_recursion_depth = 2;
     bool xdrop_alignment = false;
+    bool xdrop_extend = false;
+    bool prune_clusters = false;
+    int max_ungapped_mismatches = -1;
+    size_t low_complexity_window = 0;
+    bool numa_interleave = false;
+    bool pin_threads = false;
+    bool huge_pages = false;
     uint32_t max_gap_length = 40;
 
     int c;
@@ -248,6 +320,24 @@ int main_map(int argc, char** argv) {
                 {"unpaired-cost", required_argument, 0, 'S'},
                 {"max-gap-length", required_argument, 0, 1},
                 {"xdrop-alignment", no_argument, 0, 2},
+                {"xdrop-extend", no_argument, 0, OPT_XDROP_EXTEND},
+                {"profile", required_argument, 0, OPT_PROFILE},
+                {"slow-reads", required_argument, 0, OPT_SLOW_READS},
+                {"slow-read-ms", required_argument, 0, OPT_SLOW_READ_MS},
+                {"columns", required_argument, 0, OPT_COLUMNS},
+                {"locate-cache", required_argument, 0, OPT_LOCATE_CACHE},
+                {"locate-warm", required_argument, 0, OPT_LOCATE_WARM},
+                {"cluster-graph-cache", required_argument, 0, OPT_CLUSTER_GRAPH_CACHE},
+                {"duplicate-cache", required_argument, 0, OPT_DUPLICATE_CACHE},
+                {"path-positions", required_argument, 0, OPT_PATH_POSITIONS},
+                {"minimizer-name", required_argument, 0, OPT_MINIMIZER_NAME},
+                {"haplotype-filter", no_argument, 0, OPT_HAPLOTYPE_FILTER},
+                {"prune-clusters", no_argument, 0, OPT_PRUNE_CLUSTERS},
+                {"ungapped-mismatches", required_argument, 0, OPT_UNGAPPED_MISMATCHES},
+                {"low-complexity-window", required_argument, 0, OPT_LOW_COMPLEXITY_WINDOW},
+                {"numa-interleave", no_argument, 0, OPT_NUMA_INTERLEAVE},
+                {"pin-threads", no_argument, 0, OPT_PIN_THREADS},
+                {"huge-pages", no_argument, 0, OPT_HUGE_PAGES},
                 {0, 0, 0, 0}
             };
 
@@ -538,6 +628,78 @@ int main_map(int argc, char** argv) {
             xdrop_alignment = true;
             break;
 
+        case OPT_XDROP_EXTEND:
+            xdrop_extend = true;
+            break;
+
+        case OPT_PROFILE:
+            profile_name = optarg;
+            break;
+
+        case OPT_SLOW_READS:
+            slow_reads_name = optarg;
+            break;
+
+        case OPT_SLOW_READ_MS:
+            slow_read_ms = parse<size_t>(optarg);
+            break;
+
+        case OPT_COLUMNS:
+            columns_name = optarg;
+            break;
+
+        case OPT_LOCATE_CACHE:
+            locate_cache_size = parse<size_t>(optarg);
+            break;
+
+        case OPT_CLUSTER_GRAPH_CACHE:
+            cluster_graph_cache_size = parse<size_t>(optarg);
+            break;
+
+        case OPT_DUPLICATE_CACHE:
+            duplicate_cache_size = parse<size_t>(optarg);
+            break;
+
+        case OPT_LOCATE_WARM:
+            locate_warm_name = optarg;
+            break;
+
+        case OPT_PATH_POSITIONS:
+            path_positions_names = optarg;
+            break;
+
+        case OPT_MINIMIZER_NAME:
+            minimizer_name = optarg;
+            break;
+
+        case OPT_HAPLOTYPE_FILTER:
+            haplotype_filter = true;
+            break;
+
+        case OPT_PRUNE_CLUSTERS:
+            prune_clusters = true;
+            break;
+
+        case OPT_UNGAPPED_MISMATCHES:
+            max_ungapped_mismatches = parse<int>(optarg);
+            break;
+
+        case OPT_LOW_COMPLEXITY_WINDOW:
+            low_complexity_window = parse<size_t>(optarg);
+            break;
+
+        case OPT_NUMA_INTERLEAVE:
+            numa_interleave = true;
+            break;
+
+        case OPT_PIN_THREADS:
+            pin_threads = true;
+            break;
+
+        case OPT_HUGE_PAGES:
+            huge_pages = true;
+            break;
+
         case 'h':
         case '?':
             /* getopt_long already printed an error message. */
@@ -557,6 +719,16 @@ int main_map(int argc, char** argv) {
         return 1;
     }
 
+    if (!columns_name.empty() && (output_json || refpos_table || !surject_type.empty())) {
+        cerr << "error:[vg map] Columns can only be written alongside GAM output." << endl;
+        return 1;
+    }
+
+    if (xdrop_extend && !xdrop_alignment) {
+        cerr << "error:[vg map] --xdrop-extend only applies to X-drop alignment (--xdrop-alignment)." << endl;
+        return 1;
+    }
+
     if (!qual.empty() && (seq.length() != qual.length())) {
         cerr << "error:[vg map] Sequence and base quality string must be the same length." << endl;
         return 1;
@@ -615,10 +787,34 @@ int main_map(int argc, char** argv) {
     // One of them may be used to provide haplotype scores
     haplo::ScoreProvider* haplo_score_provider = nullptr;
 
-    // We try opening the file, and then see if it worked
-    ifstream xg_stream(xg_name);
+    // A vg server we were forked from may already have some of them loaded.
+    // We don't own those.
+    ResidentIndexes& resident = ResidentIndexes::get();
+    xgidx = resident.xg(xg_name);
+    gcsa = resident.gcsa(gcsa_name);
+    lcp = resident.lcp(gcsa_name);
+    gbwt = resident.gbwt(gbwt_name);
+    bool xg_resident = xgidx != nullptr;
+    bool gcsa_resident = gcsa != nullptr;
+    bool lcp_resident = lcp != nullptr;
+    bool gbwt_resident = gbwt != nullptr;
+
+    // The indexes are read by every thread, so if asked we spread them over
+    // all the sockets instead of leaving them next to just the loading one.
+    unique_ptr<NUMAInterleaveScope> numa_interleave_scope;
+    if (numa_interleave) {
+        numa_interleave_scope.reset(new NUMAInterleaveScope());
+        if (debug && !numa_interleave_scope->active()) {
+            cerr << "Not interleaving indexes: only one NUMA node is available" << endl;
+        }
+    }
+
+    // We try opening the file, and then see if it worked. Indexes in object
+    // storage are fetched over a connection per thread.
+    size_t fetch_parts = get_thread_count();
+    unique_ptr<istream> xg_stream = open_input_file(xg_name, fetch_parts);
 
-    if(xg_stream) {
+    if(!xgidx && *xg_stream) {
         // We have an xg index!
         
         // TODO: tell when the user asked for an XG vs. when we guessed one,
@@ -626,42 +822,145 @@ int main_map(int argc, char** argv) {
         if(debug) {
             cerr << "Loading xg index " << xg_name << "..." << endl;
         }
-        xgidx = new xg::XG(xg_stream);
+        xgidx = new xg::XG();
+        if (is_remote_file(xg_name)) {
+            // There's no local file to map
+            xgidx->load(*xg_stream);
+        } else {
+            xgidx->load_mapped(xg_name);
+        }
         
         // TODO: Support haplo::XGScoreProvider?
     }
 
-    ifstream gcsa_stream(gcsa_name);
-    if(gcsa_stream) {
+    // A minimizer index replaces the GCSA2 index and everything that goes with it
+    unique_ptr<MinimizerIndex> minimizer_index;
+    if (!minimizer_name.empty()) {
+        if(debug) {
+            cerr << "Loading minimizer index " << minimizer_name << "..." << endl;
+        }
+        minimizer_index.reset(new MinimizerIndex());
+        try {
+            minimizer_index->load(minimizer_name);
+        } catch (const runtime_error& e) {
+            cerr << "error:[vg map] " << e.what() << endl;
+            exit(1);
+        }
+    }
+
+    unique_ptr<istream> gcsa_stream = open_input_file(gcsa_name, fetch_parts);
+    if(!gcsa && !minimizer_index && *gcsa_stream) {
         // We have a GCSA index too!
         if(debug) {
             cerr << "Loading GCSA2 index " << gcsa_name << "..." << endl;
         }
         gcsa = new gcsa::GCSA();
-        gcsa->load(gcsa_stream);
+        gcsa->load(*gcsa_stream);
     }
 
     string lcp_name = gcsa_name + ".lcp";
-    ifstream lcp_stream(lcp_name);
-    if (lcp_stream) {
+    unique_ptr<istream> lcp_stream = open_input_file(lcp_name, fetch_parts);
+    if (!lcp && !minimizer_index && *lcp_stream) {
         if(debug) {
             cerr << "Loading LCP index " << gcsa_name << "..." << endl;
         }
         lcp = new gcsa::LCPArray();
-        lcp->load(lcp_stream);
+        lcp->load(*lcp_stream);
+    }
+    
+    // If the kmer table is there, we use it to speed up MEM finding
+    // A resident GCSA2 index comes with its table, if it has one.
+    GCSAKmerTable* kmer_table = resident.kmer_table(gcsa_name);
+    bool kmer_table_resident = kmer_table != nullptr;
+    unique_ptr<istream> kmer_table_stream = open_input_file(gcsa_name + ".kmers", fetch_parts);
+    if (!kmer_table && !gcsa_resident && !minimizer_index && *kmer_table_stream) {
+        if(debug) {
+            cerr << "Loading kmer table " << gcsa_name << ".kmers..." << endl;
+        }
+        kmer_table = new GCSAKmerTable();
+        kmer_table->load(*kmer_table_stream);
     }
     
-    ifstream gbwt_stream(gbwt_name);
-    if(gbwt_stream) {
+    // All the threads share one cache of the hits of repetitive MEMs
+    unique_ptr<GCSALocateCache> locate_cache;
+    if (gcsa && locate_cache_size > 0) {
+        locate_cache.reset(new GCSALocateCache(*gcsa, locate_cache_size));
+        if (!locate_warm_name.empty()) {
+            ifstream warm_stream(locate_warm_name);
+            if (!warm_stream) {
+                cerr << "error:[vg map] Cannot open kmer file " << locate_warm_name << endl;
+                exit(1);
+            }
+            vector<string> kmers;
+            string kmer;
+            while (getline(warm_stream, kmer)) {
+                if (!kmer.empty()) {
+                    kmers.push_back(kmer);
+                }
+            }
+            size_t warmed = locate_cache->warm(kmers, hit_max);
+            if(debug) {
+                cerr << "Cached hits for " << warmed << " of " << kmers.size() << " kmers" << endl;
+            }
+        }
+    }
+    
+    // All the threads share one cache of the subgraphs clusters are aligned to
+    unique_ptr<ClusterGraphCache> cluster_graph_cache;
+    if (cluster_graph_cache_size > 0) {
+        cluster_graph_cache.reset(new ClusterGraphCache(cluster_graph_cache_size));
+    }
+    // And one cache of the alignments of reads already mapped
+    unique_ptr<DuplicateReadCache> duplicate_cache;
+    if (duplicate_cache_size > 0) {
+        duplicate_cache.reset(new DuplicateReadCache(duplicate_cache_size));
+    }
+    
+    // All the threads share one index of where the nodes are on the paths
+    unique_ptr<PathPositionIndex> path_positions;
+    if (xgidx && !path_positions_names.empty()) {
+        vector<string> names;
+        if (path_positions_names != "all") {
+            names = split_delims(path_positions_names, ",");
+        }
+        try {
+            path_positions.reset(new PathPositionIndex(*xgidx, names));
+        } catch (const runtime_error& e) {
+            cerr << "error:[vg map] " << e.what() << endl;
+            exit(1);
+        }
+        if(debug) {
+            cerr << "Indexed node positions on " << path_positions->path_count() << " paths, "
+                 << path_positions->multiple_occurrence_count() << " nodes occur more than once" << endl;
+        }
+    }
+    
+    unique_ptr<istream> gbwt_stream = open_input_file(gbwt_name, fetch_parts);
+    if(!gbwt && *gbwt_stream) {
         // We have a GBWT index too!
         if(debug) {
             cerr << "Loading GBWT haplotype index " << gbwt_name << "..." << endl;
         }
         gbwt = new gbwt::GBWT();
-        gbwt->load(gbwt_stream);
-        
+        gbwt->load(*gbwt_stream);
+    }
+    if (gbwt) {
         // We want to use this for haplotype scoring
         haplo_score_provider = new haplo::GBWTScoreProvider<gbwt::GBWT>(*gbwt);
+    } else if (haplotype_filter) {
+        cerr << "error:[vg map] --haplotype-filter requires a GBWT haplotype index (-1)" << endl;
+        return 1;
+    }
+    // Per-thread state should stay local to the thread that uses it
+    numa_interleave_scope.reset();
+
+    if (huge_pages) {
+        // Random access into big succinct structures is dominated by TLB
+        // misses, which huge pages cut down
+        advise_huge_pages();
+        HugePageUsage usage = huge_page_usage();
+        cerr << "[vg map] " << usage.huge_page_bytes / (1024 * 1024) << " of "
+             << usage.anonymous_bytes / (1024 * 1024) << " MB of anonymous memory is in huge pages" << endl;
     }
 
     ifstream matrix_stream;
@@ -674,12 +973,31 @@ int main_map(int argc, char** argv) {
     }
 
     thread_count = get_thread_count();
+    if (pin_threads) {
+        size_t pinned = pin_omp_threads();
+        if (debug) {
+            cerr << "Pinned " << pinned << " of " << thread_count << " threads across "
+                 << numa_node_count() << " NUMA nodes" << endl;
+        }
+    }
 
     vector<Mapper*> mapper;
     mapper.resize(thread_count);
     vector<vector<Alignment> > output_buffer;
     output_buffer.resize(thread_count);
     vector<Alignment> empty_alns;
+
+    // If we want columns, they get written a buffer at a time along with the GAM.
+    ofstream columns_out;
+    unique_ptr<GAMColumnWriter> columns_writer;
+    if (!columns_name.empty()) {
+        columns_out.open(columns_name);
+        if (!columns_out) {
+            cerr << "error:[vg map] Cannot write columns file " << columns_name << endl;
+            return 1;
+        }
+        columns_writer.reset(new GAMColumnWriter(columns_out));
+    }
     
     // If we need to do surjection
     Surjector surjector(xgidx);
@@ -709,7 +1027,7 @@ int main_map(int argc, char** argv) {
     }
 
     // for SAM header generation
-    auto setup_sam_header = [&hdr, &sam_out, &surject_type, &compress_level, &xgidx, &rg_sample, &sam_header] (void) {
+    auto setup_sam_header = [&hdr, &sam_out, &surject_type, &compress_level, &xgidx, &rg_sample, &sam_header, &thread_count] (void) {
 #pragma omp critical (hts_header)
         if (!hdr) {
             char out_mode[5];
@@ -735,6 +1053,10 @@ int main_map(int argc, char** argv) {
                 cerr << "[vg map] failed to open stdout for writing HTS output" << endl;
                 exit(1);
             } else {
+                if (!out_format.empty()) {
+                    // compress BAM/CRAM on htslib's own threads
+                    hts_set_threads(sam_out, thread_count);
+                }
                 // write the header
                 if (sam_hdr_write(sam_out, hdr) != 0) {
                     cerr << "[vg map] error: failed to write the SAM header" << endl;
@@ -793,7 +1115,7 @@ int main_map(int argc, char** argv) {
                     path_len = xgidx->path_length(path_name);
                 }
                 string cigar = cigar_against_path(surj, path_reverse, path_pos, path_len, 0);
-                bam1_t* b = alignment_to_bam(sam_header,
+                bam1_t* b = alignment_to_bam(hdr,
                                              surj,
                                              path_name,
                                              path_pos,
@@ -843,7 +1165,7 @@ int main_map(int argc, char** argv) {
                 int template_length = 0;
                 
                 // Make BAM records
-                bam1_t* b1 = alignment_to_bam(sam_header,
+                bam1_t* b1 = alignment_to_bam(hdr,
                                               surj1,
                                               path_name1,
                                               path_pos1,
@@ -852,7 +1174,7 @@ int main_map(int argc, char** argv) {
                                               path_name2,
                                               path_pos2,
                                               template_length);
-                bam1_t* b2 = alignment_to_bam(sam_header,
+                bam1_t* b2 = alignment_to_bam(hdr,
                                               surj2,
                                               path_name2,
                                               path_pos2,
@@ -879,10 +1201,10 @@ int main_map(int argc, char** argv) {
         }
     };
 
-    auto write_json = [](const vector<Alignment>& alns) {
+    auto write_json = [](ostream& out, const vector<Alignment>& alns) {
         for(auto& alignment : alns) {
             string json = pb2json(alignment);
-            cout << json << "\n";
+            out << json << "\n";
         }
     };
 
@@ -900,9 +1222,17 @@ int main_map(int argc, char** argv) {
         }
     };
 
+    // GAM and JSON go to a writer thread, so mapping threads don't wait on each other to write
+    unique_ptr<stream::OutputQueue> output_queue;
+    if (output_json || (!refpos_table && surject_type.empty())) {
+        output_queue.reset(new stream::OutputQueue(cout));
+    }
+
     // We have one function to dump alignments into
     // Make sure to flush the buffer at the end of the program!
     auto output_alignments = [&output_buffer,
+                              &output_queue,
+                              &columns_writer,
                               &output_json,
                               &surject_type,
                               &surject_alignments,
@@ -911,12 +1241,11 @@ int main_map(int argc, char** argv) {
                               &write_json,
                               &write_refpos](const vector<Alignment>& alns1, const vector<Alignment>& alns2) {
         if (output_json) {
-            // If we want to convert to JSON, convert them all to JSON and dump them to cout.
-#pragma omp critical (cout)
-            {
-                write_json(alns1);
-                write_json(alns2);
-            }
+            // If we want to convert to JSON, convert them all to JSON and queue them for cout.
+            stringstream json;
+            write_json(json, alns1);
+            write_json(json, alns2);
+            output_queue->push(json.str());
         } else if (refpos_table) {
             // keep multi alignments ordered appropriately
 #pragma omp critical (cout)
@@ -936,22 +1265,47 @@ int main_map(int argc, char** argv) {
             copy(alns1.begin(), alns1.end(), back_inserter(output_buf));
             copy(alns2.begin(), alns2.end(), back_inserter(output_buf));
 
-            stream::write_buffered(cout, output_buf, buffer_size);
+            if (columns_writer && output_buf.size() >= buffer_size) {
+                // This buffer is about to go out as a GAM group
+                columns_writer->write_group(output_buf);
+            }
+            if (output_buf.size() >= buffer_size) {
+                output_queue->push(stream::serialize_group(output_buf));
+                output_buf.clear();
+            }
         }
     };
 
     for (int i = 0; i < thread_count; ++i) {
         Mapper* m = nullptr;
-        if(xgidx && gcsa && lcp) {
+        if(xgidx && minimizer_index) {
+            // We have the xg and a minimizer index, so seed from that
+            m = new Mapper(xgidx, nullptr, nullptr, haplo_score_provider);
+            m->set_minimizer_index(minimizer_index.get());
+            m->set_cluster_graph_cache(cluster_graph_cache.get());
+            m->set_path_position_index(path_positions.get());
+        } else if(xgidx && gcsa && lcp) {
             // We have the xg and GCSA indexes, so use them
             m = new Mapper(xgidx, gcsa, lcp, haplo_score_provider);
+            m->set_gcsa_kmer_table(kmer_table);
+            m->set_locate_cache(locate_cache.get());
+            m->set_cluster_graph_cache(cluster_graph_cache.get());
+            m->set_path_position_index(path_positions.get());
         } else {
             // Can't continue with null
-            throw runtime_error("Need XG, GCSA, and LCP to create a Mapper");
+            throw runtime_error("Need XG, and GCSA and LCP or a minimizer index, to create a Mapper");
+        }
+        if (haplotype_filter) {
+            m->set_haplotype_filter(gbwt);
         }
+        m->set_duplicate_read_cache(duplicate_cache.get());
         m->hit_max = hit_max;
         m->max_multimaps = max_multimaps;
         m->min_multimaps = max(min_multimaps, max_multimaps);
+        m->prune_clusters_by_score_bound = prune_clusters;
+        m->max_ungapped_mismatches = max_ungapped_mismatches;
+        m->xdrop_extend_in_graph = xdrop_extend;
+        m->low_complexity_window = low_complexity_window;
         m->band_multimaps = band_multimaps;
         m->min_banded_mq = min_banded_mq;
         m->maybe_mq_threshold = maybe_mq_threshold;
@@ -1000,6 +1354,27 @@ int main_map(int argc, char** argv) {
         mapper[i] = m;
     }
 
+    ofstream profile_out;
+    if (!profile_name.empty()) {
+        profile_out.open(profile_name);
+        if (!profile_out) {
+            cerr << "error:[vg map] Cannot write profile file " << profile_name << endl;
+            exit(1);
+        }
+        stage_profile::enable();
+        stage_profile::record_peak_rss("indexes_loaded");
+    }
+    ofstream slow_reads_out;
+    if (!slow_reads_name.empty()) {
+        slow_reads_out.open(slow_reads_name);
+        if (!slow_reads_out) {
+            cerr << "error:[vg map] Cannot write slow reads file " << slow_reads_name << endl;
+            exit(1);
+        }
+        stage_profile::save_slow_reads(slow_reads_out, slow_read_ms * 1000000);
+        stage_profile::enable();
+    }
+
     if (!seq.empty()) {
         int tid = omp_get_thread_num();
 
@@ -1188,7 +1563,7 @@ int main_map(int argc, char** argv) {
             }
         } else if (fastq2.empty()) {
             // single
-            function<void(Alignment&)> lambda =
+            function<void(vector<Alignment>&)> lambda =
                 [&mapper,
                  &output_alignments,
                  &kmer_size,
@@ -1198,14 +1573,16 @@ int main_map(int argc, char** argv) {
                  &band_overlap,
                  &empty_alns,
                  &xdrop_alignment]
-                    (Alignment& alignment) {
+                    (vector<Alignment>& batch) {
 
                         int tid = omp_get_thread_num();
-                        vector<Alignment> alignments = mapper[tid]->align_multi(alignment, kmer_size, kmer_stride, max_mem_length, band_width, band_overlap, xdrop_alignment);
-                        //cerr << "This is just before output_alignments" << alignment.DebugString() << endl;
-                        output_alignments(alignments, empty_alns);
+                        // Map the whole batch together, so duplicate reads are only mapped once
+                        auto batch_alignments = mapper[tid]->align_multi_batch(batch, kmer_size, kmer_stride, max_mem_length, band_width, band_overlap, xdrop_alignment);
+                        for (auto& alignments : batch_alignments) {
+                            output_alignments(alignments, empty_alns);
+                        }
                     };
-            fastq_unpaired_for_each_parallel(fastq1, lambda);
+            fastq_unpaired_for_each_batch_parallel(fastq1, lambda);
         } else {
             // paired two-file
             auto output_func = [&output_alignments,
@@ -1276,7 +1653,7 @@ int main_map(int argc, char** argv) {
     }
 
     if (!gam_input.empty()) {
-        ifstream gam_in(gam_input);
+        unique_ptr<istream> gam_in = open_input_file(gam_input, get_thread_count());
         if (interleaved_input) {
             auto output_func = [&output_alignments,
                                 &compare_gam,
@@ -1334,7 +1711,7 @@ int main_map(int argc, char** argv) {
                     }
                 }
             };
-            stream::for_each_interleaved_pair_parallel(gam_in, lambda);
+            stream::for_each_interleaved_pair_parallel(*gam_in, lambda);
 #pragma omp parallel
             {
                 auto our_mapper = mapper[omp_get_thread_num()];
@@ -1376,9 +1753,9 @@ int main_map(int argc, char** argv) {
                 }
                 output_alignments(alignments, empty_alns);
             };
-            stream::for_each_parallel(gam_in, lambda);
+            stream::for_each_parallel(*gam_in, lambda);
         }
-        gam_in.close();
+        gam_in.reset();
     }
 
     if (print_fragment_model) {
@@ -1395,7 +1772,43 @@ int main_map(int argc, char** argv) {
         delete mapper[i];
         auto& output_buf = output_buffer[i];
         if (!output_json && !refpos_table && surject_type.empty()) {
-            stream::write_buffered(cout, output_buf, 0);
+            if (columns_writer) {
+                columns_writer->write_group(output_buf);
+            }
+            if (!output_buf.empty()) {
+                output_queue->push(stream::serialize_group(output_buf));
+            }
+        }
+    }
+    if (output_queue) {
+        output_queue->close();
+        if (!output_json) {
+            stream::finish(cout);
+        }
+    }
+    // Finish the columns file
+    columns_writer.reset();
+
+    stage_profile::finish_slow_reads();
+    if (profile_out.is_open()) {
+        stage_profile::write_json(profile_out);
+        if (locate_cache) {
+            size_t lookups = locate_cache->hits() + locate_cache->misses();
+            cerr << "locate cache: " << locate_cache->hits() << " hits in " << lookups << " lookups of repetitive ranges"
+                 << " (" << (lookups ? 100.0 * locate_cache->hits() / lookups : 0.0) << "%), "
+                 << locate_cache->size() << " ranges cached" << endl;
+        }
+        if (cluster_graph_cache) {
+            size_t lookups = cluster_graph_cache->hits() + cluster_graph_cache->misses();
+            cerr << "cluster graph cache: " << cluster_graph_cache->hits() << " hits in " << lookups << " lookups"
+                 << " (" << (lookups ? 100.0 * cluster_graph_cache->hits() / lookups : 0.0) << "%), "
+                 << cluster_graph_cache->size() << " subgraphs cached" << endl;
+        }
+        if (duplicate_cache) {
+            size_t lookups = duplicate_cache->hits() + duplicate_cache->misses();
+            cerr << "duplicate read cache: " << duplicate_cache->hits() << " hits in " << lookups << " reads"
+                 << " (" << (lookups ? 100.0 * duplicate_cache->hits() / lookups : 0.0) << "%), "
+                 << duplicate_cache->size() << " reads cached" << endl;
         }
     }
 
@@ -1410,19 +1823,23 @@ int main_map(int argc, char** argv) {
         delete haplo_score_provider;
         haplo_score_provider = nullptr;
     }
-    if (gbwt) {
+    if (gbwt && !gbwt_resident) {
         delete gbwt;
         gbwt = nullptr;
     }
-    if (lcp) {
+    if (kmer_table && !kmer_table_resident) {
+        delete kmer_table;
+        kmer_table = nullptr;
+    }
+    if (lcp && !lcp_resident) {
         delete lcp;
         lcp = nullptr;
     }
-    if(gcsa) {
+    if(gcsa && !gcsa_resident) {
         delete gcsa;
         gcsa = nullptr;
     }
-    if(xgidx) {
+    if(xgidx && !xg_resident) {
         delete xgidx;
         xgidx = nullptr;
     }
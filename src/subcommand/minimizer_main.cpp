@@ -0,0 +1,175 @@
+/** \file minimizer_main.cpp
+ *
+ * Defines the "vg minimizer" subcommand, which builds a minimizer seed index
+ * for vg map.
+ */
+
+#include <omp.h>
+#include <unistd.h>
+#include <getopt.h>
+
+#include <fstream>
+#include <memory>
+#include <string>
+
+#include "subcommand.hpp"
+
+#include "../minimizer_index.hpp"
+#include "../utility.hpp"
+#include "../xg.hpp"
+
+using namespace std;
+using namespace vg;
+using namespace vg::subcommand;
+
+void help_minimizer(char** argv) {
+    cerr << "usage: " << argv[0] << " minimizer [options] -x graph.xg -o graph.min" << endl
+         << "Index the (w,k)-minimizers of walks through the graph, for seeding vg map without GCSA2." << endl
+         << endl
+         << "options:" << endl
+         << "    -x, --xg-name FILE       index walks through this graph (required)" << endl
+         << "    -o, --output FILE        write the index to FILE (required)" << endl
+         << "    -k, --kmer-length N      length of the minimizer kmers [" << MinimizerIndex::DEFAULT_KMER_LENGTH << "]" << endl
+         << "    -w, --window-length N    pick a minimizer out of every N consecutive kmers ["
+         << MinimizerIndex::DEFAULT_WINDOW_LENGTH << "]" << endl
+         << "    -p, --paths              index the embedded paths instead of all walks through the graph" << endl
+         << "    -g, --gbwt-name FILE     index the haplotypes in this GBWT instead of all walks through the graph" << endl
+         << "    -m, --max-walks N        follow at most N walks out of each node of the graph ["
+         << MinimizerIndex::DEFAULT_MAX_WALKS << "]" << endl
+         << "    -t, --threads N          number of threads to use [all available]" << endl;
+}
+
+int main_minimizer(int argc, char** argv) {
+
+    if (argc == 2) {
+        help_minimizer(argv);
+        return 1;
+    }
+
+    string xg_name;
+    string output_name;
+    string gbwt_name;
+    size_t kmer_length = MinimizerIndex::DEFAULT_KMER_LENGTH;
+    size_t window_length = MinimizerIndex::DEFAULT_WINDOW_LENGTH;
+    size_t max_walks = MinimizerIndex::DEFAULT_MAX_WALKS;
+    bool index_paths = false;
+
+    int c;
+    optind = 2; // force optind past command positional argument
+    while (true) {
+        static struct option long_options[] =
+        {
+            {"help", no_argument, 0, 'h'},
+            {"xg-name", required_argument, 0, 'x'},
+            {"output", required_argument, 0, 'o'},
+            {"kmer-length", required_argument, 0, 'k'},
+            {"window-length", required_argument, 0, 'w'},
+            {"paths", no_argument, 0, 'p'},
+            {"gbwt-name", required_argument, 0, 'g'},
+            {"max-walks", required_argument, 0, 'm'},
+            {"threads", required_argument, 0, 't'},
+            {0, 0, 0, 0}
+        };
+
+        int option_index = 0;
+        c = getopt_long (argc, argv, "hx:o:k:w:pg:m:t:",
+                         long_options, &option_index);
+
+        // Detect the end of the options.
+        if (c == -1)
+            break;
+
+        switch (c)
+        {
+        case 'x':
+            xg_name = optarg;
+            break;
+        case 'o':
+            output_name = optarg;
+            break;
+        case 'k':
+            kmer_length = parse<size_t>(optarg);
+            break;
+        case 'w':
+            window_length = parse<size_t>(optarg);
+            break;
+        case 'p':
+            index_paths = true;
+            break;
+        case 'g':
+            gbwt_name = optarg;
+            break;
+        case 'm':
+            max_walks = parse<size_t>(optarg);
+            break;
+        case 't':
+            omp_set_num_threads(parse<int>(optarg));
+            break;
+        case 'h':
+        case '?':
+            help_minimizer(argv);
+            exit(1);
+            break;
+        default:
+            abort ();
+        }
+    }
+
+    if (xg_name.empty()) {
+        cerr << "error:[vg minimizer] the graph to index must be given with -x" << endl;
+        return 1;
+    }
+    if (output_name.empty()) {
+        cerr << "error:[vg minimizer] the output file must be given with -o" << endl;
+        return 1;
+    }
+    if (max_walks == 0) {
+        cerr << "error:[vg minimizer] at least one walk must be followed out of each node" << endl;
+        return 1;
+    }
+
+    xg::XG xg_index;
+    get_input_file(xg_name, [&](istream& in) {
+        xg_index.load(in);
+    });
+
+    unique_ptr<gbwt::GBWT> gbwt_index;
+    if (!gbwt_name.empty()) {
+        ifstream in(gbwt_name);
+        if (!in) {
+            cerr << "error:[vg minimizer] unable to load GBWT index file " << gbwt_name << endl;
+            return 1;
+        }
+        gbwt_index.reset(new gbwt::GBWT());
+        gbwt_index->load(in);
+    }
+
+    try {
+        MinimizerIndex index(kmer_length, window_length);
+        if (index_paths) {
+            index.add_paths(xg_index);
+        }
+        if (gbwt_index) {
+            index.add_haplotypes(xg_index, *gbwt_index);
+        }
+        if (!index_paths && !gbwt_index) {
+            index.add_graph(xg_index, max_walks);
+        }
+        index.build();
+
+        ofstream out(output_name);
+        if (!out) {
+            cerr << "error:[vg minimizer] cannot write to " << output_name << endl;
+            return 1;
+        }
+        index.serialize(out);
+    } catch (const runtime_error& e) {
+        cerr << "error:[vg minimizer] " << e.what() << endl;
+        return 1;
+    }
+
+    return 0;
+}
+
+// Register subcommand
+static Subcommand vg_minimizer("minimizer", "build a minimizer seed index for vg map", main_minimizer);
@@ -11,6 +11,7 @@
 #include "subcommand.hpp"
 
 #include "../vg.hpp"
+#include "../packed_graph.hpp"
 #include "../cactus.hpp"
 #include "../stream.hpp"
 #include "../utility.hpp"
@@ -80,7 +81,9 @@ void help_mod(char** argv) {
          << "    -a, --cactus            convert to cactus graph representation" << endl
          << "    -v, --sample-vcf FILE   for a graph with allele paths, compute the sample graph from the given VCF" << endl
          << "    -G, --sample-graph FILE subset an augmented graph to a sample graph using a Locus file" << endl
-         << "    -t, --threads N         for tasks that can be done in parallel, use this many threads" << endl;
+         << "    -t, --threads N         for tasks that can be done in parallel, use this many threads" << endl
+         << "    -W, --packed            hold the graph in a compact form that only supports -O, -z, -M, -X, -y," << endl
+         << "                            and -D, for graphs too big to load normally; paths must visit whole nodes" << endl;
 }
 
 int main_mod(int argc, char** argv) {
@@ -116,7 +119,7 @@ int main_mod(int argc, char** argv) {
     bool retain_complement = false;
     vector<int64_t> root_nodes;
     int32_t context_steps;
-    bool remove_null;
+    bool remove_null = false;
     bool strong_connect = false;
     uint32_t unfold_to = 0;
     bool break_cycles = false;
@@ -133,6 +136,7 @@ int main_mod(int argc, char** argv) {
     string vcf_filename;
     string loci_filename;
     int max_degree = 0;
+    bool packed = false;
 
     int c;
     optind = 2; // force optind past command positional argument
@@ -185,11 +189,12 @@ int main_mod(int argc, char** argv) {
             {"sample-vcf", required_argument, 0, 'v'},
             {"sample-graph", required_argument, 0, 'G'},
             {"max-degree", required_argument, 0, 'M'},
+            {"packed", no_argument, 0, 'W'},
             {0, 0, 0, 0}
         };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "hk:oi:q:Q:cpl:e:mt:SX:KPsunzNAf:CDr:Ig:x:RTU:Bbd:Ow:L:y:Z:Eav:G:M:",
+        c = getopt_long (argc, argv, "hk:oi:q:Q:cpl:e:mt:SX:KPsunzNAf:CDr:Ig:x:RTU:Bbd:Ow:L:y:Z:Eav:G:M:W",
                 long_options, &option_index);
 
 
@@ -377,6 +382,10 @@ int main_mod(int argc, char** argv) {
             max_degree = parse<int>(optarg);
             break;
 
+        case 'W':
+            packed = true;
+            break;
+
         case 'h':
         case '?':
             help_mod(argv);
@@ -388,6 +397,69 @@ int main_mod(int argc, char** argv) {
         }
     }
 
+    if (packed) {
+        // Only the operations that work through the handle graph interface
+        // can be done without a VG.
+        bool needs_vg = !path_name.empty() || remove_orphans || !aln_file.empty() || !loci_file.empty()
+            || label_paths || compact_ids || prune_complex || add_start_and_end_markers || prune_subgraphs
+            || kill_labels || simplify_graph || unchop || normalize_graph || until_normal_iter
+            || remove_non_path || remove_path || compact_ranks || !paths_to_retain.empty() || retain_complement
+            || !root_nodes.empty() || remove_null || strong_connect || unfold_to || break_cycles
+            || dagify_steps || dagify_to || bluntify || flip_doubly_reversed_edges || cactus
+            || !vcf_filename.empty() || !loci_filename.empty() || !translation_file.empty();
+        if (needs_vg) {
+            cerr << "[vg mod]: --packed only supports -O, -z, -M, -X, -y, and -D" << endl;
+            return 1;
+        }
+
+        PackedGraph* graph;
+        get_input_file(optind, argc, argv, [&](istream& in) {
+            graph = new PackedGraph(in);
+        });
+
+        if (drop_paths) {
+            graph->clear_paths();
+        }
+
+        if (orient_forward) {
+            algorithms::orient_nodes_forward(graph);
+        }
+
+        if (sort_graph) {
+            algorithms::sort(graph);
+        }
+
+        if (max_degree) {
+            algorithms::remove_high_degree_nodes(*graph, max_degree);
+        }
+
+        if (chop_to) {
+            vector<handle_t> to_chop;
+            graph->for_each_handle([&](const handle_t& handle) {
+                if (graph->get_length(handle) > (size_t) chop_to) {
+                    to_chop.push_back(handle);
+                }
+            });
+            for (auto& handle : to_chop) {
+                vector<size_t> offsets;
+                for (size_t offset = chop_to; offset < graph->get_length(handle); offset += chop_to) {
+                    offsets.push_back(offset);
+                }
+                graph->divide_handle(handle, offsets);
+            }
+        }
+
+        if (destroy_node_id > 0 && graph->has_node(destroy_node_id)) {
+            graph->destroy_handle(graph->get_handle(destroy_node_id));
+        }
+
+        graph->serialize(std::cout);
+
+        delete graph;
+
+        return 0;
+    }
+
     VG* graph;
     get_input_file(optind, argc, argv, [&](istream& in) {
         graph = new VG(in);
@@ -10,6 +10,10 @@
 
 #include "../multipath_mapper.hpp"
 #include "../path.hpp"
+#include "../staged_pipeline.hpp"
+#include "../stage_profile.hpp"
+#include "../resident_indexes.hpp"
+#include "../huge_pages.hpp"
 
 //#define record_read_run_times
 
@@ -57,7 +61,9 @@ void help_mpmap(char** argv) {
     << "  -b, --frag-sample INT         look for this many unambiguous mappings to estimate the fragment length distribution [1000]" << endl
     << "  -I, --frag-mean               mean for fixed fragment length distribution" << endl
     << "  -D, --frag-stddev             standard deviation for fixed fragment length distribution" << endl
+    << "  --frag-prepass INT            estimate the fragment length distribution from the first INT read pairs, in parallel, before mapping them [0]" << endl
     << "  -B, --no-calibrate            do not auto-calibrate mismapping dectection" << endl
+    << "  --calibrate-only              calibrate mismapping detection, save it to the XG's path + .mpcal for later runs, and exit" << endl
     << "  -P, --max-p-val FLOAT         background model p value must be less than this to avoid mismapping detection [0.00001]" << endl
     << "  -v, --mq-method OPT           mapping quality method: 0 - none, 1 - fast approximation, 2 - adaptive, 3 - exact [2]" << endl
     << "  -Q, --mq-max INT              cap mapping quality estimates at this much [60]" << endl
@@ -75,6 +81,8 @@ void help_mpmap(char** argv) {
     << "  --recombination-penalty FLOAT use this log recombination penalty for GBWT haplotype scoring [20.7]" << endl
     << "  -C, --drop-subgraph FLOAT     drop alignment subgraphs whose MEMs cover this fraction less of the read than the best subgraph [0.2]" << endl
     << "  -U, --prune-exp FLOAT         prune MEM anchors if their approximate likelihood is this root less than the optimal anchors [1.25]" << endl
+    << "  --dagify-cache INT            reuse up to this many cyclic subgraphs unrolled into DAGs, 0 to disable [256]" << endl
+    << "  --haplotype-filter            drop MEM hits spanning nodes along walks no haplotype in the GBWT (-H) follows" << endl
     << "scoring:" << endl
     << "  -q, --match INT               use this match score [1]" << endl
     << "  -z, --mismatch INT            use this mismatch penalty [4]" << endl
@@ -85,7 +93,15 @@ void help_mpmap(char** argv) {
     << "  -m, --remove-bonuses          remove full length alignment bonuses in reported scores" << endl
     << "computational parameters:" << endl
     << "  -t, --threads INT             number of compute threads to use" << endl
-    << "  -Z, --buffer-size INT         buffer this many alignments together (per compute thread) before outputting to stdout [100]" << endl;
+    << "  -Z, --buffer-size INT         buffer this many alignments together (per compute thread) before outputting to stdout [100]" << endl
+    << "  --huge-pages                  back the loaded indexes with transparent huge pages, and report how much is in huge pages" << endl
+    << "  --stage-threads S,C,A         map unpaired reads in a pipeline, with S threads finding MEMs, C clustering, and A aligning;" << endl
+    << "                                report each stage's timing to stderr (overrides -t)" << endl
+    << "  --profile FILE                write a JSON report of the time spent in and work done by each mapping stage to FILE" << endl
+    << "                                (with a histogram of the time taken by each read)" << endl
+    << "  --slow-reads FILE             write reads that take at least --slow-read-ms to map to FILE as GAM, annotated with" << endl
+    << "                                the time and work of each stage of mapping them (not with --stage-threads)" << endl
+    << "  --slow-read-ms INT            reads taking at least INT milliseconds are slow [100]" << endl;
     
 }
 
@@ -99,6 +115,15 @@ int main_mpmap(int argc, char** argv) {
     // initialize parameters with their default options
     #define OPT_SCORE_MATRIX 1000
     #define OPT_RECOMBINATION_PENALTY 1001
+    #define OPT_STAGE_THREADS 1002
+    #define OPT_CALIBRATE_ONLY 1003
+    #define OPT_PROFILE 1004
+    #define OPT_FRAG_PREPASS 1005
+    #define OPT_HUGE_PAGES 1006
+    #define OPT_DAGIFY_CACHE 1007
+    #define OPT_HAPLOTYPE_FILTER 1008
+    #define OPT_SLOW_READS 1009
+    #define OPT_SLOW_READ_MS 1010
     string matrix_file_name;
     string xg_name;
     string gcsa_name;
@@ -126,6 +151,12 @@ int main_mpmap(int argc, char** argv) {
     int localization_max_paths = 5;
     int max_num_mappings = 1;
     int buffer_size = 100;
+    // threads for each stage in pipeline mode, or empty to map each read all the way through on one thread
+    vector<size_t> stage_threads;
+    // where to write the stage profile, if anywhere
+    string profile_name;
+    string slow_reads_name;
+    size_t slow_read_ms = 100;
     int hit_max = 1024;
     int min_mem_length = 1;
     int min_clustering_mem_length = 0;
@@ -146,11 +177,16 @@ int main_mpmap(int argc, char** argv) {
     bool single_path_alignment_mode = false;
     int max_mapq = 60;
     size_t frag_length_sample_size = 1000;
+    size_t frag_length_prepass_size = 0;
     double frag_length_robustness_fraction = 0.95;
     double frag_length_mean = NAN;
     double frag_length_stddev = NAN;
     bool same_strand = false;
     bool auto_calibrate_mismapping_detection = true;
+    bool calibrate_only = false;
+    bool huge_pages = false;
+    size_t dagify_cache_capacity = 256;
+    bool haplotype_filter = false;
     double max_mapping_p_value = 0.00001;
     size_t num_calibration_simulations = 250;
     size_t calibration_read_length = 150;
@@ -206,6 +242,7 @@ int main_mpmap(int argc, char** argv) {
             {"frag-sample", required_argument, 0, 'b'},
             {"frag-mean", required_argument, 0, 'I'},
             {"frag-stddev", required_argument, 0, 'D'},
+            {"frag-prepass", required_argument, 0, OPT_FRAG_PREPASS},
             {"no-calibrate", no_argument, 0, 'B'},
             {"max-p-val", required_argument, 0, 'P'},
             {"mq-method", required_argument, 0, 'v'},
@@ -235,6 +272,14 @@ int main_mpmap(int argc, char** argv) {
             {"no-qual-adjust", no_argument, 0, 'A'},
             {"threads", required_argument, 0, 't'},
             {"buffer-size", required_argument, 0, 'Z'},
+            {"stage-threads", required_argument, 0, OPT_STAGE_THREADS},
+            {"calibrate-only", no_argument, 0, OPT_CALIBRATE_ONLY},
+            {"profile", required_argument, 0, OPT_PROFILE},
+            {"slow-reads", required_argument, 0, OPT_SLOW_READS},
+            {"slow-read-ms", required_argument, 0, OPT_SLOW_READ_MS},
+            {"huge-pages", no_argument, 0, OPT_HUGE_PAGES},
+            {"dagify-cache", required_argument, 0, OPT_DAGIFY_CACHE},
+            {"haplotype-filter", no_argument, 0, OPT_HAPLOTYPE_FILTER},
             {0, 0, 0, 0}
         };
 
@@ -366,10 +411,42 @@ int main_mpmap(int argc, char** argv) {
                 frag_length_stddev = parse<double>(optarg);
                 break;
                 
+            case OPT_FRAG_PREPASS:
+                frag_length_prepass_size = parse<int>(optarg);
+                break;
+                
             case 'B':
                 auto_calibrate_mismapping_detection = false;
                 break;
                 
+            case OPT_CALIBRATE_ONLY:
+                calibrate_only = true;
+                break;
+                
+            case OPT_PROFILE:
+                profile_name = optarg;
+                break;
+                
+            case OPT_SLOW_READS:
+                slow_reads_name = optarg;
+                break;
+                
+            case OPT_SLOW_READ_MS:
+                slow_read_ms = parse<size_t>(optarg);
+                break;
+                
+            case OPT_HUGE_PAGES:
+                huge_pages = true;
+                break;
+                
+            case OPT_DAGIFY_CACHE:
+                dagify_cache_capacity = parse<size_t>(optarg);
+                break;
+                
+            case OPT_HAPLOTYPE_FILTER:
+                haplotype_filter = true;
+                break;
+                
             case 'P':
                 max_mapping_p_value = parse<double>(optarg);
                 break;
@@ -515,6 +592,24 @@ int main_mpmap(int argc, char** argv) {
                 buffer_size = parse<int>(optarg);
                 break;
                 
+            case OPT_STAGE_THREADS:
+            {
+                stage_threads.clear();
+                for (const string& count : split_delims(optarg, ",")) {
+                    int num_threads = parse<int>(count);
+                    if (num_threads <= 0) {
+                        cerr << "error:[vg mpmap] Stage thread counts (--stage-threads) must be positive integers." << endl;
+                        exit(1);
+                    }
+                    stage_threads.push_back(num_threads);
+                }
+                if (stage_threads.size() != 3) {
+                    cerr << "error:[vg mpmap] Stage thread counts (--stage-threads) must be given for all 3 stages." << endl;
+                    exit(1);
+                }
+            }
+                break;
+                
             case 'h':
             case '?':
             default:
@@ -551,11 +646,26 @@ int main_mpmap(int argc, char** argv) {
         exit(1);
     }
     
-    if (fastq_name_1.empty() && gam_file_name.empty()) {
+    if (calibrate_only && !auto_calibrate_mismapping_detection) {
+        cerr << "error:[vg mpmap] Cannot both calibrate (--calibrate-only) and skip calibration (-B)." << endl;
+        exit(1);
+    }
+    
+    if (fastq_name_1.empty() && gam_file_name.empty() && !calibrate_only) {
         cerr << "error:[vg mpmap] Must designate reads to map from either FASTQ (-f) or GAM (-G) file." << endl;
         exit(1);
     }
     
+    if (!stage_threads.empty() && !slow_reads_name.empty()) {
+        cerr << "error:[vg mpmap] Slow reads (--slow-reads) can't be traced through pipelined mapping (--stage-threads)." << endl;
+        exit(1);
+    }
+    
+    if (!stage_threads.empty() && (interleaved_input || !fastq_name_2.empty())) {
+        cerr << "error:[vg mpmap] Pipelined mapping (--stage-threads) is only available for unpaired reads." << endl;
+        exit(1);
+    }
+    
     if (!interleaved_input && fastq_name_2.empty() && same_strand) {
         cerr << "warning:[vg mpmap] Ignoring same strand parameter (-d) because no paired end input provided." << endl;
     }
@@ -602,6 +712,11 @@ int main_mpmap(int argc, char** argv) {
         exit(1);
     }
     
+    if (haplotype_filter && gbwt_name.empty()) {
+        cerr << "error:[vg mpmap] Haplotype filtering (--haplotype-filter) requires a GBWT index (-H)." << endl;
+        exit(1);
+    }
+    
     if (!sublinearLS_name.empty() && !gbwt_name.empty()) {
         cerr << "error:[vg mpmap] GBWT index (-H) and linear haplotype index (--linear-index) both specified. Only one can be used." << endl;
         exit(1);
@@ -797,23 +912,62 @@ int main_mpmap(int argc, char** argv) {
     // Configure its temp directory to the system temp directory
     gcsa::TempFile::setDirectory(temp_file::get_dir());
     
-    xg::XG xg_index(xg_stream);
-    gcsa::GCSA gcsa_index;
-    gcsa_index.load(gcsa_stream);
-    gcsa::LCPArray lcp_array;
-    lcp_array.load(lcp_stream);
+    // Use the indexes a vg server we were forked from has loaded, if any, and
+    // otherwise load our own
+    ResidentIndexes& resident = ResidentIndexes::get();
+    unique_ptr<xg::XG> own_xg_index;
+    xg::XG* xg_pointer = resident.xg(xg_name);
+    if (xg_pointer == nullptr) {
+        own_xg_index.reset(new xg::XG());
+        own_xg_index->load_mapped(xg_name);
+        xg_pointer = own_xg_index.get();
+    }
+    xg::XG& xg_index = *xg_pointer;
+    
+    unique_ptr<gcsa::GCSA> own_gcsa_index;
+    unique_ptr<gcsa::LCPArray> own_lcp_array;
+    gcsa::GCSA* gcsa_pointer = resident.gcsa(gcsa_name);
+    gcsa::LCPArray* lcp_pointer = resident.lcp(gcsa_name);
+    if (gcsa_pointer == nullptr || lcp_pointer == nullptr) {
+        own_gcsa_index.reset(new gcsa::GCSA());
+        own_gcsa_index->load(gcsa_stream);
+        gcsa_pointer = own_gcsa_index.get();
+        own_lcp_array.reset(new gcsa::LCPArray());
+        own_lcp_array->load(lcp_stream);
+        lcp_pointer = own_lcp_array.get();
+    }
+    gcsa::GCSA& gcsa_index = *gcsa_pointer;
+    gcsa::LCPArray& lcp_array = *lcp_pointer;
+    
+    // Use the kmer table to speed up MEM finding if it is there. A resident
+    // GCSA2 index comes with its table, if it has one.
+    GCSAKmerTable own_kmer_table;
+    GCSAKmerTable* kmer_table_pointer = resident.kmer_table(gcsa_name);
+    if (kmer_table_pointer == nullptr) {
+        kmer_table_pointer = &own_kmer_table;
+        ifstream kmer_table_stream(gcsa_name + ".kmers");
+        if (own_gcsa_index && kmer_table_stream) {
+            own_kmer_table.load(kmer_table_stream);
+        }
+    }
+    GCSAKmerTable& kmer_table = *kmer_table_pointer;
     
     gbwt::GBWT* gbwt = nullptr;
+    bool gbwt_resident = false;
     haplo::linear_haplo_structure* sublinearLS = nullptr;
     haplo::ScoreProvider* haplo_score_provider = nullptr;
     if (!gbwt_name.empty()) {
-        ifstream gbwt_stream(gbwt_name);
-        if (!gbwt_stream) {
-            cerr << "error:[vg mpmap] Cannot open GBWT file " << gbwt_name << endl;
-            exit(1);
+        gbwt = resident.gbwt(gbwt_name);
+        gbwt_resident = gbwt != nullptr;
+        if (!gbwt_resident) {
+            ifstream gbwt_stream(gbwt_name);
+            if (!gbwt_stream) {
+                cerr << "error:[vg mpmap] Cannot open GBWT file " << gbwt_name << endl;
+                exit(1);
+            }
+            gbwt = new gbwt::GBWT();
+            gbwt->load(gbwt_stream);
         }
-        gbwt = new gbwt::GBWT();
-        gbwt->load(gbwt_stream);
         
         // We have the GBWT available for scoring haplotypes
         haplo_score_provider = new haplo::GBWTScoreProvider<gbwt::GBWT>(*gbwt);
@@ -842,8 +996,20 @@ int main_mpmap(int argc, char** argv) {
         }
         snarl_manager = new SnarlManager(snarl_stream);
     }
+    
+    if (huge_pages) {
+        // Random access into big succinct structures is dominated by TLB
+        // misses, which huge pages cut down
+        advise_huge_pages();
+        HugePageUsage usage = huge_page_usage();
+        cerr << "[vg mpmap] " << usage.huge_page_bytes / (1024 * 1024) << " of "
+             << usage.anonymous_bytes / (1024 * 1024) << " MB of anonymous memory is in huge pages" << endl;
+    }
         
     MultipathMapper multipath_mapper(&xg_index, &gcsa_index, &lcp_array, haplo_score_provider, snarl_manager);
+    if (kmer_table.kmer_length() > 0) {
+        multipath_mapper.set_gcsa_kmer_table(&kmer_table);
+    }
     
     // set alignment parameters
     multipath_mapper.set_alignment_scores(match_score, mismatch_score, gap_open_score, gap_extension_score, full_length_bonus);
@@ -852,6 +1018,7 @@ int main_mpmap(int argc, char** argv) {
     multipath_mapper.strip_bonuses = strip_full_length_bonus;
     multipath_mapper.band_padding_multiplier = band_padding_multiplier;
     multipath_mapper.init_band_padding_memo();
+    multipath_mapper.set_dagify_cache_capacity(dagify_cache_capacity);
     
     // set mem finding parameters
     multipath_mapper.hit_max = hit_max;
@@ -875,6 +1042,9 @@ int main_mpmap(int argc, char** argv) {
     else {
         multipath_mapper.set_automatic_min_clustering_length();
     }
+    if (haplotype_filter) {
+        multipath_mapper.set_haplotype_filter(gbwt);
+    }
     
     // set mapping quality parameters
     multipath_mapper.mapping_quality_method = mapq_method;
@@ -909,13 +1079,71 @@ int main_mpmap(int argc, char** argv) {
     multipath_mapper.simplify_topologies = simplify_topologies;
     multipath_mapper.max_suboptimal_path_score_ratio = suboptimal_path_exponent;
     
-    // if directed to, auto calibrate the mismapping detection to the graph
+    // if directed to, auto calibrate the mismapping detection to the graph, unless a saved
+    // calibration for this graph and these settings is available
+    string calibration_name = xg_name + ".mpcal";
     if (auto_calibrate_mismapping_detection) {
-        multipath_mapper.calibrate_mismapping_detection(num_calibration_simulations, calibration_read_length);
+        bool loaded_calibration = false;
+        if (!calibrate_only) {
+            ifstream calibration_in(calibration_name);
+            loaded_calibration = calibration_in && multipath_mapper.load_mismapping_calibration(calibration_in,
+                                                                                                num_calibration_simulations,
+                                                                                                calibration_read_length);
+        }
+        if (!loaded_calibration) {
+            multipath_mapper.calibrate_mismapping_detection(num_calibration_simulations, calibration_read_length);
+        }
+    }
+    
+    if (calibrate_only) {
+        ofstream calibration_out(calibration_name);
+        if (!calibration_out) {
+            cerr << "error:[vg mpmap] Cannot write calibration file " << calibration_name << endl;
+            exit(1);
+        }
+        multipath_mapper.save_mismapping_calibration(calibration_out, num_calibration_simulations, calibration_read_length);
+        return 0;
+    }
+    
+    // start profiling now that calibration, which maps simulated reads, is done
+    ofstream profile_out;
+    if (!profile_name.empty()) {
+        profile_out.open(profile_name);
+        if (!profile_out) {
+            cerr << "error:[vg mpmap] Cannot write profile file " << profile_name << endl;
+            exit(1);
+        }
+        stage_profile::enable();
+        stage_profile::record_peak_rss("indexes_loaded");
+    }
+    ofstream slow_reads_out;
+    if (!slow_reads_name.empty()) {
+        slow_reads_out.open(slow_reads_name);
+        if (!slow_reads_out) {
+            cerr << "error:[vg mpmap] Cannot write slow reads file " << slow_reads_name << endl;
+            exit(1);
+        }
+        stage_profile::save_slow_reads(slow_reads_out, slow_read_ms * 1000000);
+        stage_profile::enable();
     }
     
     // set computational paramters
     int thread_count = get_thread_count();
+    
+    // in pipeline mode, each read moves from thread to thread through these stages
+    StagedPipeline<MultipathMapper::StagedRead> pipeline;
+    if (!stage_threads.empty()) {
+        pipeline.add_stage("finding MEMs", stage_threads[0], [&](MultipathMapper::StagedRead& read) {
+            multipath_mapper.find_staged_mems(read);
+        });
+        pipeline.add_stage("clustering", stage_threads[1], [&](MultipathMapper::StagedRead& read) {
+            multipath_mapper.cluster_staged_mems(read);
+        });
+        // the aligning stage, which also writes the output, is added once the output functions exist,
+        // and there is also one thread reading
+        thread_count = 1 + stage_threads[0] + stage_threads[1] + stage_threads[2];
+    }
+    
     multipath_mapper.set_alignment_threads(thread_count);
     
     // are we doing paired ends?
@@ -947,6 +1175,23 @@ int main_mpmap(int argc, char** argv) {
     // during distribution estimation
     vector<pair<Alignment, Alignment>> ambiguous_pair_buffer;
     
+    // a buffer to hold the read pairs for the fragment length pre-pass, also only used in single threaded mode
+    vector<pair<Alignment, Alignment>> prepass_pair_buffer;
+    bool prepass_done = false;
+    
+    // estimate the fragment length distribution from the buffered pairs in parallel, and then send them
+    // to be mapped along with the ambiguous pairs
+    auto run_frag_length_prepass = [&]() {
+        prepass_done = true;
+        if (!multipath_mapper.estimate_fragment_length_distr(prepass_pair_buffer)) {
+            cerr << "warning:[vg mpmap] Could not find " << frag_length_sample_size << " unambiguous read pair mappings to estimate fragment length distribution in the first " << prepass_pair_buffer.size() << " read pairs. Continuing estimation while mapping. Consider increasing pre-pass size (--frag-prepass)." << endl;
+        }
+        for (pair<Alignment, Alignment>& aln_pair : prepass_pair_buffer) {
+            ambiguous_pair_buffer.emplace_back(move(aln_pair));
+        }
+        prepass_pair_buffer.clear();
+    };
+    
     vector<vector<Alignment> > single_path_output_buffer(thread_count);
     vector<vector<MultipathAlignment> > multipath_output_buffer(thread_count);
     
@@ -1139,6 +1384,15 @@ int main_mpmap(int argc, char** argv) {
             alignment_2.clear_path();
             reverse_complement_alignment_in_place(&alignment_2, [&](vg::id_t node_id) { return xg_index.node_length(node_id); });
         }
+        
+        if (frag_length_prepass_size && !prepass_done && !multipath_mapper.has_fixed_fragment_length_distr()) {
+            // hold onto the pair until we have the whole pre-pass sample
+            prepass_pair_buffer.emplace_back(alignment_1, alignment_2);
+            if (prepass_pair_buffer.size() >= frag_length_prepass_size) {
+                run_frag_length_prepass();
+            }
+            return;
+        }
                 
         vector<pair<MultipathAlignment, MultipathAlignment>> mp_aln_pairs;
         multipath_mapper.multipath_map_paired(alignment_1, alignment_2, mp_aln_pairs, ambiguous_pair_buffer, max_num_mappings);
@@ -1196,6 +1450,31 @@ int main_mpmap(int argc, char** argv) {
 #endif
     };
     
+    if (!stage_threads.empty()) {
+        pipeline.add_stage("aligning", stage_threads[2], [&](MultipathMapper::StagedRead& read) {
+            multipath_mapper.align_staged_read(read, max_num_mappings);
+            if (single_path_alignment_mode) {
+                output_single_path_alignments(read.multipath_alns);
+            }
+            else {
+                output_multipath_alignments(read.multipath_alns);
+            }
+        });
+    }
+    
+    // send the reads from an unpaired input through the pipeline
+    auto run_pipeline = [&](const function<void(const function<void(Alignment&)>&)>& for_each_read) {
+        pipeline.run([&](const function<void(MultipathMapper::StagedRead&)>& emit) {
+            MultipathMapper::StagedRead read;
+            for_each_read([&](Alignment& alignment) {
+                read.alignment = move(alignment);
+                emit(read);
+            });
+        });
+        cerr << "[vg mpmap] pipeline stage timings:" << endl;
+        pipeline.report(cerr);
+    };
+    
     // for streaming paired input, don't spawn parallel tasks unless this evalutes to true
     function<bool(void)> multi_threaded_condition = [&](void) {
         return multipath_mapper.has_fixed_fragment_length_distr();
@@ -1209,7 +1488,14 @@ int main_mpmap(int argc, char** argv) {
                                                                   multi_threaded_condition);
         }
         else if (fastq_name_2.empty()) {
-            fastq_unpaired_for_each_parallel(fastq_name_1, do_unpaired_alignments);
+            if (!stage_threads.empty()) {
+                run_pipeline([&](const function<void(Alignment&)>& lambda) {
+                    fastq_unpaired_for_each(fastq_name_1, lambda);
+                });
+            }
+            else {
+                fastq_unpaired_for_each_parallel(fastq_name_1, do_unpaired_alignments);
+            }
         }
         else {
             fastq_paired_two_files_for_each_parallel_after_wait(fastq_name_1, fastq_name_2, do_paired_alignments,
@@ -1228,6 +1514,11 @@ int main_mpmap(int argc, char** argv) {
                 stream::for_each_interleaved_pair_parallel_after_wait(gam_in, do_paired_alignments,
                                                                       multi_threaded_condition);
             }
+            else if (!stage_threads.empty()) {
+                run_pipeline([&](const function<void(Alignment&)>& lambda) {
+                    stream::for_each(gam_in, lambda);
+                });
+            }
             else {
                 stream::for_each_parallel(gam_in, do_unpaired_alignments);
             }
@@ -1235,6 +1526,11 @@ int main_mpmap(int argc, char** argv) {
         get_input_file(gam_file_name, execute);
     }
 
+    // the input may have run out before we filled up the pre-pass sample
+    if (!prepass_done && !prepass_pair_buffer.empty()) {
+        run_frag_length_prepass();
+    }
+
     // take care of any read pairs that we couldn't map unambiguously before the fragment length distribution
     // had been estimated
     if (!ambiguous_pair_buffer.empty()) {
@@ -1284,6 +1580,11 @@ int main_mpmap(int argc, char** argv) {
     read_time_file.close();
 #endif
     
+    stage_profile::finish_slow_reads();
+    if (profile_out.is_open()) {
+        stage_profile::write_json(profile_out);
+    }
+    
     //cerr << "MEM length filtering efficiency: " << ((double) OrientedDistanceClusterer::MEM_FILTER_COUNTER) / OrientedDistanceClusterer::MEM_TOTAL << " (" << OrientedDistanceClusterer::MEM_FILTER_COUNTER << "/" << OrientedDistanceClusterer::MEM_TOTAL << ")" << endl;
     //cerr << "MEM cluster filtering efficiency: " << ((double) OrientedDistanceClusterer::PRUNE_COUNTER) / OrientedDistanceClusterer::CLUSTER_TOTAL << " (" << OrientedDistanceClusterer::PRUNE_COUNTER << "/" << OrientedDistanceClusterer::CLUSTER_TOTAL << ")" << endl;
     //cerr << "subgraph filtering efficiency: " << ((double) MultipathMapper::PRUNE_COUNTER) / MultipathMapper::SUBGRAPH_TOTAL << " (" << MultipathMapper::PRUNE_COUNTER << "/" << MultipathMapper::SUBGRAPH_TOTAL << ")" << endl;
@@ -1302,7 +1603,7 @@ int main_mpmap(int argc, char** argv) {
         delete sublinearLS;
     }
    
-    if (gbwt != nullptr) {
+    if (gbwt != nullptr && !gbwt_resident) {
         delete gbwt;
     }
     
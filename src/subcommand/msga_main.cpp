@@ -28,6 +28,8 @@ void help_msga(char** argv) {
          << "    -s, --seq SEQUENCE      literally include this sequence" << endl
          << "    -g, --graph FILE        include this graph" << endl
          << "    -a, --fasta-order       build the graph in the order the sequences are seen in the FASTA (default: bigger first)" << endl
+         << "    --batch-size N          align N sequences at once against the same graph, then add them all" << endl
+         << "                            with one edit and one index rebuild [1]" << endl
          << "alignment:" << endl
          << "    -k, --min-mem INT       minimum MEM length (if 0 estimate via -e) [0]" << endl
          << "    -e, --mem-chance FLOAT  set {-k} such that this fraction of {-k} length hits will by chance [5e-4]" << endl
@@ -136,6 +138,7 @@ int main_msga(int argc, char** argv) {
     int max_sub_mem_recursion_depth = 2;
     bool xdrop_alignment = false;
     uint32_t max_gap_length = 40;
+    size_t batch_size = 1;
 
     int c;
     optind = 2; // force optind past command positional argument
@@ -187,6 +190,7 @@ int main_msga(int argc, char** argv) {
                 {"no-patch-aln", no_argument, 0, '8'},
                 {"max-gap-length", required_argument, 0, 1},
                 {"xdrop-alignment", no_argument, 0, 2},
+                {"batch-size", required_argument, 0, 3},
                 {0, 0, 0, 0}
             };
 
@@ -373,6 +377,14 @@ int main_msga(int argc, char** argv) {
             xdrop_alignment = true;
             break;
 
+        case 3:
+            batch_size = parse<int>(optarg);
+            if (batch_size == 0) {
+                cerr << "error:[vg msga] --batch-size must be at least 1" << endl;
+                return 1;
+            }
+            break;
+
         case 'h':
         case '?':
             help_msga(argv);
@@ -511,7 +523,10 @@ int main_msga(int argc, char** argv) {
     // should we preferentially use sequences from fasta files in the order they were given?
     // (considering this a todo)
     // reverse complement?
-    Mapper* mapper = nullptr;
+    // with batches of more than one sequence, we align the sequences of a
+    // batch in parallel, with one single-threaded mapper per thread
+    size_t mapper_count = batch_size > 1 ? max(min(batch_size, (size_t) alignment_threads), (size_t) 1) : 1;
+    vector<Mapper*> mappers;
     gcsa::GCSA* gcsaidx = nullptr;
     gcsa::LCPArray* lcpidx = nullptr;
     xg::XG* xgidx = nullptr;
@@ -521,7 +536,8 @@ int main_msga(int argc, char** argv) {
     gcsa::TempFile::setDirectory(temp_file::get_dir());
 
     auto rebuild = [&](VG* graph) {
-        if (mapper) delete mapper;
+        for (auto mapper : mappers) delete mapper;
+        mappers.clear();
         if (xgidx) delete xgidx;
         if (gcsaidx) delete gcsaidx;
         if (lcpidx) delete lcpidx;
@@ -580,8 +596,10 @@ int main_msga(int argc, char** argv) {
             // if no complexity reduction is requested, just build the index
             build_gcsa_lcp(*graph, gcsaidx, lcpidx, idx_kmer_size, doubling_steps);
         }
-        mapper = new Mapper(xgidx, gcsaidx, lcpidx);
-        { // set mapper variables
+        for (size_t i = 0; i < mapper_count; ++i) {
+            Mapper* mapper = new Mapper(xgidx, gcsaidx, lcpidx);
+            mappers.push_back(mapper);
+            // set mapper variables
             mapper->hit_max = hit_max;
             mapper->max_multimaps = max_multimaps;
             mapper->min_multimaps = min_multimaps;
@@ -596,7 +614,7 @@ int main_msga(int argc, char** argv) {
                                  : mapper->random_match_length(chance_match));
             mapper->min_cluster_length = min_cluster_length;
             mapper->mem_reseed_length = round(mem_reseed_factor * mapper->min_mem_length);
-            if (debug) {
+            if (debug && i == 0) {
                 cerr << "[vg msga] : min_mem_length = " << mapper->min_mem_length
                      << ", mem_reseed_length = " << mapper->mem_reseed_length
                      << ", min_cluster_length = " << mapper->min_cluster_length << endl;
@@ -610,7 +628,7 @@ int main_msga(int argc, char** argv) {
             mapper->mapping_quality_method = mapping_quality_method;
             mapper->max_mapping_quality = max_mapping_quality;
             // set up the multi-threaded alignment interface
-            mapper->set_alignment_threads(alignment_threads);
+            mapper->set_alignment_threads(mapper_count > 1 ? 1 : alignment_threads);
             mapper->show_progress = show_align_progress;
             mapper->patch_alignments = patch_alignments;
         }
@@ -621,68 +639,81 @@ int main_msga(int argc, char** argv) {
 
     // todo restructure so that we are trying to map everything
     // add alignment score/bp bounds to catch when we get a good alignment
-    int i = 0;
+
+    // group the sequences into batches, which are all aligned against the same
+    // graph and indexes and then included with a single edit and rebuild
+    vector<vector<string>> batches;
     for (auto& name : names_in_order) {
-        ++i;
-        //cerr << "do... " << name << " ?" << endl;
         if (!base_seq_name.empty() && name == base_seq_name) continue; // already embedded
-        bool incomplete = true; // complete when we've fully included the sequence set
-        int iter = 0;
-        auto& seq = strings[name];
-        //cerr << "doing... " << name << endl;
+        if (batches.empty() || batches.back().size() >= batch_size) {
+            batches.emplace_back();
+        }
+        batches.back().push_back(name);
+    }
+
+    int i = 0;
+    for (auto& batch : batches) {
 #ifdef debug
         {
-            graph->serialize_to_file("msga-pre-" + name + ".vg");
-            ofstream db_out("msga-pre-" + name + ".xg");
+            graph->serialize_to_file("msga-pre-" + batch.front() + ".vg");
+            ofstream db_out("msga-pre-" + batch.front() + ".xg");
             xgidx->serialize(db_out);
             db_out.close();
         }
 #endif
-        while (incomplete && iter++ < iter_max) {
-            stringstream s; s << iter; string iterstr = s.str();
-            if (debug) cerr << name << ": adding to graph " << i << "/" << names_in_order.size() << endl;
-            vector<Path> paths;
-            int j = 0;
+        // the sequences of the batch that are not yet included in the graph
+        vector<string> pending = batch;
+        int iter = 0;
+        while (!pending.empty() && iter++ < iter_max) {
+            if (debug) {
+                for (size_t k = 0; k < pending.size(); ++k) {
+                    cerr << pending[k] << ": adding to graph " << i + k + 1 << "/" << names_in_order.size() << endl;
+                }
+            }
             // align to the graph
-            if (debug) cerr << name << ": aligning " << seq.size() << "bp -> g:"
+            if (debug) cerr << "aligning " << pending.size() << " sequence(s) -> g:"
                             << graph->length() << "bp "
                             << "n:" << graph->node_count() << " "
                             << "e:" << graph->edge_count() << endl;
-            Alignment aln = mapper->align(seq, 0, 0, 0, band_width, band_overlap, xdrop_alignment);
-            aln.set_name(name);
-            if (aln.path().mapping_size()) {
-                auto aln_seq = graph->path_string(aln.path());
-                if (aln_seq != seq) {
-                    cerr << "[vg msga] alignment corrupted, failed to obtain correct banded alignment (alignment seq != input seq)" << endl;
-                    cerr << "expected " << seq << endl;
-                    cerr << "got      " << aln_seq << endl;
-                    ofstream f(name + "-failed-alignment-" + convert(j) + ".gam");
-                    stream::write(f, 1, (std::function<Alignment(size_t)>)([&aln](size_t n) { return aln; }));
-                    stream::finish(f);
-                    f.close();
-                    graph->serialize_to_file(name + "-corrupted-alignment.vg");
-                    exit(1);
-                }
-            } else {
-                Edit* edit = aln.mutable_path()->add_mapping()->add_edit();
-                edit->set_sequence(aln.sequence());
-                edit->set_to_length(aln.sequence().size());
+            vector<Alignment> alns(pending.size());
+#pragma omp parallel for schedule(dynamic, 1) num_threads(mapper_count)
+            for (size_t k = 0; k < pending.size(); ++k) {
+                Mapper* mapper = mappers[omp_get_thread_num()];
+                auto& seq = strings.at(pending[k]);
+                alns[k] = mapper->align(seq, 0, 0, 0, band_width, band_overlap, xdrop_alignment);
+                alns[k].set_name(pending[k]);
             }
-            //if (debug) cerr << pb2json(aln) << endl; // huge in some cases
-            paths.push_back(aln.path());
-            paths.back().set_name(name); // cache name to trigger inclusion of path elements in graph by edit
 
-            /*
-               ofstream f(name + "-pre-edit-" + convert(j) + ".gam");
-               stream::write(f, 1, (std::function<Alignment(size_t)>)([&aln](size_t n) { return aln; }));
-               stream::finish(f);
-               f.close();
-               */
-
-            ++j;
+            vector<Path> paths;
+            for (size_t k = 0; k < pending.size(); ++k) {
+                auto& name = pending[k];
+                auto& seq = strings[name];
+                Alignment& aln = alns[k];
+                if (aln.path().mapping_size()) {
+                    auto aln_seq = graph->path_string(aln.path());
+                    if (aln_seq != seq) {
+                        cerr << "[vg msga] alignment corrupted, failed to obtain correct banded alignment (alignment seq != input seq)" << endl;
+                        cerr << "expected " << seq << endl;
+                        cerr << "got      " << aln_seq << endl;
+                        ofstream f(name + "-failed-alignment-" + convert(iter) + ".gam");
+                        stream::write(f, 1, (std::function<Alignment(size_t)>)([&aln](size_t n) { return aln; }));
+                        stream::finish(f);
+                        f.close();
+                        graph->serialize_to_file(name + "-corrupted-alignment.vg");
+                        exit(1);
+                    }
+                } else {
+                    Edit* edit = aln.mutable_path()->add_mapping()->add_edit();
+                    edit->set_sequence(aln.sequence());
+                    edit->set_to_length(aln.sequence().size());
+                }
+                //if (debug) cerr << pb2json(aln) << endl; // huge in some cases
+                paths.push_back(aln.path());
+                paths.back().set_name(name); // cache name to trigger inclusion of path elements in graph by edit
+            }
 
-            // now take the alignment and modify the graph with it
-            if (debug) cerr << name << ": editing graph" << endl;
+            // now take the alignments and modify the graph with them
+            if (debug) cerr << "editing graph with " << paths.size() << " path(s)" << endl;
             //graph->serialize_to_file(name + "-pre-edit.vg");
             // Modify graph and embed paths
             graph->edit(paths, true);
@@ -692,14 +723,14 @@ int main_msga(int argc, char** argv) {
             graph->dice_nodes(node_max);
             //if (!graph->is_valid()) cerr << "invalid after dice" << endl;
             //graph->serialize_to_file(name + "-post-dice.vg");
-            if (debug) cerr << name << ": sorting and compacting ids" << endl;
+            if (debug) cerr << "sorting and compacting ids" << endl;
             algorithms::sort(graph);
             //if (!graph->is_valid()) cerr << "invalid after sort" << endl;
             graph->compact_ids(); // xg can't work unless IDs are compacted.
             //if (!graph->is_valid()) cerr << "invalid after compact" << endl;
             if (circularize) {
-                if (debug) cerr << name << ": circularizing" << endl;
-                graph->circularize({name});
+                if (debug) cerr << "circularizing" << endl;
+                graph->circularize(pending);
                 //graph->serialize_to_file(name + "-post-circularize.vg");
             }
 
@@ -715,28 +746,39 @@ int main_msga(int argc, char** argv) {
             rebuild(graph);
             //graph->serialize_to_file(convert(i) + "-" + name + "-post.vg");
 
-            // verfy validity of path
+            // verfy validity of paths, and retry the ones that didn't make it
             bool is_valid = graph->is_valid();
-            auto path_seq = graph->path_string(graph->paths.path(name));
-            incomplete = !(path_seq == seq) || !is_valid;
-            if (incomplete) {
+            vector<string> failed;
+            for (size_t k = 0; k < pending.size(); ++k) {
+                auto& name = pending[k];
+                auto& seq = strings[name];
+                auto path_seq = graph->path_string(graph->paths.path(name));
+                if (path_seq == seq && is_valid) {
+                    continue;
+                }
+                failed.push_back(name);
                 cerr << "[vg msga] failed to include alignment, retrying " << endl
                     << "expected " << seq << endl
                     << "got      " << path_seq << endl
-                    << pb2json(aln.path()) << endl
+                    << pb2json(alns[k].path()) << endl
                     << pb2json(graph->paths.path(name)) << endl;
                 graph->serialize_to_file(name + "-post-edit.vg");
-                ofstream f(name + "-failed-alignment-" + convert(j) + ".gam");
+                ofstream f(name + "-failed-alignment-" + convert(iter) + ".gam");
+                Alignment& aln = alns[k];
                 stream::write(f, 1, (std::function<Alignment(size_t)>)([&aln](size_t n) { return aln; }));
                 stream::finish(f);
                 f.close();
             }
+            pending = failed;
         }
         // if (debug && !graph->is_valid()) cerr << "graph is invalid" << endl;
-        if (incomplete && iter >= iter_max) {
-            cerr << "[vg msga] Error: failed to include path " << name << endl;
+        if (!pending.empty()) {
+            for (auto& name : pending) {
+                cerr << "[vg msga] Error: failed to include path " << name << endl;
+            }
             exit(1);
         }
+        i += batch.size();
     }
 
     // auto include_paths = [&mapper,
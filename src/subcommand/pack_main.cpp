@@ -18,6 +18,7 @@ void help_pack(char** argv) {
          << "    -i, --packs-in FILE    begin by summing coverage packs from each provided FILE" << endl
          << "    -g, --gam FILE         read alignments from this file (could be '-' for stdin)" << endl
          << "    -d, --as-table         write table on stdout representing packs" << endl
+         << "    -D, --node-depth       write table on stdout of the mean coverage of each node" << endl
          << "    -e, --with-edits       record and write edits rather than only recording graph-matching coverage" << endl
          << "    -b, --bin-size N       number of sequence bases per CSA bin [default: inf]" << endl
          << "    -t, --threads N        use N threads (defaults to numCPUs)" << endl;
@@ -30,6 +31,7 @@ int main_pack(int argc, char** argv) {
     string packs_out;
     string gam_in;
     bool write_table = false;
+    bool write_node_depths = false;
     int thread_count = 1;
     bool record_edits = false;
     size_t bin_size = 0;
@@ -50,6 +52,7 @@ int main_pack(int argc, char** argv) {
             {"count-in", required_argument, 0, 'i'},
             {"gam", required_argument, 0, 'g'},
             {"as-table", no_argument, 0, 'd'},
+            {"node-depth", no_argument, 0, 'D'},
             {"threads", required_argument, 0, 't'},
             {"with-edits", no_argument, 0, 'e'},
             {"bin-size", required_argument, 0, 'b'},
@@ -57,7 +60,7 @@ int main_pack(int argc, char** argv) {
 
         };
         int option_index = 0;
-        c = getopt_long (argc, argv, "hx:o:i:g:dt:eb:",
+        c = getopt_long (argc, argv, "hx:o:i:g:dDt:eb:",
                 long_options, &option_index);
 
         // Detect the end of the options.
@@ -86,6 +89,9 @@ int main_pack(int argc, char** argv) {
         case 'd':
             write_table = true;
             break;
+        case 'D':
+            write_node_depths = true;
+            break;
         case 'e':
             record_edits = true;
             break;
@@ -112,8 +118,6 @@ int main_pack(int argc, char** argv) {
         xgidx.load(in);
     }
 
-    // todo one packer per thread and merge
-
     vg::Packer packer(&xgidx, bin_size);
     if (packs_in.size() == 1) {
         packer.load_from_file(packs_in.front());
@@ -122,16 +126,9 @@ int main_pack(int argc, char** argv) {
     }
 
     if (!gam_in.empty()) {
-        vector<vg::Packer*> packers;
-        if (thread_count == 1) {
-            packers.push_back(&packer);
-        } else {
-            for (size_t i = 0; i < thread_count; ++i) {
-                packers.push_back(new Packer(&xgidx, bin_size));
-            }
-        }
-        std::function<void(Alignment&)> lambda = [&packer,&record_edits,&packers](Alignment& aln) {
-            packers[omp_get_thread_num()]->add(aln, record_edits);
+        // all the threads add to the one packer
+        std::function<void(Alignment&)> lambda = [&packer,&record_edits](Alignment& aln) {
+            packer.add(aln, record_edits);
         };
         if (gam_in == "-") {
             stream::for_each_parallel(std::cin, lambda);
@@ -140,15 +137,6 @@ int main_pack(int argc, char** argv) {
             stream::for_each_parallel(gam_stream, lambda);
             gam_stream.close();
         }
-        if (thread_count == 1) {
-            packers.clear();
-        } else {
-            packer.merge_from_dynamic(packers);
-            for (auto& p : packers) {
-                delete p;
-            }
-            packers.clear();
-        }
     }
 
     if (!packs_out.empty()) {
@@ -158,6 +146,14 @@ int main_pack(int argc, char** argv) {
         packer.make_compact();
         packer.as_table(cout, record_edits);
     }
+    if (write_node_depths) {
+        packer.make_compact();
+        vector<double> depths = packer.average_node_coverages();
+        cout << "node.id" << "\t" << "coverage.mean" << endl;
+        for (size_t i = 0; i < depths.size(); ++i) {
+            cout << xgidx.rank_to_id(i + 1) << "\t" << depths[i] << endl;
+        }
+    }
 
     return 0;
 }
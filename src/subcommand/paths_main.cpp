@@ -193,45 +193,50 @@ int main_paths(int argc, char** argv) {
             thread_ids = xg_index->threads_named_starting(thread_prefix);
         }
         
-        for (auto& id : thread_ids) {
-            // For each matching thread
-            
-            // Get its name
-            auto thread_name = xg_index->thread_name(id); 
-        
-            if (list_names) {
-                // We are only interested in the name
-                cout << thread_name << endl;
-                continue;
-            }
-            
-            // Otherwise we need the actual thread data
-            gbwt::vector_type sequence = gbwt_index->extract(gbwt::Path::encode(id-1, false));
-            Path path;
-            path.set_name(thread_name);
-            size_t rank = 1;
-            for (auto node : sequence) {
-                Mapping* m = path.add_mapping();
-                Position* p = m->mutable_position();
-                p->set_node_id(gbwt::Node::id(node));
-                p->set_is_reverse(gbwt::Node::is_reverse(node));
-                Edit* e = m->add_edit();
-                size_t len = xg_index->node_length(p->node_id());
-                e->set_to_length(len);
-                e->set_from_length(len);
-                m->set_rank(rank++);
+        if (list_names) {
+            for (auto& id : thread_ids) {
+                // We are only interested in the names
+                cout << xg_index->thread_name(id) << endl;
             }
-            if (extract_as_gam) {
-                vector<Alignment> alns;
-                alns.emplace_back(xg_index->path_as_alignment(path));
-                write_alignments(cout, alns);
-                stream::finish(cout);
-            } else if (extract_as_vg) {
-                Graph g;
-                *(g.add_path()) = path;
-                vector<Graph> gb = { g };
-                stream::write_buffered(cout, gb, 0);
+        } else {
+            // Extract the threads in parallel, but write them in order, without
+            // holding more than a few at once.
+            stream::OutputQueue output(cout);
+#pragma omp parallel for schedule(dynamic, 1)
+            for (size_t i = 0; i < thread_ids.size(); i++) {
+                int64_t id = thread_ids[i];
+                
+                // Get its name
+                auto thread_name = xg_index->thread_name(id); 
+                
+                gbwt::vector_type sequence = gbwt_index->extract(gbwt::Path::encode(id-1, false));
+                Path path;
+                path.set_name(thread_name);
+                size_t rank = 1;
+                for (auto node : sequence) {
+                    Mapping* m = path.add_mapping();
+                    Position* p = m->mutable_position();
+                    p->set_node_id(gbwt::Node::id(node));
+                    p->set_is_reverse(gbwt::Node::is_reverse(node));
+                    Edit* e = m->add_edit();
+                    size_t len = xg_index->node_length(p->node_id());
+                    e->set_to_length(len);
+                    e->set_from_length(len);
+                    m->set_rank(rank++);
+                }
+                if (extract_as_gam) {
+                    vector<Alignment> alns;
+                    alns.emplace_back(xg_index->path_as_alignment(path));
+                    output.push(i, stream::serialize_group(alns));
+                } else if (extract_as_vg) {
+                    Graph g;
+                    *(g.add_path()) = path;
+                    vector<Graph> gb = { g };
+                    output.push(i, stream::serialize_group(gb));
+                }
             }
+            output.close();
+            stream::finish(cout);
         }
     } else if (graph.get() != nullptr) {
         // Handle non-thread queries from vg
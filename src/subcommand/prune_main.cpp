@@ -18,6 +18,8 @@
  */
 
 #include "../phase_unfolder.hpp"
+#include "../prune.hpp"
+#include "../algorithms/remove_high_degree.hpp"
 #include "subcommand.hpp"
 
 #include <gbwt/gbwt.h>
@@ -106,6 +108,10 @@ void help_prune(char** argv) {
     std::cerr << "                           "; print_defaults(PruningParameters::edge_max);
     std::cerr << "    -s, --subgraph-min N   remove subgraphs of < N bases" << std::endl;
     std::cerr << "                           "; print_defaults(PruningParameters::subgraph_min);
+    std::cerr << "    -M, --max-degree N     remove nodes with > N edges first (default: 0, keep all)" << std::endl;
+    std::cerr << "    -O, --one-pass         find the high-degree nodes, complex regions, and small" << std::endl;
+    std::cerr << "                           subgraphs in a single parallel pass and remove them at once;" << std::endl;
+    std::cerr << "                           kmers are not bounded by head and tail markers" << std::endl;
     std::cerr << "pruning modes (-P, -r, and -u are mutually exclusive):" << std::endl;
     std::cerr << "    -P, --prune            simply prune the graph (default)" << std::endl;
     std::cerr << "    -r, --restore-paths    restore the edges on non-alt paths" << std::endl;
@@ -133,6 +139,8 @@ int main_prune(int argc, char** argv) {
     int kmer_length = 0;
     int edge_max = 0;
     size_t subgraph_min = 0;
+    size_t max_degree = 0;
+    bool one_pass = false;
     PruningMode mode = mode_prune;
     int threads = omp_get_max_threads();
     bool verify_paths = false, append_mapping = false, show_progress = false, dry_run = false;
@@ -149,6 +157,8 @@ int main_prune(int argc, char** argv) {
             { "kmer-length", required_argument, 0, 'k' },
             { "edge-max", required_argument, 0, 'e' },
             { "subgraph-min", required_argument, 0, 's' },
+            { "max-degree", required_argument, 0, 'M' },
+            { "one-pass", no_argument, 0, 'O' },
             { "prune", no_argument, 0, 'P' },
             { "restore-paths", no_argument, 0, 'r' },
             { "unfold-paths", no_argument, 0, 'u' },
@@ -165,7 +175,7 @@ int main_prune(int argc, char** argv) {
         };
 
         int option_index = 0;
-        c = getopt_long(argc, argv, "k:e:s:Pruvx:g:m:apt:dh", long_options, &option_index);
+        c = getopt_long(argc, argv, "k:e:s:M:OPruvx:g:m:apt:dh", long_options, &option_index);
         if (c == -1) { break; } // End of options.
 
         switch (c)
@@ -182,6 +192,12 @@ int main_prune(int argc, char** argv) {
             subgraph_min = parse<size_t>(optarg);
             subgraph_min_set = true;
             break;
+        case 'M':
+            max_degree = parse<size_t>(optarg);
+            break;
+        case 'O':
+            one_pass = true;
+            break;
         case 'P':
             mode = mode_prune;
             break;
@@ -326,15 +342,33 @@ int main_prune(int argc, char** argv) {
     }
 
     // Prune the graph.
-    graph->prune_complex_with_head_tail(kmer_length, edge_max);
-    if (show_progress) {
-        std::cerr << "Pruned complex regions: "
-                  << graph->node_count() << " nodes, " << graph->edge_count() << " edges" << std::endl;
-    }
-    graph->prune_short_subgraphs(subgraph_min);
-    if (show_progress) {
-        std::cerr << "Removed small subgraphs: "
-                  << graph->node_count() << " nodes, " << graph->edge_count() << " edges" << std::endl;
+    if (one_pass) {
+        PruningPlan plan = plan_pruning(*graph, kmer_length, edge_max, max_degree, subgraph_min);
+        apply_pruning(*graph, plan);
+        if (show_progress) {
+            std::cerr << "Pruned " << plan.high_degree_nodes.size() << " high-degree nodes, "
+                      << plan.complex_edges.size() << " complex edges, and "
+                      << plan.small_component_nodes.size() << " nodes in small subgraphs: "
+                      << graph->node_count() << " nodes, " << graph->edge_count() << " edges" << std::endl;
+        }
+    } else {
+        if (max_degree > 0) {
+            algorithms::remove_high_degree_nodes(*graph, max_degree);
+            if (show_progress) {
+                std::cerr << "Removed high-degree nodes: "
+                          << graph->node_count() << " nodes, " << graph->edge_count() << " edges" << std::endl;
+            }
+        }
+        graph->prune_complex_with_head_tail(kmer_length, edge_max);
+        if (show_progress) {
+            std::cerr << "Pruned complex regions: "
+                      << graph->node_count() << " nodes, " << graph->edge_count() << " edges" << std::endl;
+        }
+        graph->prune_short_subgraphs(subgraph_min);
+        if (show_progress) {
+            std::cerr << "Removed small subgraphs: "
+                      << graph->node_count() << " nodes, " << graph->edge_count() << " edges" << std::endl;
+        }
     }
 
     // Restore the non-alt paths.
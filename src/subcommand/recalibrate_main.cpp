@@ -6,6 +6,7 @@
 
 #include <string>
 #include <sstream>
+#include <vector>
 
 #include <subcommand.hpp>
 
@@ -160,29 +161,39 @@ int main_recalibrate(int argc, char** argv) {
             // TODO: Note that vw defines a VW namespace but dumps its vw type into the global namespace.
             vw* model = VW::initialize(vw_args);
             
-            function<void(Alignment&)> train_on = [&](Alignment& aln) {
-                
-                // Turn each Alignment into a VW-format string
-                string example_string = alignment_to_example_string(aln, true);
-                
-                // Load an example for each Alignment.
-                // You can apparently only have so many examples at a time because they live in a ring buffer of unspecified size.
-                // TODO: There are non-string-parsing-based ways to do this too.
-                // TODO: Why link against vw at all if we're just going to shuffle strings around? We could pipe to it.
-                // TODO: vw alo dumps "example" into the global namespace...
-                example* example = VW::read_example(*model, example_string);
+            // The VW-format strings for the batch we are working on
+            vector<string> example_strings;
+            
+            function<void(int64_t, vector<Alignment>&)> train_on = [&](int64_t virtual_offset, vector<Alignment>& batch) {
                 
-                // Now we call the learn method, defined in vowpalwabbit/global_data.h.
-                // It's not clear what it does but it is probably training.
-                // If we didn't label the data, this would just predict instead.
-                model->learn(example);
+                // Turn each Alignment into a VW-format string, in parallel
+                example_strings.resize(batch.size());
+#pragma omp parallel for
+                for (size_t i = 0; i < batch.size(); i++) {
+                    example_strings[i] = alignment_to_example_string(batch[i], true);
+                }
                 
-                // Clean up the example
-                VW::finish_example(*model, example);
+                // VW learns online, so hand the examples over in order.
+                for (auto& example_string : example_strings) {
+                    // Load an example for each Alignment.
+                    // You can apparently only have so many examples at a time because they live in a ring buffer of unspecified size.
+                    // TODO: There are non-string-parsing-based ways to do this too.
+                    // TODO: vw alo dumps "example" into the global namespace...
+                    example* example = VW::read_example(*model, example_string);
+                    
+                    // Now we call the learn method, defined in vowpalwabbit/global_data.h.
+                    // It's not clear what it does but it is probably training.
+                    // If we didn't label the data, this would just predict instead.
+                    model->learn(example);
+                    
+                    // Clean up the example
+                    VW::finish_example(*model, example);
+                }
             };
             
-            // TODO: We have to go in serial because vw isn't thread safe I think.
-            stream::for_each(gam_stream, train_on);
+            // The features are made in parallel, but the training has to go in
+            // serial because one vw model isn't thread safe.
+            stream::for_each_in_batches(gam_stream, 1000 * get_thread_count(), train_on);
             
             // Now we want to output the model.
             // TODO: We had to specify that already. I think it is magic?
@@ -200,14 +211,14 @@ int main_recalibrate(int argc, char** argv) {
                 vw_args += " -i " + model_filename;
             }
             
-            // Make the model
-            vw* model = VW::initialize(vw_args);
-       
-            // Define a buffer for alignments to print
-            vector<Alignment> buf;
+            // Make a copy of the model for each thread, since they can't share
+            vector<vw*> models;
+            for (int i = 0; i < get_thread_count(); i++) {
+                models.push_back(VW::initialize(vw_args));
+            }
             
-            // Specify how to recalibrate an alignment
-            function<void(Alignment&)> recalibrate = [&](Alignment& aln) {
+            // Specify how to recalibrate an alignment with a thread's model
+            auto recalibrate = [&](vw* model, Alignment& aln) {
                 
                 // Turn each Alignment into a VW-format string
                 string example_string = alignment_to_example_string(aln, false);
@@ -228,6 +239,7 @@ int main_recalibrate(int argc, char** argv) {
                 double clamped = max(0.0, min(60.0, guess));
                
 #ifdef debug
+#pragma omp critical (cerr)
                 cerr << example_string << " -> " << prob << " -> " << guess << " -> " << clamped << endl;
 #endif
                 
@@ -236,30 +248,23 @@ int main_recalibrate(int argc, char** argv) {
                 
                 // Clean up the example
                 VW::finish_example(*model, example);
-                
-                
-                
-#pragma omp critical (buf)
-                {
-                    // Save to the buffer
-                    buf.push_back(aln);
-                    if (buf.size() > 1000) {
-                        // And output if buffer is full
-                        write_alignments(cout, buf);
-                        buf.clear();
-                    }
-                }
             };
             
-            // For each read, recalibrate and buffer and maybe print it.
-            // TODO: It would be nice if this could be parallel...
-            stream::for_each(gam_stream, recalibrate);
+            // For each batch of reads, recalibrate them in parallel and print
+            // them in the order they came in.
+            function<void(int64_t, vector<Alignment>&)> recalibrate_batch = [&](int64_t virtual_offset, vector<Alignment>& batch) {
+#pragma omp parallel for
+                for (size_t i = 0; i < batch.size(); i++) {
+                    recalibrate(models[omp_get_thread_num()], batch[i]);
+                }
+                write_alignments(cout, batch);
+            };
+            stream::for_each_in_batches(gam_stream, 1000 * get_thread_count(), recalibrate_batch);
             
-            VW::finish(*model);
+            for (vw* model : models) {
+                VW::finish(*model);
+            }
             
-            // Flush the buffer
-            write_alignments(cout, buf);
-            buf.clear();
             // Finish the stream with an EOF marker
             stream::finish(cout);
             cout.flush();
@@ -0,0 +1,611 @@
+/** \file server_main.cpp
+ *
+ * Defines the "vg server" subcommand, which keeps mapping indexes loaded and
+ * runs vg map and vg mpmap jobs against them for clients on a local socket.
+ */
+
+#include <omp.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <signal.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "subcommand.hpp"
+
+#include "../utility.hpp"
+#include "../resident_indexes.hpp"
+#include "../huge_pages.hpp"
+
+using namespace std;
+using namespace vg;
+using namespace vg::subcommand;
+
+void help_server(char** argv) {
+    cerr << "usage: " << argv[0] << " server [options] -s SOCKET" << endl
+         << "       " << argv[0] << " server -c SOCKET [-t N] map|mpmap [options] > output" << endl
+         << "Keep indexes loaded, and run vg map and vg mpmap jobs that use them instead of loading their own." << endl
+         << "Jobs run in the client's working directory, on the client's standard input, output, and error." << endl
+         << endl
+         << "server options:" << endl
+         << "    -s, --socket FILE      listen for jobs on this Unix domain socket" << endl
+         << "    -x, --xg-name FILE     keep this xg index loaded (may repeat)" << endl
+         << "    -g, --gcsa-name FILE   keep this GCSA2 index, with its .lcp and .kmers files, loaded (may repeat)" << endl
+         << "    -H, --gbwt-name FILE   keep this GBWT index loaded (may repeat)" << endl
+         << "    -t, --threads N        threads shared among all running jobs [all]" << endl
+         << "    -j, --max-jobs N       run at most N jobs at once, and make other clients wait [4]" << endl
+         << "    --huge-pages           back the indexes with transparent huge pages, which jobs share" << endl
+         << "client options:" << endl
+         << "    -c, --connect FILE     run the rest of the command line on the server listening here" << endl
+         << "    -t, --threads N        threads for the job, up to the server's limit [1]" << endl;
+}
+
+/// Set by the signal handler when the server should stop taking jobs
+static volatile sig_atomic_t stop_requested = 0;
+
+static void request_stop(int signal_number) {
+    stop_requested = 1;
+}
+
+/// Write all of the given bytes, retrying on interruption. Returns false on
+/// error.
+static bool write_all(int fd, const void* data, size_t length) {
+    const char* cursor = (const char*) data;
+    while (length > 0) {
+        ssize_t written = write(fd, cursor, length);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        cursor += written;
+        length -= written;
+    }
+    return true;
+}
+
+/// Read exactly the given number of bytes, retrying on interruption. Returns
+/// false on error or on end of file.
+static bool read_all(int fd, void* data, size_t length) {
+    char* cursor = (char*) data;
+    while (length > 0) {
+        ssize_t got = read(fd, cursor, length);
+        if (got < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        if (got == 0) {
+            return false;
+        }
+        cursor += got;
+        length -= got;
+    }
+    return true;
+}
+
+/**
+ * A job request is the length of its payload, sent along with the client's
+ * standard input, output, and error descriptors, and then the payload: the
+ * thread count, working directory, and each argument, all NUL-terminated.
+ */
+static bool send_request(int sock, size_t threads, const string& cwd, const vector<string>& args) {
+    string payload = to_string(threads);
+    payload.push_back('\0');
+    payload += cwd;
+    payload.push_back('\0');
+    for (auto& arg : args) {
+        payload += arg;
+        payload.push_back('\0');
+    }
+    uint32_t length = payload.size();
+
+    int fds[3] = {STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO};
+    char control[CMSG_SPACE(sizeof(fds))];
+    memset(control, 0, sizeof(control));
+
+    struct iovec iov;
+    iov.iov_base = &length;
+    iov.iov_len = sizeof(length);
+
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    struct cmsghdr* header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(header), fds, sizeof(fds));
+
+    ssize_t sent;
+    do {
+        sent = sendmsg(sock, &message, 0);
+    } while (sent < 0 && errno == EINTR);
+    if (sent != sizeof(length)) {
+        return false;
+    }
+    return write_all(sock, payload.data(), payload.size());
+}
+
+/// Receive a job request sent by send_request(). Any descriptors received are
+/// put in fds, and those not received are set to -1. Returns false if the
+/// request is incomplete or malformed.
+static bool receive_request(int conn, size_t& threads, string& cwd, vector<string>& args, int fds[3]) {
+    fds[0] = fds[1] = fds[2] = -1;
+
+    uint32_t length = 0;
+    char control[CMSG_SPACE(3 * sizeof(int))];
+
+    struct iovec iov;
+    iov.iov_base = &length;
+    iov.iov_len = sizeof(length);
+
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    ssize_t got;
+    do {
+        got = recvmsg(conn, &message, MSG_WAITALL);
+    } while (got < 0 && errno == EINTR);
+
+    for (struct cmsghdr* header = CMSG_FIRSTHDR(&message); header != nullptr; header = CMSG_NXTHDR(&message, header)) {
+        if (header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_RIGHTS
+            && header->cmsg_len == CMSG_LEN(3 * sizeof(int))) {
+            memcpy(fds, CMSG_DATA(header), 3 * sizeof(int));
+        }
+    }
+    if (got != sizeof(length) || fds[0] < 0 || (message.msg_flags & MSG_CTRUNC)) {
+        return false;
+    }
+
+    string payload(length, '\0');
+    if (!read_all(conn, &payload[0], length)) {
+        return false;
+    }
+
+    vector<string> fields;
+    size_t start = 0;
+    for (size_t i = 0; i < payload.size(); i++) {
+        if (payload[i] == '\0') {
+            fields.emplace_back(payload, start, i - start);
+            start = i + 1;
+        }
+    }
+    if (start != payload.size() || fields.size() < 3) {
+        return false;
+    }
+
+    threads = strtoull(fields[0].c_str(), nullptr, 10);
+    cwd = fields[1];
+    args.assign(fields.begin() + 2, fields.end());
+    return true;
+}
+
+/// Send a job's exit status back to its client and hang up.
+static void send_status(int conn, int32_t status) {
+    write_all(conn, &status, sizeof(status));
+    close(conn);
+}
+
+/// Fill in a socket address for the given path, or return false if the path
+/// is too long to fit.
+static bool make_address(const string& socket_name, struct sockaddr_un& address) {
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (socket_name.size() >= sizeof(address.sun_path)) {
+        return false;
+    }
+    strcpy(address.sun_path, socket_name.c_str());
+    return true;
+}
+
+/// Send the given subcommand line to the server, and return the job's exit
+/// status once it finishes.
+static int run_client(const string& socket_name, size_t threads, const vector<string>& args) {
+    struct sockaddr_un address;
+    if (!make_address(socket_name, address)) {
+        cerr << "error:[vg server] socket path " << socket_name << " is too long" << endl;
+        return 1;
+    }
+
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock < 0 || connect(sock, (struct sockaddr*) &address, sizeof(address)) != 0) {
+        cerr << "error:[vg server] could not connect to server at " << socket_name << ": " << strerror(errno) << endl;
+        return 1;
+    }
+
+    char cwd[PATH_MAX];
+    if (getcwd(cwd, sizeof(cwd)) == nullptr) {
+        cerr << "error:[vg server] could not get working directory: " << strerror(errno) << endl;
+        return 1;
+    }
+
+    // Anything we were about to write would interleave with the job's output
+    cout.flush();
+    cerr.flush();
+
+    if (!send_request(sock, threads, cwd, args)) {
+        cerr << "error:[vg server] could not send job to server at " << socket_name << endl;
+        return 1;
+    }
+
+    // The server answers once the job is done, which may be a long time if
+    // it is busy with other jobs
+    int32_t status;
+    if (!read_all(sock, &status, sizeof(status))) {
+        cerr << "error:[vg server] server at " << socket_name << " hung up before the job finished" << endl;
+        return 1;
+    }
+    close(sock);
+    return status;
+}
+
+/// A job that has been received and is waiting for, or using, a share of the
+/// server's threads
+struct ServerJob {
+    int conn = -1;
+    size_t threads = 1;
+    string cwd;
+    vector<string> args;
+    int fds[3] = {-1, -1, -1};
+};
+
+/// Run a job in a forked child process, with the job's descriptors as its
+/// standard streams, and exit with its return code. Never returns.
+static void run_job(const ServerJob& job) {
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    signal(SIGPIPE, SIG_DFL);
+
+    for (int i = 0; i < 3; i++) {
+        if (dup2(job.fds[i], i) < 0) {
+            _exit(1);
+        }
+    }
+    for (int i = 0; i < 3; i++) {
+        if (job.fds[i] > 2) {
+            close(job.fds[i]);
+        }
+    }
+
+    if (chdir(job.cwd.c_str()) != 0) {
+        cerr << "error:[vg server] could not enter working directory " << job.cwd << ": " << strerror(errno) << endl;
+        exit(1);
+    }
+
+    omp_set_num_threads(job.threads);
+
+    // Run the subcommand as if from its own command line, with the thread
+    // count we granted it overriding any it asked for
+    vector<string> job_args{"vg"};
+    job_args.insert(job_args.end(), job.args.begin(), job.args.end());
+    job_args.push_back("-t");
+    job_args.push_back(to_string(job.threads));
+    vector<char*> job_argv;
+    for (auto& arg : job_args) {
+        job_argv.push_back(&arg[0]);
+    }
+    job_argv.push_back(nullptr);
+    int job_argc = job_args.size();
+
+    const Subcommand* subcommand = Subcommand::get(job_argc, job_argv.data());
+    if (subcommand == nullptr) {
+        cerr << "error:[vg server] unknown subcommand " << job.args.front() << endl;
+        exit(1);
+    }
+    optind = 2;
+    int code = (*subcommand)(job_argc, job_argv.data());
+    cout.flush();
+    cerr.flush();
+    exit(code);
+}
+
+int main_server(int argc, char** argv) {
+
+    if (argc == 2) {
+        help_server(argv);
+        return 1;
+    }
+
+    string socket_name;
+    string connect_name;
+    vector<string> xg_names;
+    vector<string> gcsa_names;
+    vector<string> gbwt_names;
+    size_t threads = 0;
+    size_t max_jobs = 4;
+    bool huge_pages = false;
+
+    #define OPT_HUGE_PAGES 1000
+
+    int c;
+    optind = 2; // force optind past command positional argument
+    while (true) {
+        static struct option long_options[] =
+        {
+            {"help", no_argument, 0, 'h'},
+            {"socket", required_argument, 0, 's'},
+            {"xg-name", required_argument, 0, 'x'},
+            {"gcsa-name", required_argument, 0, 'g'},
+            {"gbwt-name", required_argument, 0, 'H'},
+            {"threads", required_argument, 0, 't'},
+            {"max-jobs", required_argument, 0, 'j'},
+            {"connect", required_argument, 0, 'c'},
+            {"huge-pages", no_argument, 0, OPT_HUGE_PAGES},
+            {0, 0, 0, 0}
+        };
+
+        int option_index = 0;
+        // Stop at the first positional argument, so the job's own options
+        // are left for it
+        c = getopt_long (argc, argv, "+hs:x:g:H:t:j:c:",
+                long_options, &option_index);
+
+        // Detect the end of the options.
+        if (c == -1)
+            break;
+
+        switch (c)
+        {
+        case 's':
+            socket_name = optarg;
+            break;
+
+        case 'x':
+            xg_names.push_back(optarg);
+            break;
+
+        case 'g':
+            gcsa_names.push_back(optarg);
+            break;
+
+        case 'H':
+            gbwt_names.push_back(optarg);
+            break;
+
+        case 't':
+            threads = parse<size_t>(optarg);
+            break;
+
+        case 'j':
+            max_jobs = parse<size_t>(optarg);
+            break;
+
+        case 'c':
+            connect_name = optarg;
+            break;
+
+        case OPT_HUGE_PAGES:
+            huge_pages = true;
+            break;
+
+        case 'h':
+        case '?':
+            help_server(argv);
+            exit(1);
+            break;
+
+        default:
+            abort ();
+        }
+    }
+
+    if (!connect_name.empty()) {
+        if (optind >= argc) {
+            cerr << "error:[vg server] a subcommand to run on the server is required" << endl;
+            return 1;
+        }
+        return run_client(connect_name, max<size_t>(threads, 1), vector<string>(argv + optind, argv + argc));
+    }
+
+    if (socket_name.empty()) {
+        cerr << "error:[vg server] a socket to listen on (-s) is required" << endl;
+        return 1;
+    }
+    if (optind != argc) {
+        cerr << "error:[vg server] unexpected argument " << argv[optind] << endl;
+        return 1;
+    }
+    if (max_jobs == 0) {
+        cerr << "error:[vg server] at least one job (-j) must be allowed" << endl;
+        return 1;
+    }
+    size_t total_threads = threads ? threads : get_thread_count();
+
+    // Load everything before we listen, so clients never see a partial set
+    ResidentIndexes& resident = ResidentIndexes::get();
+    try {
+        for (auto& name : xg_names) {
+            resident.load_xg(name);
+        }
+        for (auto& name : gcsa_names) {
+            resident.load_gcsa(name);
+        }
+        for (auto& name : gbwt_names) {
+            resident.load_gbwt(name);
+        }
+    } catch (const runtime_error& e) {
+        cerr << "error:[vg server] " << e.what() << endl;
+        return 1;
+    }
+    if (resident.empty()) {
+        cerr << "error:[vg server] at least one index (-x, -g, or -H) is required" << endl;
+        return 1;
+    }
+    if (huge_pages) {
+        advise_huge_pages();
+        HugePageUsage usage = huge_page_usage();
+        cerr << "[vg server] " << usage.huge_page_bytes / (1024 * 1024) << " of "
+             << usage.anonymous_bytes / (1024 * 1024) << " MB of anonymous memory is in huge pages" << endl;
+    }
+
+    struct sockaddr_un address;
+    if (!make_address(socket_name, address)) {
+        cerr << "error:[vg server] socket path " << socket_name << " is too long" << endl;
+        return 1;
+    }
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0 || ::bind(listen_fd, (struct sockaddr*) &address, sizeof(address)) != 0) {
+        cerr << "error:[vg server] could not listen on " << socket_name << ": " << strerror(errno) << endl;
+        if (errno == EADDRINUSE) {
+            cerr << "error:[vg server] remove it if no server is running there" << endl;
+        }
+        return 1;
+    }
+    if (listen(listen_fd, 64) != 0) {
+        cerr << "error:[vg server] could not listen on " << socket_name << ": " << strerror(errno) << endl;
+        unlink(socket_name.c_str());
+        return 1;
+    }
+
+    // Stop taking jobs on interrupt, but let the running ones finish. Don't
+    // restart system calls, so a waiting poll() notices promptly.
+    struct sigaction stop_action;
+    memset(&stop_action, 0, sizeof(stop_action));
+    stop_action.sa_handler = request_stop;
+    sigemptyset(&stop_action.sa_mask);
+    sigaction(SIGINT, &stop_action, nullptr);
+    sigaction(SIGTERM, &stop_action, nullptr);
+    // A client that goes away shouldn't take the server with it
+    signal(SIGPIPE, SIG_IGN);
+
+    cerr << "[vg server] listening on " << socket_name << " with " << total_threads << " threads" << endl;
+
+    // The running jobs, by process ID, with their connections and threads
+    map<pid_t, pair<int, size_t>> running;
+    size_t free_threads = total_threads;
+    // A job we've received and can't start until others finish. While it's
+    // waiting we don't accept more, so further clients queue in the backlog.
+    ServerJob pending;
+    bool have_pending = false;
+
+    auto reap = [&](bool block) {
+        int status;
+        pid_t pid;
+        while (!running.empty()) {
+            pid = waitpid(-1, &status, block ? 0 : WNOHANG);
+            if (pid < 0 && errno == EINTR) {
+                continue;
+            }
+            if (pid <= 0) {
+                break;
+            }
+            auto found = running.find(pid);
+            if (found == running.end()) {
+                continue;
+            }
+            int32_t code = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+            send_status(found->second.first, code);
+            free_threads += found->second.second;
+            running.erase(found);
+        }
+    };
+
+    auto close_job_fds = [](ServerJob& job) {
+        for (int i = 0; i < 3; i++) {
+            if (job.fds[i] >= 0) {
+                close(job.fds[i]);
+                job.fds[i] = -1;
+            }
+        }
+    };
+
+    while (!stop_requested) {
+        reap(false);
+
+        if (have_pending) {
+            if (running.size() < max_jobs && free_threads >= pending.threads) {
+                pid_t pid = fork();
+                if (pid == 0) {
+                    close(listen_fd);
+                    close(pending.conn);
+                    for (auto& job : running) {
+                        close(job.second.first);
+                    }
+                    run_job(pending);
+                }
+                if (pid < 0) {
+                    dprintf(pending.fds[2], "error:[vg server] could not start job: %s\n", strerror(errno));
+                    send_status(pending.conn, 1);
+                } else {
+                    running[pid] = make_pair(pending.conn, pending.threads);
+                    free_threads -= pending.threads;
+                }
+                close_job_fds(pending);
+                have_pending = false;
+            } else {
+                // Wait for a job to finish
+                usleep(100000);
+            }
+            continue;
+        }
+
+        struct pollfd listening;
+        listening.fd = listen_fd;
+        listening.events = POLLIN;
+        if (poll(&listening, 1, 100) <= 0 || !(listening.revents & POLLIN)) {
+            continue;
+        }
+
+        int conn = accept(listen_fd, nullptr, nullptr);
+        if (conn < 0) {
+            continue;
+        }
+
+        ServerJob job;
+        job.conn = conn;
+        if (!receive_request(conn, job.threads, job.cwd, job.args, job.fds)) {
+            close_job_fds(job);
+            close(conn);
+            continue;
+        }
+        if (job.args.empty() || (job.args.front() != "map" && job.args.front() != "mpmap")) {
+            dprintf(job.fds[2], "error:[vg server] only map and mpmap jobs can run on the server\n");
+            close_job_fds(job);
+            send_status(conn, 1);
+            continue;
+        }
+        job.threads = max<size_t>(1, min(job.threads, total_threads));
+
+        pending = move(job);
+        have_pending = true;
+    }
+
+    if (have_pending) {
+        dprintf(pending.fds[2], "error:[vg server] server stopped before the job could start\n");
+        close_job_fds(pending);
+        send_status(pending.conn, 1);
+    }
+    close(listen_fd);
+    unlink(socket_name.c_str());
+
+    // Let the jobs we started finish and tell their clients
+    reap(true);
+
+    return 0;
+}
+
+// Register subcommand
+static Subcommand vg_server("server", "keep mapping indexes loaded, and run map and mpmap jobs on them", main_server);
@@ -13,6 +13,7 @@
 #include "vg.pb.h"
 #include "../filter.hpp"
 #include "../alignment.hpp"
+#include "../path_position_index.hpp"
 
 using namespace std;
 using namespace vg;
@@ -28,17 +29,18 @@ void help_sift(char** argv){
     cerr << "Usage: " << argv[0] << " sift [options] <alignments.gam>" << endl
         << "Sift through a GAM and select / remove reads with particular properties." << endl
         << "General Options: " << endl
-        << "    -t / --threads  <MTHRDS>    number of OMP threads (not all algorithms are parallelized)." << endl
+        << "    -t / --threads  <MTHRDS>    number of OMP threads." << endl
         //<< "    -v / --inverse      return the inverse of a query (like grep -v)"   << endl
-        << "    -x / --xg  <MYXG>   An XG index (for realignment of split reads)" << endl
+        << "    -x / --xg  <MYXG>   An XG index (for path positions of pairs, and realignment of split reads)" << endl
         << "    -p / --paired       Input reads are paired-end" << endl
         << "    -R / --remap        Remap (locally) any soft-clipped, split, or discordant read pairs." << endl
         << "    -o / --output <PREFIX>" << endl
         << "Paired-end options:" << endl
-        << "    -I / --insert-size <INSRTSZ>        Insert size mean. Flag reads where ((I - insrtsz) / W) > 2.95" << endl
+        << "    -I / --insert-size <INSRTSZ>        Insert size mean. Flag reads where ((I - insrtsz) / W) > 1.95." << endl
+        << "                                        Pairs without fragment lengths get them from path positions if -x is given." << endl
         << "    -W / --insert-size-sigma <SIGMA>    Standard deviation of insert size." << endl
         << "    -O / --one-end-anchored             Flag reads where one read of the pair is mapped and the other is unmapped." << endl
-        << "    -C / --interchromosomal             Flag reads mapping to two distinct Paths" << endl
+        << "    -C / --interchromosomal             Flag reads mapping to two distinct Paths (uses -x if given)" << endl
         << "    -D / --discordant-orientation       Flag reads that do not have the expected --> <-- orientation." << endl
         << "Single-end / individual read options:" << endl
         << "    -c / --softclip <MAXCLIPLEN>        Flag reads with softclipped sections longer than MAXCLIPLEN" << endl
@@ -64,6 +66,7 @@ int main_sift(int argc, char** argv){
 
     string alignment_file = "";
     string graph_name = "";
+    string xg_name = "";
     int threads = 1;
 
     bool inverse = false;
@@ -80,9 +83,6 @@ int main_sift(int argc, char** argv){
     bool do_reversing = false;
     bool do_interchromosomal = false;
     bool do_split_read = false;
-    bool do_depth = false;
-    bool do_percent_id = false;
-    bool do_quality = false;
     bool do_unmapped = false;
 
     bool just_calc_insert = false;
@@ -93,16 +93,8 @@ int main_sift(int argc, char** argv){
 
 
     int softclip_max = 15;
-    int max_path_length = 200;
 
     int split_read_limit = 15;
-    double depth = -1;
-
-
-    int window = 0;
-    bool use_avg = false;
-    double pct_id = 0;
-    double quality = 0.0;
 
     Filter ff;
 
@@ -133,6 +125,9 @@ int main_sift(int argc, char** argv){
             case 't':
                 threads = parse<int>(optarg);
                 break;
+            case 'x':
+                xg_name = optarg;
+                break;
             case 'G':
                 graph_name = optarg;
                 break;
@@ -156,14 +151,9 @@ int main_sift(int argc, char** argv){
                 do_all = false;
                 break;
             case 'q':
-                do_quality = true;
-                do_all = false;
-                quality = parse<double>(optarg);
-                break;
             case 'd':
-                do_depth = true;
+                // Quality and depth sifting aren't implemented
                 do_all = false;
-                depth = parse<double>(optarg);
                 break;
             case 'R':
                 remap = true;
@@ -219,12 +209,26 @@ int main_sift(int argc, char** argv){
 
     cerr << "Filtering  " << alignment_file << endl;
 
-    vg::VG* graph;
     if (!graph_name.empty()){
         ifstream gstream(graph_name);
         ff.my_vg = new vg::VG(gstream);
     }
 
+    unique_ptr<xg::XG> xg_index;
+    unique_ptr<PathPositionIndex> path_positions;
+    if (!xg_name.empty()){
+        ifstream xg_stream(xg_name);
+        if (!xg_stream) {
+            cerr << "error:[vg sift] could not open XG index " << xg_name << endl;
+            return 1;
+        }
+        xg_index = unique_ptr<xg::XG>(new xg::XG(xg_stream));
+        ff.set_my_xg_idx(xg_index.get());
+        // Look up where mates fall on the paths without going through the
+        // XG's path structures for every read
+        path_positions = unique_ptr<PathPositionIndex>(new PathPositionIndex(*xg_index));
+    }
+
     omp_set_num_threads(threads);
     ff.set_inverse(inverse);
 
@@ -240,352 +244,264 @@ int main_sift(int argc, char** argv){
     do_softclip = true;
     do_reversing = true;
     do_interchromosomal = true;
-    do_split_read = true;
-    do_depth = true;
-    do_percent_id = true;
-    do_quality = true;
+    // Split reads can only be found with the indexes to realign them
+    do_split_read = ff.my_xg_index != nullptr && ff.gcsa_ind != nullptr;
     do_unmapped = true;
 
     }
 
-    vector<Alignment> buffer;
-    
-    
-
-    //vector<Alignment> orphaned_selected;
-    vector<Alignment> clean;
-    vector<Alignment> perfect;
-    vector<Alignment> simple_mismatch;
-    vector<Alignment> discordant_selected;
-    vector<Alignment> split_selected;
-    vector<Alignment> reversing_selected;
-    vector<Alignment> clipped_selected;
-    vector<Alignment> one_end_anchored;
-    vector<Alignment> quality_selected;
-    vector<Alignment> insert_selected;
-    vector<Alignment> depth_selected;
-    vector<Alignment> single_bp_diff;
-    vector<Alignment> unmapped_selected;
-
-    string unmapped_fn = alignment_file + ".unmapped";
-    string discordant_fn = alignment_file + ".discordant";
-    string split_fn = alignment_file + ".split";
-    string reversing_fn = alignment_file +  ".reversing";
-    string oea_fn = alignment_file + ".one_end_anchored";
-    string clipped_fn = alignment_file + ".softclipped";
-    string insert_fn = alignment_file + ".insert_size";
-    string quality_fn = alignment_file + ".quality";
-    string depth_fn = alignment_file + ".depth";
-    string clean_fn = alignment_file + ".clean";
-    string perfect_fn = alignment_file + ".perfect";
-
-    ofstream unmapped_stream;
-    ofstream discordant_stream;
-    ofstream split_stream;
-    ofstream reversing_stream;
-    ofstream oea_stream;
-    ofstream clipped_stream;
-    ofstream insert_stream;
-    ofstream quality_stream;
-    ofstream depth_stream;
-    ofstream clean_stream;
-    ofstream perfect_stream;
-
-    if (do_reversing){
-        reversing_stream.open(reversing_fn);
-    }
-
-    if (do_unmapped){
-        unmapped_stream.open(unmapped_fn);
-    }
-
-    if (do_orientation){
-        discordant_stream.open(discordant_fn);
-    }
-
-    if (do_oea){
-        oea_stream.open(oea_fn);
-    }
-
-    if (do_split_read){
-        split_stream.open(split_fn);
-    }
-    if (do_insert_size){
-        insert_stream.open(insert_fn);
-    }
-    if (do_softclip){
-        clipped_stream.open(clipped_fn);
+    // Each kind of read we sift out goes to its own file. Threads collect
+    // reads in buffers of their own, and hand full buffers to a queue that
+    // writes the file from one thread.
+    enum { UNMAPPED, DISCORDANT, ONE_END_ANCHORED, INSERT_SIZE, INTERCHROMOSOMAL,
+           SPLIT, REVERSING, SOFTCLIPPED, CLEAN, SIEVE_COUNT };
+    struct Sieve {
+        string suffix;
+        bool enabled;
+        ofstream out;
+        unique_ptr<stream::OutputQueue> queue;
+        vector<vector<Alignment>> buffers;
+    };
+    Sieve sieves[SIEVE_COUNT];
+    sieves[UNMAPPED].suffix = ".unmapped";
+    sieves[UNMAPPED].enabled = do_unmapped;
+    sieves[DISCORDANT].suffix = ".discordant";
+    sieves[DISCORDANT].enabled = do_orientation;
+    sieves[ONE_END_ANCHORED].suffix = ".one_end_anchored";
+    sieves[ONE_END_ANCHORED].enabled = do_oea;
+    sieves[INSERT_SIZE].suffix = ".insert_size";
+    sieves[INSERT_SIZE].enabled = do_insert_size;
+    sieves[INTERCHROMOSOMAL].suffix = ".interchromosomal";
+    sieves[INTERCHROMOSOMAL].enabled = do_interchromosomal;
+    sieves[SPLIT].suffix = ".split";
+    sieves[SPLIT].enabled = do_split_read;
+    sieves[REVERSING].suffix = ".reversing";
+    sieves[REVERSING].enabled = do_reversing;
+    sieves[SOFTCLIPPED].suffix = ".softclipped";
+    sieves[SOFTCLIPPED].enabled = do_softclip;
+    // Whatever isn't sifted out is only known to be clean if we looked for everything
+    sieves[CLEAN].suffix = ".clean";
+    sieves[CLEAN].enabled = do_all;
+
+    int thread_count = omp_get_max_threads();
+    for (auto& sieve : sieves) {
+        if (!sieve.enabled) {
+            continue;
+        }
+        string filename = alignment_file + sieve.suffix;
+        sieve.out.open(filename);
+        if (!sieve.out) {
+            cerr << "error:[vg sift] could not open " << filename << " for writing" << endl;
+            return 1;
+        }
+        sieve.queue = unique_ptr<stream::OutputQueue>(new stream::OutputQueue(sieve.out));
+        sieve.buffers.resize(thread_count);
     }
 
-    std::function<bool(Alignment, Alignment)> normalish = [&](Alignment a, Alignment b){
-        bool a_forward = true;
-        bool b_reverse = false;
-        for (int i = 0; i < a.path().mapping_size(); i++){
-            if (a.path().mapping(i).position().is_reverse()){
-                a_forward = false;
+    // Buffers are sent off between reads or pairs, so mates stay together
+    size_t buffer_size = 1000;
+    auto keep = [&](int sieve, const Alignment& aln) {
+        sieves[sieve].buffers[omp_get_thread_num()].push_back(aln);
+    };
+    auto send_full_buffers = [&]() {
+        for (auto& sieve : sieves) {
+            if (sieve.enabled) {
+                auto& buffer = sieve.buffers[omp_get_thread_num()];
+                if (buffer.size() >= buffer_size) {
+                    sieve.queue->push(stream::serialize_group(buffer));
+                    buffer.clear();
+                }
             }
         }
-        for (int i = 0; i < b.path().mapping_size(); i++){
-            if (b.path().mapping(i).position().is_reverse()){
-                b_reverse = true;
+    };
+
+    // Get the paths the first placed base of the read is on, and its offsets along them
+    auto path_offsets = [&](const Alignment& aln) {
+        map<string, vector<pair<size_t, bool>>> offsets;
+        for (auto& mapping : aln.path().mapping()) {
+            if (mapping.has_position() && mapping.position().node_id() != 0) {
+                offsets = path_positions->offsets_in_paths(make_pos_t(mapping.position()));
+                break;
             }
         }
-        return (a_forward != b_reverse);
+        return offsets;
     };
 
-
     std::function<void(Alignment&, Alignment&)> pair_filters = [&](Alignment& alns_first, Alignment& alns_second){
-        bool ret;
         bool flagged = false;
 
-        if (do_unmapped && !flagged){
-            if (ff.unmapped_filter(alns_first) && ff.unmapped_filter(alns_second)){
-
-                    #pragma omp critical (unmapped_selected)
-                    {
-                        flagged = true;
-                        alns_first.set_read_mapped(false);
-                        alns_first.set_mate_unmapped(true);
-                        alns_second.set_read_mapped(false);
-                        alns_second.set_mate_unmapped(false);
-                        unmapped_selected.push_back(alns_first);
-                        unmapped_selected.push_back(alns_second);
-                        
+        // Fill in what the mapper would have told us about where the mates
+        // fall on the paths, if it didn't
+        map<string, vector<pair<size_t, bool>>> first_offsets, second_offsets;
+        if (path_positions) {
+            first_offsets = path_offsets(alns_first);
+            second_offsets = path_offsets(alns_second);
+            if (alns_first.fragment_size() == 0 && alns_second.fragment_size() == 0) {
+                for (auto& path : first_offsets) {
+                    auto found = second_offsets.find(path.first);
+                    if (found != second_offsets.end() && !path.second.empty() && !found->second.empty()) {
+                        int64_t length = abs((int64_t) found->second.front().first - (int64_t) path.second.front().first);
+                        for (Alignment* aln : {&alns_first, &alns_second}) {
+                            Path* fragment = aln->add_fragment();
+                            fragment->set_name(path.first);
+                            fragment->set_length(length);
+                        }
+                        break;
                     }
                 }
+            }
         }
 
-        if (do_orientation && !flagged){
-            
-            ret = ff.pair_orientation_filter(alns_first, alns_second);
-            if (ret){
-                #pragma omp critical (discordant_selected)
-            {
+        if (do_unmapped && !flagged){
+            if (ff.unmapped_filter(alns_first) && ff.unmapped_filter(alns_second)){
                 flagged = true;
-                discordant_selected.push_back(alns_first);
-                discordant_selected.push_back(alns_second);
+                alns_first.set_read_mapped(false);
+                alns_first.set_mate_unmapped(true);
+                alns_second.set_read_mapped(false);
+                alns_second.set_mate_unmapped(false);
+                keep(UNMAPPED, alns_first);
+                keep(UNMAPPED, alns_second);
             }
-            }
-            
+        }
 
+        if (do_orientation && !flagged){
+            if (ff.pair_orientation_filter(alns_first, alns_second)){
+                flagged = true;
+                keep(DISCORDANT, alns_first);
+                keep(DISCORDANT, alns_second);
+            }
         }
         if (do_oea && !flagged){
-            ret = ff.one_end_anchored_filter(alns_first, alns_second);
-            if (ret){
-                #pragma omp critical (oea_selected)
-                {
-                    one_end_anchored.push_back(alns_first);
-                    one_end_anchored.push_back(alns_second);
-                }
+            if (ff.one_end_anchored_filter(alns_first, alns_second)){
+                keep(ONE_END_ANCHORED, alns_first);
+                keep(ONE_END_ANCHORED, alns_second);
             }
-            
-
         }
         if (do_insert_size && !flagged){
-            
-            ret = ff.insert_size_filter(alns_first, alns_second);
-            if (ret){
-                #pragma omp critial (insert_selected)
-                {
-                    insert_selected.push_back(alns_first);
-                    insert_selected.push_back(alns_second);
-                }
+            if (ff.insert_size_filter(alns_first, alns_second)){
+                keep(INSERT_SIZE, alns_first);
+                keep(INSERT_SIZE, alns_second);
             }
-            
-
-
         }
-        if (do_split_read && !flagged){
-
-            if (ff.split_read_filter(alns_first)){
-                #pragma omp critical (split_selected)
-                {
-                    split_selected.push_back(alns_first);
-                    split_selected.push_back(alns_second);
-                    flagged = true;
-
+        if (do_interchromosomal && !flagged){
+            bool different_paths;
+            if (path_positions) {
+                // Both mates are placed on paths, but never on the same one
+                different_paths = !first_offsets.empty() && !second_offsets.empty();
+                for (auto& path : first_offsets) {
+                    if (second_offsets.count(path.first)) {
+                        different_paths = false;
+                    }
                 }
-                
+            } else {
+                different_paths = ff.interchromosomal_filter(alns_first, alns_second);
             }
-            if (ff.split_read_filter(alns_second)){
-                #pragma omp critical (split_selected)
-                {
-                    split_selected.push_back(alns_first);
-                    split_selected.push_back(alns_second);
-                    flagged = true;
-
-                }
+            if (different_paths){
+                keep(INTERCHROMOSOMAL, alns_first);
+                keep(INTERCHROMOSOMAL, alns_second);
+            }
+        }
+        if (do_split_read && !flagged){
+            // Check both mates, but only keep the pair once
+            bool first_split = ff.split_read_filter(alns_first);
+            bool second_split = ff.split_read_filter(alns_second);
+            if (first_split || second_split){
+                flagged = true;
+                keep(SPLIT, alns_first);
+                keep(SPLIT, alns_second);
             }
-            
-
         }
         if (do_reversing && !flagged){
-            Alignment x = ff.reversing_filter(alns_first);
-            Alignment y = ff.reversing_filter(alns_second);
-            if (x.name() != "" || y.name() != ""){
-               #pragma omp critical (reversing_selected)
-               {
-                   reversing_selected.push_back(alns_first);
-                   reversing_selected.push_back(alns_second);
-               }
+            // The filter gives back the read if it reverses, or an empty alignment
+            bool first_reverses = ff.reversing_filter(alns_first).path().mapping_size() > 0;
+            bool second_reverses = ff.reversing_filter(alns_second).path().mapping_size() > 0;
+            if (first_reverses || second_reverses){
+                keep(REVERSING, alns_first);
+                keep(REVERSING, alns_second);
             }
-       
-
-
         }
         if (do_softclip && !flagged){
-
             bool x = ff.soft_clip_filter(alns_first);
             bool y = ff.soft_clip_filter(alns_second);
             if (x){
-                #pragma omp critical (clipped_selected)
-                {
-                    clipped_selected.push_back(alns_first);
-                    flagged = true;
-                }
-            } 
+                flagged = true;
+                keep(SOFTCLIPPED, alns_first);
+            }
             if (y){
-                #pragma omp critical (clipped_selected)
-                {
-                    flagged = true;
-                    clipped_selected.push_back(alns_second);
-                }
-            } 
-
-        }
-        if (do_quality && !flagged){
-
-            #pragma omp critical (quality_selected)
-            {
-                quality_selected.push_back(alns_first);
-                quality_selected.push_back(alns_second);
+                flagged = true;
+                keep(SOFTCLIPPED, alns_second);
             }
-
         }
-        if (do_depth && !flagged){
-
-            #pragma omp critical (depth_selected)
-            {
-                depth_selected.push_back(alns_first);
-                depth_selected.push_back(alns_second);
+        if (do_all && !flagged){
+            // Perfect pairs are dropped; anything else is pretty clean
+            if (!(ff.perfect_filter(alns_first) && ff.perfect_filter(alns_second))){
+                keep(CLEAN, alns_first);
+                keep(CLEAN, alns_second);
             }
-            
         }
-        if (!flagged){
-            // Check if read is perfect
 
-            if (ff.perfect_filter(alns_first) && ff.perfect_filter(alns_second)){
-
-            }
-            else{
-                // otherwise, it's pretty clean, so place it in the clean pile.
-                #pragma omp critical (clean)
-                {
-                    clean.push_back(alns_first);
-                    clean.push_back(alns_second);
-                }
-            }
-            
-        }
-        
-
-        stream::write_buffered(unmapped_stream, unmapped_selected, 100);
-        stream::write_buffered(discordant_stream, discordant_selected, 100);
-        stream::write_buffered(oea_stream, one_end_anchored, 100);
-        stream::write_buffered(insert_stream, insert_selected, 100);
-        stream::write_buffered(split_stream, split_selected, 100);
-        stream::write_buffered(clipped_stream, clipped_selected, 100);
-        stream::write_buffered(clean_stream, clean, 100);
-        stream::write_buffered(reversing_stream, reversing_selected, 100);
-        stream::write_buffered(perfect_stream, perfect, 100);
+        send_full_buffers();
     };
 
     std::function<void(Alignment&)> single_filters = [&](Alignment& aln){
         if (do_split_read){
-            split_selected.push_back(aln);
+            if (ff.split_read_filter(aln)){
+                keep(SPLIT, aln);
+            }
         }
         if (do_reversing){
-            reversing_selected.push_back(aln);
+            if (ff.reversing_filter(aln).path().mapping_size() > 0){
+                keep(REVERSING, aln);
+            }
         }
         if (do_softclip){
-           if (ff.soft_clip_filter(aln)){
-                clipped_selected.push_back(aln);
-           }
-           //stream::write_buffered(clipped_stream, clipped_selected, 1000);
-
-        }
-        if (do_quality){
-            quality_selected.push_back(aln);
-        }
-        if (do_depth){
-            depth_selected.push_back(aln);
+            if (ff.soft_clip_filter(aln)){
+                keep(SOFTCLIPPED, aln);
+            }
         }
 
+        send_full_buffers();
     };
 
-    // double curr_insert = 0.0;
-    // double insert_tot = 0.0;
-    // int insert_count = 0;
-    // double curr_sigma = 0.0;
-    // std::function<void(Alignment&, Alignment&)> calc_insert = [&](Alignment& a, Alignment& b){
-    //     if (a.fragment_size() > 1){
-    //         insert_count += 1;
-    //         insert_tot += (double) a.fragment(0).length();   
-    //     }
-    //     else if (b.fragment_size() > 1){
-
-    //     }
-    // };
-
-
-
-
-
-if (alignment_file == "-"){
-    stream::for_each_interleaved_pair_parallel(cin, pair_filters);
-}
-else{
-    ifstream in;
-    in.open(alignment_file);
-    if (in.good()){
-
-        // if (just_calc_insert){
-        //     stream::for_each_interleaved_pair_parallel(in, calc_insert);
-        //     exit(0);
-        // }
-
+    auto sift = [&](istream& in) {
         if (is_paired){
             cerr << "Processing..." << endl;
             stream::for_each_interleaved_pair_parallel(in, pair_filters);
         }
         else{
             stream::for_each_parallel(in, single_filters);
-
         }
+    };
+
+    if (alignment_file == "-"){
+        sift(cin);
     }
     else{
-        cerr << "Could not open " << alignment_file << endl;
-        help_sift(argv);
+        ifstream in;
+        in.open(alignment_file);
+        if (in.good()){
+            sift(in);
+        }
+        else{
+            cerr << "Could not open " << alignment_file << endl;
+            help_sift(argv);
+        }
     }
-}
-    stream::write_buffered(unmapped_stream, unmapped_selected, 0);
-    stream::write_buffered(discordant_stream, discordant_selected, 0);
-    stream::write_buffered(oea_stream, one_end_anchored, 0);
-    stream::write_buffered(insert_stream, insert_selected, 0);
-    stream::write_buffered(split_stream, split_selected, 0);
-    stream::write_buffered(clipped_stream, clipped_selected, 0);
-    stream::write_buffered(clean_stream, clean, 0);
-    stream::write_buffered(reversing_stream, reversing_selected, 0);
-    stream::write_buffered(perfect_stream, perfect, 0);
-
-    buffer.clear();
-
-
 
+    for (auto& sieve : sieves) {
+        if (!sieve.enabled) {
+            continue;
+        }
+        for (auto& buffer : sieve.buffers) {
+            if (!buffer.empty()) {
+                sieve.queue->push(stream::serialize_group(buffer));
+            }
+        }
+        sieve.queue->close();
+        stream::finish(sieve.out);
+    }
 
     return 0;
 }
 
 static Subcommand vg_sift("sift", "Filter Alignments by various metrics related to variant calling.", main_sift);
-
-
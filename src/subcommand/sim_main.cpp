@@ -43,7 +43,9 @@ void help_sim(char** argv) {
          << "    -v, --frag-std-dev FLOAT    use this standard deviation for fragment length estimation" << endl
          << "    -N, --allow-Ns              allow reads to be sampled from the graph with Ns in them" << endl
          << "    -a, --align-out             generate true alignments on stdout rather than reads" << endl
-         << "    -J, --json-out              write alignments in json" << endl;
+         << "    -J, --json-out              write alignments in json" << endl
+         << "    -t, --threads N             simulate on N threads; with more than one thread, reads are made in" << endl
+         << "                                chunks with their own random streams, and are the same for any N > 1" << endl;
 }
 
 int main_sim(int argc, char** argv) {
@@ -70,6 +72,7 @@ int main_sim(int argc, char** argv) {
     double indel_prop = 0.0;
     double error_scale_factor = 1.0;
     string fastq_name;
+    int thread_count = 1;
     // What path should we sample from? Empty string = the whole graph.
     vector<string> path_names;
 
@@ -96,11 +99,12 @@ int main_sim(int argc, char** argv) {
             {"scale-err", required_argument, 0, 'S'},
             {"frag-len", required_argument, 0, 'p'},
             {"frag-std-dev", required_argument, 0, 'v'},
+            {"threads", required_argument, 0, 't'},
             {0, 0, 0, 0}
         };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "hl:n:s:e:i:fax:Jp:v:Nd:F:P:S:I",
+        c = getopt_long (argc, argv, "hl:n:s:e:i:fax:Jp:v:Nd:F:P:S:It:",
                 long_options, &option_index);
 
         // Detect the end of the options.
@@ -184,6 +188,10 @@ int main_sim(int argc, char** argv) {
             fragment_std_dev = parse<double>(optarg);
             break;
             
+        case 't':
+            thread_count = parse<int>(optarg);
+            break;
+            
         case 'h':
         case '?':
             help_sim(argv);
@@ -231,29 +239,101 @@ int main_sim(int argc, char** argv) {
         aln.set_score(rescorer.score_alignment(aln, false));
     };
     
+    // We write out reads (or pairs, one after the other) with this.
+    auto write_reads = [&](const vector<Alignment>& reads) {
+        if (align_out) {
+            if (json_out) {
+                for (auto& aln : reads) {
+                    cout << pb2json(aln) << endl;
+                }
+            } else if (!reads.empty()) {
+                function<Alignment(size_t)> lambda = [&reads](size_t n) { return reads[n]; };
+                stream::write(cout, reads.size(), lambda);
+            }
+        } else if (fragment_length) {
+            for (size_t i = 0; i + 1 < reads.size(); i += 2) {
+                cout << reads[i].sequence() << "\t" << reads[i + 1].sequence() << endl;
+            }
+        } else {
+            for (auto& aln : reads) {
+                cout << aln.sequence() << endl;
+            }
+        }
+    };
+    
+    // With more than one thread, the reads are made in chunks, each from its
+    // own random number stream, and written out in chunk order. So the output
+    // for a seed doesn't depend on how many threads there are, as long as
+    // there is more than one.
+    size_t threads = max(thread_count, 1);
+    omp_set_num_threads(threads);
+    const size_t chunk_size = 1000;
+    size_t chunk_count = (num_reads + chunk_size - 1) / chunk_size;
+    
+    // Simulate all the reads, given a function to set up the simulator for a
+    // thread to start a chunk, and one to make a read or pair with it.
+    auto simulate = [&](const function<void(size_t, size_t, size_t)>& start_chunk,
+                        const function<void(size_t, vector<Alignment>&)>& make_read) {
+        if (threads == 1) {
+            // Use one stream from the seed itself
+            vector<Alignment> reads;
+            for (size_t i = 0; i < num_reads; i++) {
+                reads.clear();
+                make_read(0, reads);
+                write_reads(reads);
+            }
+            return;
+        }
+        vector<vector<Alignment>> chunk_reads(threads);
+        for (size_t first_chunk = 0; first_chunk < chunk_count; first_chunk += threads) {
+            size_t wave_size = min(threads, chunk_count - first_chunk);
+#pragma omp parallel for schedule(dynamic, 1)
+            for (size_t i = 0; i < wave_size; i++) {
+                size_t tid = omp_get_thread_num();
+                size_t chunk = first_chunk + i;
+                size_t first_read = chunk * chunk_size;
+                size_t chunk_end = min(first_read + chunk_size, (size_t) num_reads);
+                start_chunk(tid, chunk, first_read);
+                for (size_t j = first_read; j < chunk_end; j++) {
+                    make_read(tid, chunk_reads[i]);
+                }
+            }
+            for (size_t i = 0; i < wave_size; i++) {
+                write_reads(chunk_reads[i]);
+                chunk_reads[i].clear();
+            }
+        }
+    };
+    
     if (fastq_name.empty()) {
         // Use the fixed error rate sampler
         
-        // Make a sample to sample reads with
-        Sampler sampler(xgidx, seed_val, forward_only, reads_may_contain_Ns, path_names);
-        
-        // Make a Mapper to score reads, with the default parameters
-        Mapper rescorer(xgidx, nullptr, nullptr);
-        // Override the "default" full length bonus, just like every other subcommand that uses a mapper ends up doing.
-        // TODO: is it safe to change the default?
-        rescorer.set_alignment_scores(default_match, default_mismatch, default_gap_open, default_gap_extension, default_full_length_bonus);
-        // Include the full length bonuses if requested.
-        rescorer.strip_bonuses = strip_bonuses;
-        // We define a function to score a generated alignment under the mapper
-        auto rescore = [&] (Alignment& aln) {
-            // Score using exact distance.
-            aln.set_score(rescorer.score_alignment(aln, false));
-        };
+        // Make a sampler to sample reads with, and a Mapper to score reads
+        // with the default parameters, for each thread.
+        vector<unique_ptr<Sampler>> samplers;
+        vector<unique_ptr<Mapper>> rescorers;
+        for (size_t i = 0; i < threads; i++) {
+            samplers.emplace_back(new Sampler(xgidx, seed_val, forward_only, reads_may_contain_Ns, path_names));
+            rescorers.emplace_back(new Mapper(xgidx, nullptr, nullptr));
+            // Override the "default" full length bonus, just like every other subcommand that uses a mapper ends up doing.
+            // TODO: is it safe to change the default?
+            rescorers.back()->set_alignment_scores(default_match, default_mismatch, default_gap_open, default_gap_extension,
+                                                   default_full_length_bonus);
+            // Include the full length bonuses if requested.
+            rescorers.back()->strip_bonuses = strip_bonuses;
+        }
         
         size_t max_iter = 1000;
-        int nonce = 1;
-        for (int i = 0; i < num_reads; ++i) {
-            // For each read we are going to generate
+        auto start_chunk = [&](size_t tid, size_t chunk, size_t first_read) {
+            samplers[tid]->reseed(substream_seed(seed_val, chunk), first_read);
+        };
+        auto make_read = [&](size_t tid, vector<Alignment>& reads) {
+            Sampler& sampler = *samplers[tid];
+            // We define a function to score a generated alignment under the mapper
+            auto rescore = [&] (Alignment& aln) {
+                // Score using exact distance.
+                aln.set_score(rescorers[tid]->score_alignment(aln, false));
+            };
             
             if (fragment_length) {
                 // fragment_lenght is nonzero so make it two paired reads
@@ -269,24 +349,13 @@ int main_sim(int argc, char** argv) {
                     }
                 }
                 
-                // write the alignment or its string
                 if (align_out) {
-                    // write it out as requested
-                    
                     // We will need scores
                     rescore(alns.front());
                     rescore(alns.back());
-                    
-                    if (json_out) {
-                        cout << pb2json(alns.front()) << endl;
-                        cout << pb2json(alns.back()) << endl;
-                    } else {
-                        function<Alignment(size_t)> lambda = [&alns](size_t n) { return alns[n]; };
-                        stream::write(cout, 2, lambda);
-                    }
-                } else {
-                    cout << alns.front().sequence() << "\t" << alns.back().sequence() << endl;
                 }
+                reads.push_back(alns.front());
+                reads.push_back(alns.back());
             } else {
                 // Do single-end reads
                 auto aln = sampler.alignment_with_error(read_length, base_error, indel_error);
@@ -304,88 +373,59 @@ int main_sim(int argc, char** argv) {
                     }
                 }
                 
-                // write the alignment or its string
                 if (align_out) {
-                    // write it out as requested
-                    
                     // We will need scores
                     rescore(aln);
-                    
-                    if (json_out) {
-                        cout << pb2json(aln) << endl;
-                    } else {
-                        function<Alignment(size_t)> lambda = [&aln](size_t n) { return aln; };
-                        stream::write(cout, 1, lambda);
-                    }
-                } else {
-                    cout << aln.sequence() << endl;
                 }
+                reads.push_back(aln);
             }
-        }
+        };
         
+        simulate(start_chunk, make_read);
     }
     else {
         // Use the trained error rate
         
         Aligner aligner(default_match, default_mismatch, default_gap_open, default_gap_extension, 5);
         
-        NGSSimulator sampler(*xgidx,
-                             fastq_name,
-                             interleaved,
-                             path_names,
-                             base_error,
-                             indel_error,
-                             indel_prop,
-                             fragment_length ? fragment_length : std::numeric_limits<double>::max(), // suppresses warnings about fragment length
-                             fragment_std_dev ? fragment_std_dev : 0.000001, // eliminates errors from having 0 as stddev without substantial difference
-                             error_scale_factor,
-                             !reads_may_contain_Ns,
-                             seed_val);
+        // Each thread trains its own simulator, since they keep caches.
+        vector<unique_ptr<NGSSimulator>> samplers(threads);
+#pragma omp parallel for
+        for (size_t i = 0; i < threads; i++) {
+            samplers[i].reset(new NGSSimulator(*xgidx,
+                                               fastq_name,
+                                               interleaved,
+                                               path_names,
+                                               base_error,
+                                               indel_error,
+                                               indel_prop,
+                                               fragment_length ? fragment_length : std::numeric_limits<double>::max(), // suppresses warnings about fragment length
+                                               fragment_std_dev ? fragment_std_dev : 0.000001, // eliminates errors from having 0 as stddev without substantial difference
+                                               error_scale_factor,
+                                               !reads_may_contain_Ns,
+                                               seed_val));
+        }
         
-        if (fragment_length) {
-            for (size_t i = 0; i < num_reads; i++) {
+        auto start_chunk = [&](size_t tid, size_t chunk, size_t first_read) {
+            samplers[tid]->reseed(substream_seed(seed_val, chunk), first_read);
+        };
+        auto make_read = [&](size_t tid, vector<Alignment>& reads) {
+            NGSSimulator& sampler = *samplers[tid];
+            if (fragment_length) {
                 pair<Alignment, Alignment> read_pair = sampler.sample_read_pair();
                 read_pair.first.set_score(aligner.score_ungapped_alignment(read_pair.first, strip_bonuses));
                 read_pair.second.set_score(aligner.score_ungapped_alignment(read_pair.second, strip_bonuses));
-                
-                if (align_out) {
-                    if (json_out) {
-                        cout << pb2json(read_pair.first) << endl;
-                        cout << pb2json(read_pair.second) << endl;
-                    }
-                    else {
-                        function<Alignment(size_t)> lambda = [&read_pair](size_t n) {
-                            return n % 2 == 0 ? read_pair.first : read_pair.second;
-                        };
-                        stream::write(cout, 2, lambda);
-                    }
-                }
-                else {
-                    cout << read_pair.first.sequence() << "\t" << read_pair.second.sequence() << endl;
-                }
+                reads.push_back(read_pair.first);
+                reads.push_back(read_pair.second);
             }
-        }
-        else {
-            for (size_t i = 0; i < num_reads; i++) {
+            else {
                 Alignment read = sampler.sample_read();
                 read.set_score(aligner.score_ungapped_alignment(read, strip_bonuses));
-                
-                if (align_out) {
-                    if (json_out) {
-                        cout << pb2json(read) << endl;
-                    }
-                    else {
-                        function<Alignment(size_t)> lambda = [&read](size_t n) {
-                            return read;
-                        };
-                        stream::write(cout, 1, lambda);
-                    }
-                }
-                else {
-                    cout << read.sequence() << endl;
-                }
+                reads.push_back(read);
             }
-        }
+        };
+        
+        simulate(start_chunk, make_read);
     }
     
     if (align_out && !json_out) {
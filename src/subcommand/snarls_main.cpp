@@ -30,7 +30,8 @@ void help_snarl(char** argv) {
          << "    -o, --top-level        restrict traversals to top level ultrabubbles" << endl
          << "    -m, --max-nodes N      only compute traversals for snarls with <= N nodes [10]" << endl
          << "    -t, --include-trivial  report snarls that consist of a single edge" << endl
-         << "    -s, --sort-snarls      return snarls in sorted order by node ID (for topologically ordered graphs)" << endl;
+         << "    -s, --sort-snarls      return snarls in sorted order by node ID (for topologically ordered graphs)" << endl
+         << "    -T, --threads N        decompose connected components separately, on N threads, to save memory" << endl;
 }
 
 int main_snarl(int argc, char** argv) {
@@ -49,6 +50,7 @@ int main_snarl(int argc, char** argv) {
     bool filter_trivial_snarls = true;
     bool sort_snarls = false;
     bool fill_path_names = false;
+    int thread_count = 0;
 
     int c;
     optind = 2; // force optind past command positional argument
@@ -62,12 +64,13 @@ int main_snarl(int argc, char** argv) {
                 {"max-nodes", required_argument, 0, 'm'},
                 {"include-trivial", no_argument, 0, 't'},
                 {"sort-snarls", no_argument, 0, 's'},
+                {"threads", required_argument, 0, 'T'},
                 {0, 0, 0, 0}
             };
 
         int option_index = 0;
 
-        c = getopt_long (argc, argv, "sr:ltopm:h?",
+        c = getopt_long (argc, argv, "sr:ltopm:T:h?",
                          long_options, &option_index);
 
         /* Detect the end of the options. */
@@ -104,6 +107,10 @@ int main_snarl(int argc, char** argv) {
             fill_path_names = true;
             break;
             
+        case 'T':
+            thread_count = parse<int>(optarg);
+            break;
+            
         case 'h':
         case '?':
             /* getopt_long already printed an error message. */
@@ -140,10 +147,16 @@ int main_snarl(int argc, char** argv) {
     }
 
     // The only implemented snarl finder:
-    SnarlFinder* snarl_finder = new CactusSnarlFinder(*graph);
+    CactusSnarlFinder* snarl_finder = new CactusSnarlFinder(*graph);
     
     // Load up all the snarls
-    SnarlManager snarl_manager = snarl_finder->find_snarls();
+    SnarlManager snarl_manager;
+    if (thread_count > 0) {
+        omp_set_num_threads(thread_count);
+        snarl_manager = snarl_finder->find_snarls_parallel();
+    } else {
+        snarl_manager = snarl_finder->find_snarls();
+    }
     vector<const Snarl*> snarl_roots = snarl_manager.top_level_snarls();
     if (fill_path_names){
         TraversalFinder* trav_finder = new PathBasedTraversalFinder(*graph, snarl_manager);
@@ -18,6 +18,14 @@
 #include "../vg.hpp"
 #include "../distributions.hpp"
 #include "../genotypekit.hpp"
+#include "../alignment_stats.hpp"
+#include "../memory_report.hpp"
+#include "../packer.hpp"
+#include "../xg.hpp"
+
+#include <gcsa/gcsa.h>
+#include <gcsa/lcp.h>
+#include <gbwt/gbwt.h>
 
 using namespace std;
 using namespace vg;
@@ -48,7 +56,15 @@ void help_stats(char** argv) {
          << "                          multiple allowed; limit comparison to those provided" << endl
          << "    -O, --overlap-all     print overlap table for the cartesian product of paths" << endl
          << "    -R, --snarls          print statistics for each snarl" << endl
-         << "    -v, --verbose         output longer reports" << endl;
+         << "    -v, --verbose         output longer reports" << endl
+         << "memory report:" << endl
+         << "    -M, --memory          instead of describing a graph, load the indexes below and report the bytes each" << endl
+         << "                          of their succinct components takes, and the peak RSS of loading them" << endl
+         << "    -x, --xg-name FILE    report on this xg index" << endl
+         << "    -g, --gcsa-name FILE  report on this GCSA2 index, and its LCP array FILE.lcp if there is one" << endl
+         << "    -G, --gbwt-name FILE  report on this GBWT index" << endl
+         << "    -P, --pack FILE       report on this coverage pack (requires -x)" << endl
+         << "    -D, --depth N         report components down to N levels into each index [3]" << endl;
 }
 
 int main_stats(int argc, char** argv) {
@@ -79,6 +95,12 @@ int main_stats(int argc, char** argv) {
     vector<string> paths_to_overlap;
     bool overlap_all_paths = false;
     bool snarl_stats = false;
+    bool memory_report = false;
+    string xg_name;
+    string gcsa_name;
+    string gbwt_name;
+    string pack_name;
+    size_t memory_depth = 3;
 
     int c;
     optind = 2; // force optind past command positional argument
@@ -105,11 +127,17 @@ int main_stats(int argc, char** argv) {
             {"overlap", no_argument, 0, 'o'},
             {"overlap-all", no_argument, 0, 'O'},
             {"snarls", no_argument, 0, 'R'},
+            {"memory", no_argument, 0, 'M'},
+            {"xg-name", required_argument, 0, 'x'},
+            {"gcsa-name", required_argument, 0, 'g'},
+            {"gbwt-name", required_argument, 0, 'G'},
+            {"pack", required_argument, 0, 'P'},
+            {"depth", required_argument, 0, 'D'},
             {0, 0, 0, 0}
         };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "hzlsHTScdtn:NEa:vAro:OR",
+        c = getopt_long (argc, argv, "hzlsHTScdtn:NEa:vAro:ORMx:g:G:P:D:",
                 long_options, &option_index);
 
         // Detect the end of the options.
@@ -194,6 +222,30 @@ int main_stats(int argc, char** argv) {
             verbose = true;
             break;
 
+        case 'M':
+            memory_report = true;
+            break;
+
+        case 'x':
+            xg_name = optarg;
+            break;
+
+        case 'g':
+            gcsa_name = optarg;
+            break;
+
+        case 'G':
+            gbwt_name = optarg;
+            break;
+
+        case 'P':
+            pack_name = optarg;
+            break;
+
+        case 'D':
+            memory_depth = parse<size_t>(optarg);
+            break;
+
         case 'h':
         case '?':
             help_stats(argv);
@@ -205,6 +257,57 @@ int main_stats(int argc, char** argv) {
         }
     }
 
+    if (memory_report) {
+        if (xg_name.empty() && gcsa_name.empty() && gbwt_name.empty()) {
+            cerr << "error:[vg stats] a memory report needs an index to report on (-x, -g, or -G)" << endl;
+            return 1;
+        }
+        if (!pack_name.empty() && xg_name.empty()) {
+            cerr << "error:[vg stats] a memory report on a pack needs its xg index (-x)" << endl;
+            return 1;
+        }
+        
+        cout << "component\ttype\tbytes\tpercent" << endl;
+        
+        unique_ptr<xg::XG> xg_index;
+        if (!xg_name.empty()) {
+            xg_index.reset(new xg::XG());
+            get_input_file(xg_name, [&](istream& in) {
+                xg_index->load(in);
+            });
+            write_memory_report(measure_memory(*xg_index, "xg"), cout, memory_depth);
+        }
+        if (!gcsa_name.empty()) {
+            gcsa::GCSA gcsa_index;
+            get_input_file(gcsa_name, [&](istream& in) {
+                gcsa_index.load(in);
+            });
+            write_memory_report(measure_memory(gcsa_index, "gcsa"), cout, memory_depth);
+            
+            ifstream lcp_in(gcsa_name + ".lcp");
+            if (lcp_in) {
+                gcsa::LCPArray lcp_array;
+                lcp_array.load(lcp_in);
+                write_memory_report(measure_memory(lcp_array, "lcp"), cout, memory_depth);
+            }
+        }
+        if (!gbwt_name.empty()) {
+            gbwt::GBWT gbwt_index;
+            get_input_file(gbwt_name, [&](istream& in) {
+                gbwt_index.load(in);
+            });
+            write_memory_report(measure_memory(gbwt_index, "gbwt"), cout, memory_depth);
+        }
+        if (!pack_name.empty()) {
+            Packer packer(xg_index.get());
+            packer.load_from_file(pack_name);
+            write_memory_report(measure_memory(packer, "pack"), cout, memory_depth);
+        }
+        
+        cout << "peak_rss\t\t" << get_peak_rss() << "\t" << endl;
+        return 0;
+    }
+
     VG graph;
     get_input_file(optind, argc, argv, [&](istream& in) {
             graph.from_istream(in);
@@ -475,152 +578,22 @@ int main_stats(int argc, char** argv) {
         });
 
 
-        // These are the general stats we will compute.
-        size_t total_alignments = 0;
-        size_t total_aligned = 0;
-        size_t total_primary = 0;
-        size_t total_secondary = 0;
-
         // These are for counting significantly allele-biased hets
         size_t total_hets = 0;
         size_t significantly_biased_hets = 0;
 
-        // These are for tracking which nodes are covered and which are not
-        map<vg::id_t, size_t> node_visit_counts;
-
-        // And for counting indels
-        // Inserted bases also counts softclips
-        size_t total_insertions = 0;
-        size_t total_inserted_bases = 0;
-        size_t total_deletions = 0;
-        size_t total_deleted_bases = 0;
-        // And substitutions
-        size_t total_substitutions = 0;
-        size_t total_substituted_bases = 0;
-        // And softclips
-        size_t total_softclips = 0;
-        size_t total_softclipped_bases = 0;
-
-        // In verbose mode we want to report details of insertions, deletions,
-        // and substitutions, and soft clips.
-        vector<pair<vg::id_t, Edit>> insertions;
-        vector<pair<vg::id_t, Edit>> deletions;
-        vector<pair<vg::id_t, Edit>> substitutions;
-        vector<pair<vg::id_t, Edit>> softclips;
-
-        function<void(Alignment&)> lambda = [&](Alignment& aln) {
-            int tid = omp_get_thread_num();
-
-            // We ought to be able to do many stats on the alignments.
-
-            // Now do all the non-mapping stats
-            #pragma omp critical (total_alignments)
-            total_alignments++;
-            if(aln.is_secondary()) {
-                #pragma omp critical (total_secondary)
-                total_secondary++;
-            } else {
-                #pragma omp critical (total_primary)
-                total_primary++;
-                if(aln.score() > 0) {
-                    // We only count aligned primary reads in "total aligned";
-                    // the primary can't be unaligned if the secondary is
-                    // aligned.
-                    #pragma omp critical (total_aligned)
-                    total_aligned++;
-                }
-
-                // Which sites and alleles does this read support. TODO: if we hit
-                // unique nodes from multiple alleles of the same site, we should...
-                // do something. Discard the read? Not just count it on both sides
-                // like we do now.
-                set<pair<string, string>> alleles_supported;
-
-                for(size_t i = 0; i < aln.path().mapping_size(); i++) {
-                    // For every mapping...
-                    auto& mapping = aln.path().mapping(i);
-                    vg::id_t node_id = mapping.position().node_id();
-
-                    if(allele_path_for_node.count(node_id)) {
-                        // We hit a unique node for this allele. Add it to the set,
-                        // in case we hit another unique node for it later in the
-                        // read.
-                        alleles_supported.insert(allele_path_for_node.at(node_id));
-                    }
-
-                    // Record that there was a visit to this node.
-                    #pragma omp critical (node_visit_counts)
-                    node_visit_counts[node_id]++;
-
-                    for(size_t j = 0; j < mapping.edit_size(); j++) {
-                        // Go through edits and look for each type.
-                        auto& edit = mapping.edit(j);
-
-                        if(edit.to_length() > edit.from_length()) {
-                            if((j == 0 && i == 0) || (j == mapping.edit_size() - 1 && i == aln.path().mapping_size() - 1)) {
-                                // We're at the very end of the path, so this is a soft clip.
-                                #pragma omp critical (total_softclipped_bases)
-                                total_softclipped_bases += edit.to_length() - edit.from_length();
-                                #pragma omp critical (total_softclips)
-                                total_softclips++;
-                                if(verbose) {
-                                    // Record the actual insertion
-                                    #pragma omp critical (softclips)
-                                    softclips.push_back(make_pair(node_id, edit));
-                                }
-                            } else {
-                                // Record this insertion
-                                #pragma omp critical (total_inserted_bases)
-                                total_inserted_bases += edit.to_length() - edit.from_length();
-                                #pragma omp critical (total_insertions)
-                                total_insertions++;
-                                if(verbose) {
-                                    // Record the actual insertion
-                                    #pragma omp critical (insertions)
-                                    insertions.push_back(make_pair(node_id, edit));
-                                }
-                            }
-
-                        } else if(edit.from_length() > edit.to_length()) {
-                            // Record this deletion
-                            #pragma omp critical (total_deleted_bases)
-                            total_deleted_bases += edit.from_length() - edit.to_length();
-                            #pragma omp critical (total_deletions)
-                            total_deletions++;
-                            if(verbose) {
-                                // Record the actual deletion
-                                #pragma omp critical (deletions)
-                                deletions.push_back(make_pair(node_id, edit));
-                            }
-                        } else if(!edit.sequence().empty()) {
-                            // Record this substitution
-                            // TODO: a substitution might also occur as part of a deletion/insertion above!
-                            #pragma omp critical (total_substituted_bases)
-                            total_substituted_bases += edit.from_length();
-                            #pragma omp critical (total_substitutions)
-                            total_substitutions++;
-                            if(verbose) {
-                                // Record the actual substitution
-                                #pragma omp critical (substitutions)
-                                substitutions.push_back(make_pair(node_id, edit));
-                            }
-                        }
-
-                    }
-                }
+        // Actually go through all the reads and count stuff up. Each thread
+        // counts into its own stats, and they are merged at the end.
+        AlignmentStats stats = accumulate_alignment_stats(alignment_stream,
+            AlignmentStats(verbose, &allele_path_for_node));
 
-                for(auto& site_and_allele : alleles_supported) {
-                    // This read is informative for an allele of a site.
-                    // Up the reads on that allele of that site.
-                    #pragma omp critical (reads_on_allele)
-                    reads_on_allele[site_and_allele.first][site_and_allele.second]++;
-                }
+        // Add the allele support to the 0s for all the sites
+        for(auto& site_and_alleles : stats.reads_on_allele) {
+            for(auto& allele_and_count : site_and_alleles.second) {
+                reads_on_allele[site_and_alleles.first][allele_and_count.first] += allele_and_count.second;
             }
-
-        };
-
-        // Actually go through all the reads and count stuff up.
-        stream::for_each_parallel(alignment_stream, lambda);
+        }
+        auto& node_visit_counts = stats.node_visit_counts;
 
         // Calculate stats about the reads per allele data
         for(auto& site_and_alleles : reads_on_allele) {
@@ -681,7 +654,9 @@ int main_stats(int argc, char** argv) {
         // visit the whole node.
         graph.for_each_node_parallel([&](Node* node) {
             // For every node
-            if(!node_visit_counts.count(node->id()) || node_visit_counts.at(node->id()) == 0) {
+            auto found = node_visit_counts.find(node->id());
+            size_t visits = (found == node_visit_counts.end()) ? 0 : found->second;
+            if(visits == 0) {
                 // If we never visited it with a read, count it.
                 #pragma omp critical (unvisited_nodes)
                 unvisited_nodes++;
@@ -691,7 +666,7 @@ int main_stats(int argc, char** argv) {
                     #pragma omp critical (unvisited_ids)
                     unvisited_ids.insert(node->id());
                 }
-            } else if(node_visit_counts.at(node->id()) == 1) {
+            } else if(visits == 1) {
                 // If we visited it with only one read, count it.
                 #pragma omp critical (single_visited_nodes)
                 single_visited_nodes++;
@@ -704,35 +679,35 @@ int main_stats(int argc, char** argv) {
             }
         });
 
-        cout << "Total alignments: " << total_alignments << endl;
-        cout << "Total primary: " << total_primary << endl;
-        cout << "Total secondary: " << total_secondary << endl;
-        cout << "Total aligned: " << total_aligned << endl;
+        cout << "Total alignments: " << stats.total_alignments << endl;
+        cout << "Total primary: " << stats.total_primary << endl;
+        cout << "Total secondary: " << stats.total_secondary << endl;
+        cout << "Total aligned: " << stats.total_aligned << endl;
 
-        cout << "Insertions: " << total_inserted_bases << " bp in " << total_insertions << " read events" << endl;
+        cout << "Insertions: " << stats.total_inserted_bases << " bp in " << stats.total_insertions << " read events" << endl;
         if(verbose) {
-            for(auto& id_and_edit : insertions) {
+            for(auto& id_and_edit : stats.insertions) {
                 cout << "\t" << id_and_edit.second.from_length() << " -> " << id_and_edit.second.sequence()
                     << " on " << id_and_edit.first << endl;
             }
         }
-        cout << "Deletions: " << total_deleted_bases << " bp in " << total_deletions << " read events" << endl;
+        cout << "Deletions: " << stats.total_deleted_bases << " bp in " << stats.total_deletions << " read events" << endl;
         if(verbose) {
-            for(auto& id_and_edit : deletions) {
+            for(auto& id_and_edit : stats.deletions) {
                 cout << "\t" << id_and_edit.second.from_length() << " -> " << id_and_edit.second.to_length()
                     << " on " << id_and_edit.first << endl;
             }
         }
-        cout << "Substitutions: " << total_substituted_bases << " bp in " << total_substitutions << " read events" << endl;
+        cout << "Substitutions: " << stats.total_substituted_bases << " bp in " << stats.total_substitutions << " read events" << endl;
         if(verbose) {
-            for(auto& id_and_edit : substitutions) {
+            for(auto& id_and_edit : stats.substitutions) {
                 cout << "\t" << id_and_edit.second.from_length() << " -> " << id_and_edit.second.sequence()
                     << " on " << id_and_edit.first << endl;
             }
         }
-        cout << "Softclips: " << total_softclipped_bases << " bp in " << total_softclips << " read events" << endl;
+        cout << "Softclips: " << stats.total_softclipped_bases << " bp in " << stats.total_softclips << " read events" << endl;
         if(verbose) {
-            for(auto& id_and_edit : softclips) {
+            for(auto& id_and_edit : stats.softclips) {
                 cout << "\t" << id_and_edit.second.from_length() << " -> " << id_and_edit.second.sequence()
                     << " on " << id_and_edit.first << endl;
             }
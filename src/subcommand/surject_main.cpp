@@ -179,32 +179,59 @@ int main_surject(int argc, char** argv) {
     for (int i = 0; i < surjectors.size(); i++) {
         surjectors[i] = new Surjector(xgidx);
     }
+    
+    // We define a type to represent a surjected alignment, ready for
+    // output. It consists of surjected path name (or ""), surjected position
+    // (or -1), surjected orientation, and the actual Alignment.
+    using surjected_t = tuple<string, int64_t, bool, Alignment>;
+    // You make one with make_tuple()
+    
+    // We want to hand each thread runs of consecutive reads, so that in a
+    // sorted GAM each run comes from one region and its surjections can share
+    // path lookups. So we read the stream in big batches, split them into
+    // runs of this many reads, and then hand back each batch of surjected
+    // reads in stream order, on the calling thread.
+    size_t reads_per_run = 128;
+    auto surject_batches = [&](istream& in, const function<void(vector<surjected_t>&)>& handle_batch) {
+        function<void(int64_t, vector<Alignment>&)> lambda = [&](int64_t virtual_offset, vector<Alignment>& batch) {
+            vector<surjected_t> surjected(batch.size());
+            size_t num_runs = (batch.size() + reads_per_run - 1) / reads_per_run;
+#pragma omp parallel for schedule(dynamic, 1)
+            for (size_t i = 0; i < num_runs; i++) {
+                size_t run_begin = i * reads_per_run;
+                size_t run_end = min(batch.size(), run_begin + reads_per_run);
+                vector<Alignment> run(make_move_iterator(batch.begin() + run_begin),
+                                      make_move_iterator(batch.begin() + run_end));
+                vector<string> run_path_names;
+                vector<int64_t> run_path_positions;
+                vector<bool> run_path_reverses;
+                vector<Alignment> run_surjected = surjectors[omp_get_thread_num()]->path_anchored_surject(run, path_names,
+                                                                                                           run_path_names,
+                                                                                                           run_path_positions,
+                                                                                                           run_path_reverses);
+                for (size_t j = 0; j < run_surjected.size(); j++) {
+                    surjected[run_begin + j] = make_tuple(move(run_path_names[j]), run_path_positions[j],
+                                                          (bool) run_path_reverses[j], move(run_surjected[j]));
+                }
+            }
+            handle_batch(surjected);
+        };
+        stream::for_each_in_batches(in, reads_per_run * 4 * thread_count, lambda);
+    };
 
     if (input_type == "gam") {
         if (output_type == "gam") {
-            vector<vector<Alignment> > buffer;
-            buffer.resize(thread_count);
-            function<void(Alignment&)> lambda = [&xgidx, &path_names, &buffer, &surjectors](Alignment& src) {
-                int tid = omp_get_thread_num();
-                // Since we're outputting full GAM, we ignore all this info
-                // about where on the path the alignment falls. But we need to
-                // provide the space to the surject call anyway.
-                string path_name;
-                int64_t path_pos;
-                bool path_reverse;
-                buffer[tid].push_back(surjectors[omp_get_thread_num()]->path_anchored_surject(src,
-                                                                                              path_names,
-                                                                                              path_name,
-                                                                                              path_pos,
-                                                                                              path_reverse));
-                stream::write_buffered(cout, buffer[tid], 100);
-            };
+            // Since we're outputting full GAM, we ignore all the info about
+            // where on the path the alignments fall.
+            vector<Alignment> buffer;
             get_input_file(file_name, [&](istream& in) {
-                stream::for_each_parallel(in, lambda);
+                surject_batches(in, [&](vector<surjected_t>& surjected) {
+                    for (auto& s : surjected) {
+                        buffer.emplace_back(move(get<3>(s)));
+                    }
+                    stream::write_buffered(cout, buffer, 0);
+                });
             });
-            for (int i = 0; i < thread_count; ++i) {
-                stream::write_buffered(cout, buffer[i], 0); // flush
-            }
         } else {
             char out_mode[5];
             string out_format = "";
@@ -237,12 +264,18 @@ int main_surject(int argc, char** argv) {
             omp_lock_t output_lock;
             omp_init_lock(&output_lock);
             
-            // We define a type to represent a surjected alignment, ready for
-            // HTSlib output. It consists of surjected path name (or ""),
-            // surjected position (or -1), surjected orientation, and the
-            // actual Alignment.
-            using surjected_t = tuple<string, int64_t, bool, Alignment>;
-            // You make one with make_tuple()
+            // We need to see the read group info of the surjected reads to make the header
+            auto note_read_group = [&](const Alignment& surj) {
+                if (!hdr && !surj.read_group().empty() && !surj.sample_name().empty()) {
+                    // There's no header yet (although we race its
+                    // construction) and we have a sample and a read group.
+                    
+                    // Record the read group for the sample that this read
+                    // represents, so that when we build the header we list it.
+#pragma omp critical (hts_header)
+                    rg_sample[surj.read_group()] = surj.sample_name();
+                }
+            };
             
             // We define a basic surject function, which also fills in the read group info we need to make the header
             auto surject_alignment = [&](const Alignment& src) {
@@ -261,16 +294,7 @@ int main_surject(int argc, char** argv) {
                                                                                     path_pos,
                                                                                     path_reverse);
                 // Always use the surjected alignment, even if it surjects to unmapped.
-                
-                if (!hdr && !surj.read_group().empty() && !surj.sample_name().empty()) {
-                    // There's no header yet (although we race its
-                    // construction) and we have a sample and a read group.
-                    
-                    // Record the read group for the sample that this read
-                    // represents, so that when we build the header we list it.
-#pragma omp critical (hts_header)
-                    rg_sample[surj.read_group()] = surj.sample_name();
-                }
+                note_read_group(surj);
                 
                 return make_tuple(path_name, path_pos, path_reverse, surj);
             };
@@ -287,6 +311,10 @@ int main_surject(int argc, char** argv) {
                             cerr << "[vg surject] error: failed to open stdout for writing HTS output" << endl;
                             exit(1);
                         } else {
+                            if (!out_format.empty()) {
+                                // compress BAM/CRAM on htslib's own threads
+                                hts_set_threads(out, thread_count);
+                            }
                             // write the header
                             if (sam_hdr_write(out, hdr) != 0) {
 #pragma omp critical (cerr)
@@ -362,9 +390,9 @@ int main_surject(int argc, char** argv) {
                                     int template_length = 0;
                                     
                                     // Create and write paired BAM records referencing each other
-                                    write_bam_record(alignment_to_bam(header, surj1, name1, pos1, reverse1, cigar1,
+                                    write_bam_record(alignment_to_bam(hdr, surj1, name1, pos1, reverse1, cigar1,
                                         name2, pos2, template_length));
-                                    write_bam_record(alignment_to_bam(header, surj2, name2, pos2, reverse2, cigar2,
+                                    write_bam_record(alignment_to_bam(hdr, surj2, name2, pos2, reverse2, cigar2,
                                         name1, pos1, template_length));
                                 
                                 }
@@ -438,66 +466,46 @@ int main_surject(int argc, char** argv) {
                 
             } else {
                 // GAM input is single-ended, so each read can be surjected
-                // independently
-                
-                // We keep a buffer, one per thread, of surjected alignments.
-                vector<vector<surjected_t>> buffer;
-                buffer.resize(thread_count);
-
-                // Define a function that handles buffers, possibly opening the
-                // output file if we're on the first record
-                auto handle_buffer = [&](vector<surjected_t>& buf) {
-                    if (buf.size() >= buffer_limit) {
-                        // We have enough data to start the file.
+                // independently. We convert each batch to BAM records in
+                // parallel, and write them out in order.
+                vector<bam1_t*> records;
+                get_input_file(file_name, [&](istream& in) {
+                    surject_batches(in, [&](vector<surjected_t>& surjected) {
+                        for (auto& s : surjected) {
+                            note_read_group(get<3>(s));
+                        }
                         
                         // Make sure we have emitted the header
                         ensure_header();
-
-                        // try to get a lock, and force things if we've built up a huge buffer waiting
-                        // TODO: Is continuing without the lock safe? And if so why do we have the lock in the first place?
-                        if (omp_test_lock(&output_lock) || buf.size() > 10*buffer_limit) {
-                            for (auto& s : buf) {
-                                // For each alignment in the buffer
-                                
-                                // Unpack it
-                                auto& name = get<0>(s);
-                                auto& pos = get<1>(s);
-                                auto& reverse = get<2>(s);
-                                auto& surj = get<3>(s);
-                                
-                                // Generate a CIGAR string for it
-                                string cigar = "";
-                                if (name != "") {
-                                    size_t path_len = xgidx->path_length(name);
-                                    cigar = cigar_against_path(surj, reverse, pos, path_len, 0);
-                                }
-                                
-                                // Create and write a single unpaired BAM record
-                                write_bam_record(alignment_to_bam(header, surj, name, pos, reverse, cigar));
-                                
+                        
+                        records.resize(surjected.size());
+#pragma omp parallel for schedule(dynamic, 64)
+                        for (size_t i = 0; i < surjected.size(); i++) {
+                            // Unpack it
+                            auto& name = get<0>(surjected[i]);
+                            auto& pos = get<1>(surjected[i]);
+                            auto& reverse = get<2>(surjected[i]);
+                            auto& surj = get<3>(surjected[i]);
+                            
+                            // Generate a CIGAR string for it
+                            string cigar = "";
+                            if (name != "") {
+                                size_t path_len = xgidx->path_length(name);
+                                cigar = cigar_against_path(surj, reverse, pos, path_len, 0);
                             }
                             
-                            omp_unset_lock(&output_lock);
-                            buf.clear();
+                            // Create a single unpaired BAM record
+                            records[i] = alignment_to_bam(hdr, surj, name, pos, reverse, cigar);
                         }
-                    }
-                };
-
-                function<void(Alignment&)> lambda = [&](Alignment& src) {
-                    auto& thread_buffer = buffer[omp_get_thread_num()];
-                    thread_buffer.push_back(surject_alignment(src));
-                    handle_buffer(thread_buffer);
-                };
-
-
-                // now apply the alignment processor to the stream
-                get_input_file(file_name, [&](istream& in) {
-                    stream::for_each_parallel(in, lambda);
+                        
+                        for (bam1_t* b : records) {
+                            write_bam_record(b);
+                        }
+                    });
                 });
-                buffer_limit = 0;
-                for (auto& buf : buffer) {
-                    handle_buffer(buf);
-                }
+                
+                // Make sure there is a file even if there were no reads
+                ensure_header();
                 
             }
             
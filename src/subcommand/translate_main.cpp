@@ -30,7 +30,8 @@ void help_translate(char** argv) {
          << "    -l, --loci FILE       project the input locus descriptions into the from-graph" << endl
          << "    -m, --mapping JSON    print the from-mapping corresponding to the given JSON mapping" << endl
          << "    -P, --position JSON   print the from-position corresponding to the given JSON position" << endl
-         << "    -o, --overlay FILE    overlay this translation on top of the one we are given" << endl;
+         << "    -o, --overlay FILE    overlay this translation on top of the one we are given" << endl
+         << "    -t, --threads N       translate paths and alignments on N threads (output order may change) [1]" << endl;
 }
 
 int main_translate(int argc, char** argv) {
@@ -46,6 +47,7 @@ int main_translate(int argc, char** argv) {
     string aln_file;
     string loci_file;
     string overlay_file;
+    int thread_count = 1;
 
     int c;
     optind = 2; // force optind past command positional argument
@@ -59,11 +61,12 @@ int main_translate(int argc, char** argv) {
             {"alns", required_argument, 0, 'a'},
             {"loci", required_argument, 0, 'l'},
             {"overlay", required_argument, 0, 'o'},
+            {"threads", required_argument, 0, 't'},
             {0, 0, 0, 0}
         };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "hp:m:P:a:o:l:",
+        c = getopt_long (argc, argv, "hp:m:P:a:o:l:t:",
                 long_options, &option_index);
 
         // Detect the end of the options.
@@ -96,6 +99,10 @@ int main_translate(int argc, char** argv) {
             overlay_file = optarg;
             break;
 
+        case 't':
+            thread_count = parse<int>(optarg);
+            break;
+
         case 'h':
         case '?':
             help_translate(argv);
@@ -107,6 +114,8 @@ int main_translate(int argc, char** argv) {
         }
     }
 
+    omp_set_num_threads(thread_count);
+
     Translator* translator;
     get_input_file(optind, argc, argv, [&](istream& in) {
         translator = new Translator(in);
@@ -127,23 +136,38 @@ int main_translate(int argc, char** argv) {
     }
 
     if (!path_file.empty()) {
-        vector<Path> buffer;
+        vector<vector<Path>> buffer(thread_count);
         function<void(Path&)> lambda = [&](Path& path) {
-            buffer.push_back(translator->translate(path));
-            stream::write_buffered(cout, buffer, 100);
+            auto& thread_buffer = buffer[omp_get_thread_num()];
+            thread_buffer.push_back(translator->translate(path));
+            stream::write_buffered(cout, thread_buffer, 100);
         };
         ifstream path_in(path_file);
-        stream::for_each(path_in, lambda);
-        stream::write_buffered(cout, buffer, 0);
+        if (thread_count > 1) {
+            stream::for_each_parallel(path_in, lambda);
+        } else {
+            stream::for_each(path_in, lambda);
+        }
+        for (auto& thread_buffer : buffer) {
+            stream::write_buffered(cout, thread_buffer, 0);
+        }
     } else if (!aln_file.empty()) {
-        vector<Alignment> buffer;
+        vector<vector<Alignment>> buffer(thread_count);
         function<void(Alignment&)> lambda = [&](Alignment& aln) {
-            buffer.push_back(translator->translate(aln));
-            stream::write_buffered(cout, buffer, 100);
+            auto& thread_buffer = buffer[omp_get_thread_num()];
+            translator->translate_in_place(aln);
+            thread_buffer.emplace_back(move(aln));
+            stream::write_buffered(cout, thread_buffer, 100);
         };
         ifstream aln_in(aln_file);
-        stream::for_each(aln_in, lambda);
-        stream::write_buffered(cout, buffer, 0);
+        if (thread_count > 1) {
+            stream::for_each_parallel(aln_in, lambda);
+        } else {
+            stream::for_each(aln_in, lambda);
+        }
+        for (auto& thread_buffer : buffer) {
+            stream::write_buffered(cout, thread_buffer, 0);
+        }
     } else if (!loci_file.empty()) {
         vector<Locus> buffer;
         function<void(Locus&)> lambda = [&](Locus& locus) {
@@ -12,7 +12,8 @@
 
 #include "subcommand.hpp"
 
-#include "../vg.hpp"
+#include "../graph_stream_validator.hpp"
+#include "../utility.hpp"
 
 using namespace std;
 using namespace vg;
@@ -27,7 +28,9 @@ void help_validate(char** argv) {
         << "    -n, --nodes    verify that we have the expected number of nodes" << endl
         << "    -e, --edges    verify that the graph contains all nodes that are referred to by edges" << endl
         << "    -p, --paths    verify that contiguous path segments are connected by edges" << endl
-        << "    -o, --orphans  verify that all nodes have edges" << endl;
+        << "    -o, --orphans  verify that all nodes have edges (not checked by default)" << endl
+        << "    -t, --threads N  check using N threads [numCPUs]" << endl
+        << "checks run over the graph's chunks as they stream in, and every problem found is reported" << endl;
 }
 
 int main_validate(int argc, char** argv) {
@@ -50,13 +53,14 @@ int main_validate(int argc, char** argv) {
             {"help", no_argument, 0, 'h'},
             {"nodes", no_argument, 0, 'n'},
             {"edges", no_argument, 0, 'e'},
-            {"paths", no_argument, 0, 'o'},
-            {"orphans", no_argument, 0, 'p'},
+            {"paths", no_argument, 0, 'p'},
+            {"orphans", no_argument, 0, 'o'},
+            {"threads", required_argument, 0, 't'},
             {0, 0, 0, 0}
         };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "hneop",
+        c = getopt_long (argc, argv, "hneopt:",
                 long_options, &option_index);
 
         // Detect the end of the options.
@@ -82,6 +86,10 @@ int main_validate(int argc, char** argv) {
                 check_paths = true;
                 break;
 
+            case 't':
+                omp_set_num_threads(parse<int>(optarg));
+                break;
+
             case 'h':
             case '?':
                 help_validate(argv);
@@ -93,24 +101,24 @@ int main_validate(int argc, char** argv) {
         }
     }
 
-    VG* graph;
+    GraphStreamValidator validator;
+    // if we chose a specific subset, do just them, otherwise do everything
+    if (check_nodes || check_edges || check_orphans || check_paths) {
+        validator.check_nodes = check_nodes;
+        validator.check_edges = check_edges;
+        validator.check_orphans = check_orphans;
+        validator.check_paths = check_paths;
+    }
+
     get_input_file(optind, argc, argv, [&](istream& in) {
-        graph = new VG(in);
+        validator.add_stream(in);
     });
 
-    // if we chose a specific subset, do just them
-    if (check_nodes || check_edges || check_orphans || check_paths) {
-        if (graph->is_valid(check_nodes, check_edges, check_orphans, check_paths)) {
-            return 0;
-        } else {
-            return 1;
-        }
-        // otherwise do everything
-    } else if (graph->is_valid()) {
-        return 0;
-    } else {
-        return 1;
+    vector<string> errors = validator.validate();
+    for (auto& error : errors) {
+        cerr << "graph invalid: " << error << endl;
     }
+    return errors.empty() ? 0 : 1;
 }
 
 // Register subcommand
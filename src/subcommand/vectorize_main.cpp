@@ -40,6 +40,9 @@ void help_vectorize(char** argv){
          << "  -p --mem-positions Add the positions to the MEM sketch of a given read based on the GCSA" << endl
          << "  -H --mem-hit-max N Ignore MEMs with this many hits when extracting poisitions" << endl
          << "  -i --identity-hot  Output a score vector based on percent identity and coverage" << endl
+         << "  -S --sparse        Output only the set entries of each vector: in vowpal wabbit format with -w," << endl
+         << "                     and otherwise in libsvm format, labeled with the class from --wabbit-mapping" << endl
+         << "  -t --threads N     Vectorize on N threads (output order is only kept with 1 thread, or for MEM sketches)" << endl
          << endl;
 }
 
@@ -57,6 +60,7 @@ int main_vectorize(int argc, char** argv){
     bool a_hot = false;
     bool output_wabbit = false;
     bool use_identity_hot = false;
+    bool sparse = false;
     bool mem_sketch = false;
     bool mem_positions = false;
     bool mem_hit_max = 0;
@@ -67,6 +71,9 @@ int main_vectorize(int argc, char** argv){
         return 1;
     }
 
+    // Keep the output in order unless we are asked for threads
+    omp_set_num_threads(1);
+
     int c;
     optind = 2; // force optind past command positional argument
     while (true) {
@@ -87,11 +94,12 @@ int main_vectorize(int argc, char** argv){
             {"identity-hot", no_argument, 0, 'i'},
             {"aln-label", required_argument, 0, 'l'},
             {"reads", required_argument, 0, 'r'},
+            {"sparse", no_argument, 0, 'S'},
             {0, 0, 0, 0}
 
         };
         int option_index = 0;
-        c = getopt_long (argc, argv, "AaihwM:fmpx:g:l:H:",
+        c = getopt_long (argc, argv, "AaihwM:fmpx:g:l:H:St:",
                 long_options, &option_index);
 
         // Detect the end of the options.
@@ -174,6 +182,12 @@ int main_vectorize(int argc, char** argv){
         case 'M':
             wabbit_mapping_file = optarg;
             break;
+        case 'S':
+            sparse = true;
+            break;
+        case 't':
+            omp_set_num_threads(parse<int>(optarg));
+            break;
         default:
             abort();
         }
@@ -230,31 +244,56 @@ int main_vectorize(int argc, char** argv){
         cout << endl;
     }
 
+    if (sparse && (format || mem_sketch)) {
+        cerr << "[vg vectorize] error: sparse output can't be tab-delimited or made from MEM sketches" << endl;
+        return 1;
+    }
+
+    // Make sparse vectors, with only the entries for the nodes each alignment visits.
+    function<void(Alignment&)> sparse_lambda = [&vz, use_identity_hot, output_wabbit, aln_label, a_hot](Alignment& a){
+        string name = aln_label == "" ? a.name() : aln_label;
+        string line;
+        if (a_hot) {
+            auto v = vz.alignment_to_sparse_a_hot(a);
+            line = output_wabbit ? vz.sparse_wabbitize(name, v) : vz.sparse_libsvm(name, v);
+        } else if (use_identity_hot) {
+            auto v = vz.alignment_to_sparse_identity_hot(a);
+            line = output_wabbit ? vz.sparse_wabbitize(name, v) : vz.sparse_libsvm(name, v);
+        } else {
+            auto v = vz.alignment_to_sparse_onehot(a);
+            line = output_wabbit ? vz.sparse_wabbitize(name, v) : vz.sparse_libsvm(name, v);
+        }
+#pragma omp critical (cout)
+        cout << line << "\n";
+    };
+
     //Generate a 1-hot coverage vector for graph entities.
     function<void(Alignment&)> lambda = [&vz, &mapper, use_identity_hot, output_wabbit, aln_label, mem_sketch, mem_positions, format, a_hot, max_mem_length](Alignment& a){
         //vz.add_bv(vz.alignment_to_onehot(a));
         //vz.add_name(a.name());
+        // Each alignment's output goes out together
+        stringstream out;
         if (a_hot) {
             vector<int> v = vz.alignment_to_a_hot(a);
             if (output_wabbit){
-                cout << vz.wabbitize(aln_label == "" ? a.name() : aln_label, v) << endl;
+                out << vz.wabbitize(aln_label == "" ? a.name() : aln_label, v) << endl;
             }
             else if (format){
-                cout << a.name() << "\t" << vz.format(v) << endl;
+                out << a.name() << "\t" << vz.format(v) << endl;
             } else{
-                cout << v << endl;
+                out << v << endl;
             }
         }
         else if (use_identity_hot){
             vector<double> v = vz.alignment_to_identity_hot(a);
             if (output_wabbit){
-                cout << vz.wabbitize(aln_label == "" ? a.name() : aln_label, v) << endl;
+                out << vz.wabbitize(aln_label == "" ? a.name() : aln_label, v) << endl;
             }
             else if (format){
-                cout << a.name() << "\t" << vz.format(v) << endl;
+                out << a.name() << "\t" << vz.format(v) << endl;
             }
             else {
-                cout << vz.format(v) << endl;
+                out << vz.format(v) << endl;
             }
 
         } else if (mem_sketch) {
@@ -265,40 +304,49 @@ int main_vectorize(int argc, char** argv){
             for (auto& mem : mems) {
                 mem_to_count[mem.sequence()]++;
             }
-            cout << " |info count:" << mems.size() << " unique:" << mem_to_count.size();
-            cout << " |mems";
+            out << " |info count:" << mems.size() << " unique:" << mem_to_count.size();
+            out << " |mems";
             for (auto m : mem_to_count) {
-                cout << " " << m.first << ":" << m.second;
+                out << " " << m.first << ":" << m.second;
             }
             if (mem_positions) {
-                cout << " |positions";
+                out << " |positions";
                 for (auto& mem : mems) {
                     for (auto& node : mem.nodes) {
-                        cout << " " << gcsa::Node::id(node);
+                        out << " " << gcsa::Node::id(node);
                         if (gcsa::Node::rc(node)) {
-                            cout << "-";
+                            out << "-";
                         } else {
-                            cout << "+";
+                            out << "+";
                         }
-                        cout << ":" << mem.end - mem.begin;
+                        out << ":" << mem.end - mem.begin;
                     }
                 }
             }
-            cout << endl;
+            out << endl;
         } else {
             bit_vector v = vz.alignment_to_onehot(a);
             if (output_wabbit){
-                cout << vz.wabbitize(aln_label == "" ? a.name() : aln_label, v) << endl;
+                out << vz.wabbitize(aln_label == "" ? a.name() : aln_label, v) << endl;
             } else if (format) {
-                cout << a.name() << "\t" << vz.format(v) << endl;
+                out << a.name() << "\t" << vz.format(v) << endl;
             } else{
-                cout << v << endl;
+                out << v << endl;
             }
         }
+#pragma omp critical (cout)
+        cout << out.str();
     };
     
     get_input_file(optind, argc, argv, [&](istream& in) {
-        stream::for_each(in, lambda);
+        if (sparse) {
+            stream::for_each_parallel(in, sparse_lambda);
+        } else if (mem_sketch) {
+            // The Mapper isn't safe to share between threads.
+            stream::for_each(in, lambda);
+        } else {
+            stream::for_each_parallel(in, lambda);
+        }
     });
 
     string mapping_str = vz.output_wabbit_map();
@@ -17,6 +17,7 @@
 #include "../vg.hpp"
 #include "../gfa.hpp"
 #include "../json_stream_helper.hpp"
+#include "../gam_columns.hpp"
 
 using namespace std;
 using namespace vg;
@@ -47,6 +48,8 @@ void help_view(char** argv) {
 
          << "    -a, --align-in             input GAM format" << endl
          << "    -A, --aln-graph GAM        add alignments from GAM to the graph" << endl
+         << "    -O, --columns-out          output the scores, mapping qualities, and reference positions" << endl
+         << "                               of GAM input as column blocks, one per GAM group" << endl
 
          << "    -q, --locus-in             input stream is Locus format" << endl
          << "    -z, --locus-out            output stream Locus format" << endl
@@ -153,6 +156,7 @@ int main_view(int argc, char** argv) {
                 {"fastq-out", no_argument, 0, 'X'},
                 {"interleaved", no_argument, 0, 'i'},
                 {"aln-graph", required_argument, 0, 'A'},
+                {"columns-out", no_argument, 0, 'O'},
                 {"show-paths", no_argument, 0, 'p'},
                 {"turtle-in", no_argument, 0, 'T'},
                 {"walk-paths", no_argument, 0, 'w'},
@@ -181,7 +185,7 @@ int main_view(int argc, char** argv) {
             };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "dgFjJhvVpaGbifA:s:wnlLIMcTtr:SCZYmqQ:zXREDkKe7:",
+        c = getopt_long (argc, argv, "dgFjJhvVpaGbifA:Os:wnlLIMcTtr:SCZYmqQ:zXREDkKe7:",
                          long_options, &option_index);
 
         /* Detect the end of the options. */
@@ -327,6 +331,14 @@ int main_view(int argc, char** argv) {
             alignments = optarg;
             break;
 
+        case 'O':
+            output_type = "columns";
+            if(input_type.empty()) {
+                // Columns can only be made from GAM
+                input_type = "gam";
+            }
+            break;
+
         case 'I':
             invert_edge_ports_in_dot = true;
             break;
@@ -448,6 +460,39 @@ int main_view(int argc, char** argv) {
         }
         // VG can convert to any of the graph formats, so keep going
     } else if (input_type == "gfa") {
+        if (output_type == "vg" || output_type == "stream") {
+            // Blunt GFA can go straight out in chunks without building a VG
+            vector<Graph> buffer;
+            function<void(Graph&)> lambda = [&](Graph& g) {
+                if (output_type == "vg") {
+                    buffer.push_back(g);
+                    stream::write_buffered(cout, buffer, 1);
+                } else {
+                    cout << pb2json(g) << endl;
+                }
+            };
+            bool streamed = false;
+            get_input_file(file_name, [&](istream& in) {
+                try {
+                    if (!gfa_to_graph_chunks(in, lambda)) {
+                        // GFA loading has failed because the file is invalid
+                        exit(1);
+                    }
+                    streamed = true;
+                } catch (GFAOverlapError& e) {
+                    if (file_name == "-") {
+                        cerr << "[vg view] error: " << e.what() << ", which can't be imported from standard input" << endl;
+                        exit(1);
+                    }
+                }
+            });
+            if (streamed) {
+                if (output_type == "vg") {
+                    stream::write_buffered(cout, buffer, 0);
+                }
+                return 0;
+            }
+        }
         get_input_file(file_name, [&](istream& in) {
             graph = new VG;
             if (!gfa_to_graph(in, graph)) {
@@ -472,18 +517,27 @@ int main_view(int argc, char** argv) {
     } else if (input_type == "gam") {
         if (!input_json) {
             if (output_type == "json") {
-                // convert values to printable ones
-                function<void(Alignment&)> lambda = [](Alignment& a) {
-                    if(std::isnan(a.identity())) {
-                        // Fix up NAN identities that can't be serialized in
-                        // JSON. We shouldn't generate these any more, and they
-                        // are out of spec, but they can be in files.
-                        a.set_identity(0);
+                // Encode batches of reads in parallel, and print them in order
+                vector<string> json;
+                function<void(int64_t, vector<Alignment>&)> lambda = [&](int64_t virtual_offset, vector<Alignment>& batch) {
+                    json.resize(batch.size());
+#pragma omp parallel for schedule(dynamic, 64)
+                    for (size_t i = 0; i < batch.size(); i++) {
+                        Alignment& a = batch[i];
+                        if(std::isnan(a.identity())) {
+                            // Fix up NAN identities that can't be serialized in
+                            // JSON. We shouldn't generate these any more, and they
+                            // are out of spec, but they can be in files.
+                            a.set_identity(0);
+                        }
+                        json[i] = pb2json(a);
+                    }
+                    for (auto& line : json) {
+                        cout << line << "\n";
                     }
-                    cout << pb2json(a) << "\n";
                 };
                 get_input_file(file_name, [&](istream& in) {
-                    stream::for_each(in, lambda);
+                    stream::for_each_in_batches(in, 1024 * get_thread_count(), lambda);
                 });
             } else if (output_type == "fastq") {
                 function<void(Alignment&)> lambda = [](Alignment& a) {
@@ -512,9 +566,34 @@ int main_view(int argc, char** argv) {
                 });
                 stream::write_buffered(cout, buf, 0);
             }
+            else if (output_type == "columns") {
+                // Make one block of columns per GAM group, without decoding
+                // the fields we don't keep.
+                GAMColumnWriter writer(cout);
+                AlignmentColumns columns;
+                auto flush_columns = [&]() {
+                    if (columns.name_size() > 0) {
+                        writer.write_columns(columns);
+                    }
+                    columns.Clear();
+                };
+                function<void(int64_t, AlignmentView&)> lambda = [&](int64_t virtual_offset, AlignmentView& aln) {
+                    if (columns.name_size() == 0) {
+                        columns.set_virtual_offset(virtual_offset);
+                    }
+                    append_row(columns, aln);
+                };
+                function<void(size_t)> on_group = [&](size_t count) {
+                    flush_columns();
+                };
+                get_input_file(file_name, [&](istream& in) {
+                    stream::for_each_with_group_length(in, lambda, on_group);
+                });
+                flush_columns();
+            }
             else {
                 // todo
-                cerr << "[vg view] error: (binary) GAM can only be converted to JSON, GAMP or FASTQ" << endl;
+                cerr << "[vg view] error: (binary) GAM can only be converted to JSON, GAMP, FASTQ, or columns" << endl;
                 return 1;
             }
         } else {
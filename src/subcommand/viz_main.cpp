@@ -3,6 +3,7 @@
 #include "../viz.hpp"
 #include "../stream.hpp"
 
+#include <omp.h>
 #include <unistd.h>
 #include <getopt.h>
 
@@ -16,11 +17,13 @@ void help_viz(char** argv) {
          << "    -i, --pack-in FILE    use this compressed coverage format (multiple allowed)" << endl
          << "    -n, --name NAME       apply name to the previous .pack (multiple allowed)" << endl
          << "    -o, --out FILE        write to file (could be .png or .svg)" << endl
-         << "    -X, --width N         write an image N pixels wide (default 1024)" << endl
-         << "    -Y, --height N        write an image N pixels high (default 1024)" << endl
+         << "    -X, --width N         write an image N pixels wide, summarizing the graph in" << endl
+         << "                          pixel-wide bins if it has too many bases to draw one by one" << endl
+         << "    -Y, --height N        write an image N pixels high (only with bins)" << endl
          << "    -C, --show-cnv        visualize CNVs in paths on new rows (default uses text)" << endl
          << "    -P, --hide-paths      hide reference paths in the graph" << endl
-         << "    -D, --hide-dna        suppress the visualization of DNA sequences" << endl;
+         << "    -D, --hide-dna        suppress the visualization of DNA sequences" << endl
+         << "    -t, --threads N       summarize bins using N threads" << endl;
 }
 
 int main_viz(int argc, char** argv) {
@@ -57,10 +60,11 @@ int main_viz(int argc, char** argv) {
             {"hide-cnv", no_argument, 0, 'C'},
             {"hide-dna", no_argument, 0, 'D'},
             {"hide-paths", no_argument, 0, 'P'},
+            {"threads", required_argument, 0, 't'},
             {0, 0, 0, 0}
         };
         int option_index = 0;
-        c = getopt_long (argc, argv, "hx:i:n:o:X:Y:s:CDP",
+        c = getopt_long (argc, argv, "hx:i:n:o:X:Y:s:CDPt:",
                 long_options, &option_index);
 
         // Detect the end of the options.
@@ -104,6 +108,9 @@ int main_viz(int argc, char** argv) {
         case 'P':
             show_paths = false;
             break;
+        case 't':
+            omp_set_num_threads(parse<int>(optarg));
+            break;
         default:
             abort();
         }
@@ -20,6 +20,8 @@
 #include "../xg.hpp"
 #include "../region.hpp"
 #include "../handle_to_vg.hpp"
+#include "../gfa.hpp"
+#include "../utility.hpp"
 
 using namespace std;
 using namespace vg;
@@ -35,7 +37,9 @@ void help_xg(char** argv) {
          << "    -V, --validate             validate compression" << endl
          << "    -o, --out FILE             serialize graph to FILE in xg format" << endl
          << "    -i, --in FILE              use index in FILE" << endl
+         << "    -A, --add-paths FILE       add the paths in vg FILE to the index from -i, keeping its graph" << endl
          << "    -X, --extract-vg FILE      serialize graph to FILE in vg format" << endl
+         << "    -G, --gfa-out FILE         serialize graph to FILE in GFA format" << endl
          << "    -n, --node ID              graph neighborhood around node with ID" << endl
          << "    -c, --context N            steps of context to extract when building neighborhood" << endl
          << "    -s, --node-seq ID          provide node sequence for ID" << endl
@@ -66,6 +70,7 @@ int main_xg(int argc, char** argv) {
 
     string vg_in;
     string vg_out;
+    string gfa_out;
     string out_name;
     string in_name;
     int64_t node_id;
@@ -88,6 +93,7 @@ int main_xg(int argc, char** argv) {
     bool is_sorted_dag = false;
     string report_name;
     string b_array_name;
+    string add_paths_name;
     
     int c;
     optind = 2; // force optind past "xg" positional argument
@@ -98,7 +104,9 @@ int main_xg(int argc, char** argv) {
                 {"vg", required_argument, 0, 'v'},
                 {"out", required_argument, 0, 'o'},
                 {"in", required_argument, 0, 'i'},
+                {"add-paths", required_argument, 0, 'A'},
                 {"extract-vg", required_argument, 0, 'X'},
+                {"gfa-out", required_argument, 0, 'G'},
                 {"node", required_argument, 0, 'n'},
                 {"char", required_argument, 0, 'P'},
                 {"substr", required_argument, 0, 'F'},
@@ -123,7 +131,7 @@ int main_xg(int argc, char** argv) {
             };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "hv:o:i:X:f:t:s:c:n:p:DxrdTO:S:E:VR:P:F:b:",
+        c = getopt_long (argc, argv, "hv:o:i:A:X:G:f:t:s:c:n:p:DxrdTO:S:E:VR:P:F:b:",
                          long_options, &option_index);
 
         // Detect the end of the options.
@@ -169,10 +177,18 @@ int main_xg(int argc, char** argv) {
             in_name = optarg;
             break;
 
+        case 'A':
+            add_paths_name = optarg;
+            break;
+
         case 'X':
             vg_out = optarg;
             break;
 
+        case 'G':
+            gfa_out = optarg;
+            break;
+
         case 'n':
             node_id = parse<int64_t>(optarg);
             node_context = true;
@@ -267,6 +283,36 @@ int main_xg(int argc, char** argv) {
         }
     }
 
+    if (!add_paths_name.empty()) {
+        if (in_name.empty()) {
+            cerr << "error [vg xg] paths can only be added to an existing index; Try: vg xg -i graph.xg -A paths.vg -o new.xg" << endl;
+            return 1;
+        }
+        // Paths can be split across the chunks of a vg file
+        map<string, Path> paths_by_name;
+        get_input_file(add_paths_name, [&](istream& in) {
+            stream::for_each<Graph>(in, [&](Graph& chunk) {
+                for (size_t i = 0; i < chunk.path_size(); i++) {
+                    const Path& part = chunk.path(i);
+                    Path& path = paths_by_name[part.name()];
+                    path.set_name(part.name());
+                    path.set_is_circular(path.is_circular() || part.is_circular());
+                    path.mutable_mapping()->MergeFrom(part.mapping());
+                }
+            });
+        });
+        vector<Path> new_paths;
+        for (auto& named_path : paths_by_name) {
+            new_paths.emplace_back(move(named_path.second));
+        }
+        try {
+            graph->add_paths(new_paths);
+        } catch (const runtime_error& e) {
+            cerr << "error [vg xg] " << e.what() << endl;
+            return 1;
+        }
+    }
+
     // Prepare structure tree for serialization
     unique_ptr<sdsl::structure_tree_node> structure;
     
@@ -307,6 +353,20 @@ int main_xg(int argc, char** argv) {
         }
     }
 
+    if (!gfa_out.empty()) {
+        if (graph == nullptr) {
+             cerr << "error [vg xg] no xg graph exists to convert; Try: vg xg -i graph.xg -G graph.gfa" << endl;
+             return 1;
+        }
+        
+        if (gfa_out == "-") {
+            graph_to_gfa(*graph, std::cout);
+        } else {
+            ofstream out(gfa_out);
+            graph_to_gfa(*graph, out);
+        }
+    }
+
     if (!out_name.empty()) {
         if (out_name == "-") {
             graph->serialize(std::cout, structure.get(), "xg");
@@ -411,51 +471,49 @@ int main_xg(int argc, char** argv) {
     }
     
     if (extract_threads) {
-        list<XG::thread_t> threads;
-        for (auto& p : graph->extract_threads(false)) {
-            for (auto& t : p.second) {
-                threads.push_back(t);
-            }
-        }
-        for (auto& p : graph->extract_threads(true)) {
-            for (auto& t : p.second) {
-                threads.push_back(t);
-            }
-        }
-
-        size_t thread_number = 0;
-        for(XG::thread_t& thread : threads) {
-            // Convert to a Path
-            Path path;
-            for(XG::ThreadMapping& m : thread) {
-                // Convert all the mappings
-                Mapping mapping;
-                mapping.mutable_position()->set_node_id(m.node_id);
-                mapping.mutable_position()->set_is_reverse(m.is_reverse);
+        // Walk the threads in parallel, but write them in order. Threads can
+        // be long, so we write one chunk per thread instead of collecting them.
+        stream::OutputQueue output(cout);
+        size_t forward_count = graph->thread_starts(false).size();
+        for (bool reverse : {false, true}) {
+            graph->for_each_thread(reverse, [&](size_t i, const string& name, XG::thread_t& thread) {
+                // Convert to a Path
+                Path path;
+                for(XG::ThreadMapping& m : thread) {
+                    // Convert all the mappings
+                    Mapping mapping;
+                    mapping.mutable_position()->set_node_id(m.node_id);
+                    mapping.mutable_position()->set_is_reverse(m.is_reverse);
+                    
+                    *(path.add_mapping()) = mapping;
+                }
                 
-                *(path.add_mapping()) = mapping;
-            }
-        
-        
-            // Give each thread a name
-            path.set_name("_thread_" + to_string(thread_number++));
-            
-            // We need a Graph for serialization purposes. We do one chunk per
-            // thread in case the threads are long.
-            Graph g;
-            
-            *(g.add_path()) = path;
-            
-            // Dump the graph with its mappings. TODO: can we restrict these to
-            // mappings to nodes we have already pulled out? Or pull out the
-            // whole compressed graph?
-            if (text_output) {
-                to_text(cout, g);
-            } else {
-                vector<Graph> gb = { g };
-                stream::write_buffered(cout, gb, 0);
-            }
-            
+                // Give each thread a name
+                size_t thread_number = reverse ? forward_count + i : i;
+                path.set_name("_thread_" + to_string(thread_number));
+                
+                // We need a Graph for serialization purposes. We do one chunk per
+                // thread in case the threads are long.
+                Graph g;
+                
+                *(g.add_path()) = path;
+                
+                // Dump the graph with its mappings. TODO: can we restrict these to
+                // mappings to nodes we have already pulled out? Or pull out the
+                // whole compressed graph?
+                if (text_output) {
+                    stringstream text;
+                    to_text(text, g);
+                    output.push(thread_number, text.str());
+                } else {
+                    vector<Graph> gb = { g };
+                    output.push(thread_number, stream::serialize_group(gb));
+                }
+            }, true);
+        }
+        output.close();
+        if (!text_output) {
+            stream::finish(cout);
         }
     }
 
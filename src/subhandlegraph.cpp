@@ -0,0 +1,163 @@
+#include "subhandlegraph.hpp"
+
+#include <stdexcept>
+
+/** \file subhandlegraph.cpp
+ * Implementation of the handle-based subgraph view.
+ */
+
+namespace vg {
+
+using namespace std;
+
+SubHandleGraph::SubHandleGraph(const HandleGraph* super) : super(super) {
+    // Nothing to do
+}
+
+void SubHandleGraph::add_node(const handle_t& handle) {
+    id_t node_id = super->get_id(handle);
+    if (node_index.count(node_id)) {
+        return;
+    }
+    node_index[node_id] = nodes.size();
+    nodes.push_back(super->forward(handle));
+    left_edges.emplace_back();
+    right_edges.emplace_back();
+}
+
+void SubHandleGraph::add_edge(const handle_t& left, const handle_t& right) {
+    edge_t edge = super->edge_handle(left, right);
+    if (!edges.insert(edge).second) {
+        return;
+    }
+    edge_order.push_back(edge);
+    add_node(left);
+    add_node(right);
+
+    // Going right from left reaches right
+    size_t left_index = node_index[super->get_id(left)];
+    if (super->get_is_reverse(left)) {
+        left_edges[left_index].push_back(super->flip(right));
+    } else {
+        right_edges[left_index].push_back(right);
+    }
+    if (as_integer(left) == as_integer(super->flip(right))) {
+        // A reversing self loop is its own reverse, so that was both sides
+        return;
+    }
+    // Going left from right reaches left
+    size_t right_index = node_index[super->get_id(right)];
+    if (super->get_is_reverse(right)) {
+        right_edges[right_index].push_back(super->flip(left));
+    } else {
+        left_edges[right_index].push_back(left);
+    }
+}
+
+void SubHandleGraph::clear() {
+    nodes.clear();
+    node_index.clear();
+    left_edges.clear();
+    right_edges.clear();
+    edge_order.clear();
+    edges.clear();
+}
+
+bool SubHandleGraph::has_node(id_t node_id) const {
+    return node_index.count(node_id);
+}
+
+bool SubHandleGraph::has_edge(const handle_t& left, const handle_t& right) const {
+    return edges.count(super->edge_handle(left, right));
+}
+
+size_t SubHandleGraph::edge_size() const {
+    return edge_order.size();
+}
+
+const HandleGraph* SubHandleGraph::get_super() const {
+    return super;
+}
+
+void SubHandleGraph::to_graph(Graph& g) const {
+    for (auto& handle : nodes) {
+        Node* node = g.add_node();
+        node->set_id(super->get_id(handle));
+        node->set_sequence(super->get_sequence(handle));
+    }
+    for (auto& edge : edge_order) {
+        Edge* e = g.add_edge();
+        e->set_from(super->get_id(edge.first));
+        e->set_from_start(super->get_is_reverse(edge.first));
+        e->set_to(super->get_id(edge.second));
+        e->set_to_end(super->get_is_reverse(edge.second));
+    }
+}
+
+handle_t SubHandleGraph::get_handle(const id_t& node_id, bool is_reverse) const {
+    auto found = node_index.find(node_id);
+    if (found == node_index.end()) {
+        throw runtime_error("SubHandleGraph: node " + to_string(node_id) + " is not in the subgraph");
+    }
+    handle_t handle = nodes[found->second];
+    return is_reverse ? super->flip(handle) : handle;
+}
+
+id_t SubHandleGraph::get_id(const handle_t& handle) const {
+    return super->get_id(handle);
+}
+
+bool SubHandleGraph::get_is_reverse(const handle_t& handle) const {
+    return super->get_is_reverse(handle);
+}
+
+handle_t SubHandleGraph::flip(const handle_t& handle) const {
+    return super->flip(handle);
+}
+
+size_t SubHandleGraph::get_length(const handle_t& handle) const {
+    return super->get_length(handle);
+}
+
+string SubHandleGraph::get_sequence(const handle_t& handle) const {
+    return super->get_sequence(handle);
+}
+
+bool SubHandleGraph::follow_edges(const handle_t& handle, bool go_left, const function<bool(const handle_t&)>& iteratee) const {
+    size_t index = node_index.at(super->get_id(handle));
+    bool is_reverse = super->get_is_reverse(handle);
+    // On the reverse strand, left and right swap and the neighbors flip
+    auto& neighbors = (go_left != is_reverse) ? left_edges[index] : right_edges[index];
+    for (auto& neighbor : neighbors) {
+        if (!iteratee(is_reverse ? super->flip(neighbor) : neighbor)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void SubHandleGraph::for_each_handle(const function<bool(const handle_t&)>& iteratee, bool parallel) const {
+    if (parallel) {
+        volatile bool flag = true;
+#pragma omp parallel for
+        for (size_t i = 0; i < nodes.size(); i++) {
+            if (!flag) continue;
+            bool still_go = iteratee(nodes[i]);
+            if (!still_go) {
+                flag = false;
+            }
+        }
+    } else {
+        for (auto& handle : nodes) {
+            if (!iteratee(handle)) {
+                break;
+            }
+        }
+    }
+}
+
+size_t SubHandleGraph::node_size() const {
+    return nodes.size();
+}
+
+}
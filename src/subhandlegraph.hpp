@@ -0,0 +1,142 @@
+#ifndef VG_SUBHANDLEGRAPH_HPP_INCLUDED
+#define VG_SUBHANDLEGRAPH_HPP_INCLUDED
+
+/** \file
+ * A lightweight view of some of the nodes and edges of another handle graph,
+ * for extracting subgraphs without copying sequences into Protobuf objects.
+ */
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "handle.hpp"
+#include "hash_map.hpp"
+#include "vg.pb.h"
+
+namespace vg {
+
+using namespace std;
+
+/**
+ * A HandleGraph made of a set of nodes and edges of a backing "super" graph,
+ * which must outlive it. Handles are the super graph's handles, and lengths
+ * and sequences are read from the super graph on demand, so building a view
+ * only costs an id table and the local adjacency lists of the nodes in it.
+ *
+ * Edges are only in the view if they have been added, even if both of their
+ * nodes are, so the view can represent exactly the edges a search crossed.
+ * Paths are not represented.
+ */
+class SubHandleGraph : public HandleGraph {
+public:
+
+    /// Make an empty view of the given graph.
+    SubHandleGraph(const HandleGraph* super);
+
+    ////////////////////////////////////////////////////////////////////////////
+    // Building the view
+    ////////////////////////////////////////////////////////////////////////////
+
+    /// Add the node of a handle of the super graph, if it isn't in the view
+    /// already.
+    void add_node(const handle_t& handle);
+
+    /// Add an edge of the super graph from left to right, and its nodes, if
+    /// it isn't in the view already. The edge must exist in the super graph.
+    void add_edge(const handle_t& left, const handle_t& right);
+
+    /// Empty out the view, keeping the super graph.
+    void clear();
+
+    ////////////////////////////////////////////////////////////////////////////
+    // Queries beyond the handle graph interface
+    ////////////////////////////////////////////////////////////////////////////
+
+    /// Is there a node with this ID in the view?
+    bool has_node(id_t node_id) const;
+
+    /// Is this edge in the view?
+    bool has_edge(const handle_t& left, const handle_t& right) const;
+
+    /// Get the number of edges in the view.
+    size_t edge_size() const;
+
+    /// Get the graph this is a view of.
+    const HandleGraph* get_super() const;
+
+    /// Fill in a Protobuf graph with the nodes and edges of the view, for
+    /// code that can't work on handles. Nodes are added in the order they
+    /// were added to the view.
+    void to_graph(Graph& g) const;
+
+    ////////////////////////////////////////////////////////////////////////////
+    // Handle-based interface
+    ////////////////////////////////////////////////////////////////////////////
+
+    /// Look up the handle for the node with the given ID in the given
+    /// orientation. The node must be in the view.
+    virtual handle_t get_handle(const id_t& node_id, bool is_reverse = false) const;
+
+    // Copy over the visit version which would otherwise be shadowed.
+    using HandleGraph::get_handle;
+
+    /// Get the ID from a handle
+    virtual id_t get_id(const handle_t& handle) const;
+
+    /// Get the orientation of a handle
+    virtual bool get_is_reverse(const handle_t& handle) const;
+
+    /// Invert the orientation of a handle (potentially without getting its ID)
+    virtual handle_t flip(const handle_t& handle) const;
+
+    /// Get the length of a node
+    virtual size_t get_length(const handle_t& handle) const;
+
+    /// Get the sequence of a node, presented in the handle's local forward
+    /// orientation.
+    virtual string get_sequence(const handle_t& handle) const;
+
+    /// Loop over the handles to next/previous (right/left) nodes along the
+    /// edges in the view. Passes them to a callback which returns false to
+    /// stop iterating and true to continue. Returns true if we finished and
+    /// false if we stopped early.
+    virtual bool follow_edges(const handle_t& handle, bool go_left, const function<bool(const handle_t&)>& iteratee) const;
+
+    // Copy over the template for nice calls
+    using HandleGraph::follow_edges;
+
+    /// Loop over all the nodes in the view in their local forward
+    /// orientations, in the order they were added. Stop if the iteratee
+    /// returns false.
+    virtual void for_each_handle(const function<bool(const handle_t&)>& iteratee, bool parallel = false) const;
+
+    // Copy over the template for nice calls
+    using HandleGraph::for_each_handle;
+
+    /// Return the number of nodes in the view
+    virtual size_t node_size() const;
+
+private:
+
+    const HandleGraph* super;
+
+    /// The forward handles of the nodes, in the order they were added
+    vector<handle_t> nodes;
+    /// The index of each node in nodes, by ID
+    hash_map<id_t, size_t> node_index;
+    /// The handles reached going left and right from the forward strand of
+    /// each node, by index
+    vector<vector<handle_t>> left_edges;
+    vector<vector<handle_t>> right_edges;
+    /// The edges in the view, in canonical orientation, in the order they
+    /// were added, and as a set for deduplication
+    vector<edge_t> edge_order;
+    unordered_set<edge_t> edges;
+};
+
+}
+
+#endif
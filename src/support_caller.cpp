@@ -238,20 +238,20 @@ SupportCaller::PrimaryPath::PrimaryPath(SupportAugmentedGraph& augmented, const
     // Crunch the numbers on the reference and its read support. How much read
     // support in total (node length * aligned reads) does the primary path get?
     total_support = Support();
-    for(auto& pointerAndSupport : augmented.node_supports) {
-        if(index.by_id.count(pointerAndSupport.first->id())) {
+    augmented.for_each_node_support([&](Node* node, const Support& support) {
+        if(index.by_id.count(node->id())) {
             // This is a primary path node. Add in the total read bases supporting it
-            total_support += pointerAndSupport.first->sequence().size() * pointerAndSupport.second;
+            total_support += node->sequence().size() * support;
             
             // We also update the total for the appropriate bin
-            size_t bin = index.by_id[pointerAndSupport.first->id()].first / ref_bin_size;
+            size_t bin = index.by_id[node->id()].first / ref_bin_size;
             if (bin == binned_support.size()) {
                 --bin;
             }
             binned_support[bin] = binned_support[bin] + 
-                pointerAndSupport.first->sequence().size() * pointerAndSupport.second;
+                node->sequence().size() * support;
         }
-    }
+    });
     
     // Average out the support bins too (in place)
     min_bin = 0;
@@ -1268,504 +1268,583 @@ void SupportCaller::call(
     // How many sites result in output?
     size_t called_loci = 0;
     
-    for(const Snarl* site : sites) {
-        // For every site, we're going to make a bunch of Locus objects
-        
-        // See if the site is on a primary path, so we can use binned support.
-        map<string, PrimaryPath>::iterator found_path = find_path(*site, primary_paths);
-        
-        // We need to figure out how much support a site ought to have.
-        // Within its local bin?
-        Support baseline_support;
-        // On its primary path?
-        Support global_baseline_support;
-        if (expected_coverage != 0.0) {
-            // Use the specified coverage override
-            baseline_support.set_forward(expected_coverage / 2);
-            baseline_support.set_reverse(expected_coverage / 2);
-            global_baseline_support = baseline_support;
-        } else if (found_path != primary_paths.end()) {
-            // We're on a primary path, so we can find the appropriate bin
-        
-            // Since the variable part of the site is after the first anchoring node, where does it start?
-            // Account for the site possibly being backward on the path.
-            size_t variation_start = min(found_path->second.get_index().by_id.at(site->start().node_id()).first
-                    + augmented.graph.get_node(site->start().node_id())->sequence().size(),
-                found_path->second.get_index().by_id.at(site->end().node_id()).first
-                    + augmented.graph.get_node(site->end().node_id())->sequence().size());
-            
-            // Look in the bins for the primary path to get the support there.
-            baseline_support = found_path->second.get_support_at(variation_start);
-            
-            // And grab the path's overall support
-            global_baseline_support = found_path->second.get_average_support();
-            
-        } else {
-            // Just use the primary paths' average support, which may be 0 if there are none.
-            // How much support is expected across all the primary paths? May be 0 if there are no primary paths.
-            global_baseline_support = PrimaryPath::get_average_support(primary_paths);
-            baseline_support = global_baseline_support;
+    // Split the sites into work chunks that can be called independently. Sites
+    // on a primary path are grouped by the coverage bin they start in, and
+    // sorted along the path within each bin. Each site off the primary paths
+    // gets a chunk of its own. Chunks are ordered by path, then by bin, with
+    // the off-path sites last.
+    map<pair<size_t, size_t>, vector<pair<size_t, const Snarl*>>> sites_by_bin;
+    vector<const Snarl*> off_path_sites;
+    for (const Snarl* site : sites) {
+        auto found_path = find_path(*site, primary_paths);
+        if (found_path == primary_paths.end()) {
+            off_path_sites.push_back(site);
+            continue;
+        }
+        auto& index = found_path->second.get_index();
+        size_t site_start = min(index.by_id.at(site->start().node_id()).first,
+                                index.by_id.at(site->end().node_id()).first);
+        size_t path_number = find(primary_path_names.begin(), primary_path_names.end(),
+                                  found_path->first) - primary_path_names.begin();
+        sites_by_bin[make_pair(path_number, found_path->second.get_bin_index(site_start))].emplace_back(site_start, site);
+    }
+    vector<vector<const Snarl*>> chunks;
+    for (auto& bin_and_sites : sites_by_bin) {
+        auto& bin_sites = bin_and_sites.second;
+        stable_sort(bin_sites.begin(), bin_sites.end(), [](const pair<size_t, const Snarl*>& a,
+                                                           const pair<size_t, const Snarl*>& b) {
+                return a.first < b.first;
+            });
+        chunks.emplace_back();
+        for (auto& start_and_site : bin_sites) {
+            chunks.back().push_back(start_and_site.second);
         }
+    }
+    for (const Snarl* site : off_path_sites) {
+        chunks.emplace_back(1, site);
+    }
+    
+    if (verbose) {
+        cerr << "Calling " << sites.size() << " sites in " << chunks.size() << " chunks" << endl;
+    }
+    
+    // Everything calling a chunk produces, held until all the chunks before it
+    // have been written.
+    struct ChunkOutput {
+        string vcf_text;
+        vector<Locus> loci;
+        set<Node*> covered_nodes;
+        set<Edge*> covered_edges;
+        size_t called_loci = 0;
+    };
+    map<size_t, ChunkOutput> finished_chunks;
+    size_t next_chunk = 0;
+    
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (size_t chunk_number = 0; chunk_number < chunks.size(); chunk_number++) {
+        
+        ChunkOutput output;
+        stringstream vcf_stream;
+    
+        for(const Snarl* site : chunks[chunk_number]) {
+                // For every site, we're going to make a bunch of Locus objects
+        
+                // See if the site is on a primary path, so we can use binned support.
+                map<string, PrimaryPath>::iterator found_path = find_path(*site, primary_paths);
+        
+                // We need to figure out how much support a site ought to have.
+                // Within its local bin?
+                Support baseline_support;
+                // On its primary path?
+                Support global_baseline_support;
+                if (expected_coverage != 0.0) {
+                    // Use the specified coverage override
+                    baseline_support.set_forward(expected_coverage / 2);
+                    baseline_support.set_reverse(expected_coverage / 2);
+                    global_baseline_support = baseline_support;
+                } else if (found_path != primary_paths.end()) {
+                    // We're on a primary path, so we can find the appropriate bin
+        
+                    // Since the variable part of the site is after the first anchoring node, where does it start?
+                    // Account for the site possibly being backward on the path.
+                    size_t variation_start = min(found_path->second.get_index().by_id.at(site->start().node_id()).first
+                            + augmented.graph.get_node(site->start().node_id())->sequence().size(),
+                        found_path->second.get_index().by_id.at(site->end().node_id()).first
+                            + augmented.graph.get_node(site->end().node_id())->sequence().size());
+            
+                    // Look in the bins for the primary path to get the support there.
+                    baseline_support = found_path->second.get_support_at(variation_start);
+            
+                    // And grab the path's overall support
+                    global_baseline_support = found_path->second.get_average_support();
+            
+                } else {
+                    // Just use the primary paths' average support, which may be 0 if there are none.
+                    // How much support is expected across all the primary paths? May be 0 if there are no primary paths.
+                    global_baseline_support = PrimaryPath::get_average_support(primary_paths);
+                    baseline_support = global_baseline_support;
+                }
         
-        // This function emits the given variant on the given primary path, as
-        // VCF. It needs to take the site as an argument because it may be
-        // called for children of the site we're working on right now.
-        auto emit_variant = [&contig_names_by_path_name, &vcf, &augmented,
-            &baseline_support, &global_baseline_support, this](
-            const Locus& locus, PrimaryPath& primary_path, const Snarl* site) {
-        
-            // Note that the locus paths will traverse our site forward, which
-            // may make them backward along the primary path.
-            bool site_backward = (primary_path.get_index().by_id.at(site->start().node_id()).first >
-                primary_path.get_index().by_id.at(site->end().node_id()).first);
-        
-            // Unpack the genotype back into best and second-best allele
-            auto& genotype = locus.genotype(0);
-            int best_allele = genotype.allele(0);
-            // If we called a single allele, we've lost the second-best allele info. But we won't need it, so we can just say -1.
-            int second_best_allele = (genotype.allele_size() >= 2 && genotype.allele(0) != genotype.allele(1)) ?
-                genotype.allele(1) :
-                -1;
+                // This function emits the given variant on the given primary path, as
+                // VCF. It needs to take the site as an argument because it may be
+                // called for children of the site we're working on right now.
+                auto emit_variant = [&contig_names_by_path_name, &vcf, &vcf_stream, &augmented,
+                    &baseline_support, &global_baseline_support, this](
+                    const Locus& locus, PrimaryPath& primary_path, const Snarl* site) {
+        
+                    // Note that the locus paths will traverse our site forward, which
+                    // may make them backward along the primary path.
+                    bool site_backward = (primary_path.get_index().by_id.at(site->start().node_id()).first >
+                        primary_path.get_index().by_id.at(site->end().node_id()).first);
+        
+                    // Unpack the genotype back into best and second-best allele
+                    auto& genotype = locus.genotype(0);
+                    int best_allele = genotype.allele(0);
+                    // If we called a single allele, we've lost the second-best allele info. But we won't need it, so we can just say -1.
+                    int second_best_allele = (genotype.allele_size() >= 2 && genotype.allele(0) != genotype.allele(1)) ?
+                        genotype.allele(1) :
+                        -1;
                 
-            // Populate this with original node IDs, from before augmentation.
-            set<id_t> original_nodes;
+                    // Populate this with original node IDs, from before augmentation.
+                    set<id_t> original_nodes;
                 
-            // Calculate the ID and sequence strings for all the alleles.
-            // TODO: we only use some of these
-            vector<string> sequences;
-            vector<string> id_lists;
-            // Also the flags for whether alts are reference (i.e. known)
-            vector<bool> is_ref;
-
-            for (size_t i = 0; i < locus.allele_size(); i++) {
-
-                // For each allele path in the Locus
-                auto& path = locus.allele(i);
-#ifdef debug
-                cerr << "Extracting allele " << i << ": " << pb2json(path) << endl;
-#endif
-                // Make a stream for the sequence of the path
-                stringstream sequence_stream;
-                // And for the description of involved IDs
-                stringstream id_stream;
+                    // Calculate the ID and sequence strings for all the alleles.
+                    // TODO: we only use some of these
+                    vector<string> sequences;
+                    vector<string> id_lists;
+                    // Also the flags for whether alts are reference (i.e. known)
+                    vector<bool> is_ref;
+
+                    for (size_t i = 0; i < locus.allele_size(); i++) {
+
+                        // For each allele path in the Locus
+                        auto& path = locus.allele(i);
+        #ifdef debug
+                        cerr << "Extracting allele " << i << ": " << pb2json(path) << endl;
+        #endif
+                        // Make a stream for the sequence of the path
+                        stringstream sequence_stream;
+                        // And for the description of involved IDs
+                        stringstream id_stream;
                 
-                for (size_t j = 0; j < path.mapping_size(); j++) {
-                    // For each mapping along the path
-                    auto& mapping = path.mapping(j);
+                        for (size_t j = 0; j < path.mapping_size(); j++) {
+                            // For each mapping along the path
+                            auto& mapping = path.mapping(j);
                     
-                    // Record the sequence
-                    string node_sequence = augmented.graph.get_node(mapping.position().node_id())->sequence();
-                    if (mapping.position().is_reverse()) {
-                        node_sequence = reverse_complement(node_sequence);
-                    }
-                    sequence_stream << node_sequence;
-#ifdef debug
-                    cerr << "\tMapping: " << pb2json(mapping) << ", sequence " << node_sequence << endl;
-#endif
-                    if (j != 0) {
-                        // Add a separator
-                        id_stream << "_";
-                    }
-                    // Record the ID
-                    id_stream << mapping.position().node_id();
-
-                    if (augmented.translator.has_translation(mapping.position(), false)) {
-                        // This node is derived from an original graph node. Remember it.
-                        original_nodes.insert(augmented.translator.translate(mapping.position()).node_id());
-                    }                    
-                }
+                            // Record the sequence
+                            string node_sequence = augmented.graph.get_node(mapping.position().node_id())->sequence();
+                            if (mapping.position().is_reverse()) {
+                                node_sequence = reverse_complement(node_sequence);
+                            }
+                            sequence_stream << node_sequence;
+        #ifdef debug
+                            cerr << "\tMapping: " << pb2json(mapping) << ", sequence " << node_sequence << endl;
+        #endif
+                            if (j != 0) {
+                                // Add a separator
+                                id_stream << "_";
+                            }
+                            // Record the ID
+                            id_stream << mapping.position().node_id();
+
+                            if (augmented.translator.has_translation(mapping.position(), false)) {
+                                // This node is derived from an original graph node. Remember it.
+                                original_nodes.insert(augmented.translator.translate(mapping.position()).node_id());
+                            }                    
+                        }
                 
-                // Remember the descriptions of the alleles
-                if (site_backward) {
-                    sequences.push_back(reverse_complement(sequence_stream.str()));
-                } else {
-                    sequences.push_back(sequence_stream.str());
-                }
-#ifdef debug
-                cerr << "Recorded allele sequence " << sequences.back() << endl;
-#endif
-                id_lists.push_back(id_stream.str());
-                // And whether they're reference or not
-                is_ref.push_back(is_reference(path, augmented));
-            }
+                        // Remember the descriptions of the alleles
+                        if (site_backward) {
+                            sequences.push_back(reverse_complement(sequence_stream.str()));
+                        } else {
+                            sequences.push_back(sequence_stream.str());
+                        }
+        #ifdef debug
+                        cerr << "Recorded allele sequence " << sequences.back() << endl;
+        #endif
+                        id_lists.push_back(id_stream.str());
+                        // And whether they're reference or not
+                        is_ref.push_back(is_reference(path, augmented));
+                    }
             
-            // Start off declaring the variable part to start at the start of
-            // the first anchoring node. We'll clip it back later to just what's
-            // after the shared prefix.
-            size_t variation_start = min(primary_path.get_index().by_id.at(site->start().node_id()).first,
-                primary_path.get_index().by_id.at(site->end().node_id()).first);
-        
-            // Keep track of the alleles that actually need to go in the VCF:
-            // ref, best, and second-best (if any), some of which may overlap.
-            // This is the order they will show up in the variant.
-            vector<int> used_alleles;
-            used_alleles.push_back(0);
-            if (best_allele != 0) {
-                used_alleles.push_back(best_allele);
-            }
-            if(second_best_allele != -1 && second_best_allele != 0) {
-                used_alleles.push_back(second_best_allele);
-            }
+                    // Start off declaring the variable part to start at the start of
+                    // the first anchoring node. We'll clip it back later to just what's
+                    // after the shared prefix.
+                    size_t variation_start = min(primary_path.get_index().by_id.at(site->start().node_id()).first,
+                        primary_path.get_index().by_id.at(site->end().node_id()).first);
+        
+                    // Keep track of the alleles that actually need to go in the VCF:
+                    // ref, best, and second-best (if any), some of which may overlap.
+                    // This is the order they will show up in the variant.
+                    vector<int> used_alleles;
+                    used_alleles.push_back(0);
+                    if (best_allele != 0) {
+                        used_alleles.push_back(best_allele);
+                    }
+                    if(second_best_allele != -1 && second_best_allele != 0) {
+                        used_alleles.push_back(second_best_allele);
+                    }
             
-            // Rewrite the sequences and variation_start to just represent the
-            // actually variable part, by dropping any common prefix and common
-            // suffix. We just do the whole thing in place, modifying the used
-            // entries in sequences.
+                    // Rewrite the sequences and variation_start to just represent the
+                    // actually variable part, by dropping any common prefix and common
+                    // suffix. We just do the whole thing in place, modifying the used
+                    // entries in sequences.
             
-            auto shared_prefix_length = [&](bool backward) {
-                size_t shortest_prefix = std::numeric_limits<size_t>::max();
+                    auto shared_prefix_length = [&](bool backward) {
+                        size_t shortest_prefix = std::numeric_limits<size_t>::max();
                 
-                auto here = used_alleles.begin();
-                if (here == used_alleles.end()) {
-                    // No strings.
-                    // Say no prefix is in common...
-                    return (size_t) 0;
-                }
-                auto next = here;
-                next++;
+                        auto here = used_alleles.begin();
+                        if (here == used_alleles.end()) {
+                            // No strings.
+                            // Say no prefix is in common...
+                            return (size_t) 0;
+                        }
+                        auto next = here;
+                        next++;
                 
-                if (next == used_alleles.end()) {
-                    // Only one string.
-                    // Say no prefix is in common...
-                    return (size_t) 0;
-                }
+                        if (next == used_alleles.end()) {
+                            // Only one string.
+                            // Say no prefix is in common...
+                            return (size_t) 0;
+                        }
                 
-                while (next != used_alleles.end()) {
-                    // Consider each allele and the next one after it, as
-                    // long as we have both.
+                        while (next != used_alleles.end()) {
+                            // Consider each allele and the next one after it, as
+                            // long as we have both.
                 
-                    // Figure out the shorter and the longer string
-                    string* shorter = &sequences.at(*here);
-                    string* longer = &sequences.at(*next);
-                    if (shorter->size() > longer->size()) {
-                        swap(shorter, longer);
-                    }
+                            // Figure out the shorter and the longer string
+                            string* shorter = &sequences.at(*here);
+                            string* longer = &sequences.at(*next);
+                            if (shorter->size() > longer->size()) {
+                                swap(shorter, longer);
+                            }
                 
-                    // Calculate the match length for this pair
-                    size_t match_length;
-                    if (backward) {
-                        // Find out how far in from the right the first mismatch is.
-                        auto mismatch_places = std::mismatch(shorter->rbegin(), shorter->rend(), longer->rbegin());
-                        match_length = std::distance(shorter->rbegin(), mismatch_places.first);
-                    } else {
-                        // Find out how far in from the left the first mismatch is.
-                        auto mismatch_places = std::mismatch(shorter->begin(), shorter->end(), longer->begin());
-                        match_length = std::distance(shorter->begin(), mismatch_places.first);
-                    }
+                            // Calculate the match length for this pair
+                            size_t match_length;
+                            if (backward) {
+                                // Find out how far in from the right the first mismatch is.
+                                auto mismatch_places = std::mismatch(shorter->rbegin(), shorter->rend(), longer->rbegin());
+                                match_length = std::distance(shorter->rbegin(), mismatch_places.first);
+                            } else {
+                                // Find out how far in from the left the first mismatch is.
+                                auto mismatch_places = std::mismatch(shorter->begin(), shorter->end(), longer->begin());
+                                match_length = std::distance(shorter->begin(), mismatch_places.first);
+                            }
                     
-                    // The shared prefix of these strings limits the longest
-                    // prefix shared by all strings.
-                    shortest_prefix = min(shortest_prefix, match_length);
+                            // The shared prefix of these strings limits the longest
+                            // prefix shared by all strings.
+                            shortest_prefix = min(shortest_prefix, match_length);
                 
-                    here = next;
-                    ++next;
-                }
+                            here = next;
+                            ++next;
+                        }
                 
-                // Return the shortest universally shared prefix
-                return shortest_prefix;
-            };
-            // Trim off the shared prefix
-            size_t shared_prefix = shared_prefix_length(false);
-            for (auto allele : used_alleles) {
-                sequences[allele] = sequences[allele].substr(shared_prefix);
-            }
-            // Add it onto the start coordinate
-            variation_start += shared_prefix;
+                        // Return the shortest universally shared prefix
+                        return shortest_prefix;
+                    };
+                    // Trim off the shared prefix
+                    size_t shared_prefix = shared_prefix_length(false);
+                    for (auto allele : used_alleles) {
+                        sequences[allele] = sequences[allele].substr(shared_prefix);
+                    }
+                    // Add it onto the start coordinate
+                    variation_start += shared_prefix;
             
-            // Then find and trim off the shared suffix
-            size_t shared_suffix = shared_prefix_length(true);
-            for (auto allele : used_alleles) {
-                sequences[allele] = sequences[allele].substr(0, sequences[allele].size() - shared_suffix);
-            }
+                    // Then find and trim off the shared suffix
+                    size_t shared_suffix = shared_prefix_length(true);
+                    for (auto allele : used_alleles) {
+                        sequences[allele] = sequences[allele].substr(0, sequences[allele].size() - shared_suffix);
+                    }
             
-            // Make a Variant
-            vcflib::Variant variant;
-            variant.sequenceName = contig_names_by_path_name.at(primary_path.get_name());
-            variant.setVariantCallFile(vcf);
-            variant.quality = 0;
-            // Position should be 1-based and offset with our offset option.
-            variant.position = variation_start + 1 + variant_offset;
-            
-            // Set the ID based on the IDs of the involved nodes. Note that the best
-            // allele may have no nodes (because it's a pure edge)
-            variant.id = id_lists.at(best_allele);
-            if(second_best_allele != -1 && !id_lists.at(second_best_allele).empty()) {
-                // Add the second best allele's nodes in.
-                variant.id += "-" + id_lists.at(second_best_allele);
-            }
+                    // Make a Variant
+                    vcflib::Variant variant;
+                    variant.sequenceName = contig_names_by_path_name.at(primary_path.get_name());
+                    variant.setVariantCallFile(vcf);
+                    variant.quality = 0;
+                    // Position should be 1-based and offset with our offset option.
+                    variant.position = variation_start + 1 + variant_offset;
+            
+                    // Set the ID based on the IDs of the involved nodes. Note that the best
+                    // allele may have no nodes (because it's a pure edge)
+                    variant.id = id_lists.at(best_allele);
+                    if(second_best_allele != -1 && !id_lists.at(second_best_allele).empty()) {
+                        // Add the second best allele's nodes in.
+                        variant.id += "-" + id_lists.at(second_best_allele);
+                    }
             
             
-            if(sequences.at(0).empty() ||
-                (best_allele != -1 && sequences.at(best_allele).empty()) ||
-                (second_best_allele != -1 && sequences.at(second_best_allele).empty())) {
+                    if(sequences.at(0).empty() ||
+                        (best_allele != -1 && sequences.at(best_allele).empty()) ||
+                        (second_best_allele != -1 && sequences.at(second_best_allele).empty())) {
                 
-                // Fix up the case where we have an empty allele.
+                        // Fix up the case where we have an empty allele.
                 
-                // We need to grab the character before the variable part of the
-                // site in the reference.
-                assert(variation_start > 0);
-                string extra_base = char_to_string(primary_path.get_index().sequence.at(variation_start - 1));
+                        // We need to grab the character before the variable part of the
+                        // site in the reference.
+                        assert(variation_start > 0);
+                        string extra_base = char_to_string(primary_path.get_index().sequence.at(variation_start - 1));
                 
-                for(auto& seq : sequences) {
-                    // Stick it on the front of all the allele sequences
-                    seq = extra_base + seq;
-                }
+                        for(auto& seq : sequences) {
+                            // Stick it on the front of all the allele sequences
+                            seq = extra_base + seq;
+                        }
                 
-                // Budge the variant left
-                variant.position--;
-            }
+                        // Budge the variant left
+                        variant.position--;
+                    }
             
-            // Make sure the ref allele is correct
-            {
-                string real_ref = primary_path.get_index().sequence.substr(
-                    variant.position - variant_offset - 1, sequences.front().size());
-                string got_ref = sequences.front();
+                    // Make sure the ref allele is correct
+                    {
+                        string real_ref = primary_path.get_index().sequence.substr(
+                            variant.position - variant_offset - 1, sequences.front().size());
+                        string got_ref = sequences.front();
                 
-                if (real_ref != got_ref) {
-                    cerr << "Error: Ref should be " << real_ref << " but is " << got_ref << " at " << variant.position << endl;
-                    throw runtime_error("Reference mismatch at site " + pb2json(*site));
-                }
+                        if (real_ref != got_ref) {
+                            cerr << "Error: Ref should be " << real_ref << " but is " << got_ref << " at " << variant.position << endl;
+                            throw runtime_error("Reference mismatch at site " + pb2json(*site));
+                        }
             
-            }
+                    }
             
-            // Add the ref allele to the variant
-            create_ref_allele(variant, sequences.front());
+                    // Add the ref allele to the variant
+                    create_ref_allele(variant, sequences.front());
             
-            // Add the best allele
-            assert(best_allele != -1);
-            int best_alt = add_alt_allele(variant, sequences.at(best_allele));
+                    // Add the best allele
+                    assert(best_allele != -1);
+                    int best_alt = add_alt_allele(variant, sequences.at(best_allele));
             
-            int second_best_alt = (second_best_allele == -1) ? -1 : add_alt_allele(variant, sequences.at(second_best_allele));
+                    int second_best_alt = (second_best_allele == -1) ? -1 : add_alt_allele(variant, sequences.at(second_best_allele));
 
-            // Say we're going to spit out the genotype for this sample.        
-            variant.format.push_back("GT");
-            auto& genotype_vector = variant.samples[sample_name]["GT"];
+                    // Say we're going to spit out the genotype for this sample.        
+                    variant.format.push_back("GT");
+                    auto& genotype_vector = variant.samples[sample_name]["GT"];
 
-            if (locus.genotype_size() > 0) {
-                // We actually made a call. Emit the first genotype, which is the call.
+                    if (locus.genotype_size() > 0) {
+                        // We actually made a call. Emit the first genotype, which is the call.
                 
-                // We need to rewrite the allele numbers to alt numbers, since
-                // we aren't keeping all the alleles in the VCF, so we can't use
-                // the natural conversion of Genotype to VCF genotype string.
+                        // We need to rewrite the allele numbers to alt numbers, since
+                        // we aren't keeping all the alleles in the VCF, so we can't use
+                        // the natural conversion of Genotype to VCF genotype string.
                 
-                // Emit parts into this stream
-                stringstream stream;
-                for (size_t i = 0; i < genotype.allele_size(); i++) {
-                    // For each allele called as present in the genotype
+                        // Emit parts into this stream
+                        stringstream stream;
+                        for (size_t i = 0; i < genotype.allele_size(); i++) {
+                            // For each allele called as present in the genotype
                     
-                    // Convert from allele number to alt number
-                    if (genotype.allele(i) == best_allele) {
-                        stream << best_alt;
-                    } else if (genotype.allele(i) == second_best_allele) {
-                        stream << second_best_alt;
-                    } else {
-                        throw runtime_error("Allele " + to_string(genotype.allele(i)) +
-                            " is not best or second-best and has no alt");
-                    }
+                            // Convert from allele number to alt number
+                            if (genotype.allele(i) == best_allele) {
+                                stream << best_alt;
+                            } else if (genotype.allele(i) == second_best_allele) {
+                                stream << second_best_alt;
+                            } else {
+                                throw runtime_error("Allele " + to_string(genotype.allele(i)) +
+                                    " is not best or second-best and has no alt");
+                            }
                     
-                    if (i + 1 != genotype.allele_size()) {
-                        // Write a separator after all but the last one
-                        stream << (genotype.is_phased() ? '|' : '/');
+                            if (i + 1 != genotype.allele_size()) {
+                                // Write a separator after all but the last one
+                                stream << (genotype.is_phased() ? '|' : '/');
+                            }
+                        }
+                        // Save the finished genotype
+                        genotype_vector.push_back(stream.str());              
+                    } else {
+                        // Say there's no call here
+                        genotype_vector.push_back("./.");
                     }
-                }
-                // Save the finished genotype
-                genotype_vector.push_back(stream.str());              
-            } else {
-                // Say there's no call here
-                genotype_vector.push_back("./.");
-            }
             
-            // Now fill in all the other variant info/format stuff
+                    // Now fill in all the other variant info/format stuff
 
-            if((best_allele != 0 && is_ref.at(best_allele)) || 
-                (second_best_allele != 0 && second_best_allele != -1 && is_ref.at(second_best_allele))) {
-                // Flag the variant as reference if either of its two best alleles
-                // is known but not the primary path. Don't put in a false entry if
-                // it isn't known, because vcflib will spit out the flag anyway...
-                variant.infoFlags["XREF"] = true;
-            }
+                    if((best_allele != 0 && is_ref.at(best_allele)) || 
+                        (second_best_allele != 0 && second_best_allele != -1 && is_ref.at(second_best_allele))) {
+                        // Flag the variant as reference if either of its two best alleles
+                        // is known but not the primary path. Don't put in a false entry if
+                        // it isn't known, because vcflib will spit out the flag anyway...
+                        variant.infoFlags["XREF"] = true;
+                    }
             
-            for (auto id : original_nodes) {
-                // Add references to the relevant original nodes
-                variant.info["XSEE"].push_back(to_string(id));
-            }
+                    for (auto id : original_nodes) {
+                        // Add references to the relevant original nodes
+                        variant.info["XSEE"].push_back(to_string(id));
+                    }
             
-            for (size_t i = 1; i < variant.alleles.size(); i++) {
-                // Claculate the SVLEN for this non-reference allele
-                int64_t svlen = (int64_t) variant.alleles.at(i).size() - (int64_t) variant.alleles.at(0).size();
+                    for (size_t i = 1; i < variant.alleles.size(); i++) {
+                        // Claculate the SVLEN for this non-reference allele
+                        int64_t svlen = (int64_t) variant.alleles.at(i).size() - (int64_t) variant.alleles.at(0).size();
                 
-                // Add it in
-                variant.info["SVLEN"].push_back(to_string(svlen));
-            }
+                        // Add it in
+                        variant.info["SVLEN"].push_back(to_string(svlen));
+                    }
             
-            // Set up the depth format field
-            variant.format.push_back("DP");
-            // And expected depth
-            variant.format.push_back("XDP");
-            // And allelic depth
-            variant.format.push_back("AD");
-            // And the log likelihood from the assignment of reads among the
-            // present alleles
-            variant.format.push_back("XADL");
-            // And strand bias
-            variant.format.push_back("SB");
-            // Also the alt allele depth
-            variant.format.push_back("XAAD");
-            
-            // Compute the total support for all the alts that will be appearing
-            Support total_support;
-            // And total alt allele depth for the alt alleles
-            Support alt_support;
-
-            for (int allele : used_alleles) {
-                // For all the alleles we are using, look at the support.
-                auto& support = locus.support(allele);
+                    // Set up the depth format field
+                    variant.format.push_back("DP");
+                    // And expected depth
+                    variant.format.push_back("XDP");
+                    // And allelic depth
+                    variant.format.push_back("AD");
+                    // And the log likelihood from the assignment of reads among the
+                    // present alleles
+                    variant.format.push_back("XADL");
+                    // And strand bias
+                    variant.format.push_back("SB");
+                    // Also the alt allele depth
+                    variant.format.push_back("XAAD");
+            
+                    // Compute the total support for all the alts that will be appearing
+                    Support total_support;
+                    // And total alt allele depth for the alt alleles
+                    Support alt_support;
+
+                    for (int allele : used_alleles) {
+                        // For all the alleles we are using, look at the support.
+                        auto& support = locus.support(allele);
                 
-                // Set up allele-specific stats for the allele
-                variant.samples[sample_name]["AD"].push_back(to_string((int64_t)round(total(support))));
-                variant.samples[sample_name]["SB"].push_back(to_string((int64_t)round(support.forward())));
-                variant.samples[sample_name]["SB"].push_back(to_string((int64_t)round(support.reverse())));
+                        // Set up allele-specific stats for the allele
+                        variant.samples[sample_name]["AD"].push_back(to_string((int64_t)round(total(support))));
+                        variant.samples[sample_name]["SB"].push_back(to_string((int64_t)round(support.forward())));
+                        variant.samples[sample_name]["SB"].push_back(to_string((int64_t)round(support.reverse())));
                 
-                // Sum up into total depth
-                total_support += support;
+                        // Sum up into total depth
+                        total_support += support;
                 
-                if (allele != 0) {
-                    // It's not the primary reference allele
-                    alt_support += support;
-                }
-            }
+                        if (allele != 0) {
+                            // It's not the primary reference allele
+                            alt_support += support;
+                        }
+                    }
 
-            // Find the min total support of anything called
-            double min_site_support = INFINITY;
-            double min_site_quality = INFINITY;
+                    // Find the min total support of anything called
+                    double min_site_support = INFINITY;
+                    double min_site_quality = INFINITY;
             
-            for (size_t i = 0; i < genotype.allele_size(); i++) {
-                // Min all the total supports from the non-ref alleles called as present
-                min_site_support = min(min_site_support, total(locus.support(genotype.allele(i))));
-                min_site_quality = min(min_site_quality, locus.support(genotype.allele(i)).quality());
-            }
+                    for (size_t i = 0; i < genotype.allele_size(); i++) {
+                        // Min all the total supports from the non-ref alleles called as present
+                        min_site_support = min(min_site_support, total(locus.support(genotype.allele(i))));
+                        min_site_quality = min(min_site_quality, locus.support(genotype.allele(i)).quality());
+                    }
             
-            // Find the binomial bias between the called alleles, if multiple were called.
-            double ad_log_likelihood = INFINITY;
-            if (second_best_allele != -1) {
-                // How many of the less common one do we have?
-                size_t successes = round(total(locus.support(second_best_allele)));
-                // Out of how many chances
-                size_t trials = successes + (size_t) round(total(locus.support(best_allele)));
+                    // Find the binomial bias between the called alleles, if multiple were called.
+                    double ad_log_likelihood = INFINITY;
+                    if (second_best_allele != -1) {
+                        // How many of the less common one do we have?
+                        size_t successes = round(total(locus.support(second_best_allele)));
+                        // Out of how many chances
+                        size_t trials = successes + (size_t) round(total(locus.support(best_allele)));
                 
-                assert(trials >= successes);
+                        assert(trials >= successes);
                 
-                // How weird is that?                
-                ad_log_likelihood = binomial_cmf_ln(prob_to_logprob((real_t) 0.5), trials, successes);
+                        // How weird is that?                
+                        ad_log_likelihood = binomial_cmf_ln(prob_to_logprob((real_t) 0.5), trials, successes);
                 
-                assert(!std::isnan(ad_log_likelihood));
+                        assert(!std::isnan(ad_log_likelihood));
                 
-                variant.samples[sample_name]["XADL"].push_back(to_string(ad_log_likelihood));
-            } else {
-                // No need to assign reads between two alleles
-                variant.samples[sample_name]["XADL"].push_back(".");
-            }
+                        variant.samples[sample_name]["XADL"].push_back(to_string(ad_log_likelihood));
+                    } else {
+                        // No need to assign reads between two alleles
+                        variant.samples[sample_name]["XADL"].push_back(".");
+                    }
 
-            // Set the variant's total depth            
-            string depth_string = to_string((int64_t)round(total(total_support)));
-            variant.info["DP"].push_back(depth_string); // We only have one sample, so variant depth = sample depth
-            
-            // And for the sample
-            variant.samples[sample_name]["DP"].push_back(depth_string);
-            
-            // Set the sample's local and global expected depth            
-            variant.samples[sample_name]["XDP"].push_back(to_string((int64_t)round(total(baseline_support))));
-            variant.samples[sample_name]["XDP"].push_back(to_string((int64_t)round(total(global_baseline_support))));
-            
-            // And its depth of non-0 alleles
-            variant.samples[sample_name]["XAAD"].push_back(to_string((int64_t)round(total(alt_support))));
-
-            // Set the total support quality of the min allele as the variant quality
-            variant.quality = min_site_quality;
-
-            // Now do the filters
-            variant.filter = "PASS";            
-            if (min_site_support < min_mad_for_filter) {
-                // Apply Min Allele Depth cutoff across all alleles (even ref)
-                variant.filter = "lowad";
-            } else if (max_dp_for_filter != 0 && total(total_support) > max_dp_for_filter) {
-                // Apply the max depth cutoff
-                variant.filter = "highabsdp";
-            } else if (max_dp_multiple_for_filter != 0 &&
-                total(total_support) > max_dp_multiple_for_filter * total(global_baseline_support)) {
-                // Apply the max depth multiple cutoff
-                // TODO: Different standard for sites called as haploid
-                variant.filter = "highreldp";
-            } else if (max_local_dp_multiple_for_filter != 0 &&
-                total(total_support) > max_local_dp_multiple_for_filter * total(baseline_support)) {
-                // Apply the max local depth multiple cutoff
-                // TODO: Different standard for sites called as haoploid
-                variant.filter = "highlocaldp";
-            } else if (min_ad_log_likelihood_for_filter != 0 &&
-                ad_log_likelihood < min_ad_log_likelihood_for_filter) {
-                // We have a het, but the assignment of reads between the two branches is just too weird
-                variant.filter = "lowxadl";
-            }
-            
-            // Don't bother with trivial calls
-            if (write_trivial_calls ||
-                (genotype_vector.back() != "./." && genotype_vector.back() != ".|." &&
-                 genotype_vector.back() != "0/0" && genotype_vector.back() != "0|0")) {
-            
-                if(can_write_alleles(variant)) {
-                    // No need to check for collisions because we assume sites are correctly found.
-                    // Output the created VCF variant.
-                    cout << variant << endl;
+                    // Set the variant's total depth            
+                    string depth_string = to_string((int64_t)round(total(total_support)));
+                    variant.info["DP"].push_back(depth_string); // We only have one sample, so variant depth = sample depth
+            
+                    // And for the sample
+                    variant.samples[sample_name]["DP"].push_back(depth_string);
+            
+                    // Set the sample's local and global expected depth            
+                    variant.samples[sample_name]["XDP"].push_back(to_string((int64_t)round(total(baseline_support))));
+                    variant.samples[sample_name]["XDP"].push_back(to_string((int64_t)round(total(global_baseline_support))));
+            
+                    // And its depth of non-0 alleles
+                    variant.samples[sample_name]["XAAD"].push_back(to_string((int64_t)round(total(alt_support))));
+
+                    // Set the total support quality of the min allele as the variant quality
+                    variant.quality = min_site_quality;
+
+                    // Now do the filters
+                    variant.filter = "PASS";            
+                    if (min_site_support < min_mad_for_filter) {
+                        // Apply Min Allele Depth cutoff across all alleles (even ref)
+                        variant.filter = "lowad";
+                    } else if (max_dp_for_filter != 0 && total(total_support) > max_dp_for_filter) {
+                        // Apply the max depth cutoff
+                        variant.filter = "highabsdp";
+                    } else if (max_dp_multiple_for_filter != 0 &&
+                        total(total_support) > max_dp_multiple_for_filter * total(global_baseline_support)) {
+                        // Apply the max depth multiple cutoff
+                        // TODO: Different standard for sites called as haploid
+                        variant.filter = "highreldp";
+                    } else if (max_local_dp_multiple_for_filter != 0 &&
+                        total(total_support) > max_local_dp_multiple_for_filter * total(baseline_support)) {
+                        // Apply the max local depth multiple cutoff
+                        // TODO: Different standard for sites called as haoploid
+                        variant.filter = "highlocaldp";
+                    } else if (min_ad_log_likelihood_for_filter != 0 &&
+                        ad_log_likelihood < min_ad_log_likelihood_for_filter) {
+                        // We have a het, but the assignment of reads between the two branches is just too weird
+                        variant.filter = "lowxadl";
+                    }
             
-                } else {
-                    if (verbose) {
-                        cerr << "Variant is too large" << endl;
+                    // Don't bother with trivial calls
+                    if (write_trivial_calls ||
+                        (genotype_vector.back() != "./." && genotype_vector.back() != ".|." &&
+                         genotype_vector.back() != "0/0" && genotype_vector.back() != "0|0")) {
+            
+                        if(can_write_alleles(variant)) {
+                            // No need to check for collisions because we assume sites are correctly found.
+                            // Output the created VCF variant.
+                            vcf_stream << variant << endl;
+            
+                        } else {
+                            if (verbose) {
+                                cerr << "Variant is too large" << endl;
+                            }
+                            // TODO: track bases lost again
+                        }
                     }
-                    // TODO: track bases lost again
-                }
-            }
-        };
+                };
         
-        // Recursively type the site, using that support and an assumption of a diploid sample.
-        find_best_traversals(augmented, site_manager, &traversal_finder, *site, baseline_support, 2,
-            [&locus_buffer, &emit_variant, &site_manager, &called_loci, &primary_paths, &augmented,
-            &covered_nodes, &covered_edges, this](const Locus& locus, const Snarl* site) {
+                // Recursively type the site, using that support and an assumption of a diploid sample.
+                find_best_traversals(augmented, site_manager, &traversal_finder, *site, baseline_support, 2,
+                    [&output, &emit_variant, &site_manager, &primary_paths, &augmented,
+                    this](const Locus& locus, const Snarl* site) {
             
-            // Now we have the Locus with call information, and the site (either
-            // the root snarl we passed in or a child snarl) that the call is
-            // for. We need to output the call.
+                    // Now we have the Locus with call information, and the site (either
+                    // the root snarl we passed in or a child snarl) that the call is
+                    // for. We need to output the call.
         
-            if (convert_to_vcf) {
-                // We want to emit VCF
+                    if (convert_to_vcf) {
+                        // We want to emit VCF
                 
-                // Look up the path this child site lives on. (TODO: just capture and use the path the parent lives on?)
-                auto found_path = find_path(*site, primary_paths);
-                if(found_path != primary_paths.end()) {
-                    // And this site is on a primary path
+                        // Look up the path this child site lives on. (TODO: just capture and use the path the parent lives on?)
+                        auto found_path = find_path(*site, primary_paths);
+                        if(found_path != primary_paths.end()) {
+                            // And this site is on a primary path
                     
-                    // Emit the variant for this Locus
-                    emit_variant(locus, found_path->second, site);
-                }
-                // Otherwise discard it as off-path
-                // TODO: update bases lost
-            } else {
-                // Emit the locus itself
-                locus_buffer.push_back(locus);
-                stream::write_buffered(cout, locus_buffer, locus_buffer_size);
-            }
+                            // Emit the variant for this Locus
+                            emit_variant(locus, found_path->second, site);
+                        }
+                        // Otherwise discard it as off-path
+                        // TODO: update bases lost
+                    } else {
+                        // Emit the locus itself, once the chunks before us are out
+                        output.loci.push_back(locus);
+                    }
             
-            // We called a site
-            called_loci++;
+                    // We called a site
+                    output.called_loci++;
             
-            // Mark all the nodes and edges in the site as covered
-            auto contents = site_manager.deep_contents(site, augmented.graph, true);
-            for (auto* node : contents.first) {
-                covered_nodes.insert(node);
-            }
-            for (auto* edge : contents.second) {
-                covered_edges.insert(edge);
+                    // Mark all the nodes and edges in the site as covered
+                    auto contents = site_manager.deep_contents(site, augmented.graph, true);
+                    for (auto* node : contents.first) {
+                        output.covered_nodes.insert(node);
+                    }
+                    for (auto* edge : contents.second) {
+                        output.covered_edges.insert(edge);
+                    }
+                });
+        }
+    
+        output.vcf_text = vcf_stream.str();
+    
+        #pragma omp critical (support_caller_output)
+        {
+            // Write out every chunk that is now next in line
+            finished_chunks[chunk_number] = std::move(output);
+            while (!finished_chunks.empty() && finished_chunks.begin()->first == next_chunk) {
+                ChunkOutput& ready = finished_chunks.begin()->second;
+                cout << ready.vcf_text;
+                for (auto& locus : ready.loci) {
+                    locus_buffer.push_back(locus);
+                    stream::write_buffered(cout, locus_buffer, locus_buffer_size);
+                }
+                covered_nodes.insert(ready.covered_nodes.begin(), ready.covered_nodes.end());
+                covered_edges.insert(ready.covered_edges.begin(), ready.covered_edges.end());
+                called_loci += ready.called_loci;
+                finished_chunks.erase(finished_chunks.begin());
+                next_chunk++;
             }
-        });
+        }
     }
     
     if (verbose) {
@@ -1809,8 +1888,8 @@ void SupportCaller::call(
                 *path->add_mapping() = to_mapping(to_visit, augmented.graph);
                 
                 // Set the support
-                *locus.add_support() = augmented.edge_supports[e];
-                *locus.mutable_overall_support() = augmented.edge_supports[e];
+                *locus.add_support() = augmented.get_support(e);
+                *locus.mutable_overall_support() = augmented.get_support(e);
                 
                 // Decide on the genotype
                 Genotype gt;
@@ -417,16 +417,61 @@ using namespace std;
         cerr << endl;
 #endif
         
-        // translate the path names into ranks for the XG
+        return path_anchored_surject(source, path_ranks_of(path_names), path_name_out, path_pos_out, path_rev_out);
+    }
+    
+    vector<Alignment> Surjector::path_anchored_surject(const vector<Alignment>& sources, const set<string>& path_names,
+                                                       vector<string>& path_names_out, vector<int64_t>& path_positions_out,
+                                                       vector<bool>& path_reverses_out) {
+        
+        unordered_map<size_t, string> path_rank_to_name = path_ranks_of(path_names);
+        
+        // visit the alignments in order of where they start in the graph, and unmapped ones at the end
+        vector<size_t> order(sources.size());
+        for (size_t i = 0; i < order.size(); i++) {
+            order[i] = i;
+        }
+        auto start_node = [&](size_t i) {
+            const Path& path = sources[i].path();
+            return path.mapping_size() > 0 ? path.mapping(0).position().node_id() : numeric_limits<id_t>::max();
+        };
+        stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+            return start_node(a) < start_node(b);
+        });
+        
+        vector<Alignment> surjected(sources.size());
+        path_names_out.assign(sources.size(), "");
+        path_positions_out.assign(sources.size(), -1);
+        path_reverses_out.assign(sources.size(), false);
+        for (size_t i : order) {
+            int64_t path_pos = -1;
+            bool path_rev = false;
+            surjected[i] = path_anchored_surject(sources[i], path_rank_to_name, path_names_out[i], path_pos, path_rev);
+            path_positions_out[i] = path_pos;
+            path_reverses_out[i] = path_rev;
+        }
+        
+        return surjected;
+    }
+    
+    unordered_map<size_t, string> Surjector::path_ranks_of(const set<string>& path_names) const {
         unordered_map<size_t, string> path_rank_to_name;
         for (const string& path_name : path_names) {
             path_rank_to_name[xindex->path_rank(path_name)] = path_name;
         }
+        return path_rank_to_name;
+    }
+    
+    Alignment Surjector::path_anchored_surject(const Alignment& source, const unordered_map<size_t, string>& path_rank_to_name,
+                                               string& path_name_out, int64_t& path_pos_out, bool& path_rev_out) {
         
-        
-        // memos for expensive succinct operations that may be repeated
-        unordered_map<int64_t, vector<size_t>> paths_of_node_memo;
-        unordered_map<pair<int64_t, size_t>, vector<pair<size_t, bool>>> oriented_occurrences_memo;
+        // the memos are shared with earlier alignments, but don't let them grow without bound
+        if (paths_of_node_memo.size() > max_memo_size) {
+            paths_of_node_memo.clear();
+        }
+        if (oriented_occurrences_memo.size() > max_memo_size) {
+            oriented_occurrences_memo.clear();
+        }
         
         // get the chunks of the aligned path that overlap the ref path
         auto path_overlapping_anchors = extract_overlapping_paths(source, path_rank_to_name, &paths_of_node_memo, &oriented_occurrences_memo);
@@ -453,7 +498,7 @@ using namespace std;
             cerr << "found overlaps on path " << path_record.first << ", performing surjection" << endl;
 #endif
             
-            const xg::XGPath& xpath = xindex->get_path(path_rank_to_name[path_record.first]);
+            const xg::XGPath& xpath = xindex->get_path(path_rank_to_name.at(path_record.first));
             
             // find the interval of the ref path we need to consider
             pair<size_t, size_t> ref_path_interval = compute_path_interval(source, path_record.first, xpath, path_record.second,
@@ -547,8 +592,9 @@ using namespace std;
             }
         }
         
-        // which path was it?
-        path_name_out = path_rank_to_name[best_path_rank];
+        // which path was it? (the sentinel for overlapping no paths has no name)
+        auto best_name = path_rank_to_name.find(best_path_rank);
+        path_name_out = best_name != path_rank_to_name.end() ? best_name->second : "";
         
         Alignment& best_surjection = path_surjections[best_path_rank];
         
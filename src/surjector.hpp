@@ -46,12 +46,34 @@ using namespace std;
                                         int64_t& path_pos_out,
                                         bool& path_rev_out);
         
+        /// surject a batch of alignments with path_anchored_surject, working out the paths once for the
+        /// whole batch; the alignments are visited in order of the node they start on, so that reads near
+        /// each other (as in a sorted GAM) share succinct path lookups, but the results and their path
+        /// names, positions, and strands are returned in the order of the sources
+        vector<Alignment> path_anchored_surject(const vector<Alignment>& sources,
+                                                const set<string>& path_names,
+                                                vector<string>& path_names_out,
+                                                vector<int64_t>& path_positions_out,
+                                                vector<bool>& path_reverses_out);
+        
+        /// the most node lookups to remember between alignments before starting over
+        size_t max_memo_size = 1 << 16;
         
         /// a local type that represents a read interval matched to a portion of the alignment path
         using path_chunk_t = pair<pair<string::const_iterator, string::const_iterator>, Path>;
         
     private:
         
+        /// surject an alignment onto the paths with the given ranks and names
+        Alignment path_anchored_surject(const Alignment& source,
+                                        const unordered_map<size_t, string>& path_rank_to_name,
+                                        string& path_name_out,
+                                        int64_t& path_pos_out,
+                                        bool& path_rev_out);
+        
+        /// translate the path names into ranks for the XG
+        unordered_map<size_t, string> path_ranks_of(const set<string>& path_names) const;
+        
         /// get the chunks of the alignment path that follow the given reference paths
         unordered_map<size_t, vector<path_chunk_t>>
         extract_overlapping_paths(const Alignment& source, const unordered_map<size_t, string>& path_rank_to_name,
@@ -75,6 +97,11 @@ using namespace std;
         
         // make a sentinel meant to indicate an unmapped read
         Alignment make_null_alignment(const Alignment& source);
+        
+        /// memos for expensive succinct operations, which are kept between alignments because nearby
+        /// alignments tend to repeat them
+        unordered_map<int64_t, vector<size_t>> paths_of_node_memo;
+        unordered_map<pair<int64_t, size_t>, vector<pair<size_t, bool>>> oriented_occurrences_memo;
     };
 }
 
@@ -0,0 +1,126 @@
+#include "timeline.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/**
+ * \file timeline.cpp: implementation of the thread activity timeline
+ */
+
+namespace vg {
+
+namespace timeline {
+
+using namespace std;
+
+bool is_enabled = false;
+
+/// One span of work by one thread.
+struct Event {
+    const char* name;
+    uint64_t start;
+    uint64_t duration;
+};
+
+/// The most recent spans of one thread, as a ring buffer.
+struct ThreadEvents {
+    ThreadEvents(size_t capacity) : events(capacity) {}
+    vector<Event> events;
+    /// The number of spans ever recorded, so the next one goes at
+    /// recorded % capacity. Atomic so the writer can tell how many are done.
+    atomic<uint64_t> recorded{0};
+};
+
+static chrono::steady_clock::time_point epoch;
+static size_t thread_capacity = DEFAULT_SPANS_PER_THREAD;
+static string output_name;
+
+/// Guards the list of per-thread spans.
+static mutex registry_lock;
+
+/// Get the spans of every thread that has recorded any. We never free them,
+/// so threads that finish before the output still show up.
+static vector<unique_ptr<ThreadEvents>>& registry() {
+    static vector<unique_ptr<ThreadEvents>>* all_events = new vector<unique_ptr<ThreadEvents>>();
+    return *all_events;
+}
+
+/// Get this thread's spans, making them on first use.
+static ThreadEvents& local_events() {
+    thread_local ThreadEvents* mine = nullptr;
+    if (mine == nullptr) {
+        lock_guard<mutex> guard(registry_lock);
+        registry().emplace_back(new ThreadEvents(thread_capacity));
+        mine = registry().back().get();
+    }
+    return *mine;
+}
+
+/// Write the timeline to the file we were started with.
+static void write_at_exit() {
+    ofstream out(output_name);
+    if (!out) {
+        cerr << "warning:[vg] cannot write timeline to " << output_name << endl;
+        return;
+    }
+    write_json(out);
+}
+
+void start(const string& file_name, size_t spans_per_thread) {
+    epoch = chrono::steady_clock::now();
+    thread_capacity = max(spans_per_thread, (size_t) 1);
+    output_name = file_name;
+    is_enabled = true;
+    atexit(write_at_exit);
+}
+
+uint64_t now() {
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - epoch).count();
+}
+
+void record(const char* name, uint64_t start) {
+    ThreadEvents& mine = local_events();
+    uint64_t index = mine.recorded.load(memory_order_relaxed);
+    mine.events[index % mine.events.size()] = Event{name, start, now() - start};
+    mine.recorded.store(index + 1, memory_order_release);
+}
+
+void write_json(ostream& out) {
+    lock_guard<mutex> guard(registry_lock);
+    
+    // Times are in microseconds, written out in full, since runs can be long
+    // enough that floating point output would round them off
+    auto microseconds = [](uint64_t nanoseconds) {
+        string fraction = to_string(nanoseconds % 1000);
+        return to_string(nanoseconds / 1000) + "." + string(3 - fraction.size(), '0') + fraction;
+    };
+    
+    // Each thread gets its own row
+    out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+    bool first = true;
+    for (size_t tid = 0; tid < registry().size(); tid++) {
+        ThreadEvents& thread_events = *registry()[tid];
+        out << (first ? "" : ",") << endl;
+        first = false;
+        out << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << tid
+            << ", \"args\": {\"name\": \"thread " << tid << "\"}}";
+        
+        uint64_t recorded = thread_events.recorded.load(memory_order_acquire);
+        size_t capacity = thread_events.events.size();
+        uint64_t oldest = recorded > capacity ? recorded - capacity : 0;
+        for (uint64_t i = oldest; i < recorded; i++) {
+            const Event& event = thread_events.events[i % capacity];
+            out << "," << endl << "{\"name\": \"" << event.name << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << tid
+                << ", \"ts\": " << microseconds(event.start) << ", \"dur\": " << microseconds(event.duration) << "}";
+        }
+    }
+    out << endl << "]}" << endl;
+}
+
+}
+
+}
@@ -0,0 +1,91 @@
+#ifndef VG_TIMELINE_HPP_INCLUDED
+#define VG_TIMELINE_HPP_INCLUDED
+
+/** \file
+ * A lightweight recorder of what each thread was doing when, over a whole
+ * run, for finding idle threads and lock contention. Spans of work are kept
+ * in a fixed-size ring buffer per thread, so long runs keep their most recent
+ * activity in bounded memory, and are written out in the Chrome trace event
+ * format, which chrome://tracing and Perfetto display as a timeline.
+ *
+ * Recording is off until start() is called, and costs one branch per span
+ * when off. vg turns it on when the VG_TIMELINE environment variable names a
+ * file to write the timeline to.
+ */
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+namespace vg {
+
+namespace timeline {
+
+using namespace std;
+
+/// The default number of spans kept for each thread.
+const size_t DEFAULT_SPANS_PER_THREAD = 1 << 16;
+
+/// Set if recording is on. Read it through enabled().
+extern bool is_enabled;
+
+/// Start recording, keeping the most recent spans_per_thread spans of each
+/// thread, and write the timeline to the given file when the program exits.
+/// Should be called before any other threads start.
+void start(const string& file_name, size_t spans_per_thread = DEFAULT_SPANS_PER_THREAD);
+
+/// Return true if we are recording.
+inline bool enabled() {
+    return is_enabled;
+}
+
+/// Get the time since recording started, in nanoseconds.
+uint64_t now();
+
+/// Record that this thread spent the time from start, as given by now(),
+/// until now on the named work. The name must be a string literal, or
+/// otherwise live as long as the program.
+void record(const char* name, uint64_t start);
+
+/// Write the spans recorded so far as a Chrome trace JSON object. Spans still
+/// being recorded by other threads are skipped or may be torn, so this should
+/// be called when the other threads are done or idle.
+void write_json(ostream& out);
+
+/**
+ * Records the time from construction to destruction as a span, if recording
+ * is on.
+ */
+class Span {
+public:
+    inline Span(const char* name) : name(name), running(enabled()) {
+        if (running) {
+            start = now();
+        }
+    }
+    
+    inline ~Span() {
+        if (running) {
+            record(name, start);
+        }
+    }
+    
+private:
+    const char* name;
+    bool running;
+    uint64_t start = 0;
+};
+
+}
+
+}
+
+#define VG_TIMELINE_CONCAT_INNER(a, b) a##b
+#define VG_TIMELINE_CONCAT(a, b) VG_TIMELINE_CONCAT_INNER(a, b)
+
+/// Record the current scope as a span of the named work on the timeline.
+#define VG_TIMELINE_SPAN(name) \
+    ::vg::timeline::Span VG_TIMELINE_CONCAT(timeline_span_, __LINE__)(name)
+
+#endif
@@ -25,45 +25,94 @@ void Translator::load(const vector<Translation>& trans) {
 }
 
 void Translator::build_position_table(void) {
-    //map<pos_t, Translation*> pos_to_trans;
-    for (auto& t : translations) {
-        // map from the new positions to the corresponding translations
-        pos_to_trans[make_pos_t(t.to().mapping(0).position())] = &t;
+    // Find where each translation starts in the to graph
+    vector<pair<id_t, TranslationStart>> found;
+    found.reserve(translations.size());
+    for (size_t i = 0; i < translations.size(); ++i) {
+        auto& pos = translations[i].to().mapping(0).position();
+        found.emplace_back(pos.node_id(), TranslationStart{pos.is_reverse(), pos.offset(), i});
+    }
+    auto position_less = [](const pair<id_t, TranslationStart>& a, const pair<id_t, TranslationStart>& b) {
+        return make_tuple(a.first, a.second.is_reverse, a.second.offset)
+            < make_tuple(b.first, b.second.is_reverse, b.second.offset);
+    };
+    // keep the given order among translations that start in the same place,
+    // so we can keep only the last of them
+    stable_sort(found.begin(), found.end(), position_less);
+
+    starts.clear();
+    starts.reserve(found.size());
+    min_id = found.empty() ? 0 : found.front().first;
+    id_t max_id = found.empty() ? min_id - 1 : found.back().first;
+    node_start.assign(max_id - min_id + 2, 0);
+    for (size_t i = 0; i < found.size(); ++i) {
+        if (i + 1 < found.size() && !position_less(found[i], found[i + 1])) {
+            // a later translation replaces this one
+            continue;
+        }
+        starts.push_back(found[i].second);
+        // count the starts on each node, to turn into offsets below
+        node_start[found[i].first - min_id + 1]++;
+    }
+    for (size_t i = 1; i < node_start.size(); ++i) {
+        node_start[i] += node_start[i - 1];
     }
 }
 
-bool Translator::has_translation(const Position& position, bool ignore_strand) {
-    auto pos = make_pos_t(position);
-    pos_t node_only = pos;
-    get_offset(node_only) = 0;
-    get_is_rev(node_only) = ignore_strand ? false : position.is_reverse();
-    return pos_to_trans.find(node_only) != pos_to_trans.end();
+const Translation* Translator::find_translation(const Position& position) const {
+    if (position.node_id() < min_id || position.node_id() - min_id + 1 >= node_start.size()) {
+        return nullptr;
+    }
+    auto node_begin = starts.begin() + node_start[position.node_id() - min_id];
+    auto node_end = starts.begin() + node_start[position.node_id() - min_id + 1];
+    // find our strand
+    auto strand = equal_range(node_begin, node_end, TranslationStart{position.is_reverse(), 0, 0},
+                              [](const TranslationStart& a, const TranslationStart& b) {
+        return a.is_reverse < b.is_reverse;
+    });
+    if (strand.first == strand.second || strand.first->offset != 0) {
+        // the node isn't in the translation on this strand
+        return nullptr;
+    }
+    // take the last translation starting at or before our offset
+    auto after = upper_bound(strand.first, strand.second, position.offset(),
+                             [](int64_t offset, const TranslationStart& start) {
+        return offset < start.offset;
+    });
+    return &translations[(after - 1)->translation];
 }
 
-Translation Translator::get_translation(const Position& position) {
-    auto pos = make_pos_t(position);
-    // check that the node is in the translation
-    pos_t node_only = pos;
-    get_offset(node_only) = 0;
-    get_is_rev(node_only) = position.is_reverse();
-    Translation translation;
-    if (pos_to_trans.find(node_only) == pos_to_trans.end()) {
-        cerr << "WARNING: node " << id(pos) << " is not in the translation table" << endl;
-    } else {
-        auto t = pos_to_trans.upper_bound(pos); --t;
-        translation = *t->second;
+bool Translator::has_translation(const Position& position, bool ignore_strand) const {
+    Position node_only;
+    node_only.set_node_id(position.node_id());
+    node_only.set_is_reverse(ignore_strand ? false : position.is_reverse());
+    return find_translation(node_only) != nullptr;
+}
+
+const Translation& Translator::lookup(const Position& position) const {
+    static const Translation empty;
+    const Translation* found = find_translation(position);
+    if (found == nullptr) {
+        cerr << "WARNING: node " << position.node_id() << " is not in the translation table" << endl;
+        return empty;
     }
-    return translation;
+    return *found;
+}
+
+Translation Translator::get_translation(const Position& position) const {
+    return lookup(position);
 }
 
-Position Translator::translate(const Position& position) {
-    return translate(position, get_translation(position));
+Position Translator::translate(const Position& position) const {
+    return translate(position, lookup(position));
 }
 
-Position Translator::translate(const Position& position, const Translation& translation) {
+Position Translator::translate(const Position& position, const Translation& translation) const {
     // what kind of translation is it?
     if (is_match(translation)) {
-        if (position.offset() >= mapping_from_length(translation.to().mapping(0))) {
+        // the translation may start partway along the to node
+        int64_t offset = position.offset() - translation.to().mapping(0).position().offset();
+        if (offset >= mapping_from_length(translation.to().mapping(0))) {
             stringstream s;
             s << "to-position offset is greater than translation length "
               << mapping_from_length(translation.to().mapping(0));
@@ -71,7 +120,7 @@ Position Translator::translate(const Position& position, const Translation& tran
         }
         // exact match; local coordinate space is identical
         Position from_pos = translation.from().mapping(0).position();
-        from_pos.set_offset(from_pos.offset()+position.offset());
+        from_pos.set_offset(from_pos.offset()+offset);
         return from_pos;
     } else {
         // novel sequence
@@ -79,15 +128,15 @@ Position Translator::translate(const Position& position, const Translation& tran
     }
 }
 
-Mapping Translator::translate(const Mapping& mapping) {
-    Mapping translated = mapping;
+Mapping Translator::translate(const Mapping& mapping) const {
     if (!mapping.has_position()) return mapping;
-    Translation translation = get_translation(mapping.position());
+    Mapping translated = mapping;
+    const Translation& translation = lookup(mapping.position());
     *translated.mutable_position() = translate(mapping.position(), translation);
     if (is_match(translation)) {
         return translated;
     } else {
-        auto seq = translation.from().mapping(0).edit(0).sequence();
+        string seq = translation.from().mapping(0).edit(0).sequence();
         if (translation.from().mapping(0).position().is_reverse()) {
             seq = reverse_complement(seq);
         }
@@ -122,21 +171,27 @@ Mapping Translator::translate(const Mapping& mapping) {
     return translated;
 }
 
-Path Translator::translate(const Path& path) {
+Path Translator::translate(const Path& path) const {
     Path result;
+    result.mutable_mapping()->Reserve(path.mapping_size());
     for (int i = 0; i < path.mapping_size(); ++i) {
         *result.add_mapping() = translate(path.mapping(i));
     }
     return simplify(result, false);
 }
 
-Alignment Translator::translate(const Alignment& aln) {
+Alignment Translator::translate(const Alignment& aln) const {
     Alignment result = aln;
-    *result.mutable_path() = translate(aln.path());
+    translate_in_place(result);
     return result;
 }
 
-Locus Translator::translate(const Locus& locus) {
+void Translator::translate_in_place(Alignment& aln) const {
+    Path translated = translate(aln.path());
+    aln.mutable_path()->Swap(&translated);
+}
+
+Locus Translator::translate(const Locus& locus) const {
     Locus result = locus;
     for (int i = 0; i < locus.allele_size(); ++i) {
         *result.mutable_allele(i) = translate(locus.allele(i));
@@ -153,7 +208,7 @@ bool is_match(const Translation& translation) {
         && path_to_length(translation.from()) == path_to_length(translation.to());
 }
 
-Translation Translator::overlay(const Translation& trans) {
+Translation Translator::overlay(const Translation& trans) const {
     Translation result;
     *result.mutable_to() = trans.to();
     *result.mutable_from() = translate(trans.from());
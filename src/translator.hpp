@@ -24,27 +24,59 @@ using namespace std;
 
 /**
  * Class to map paths into a base graph found via a set of Translations
+ *
+ * The translations are found by the start of their to paths, in a flat table
+ * indexed by node ID, so lookups don't walk a tree and can be done from many
+ * threads at once.
  */
 class Translator {
 public:
 
     vector<Translation> translations;
-    map<pos_t, Translation*> pos_to_trans;
     Translator(void);
     Translator(istream& in);
     Translator(const vector<Translation>& trans);
     void load(const vector<Translation>& trans);
+    /// Index the translations by the start of their to paths. Must be called
+    /// again after translations is changed. If several translations start at
+    /// the same place, the last one wins.
     void build_position_table(void);
-    Translation get_translation(const Position& position);
-    bool has_translation(const Position& position, bool ignore_strand = true);
-    Position translate(const Position& position);
-    Position translate(const Position& position, const Translation& translation);
+    Translation get_translation(const Position& position) const;
+    /// Get the translation that covers the given position, or nullptr if the
+    /// position's node and strand aren't in the table.
+    const Translation* find_translation(const Position& position) const;
+    bool has_translation(const Position& position, bool ignore_strand = true) const;
+    Position translate(const Position& position) const;
+    Position translate(const Position& position, const Translation& translation) const;
     Edge translate(const Edge& edge);
-    Mapping translate(const Mapping& mapping);
-    Path translate(const Path& path);
-    Alignment translate(const Alignment& aln);
-    Locus translate(const Locus& locus);
-    Translation overlay(const Translation& trans);
+    Mapping translate(const Mapping& mapping) const;
+    Path translate(const Path& path) const;
+    Alignment translate(const Alignment& aln) const;
+    /// Translate an alignment's path without copying the rest of it.
+    void translate_in_place(Alignment& aln) const;
+    Locus translate(const Locus& locus) const;
+    Translation overlay(const Translation& trans) const;
+
+private:
+
+    /// Where a translation's to path starts on its node
+    struct TranslationStart {
+        bool is_reverse;
+        int64_t offset;
+        size_t translation;
+    };
+
+    /// Get the translation for a position, warning and returning an empty
+    /// translation if there is none.
+    const Translation& lookup(const Position& position) const;
+
+    /// The ID of the node that node_start begins at
+    id_t min_id = 0;
+    /// Where the starts for each node ID from min_id begin in starts, with
+    /// the end of the last node's starts at the end.
+    vector<size_t> node_start = {0};
+    /// The translation starts, sorted by node, strand, and offset.
+    vector<TranslationStart> starts;
 };
 
 bool is_match(const Translation& translation);
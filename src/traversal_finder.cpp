@@ -3,6 +3,7 @@
 #include "algorithms/topological_sort.hpp"
 #include "algorithms/is_acyclic.hpp"
 #include "cactus.hpp"
+#include <omp.h>
 
 //#define debug
 
@@ -10,6 +11,59 @@ namespace vg {
 
 using namespace std;
 
+bool TraversalFinder::for_each_traversal(const Snarl& site, const function<bool(const SnarlTraversal&)>& iteratee) {
+    for (const SnarlTraversal& traversal : find_traversals(site)) {
+        if (!iteratee(traversal)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+vector<vector<SnarlTraversal>> TraversalFinder::find_traversals_parallel(const vector<const Snarl*>& sites,
+    const function<unique_ptr<TraversalFinder>()>& make_finder) {
+    
+    // Finders may keep state between searches, so each thread gets its own
+    vector<unique_ptr<TraversalFinder>> finders(get_thread_count());
+    
+    vector<vector<SnarlTraversal>> traversals(sites.size());
+#pragma omp parallel for schedule(dynamic, 1)
+    for (size_t i = 0; i < sites.size(); i++) {
+        unique_ptr<TraversalFinder>& finder = finders[omp_get_thread_num()];
+        if (!finder) {
+            finder = make_finder();
+        }
+        traversals[i] = finder->find_traversals(*sites[i]);
+    }
+    return traversals;
+}
+
+TraversalSearchBudget::TraversalSearchBudget(size_t max_traversals, double max_seconds) :
+    remaining(max_traversals), timed(max_seconds < numeric_limits<double>::infinity()) {
+    if (timed) {
+        deadline = chrono::steady_clock::now() + chrono::duration_cast<chrono::steady_clock::duration>(
+            chrono::duration<double>(max_seconds));
+    }
+}
+
+bool TraversalSearchBudget::found_traversal() {
+    if (remaining > 0) {
+        remaining--;
+    }
+    return remaining > 0;
+}
+
+bool TraversalSearchBudget::step() {
+    // Only look at the clock every so often, since it isn't free
+    steps++;
+    if (timed && steps % 1024 == 0 && chrono::steady_clock::now() >= deadline) {
+        // Stay out of time
+        timed = false;
+        remaining = 0;
+    }
+    return remaining > 0;
+}
+
 PathBasedTraversalFinder::PathBasedTraversalFinder(vg::VG& g, SnarlManager& sm) : graph(g), snarlmanager(sm){
 }
 
@@ -169,13 +223,28 @@ void ExhaustiveTraversalFinder::stack_up_valid_walks(NodeTraversal walk_head, ve
     }
 }
 
-void ExhaustiveTraversalFinder::add_traversals(vector<SnarlTraversal>& traversals,
+bool ExhaustiveTraversalFinder::add_traversals(const function<bool(const SnarlTraversal&)>& iteratee,
                                                NodeTraversal traversal_start,
                                                set<NodeTraversal>& stop_at,
-                                               set<NodeTraversal>& yield_at) {
-    // keeps track of the walk of the DFS traversal
+                                               set<NodeTraversal>& yield_at,
+                                               TraversalSearchBudget& budget) {
+    // keeps track of the walk of the DFS traversal, which is the prefix shared
+    // by every traversal still on the stack
     list<Visit> path;
     
+    // for each node visit on the path, where it is and how many traversals
+    // had been found when we got there, so we can tell if we got anywhere
+    // from it (snarl visits get a null entry)
+    vector<pair<NodeTraversal, size_t>> path_entries;
+    size_t yielded = 0;
+    
+    // the site is acyclic, so a node traversal we have searched from without
+    // finding a way out will never lead anywhere, however we got to it
+    set<NodeTraversal> dead_ends;
+    
+    // the traversal we hand out, reused between yields
+    SnarlTraversal traversal;
+    
     // these mark the start of the edges out of the node that is on the head of the path
     // they can be used to see how many nodes we need to peel off the path when we're
     // backtracking
@@ -186,12 +255,22 @@ void ExhaustiveTraversalFinder::add_traversals(vector<SnarlTraversal>& traversal
     
     while (stack.size()) {
         
+        if (!budget.step()) {
+            // out of time
+            return false;
+        }
+        
         NodeTraversal node_traversal = stack.back();
         stack.pop_back();
         
         // we have traversed all of edges out of the head of the path, so we can pop it off
         if (node_traversal == stack_sentinel) {
             path.pop_back();
+            auto& entry = path_entries.back();
+            if (entry.first.node != nullptr && entry.second == yielded) {
+                dead_ends.insert(entry.first);
+            }
+            path_entries.pop_back();
             continue;
         }
         
@@ -199,20 +278,28 @@ void ExhaustiveTraversalFinder::add_traversals(vector<SnarlTraversal>& traversal
         if (stop_at.count(node_traversal)) {
             if (yield_at.count(node_traversal)) {
                 // yield path as a snarl traversal
-                traversals.emplace_back();
-                
-                // record the traversal in the return value
+                traversal.clear_visit();
                 for (auto iter = path.begin(); iter != path.end(); iter++) {
-                    *traversals.back().add_visit() = *iter;
+                    *traversal.add_visit() = *iter;
                 }
                 // add the final visit
-                *traversals.back().add_visit() = to_visit(node_traversal);
+                *traversal.add_visit() = to_visit(node_traversal);
+                yielded++;
+                
+                if (!iteratee(traversal) || !budget.found_traversal()) {
+                    return false;
+                }
             }
             
             // don't proceed to add more onto the DFS stack
             continue;
         }
         
+        if (dead_ends.count(node_traversal)) {
+            // we already know there's no way out from here
+            continue;
+        }
+        
         // mark the beginning of this node's edges forward in the stack
         stack.push_back(stack_sentinel);
         
@@ -220,6 +307,7 @@ void ExhaustiveTraversalFinder::add_traversals(vector<SnarlTraversal>& traversal
         path.emplace_back();
         path.back().set_node_id(node_traversal.node->id());
         path.back().set_backward(node_traversal.backward);
+        path_entries.emplace_back(node_traversal, yielded);
         
         // does this traversal point into a child snarl?
         const Snarl* into_snarl = snarl_manager.into_which_snarl(node_traversal.node->id(),
@@ -239,6 +327,7 @@ void ExhaustiveTraversalFinder::add_traversals(vector<SnarlTraversal>& traversal
             path.emplace_back();
             *path.back().mutable_snarl()->mutable_start() = into_snarl->start();
             *path.back().mutable_snarl()->mutable_end() = into_snarl->end();
+            path_entries.emplace_back(stack_sentinel, yielded);
             
             // mark the beginning of this child snarls edges forward in the stack
             stack.push_back(stack_sentinel);
@@ -297,11 +386,24 @@ void ExhaustiveTraversalFinder::add_traversals(vector<SnarlTraversal>& traversal
             stack_up_valid_walks(node_traversal, stack);
         }
     }
+    
+    return true;
 }
     
 vector<SnarlTraversal> ExhaustiveTraversalFinder::find_traversals(const Snarl& site) {
 
     vector<SnarlTraversal> to_return;
+    for_each_traversal(site, [&](const SnarlTraversal& traversal) {
+        to_return.push_back(traversal);
+        return true;
+    });
+    return to_return;
+}
+
+bool ExhaustiveTraversalFinder::for_each_traversal(const Snarl& site,
+                                                   const function<bool(const SnarlTraversal&)>& iteratee) {
+    
+    TraversalSearchBudget budget(max_traversals, max_search_seconds);
     
     NodeTraversal site_end = to_node_traversal(site.end(), graph);
     NodeTraversal site_start = to_node_traversal(site.start(), graph);
@@ -320,19 +422,199 @@ vector<SnarlTraversal> ExhaustiveTraversalFinder::find_traversals(const Snarl& s
     }
     
     // search forward from the start and add any traversals that leave the indicated boundaries
-    add_traversals(to_return, site_start, stop_at, yield_at);
+    if (!add_traversals(iteratee, site_start, stop_at, yield_at, budget)) {
+        return false;
+    }
 
     if (site.end_self_reachable() && include_reversing_traversals) {
         // if the end is reachable from itself, also look for traversals that both enter and
         // leave through the end
         yield_at.erase(site_rev_start);
-        add_traversals(to_return, NodeTraversal(site_end.node, !site_end.backward),
-                       stop_at, yield_at);
+        if (!add_traversals(iteratee, NodeTraversal(site_end.node, !site_end.backward),
+                            stop_at, yield_at, budget)) {
+            return false;
+        }
     }
     
+    return true;
+}
+
+ExhaustiveHandleTraversalFinder::ExhaustiveHandleTraversalFinder(const HandleGraph& graph,
+                                                                 const SnarlManager& snarl_manager,
+                                                                 bool include_reversing_traversals) :
+    graph(graph), snarl_manager(snarl_manager),
+    include_reversing_traversals(include_reversing_traversals) {
+    // nothing more to do
+}
+
+bool ExhaustiveHandleTraversalFinder::add_traversals(const function<bool(const SnarlTraversal&)>& iteratee,
+                                                     const handle_t& traversal_start,
+                                                     const unordered_set<handle_t>& stop_at,
+                                                     const unordered_set<handle_t>& yield_at,
+                                                     TraversalSearchBudget& budget) {
+    // keeps track of the walk of the DFS traversal, which is the prefix shared
+    // by every traversal still on the stack
+    list<Visit> path;
+    
+    // for each visit on the path, the handle it visits (if it is a node
+    // visit) and how many traversals had been found when we got there, so we
+    // can tell if we got anywhere from it
+    vector<tuple<handle_t, bool, size_t>> path_entries;
+    size_t yielded = 0;
+    
+    // the site is acyclic, so a handle we have searched from without finding
+    // a way out will never lead anywhere, however we got to it
+    unordered_set<handle_t> dead_ends;
+    
+    // the traversal we hand out, reused between yields
+    SnarlTraversal traversal;
+    
+    // Each entry in the stack is either a handle to visit next, or a sentinel
+    // marking where the handles reachable from the head of the path start,
+    // so we know when to peel it off the path when backtracking.
+    vector<pair<handle_t, bool>> stack{make_pair(traversal_start, false)};
+    
+    while (stack.size()) {
+        
+        if (!budget.step()) {
+            // out of time
+            return false;
+        }
+        
+        handle_t here = stack.back().first;
+        bool is_sentinel = stack.back().second;
+        stack.pop_back();
+        
+        // we have traversed all of edges out of the head of the path, so we can pop it off
+        if (is_sentinel) {
+            path.pop_back();
+            auto& entry = path_entries.back();
+            if (get<1>(entry) && get<2>(entry) == yielded) {
+                dead_ends.insert(get<0>(entry));
+            }
+            path_entries.pop_back();
+            continue;
+        }
+        
+        // have we finished a traversal through the site?
+        if (stop_at.count(here)) {
+            if (yield_at.count(here)) {
+                // yield path as a snarl traversal
+                traversal.clear_visit();
+                for (auto& visit : path) {
+                    *traversal.add_visit() = visit;
+                }
+                // add the final visit
+                *traversal.add_visit() = graph.to_visit(here);
+                yielded++;
+                
+                if (!iteratee(traversal) || !budget.found_traversal()) {
+                    return false;
+                }
+            }
+            
+            // don't proceed to add more onto the DFS stack
+            continue;
+        }
+        
+        if (dead_ends.count(here)) {
+            // we already know there's no way out from here
+            continue;
+        }
+        
+        // mark the beginning of this node's edges forward in the stack
+        stack.emplace_back(handle_t(), true);
+        path.push_back(graph.to_visit(here));
+        path_entries.emplace_back(here, true, yielded);
+        
+        // does this traversal point into a child snarl?
+        const Snarl* into_snarl = snarl_manager.into_which_snarl(graph.get_id(here), graph.get_is_reverse(here));
+        
+        if (into_snarl && here != traversal_start) {
+            // add a visit for the child snarl, and skip over its contents
+            path.emplace_back();
+            *path.back().mutable_snarl()->mutable_start() = into_snarl->start();
+            *path.back().mutable_snarl()->mutable_end() = into_snarl->end();
+            path_entries.emplace_back(handle_t(), false, yielded);
+            stack.emplace_back(handle_t(), true);
+            
+            handle_t start = graph.get_handle(into_snarl->start().node_id(), into_snarl->start().backward());
+            handle_t end = graph.get_handle(into_snarl->end().node_id(), into_snarl->end().backward());
+            
+            if (here == start) {
+                // Into the start, so come out of the end, or back out of the
+                // start if it is reachable from itself
+                if (into_snarl->start_end_reachable()) {
+                    stack.emplace_back(end, false);
+                }
+                if (into_snarl->start_self_reachable()) {
+                    stack.emplace_back(graph.flip(start), false);
+                }
+            } else {
+                // Into the end, so come out of the start or the end, both
+                // pointing away from the child
+                if (into_snarl->start_end_reachable()) {
+                    stack.emplace_back(graph.flip(start), false);
+                }
+                if (into_snarl->end_self_reachable()) {
+                    stack.emplace_back(end, false);
+                }
+            }
+        } else {
+            // add all of the handles we can walk to next
+            graph.follow_edges(here, false, [&](const handle_t& next) {
+                stack.emplace_back(next, false);
+            });
+        }
+    }
+    
+    return true;
+}
+
+vector<SnarlTraversal> ExhaustiveHandleTraversalFinder::find_traversals(const Snarl& site) {
+
+    vector<SnarlTraversal> to_return;
+    for_each_traversal(site, [&](const SnarlTraversal& traversal) {
+        to_return.push_back(traversal);
+        return true;
+    });
     return to_return;
 }
 
+bool ExhaustiveHandleTraversalFinder::for_each_traversal(const Snarl& site,
+                                                         const function<bool(const SnarlTraversal&)>& iteratee) {
+    
+    TraversalSearchBudget budget(max_traversals, max_search_seconds);
+    
+    handle_t site_start = graph.get_handle(site.start().node_id(), site.start().backward());
+    handle_t site_end = graph.get_handle(site.end().node_id(), site.end().backward());
+    
+    // stop searching when the traversal is leaving the site
+    unordered_set<handle_t> stop_at{site_end, graph.flip(site_start)};
+    
+    // choose which side(s) can be the end of the traversal
+    unordered_set<handle_t> yield_at{site_end};
+    if (include_reversing_traversals) {
+        yield_at.insert(graph.flip(site_start));
+    }
+    
+    // search forward from the start and add any traversals that leave the indicated boundaries
+    if (!add_traversals(iteratee, site_start, stop_at, yield_at, budget)) {
+        return false;
+    }
+
+    if (site.end_self_reachable() && include_reversing_traversals) {
+        // if the end is reachable from itself, also look for traversals that both enter and
+        // leave through the end
+        yield_at.erase(graph.flip(site_start));
+        if (!add_traversals(iteratee, graph.flip(site_end), stop_at, yield_at, budget)) {
+            return false;
+        }
+    }
+    
+    return true;
+}
+
 SupportRestrictedTraversalFinder::SupportRestrictedTraversalFinder(AugmentedGraph& augmented_graph,
                                                                    SnarlManager& snarl_manager,
                                                                    int min_node_support,
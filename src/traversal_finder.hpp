@@ -15,6 +15,8 @@
 #include <unordered_set>
 #include <unordered_map>
 #include <list>
+#include <chrono>
+#include <memory>
 #include "vg.pb.h"
 #include "vg.hpp"
 #include "translator.hpp"
@@ -40,6 +42,43 @@ public:
     virtual ~TraversalFinder() = default;
     
     virtual vector<SnarlTraversal> find_traversals(const Snarl& site) = 0;
+    
+    /**
+     * Call iteratee with each traversal of the site, in the order
+     * find_traversals would return them, until it returns false. Returns true
+     * if every traversal was visited. Finders that can enumerate lazily
+     * override this, so callers that stop early don't pay for the rest.
+     */
+    virtual bool for_each_traversal(const Snarl& site, const function<bool(const SnarlTraversal&)>& iteratee);
+    
+    /**
+     * Find the traversals of each of the given sites, using a separate finder
+     * from make_finder on each OMP thread, and return them in the order of the
+     * sites.
+     */
+    static vector<vector<SnarlTraversal>> find_traversals_parallel(const vector<const Snarl*>& sites,
+        const function<unique_ptr<TraversalFinder>()>& make_finder);
+};
+
+/**
+ * Tracks how much of its budget of traversals and time a search for
+ * traversals of a site has used up.
+ */
+class TraversalSearchBudget {
+public:
+    TraversalSearchBudget(size_t max_traversals, double max_seconds);
+    
+    /// Record finding a traversal. Returns false if no more may be found.
+    bool found_traversal();
+    
+    /// Record taking a step of the search. Returns false if the time is up.
+    bool step();
+    
+private:
+    size_t remaining;
+    bool timed;
+    chrono::steady_clock::time_point deadline;
+    size_t steps = 0;
 };
 
 class ExhaustiveTraversalFinder : public TraversalFinder {
@@ -55,16 +94,70 @@ public:
     virtual ~ExhaustiveTraversalFinder();
     
     /**
-     * Exhaustively enumerate all traversals through the site. Only valid for
-     * acyclic Snarls.
+     * Exhaustively enumerate all traversals through the site, up to
+     * max_traversals of them or max_search_seconds of searching. Only valid
+     * for acyclic Snarls.
      */
     virtual vector<SnarlTraversal> find_traversals(const Snarl& site);
     
+    /**
+     * Enumerate the traversals lazily, within the same limits.
+     */
+    virtual bool for_each_traversal(const Snarl& site, const function<bool(const SnarlTraversal&)>& iteratee);
+    
+    /// Stop after finding this many traversals of a site
+    size_t max_traversals = numeric_limits<size_t>::max();
+    
+    /// Stop searching a site after this many seconds
+    double max_search_seconds = numeric_limits<double>::infinity();
+    
 protected:
     void stack_up_valid_walks(NodeTraversal walk_head, vector<NodeTraversal>& stack);
     virtual bool visit_next_node(const Node*, const Edge*) { return true; }
-    void add_traversals(vector<SnarlTraversal>& traversals, NodeTraversal traversal_start,
-                        set<NodeTraversal>& stop_at, set<NodeTraversal>& yield_at);
+    bool add_traversals(const function<bool(const SnarlTraversal&)>& iteratee, NodeTraversal traversal_start,
+                        set<NodeTraversal>& stop_at, set<NodeTraversal>& yield_at, TraversalSearchBudget& budget);
+};
+
+/**
+ * Does the same exhaustive enumeration as ExhaustiveTraversalFinder, but on
+ * any HandleGraph, like an XG, instead of only a VG. Keeps no state between
+ * searches, so separate instances can search different snarls of the same
+ * graph at the same time.
+ */
+class ExhaustiveHandleTraversalFinder : public TraversalFinder {
+    
+    const HandleGraph& graph;
+    const SnarlManager& snarl_manager;
+    bool include_reversing_traversals;
+    
+public:
+    ExhaustiveHandleTraversalFinder(const HandleGraph& graph, const SnarlManager& snarl_manager,
+                                    bool include_reversing_traversals = false);
+    
+    virtual ~ExhaustiveHandleTraversalFinder() = default;
+    
+    /**
+     * Exhaustively enumerate all traversals through the site, up to
+     * max_traversals of them or max_search_seconds of searching. Only valid
+     * for acyclic Snarls.
+     */
+    virtual vector<SnarlTraversal> find_traversals(const Snarl& site);
+    
+    /**
+     * Enumerate the traversals lazily, within the same limits.
+     */
+    virtual bool for_each_traversal(const Snarl& site, const function<bool(const SnarlTraversal&)>& iteratee);
+    
+    /// Stop after finding this many traversals of a site
+    size_t max_traversals = numeric_limits<size_t>::max();
+    
+    /// Stop searching a site after this many seconds
+    double max_search_seconds = numeric_limits<double>::infinity();
+    
+protected:
+    bool add_traversals(const function<bool(const SnarlTraversal&)>& iteratee, const handle_t& traversal_start,
+                        const unordered_set<handle_t>& stop_at, const unordered_set<handle_t>& yield_at,
+                        TraversalSearchBudget& budget);
 };
 
 /** Does exhaustive traversal, but restricting to nodes and edges that meet 
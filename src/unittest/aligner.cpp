@@ -384,8 +384,83 @@ TEST_CASE("BaseAligner mapping quality estimation is robust", "[aligner][alignme
     
     }
     
+    SECTION("integer scores get the same mapping qualities as scaled scores") {
+        
+        Aligner aligner;
+        
+        // include scores too far below the best to be tabulated
+        vector<vector<int32_t>> score_sets{{10}, {0}, {-10}, {1, 5, 2, 5, 4}, {60, 58, 57, 60 - 2000, 12},
+                                           {-5, -3, -3, -100}};
+        for (vector<int32_t>& scores : score_sets) {
+            scaled_scores.clear();
+            for (int32_t score : scores) {
+                scaled_scores.push_back(aligner.log_base * score);
+            }
+            
+            size_t int_max_idx;
+            double int_mapq = aligner.maximum_mapping_quality_exact(scores.data(), scores.size(), &int_max_idx);
+            double mapq = BaseAligner::maximum_mapping_quality_exact(scaled_scores, &max_idx);
+            REQUIRE(int_max_idx == max_idx);
+            REQUIRE(int_mapq == Approx(mapq));
+            
+            int_mapq = aligner.maximum_mapping_quality_approx(scores.data(), scores.size(), &int_max_idx);
+            mapq = BaseAligner::maximum_mapping_quality_approx(scaled_scores, &max_idx);
+            REQUIRE(int_max_idx == max_idx);
+            REQUIRE(int_mapq == Approx(mapq));
+        }
+    }
+    
 }
    
+TEST_CASE("Aligner can align to a HandleGraph directly", "[aligner][alignment][mapping][handle]") {
+    
+    VG graph;
+    
+    Aligner aligner(1, 4, 6, 1, 5);
+    
+    Node* n0 = graph.create_node("AGTG");
+    Node* n1 = graph.create_node("C");
+    Node* n2 = graph.create_node("A");
+    Node* n3 = graph.create_node("TGAAGT");
+    
+    graph.create_edge(n0, n1);
+    graph.create_edge(n0, n2);
+    graph.create_edge(n1, n3);
+    graph.create_edge(n2, n3);
+    
+    SECTION("Aligning to the handle graph matches aligning to the protobuf graph") {
+        Alignment proto_aln, handle_aln;
+        proto_aln.set_sequence("AGTGCTGAAGT");
+        handle_aln.set_sequence("AGTGCTGAAGT");
+        
+        aligner.align(proto_aln, graph.graph, true, false);
+        aligner.align(handle_aln, graph, true, false);
+        
+        REQUIRE(handle_aln.score() == proto_aln.score());
+        REQUIRE(handle_aln.path().mapping_size() == 3);
+        REQUIRE(pb2json(handle_aln.path()) == pb2json(proto_aln.path()));
+    }
+    
+    SECTION("A topological order on the reverse strand produces reverse strand mappings") {
+        vector<handle_t> order{graph.get_handle(n3->id(), true), graph.get_handle(n2->id(), true),
+                               graph.get_handle(n1->id(), true), graph.get_handle(n0->id(), true)};
+        
+        Alignment aln;
+        aln.set_sequence("ACTTCAGCACT");
+        aligner.align(aln, graph, true, false, &order);
+        
+        REQUIRE(aln.score() == 11 + 2 * 5);
+        REQUIRE(aln.path().mapping_size() == 3);
+        REQUIRE(aln.path().mapping(0).position().node_id() == n3->id());
+        REQUIRE(aln.path().mapping(1).position().node_id() == n1->id());
+        REQUIRE(aln.path().mapping(2).position().node_id() == n0->id());
+        for (size_t i = 0; i < aln.path().mapping_size(); i++) {
+            REQUIRE(aln.path().mapping(i).position().is_reverse());
+            REQUIRE(aln.path().mapping(i).position().offset() == 0);
+        }
+    }
+}
+
 }
 }
         
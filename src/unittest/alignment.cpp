@@ -10,6 +10,9 @@
 #include "../alignment.hpp"
 #include "catch.hpp"
 
+#include <cstring>
+#include "htslib/kstring.h"
+
 namespace vg {
 namespace unittest {
 using namespace std;
@@ -107,7 +110,135 @@ TEST_CASE("Alignment trimming works even on unaligned reads", "[alignment]") {
     aln = strip_from_end(aln, 50);
 
     REQUIRE(a.sequence().size() - 100 == aln.sequence().size());
+
+}
+
+TEST_CASE("In-place alignment trimming cuts paths like cut_path", "[alignment]") {
+
+    string alignment_string = R"(
+        {
+            "sequence": "GATTACAT",
+            "quality": "ABCDEFGH",
+            "name": "read",
+            "score": 5,
+            "mapping_quality": 60,
+            "path": {"mapping": [
+                {
+                    "position": {"node_id": 1, "offset": 2},
+                    "rank": 1,
+                    "edit": [
+                        {"from_length": 2, "to_length": 2},
+                        {"to_length": 1, "sequence": "T"}
+                    ]
+                },
+                {
+                    "position": {"node_id": 2},
+                    "rank": 2,
+                    "edit": [
+                        {"from_length": 1},
+                        {"from_length": 3, "to_length": 3}
+                    ]
+                },
+                {
+                    "position": {"node_id": 3},
+                    "rank": 3,
+                    "edit": [
+                        {"from_length": 2, "to_length": 2}
+                    ]
+                }
+            ]}
+        }
+    )";
+
+    Alignment a;
+    json2pb(a, alignment_string.c_str(), alignment_string.size());
+
+    for (size_t drop = 1; drop <= a.sequence().size(); drop++) {
+        // The paths are cut the same way cut_path() cuts them
+        Alignment from_start = a;
+        strip_from_start_in_place(&from_start, drop);
+        REQUIRE(pb2json(from_start.path()) == pb2json(cut_path(a.path(), drop).second));
+
+        Alignment from_end = a;
+        strip_from_end_in_place(&from_end, drop);
+        REQUIRE(pb2json(from_end.path()) == pb2json(cut_path(a.path(), a.sequence().size() - drop).first));
+
+        // Stripping drops the fields that don't survive trimming
+        REQUIRE(from_start.quality().empty());
+        REQUIRE(from_start.mapping_quality() == 0);
+        REQUIRE(from_start.name() == "read");
+        REQUIRE(from_start.sequence() == a.sequence().substr(drop));
+        REQUIRE(alignment_to_length(from_end) == a.sequence().size() - drop);
+    }
+
+    Alignment simplified = a;
+    simplify_in_place(&simplified);
+    REQUIRE(pb2json(simplified) == pb2json(simplify(a)));
+}
+
+TEST_CASE("BAM records are built the same as from SAM text", "[alignment][bam]") {
+    
+    map<string, int64_t> path_length{{"ref", 100}, {"other", 50}};
+    map<string, string> rg_sample{{"rg1", "sample1"}};
+    string header_text;
+    bam_hdr_t* header = hts_string_header(header_text, path_length, rg_sample);
+    REQUIRE(header != nullptr);
+    
+    string alignment_string = R"(
+        {"name": "read/1", "sequence": "GATTACA", "read_group": "rg1", "mapping_quality": 30,
+         "fragment_next": {"name": "read/2"},
+         "path": {"mapping": [{"position": {"node_id": 1}, "edit": [{"from_length": 7, "to_length": 7}]}]}}
+    )";
+    Alignment aln;
+    json2pb(aln, alignment_string.c_str(), alignment_string.size());
+    // Qualities are stored raw
+    aln.set_quality(string{0, 1, 2, 3, 40, 41, 42});
+    
+    // Compare a record against what htslib makes from the matching SAM line
+    auto check_against_sam = [&](bam1_t* b, const string& sam_line) {
+        kstring_t line = {0, 0, nullptr};
+        kputsn(sam_line.c_str(), sam_line.size() - 1, &line);
+        bam1_t* parsed = bam_init1();
+        REQUIRE(sam_parse1(&line, header, parsed) >= 0);
+        free(line.s);
+        
+        REQUIRE(b->core.tid == parsed->core.tid);
+        REQUIRE(b->core.pos == parsed->core.pos);
+        REQUIRE(b->core.bin == parsed->core.bin);
+        REQUIRE(b->core.qual == parsed->core.qual);
+        REQUIRE(b->core.flag == parsed->core.flag);
+        REQUIRE(b->core.mtid == parsed->core.mtid);
+        REQUIRE(b->core.mpos == parsed->core.mpos);
+        REQUIRE(b->core.isize == parsed->core.isize);
+        REQUIRE(b->l_data == parsed->l_data);
+        REQUIRE(memcmp(b->data, parsed->data, b->l_data) == 0);
+        
+        bam_destroy1(parsed);
+        bam_destroy1(b);
+    };
+    
+    SECTION("a paired read on the reverse strand") {
+        check_against_sam(alignment_to_bam(header, aln, "ref", 10, true, "2M1I4M", "ref", 40, 37),
+                          alignment_to_sam(aln, "ref", 10, true, "2M1I4M", "ref", 40, 37));
+    }
+    
+    SECTION("an unpaired read on the forward strand") {
+        aln.clear_fragment_next();
+        aln.set_name("");
+        check_against_sam(alignment_to_bam(header, aln, "other", 3, false, "7M"),
+                          alignment_to_sam(aln, "other", 3, false, "7M"));
+    }
+    
+    SECTION("an unmapped read without qualities") {
+        aln.clear_fragment_next();
+        aln.clear_path();
+        aln.clear_quality();
+        aln.clear_read_group();
+        check_against_sam(alignment_to_bam(header, aln, "", -1, false, ""),
+                          alignment_to_sam(aln, "", -1, false, ""));
+    }
     
+    bam_hdr_destroy(header);
 }
 
 }
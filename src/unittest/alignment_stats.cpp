@@ -0,0 +1,131 @@
+/// \file alignment_stats.cpp
+///
+/// Unit tests for the mergeable AlignmentStats accumulators
+
+#include "../alignment_stats.hpp"
+#include "../stream.hpp"
+
+#include "catch.hpp"
+
+#include <sstream>
+
+namespace vg {
+namespace unittest {
+using namespace std;
+
+/// Add a mapping to the given node with one edit to an Alignment
+static void add_stats_test_mapping(Alignment& aln, id_t node_id, size_t from_length, size_t to_length,
+                                   const string& sequence = "") {
+    Mapping* mapping = aln.mutable_path()->add_mapping();
+    mapping->mutable_position()->set_node_id(node_id);
+    Edit* edit = mapping->add_edit();
+    edit->set_from_length(from_length);
+    edit->set_to_length(to_length);
+    edit->set_sequence(sequence);
+}
+
+/// Make a primary Alignment with a softclip on node 1, a match on node 2, a
+/// deletion on node 3, a substitution on node 4, and a match on node 5.
+static Alignment make_stats_test_alignment() {
+    Alignment aln;
+    aln.set_score(10);
+    add_stats_test_mapping(aln, 1, 0, 2, "GG");
+    add_stats_test_mapping(aln, 2, 4, 4);
+    add_stats_test_mapping(aln, 3, 3, 0);
+    add_stats_test_mapping(aln, 4, 1, 1, "A");
+    add_stats_test_mapping(aln, 5, 4, 4);
+    return aln;
+}
+
+TEST_CASE("AlignmentStats count alignments and edits", "[alignment][stats]") {
+
+    map<id_t, pair<string, string>> allele_path_for_node {
+        {2, make_pair("_alt_site", "0")},
+        {6, make_pair("_alt_site", "1")}
+    };
+
+    AlignmentStats stats(true, &allele_path_for_node);
+    stats.add(make_stats_test_alignment());
+
+    Alignment secondary = make_stats_test_alignment();
+    secondary.set_is_secondary(true);
+    stats.add(secondary);
+
+    Alignment unaligned;
+    stats.add(unaligned);
+
+    REQUIRE(stats.total_alignments == 3);
+    REQUIRE(stats.total_primary == 2);
+    REQUIRE(stats.total_secondary == 1);
+    REQUIRE(stats.total_aligned == 1);
+
+    // Secondary alignments don't count as visits or edits
+    REQUIRE(stats.node_visit_counts.size() == 5);
+    REQUIRE(stats.node_visit_counts[2] == 1);
+
+    REQUIRE(stats.total_softclips == 1);
+    REQUIRE(stats.total_softclipped_bases == 2);
+    REQUIRE(stats.total_insertions == 0);
+    REQUIRE(stats.total_deletions == 1);
+    REQUIRE(stats.total_deleted_bases == 3);
+    REQUIRE(stats.total_substitutions == 1);
+    REQUIRE(stats.total_substituted_bases == 1);
+
+    REQUIRE(stats.softclips.size() == 1);
+    REQUIRE(stats.softclips[0].first == 1);
+    REQUIRE(stats.deletions.size() == 1);
+    REQUIRE(stats.deletions[0].first == 3);
+
+    REQUIRE(stats.reads_on_allele.size() == 1);
+    REQUIRE(stats.reads_on_allele["_alt_site"]["0"] == 1);
+    REQUIRE(!stats.reads_on_allele["_alt_site"].count("1"));
+
+    SECTION("merged stats are the sum of their parts") {
+        AlignmentStats other = stats.empty_copy();
+        other.add(make_stats_test_alignment());
+        REQUIRE(other.softclips.size() == 1);
+
+        stats.merge(other);
+        REQUIRE(stats.total_alignments == 4);
+        REQUIRE(stats.total_primary == 3);
+        REQUIRE(stats.total_aligned == 2);
+        REQUIRE(stats.node_visit_counts[5] == 2);
+        REQUIRE(stats.total_deleted_bases == 6);
+        REQUIRE(stats.deletions.size() == 2);
+        REQUIRE(stats.reads_on_allele["_alt_site"]["0"] == 2);
+    }
+
+    SECTION("edits are not kept unless asked for") {
+        AlignmentStats quiet;
+        quiet.add(make_stats_test_alignment());
+        REQUIRE(quiet.total_deletions == 1);
+        REQUIRE(quiet.deletions.empty());
+        REQUIRE(quiet.reads_on_allele.empty());
+    }
+}
+
+TEST_CASE("AlignmentStats can be accumulated over a stream on many threads", "[alignment][stats]") {
+
+    stringstream gam;
+    {
+        vector<Alignment> buffer;
+        for (size_t i = 0; i < 1000; i++) {
+            buffer.push_back(make_stats_test_alignment());
+            buffer.back().set_is_secondary(i % 4 == 0);
+            stream::write_buffered(gam, buffer, 100);
+        }
+        stream::write_buffered(gam, buffer, 0);
+    }
+
+    AlignmentStats stats = accumulate_alignment_stats(gam, AlignmentStats(true));
+
+    REQUIRE(stats.total_alignments == 1000);
+    REQUIRE(stats.total_secondary == 250);
+    REQUIRE(stats.total_primary == 750);
+    REQUIRE(stats.node_visit_counts[1] == 750);
+    REQUIRE(stats.total_substitutions == 750);
+    REQUIRE(stats.substitutions.size() == 750);
+}
+
+}
+}
@@ -0,0 +1,118 @@
+/// \file alignment_view.cpp
+///
+/// Unit tests for AlignmentView, which decodes single fields of serialized
+/// Alignments
+
+#include "../alignment_view.hpp"
+#include "../stream.hpp"
+
+#include "catch.hpp"
+
+#include <sstream>
+
+namespace vg {
+namespace unittest {
+using namespace std;
+
+/// Make an Alignment with most of the fields AlignmentView can read
+static Alignment make_view_test_alignment() {
+    Alignment aln;
+    aln.set_name("read1");
+    aln.set_sequence("GATTACA");
+    aln.set_quality("1234567");
+    aln.set_mapping_quality(37);
+    aln.set_score(-5);
+    aln.set_is_secondary(true);
+    aln.set_identity(0.75);
+    for (size_t i = 0; i < 3; i++) {
+        Mapping* mapping = aln.mutable_path()->add_mapping();
+        mapping->mutable_position()->set_node_id(10 + i);
+        mapping->mutable_position()->set_offset(i);
+        Edit* edit = mapping->add_edit();
+        edit->set_from_length(2);
+        edit->set_to_length(2);
+        mapping->set_rank(i + 1);
+    }
+    Position* refpos = aln.add_refpos();
+    refpos->set_name("chr1");
+    refpos->set_offset(100);
+    aln.set_read_paired(true);
+    return aln;
+}
+
+TEST_CASE("AlignmentView decodes individual fields", "[alignment][view]") {
+    
+    Alignment aln = make_view_test_alignment();
+    string serialized;
+    aln.SerializeToString(&serialized);
+    AlignmentView view(serialized);
+    
+    SECTION("scalars and strings can be read") {
+        REQUIRE(view.name() == "read1");
+        REQUIRE(view.sequence() == "GATTACA");
+        REQUIRE(view.sequence_length() == 7);
+        REQUIRE(view.quality() == "1234567");
+        REQUIRE(view.mapping_quality() == 37);
+        REQUIRE(view.score() == -5);
+        REQUIRE(view.is_secondary());
+        REQUIRE(view.identity() == 0.75);
+    }
+    
+    SECTION("the path can be looked into without decoding it") {
+        REQUIRE(view.has_path());
+        REQUIRE(view.mapping_size() == 3);
+        REQUIRE(view.first_position().node_id() == 10);
+        REQUIRE(view.first_position().offset() == 0);
+    }
+    
+    SECTION("repeated messages can be read") {
+        auto refpos = view.refpos();
+        REQUIRE(refpos.size() == 1);
+        REQUIRE(refpos[0].name() == "chr1");
+        REQUIRE(refpos[0].offset() == 100);
+    }
+    
+    SECTION("the whole alignment can be decoded") {
+        Alignment decoded = view.to_alignment();
+        REQUIRE(decoded.path().mapping_size() == 3);
+        REQUIRE(decoded.read_paired());
+    }
+    
+    SECTION("an empty view has default values") {
+        AlignmentView empty;
+        REQUIRE(empty.name().empty());
+        REQUIRE(empty.mapping_quality() == 0);
+        REQUIRE(!empty.has_path());
+        REQUIRE(empty.mapping_size() == 0);
+        REQUIRE(empty.first_position().node_id() == 0);
+    }
+    
+    SECTION("corrupt data is reported") {
+        AlignmentView truncated(serialized.substr(0, serialized.size() - 5));
+        REQUIRE_THROWS(truncated.refpos());
+    }
+}
+
+TEST_CASE("AlignmentViews can be read from GAM streams", "[alignment][view]") {
+    
+    vector<Alignment> alns;
+    for (size_t i = 0; i < 10; i++) {
+        alns.push_back(make_view_test_alignment());
+        alns.back().set_mapping_quality(i);
+    }
+    stringstream gam;
+    stream::write_buffered(gam, alns, 0);
+    
+    vector<int32_t> mapqs;
+    stream::for_each<AlignmentView>(gam, [&](AlignmentView& view) {
+        mapqs.push_back(view.mapping_quality());
+    });
+    
+    REQUIRE(mapqs.size() == 10);
+    for (size_t i = 0; i < mapqs.size(); i++) {
+        REQUIRE(mapqs[i] == i);
+    }
+}
+
+}
+}
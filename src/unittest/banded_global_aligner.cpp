@@ -3438,6 +3438,58 @@ namespace vg {
                 }
             }
         }
+        
+        TEST_CASE( "Banded global aligner gets the same alignment from a gathered quality profile",
+                  "[alignment][banded][mapping]" ) {
+            
+            VG graph;
+            
+            QualAdjAligner aligner = QualAdjAligner();
+            
+            Node* n0 = graph.create_node("AGTG");
+            Node* n1 = graph.create_node("C");
+            Node* n2 = graph.create_node("A");
+            Node* n3 = graph.create_node("TGAAGT");
+            
+            graph.create_edge(n0, n1);
+            graph.create_edge(n0, n2);
+            graph.create_edge(n1, n3);
+            graph.create_edge(n2, n3);
+            
+            string read = string("AGTGGTGAAGT");
+            string qual = string("HHDD#<<9861");
+            Alignment aln;
+            aln.set_sequence(read);
+            aln.set_quality(qual);
+            alignment_quality_char_to_short(aln);
+            
+            SECTION( "The profile holds the quality adjusted score of each read base against each reference base" ) {
+                
+                vector<int8_t> profile;
+                aligner.query_profile(aln, profile);
+                
+                REQUIRE(profile.size() == 5 * read.size());
+                for (size_t i = 0; i < read.size(); i++) {
+                    for (size_t j = 0; j < 5; j++) {
+                        REQUIRE(profile[5 * i + j] == aligner.score_matrix[25 * aln.quality()[i] + 5 * j
+                                                                           + aligner.nt_table[read[i]]]);
+                    }
+                }
+            }
+            
+            SECTION( "Aligning with the aligner's profile matches gathering it in the banded aligner" ) {
+                
+                Alignment direct_aln = aln;
+                
+                aligner.align_global_banded(aln, graph.graph, 1, true);
+                
+                BandedGlobalAligner<int16_t> band_graph(direct_aln, graph.graph, 1, true, true);
+                band_graph.align(aligner.score_matrix, aligner.nt_table, aligner.gap_open, aligner.gap_extension);
+                
+                REQUIRE(aln.score() == direct_aln.score());
+                REQUIRE(pb2json(aln.path()) == pb2json(direct_aln.path()));
+            }
+        }
     }
 }
 
@@ -434,6 +434,68 @@ TEST_CASE("a BlockedGzipInputStream can read large amounts of blocked compressed
 
 }
 
+TEST_CASE("a BlockedGzipInputStream can decompress blocked data on background threads", "[bgzip]") {
+    stringstream datastream;
+
+    {
+        // Write some data in
+        BlockedGzipOutputStream bgzip_out(datastream);
+        ::google::protobuf::io::CodedOutputStream coded_out(&bgzip_out);
+        
+        for (uint32_t i = 0; i < 1000000; i++) {
+            // Generate ~4 MB of data, which spans many blocks
+            coded_out.WriteLittleEndian32(i);
+        }
+        bgzip_out.EndFile();
+        
+    }
+    
+    // Get the virtual offsets at the start of every buffer from a reader
+    // without read-ahead, to compare against.
+    vector<int64_t> expected_offsets;
+    {
+        stringstream copy(datastream.str());
+        BlockedGzipInputStream bgzip_in(copy);
+        const void* buffer;
+        int buffer_size;
+        expected_offsets.push_back(bgzip_in.Tell());
+        while (bgzip_in.Next(&buffer, &buffer_size)) {
+            expected_offsets.push_back(bgzip_in.Tell());
+        }
+    }
+    
+    SECTION("data comes back in order") {
+        BlockedGzipInputStream bgzip_in(datastream, 2);
+        ::google::protobuf::io::CodedInputStream coded_in(&bgzip_in);
+        
+        uint32_t expected = 0;
+        uint32_t found;
+        
+        while(coded_in.ReadLittleEndian32(&found)) {
+            if (expected % 1000 == 1) {
+                REQUIRE(found == expected);
+            }
+            expected++;
+        }
+        
+        REQUIRE(expected == 1000000);
+    }
+    
+    SECTION("virtual offsets are still correct") {
+        BlockedGzipInputStream bgzip_in(datastream, 2);
+        const void* buffer;
+        int buffer_size;
+        vector<int64_t> found_offsets;
+        found_offsets.push_back(bgzip_in.Tell());
+        while (bgzip_in.Next(&buffer, &buffer_size)) {
+            found_offsets.push_back(bgzip_in.Tell());
+        }
+        
+        REQUIRE(found_offsets == expected_offsets);
+    }
+
+}
+
 }
 
 }
@@ -0,0 +1,83 @@
+/// \file cluster_graph_cache.cpp
+///
+/// Unit tests for the ClusterGraphCache, which shares cluster subgraphs between reads with the same anchors
+
+#include <iostream>
+#include "json2pb.h"
+#include "vg.pb.h"
+#include "../cluster_graph_cache.hpp"
+#include "catch.hpp"
+
+namespace vg {
+namespace unittest {
+
+TEST_CASE( "ClusterGraphCache shares subgraphs between reads with the same anchors", "[mapping][cluster][cache]" ) {
+
+    string graph_json = R"({
+        "node": [
+            {"id": 1, "sequence": "GATT"},
+            {"id": 2, "sequence": "ACA"}
+        ],
+        "edge": [
+            {"from": 1, "to": 2}
+        ]
+    })";
+
+    Graph proto_graph;
+    json2pb(proto_graph, graph_json.c_str(), graph_json.size());
+
+    ClusterGraphCache cache(16);
+    size_t extractions = 0;
+    auto extract = [&]() {
+        extractions++;
+        return proto_graph;
+    };
+
+    // Make a read with one MEM at the given offset and length, at the given
+    // graph position
+    auto make_read = [&](const string& sequence, Alignment& aln, vector<MaximalExactMatch>& mems,
+                         size_t offset, size_t length, gcsa::node_type node) {
+        aln.set_sequence(sequence);
+        mems.clear();
+        mems.emplace_back(aln.sequence().begin() + offset, aln.sequence().begin() + offset + length,
+                          gcsa::range_type(0, 0));
+        mems.back().nodes.push_back(node);
+    };
+
+    Alignment aln1, aln2;
+    vector<MaximalExactMatch> mems1, mems2;
+    gcsa::node_type node = gcsa::Node::encode(1, 0, false);
+
+    SECTION( "the same anchors in another read reuse the subgraph" ) {
+        make_read("GATTACA", aln1, mems1, 0, 5, node);
+        make_read("GATTACT", aln2, mems2, 0, 5, node);
+        auto first = cache.get(aln1, mems1, extract);
+        auto second = cache.get(aln2, mems2, extract);
+        REQUIRE(extractions == 1);
+        REQUIRE(first.get() == second.get());
+        REQUIRE(first->acyclic_and_sorted);
+        REQUIRE(first->graph.node_size() == 2);
+        REQUIRE(cache.hits() == 1);
+        REQUIRE(cache.misses() == 1);
+    }
+
+    SECTION( "MEMs that spell something else get their own subgraph" ) {
+        make_read("GATTACA", aln1, mems1, 0, 5, node);
+        make_read("GATCACA", aln2, mems2, 0, 5, node);
+        cache.get(aln1, mems1, extract);
+        cache.get(aln2, mems2, extract);
+        REQUIRE(extractions == 2);
+    }
+
+    SECTION( "MEMs elsewhere in the read get their own subgraph" ) {
+        make_read("GATTACA", aln1, mems1, 0, 5, node);
+        make_read("GATTACA", aln2, mems2, 1, 5, node);
+        cache.get(aln1, mems1, extract);
+        cache.get(aln2, mems2, extract);
+        REQUIRE(extractions == 2);
+        REQUIRE(cache.size() == 2);
+    }
+}
+
+}
+}
@@ -0,0 +1,200 @@
+/// \file compact_alignment.cpp
+///
+/// Unit tests for the compact reference-relative Alignment encoding
+
+#include <iostream>
+#include <vector>
+#include "json2pb.h"
+#include "vg.pb.h"
+#include "../compact_alignment.hpp"
+#include "catch.hpp"
+
+namespace vg {
+namespace unittest {
+
+using namespace std;
+
+TEST_CASE("CompactAlignments round-trip through the graph", "[gam][compact]") {
+
+    string graph_json = R"({
+        "node": [
+            {"id": 1, "sequence": "GATTACA"},
+            {"id": 2, "sequence": "C"},
+            {"id": 3, "sequence": "T"},
+            {"id": 4, "sequence": "CATTAG"}
+        ],
+        "edge": [
+            {"from": 1, "to": 2},
+            {"from": 1, "to": 3},
+            {"from": 2, "to": 4},
+            {"from": 3, "to": 4}
+        ]
+    })";
+
+    Graph proto_graph;
+    json2pb(proto_graph, graph_json.c_str(), graph_json.size());
+    xg::XG xg_index(proto_graph);
+
+    auto round_trip = [&](const string& aln_json, bool& sequence_implied) -> CompactAlignment {
+        Alignment aln;
+        json2pb(aln, aln_json.c_str(), aln_json.size());
+        CompactAlignment compact = compact_alignment(aln, xg_index);
+        sequence_implied = compact.sequence_implied();
+        REQUIRE(pb2json(expand_alignment(compact, xg_index)) == pb2json(aln));
+        return compact;
+    };
+
+    SECTION("a perfect match needs no edits or sequence") {
+        bool sequence_implied;
+        CompactAlignment compact = round_trip(R"({"sequence": "TACATCAT", "name": "read", "path": {"mapping": [
+            {"position": {"node_id": 1, "offset": 3}, "edit": [{"from_length": 4, "to_length": 4}], "rank": 1},
+            {"position": {"node_id": 3}, "edit": [{"from_length": 1, "to_length": 1}], "rank": 2},
+            {"position": {"node_id": 4}, "edit": [{"from_length": 3, "to_length": 3}], "rank": 3}
+        ]}})", sequence_implied);
+        REQUIRE(sequence_implied);
+        REQUIRE(compact.alignment().sequence().empty());
+        REQUIRE(compact.alignment().path().mapping_size() == 0);
+        REQUIRE(compact.edit_count(0) == 0);
+        REQUIRE(compact.edit_count(1) == 0);
+        // The last mapping stops partway through its node
+        REQUIRE(compact.edit_count(2) == 1);
+        REQUIRE(compact.edit_sequence().empty());
+
+        vector<id_t> visited;
+        for_each_node_id(compact, [&](id_t id) {
+            visited.push_back(id);
+            return true;
+        });
+        REQUIRE(visited == vector<id_t>({1, 3, 4}));
+    }
+
+    SECTION("substitutions, insertions, and deletions keep their sequences") {
+        bool sequence_implied;
+        CompactAlignment compact = round_trip(R"({"sequence": "GGATTCACCAG", "path": {"mapping": [
+            {"position": {"node_id": 1}, "edit": [{"to_length": 1, "sequence": "G"}, {"from_length": 3, "to_length": 3},
+                {"from_length": 1, "to_length": 1, "sequence": "T"}, {"from_length": 1}, {"from_length": 2, "to_length": 2}]},
+            {"position": {"node_id": 2}, "edit": [{"from_length": 1, "to_length": 1}]},
+            {"position": {"node_id": 4, "offset": 1}, "edit": [{"from_length": 1, "to_length": 1, "sequence": "C"}, {"to_length": 2, "sequence": "AG"}]}
+        ]}})", sequence_implied);
+        REQUIRE(sequence_implied);
+        REQUIRE(compact.edit_sequence() == "GTCAG");
+        REQUIRE(!compact.ranked());
+    }
+
+    SECTION("reverse strand paths round-trip") {
+        bool sequence_implied;
+        round_trip(R"({"sequence": "TAATGGGA", "path": {"mapping": [
+            {"position": {"node_id": 4, "is_reverse": true, "offset": 1}, "edit": [{"from_length": 5, "to_length": 5}]},
+            {"position": {"node_id": 2, "is_reverse": true}, "edit": [{"from_length": 1, "to_length": 1}]},
+            {"position": {"node_id": 1, "is_reverse": true}, "edit": [{"from_length": 2, "to_length": 2, "sequence": "GA"}]}
+        ]}})", sequence_implied);
+        REQUIRE(sequence_implied);
+    }
+
+    SECTION("sequences the path doesn't spell are kept") {
+        bool sequence_implied;
+        CompactAlignment compact = round_trip(R"({"sequence": "GATTACAA", "path": {"mapping": [
+            {"position": {"node_id": 1}, "edit": [{"from_length": 7, "to_length": 7}]}
+        ]}})", sequence_implied);
+        REQUIRE(!sequence_implied);
+        REQUIRE(compact.alignment().sequence() == "GATTACAA");
+    }
+
+    SECTION("paths with names are kept as they are") {
+        bool sequence_implied;
+        CompactAlignment compact = round_trip(R"({"sequence": "GATTACA", "path": {"name": "ref", "mapping": [
+            {"position": {"node_id": 1}, "edit": [{"from_length": 7, "to_length": 7}]}
+        ]}})", sequence_implied);
+        REQUIRE(!sequence_implied);
+        REQUIRE(compact.alignment().path().mapping_size() == 1);
+        REQUIRE(compact.node_step_size() == 0);
+    }
+
+    SECTION("unmapped reads visit node 0") {
+        bool sequence_implied;
+        CompactAlignment compact = round_trip(R"({"sequence": "GATTACA"})", sequence_implied);
+        REQUIRE(!sequence_implied);
+        vector<id_t> visited;
+        for_each_node_id(compact, [&](id_t id) {
+            visited.push_back(id);
+            return true;
+        });
+        REQUIRE(visited == vector<id_t>({0}));
+    }
+
+    SECTION("qualities can be binned") {
+        string quality{0, 5, 12, 23, 28, 31, 38, 41};
+        bin_qualities(quality);
+        REQUIRE(quality == string{0, 6, 15, 22, 27, 33, 37, 40});
+    }
+}
+
+TEST_CASE("CompactMultipathAlignments round-trip through the graph", "[gam][compact][multipath]") {
+
+    string graph_json = R"({
+        "node": [
+            {"id": 1, "sequence": "GATTACA"},
+            {"id": 2, "sequence": "C"},
+            {"id": 3, "sequence": "T"},
+            {"id": 4, "sequence": "CATTAG"}
+        ],
+        "edge": [
+            {"from": 1, "to": 2},
+            {"from": 1, "to": 3},
+            {"from": 2, "to": 4},
+            {"from": 3, "to": 4}
+        ]
+    })";
+
+    Graph proto_graph;
+    json2pb(proto_graph, graph_json.c_str(), graph_json.size());
+    xg::XG xg_index(proto_graph);
+
+    // Two ways through the bubble, one of them with a substitution
+    auto multipath_json = [](const string& substitution) {
+        return R"({"sequence": "GATTACACCAT", "name": "read", "start": [0], "subpath": [
+            {"path": {"mapping": [{"position": {"node_id": 1}, "edit": [{"from_length": 7, "to_length": 7}]}]}, "next": [1, 2]},
+            {"path": {"mapping": [{"position": {"node_id": 2}, "edit": [{"from_length": 1, "to_length": 1}]}]}, "next": [3]},
+            {"path": {"mapping": [{"position": {"node_id": 3}, "edit": [{"from_length": 1, "to_length": 1, "sequence": ")"
+            + substitution + R"("}]}]}, "next": [3]},
+            {"path": {"mapping": [{"position": {"node_id": 4}, "edit": [{"from_length": 3, "to_length": 3}]}]}}
+        ]})";
+    };
+
+    auto round_trip = [&](const string& json) -> CompactMultipathAlignment {
+        MultipathAlignment multipath_aln;
+        json2pb(multipath_aln, json.c_str(), json.size());
+        CompactMultipathAlignment compact = compact_multipath_alignment(multipath_aln, xg_index);
+        for (auto& subpath : compact.multipath_alignment().subpath()) {
+            REQUIRE(subpath.path().mapping_size() == 0);
+        }
+        REQUIRE(pb2json(expand_multipath_alignment(compact, xg_index)) == pb2json(multipath_aln));
+        return compact;
+    };
+
+    SECTION("edit sequences come from the read") {
+        CompactMultipathAlignment compact = round_trip(multipath_json("C"));
+        REQUIRE(compact.edit_sequences_from_read());
+        REQUIRE(compact.edit_sequence().empty());
+        REQUIRE(compact.mapping_count_size() == 4);
+        // The last subpath steps from the first subpath that leads into it
+        REQUIRE(compact.node_step(3) == 4);
+        REQUIRE(subpath_predecessors(compact.multipath_alignment()) == vector<int64_t>({-1, 0, 0, 1}));
+
+        vector<id_t> visited;
+        for_each_node_id(compact, [&](id_t id) {
+            visited.push_back(id);
+            return true;
+        });
+        REQUIRE(visited == vector<id_t>({1, 2, 3, 4}));
+    }
+
+    SECTION("edit sequences that aren't in the read are kept") {
+        CompactMultipathAlignment compact = round_trip(multipath_json("G"));
+        REQUIRE(!compact.edit_sequences_from_read());
+        REQUIRE(compact.edit_sequence() == "G");
+    }
+}
+
+}
+}
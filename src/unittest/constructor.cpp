@@ -10,6 +10,7 @@
 #include "../path.hpp"
 #include "../json2pb.h"
 
+#include <omp.h>
 #include <vector>
 #include <sstream>
 #include <iostream>
@@ -232,7 +233,7 @@ ConstructedChunk construct_test_chunk(string ref_sequence, string ref_name, stri
  * Testing wrapper to build a whole graph from a VCF string. Adds alt paths by default.
  */
 Graph construct_test_graph(string fasta_data, string vcf_data, size_t max_node_size,
-    bool do_svs) {
+    bool do_svs, size_t vars_per_chunk = 1024) {
     
     // Merge all the graphs we get into this graph
     Graph built;
@@ -275,6 +276,7 @@ Graph construct_test_graph(string fasta_data, string vcf_data, size_t max_node_s
     constructor.do_svs = do_svs;
     // Make sure we can test the node splitting behavior at reasonable sizes
     constructor.max_node_size = max_node_size;
+    constructor.vars_per_chunk = vars_per_chunk;
 
     // Construct the graph    
     constructor.construct_graph(fasta_pointers, vcf_pointers, ins_pointers, callback);
@@ -1267,6 +1269,42 @@ GATTACACATTAG
 
 }
 
+TEST_CASE( "Graph construction does not depend on the thread count", "[constructor]" ) {
+
+    auto vcf_data = R"(##fileformat=VCFv4.0
+##fileDate=20090805
+##source=myImputationProgramV3.1
+##reference=1000GenomesPilot-NCBI36
+##phasing=partial
+##FILTER=<ID=q10,Description="Quality below 10">
+##FILTER=<ID=s50,Description="Less than 50% of samples have data">
+##FORMAT=<ID=GT,Number=1,Type=String,Description="Genotype">
+#CHROM	POS	ID	REF	ALT	QUAL	FILTER	INFO	FORMAT
+ref1	3	.	T	G	29	PASS	.	GT
+ref1	8	rs1337	AC	A	29	PASS	.	GT
+ref1	12	.	A	AT	29	PASS	.	GT
+ref2	5	.	A	T	29	PASS	.	GT
+ref2	9	rs1338	A	G	29	PASS	.	GT
+)";
+
+    auto fasta_data = R"(>ref1
+GATTACACATTAGGATTACA
+>ref2
+GATTACACATTAG
+)";
+
+    int threads = get_thread_count();
+
+    // Put every variant in its own chunk, so there are chunks to share out
+    omp_set_num_threads(1);
+    auto serial = construct_test_graph(fasta_data, vcf_data, 50, false, 1);
+    omp_set_num_threads(4);
+    auto parallel = construct_test_graph(fasta_data, vcf_data, 50, false, 1);
+    omp_set_num_threads(threads);
+
+    REQUIRE(pb2json(serial) == pb2json(parallel));
+}
+
 TEST_CASE( "A deletion is represented properly" , "[constructor]") {
 
     auto vcf_data = R"(##fileformat=VCFv4.2
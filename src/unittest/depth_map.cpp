@@ -0,0 +1,81 @@
+/** \file
+ * unittest/depth_map.cpp: tests for the saturating read depth counters in srpe.hpp
+ */
+
+#include "catch.hpp"
+#include "../json2pb.h"
+#include "../srpe.hpp"
+
+namespace vg {
+namespace unittest {
+
+using namespace std;
+
+TEST_CASE("DepthMap counts read depth along nodes", "[srpe][depth]") {
+
+    VG graph;
+    Node* n1 = graph.create_node("ACGTACGT");
+    Node* n2 = graph.create_node("GG");
+    graph.create_edge(n1, n2);
+
+    // A read that matches two bases, deletes one, and matches two more on
+    // node 1, then matches the last base of node 2 on its reverse strand
+    const string path_json = R"(
+        {"mapping": [
+            {"position": {"node_id": 1, "offset": 1}, "edit": [
+                {"from_length": 2, "to_length": 2},
+                {"from_length": 1},
+                {"from_length": 2, "to_length": 2}
+            ]},
+            {"position": {"node_id": 2, "is_reverse": true}, "edit": [
+                {"from_length": 1, "to_length": 1}
+            ]}
+        ]}
+    )";
+    Path path;
+    json2pb(path, path_json.c_str(), path_json.size());
+
+    for (bool on_disk : {false, true}) {
+        DepthMap depth(&graph, on_disk);
+        REQUIRE(depth.size() == 10);
+
+        SECTION(string("covered bases are counted on the forward strand") + (on_disk ? " on disk" : "")) {
+            depth.fill_depth(path);
+            vector<int> expected{0, 1, 1, 0, 1, 1, 0, 0};
+            for (size_t i = 0; i < expected.size(); i++) {
+                REQUIRE(depth.get_depth(n1->id(), i) == expected[i]);
+            }
+            REQUIRE(depth.get_depth(n2->id(), 0) == 0);
+            REQUIRE(depth.get_depth(n2->id(), 1) == 1);
+        }
+
+        SECTION(string("counters saturate under parallel increments") + (on_disk ? " on disk" : "")) {
+#pragma omp parallel for
+            for (size_t i = 0; i < 1000; i++) {
+                depth.fill_depth(path);
+            }
+            REQUIRE(depth.get_depth(n1->id(), 1) == DepthMap::max_depth);
+            REQUIRE(depth.get_depth(n1->id(), 3) == 0);
+        }
+
+        SECTION(string("windowed queries average the depth") + (on_disk ? " on disk" : "")) {
+            depth.fill_depth(path);
+            depth.fill_depth(path);
+            REQUIRE(depth.mean_depth(n1->id(), 0, 4) == 1.0);
+            // The window is clipped to the node
+            REQUIRE(depth.mean_depth(n1->id(), 6, 10) == 0.0);
+            vector<double> windows = depth.window_depths(n1->id(), 3);
+            REQUIRE(windows.size() == 3);
+            REQUIRE(windows[0] == Approx(4.0 / 3));
+            REQUIRE(windows[1] == Approx(4.0 / 3));
+            REQUIRE(windows[2] == 0.0);
+        }
+
+        SECTION(string("nodes not in the graph are an error") + (on_disk ? " on disk" : "")) {
+            REQUIRE_THROWS(depth.get_depth(n2->id() + 1, 0));
+        }
+    }
+}
+
+}
+}
@@ -13,6 +13,8 @@
 #include <fstream>
 #include <random>
 #include <time.h> 
+#include <sstream>
+#include <omp.h>
 //#define print
 namespace vg {
 namespace unittest {
@@ -1965,6 +1967,94 @@ class TestDistanceIndex : public DistanceIndex {
         }
     } //end test case
 
+    TEST_CASE("Serialized distance index does not depend on thread count",
+              "[dist][serial]") {
+        for (int i = 0; i < 10; i++) {
+
+            VG graph = randomGraph(1000, 20, 100); 
+
+            CactusSnarlFinder bubble_finder(graph);
+            SnarlManager snarl_manager = bubble_finder.find_snarls(); 
+
+            int threads = omp_get_max_threads();
+
+            omp_set_num_threads(1);
+            DistanceIndex serialIndex (&graph, &snarl_manager);
+            stringstream serialOut;
+            serialIndex.serialize(serialOut);
+
+            omp_set_num_threads(4);
+            DistanceIndex parallelIndex (&graph, &snarl_manager);
+            stringstream parallelOut;
+            parallelIndex.serialize(parallelOut);
+
+            omp_set_num_threads(threads);
+
+            REQUIRE(serialOut.str() == parallelOut.str());
+        }
+    }
+
+    TEST_CASE("Distance index finds the snarls of positions", "[dist]") {
+        VG graph;
+
+        Node* n1 = graph.create_node("GCA");
+        Node* n2 = graph.create_node("T");
+        Node* n3 = graph.create_node("G");
+        Node* n4 = graph.create_node("CTGA");
+        Node* n5 = graph.create_node("GCA");
+        Node* n6 = graph.create_node("T");
+        Node* n7 = graph.create_node("G");
+        Node* n8 = graph.create_node("CTGA");
+
+        Edge* e1 = graph.create_edge(n1, n2);
+        Edge* e2 = graph.create_edge(n1, n8);
+        Edge* e3 = graph.create_edge(n2, n3);
+        Edge* e4 = graph.create_edge(n2, n6);
+        Edge* e5 = graph.create_edge(n3, n4);
+        Edge* e6 = graph.create_edge(n3, n5);
+        Edge* e7 = graph.create_edge(n4, n5);
+        Edge* e8 = graph.create_edge(n5, n7);
+        Edge* e9 = graph.create_edge(n6, n7);
+        Edge* e10 = graph.create_edge(n7, n8);
+
+        CactusSnarlFinder bubble_finder(graph);
+        SnarlManager snarl_manager = bubble_finder.find_snarls(); 
+        TestDistanceIndex di (&graph, &snarl_manager);
+
+        const Snarl* snarl1 = snarl_manager.into_which_snarl(1, false);
+        const Snarl* snarl2 = snarl_manager.into_which_snarl(2, false);
+        const Snarl* snarl3 = snarl_manager.into_which_snarl(3, false);
+
+        SECTION("Nodes map to the deepest snarl containing them") {
+            REQUIRE(di.snarlOf(1) == snarl1);
+            REQUIRE(di.snarlOf(2) == snarl2);
+            REQUIRE(di.snarlOf(6) == snarl2);
+            REQUIRE(di.snarlOf(4) == snarl3);
+            REQUIRE(di.snarlOf(100) == NULL);
+        }
+
+        SECTION("Distances between positions match distances given snarls") {
+            pos_t pos1 = make_pos_t(4, false, 1);
+            pos_t pos2 = make_pos_t(5, false, 2);
+            pos_t pos5 = make_pos_t(2, false, 0);
+            pos_t pos7 = make_pos_t(1, true, 1);
+            pos_t pos8 = make_pos_t(8, true, 1);
+            pos_t pos9 = make_pos_t(6, true, 0);
+
+            DistanceIndex::AncestorMemo memo;
+            for (int i = 0; i < 2; i++) {
+                //Second time through, the ancestors come from the memo
+                REQUIRE(di.distance(pos1, pos2, &memo) == 6);
+                REQUIRE(di.distance(pos5, pos2, &memo) == 5);
+                REQUIRE(di.distance(pos2, pos5, &memo) == 5);
+                REQUIRE(di.distance(pos7, pos8, &memo) == 5);
+                REQUIRE(di.distance(pos1, pos9, &memo) == -1);
+            }
+            REQUIRE(memo.count(snarl3));
+            REQUIRE(di.distance(pos5, pos2) == 5);
+        }
+    }
+
 }
 
 }
@@ -0,0 +1,66 @@
+/// \file duplicate_read_cache.cpp
+///
+/// Unit tests for the DuplicateReadCache, which shares alignments between reads with the same sequence
+
+#include <iostream>
+#include "vg.pb.h"
+#include "../duplicate_read_cache.hpp"
+#include "catch.hpp"
+
+namespace vg {
+namespace unittest {
+
+TEST_CASE( "DuplicateReadCache shares alignments between duplicate reads", "[mapping][cache]" ) {
+
+    DuplicateReadCache cache(16);
+
+    Alignment read1;
+    read1.set_name("read1");
+    read1.set_sequence("GATTACA");
+    read1.set_quality("IIIIIII");
+
+    // Pretend it mapped to two places
+    vector<Alignment> mapped(2, read1);
+    mapped[0].set_score(7);
+    mapped[1].set_score(5);
+    mapped[1].set_is_secondary(true);
+    mapped[0].set_time_used(100);
+
+    string parameters = "defaults";
+    cache.put(read1, parameters, mapped);
+
+    SECTION( "a duplicate gets the alignments under its own name and read group" ) {
+        Alignment read2 = read1;
+        read2.set_name("read2");
+        read2.set_read_group("rg2");
+        read2.mutable_fragment_next()->set_name("read2_mate");
+
+        vector<Alignment> found;
+        REQUIRE(cache.retrieve(read2, parameters, found));
+        REQUIRE(found.size() == 2);
+        REQUIRE(found[0].score() == 7);
+        REQUIRE(found[1].is_secondary());
+        for (auto& aln : found) {
+            REQUIRE(aln.name() == "read2");
+            REQUIRE(aln.read_group() == "rg2");
+            REQUIRE(aln.fragment_next().name() == "read2_mate");
+            REQUIRE(!aln.has_fragment_prev());
+            REQUIRE(aln.time_used() == 0);
+        }
+        REQUIRE(cache.hits() == 1);
+    }
+
+    SECTION( "reads with other qualities or parameters are not duplicates" ) {
+        Alignment read2 = read1;
+        read2.set_quality("IIIII#I");
+        vector<Alignment> found;
+        REQUIRE(!cache.retrieve(read2, parameters, found));
+        REQUIRE(!cache.retrieve(read1, "other", found));
+        REQUIRE(found.empty());
+        REQUIRE(cache.misses() == 2);
+        REQUIRE(cache.size() == 1);
+    }
+}
+
+}
+}
@@ -0,0 +1,65 @@
+/// \file entropy.cpp
+///
+/// Unit tests for sequence entropy and low-complexity masking
+
+#include <string>
+#include <vector>
+#include "../entropy.hpp"
+#include "catch.hpp"
+
+namespace vg {
+namespace unittest {
+
+using namespace std;
+
+TEST_CASE( "Entropy is computed in bits over the characters", "[entropy]" ) {
+    REQUIRE(entropy("AAAA") == 0.0);
+    REQUIRE(entropy("ACGT") == Approx(2.0));
+    REQUIRE(entropy("AACC") == Approx(1.0));
+}
+
+TEST_CASE( "LowComplexityMasker masks homopolymers and short tandem repeats", "[entropy]" ) {
+    
+    LowComplexityMasker masker(16, 1.0, 2.0);
+    
+    // A de Bruijn-like sequence with no low-complexity windows
+    string complex_seq = "AACAGATCCGCTGGTTACGACTAGCATGTCTTGAGGAAT";
+    string homopolymer(20, 'A');
+    string repeat = "CACACACACACACACACACA";
+    
+    SECTION( "complex sequence is not masked" ) {
+        REQUIRE(masker.masked_length(complex_seq.c_str(), complex_seq.size()) == 0);
+    }
+    
+    SECTION( "a homopolymer run is masked" ) {
+        string seq = complex_seq + homopolymer + complex_seq;
+        vector<bool> mask = masker.mask(seq);
+        for (size_t i = complex_seq.size(); i < complex_seq.size() + homopolymer.size(); i++) {
+            REQUIRE(mask[i]);
+        }
+        REQUIRE(!mask.front());
+        REQUIRE(!mask.back());
+    }
+    
+    SECTION( "a dinucleotide repeat is masked even though it has two bases" ) {
+        string seq = complex_seq + repeat + complex_seq;
+        vector<bool> mask = masker.mask(seq);
+        for (size_t i = complex_seq.size(); i < complex_seq.size() + repeat.size(); i++) {
+            REQUIRE(mask[i]);
+        }
+        size_t count = 0;
+        for (bool masked : mask) {
+            count += masked;
+        }
+        REQUIRE(masker.masked_length(seq.c_str(), seq.size()) == count);
+    }
+    
+    SECTION( "short sequences are scored as one window" ) {
+        REQUIRE(masker.masked_length("AAAAAAAA", 8) == 8);
+        REQUIRE(masker.masked_length("ACGTTGCA", 8) == 0);
+        REQUIRE(masker.masked_length("A", 1) == 0);
+    }
+}
+
+}
+}
@@ -0,0 +1,121 @@
+/// \file fast_json.cpp
+///
+/// Unit tests for the specialized JSON codec behind pb2json() and json2pb()
+
+#include <cmath>
+#include <string>
+#include <google/protobuf/util/json_util.h>
+#include "vg.pb.h"
+#include "../fast_json.hpp"
+#include "catch.hpp"
+
+namespace vg {
+namespace unittest {
+
+using namespace std;
+
+/// Get the JSON Protobuf's reflection-based printer would produce
+static string reflection_json(const google::protobuf::Message& msg) {
+    google::protobuf::util::JsonPrintOptions opts;
+    opts.preserve_proto_field_names = true;
+    string json;
+    google::protobuf::util::MessageToJsonString(msg, &json, opts);
+    return json;
+}
+
+TEST_CASE( "Fast JSON encoding matches Protobuf's", "[json]" ) {
+
+    SECTION( "an alignment with a path, special values, and escapes round trips" ) {
+        Alignment aln;
+        aln.set_sequence("GATTACA");
+        aln.set_name("read\t\"1\"<\x01>");
+        aln.set_quality(string("\x00\x10\x28\x3f", 4));
+        aln.set_mapping_quality(60);
+        aln.set_score(-3);
+        aln.set_identity(0.1);
+        aln.set_uniqueness(-0.0);
+        aln.set_haplotype_logprob(-INFINITY);
+        aln.add_secondary_score(5);
+        aln.add_secondary_score(0);
+        aln.set_read_paired(true);
+        Mapping* m = aln.mutable_path()->add_mapping();
+        m->mutable_position()->set_node_id(9007199254740993);
+        m->mutable_position()->set_is_reverse(true);
+        m->set_rank(1);
+        Edit* e = m->add_edit();
+        e->set_from_length(3);
+        e->set_to_length(3);
+        e = m->add_edit();
+        e->set_to_length(4);
+        e->set_sequence("ACGT");
+        aln.mutable_fragment_prev()->set_name("mate");
+
+        string fast;
+        REQUIRE(fast_json::encode(aln, fast));
+        REQUIRE(fast == reflection_json(aln));
+
+        // Protobuf reads "-0" back as positive zero, and so must we
+        Alignment decoded;
+        REQUIRE(fast_json::decode(fast.c_str(), fast.size(), decoded));
+        Alignment reflected;
+        REQUIRE(google::protobuf::util::JsonStringToMessage(fast, &reflected).ok());
+        REQUIRE(decoded.SerializeAsString() == reflected.SerializeAsString());
+        REQUIRE(!std::signbit(decoded.uniqueness()));
+        REQUIRE(decoded.path().mapping(0).position().node_id() == 9007199254740993);
+    }
+
+    SECTION( "a graph round trips" ) {
+        Graph graph;
+        Node* n = graph.add_node();
+        n->set_id(1);
+        n->set_sequence("GATT");
+        n = graph.add_node();
+        n->set_id(2);
+        n->set_sequence("A");
+        n->set_name("second");
+        Edge* e = graph.add_edge();
+        e->set_from(1);
+        e->set_to(2);
+        e->set_to_end(true);
+        Path* p = graph.add_path();
+        p->set_name("x");
+        p->add_mapping()->mutable_position()->set_node_id(1);
+
+        string fast;
+        REQUIRE(fast_json::encode(graph, fast));
+        REQUIRE(fast == reflection_json(graph));
+
+        Graph decoded;
+        REQUIRE(fast_json::decode(fast.c_str(), fast.size(), decoded));
+        REQUIRE(decoded.SerializeAsString() == graph.SerializeAsString());
+    }
+
+    SECTION( "whitespace is accepted but unusual JSON is left to Protobuf" ) {
+        string spaced = " { \"sequence\" : \"AC\" ,\n \"score\" : 4 } ";
+        Alignment decoded;
+        REQUIRE(fast_json::decode(spaced.c_str(), spaced.size(), decoded));
+        REQUIRE(decoded.sequence() == "AC");
+        REQUIRE(decoded.score() == 4);
+
+        for (string odd : {"{\"mappingQuality\": 2}", "{\"name\": null}", "{\"name\": \"\\u00e9\"}"}) {
+            Alignment other;
+            REQUIRE(!fast_json::decode(odd.c_str(), odd.size(), other));
+        }
+
+        Alignment non_ascii;
+        non_ascii.set_name("caf\xc3\xa9");
+        string out;
+        REQUIRE(!fast_json::encode(non_ascii, out));
+        REQUIRE(out.empty());
+    }
+
+    SECTION( "other message types are left to Protobuf" ) {
+        Locus locus;
+        locus.set_name("l");
+        string out;
+        REQUIRE(!fast_json::encode(locus, out));
+    }
+}
+
+}
+}
@@ -263,6 +263,44 @@ TEST_CASE("Complete deletions remove the feature", "[featureset][simplify]") {
 
 }
 
+TEST_CASE("FeatureSet can find overlapping features", "[featureset][simplify]") {
+
+    // Make a BED stream with some nested and disjoint features
+    stringstream in("seq1\t5\t10\tfirst\n"
+                    "seq1\t0\t100\tbig\n"
+                    "seq1\t20\t30\tsecond\n"
+                    "seq2\t5\t10\tother\n");
+    
+    FeatureSet features;
+    features.load_bed(in);
+    
+    // Get the names of the features overlapping a range
+    auto names_at = [&](const string& path, size_t first, size_t last) {
+        vector<string> names;
+        for (auto* feature : features.find_overlapping(path, first, last)) {
+            names.push_back(feature->feature_name);
+        }
+        return names;
+    };
+    
+    REQUIRE((names_at("seq1", 10, 19) == vector<string>{"big", "first"}));
+    REQUIRE((names_at("seq1", 11, 19) == vector<string>{"big"}));
+    REQUIRE((names_at("seq1", 8, 25) == vector<string>{"big", "first", "second"}));
+    REQUIRE(names_at("seq1", 101, 200).empty());
+    REQUIRE(names_at("seq2", 0, 4).empty());
+    REQUIRE((names_at("seq2", 0, 5) == vector<string>{"other"}));
+    REQUIRE(names_at("seq3", 0, 5).empty());
+    
+    SECTION("Overlaps follow edits to the path") {
+        // Delete the first feature and shift the second one left
+        features.on_path_edit("seq1", 5, 10, 0);
+        
+        REQUIRE((names_at("seq1", 5, 9) == vector<string>{"big"}));
+        REQUIRE((names_at("seq1", 10, 10) == vector<string>{"big", "second"}));
+    }
+
+}
+
 }
 }
 
@@ -0,0 +1,133 @@
+/// \file flat_hash_map.cpp
+///
+/// Unit tests for the open addressing hash map behind the hot hash maps
+
+#include "../hash_map.hpp"
+#include "../handle.hpp"
+
+#include "catch.hpp"
+
+#include <map>
+#include <random>
+#include <string>
+
+namespace vg {
+namespace unittest {
+using namespace std;
+
+TEST_CASE("flat_hash_map stores, finds, and erases entries", "[hash]") {
+
+    flat_hash_map<int64_t, string, wang_hash<int64_t>> table;
+
+    SECTION("an empty map finds nothing") {
+        REQUIRE(table.empty());
+        REQUIRE(table.find(1) == table.end());
+        REQUIRE(table.count(1) == 0);
+        REQUIRE(table.begin() == table.end());
+        REQUIRE(table.erase(1) == 0);
+    }
+
+    SECTION("inserted entries can be found and are not replaced") {
+        REQUIRE(table.insert(make_pair(1, string("GATTACA"))).second);
+        REQUIRE(!table.insert(make_pair(1, string("CATTAG"))).second);
+        table[2] = "TAG";
+        REQUIRE(table.size() == 2);
+        REQUIRE(table.at(1) == "GATTACA");
+        REQUIRE(table.find(2)->second == "TAG");
+        REQUIRE_THROWS(table.at(3));
+    }
+
+    SECTION("entries survive growing the map") {
+        for (int64_t i = 0; i < 10000; i++) {
+            table[i * 7] = to_string(i);
+        }
+        REQUIRE(table.size() == 10000);
+        for (int64_t i = 0; i < 10000; i++) {
+            REQUIRE(table.at(i * 7) == to_string(i));
+            REQUIRE(table.count(i * 7 + 1) == 0);
+        }
+    }
+
+    SECTION("erasing while iterating visits and removes every entry once") {
+        for (int64_t i = 0; i < 1000; i++) {
+            table[i] = to_string(i);
+        }
+        size_t visited = 0;
+        for (auto it = table.begin(); it != table.end();) {
+            visited++;
+            it = it->first % 2 ? table.erase(it) : ++it;
+        }
+        REQUIRE(visited == 1000);
+        REQUIRE(table.size() == 500);
+        for (auto& entry : table) {
+            REQUIRE(entry.first % 2 == 0);
+        }
+    }
+
+    SECTION("cleared maps can be reused") {
+        for (int64_t i = 0; i < 100; i++) {
+            table[i] = "A";
+        }
+        size_t slots = table.bucket_count();
+        table.clear_no_resize();
+        REQUIRE(table.empty());
+        REQUIRE(table.bucket_count() == slots);
+        REQUIRE(table.count(5) == 0);
+        table[5] = "C";
+        table.clear();
+        REQUIRE(table.empty());
+        REQUIRE(table.bucket_count() == 0);
+        table[6] = "G";
+        REQUIRE(table.at(6) == "G");
+    }
+}
+
+TEST_CASE("flat_hash_map agrees with std::map under random operations", "[hash]") {
+
+    flat_hash_map<int64_t, int64_t, wang_hash<int64_t>> table;
+    map<int64_t, int64_t> truth;
+
+    // Churn through a small key space, so tombstones pile up and get reused
+    default_random_engine generator(12345);
+    uniform_int_distribution<int64_t> key_distribution(0, 500);
+    uniform_int_distribution<int> operation_distribution(0, 2);
+    for (size_t i = 0; i < 100000; i++) {
+        int64_t key = key_distribution(generator);
+        switch (operation_distribution(generator)) {
+        case 0:
+            table[key] = i;
+            truth[key] = i;
+            break;
+        case 1:
+            REQUIRE(table.erase(key) == truth.erase(key));
+            break;
+        default:
+            REQUIRE(table.count(key) == truth.count(key));
+            break;
+        }
+    }
+
+    REQUIRE(table.size() == truth.size());
+    REQUIRE(table.bucket_count() <= 2048);
+    map<int64_t, int64_t> contents(table.begin(), table.end());
+    REQUIRE(contents == truth);
+}
+
+TEST_CASE("hot hash maps work with handle and pair keys", "[hash]") {
+
+    hot_hash_map<handle_t, size_t> by_handle;
+    hot_hash_map<pair<int64_t, bool>, size_t> by_pair;
+    for (int64_t i = 0; i < 100; i++) {
+        by_handle[as_handle(i)] = i;
+        by_pair[make_pair(i / 2, (bool) (i % 2))] = i;
+    }
+    REQUIRE(by_handle.size() == 100);
+    REQUIRE(by_pair.size() == 100);
+    for (int64_t i = 0; i < 100; i++) {
+        REQUIRE(by_handle.at(as_handle(i)) == i);
+        REQUIRE(by_pair.at(make_pair(i / 2, (bool) (i % 2))) == i);
+    }
+}
+
+}
+}
@@ -0,0 +1,150 @@
+/// \file gam_columns.cpp
+///
+/// Unit tests for the AlignmentColumns sidecar format
+
+#include "../gam_columns.hpp"
+#include "../stream.hpp"
+
+#include "catch.hpp"
+
+#include <sstream>
+
+namespace vg {
+namespace unittest {
+using namespace std;
+
+/// Make an Alignment with a given name and score, and some refpos entries
+static Alignment make_columns_test_alignment(const string& name, int32_t score, size_t refpos_count) {
+    Alignment aln;
+    aln.set_name(name);
+    aln.set_sequence("GATTACA");
+    aln.set_score(score);
+    aln.set_mapping_quality(score / 2);
+    aln.set_identity(0.5);
+    aln.set_is_secondary(score % 2);
+    aln.set_correctly_mapped(!aln.is_secondary());
+    for (size_t i = 0; i < refpos_count; i++) {
+        Position* refpos = aln.add_refpos();
+        refpos->set_name("chr" + to_string(i));
+        refpos->set_offset(100 * score + i);
+        refpos->set_is_reverse(i % 2);
+    }
+    // Something that isn't kept
+    aln.mutable_path()->add_mapping()->mutable_position()->set_node_id(1);
+    return aln;
+}
+
+TEST_CASE("AlignmentColumns hold the scanned fields of each Alignment", "[alignment][columns]") {
+
+    vector<Alignment> group {
+        make_columns_test_alignment("read1", 10, 2),
+        make_columns_test_alignment("read2", 7, 0),
+        make_columns_test_alignment("read3", 4, 1)
+    };
+    AlignmentColumns columns = make_columns(group, 1234);
+
+    SECTION("rows come back out in order") {
+        REQUIRE(columns.virtual_offset() == 1234);
+        REQUIRE(row_count(columns) == 3);
+
+        vector<AlignmentRow> rows;
+        for_each_row(columns, [&](const AlignmentRow& row) {
+            rows.push_back(row);
+        });
+        REQUIRE(rows.size() == group.size());
+        for (size_t i = 0; i < rows.size(); i++) {
+            REQUIRE(rows[i].name == group[i].name());
+            REQUIRE(rows[i].score == group[i].score());
+            REQUIRE(rows[i].mapping_quality == group[i].mapping_quality());
+            REQUIRE(rows[i].identity == group[i].identity());
+            REQUIRE(rows[i].is_secondary == group[i].is_secondary());
+            REQUIRE(rows[i].correctly_mapped == group[i].correctly_mapped());
+            REQUIRE(rows[i].sequence_length == 7);
+            REQUIRE(rows[i].refpos.size() == group[i].refpos_size());
+            for (size_t j = 0; j < rows[i].refpos.size(); j++) {
+                REQUIRE(rows[i].refpos[j].name() == group[i].refpos(j).name());
+                REQUIRE(rows[i].refpos[j].offset() == group[i].refpos(j).offset());
+                REQUIRE(rows[i].refpos[j].is_reverse() == group[i].refpos(j).is_reverse());
+            }
+        }
+    }
+
+    SECTION("columns made from serialized Alignments are the same") {
+        AlignmentColumns from_views;
+        from_views.set_virtual_offset(1234);
+        for (auto& aln : group) {
+            string serialized;
+            aln.SerializeToString(&serialized);
+            append_row(from_views, AlignmentView(serialized));
+        }
+        string expected;
+        string observed;
+        columns.SerializeToString(&expected);
+        from_views.SerializeToString(&observed);
+        REQUIRE(observed == expected);
+    }
+
+    SECTION("columns of different lengths are rejected") {
+        columns.add_score(5);
+        REQUIRE_THROWS(row_count(columns));
+    }
+
+    SECTION("refpos that don't match their counts are rejected") {
+        columns.set_refpos_count(1, 1);
+        REQUIRE_THROWS(row_count(columns));
+    }
+}
+
+TEST_CASE("GAMColumnWriter writes one block per GAM group", "[alignment][columns]") {
+
+    stringstream gam;
+    stringstream sidecar;
+    {
+        GAMColumnWriter writer(sidecar);
+        stream::ProtobufEmitter<Alignment> emitter(gam, 2);
+        emitter.on_group([&](const vector<Alignment>& group, int64_t start_vo, int64_t end_vo) {
+            writer.write_group(group, start_vo);
+        });
+        for (size_t i = 0; i < 5; i++) {
+            emitter.write(make_columns_test_alignment("read" + to_string(i), i, 1));
+        }
+        // The emitter goes first, so the last group is written before the
+        // writer finishes.
+    }
+
+    // Find where each read's group starts in the GAM
+    vector<int64_t> gam_offsets;
+    function<void(int64_t, Alignment&)> record_offset = [&](int64_t virtual_offset, Alignment& aln) {
+        gam_offsets.push_back(virtual_offset);
+    };
+    stream::for_each(gam, record_offset);
+    REQUIRE(gam_offsets.size() == 5);
+
+    vector<AlignmentColumns> blocks;
+    function<void(AlignmentColumns&)> record_block = [&](AlignmentColumns& columns) {
+        blocks.push_back(columns);
+    };
+    stream::for_each(sidecar, record_block);
+
+    REQUIRE(blocks.size() == 3);
+    REQUIRE(row_count(blocks[0]) == 2);
+    REQUIRE(row_count(blocks[1]) == 2);
+    REQUIRE(row_count(blocks[2]) == 1);
+    REQUIRE(blocks[0].virtual_offset() == gam_offsets[0]);
+    REQUIRE(blocks[1].virtual_offset() == gam_offsets[2]);
+    REQUIRE(blocks[2].virtual_offset() == gam_offsets[4]);
+
+    // And the rows can be read straight from the stream
+    sidecar.clear();
+    sidecar.seekg(0);
+    vector<string> names;
+    for_each_row(sidecar, [&](const AlignmentRow& row) {
+        names.push_back(row.name);
+        REQUIRE(row.refpos.size() == 1);
+    });
+    vector<string> expected_names {"read0", "read1", "read2", "read3", "read4"};
+    REQUIRE(names == expected_names);
+}
+
+}
+}
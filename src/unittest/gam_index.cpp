@@ -5,6 +5,7 @@
 ///
 
 #include <iostream>
+#include <list>
 #include "catch.hpp"
 #include "../gam_index.hpp"
 #include "../utility.hpp"
@@ -297,6 +298,84 @@ TEST_CASE("GAMIndex can work with ProtobufIterator cursors", "[gam][gamindex]")
     
     REQUIRE(recovered == total_found);
     
+    // Ranges close enough together get looked up as one, but only reads on
+    // the nodes actually asked for come back.
+    vector<pair<id_t, id_t>> sparse;
+    for (id_t node = 3; node < next_id; node += 7) {
+        sparse.emplace_back(node, node + 1);
+    }
+    vector<id_t> seen;
+    index.find(cursor, sparse, [&](const Alignment& found) {
+        seen.push_back(found.path().mapping(0).position().node_id());
+    });
+    REQUIRE(seen.size() == 2 * sparse.size());
+    for (size_t i = 0; i < seen.size(); i++) {
+        REQUIRE(seen[i] == sparse[i / 2].first + i % 2);
+    }
+    
+}
+
+TEST_CASE("GAMIndex can answer many queries at once", "[gam][gamindex]") {
+    stringstream file;
+    
+    // Make reads that each visit two adjacent nodes, in sorted order
+    vector<Alignment> group;
+    for (id_t start = 1; start <= 1000; start++) {
+        group.emplace_back();
+        for (id_t node_id = start; node_id <= start + 1; node_id++) {
+            auto* mapping = group.back().mutable_path()->add_mapping();
+            mapping->mutable_position()->set_node_id(node_id);
+        }
+        if (group.size() == 50) {
+            stream::write_buffered(file, group, 0);
+            group.clear();
+        }
+    }
+    
+    GAMIndex index;
+    {
+        GAMIndex::cursor_t cursor(file);
+        index.index(cursor);
+    }
+    
+    // Each cursor needs its own stream
+    list<stringstream> streams;
+    vector<GAMIndex::cursor_t> cursors;
+    cursors.reserve(4);
+    for (size_t i = 0; i < 4; i++) {
+        streams.emplace_back(file.str());
+        cursors.emplace_back(streams.back());
+    }
+    
+    // Make overlapping queries, including some with more than one range.
+    vector<vector<pair<id_t, id_t>>> queries {
+        {{10, 20}},
+        {{15, 25}},
+        {{15, 25}, {500, 510}},
+        {{990, 2000}}
+    };
+    
+    for (bool contained : {false, true}) {
+        // Find the answers one query at a time
+        vector<multiset<id_t>> expected(queries.size());
+        GAMIndex::cursor_t& cursor = cursors.front();
+        for (size_t i = 0; i < queries.size(); i++) {
+            index.find(cursor, queries[i], [&](const Alignment& found) {
+                expected[i].insert(found.path().mapping(0).position().node_id());
+            }, contained);
+        }
+        
+        // And all together
+        vector<multiset<id_t>> batched(queries.size());
+        index.find(cursors, queries, [&](size_t query, const Alignment& found) {
+            batched[query].insert(found.path().mapping(0).position().node_id());
+        }, contained);
+        
+        for (size_t i = 0; i < queries.size(); i++) {
+            REQUIRE(!expected[i].empty());
+            REQUIRE(batched[i] == expected[i]);
+        }
+    }
 }
 
 
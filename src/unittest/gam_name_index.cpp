@@ -0,0 +1,168 @@
+/// \file gam_name_index.cpp
+///
+/// Unit tests for the GAMNameIndex, which finds reads in seekable GAM files by name
+///
+
+#include "catch.hpp"
+#include "../gam_name_index.hpp"
+#include "../stream.hpp"
+
+#include <algorithm>
+#include <sstream>
+
+namespace vg {
+namespace unittest {
+
+using namespace std;
+
+TEST_CASE("GAMNameIndex knows about mate suffixes", "[gam][gamnameindex]") {
+    REQUIRE(GAMNameIndex::fragment_name("read1/1") == "read1");
+    REQUIRE(GAMNameIndex::fragment_name("read1/2") == "read1");
+    REQUIRE(GAMNameIndex::fragment_name("read1/3") == "read1/3");
+    REQUIRE(GAMNameIndex::fragment_name("read1") == "read1");
+    REQUIRE(GAMNameIndex::fragment_name("/1") == "");
+    REQUIRE(GAMNameIndex::fragment_name("1") == "1");
+
+    // The hash gets saved, so it can't change
+    REQUIRE(GAMNameIndex::hash_name("") == 0xcbf29ce484222325ULL);
+    REQUIRE(GAMNameIndex::hash_name("a") == 0xaf63dc4c8601ec8cULL);
+}
+
+TEST_CASE("GAMNameIndex can find reads and their mates in a GAM", "[gam][gamnameindex]") {
+    // Write a GAM where the two mates of each pair are far apart
+    stringstream file;
+    GAMNameIndex built;
+    vector<pair<vector<stream::RawMessage>, int64_t>> raw_groups;
+    {
+        stream::ProtobufEmitter<Alignment> emitter(file, 10);
+        emitter.on_group([&](const vector<Alignment>& group, int64_t start_vo, int64_t past_end_vo) {
+            built.add_group(group, start_vo, past_end_vo);
+
+            // Keep the serialized reads too
+            raw_groups.emplace_back(vector<stream::RawMessage>(), start_vo);
+            for (auto& aln : group) {
+                raw_groups.back().first.emplace_back();
+                aln.SerializeToString(&raw_groups.back().first.back().data);
+            }
+        });
+        for (size_t mate : {1, 2}) {
+            for (size_t i = 0; i < 100; i++) {
+                Alignment aln;
+                aln.set_name("read" + to_string(i) + "/" + to_string(mate));
+                aln.set_sequence(mate == 1 ? "GATTACA" : "TGTAATC");
+                emitter.write(std::move(aln));
+            }
+        }
+        // And some unpaired reads, one of which is there twice
+        for (string name : {"single", "single", "other"}) {
+            Alignment aln;
+            aln.set_name(name);
+            emitter.write(std::move(aln));
+        }
+    }
+    built.finish();
+
+    // Each read's group has an entry, with mates in different groups
+    REQUIRE(built.size() == 202);
+
+    GAMNameIndex::cursor_t cursor(file);
+
+    SECTION("indexing the file gets the same index") {
+        GAMNameIndex indexed;
+        indexed.index(cursor);
+        REQUIRE(indexed.size() == built.size());
+        for (size_t i = 0; i < 100; i++) {
+            REQUIRE(indexed.find("read" + to_string(i)) == built.find("read" + to_string(i)));
+        }
+    }
+
+    SECTION("indexing serialized reads gets the same index") {
+        GAMNameIndex raw;
+        for (auto& group : raw_groups) {
+            raw.add_group(group.first, group.second, 0);
+        }
+        raw.finish();
+        REQUIRE(raw.size() == built.size());
+        for (size_t i = 0; i < 100; i++) {
+            REQUIRE(raw.find("read" + to_string(i) + "/2") == built.find("read" + to_string(i)));
+        }
+    }
+
+    SECTION("names can be looked up with and without mates") {
+        vector<string> found;
+        built.find(cursor, "read7/2", [&](const Alignment& aln) {
+            found.push_back(aln.name());
+            REQUIRE(aln.sequence() == "TGTAATC");
+        });
+        REQUIRE(found == vector<string>{"read7/2"});
+
+        found.clear();
+        built.find(cursor, "read7/2", [&](const Alignment& aln) {
+            found.push_back(aln.name());
+        }, true);
+        REQUIRE(found == (vector<string>{"read7/1", "read7/2"}));
+
+        found.clear();
+        built.find(cursor, "single", [&](const Alignment& aln) {
+            found.push_back(aln.name());
+        });
+        REQUIRE(found == (vector<string>{"single", "single"}));
+
+        found.clear();
+        built.find(cursor, "missing", [&](const Alignment& aln) {
+            found.push_back(aln.name());
+        });
+        REQUIRE(found.empty());
+    }
+
+    SECTION("many names can be looked up at once") {
+        vector<string> names {"read99/1", "other", "read3", "read50/2", "nope", "read3/1"};
+        vector<vector<string>> found(names.size());
+        built.find(cursor, names, [&](size_t query, const Alignment& aln) {
+            found.at(query).push_back(aln.name());
+        }, true);
+        REQUIRE(found[0] == (vector<string>{"read99/1", "read99/2"}));
+        REQUIRE(found[1] == vector<string>{"other"});
+        REQUIRE(found[2] == (vector<string>{"read3/1", "read3/2"}));
+        REQUIRE(found[3] == (vector<string>{"read50/1", "read50/2"}));
+        REQUIRE(found[4].empty());
+        REQUIRE(found[5] == found[2]);
+
+        // Without mates, only exact names match
+        for (auto& result : found) {
+            result.clear();
+        }
+        built.find(cursor, names, [&](size_t query, const Alignment& aln) {
+            found.at(query).push_back(aln.name());
+        });
+        REQUIRE(found[0] == vector<string>{"read99/1"});
+        REQUIRE(found[2].empty());
+        REQUIRE(found[5] == vector<string>{"read3/1"});
+    }
+
+    SECTION("the index survives serialization") {
+        stringstream index_data;
+        built.save(index_data);
+
+        GAMNameIndex loaded;
+        loaded.load(index_data);
+        REQUIRE(loaded.size() == built.size());
+
+        vector<string> found;
+        loaded.find(cursor, "read42", [&](const Alignment& aln) {
+            found.push_back(aln.name());
+        }, true);
+        REQUIRE(found == (vector<string>{"read42/1", "read42/2"}));
+
+        // Something that isn't an index is rejected
+        stringstream not_an_index;
+        {
+            stream::ProtobufEmitter<Alignment> emitter(not_an_index);
+            emitter.write(Alignment());
+        }
+        REQUIRE_THROWS(loaded.load(not_an_index));
+    }
+}
+
+}
+}
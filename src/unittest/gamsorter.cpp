@@ -0,0 +1,61 @@
+/// \file gamsorter.cpp
+///
+/// Unit tests for the GAMSorter
+
+#include "../gamsorter.hpp"
+#include "../position.hpp"
+
+#include "catch.hpp"
+
+#include <string>
+
+namespace vg {
+namespace unittest {
+using namespace std;
+
+TEST_CASE("GAMSorter can read sort keys from serialized Alignments", "[gamsort]") {
+
+    GAMSorter sorter;
+
+    SECTION("an unmapped read gets the default key") {
+        Alignment aln;
+        aln.set_sequence("GATTACA");
+        string serialized;
+        aln.SerializeToString(&serialized);
+        
+        auto key = sorter.get_key_and_max_id(serialized);
+        REQUIRE(id(key.first) == 0);
+        REQUIRE(key.second == 0);
+    }
+
+    SECTION("a mapped read gets the same key as get_min_position") {
+        Alignment aln;
+        aln.set_sequence("GATTACA");
+        aln.set_name("read");
+        aln.set_score(7);
+        
+        Mapping* mapping = aln.mutable_path()->add_mapping();
+        mapping->mutable_position()->set_node_id(7);
+        mapping->mutable_position()->set_offset(3);
+        mapping->add_edit()->set_sequence("AA");
+        
+        mapping = aln.mutable_path()->add_mapping();
+        mapping->mutable_position()->set_node_id(5);
+        mapping->mutable_position()->set_offset(2);
+        mapping->mutable_position()->set_is_reverse(true);
+        mapping->set_rank(2);
+        
+        mapping = aln.mutable_path()->add_mapping();
+        mapping->mutable_position()->set_node_id(9);
+        
+        string serialized;
+        aln.SerializeToString(&serialized);
+        
+        auto key = sorter.get_key_and_max_id(serialized);
+        REQUIRE(key.first == make_pos_t(sorter.get_min_position(aln)));
+        REQUIRE(key.second == 9);
+    }
+}
+
+}
+}
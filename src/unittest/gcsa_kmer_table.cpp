@@ -0,0 +1,139 @@
+/// \file gcsa_kmer_table.cpp
+///
+/// Unit tests for the GCSAKmerTable, which jump-starts MEM searches
+
+#include <iostream>
+#include <sstream>
+#include "json2pb.h"
+#include "vg.pb.h"
+#include "../gcsa_kmer_table.hpp"
+#include "../mapper.hpp"
+#include "../build_index.hpp"
+#include "catch.hpp"
+
+namespace vg {
+namespace unittest {
+
+TEST_CASE( "GCSAKmerTable finds the same ranges as backward search", "[mapping][mem][gcsa]" ) {
+
+    string graph_json = R"({
+        "node": [
+            {"id": 1, "sequence": "GATTACAGATTACA"},
+            {"id": 2, "sequence": "C"},
+            {"id": 3, "sequence": "T"},
+            {"id": 4, "sequence": "CATTAGGACCATTAGACA"}
+        ],
+        "edge": [
+            {"from": 1, "to": 2},
+            {"from": 1, "to": 3},
+            {"from": 2, "to": 4},
+            {"from": 3, "to": 4}
+        ]
+    })";
+
+    Graph proto_graph;
+    json2pb(proto_graph, graph_json.c_str(), graph_json.size());
+    VG graph;
+    graph.extend(proto_graph);
+
+    gcsa::TempFile::setDirectory(temp_file::get_dir());
+    gcsa::Verbosity::set(gcsa::Verbosity::SILENT);
+
+    gcsa::GCSA* gcsaidx = nullptr;
+    gcsa::LCPArray* lcpidx = nullptr;
+    build_gcsa_lcp(graph, gcsaidx, lcpidx, 16, 3);
+
+    GCSAKmerTable table(*gcsaidx, *lcpidx, 4);
+    REQUIRE(table.kmer_length() == 4);
+    REQUIRE(table.gcsa_size() == gcsaidx->size());
+
+    // Search for a kmer one base at a time
+    auto backward_search = [&](const string& kmer) {
+        gcsa::range_type range(0, gcsaidx->size() - 1);
+        for (auto it = kmer.rbegin(); it != kmer.rend() && !gcsa::Range::empty(range); ++it) {
+            range = gcsaidx->LF(range, gcsaidx->alpha.char2comp[*it]);
+        }
+        return range;
+    };
+
+    SECTION( "kmers in the graph have their backward search ranges" ) {
+        for (string kmer : {"GATT", "ACAG", "ACAC", "ATCA", "GACA"}) {
+            auto entry = table.find(kmer.begin());
+            REQUIRE(entry != nullptr);
+            REQUIRE(entry->range == backward_search(kmer));
+            REQUIRE(entry->min_count >= gcsaidx->count(entry->range));
+        }
+    }
+
+    SECTION( "kmers not in the graph or with other characters are not found" ) {
+        string absent = "GGGG";
+        REQUIRE(gcsa::Range::empty(backward_search(absent)));
+        REQUIRE(table.find(absent.begin()) == nullptr);
+        string with_n = "GATN";
+        REQUIRE(table.find(with_n.begin()) == nullptr);
+    }
+
+    SECTION( "tables survive serialization" ) {
+        stringstream serialized;
+        table.serialize(serialized);
+        GCSAKmerTable loaded;
+        loaded.load(serialized);
+        REQUIRE(loaded.kmer_length() == table.kmer_length());
+        REQUIRE(loaded.gcsa_size() == table.gcsa_size());
+        string kmer = "TTAG";
+        REQUIRE(loaded.find(kmer.begin()) != nullptr);
+        REQUIRE(loaded.find(kmer.begin())->range == table.find(kmer.begin())->range);
+        REQUIRE(loaded.find(kmer.begin())->max_parent_lcp == table.find(kmer.begin())->max_parent_lcp);
+    }
+
+    SECTION( "garbage is not loaded as a table" ) {
+        stringstream garbage("GATTACA");
+        GCSAKmerTable loaded;
+        REQUIRE_THROWS(loaded.load(garbage));
+    }
+
+    SECTION( "the mapper finds the same MEMs with the table" ) {
+        xg::XG xg_index(proto_graph);
+        Mapper mapper(&xg_index, gcsaidx, lcpidx);
+
+        for (string read : {"GATTACAGATTACATCATTAGGACC", "TTACANNGATTACACCATTAGACA", "CCCCGATTAGACATTAG"}) {
+            double lcp_avg, fraction_filtered;
+            mapper.set_gcsa_kmer_table(nullptr);
+            auto plain = mapper.find_mems_deep(read.begin(), read.end(), lcp_avg, fraction_filtered,
+                                               0, 1, 8, false, false, false, true);
+            auto plain_simple = mapper.find_mems_simple(read.begin(), read.end(), 0, 1, 0);
+
+            mapper.set_gcsa_kmer_table(&table);
+            auto jumped = mapper.find_mems_deep(read.begin(), read.end(), lcp_avg, fraction_filtered,
+                                                0, 1, 8, false, false, false, true);
+            auto jumped_simple = mapper.find_mems_simple(read.begin(), read.end(), 0, 1, 0);
+
+            REQUIRE(jumped.size() == plain.size());
+            for (size_t i = 0; i < plain.size(); i++) {
+                REQUIRE(jumped[i].begin == plain[i].begin);
+                REQUIRE(jumped[i].end == plain[i].end);
+                REQUIRE(jumped[i].range == plain[i].range);
+                REQUIRE(jumped[i].match_count == plain[i].match_count);
+            }
+            REQUIRE(jumped_simple.size() == plain_simple.size());
+            for (size_t i = 0; i < plain_simple.size(); i++) {
+                REQUIRE(jumped_simple[i].begin == plain_simple[i].begin);
+                REQUIRE(jumped_simple[i].end == plain_simple[i].end);
+                REQUIRE(jumped_simple[i].range == plain_simple[i].range);
+            }
+        }
+    }
+
+    SECTION( "tables from other indexes are rejected" ) {
+        GCSAKmerTable empty;
+        xg::XG xg_index(proto_graph);
+        Mapper mapper(&xg_index, gcsaidx, lcpidx);
+        REQUIRE_THROWS(mapper.set_gcsa_kmer_table(&empty));
+    }
+
+    delete gcsaidx;
+    delete lcpidx;
+}
+
+}
+}
@@ -0,0 +1,118 @@
+/// \file gcsa_locate_cache.cpp
+///
+/// Unit tests for the GCSALocateCache, which remembers hits of repetitive MEMs
+
+#include <iostream>
+#include "json2pb.h"
+#include "vg.pb.h"
+#include "../gcsa_locate_cache.hpp"
+#include "../build_index.hpp"
+#include "catch.hpp"
+
+namespace vg {
+namespace unittest {
+
+TEST_CASE( "GCSALocateCache finds the same hits as the index", "[mapping][mem][gcsa][cache]" ) {
+
+    string graph_json = R"({
+        "node": [
+            {"id": 1, "sequence": "CACACACACACACACAGATTACA"},
+            {"id": 2, "sequence": "CACACACACACACACATTTAAACACACA"}
+        ],
+        "edge": [
+            {"from": 1, "to": 2}
+        ]
+    })";
+
+    Graph proto_graph;
+    json2pb(proto_graph, graph_json.c_str(), graph_json.size());
+    VG graph;
+    graph.extend(proto_graph);
+
+    gcsa::TempFile::setDirectory(temp_file::get_dir());
+    gcsa::Verbosity::set(gcsa::Verbosity::SILENT);
+
+    gcsa::GCSA* gcsaidx = nullptr;
+    gcsa::LCPArray* lcpidx = nullptr;
+    build_gcsa_lcp(graph, gcsaidx, lcpidx, 16, 3);
+
+    GCSALocateCache cache(*gcsaidx, 16, 4);
+
+    gcsa::range_type repeat = gcsaidx->find(string("CACA"));
+    REQUIRE(gcsa::Range::length(repeat) >= 4);
+    gcsa::range_type unique = gcsaidx->find(string("GATTACA"));
+    REQUIRE(gcsa::Range::length(unique) < 4);
+
+    SECTION( "repetitive ranges are cached and give the same hits" ) {
+        vector<gcsa::node_type> expected;
+        gcsaidx->locate(repeat, expected);
+
+        vector<gcsa::node_type> found;
+        cache.locate(repeat, 0, found);
+        REQUIRE(found == expected);
+        REQUIRE(cache.misses() == 1);
+        REQUIRE(cache.hits() == 0);
+
+        found.clear();
+        cache.locate(repeat, 0, found);
+        REQUIRE(found == expected);
+        REQUIRE(cache.hits() == 1);
+        REQUIRE(cache.size() == 1);
+    }
+
+    SECTION( "result limits are cached separately" ) {
+        vector<gcsa::node_type> expected;
+        gcsaidx->locate(repeat, 2, expected);
+
+        vector<gcsa::node_type> all;
+        cache.locate(repeat, 0, all);
+        vector<gcsa::node_type> limited;
+        cache.locate(repeat, 2, limited);
+        REQUIRE(limited == expected);
+        REQUIRE(cache.misses() == 2);
+        REQUIRE(cache.size() == 2);
+    }
+
+    SECTION( "small ranges go straight to the index" ) {
+        vector<gcsa::node_type> expected;
+        gcsaidx->locate(unique, expected);
+
+        vector<gcsa::node_type> found;
+        cache.locate(unique, 0, found);
+        cache.locate(unique, 0, found);
+        REQUIRE(found == expected);
+        REQUIRE(cache.hits() == 0);
+        REQUIRE(cache.misses() == 0);
+        REQUIRE(cache.size() == 0);
+    }
+
+    SECTION( "the cache can be warmed from kmers" ) {
+        REQUIRE(cache.warm({"CACA", "GATTACA", "GGGGGG"}, 0) == 1);
+        vector<gcsa::node_type> found;
+        cache.locate(repeat, 0, found);
+        REQUIRE(cache.hits() == 1);
+        REQUIRE(cache.misses() == 0);
+    }
+
+    SECTION( "the cache can be shared between threads" ) {
+        vector<gcsa::node_type> expected;
+        gcsaidx->locate(repeat, expected);
+        size_t wrong = 0;
+#pragma omp parallel for reduction(+:wrong)
+        for (size_t i = 0; i < 1000; i++) {
+            vector<gcsa::node_type> found;
+            cache.locate(repeat, 0, found);
+            if (found != expected) {
+                wrong++;
+            }
+        }
+        REQUIRE(wrong == 0);
+        REQUIRE(cache.hits() + cache.misses() == 1000);
+    }
+
+    delete gcsaidx;
+    delete lcpidx;
+}
+
+}
+}
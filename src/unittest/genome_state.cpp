@@ -838,6 +838,23 @@ TEST_CASE("GenomeState can hold and manipulate haplotypes", "[genomestate]") {
         
         }
         
+        SECTION("The added haplotype can be deleted and restored one snarl per thread") {
+            state.parallel_snarl_threshold = 1;
+            
+            GenomeStateCommand* undelete = state.execute(undo);
+            
+            REQUIRE(state.count_haplotypes(chromosome) == 0);
+            REQUIRE(((InsertHaplotypeCommand*)undelete)->insertions == insert.insertions);
+            
+            GenomeStateCommand* redelete = state.execute(undelete);
+            
+            REQUIRE(state.count_haplotypes(chromosome) == 1);
+            REQUIRE(((DeleteHaplotypeCommand*)redelete)->deletions == ((DeleteHaplotypeCommand*)undo)->deletions);
+            
+            delete redelete;
+            delete undelete;
+        }
+        
         // Free the undo command
         delete undo;
     }
@@ -426,6 +426,79 @@ TEST_CASE("ExhaustiveTraversalFinder finds all paths on a bubble with an inverte
   REQUIRE(found_trav_2);
 }
 
+TEST_CASE("ExhaustiveTraversalFinder enumerates lazily and within limits", "[genotype]") {
+  // Three bubbles in a row, all in one site, with a dead end hanging off the middle
+  VG graph;
+  Node* start = graph.create_node("A");
+  Node* prev = start;
+  for (size_t i = 0; i < 3; i++) {
+    Node* ref = graph.create_node("C");
+    Node* alt = graph.create_node("G");
+    Node* next = graph.create_node("T");
+    graph.create_edge(prev, ref);
+    graph.create_edge(prev, alt);
+    graph.create_edge(ref, next);
+    graph.create_edge(alt, next);
+    if (i == 1) {
+      graph.create_edge(ref, graph.create_node("TT"));
+    }
+    prev = next;
+  }
+    
+  Snarl site;
+  site.mutable_start()->set_node_id(start->id());
+  site.mutable_end()->set_node_id(prev->id());
+  site.set_type(ULTRABUBBLE);
+    
+  list<Snarl> snarls{site};
+  SnarlManager manager(snarls.begin(), snarls.end());
+  const Snarl* snarl = manager.top_level_snarls().front();
+    
+  ExhaustiveTraversalFinder finder(graph, manager);
+  ExhaustiveHandleTraversalFinder handle_finder(graph, manager);
+    
+  SECTION("every traversal is found") {
+    REQUIRE(finder.find_traversals(*snarl).size() == 8);
+    REQUIRE(handle_finder.find_traversals(*snarl).size() == 8);
+  }
+    
+  SECTION("the count cap is respected") {
+    finder.max_traversals = 3;
+    handle_finder.max_traversals = 3;
+    REQUIRE(finder.find_traversals(*snarl).size() == 3);
+    REQUIRE(handle_finder.find_traversals(*snarl).size() == 3);
+  }
+    
+  SECTION("callers can stop early") {
+    size_t seen = 0;
+    bool finished = handle_finder.for_each_traversal(*snarl, [&](const SnarlTraversal& trav) {
+      REQUIRE(trav.visit_size() == 7);
+      seen++;
+      return seen < 2;
+    });
+    REQUIRE(!finished);
+    REQUIRE(seen == 2);
+      
+    seen = 0;
+    REQUIRE(finder.for_each_traversal(*snarl, [&](const SnarlTraversal& trav) {
+      seen++;
+      return true;
+    }));
+    REQUIRE(seen == 8);
+  }
+    
+  SECTION("snarls can be searched in parallel") {
+    vector<const Snarl*> sites{snarl, snarl, snarl};
+    auto found = TraversalFinder::find_traversals_parallel(sites, [&]() {
+      return unique_ptr<TraversalFinder>(new ExhaustiveHandleTraversalFinder(graph, manager));
+    });
+    REQUIRE(found.size() == 3);
+    for (auto& travs : found) {
+      REQUIRE(travs.size() == 8);
+    }
+  }
+}
+
 TEST_CASE("SiteFinder can differntiate ultrabubbles from snarls", "[genotype]") {
 
   SECTION("Directed cycle does not count as ultrabubble") {
@@ -691,5 +764,67 @@ TEST_CASE("RepresentativeTraversalFinder finds traversals correctly", "[genotype
 
 }
 
+TEST_CASE("SupportAugmentedGraph stores supports by node ID and edge sides", "[genotype]") {
+  SupportAugmentedGraph augmented;
+  Node* n1 = augmented.graph.create_node("GAT", 5);
+  Node* n2 = augmented.graph.create_node("TACA", 2);
+  Node* n3 = augmented.graph.create_node("C", 9);
+  Edge* e1 = augmented.graph.create_edge(n1, n2);
+  Edge* e2 = augmented.graph.create_edge(n2, n3, false, true);
+    
+  Support support;
+  support.set_forward(3);
+  support.set_reverse(1.5);
+  support.set_quality(20);
+    
+  REQUIRE(!augmented.has_supports());
+  augmented.set_support(n1, support);
+  support.set_forward(7);
+  augmented.set_support(n2, support);
+  augmented.set_support(e2, support);
+    
+  SECTION("supports are found for what they were set on and nothing else") {
+    REQUIRE(augmented.has_supports());
+    REQUIRE(augmented.has_support(n1));
+    REQUIRE(augmented.has_support(n2));
+    REQUIRE(!augmented.has_support(n3));
+    REQUIRE(!augmented.has_support(e1));
+    REQUIRE(augmented.has_support(e2));
+    REQUIRE(augmented.get_support(n1).forward() == 3);
+    REQUIRE(augmented.get_support(n2).forward() == 7);
+    REQUIRE(augmented.get_support(n2).reverse() == 1.5);
+    REQUIRE(total(augmented.get_support(n3)) == 0);
+    REQUIRE(total(augmented.get_support(e1)) == 0);
+    REQUIRE(augmented.get_support(e2).quality() == 20);
+    REQUIRE(total(augmented.get_support((Edge*) nullptr)) == 0);
+  }
+    
+  SECTION("node supports are visited in ID order") {
+    vector<vg::id_t> visited;
+    augmented.for_each_node_support([&](Node* node, const Support& visited_support) {
+      visited.push_back(node->id());
+      REQUIRE(total(visited_support) > 0);
+    });
+    REQUIRE(visited == vector<vg::id_t>{2, 5});
+  }
+    
+  SECTION("supports survive writing and loading") {
+    stringstream serialized;
+    augmented.write_supports(serialized);
+        
+    SupportAugmentedGraph loaded;
+    loaded.graph = augmented.graph;
+    loaded.load_supports(serialized);
+    for (Node* node : {n1, n2, n3}) {
+      Node* loaded_node = loaded.graph.get_node(node->id());
+      REQUIRE(loaded.has_support(loaded_node) == augmented.has_support(node));
+      REQUIRE(loaded.get_support(loaded_node).forward() == augmented.get_support(node).forward());
+    }
+    Edge* loaded_edge = loaded.graph.get_edge(NodeSide::pair_from_edge(e2));
+    REQUIRE(loaded.has_support(loaded_edge));
+    REQUIRE(loaded.get_support(loaded_edge).forward() == 7);
+  }
+}
+
 }
 }
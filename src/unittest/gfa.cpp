@@ -594,6 +594,74 @@ P	2	ref	2	+	3M)";
     
 }
 
+TEST_CASE("Blunt GFA can be streamed in chunks", "[gfa]") {
+    const string graph_gfa = R"(H	VN:Z:1.0
+S	1	GATT
+S	3	G
+L	1	+	2	+	0M
+L	1	+	3	+	*
+L	2	+	3	+	0M
+L	3	-	2	-	0M
+S	2	ACA
+P	ref	1+,2+,3+	*
+P	alt	1+,3+	4M,1M)";
+
+    // Chunk small enough to split the nodes and the paths
+    VG streamed;
+    size_t chunks = 0;
+    stringstream in(graph_gfa);
+    REQUIRE(gfa_to_graph_chunks(in, [&](Graph& g) {
+        streamed.extend(g);
+        chunks++;
+    }, 2));
+    REQUIRE(chunks > 3);
+    REQUIRE(streamed.is_valid());
+
+    VG imported;
+    stringstream again(graph_gfa);
+    REQUIRE(gfa_to_graph(again, &imported));
+
+    // The reverse complement of a link is the same edge
+    REQUIRE(streamed.node_count() == imported.node_count());
+    REQUIRE(streamed.edge_count() == imported.edge_count());
+    REQUIRE(streamed.length() == imported.length());
+    for (const string& name : {"ref", "alt"}) {
+        REQUIRE(streamed.paths.get_path(name).size() == imported.paths.get_path(name).size());
+    }
+
+    SECTION("Old-style paths are put in rank order") {
+        stringstream old_style("S\t1\tGATT\nS\t2\tACA\nL\t1\t+\t2\t+\t0M\n"
+                               "P\t2\told\t2\t+\t3M\nP\t1\told\t1\t+\t4M\n");
+        VG graph;
+        REQUIRE(gfa_to_graph_chunks(old_style, [&](Graph& g) {
+            graph.extend(g);
+        }));
+        auto& path = graph.paths.get_path("old");
+        REQUIRE(path.size() == 2);
+        REQUIRE(path.front().node_id() == 1);
+        REQUIRE(path.back().node_id() == 2);
+    }
+
+    SECTION("Overlapping links need the full importer") {
+        stringstream overlapping("S\t1\tGATT\nS\t2\tTTACA\nL\t1\t+\t2\t+\t2M\n");
+        size_t called = 0;
+        REQUIRE_THROWS_AS(gfa_to_graph_chunks(overlapping, [&](Graph& g) {
+            called++;
+        }), GFAOverlapError);
+        REQUIRE(called == 0);
+    }
+
+    SECTION("Links to missing segments are dropped") {
+        stringstream dangling("S\t1\tGATT\nL\t1\t+\t7\t+\t0M\n");
+        VG graph;
+        REQUIRE(gfa_to_graph_chunks(dangling, [&](Graph& g) {
+            graph.extend(g);
+        }));
+        REQUIRE(graph.node_count() == 1);
+        REQUIRE(graph.edge_count() == 0);
+    }
+}
+
 
         
 }
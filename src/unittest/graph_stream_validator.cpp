@@ -0,0 +1,173 @@
+/// \file graph_stream_validator.cpp
+///
+/// Unit tests for the GraphStreamValidator, which checks graphs chunk by chunk
+
+#include "../graph_stream_validator.hpp"
+#include "../utility.hpp"
+
+#include "catch.hpp"
+
+#include <omp.h>
+
+namespace vg {
+namespace unittest {
+using namespace std;
+
+/// Add a node to the chunk
+static void add_node(Graph& chunk, vg::id_t id, const string& sequence) {
+    Node* node = chunk.add_node();
+    node->set_id(id);
+    node->set_sequence(sequence);
+}
+
+/// Add an edge from the end of one node to the start of another to the chunk
+static void add_edge(Graph& chunk, vg::id_t from, vg::id_t to) {
+    Edge* edge = chunk.add_edge();
+    edge->set_from(from);
+    edge->set_to(to);
+}
+
+/// Add a mapping covering length bases of the given node to the named path
+static Mapping* add_mapping(Graph& chunk, const string& name, vg::id_t id, size_t length, int64_t rank) {
+    Path* path = nullptr;
+    for (auto& existing : *chunk.mutable_path()) {
+        if (existing.name() == name) {
+            path = &existing;
+        }
+    }
+    if (!path) {
+        path = chunk.add_path();
+        path->set_name(name);
+    }
+    Mapping* mapping = path->add_mapping();
+    mapping->mutable_position()->set_node_id(id);
+    mapping->set_rank(rank);
+    Edit* edit = mapping->add_edit();
+    edit->set_from_length(length);
+    edit->set_to_length(length);
+    return mapping;
+}
+
+TEST_CASE("GraphStreamValidator accepts valid graphs split across chunks", "[validate]") {
+
+    // Edges and paths come before the nodes they visit
+    Graph first, second;
+    add_edge(first, 1, 2);
+    add_edge(first, 2, 3);
+    add_mapping(first, "x", 3, 2, 3);
+    add_mapping(first, "x", 2, 1, 2);
+    add_node(second, 1, "GAT");
+    add_node(second, 2, "T");
+    add_node(second, 3, "AC");
+    add_node(second, 1, "GAT");
+    add_mapping(second, "x", 1, 3, 1);
+
+    GraphStreamValidator validator;
+    validator.check_orphans = true;
+    validator.add_chunk(first);
+    validator.add_chunk(second);
+    REQUIRE(validator.validate().empty());
+
+    validator.clear();
+    REQUIRE(validator.validate().empty());
+}
+
+TEST_CASE("GraphStreamValidator reports every problem it finds", "[validate]") {
+
+    Graph chunk;
+    add_node(chunk, 1, "GAT");
+    add_node(chunk, 2, "TA");
+    add_node(chunk, 4, "C");
+    add_edge(chunk, 1, 2);
+    add_edge(chunk, 2, 3);
+    add_edge(chunk, 5, 6);
+
+    SECTION("edges to missing nodes are each reported") {
+        GraphStreamValidator validator;
+        validator.add_chunk(chunk);
+        auto errors = validator.validate();
+        REQUIRE(errors.size() == 3);
+        REQUIRE(errors[0].find("node 3, which is not in the graph") != string::npos);
+        REQUIRE(errors[0].find("chunk 0, edge 1") != string::npos);
+        REQUIRE(errors[1].find("node 5,") != string::npos);
+        REQUIRE(errors[2].find("node 6,") != string::npos);
+    }
+
+    SECTION("orphans are only reported when asked for") {
+        GraphStreamValidator validator;
+        validator.check_edges = false;
+        validator.add_chunk(chunk);
+        REQUIRE(validator.validate().empty());
+
+        validator.check_orphans = true;
+        auto errors = validator.validate();
+        REQUIRE(errors.size() == 1);
+        REQUIRE(errors[0].find("node 4 ") == 0);
+    }
+
+    SECTION("copies of a node must agree") {
+        Graph other;
+        add_node(other, 2, "TAC");
+        GraphStreamValidator validator;
+        validator.check_edges = false;
+        validator.add_chunk(chunk);
+        validator.add_chunk(other);
+        auto errors = validator.validate();
+        REQUIRE(errors.size() == 1);
+        REQUIRE(errors[0].find("chunk 1, node 0") != string::npos);
+    }
+
+    SECTION("paths must follow edges and cover their nodes") {
+        Graph paths;
+        // Missing the last base of node 1
+        add_mapping(paths, "x", 1, 2, 1);
+        add_mapping(paths, "x", 2, 2, 2);
+        // No edge from 2 to 4
+        add_mapping(paths, "x", 4, 1, 3);
+        // No such node
+        add_mapping(paths, "y", 7, 1, 1);
+        // Runs off the end of the node
+        add_mapping(paths, "z", 4, 2, 1);
+
+        GraphStreamValidator validator;
+        validator.check_edges = false;
+        validator.add_chunk(chunk);
+        validator.add_chunk(paths);
+        auto errors = validator.validate();
+        REQUIRE(errors.size() == 4);
+        REQUIRE(errors[0].find("path 'x' mapping rank 1") == 0);
+        REQUIRE(errors[0].find("does not reach the end of node 1") != string::npos);
+        REQUIRE(errors[1].find("path 'x' mapping rank 3") == 0);
+        REQUIRE(errors[1].find("no edge") != string::npos);
+        REQUIRE(errors[2].find("path 'y'") == 0);
+        REQUIRE(errors[3].find("path 'z'") == 0);
+        REQUIRE(errors[3].find("outside of node 4") != string::npos);
+    }
+
+    SECTION("the same problems are found on any number of threads") {
+        // Make enough edges to split between threads
+        Graph big;
+        for (vg::id_t id = 1; id <= 5000; id++) {
+            add_node(big, id, "A");
+            add_edge(big, id, id % 1000 == 0 ? id + 10000 : id + 1);
+        }
+        vector<string> single_threaded;
+        int thread_count = get_thread_count();
+        for (int threads : {1, 4}) {
+            omp_set_num_threads(threads);
+            GraphStreamValidator validator;
+            validator.add_chunk(big);
+            auto errors = validator.validate();
+            REQUIRE(errors.size() == 5);
+            if (threads == 1) {
+                single_threaded = errors;
+            } else {
+                REQUIRE(errors == single_threaded);
+            }
+        }
+        omp_set_num_threads(thread_count);
+    }
+}
+
+}
+}
@@ -392,6 +392,33 @@ TEST_CASE("We can score haplotypes using gPBWT", "[haplo-score][xg]") {
   
   vector<xg::XG::ThreadMapping> empty_node = {tm[1], tm[8]};
   REQUIRE(!(haplo::haplo_DP::score(empty_node, xg_index, memo).second));
+  
+  SECTION("Batch scoring matches scoring threads one at a time") {
+    // Queries that share prefixes, repeat, contain each other, and fail part
+    // way through in the same place.
+    vector<vector<xg::XG::ThreadMapping>> threads = {
+      t1_2_4_5_7,
+      t1_2_4_6_7,
+      query,
+      t1_3_4_5_7,
+      t1_2_4_5_7,
+      {tm[1], tm[8], tm[4]},
+      empty_node,
+      missing_edge,
+      {tm[1], tm[2]}
+    };
+    auto batch = haplo::haplo_DP::score_batch(threads, xg_index, memo);
+    REQUIRE(batch.size() == threads.size());
+    for(size_t i = 0; i < threads.size(); i++) {
+      auto single = haplo::haplo_DP::score(threads[i], xg_index, memo);
+      REQUIRE(batch[i].second == single.second);
+      if(single.second) {
+        REQUIRE(batch[i].first == single.first);
+      }
+    }
+    REQUIRE(!batch[5].second);
+    REQUIRE(!batch[6].second);
+  }
 }
 
 TEST_CASE("We can score haplotypes using GBWT", "[haplo-score][gbwt]") {
@@ -603,4 +630,64 @@ TEST_CASE("We can recognize a required crossover", "[hapo-score][gbwt]") {
     
 }
 
+TEST_CASE("Batch GBWT haplotype scoring matches scoring paths one at a time", "[haplo-score][gbwt]") {
+
+  gbwt::Verbosity::set(gbwt::Verbosity::SILENT);
+  gbwt::DynamicGBWT gbwt_index;
+  
+  gbwt::vector_type tm;
+  for(size_t i = 0; i <= 8; i++) {
+    tm.push_back(static_cast<gbwt::vector_type::value_type>(gbwt::Node::encode(i, false)));
+  }
+  gbwt::vector_type t1_2_4_5_7 = {tm[1], tm[2], tm[4], tm[5], tm[7], static_cast<gbwt::vector_type::value_type>(gbwt::ENDMARKER)};
+  gbwt::vector_type t1_3_4_6_7 = {tm[1], tm[3], tm[4], tm[6], tm[7], static_cast<gbwt::vector_type::value_type>(gbwt::ENDMARKER)};
+  gbwt::vector_type t1_2_4_7 = {tm[1], tm[2], tm[4], tm[7], static_cast<gbwt::vector_type::value_type>(gbwt::ENDMARKER)};
+  for(auto& haplotype : {t1_2_4_5_7, t1_2_4_5_7, t1_3_4_6_7, t1_2_4_7}) {
+    gbwt_index.insert(haplotype);
+  }
+  
+  haplo::haploMath::RRMemo memo(9, 4);
+  
+  // Queries that share prefixes, repeat, contain each other, and fail part
+  // way through in the same place.
+  vector<vector<size_t>> queries = {
+    {1, 2, 4, 5, 7},
+    {1, 2, 4, 6, 7},
+    {1, 2, 4},
+    {1, 3, 4, 5, 7},
+    {1, 2, 4, 5, 7},
+    {1, 8, 4},
+    {1, 8, 5},
+    {2, 4, 7},
+    {1, 2}
+  };
+  vector<haplo::gbwt_thread_t> threads;
+  for(auto& query : queries) {
+    haplo::gbwt_thread_t thread;
+    for(size_t i = 0; i < query.size(); i++) {
+      // Make the last visit partial, so node lengths matter too.
+      thread.push_back(tm[query[i]], i + 1 == query.size() ? 2 : 3);
+    }
+    threads.push_back(thread);
+  }
+  // The same nodes as the first, but with a different length at the end.
+  haplo::gbwt_thread_t longer_end;
+  for(size_t node : queries[0]) {
+    longer_end.push_back(tm[node], 3);
+  }
+  threads.push_back(longer_end);
+  
+  auto batch = haplo::haplo_DP::score_batch(threads, gbwt_index, memo);
+  REQUIRE(batch.size() == threads.size());
+  for(size_t i = 0; i < threads.size(); i++) {
+    auto single = haplo::haplo_DP::score(threads[i], gbwt_index, memo);
+    REQUIRE(batch[i].second == single.second);
+    if(single.second) {
+      REQUIRE(batch[i].first == single.first);
+    }
+  }
+  REQUIRE(!batch[5].second);
+  REQUIRE(!batch[6].second);
+}
+
 }
@@ -0,0 +1,78 @@
+/// \file id_translator.cpp
+///
+/// Unit tests for the IDTranslator, which renumbers node IDs through sorted runs
+
+#include "../id_translator.hpp"
+
+#include "catch.hpp"
+
+#include <algorithm>
+#include <random>
+
+namespace vg {
+namespace unittest {
+using namespace std;
+
+TEST_CASE("IDTranslator compacts IDs in order", "[ids]") {
+
+    SECTION("dense IDs take one run and translate to themselves") {
+        Graph graph;
+        for (vg::id_t id = 10; id > 0; id--) {
+            graph.add_node()->set_id(id);
+        }
+        IDTranslator translator;
+        translator.add_ids(graph);
+        translator.build();
+        REQUIRE(translator.size() == 10);
+        REQUIRE(translator.run_count() == 1);
+        for (vg::id_t id = 1; id <= 10; id++) {
+            REQUIRE(translator.translate(id) == id);
+        }
+        REQUIRE_THROWS(translator.translate(11));
+        REQUIRE_THROWS(translator.translate(0));
+    }
+
+    SECTION("overlapping chunks and translators merge into one numbering") {
+        IDTranslator first, second;
+        first.add_range(100, 199);
+        first.add_range(1000, 1009);
+        second.add_range(150, 249);
+        second.add_range(5, 5);
+        first.add_ids(second);
+        first.build(1);
+        REQUIRE(first.size() == 1 + 150 + 10);
+        REQUIRE(first.run_count() == 3);
+        REQUIRE(first.translate(5) == 1);
+        REQUIRE(first.translate(100) == 2);
+        REQUIRE(first.translate(249) == 151);
+        REQUIRE(first.translate(1000) == 152);
+        REQUIRE(first.translate(1009) == 161);
+        REQUIRE_THROWS(first.translate(250));
+        REQUIRE_THROWS(first.translate(999));
+    }
+
+    SECTION("random sparse IDs get consecutive new IDs in their order") {
+        default_random_engine generator(54321);
+        uniform_int_distribution<vg::id_t> distribution(1, 100000);
+        vector<vg::id_t> ids;
+        IDTranslator translator;
+        for (size_t chunk = 0; chunk < 10; chunk++) {
+            Graph graph;
+            for (size_t i = 0; i < 500; i++) {
+                ids.push_back(distribution(generator));
+                graph.add_node()->set_id(ids.back());
+            }
+            translator.add_ids(graph);
+        }
+        translator.build(42);
+        sort(ids.begin(), ids.end());
+        ids.erase(unique(ids.begin(), ids.end()), ids.end());
+        REQUIRE(translator.size() == ids.size());
+        for (size_t i = 0; i < ids.size(); i++) {
+            REQUIRE(translator.translate(ids[i]) == 42 + i);
+        }
+    }
+}
+
+}
+}
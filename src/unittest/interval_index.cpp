@@ -0,0 +1,80 @@
+/// \file interval_index.cpp
+///
+/// Unit tests for the IntervalIndex, which finds the intervals overlapping a query
+
+#include <iostream>
+#include <random>
+#include "../interval_index.hpp"
+#include "catch.hpp"
+
+namespace vg {
+namespace unittest {
+
+TEST_CASE( "IntervalIndex finds overlapping intervals", "[interval]" ) {
+
+    using Interval = IntervalIndex<int>::Interval;
+
+    // Get the values of the intervals overlapping the query, in the order they
+    // are reported
+    auto query = [](const IntervalIndex<int>& index, size_t start, size_t end) {
+        vector<int> found;
+        index.for_each_overlapping(start, end, [&](const Interval& interval) {
+            found.push_back(interval.value);
+        });
+        return found;
+    };
+
+    SECTION( "an empty index finds nothing" ) {
+        IntervalIndex<int> index;
+        REQUIRE(index.empty());
+        REQUIRE(query(index, 0, 100).empty());
+    }
+
+    SECTION( "overlaps are reported in order of start" ) {
+        IntervalIndex<int> index({{20, 30, 2}, {0, 100, 0}, {5, 10, 1}, {40, 41, 3}});
+        REQUIRE(index.size() == 4);
+        REQUIRE((query(index, 9, 25) == vector<int>{0, 1, 2}));
+        REQUIRE((query(index, 10, 20) == vector<int>{0}));
+        REQUIRE((query(index, 40, 41) == vector<int>{0, 3}));
+        REQUIRE(query(index, 100, 200).empty());
+    }
+
+    SECTION( "an empty query finds the intervals around it" ) {
+        IntervalIndex<int> index({{5, 10, 0}, {10, 15, 1}});
+        REQUIRE((query(index, 7, 7) == vector<int>{0}));
+        REQUIRE(query(index, 10, 10).empty());
+    }
+
+    SECTION( "queries agree with a linear scan on many intervals" ) {
+        default_random_engine generator(8);
+        uniform_int_distribution<size_t> start_distribution(0, 10000);
+        uniform_int_distribution<size_t> length_distribution(0, 500);
+
+        vector<Interval> intervals;
+        for (int i = 0; i < 2000; i++) {
+            size_t start = start_distribution(generator);
+            intervals.push_back({start, start + length_distribution(generator), i});
+        }
+        IntervalIndex<int> index(intervals);
+
+        for (int i = 0; i < 200; i++) {
+            size_t start = start_distribution(generator);
+            size_t end = start + length_distribution(generator) / 10;
+
+            vector<int> found = query(index, start, end);
+            sort(found.begin(), found.end());
+
+            vector<int> expected;
+            for (auto& interval : intervals) {
+                if (interval.end > start && (interval.start < end || (start == end && interval.start < start))) {
+                    expected.push_back(interval.value);
+                }
+            }
+
+            REQUIRE(found == expected);
+        }
+    }
+}
+
+}
+}
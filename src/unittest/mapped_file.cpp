@@ -0,0 +1,64 @@
+/// \file mapped_file.cpp
+///
+/// Unit tests for memory-mapped file reading
+
+#include "../mapped_file.hpp"
+#include "../utility.hpp"
+
+#include "catch.hpp"
+
+#include <fstream>
+#include <istream>
+
+namespace vg {
+namespace unittest {
+using namespace std;
+
+TEST_CASE("Mapped files can be read through a stream buffer", "[mmap]") {
+    string filename = temp_file::create();
+    {
+        ofstream out(filename);
+        out << "Candy";
+    }
+
+    MappedFile mapped(filename);
+    REQUIRE(mapped.size() == 5);
+
+    MappedFileStreamBuffer buffer(mapped);
+    istream in(&buffer);
+
+    SECTION("reading works") {
+        string contents;
+        in >> contents;
+        REQUIRE(contents == "Candy");
+        REQUIRE(in.get() == EOF);
+    }
+
+    SECTION("seeking and telling works") {
+        REQUIRE(in.tellg() == 0);
+        REQUIRE(in.get() == 'C');
+        REQUIRE(in.tellg() == 1);
+
+        in.seekg(1, ios_base::cur);
+        REQUIRE(in.tellg() == 2);
+        REQUIRE(in.get() == 'n');
+
+        in.seekg(-1, ios_base::end);
+        REQUIRE(in.get() == 'y');
+
+        in.seekg(1);
+        REQUIRE(in.get() == 'a');
+
+        in.unget();
+        REQUIRE(in.get() == 'a');
+    }
+
+    temp_file::remove(filename);
+}
+
+TEST_CASE("Mapping a missing file throws", "[mmap]") {
+    REQUIRE_THROWS(MappedFile("/nonexistent/file/for/vg/mapping"));
+}
+
+}
+}
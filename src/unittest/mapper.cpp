@@ -288,15 +288,77 @@ TEST_CASE( "Mapper finds optimal mapping for read starting with node-border MEM"
         // We want its first mapping to be to 1433 like the optimal alignment.
         REQUIRE(results.front().path().mapping_size() >= 1);
         REQUIRE(results.front().path().mapping(0).position().node_id() == 1436);
-    
+
     }
-    
+
+    SECTION( "Mapper finds the same MEMs for a batch of reads as for each read alone" ) {
+
+        vector<string> reads {
+            "TTGTTGTTGTTGTTGTGTTGTTGGGACAGCCATCTCATTTCGTTGCCAATGCTAGAGTGCATGGAG",
+            "TGCGGTAGCACGATCTCAGCTCACTCCAANNNCGCCTCTCGGTTCAAGAGATTTTCCTGGTTCAG",
+            "",
+            "CCTCCCGAGTAGCTGGAT"
+        };
+
+        vector<pair<string::const_iterator, string::const_iterator>> seqs;
+        for (auto& read : reads) {
+            seqs.emplace_back(read.begin(), read.end());
+        }
+        vector<double> longest_lcps, fractions_filtered;
+        auto batch_mems = mapper.find_mems_deep_batch(seqs, longest_lcps, fractions_filtered,
+                                                      0, 1, 8, false, true, true, true);
+        REQUIRE(batch_mems.size() == reads.size());
+        REQUIRE(longest_lcps.size() == reads.size());
+
+        for (size_t i = 0; i < reads.size(); i++) {
+            double longest_lcp, fraction_filtered;
+            auto mems = mapper.find_mems_deep(reads[i].begin(), reads[i].end(), longest_lcp, fraction_filtered,
+                                              0, 1, 8, false, true, true, true);
+            REQUIRE(batch_mems[i].size() == mems.size());
+            for (size_t j = 0; j < mems.size(); j++) {
+                REQUIRE(batch_mems[i][j].begin == mems[j].begin);
+                REQUIRE(batch_mems[i][j].end == mems[j].end);
+                REQUIRE(batch_mems[i][j].match_count == mems[j].match_count);
+                REQUIRE(batch_mems[i][j].nodes == mems[j].nodes);
+            }
+            REQUIRE(longest_lcps[i] == longest_lcp);
+        }
+    }
+
     // Clean up the GCSA/LCP index
     delete gcsaidx;
     delete lcpidx;
     
 }
 
+TEST_CASE( "FragmentLengthDistribution merges measurements from parallel threads", "[mapping][mapper]" ) {
+    
+    FragmentLengthDistribution distr(1000, 100, 0.95);
+    
+#pragma omp parallel for
+    for (size_t i = 0; i < 2000; i++) {
+        distr.register_fragment_length(300 + (int64_t) (i % 21) - 10);
+    }
+    
+    SECTION( "Buffered measurements are merged by a flush" ) {
+        distr.flush();
+        REQUIRE(distr.is_finalized());
+        REQUIRE(distr.curr_sample_size() == 1000);
+        REQUIRE(is_sorted(distr.measurements_begin(), distr.measurements_end()));
+        REQUIRE(distr.mean() > 295.0);
+        REQUIRE(distr.mean() < 305.0);
+        REQUIRE(distr.stdev() < 10.0);
+    }
+    
+    SECTION( "Nothing is registered after the distribution is finalized" ) {
+        distr.flush();
+        distr.register_fragment_length(100000);
+        distr.flush();
+        REQUIRE(distr.curr_sample_size() == 1000);
+        REQUIRE(distr.mean() < 305.0);
+    }
+}
+
 }
 
 }
@@ -0,0 +1,159 @@
+/// \file minimizer_index.cpp
+///
+/// Unit tests for the MinimizerIndex, which finds seeds from the minimizers of walks through a graph
+
+#include <iostream>
+#include <fstream>
+#include "json2pb.h"
+#include "vg.pb.h"
+#include "../minimizer_index.hpp"
+#include "../utility.hpp"
+#include "catch.hpp"
+
+namespace vg {
+namespace unittest {
+
+TEST_CASE( "MinimizerIndex finds the graph positions of read minimizers", "[minimizer][mapping]" ) {
+
+    // A SNP between two longer nodes, with the reference allele on a path
+    string graph_json = R"({
+        "node": [
+            {"id": 1, "sequence": "GATTACACATTAGCA"},
+            {"id": 2, "sequence": "G"},
+            {"id": 3, "sequence": "T"},
+            {"id": 4, "sequence": "CCATGGATCCTTGAC"}
+        ],
+        "edge": [
+            {"from": 1, "to": 2},
+            {"from": 1, "to": 3},
+            {"from": 2, "to": 4},
+            {"from": 3, "to": 4}
+        ],
+        "path": [
+            {"name": "ref", "mapping": [
+                {"position": {"node_id": 1}, "rank": 1},
+                {"position": {"node_id": 2}, "rank": 2},
+                {"position": {"node_id": 4}, "rank": 3}
+            ]}
+        ]
+    })";
+
+    Graph proto_graph;
+    json2pb(proto_graph, graph_json.c_str(), graph_json.size());
+    xg::XG xg_index(proto_graph);
+
+    // Spell out a walk, with the position of each base, on either strand
+    auto spell = [&](const vector<id_t>& walk, bool reverse, string& sequence, vector<pos_t>& positions) {
+        sequence.clear();
+        positions.clear();
+        for (id_t id : walk) {
+            string node_sequence = xg_index.node_sequence(id);
+            for (size_t i = 0; i < node_sequence.size(); i++) {
+                sequence.push_back(node_sequence[i]);
+                positions.push_back(make_pos_t(id, false, i));
+            }
+        }
+        if (reverse) {
+            sequence = reverse_complement(sequence);
+            std::reverse(positions.begin(), positions.end());
+            for (auto& pos : positions) {
+                pos = make_pos_t(id(pos), true, xg_index.node_length(id(pos)) - offset(pos) - 1);
+            }
+        }
+    };
+
+    // Is the position among the hits of the key?
+    auto has_hit = [](const MinimizerIndex& index, uint64_t key, const pos_t& pos) {
+        auto hits = index.find(key);
+        for (auto hit = hits.first; hit != hits.second; ++hit) {
+            if (make_pos_t(*hit) == pos) {
+                return true;
+            }
+        }
+        return false;
+    };
+
+    SECTION( "every minimizer of every walk is found where it is on either strand" ) {
+        MinimizerIndex index(5, 3);
+        index.add_graph(xg_index);
+        index.build();
+        REQUIRE(index.k() == 5);
+        REQUIRE(index.w() == 3);
+        REQUIRE(index.size() > 0);
+
+        for (auto& walk : vector<vector<id_t>>{{1, 2, 4}, {1, 3, 4}}) {
+            for (bool reverse : {false, true}) {
+                string sequence;
+                vector<pos_t> positions;
+                spell(walk, reverse, sequence, positions);
+                auto minimizers = index.minimizers(sequence.begin(), sequence.end());
+                REQUIRE(!minimizers.empty());
+                for (auto& minimizer : minimizers) {
+                    REQUIRE(has_hit(index, minimizer.key, positions[minimizer.offset]));
+                }
+            }
+        }
+    }
+
+    SECTION( "indexing paths leaves out the sequence that is only off the paths" ) {
+        MinimizerIndex index(5, 3);
+        index.add_paths(xg_index);
+        index.build();
+
+        string sequence;
+        vector<pos_t> positions;
+        spell({1, 2, 4}, false, sequence, positions);
+        for (auto& minimizer : index.minimizers(sequence.begin(), sequence.end())) {
+            REQUIRE(has_hit(index, minimizer.key, positions[minimizer.offset]));
+        }
+        spell({1, 3, 4}, true, sequence, positions);
+        for (auto& minimizer : index.minimizers(sequence.begin(), sequence.end())) {
+            auto hits = index.find(minimizer.key);
+            for (auto hit = hits.first; hit != hits.second; ++hit) {
+                REQUIRE(gcsa::Node::id(*hit) != 3);
+            }
+        }
+    }
+
+    SECTION( "a loaded index finds the same hits as the one that was built" ) {
+        MinimizerIndex index(5, 3);
+        index.add_graph(xg_index);
+        index.build();
+
+        string file_name = temp_file::create();
+        {
+            ofstream out(file_name);
+            index.serialize(out);
+        }
+        MinimizerIndex loaded;
+        loaded.load(file_name);
+        REQUIRE(loaded.k() == index.k());
+        REQUIRE(loaded.w() == index.w());
+        REQUIRE(loaded.size() == index.size());
+        REQUIRE(loaded.hit_count() == index.hit_count());
+
+        string sequence;
+        vector<pos_t> positions;
+        spell({1, 3, 4}, false, sequence, positions);
+        for (auto& minimizer : index.minimizers(sequence.begin(), sequence.end())) {
+            auto built_hits = index.find(minimizer.key);
+            auto loaded_hits = loaded.find(minimizer.key);
+            REQUIRE((vector<gcsa::node_type>(built_hits.first, built_hits.second)
+                     == vector<gcsa::node_type>(loaded_hits.first, loaded_hits.second)));
+        }
+        temp_file::remove(file_name);
+    }
+
+    SECTION( "kmers with Ns are never minimizers" ) {
+        MinimizerIndex index(5, 3);
+        string sequence = "GATTNCACATTAGCA";
+        for (auto& minimizer : index.minimizers(sequence.begin(), sequence.end())) {
+            REQUIRE(minimizer.offset > 4);
+        }
+        string short_sequence = "GATT";
+        REQUIRE(index.minimizers(short_sequence.begin(), short_sequence.end()).empty());
+    }
+}
+
+}
+}
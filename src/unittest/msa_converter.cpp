@@ -242,6 +242,38 @@ namespace vg {
                 REQUIRE(graph.has_edge(NodeSide(nodes["C"], true), NodeSide(nodes["G"], false)));
                 REQUIRE(graph.has_edge(NodeSide(nodes["G"], true), NodeSide(nodes["TT"], false)));
             }
+            
+            SECTION("MSAConverter builds the same sequences when it splits an alignment into column ranges") {
+                
+                string input = ">seq1\nAAACGTT\n>seq2\nAA---TT\n>seq3\nAAA-GTT\n";
+                
+                istringstream strm(input);
+                
+                MSAConverter msa_converter;
+                msa_converter.parallel_block_length = 2;
+                msa_converter.load_alignments(strm, "fasta");
+                
+                VG graph = msa_converter.make_graph();
+                
+                unordered_map<string, string> path_seqs;
+                for (size_t i = 0; i < graph.graph.path_size(); i++) {
+                    const Path& path = graph.graph.path(i);
+                    for (size_t j = 0; j < path.mapping_size(); j++) {
+                        id_t node_id = path.mapping(j).position().node_id();
+                        // each step along the path must follow an edge
+                        if (j > 0) {
+                            REQUIRE(graph.has_edge(NodeSide(path.mapping(j - 1).position().node_id(), true),
+                                                   NodeSide(node_id, false)));
+                        }
+                        path_seqs[path.name()] += graph.get_node(node_id)->sequence();
+                    }
+                }
+                
+                REQUIRE(path_seqs.size() == 3);
+                REQUIRE(path_seqs["seq1"] == "AAACGTT");
+                REQUIRE(path_seqs["seq2"] == "AATT");
+                REQUIRE(path_seqs["seq3"] == "AAAGTT");
+            }
         }
     }
 }
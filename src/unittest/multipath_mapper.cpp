@@ -3,6 +3,7 @@
 /// unit tests for the multipath mapper
 
 #include <iostream>
+#include <sstream>
 #include "json2pb.h"
 #include "vg.pb.h"
 #include "../multipath_mapper.hpp"
@@ -628,6 +629,57 @@ TEST_CASE( "MultipathMapper can work on a bigger graph", "[multipath][mapping][m
     delete lcpidx;
 }
 
+TEST_CASE( "MultipathMapper can save and reload a mismapping calibration", "[multipath][mapping][multipathmapper]" ) {
+    
+    string graph_json = R"({
+        "node": [{"id": 1, "sequence": "GATTACA"}],
+        "path": [
+            {"name": "ref", "mapping": [
+                {"position": {"node_id": 1}, "edit": [{"from_length": 7, "to_length": 7}]}
+            ]}
+        ]
+    })";
+    
+    Graph proto_graph;
+    json2pb(proto_graph, graph_json.c_str(), graph_json.size());
+    VG graph;
+    graph.extend(proto_graph);
+    
+    gcsa::TempFile::setDirectory(temp_file::get_dir());
+    gcsa::Verbosity::set(gcsa::Verbosity::SILENT);
+    gcsa::GCSA* gcsaidx = nullptr;
+    gcsa::LCPArray* lcpidx = nullptr;
+    build_gcsa_lcp(graph, gcsaidx, lcpidx, 16, 3);
+    xg::XG xg_index(proto_graph);
+    
+    MultipathMapper calibrated(&xg_index, gcsaidx, lcpidx);
+    calibrated.pseudo_length_multiplier = 1.0 / 3.0;
+    stringstream saved;
+    calibrated.save_mismapping_calibration(saved, 250, 150);
+    
+    MultipathMapper mapper(&xg_index, gcsaidx, lcpidx);
+    double default_multiplier = mapper.pseudo_length_multiplier;
+    
+    SECTION( "The calibration loads for the same settings" ) {
+        REQUIRE(mapper.load_mismapping_calibration(saved, 250, 150));
+        REQUIRE(mapper.pseudo_length_multiplier == calibrated.pseudo_length_multiplier);
+    }
+    
+    SECTION( "The calibration is not used for a different read length" ) {
+        REQUIRE(!mapper.load_mismapping_calibration(saved, 250, 100));
+        REQUIRE(mapper.pseudo_length_multiplier == default_multiplier);
+    }
+    
+    SECTION( "The calibration is not used for different scores" ) {
+        mapper.set_alignment_scores(1, 4, 6, 1, 0);
+        REQUIRE(!mapper.load_mismapping_calibration(saved, 250, 150));
+        REQUIRE(mapper.pseudo_length_multiplier == default_multiplier);
+    }
+    
+    delete gcsaidx;
+    delete lcpidx;
+}
+
 }
 
 }
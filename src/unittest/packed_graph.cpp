@@ -0,0 +1,137 @@
+/// \file packed_graph.cpp
+///
+/// Unit tests for the compact handle graph
+
+#include "../packed_graph.hpp"
+#include "../vg.hpp"
+#include "../json2pb.h"
+
+#include "catch.hpp"
+
+#include <sstream>
+
+namespace vg {
+namespace unittest {
+using namespace std;
+
+TEST_CASE("PackedGraph supports the mutable handle graph operations", "[packed]") {
+
+    PackedGraph graph;
+    handle_t h1 = graph.create_handle("GATT");
+    handle_t h2 = graph.create_handle("ACA");
+    handle_t h3 = graph.create_handle("CAT", 10);
+    graph.create_edge(h1, h2);
+    graph.create_edge(h1, graph.flip(h3));
+    // Adding an edge again, from the other end, does nothing
+    graph.create_edge(graph.flip(h2), graph.flip(h1));
+
+    auto right_of = [&](const handle_t& h) {
+        vector<handle_t> found;
+        graph.follow_edges(h, false, [&](const handle_t& next) {
+            found.push_back(next);
+        });
+        return found;
+    };
+    auto left_of = [&](const handle_t& h) {
+        vector<handle_t> found;
+        graph.follow_edges(h, true, [&](const handle_t& prev) {
+            found.push_back(prev);
+        });
+        return found;
+    };
+
+    REQUIRE(graph.node_size() == 3);
+    REQUIRE(graph.edge_count() == 2);
+    REQUIRE(graph.get_id(h3) == 10);
+    REQUIRE(graph.max_node_id() == 10);
+    REQUIRE(graph.get_sequence(graph.flip(h1)) == "AATC");
+
+    SECTION("edges can be followed from both ends") {
+        REQUIRE(right_of(h1).size() == 2);
+        REQUIRE(left_of(h2) == vector<handle_t>{h1});
+        REQUIRE(right_of(h3) == vector<handle_t>{graph.flip(h1)});
+    }
+
+    SECTION("edges and nodes can be destroyed") {
+        graph.destroy_edge(graph.flip(h2), graph.flip(h1));
+        REQUIRE(graph.edge_count() == 1);
+        REQUIRE(left_of(h2).empty());
+
+        graph.destroy_handle(h1);
+        REQUIRE(graph.node_size() == 2);
+        REQUIRE(graph.edge_count() == 0);
+        REQUIRE(!graph.has_node(1));
+    }
+
+    SECTION("nodes can be reoriented") {
+        handle_t flipped = graph.apply_orientation(graph.flip(h3));
+        REQUIRE(graph.get_id(flipped) == 10);
+        REQUIRE(graph.get_sequence(flipped) == "ATG");
+        REQUIRE(left_of(flipped) == vector<handle_t>{h1});
+    }
+
+    SECTION("nodes can be divided, and paths follow") {
+        graph.append_step("path", h1);
+        graph.append_step("path", h2);
+
+        auto parts = graph.divide_handle(graph.flip(h1), vector<size_t>{1, 3});
+        REQUIRE(parts.size() == 3);
+        REQUIRE(graph.get_sequence(parts[0]) == "A");
+        REQUIRE(graph.get_sequence(parts[1]) == "AT");
+        REQUIRE(graph.get_sequence(parts[2]) == "C");
+        REQUIRE(graph.get_id(parts[2]) == 1);
+        REQUIRE(left_of(graph.flip(parts[0])) == vector<handle_t>{graph.flip(parts[1])});
+        REQUIRE(right_of(graph.flip(parts[0])).size() == 2);
+
+        auto& path = graph.get_path("path");
+        REQUIRE(path == vector<handle_t>{graph.flip(parts[2]), graph.flip(parts[1]), graph.flip(parts[0]), h2});
+    }
+}
+
+TEST_CASE("PackedGraph round trips through the VG format", "[packed]") {
+
+    string graph_json = R"(
+    {"node": [{"id": 1, "sequence": "GATT"}, {"id": 2, "sequence": "ACA"}, {"id": 3, "sequence": "T"}],
+     "edge": [{"from": 1, "to": 2}, {"from": 1, "to": 3, "to_end": true}, {"from": 3, "to": 2, "from_start": true}],
+     "path": [{"name": "ref", "mapping": [
+         {"position": {"node_id": 1}, "rank": 1},
+         {"position": {"node_id": 2}, "edit": [{"from_length": 3, "to_length": 3}], "rank": 2}]}]}
+    )";
+
+    Graph source;
+    json2pb(source, graph_json.c_str(), graph_json.size());
+    VG vg(source);
+
+    stringstream vg_stream;
+    vg.serialize_to_ostream(vg_stream);
+    PackedGraph packed(vg_stream);
+
+    REQUIRE(packed.node_size() == 3);
+    REQUIRE(packed.edge_count() == 3);
+    REQUIRE(packed.get_path("ref") == vector<handle_t>{packed.get_handle(1), packed.get_handle(2)});
+
+    stringstream packed_stream;
+    packed.serialize(packed_stream);
+    VG loaded(packed_stream);
+
+    REQUIRE(loaded.node_count() == 3);
+    REQUIRE(loaded.edge_count() == 3);
+    REQUIRE(loaded.has_edge(NodeSide(1, true), NodeSide(3, true)));
+    REQUIRE(loaded.paths.has_path("ref"));
+    REQUIRE(loaded.paths.get_path("ref").size() == 2);
+
+    SECTION("paths over parts of nodes are rejected") {
+        Path* path = source.add_path();
+        path->set_name("partial");
+        Mapping* mapping = path->add_mapping();
+        mapping->mutable_position()->set_node_id(1);
+        mapping->mutable_position()->set_offset(1);
+
+        stringstream partial_stream;
+        VG(source).serialize_to_ostream(partial_stream);
+        REQUIRE_THROWS(PackedGraph(partial_stream));
+    }
+}
+
+}
+}
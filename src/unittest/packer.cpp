@@ -0,0 +1,258 @@
+/// \file packer.cpp
+///
+/// Unit tests for the Packer coverage and edit store
+
+#include "../packer.hpp"
+#include "../json2pb.h"
+
+#include "catch.hpp"
+
+#include <omp.h>
+#include <sstream>
+
+namespace vg {
+namespace unittest {
+using namespace std;
+
+TEST_CASE("Packer records coverage and edits", "[pack]") {
+
+    string graph_json = R"(
+    {"node": [{"id": 1, "sequence": "GATT"}, {"id": 2, "sequence": "ACA"}],
+     "edge": [{"from": 1, "to": 2}]}
+    )";
+
+    Graph graph;
+    json2pb(graph, graph_json.c_str(), graph_json.size());
+    xg::XG index(graph);
+
+    // A read of GCTTA: a match, a substitution, and then more matches
+    string aln_json = R"(
+    {"sequence": "GCTTA", "path": {"mapping": [
+        {"position": {"node_id": 1}, "edit": [
+            {"from_length": 1, "to_length": 1},
+            {"from_length": 1, "to_length": 1, "sequence": "C"},
+            {"from_length": 2, "to_length": 2}]},
+        {"position": {"node_id": 2}, "edit": [
+            {"from_length": 1, "to_length": 1}]}]}}
+    )";
+
+    Alignment aln;
+    json2pb(aln, aln_json.c_str(), aln_json.size());
+
+    Packer packer(&index);
+    // Add the read twice, so the edit shows up twice
+    packer.add(aln);
+    packer.add(aln);
+    packer.make_compact();
+
+    Position snp_pos;
+    snp_pos.set_node_id(1);
+    snp_pos.set_offset(1);
+    size_t snp = packer.position_in_basis(snp_pos);
+
+    SECTION("coverage comes from the matches") {
+        REQUIRE(packer.coverage_at_position(snp - 1) == 2);
+        REQUIRE(packer.coverage_at_position(snp) == 0);
+        REQUIRE(packer.coverage_at_position(snp + 1) == 2);
+    }
+
+    SECTION("edits can be found by position and by range") {
+        auto edits = packer.edits_at_position(snp);
+        REQUIRE(edits.size() == 2);
+        REQUIRE(edits[0].sequence() == "C");
+        REQUIRE(packer.edits_at_position(snp + 1).empty());
+
+        auto in_range = packer.edits_in_range(0, packer.graph_length());
+        REQUIRE(in_range.size() == 2);
+        REQUIRE(in_range[0].first == snp);
+    }
+
+    SECTION("a serialized packer has the same edits") {
+        stringstream buffer;
+        packer.serialize(buffer);
+
+        Packer loaded;
+        loaded.load(buffer);
+        REQUIRE(loaded.coverage_at_position(snp + 1) == 2);
+
+        auto edits = loaded.edits_at_position(snp);
+        REQUIRE(edits.size() == 2);
+        REQUIRE(edits[1].sequence() == "C");
+    }
+}
+
+TEST_CASE("Packer can be added to from many threads", "[pack]") {
+
+    string graph_json = R"(
+    {"node": [{"id": 1, "sequence": "GATT"}, {"id": 2, "sequence": "ACA"}],
+     "edge": [{"from": 1, "to": 2}]}
+    )";
+
+    Graph graph;
+    json2pb(graph, graph_json.c_str(), graph_json.size());
+    xg::XG index(graph);
+
+    string aln_json = R"(
+    {"sequence": "GCTTA", "path": {"mapping": [
+        {"position": {"node_id": 1}, "edit": [
+            {"from_length": 1, "to_length": 1},
+            {"from_length": 1, "to_length": 1, "sequence": "C"},
+            {"from_length": 2, "to_length": 2}]},
+        {"position": {"node_id": 2}, "edit": [
+            {"from_length": 1, "to_length": 1}]}]}}
+    )";
+
+    Alignment aln;
+    json2pb(aln, aln_json.c_str(), aln_json.size());
+
+    Packer packer(&index, 2);
+#pragma omp parallel for
+    for (size_t i = 0; i < 5000; i++) {
+        packer.add(aln);
+    }
+    packer.make_compact();
+
+    Position snp_pos;
+    snp_pos.set_node_id(1);
+    snp_pos.set_offset(1);
+    size_t snp = packer.position_in_basis(snp_pos);
+
+    REQUIRE(packer.coverage_at_position(snp - 1) == 5000);
+    REQUIRE(packer.coverage_at_position(snp + 3) == 5000);
+    REQUIRE(packer.edits_at_position(snp).size() == 5000);
+    REQUIRE(packer.edits_in_range(0, packer.graph_length()).size() == 5000);
+}
+
+TEST_CASE("Packer sums coverage over ranges and nodes", "[pack]") {
+
+    string graph_json = R"(
+    {"node": [{"id": 1, "sequence": "GATTACACATTAG"}, {"id": 2, "sequence": "C"},
+              {"id": 3, "sequence": "ATTAGGGCCCAGTAGACAT"}],
+     "edge": [{"from": 1, "to": 2}, {"from": 2, "to": 3}]}
+    )";
+
+    Graph graph;
+    json2pb(graph, graph_json.c_str(), graph_json.size());
+    xg::XG index(graph);
+
+    // Reads matching the whole of node 1, and staggered runs along node 3
+    Packer packer(&index);
+    for (size_t i = 0; i < 10; i++) {
+        string aln_json = "{\"path\": {\"mapping\": ["
+            "{\"position\": {\"node_id\": 1}, \"edit\": [{\"from_length\": 13, \"to_length\": 13}]},"
+            "{\"position\": {\"node_id\": 3, \"offset\": " + to_string(i) + "},"
+            " \"edit\": [{\"from_length\": 5, \"to_length\": 5}]}]}}";
+        Alignment aln;
+        json2pb(aln, aln_json.c_str(), aln_json.size());
+        packer.add(aln, false);
+    }
+
+    // Sum up ranges a base at a time before compacting
+    vector<size_t> prefix(1, 0);
+    for (size_t i = 0; i < packer.graph_length(); i++) {
+        prefix.push_back(prefix.back() + packer.coverage_at_position(i));
+    }
+    REQUIRE(packer.coverage_in_range(0, packer.graph_length()) == 13 * 10 + 5 * 10);
+    packer.make_compact();
+
+    auto check_ranges = [&](const Packer& p) {
+        for (size_t start = 0; start <= p.graph_length(); start++) {
+            for (size_t end = start; end <= p.graph_length() + 1; end++) {
+                REQUIRE(p.coverage_in_range(start, end) == prefix[min(end, p.graph_length())] - prefix[start]);
+            }
+        }
+    };
+
+    SECTION("ranges sum to the coverage of their positions at any sample rate") {
+        check_ranges(packer);
+        for (size_t rate : {1, 2, 7, 33, 64, 0}) {
+            packer.index_coverage(rate);
+            check_ranges(packer);
+        }
+    }
+
+    SECTION("a loaded packer sums ranges the same way") {
+        stringstream buffer;
+        packer.serialize(buffer);
+        Packer loaded(&index);
+        loaded.load(buffer);
+        check_ranges(loaded);
+    }
+
+    SECTION("node averages are the mean coverage over each node") {
+        REQUIRE(packer.average_node_coverage(1) == 10);
+        REQUIRE(packer.average_node_coverage(2) == 0);
+        REQUIRE(packer.average_node_coverage(3) == Approx(50.0 / 19));
+        vector<double> averages = packer.average_node_coverages();
+        REQUIRE(averages.size() == 3);
+        for (size_t i = 0; i < averages.size(); i++) {
+            REQUIRE(averages[i] == Approx(packer.average_node_coverage(index.rank_to_id(i + 1))));
+        }
+    }
+}
+
+TEST_CASE("Packer merges pack files", "[pack]") {
+
+    string graph_json = R"(
+    {"node": [{"id": 1, "sequence": "GATT"}, {"id": 2, "sequence": "ACA"}],
+     "edge": [{"from": 1, "to": 2}]}
+    )";
+
+    Graph graph;
+    json2pb(graph, graph_json.c_str(), graph_json.size());
+    xg::XG index(graph);
+
+    string aln_json = R"(
+    {"sequence": "GCTTA", "path": {"mapping": [
+        {"position": {"node_id": 1}, "edit": [
+            {"from_length": 1, "to_length": 1},
+            {"from_length": 1, "to_length": 1, "sequence": "C"},
+            {"from_length": 2, "to_length": 2}]},
+        {"position": {"node_id": 2}, "edit": [
+            {"from_length": 1, "to_length": 1}]}]}}
+    )";
+
+    Alignment aln;
+    json2pb(aln, aln_json.c_str(), aln_json.size());
+
+    // Write out more packs than there are threads, with i copies of the read in pack i
+    int threads = get_thread_count();
+    omp_set_num_threads(2);
+    vector<string> file_names;
+    for (size_t i = 1; i <= 5; i++) {
+        Packer packer(&index, 2);
+        for (size_t j = 0; j < i; j++) {
+            packer.add(aln);
+        }
+        file_names.push_back(temp_file::create());
+        packer.save_to_file(file_names.back());
+    }
+
+    Packer merged(&index);
+    merged.merge_from_files(file_names);
+    merged.make_compact();
+    omp_set_num_threads(threads);
+    REQUIRE(merged.get_bin_size() == 2);
+
+    Position snp_pos;
+    snp_pos.set_node_id(1);
+    snp_pos.set_offset(1);
+    size_t snp = merged.position_in_basis(snp_pos);
+
+    REQUIRE(merged.coverage_at_position(snp - 1) == 15);
+    REQUIRE(merged.coverage_at_position(snp) == 0);
+    REQUIRE(merged.coverage_in_range(0, merged.graph_length()) == 15 * 4);
+    auto edits = merged.edits_at_position(snp);
+    REQUIRE(edits.size() == 15);
+    for (auto& edit : edits) {
+        REQUIRE(edit.sequence() == "C");
+    }
+    REQUIRE(merged.edits_in_range(0, merged.graph_length()).size() == 15);
+
+    for (auto& file_name : file_names) {
+        temp_file::remove(file_name);
+    }
+}
+
+}
+}
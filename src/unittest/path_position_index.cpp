@@ -0,0 +1,87 @@
+/// \file path_position_index.cpp
+///
+/// Unit tests for the PathPositionIndex, which looks up node positions on paths
+
+#include <iostream>
+#include "json2pb.h"
+#include "vg.pb.h"
+#include "../path_position_index.hpp"
+#include "catch.hpp"
+
+namespace vg {
+namespace unittest {
+
+TEST_CASE( "PathPositionIndex gives the same path positions as the xg", "[xg][paths]" ) {
+
+    // Node 2 is visited twice by path x, and nodes 1 and 4 are on both paths
+    string graph_json = R"({
+        "node": [
+            {"id": 1, "sequence": "GATT"},
+            {"id": 2, "sequence": "ACA"},
+            {"id": 3, "sequence": "TT"},
+            {"id": 4, "sequence": "GGCAT"},
+            {"id": 5, "sequence": "C"}
+        ],
+        "edge": [
+            {"from": 1, "to": 2},
+            {"from": 2, "to": 3},
+            {"from": 3, "to": 2},
+            {"from": 2, "to": 4},
+            {"from": 1, "to": 4},
+            {"from": 4, "to": 5}
+        ],
+        "path": [
+            {"name": "x", "mapping": [
+                {"position": {"node_id": 1}, "rank": 1},
+                {"position": {"node_id": 2}, "rank": 2},
+                {"position": {"node_id": 3}, "rank": 3},
+                {"position": {"node_id": 2}, "rank": 4},
+                {"position": {"node_id": 4}, "rank": 5}
+            ]},
+            {"name": "y", "mapping": [
+                {"position": {"node_id": 4, "is_reverse": true}, "rank": 1},
+                {"position": {"node_id": 1, "is_reverse": true}, "rank": 2}
+            ]}
+        ]
+    })";
+
+    Graph proto_graph;
+    json2pb(proto_graph, graph_json.c_str(), graph_json.size());
+    xg::XG xg_index(proto_graph);
+
+    SECTION( "all paths are indexed by default" ) {
+        PathPositionIndex index(xg_index);
+        REQUIRE(index.path_count() == 2);
+        REQUIRE(index.multiple_occurrence_count() == 3);
+
+        for (id_t id = 1; id <= 5; id++) {
+            for (bool rev : {false, true}) {
+                for (size_t off = 0; off < xg_index.node_length(id); off++) {
+                    pos_t pos = make_pos_t(id, rev, off);
+                    REQUIRE(index.offsets_in_paths(pos) == xg_index.offsets_in_paths(pos));
+                    REQUIRE(index.nearest_offsets_in_paths(pos, 10) == xg_index.nearest_offsets_in_paths(pos, 10));
+                    REQUIRE(index.position_in_paths(id, rev, off) == xg_index.position_in_paths(id, rev, off));
+                }
+            }
+        }
+    }
+
+    SECTION( "only the named paths are reported" ) {
+        PathPositionIndex index(xg_index, {"y"});
+        REQUIRE(index.path_count() == 1);
+        REQUIRE(index.multiple_occurrence_count() == 0);
+
+        auto offsets = index.offsets_in_paths(make_pos_t(1, false, 2));
+        REQUIRE(offsets.size() == 1);
+        REQUIRE(offsets["y"] == xg_index.offsets_in_paths(make_pos_t(1, false, 2))["y"]);
+        REQUIRE(index.offsets_in_paths(make_pos_t(3, false, 0)).empty());
+        REQUIRE(index.offsets_in_paths(make_pos_t(5, false, 0)).empty());
+    }
+
+    SECTION( "unknown paths are rejected" ) {
+        REQUIRE_THROWS(PathPositionIndex(xg_index, {"z"}));
+    }
+}
+
+}
+}
@@ -1071,8 +1071,22 @@ namespace vg {
                 identify_start_subpaths(multipath_aln);
                 
                 REQUIRE( genome.optimal_score_on_genome(multipath_aln, graph) == 6 + 1 + 9 );
+
+                SECTION( "PhasedGenome gives the same scores for a batch of multipath alignments" ) {
+
+                    MultipathAlignment other_aln = multipath_aln;
+                    other_aln.mutable_subpath(2)->set_score(-2);
+
+                    vector<MultipathAlignment> multipath_alns{multipath_aln, other_aln, multipath_aln};
+                    vector<int32_t> scores = genome.optimal_score_on_genome(multipath_alns, graph);
+
+                    REQUIRE( scores.size() == 3 );
+                    REQUIRE( scores[0] == 6 + 1 + 9 );
+                    REQUIRE( scores[1] == genome.optimal_score_on_genome(other_aln, graph) );
+                    REQUIRE( scores[2] == 6 + 1 + 9 );
+                }
             }
-            
+
             SECTION( "PhasedGenome can compute the score of a restricted multipath alignment on the reverse strand") {
                 
                 // construct graph
@@ -0,0 +1,72 @@
+/// \file prune.cpp
+///
+/// Unit tests for finding the complex edges to prune before GCSA indexing
+
+#include "../prune.hpp"
+#include "../vg.hpp"
+#include "../json2pb.h"
+
+#include "catch.hpp"
+
+#include <algorithm>
+
+namespace vg {
+namespace unittest {
+using namespace std;
+
+TEST_CASE("Edges to prune are found once across components", "[prune]") {
+
+    // Two copies of a pair of SNP bubbles, as separate components
+    string graph_json = R"(
+    {"node": [{"id": 1, "sequence": "G"}, {"id": 2, "sequence": "A"}, {"id": 3, "sequence": "C"},
+              {"id": 4, "sequence": "T"}, {"id": 5, "sequence": "A"}, {"id": 6, "sequence": "C"},
+              {"id": 7, "sequence": "G"},
+              {"id": 11, "sequence": "G"}, {"id": 12, "sequence": "A"}, {"id": 13, "sequence": "C"},
+              {"id": 14, "sequence": "T"}, {"id": 15, "sequence": "A"}, {"id": 16, "sequence": "C"},
+              {"id": 17, "sequence": "G"}],
+     "edge": [{"from": 1, "to": 2}, {"from": 1, "to": 3}, {"from": 2, "to": 4}, {"from": 3, "to": 4},
+              {"from": 4, "to": 5}, {"from": 4, "to": 6}, {"from": 5, "to": 7}, {"from": 6, "to": 7},
+              {"from": 11, "to": 12}, {"from": 11, "to": 13}, {"from": 12, "to": 14}, {"from": 13, "to": 14},
+              {"from": 14, "to": 15}, {"from": 14, "to": 16}, {"from": 15, "to": 17}, {"from": 16, "to": 17}]}
+    )";
+
+    Graph graph;
+    json2pb(graph, graph_json.c_str(), graph_json.size());
+    VG vg(graph);
+
+    auto as_integers = [](vector<edge_t> edges) {
+        vector<pair<int64_t, int64_t>> integers;
+        for (auto& e : edges) {
+            integers.emplace_back(as_integer(e.first), as_integer(e.second));
+        }
+        sort(integers.begin(), integers.end());
+        return integers;
+    };
+
+    SECTION("with no branching allowed, every edge next to a fork is pruned once") {
+        auto edges = as_integers(find_edges_to_prune(vg, 8, 0));
+        REQUIRE(edges.size() == 16);
+        REQUIRE(unique(edges.begin(), edges.end()) == edges.end());
+    }
+
+    SECTION("with enough branching allowed, nothing is pruned") {
+        REQUIRE(find_edges_to_prune(vg, 8, 4).empty());
+    }
+
+    SECTION("going by component finds the same edges") {
+        auto whole = as_integers(find_edges_to_prune(vg, 8, 1));
+        REQUIRE(!whole.empty());
+
+        vector<edge_t> by_component;
+        size_t components = 0;
+        for_each_component_edges_to_prune(vg, 8, 1, [&](const vector<edge_t>& edges) {
+            by_component.insert(by_component.end(), edges.begin(), edges.end());
+            components++;
+        });
+        REQUIRE(components == 2);
+        REQUIRE(as_integers(by_component) == whole);
+    }
+}
+
+}
+}
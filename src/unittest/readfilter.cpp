@@ -4,6 +4,9 @@
 
 #include "catch.hpp"
 #include "readfilter.hpp"
+#include "stream.hpp"
+
+#include <sstream>
 
 namespace vg {
 namespace unittest {
@@ -270,6 +273,44 @@ TEST_CASE("reads with ambiguous ends can be trimmed", "[filter]") {
 
 }
 
+TEST_CASE("filtering keeps the surviving reads in input order", "[filter]") {
+    
+    // Make reads with a range of mapping qualities and no paths
+    vector<Alignment> reads;
+    for (size_t i = 0; i < 5000; i++) {
+        reads.emplace_back();
+        reads.back().set_name("read" + to_string(i));
+        reads.back().set_sequence("GATTACA");
+        reads.back().set_mapping_quality(i % 60);
+    }
+    stringstream gam;
+    stream::write_buffered(gam, reads, 0);
+    
+    ReadFilter filter;
+    filter.min_mapq = 30;
+    filter.threads = 2;
+    
+    // Catch what goes to standard output
+    stringstream filtered;
+    auto old_buffer = cout.rdbuf(filtered.rdbuf());
+    int status = filter.filter(&gam);
+    cout.rdbuf(old_buffer);
+    REQUIRE(status == 0);
+    
+    vector<string> names;
+    stream::for_each<Alignment>(filtered, [&](Alignment& aln) {
+        REQUIRE(aln.mapping_quality() >= 30);
+        names.push_back(aln.name());
+    });
+    
+    vector<string> expected;
+    for (auto& read : reads) {
+        if (read.mapping_quality() >= 30) {
+            expected.push_back(read.name());
+        }
+    }
+    REQUIRE(names == expected);
+}
 
 }
 }
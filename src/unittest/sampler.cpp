@@ -2,6 +2,7 @@
 ///  
 /// unit tests for the Sampler
 
+#include <cmath>
 #include <iostream>
 #include <unordered_set>
 #include <utility>
@@ -293,8 +294,98 @@ TEST_CASE( "Sampler can across reversing edges", "[sampler]" ) {
     }
 }
 
+TEST_CASE( "AliasTable draws indexes in proportion to their weights", "[sampler]" ) {
+    
+    AliasTable table({1.0, 0.0, 3.0, 4.0});
+    REQUIRE(table.size() == 4);
+    
+    mt19937 rng(1337);
+    vector<size_t> counts(4, 0);
+    size_t draws = 80000;
+    for (size_t i = 0; i < draws; i++) {
+        size_t drawn = table(rng);
+        REQUIRE(drawn < 4);
+        counts[drawn]++;
+    }
+    
+    // Things with no weight are never drawn
+    REQUIRE(counts[1] == 0);
+    // And the rest come up about as often as they should
+    REQUIRE(abs((double) counts[0] / draws - 0.125) < 0.01);
+    REQUIRE(abs((double) counts[2] / draws - 0.375) < 0.01);
+    REQUIRE(abs((double) counts[3] / draws - 0.5) < 0.01);
+    
+    SECTION( "A single index is always drawn" ) {
+        AliasTable single({5.0});
+        for (size_t i = 0; i < 100; i++) {
+            REQUIRE(single(rng) == 0);
+        }
+    }
+    
+    SECTION( "Tables need some weight" ) {
+        REQUIRE_THROWS(AliasTable({0.0, 0.0}));
+        REQUIRE_THROWS(AliasTable(vector<double>()));
+    }
 }
 
+TEST_CASE( "Reseeded samplers make the same reads", "[sampler]" ) {
+    
+    string graph_json = R"({
+        "node": [
+            {"id": 1, "sequence": "GATTACA"},
+            {"id": 2, "sequence": "C"},
+            {"id": 3, "sequence": "T"},
+            {"id": 4, "sequence": "CATTAGGA"}
+        ],
+        "edge": [
+            {"from": 1, "to": 2},
+            {"from": 1, "to": 3},
+            {"from": 2, "to": 4},
+            {"from": 3, "to": 4}
+        ]
+    })";
+    
+    // Load the JSON
+    Graph proto_graph;
+    json2pb(proto_graph, graph_json.c_str(), graph_json.size());
+    
+    // Build the xg index
+    xg::XG xg_index(proto_graph);
+    
+    SECTION( "Substream seeds are distinct and nonzero" ) {
+        unordered_set<size_t> seeds;
+        for (size_t i = 0; i < 1000; i++) {
+            size_t seed = substream_seed(1337, i);
+            REQUIRE(seed != 0);
+            seeds.insert(seed);
+        }
+        REQUIRE(seeds.size() == 1000);
+        REQUIRE(substream_seed(1337, 5) == substream_seed(1337, 5));
+        REQUIRE(substream_seed(1337, 5) != substream_seed(1338, 5));
+    }
+    
+    SECTION( "Samplers reseeded the same way agree, whatever they did before" ) {
+        Sampler first(&xg_index, 1);
+        Sampler second(&xg_index, 2);
+        
+        // Put the second one somewhere else in its stream
+        for (size_t i = 0; i < 10; i++) {
+            second.alignment_with_error(5, 0.1, 0.1);
+        }
+        
+        first.reseed(substream_seed(1337, 3), 3000);
+        second.reseed(substream_seed(1337, 3), 3000);
+        
+        for (size_t i = 0; i < 20; i++) {
+            Alignment a = first.alignment_with_error(5, 0.1, 0.1);
+            Alignment b = second.alignment_with_error(5, 0.1, 0.1);
+            REQUIRE(a.name() == b.name());
+            REQUIRE(a.sequence() == b.sequence());
+            REQUIRE(pb2json(a.path()) == pb2json(b.path()));
+        }
+    }
 }
 
-    
+}
+
+}
@@ -0,0 +1,140 @@
+/// \file sequence_ops.cpp
+///
+/// Unit tests for the vectorized sequence kernels, against simple loops
+
+#include "../sequence_ops.hpp"
+
+#include "catch.hpp"
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace vg {
+namespace unittest {
+using namespace std;
+
+/// Make a random string from the given alphabet
+static string random_sequence(size_t length, const string& alphabet, default_random_engine& engine) {
+    uniform_int_distribution<size_t> pick(0, alphabet.size() - 1);
+    string seq(length, 'N');
+    for (auto& c : seq) {
+        c = alphabet[pick(engine)];
+    }
+    return seq;
+}
+
+/// Reverse complement the simple way, through the table
+static string slow_reverse_complement(const string& seq) {
+    string rc(seq.rbegin(), seq.rend());
+    for (auto& c : rc) {
+        c = complement_of(c);
+    }
+    return rc;
+}
+
+TEST_CASE("Sequence kernels agree with simple loops", "[sequence]") {
+
+    default_random_engine engine(1234);
+    // Lengths around the vector sizes, and long ones with tails
+    vector<size_t> lengths {0, 1, 2, 15, 16, 17, 31, 32, 33, 63, 64, 65, 100, 1001};
+    string bases = "ACGT";
+    string with_n = "ACGTN";
+    string anything = "ACGTNacgtnRYKMBDHVSW-#$x!";
+
+    SECTION("complement handles case, IUPAC codes, and GCSA2 characters") {
+        REQUIRE(complement_of('A') == 'T');
+        REQUIRE(complement_of('g') == 'c');
+        REQUIRE(complement_of('R') == 'Y');
+        REQUIRE(complement_of('#') == '$');
+        REQUIRE(complement_of('x') == 'N');
+        REQUIRE(complement_of((char) 0xC1) == 'N');
+    }
+
+    SECTION("reverse complements match, in place and out") {
+        for (auto& alphabet : {bases, with_n, anything}) {
+            for (size_t length : lengths) {
+                string seq = random_sequence(length, alphabet, engine);
+                string expected = slow_reverse_complement(seq);
+
+                string into(length, ' ');
+                reverse_complement_into(seq.data(), length, &into[0]);
+                REQUIRE(into == expected);
+
+                string in_place = seq;
+                reverse_complement_in_place(&in_place[0], length);
+                REQUIRE(in_place == expected);
+            }
+        }
+    }
+
+    SECTION("upper casing and N handling match") {
+        for (auto& alphabet : {bases, with_n, anything}) {
+            for (size_t length : lengths) {
+                string seq = random_sequence(length, alphabet, engine);
+
+                string upper = seq;
+                to_uppercase_in_place(&upper[0], length);
+                string expected_upper = seq;
+                for (auto& c : expected_upper) {
+                    c = toupper(c);
+                }
+                REQUIRE(upper == expected_upper);
+
+                auto is_acgt = [](char c) { return c == 'A' || c == 'C' || c == 'G' || c == 'T'; };
+                REQUIRE(all_ACGT(seq.data(), length) == all_of(seq.begin(), seq.end(), is_acgt));
+                REQUIRE(all_ACGTN(seq.data(), length) == all_of(seq.begin(), seq.end(), [&](char c) {
+                    return is_acgt(c) || c == 'N';
+                }));
+
+                string cleaned = seq;
+                non_ACGTN_to_N_in_place(&cleaned[0], length);
+                string expected_cleaned = seq;
+                for (auto& c : expected_cleaned) {
+                    if (!is_acgt(c) && c != 'N') {
+                        c = 'N';
+                    }
+                }
+                REQUIRE(cleaned == expected_cleaned);
+
+                size_t upper_ns = count(seq.begin(), seq.end(), 'N');
+                REQUIRE(count_Ns(seq.data(), length) == upper_ns);
+                REQUIRE(count_Ns(seq.data(), length, true) == upper_ns + count(seq.begin(), seq.end(), 'n'));
+            }
+        }
+    }
+
+    SECTION("2-bit packing round trips") {
+        for (size_t length : lengths) {
+            string seq = random_sequence(length, "ACGTacgt", engine);
+            vector<uint8_t> packed((length + 3) / 4);
+            REQUIRE(pack_2bit(seq.data(), length, packed.data()));
+
+            string unpacked(length, ' ');
+            unpack_2bit(packed.data(), length, &unpacked[0]);
+            to_uppercase_in_place(&seq[0], length);
+            REQUIRE(unpacked == seq);
+
+            // The first base is in the low bits
+            if (length > 0) {
+                REQUIRE((packed[0] & 3) == string("ACGT").find(seq[0]));
+            }
+        }
+
+        // Anything else is reported, and packed as A
+        string seq = random_sequence(40, bases, engine);
+        seq[5] = 'N';
+        seq[37] = 'N';
+        vector<uint8_t> packed(10);
+        REQUIRE(!pack_2bit(seq.data(), seq.size(), packed.data()));
+        string unpacked(seq.size(), ' ');
+        unpack_2bit(packed.data(), seq.size(), &unpacked[0]);
+        seq[5] = 'A';
+        seq[37] = 'A';
+        REQUIRE(unpacked == seq);
+    }
+}
+
+}
+}
@@ -0,0 +1,68 @@
+/// \file shard_router.cpp
+///
+/// Unit tests for the ShardRouter, which says which shard of a split-up graph each node is in
+
+#include <iostream>
+#include <sstream>
+#include "../vg.hpp"
+#include "../shard_router.hpp"
+#include "catch.hpp"
+
+namespace vg {
+namespace unittest {
+
+TEST_CASE( "ShardRouter keeps components together and balances shards", "[shard][xg]" ) {
+
+    VG graph;
+
+    // A big component with IDs 1-3
+    Node* n1 = graph.create_node("GATTACAGATTACA");
+    Node* n2 = graph.create_node("CAT");
+    Node* n3 = graph.create_node("GAT");
+    graph.create_edge(n1, n2);
+    graph.create_edge(n2, n3);
+
+    // Two small components with IDs 4-5 and 6
+    Node* n4 = graph.create_node("ACGT");
+    Node* n5 = graph.create_node("TTTT");
+    graph.create_edge(n4, n5);
+    graph.create_node("GGGGGG");
+
+    ShardRouter router(graph, 2);
+
+    SECTION( "each component is in one shard and the big one is alone" ) {
+        REQUIRE(router.shard_count() == 2);
+        REQUIRE(router.shard_of(1) == router.shard_of(2));
+        REQUIRE(router.shard_of(2) == router.shard_of(3));
+        REQUIRE(router.shard_of(4) == router.shard_of(5));
+        REQUIRE(router.shard_of(4) == router.shard_of(6));
+        REQUIRE(router.shard_of(1) != router.shard_of(4));
+        REQUIRE(router.shard_length(router.shard_of(1)) == 20);
+        REQUIRE(router.shard_length(router.shard_of(4)) == 14);
+    }
+
+    SECTION( "IDs outside the graph are in no shard" ) {
+        REQUIRE(router.shard_of(0) == router.shard_count());
+        REQUIRE(router.shard_of(7) == router.shard_count());
+    }
+
+    SECTION( "reads are routed to every shard their seeds hit" ) {
+        REQUIRE(router.shards_of({2, 3}) == vector<size_t>{router.shard_of(1)});
+        REQUIRE(router.shards_of({5, 1, 100}).size() == 2);
+    }
+
+    SECTION( "the router survives serialization" ) {
+        stringstream tsv;
+        router.serialize(tsv);
+        ShardRouter loaded;
+        loaded.load(tsv);
+        REQUIRE(loaded.shard_count() == 2);
+        for (id_t id = 0; id <= 7; id++) {
+            REQUIRE(loaded.shard_of(id) == router.shard_of(id));
+        }
+        REQUIRE(loaded.shard_length(0) == router.shard_length(0));
+    }
+}
+
+}
+}
@@ -0,0 +1,65 @@
+/// \file sharded_cache.cpp
+///
+/// Unit tests for the thread-safe sharded LRU cache
+
+#include "../sharded_cache.hpp"
+
+#include "catch.hpp"
+
+#include <omp.h>
+#include <string>
+
+namespace vg {
+namespace unittest {
+using namespace std;
+
+TEST_CASE("ShardedCache stores, evicts, and counts", "[cache]") {
+
+    ShardedCache<int64_t, string> cache(4, 2);
+
+    SECTION("missing items are reported as misses") {
+        REQUIRE(!cache.retrieve(1).second);
+        REQUIRE(cache.misses() == 1);
+        REQUIRE(cache.hits() == 0);
+    }
+
+    SECTION("stored items can be retrieved") {
+        cache.put(1, "GATTACA");
+        auto found = cache.retrieve(1);
+        REQUIRE(found.second);
+        REQUIRE(found.first == "GATTACA");
+        REQUIRE(cache.hits() == 1);
+    }
+
+    SECTION("the cache does not grow past its capacity") {
+        for (int64_t i = 0; i < 100; i++) {
+            cache.put(i, to_string(i));
+        }
+        REQUIRE(cache.size() <= 4);
+    }
+}
+
+TEST_CASE("ShardedCache can be used from many threads", "[cache]") {
+
+    ShardedCache<int64_t, int64_t> cache(256);
+
+    size_t wrong = 0;
+#pragma omp parallel for reduction(+:wrong)
+    for (int64_t i = 0; i < 10000; i++) {
+        int64_t key = i % 100;
+        auto found = cache.retrieve(key);
+        if (found.second) {
+            if (found.first != key * 2) {
+                wrong++;
+            }
+        } else {
+            cache.put(key, key * 2);
+        }
+    }
+
+    REQUIRE(wrong == 0);
+    REQUIRE(cache.hits() + cache.misses() == 10000);
+}
+
+}
+}
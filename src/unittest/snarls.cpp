@@ -2432,6 +2432,107 @@ namespace vg {
             
         }
         
+        TEST_CASE("Snarls can be found one connected component at a time", "[snarls]") {
+            
+            // Two bubbles that aren't connected to each other, and a loose node
+            VG graph;
+            
+            Node* n1 = graph.create_node("GCA");
+            Node* n2 = graph.create_node("T");
+            Node* n3 = graph.create_node("G");
+            Node* n4 = graph.create_node("CTGA");
+            Node* n5 = graph.create_node("GCA");
+            Node* n6 = graph.create_node("T");
+            Node* n7 = graph.create_node("G");
+            Node* n8 = graph.create_node("CTGA");
+            graph.create_node("A");
+            
+            graph.create_edge(n1, n2);
+            graph.create_edge(n1, n3);
+            graph.create_edge(n2, n4);
+            graph.create_edge(n3, n4);
+            graph.create_edge(n5, n6);
+            graph.create_edge(n5, n7);
+            graph.create_edge(n6, n8);
+            graph.create_edge(n7, n8);
+            
+            SnarlManager snarl_manager = CactusSnarlFinder(graph).find_snarls_parallel();
+            
+            SECTION("Each component's snarl is found") {
+                REQUIRE(snarl_manager.top_level_snarls().size() == 2);
+                
+                set<pair<id_t, id_t>> found;
+                for (const Snarl* snarl : snarl_manager.top_level_snarls()) {
+                    found.insert(make_pair(min(snarl->start().node_id(), snarl->end().node_id()),
+                                           max(snarl->start().node_id(), snarl->end().node_id())));
+                    REQUIRE(snarl->type() == ULTRABUBBLE);
+                }
+                
+                REQUIRE(found.count(make_pair(n1->id(), n4->id())));
+                REQUIRE(found.count(make_pair(n5->id(), n8->id())));
+            }
+        }
+        
+        TEST_CASE("SnarlManager numbers snarls densely", "[snarls]") {
+            
+            // A snarl from 1 to 6 containing a snarl from 2 to 5
+            VG graph;
+            
+            Node* n1 = graph.create_node("GCA");
+            Node* n2 = graph.create_node("T");
+            Node* n3 = graph.create_node("G");
+            Node* n4 = graph.create_node("CTGA");
+            Node* n5 = graph.create_node("GCA");
+            Node* n6 = graph.create_node("T");
+            
+            graph.create_edge(n1, n2);
+            graph.create_edge(n1, n6);
+            graph.create_edge(n2, n3);
+            graph.create_edge(n2, n4);
+            graph.create_edge(n3, n5);
+            graph.create_edge(n4, n5);
+            graph.create_edge(n5, n6);
+            
+            SnarlManager snarl_manager = CactusSnarlFinder(graph).find_snarls();
+            
+            REQUIRE(snarl_manager.num_snarls() == 2);
+            
+            SECTION("Numbers and snarls convert back and forth") {
+                set<size_t> numbers;
+                snarl_manager.for_each_snarl_preorder([&](const Snarl* snarl) {
+                    size_t number = snarl_manager.number_of(snarl);
+                    REQUIRE(number < snarl_manager.num_snarls());
+                    REQUIRE(snarl_manager.snarl_by_number(number) == snarl);
+                    numbers.insert(number);
+                });
+                REQUIRE(numbers.size() == 2);
+            }
+            
+            SECTION("Snarls we don't own are found by their boundaries") {
+                const Snarl* child = snarl_manager.into_which_snarl(n2->id(), false);
+                if (child == nullptr) {
+                    child = snarl_manager.into_which_snarl(n5->id(), true);
+                }
+                REQUIRE(child != nullptr);
+                
+                Snarl copy = *child;
+                REQUIRE(snarl_manager.number_of(&copy) == snarl_manager.number_of(child));
+                REQUIRE(snarl_manager.parent_of(&copy) == snarl_manager.parent_of(child));
+                REQUIRE(snarl_manager.parent_of(&copy) != nullptr);
+                REQUIRE(snarl_manager.chain_of(&copy) == snarl_manager.chain_of(child));
+            }
+            
+            SECTION("Flipping a snarl keeps its place in the tree") {
+                const Snarl* root = snarl_manager.top_level_snarls().front();
+                size_t number = snarl_manager.number_of(root);
+                snarl_manager.flip(root);
+                
+                REQUIRE(snarl_manager.number_of(root) == number);
+                REQUIRE(snarl_manager.children_of(root).size() == 1);
+                REQUIRE(snarl_manager.manage(*root) == root);
+            }
+        }
+        
         TEST_CASE("SnarlManager accepts chain input", "[snarls]") {
             // Make a little graph where snarl1 and snarl2 are a top-level
             // chain, and snarl3 and snarl4 are trivial chains inside snarl1
@@ -0,0 +1,68 @@
+/// \file staged_pipeline.cpp
+///
+/// Unit tests for running work through threaded stages
+
+#include "../staged_pipeline.hpp"
+
+#include "catch.hpp"
+
+#include <omp.h>
+#include <sstream>
+#include <vector>
+
+namespace vg {
+namespace unittest {
+using namespace std;
+
+TEST_CASE("StagedPipeline runs every item through every stage in order", "[pipeline]") {
+
+    // Each item records the stages it has been through
+    StagedPipeline<vector<int>> pipeline(7);
+    for (int s = 0; s < 3; s++) {
+        pipeline.add_stage("stage " + to_string(s), 2, [s](vector<int>& item) {
+            item.push_back(s);
+        });
+    }
+    REQUIRE(pipeline.thread_count() == 7);
+
+    vector<bool> seen(1000, false);
+    bool all_staged = true;
+    pipeline.add_stage("check", 1, [&](vector<int>& item) {
+        // Only one thread checks, so we can write here
+        all_staged = all_staged && item.size() == 4 &&
+            item[1] == 0 && item[2] == 1 && item[3] == 2;
+        seen.at(item.front()) = true;
+    });
+
+    size_t count = pipeline.run([&](const function<void(vector<int>&)>& emit) {
+        for (int i = 0; i < 1000; i++) {
+            vector<int> item{i};
+            emit(item);
+        }
+    });
+
+    REQUIRE(count == 1000);
+    REQUIRE(all_staged);
+    for (bool was_seen : seen) {
+        REQUIRE(was_seen);
+    }
+
+    stringstream report;
+    pipeline.report(report);
+    REQUIRE(report.str().find("check: 1 threads, 1000 items") != string::npos);
+}
+
+TEST_CASE("StagedPipeline works with an empty source", "[pipeline]") {
+
+    StagedPipeline<int> pipeline;
+    size_t done = 0;
+    pipeline.add_stage("count", 1, [&](int& item) {
+        done++;
+    });
+
+    REQUIRE(pipeline.run([&](const function<void(int&)>& emit) {}) == 0);
+    REQUIRE(done == 0);
+}
+
+}
+}
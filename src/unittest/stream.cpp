@@ -305,6 +305,50 @@ TEST_CASE("ProtobufIterator can read serialized data", "[stream]") {
     }
 }
 
+TEST_CASE("OutputQueue writes ordered chunks in sequence order", "[stream]") {
+    stringstream out;
+    
+    size_t chunk_count = 200;
+    {
+        stream::OutputQueue queue(out, 8);
+#pragma omp parallel for schedule(dynamic, 1)
+        for (size_t i = 0; i < chunk_count; i++) {
+            queue.push(i, to_string(i) + "\n");
+        }
+        queue.close();
+    }
+    
+    stringstream expected;
+    for (size_t i = 0; i < chunk_count; i++) {
+        expected << i << "\n";
+    }
+    REQUIRE(out.str() == expected.str());
+}
+
+TEST_CASE("OutputQueue can write GAM groups from many threads", "[stream]") {
+    stringstream datastream;
+    
+    size_t group_count = 50;
+    {
+        stream::OutputQueue queue(datastream);
+#pragma omp parallel for
+        for (size_t i = 0; i < group_count; i++) {
+            vector<Graph> group(1);
+            group.front().add_node()->set_id(i + 1);
+            queue.push(stream::serialize_group(group));
+        }
+        queue.close();
+    }
+    stream::finish(datastream);
+    
+    vector<bool> seen(group_count, false);
+    stream::for_each<Graph>(datastream, [&](const Graph& item) {
+        REQUIRE(item.node_size() == 1);
+        seen.at(item.node(0).id() - 1) = true;
+    });
+    REQUIRE(count(seen.begin(), seen.end(), true) == group_count);
+}
+
 }
 
 }
@@ -0,0 +1,155 @@
+/// \file subhandlegraph.cpp
+///
+/// Unit tests for the SubHandleGraph view and the XG extractions into it
+
+#include <iostream>
+#include <set>
+#include <tuple>
+#include "json2pb.h"
+#include "vg.pb.h"
+#include "../xg.hpp"
+#include "../subhandlegraph.hpp"
+#include "catch.hpp"
+
+namespace vg {
+namespace unittest {
+
+using namespace std;
+
+/// Get the node IDs of a Protobuf graph
+static set<id_t> node_ids(const Graph& g) {
+    set<id_t> ids;
+    for (auto& node : g.node()) {
+        ids.insert(node.id());
+    }
+    return ids;
+}
+
+/// Get the node IDs of a view
+static set<id_t> node_ids(const SubHandleGraph& g) {
+    set<id_t> ids;
+    g.for_each_handle([&](const handle_t& handle) {
+        ids.insert(g.get_id(handle));
+    });
+    return ids;
+}
+
+/// Get the edges of a Protobuf graph in canonical orientation, as handles of
+/// the given XG
+static set<pair<int64_t, int64_t>> edge_set(const Graph& g, const xg::XG& xg_index) {
+    set<pair<int64_t, int64_t>> edges;
+    for (auto& edge : g.edge()) {
+        auto canonical = xg_index.edge_handle(xg_index.get_handle(edge.from(), edge.from_start()),
+                                              xg_index.get_handle(edge.to(), edge.to_end()));
+        edges.emplace(as_integer(canonical.first), as_integer(canonical.second));
+    }
+    return edges;
+}
+
+TEST_CASE( "SubHandleGraph extractions match the Graph extractions of the xg", "[xg][handle]" ) {
+
+    // Node 3 has a reversing self loop on its end, and node 4 is entered
+    // backward from node 2
+    string graph_json = R"({
+        "node": [
+            {"id": 1, "sequence": "GATT"},
+            {"id": 2, "sequence": "ACA"},
+            {"id": 3, "sequence": "TT"},
+            {"id": 4, "sequence": "GGCAT"},
+            {"id": 5, "sequence": "C"},
+            {"id": 6, "sequence": "AAAAAAAAAAAA"},
+            {"id": 7, "sequence": "G"}
+        ],
+        "edge": [
+            {"from": 1, "to": 2},
+            {"from": 2, "to": 3},
+            {"from": 3, "to": 3, "to_end": true},
+            {"from": 2, "to": 4, "to_end": true},
+            {"from": 4, "to": 5, "from_start": true},
+            {"from": 3, "to": 5},
+            {"from": 5, "to": 6},
+            {"from": 6, "to": 7}
+        ]
+    })";
+
+    Graph proto_graph;
+    json2pb(proto_graph, graph_json.c_str(), graph_json.size());
+    xg::XG xg_index(proto_graph);
+
+    for (bool use_steps : {true, false}) {
+        for (size_t dist : {0, 1, 2, 3, 6}) {
+            for (id_t start = 1; start <= 7; start++) {
+                Graph g;
+                xg_index.neighborhood(start, dist, g, use_steps);
+                SubHandleGraph view(&xg_index);
+                xg_index.neighborhood(start, dist, view, use_steps);
+
+                REQUIRE(node_ids(view) == node_ids(g));
+                REQUIRE(view.node_size() == node_ids(g).size());
+
+                Graph converted;
+                view.to_graph(converted);
+                REQUIRE(edge_set(converted, xg_index) == edge_set(g, xg_index));
+                REQUIRE(view.edge_size() == edge_set(g, xg_index).size());
+            }
+        }
+    }
+
+    SECTION( "the view follows only its own edges, in both orientations" ) {
+        SubHandleGraph view(&xg_index);
+        view.add_edge(xg_index.get_handle(2, false), xg_index.get_handle(4, true));
+        view.add_edge(xg_index.get_handle(3, false), xg_index.get_handle(3, true));
+        view.add_node(xg_index.get_handle(1, false));
+
+        REQUIRE(view.node_size() == 4);
+        REQUIRE(view.edge_size() == 2);
+        REQUIRE(view.has_edge(xg_index.get_handle(4, false), xg_index.get_handle(2, true)));
+        REQUIRE(!view.has_edge(xg_index.get_handle(1, false), xg_index.get_handle(2, false)));
+
+        // The end of 4 is attached to the end of 2
+        vector<handle_t> found;
+        view.follow_edges(view.get_handle(4, false), false, [&](const handle_t& h) {
+            found.push_back(h);
+        });
+        REQUIRE(found.size() == 1);
+        REQUIRE(view.get_id(found[0]) == 2);
+        REQUIRE(view.get_is_reverse(found[0]));
+        REQUIRE(view.follow_edges(view.get_handle(4, false), true, [&](const handle_t& h) {
+            return false;
+        }));
+
+        // The reversing self loop is seen once from each side it touches
+        found.clear();
+        view.follow_edges(view.get_handle(3, false), false, [&](const handle_t& h) {
+            found.push_back(h);
+        });
+        REQUIRE(found.size() == 1);
+        REQUIRE(found[0] == view.get_handle(3, true));
+        found.clear();
+        view.follow_edges(view.get_handle(3, true), true, [&](const handle_t& h) {
+            found.push_back(h);
+        });
+        REQUIRE(found.size() == 1);
+        REQUIRE(found[0] == view.get_handle(3, false));
+
+        // Node 1 has no edges in the view
+        REQUIRE(view.follow_edges(view.get_handle(1, false), false, [&](const handle_t& h) {
+            return false;
+        }));
+        REQUIRE(view.get_sequence(view.get_handle(4, true)) == "ATGCC");
+        REQUIRE_THROWS(view.get_handle(6, false));
+    }
+
+    SECTION( "graph contexts cover the same forward walk" ) {
+        pos_t pos = make_pos_t(1, false, 2);
+        Graph g = xg_index.graph_context_id(pos, 5);
+        SubHandleGraph view(&xg_index);
+        xg_index.graph_context(pos, 5, view);
+        for (auto& node : g.node()) {
+            REQUIRE(view.has_node(node.id()));
+        }
+    }
+}
+
+}
+}
@@ -0,0 +1,135 @@
+/// \file translator.cpp
+///
+/// Unit tests for the Translator, which projects positions and paths from an
+/// augmented graph back into its base graph
+
+#include "../translator.hpp"
+#include "../path.hpp"
+#include "../json2pb.h"
+
+#include "catch.hpp"
+
+#include <omp.h>
+
+namespace vg {
+namespace unittest {
+using namespace std;
+
+/// Make a translation of a simple match from one node to another
+static Translation match_translation(id_t from_id, int64_t from_offset, id_t to_id, int64_t to_offset,
+                                     size_t length) {
+    Translation translation;
+    Mapping* from = translation.mutable_from()->add_mapping();
+    from->mutable_position()->set_node_id(from_id);
+    from->mutable_position()->set_offset(from_offset);
+    Edit* from_edit = from->add_edit();
+    from_edit->set_from_length(length);
+    from_edit->set_to_length(length);
+    Mapping* to = translation.mutable_to()->add_mapping();
+    to->mutable_position()->set_node_id(to_id);
+    to->mutable_position()->set_offset(to_offset);
+    Edit* to_edit = to->add_edit();
+    to_edit->set_from_length(length);
+    to_edit->set_to_length(length);
+    return translation;
+}
+
+/// Make a position
+static Position make_position(id_t id, int64_t offset, bool is_reverse = false) {
+    Position position;
+    position.set_node_id(id);
+    position.set_offset(offset);
+    position.set_is_reverse(is_reverse);
+    return position;
+}
+
+TEST_CASE("Translator finds translations by node and offset", "[translator]") {
+
+    // Node 1 was split into nodes 10 and 11, and node 2 was replaced by node
+    // 13, which has a translation for each half.
+    vector<Translation> translations {
+        match_translation(1, 0, 10, 0, 4),
+        match_translation(1, 4, 11, 0, 3),
+        match_translation(2, 0, 13, 0, 2),
+        match_translation(2, 5, 13, 2, 2)
+    };
+    Translator translator(translations);
+
+    SECTION("positions at and inside translations are translated") {
+        Position translated = translator.translate(make_position(10, 2));
+        REQUIRE(translated.node_id() == 1);
+        REQUIRE(translated.offset() == 2);
+
+        translated = translator.translate(make_position(11, 0));
+        REQUIRE(translated.node_id() == 1);
+        REQUIRE(translated.offset() == 4);
+    }
+
+    SECTION("the translation used is the last one starting at or before the offset") {
+        Position translated = translator.translate(make_position(13, 1));
+        REQUIRE(translated.node_id() == 2);
+        REQUIRE(translated.offset() == 1);
+
+        translated = translator.translate(make_position(13, 3));
+        REQUIRE(translated.node_id() == 2);
+        REQUIRE(translated.offset() == 6);
+    }
+
+    SECTION("missing nodes and strands have no translation") {
+        REQUIRE(translator.has_translation(make_position(10, 0)));
+        REQUIRE(!translator.has_translation(make_position(12, 0)));
+        REQUIRE(!translator.has_translation(make_position(99, 0)));
+        REQUIRE(!translator.has_translation(make_position(9, 0)));
+        REQUIRE(!translator.has_translation(make_position(10, 0, true), false));
+        REQUIRE(translator.find_translation(make_position(11, 1, true)) == nullptr);
+    }
+
+    SECTION("a later translation starting in the same place replaces an earlier one") {
+        translator.translations.push_back(match_translation(3, 0, 10, 0, 4));
+        translator.build_position_table();
+        REQUIRE(translator.translate(make_position(10, 1)).node_id() == 3);
+        REQUIRE(translator.translate(make_position(11, 1)).node_id() == 1);
+    }
+
+    SECTION("alignments across split nodes are translated back onto the base node") {
+        Alignment aln;
+        aln.set_sequence("TTACA");
+        Mapping* first = aln.mutable_path()->add_mapping();
+        *first->mutable_position() = make_position(10, 2);
+        first->set_rank(1);
+        Edit* first_edit = first->add_edit();
+        first_edit->set_from_length(2);
+        first_edit->set_to_length(2);
+        Mapping* second = aln.mutable_path()->add_mapping();
+        *second->mutable_position() = make_position(11, 0);
+        second->set_rank(2);
+        Edit* second_edit = second->add_edit();
+        second_edit->set_from_length(3);
+        second_edit->set_to_length(3);
+
+        Alignment copied = translator.translate(aln);
+        translator.translate_in_place(aln);
+
+        REQUIRE(aln.sequence() == "TTACA");
+        REQUIRE(aln.path().mapping(0).position().node_id() == 1);
+        REQUIRE(aln.path().mapping(0).position().offset() == 2);
+        REQUIRE(path_from_length(aln.path()) == 5);
+        REQUIRE(pb2json(aln) == pb2json(copied));
+    }
+
+    SECTION("translations can be looked up from many threads") {
+        size_t wrong = 0;
+#pragma omp parallel for reduction(+:wrong)
+        for (size_t i = 0; i < 10000; i++) {
+            int64_t offset = i % 4;
+            Position translated = translator.translate(make_position(13, offset));
+            if (translated.node_id() != 2 || translated.offset() != (offset < 2 ? offset : offset + 3)) {
+                wrong++;
+            }
+        }
+        REQUIRE(wrong == 0);
+    }
+}
+
+}
+}
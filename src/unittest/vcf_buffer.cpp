@@ -136,5 +136,43 @@ ref	18	rs1342	A	G	29	PASS	.	GT
     
 }
 
+TEST_CASE( "WindowedVcfBuffer parses genotypes from unparsed samples", "[windowedvcfbuffer][vcf]" ) {
+
+    auto vcf_data = R"(##fileformat=VCFv4.0
+##FORMAT=<ID=DP,Number=1,Type=Integer,Description="Read Depth">
+##FORMAT=<ID=GT,Number=1,Type=String,Description="Genotype">
+#CHROM	POS	ID	REF	ALT	QUAL	FILTER	INFO	FORMAT	s1	s2
+ref	5	rs1337	A	G,T	29	PASS	.	DP:GT	4:0|1	7:2/.
+ref	50	rs1338	A	G	29	PASS	.	GT	1|1	0
+ref	100	rs1339	A	G	29	PASS	.	GT:DP	0|1:3	1|0:9
+)";
+
+    std::stringstream vcf_stream(vcf_data);
+    vcflib::VariantCallFile vcf;
+    vcf.parseSamples = false;
+    vcf.open(vcf_stream);
+    
+    // Use a small window so variants scroll out and get reused
+    WindowedVcfBuffer buffer(&vcf, 10);
+    
+    REQUIRE(buffer.next());
+    auto& first = buffer.get_parsed_genotypes(get<1>(buffer.get()));
+    REQUIRE(first.size() == 2);
+    REQUIRE(first[0] == vector<int>({0, 1}));
+    REQUIRE(first[1] == vector<int>({2, vcflib::NULL_ALLELE}));
+    
+    REQUIRE(buffer.next());
+    auto& second = buffer.get_parsed_genotypes(get<1>(buffer.get()));
+    REQUIRE(second[0] == vector<int>({1, 1}));
+    REQUIRE(second[1] == vector<int>({0}));
+    
+    REQUIRE(buffer.next());
+    auto& third = buffer.get_parsed_genotypes(get<1>(buffer.get()));
+    REQUIRE(third[0] == vector<int>({0, 1}));
+    REQUIRE(third[1] == vector<int>({1, 0}));
+    
+    REQUIRE(!buffer.next());
+}
+
 }
 }
@@ -0,0 +1,104 @@
+/// \file vectorizer.cpp
+///
+/// Unit tests for the Vectorizer, which turns alignments into ML vectors
+
+#include "../vectorizer.hpp"
+#include "../json2pb.h"
+
+#include "catch.hpp"
+
+namespace vg {
+namespace unittest {
+using namespace std;
+
+TEST_CASE("Sparse vectors match the dense ones", "[vectorize]") {
+
+    string graph_json = R"(
+    {"node": [{"id": 1, "sequence": "GATT"}, {"id": 2, "sequence": "A"},
+              {"id": 3, "sequence": "C"}, {"id": 4, "sequence": "ACA"}],
+     "edge": [{"from": 1, "to": 2}, {"from": 1, "to": 3}, {"from": 2, "to": 4}, {"from": 3, "to": 4}],
+     "path": [{"name": "ref", "mapping": [
+         {"position": {"node_id": 1}, "rank": 1, "edit": [{"from_length": 4, "to_length": 4}]},
+         {"position": {"node_id": 2}, "rank": 2, "edit": [{"from_length": 1, "to_length": 1}]},
+         {"position": {"node_id": 4}, "rank": 3, "edit": [{"from_length": 3, "to_length": 3}]}]}]}
+    )";
+
+    Graph graph;
+    json2pb(graph, graph_json.c_str(), graph_json.size());
+    // The Vectorizer owns its index
+    Vectorizer vz(new xg::XG(graph));
+
+    // A read over the alt allele, with a mismatch on the last node
+    string aln_json = R"(
+    {"name": "read1", "sequence": "TTCACT", "path": {"mapping": [
+        {"position": {"node_id": 1, "offset": 2}, "edit": [{"from_length": 2, "to_length": 2}]},
+        {"position": {"node_id": 3}, "edit": [{"from_length": 1, "to_length": 1}]},
+        {"position": {"node_id": 4}, "edit": [
+            {"from_length": 2, "to_length": 2},
+            {"from_length": 1, "to_length": 1, "sequence": "T"}]}]}}
+    )";
+    Alignment aln;
+    json2pb(aln, aln_json.c_str(), aln_json.size());
+
+    SECTION("one-hot vectors have the visited nodes") {
+        auto sparse = vz.alignment_to_sparse_onehot(aln);
+        auto dense = vz.alignment_to_onehot(aln);
+        REQUIRE(sparse.size() == 3);
+        size_t set = 0;
+        for (size_t i = 0; i < dense.size(); i++) {
+            set += dense[i];
+        }
+        REQUIRE(set == sparse.size());
+        for (auto& entry : sparse) {
+            REQUIRE(dense[entry.first] == 1);
+            REQUIRE(entry.second == 1);
+        }
+        // Sorted by node rank
+        REQUIRE(sparse[0].first < sparse[1].first);
+        REQUIRE(sparse[1].first < sparse[2].first);
+    }
+
+    SECTION("a-hot vectors tell reference from alt") {
+        auto sparse = vz.alignment_to_sparse_a_hot(aln);
+        auto dense = vz.alignment_to_a_hot(aln);
+        REQUIRE(sparse.size() == 3);
+        size_t nonzero = 0;
+        for (auto& value : dense) {
+            nonzero += (value != 0);
+        }
+        REQUIRE(nonzero == 3);
+        for (auto& entry : sparse) {
+            REQUIRE(dense[entry.first] == entry.second);
+        }
+        REQUIRE(sparse[0].second == 2);
+        REQUIRE(sparse[1].second == 1);
+        REQUIRE(sparse[2].second == 2);
+    }
+
+    SECTION("identity-hot vectors have each node's identity") {
+        auto sparse = vz.alignment_to_sparse_identity_hot(aln);
+        auto dense = vz.alignment_to_identity_hot(aln);
+        REQUIRE(sparse.size() == 3);
+        for (auto& entry : sparse) {
+            REQUIRE(dense[entry.first] == entry.second);
+        }
+        REQUIRE(sparse[0].second == 1.0);
+        REQUIRE(sparse[2].second == Approx(2.0 / 3.0));
+    }
+
+    SECTION("sparse output only lists the set entries") {
+        auto sparse = vz.alignment_to_sparse_onehot(aln);
+        string libsvm = vz.sparse_libsvm(aln.name(), sparse);
+        string wabbit = vz.sparse_wabbitize(aln.name(), sparse);
+        REQUIRE(libsvm == "0 " + to_string(sparse[0].first + 1) + ":1 " + to_string(sparse[1].first + 1) + ":1 " +
+                to_string(sparse[2].first + 1) + ":1");
+        REQUIRE(wabbit == "0 1.0 'read1 | vectorspace " + to_string(sparse[0].first) + ":1 " +
+                to_string(sparse[1].first) + ":1 " + to_string(sparse[2].first) + ":1");
+        // A new name gets a new class
+        REQUIRE(vz.wabbit_class("read2") == 1);
+        REQUIRE(vz.wabbit_class("read1") == 0);
+    }
+}
+
+}
+}
@@ -6,6 +6,8 @@
 #include "../vg.hpp"
 #include "../utility.hpp"
 
+#include <sstream>
+
 namespace vg {
 namespace unittest {
 
@@ -1765,5 +1767,181 @@ TEST_CASE("create_handle() correctly creates handles using given sequence and id
     
 }
 
+TEST_CASE("normalize() unchops and merges siblings in every component", "[vg][normalize]") {
+    
+    const string graph_json = R"(
+    
+    {
+        "node": [
+            {"id": 1, "sequence": "GAT"},
+            {"id": 2, "sequence": "CC"},
+            {"id": 3, "sequence": "TAC"},
+            {"id": 4, "sequence": "AC"},
+            {"id": 5, "sequence": "AG"},
+            {"id": 6, "sequence": "A"},
+            {"id": 7, "sequence": "T"},
+            {"id": 8, "sequence": "GG"},
+            {"id": 9, "sequence": "TT"}
+        ],
+        "edge": [
+            {"from": 1, "to": 3},
+            {"from": 3, "to": 6},
+            {"from": 2, "to": 4},
+            {"from": 2, "to": 5},
+            {"from": 4, "to": 7},
+            {"from": 5, "to": 7},
+            {"from": 8, "to": 9}
+        ]
+    }
+    
+    )";
+    
+    SECTION("simple components are the same with and without threads") {
+        VG graph = string_to_graph(graph_json);
+        
+        int threads = omp_get_max_threads();
+        omp_set_num_threads(1);
+        auto serial = graph.simple_components(2);
+        omp_set_num_threads(4);
+        auto parallel = graph.simple_components(2);
+        omp_set_num_threads(threads);
+        
+        REQUIRE(serial.size() == 2);
+        REQUIRE(parallel == serial);
+    }
+    
+    SECTION("simple components can be found from just some nodes") {
+        VG graph = string_to_graph(graph_json);
+        
+        auto found = graph.simple_components(vector<id_t>{3, 100}, 2);
+        REQUIRE(found.size() == 1);
+        REQUIRE(found.begin()->size() == 3);
+    }
+    
+    SECTION("normalizing until nothing changes finishes the job") {
+        VG graph = string_to_graph(graph_json);
+        graph.normalize(10);
+        
+        // GATTACA, GGTT, and CCA -> (C, G) -> T
+        REQUIRE(graph.node_count() == 6);
+        REQUIRE(graph.length() == 7 + 4 + 6);
+        
+        set<string> sequences;
+        graph.for_each_node([&](Node* n) {
+            sequences.insert(n->sequence());
+        });
+        REQUIRE(sequences.count("GATTACA"));
+        REQUIRE(sequences.count("GGTT"));
+        REQUIRE(sequences.count("CCA"));
+        REQUIRE(sequences.count("C"));
+        REQUIRE(sequences.count("G"));
+        REQUIRE(sequences.count("T"));
+    }
+}
+
+TEST_CASE("serialize_to_ostream() writes chunks in parallel that read back as the same graph", "[vg][serialize]") {
+    
+    // A chain with a bubble at every node, a self loop, and paths
+    VG graph;
+    vector<Node*> chain;
+    for (size_t i = 0; i < 50; i++) {
+        chain.push_back(graph.create_node(i % 2 ? "GATTACA" : "CAT"));
+        if (i > 0) {
+            graph.create_edge(chain[i - 1], chain[i]);
+        }
+        Node* bubble = graph.create_node("A");
+        if (i > 0) {
+            graph.create_edge(chain[i - 1], bubble);
+            graph.create_edge(bubble, chain[i]);
+        }
+    }
+    graph.create_edge(chain[10], chain[10]);
+    for (size_t i = 0; i < chain.size(); i++) {
+        graph.paths.append_mapping("chain", chain[i]->id(), false, chain[i]->sequence().size(), i + 1);
+    }
+    graph.paths.append_mapping("backward", chain[30]->id(), true, chain[30]->sequence().size(), 1);
+    graph.paths.append_mapping("backward", chain[2]->id(), true, chain[2]->sequence().size(), 2);
+    graph.paths.create_path("empty");
+    graph.paths.make_circular("chain");
+    
+    int threads = omp_get_max_threads();
+    omp_set_num_threads(4);
+    stringstream buffer;
+    graph.serialize_to_ostream(buffer, 3);
+    omp_set_num_threads(threads);
+    
+    VG loaded(buffer);
+    REQUIRE(loaded.node_count() == graph.node_count());
+    REQUIRE(loaded.edge_count() == graph.edge_count());
+    graph.for_each_edge([&](Edge* e) {
+        REQUIRE(loaded.get_edge(NodeSide::pair_from_edge(e)) != nullptr);
+    });
+    REQUIRE(loaded.paths.size() == 3);
+    REQUIRE(loaded.paths.has_path("empty"));
+    REQUIRE(loaded.paths.circular.count("chain"));
+    for (const string name : {"chain", "backward"}) {
+        Path original = graph.paths.path(name);
+        Path reloaded = loaded.paths.path(name);
+        REQUIRE(reloaded.mapping_size() == original.mapping_size());
+        for (size_t i = 0; i < original.mapping_size(); i++) {
+            REQUIRE(reloaded.mapping(i).position().node_id() == original.mapping(i).position().node_id());
+            REQUIRE(reloaded.mapping(i).position().is_reverse() == original.mapping(i).position().is_reverse());
+        }
+    }
+}
+
+
+TEST_CASE("A frozen VG can be read from many threads and refuses edits until thawed", "[vg][freeze]") {
+    VG graph;
+    vector<Node*> chain;
+    for (size_t i = 0; i < 100; i++) {
+        chain.push_back(graph.create_node(i % 2 ? "GATT" : "ACA"));
+        if (i > 0) {
+            graph.create_edge(chain[i - 1], chain[i]);
+        }
+        if (i > 1 && i % 3 == 0) {
+            graph.create_edge(chain[i - 2], chain[i], false, true);
+        }
+    }
+    for (size_t i = 0; i < chain.size(); i++) {
+        graph.paths.append_mapping("chain", chain[i]->id(), false, chain[i]->sequence().size(), i + 1);
+    }
+    graph.paths.create_path("empty");
+    
+    graph.freeze();
+    REQUIRE(graph.is_frozen());
+    
+    // Walk every node and its edges from all the threads
+    vector<size_t> degrees(chain.size() + 1, 0);
+    vector<size_t> lengths(chain.size() + 1, 0);
+    vector<size_t> path_visits(chain.size() + 1, 0);
+    graph.for_each_handle([&](const handle_t& handle) {
+        id_t id = graph.get_id(handle);
+        lengths[id] = graph.get_sequence(graph.flip(handle)).size();
+        for (bool go_left : {false, true}) {
+            graph.follow_edges(handle, go_left, [&](const handle_t& next) {
+                degrees[id]++;
+            });
+        }
+        path_visits[id] = graph.paths.get_node_mappings_by_rank(id).size();
+    }, true);
+    
+    for (auto* node : chain) {
+        REQUIRE(degrees[node->id()] == graph.start_degree(node) + graph.end_degree(node));
+        REQUIRE(lengths[node->id()] == node->sequence().size());
+        REQUIRE(path_visits[node->id()] == 1);
+    }
+    
+    REQUIRE_THROWS(graph.create_node("GATTACA"));
+    REQUIRE_THROWS(graph.create_edge(chain[5], chain[50]));
+    REQUIRE_THROWS(graph.destroy_node(chain[10]));
+    REQUIRE(graph.node_count() == chain.size());
+    
+    graph.thaw();
+    REQUIRE(!graph.is_frozen());
+    graph.destroy_node(chain[10]);
+    REQUIRE(graph.node_count() == chain.size() - 1);
+}
+
 }
 }
@@ -9,6 +9,7 @@
 #include <stdio.h>
 #include <set>
 #include <random>
+#include <omp.h>
 #include "catch.hpp"
 #include "algorithms/extract_connecting_graph.hpp"
 #include "algorithms/extract_containing_graph.hpp"
@@ -23,6 +24,7 @@
 #include "algorithms/apply_bulk_modifications.hpp"
 #include "algorithms/count_walks.hpp"
 #include "vg.hpp"
+#include "snarls.hpp"
 #include "json2pb.h"
 
 
@@ -3275,6 +3277,21 @@ namespace vg {
                 }
             }
             
+            SECTION( "algorithms::weakly_connected_component_labels labels the same two components" ) {
+                vector<id_t> ids;
+                size_t component_count;
+                auto labels = algorithms::weakly_connected_component_labels(&vg, ids, &component_count);
+                
+                REQUIRE(component_count == 2);
+                REQUIRE(ids.size() == 10);
+                REQUIRE(labels.size() == 10);
+                for (size_t i = 0; i < ids.size(); i++) {
+                    // The first five nodes made are the first component, which has the lowest IDs
+                    REQUIRE(ids[i] == (id_t) i + 1);
+                    REQUIRE(labels[i] == (i < 5 ? 0 : 1));
+                }
+            }
+            
             vg.create_edge(n3, n5);
             vg.create_edge(n4, n5);
             
@@ -4308,7 +4325,50 @@ namespace vg {
             }
         }
     }
-    
+
+    TEST_CASE("apply_divisions cuts each node at all of its offsets at once", "[algorithms]") {
+
+        VG vg;
+
+        handle_t h1 = vg.create_handle("GATT");
+        handle_t h2 = vg.create_handle("ACACATTAG");
+        handle_t h3 = vg.create_handle("C");
+        vg.create_edge(h1, h2);
+        vg.create_edge(h2, h3);
+
+        vector<pair<id_t, vector<size_t>>> divisions{{vg.get_id(h2), {2, 3, 7}}, {vg.get_id(h3), {}}};
+        auto parts = algorithms::apply_divisions(&vg, divisions);
+
+        REQUIRE(parts.size() == 2);
+        REQUIRE(parts[0].size() == 4);
+        vector<string> sequences;
+        for (auto& part : parts[0]) {
+            REQUIRE(!vg.get_is_reverse(part));
+            sequences.push_back(vg.get_sequence(part));
+        }
+        REQUIRE(sequences == vector<string>({"AC", "A", "CATT", "AG"}));
+
+        // The untouched node is its own part
+        REQUIRE(parts[1].size() == 1);
+        REQUIRE(vg.get_id(parts[1][0]) == vg.get_id(h3));
+
+        // The parts are wired in order between the old neighbors
+        auto follows = [&](const handle_t& from, const handle_t& to) {
+            bool found = false;
+            vg.follow_edges(from, false, [&](const handle_t& next) {
+                found = found || next == to;
+            });
+            return found;
+        };
+        REQUIRE(!vg.has_node(vg.get_id(h2)));
+        REQUIRE(follows(h1, parts[0].front()));
+        for (size_t i = 1; i < parts[0].size(); i++) {
+            REQUIRE(follows(parts[0][i - 1], parts[0][i]));
+        }
+        REQUIRE(follows(parts[0].back(), h3));
+        REQUIRE(vg.node_size() == 6);
+    }
+
     TEST_CASE("is_acyclic can detect cyclic graphs", "[algorithms][cycles]") {
         
         SECTION("is_acyclic works on a graph with one node") {
@@ -4512,5 +4572,178 @@ namespace vg {
         vg.create_edge(n4, n7);
         
         REQUIRE(algorithms::count_walks(&vg) == 6);
+        REQUIRE(abs(algorithms::log_count_walks(&vg) - log(6.0)) < 1e-9);
+    }
+    
+    TEST_CASE("count_walks() saturates and log_count_walks() doesn't overflow", "[algorithms][walks]") {
+        
+        VG vg;
+        
+        // A chain of 70 bubbles has 2^70 walks
+        handle_t prev = vg.create_handle("A");
+        for (size_t i = 0; i < 70; i++) {
+            handle_t left = vg.create_handle("C");
+            handle_t right = vg.create_handle("G");
+            handle_t next = vg.create_handle("T");
+            vg.create_edge(prev, left);
+            vg.create_edge(prev, right);
+            vg.create_edge(left, next);
+            vg.create_edge(right, next);
+            prev = next;
+        }
+        
+        REQUIRE(algorithms::count_walks(&vg) == numeric_limits<size_t>::max());
+        REQUIRE(abs(algorithms::log_count_walks(&vg) - 70 * log(2.0)) < 1e-9);
+    }
+    
+    TEST_CASE("count_walks_through_snarls() multiplies through chains of child snarls", "[algorithms][walks][snarls]") {
+        
+        VG vg;
+        
+        Node* n0 = vg.create_node("A");
+        Node* n1 = vg.create_node("C");
+        Node* n2 = vg.create_node("G");
+        Node* n3 = vg.create_node("T");
+        Node* n4 = vg.create_node("A");
+        Node* n5 = vg.create_node("C");
+        Node* n6 = vg.create_node("G");
+        Node* n7 = vg.create_node("T");
+        Node* n8 = vg.create_node("A");
+        Node* n9 = vg.create_node("C");
+        
+        vg.create_edge(n0, n1);
+        vg.create_edge(n0, n8);
+        vg.create_edge(n8, n9);
+        vg.create_edge(n1, n2);
+        vg.create_edge(n1, n3);
+        vg.create_edge(n2, n4);
+        vg.create_edge(n3, n4);
+        vg.create_edge(n4, n5);
+        vg.create_edge(n4, n6);
+        vg.create_edge(n5, n7);
+        vg.create_edge(n6, n7);
+        vg.create_edge(n7, n9);
+        
+        auto make_snarl = [](id_t start, id_t end) {
+            Snarl snarl;
+            snarl.mutable_start()->set_node_id(start);
+            snarl.mutable_end()->set_node_id(end);
+            snarl.set_type(ULTRABUBBLE);
+            snarl.set_start_end_reachable(true);
+            return snarl;
+        };
+        
+        Snarl outer = make_snarl(n0->id(), n9->id());
+        Snarl first = make_snarl(n1->id(), n4->id());
+        *first.mutable_parent() = outer;
+        Snarl second = make_snarl(n4->id(), n7->id());
+        *second.mutable_parent() = outer;
+        
+        list<Snarl> snarls{outer, first, second};
+        SnarlManager snarl_manager(snarls.begin(), snarls.end());
+        
+        unordered_map<const Snarl*, size_t> counts = algorithms::count_walks_through_snarls(&vg, snarl_manager);
+        REQUIRE(counts.size() == 3);
+        
+        for (auto& entry : counts) {
+            if (entry.first->start().node_id() == n0->id()) {
+                // Two ways through each child, or around them
+                REQUIRE(entry.second == 5);
+            } else {
+                REQUIRE(entry.second == 2);
+            }
+        }
+    }
+    
+    TEST_CASE("Graph extraction gives the same results when it reuses a workspace", "[algorithms]") {
+        
+        VG vg;
+        
+        Node* n0 = vg.create_node("CGA");
+        Node* n1 = vg.create_node("TTGG");
+        Node* n2 = vg.create_node("CCGT");
+        Node* n3 = vg.create_node("C");
+        Node* n4 = vg.create_node("GT");
+        Node* n5 = vg.create_node("GATAA");
+        
+        vg.create_edge(n0, n1);
+        vg.create_edge(n1, n2);
+        vg.create_edge(n2, n3);
+        vg.create_edge(n2, n4);
+        vg.create_edge(n3, n5);
+        vg.create_edge(n4, n5);
+        vg.create_edge(n5, n1);
+        
+        auto summarize = [](VG& extracted, unordered_map<id_t, id_t>& trans) {
+            multiset<pair<id_t, string>> nodes;
+            extracted.for_each_handle([&](const handle_t& handle) {
+                nodes.emplace(trans.at(extracted.get_id(handle)), extracted.get_sequence(handle));
+            });
+            return make_pair(nodes, extracted.edge_count());
+        };
+        
+        algorithms::ExtractionWorkspace workspace;
+        vector<pos_t> starts{make_pos_t(n0->id(), false, 1), make_pos_t(n2->id(), false, 2), make_pos_t(n5->id(), true, 1)};
+        vector<pos_t> ends{make_pos_t(n5->id(), false, 3), make_pos_t(n1->id(), false, 2), make_pos_t(n3->id(), true, 0)};
+        
+        for (size_t i = 0; i < starts.size(); i++) {
+            for (bool only_walks : {false, true}) {
+                VG fresh, reused;
+                auto fresh_trans = algorithms::extract_connecting_graph(&vg, &fresh, 20, starts[i], ends[i], true, only_walks);
+                auto reused_trans = algorithms::extract_connecting_graph(&vg, &reused, 20, starts[i], ends[i], workspace, true, only_walks);
+                REQUIRE(summarize(fresh, fresh_trans) == summarize(reused, reused_trans));
+            }
+            
+            for (bool backward : {false, true}) {
+                VG fresh, reused;
+                auto fresh_trans = algorithms::extract_extending_graph(&vg, &fresh, 8, starts[i], backward, true);
+                auto reused_trans = algorithms::extract_extending_graph(&vg, &reused, 8, starts[i], backward, true, workspace);
+                REQUIRE(summarize(fresh, fresh_trans) == summarize(reused, reused_trans));
+            }
+        }
+        
+        TEST_CASE( "Topological sort is the same with and without threads on a graph with many components",
+                  "[algorithms][topologicalsort]" ) {
+            
+            VG vg;
+            
+            // Make components with interleaved IDs, so they have to take
+            // turns in the sort.
+            size_t component_count = 7;
+            vector<vector<Node*>> components(component_count);
+            for (id_t id = 1; id <= 210; id++) {
+                components[id % component_count].push_back(vg.create_node("GATTACA", id));
+            }
+            
+            // Wire them up randomly, with cycles and reversing edges.
+            mt19937 gen(9876);
+            for (size_t c = 0; c < component_count; c++) {
+                auto& nodes = components[c];
+                uniform_int_distribution<size_t> pick(0, nodes.size() - 1);
+                for (size_t i = 1; i < nodes.size(); i++) {
+                    // Keep it connected, going mostly forward
+                    vg.create_edge(nodes[pick(gen) % i], nodes[i], c == 3 && gen() % 4 == 0, false);
+                }
+                if (c % 2 == 0) {
+                    // Some components get extra edges that make cycles
+                    for (size_t i = 0; i < nodes.size() / 4; i++) {
+                        vg.create_edge(nodes[pick(gen)], nodes[pick(gen)], gen() % 2, gen() % 2);
+                    }
+                }
+            }
+            
+            int threads = omp_get_max_threads();
+            
+            omp_set_num_threads(1);
+            auto serial_order = algorithms::topological_order(&vg);
+            
+            omp_set_num_threads(4);
+            auto parallel_order = algorithms::topological_order(&vg);
+            
+            omp_set_num_threads(threads);
+            
+            REQUIRE(serial_order.size() == vg.node_size());
+            REQUIRE(parallel_order == serial_order);
+        }
     }
 }
@@ -8,7 +8,10 @@
 #include "vg.hpp"
 #include "xg.hpp"
 #include "graph.hpp"
+#include "xg_position.hpp"
 #include <stdio.h>
+#include <omp.h>
+#include <sstream>
 
 namespace vg {
     namespace unittest {
@@ -235,6 +238,114 @@ TEST_CASE("We can build the xg index on a small graph with discontinuous node id
 
 }
 
+TEST_CASE("Batched handle queries agree with single handle queries", "[xg][handle]") {
+
+    string graph_json = R"(
+    {"node":[{"id":1,"sequence":"GATT"},
+    {"id":2,"sequence":"ACA"},
+    {"id":3,"sequence":"CG"}],
+    "edge":[{"to":2,"from":1},{"to":3,"from":1},{"to":3,"from":2,"to_end":true}]}
+    )";
+
+    Graph proto_graph;
+    json2pb(proto_graph, graph_json.c_str(), graph_json.size());
+    xg::XG xg_index(proto_graph);
+
+    // Ask in an order that doesn't match the g vector order
+    vector<handle_t> handles {xg_index.get_handle(3, false), xg_index.get_handle(1, true),
+        xg_index.get_handle(2, false), xg_index.get_handle(1, false)};
+
+    SECTION("Batched lengths match") {
+        vector<size_t> lengths;
+        xg_index.get_lengths(handles, lengths);
+        REQUIRE(lengths.size() == handles.size());
+        for (size_t i = 0; i < handles.size(); i++) {
+            REQUIRE(lengths[i] == xg_index.get_length(handles[i]));
+        }
+    }
+
+    SECTION("Batched sequences match") {
+        string sequences;
+        vector<size_t> offsets;
+        xg_index.get_sequences(handles, sequences, offsets);
+        REQUIRE(offsets.size() == handles.size() + 1);
+        for (size_t i = 0; i < handles.size(); i++) {
+            REQUIRE(sequences.substr(offsets[i], offsets[i + 1] - offsets[i]) == xg_index.get_sequence(handles[i]));
+        }
+    }
+
+    SECTION("Batched neighbors match") {
+        for (bool go_left : {false, true}) {
+            vector<handle_t> neighbors;
+            vector<size_t> offsets;
+            xg_index.follow_edges(handles, go_left, neighbors, offsets);
+            REQUIRE(offsets.size() == handles.size() + 1);
+            for (size_t i = 0; i < handles.size(); i++) {
+                vector<handle_t> expected;
+                xg_index.follow_edges(handles[i], go_left, [&](const handle_t& next) {
+                    expected.push_back(next);
+                    return true;
+                });
+                vector<handle_t> found(neighbors.begin() + offsets[i], neighbors.begin() + offsets[i + 1]);
+                REQUIRE(found == expected);
+            }
+        }
+    }
+}
+
+TEST_CASE("Edge lookups agree with the edge lists, with and without the edge index", "[xg][handle]") {
+
+    // Includes a reversing edge and a self loop
+    string graph_json = R"(
+    {"node":[{"id":1,"sequence":"GATT"},
+    {"id":2,"sequence":"ACA"},
+    {"id":3,"sequence":"CG"},
+    {"id":4,"sequence":"T"}],
+    "edge":[{"to":2,"from":1},{"to":3,"from":1},{"to":3,"from":2,"to_end":true},
+    {"to":4,"from":3,"from_start":true},{"to":4,"from":4}]}
+    )";
+
+    Graph proto_graph;
+    json2pb(proto_graph, graph_json.c_str(), graph_json.size());
+    xg::XG xg_index(proto_graph);
+
+    // Work out the right answer for every oriented pair from follow_edges
+    auto check_all_pairs = [&]() {
+        for (id_t from = 1; from <= 4; from++) {
+            for (bool from_rev : {false, true}) {
+                handle_t left = xg_index.get_handle(from, from_rev);
+                unordered_set<handle_t> expected;
+                xg_index.follow_edges(left, false, [&](const handle_t& next) {
+                    expected.insert(next);
+                    return true;
+                });
+                for (id_t to = 1; to <= 4; to++) {
+                    for (bool to_rev : {false, true}) {
+                        handle_t right = xg_index.get_handle(to, to_rev);
+                        bool wanted = expected.count(right);
+                        REQUIRE(xg_index.has_edge(left, right) == wanted);
+                        REQUIRE(xg_index.has_edge(from, from_rev, to, to_rev) == wanted);
+                        // The same edge read the other way around
+                        REQUIRE(xg_index.has_edge(xg_index.flip(right), xg_index.flip(left)) == wanted);
+                    }
+                }
+            }
+        }
+        for (auto& edge : proto_graph.edge()) {
+            REQUIRE(xg_index.has_edge(edge));
+        }
+    };
+
+    SECTION("Edges are found by scanning the edge lists") {
+        check_all_pairs();
+    }
+
+    SECTION("Edges are found in the edge index") {
+        xg_index.index_edges();
+        check_all_pairs();
+    }
+}
+
 TEST_CASE("Target to alignment extraction", "[xg-target-to-aln]") {
 
     VG vg;
@@ -504,6 +615,17 @@ TEST_CASE("Path-based distance approximation in XG produces expected results", "
         REQUIRE(dist == std::numeric_limits<int64_t>::max());
     }
     
+    SECTION("Distance approxmation produces the same distances with path anchors loaded from a file") {
+        stringstream serialized;
+        xg_index.serialize(serialized);
+        xg::XG loaded(serialized);
+        
+        REQUIRE(loaded.closest_shared_path_oriented_distance(n1->id(), 3, false, n7->id(), 3, true, false, 10) == 15);
+        REQUIRE(loaded.closest_shared_path_oriented_distance(n1->id(), 3, false, n15->id(), 1, false, false, 20) == 22);
+        REQUIRE(loaded.closest_shared_path_oriented_distance(n1->id(), 3, true, n7->id(), 3, true, false, 10) ==
+                std::numeric_limits<int64_t>::max());
+    }
+    
     SECTION("Distance jumping produces expected result when start position and jump position are on path") {
         vector<tuple<int64_t, bool, size_t>> jump_pos = xg_index.jump_along_closest_path(n0->id(),
                                                                                          false,
@@ -678,5 +800,226 @@ TEST_CASE("Path component memoization produces expected results", "[xg]") {
     }
 }
 
+TEST_CASE("XG construction does not depend on the thread count", "[xg]") {
+
+    string graph_json = R"(
+    {"node": [{"id": 1, "sequence": "GATT"}, {"id": 2, "sequence": "A"}, {"id": 3, "sequence": "C"},
+              {"id": 4, "sequence": "TACA"}, {"id": 5, "sequence": "G"}],
+     "edge": [{"from": 1, "to": 2}, {"from": 1, "to": 3}, {"from": 2, "to": 4}, {"from": 3, "to": 4},
+              {"from": 4, "to": 5, "to_end": true}, {"from": 5, "to": 1, "from_start": true}],
+     "path": [{"name": "a", "mapping": [{"position": {"node_id": 1}, "rank": 1},
+                                        {"position": {"node_id": 2}, "rank": 2},
+                                        {"position": {"node_id": 4}, "rank": 3}]},
+              {"name": "b", "mapping": [{"position": {"node_id": 1}, "rank": 1},
+                                        {"position": {"node_id": 3}, "rank": 2},
+                                        {"position": {"node_id": 4}, "rank": 3}]},
+              {"name": "c", "mapping": [{"position": {"node_id": 4}, "rank": 1},
+                                        {"position": {"node_id": 5, "is_reverse": true}, "rank": 2}]}]}
+    )";
+
+    Graph proto_graph;
+    json2pb(proto_graph, graph_json.c_str(), graph_json.size());
+
+    int threads = omp_get_max_threads();
+    auto build = [&](int thread_count) {
+        omp_set_num_threads(thread_count);
+        xg::XG xg_index(proto_graph);
+        stringstream serialized;
+        xg_index.serialize(serialized);
+        return serialized.str();
+    };
+    string serial = build(1);
+    string parallel = build(4);
+    omp_set_num_threads(threads);
+
+    REQUIRE(serial == parallel);
+
+    xg::XG xg_index(proto_graph);
+    REQUIRE(xg_index.node_count == 5);
+    REQUIRE(xg_index.edge_count == 6);
+    REQUIRE(xg_index.paths_of_node(4).size() == 3);
+    REQUIRE(xg_index.paths_of_node(5) == vector<size_t>{xg_index.path_rank("c")});
+}
+
+TEST_CASE("XG thread insertion into a DAG does not depend on the thread count", "[xg]") {
+
+    string graph_json = R"(
+    {"node": [{"id": 1, "sequence": "GATT"}, {"id": 2, "sequence": "A"}, {"id": 3, "sequence": "C"},
+              {"id": 4, "sequence": "TACA"}],
+     "edge": [{"from": 1, "to": 2}, {"from": 1, "to": 3}, {"from": 2, "to": 4}, {"from": 3, "to": 4}],
+     "path": [{"name": "a", "mapping": [{"position": {"node_id": 1}, "rank": 1},
+                                        {"position": {"node_id": 2}, "rank": 2},
+                                        {"position": {"node_id": 4}, "rank": 3}]},
+              {"name": "b", "mapping": [{"position": {"node_id": 1}, "rank": 1},
+                                        {"position": {"node_id": 3}, "rank": 2},
+                                        {"position": {"node_id": 4}, "rank": 3}]},
+              {"name": "c", "mapping": [{"position": {"node_id": 2}, "rank": 1},
+                                        {"position": {"node_id": 4}, "rank": 2}]}]}
+    )";
+
+    Graph proto_graph;
+    json2pb(proto_graph, graph_json.c_str(), graph_json.size());
+
+    int threads = omp_get_max_threads();
+    auto build = [&](int thread_count) {
+        omp_set_num_threads(thread_count);
+        xg::XG xg_index;
+        xg_index.from_graph(proto_graph, false, false, true, true);
+        stringstream serialized;
+        xg_index.serialize(serialized);
+        return serialized.str();
+    };
+    string serial = build(1);
+    string parallel = build(4);
+    omp_set_num_threads(threads);
+
+    REQUIRE(serial == parallel);
+
+    xg::XG xg_index;
+    xg_index.from_graph(proto_graph, false, false, true, true);
+    xg::XG::thread_t through_2 = {{1, false}, {2, false}, {4, false}};
+    xg::XG::thread_t back_through_2 = {{4, true}, {2, true}};
+    xg::XG::thread_t through_3 = {{1, false}, {3, false}, {4, false}};
+    REQUIRE(xg_index.count_matches(through_2) == 1);
+    REQUIRE(xg_index.count_matches(back_through_2) == 2);
+    REQUIRE(xg_index.count_matches(through_3) == 1);
+    
+    SECTION("batched counts match counting one at a time") {
+        vector<xg::XG::thread_t> batch = {through_3, through_2, {{1, false}, {2, false}}, back_through_2,
+                                          {{1, false}, {3, false}, {4, true}}, through_2, {{1, false}}};
+        vector<size_t> counts = xg_index.count_matches_batch(batch);
+        REQUIRE(counts.size() == batch.size());
+        for (size_t i = 0; i < batch.size(); i++) {
+            REQUIRE(counts[i] == xg_index.count_matches(batch[i]));
+        }
+    }
+}
+
+TEST_CASE("xg_distance agrees with walking the graph one base at a time", "[xg]") {
+
+    // A graph with a cycle, a reversing edge, and a self loop
+    string graph_json = R"(
+    {"node": [{"id": 1, "sequence": "GATT"}, {"id": 2, "sequence": "A"}, {"id": 3, "sequence": "CAT"},
+              {"id": 4, "sequence": "TACA"}, {"id": 5, "sequence": "GG"}],
+     "edge": [{"from": 1, "to": 2}, {"from": 1, "to": 3}, {"from": 2, "to": 4}, {"from": 3, "to": 4},
+              {"from": 4, "to": 5, "to_end": true}, {"from": 4, "to": 1}, {"from": 3, "to": 3}]}
+    )";
+
+    Graph proto_graph;
+    json2pb(proto_graph, graph_json.c_str(), graph_json.size());
+    xg::XG xg_index(proto_graph);
+
+    // This is how xg_distance used to work
+    auto walk_distance = [&](pos_t pos1, pos_t pos2, int64_t maximum) {
+        if (pos1 == pos2) return (int64_t) 0;
+        int64_t adj = (offset(pos1) == xg_node_length(id(pos1), &xg_index) ? 0 : 1);
+        set<pos_t> seen;
+        set<pos_t> nexts = xg_next_pos(pos1, false, &xg_index);
+        int64_t distance = 0;
+        while (!nexts.empty()) {
+            set<pos_t> todo;
+            for (auto& next : nexts) {
+                if (!seen.count(next)) {
+                    seen.insert(next);
+                    if (next == pos2) {
+                        return distance+adj;
+                    }
+                    if (make_pos_t(id(next), is_rev(next), offset(next)+1) == pos2) {
+                        return distance+adj+1;
+                    }
+                    for (auto& x : xg_next_pos(next, false, &xg_index)) {
+                        todo.insert(x);
+                    }
+                }
+            }
+            if (distance == maximum) {
+                break;
+            }
+            nexts = todo;
+            ++distance;
+        }
+        return numeric_limits<int64_t>::max();
+    };
+
+    vector<pos_t> positions;
+    for (id_t node_id = 1; node_id <= 5; node_id++) {
+        for (bool is_reverse : {false, true}) {
+            for (size_t i = 0; i <= xg_index.node_length(node_id); i++) {
+                positions.push_back(make_pos_t(node_id, is_reverse, i));
+            }
+        }
+    }
+
+    for (auto& pos1 : positions) {
+        for (auto& pos2 : positions) {
+            for (int64_t maximum : {0, 3, 7, 100}) {
+                REQUIRE(xg_distance(pos1, pos2, maximum, &xg_index) == walk_distance(pos1, pos2, maximum));
+            }
+        }
+    }
+}
+
+TEST_CASE("XG packed sequences decode the same in every direction and after reloading", "[xg]") {
+
+    // Long enough to fill whole words of packed bases, with Ns and other characters mixed in
+    string seq1 = "GATTACANNNNCATTAGGACCATTAGACAGATTARCATTACAGGATTACANNTTACAGC";
+    string seq2 = "N";
+    string seq3 = "ACGTACGTAC";
+    string graph_json = R"(
+    {"node": [{"id": 1, "sequence": ")" + seq1 + R"("}, {"id": 2, "sequence": ")" + seq2 + R"("},
+              {"id": 3, "sequence": ")" + seq3 + R"("}, {"id": 4, "sequence": "T"}],
+     "edge": [{"from": 1, "to": 2}, {"from": 2, "to": 3}, {"from": 3, "to": 4}]}
+    )";
+
+    Graph proto_graph;
+    json2pb(proto_graph, graph_json.c_str(), graph_json.size());
+    xg::XG built(proto_graph);
+
+    stringstream serialized;
+    built.serialize(serialized);
+    xg::XG loaded(serialized);
+
+    // anything that isn't ACGT comes back as N
+    auto expected_sequence = [](string seq) {
+        for (auto& c : seq) {
+            if (c != 'A' && c != 'C' && c != 'G' && c != 'T') {
+                c = 'N';
+            }
+        }
+        return seq;
+    };
+
+    for (xg::XG* xg_index : {&built, &loaded}) {
+        for (id_t id : {1, 2, 3}) {
+            string expected = expected_sequence(id == 1 ? seq1 : (id == 2 ? seq2 : seq3));
+            REQUIRE(xg_index->node_sequence(id) == expected);
+            for (bool is_rev : {false, true}) {
+                string oriented = is_rev ? reverse_complement(expected) : expected;
+                handle_t handle = xg_index->get_handle(id, is_rev);
+                REQUIRE(xg_index->get_sequence(handle) == oriented);
+                string buffer(oriented.size(), '\0');
+                xg_index->get_sequence_into(handle, &buffer[0]);
+                REQUIRE(buffer == oriented);
+                for (size_t off = 0; off < oriented.size(); off++) {
+                    REQUIRE(xg_index->pos_char(id, is_rev, off) == oriented[off]);
+                }
+            }
+            for (size_t off = 0; off < expected.size(); off++) {
+                REQUIRE(xg_index->pos_substr(id, false, off) == expected.substr(off));
+                REQUIRE(xg_index->pos_substr(id, false, off, 5) == expected.substr(off, 5));
+                REQUIRE(xg_index->pos_substr(id, true, off) == reverse_complement(expected).substr(off));
+            }
+        }
+    }
+
+    vector<handle_t> handles{built.get_handle(3, true), built.get_handle(1, false), built.get_handle(1, true)};
+    string sequences;
+    vector<size_t> offsets;
+    built.get_sequences(handles, sequences, offsets);
+    for (size_t i = 0; i < handles.size(); i++) {
+        REQUIRE(sequences.substr(offsets[i], offsets[i + 1] - offsets[i]) == built.get_sequence(handles[i]));
+    }
+}
+
 }
 }
@@ -1,78 +1,31 @@
 #include "utility.hpp"
+#include "remote_file.hpp"
+#include "sequence_ops.hpp"
 
 #include <cstdio>
 #include <set>
 #include <mutex>
 #include <dirent.h>
+#include <sys/resource.h>
 
 namespace vg {
 
-static const char complement[256] = {'N', 'N', 'N', 'N', 'N', 'N', 'N', 'N', // 8
-                                     'N', 'N', 'N', 'N', 'N', 'N', 'N', 'N', // 16
-                                     'N', 'N', 'N', 'N', 'N', 'N', 'N', 'N', // 24
-                                     'N', 'N', 'N', 'N', 'N', 'N', 'N', 'N', // 32
-                                     'N', 'N', 'N', '$', '#', 'N', 'N', 'N', // 40 GCSA stop/start characters
-                                     'N', 'N', 'N', 'N', 'N', '-', 'N', 'N', // 48
-                                     'N', 'N', 'N', 'N', 'N', 'N', 'N', 'N', // 56
-                                     'N', 'N', 'N', 'N', 'N', 'N', 'N', 'N', // 64
-                                     'N', 'T', 'V', 'G', 'H', 'N', 'N', 'C', // 72
-                                     'D', 'N', 'N', 'M', 'N', 'K', 'N', 'N', // 80
-                                     'N', 'Q', 'Y', 'W', 'A', 'A', 'B', 'S', // 88
-                                     'N', 'R', 'N', 'N', 'N', 'N', 'N', 'N', // 96
-                                     'N', 't', 'v', 'g', 'h', 'N', 'N', 'c', // 104
-                                     'd', 'N', 'N', 'm', 'N', 'k', 'n', 'N', // 112
-                                     'N', 'q', 'y', 'w', 'a', 'a', 'b', 's', // 120
-                                     'N', 'r', 'N', 'N', 'N', 'N', 'N', 'N', // 128
-                                     'N', 'N', 'N', 'N', 'N', 'N', 'N', 'N', // 136
-                                     'N', 'N', 'N', 'N', 'N', 'N', 'N', 'N', // 144
-                                     'N', 'N', 'N', 'N', 'N', 'N', 'N', 'N', // 152
-                                     'N', 'N', 'N', 'N', 'N', 'N', 'N', 'N', // 160
-                                     'N', 'N', 'N', 'N', 'N', 'N', 'N', 'N', // 168
-                                     'N', 'N', 'N', 'N', 'N', 'N', 'N', 'N', // 176
-                                     'N', 'N', 'N', 'N', 'N', 'N', 'N', 'N', // 184
-                                     'N', 'N', 'N', 'N', 'N', 'N', 'N', 'N', // 192
-                                     'N', 'N', 'N', 'N', 'N', 'N', 'N', 'N', // 200
-                                     'N', 'N', 'N', 'N', 'N', 'N', 'N', 'N', // 208
-                                     'N', 'N', 'N', 'N', 'N', 'N', 'N', 'N', // 216
-                                     'N', 'N', 'N', 'N', 'N', 'N', 'N', 'N', // 224
-                                     'N', 'N', 'N', 'N', 'N', 'N', 'N', 'N', // 232
-                                     'N', 'N', 'N', 'N', 'N', 'N', 'N', 'N', // 240
-                                     'N', 'N', 'N', 'N', 'N', 'N', 'N', 'N', // 248
-                                     'N', 'N', 'N', 'N', 'N', 'N', 'N', 'N'};// 256
-
 char reverse_complement(const char& c) {
-    return complement[c];
+    return complement_of(c);
 }
 
 string reverse_complement(const string& seq) {
-    string rc;
-    rc.assign(seq.rbegin(), seq.rend());
-    for (auto& c : rc) {
-        c = complement[c];
-    }
+    string rc(seq.size(), 'N');
+    reverse_complement_into(seq.data(), seq.size(), &rc[0]);
     return rc;
 }
     
 void reverse_complement_in_place(string& seq) {
-    size_t swap_size = seq.size() / 2;
-    for (size_t i = 0, j = seq.size() - 1; i < swap_size; i++, j--) {
-        char tmp = seq[i];
-        seq[i] = complement[seq[j]];
-        seq[j] = complement[tmp];
-    }
-    
-    if (seq.size() % 2) {
-        seq[swap_size] = complement[seq[swap_size]];
-    }
+    reverse_complement_in_place(&seq[0], seq.size());
 }
 
 bool is_all_n(const string& seq) {
-    for (auto& c : seq) {
-        if (c != 'N' && c != 'n') {
-            return false;
-        }
-    }
-    return true;
+    return count_Ns(seq.data(), seq.size(), true) == seq.size();
 }
 
 int get_thread_count(void) {
@@ -85,6 +38,20 @@ int get_thread_count(void) {
     return thread_count;
 }
 
+size_t get_peak_rss(void) {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+#ifdef __APPLE__
+    // Mac reports bytes
+    return usage.ru_maxrss;
+#else
+    // Linux reports kilobytes
+    return usage.ru_maxrss * 1024;
+#endif
+}
+
 std::vector<std::string> &split_delims(const std::string &s, const std::string& delims, std::vector<std::string> &elems) {
     char* tok;
     char cchars [s.size()+1];
@@ -137,43 +104,22 @@ bool is_number(const std::string& s) {
 }
 
 bool allATGC(const string& s) {
-    for (string::const_iterator c = s.begin(); c != s.end(); ++c) {
-        char b = *c;
-        if (b != 'A' && b != 'T' && b != 'G' && b != 'C') {
-            return false;
-        }
-    }
-    return true;
+    return all_ACGT(s.data(), s.size());
 }
 
 bool allATGCN(const string& s) {
-    for (string::const_iterator c = s.begin(); c != s.end(); ++c) {
-        char b = *c;
-        if (b != 'A' && b != 'T' && b != 'G' && b != 'C' && b != 'N') {
-            return false;
-        }
-    }
-    return true;
+    return all_ACGTN(s.data(), s.size());
 }
 
 string nonATGCNtoN(const string& s) {
     auto n = s;
-    for (string::iterator c = n.begin(); c != n.end(); ++c) {
-        char b = *c;
-        if (b != 'A' && b != 'T' && b != 'G' && b != 'C' && b != 'N') {
-            *c = 'N';
-        }
-    }
+    non_ACGTN_to_N_in_place(&n[0], n.size());
     return n;
 }
 
 string toUppercase(const string& s) {
     auto n = s;
-    for (string::iterator c = n.begin(); c != n.end(); ++c) {
-        if (*c >= 'a' && *c <= 'z') {
-            *c -= 'a' - 'A';
-        }
-    }
+    to_uppercase_in_place(&n[0], n.size());
     return n;
 }
 
@@ -387,15 +333,14 @@ void get_input_file(const string& file_name, function<void(istream&)> callback)
         // Just use standard input
         callback(std::cin);
     } else {
-        // Open a file
-        ifstream in;
-        in.open(file_name.c_str());
-        if (!in.is_open()) {
+        // Open a file, fetching it in parallel if it is remote
+        unique_ptr<istream> in = open_input_file(file_name, get_thread_count());
+        if (!*in) {
             // The user gave us a bad filename
             cerr << "error:[get_input_file] could not open file \"" << file_name << "\"" << endl;
             exit(1);
         }
-        callback(in);
+        callback(*in);
     }
     
 }
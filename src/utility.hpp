@@ -33,6 +33,9 @@ bool is_all_n(const string& seq);
 /// Return the number of threads that OMP will produce for a parallel section.
 /// TODO: Assumes that this is the same for every parallel section.
 int get_thread_count(void);
+/// Return the most memory this process has had resident at once so far, in
+/// bytes.
+size_t get_peak_rss(void);
 string wrap_text(const string& str, size_t width);
 bool is_number(const string& s);
 
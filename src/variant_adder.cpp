@@ -55,6 +55,11 @@ void VariantAdder::add_variants(vcflib::VariantCallFile* vcf) {
     // We report when we skip contigs, but only once.
     set<string> skipped_contigs;
     
+    // We read groups of variants in batches, so we can align them to the
+    // graph in parallel before adding them in order.
+    size_t batch_size = get_thread_count() > 1 ? groups_per_thread * get_thread_count() : 1;
+    vector<VariantGroup> batch;
+    
     while(buffer.next()) {
         // For each variant in its context of nonoverlapping variants
         vcflib::Variant* variant;
@@ -87,7 +92,7 @@ void VariantAdder::add_variants(vcflib::VariantCallFile* vcf) {
             }
         }
         
-        if (variant->samples.empty()) {
+        if (variant->sampleNames.empty()) {
             // Complain if the variant has no samples. If there are no samples
             // in the VCF, we can't generate any haplotypes to use to add the
             // variants.
@@ -120,63 +125,46 @@ void VariantAdder::add_variants(vcflib::VariantCallFile* vcf) {
         // Get the unique haplotypes
         auto haplotypes = get_unique_haplotypes(local_variants, &buffer);
         
-        // Track the total bp of haplotypes
-        size_t total_haplotype_bases = 0;
-        
-        // Track the total graph size for the alignments
-        size_t total_graph_bases = 0;
-        
-        // How many haplotypes actually pass any haplotype filtering?
-        size_t used_haplotypes = 0;
-            
 #ifdef debug
         cerr << "Have " << haplotypes.size() << " haplotypes for variant "
             << variant->sequenceName << ":" << variant->position << endl;
 #endif
         
+        // Save everything we need about the group, since the buffer will
+        // move on before we add it.
+        batch.emplace_back();
+        VariantGroup& group = batch.back();
+        group.path_name = variant_path_name;
+        group.variant_name = variant->sequenceName + ":" + to_string(variant->position);
+        group.haplotype_count = haplotypes.size();
+        
         // Where does the group of nearby variants start?
-        size_t group_start = local_variants.front()->position;
+        group.group_start = local_variants.front()->position;
         // And where does it end (exclusive)? This is the latest ending point of any variant in the group...
-        size_t group_end = local_variants.back()->position + local_variants.back()->ref.size();
+        group.group_end = local_variants.back()->position + local_variants.back()->ref.size();
         
-        // We need to make sure we also grab this much extra graph context,
-        // since we count 2 radiuses + flank out from the ends of the group.
-        size_t group_width = group_end - group_start;
-        
-        // Find the center and radius of the group of variants, so we know what graph part to grab.
-        size_t overall_center;
-        size_t overall_radius;
-        tie(overall_center, overall_radius) = get_center_and_radius(local_variants);
-
         // Get the leading and trailing ref sequence on either side of this
         // group of variants (to pin the outside variants down).
 
         // On the left we want either flank_range bases, or all the bases before
         // the first base in the group.
-        size_t left_context_length = min((int64_t) flank_range, (int64_t) group_start);
+        size_t left_context_length = min((int64_t) flank_range, (int64_t) group.group_start);
         // On the right we want either flank_range bases, or all the bases after
         // the last base in the group. We know nothing will overlap the end of
         // the last variant, because we grabbed nonoverlapping variants.
-        size_t right_context_length = min(path_sequence.size() - group_end, (size_t) flank_range);
+        size_t right_context_length = min(path_sequence.size() - group.group_end, (size_t) flank_range);
     
         // Turn those into desired substring bounds.
-        // TODO: this is sort of just undoing some math we already did
-        size_t left_context_start = group_start - left_context_length;
-        size_t right_context_past_end = group_end + right_context_length;
+        group.left_context_start = group.group_start - left_context_length;
+        group.right_context_past_end = group.group_end + right_context_length;
             
 #ifdef debug
-            cerr << "Original context bounds: " << left_context_start << " - " << right_context_past_end << endl;
+            cerr << "Original context bounds: " << group.left_context_start << " - " << group.right_context_past_end << endl;
 #endif
 
-        // Find the reference sequence
-        const string& ref_sequence = sync.get_path_sequence(vcf_to_fasta(variant->sequenceName));
-
         for (auto& haplotype : haplotypes) {
             // For each haplotype
             
-            // TODO: since we lock repeatedly, neighboring variants will come in
-            // in undefined order and our result is nondeterministic.
-            
             // Only look at haplotypes that aren't pure reference.
             bool has_nonreference = false;
             for (auto& allele : haplotype) {
@@ -201,181 +189,15 @@ void VariantAdder::add_variants(vcflib::VariantCallFile* vcf) {
             }
             cerr << endl;
 #endif
-
-            // This lets us know if we need to walk out more to find matchable sequence
-            bool have_dangling_ends;
-            do {
-                // We need to be able to increase our bounds until we haven't
-                // shifted an indel to the border of our context.
-                
-                // Round bounds to node start and endpoints.
-                // This haplotype and all subsequent ones will be aligned with this wider context.
-                sync.with_path_index(variant_path_name, [&](const PathIndex& index) {
-                    tie(left_context_start, right_context_past_end) = index.round_outward(left_context_start,
-                        right_context_past_end);
-                });
-                
-#ifdef debug
-                cerr << "New context bounds: " << left_context_start << " - " << right_context_past_end << endl;
-#endif
-                
-                // Recalculate context lengths
-                left_context_length = group_start - left_context_start;
-                right_context_length = right_context_past_end - group_end;
-                
-                // Make sure we pull out out to the ends of the contexts
-                overall_radius = max(overall_radius, max(overall_center - left_context_start,
-                    right_context_past_end - overall_center));
-                
-                // Get actual context strings
-                string left_context = path_sequence.substr(group_start - left_context_length, left_context_length);
-                string right_context = path_sequence.substr(group_end, right_context_length);
-                
-                // Make the haplotype's combined string
-                stringstream to_align;
-                to_align << left_context << haplotype_to_string(haplotype, local_variants) << right_context;
-                
-#ifdef debug
-                cerr << "Align " << to_align.str() << endl;
-#endif
-
-                // Make a request to lock the subgraph, leaving the nodes we rounded
-                // to (or the child nodes they got broken into) as heads/tails.
-                GraphSynchronizer::Lock lock(sync, variant_path_name, left_context_start, right_context_past_end);
-                
-#ifdef debug
-                cerr << "Waiting for lock on " << variant_path_name << ":"
-                    << left_context_start << "-" << right_context_past_end << endl;
-#endif
-                
-                // Block until we get it
-                lock_guard<GraphSynchronizer::Lock> guard(lock);
-                
-#ifdef debug
-                cerr << "Got lock on " << variant_path_name << ":"
-                    << left_context_start << "-" << right_context_past_end << endl;
-#endif            
-                    
-#ifdef debug
-                cerr << "Got " << lock.get_subgraph().length() << " bp in " << lock.get_subgraph().size() << " nodes" << endl;
-#endif
-
-#ifdef debug
-                ofstream seq_dump("seq_dump.txt");
-                seq_dump << to_align.str();
-                seq_dump.close();
-
-                sync.with_path_index(variant_path_name, [&](const PathIndex& index) {
-                    // Make sure we actually have the endpoints we wanted
-                    auto found_left = index.find_position(left_context_start);
-                    auto found_right = index.find_position(right_context_past_end - 1);
-                    assert(left_context_start == found_left->first);
-                    assert(right_context_past_end == found_right->first + index.node_length(found_right));
-                    
-                    cerr << "Group runs " << group_start << "-" << group_end << endl;
-                    cerr << "Context runs " << left_context_start << "-" << right_context_past_end << ": "
-                        << right_context_past_end - left_context_start  << " bp" << endl;
-                    cerr << "Sequence is " << to_align.str().size() << " bp" << endl;
-                    cerr << "Leftmost node is " << found_left->second << endl;
-                    cerr << "Leftmost Sequence: " << lock.get_subgraph().get_node(found_left->second.node)->sequence() << endl;
-                    cerr << "Rightmost node is " << found_right->second << endl;
-                    cerr << "Rightmost Sequence: " << lock.get_subgraph().get_node(found_right->second.node)->sequence() << endl;
-                    cerr << "Left context: " << left_context << endl;
-                    cerr << "Right context: " << right_context << endl;
-                    
-                    lock.get_subgraph().for_each_node([&](Node* node) {
-                        // Look at nodes
-                        if (index.by_id.count(node->id())) {
-                            cerr << "Node " << node->id() << " at " << index.by_id.at(node->id()).first
-                                << " orientation " << index.by_id.at(node->id()).second << endl;
-                        } else {
-                            cerr << "Node " << node->id() << " not on path" << endl;
-                        }
-                    });
-                    
-                    if (lock.get_subgraph().is_acyclic()) {
-                        cerr << "Subgraph is acyclic" << endl;
-                    } else {
-                        cerr << "Subgraph is cyclic" << endl;
-                    }
-                });
-#endif
-                
-                // Work out how far we would have to unroll the graph to account for
-                // a giant deletion. We also want to account for alts that may
-                // already be in the graph and need unrolling for a long insert.
-                size_t max_span = max(right_context_past_end - left_context_start, to_align.str().size());
-                
-                // Do the alignment, dispatching cleverly on size
-                Alignment aln = smart_align(lock.get_subgraph(), lock.get_endpoints(), to_align.str(), max_span);
-                
-#ifdef debug
-                cerr << "Postprocessed: " << pb2json(aln) << endl;
-#endif
-                
-                // Look at the ends of the alignment
-                assert(aln.path().mapping_size() > 0);
-                auto& last_mapping = aln.path().mapping(aln.path().mapping_size() - 1);
-                assert(last_mapping.edit_size() > 0);
-                auto& last_edit = last_mapping.edit(last_mapping.edit_size() - 1);
-                auto& first_mapping = aln.path().mapping(0);
-                assert(first_mapping.edit_size() > 0);
-                auto& first_edit = first_mapping.edit(0);
-                
-                // Assume they aren't dangling
-                have_dangling_ends = false;
-                
-                if (!edit_is_match(first_edit) && left_context_start > 0) {
-                    // Actually the left end is dangling, so try looking left
-                    have_dangling_ends = true;
-                    left_context_start--;
-#ifdef debug
-                    cerr << "Left end dangled!" << endl;
-#endif
-                }
-                
-                if (!edit_is_match(last_edit) && right_context_past_end < ref_sequence.size()) {
-                    // Actually the right end is dangling, so try looking right
-                    have_dangling_ends = true;
-                    right_context_past_end++;
-#ifdef debug
-                    cerr << "Right end dangled!" << endl;
-#endif
-                }
-                
-                if (!have_dangling_ends) {
-                    
-                    // Make this path's edits to the original graph. We don't need to do
-                    // anything with the translations.
-                    lock.apply_full_length_edit(aln.path());
-                    
-                    // Count all the bases in the haplotype
-                    total_haplotype_bases += to_align.str().size();
-                    // Record the size of graph we're aligning to in bases
-                    total_graph_bases += lock.get_subgraph().length();
-                    // Record the haplotype as used
-                    used_haplotypes++;
-                    
-                    
-                } else {
-#ifdef debug
-                    cerr << "Expand context and retry" << endl;
-#endif
-                }
-                // If we have dangling ends, we try again with our expanded context
-                
-            } while (have_dangling_ends);
+            
+            group.haplotypes.push_back(haplotype_to_string(haplotype, local_variants));
         }
         
-        if (print_updates && (variants_processed++ % 1000 == 0 || true)) {
-            #pragma omp critical (cerr)
-            cerr << "Variant " << variants_processed << ": " << haplotypes.size() << " haplotypes at "
-                << variant->sequenceName << ":" << variant->position << ": "
-                << (used_haplotypes ? (total_haplotype_bases / used_haplotypes) : 0) << " bp vs. "
-                << (used_haplotypes ? (total_graph_bases / used_haplotypes) : 0) << " bp haplotypes vs. graphs average" << endl;
+        if (batch.size() >= batch_size) {
+            add_groups(batch, variants_processed);
+            batch.clear();
         }
         
-        
 #ifdef debug
         // Count our current heads and tails
         graph.head_nodes(to_count);
@@ -405,12 +227,226 @@ void VariantAdder::add_variants(vcflib::VariantCallFile* vcf) {
 #endif
         
     }
+    
+    // Add whatever is left
+    add_groups(batch, variants_processed);
 
     // Clean up after the last contig.
     destroy_progress();
     
 }
 
+void VariantAdder::add_groups(vector<VariantGroup>& batch, size_t& variants_processed) {
+    
+    // Align the first haplotype of each group in parallel, against the graph
+    // as it is before the batch. Groups far enough apart not to interact will
+    // find the graph the same when their turn comes, and can just use these.
+    vector<HaplotypeAlignment> speculations(batch.size());
+    if (batch.size() > 1) {
+        #pragma omp parallel for schedule(dynamic, 1)
+        for (size_t i = 0; i < batch.size(); i++) {
+            if (!batch[i].haplotypes.empty()) {
+                speculations[i] = add_haplotype(batch[i], batch[i].haplotypes.front(),
+                    batch[i].left_context_start, batch[i].right_context_past_end, false);
+            }
+        }
+    }
+    
+    for (size_t i = 0; i < batch.size(); i++) {
+        VariantGroup& group = batch[i];
+        
+        // Track the total bp of haplotypes
+        size_t total_haplotype_bases = 0;
+        
+        // Track the total graph size for the alignments
+        size_t total_graph_bases = 0;
+        
+        // Each haplotype and all subsequent ones will be aligned with the
+        // widest context we needed so far.
+        size_t left_context_start = group.left_context_start;
+        size_t right_context_past_end = group.right_context_past_end;
+        
+        for (size_t j = 0; j < group.haplotypes.size(); j++) {
+            // Add each haplotype in order, using the speculative alignment
+            // for the first if it still holds.
+            HaplotypeAlignment added = add_haplotype(group, group.haplotypes[j], left_context_start,
+                right_context_past_end, true, (j == 0 && speculations[i].valid) ? &speculations[i] : nullptr);
+            
+            left_context_start = added.left_context_start;
+            right_context_past_end = added.right_context_past_end;
+            total_haplotype_bases += added.haplotype_bases;
+            total_graph_bases += added.graph_bases;
+        }
+        
+        // How many haplotypes actually pass any haplotype filtering?
+        size_t used_haplotypes = group.haplotypes.size();
+        
+        if (print_updates && (variants_processed++ % 1000 == 0 || true)) {
+            #pragma omp critical (cerr)
+            cerr << "Variant " << variants_processed << ": " << group.haplotype_count << " haplotypes at "
+                << group.variant_name << ": "
+                << (used_haplotypes ? (total_haplotype_bases / used_haplotypes) : 0) << " bp vs. "
+                << (used_haplotypes ? (total_graph_bases / used_haplotypes) : 0) << " bp haplotypes vs. graphs average" << endl;
+        }
+    }
+}
+
+VariantAdder::HaplotypeAlignment VariantAdder::add_haplotype(const VariantGroup& group, const string& haplotype,
+    size_t left_context_start, size_t right_context_past_end, bool apply, const HaplotypeAlignment* speculation) {
+    
+    // Grab the sequence of the path, which won't change
+    const string& path_sequence = sync.get_path_sequence(group.path_name);
+    
+    HaplotypeAlignment result;
+    
+    if (speculation != nullptr) {
+        // Try straight away with the context the speculative alignment ended
+        // up needing.
+        left_context_start = speculation->left_context_start;
+        right_context_past_end = speculation->right_context_past_end;
+    }
+    
+    // This lets us know if we need to walk out more to find matchable sequence
+    bool have_dangling_ends;
+    do {
+        // We need to be able to increase our bounds until we haven't
+        // shifted an indel to the border of our context.
+        
+        // Round bounds to node start and endpoints.
+        sync.with_path_index(group.path_name, [&](const PathIndex& index) {
+            tie(left_context_start, right_context_past_end) = index.round_outward(left_context_start,
+                right_context_past_end);
+        });
+        
+#ifdef debug
+        cerr << "New context bounds: " << left_context_start << " - " << right_context_past_end << endl;
+#endif
+        
+        // Get actual context strings
+        size_t left_context_length = group.group_start - left_context_start;
+        size_t right_context_length = right_context_past_end - group.group_end;
+        string left_context = path_sequence.substr(left_context_start, left_context_length);
+        string right_context = path_sequence.substr(group.group_end, right_context_length);
+        
+        // Make the haplotype's combined string
+        string to_align = left_context + haplotype + right_context;
+        
+#ifdef debug
+        cerr << "Align " << to_align << endl;
+#endif
+
+        // Make a request to lock the subgraph, leaving the nodes we rounded
+        // to (or the child nodes they got broken into) as heads/tails.
+        GraphSynchronizer::Lock lock(sync, group.path_name, left_context_start, right_context_past_end);
+        
+#ifdef debug
+        cerr << "Waiting for lock on " << group.path_name << ":"
+            << left_context_start << "-" << right_context_past_end << endl;
+#endif
+        
+        // Block until we get it
+        lock_guard<GraphSynchronizer::Lock> guard(lock);
+        
+#ifdef debug
+        cerr << "Got " << lock.get_subgraph().length() << " bp in " << lock.get_subgraph().size() << " nodes" << endl;
+#endif
+        
+        Alignment aln;
+        bool speculated = false;
+        if (speculation != nullptr) {
+            if (lock.get_subgraph().graph.SerializeAsString() == speculation->subgraph) {
+                // Nothing has changed here since we aligned, so we would
+                // get the same alignment again.
+                aln = speculation->aln;
+                speculated = true;
+            } else {
+                // We need to start over from where the speculation started,
+                // and work out again how much context we really need.
+                left_context_start = group.left_context_start;
+                right_context_past_end = group.right_context_past_end;
+                speculation = nullptr;
+                have_dangling_ends = true;
+                continue;
+            }
+            speculation = nullptr;
+        }
+        
+        if (!speculated) {
+            // Work out how far we would have to unroll the graph to account for
+            // a giant deletion. We also want to account for alts that may
+            // already be in the graph and need unrolling for a long insert.
+            size_t max_span = max(right_context_past_end - left_context_start, to_align.size());
+            
+            // Do the alignment, dispatching cleverly on size
+            aln = smart_align(lock.get_subgraph(), lock.get_endpoints(), to_align, max_span);
+        }
+        
+#ifdef debug
+        cerr << "Postprocessed: " << pb2json(aln) << endl;
+#endif
+        
+        // Look at the ends of the alignment
+        assert(aln.path().mapping_size() > 0);
+        auto& last_mapping = aln.path().mapping(aln.path().mapping_size() - 1);
+        assert(last_mapping.edit_size() > 0);
+        auto& last_edit = last_mapping.edit(last_mapping.edit_size() - 1);
+        auto& first_mapping = aln.path().mapping(0);
+        assert(first_mapping.edit_size() > 0);
+        auto& first_edit = first_mapping.edit(0);
+        
+        // Assume they aren't dangling
+        have_dangling_ends = false;
+        
+        if (!edit_is_match(first_edit) && left_context_start > 0) {
+            // Actually the left end is dangling, so try looking left
+            have_dangling_ends = true;
+            left_context_start--;
+#ifdef debug
+            cerr << "Left end dangled!" << endl;
+#endif
+        }
+        
+        if (!edit_is_match(last_edit) && right_context_past_end < path_sequence.size()) {
+            // Actually the right end is dangling, so try looking right
+            have_dangling_ends = true;
+            right_context_past_end++;
+#ifdef debug
+            cerr << "Right end dangled!" << endl;
+#endif
+        }
+        
+        if (!have_dangling_ends) {
+            
+            result.left_context_start = left_context_start;
+            result.right_context_past_end = right_context_past_end;
+            // Count all the bases in the haplotype
+            result.haplotype_bases = to_align.size();
+            // Record the size of graph we're aligning to in bases
+            result.graph_bases = lock.get_subgraph().length();
+            
+            if (apply) {
+                // Make this path's edits to the original graph. We don't need to do
+                // anything with the translations.
+                lock.apply_full_length_edit(aln.path());
+            } else {
+                // Remember what we aligned against, so we can tell if the
+                // alignment is still good later.
+                result.subgraph = lock.get_subgraph().graph.SerializeAsString();
+                result.aln = move(aln);
+                result.valid = true;
+            }
+        } else {
+#ifdef debug
+            cerr << "Expand context and retry" << endl;
+#endif
+        }
+        // If we have dangling ends, we try again with our expanded context
+        
+    } while (have_dangling_ends);
+    
+    return result;
+}
+
 void VariantAdder::align_ns(vg::VG& graph, Alignment& aln) {
     for (size_t i = 0; i < aln.path().mapping_size(); i++) {
         // For each mapping
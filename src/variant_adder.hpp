@@ -135,6 +135,14 @@ public:
     /// processed?
     bool print_updates = false;
     
+    /// When running with multiple threads, how many groups of nearby variants
+    /// per thread should we read from the VCF at a time? The first haplotype
+    /// of each group in a batch is aligned in parallel, and the groups are
+    /// then added in order, reusing those alignments wherever the graph
+    /// around them hasn't changed since. The result is the same no matter
+    /// how many threads are used.
+    size_t groups_per_thread = 8;
+    
 protected:
     /// The graph we are modifying
     VG& graph;
@@ -147,6 +155,65 @@ protected:
     /// without locking the graph.
     set<string> path_names;
     
+    /**
+     * Everything we need to know about a group of nearby variants to add it to
+     * the graph, once the VCF buffer has moved on.
+     */
+    struct VariantGroup {
+        /// The graph path the variants are on
+        string path_name;
+        /// A name for the main variant, for reporting
+        string variant_name;
+        /// The number of unique haplotypes, including pure reference ones
+        size_t haplotype_count = 0;
+        /// Where on the path the group starts
+        size_t group_start = 0;
+        /// Where on the path the group ends (exclusive)
+        size_t group_end = 0;
+        /// The bounds of the flanking context we start out aligning with
+        size_t left_context_start = 0;
+        size_t right_context_past_end = 0;
+        /// The sequences of the non-reference haplotypes, from the group start
+        /// to the group end
+        vector<string> haplotypes;
+    };
+    
+    /**
+     * The result of aligning a haplotype of a variant group to the graph.
+     */
+    struct HaplotypeAlignment {
+        /// The context bounds the alignment needed
+        size_t left_context_start = 0;
+        size_t right_context_past_end = 0;
+        /// The size of the aligned string with its context, and of the graph
+        /// it was aligned to
+        size_t haplotype_bases = 0;
+        size_t graph_bases = 0;
+        /// If the alignment wasn't applied, it is kept here, along with the
+        /// serialized subgraph it was made against.
+        bool valid = false;
+        Alignment aln;
+        string subgraph;
+    };
+    
+    /**
+     * Add all the groups in a batch to the graph, in order.
+     */
+    void add_groups(vector<VariantGroup>& batch, size_t& variants_processed);
+    
+    /**
+     * Align a haplotype of the given group to the graph, starting from the
+     * given context bounds and widening them until neither end of the
+     * alignment dangles. If apply is set, the alignment is applied to the
+     * graph while its context is still locked; otherwise it is returned. If a
+     * speculative alignment of the same haplotype is given, it is used instead
+     * of aligning again when the graph in its context hasn't changed since it
+     * was made.
+     */
+    HaplotypeAlignment add_haplotype(const VariantGroup& group, const string& haplotype,
+        size_t left_context_start, size_t right_context_past_end, bool apply,
+        const HaplotypeAlignment* speculation = nullptr);
+    
     /**
      * Get all the unique combinations of variant alts represented by actual
      * haplotypes. Arbitrarily phases unphased variants.
@@ -2,6 +2,8 @@
 #include "variant_recall.hpp"
 #include "algorithms/topological_sort.hpp"
 #include "traversal_finder.hpp"
+#include "gam_index.hpp"
+#include <omp.h>
 
 namespace vg {
 
@@ -49,21 +51,30 @@ void genotype_svs(VG* graph,
     // We trust that the relevant flags are set by FILTER
     vector<Path> direct_ins;
     set<NodeSide> spare_nodesides;
+    // Pairs are classified on all the threads, so each thread collects its own
+    // reads and they are put together afterward
+    vector<vector<pair<Alignment, Alignment> > > thread_sv_reads(get_thread_count());
+    vector<vector<Path> > thread_direct_ins(get_thread_count());
     std::function<void(Alignment&, Alignment&)> readfunc = [&](Alignment& a, Alignment& b){
-        bool toss_into_sv_map = false;
-
+        int tid = omp_get_thread_num();
 
         if (srrp.ff.mark_sv_alignments(a,b)){
-            sv_reads.push_back(make_pair(a, b));
+            thread_sv_reads[tid].push_back(make_pair(a, b));
         }
                                 
         else if (srrp.ff.mark_smallVariant_alignments(a, b)){
-            direct_ins.push_back(a.path());
-            direct_ins.push_back(b.path());
+            thread_direct_ins[tid].push_back(a.path());
+            thread_direct_ins[tid].push_back(b.path());
         }
 
     };
     stream::for_each_interleaved_pair_parallel(gamstream, readfunc);
+    for (int i = 0; i < thread_sv_reads.size(); ++i){
+        std::move(thread_sv_reads[i].begin(), thread_sv_reads[i].end(), back_inserter(sv_reads));
+        std::move(thread_direct_ins[i].begin(), thread_direct_ins[i].end(), back_inserter(direct_ins));
+    }
+    thread_sv_reads.clear();
+    thread_direct_ins.clear();
     vector<Translation> transls;
     if (refpath != ""){
         transls = graph->edit(direct_ins); // TODO could maybe use edit_fast??
@@ -115,8 +126,6 @@ void variant_recall(VG* graph,
                                FastaReference* ref_genome,
                                vector<FastaReference*> insertions,
                                string gamfile, bool isIndex){
-    // Store variant->name index
-    map<string, vcflib::Variant> hash_to_var;
     set<int64_t> variant_nodes;
 
     bool use_snarls = false;
@@ -131,20 +140,6 @@ void variant_recall(VG* graph,
         }
     };
 
-    // Store a list of node IDs each variant covers
-    map<string, unordered_set<int64_t> > allele_name_to_node_id;
-        
-    unordered_map<int64_t, string> node_to_variant;
-
-        
-
-    map<string, set<string> > allele_name_to_alignment_name;
-        
-
-    // A dumb depth map, for each node in the graph, of substantial size
-    unordered_map<int64_t, int32_t> node_id_to_depth;
-    node_id_to_depth.reserve(10000);
-
     //Cache graph paths
     unordered_map<string, list<mapping_t> > gpaths( (graph->paths)._paths.begin(), (graph->paths)._paths.end()  );
 
@@ -177,31 +172,69 @@ void variant_recall(VG* graph,
     }
         
 
-    // For each variant in VCF:
+    // For each variant in VCF, in order:
+    vector<vcflib::Variant> variants;
+    vector<string> variant_ids;
+    unordered_set<string> seen_variant_ids;
+    // The nodes on the paths of each variant's alleles, and which variant and
+    // allele each node belongs to, so we can count mappings to nodes later.
+    vector<vector<int64_t> > nodes_of_variant;
+    unordered_map<int64_t, pair<size_t, int> > node_to_allele;
     vcflib::Variant var;
     while(vars->getNextVariant(var)){
         // Adjust the position offset, canonicalize any structural variants,
-        // and get the sha1 hash of the variant and store that in a map for later.
+        // and get the sha1 hash of the variant so each one is only genotyped once.
         var.position -= 1;
         var.canonicalize_sv(*ref_genome, insertions, -1);
         string var_id = make_variant_id(var);
+        if (!seen_variant_ids.insert(var_id).second){
+            continue;
+        }
 
-        hash_to_var[ var_id ] = var;
-
-
-        // If we're just using the GAM, build a map Node -> variant and
-        // a map alt_path_id (i.e. "allele name") -> NodeID. We'll use these to count
-        // mappings to nodes later.
+        vector<int64_t> var_nodes;
         for (int alt_ind = 0; alt_ind <= var.alt.size(); alt_ind++){
             string alt_id = "_alt_" + var_id + "_" + std::to_string(alt_ind);
-            list<mapping_t> x_path = gpaths[ alt_id ];
-            for (mapping_t x_m : x_path){
-                allele_name_to_node_id[ alt_id ].insert(x_m.node_id());
-                node_to_variant[x_m.node_id()] = alt_id;
+            auto found = gpaths.find(alt_id);
+            if (found == gpaths.end()){
+                continue;
+            }
+            for (mapping_t& x_m : found->second){
+                node_to_allele[x_m.node_id()] = make_pair(variants.size(), alt_ind);
                 variant_nodes.insert(x_m.node_id());
+                var_nodes.push_back(x_m.node_id());
             }
         }
+        std::sort(var_nodes.begin(), var_nodes.end());
+        var_nodes.erase(std::unique(var_nodes.begin(), var_nodes.end()), var_nodes.end());
 
+        variants.push_back(var);
+        variant_ids.push_back(var_id);
+        nodes_of_variant.push_back(std::move(var_nodes));
+    }
+
+    // Partition the variants into regions of nearby variants on the same
+    // contig. The reads for each region are gathered with one query, and the
+    // regions are genotyped concurrently.
+    const size_t region_max_variants = 256;
+    const int64_t region_max_length = 1000000;
+    vector<pair<size_t, size_t> > regions;
+    for (size_t i = 0; i < variants.size(); ++i){
+        if (regions.empty() ||
+            variants[i].sequenceName != variants[regions.back().first].sequenceName ||
+            i - regions.back().first >= region_max_variants ||
+            abs(variants[i].position - variants[regions.back().first].position) > region_max_length){
+            regions.emplace_back(i, i + 1);
+        }
+        else{
+            regions.back().second = i + 1;
+        }
+    }
+
+    // The names of the reads supporting each allele of each variant. Regions
+    // only ever touch their own variants' entries.
+    vector<vector<set<string> > > allele_to_alignment_names(variants.size());
+    for (size_t i = 0; i < variants.size(); ++i){
+        allele_to_alignment_names[i].resize(variants[i].alt.size() + 1);
     }
 
     vcflib::VariantCallFile outvcf;
@@ -238,69 +271,29 @@ void variant_recall(VG* graph,
         return ( (double) matches / (double) tot_len) > 0.85;
     };
 
-    std::function<void(Alignment&)> incr = [&](const Alignment& a){
-        bool anchored = false;
-        bool contained = false;
-        int64_t node_for_var = 0;
-        for (int i = 0; i < a.path().mapping_size(); i++){
-            int64_t node_id = a.path().mapping(i).position().node_id();
-            if (variant_nodes.count(node_id) && a.mapping_quality() > 20 && sufficient_matches(a.path().mapping(i))){
-#pragma omp atomic write
-                contained = true;
-                node_for_var = node_id;
-
-            }
-            else if (!variant_nodes.count(node_id)){
-#pragma omp atomic write
-                anchored = true;
-            }
-        }
-
-        if (contained & anchored){
-
-#pragma omp critical
-            {
-                // Get our variant allele hash
-                string all_str = node_to_variant[node_for_var];
-
-                // Add alignment to the variant's set of alignments
-                allele_name_to_alignment_name[all_str].insert(a.name());
-
-            }
-                
-        }
-    };
-
-    std::function<void(const Alignment&)> index_incr = [&allele_name_to_alignment_name, &sufficient_matches, &node_to_variant, &variant_nodes](const Alignment& a){
+    // Find the variant and allele a read supports, if any: it has to match
+    // well to a variant node and also be anchored on a node outside the
+    // variants. Only reads the graph and the variant maps, so it is safe to
+    // call from any thread.
+    std::function<bool(const Alignment&, pair<size_t, int>&)> supported_allele = [&](const Alignment& a, pair<size_t, int>& allele){
         bool anchored = false;
         bool contained = false;
         int64_t node_for_var = 0;
         for (int i = 0; i < a.path().mapping_size(); i++){
             int64_t node_id = a.path().mapping(i).position().node_id();
             if (variant_nodes.count(node_id) && a.mapping_quality() > 20 && sufficient_matches(a.path().mapping(i))){
-#pragma omp atomic write
                 contained = true;
-#pragma omp atomic write
                 node_for_var = node_id;
             }
             else if (!variant_nodes.count(node_id)){
-#pragma omp atomic write
                 anchored = true;
             }
         }
-
-        if (contained & anchored){
-#pragma omp critical
-            {
-                // Get our variant allele hash
-                string all_str = node_to_variant[node_for_var];
-
-                // Add alignment to the variant's set of alignments
-                allele_name_to_alignment_name[all_str].insert(a.name());
-
-            }
-                
+        if (!(contained & anchored)){
+            return false;
         }
+        allele = node_to_allele.at(node_for_var);
+        return true;
     };
 
     SimpleConsistencyCalculator scc;
@@ -339,16 +332,28 @@ void variant_recall(VG* graph,
             
     };
     // open our gam, count our reads, close our gam.
-    if (!isIndex){
+    if (!isIndex && !use_snarls && !ifstream(gamfile + ".gai")){
+        // With no index, stream the whole GAM once on all the threads, and
+        // sort the supporting reads into their alleles afterward.
         ifstream gamstream(gamfile);
-        if (gamstream.good()){
-            stream::for_each(gamstream, incr);
-        }
-        else{
+        if (!gamstream.good()){
             cerr << "GAM stream is bad " << gamfile << endl;
             exit(9);
         }
+        vector<vector<pair<pair<size_t, int>, string> > > thread_supports(get_thread_count());
+        std::function<void(Alignment&)> incr = [&](Alignment& a){
+            pair<size_t, int> allele;
+            if (supported_allele(a, allele)){
+                thread_supports[omp_get_thread_num()].emplace_back(allele, a.name());
+            }
+        };
+        stream::for_each_parallel(gamstream, incr);
         gamstream.close();
+        for (auto& supports : thread_supports){
+            for (auto& support : supports){
+                allele_to_alignment_names[support.first.first][support.first.second].insert(support.second);
+            }
+        }
     }
     else if (use_snarls && !isIndex){
         ifstream gamstream(gamfile);
@@ -357,13 +362,66 @@ void variant_recall(VG* graph,
         }
         gamstream.close();
     }
-    else{
-        Index gamindex;
-        gamindex.open_read_only(gamfile);
-        vector<int64_t> vn(variant_nodes.begin(), variant_nodes.end());
-        gamindex.for_alignment_to_nodes(vn, index_incr);
-    }
 
+    // Otherwise each region queries the index for the reads on its variants'
+    // nodes, on its own thread.
+    unique_ptr<GAMIndex> gam_index;
+    list<ifstream> gam_streams;
+    vector<GAMIndex::cursor_t> gam_cursors;
+    unique_ptr<Index> gamindex;
+    if (isIndex){
+        gamindex = unique_ptr<Index>(new Index());
+        gamindex->open_read_only(gamfile);
+    }
+    else if (!use_snarls && ifstream(gamfile + ".gai")){
+        ifstream index_stream(gamfile + ".gai");
+        gam_index = unique_ptr<GAMIndex>(new GAMIndex());
+        gam_index->load(index_stream);
+        gam_cursors.reserve(get_thread_count());
+        for (int i = 0; i < get_thread_count(); ++i){
+            // Every thread seeks in the sorted GAM with its own cursor
+            gam_streams.emplace_back(gamfile);
+            if (!gam_streams.back().good()){
+                cerr << "GAM stream is bad " << gamfile << endl;
+                exit(9);
+            }
+            gam_cursors.emplace_back(gam_streams.back());
+        }
+    }
+    std::function<void(size_t)> gather_region_reads = [&](size_t r){
+        size_t first = regions[r].first;
+        size_t past_last = regions[r].second;
+        vector<int64_t> region_nodes;
+        for (size_t i = first; i < past_last; ++i){
+            region_nodes.insert(region_nodes.end(), nodes_of_variant[i].begin(), nodes_of_variant[i].end());
+        }
+        std::sort(region_nodes.begin(), region_nodes.end());
+        region_nodes.erase(std::unique(region_nodes.begin(), region_nodes.end()), region_nodes.end());
+
+        // reads can support variants in other regions, which find them themselves
+        std::function<void(const Alignment&)> region_incr = [&](const Alignment& a){
+            pair<size_t, int> allele;
+            if (supported_allele(a, allele) && allele.first >= first && allele.first < past_last){
+                allele_to_alignment_names[allele.first][allele.second].insert(a.name());
+            }
+        };
+        if (gam_index.get() != nullptr){
+            // Query all of the region's nodes at once, as coalesced ID ranges
+            vector<pair<vg::id_t, vg::id_t> > ranges;
+            for (int64_t id : region_nodes){
+                if (!ranges.empty() && ranges.back().second + 1 == id){
+                    ranges.back().second = id;
+                }
+                else{
+                    ranges.emplace_back(id, id);
+                }
+            }
+            gam_index->find(gam_cursors[omp_get_thread_num()], ranges, region_incr);
+        }
+        else{
+            gamindex->for_alignment_to_nodes(region_nodes, region_incr);
+        }
+    };
 
     std::function<long double(int64_t)> fac = [](int64_t t){
         long double result = 1.0;
@@ -450,23 +508,24 @@ void variant_recall(VG* graph,
     };
 
     string sampleName = "Sample";
-    for (auto it : hash_to_var){
-        //cerr << it.second.position << " ";
-        it.second.setVariantCallFile(outvcf);
-        it.second.format.push_back("GT");
-        auto& genotype_vector = it.second.samples[sampleName]["GT"];
-        vector<int64_t> read_counts(it.second.alt.size() + 1, 0);
-        for (int i = 0; i <= it.second.alt.size(); ++i){
+    std::function<string(size_t)> genotype_variant = [&](size_t v){
+        vcflib::Variant& variant = variants[v];
+        variant.setVariantCallFile(outvcf);
+        variant.format.push_back("GT");
+        auto& genotype_vector = variant.samples[sampleName]["GT"];
+        vector<int64_t> read_counts(variant.alt.size() + 1, 0);
+        for (int i = 0; i <= variant.alt.size(); ++i){
             int64_t readsum = 0;
-            string alt_id = "_alt_" + it.first + "_" + std::to_string(i);
             if (!use_snarls){
-                readsum = allele_name_to_alignment_name[ alt_id ].size();
+                readsum = allele_to_alignment_names[v][i].size();
             }
             else{
-                readsum = traversal_name_to_alignment_names[ alt_id ].size();
+                string alt_id = "_alt_" + variant_ids[v] + "_" + std::to_string(i);
+                auto found = traversal_name_to_alignment_names.find(alt_id);
+                readsum = (found == traversal_name_to_alignment_names.end() ? 0 : found->second.size());
             }
             read_counts[i] = readsum;
-            it.second.info["AD"].push_back(std::to_string(readsum));
+            variant.info["AD"].push_back(std::to_string(readsum));
         }
 
         pair<double, int> prob_and_geno_index = do_math(  read_counts[0], read_counts[1], 0.333);
@@ -483,11 +542,36 @@ void variant_recall(VG* graph,
             genotype_vector.push_back("./.");
         }
 
-        it.second.info["GP"].push_back(std::to_string(prob_and_geno_index.first));
+        variant.info["GP"].push_back(std::to_string(prob_and_geno_index.first));
 
+        stringstream line;
+        line << variant;
+        // the reads were only needed for this variant
+        vector<set<string> >().swap(allele_to_alignment_names[v]);
+        return line.str();
+    };
 
-        cout << it.second << endl;
-
+    // Genotype a batch of regions at a time on all the threads, and write
+    // each batch out in VCF order.
+    bool query_regions = gam_index.get() != nullptr || gamindex.get() != nullptr;
+    size_t batch_size = get_thread_count() * 4;
+    for (size_t batch_start = 0; batch_start < regions.size(); batch_start += batch_size){
+        size_t batch_end = min(batch_start + batch_size, regions.size());
+        vector<string> region_lines(batch_end - batch_start);
+#pragma omp parallel for schedule(dynamic, 1)
+        for (size_t r = batch_start; r < batch_end; ++r){
+            if (query_regions){
+                gather_region_reads(r);
+            }
+            stringstream lines;
+            for (size_t v = regions[r].first; v < regions[r].second; ++v){
+                lines << genotype_variant(v) << endl;
+            }
+            region_lines[r - batch_start] = lines.str();
+        }
+        for (auto& lines : region_lines){
+            cout << lines;
+        }
     }
 
 }
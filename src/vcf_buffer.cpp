@@ -87,10 +87,18 @@ bool WindowedVcfBuffer::has_tabix() const {
 }
 
 bool WindowedVcfBuffer::set_region(const string& contig, int64_t start, int64_t end) {
-    // Clear buffers
+    // Clear buffers, keeping the variants to reuse
+    for (auto& variant : variants_before) {
+        recycle(std::move(variant));
+    }
     variants_before.clear();
+    for (auto& variant : variants_after) {
+        recycle(std::move(variant));
+    }
     variants_after.clear();
-    current.reset(nullptr);
+    if (current.get() != nullptr) {
+        recycle(std::move(current));
+    }
     
     return reader.set_region(contig, start, end);
 }
@@ -113,8 +121,8 @@ bool WindowedVcfBuffer::next() {
             // Couldn't find anything. Leave current as nullptr.
             return false;
         } else {
-            // Copy what we found into a new Variant we own
-            current.reset(new vcflib::Variant(*(reader.get())));
+            // Copy what we found into a Variant we own
+            current = copy_variant(*(reader.get()));
             reader.handle_buffer();
         }
     }
@@ -131,8 +139,8 @@ bool WindowedVcfBuffer::next() {
         // As long as the leftmost variant exists and is on the wrong contig or
         // too far left
         
-        // Delete anything we have cached for it
-        cached_genotypes.erase(variants_before.front().get());
+        // Keep it, and anything we have cached for it, to reuse
+        recycle(std::move(variants_before.front()));
         
         // Pop it        
         variants_before.pop_front();
@@ -148,7 +156,7 @@ bool WindowedVcfBuffer::next() {
         
         // As long as we have a next variant on this contig that's in range,
         // grab a copy.
-        variants_after.emplace_back(new vcflib::Variant(*(reader.get())));
+        variants_after.emplace_back(copy_variant(*(reader.get())));
         reader.handle_buffer();
         reader.fill_buffer();
     }
@@ -217,78 +225,117 @@ tuple<vector<vcflib::Variant*>, vcflib::Variant*, vector<vcflib::Variant*>> Wind
 
 const vector<vector<int>>& WindowedVcfBuffer::get_parsed_genotypes(vcflib::Variant* variant) {
 
-    if (!cached_genotypes.count(variant)) {
-        // We need to parse the genotypes for this variant
-        
-        if (map_order_to_original.empty()) {
-            // First we need to build our table converting from sample index in
-            // map iteration order to sample index in the original order.
-            
-            
-            // But to do that we need to be able to look up original index by
-            // sample name.
-            map<string, size_t> original_index_by_name;
-            for (size_t i = 0; i < variant->sampleNames.size(); i++) {
-                // Basically invert the vector's mapping
-                original_index_by_name[variant->sampleNames[i]] = i;
-            }
-            
-            for (auto& kv : variant->samples) {
-                // Now we go through the samples (where all the format field
-                // data is kept) in map iteration order, and put the actual
-                // sample number for each.
-                map_order_to_original.push_back(original_index_by_name.at(kv.first));
-            }
-            
-            // We're going to have to account for all the samples in the file.
-            assert(map_order_to_original.size() == variant->sampleNames.size());
+    auto found = cached_genotypes.find(variant);
+    if (found != cached_genotypes.end()) {
+        // We already parsed this variant
+        return found->second;
+    }
+    
+    // Start from a table left by a variant that has scrolled out, if we can,
+    // so the per-sample vectors already have room.
+    vector<vector<int>> genotypes;
+    if (!genotype_pool.empty()) {
+        genotypes = std::move(genotype_pool.back());
+        genotype_pool.pop_back();
+    }
+    genotypes.resize(variant->sampleNames.size());
+    
+    // We work straight from the VCF line, so vcflib never has to have parsed
+    // the samples.
+    const string& line = variant->originalLine;
+    auto complain = [&](const string& problem) {
+        throw runtime_error(problem + " in VCF line for variant at " + variant->sequenceName + ":" +
+                            to_string(variant->position + 1));
+    };
+    
+    // Skip the 8 fixed columns to get to FORMAT
+    size_t cursor = 0;
+    for (size_t column = 0; column < 8; column++) {
+        cursor = line.find('\t', cursor);
+        if (cursor == string::npos) {
+            complain("No FORMAT column");
         }
-
-        // Make a vector to fill in, with one entry per sample
-        auto result = cached_genotypes.emplace(piecewise_construct,
-            forward_as_tuple(variant), 
-            forward_as_tuple(variant->sampleNames.size()));
-        assert(result.second);
-        auto& genotypes = result.first->second;
+        cursor++;
+    }
+    size_t format_end = line.find('\t', cursor);
+    if (format_end == string::npos) {
+        complain("No sample columns");
+    }
+    
+    // Find which of the colon-separated FORMAT fields is GT
+    size_t gt_field = 0;
+    bool found_gt = false;
+    for (size_t field_start = cursor; field_start < format_end; gt_field++) {
+        size_t field_end = min(line.find(':', field_start), format_end);
+        if (line.compare(field_start, field_end - field_start, "GT") == 0) {
+            found_gt = true;
+            break;
+        }
+        field_start = field_end + 1;
+    }
+    if (!found_gt) {
+        complain("No GT field");
+    }
+    
+    cursor = format_end + 1;
+    for (size_t sample = 0; sample < genotypes.size(); sample++) {
+        // Go through the sample columns in file order
+        if (cursor > line.size()) {
+            complain("Missing sample columns");
+        }
+        size_t column_end = min(line.find('\t', cursor), line.size());
         
-        // Track what entry we're on in the map from sample to FORMAT values
-        size_t map_index = 0;
-        for (auto& kv : variant->samples) {
-            // Go through all the parsed FORMAT fields for each sample
-            
-            // Figure out where in the vector by original sample index our
-            // result goes.
-            size_t original_index = map_order_to_original.at(map_index);
-            
-            // Pull out the GT value. Explode if there isn't one (though
-            // something like "." is acceptable)
-            auto& gt_string = kv.second.at("GT").at(0);
-            
-            // Decompose it and fill in the genotype slot for this sample.
-            genotypes[original_index] = decompose_genotype_fast(gt_string);
-            
-            // Next we'll look at the next sample in map order.
-            map_index++;
+        // Find the GT value in this sample's column. If trailing fields are
+        // dropped, it may be empty.
+        size_t field_start = cursor;
+        for (size_t i = 0; i < gt_field && field_start <= column_end; i++) {
+            field_start = min(line.find(':', field_start), column_end) + 1;
         }
+        field_start = min(field_start, column_end);
+        size_t field_end = min(line.find(':', field_start), column_end);
+        
+        // Decompose it and fill in the genotype slot for this sample.
+        decompose_genotype_fast(line.data() + field_start, line.data() + field_end, genotypes[sample]);
+        
+        cursor = column_end + 1;
     }
-    return cached_genotypes.at(variant);
+    
+    return cached_genotypes.emplace(variant, std::move(genotypes)).first->second;
 
 }
 
-vector<int> WindowedVcfBuffer::decompose_genotype_fast(const string& genotype) {
+unique_ptr<vcflib::Variant> WindowedVcfBuffer::copy_variant(const vcflib::Variant& source) {
+    if (variant_pool.empty()) {
+        return unique_ptr<vcflib::Variant>(new vcflib::Variant(source));
+    }
+    
+    unique_ptr<vcflib::Variant> variant = std::move(variant_pool.back());
+    variant_pool.pop_back();
+    // Assigning over an old variant reuses its strings and vectors
+    *variant = source;
+    return variant;
+}
+
+void WindowedVcfBuffer::recycle(unique_ptr<vcflib::Variant>&& variant) {
+    auto found = cached_genotypes.find(variant.get());
+    if (found != cached_genotypes.end()) {
+        // Keep the genotype table around too
+        genotype_pool.emplace_back(std::move(found->second));
+        cached_genotypes.erase(found);
+    }
+    variant_pool.emplace_back(std::move(variant));
+}
+
+void WindowedVcfBuffer::decompose_genotype_fast(const char* start, const char* end, vector<int>& alleles) {
     // Rather than doing lots of splits, we just squash atoi in with a single
     // pass over the characters in place.
     
-    // We'll fill this in
-    vector<int> to_return;
-    
-    // Guess at size
-    to_return.reserve(2);
+    alleles.clear();
     
     // We use this for our itoa
     int number = 0;
-    for (size_t i = 0; i < genotype.size(); i++) {
-        switch(genotype[i]) {
+    for (const char* here = start; here != end; ++here) {
+        switch(*here) {
         case '.':
             // We have a missing allele.
             number = vcflib::NULL_ALLELE;
@@ -296,7 +343,7 @@ vector<int> WindowedVcfBuffer::decompose_genotype_fast(const string& genotype) {
         case '|':
         case '/':
             // We've terminated a field
-            to_return.push_back(number);
+            alleles.push_back(number);
             number = 0;
             break;
         case '0':
@@ -311,18 +358,17 @@ vector<int> WindowedVcfBuffer::decompose_genotype_fast(const string& genotype) {
         case '9':
             // We have a digit, so add it to the growing number
             number *= 10;
-            number += (genotype[i] - '0');
+            number += (*here - '0');
             break;
         default:
-            throw std::runtime_error("Invalid genotype character in " + genotype);
+            throw std::runtime_error("Invalid genotype character in " + string(start, end));
             break;            
         }
     }
-    if(!genotype.empty()) {
+    if(start != end) {
         // Finish the last field
-        to_return.push_back(number);
+        alleles.push_back(number);
     }
-    return to_return;
 }
 
 }
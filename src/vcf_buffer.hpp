@@ -109,7 +109,13 @@ private:
  * the context of nearby variants.
  *
  * Also caches parsings of genotypes, so you can iterate over genotypes
- * efficiently without parsing them out over and over again.
+ * efficiently without parsing them out over and over again. Genotypes are
+ * parsed from the GT column of the original VCF line only when asked for, so
+ * the VariantCallFile can be opened with parseSamples = false.
+ *
+ * Variants and genotype tables that scroll out of the window are kept and
+ * reused for the variants that scroll in, so once the window is full, reading
+ * along doesn't allocate.
  */
 class WindowedVcfBuffer {
 
@@ -153,7 +159,8 @@ public:
      * for all the samples, in the order the samples appear in the VCF file.
      *
      * Returns a reference which is valid until the variant passed in is
-     * scrolled out of the buffer.
+     * scrolled out of the buffer. Throws if the variant has no GT field or is
+     * missing sample columns.
      */
     const vector<vector<int>>& get_parsed_genotypes(vcflib::Variant* variant);
     
@@ -184,9 +191,22 @@ public:
 protected:
     
     /**
-     * Quickly decompose a genotype without any string copies.
+     * Quickly decompose the genotype in the given range of characters without
+     * any string copies. Fills in the given vector, reusing its storage.
+     */
+    static void decompose_genotype_fast(const char* start, const char* end, vector<int>& alleles);
+    
+    /**
+     * Make an owned copy of a variant from the reader, reusing a variant that
+     * scrolled out of the window if there is one.
+     */
+    unique_ptr<vcflib::Variant> copy_variant(const vcflib::Variant& source);
+    
+    /**
+     * Take back a variant that has scrolled out of the window, and any
+     * genotypes cached for it, to be reused.
      */
-    static vector<int> decompose_genotype_fast(const string& genotype);
+    void recycle(unique_ptr<vcflib::Variant>&& variant);
     
     // This lets us read from our VCF
     VcfBuffer reader;
@@ -209,10 +229,9 @@ protected:
     // and occur in the order that the samples occur in the file.
     map<vcflib::Variant*, vector<vector<int>>> cached_genotypes;
     
-    // Keep a key from sample name index in map key order to sample index in the
-    // VCF. We use this to build our cache efficiently without any lample name
-    // lookups.
-    vector<size_t> map_order_to_original;
+    // Variants and genotype tables no longer in the window, kept to be reused
+    vector<unique_ptr<vcflib::Variant>> variant_pool;
+    vector<vector<vector<int>>> genotype_pool;
     
 private:
     // Don't copy or assign because we contain VcfBuffers
@@ -67,51 +67,36 @@ void Vectorizer::add_name(string n){
     my_names.push_back(n);
 }
 
-vector<int> Vectorizer::alignment_to_a_hot(Alignment a){
-    int64_t entity_size = my_xg->node_count;
-    vector<int> ret(entity_size, 0);
-    Path path = a.path();
-    for (int i = 0; i < path.mapping_size(); i++){
-        Mapping mapping = path.mapping(i);
-        if(! mapping.has_position()){
-            continue;
-        }
-        Position pos = mapping.position();
-        int64_t node_id = pos.node_id();
-        if (!node_id) continue;
-        int64_t key = my_xg->id_to_rank(node_id);
-        vector<size_t> node_paths = my_xg->paths_of_node(node_id);
-        if (node_paths.size() > 0){
-            ret[key - 1] = 2;
-        }
-        else{
-            ret[key - 1] = 1;
-        }
+int Vectorizer::wabbit_class(const string& name){
+    lock_guard<mutex> guard(wabbit_map_mutex);
+    auto found = wabbit_map.find(name);
+    if (found == wabbit_map.end()){
+        found = wabbit_map.emplace(name, wabbit_map.size()).first;
     }
-    return ret;
+    return found->second;
 }
 
-vector<double> Vectorizer::alignment_to_identity_hot(Alignment a){
-    int64_t entity_size = my_xg->node_count;
-    vector<double> ret(entity_size, 0.0);
-    Path path = a.path();
-    for (int i = 0; i < path.mapping_size(); i ++){
-        Mapping mapping = path.mapping(i);
-        if(! mapping.has_position()){
-            continue;
-        }
-        Position pos = mapping.position();
-        int64_t node_id = pos.node_id();
-        if (!node_id) continue;
-        int64_t key = my_xg->id_to_rank(node_id);
+vector<pair<size_t, int>> Vectorizer::alignment_to_sparse_onehot(const Alignment& a){
+    return sparse_visits<int>(a, [](const Mapping& mapping){
+        return 1;
+    });
+}
 
+vector<pair<size_t, int>> Vectorizer::alignment_to_sparse_a_hot(const Alignment& a){
+    return sparse_visits<int>(a, [&](const Mapping& mapping){
+        // Nodes on paths are reference, and others are alt
+        return my_xg->paths_of_node(mapping.position().node_id()).size() > 0 ? 2 : 1;
+    });
+}
+
+vector<pair<size_t, double>> Vectorizer::alignment_to_sparse_identity_hot(const Alignment& a){
+    return sparse_visits<double>(a, [](const Mapping& mapping){
         //Calculate % identity by walking the edits and counting matches.
-        double pct_id = 0.0;
         double match_len = 0.0;
         double total_len = 0.0;
 
         for (int j = 0; j < mapping.edit_size(); j++){
-            Edit e = mapping.edit(j);
+            const Edit& e = mapping.edit(j);
             total_len += e.from_length();
             if (e.from_length() == e.to_length() && e.sequence() == ""){
                 match_len += (double) e.to_length();
@@ -120,32 +105,24 @@ vector<double> Vectorizer::alignment_to_identity_hot(Alignment a){
                 // TODO if we map but don't match exactly, add half the average length to match_length
                 //match_len += (double) (0.5 * ((double) e.to_length()));
             }
-            else{
-                
-            }
-            
         }
-        pct_id = (match_len == 0.0 && total_len == 0.0) ? 0.0 : (match_len / total_len);
-        ret[key - 1] = pct_id;
-    }
-    return ret;
+        return (match_len == 0.0 && total_len == 0.0) ? 0.0 : (match_len / total_len);
+    });
+}
+
+vector<int> Vectorizer::alignment_to_a_hot(Alignment a){
+    return densify(alignment_to_sparse_a_hot(a));
+}
+
+vector<double> Vectorizer::alignment_to_identity_hot(Alignment a){
+    return densify(alignment_to_sparse_identity_hot(a));
 }
 
 bit_vector Vectorizer::alignment_to_onehot(Alignment a){
     int64_t entity_size = my_xg->node_count;
     bit_vector ret(entity_size, 0);
-    Path path = a.path();
-    for (int i = 0; i < path.mapping_size(); i++){
-        Mapping mapping = path.mapping(i);
-        if(! mapping.has_position()){
-            continue;
-        }
-        Position pos = mapping.position();
-        int64_t node_id = pos.node_id();
-        if (!node_id) continue;
-        int64_t key = my_xg->id_to_rank(node_id);
-        //Find entity rank of edge
-        ret[key - 1] = 1;
+    for (auto& entry : alignment_to_sparse_onehot(a)){
+        ret[entry.first] = 1;
     }
     return ret;
 }
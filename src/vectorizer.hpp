@@ -3,6 +3,10 @@
 #include <iostream>
 #include <sstream>
 #include "sdsl/bit_vectors.hpp"
+#include <algorithm>
+#include <functional>
+#include <mutex>
+#include <utility>
 #include <vector>
 #include <unordered_map>
 #include "vg.hpp"
@@ -31,6 +35,20 @@ class Vectorizer{
     vector<int> alignment_to_a_hot(Alignment a);
     vector<double> alignment_to_custom_score(Alignment a, std::function<double(Alignment)> lambda);
     vector<double> alignment_to_identity_hot(Alignment a);
+    
+    /// The sparse versions give only the entries that are set, as pairs of
+    /// 0-based node rank and value, sorted by rank. They are made straight
+    /// from the alignment's mappings, without a vector over the whole graph.
+    /// They are safe to call from multiple threads.
+    vector<pair<size_t, int>> alignment_to_sparse_onehot(const Alignment& a);
+    vector<pair<size_t, int>> alignment_to_sparse_a_hot(const Alignment& a);
+    vector<pair<size_t, double>> alignment_to_sparse_identity_hot(const Alignment& a);
+    
+    /// Get the class number used for the given name in Vowpal Wabbit and
+    /// libsvm output, assigning the next one if the name is new. Safe to call
+    /// from multiple threads.
+    int wabbit_class(const string& name);
+    
     string output_wabbit_map();
     template<typename T> string format(T v){
         stringstream sout;
@@ -44,10 +62,7 @@ class Vectorizer{
     }
     template<typename T> string wabbitize(string name, T v){
         stringstream sout;
-        if (!(wabbit_map.count(name) > 0)){
-            wabbit_map[name] = wabbit_map.size();
-        }
-        sout << wabbit_map[name] << " " << "1.0" << " " << "'" << name
+        sout << wabbit_class(name) << " " << "1.0" << " " << "'" << name
             << " " << "|" << " " << "vectorspace" << " ";
         for (int i = 0; i < v.size(); i++){
             sout << i << ":" << v[i];
@@ -57,7 +72,34 @@ class Vectorizer{
         }
         return sout.str();
     }
+    /// Make a Vowpal Wabbit line with only the set entries of a sparse vector
+    template<typename T> string sparse_wabbitize(const string& name, const vector<pair<size_t, T>>& v){
+        stringstream sout;
+        sout << wabbit_class(name) << " " << "1.0" << " " << "'" << name
+            << " " << "|" << " " << "vectorspace";
+        for (auto& entry : v){
+            sout << " " << entry.first << ":" << entry.second;
+        }
+        return sout.str();
+    }
+    /// Make a libsvm line from a sparse vector. libsvm counts features from 1.
+    template<typename T> string sparse_libsvm(const string& name, const vector<pair<size_t, T>>& v){
+        stringstream sout;
+        sout << wabbit_class(name);
+        for (auto& entry : v){
+            sout << " " << entry.first + 1 << ":" << entry.second;
+        }
+        return sout.str();
+    }
   private:
+    /// Get the value for each node rank the alignment visits, from the
+    /// mapping visiting it, keeping the last mapping to visit each node.
+    template<typename T> vector<pair<size_t, T>> sparse_visits(const Alignment& a,
+                                                               const function<T(const Mapping&)>& value);
+    
+    /// Make a dense vector from a sparse one.
+    template<typename T> vector<T> densify(const vector<pair<size_t, T>>& v);
+
     xg::XG* my_xg;
     //We use vectors for both names and bit vectors because we want to allow the use of duplicate
     // names. This allows things like generating simulated data with true cluster as the name.
@@ -67,7 +109,43 @@ class Vectorizer{
     bool output_names = false;
     //bool output_wabbit = false;
     unordered_map<string, int> wabbit_map;
+    mutex wabbit_map_mutex;
 
 };
 
+template<typename T> vector<pair<size_t, T>> Vectorizer::sparse_visits(const Alignment& a,
+                                                                       const function<T(const Mapping&)>& value){
+    vector<pair<size_t, T>> visits;
+    const Path& path = a.path();
+    for (int i = 0; i < path.mapping_size(); i++){
+        const Mapping& mapping = path.mapping(i);
+        if (!mapping.has_position() || !mapping.position().node_id()){
+            continue;
+        }
+        visits.emplace_back(my_xg->id_to_rank(mapping.position().node_id()) - 1, value(mapping));
+    }
+    // Sort by rank, keeping the visits to each node in order, and keep the
+    // last one, as if we had been writing into a dense vector.
+    stable_sort(visits.begin(), visits.end(), [](const pair<size_t, T>& x, const pair<size_t, T>& y){
+        return x.first < y.first;
+    });
+    size_t kept = 0;
+    for (size_t i = 0; i < visits.size(); i++){
+        if (i + 1 < visits.size() && visits[i + 1].first == visits[i].first){
+            continue;
+        }
+        visits[kept++] = visits[i];
+    }
+    visits.resize(kept);
+    return visits;
+}
+
+template<typename T> vector<T> Vectorizer::densify(const vector<pair<size_t, T>>& v){
+    vector<T> ret(my_xg->node_count, 0);
+    for (auto& entry : v){
+        ret[entry.first] = entry.second;
+    }
+    return ret;
+}
+
 #endif
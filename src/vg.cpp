@@ -4,10 +4,13 @@
 // We need to use ultrabubbles for dot output
 #include "genotypekit.hpp"
 #include "algorithms/topological_sort.hpp"
+#include "algorithms/apply_bulk_modifications.hpp"
+#include "algorithms/weakly_connected_components.hpp"
 #include <raptor2/raptor2.h>
 #include <stPinchGraphs.h>
 
 #include <stack>
+#include <exception>
 
 //#define debug
 
@@ -53,22 +56,20 @@ void VG::from_istream(istream& in, bool showp, bool warn_on_duplicates) {
     // Don't give an actual 0 to the progress code or it will NaN
     create_progress("loading graph", file_size == 0 ? 1 : file_size);
     
-    // the graph is read in chunks, which are attached to this graph
-    function<void(Graph&)> lambda = [this, &in, &file_size, &warn_on_duplicates](Graph& g) {
-        if(in.good() && file_size != 0) {
-            // We want to update the progress bar from the file position.
-            // Note that tellg isn't thread-safe, but we're single-threaded.
-            update_progress(in.tellg());
-            if (!in.good()) {
-                // tellg upset something
-                in.clear();
-            }
+    // the graph is read in chunks, which are parsed in parallel and attached
+    // to this graph in batches
+    function<void(int64_t, vector<Graph>&)> lambda = [&](int64_t virtual_offset, vector<Graph>& batch) {
+        if (virtual_offset >= 0 && file_size != 0) {
+            // The high bits of the virtual offset are the position in the
+            // compressed file. We can't ask the stream, since it is being read
+            // ahead on other threads.
+            update_progress(virtual_offset >> 16);
         }
         // We usually expect these to not overlap in nodes or edges, so complain unless we've been told not to.
-        extend(g, warn_on_duplicates);
+        extend(batch, warn_on_duplicates);
     };
 
-    stream::for_each(in, lambda);
+    stream::for_each_in_batches(in, 4 * get_thread_count(), lambda);
     
     update_progress(file_size);
 
@@ -258,16 +259,19 @@ void VG::destroy_edge(const handle_t& left, const handle_t& right) {
 }
     
 void VG::clear() {
+    check_unfrozen("clear");
     graph.mutable_node()->Clear();
     graph.mutable_edge()->Clear();
     clear_indexes();
 }
 
 void VG::swap_handles(const handle_t& a, const handle_t& b) {
+    check_unfrozen("swap_handles");
     swap_nodes(get_node(get_id(a)), get_node(get_id(b)));
 }
 
 handle_t VG::apply_orientation(const handle_t& handle) {
+    check_unfrozen("apply_orientation");
     if (!get_is_reverse(handle)) {
         // Nothing to do!
         return handle;
@@ -348,6 +352,7 @@ handle_t VG::apply_orientation(const handle_t& handle) {
 }
 
 vector<handle_t> VG::divide_handle(const handle_t& handle, const vector<size_t>& offsets) {
+    check_unfrozen("divide_handle");
     Node* node = get_node(get_id(handle));
     bool reverse = get_is_reverse(handle);
     
@@ -410,67 +415,150 @@ void VG::serialize_to_ostream_as_part(ostream& out, id_t chunk_size) {
     sync_paths();
     
     create_progress("saving graph", graph.node_size());
-    
-    // Have a function to grab the chunk for the given range of nodes
-    function<Graph(size_t, size_t)> lambda = [this](size_t element_start, size_t element_length) -> Graph {
-    
-        VG g;
-        map<string, map<size_t, mapping_t*> > sorted_paths;
-        for (size_t j = element_start;
-             j < element_start + element_length && j < graph.node_size();
-             ++j) {
-            Node* node = graph.mutable_node(j);
-            // Grab the node and only the edges where it has the lower ID.
-            // This prevents duplication of edges in the serialized output.
-            nonoverlapping_node_context_without_paths(node, g);
-            auto& mappings = paths.get_node_mapping(node);
-            //cerr << "getting node mappings for " << node->id() << endl;
-            for (auto m : mappings) {
-                auto& name = paths.get_path_name(m.first);
-                auto& mappings = m.second;
-                for (auto& mapping : mappings) {
-                    //cerr << "mapping " << name << pb2json(*mapping) << endl;
-                    sorted_paths[name][mapping->rank] = mapping;
-                }
+
+    size_t chunk_nodes = max<id_t>(chunk_size, 1);
+    size_t chunk_count = (graph.node_size() + chunk_nodes - 1) / chunk_nodes;
+
+    // A mapping to write, with the index of the node it is on, or no mapping
+    // for a path with no mappings
+    struct SliceEntry {
+        size_t node_index;
+        const string* name;
+        const mapping_t* mapping;
+    };
+    // Split up the paths by chunk before we start, so each chunk just reads
+    // its own mappings. Going through the paths in name order, and each path
+    // in rank order, leaves each chunk's slice in the order it is written.
+    vector<vector<SliceEntry>> path_slices(chunk_count);
+    paths.for_each_name([&](const string& name) {
+        auto& mappings = paths.get_path(name);
+        if (mappings.empty()) {
+            // The first chunk will always include all the 0-length paths.
+            // TODO: if there are too many, this chunk may grow too large!
+            if (chunk_count > 0) {
+                path_slices[0].push_back(SliceEntry {0, &name, nullptr});
             }
+            return;
         }
-        // now get the paths for this chunk so that they are ordered correctly
-        for (auto& p : sorted_paths) {
-            auto& name = p.first;
-            auto& path = p.second;
-            // now sorted in ascending order by rank
-            // May not be contiguous because other chunks may contain nodes between the nodes in this one
-            for (auto& m : path) {
-                g.paths.append_mapping(name, m.second->to_mapping());
+        for (auto& mapping : mappings) {
+            auto node = node_by_id.find(mapping.node_id());
+            if (node == node_by_id.end()) {
+                // Only the mappings of nodes being written can be written
+                continue;
             }
+            size_t index = node_index.find(node->second)->second;
+            path_slices[index / chunk_nodes].push_back(SliceEntry {index, &name, &mapping});
         }
+    });
 
-        if (element_start == 0) {
-            // The first chunk will always include all the 0-length paths.
-            // TODO: if there are too many, this chunk may grow too large!
-            paths.for_each_name([&](const string& name) {
-                // For every path
-                if (paths.get_path(name).empty()) {
-                    // If its mapping list has no mappings, make it in the chunk
-                    g.paths.create_path(name);
+    // Build the chunk for the nodes in [start, end), which lie in chunk c
+    auto build_chunk = [&](size_t c, size_t start, size_t end) {
+        Graph chunk;
+        vector<Edge*> owned;
+        for (size_t j = start; j < end; ++j) {
+            const Node& node = graph.node(j);
+            *chunk.add_node() = node;
+            // Grab only the edges where the node has the lower ID. This
+            // prevents duplication of edges in the serialized output.
+            owned.clear();
+            auto grab_edges = [&](const hash_map<id_t, vector<pair<id_t, bool>>>& edges_on_side, bool on_start) {
+                auto found = edges_on_side.find(node.id());
+                if (found == edges_on_side.end()) {
+                    return;
                 }
-            });
+                for (auto& other : found->second) {
+                    Edge* edge = get_edge(on_start ? NodeSide::pair_from_start_edge(node.id(), other)
+                                                   : NodeSide::pair_from_end_edge(node.id(), other));
+                    id_t owner_id = min(edge->from(), edge->to());
+                    if (node.id() == owner_id || !has_node(owner_id)) {
+                        // Either we are the owner, or the owner isn't in the graph to get serialized.
+                        owned.push_back(edge);
+                    }
+                }
+            };
+            grab_edges(edges_on_start, true);
+            grab_edges(edges_on_end, false);
+            // Self loops are listed on both of their sides
+            std::sort(owned.begin(), owned.end());
+            owned.erase(std::unique(owned.begin(), owned.end()), owned.end());
+            for (Edge* edge : owned) {
+                *chunk.add_edge() = *edge;
+            }
+        }
+        // Now the paths for this chunk, which may not be contiguous because
+        // other chunks may contain nodes between the nodes in this one
+        Path* path = nullptr;
+        for (auto& entry : path_slices[c]) {
+            bool wanted = entry.mapping ? entry.node_index >= start && entry.node_index < end : start == 0;
+            if (!wanted) {
+                continue;
+            }
+            if (path == nullptr || path->name() != *entry.name) {
+                path = chunk.add_path();
+                path->set_name(*entry.name);
+                if (paths.circular.count(*entry.name)) {
+                    path->set_is_circular(true);
+                }
+            }
+            if (entry.mapping) {
+                *path->add_mapping() = entry.mapping->to_mapping();
+            }
         }
+        return chunk;
+    };
 
-        // record our circular paths
-        g.paths.circular = this->paths.circular;
-        // TODO: but this is broken as our paths have been reordered as
-        // the nodes they cross are stored in graph.nodes
-        g.paths.to_graph(g.graph);
-
-        update_progress(element_start);
-        return g.graph;
-    
+    // Serialize and compress the nodes in [start, end) as one or more groups,
+    // splitting the range until each message is small enough to read back.
+    function<void(size_t, size_t, size_t, string&)> compress_range = [&](size_t c, size_t start, size_t end, string& data) {
+        Graph chunk = build_chunk(c, start, end);
+        if (chunk.ByteSizeLong() > stream::MAX_PROTOBUF_SIZE) {
+            if (end - start == 1) {
+                throw runtime_error("VG::serialize_to_ostream: message for node " + to_string(start) +
+                                    " too large error writing protobuf");
+            }
+            size_t middle = start + (end - start) / 2;
+            compress_range(c, start, middle, data);
+            compress_range(c, middle, end, data);
+            return;
+        }
+        // Hand the chunk over without copying it
+        std::function<Graph(size_t)> take_chunk = [&](size_t n) { return std::move(chunk); };
+        stringstream compressed;
+        stream::write(compressed, 1, take_chunk);
+        data += compressed.str();
     };
 
-    // Write all the dynamically sized chunks, starting with our selected chunk
-    // size as a guess.
-    stream::write(out, graph.node_size(), chunk_size, lambda);
+    // Build and compress the chunks in parallel, and write them in order
+    exception_ptr error;
+    atomic<bool> failed(false);
+#pragma omp parallel for ordered schedule(dynamic, 1)
+    for (size_t c = 0; c < chunk_count; ++c) {
+        string data;
+        if (!failed) {
+            try {
+                compress_range(c, c * chunk_nodes, min((c + 1) * chunk_nodes, (size_t) graph.node_size()), data);
+            } catch (...) {
+#pragma omp critical (vg_serialize_error)
+                if (!error) {
+                    error = current_exception();
+                }
+                failed = true;
+            }
+        }
+#pragma omp ordered
+        {
+            if (!failed) {
+                out.write(data.data(), data.size());
+            }
+        }
+        update_progress(c * chunk_nodes);
+    }
+    if (error) {
+        rethrow_exception(error);
+    }
+    if (!out) {
+        throw runtime_error("VG::serialize_to_ostream: I/O error writing protobuf");
+    }
 
     destroy_progress();
 }
@@ -492,6 +580,7 @@ VG::VG(void) {
 void VG::init(void) {
     current_id = 1;
     show_progress = false;
+    frozen = false;
 }
 
 VG::VG(set<Node*>& nodes, set<Edge*>& edges) {
@@ -1030,16 +1119,20 @@ set<set<NodeTraversal>> VG::identically_oriented_sibling_sets(const set<set<Node
 }
 
 void VG::simplify_siblings(void) {
-    // make a list of all the sets of siblings
-    set<set<NodeTraversal>> to_sibs;
-    for_each_node([this, &to_sibs](Node* n) {
+    // make a list of all the sets of siblings, looking at nodes in parallel
+    vector<set<set<NodeTraversal>>> thread_to_sibs(omp_get_max_threads());
+    for_each_node_parallel([this, &thread_to_sibs](Node* n) {
             auto trav = NodeTraversal(n, false);
             auto tsibs = full_siblings_to(trav);
             tsibs.insert(trav);
             if (tsibs.size() > 1) {
-                to_sibs.insert(tsibs);
+                thread_to_sibs[omp_get_thread_num()].insert(tsibs);
             }
         });
+    set<set<NodeTraversal>> to_sibs;
+    for (auto& sibs : thread_to_sibs) {
+        to_sibs.insert(sibs.begin(), sibs.end());
+    }
         
     // make the sibling sets transitive
     // by removing any that are intransitive
@@ -1051,15 +1144,19 @@ void VG::simplify_siblings(void) {
     remove_null_nodes_forwarding_edges();
 
     // make a list of the from-siblings
-    set<set<NodeTraversal>> from_sibs;
-    for_each_node([this, &from_sibs](Node* n) {
+    vector<set<set<NodeTraversal>>> thread_from_sibs(omp_get_max_threads());
+    for_each_node_parallel([this, &thread_from_sibs](Node* n) {
             auto trav = NodeTraversal(n, false);
             auto fsibs = full_siblings_from(trav);
             fsibs.insert(trav);
             if (fsibs.size() > 1) {
-                from_sibs.insert(fsibs);
+                thread_from_sibs[omp_get_thread_num()].insert(fsibs);
             }
         });
+    set<set<NodeTraversal>> from_sibs;
+    for (auto& sibs : thread_from_sibs) {
+        from_sibs.insert(sibs.begin(), sibs.end());
+    }
     // then do the from direction
     simplify_from_siblings(
         identically_oriented_sibling_sets(
@@ -1069,6 +1166,77 @@ void VG::simplify_siblings(void) {
 
 }
 
+void VG::simplify_siblings(const vector<id_t>& seeds) {
+    simplify_to_siblings(
+        identically_oriented_sibling_sets(
+            transitive_sibling_sets_around(seeds, true)));
+    remove_null_nodes_forwarding_edges();
+    
+    simplify_from_siblings(
+        identically_oriented_sibling_sets(
+            transitive_sibling_sets_around(seeds, false)));
+    remove_null_nodes_forwarding_edges();
+}
+
+set<set<NodeTraversal>> VG::transitive_sibling_sets_around(const vector<id_t>& seeds, bool to) {
+    auto sibling_set = [&](const NodeTraversal& trav) {
+        set<NodeTraversal> sibs = to ? full_siblings_to(trav) : full_siblings_from(trav);
+        sibs.insert(trav);
+        return sibs;
+    };
+    
+    // the whole-graph pass takes the set for each node's forward traversal
+    set<set<NodeTraversal>> candidates;
+    for (const id_t& id : seeds) {
+        if (!has_node(id)) continue;
+        auto sibs = sibling_set(NodeTraversal(get_node(id), false));
+        if (sibs.size() > 1) {
+            candidates.insert(sibs);
+        }
+    }
+    
+    // Find every set the whole-graph pass would have that shares a node with
+    // a candidate. Each node traversal is in only one set, and the
+    // whole-graph pass only finds sets with a forward traversal in them.
+    set<set<NodeTraversal>> context = candidates;
+    for (auto& sibs : candidates) {
+        for (auto& trav : sibs) {
+            for (bool backward : {false, true}) {
+                auto other = sibling_set(NodeTraversal(trav.node, backward));
+                if (other.size() < 2) continue;
+                for (auto& member : other) {
+                    if (!member.backward) {
+                        context.insert(other);
+                        break;
+                    }
+                }
+            }
+        }
+    }
+    
+    // only keep the candidates whose members are in no other set
+    map<Node*, int> membership;
+    for (auto& sibs : context) {
+        for (auto& t : sibs) {
+            ++membership[t.node];
+        }
+    }
+    set<set<NodeTraversal>> trans_sibs;
+    for (auto& sibs : candidates) {
+        bool is_transitive = true;
+        for (auto& t : sibs) {
+            if (membership[t.node] > 1) {
+                is_transitive = false;
+                break;
+            }
+        }
+        if (is_transitive) {
+            trans_sibs.insert(sibs);
+        }
+    }
+    return trans_sibs;
+}
+
 void VG::simplify_to_siblings(const set<set<NodeTraversal>>& to_sibs) {
     for (auto& sibs : to_sibs) {
         // determine the amount of sharing at the start
@@ -1574,35 +1742,88 @@ void VG::unchop(void) {
     paths.compact_ranks();
 }
 
+void VG::unchop(const vector<id_t>& seeds) {
+    for (auto& comp : simple_components(seeds, 2)) {
+        concat_nodes(comp);
+    }
+    // rebuild path ranks, as these will be affected by mapping merging
+    paths.compact_ranks();
+}
+
+vector<id_t> VG::new_nodes_and_neighbors(id_t first_new_id) {
+    vector<id_t> found;
+    unordered_set<id_t> seen;
+    auto add = [&](id_t id) {
+        if (seen.insert(id).second) {
+            found.push_back(id);
+        }
+    };
+    id_t last_id = max_node_id();
+    for (id_t id = first_new_id; id <= last_id; id++) {
+        if (!has_node(id)) continue;
+        add(id);
+        NodeTraversal trav(get_node(id), false);
+        for (auto& prev : nodes_prev(trav)) {
+            add(prev.node->id());
+        }
+        for (auto& next : nodes_next(trav)) {
+            add(next.node->id());
+        }
+    }
+    return found;
+}
+
 void VG::normalize(int max_iter, bool debug) {
     size_t last_len = 0;
     if (max_iter > 1) {
         last_len = length();
     }
+    // Unchopping and sibling merging only change the graph around the nodes
+    // they make, so after the first iteration we only look there. When that
+    // stops changing anything we do one more iteration over the whole graph,
+    // to be sure.
+    bool whole_graph = true;
+    vector<id_t> changed;
     int iter = 0;
     do {
+        id_t first_new_id = max_node_id() + 1;
         // convert edges that go from_start -> to_end to the equivalent "regular" edge
         flip_doubly_reversed_edges();
         //if (!is_valid()) cerr << "invalid after doubly flip" << endl;
         // combine diced/chopped nodes (subpaths with no branching)
-        unchop();
+        if (whole_graph) {
+            unchop();
+        } else {
+            unchop(changed);
+        }
         //if (!is_valid()) cerr << "invalid after unchop" << endl;
         // merge redundancy across multiple nodes into single nodes (requires flip_doubly_reversed_edges)
-        simplify_siblings();
+        id_t first_sibling_id = max_node_id() + 1;
+        if (whole_graph) {
+            simplify_siblings();
+        } else {
+            // look at whatever the unchop made as well
+            for (id_t id : new_nodes_and_neighbors(first_new_id)) {
+                changed.push_back(id);
+            }
+            simplify_siblings(changed);
+        }
         //if (!is_valid()) cerr << "invalid after simplify sibs" << endl;
-        // compact node ranks
-        paths.compact_ranks();
-        //if (!is_valid()) cerr << "invalid after compact ranks" << endl;
-        // there may now be some cut nodes that can be simplified
-        unchop();
+        // there may now be some cut nodes that can be simplified, but only
+        // next to the nodes sibling merging made
+        unchop(new_nodes_and_neighbors(first_sibling_id));
         //if (!is_valid()) cerr << "invalid after unchop two" << endl;
-        // compact node ranks (again)
-        paths.compact_ranks();
-        //if (!is_valid()) cerr << "invalid after compact ranks two  " << endl;
         if (max_iter > 1) {
             size_t curr_len = length();
             if (debug) cerr << "[VG::normalize] iteration " << iter+1 << " current length " << curr_len << endl;
-            if (curr_len == last_len) break;
+            if (curr_len == last_len) {
+                if (whole_graph) break;
+                // check everything before we finish
+                whole_graph = true;
+            } else {
+                whole_graph = false;
+                changed = new_nodes_and_neighbors(first_new_id);
+            }
             last_len = curr_len;
         }
     } while (++iter < max_iter);
@@ -1783,120 +2004,166 @@ bool VG::nodes_are_perfect_path_neighbors(NodeTraversal left, NodeTraversal righ
     return true;
 }
 
-// the set of components that could be merged into single nodes without
-// changing the path space of the graph
+// walk out as far as we can merge from one node
 // respects stored paths
-set<list<NodeTraversal>> VG::simple_components(int min_size) {
-
-    // go around and establish groupings
-    set<Node*> seen;
-    set<list<NodeTraversal>> components;
-    for_each_node([this, min_size, &components, &seen](Node* n) {
-            if (seen.count(n)) return;
-            
+list<NodeTraversal> VG::simple_component_from(Node* n, unordered_set<Node*>& seen) {
+    
 #ifdef debug
-            cerr << "Component based on " << n->id() << endl;
+    cerr << "Component based on " << n->id() << endl;
 #endif
-            
-            seen.insert(n);
-            // go left and right through each as far as we have only single edges connecting us
-            // to nodes that have only single edges coming in or out
-            // that go to other nodes
-            list<NodeTraversal> c;
-            // go left
-            {
-                NodeTraversal l(n, false);
-                vector<NodeTraversal> prev = nodes_prev(l);
+    
+    seen.insert(n);
+    // go left and right through each as far as we have only single edges connecting us
+    // to nodes that have only single edges coming in or out
+    // that go to other nodes
+    list<NodeTraversal> c;
+    // go left
+    {
+        NodeTraversal l(n, false);
+        vector<NodeTraversal> prev = nodes_prev(l);
 #ifdef debug
-                cerr << "\tLeft: ";
-                for (auto& x : prev) {
-                    cerr << x << "(" << node_count_next(x) << " edges right) ";
-                }
-                cerr << endl;
+        cerr << "\tLeft: ";
+        for (auto& x : prev) {
+            cerr << x << "(" << node_count_next(x) << " edges right) ";
+        }
+        cerr << endl;
 #endif
-                while (prev.size() == 1
-                       && node_count_next(prev.front()) == 1) {   
-                       
-                    // While there's only one node left of here, and one node right of that node...
-                    auto last = l;
-                    // Move over left to that node
-                    l = prev.front();
-                    // avoid merging if it breaks stored paths
-                    if (!nodes_are_perfect_path_neighbors(l, last)) {
+        while (prev.size() == 1
+               && node_count_next(prev.front()) == 1) {   
+               
+            // While there's only one node left of here, and one node right of that node...
+            auto last = l;
+            // Move over left to that node
+            l = prev.front();
+            // avoid merging if it breaks stored paths
+            if (!nodes_are_perfect_path_neighbors(l, last)) {
 #ifdef debug
-                        cerr << "\tNot perfect neighbors!" << endl;
+                cerr << "\tNot perfect neighbors!" << endl;
 #endif
-                        break;
-                    }
-                    // avoid merging if it's already in this or any other component (catch self loops)
-                    if (seen.count(l.node)) {
+                break;
+            }
+            // avoid merging if it's already in this or any other component (catch self loops)
+            if (seen.count(l.node)) {
 #ifdef debug
-                        cerr << "\tAlready seen!" << endl;
+                cerr << "\tAlready seen!" << endl;
 #endif
-                        break;
-                    }
-                    prev = nodes_prev(l);
+                break;
+            }
+            prev = nodes_prev(l);
 #ifdef debug
-                    cerr << "\tLeft: ";
-                    for (auto& x : prev) {
-                        cerr << x << "(" << node_count_next(x) << " edges right) ";
-                    }
-                    cerr << endl;
-#endif
-                    c.push_front(l);
-                    seen.insert(l.node);
-                }
+            cerr << "\tLeft: ";
+            for (auto& x : prev) {
+                cerr << x << "(" << node_count_next(x) << " edges right) ";
             }
-            // add the node (in the middle)
-            c.push_back(NodeTraversal(n, false));
-            // go right
-            {
-                NodeTraversal r(n, false);
-                vector<NodeTraversal> next = nodes_next(r);
+            cerr << endl;
+#endif
+            c.push_front(l);
+            seen.insert(l.node);
+        }
+    }
+    // add the node (in the middle)
+    c.push_back(NodeTraversal(n, false));
+    // go right
+    {
+        NodeTraversal r(n, false);
+        vector<NodeTraversal> next = nodes_next(r);
 #ifdef debug
-                cerr << "\tRight: ";
-                for (auto& x : next) {
-                    cerr << x << "(" << node_count_prev(x) << " edges left) ";
-                }
-                cerr << endl;
+        cerr << "\tRight: ";
+        for (auto& x : next) {
+            cerr << x << "(" << node_count_prev(x) << " edges left) ";
+        }
+        cerr << endl;
 #endif
-                while (next.size() == 1
-                       && node_count_prev(next.front()) == 1) {   
-                       
-                    // While there's only one node right of here, and one node left of that node...
-                    auto last = r;
-                    // Move over right to that node
-                    r = next.front();
-                    // avoid merging if it breaks stored paths
-                    if (!nodes_are_perfect_path_neighbors(last, r)) {
+        while (next.size() == 1
+               && node_count_prev(next.front()) == 1) {   
+               
+            // While there's only one node right of here, and one node left of that node...
+            auto last = r;
+            // Move over right to that node
+            r = next.front();
+            // avoid merging if it breaks stored paths
+            if (!nodes_are_perfect_path_neighbors(last, r)) {
 #ifdef debug
-                        cerr << "\tNot perfect neighbors!" << endl;
+                cerr << "\tNot perfect neighbors!" << endl;
 #endif
-                        break;
-                    }
-                    // avoid merging if it's already in this or any other component (catch self loops)
-                    if (seen.count(r.node)) {
+                break;
+            }
+            // avoid merging if it's already in this or any other component (catch self loops)
+            if (seen.count(r.node)) {
 #ifdef debug
-                        cerr << "\tAlready seen!" << endl;
+                cerr << "\tAlready seen!" << endl;
 #endif
-                        break;
-                    }
-                    next = nodes_next(r);
+                break;
+            }
+            next = nodes_next(r);
 #ifdef debug
-                    cerr << "\tRight: ";
-                    for (auto& x : next) {
-                        cerr << x << "(" << node_count_prev(x) << " edges left) ";
-                    }
-                    cerr << endl;
+            cerr << "\tRight: ";
+            for (auto& x : next) {
+                cerr << x << "(" << node_count_prev(x) << " edges left) ";
+            }
+            cerr << endl;
 #endif
-                    c.push_back(r);
-                    seen.insert(r.node);
+            c.push_back(r);
+            seen.insert(r.node);
+        }
+    }
+    return c;
+}
+
+// the set of components that could be merged into single nodes without
+// changing the path space of the graph
+// respects stored paths
+set<list<NodeTraversal>> VG::simple_components(int min_size) {
+
+    set<list<NodeTraversal>> components;
+    
+    if (omp_get_max_threads() == 1 || omp_in_parallel()) {
+        // go around and establish groupings
+        unordered_set<Node*> seen;
+        for_each_node([&](Node* n) {
+                if (seen.count(n)) return;
+                list<NodeTraversal> c = simple_component_from(n, seen);
+                if (c.size() >= min_size) {
+                    components.insert(c);
+                }
+            });
+    } else {
+        // Walks never leave a weakly connected component, so we can do each
+        // component at the same time with its own seen set. As long as we
+        // start from each component's nodes in the same order as the serial
+        // loop would, we find exactly the same groupings.
+        vector<unordered_set<id_t>> weak_components = algorithms::weakly_connected_components(this);
+        hash_map<id_t, size_t> component_of;
+        for (size_t i = 0; i < weak_components.size(); i++) {
+            for (const id_t& id : weak_components[i]) {
+                component_of[id] = i;
+            }
+            unordered_set<id_t>().swap(weak_components[i]);
+        }
+        vector<vector<Node*>> component_nodes(weak_components.size());
+        for_each_node([&](Node* n) {
+                component_nodes[component_of[n->id()]].push_back(n);
+            });
+        
+        vector<vector<list<NodeTraversal>>> found(component_nodes.size());
+#pragma omp parallel for schedule(dynamic, 1)
+        for (size_t i = 0; i < component_nodes.size(); i++) {
+            unordered_set<Node*> seen;
+            for (Node* n : component_nodes[i]) {
+                if (seen.count(n)) continue;
+                list<NodeTraversal> c = simple_component_from(n, seen);
+                if (c.size() >= min_size) {
+                    found[i].emplace_back(move(c));
                 }
             }
-            if (c.size() >= min_size) {
-                components.insert(c);
+        }
+        
+        for (auto& component_found : found) {
+            for (auto& c : component_found) {
+                components.insert(move(c));
             }
-        });
+        }
+    }
 #ifdef debug
     cerr << "components " << endl;
     for (auto& c : components) {
@@ -1909,6 +2176,21 @@ set<list<NodeTraversal>> VG::simple_components(int min_size) {
     return components;
 }
 
+set<list<NodeTraversal>> VG::simple_components(const vector<id_t>& seeds, int min_size) {
+    set<list<NodeTraversal>> components;
+    unordered_set<Node*> seen;
+    for (const id_t& id : seeds) {
+        if (!has_node(id)) continue;
+        Node* n = get_node(id);
+        if (seen.count(n)) continue;
+        list<NodeTraversal> c = simple_component_from(n, seen);
+        if (c.size() >= min_size) {
+            components.insert(c);
+        }
+    }
+    return components;
+}
+
 map<string, vector<mapping_t>>
     VG::concat_mappings_for_nodes(const list<NodeTraversal>& nodes) {
 
@@ -2246,6 +2528,31 @@ void VG::rebuild_edge_indexes(void) {
     build_edge_indexes_no_init_size();
 }
 
+void VG::freeze(void) {
+    // Everything the const accessors look at must exist before the threads
+    // arrive, since nothing may be added or rebuilt while they read.
+    rebuild_indexes();
+    for (auto& p : paths._paths) {
+        // Paths with no mappings don't get IDs from the node mapping rebuild
+        paths.get_path_id(p.first);
+    }
+    frozen = true;
+}
+
+void VG::thaw(void) {
+    frozen = false;
+}
+
+bool VG::is_frozen(void) const {
+    return frozen;
+}
+
+void VG::check_unfrozen(const char* operation) const {
+    if (frozen) {
+        throw runtime_error(string("VG::") + operation + " called on a frozen graph; thaw() it first");
+    }
+}
+
 bool VG::empty(void) const {
     return graph.node_size() == 0 && graph.edge_size() == 0;
 }
@@ -2467,6 +2774,68 @@ void VG::extend(const Graph& graph, bool warn_on_duplicates) {
     paths.append(graph, warn_on_duplicates);
 }
 
+void VG::extend(vector<Graph>& graphs, bool warn_on_duplicates) {
+    size_t node_total = graph.node_size();
+    size_t edge_total = graph.edge_size();
+    for (auto& g : graphs) {
+        node_total += g.node_size();
+        edge_total += g.edge_size();
+    }
+
+    // Nodes, edges, and paths all live in separate indexes, so each can be
+    // merged on its own thread. Each insert into an index also tells us if
+    // the item was there already, so we don't need to look it up first.
+#pragma omp parallel sections
+    {
+#pragma omp section
+        {
+            graph.mutable_node()->Reserve(node_total);
+            for (auto& g : graphs) {
+                for (auto& n : *g.mutable_node()) {
+                    if (n.id() == 0) {
+                        cerr << "[vg] warning: node ID 0 is not allowed. Skipping." << endl;
+                        continue;
+                    }
+                    auto inserted = node_by_id.insert(make_pair(n.id(), (Node*) nullptr));
+                    if (inserted.second) {
+                        Node* new_node = graph.add_node();
+                        new_node->Swap(&n);
+                        inserted.first->second = new_node;
+                        node_index[new_node] = graph.node_size() - 1;
+                    } else if (warn_on_duplicates) {
+                        cerr << "[vg] warning: node ID " << n.id() << " appears multiple times. Skipping." << endl;
+                    }
+                }
+            }
+        }
+#pragma omp section
+        {
+            graph.mutable_edge()->Reserve(edge_total);
+            for (auto& g : graphs) {
+                for (auto& e : *g.mutable_edge()) {
+                    auto inserted = edge_by_sides.insert(make_pair(NodeSide::pair_from_edge(e), (Edge*) nullptr));
+                    if (inserted.second) {
+                        Edge* new_edge = graph.add_edge();
+                        new_edge->Swap(&e);
+                        index_edge_by_node_sides(new_edge);
+                        edge_index[new_edge] = graph.edge_size() - 1;
+                    } else if (warn_on_duplicates) {
+                        cerr << "[vg] warning: edge " << e.from() << (e.from_start() ? " start" : " end") << " <-> "
+                             << e.to() << (e.to_end() ? " end" : " start") << " appears multiple times. Skipping." << endl;
+                    }
+                }
+            }
+        }
+#pragma omp section
+        {
+            for (auto& g : graphs) {
+                // Append the path mappings from this graph, but don't sort by rank
+                paths.append(g, warn_on_duplicates);
+            }
+        }
+    }
+}
+
 // extend this graph by g, connecting the tails of this graph to the heads of the other
 // the ids of the second graph are modified for compact representation
 void VG::append(VG& g) {
@@ -3542,6 +3911,7 @@ Edge* VG::create_edge(Node* from, Node* to, bool from_start, bool to_end) {
 }
 
 Edge* VG::create_edge(id_t from, id_t to, bool from_start, bool to_end) {
+    check_unfrozen("create_edge");
     //cerr << "creating edge " << from << "->" << to << endl;
     // ensure the edge (or another between the same sides) does not already exist
     Edge* edge = get_edge(NodeSide(from, !from_start), NodeSide(to, to_end));
@@ -3623,6 +3993,7 @@ void VG::destroy_edge(const pair<NodeSide, NodeSide>& sides) {
 
 
 void VG::destroy_edge(Edge* edge) {
+    check_unfrozen("destroy_edge");
     //cerr << "destroying edge " << edge->from() << "->" << edge->to() << endl;
 
     // noop on NULL pointer or non-existent edge
@@ -3799,6 +4170,7 @@ Node* VG::create_node(const string& seq, id_t id) {
     // It was too easy to accidentally pass 0 by forgetting to offset an incoming source of IDs by 1.
     // Use the overload without an ID instead.
     assert(id != 0);
+    check_unfrozen("create_node");
     // create the node
     Node* node = graph.add_node();
     node->set_sequence(seq);
@@ -3897,6 +4269,7 @@ void VG::destroy_node(id_t id) {
 }
 
 void VG::destroy_node(Node* node) {
+    check_unfrozen("destroy_node");
     //if (!is_valid()) cerr << "graph is invalid before destroy_node" << endl;
     //cerr << "destroying node " << node->id() << " degrees " << start_degree(node) << ", " << end_degree(node) << endl;
     // noop on NULL/nonexistent node
@@ -4462,21 +4835,32 @@ vector<Translation> VG::edit(vector<Path>& paths_to_add, bool save_paths, bool u
     }
 #endif
 
-    std::vector<Path> simplified_paths;
-
-    for(auto path : paths_to_add) {
-        // Simplify the path, just to eliminate adjacent match Edits in the same
-        // Mapping (because we don't have or want a breakpoint there)
-        simplified_paths.push_back(simplify(path));
-    }
+    std::vector<Path> simplified_paths(paths_to_add.size());
 
     // If we are going to actually add the paths to the graph, we need to break at path ends
     break_at_ends |= save_paths;
 
-    for(auto path : simplified_paths) {
+    // Nothing touches the graph until all the breakpoints are known, so each
+    // thread can collect its own and we merge them once.
+    vector<map<id_t, set<pos_t>>> thread_breakpoints(get_thread_count());
+#pragma omp parallel for schedule(dynamic, 128)
+    for (size_t i = 0; i < paths_to_add.size(); ++i) {
+        // Simplify the path, just to eliminate adjacent match Edits in the same
+        // Mapping (because we don't have or want a breakpoint there)
+        simplified_paths[i] = simplify(paths_to_add[i]);
         // Add in breakpoints from each path
-        find_breakpoints(path, breakpoints, break_at_ends);
+        find_breakpoints(simplified_paths[i], thread_breakpoints[omp_get_thread_num()], break_at_ends);
+    }
+    for (auto& found : thread_breakpoints) {
+        if (breakpoints.empty()) {
+            std::swap(breakpoints, found);
+            continue;
+        }
+        for (auto& kv : found) {
+            breakpoints[kv.first].insert(kv.second.begin(), kv.second.end());
+        }
     }
+    thread_breakpoints.clear();
 
     // Invert the breakpoints that are on the reverse strand
     breakpoints = forwardize_breakpoints(breakpoints);
@@ -4484,11 +4868,12 @@ vector<Translation> VG::edit(vector<Path>& paths_to_add, bool save_paths, bool u
     // Clear existing path ranks.
     paths.clear_mapping_ranks();
 
-    // get the node sizes, for use when making the translation
+    // get the sizes of the nodes we are about to break, for use when making
+    // the translation (everything else keeps its size)
     map<id_t, size_t> orig_node_sizes;
-    for_each_node([&](Node* node) {
-            orig_node_sizes[node->id()] = node->sequence().size();
-        });
+    for (auto& kv : breakpoints) {
+        orig_node_sizes[kv.first] = get_node(kv.first)->sequence().size();
+    }
 
     // Break any nodes that need to be broken. Save the map we need to translate
     // from offsets on old nodes to new nodes. Note that this would mess up the
@@ -4861,6 +5246,12 @@ map<pos_t, Node*> VG::ensure_breakpoints(const map<id_t, set<pos_t>>& breakpoint
     // old nodes.
     map<pos_t, Node*> toReturn;
 
+    // Work out all the offsets each node needs to be cut at, so we can cut
+    // each one just once.
+    vector<pair<id_t, vector<size_t>>> divisions;
+    vector<size_t> original_node_lengths;
+    divisions.reserve(breakpoints.size());
+    original_node_lengths.reserve(breakpoints.size());
     for(auto& kv : breakpoints) {
         // Go through all the nodes we need to break up
         auto original_node_id = kv.first;
@@ -4868,17 +5259,9 @@ map<pos_t, Node*> VG::ensure_breakpoints(const map<id_t, set<pos_t>>& breakpoint
         // Save the original node length. We don't want to break here (or later)
         // because that would be off the end.
         id_t original_node_length = get_node(original_node_id)->sequence().size();
+        original_node_lengths.push_back(original_node_length);
 
-        // We are going through the breakpoints left to right, so we need to
-        // keep the node pointer for the right part that still needs further
-        // dividing.
-        Node* right_part = get_node(original_node_id);
-        Node* left_part = nullptr;
-
-        pos_t last_bp = make_pos_t(original_node_id, false, 0);
-        // How far into the original node does our right part start?
-        id_t current_offset = 0;
-
+        divisions.emplace_back(original_node_id, vector<size_t>());
         for(auto breakpoint : kv.second) {
             // For every point at which we need to make a new node, in ascending
             // order (due to the way sets store ints)...
@@ -4892,53 +5275,40 @@ map<pos_t, Node*> VG::ensure_breakpoints(const map<id_t, set<pos_t>>& breakpoint
                 continue;
             }
 
-            // How far in do we need to break the remaining right part? And how
-            // many bases will be in this new left part?
-            id_t divide_offset = offset(breakpoint) - current_offset;
-
-
-#ifdef debug
-            cerr << "Need to divide original " << original_node_id << " at " << breakpoint << "/" <<
-
-                original_node_length << endl;
-            cerr << "Translates to " << right_part->id() << " at " << divide_offset << "/" <<
-                right_part->sequence().size() << endl;
-            cerr << "divide offset is " << divide_offset << endl;
-#endif
-
             if (offset(breakpoint) <= 0) { cerr << "breakpoint is " << breakpoint << endl; }
             assert(offset(breakpoint) > 0);
             if (offset(breakpoint) >= original_node_length) { cerr << "breakpoint is " << breakpoint << endl; }
             assert(offset(breakpoint) < original_node_length);
 
-            // Make a new left part and right part. This updates all the
-            // existing perfect match paths in the graph.
-            divide_node(right_part, divide_offset, left_part, right_part);
-
-#ifdef debug
+            divisions.back().second.push_back(offset(breakpoint));
+        }
+    }
 
-            cerr << "Produced " << left_part->id() << " (" << left_part->sequence().size() << " bp)" << endl;
-            cerr << "Left " << right_part->id() << " (" << right_part->sequence().size() << " bp)" << endl;
-#endif
+    // Make all the new nodes. This updates all the existing perfect match
+    // paths in the graph.
+    auto parts = algorithms::apply_divisions(this, divisions);
 
-            // The left part is now done. We know it started at current_offset
-            // and ended before breakpoint, so record it by start position.
+    for(size_t i = 0; i < divisions.size(); i++) {
+        auto original_node_id = divisions[i].first;
+        auto& offsets = divisions[i].second;
+        auto original_node_length = original_node_lengths[i];
 
-            // record forward and reverse
-            toReturn[last_bp] = left_part;
-            toReturn[reverse(breakpoint, original_node_length)] = left_part;
+        for(size_t j = 0; j < parts[i].size(); j++) {
+            // Each part runs from the previous cut to the next one. Record it
+            // by its start position on both strands.
+            Node* part = get_node(get_id(parts[i][j]));
+            size_t part_start = j == 0 ? 0 : offsets[j - 1];
+            size_t part_end = j < offsets.size() ? offsets[j] : original_node_length;
 
-            // Record that more sequence has been consumed
-            current_offset += divide_offset;
-            last_bp = breakpoint;
+#ifdef debug
+            cerr << "Produced " << part->id() << " (" << part->sequence().size() << " bp) from "
+                << original_node_id << " at " << part_start << endl;
+#endif
 
+            toReturn[make_pos_t(original_node_id, false, part_start)] = part;
+            toReturn[make_pos_t(original_node_id, true, original_node_length - part_end)] = part;
         }
 
-        // Now the right part is done too. It's going to be the part
-        // corresponding to the remainder of the original node.
-        toReturn[last_bp] = right_part;
-        toReturn[make_pos_t(original_node_id, true, 0)] = right_part;
-
         // and record the start and end of the node
         toReturn[make_pos_t(original_node_id, true, original_node_length)] = nullptr;
         toReturn[make_pos_t(original_node_id, false, original_node_length)] = nullptr;
@@ -6888,7 +7258,10 @@ void VG::prune_complex_with_head_tail(int path_length, int edge_max) {
 
 void VG::prune_complex(int path_length, int edge_max, Node* head_node, Node* tail_node) {
 
+    // Search from all the threads, then go back to editing
+    freeze();
     vector<edge_t> to_destroy = find_edges_to_prune(*this, path_length, edge_max);
+    thaw();
     for (auto& e : to_destroy) {
         destroy_edge(e.first, e.second);
     }
@@ -117,7 +117,10 @@ public:
     using HandleGraph::follow_edges;
     
     /// Loop over all the nodes in the graph in their local forward
-    /// orientations, in their internal stored order. Stop if the iteratee returns false.
+    /// orientations, in their internal stored order. Stop if the iteratee
+    /// returns false. If parallel is set, the iteratee may call the other
+    /// handle graph accessors from all the threads; freeze() the graph first
+    /// to make sure its indexes are current and stay that way.
     virtual void for_each_handle(const function<bool(const handle_t&)>& iteratee, bool parallel = false) const;
     
     // Copy over the template for nice calls
@@ -174,6 +177,12 @@ private:
     const static size_t HIGH_BIT = (size_t)1 << 63;
     const static size_t LOW_BITS = 0x7FFFFFFFFFFFFFFF;
     
+    /// Is the graph read-only, with all its indexes built?
+    bool frozen = false;
+    
+    /// Throw if the graph is frozen, naming the mutating operation attempted.
+    void check_unfrozen(const char* operation) const;
+    
 public:
     
     ////////////////////////////////////////////////////////////////////////////
@@ -198,12 +207,12 @@ public:
     //id_t max_id;
 
     /// `Node`s by id.
-    hash_map<id_t, Node*> node_by_id;
+    hot_hash_map<id_t, Node*> node_by_id;
 
     /// `Edge`s by sides of `Node`s they connect.
     /// Since duplicate edges are not permitted, two edges cannot connect the same pair of node sides.
     /// Each edge is indexed here with the smaller NodeSide first. The actual node order is recorded in the Edge object.
-    pair_hash_map<pair<NodeSide, NodeSide>, Edge*> edge_by_sides;
+    hot_hash_map<pair<NodeSide, NodeSide>, Edge*> edge_by_sides;
 
     /// nodes by position in nodes repeated field.
     /// this is critical to allow fast deletion of nodes
@@ -298,10 +307,17 @@ public:
     void dice_nodes(int max_node_size);
     /// Does the reverse --- combines nodes by removing edges where doing so has no effect on the graph labels.
     void unchop(void);
+    /// Unchop only the simple components that include any of the given nodes.
+    /// IDs of nodes that no longer exist are ignored.
+    void unchop(const vector<id_t>& seeds);
     /// Get the set of components that could be merged into single nodes without
     /// changing the path space of the graph. Emits oriented traversals of
     /// nodes, in the order and orientation in which they are to be merged.
+    /// Uses multiple threads when available, by weakly connected component.
     set<list<NodeTraversal>> simple_components(int min_size = 1);
+    /// Get the simple components that include any of the given nodes. IDs of
+    /// nodes that no longer exist are ignored.
+    set<list<NodeTraversal>> simple_components(const vector<id_t>& seeds, int min_size = 1);
     /// Get the simple components of multiple nodes.
     set<list<NodeTraversal>> simple_multinode_components(void);
     /// Get the strongly connected components of the graph.
@@ -324,6 +340,9 @@ public:
     /// Use the orientation of the first node as the basis.
     Node* merge_nodes(const list<Node*>& nodes);
     /// Use unchop and sibling merging to simplify the graph into a normalized form.
+    /// After the first iteration, each iteration only looks around the nodes
+    /// the previous one made, and a final full iteration checks that nothing
+    /// was missed.
     void normalize(int max_iter = 1, bool debug = false);
     /// Remove redundant overlaps.
     void bluntify(void);
@@ -403,6 +422,7 @@ public:
     /// Move assignment operator.
     VG& operator=(VG&& other) noexcept {
         std::swap(graph, other.graph);
+        frozen = false;
         rebuild_indexes();
         return *this;
     }
@@ -426,6 +446,17 @@ public:
     void rebuild_indexes(void);
     void rebuild_edge_indexes(void);
 
+    /// Rebuild all the node, edge, and path indexes, and make the graph
+    /// read-only until thaw() is called. While frozen, the handle graph
+    /// accessors (and has_node(), get_node(), edges_start() and
+    /// edges_end()) are safe to call from many threads at once without
+    /// locking, and the structural mutators throw.
+    void freeze(void);
+    /// Allow the graph to be modified again after freeze().
+    void thaw(void);
+    /// Has the graph been frozen with freeze()?
+    bool is_frozen(void) const;
+
     /// Literally merge protobufs.
     void merge(Graph& g);
     /// Literally merge protobufs.
@@ -495,6 +526,11 @@ public:
     /// Paths::rebuild_mapping_aux() after you are done adding in graphs to this
     /// graph.
     void extend(const Graph& graph, bool warn_on_duplicates = false);
+    /// This version takes a batch of graphs to add in order, and moves their
+    /// nodes and edges out instead of copying them. Nodes, edges, and paths
+    /// are merged into their indexes on separate threads. Like the single
+    /// graph version, it does not sort path mappings by rank.
+    void extend(vector<Graph>& graphs, bool warn_on_duplicates = false);
     // TODO: Do a member group for these overloads
 
     /// Add another graph into this graph, attaching tails to heads.
@@ -688,6 +724,9 @@ public:
     set<Node*> siblings_of(Node* node);
     /// Remove easily-resolvable redundancy in the graph.
     void simplify_siblings(void);
+    /// Remove easily-resolvable redundancy among the siblings of the given
+    /// nodes. IDs of nodes that no longer exist are ignored.
+    void simplify_siblings(const vector<id_t>& seeds);
     /// Remove easily-resolvable redundancy in the graph for all provided to-sibling sets.
     void simplify_to_siblings(const set<set<NodeTraversal>>& to_sibs);
     /// Remove easily-resolvable redundancy in the graph for all provided from-sibling sets.
@@ -1190,6 +1229,18 @@ private:
                         bool allow_negatives,
                         Node* node = nullptr);
     
+    /// Walk left and right from the given node for as long as the nodes can be
+    /// merged, for simple_components(). Skips over and adds to the seen nodes.
+    list<NodeTraversal> simple_component_from(Node* n, unordered_set<Node*>& seen);
+    
+    /// Get the transitive full to- (or from-) sibling sets of the given nodes,
+    /// judging transitivity against all the sets the sibling nodes are in, as
+    /// the whole-graph pass in simplify_siblings() would.
+    set<set<NodeTraversal>> transitive_sibling_sets_around(const vector<id_t>& seeds, bool to);
+    
+    /// Get the nodes with IDs of at least first_new_id, and their neighbors.
+    vector<id_t> new_nodes_and_neighbors(id_t first_new_id);
+    
     /// Private method to funnel other align functions into. max_span specifies
     /// the min distance to unfold the graph to, and is meant to be the longest
     /// path that the specified sequence could cover, accounting for deletions.
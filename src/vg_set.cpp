@@ -1,5 +1,11 @@
 #include "vg_set.hpp"
 #include "stream.hpp"
+#include "gfa.hpp"
+#include "graph.hpp"
+
+#include <cstdio>
+#include <exception>
+#include <iterator>
 
 namespace vg {
 // sets of VGs on disk
@@ -64,13 +70,301 @@ id_t VGset::get_max_id(void) {
 }
 
 int64_t VGset::merge_id_space(void) {
-    int64_t max_node_id = 0;
-    auto lambda = [&max_node_id](VG* g) {
-        if (max_node_id > 0) g->increment_node_ids(max_node_id);
-        max_node_id = g->max_node_id();
+    if (std::find(filenames.begin(), filenames.end(), "-") != filenames.end()) {
+        // We can't read standard input twice, so go through the graphs one at a time
+        int64_t max_node_id = 0;
+        auto lambda = [&max_node_id](VG* g) {
+            if (max_node_id > 0) g->increment_node_ids(max_node_id);
+            max_node_id = g->max_node_id();
+        };
+        transform(lambda);
+        return max_node_id;
+    }
+    
+    // Each graph's IDs go after the IDs of all the graphs before it, so find
+    // every graph's max ID first, in parallel
+    vector<int64_t> max_ids(filenames.size(), 0);
+#pragma omp parallel for schedule(dynamic, 1)
+    for (size_t i = 0; i < filenames.size(); ++i) {
+        ifstream in(filenames[i].c_str());
+        if (!in) {
+#pragma omp critical (cerr)
+            cerr << "error:[vg_set] failed to open " << filenames[i] << endl;
+            exit(1);
+        }
+        stream::for_each<Graph>(in, [&](Graph& graph) {
+            for (size_t j = 0; j < graph.node_size(); ++j) {
+                max_ids[i] = max<int64_t>(graph.node(j).id(), max_ids[i]);
+            }
+        });
+    }
+    
+    vector<int64_t> offsets(filenames.size(), 0);
+    for (size_t i = 1; i < filenames.size(); ++i) {
+        offsets[i] = offsets[i - 1] + max_ids[i - 1];
+    }
+    
+    // Then shift them all at once, streaming each file through a temp file beside it
+    exception_ptr error;
+#pragma omp parallel for schedule(dynamic, 1)
+    for (size_t i = 0; i < filenames.size(); ++i) {
+        if (offsets[i] == 0) {
+            // Nothing to change
+            continue;
+        }
+        try {
+            string temp_name = filenames[i] + ".merge_id_space.tmp";
+            {
+                ifstream in(filenames[i].c_str());
+                ofstream out(temp_name.c_str());
+                int64_t offset = offsets[i];
+                for_each_translated(in, out, [&](Graph& graph) {
+                    translate_ids(graph, [&](id_t id) { return id + offset; });
+                });
+                stream::finish(out);
+                if (!out) {
+                    throw runtime_error("vg_set: failed to write " + temp_name);
+                }
+            }
+            if (rename(temp_name.c_str(), filenames[i].c_str()) != 0) {
+                throw runtime_error("vg_set: failed to replace " + filenames[i]);
+            }
+        } catch (...) {
+#pragma omp critical (vg_set_error)
+            if (!error) {
+                error = current_exception();
+            }
+        }
+    }
+    if (error) {
+        rethrow_exception(error);
+    }
+    
+    return filenames.empty() ? 0 : offsets.back() + max_ids.back();
+}
+
+void VGset::for_each_translated(istream& in, ostream& out, const function<void(Graph&)>& lambda) {
+    vector<Graph> buffer;
+    function<void(Graph&)> translate_chunk = [&](Graph& graph) {
+        lambda(graph);
+        buffer.emplace_back();
+        buffer.back().Swap(&graph);
+        stream::write_buffered(out, buffer, 1);
+    };
+    stream::for_each(in, translate_chunk);
+}
+
+void VGset::for_each_file_translated(ostream& out, const function<void(size_t, Graph&)>& lambda) {
+    if (filenames.size() == 1) {
+        // No point in a temp file
+        ifstream file_in;
+        if (filenames[0] != "-") file_in.open(filenames[0].c_str());
+        istream& in = filenames[0] == "-" ? std::cin : file_in;
+        if (!in) throw ifstream::failure("failed to open " + filenames[0]);
+        for_each_translated(in, out, [&](Graph& graph) { lambda(0, graph); });
+        return;
+    }
+    // Translate the files in parallel into temp files, then copy them out in order
+    vector<string> temp_names(filenames.size());
+    exception_ptr error;
+#pragma omp parallel for schedule(dynamic, 1)
+    for (size_t i = 0; i < filenames.size(); ++i) {
+        try {
+            ifstream file_in;
+            if (filenames[i] != "-") file_in.open(filenames[i].c_str());
+            istream& in = filenames[i] == "-" ? std::cin : file_in;
+            if (!in) throw ifstream::failure("failed to open " + filenames[i]);
+            temp_names[i] = temp_file::create("vg-set-");
+            ofstream temp_out(temp_names[i].c_str(), std::ios_base::binary);
+            for_each_translated(in, temp_out, [&](Graph& graph) { lambda(i, graph); });
+        } catch (...) {
+#pragma omp critical (vg_set_error)
+            if (!error) {
+                error = current_exception();
+            }
+        }
+    }
+    for (auto& temp_name : temp_names) {
+        if (!error) {
+            ifstream temp_in(temp_name.c_str(), std::ios_base::binary);
+            if (temp_in.peek() != EOF) {
+                out << temp_in.rdbuf();
+            }
+        }
+        if (!temp_name.empty()) {
+            temp_file::remove(temp_name);
+        }
+    }
+    if (error) {
+        rethrow_exception(error);
+    }
+}
+
+void VGset::scan_files(const function<void(size_t, const Graph&)>& lambda) {
+    exception_ptr error;
+#pragma omp parallel for schedule(dynamic, 1)
+    for (size_t i = 0; i < filenames.size(); ++i) {
+        try {
+            if (filenames[i] == "-") {
+                throw runtime_error("vg_set: standard input can't be read twice");
+            }
+            ifstream in(filenames[i].c_str());
+            if (!in) throw ifstream::failure("failed to open " + filenames[i]);
+            stream::for_each<Graph>(in, [&](Graph& graph) { lambda(i, graph); });
+        } catch (...) {
+#pragma omp critical (vg_set_error)
+            if (!error) {
+                error = current_exception();
+            }
+        }
+    }
+    if (error) {
+        rethrow_exception(error);
+    }
+}
+
+IDTranslator VGset::compacted_ids(id_t first_id) {
+    vector<IDTranslator> file_ids(filenames.size());
+    scan_files([&](size_t i, const Graph& graph) {
+        file_ids[i].add_ids(graph);
+    });
+    IDTranslator translator;
+    for (auto& ids : file_ids) {
+        translator.add_ids(ids);
+    }
+    translator.build(first_id);
+    return translator;
+}
+
+void VGset::write_compacted(ostream& out, id_t first_id) {
+    IDTranslator translator = compacted_ids(first_id);
+    for_each_file_translated(out, [&](size_t i, Graph& graph) {
+        translate_ids(graph, [&](id_t id) { return translator.translate(id); });
+    });
+    stream::finish(out);
+}
+
+void VGset::write_incremented(ostream& out, int64_t increment) {
+    for_each_file_translated(out, [&](size_t i, Graph& graph) {
+        translate_ids(graph, [&](id_t id) { return id + increment; });
+    });
+    stream::finish(out);
+}
+
+VGset::FileEnds VGset::file_ends(bool joint) {
+    // Each file's node IDs, and the IDs with edges on their starts and ends
+    vector<vector<id_t>> nodes(filenames.size()), on_start(filenames.size()), on_end(filenames.size());
+    FileEnds ends;
+    ends.max_ids.resize(filenames.size(), 0);
+    scan_files([&](size_t i, const Graph& graph) {
+        for (auto& node : graph.node()) {
+            nodes[i].push_back(node.id());
+            ends.max_ids[i] = max(ends.max_ids[i], node.id());
+        }
+        for (auto& edge : graph.edge()) {
+            (edge.from_start() ? on_start : on_end)[i].push_back(edge.from());
+            (edge.to_end() ? on_end : on_start)[i].push_back(edge.to());
+        }
+    });
+    if (joint) {
+        // Pool everything into the first file's lists
+        for (size_t i = 1; i < filenames.size(); ++i) {
+            nodes[0].insert(nodes[0].end(), nodes[i].begin(), nodes[i].end());
+            on_start[0].insert(on_start[0].end(), on_start[i].begin(), on_start[i].end());
+            on_end[0].insert(on_end[0].end(), on_end[i].begin(), on_end[i].end());
+            vector<id_t>().swap(nodes[i]);
+            vector<id_t>().swap(on_start[i]);
+            vector<id_t>().swap(on_end[i]);
+        }
+    }
+    auto sort_unique = [](vector<id_t>& ids) {
+        std::sort(ids.begin(), ids.end());
+        ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
     };
-    transform(lambda);
-    return max_node_id;
+    // A head has no edges on its start, and a tail none on its end
+    ends.heads.resize(filenames.size());
+    ends.tails.resize(filenames.size());
+#pragma omp parallel for schedule(dynamic, 1)
+    for (size_t i = 0; i < filenames.size(); ++i) {
+        sort_unique(nodes[i]);
+        sort_unique(on_start[i]);
+        sort_unique(on_end[i]);
+        std::set_difference(nodes[i].begin(), nodes[i].end(), on_start[i].begin(), on_start[i].end(),
+                            back_inserter(ends.heads[i]));
+        std::set_difference(nodes[i].begin(), nodes[i].end(), on_end[i].begin(), on_end[i].end(),
+                            back_inserter(ends.tails[i]));
+    }
+    return ends;
+}
+
+void VGset::write_concatenated(ostream& out) {
+    FileEnds ends = file_ends(false);
+    // Each graph's IDs go after the IDs of the graphs before it, as in VG::append
+    vector<int64_t> offsets(filenames.size(), 0);
+    for (size_t i = 1; i < filenames.size(); ++i) {
+        offsets[i] = offsets[i - 1] + ends.max_ids[i - 1];
+    }
+    for_each_file_translated(out, [&](size_t i, Graph& graph) {
+        translate_ids(graph, [&](id_t id) { return id + offsets[i]; });
+        // Paths with the same name are concatenated, so they go by stream order, not rank
+        for (auto& path : *graph.mutable_path()) {
+            for (auto& mapping : *path.mutable_mapping()) {
+                mapping.set_rank(0);
+            }
+        }
+    });
+    // Connect the tails so far to the heads of each graph in turn
+    vector<Graph> buffer(1);
+    vector<id_t> tails;
+    for (size_t i = 0; i < filenames.size(); ++i) {
+        if (ends.heads[i].empty()) {
+            // Nothing to connect to, so the tails so far stay tails
+            for (id_t tail : ends.tails[i]) {
+                tails.push_back(tail + offsets[i]);
+            }
+            continue;
+        }
+        for (id_t tail : tails) {
+            for (id_t head : ends.heads[i]) {
+                Edge* edge = buffer.back().add_edge();
+                edge->set_from(tail);
+                edge->set_to(head + offsets[i]);
+            }
+        }
+        tails.clear();
+        for (id_t tail : ends.tails[i]) {
+            tails.push_back(tail + offsets[i]);
+        }
+    }
+    if (buffer.back().edge_size()) {
+        stream::write_buffered(out, buffer, 1);
+    }
+    stream::write_buffered(out, buffer, 0);
+}
+
+void VGset::write_joined(ostream& out) {
+    // The graphs share an ID space, so the heads are the nodes with no edges
+    // on their starts in any of them
+    FileEnds ends = file_ends(true);
+    id_t max_id = 0;
+    for (id_t file_max_id : ends.max_ids) {
+        max_id = max(max_id, file_max_id);
+    }
+    for_each_file_translated(out, [](size_t i, Graph& graph) {});
+    // Then wire a new root node to all the heads, as in VG::join_heads
+    vector<Graph> buffer(1);
+    Node* root = buffer.back().add_node();
+    root->set_id(max_id + 1);
+    root->set_sequence("N");
+    if (!ends.heads.empty()) {
+        for (id_t head : ends.heads[0]) {
+            Edge* edge = buffer.back().add_edge();
+            edge->set_from(root->id());
+            edge->set_to(head);
+        }
+    }
+    stream::write_buffered(out, buffer, 1);
+    stream::write_buffered(out, buffer, 0);
 }
 
 void VGset::to_xg(xg::XG& index, bool store_threads) {
@@ -85,83 +379,135 @@ void VGset::to_xg(xg::XG& index, bool store_threads, const regex& paths_to_take,
     // from path anme and then rank to Mapping.
     map<string, map<int64_t, Mapping>> mappings;
     
-    // Set up an XG index
-    index.from_callback([&](function<void(Graph&)> callback) {
-        for (auto& name : filenames) {
+    // Decode a file into chunks, with the matching paths moved out of them
+    auto load_chunks = [&](const string& name, vector<Graph>& chunks, list<Path>& paths_taken) {
 #ifdef debug
-            cerr << "Loading chunks from " << name << endl;
+        cerr << "Loading chunks from " << name << endl;
 #endif
-            // Load chunks from all the files and pass them into XG.
-            std::ifstream in(name);
-            
-            if (name == "-"){
-                if (!in) throw ifstream::failure("vg_set: cannot read from stdin. Failed to open " + name);
-            }
-            
-            if (!in) throw ifstream::failure("failed to open " + name);
-            
-            function<void(Graph&)> handle_graph = [&](Graph& graph) {
+        std::ifstream in(name);
+        
+        if (name == "-"){
+            if (!in) throw ifstream::failure("vg_set: cannot read from stdin. Failed to open " + name);
+        }
+        
+        if (!in) throw ifstream::failure("failed to open " + name);
+        
+        function<void(Graph&)> take_chunk = [&](Graph& graph) {
 #ifdef debug
-                cerr << "Got chunk of " << name << "!" << endl;
+            cerr << "Got chunk of " << name << "!" << endl;
 #endif
-
-                // We'll move all the paths into one of these (if removed_paths is not null)
-                std::list<Path> paths_taken;
-
-                // Remove the matching paths.
-                remove_paths(graph, paths_to_take, removed_paths ? &paths_taken : nullptr);
-
-                // Sort out all the mappings from the paths we pulled out
-                for(Path& path : paths_taken) {
-                    mappings[path.name()] = map<int64_t, Mapping>(); // We want to include empty paths as well.
-
-                    for(size_t i = 0; i < path.mapping_size(); i++) {
-                        // For each mapping, file it under its rank if a rank is
-                        // specified, or at the last rank otherwise.
-                        // TODO: this sort of duplicates logic from Paths...
-                        Mapping& mapping = *path.mutable_mapping(i);
-                        
-                        if(mapping.rank() == 0) {
-                            if(mappings[path.name()].size() > 0) {
-                                // Calculate a better rank, which is 1 more than the current largest rank.
-                                int64_t last_rank = (*mappings[path.name()].rbegin()).first;
-                                mapping.set_rank(last_rank + 1);
-                            } else {
-                                // Say it has rank 1 now.
-                                mapping.set_rank(1);
-                            }
-                        }
-                        
-                        // Move the mapping into place
-                        mappings[path.name()][mapping.rank()] = mapping;
-                    }
+            // Remove the matching paths, keeping them if removed_paths is not null
+            remove_paths(graph, paths_to_take, removed_paths ? &paths_taken : nullptr);
+            chunks.emplace_back();
+            chunks.back().Swap(&graph);
+        };
+        
+        if (name.size() > 4 && name.substr(name.size() - 4) == ".gfa") {
+            // GFA can be indexed directly, without a .vg
+            bool imported;
+            try {
+                imported = gfa_to_graph_chunks(in, take_chunk);
+            } catch (GFAOverlapError& e) {
+                // Overlaps need the full importer, so read the file again
+                chunks.clear();
+                paths_taken.clear();
+                std::ifstream again(name);
+                VG graph;
+                imported = gfa_to_graph(again, &graph);
+                if (imported) {
+                    take_chunk(graph.graph);
                 }
+            }
+            if (!imported) {
+                throw runtime_error("vg_set: could not import GFA file " + name);
+            }
+        } else {
+            stream::for_each(in, take_chunk);
+        }
+    };
+    
+    // Sort out all the mappings from the paths we pulled out
+    auto file_mappings = [&](list<Path>& paths_taken) {
+        for(Path& path : paths_taken) {
+            mappings[path.name()] = map<int64_t, Mapping>(); // We want to include empty paths as well.
 
-                // Ship out the corrected graph
-                callback(graph);
-            };
-            
-            stream::for_each(in, handle_graph);
-            
-            // Now that we got all the chunks, reconstitute any siphoned-off paths into Path objects and return them.
-            for(auto& kv : mappings) {
-                // We'll fill in this Path object
-                Path path;
-                path.set_name(kv.first);
+            for(size_t i = 0; i < path.mapping_size(); i++) {
+                // For each mapping, file it under its rank if a rank is
+                // specified, or at the last rank otherwise.
+                // TODO: this sort of duplicates logic from Paths...
+                Mapping& mapping = *path.mutable_mapping(i);
                 
-                for(auto& rank_and_mapping : kv.second) {
-                    // Put in all the mappings. Ignore the rank since thay're already marked with and sorted by rank.
-                    *path.add_mapping() = rank_and_mapping.second;
+                if(mapping.rank() == 0) {
+                    if(mappings[path.name()].size() > 0) {
+                        // Calculate a better rank, which is 1 more than the current largest rank.
+                        int64_t last_rank = (*mappings[path.name()].rbegin()).first;
+                        mapping.set_rank(last_rank + 1);
+                    } else {
+                        // Say it has rank 1 now.
+                        mapping.set_rank(1);
+                    }
                 }
                 
-                // Now the Path is rebuilt; stick it in the big output map.
-                (*removed_paths)[path.name()] = path;
+                // Move the mapping into place
+                mappings[path.name()][mapping.rank()] = mapping;
+            }
+        }
+    };
+    
+    // Set up an XG index
+    index.from_callback([&](function<void(Graph&)> callback) {
+        // Decode the files in parallel, but hand their chunks to the XG one
+        // file at a time and in order, so the result doesn't depend on which
+        // file finishes first. Only the files being worked on are held in
+        // memory.
+        exception_ptr error;
+#pragma omp parallel for ordered schedule(dynamic, 1)
+        for (size_t i = 0; i < filenames.size(); ++i) {
+            vector<Graph> chunks;
+            list<Path> paths_taken;
+            bool loaded = false;
+            try {
+                load_chunks(filenames[i], chunks, paths_taken);
+                loaded = true;
+            } catch (...) {
+#pragma omp critical (vg_set_error)
+                if (!error) {
+                    error = current_exception();
+                }
+            }
+#pragma omp ordered
+            {
+                if (loaded && !error) {
+                    file_mappings(paths_taken);
+                    for (auto& chunk : chunks) {
+                        // Ship out the corrected graph
+                        callback(chunk);
+                    }
+                }
+            }
+        }
+        if (error) {
+            rethrow_exception(error);
+        }
+        
+        // Now that we got all the chunks, reconstitute any siphoned-off paths into Path objects and return them.
+        for(auto& kv : mappings) {
+            // We'll fill in this Path object
+            Path path;
+            path.set_name(kv.first);
+            
+            for(auto& rank_and_mapping : kv.second) {
+                // Put in all the mappings. Ignore the rank since thay're already marked with and sorted by rank.
+                *path.add_mapping() = rank_and_mapping.second;
             }
             
+            // Now the Path is rebuilt; stick it in the big output map.
+            (*removed_paths)[path.name()] = path;
+        }
+        
 #ifdef debug
-            cerr << "Got all chunks; building XG index" << endl;
+        cerr << "Got all chunks; building XG index" << endl;
 #endif
-        }
     });
 }
 
@@ -170,7 +516,11 @@ void VGset::for_each_kmer_parallel(int kmer_size, const function<void(const kmer
         g->show_progress = show_progress;
         g->preload_progress("processing kmers of " + g->name);
         //g->for_each_kmer_parallel(kmer_size, path_only, edge_max, lambda, stride, allow_dups, allow_negatives);
-        for_each_kmer(*g, kmer_size, lambda);
+        if (haplotypes != nullptr) {
+            for_each_haplotype_kmer(*g, *haplotypes, kmer_size, lambda);
+        } else {
+            for_each_kmer(*g, kmer_size, lambda);
+        }
     });
 }
 
@@ -196,7 +546,11 @@ void VGset::write_gcsa_kmers_ascii(ostream& out, int kmer_size,
             Node* head_node = nullptr; Node* tail_node = nullptr;
             g->add_start_end_markers(kmer_size, '#', '$', head_node, tail_node, head_id, tail_id);
             // now get the kmers
-            for_each_kmer(*g, kmer_size, write_kmer, head_id, tail_id);
+            if (haplotypes != nullptr) {
+                for_each_haplotype_kmer(*g, *haplotypes, kmer_size, write_kmer, head_id, tail_id);
+            } else {
+                for_each_kmer(*g, kmer_size, write_kmer, head_id, tail_id);
+            }
         });
 }
 
@@ -215,7 +569,7 @@ void VGset::write_gcsa_kmers_binary(ostream& out, int kmer_size, size_t& size_li
         Node* head_node = nullptr; Node* tail_node = nullptr;
         g->add_start_end_markers(kmer_size, '#', '$', head_node, tail_node, head_id, tail_id);
         size_t current_bytes = size_limit - total_size;
-        write_gcsa_kmers(*g, kmer_size, out, current_bytes, head_id, tail_id);
+        write_gcsa_kmers(*g, kmer_size, out, current_bytes, head_id, tail_id, show_progress, haplotypes);
         total_size += current_bytes;
     });
     size_limit = total_size;
@@ -236,7 +590,8 @@ vector<string> VGset::write_gcsa_kmers_binary(int kmer_size, size_t& size_limit,
         Node* head_node = nullptr; Node* tail_node = nullptr;
         g->add_start_end_markers(kmer_size, '#', '$', head_node, tail_node, head_id, tail_id);
         size_t current_bytes = size_limit - total_size;
-        tmpnames.push_back(write_gcsa_kmers_to_tmpfile(*g, kmer_size, current_bytes, head_id, tail_id));
+        tmpnames.push_back(write_gcsa_kmers_to_tmpfile(*g, kmer_size, current_bytes, head_id, tail_id,
+                                                       "vg-kmers-tmp-", show_progress, haplotypes));
         total_size += current_bytes;
     });
     size_limit = total_size;
@@ -9,6 +9,7 @@
 #include "index.hpp"
 #include "xg.hpp"
 #include "kmer.hpp"
+#include "id_translator.hpp"
 
 
 namespace vg {
@@ -36,6 +37,33 @@ public:
     /// necessary when storing many graphs in the same index
     int64_t merge_id_space(void);
 
+    /// Stream through the files in parallel and find the new IDs that
+    /// compact all their node IDs into one range from first_id up, keeping
+    /// their order.
+    IDTranslator compacted_ids(id_t first_id = 1);
+
+    /// The streaming transforms below write all the files, in order, to out
+    /// as one graph, working on the files in parallel and holding only a
+    /// chunk of each in memory. All but write_incremented read each file
+    /// twice, so can't read standard input.
+
+    /// Write the graphs with their node IDs compacted into one range from
+    /// first_id up.
+    void write_compacted(ostream& out, id_t first_id = 1);
+
+    /// Write the graphs with increment added to all their node IDs.
+    void write_incremented(ostream& out, int64_t increment);
+
+    /// Write the graphs concatenated as VG::append would, with each graph's
+    /// IDs moved past the ones before it and the tails of each connected to
+    /// the heads of the next. Paths with the same name are concatenated.
+    void write_concatenated(ostream& out);
+
+    /// Write the graphs, which must share an ID space, joined to a new root
+    /// node as VG::join_heads would. Nodes repeated between the graphs are
+    /// not merged.
+    void write_joined(ostream& out);
+
     /// Transforms to a succinct, queryable representation
     void to_xg(xg::XG& index, bool store_threads = false);
     /// As above, except paths with names matching the given regex are removed.
@@ -65,6 +93,34 @@ public:
 
     // Should we show our progress running through each graph?             
     bool show_progress = false;
+    
+    // If set, only generate the kmers along these haplotypes
+    const gbwt::GBWT* haplotypes = nullptr;
+
+private:
+
+    /// The head and tail node IDs of each graph, and each graph's max node ID
+    struct FileEnds {
+        vector<vector<id_t>> heads;
+        vector<vector<id_t>> tails;
+        vector<id_t> max_ids;
+    };
+
+    /// Find the heads and tails of each file, or, if joint, of the union of
+    /// all of them in the first entries.
+    FileEnds file_ends(bool joint);
+
+    /// Call the lambda on every chunk of every file, with the file's number,
+    /// working on the files in parallel. Throws on standard input.
+    void scan_files(const function<void(size_t, const Graph&)>& lambda);
+
+    /// Stream the chunks of a graph to out through the lambda, without an EOF marker.
+    void for_each_translated(istream& in, ostream& out, const function<void(Graph&)>& lambda);
+
+    /// Stream every file to out, in order, through the lambda, which gets
+    /// the file's number. Files are transformed into temp files in parallel.
+    /// Writes no EOF marker.
+    void for_each_file_translated(ostream& out, const function<void(size_t, Graph&)>& lambda);
 
 };
 
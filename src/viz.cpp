@@ -1,4 +1,6 @@
 #include "viz.hpp"
+#include "hash_map.hpp"
+#include <omp.h>
 #include <regex>
 
 namespace vg {
@@ -15,7 +17,12 @@ void Viz::init(xg::XG* x, vector<Packer>* p, const vector<string>& n, const stri
     show_cnv = c;
     show_dna = d;
     show_paths = t;
-    compute_borders_and_dimensions();
+    if (w > 0 && xgidx->seq_length + xgidx->node_count > (size_t) w) {
+        // one pixel per base won't fit, so summarize the sequence in bins
+        compute_bins(w, h);
+    } else {
+        compute_borders_and_dimensions();
+    }
     /*
     left_border = 8;
     top_border = 8;
@@ -47,41 +54,149 @@ void Viz::compute_borders_and_dimensions(void) {
                     double s2 = node_offset(id2);
                     double x = s+l;
                     int delta = s2 - x;
-                    double w = pow(log(abs(delta)+1), 1.5);
-                    int xdiff = (delta < 0 ? -w : w)/2;
+                    double w = edge_arc_width(delta);
                     int ydiff = w*2;
                     top_border = max(ydiff, top_border);
                     return true;
                 });
         });
     int height = top_border + 4;
-    surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, 0, 0);
-    cr = cairo_create(surface);
-    for (size_t i = 1; show_paths && i <= xgidx->path_count; ++i) {
-        string path_name = xgidx->path_name(i);
+    left_border = max(left_border, widest_label(1));
+    height += 2 * ((show_paths ? xgidx->path_count : 0) + packs->size());
+    height += 2;
+    image_width = xgidx->seq_length + xgidx->node_count + left_border * 2;
+    image_height = height;
+}
+
+int Viz::widest_label(double font_size) {
+    int widest = 0;
+    cairo_surface_t* measure_surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, 0, 0);
+    cairo_t* measure_cr = cairo_create(measure_surface);
+    cairo_select_font_face(measure_cr, "Arial", CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_BOLD);
+    cairo_set_font_size(measure_cr, font_size);
+    auto measure = [&](const string& label) {
         cairo_text_extents_t te;
-        cairo_select_font_face(cr, "Arial", CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_BOLD);
-        cairo_set_font_size(cr, 1);
-        cairo_text_extents(cr, path_name.c_str(), &te);
-        left_border = max(left_border, (int)round(te.width+2));
-        height += 2;
+        cairo_text_extents(measure_cr, label.c_str(), &te);
+        widest = max(widest, (int)round(te.width+2*font_size));
+    };
+    for (size_t i = 1; show_paths && i <= xgidx->path_count; ++i) {
+        measure(xgidx->path_name(i));
     }
     for (int i = 0; i < packs->size(); ++i) {
-        auto& pack_name = pack_names[i];
-        cairo_text_extents_t te;
-        cairo_select_font_face(cr, "Arial", CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_BOLD);
-        cairo_set_font_size(cr, 1);
-        cairo_text_extents(cr, pack_name.c_str(), &te);
-        left_border = max(left_border, (int)round(te.width+2));
-        height += 2;
+        measure(pack_names[i]);
+    }
+    cairo_destroy(measure_cr);
+    cairo_surface_destroy(measure_surface);
+    return widest;
+}
+
+void Viz::compute_bins(int width, int height) {
+    left_border = widest_label(bin_font_size);
+    bin_count = max(width - left_border * 2, 1);
+    // never make a bin smaller than a base
+    bin_count = min(bin_count, max(xgidx->seq_length, (size_t)1));
+    compute_bin_summaries();
+    // leave room for the tallest edge arc above the graph
+    top_border = bin_row_height;
+    for (auto& e : bin_edges) {
+        top_border = max(top_border, (int)(edge_arc_width(e.second - e.first)*2) + 2);
+    }
+    int rows_height = bin_row_height * 2;
+    for (auto& rows : bin_path_rows) {
+        rows_height += rows * bin_row_height;
+    }
+    rows_height += bin_row_height * 2 * packs->size();
+    image_width = bin_count + left_border * 2;
+    image_height = (height ? height : top_border + rows_height + bin_row_height);
+}
+
+size_t Viz::bin_of(size_t pos) const {
+    // bins split the sequence as evenly as integers allow
+    if (xgidx->seq_length == 0) {
+        return 0;
+    }
+    return min((size_t)((uint64_t)pos * bin_count / xgidx->seq_length), bin_count - 1);
+}
+
+size_t Viz::bin_start(size_t bin) const {
+    // the first position pos with pos * bin_count >= bin * seq_length
+    return ((uint64_t)bin * xgidx->seq_length + bin_count - 1) / bin_count;
+}
+
+void Viz::compute_bin_summaries(void) {
+    int thread_count = omp_get_max_threads();
+
+    // edges joining different bins, collected on all threads at once
+    vector<pair_hash_set<pair<size_t, size_t>>> thread_edges(thread_count);
+    xgidx->for_each_handle([&](const handle_t& h) {
+            id_t id = xgidx->get_id(h);
+            size_t length = xgidx->node_length(id);
+            size_t from = bin_of(xgidx->node_start(id) + (length ? length - 1 : 0));
+            auto& edges = thread_edges[omp_get_thread_num()];
+            xgidx->follow_edges(h, false, [&](const handle_t& o) {
+                    size_t to = bin_of(xgidx->node_start(xgidx->get_id(o)));
+                    if (from != to) {
+                        edges.insert(make_pair(min(from, to), max(from, to)));
+                    }
+                    return true;
+                });
+        }, true);
+    bin_edges.clear();
+    for (auto& edges : thread_edges) {
+        bin_edges.insert(bin_edges.end(), edges.begin(), edges.end());
+    }
+    sort(bin_edges.begin(), bin_edges.end());
+    bin_edges.erase(unique(bin_edges.begin(), bin_edges.end()), bin_edges.end());
+
+    // path depth, by splitting each path's steps between the threads
+    bin_path_depth.clear();
+    bin_path_rows.clear();
+    for (size_t i = 1; show_paths && i <= xgidx->path_count; ++i) {
+        const xg::XGPath& path = xgidx->get_path(xgidx->path_name(i));
+        vector<vector<size_t>> thread_bases(thread_count, vector<size_t>(bin_count, 0));
+#pragma omp parallel for schedule(dynamic, 4096)
+        for (size_t j = 0; j < path.ids.size(); ++j) {
+            id_t id = path.node(j);
+            auto& bases = thread_bases[omp_get_thread_num()];
+            size_t start = xgidx->node_start(id);
+            size_t end = start + xgidx->node_length(id);
+            // a node can cross into later bins
+            for (size_t b = bin_of(start); b < bin_count && bin_start(b) < end; ++b) {
+                bases[b] += min(end, bin_start(b+1)) - max(start, bin_start(b));
+            }
+        }
+        vector<double> depth(bin_count, 0);
+        int rows = 1;
+        for (size_t b = 0; b < bin_count; ++b) {
+            size_t bases = 0;
+            for (auto& t : thread_bases) {
+                bases += t[b];
+            }
+            size_t length = bin_start(b+1) - bin_start(b);
+            depth[b] = length ? (double)bases / (double)length : 0;
+            if (show_cnv) {
+                rows = max(rows, min((int)round(depth[b]), max_cnv_rows));
+            }
+        }
+        bin_path_depth.push_back(std::move(depth));
+        bin_path_rows.push_back(rows);
+    }
+
+    // mean coverage, with each thread taking a tile of bins at a time
+    bin_coverage.assign(packs->size(), vector<double>(bin_count, 0));
+    for (int i = 0; i < packs->size(); ++i) {
+        auto& pack = packs->at(i);
+        size_t covered = pack.coverage_size();
+        auto& coverage = bin_coverage[i];
+#pragma omp parallel for schedule(dynamic, 16)
+        for (size_t b = 0; b < bin_count; ++b) {
+            size_t start = min(bin_start(b), covered);
+            size_t end = min(bin_start(b+1), covered);
+            if (end > start) {
+                coverage[b] = (double)pack.coverage_in_range(start, end) / (double)(end - start);
+            }
+        }
     }
-    cairo_destroy(cr);
-    cairo_surface_destroy(surface);
-    cr = nullptr;
-    surface = nullptr;
-    height += 2;
-    image_width = xgidx->seq_length + xgidx->node_count + left_border * 2;
-    image_height = height;
 }
 
 double Viz::node_offset(id_t id) {
@@ -116,12 +231,84 @@ tuple<double, double, double> hash_to_rgb(const string& str, double min_sum) {
     return make_tuple(r, g, b);
 }
 
+double edge_arc_width(double delta) {
+    return pow(log(fabs(delta)+1), 1.5);
+}
+
 void Viz::set_hash_color(const string& str) {
     auto c = hash_to_rgb(str, 0.5);
     cairo_set_source_rgb(cr, get<0>(c), get<1>(c), get<2>(c));
 }
 
+void Viz::draw_bins(void) {
+    cairo_select_font_face(cr, "Arial", CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_BOLD);
+    cairo_set_font_size(cr, bin_font_size);
+    auto draw_label = [&](const string& label, double y) {
+        cairo_text_extents_t te;
+        cairo_text_extents(cr, label.c_str(), &te);
+        cairo_move_to(cr, left_border-(te.width+bin_font_size), y+bin_font_size/2);
+        cairo_show_text(cr, label.c_str());
+    };
+    // the graph, with an arc between each pair of bins an edge joins
+    int y_pos = top_border;
+    cairo_set_source_rgb(cr, 0, 0, 0);
+    cairo_set_line_width(cr, 2);
+    cairo_move_to(cr, left_border, y_pos);
+    cairo_line_to(cr, left_border+bin_count, y_pos);
+    cairo_stroke(cr);
+    cairo_set_line_width(cr, 0.25);
+    for (auto& e : bin_edges) {
+        double x = left_border+e.first+0.5;
+        double x3 = left_border+e.second+0.5;
+        double w = edge_arc_width(x3 - x);
+        cairo_move_to(cr, x, y_pos);
+        cairo_curve_to(cr, x+w/2, y_pos-w*2, x3-w/2, y_pos-w*2, x3, y_pos);
+        cairo_stroke(cr);
+    }
+    y_pos += bin_row_height*2;
+    // paths, shaded by how much of each bin they cover
+    for (size_t i = 0; i < bin_path_depth.size(); ++i) {
+        string path_name = xgidx->path_name(i+1);
+        auto& depth = bin_path_depth[i];
+        auto c = hash_to_rgb(path_name, 0.5);
+        cairo_set_source_rgb(cr, get<0>(c), get<1>(c), get<2>(c));
+        draw_label(path_name, y_pos);
+        for (size_t b = 0; b < bin_count; ++b) {
+            if (depth[b] == 0) {
+                continue;
+            }
+            // with CNVs shown, each copy gets its own row
+            int copies = (!show_cnv ? 1 : max(1, min((int)round(depth[b]), max_cnv_rows)));
+            cairo_set_source_rgba(cr, get<0>(c), get<1>(c), get<2>(c), min(depth[b], 1.0));
+            for (int j = 0; j < copies; ++j) {
+                cairo_rectangle(cr, left_border+b, y_pos+j*bin_row_height-bin_row_height*0.3, 1, bin_row_height*0.6);
+            }
+            cairo_fill(cr);
+        }
+        y_pos += bin_row_height*bin_path_rows[i];
+    }
+    y_pos += bin_row_height;
+    // coverage, as a bar for each bin scaled to the highest mean coverage
+    for (int i = 0; i < bin_coverage.size(); ++i) {
+        auto& coverage = bin_coverage[i];
+        set_hash_color(pack_names[i]);
+        draw_label(pack_names[i], y_pos);
+        double max_coverage = *max_element(coverage.begin(), coverage.end());
+        double bar_height = bin_row_height*1.5;
+        for (size_t b = 0; max_coverage > 0 && b < bin_count; ++b) {
+            double h = coverage[b]/max_coverage*bar_height;
+            cairo_rectangle(cr, left_border+b, y_pos+bin_row_height*0.5-h, 1, h);
+        }
+        cairo_fill(cr);
+        y_pos += bin_row_height*2;
+    }
+}
+
 void Viz::draw_graph(void) {
+    if (bin_count) {
+        draw_bins();
+        return;
+    }
     cairo_set_source_rgb(cr, 0, 0, 0);
     int y_pos = top_border;
     xgidx->for_each_handle([&](const handle_t& h) {
@@ -154,7 +341,7 @@ void Viz::draw_graph(void) {
                     double x = s+l;
                     double y = y_pos;
                     int delta = s2 - x;
-                    double w = pow(log(abs(delta)+1), 1.5);
+                    double w = edge_arc_width(delta);
                     int xdiff = (delta < 0 ? -w : w)/2;
                     int ydiff = w*2;
                     double x1 = x+xdiff, y1=y-ydiff,
@@ -33,6 +33,15 @@ private:
     double nodes_before_offset(size_t pos);
     void set_hash_color(const string& str);
     void compute_borders_and_dimensions(void);
+    // the width of the widest row label at the given font size, plus padding
+    int widest_label(double font_size);
+    // level of detail rendering: when the graph is too big to draw base by base,
+    // split its sequence into pixel-wide bins and draw a summary of each one
+    void compute_bins(int width, int height);
+    void compute_bin_summaries(void);
+    void draw_bins(void);
+    size_t bin_of(size_t pos) const;
+    size_t bin_start(size_t bin) const;
     xg::XG* xgidx = nullptr;
     vector<Packer>* packs = nullptr;
     vector<string> pack_names;
@@ -48,10 +57,26 @@ private:
     int image_height = 0;
     int left_border = 0;
     int top_border = 0;
+    // how many bins the sequence is split into, or 0 to draw every base
+    size_t bin_count = 0;
+    double bin_font_size = 8;
+    int bin_row_height = 10;
+    int max_cnv_rows = 8;
+    // pairs of distinct bins joined by at least one edge, in order
+    vector<pair<size_t, size_t>> bin_edges;
+    // for each path, the bases it covers in each bin over the bin's length
+    vector<vector<double>> bin_path_depth;
+    // how many rows each path takes up
+    vector<int> bin_path_rows;
+    // for each pack, the mean coverage of each bin
+    vector<vector<double>> bin_coverage;
 };
 
 tuple<double, double, double> hash_to_rgb(const string& str, double min_sum);
 
+// how far out the arc for an edge spanning delta units goes
+double edge_arc_width(double delta);
+
 }
 
 #endif
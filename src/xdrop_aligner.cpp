@@ -6,6 +6,7 @@
  */
 #include <cstdio>
 #include <assert.h>
+#include <queue>
 #include "mem.hpp"
 #include "xdrop_aligner.hpp"
 
@@ -18,6 +19,13 @@ enum { MISMATCH = 1, MATCH = 2, INS = 3, DEL = 4 };
 
 using namespace vg;
 
+std::atomic<uint64_t> XdropAligner::buffer_growths(0);
+
+uint64_t XdropAligner::working_buffer_growths(void)
+{
+	return(buffer_growths.load(std::memory_order_relaxed));
+}
+
 XdropAligner::XdropAligner(XdropAligner const &rhs)
 {
 	dz = dz_init(
@@ -27,6 +35,7 @@ XdropAligner::XdropAligner(XdropAligner const &rhs)
 		(uint16_t)rhs.dz->max_gap_len,
 		(uint16_t)rhs.dz->bonus
 	);
+	max_gap_length = rhs.max_gap_length;
 }
 
 XdropAligner& XdropAligner::operator=(XdropAligner const &rhs)
@@ -39,6 +48,7 @@ XdropAligner& XdropAligner::operator=(XdropAligner const &rhs)
 		(uint16_t)rhs.dz->max_gap_len,
 		(uint16_t)rhs.dz->bonus
 	);
+	max_gap_length = rhs.max_gap_length;
 	return(*this);
 }
 
@@ -47,6 +57,7 @@ XdropAligner::XdropAligner(XdropAligner&& rhs)
 	dz_destroy(dz);
 	dz = rhs.dz;		// move
 	rhs.dz = nullptr;
+	max_gap_length = rhs.max_gap_length;
 }
 
 XdropAligner& XdropAligner::operator=(XdropAligner&& rhs)
@@ -55,12 +66,14 @@ XdropAligner& XdropAligner::operator=(XdropAligner&& rhs)
 	dz_destroy(dz);
 	dz = rhs.dz;
 	rhs.dz = nullptr;
+	max_gap_length = rhs.max_gap_length;
 	return(*this);
 }
 
 XdropAligner::XdropAligner()
 {
 	dz = nullptr;
+	max_gap_length = 0;
 }
 
 XdropAligner::XdropAligner(
@@ -78,6 +91,7 @@ XdropAligner::XdropAligner(
 	uint64_t go = _gap_open - _gap_extension, ge = _gap_extension;
 	uint64_t xdrop_threshold = ge * (uint64_t)_max_gap_length + go;
 	dz = dz_init((int8_t const *)_score_matrix, go, ge, xdrop_threshold, _full_length_bonus);
+	max_gap_length = _max_gap_length;
 	// bench_init(bench);
 }
 
@@ -106,6 +120,7 @@ XdropAligner::XdropAligner(
 	uint64_t go = _gap_open - _gap_extension, ge = _gap_extension;
 	uint64_t xdrop_threshold = ge * (uint64_t)_max_gap_length + go;
 	dz = dz_init((int8_t const *)_score_matrix, go, ge, xdrop_threshold, _full_length_bonus);
+	max_gap_length = _max_gap_length;
 	// bench_init(bench);
 }
 
@@ -135,15 +150,26 @@ static inline char comp(char x)
 void XdropAligner::build_id_index_table(Graph const &graph)
 {
 	// construct node_id -> index map
-	id_to_index.clear();							// unordered_map< id_t, uint64_t >
+	id_to_index.clear();							// vector< pair< id_t, uint32_t > >
 	for(size_t i = 0; i < graph.node_size(); i++) {
 		Node const &n = graph.node(i);
-		id_to_index[n.id()] = (uint32_t)i;
+		id_to_index.emplace_back(n.id(), (uint32_t)i);
 		// fprintf(stderr, "i(%lu), id(%ld), length(%lu)\n", i, n.id(), n.sequence().length());
 	}
+	// extracted subgraphs usually come in id order already
+	if(!std::is_sorted(id_to_index.begin(), id_to_index.end())) {
+		std::sort(id_to_index.begin(), id_to_index.end());
+	}
 	return;
 }
 
+uint64_t XdropAligner::index_of(id_t node_id) const
+{
+	auto it = std::lower_bound(id_to_index.begin(), id_to_index.end(), std::make_pair(node_id, (uint32_t)0));
+	// ids not in the graph (from dangling edges) go to index 0, as they did with the old hash table
+	return((it != id_to_index.end() && it->first == node_id) ? it->second : 0);
+}
+
 void XdropAligner::build_index_edge_table(Graph const &graph, uint32_t const seed_node_index, bool direction)
 {
 	// build (src_index, dst_index) array
@@ -154,12 +180,13 @@ void XdropAligner::build_index_edge_table(Graph const &graph, uint32_t const see
 	index_edges_head.reserve(graph.edge_size());	// vector< uint64_t >
 	for(size_t i = 0; i < graph.edge_size(); i++) {
 		Edge const &e = graph.edge(i);
-		index_edges.push_back(edge[!direction](id_to_index[e.from()], id_to_index[e.to()]));
-		// fprintf(stderr, "append edge, %u -> %u\n", id_to_index[e.from()], id_to_index[e.to()]);
+		uint64_t from_index = index_of(e.from()), to_index = index_of(e.to());
+		index_edges.push_back(edge[!direction](from_index, to_index));
+		// fprintf(stderr, "append edge, %u -> %u\n", from_index, to_index);
 
-		if(!compare[!direction](id_to_index[direction ? e.from() : e.to()], seed_node_index)) { continue; }
-		index_edges_head.push_back(edge[direction](id_to_index[e.from()], id_to_index[e.to()]));	// reversed
-		// fprintf(stderr, "append head edge, %u -> %u\n", id_to_index[e.from()], id_to_index[e.to()]);
+		if(!compare[!direction](direction ? from_index : to_index, seed_node_index)) { continue; }
+		index_edges_head.push_back(edge[direction](from_index, to_index));	// reversed
+		// fprintf(stderr, "append head edge, %u -> %u\n", from_index, to_index);
 	}
 
 	sort(index_edges.begin(), index_edges.end(), compare[!direction]);
@@ -194,7 +221,7 @@ struct graph_pos_s XdropAligner::calculate_seed_position(Graph const &graph, vec
 	auto seed_pos = direction ? seed.nodes.front() : seed.nodes.back();
 	size_t node_id = gcsa::Node::id(seed_pos);
 	size_t node_offset = gcsa::Node::offset(seed_pos);
-	pos.node_index = id_to_index[node_id];
+	pos.node_index = index_of(node_id);
 
 	// calc ref_offset
 	Node const &n = graph.node(pos.node_index);
@@ -441,8 +468,8 @@ void XdropAligner::calculate_and_save_alignment(
 void XdropAligner::debug_print(Alignment const &alignment, Graph const &graph, MaximalExactMatch const &seed, bool reverse_complemented)
 {
 	uint64_t seed_pos = gcsa::Node::offset(seed.nodes.front());
-	uint64_t rlen = graph.node(id_to_index[gcsa::Node::id(seed_pos)]).sequence().length();
-	char const *rseq = graph.node(id_to_index[gcsa::Node::id(seed_pos)]).sequence().c_str();
+	uint64_t rlen = graph.node(index_of(gcsa::Node::id(seed_pos))).sequence().length();
+	char const *rseq = graph.node(index_of(gcsa::Node::id(seed_pos))).sequence().c_str();
 	uint64_t qlen = alignment.sequence().length(), qpos = calculate_query_seed_pos(alignment, seed);
 	char const *qseq = alignment.sequence().c_str();
 	fprintf(stderr, "xdrop_aligner::align, rev(%d), ptr(%p, %p), (%u, %u, %lu), (%d, %d), %s\n",
@@ -490,9 +517,13 @@ XdropAligner::align(
 	std::string const &query_seq = alignment.sequence();
 	uint64_t const qlen = query_seq.length();
 
+	// remember how big the working buffers were, so we can tell if this read made them grow
+	size_t const capacity_before = id_to_index.capacity() + index_edges.capacity()
+		+ index_edges_head.capacity() + forefronts.capacity();
+
 	// construct node_id -> index mapping table
 	build_id_index_table(graph);
-	forefronts.reserve(graph.node_size());		// vector< void * >
+	forefronts.resize(graph.node_size());		// vector< void * >
 
 	// extract seed node
 	// MaximalExactMatch const &seed = select_root_seed(mems);
@@ -536,10 +567,244 @@ XdropAligner::align(
 		direction
 	);
 	dz_flush(dz);
+
+	if(id_to_index.capacity() + index_edges.capacity() + index_edges_head.capacity() + forefronts.capacity() > capacity_before) {
+		buffer_growths.fetch_add(1, std::memory_order_relaxed);
+	}
 	// bench_end(bench);
 	return;
 }
 
+void XdropAligner::collect_local_graph(HandleGraph const &graph, handle_t root, size_t root_offset, size_t max_length)
+{
+	// find the nodes starting within max_length bases of the root position, nearest first, so that the band can
+	// never run off the end of what we fetched
+	local_handles.clear();
+	local_sequences.clear();
+	local_index.clear();
+
+	// (distance to the node's start, handle as integer), smallest first
+	std::priority_queue< std::pair< size_t, int64_t >, std::vector< std::pair< size_t, int64_t > >,
+		std::greater< std::pair< size_t, int64_t > > > queue;
+	queue.emplace(0, as_integer(root));
+	while(!queue.empty()) {
+		size_t start = queue.top().first;
+		handle_t h = as_handle(queue.top().second);
+		queue.pop();
+		if(local_index.count(h)) { continue; }
+
+		local_index[h] = (uint32_t)local_handles.size();
+		local_handles.push_back(h);
+		local_sequences.push_back(graph.get_sequence(h));
+
+		size_t end = start + local_sequences.back().length() - (local_handles.size() == 1 ? root_offset : 0);
+		if(end >= max_length) { continue; }
+		graph.follow_edges(h, false, [&](handle_t const &next) {
+			if(!local_index.count(next)) { queue.emplace(end, as_integer(next)); }
+		});
+	}
+	assert(local_handles.size() < UINT32_MAX);
+
+	// record the edges between the nodes we found; nothing comes into the root, which is where the band starts
+	size_t n = local_handles.size();
+	if(local_incoming.size() < n) { local_incoming.resize(n); local_outgoing.resize(n); }
+	for(size_t i = 0; i < n; i++) { local_incoming[i].clear(); local_outgoing[i].clear(); }
+	for(size_t i = 0; i < n; i++) {
+		graph.follow_edges(local_handles[i], false, [&](handle_t const &next) {
+			auto it = local_index.find(next);
+			if(it == local_index.end() || it->second == 0) { return; }
+			local_outgoing[i].push_back(it->second);
+			local_incoming[it->second].push_back((uint32_t)i);
+		});
+	}
+	return;
+}
+
+size_t XdropAligner::extend_over_handles(
+	HandleGraph const &graph,
+	handle_t root,
+	size_t root_offset,								// offset on the root in its own orientation
+	struct dz_query_s const *packed_query,
+	size_t max_length)								// how far the band could possibly get from the root position
+{
+	collect_local_graph(graph, root, root_offset, max_length);
+	size_t n = local_handles.size();
+	forefronts.assign(n, nullptr);
+
+	// dozeu ids are local indices
+	std::string const &root_seq = local_sequences[0];
+	forefronts[0] = dz_extend(dz,
+		packed_query,
+		dz_root(dz), 1,
+		&root_seq.c_str()[root_offset], root_seq.length() - root_offset, 0
+	);
+	size_t max_index = 0;
+
+	// visit the rest in topological order; when a cycle leaves nothing ready, go on with the nearest node left,
+	// dropping the edges that close the cycle
+	std::vector< uint32_t > remaining_incoming(n), ready;
+	std::vector< bool > visited(n, false);
+	for(size_t i = 0; i < n; i++) { remaining_incoming[i] = local_incoming[i].size(); }
+	visited[0] = true;
+	size_t next_unvisited = 1;
+	auto release = [&](size_t i) {
+		for(uint32_t j : local_outgoing[i]) {
+			if(--remaining_incoming[j] == 0 && !visited[j]) { ready.push_back(j); }
+		}
+	};
+	release(0);
+	for(size_t processed = 1; processed < n; processed++) {
+		size_t node_index;
+		if(!ready.empty()) {
+			node_index = ready.back(); ready.pop_back();
+		} else {
+			while(visited[next_unvisited]) { next_unvisited++; }
+			node_index = next_unvisited;
+		}
+		visited[node_index] = true;
+
+		// gather the forefronts coming in that haven't dropped out
+		struct dz_forefront_s const *incoming_forefronts[local_incoming[node_index].size() + 1];
+		size_t n_incoming_forefronts = 0;
+		for(uint32_t k : local_incoming[node_index]) {
+			struct dz_forefront_s const *t = forefronts[k];
+			if(t == nullptr || dz_is_terminated(t)) { continue; }
+			incoming_forefronts[n_incoming_forefronts++] = t;
+		}
+		if(n_incoming_forefronts > 0) {
+			std::string const &ref_seq = local_sequences[node_index];
+			forefronts[node_index] = dz_extend(dz,
+				packed_query,
+				incoming_forefronts, n_incoming_forefronts,
+				ref_seq.c_str(), ref_seq.length(), node_index
+			);
+			if(forefronts[node_index]->max > forefronts[max_index]->max) { max_index = node_index; }
+		}
+		release(node_index);
+	}
+	return(max_index);
+}
+
+void XdropAligner::save_handle_alignment(
+	Alignment &alignment,
+	HandleGraph const &graph,
+	size_t head_offset,
+	size_t head_query_offset,
+	size_t tail_index)
+{
+	// same conversion as the forward case of calculate_and_save_alignment, with local indices for nodes
+	alignment.clear_path();
+	alignment.set_score(forefronts[tail_index]->max);
+	if(forefronts[tail_index]->max == 0) { return; }
+
+	struct dz_alignment_s const *aln = dz_trace(dz, forefronts[tail_index]);
+	if(aln == nullptr || aln->path_length == 0) { return; }
+	assert(aln->span[aln->span_length - 1].id == tail_index);
+	if(head_query_offset + aln->query_length > alignment.sequence().size()) {
+		cerr << "[vg xdrop_aligner.cpp] Error: dozeu alignment query_length longer than sequence" << endl;
+		alignment.set_score(0);
+		return;
+	}
+
+	std::string const &query_seq = alignment.sequence();
+	char const *query = query_seq.c_str();
+	size_t query_offset = 0;
+
+	alignment.set_score(aln->score);
+	alignment.set_identity((double)aln->match_count / (double)query_seq.length());
+	alignment.set_query_position(0);
+
+	Path *path = alignment.mutable_path();
+	Mapping *m = nullptr;
+	uint64_t ref_offset = head_offset, state = head_query_offset<<8;
+	auto push_mapping = [&](uint32_t index) {
+		handle_t h = local_handles[index];
+		Mapping *mapping = path->add_mapping();
+		mapping->set_rank(path->mapping_size());
+		Position *position = mapping->mutable_position();
+		position->set_node_id(graph.get_id(h));
+		position->set_is_reverse(graph.get_is_reverse(h));
+		position->set_offset(ref_offset); ref_offset = 0;
+		return(mapping);
+	};
+	auto push_op = [&](Mapping *mapping, uint8_t op, size_t len) {
+		// a run can come out empty at a node boundary; leave it out rather than writing an empty edit
+		if(len > 0) { query_offset += push_edit(mapping, op, &query[query_offset], len); }
+	};
+
+	// leading soft clip (if any) goes in with the first op, as an insertion
+	state |= state == 0 ? MATCH : INS;
+	for(size_t i = 0, path_offset = aln->span[0].offset; i < aln->span_length; i++) {
+		struct dz_path_span_s const *span = &aln->span[i];
+		for(m = push_mapping(span->id); path_offset < span[1].offset; path_offset++) {
+			uint8_t op = aln->path[path_offset];
+			if((state & 0xff) == op) { state += 0x100; }
+			else { push_op(m, state & 0xff, state>>8); state = op | (1<<8); }
+		}
+		push_op(m, state & 0xff, state>>8); state = aln->path[path_offset];
+	}
+	if(m != nullptr && query_seq.length() != query_offset) {
+		push_op(m, INS, query_seq.length() - query_offset);
+	}
+	return;
+}
+
+void
+XdropAligner::align(
+	Alignment &alignment,
+	HandleGraph const &graph,
+	vector<MaximalExactMatch> const &mems)
+{
+	std::string const &query_seq = alignment.sequence();
+	uint64_t const qlen = query_seq.length();
+	alignment.clear_path();
+	alignment.set_score(0);
+
+	// seed from the longest MEM we have a hit for
+	MaximalExactMatch const *seed = nullptr;
+	for(auto const &mem : mems) {
+		if(mem.nodes.empty() || mem.begin < query_seq.begin() || mem.end > query_seq.end() || mem.begin >= mem.end) { continue; }
+		if(seed == nullptr || mem.length() > seed->length()) { seed = &mem; }
+	}
+	if(seed == nullptr) { return; }
+
+	size_t const capacity_before = local_handles.capacity() + local_sequences.capacity() + forefronts.capacity();
+
+	pos_t seed_pos = make_pos_t(seed->nodes.front());
+	handle_t seed_handle = graph.get_handle(id(seed_pos), is_rev(seed_pos));
+	size_t seed_query_offset = seed->begin - query_seq.begin();
+
+	// extend left from the start of the MEM, on the other strand, to find where the alignment starts
+	handle_t head_handle = seed_handle;
+	size_t head_offset = offset(seed_pos), head_query_offset = seed_query_offset;
+	if(seed_query_offset > 0) {
+		size_t seed_length = graph.get_length(seed_handle);
+		struct dz_query_s const *packed_query_left = dz_pack_query_reverse(dz, &query_seq.c_str()[0], seed_query_offset);
+		size_t left_index = extend_over_handles(graph, graph.flip(seed_handle), seed_length - offset(seed_pos),
+			packed_query_left, seed_query_offset + max_gap_length);
+		if(forefronts[left_index]->max > 0) {
+			uint64_t max_pos = (uint64_t)dz_calc_max_pos(dz, forefronts[left_index]);
+			int32_t rpos = (int32_t)(max_pos>>32), qpos = max_pos & 0xffffffff;
+			// rpos counts the bases left on the flipped node, which are the bases before the head on the node
+			head_handle = graph.flip(local_handles[left_index]);
+			head_offset = rpos;
+			head_query_offset = seed_query_offset - qpos;
+		}
+	}
+
+	// then right from there over the whole rest of the read, keeping the traceback
+	struct dz_query_s const *packed_query_right = dz_pack_query_forward(dz, &query_seq.c_str()[head_query_offset], qlen - head_query_offset);
+	size_t tail_index = extend_over_handles(graph, head_handle, head_offset, packed_query_right,
+		qlen - head_query_offset + max_gap_length);
+	save_handle_alignment(alignment, graph, head_offset, head_query_offset, tail_index);
+	dz_flush(dz);
+
+	if(local_handles.capacity() + local_sequences.capacity() + forefronts.capacity() > capacity_before) {
+		buffer_growths.fetch_add(1, std::memory_order_relaxed);
+	}
+	return;
+}
+
 /**
  * end of xdrop_aligner.cpp
  */
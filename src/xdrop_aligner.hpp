@@ -8,14 +8,17 @@
 #define VG_XDROP_ALIGNER_HPP_INCLUDED
 
 #include <algorithm>
+#include <atomic>
 #include <cstdint>			/* int8_t, ... */
 #include <functional>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include "vg.pb.h"
 #include "types.hpp"
 #include "mem.hpp"
+#include "handle.hpp"
 
 // #define BENCH
 // #include "bench.h"
@@ -35,10 +38,18 @@ namespace vg {
 	private:
 		// context (contains memory arena and constants) and working buffers
 		struct dz_s *dz;
-		std::unordered_map< id_t, uint64_t > id_to_index;			// can be lighter? index in lower 32bit and graph_id -> mem_id mapping (inverse of trans mapping)
+		std::vector< std::pair< id_t, uint32_t > > id_to_index;	// (node_id, index) sorted by node_id; a flat table so that rebuilding it for each read reuses its memory
 		std::vector< uint64_t > index_edges, index_edges_head;		// (int32_t, int32_t) tuple; FIXME: index_edges and index_edges_head are partly duplicated
 		std::vector< struct dz_forefront_s const * > forefronts;
 
+		// working buffers for extending over a handle graph: the nodes the band can reach from the root, in the
+		// order they were found, with their oriented sequences and the local indices of their predecessors
+		uint32_t max_gap_length;
+		std::vector< handle_t > local_handles;
+		std::vector< std::string > local_sequences;
+		std::unordered_map< handle_t, uint32_t > local_index;
+		std::vector< std::vector< uint32_t > > local_incoming, local_outgoing;
+
 		// forward and reverse comparators; [0] for forward and [1] for reverse (FIXME: can we embed them in the vtable?)
 		std::function<bool (uint64_t const &, uint64_t const &)> const compare[2] = {
 			[](uint64_t const &x, uint64_t const &y) -> bool { return((int64_t)x < (int64_t)y); },
@@ -49,8 +60,12 @@ namespace vg {
 			[](uint64_t const &from, uint64_t const &to) -> uint64_t { return((from<<32) | to); }
 		};
 
+		// number of times the working buffers of any aligner had to grow, see working_buffer_growths()
+		static std::atomic<uint64_t> buffer_growths;
+
 		// working buffer init functions
 		void build_id_index_table(Graph const &graph);
+		uint64_t index_of(id_t node_id) const;
 		void build_index_edge_table(Graph const &graph, uint32_t const seed_node_index, bool direction);
 
 		// position handling -> (node_index, ref_offset, query_offset): struct graph_pos_s
@@ -64,6 +79,11 @@ namespace vg {
 		size_t extend(Graph const &graph, vector<uint64_t>::const_iterator begin, vector<uint64_t>::const_iterator end, struct dz_query_s const *packed_query, size_t seed_node_index, uint64_t seed_offset, bool direction);
 		void calculate_and_save_alignment(Alignment &alignment, Graph const &graph, struct graph_pos_s const &head_pos, size_t tail_node_index, bool direction);
 
+		// handle graph extension -> local index of the node with the max score: size_t
+		void collect_local_graph(HandleGraph const &graph, handle_t root, size_t root_offset, size_t max_length);
+		size_t extend_over_handles(HandleGraph const &graph, handle_t root, size_t root_offset, struct dz_query_s const *packed_query, size_t max_length);
+		void save_handle_alignment(Alignment &alignment, HandleGraph const &graph, size_t head_offset, size_t head_query_offset, size_t tail_index);
+
 		// void debug_print(Alignment const &alignment, Graph const &graph, MaximalExactMatch const &seed, bool reverse_complemented);
 		// bench_t bench;
 
@@ -89,6 +109,17 @@ namespace vg {
 
 		// copied from gssw_aligner.hpp
 		void align(Alignment &alignment, Graph const &graph, const vector<MaximalExactMatch> &mems, bool reverse_complemented);
+
+		// seed-and-extend straight over a handle graph (e.g. the xg index), from the longest MEM: extend left from
+		// the MEM to find where the alignment starts, then right from there, fetching only the nodes the band can
+		// reach from where it is. MEM hits must be in the graph's own ID space, and the MEMs must point into the
+		// read's sequence.
+		void align(Alignment &alignment, HandleGraph const &graph, const vector<MaximalExactMatch> &mems);
+
+		// the working buffers (and the DP arena in dz) are reset, not freed, between calls to align(), so once
+		// an aligner has seen its largest graph it stops allocating. this counts the calls, over all aligners,
+		// that had to grow a working buffer, so steady-state allocation can be checked (see vg benchmark).
+		static uint64_t working_buffer_growths(void);
 	};
 } // end of namespace vg
 
@@ -1,9 +1,16 @@
 #include "xg.hpp"
 #include "stream.hpp"
 #include "alignment.hpp"
+#include "mapped_file.hpp"
+#include "graph_stream_validator.hpp"
 
+#include <algorithm>
 #include <bitset>
+#include <cstring>
+#include <exception>
+#include <memory>
 #include <arpa/inet.h>
+#include <sys/mman.h>
 
 //#define VERBOSE_DEBUG
 //#define debug_algorithms
@@ -69,6 +76,24 @@ char revdna3bit(int i) {
     }
 }
 
+// The four bases packed two bits apiece, lowest bits first, in each possible
+// byte of s_iv, and their complements. In the dna3bit() encoding the
+// complement of a base is its code with the low bit flipped.
+struct PackedBaseTables {
+    char forward[256][4];
+    char complement[256][4];
+    PackedBaseTables() {
+        for (size_t b = 0; b < 256; b++) {
+            for (size_t k = 0; k < 4; k++) {
+                int code = (b >> (2 * k)) & 3;
+                forward[b][k] = revdna3bit(code);
+                complement[b][k] = revdna3bit(code ^ 1);
+            }
+        }
+    }
+};
+static const PackedBaseTables packed_base_tables;
+
 const XG::destination_t XG::BS_SEPARATOR = 1;
 const XG::destination_t XG::BS_NULL = 0;
 
@@ -94,6 +119,9 @@ XG::~XG(void) {
 
 void XG::load(istream& in) {
 
+    // Any edge index was for the old graph
+    edge_positions = int_vector<>();
+
     if (!in.good()) {
         throw XGFormatError("Index file does not exist or index stream cannot be read");
     }
@@ -152,6 +180,8 @@ void XG::load(istream& in) {
                  << "or upgrading it with 'vg xg'." << endl;
             // Fall through
         case 10:
+        case 11:
+        case 12:
             {
                 sdsl::read_member(seq_length, in);
                 sdsl::read_member(node_count, in);
@@ -174,10 +204,23 @@ void XG::load(istream& in) {
                 g_bv_rank.load(in, &g_bv);
                 g_bv_select.load(in, &g_bv);
 
-                s_iv.load(in);
+                if (file_version >= 12) {
+                    s_iv.load(in);
+                } else {
+                    // repack the old 3-bit sequence into 2 bits and N exceptions
+                    int_vector<> old_s_iv;
+                    old_s_iv.load(in);
+                    pack_sequence(old_s_iv);
+                }
                 s_bv.load(in);
                 s_bv_rank.load(in, &s_bv);
                 s_bv_select.load(in, &s_bv);
+                if (file_version >= 12) {
+                    sn_bv.load(in);
+                    sn_bv_rank.load(in, &sn_bv);
+                    sn_bv_select.load(in, &sn_bv);
+                    sn_count = sn_bv_rank(sn_bv.size());
+                }
 
                 // Load thread names
                 tn_csa.load(in);
@@ -230,6 +273,14 @@ void XG::load(istream& in) {
                     index_component_path_sets();
                 }
                 
+                if (file_version >= 11) {
+                    // load the nearest path nodes of each node
+                    sdsl::read_member(path_anchor_search_dist, in);
+                    path_anchor_iv.load(in);
+                    path_anchor_dist_iv.load(in);
+                }
+                // Otherwise we do without and search for paths every time
+                
                 h_civ.load(in);
                 ts_civ.load(in);
 
@@ -260,6 +311,24 @@ void XG::load(istream& in) {
 
 }
 
+void XG::load_mapped(const string& filename) {
+    unique_ptr<MappedFile> mapped;
+    try {
+        mapped = unique_ptr<MappedFile>(new MappedFile(filename));
+    } catch (runtime_error& e) {
+        throw XGFormatError(string("Index file cannot be mapped (") + e.what() + ")");
+    }
+    // We read the whole thing front to back, so let the kernel read ahead.
+    mapped->advise(MADV_SEQUENTIAL);
+    
+    MappedFileStreamBuffer buffer(*mapped);
+    istream in(&buffer);
+    load(in);
+    
+    // Nothing will read the mapping again once we have unpacked it.
+    mapped->advise(MADV_DONTNEED);
+}
+
 void XGPath::load(istream& in, uint32_t file_version, const function<int64_t(size_t)>& rank_to_id) {
     if (file_version >= 8) {
         // Min node ID readily available
@@ -508,6 +577,9 @@ size_t XG::serialize(ostream& out, sdsl::structure_tree_node* s, std::string nam
     written += s_bv.serialize(out, child, "seq_node_starts");
     written += s_bv_rank.serialize(out, child, "seq_node_starts_rank");
     written += s_bv_select.serialize(out, child, "seq_node_starts_select");
+    written += sn_bv.serialize(out, child, "seq_n_positions");
+    written += sn_bv_rank.serialize(out, child, "seq_n_positions_rank");
+    written += sn_bv_select.serialize(out, child, "seq_n_positions_select");
 
     // save the thread name index and haplotype database
     written += tn_csa.serialize(out, child, "thread_name_csa");
@@ -551,6 +623,10 @@ size_t XG::serialize(ostream& out, sdsl::structure_tree_node* s, std::string nam
     paths_written += path_ranks_iv.serialize(out, paths_child, "component_path_set_path_ranks");
     paths_written += path_ranks_bv.serialize(out, paths_child, "component_path_set_bit_vector");
     
+    paths_written += sdsl::write_member(path_anchor_search_dist, out, paths_child, "path_anchor_search_dist");
+    paths_written += path_anchor_iv.serialize(out, paths_child, "path_anchors");
+    paths_written += path_anchor_dist_iv.serialize(out, paths_child, "path_anchor_distances");
+    
     sdsl::structure_tree::add_size(paths_child, paths_written);
     written += paths_written;
 
@@ -597,6 +673,8 @@ void XG::from_callback(function<void(function<void(Graph&)>)> get_chunks,
 
     // temporaries for construction
     vector<pair<id_t, string> > node_label;
+    // checks the chunks as they come in, if we are validating
+    GraphStreamValidator validator;
     // need to store node sides
     unordered_map<side_t, vector<side_t> > from_to;
     unordered_map<side_t, vector<side_t> > to_from;
@@ -611,7 +689,13 @@ void XG::from_callback(function<void(function<void(Graph&)>)> get_chunks,
                                      &from_to,
                                      &to_from,
                                      &path_nodes,
-                                     &circular_paths](Graph& graph) {
+                                     &circular_paths,
+                                     &validator,
+                                     validate_graph](Graph& graph) {
+
+        if (validate_graph) {
+            validator.add_chunk(graph);
+        }
 
         for (int64_t i = 0; i < graph.node_size(); ++i) {
             const Node& n = graph.node(i);
@@ -667,6 +751,18 @@ void XG::from_callback(function<void(function<void(Graph&)>)> get_chunks,
     // The other end handles figuring out how much to loop.
     get_chunks(lambda);
 
+    if (validate_graph) {
+        cerr << "validating graph" << endl;
+        vector<string> errors = validator.validate();
+        validator.clear();
+        if (!errors.empty()) {
+            for (auto& error : errors) {
+                cerr << "[xg] error: graph invalid: " << error << endl;
+            }
+            exit(1);
+        }
+    }
+
     // sort the node labels and remove any duplicates
     std::sort(node_label.begin(), node_label.end());
     node_label.erase(std::unique(node_label.begin(), node_label.end()), node_label.end());
@@ -735,7 +831,7 @@ void XG::build(vector<pair<id_t, string> >& node_label,
     
     // set up our compressed representation
     int_vector<> i_iv;
-    util::assign(s_iv, int_vector<>(seq_length, 0, 3));
+    int_vector<> seq_iv(seq_length, 0, 3);
     util::assign(s_bv, bit_vector(seq_length));
     util::assign(i_iv, int_vector<>(node_count));
     util::assign(r_iv, int_vector<>(max_id-min_id+1)); // note possibly discontiguous
@@ -764,82 +860,95 @@ void XG::build(vector<pair<id_t, string> >& node_label,
         const string& l = p.second;
         s_bv[i] = 1; // record node start
         for (auto c : l) {
-            s_iv[i++] = dna3bit(c); // store sequence
+            seq_iv[i++] = dna3bit(c); // store sequence
         }
     }
     // keep only if we need to validate the graph
     if (!validate_graph) node_label.clear();
 
     // to label the paths we'll need to compress and index our vectors
-    util::bit_compress(s_iv);
+    pack_sequence(seq_iv);
+    util::clear(seq_iv);
     util::assign(s_bv_rank, rank_support_v<1>(&s_bv));
     util::assign(s_bv_select, bit_vector::select_1_type(&s_bv));
     
     // now that we've set up our sequence indexes, we can build the locally traversable graph storage
+    // Find each node's edges, and where its record will start in g_iv
+    auto sides_of = [](unordered_map<side_t, vector<side_t> >& sides, side_t side) -> const vector<side_t>* {
+        auto found = sides.find(side);
+        return found == sides.end() ? nullptr : &found->second;
+    };
+    vector<size_t> record_start(node_count + 1);
+    record_start[0] = 0;
+    for (int64_t i = 0; i < node_count; ++i) {
+        int64_t id = i_iv[i];
+        size_t edges = 0;
+        for (auto end : { false, true }) {
+            auto to_sides = sides_of(to_from, make_side(id, end));
+            auto from_sides = sides_of(from_to, make_side(id, end));
+            edges += (to_sides ? to_sides->size() : 0) + (from_sides ? from_sides->size() : 0);
+        }
+        record_start[i + 1] = record_start[i] + G_NODE_HEADER_LENGTH + edges * G_EDGE_LENGTH;
+    }
     // calculate g_iv size
     size_t g_iv_size =
         node_count * G_NODE_HEADER_LENGTH // record headers
         + edge_count * 2 * G_EDGE_LENGTH; // edges (stored twice)
+    assert(record_start[node_count] == g_iv_size);
     util::assign(g_iv, int_vector<>(g_iv_size));
     util::assign(g_bv, bit_vector(g_iv_size));
-    int64_t g = 0; // pointer into g_iv and g_bv
+    // Bits share words, so mark the record starts on one thread
     for (int64_t i = 0; i < node_count; ++i) {
-        Node n = node(i_iv[i]);
-        
-        // now build up the record
-        g_bv[g] = 1; // mark record start for later query
-        g_iv[g++] = n.id(); // save id
-        g_iv[g++] = node_start(n.id());
-        g_iv[g++] = n.sequence().size(); // sequence length
+        g_bv[record_start[i]] = 1; // mark record start for later query
+    }
+    util::assign(g_bv_rank, rank_support_v<1>(&g_bv));
+    util::assign(g_bv_select, bit_vector::select_1_type(&g_bv));
+
+    // Now every record can be written independently, since g_iv has one word
+    // per entry until it is compressed. Since we know where every record
+    // starts, we can write the edges in relative format right away.
+#pragma omp parallel for schedule(dynamic, 1024)
+    for (int64_t i = 0; i < node_count; ++i) {
+        int64_t id = i_iv[i];
+        size_t record = record_start[i];
+        int64_t g = record;
+        auto relative = [&](side_t other) {
+            return record_start[id_to_rank(side_id(other)) - 1] - record;
+        };
+        g_iv[g++] = id; // save id
+        g_iv[g++] = node_start(id);
+        g_iv[g++] = node_length(id); // sequence length
         size_t to_edge_count = 0;
         size_t from_edge_count = 0;
         size_t to_edge_count_idx = g++;
         size_t from_edge_count_idx = g++;
-        // write the edges in id-based format
-        // we will next convert these into relative format
         for (auto end : { false, true }) {
-            auto& to_sides = to_from[make_side(n.id(), end)];
-            for (auto& e : to_sides) {
-                g_iv[g++] = side_id(e);
-                g_iv[g++] = edge_type(side_is_end(e), end);
-                ++to_edge_count;
+            if (auto to_sides = sides_of(to_from, make_side(id, end))) {
+                for (auto& e : *to_sides) {
+                    g_iv[g] = relative(e);
+                    g_iv[g + 1] = edge_type(side_is_end(e), end);
+                    g += G_EDGE_LENGTH;
+                    ++to_edge_count;
+                }
             }
         }
         g_iv[to_edge_count_idx] = to_edge_count;
         for (auto end : { false, true }) {
-            auto& from_sides = from_to[make_side(n.id(), end)];
-            for (auto& e : from_sides) {
-                g_iv[g++] = side_id(e);
-                g_iv[g++] = edge_type(end, side_is_end(e));
-                ++from_edge_count;
+            if (auto from_sides = sides_of(from_to, make_side(id, end))) {
+                for (auto& e : *from_sides) {
+                    g_iv[g] = relative(e);
+                    g_iv[g + 1] = edge_type(end, side_is_end(e));
+                    g += G_EDGE_LENGTH;
+                    ++from_edge_count;
+                }
             }
         }
         g_iv[from_edge_count_idx] = from_edge_count;
     }
-    
-    // set up rank and select supports on g_bv so we can locate nodes in g_iv
-    util::assign(g_bv_rank, rank_support_v<1>(&g_bv));
-    util::assign(g_bv_select, bit_vector::select_1_type(&g_bv));
-    
-    // convert the edges in g_iv to relativistic form
-    for (int64_t i = 0; i < node_count; ++i) {
-        int64_t id = i_iv[i];
-        // find the start of the node's record in g_iv
-        int64_t g = g_bv_select(id_to_rank(id));
-        // get to the edges to
-        int edges_to_count = g_iv[g+G_NODE_TO_COUNT_OFFSET];
-        int edges_from_count = g_iv[g+G_NODE_FROM_COUNT_OFFSET];
-        int64_t t = g + G_NODE_HEADER_LENGTH;
-        int64_t f = g + G_NODE_HEADER_LENGTH + G_EDGE_LENGTH * edges_to_count;
-        for (int64_t j = t; j < f; ) {
-            g_iv[j] = g_bv_select(id_to_rank(g_iv[j])) - g;
-            j += 2;
-        }
-        for (int64_t j = f; j < f + G_EDGE_LENGTH * edges_from_count; ) {
-            g_iv[j] = g_bv_select(id_to_rank(g_iv[j])) - g;
-            j += 2;
-        }
-    }
+    vector<size_t>().swap(record_start);
+    // The edges are all in g_iv now
+    unordered_map<side_t, vector<side_t> >().swap(from_to);
+    unordered_map<side_t, vector<side_t> >().swap(to_from);
     sdsl::util::clear(i_iv);
     util::bit_compress(g_iv);
 
@@ -849,71 +958,8 @@ void XG::build(vector<pair<id_t, string> >& node_label,
     bs_arrays.resize(max_node_rank() * 2);
 #endif
 
-#ifdef VERBOSE_DEBUG
-    cerr << "storing paths" << endl;
-#endif
-    // paths
-    string path_names;
-    size_t path_node_count = 0; // count of node path memberships
-    for (auto& pathpair : path_nodes) {
-        // add path name
-        const string& path_name = pathpair.first;
-        //cerr << path_name << endl;
-        path_names += start_marker + path_name + end_marker;
-        // The path constructor helpfully counts unique path members for us
-        size_t unique_member_count;
-        XGPath* path = new XGPath(path_name, pathpair.second, circular_paths.count(path_name),
-            node_count, *this, &unique_member_count);
-        paths.push_back(path);
-        path_node_count += unique_member_count;
-    }
-
-    // handle path names
-    util::assign(pn_iv, int_vector<>(path_names.size()));
-    util::assign(pn_bv, bit_vector(path_names.size()));
-    // now record path name starts
-    for (size_t i = 0; i < path_names.size(); ++i) {
-        pn_iv[i] = path_names[i];
-        if (path_names[i] == start_marker) {
-            pn_bv[i] = 1; // register name start
-        }
-    }
-    util::assign(pn_bv_rank, rank_support_v<1>(&pn_bv));
-    util::assign(pn_bv_select, bit_vector::select_1_type(&pn_bv));
-    
-    //util::bit_compress(pn_iv);
-    string path_name_file = "@pathnames.iv";
-    store_to_file((const char*)path_names.c_str(), path_name_file);
-    construct(pn_csa, path_name_file, 1);
-
-    // node -> paths
-    util::assign(np_iv, int_vector<>(path_node_count+node_count));
-    util::assign(np_bv, bit_vector(path_node_count+node_count));
-    size_t np_off = 0;
-    for (size_t i = 0; i < node_count; ++i) {
-        np_bv[np_off] = 1;
-        np_iv[np_off] = 0; // null so we can detect entities with no path membership
-        ++np_off;
-        id_t id = rank_to_id(i+1);
-        for (size_t j = 1; j <= paths.size(); ++j) {
-            if (node_occs_in_path(id, j) > 0) {
-                np_iv[np_off++] = j;
-            }
-        }
-    }
-
-    util::bit_compress(np_iv);
-    //cerr << ep_off << " " << path_entities << " " << entity_count << endl;
-    assert(np_off <= path_node_count+node_count);
-    util::assign(np_bv_rank, rank_support_v<1>(&np_bv));
-    util::assign(np_bv_select, bit_vector::select_1_type(&np_bv));
-
-#ifdef VERBOSE_DEBUG
-    cerr << "indexing component path sets" << endl;
-#endif
-    
-    // memoize which paths co-occur on connected components
-    index_component_path_sets();
+    // everything about the paths
+    index_paths(path_nodes, circular_paths, store_threads);
     
     if(store_threads) {
 
@@ -1035,7 +1081,7 @@ void XG::build(vector<pair<id_t, string> >& node_label,
             size_t seq_start = g_iv[g+G_NODE_SEQ_START_OFFSET];
             cerr << id << " ";
             for (int64_t j = seq_start; j < seq_start+sequence_size; ++j) {
-                cerr << revdna3bit(s_iv[j]);
+                cerr << sequence_char(j);
             } cerr << " : ";
             int64_t t = g + G_NODE_HEADER_LENGTH;
             int64_t f = g + G_NODE_HEADER_LENGTH + G_EDGE_LENGTH * edges_to_count;
@@ -1052,7 +1098,7 @@ void XG::build(vector<pair<id_t, string> >& node_label,
         }
         cerr << s_iv << endl;
         for (size_t i = 0; i < s_iv.size(); ++i) {
-            cerr << revdna3bit(s_iv[i]);
+            cerr << sequence_char(i);
         } cerr << endl;
         cerr << s_bv << endl;
         cerr << "paths (" << paths.size() << ")" << endl;
@@ -1087,37 +1133,36 @@ void XG::build(vector<pair<id_t, string> >& node_label,
 
     if (validate_graph) {
         cerr << "validating graph sequence" << endl;
-        int max_id = s_bv_rank(s_bv.size());
-        for (auto& p : node_label) {
-            int64_t id = p.first;
-            const string& l = p.second;
-            //size_t rank = node_rank[id];
+        // Check the nodes on all the threads, and report every one that came out wrong
+        vector<vector<id_t>> bad_nodes(omp_get_max_threads());
+#pragma omp parallel for schedule(dynamic, 1024)
+        for (size_t i = 0; i < node_label.size(); i++) {
+            int64_t id = node_label[i].first;
+            const string& l = node_label[i].second;
             size_t rank = id_to_rank(id);
-            //cerr << rank << endl;
-            // find the node in the array
-            //cerr << "id = " << id << " rank = " << s_bv_select(rank) << endl;
             // this should be true given how we constructed things
-            if (rank != s_bv_rank(s_bv_select(rank)+1)) {
-                cerr << rank << " != " << s_bv_rank(s_bv_select(rank)+1) << " for node " << id << endl;
-                assert(false);
-            }
-            // get the sequence from the s_iv
-            string s = node_sequence(id);
-
-            string ltmp, stmp;
-            if (l.size() != s.size()) {
-                cerr << l << " != " << endl << s << endl << " for node " << id << endl;
-                assert(false);
-            } else {
-                int j = 0;
-                for (auto c : l) {
-                    if (dna3bit(c) != dna3bit(s[j++])) {
-                        cerr << l << " != " << endl << s << endl << " for node " << id << endl;
-                        assert(false);
-                    }
+            bool ok = rank == s_bv_rank(s_bv_select(rank)+1);
+            if (ok) {
+                // get the sequence from the s_iv
+                string s = node_sequence(id);
+                ok = l.size() == s.size();
+                for (size_t j = 0; ok && j < l.size(); j++) {
+                    ok = dna3bit(l[j]) == dna3bit(s[j]);
                 }
             }
+            if (!ok) {
+                bad_nodes[omp_get_thread_num()].push_back(id);
+            }
         }
+        size_t bad_node_count = 0;
+        for (auto& thread_bad_nodes : bad_nodes) {
+            for (auto id : thread_bad_nodes) {
+                cerr << "[xg] error: index has rank " << id_to_rank(id) << " and sequence "
+                     << node_sequence(id) << " for node " << id << endl;
+            }
+            bad_node_count += thread_bad_nodes.size();
+        }
+        assert(bad_node_count == 0);
         node_label.clear();
         
 #if GPBWT_MODE == MODE_SDSL
@@ -1185,6 +1230,177 @@ void XG::build(vector<pair<id_t, string> >& node_label,
     
 }
     
+void XG::index_paths(map<string, vector<trav_t> >& path_nodes,
+                     const unordered_set<string>& circular_paths,
+                     bool store_threads) {
+
+    path_count = path_nodes.size();
+
+#ifdef VERBOSE_DEBUG
+    cerr << "storing paths" << endl;
+#endif
+    // paths
+    string path_names;
+    vector<pair<const string*, vector<trav_t>*>> to_build;
+    for (auto& pathpair : path_nodes) {
+        // add path name
+        const string& path_name = pathpair.first;
+        //cerr << path_name << endl;
+        path_names += start_marker + path_name + end_marker;
+        to_build.emplace_back(&pathpair.first, &pathpair.second);
+    }
+    // Build the paths in parallel. Each path's traversals are dropped once it
+    // is built, unless we need them for threads, so we never hold much more
+    // than the finished paths plus the ones in progress. We keep the sorted
+    // ranks of the nodes each path visits, for the node to path index.
+    size_t first_path = paths.size();
+    paths.resize(first_path + to_build.size());
+    vector<vector<size_t>> path_members(to_build.size());
+#pragma omp parallel for schedule(dynamic, 1)
+    for (size_t j = 0; j < to_build.size(); ++j) {
+        const string& path_name = *to_build[j].first;
+        vector<trav_t>& travs = *to_build[j].second;
+        paths[first_path + j] = new XGPath(path_name, travs, circular_paths.count(path_name),
+            node_count, *this, nullptr);
+        auto& members = path_members[j];
+        members.reserve(travs.size());
+        for (auto& trav : travs) {
+            members.push_back(id_to_rank(trav_id(trav)));
+        }
+        std::sort(members.begin(), members.end());
+        members.erase(std::unique(members.begin(), members.end()), members.end());
+        members.shrink_to_fit();
+        if (!store_threads) {
+            vector<trav_t>().swap(travs);
+        }
+    }
+    size_t path_node_count = 0; // count of node path memberships
+    for (auto& members : path_members) {
+        path_node_count += members.size();
+    }
+
+    // handle path names
+    util::assign(pn_iv, int_vector<>(path_names.size()));
+    util::assign(pn_bv, bit_vector(path_names.size()));
+    // now record path name starts
+    for (size_t i = 0; i < path_names.size(); ++i) {
+        pn_iv[i] = path_names[i];
+        if (path_names[i] == start_marker) {
+            pn_bv[i] = 1; // register name start
+        }
+    }
+    util::assign(pn_bv_rank, rank_support_v<1>(&pn_bv));
+    util::assign(pn_bv_select, bit_vector::select_1_type(&pn_bv));
+    
+    //util::bit_compress(pn_iv);
+    string path_name_file = "@pathnames.iv";
+    store_to_file((const char*)path_names.c_str(), path_name_file);
+    construct(pn_csa, path_name_file, 1);
+
+    // node -> paths
+    // Work out where each node's list of paths goes, from the path members,
+    // instead of asking every path about every node.
+    vector<size_t> np_next(node_count + 1, 0);
+    for (auto& members : path_members) {
+        for (auto rank : members) {
+            ++np_next[rank];
+        }
+    }
+    for (size_t i = 0; i < node_count; ++i) {
+        // Each node's list starts with a null entry
+        np_next[i + 1] += np_next[i] + 1;
+    }
+    util::assign(np_iv, int_vector<>(path_node_count+node_count));
+    util::assign(np_bv, bit_vector(path_node_count+node_count));
+    for (size_t i = 0; i < node_count; ++i) {
+        np_bv[np_next[i]] = 1;
+        np_iv[np_next[i]] = 0; // null so we can detect entities with no path membership
+        ++np_next[i];
+    }
+    // Fill in the paths in order, so each node's list is sorted
+    for (size_t j = 0; j < path_members.size(); ++j) {
+        for (auto rank : path_members[j]) {
+            np_iv[np_next[rank - 1]++] = first_path + j + 1;
+        }
+        vector<size_t>().swap(path_members[j]);
+    }
+    size_t np_off = node_count == 0 ? 0 : np_next[node_count - 1];
+    vector<size_t>().swap(np_next);
+
+    util::bit_compress(np_iv);
+    //cerr << ep_off << " " << path_entities << " " << entity_count << endl;
+    assert(np_off == path_node_count+node_count);
+    util::assign(np_bv_rank, rank_support_v<1>(&np_bv));
+    util::assign(np_bv_select, bit_vector::select_1_type(&np_bv));
+
+#ifdef VERBOSE_DEBUG
+    cerr << "indexing component path sets" << endl;
+#endif
+    
+    // memoize which paths co-occur on connected components
+    index_component_path_sets();
+    
+#ifdef VERBOSE_DEBUG
+    cerr << "indexing path anchors" << endl;
+#endif
+    
+    // memoize the nearest path nodes for the distance oracle
+    index_path_anchors(PATH_ANCHOR_SEARCH_DIST);
+}
+
+void XG::add_paths(const vector<Path>& new_paths) {
+    
+    // The path structures can't be extended in place, so we rebuild them all,
+    // starting from the paths we already have
+    map<string, vector<trav_t> > path_nodes;
+    unordered_set<string> circular_paths;
+    for (size_t rank = 1; rank <= paths.size(); ++rank) {
+        string name = path_name(rank);
+        const XGPath& xgpath = *paths[rank - 1];
+        vector<trav_t>& travs = path_nodes[name];
+        travs.reserve(xgpath.ids.size());
+        for (size_t i = 0; i < xgpath.ids.size(); ++i) {
+            travs.push_back(make_trav(xgpath.node(i), xgpath.is_reverse(i), xgpath.ranks[i]));
+        }
+        if (xgpath.is_circular) {
+            circular_paths.insert(name);
+        }
+    }
+    
+    for (auto& path : new_paths) {
+        if (path_nodes.count(path.name())) {
+            throw runtime_error("XG::add_paths: path " + path.name() + " is already in the index");
+        }
+        vector<trav_t>& travs = path_nodes[path.name()];
+        for (size_t i = 0; i < path.mapping_size(); ++i) {
+            const Mapping& m = path.mapping(i);
+            if (!has_node(m.position().node_id())) {
+                throw runtime_error("XG::add_paths: path " + path.name() + " visits node " +
+                                    to_string(m.position().node_id()) + ", which is not in the index");
+            }
+            // Unranked mappings are in path order
+            travs.push_back(make_trav(m.position().node_id(), m.position().is_reverse(), m.rank() ? m.rank() : i + 1));
+        }
+        std::sort(travs.begin(), travs.end(),
+                  [](const trav_t& m1, const trav_t& m2) { return trav_rank(m1) < trav_rank(m2); });
+        if (std::adjacent_find(travs.begin(), travs.end(), [](const trav_t& m1, const trav_t& m2) {
+                return trav_rank(m1) == trav_rank(m2);
+            }) != travs.end()) {
+            throw runtime_error("XG::add_paths: path " + path.name() + " contains duplicate node ranks");
+        }
+        if (path.is_circular()) {
+            circular_paths.insert(path.name());
+        }
+    }
+    
+    for (auto xgpath : paths) {
+        delete xgpath;
+    }
+    paths.clear();
+    
+    index_paths(path_nodes, circular_paths, false);
+}
+
 void XG::index_component_path_sets() {
     
     // for safety, empty the indexes
@@ -1341,6 +1557,85 @@ void XG::unpack_succinct_component_path_sets(const int_vector<>& path_ranks_iv,
     }
 }
     
+void XG::index_path_anchors(size_t max_search_dist) {
+    
+    path_anchor_search_dist = 0;
+    path_anchor_iv = int_vector<>(2 * node_count, 0);
+    path_anchor_dist_iv = int_vector<>(2 * node_count, 0);
+    
+    // nothing to anchor to if no component has a path on it
+    bool have_paths = false;
+    for (const unordered_set<size_t>& component_path_set : component_path_sets) {
+        have_paths = have_paths || !component_path_set.empty();
+    }
+    
+    if (have_paths && max_search_dist > 0) {
+        // the anchors of each node side are independent, and we only write to our own
+        // 64-bit entries before compressing
+#pragma omp parallel for schedule(dynamic, 1024)
+        for (size_t i = 0; i < 2 * node_count; i++) {
+            handle_t start = get_handle(rank_to_id(i / 2 + 1), false);
+            bool search_left = i % 2;
+            
+            // traversals (as integers) ordered by the amount of sequence before them
+            priority_queue<pair<int64_t, int64_t>, vector<pair<int64_t, int64_t>>, std::greater<pair<int64_t, int64_t>>> queue;
+            unordered_set<handle_t> queued{start};
+            
+            follow_edges(start, search_left, [&](const handle_t& next) {
+                if (!queued.count(next)) {
+                    queued.insert(next);
+                    queue.emplace(0, as_integer(next));
+                }
+                return true;
+            });
+            
+            while (!queue.empty()) {
+                int64_t dist = queue.top().first;
+                handle_t trav = as_handle(queue.top().second);
+                queue.pop();
+                
+                if (!paths_of_node(get_id(trav)).empty()) {
+                    path_anchor_iv[i] = 2 * id_to_rank(get_id(trav)) + get_is_reverse(trav);
+                    path_anchor_dist_iv[i] = dist;
+                    break;
+                }
+                
+                int64_t next_dist = dist + get_length(trav);
+                if (next_dist > (int64_t) max_search_dist) {
+                    continue;
+                }
+                follow_edges(trav, search_left, [&](const handle_t& next) {
+                    if (!queued.count(next)) {
+                        queued.insert(next);
+                        queue.emplace(next_dist, as_integer(next));
+                    }
+                    return true;
+                });
+            }
+        }
+        path_anchor_search_dist = max_search_dist;
+    }
+    
+    util::bit_compress(path_anchor_iv);
+    util::bit_compress(path_anchor_dist_iv);
+}
+
+bool XG::path_anchor(int64_t id, bool is_rev, bool search_left, handle_t& anchor_out, int64_t& dist_out) const {
+    if (path_anchor_search_dist == 0) {
+        return false;
+    }
+    // leaving the reverse strand on one side is leaving the forward strand on the other
+    size_t i = 2 * (id_to_rank(id) - 1) + (search_left != is_rev);
+    size_t anchor = path_anchor_iv[i];
+    if (anchor == 0) {
+        return false;
+    }
+    // and reaches the anchor on its other strand
+    anchor_out = get_handle(rank_to_id(anchor / 2), (anchor % 2) != is_rev);
+    dist_out = path_anchor_dist_iv[i];
+    return true;
+}
+
 bool XG::paths_on_same_component(size_t path_rank_1, size_t path_rank_2) const {
     return component_path_sets[component_path_set_of_path[path_rank_1]].count(path_rank_2);
 }
@@ -1374,9 +1669,7 @@ string XG::node_sequence(int64_t id) const {
     size_t start = s_bv_select(rank);
     size_t end = rank == node_count ? s_bv.size() : s_bv_select(rank+1);
     string s; s.resize(end-start);
-    for (size_t i = start; i < s_bv.size() && i < end; ++i) {
-        s[i-start] = revdna3bit(s_iv[i]);
-    }
+    decode_sequence(start, end-start, false, &s[0]);
     return s;
 }
 
@@ -1393,18 +1686,26 @@ char XG::pos_char(int64_t id, bool is_rev, size_t off) const {
         size_t rank = id_to_rank(id);
         size_t pos = s_bv_select(rank) + off;
         assert(pos < s_iv.size());
-        char c = revdna3bit(s_iv[pos]);
+        char c = sequence_char(pos);
         return c;
     } else {
         size_t rank = id_to_rank(id);
         size_t pos = s_bv_select(rank+1) - (off+1);
         assert(pos < s_iv.size());
-        char c = revdna3bit(s_iv[pos]);
+        char c = sequence_char(pos);
         return reverse_complement(c);
     }
 }
 
 string XG::pos_substr(int64_t id, bool is_rev, size_t off, size_t len) const {
+    // we never get more than the node
+    size_t max_len = node_length(id);
+    string s; s.resize(len ? min(len, max_len) : max_len);
+    s.resize(pos_substr_into(id, is_rev, off, len, &s[0]));
+    return s;
+}
+
+size_t XG::pos_substr_into(int64_t id, bool is_rev, size_t off, size_t len, char* dest) const {
     if (!is_rev) {
         size_t rank = id_to_rank(id);
         size_t start = s_bv_select(rank) + off;
@@ -1417,11 +1718,8 @@ string XG::pos_substr(int64_t id, bool is_rev, size_t off, size_t len) const {
             end = min(start + len, (size_t)s_bv_select(rank+1));
         }
         assert(end < s_iv.size());
-        string s; s.resize(end-start);
-        for (size_t i = start; i < s_bv.size() && i < end; ++i) {
-            s[i-start] = revdna3bit(s_iv[i]);
-        }
-        return s;
+        decode_sequence(start, end-start, false, dest);
+        return end-start;
     } else {
         size_t rank = id_to_rank(id);
         size_t end = s_bv_select(rank+1) - off;
@@ -1434,11 +1732,61 @@ string XG::pos_substr(int64_t id, bool is_rev, size_t off, size_t len) const {
             start = max(end - len, (size_t)s_bv_select(rank));
         }
         assert(end < s_iv.size());
-        string s; s.resize(end-start);
-        for (size_t i = start; i < s_bv.size() && i < end; ++i) {
-            s[i-start] = revdna3bit(s_iv[i]);
+        decode_sequence(start, end-start, true, dest);
+        return end-start;
+    }
+}
+
+void XG::pack_sequence(const int_vector<>& sequence) {
+    util::assign(s_iv, int_vector<2>(sequence.size(), 0));
+    bit_vector n_bv(sequence.size(), 0);
+    for (size_t i = 0; i < sequence.size(); i++) {
+        if (sequence[i] > 3) {
+            // an N, or something else we can't represent
+            n_bv[i] = 1;
+        } else {
+            s_iv[i] = sequence[i];
         }
-        return reverse_complement(s);
+    }
+    util::assign(sn_bv, sd_vector<>(n_bv));
+    util::assign(sn_bv_rank, sd_vector<>::rank_1_type(&sn_bv));
+    util::assign(sn_bv_select, sd_vector<>::select_1_type(&sn_bv));
+    sn_count = sn_bv_rank(sn_bv.size());
+}
+
+char XG::sequence_char(size_t i) const {
+    return (sn_count && sn_bv[i]) ? 'N' : revdna3bit(s_iv[i]);
+}
+
+void XG::decode_sequence(size_t start, size_t length, bool reverse_complemented, char* dest) const {
+    const char (*table)[4] = reverse_complemented ? packed_base_tables.complement : packed_base_tables.forward;
+    size_t i = 0;
+    // whole 64-bit words first, 32 bases at a time, looking up a byte of 4 bases at once
+    for (; i + 32 <= length; i += 32) {
+        uint64_t word = s_iv.get_int(2 * (start + i), 64);
+        for (size_t k = 0; k < 8; k++) {
+            memcpy(dest + i + 4 * k, table[(word >> (8 * k)) & 0xFF], 4);
+        }
+    }
+    // then the stragglers, whose codes are also the bytes holding them alone
+    for (; i < length; i++) {
+        dest[i] = table[s_iv[start + i]][0];
+    }
+    
+    if (sn_count) {
+        // put back the Ns
+        for (size_t j = sn_bv_rank(start) + 1; j <= sn_count; j++) {
+            size_t pos = sn_bv_select(j);
+            if (pos >= start + length) {
+                break;
+            }
+            dest[pos - start] = 'N';
+        }
+    }
+    
+    if (reverse_complemented) {
+        // the bases are already complemented in place, so just flip them around
+        std::reverse(dest, dest + length);
     }
 }
 
@@ -1533,10 +1881,7 @@ Graph XG::node_subgraph_g(int64_t g) const {
     int sequence_size = g_iv[g+G_NODE_LENGTH_OFFSET];
     size_t seq_start = g_iv[g+G_NODE_SEQ_START_OFFSET];
     string sequence; sequence.resize(sequence_size);
-    int i = 0;
-    for (int64_t j = seq_start; j < seq_start+sequence_size; ++j, ++i) {
-        sequence[i] = revdna3bit(s_iv[j]);
-    }
+    decode_sequence(seq_start, sequence_size, false, &sequence[0]);
     Node* node = graph.add_node();
     node->set_sequence(sequence);
     node->set_id(g);
@@ -1655,20 +2000,17 @@ string XG::get_sequence(const handle_t& handle) const {
     size_t sequence_size = get_length(handle);
     // Allocate the sequence string
     string sequence(sequence_size, '\0');
+    get_sequence_into(handle, &sequence[0]);
+    return sequence;
+}
+
+void XG::get_sequence_into(const handle_t& handle, char* dest) const {
     // Extract the node record start
     size_t g = as_integer(handle) & LOW_BITS;
     // Figure out where the sequence starts
     size_t sequence_start = g_iv[g + G_NODE_SEQ_START_OFFSET];
-    for (int64_t i = 0; i < sequence_size; i++) {
-        // Blit the sequence out
-        sequence[i] = revdna3bit(s_iv[sequence_start + i]);
-    }
-    
-    if (as_integer(handle) & HIGH_BIT) {
-        return reverse_complement(sequence);
-    } else {
-        return sequence;
-    }
+    // Blit the sequence out, reverse complementing as we go if necessary
+    decode_sequence(sequence_start, g_iv[g + G_NODE_LENGTH_OFFSET], as_integer(handle) & HIGH_BIT, dest);
 }
 
 bool XG::edge_filter(int type, bool is_to, bool want_left, bool is_reverse) const {
@@ -1814,6 +2156,86 @@ size_t XG::node_size() const {
     return this->node_count;
 }
 
+vector<size_t> XG::g_order(const vector<handle_t>& handles) const {
+    vector<size_t> order(handles.size());
+    for (size_t i = 0; i < order.size(); i++) {
+        order[i] = i;
+    }
+    // Sort by g vector position, ignoring orientation
+    sort(order.begin(), order.end(), [&](const size_t& a, const size_t& b) {
+        return (as_integer(handles[a]) & LOW_BITS) < (as_integer(handles[b]) & LOW_BITS);
+    });
+    return order;
+}
+
+void XG::get_lengths(const vector<handle_t>& handles, vector<size_t>& lengths_out) const {
+    lengths_out.resize(handles.size());
+    for (size_t i : g_order(handles)) {
+        lengths_out[i] = g_iv[(as_integer(handles[i]) & LOW_BITS) + G_NODE_LENGTH_OFFSET];
+    }
+}
+
+void XG::get_sequences(const vector<handle_t>& handles, string& sequences_out,
+                       vector<size_t>& offsets_out) const {
+    
+    vector<size_t> order = g_order(handles);
+    
+    // Lay out the output in input order. We store each length in the slot
+    // after its handle and then prefix sum.
+    offsets_out.resize(handles.size() + 1);
+    offsets_out[0] = 0;
+    for (size_t i : order) {
+        offsets_out[i + 1] = g_iv[(as_integer(handles[i]) & LOW_BITS) + G_NODE_LENGTH_OFFSET];
+    }
+    for (size_t i = 0; i < handles.size(); i++) {
+        offsets_out[i + 1] += offsets_out[i];
+    }
+    
+    sequences_out.resize(offsets_out.back());
+    
+    for (size_t i : order) {
+        size_t g = as_integer(handles[i]) & LOW_BITS;
+        size_t sequence_start = g_iv[g + G_NODE_SEQ_START_OFFSET];
+        size_t sequence_size = offsets_out[i + 1] - offsets_out[i];
+        // Blit the sequence or its reverse complement out directly
+        decode_sequence(sequence_start, sequence_size, as_integer(handles[i]) & HIGH_BIT,
+                        &sequences_out[offsets_out[i]]);
+    }
+}
+
+void XG::follow_edges(const vector<handle_t>& handles, bool go_left, vector<handle_t>& neighbors_out,
+                      vector<size_t>& offsets_out) const {
+    
+    vector<size_t> order = g_order(handles);
+    
+    offsets_out.resize(handles.size() + 1);
+    offsets_out[0] = 0;
+    
+    // We don't know how many edges pass the filter until we look, so first
+    // count, then prefix sum, then fill.
+    for (size_t i : order) {
+        size_t count = 0;
+        follow_edges(handles[i], go_left, [&](const handle_t& next) {
+            count++;
+            return true;
+        });
+        offsets_out[i + 1] = count;
+    }
+    for (size_t i = 0; i < handles.size(); i++) {
+        offsets_out[i + 1] += offsets_out[i];
+    }
+    
+    neighbors_out.resize(offsets_out.back());
+    
+    for (size_t i : order) {
+        size_t next_slot = offsets_out[i];
+        follow_edges(handles[i], go_left, [&](const handle_t& next) {
+            neighbors_out[next_slot++] = next;
+            return true;
+        });
+    }
+}
+
 vector<Edge> XG::edges_of(int64_t id) const {
     size_t g = g_bv_select(id_to_rank(id));
     int edges_to_count = g_iv[g+G_NODE_TO_COUNT_OFFSET];
@@ -1921,29 +2343,84 @@ size_t XG::max_path_rank(void) const {
     return pn_bv.size() ? pn_bv_rank(pn_bv.size()) : 0;
 }
 
-// snoop through the forward table to check if the edge exists
 bool XG::has_edge(int64_t id1, bool from_start, int64_t id2, bool to_end) const {
-    Edge query;
-    query.set_from(id1);
-    query.set_from_start(from_start);
-    query.set_to(id2);
-    query.set_to_end(to_end);
-    query = canonicalize(query);
-    Graph node_graph = node_subgraph_id(id1);
-    for (auto& edge : node_graph.edge()) {
-        if (edge.from() == query.from()
-            && edge.from_start() == query.from_start()
-            && edge.to() == query.to()
-            && edge.to_end() == query.to_end()) {
+    return has_edge(get_handle(id1, from_start), get_handle(id2, to_end));
+}
+
+bool XG::has_edge(const Edge& edge) const {
+    auto fixed = canonicalize(edge);
+    return has_edge(fixed.from(), fixed.from_start(), fixed.to(), fixed.to_end());
+}
+
+bool XG::has_edge(const handle_t& left, const handle_t& right) const {
+    if (!edge_positions.empty()) {
+        // The edge is stored in one of its two articulations
+        return has_indexed_edge(left, right) || has_indexed_edge(flip(right), flip(left));
+    }
+    // Snoop through the edges off the left handle's side
+    bool found = false;
+    follow_edges(left, false, [&](const handle_t& next) {
+        found = (next == right);
+        return !found;
+    });
+    return found;
+}
+
+pair<handle_t, handle_t> XG::edge_from_handles(size_t g, size_t edge_position) const {
+    int64_t offset = g_iv[edge_position + G_EDGE_OFFSET_OFFSET];
+    int type = g_iv[edge_position + G_EDGE_TYPE_OFFSET];
+    // Types 3 and 4 leave from the start, and types 2 and 4 arrive at the end
+    handle_t from = as_handle(g | (type == 3 || type == 4 ? HIGH_BIT : 0));
+    handle_t to = as_handle((g + offset) | (type == 2 || type == 4 ? HIGH_BIT : 0));
+    return make_pair(from, to);
+}
+
+bool XG::has_indexed_edge(const handle_t& from, const handle_t& to) const {
+    // Only the from node's edges_from list can hold the edge this way around
+    size_t g = as_integer(from) & LOW_BITS;
+    size_t from_start = g + G_NODE_HEADER_LENGTH + G_EDGE_LENGTH * g_iv[g + G_NODE_TO_COUNT_OFFSET];
+    size_t from_end = from_start + G_EDGE_LENGTH * g_iv[g + G_NODE_FROM_COUNT_OFFSET];
+    
+    auto wanted = make_pair(from, to);
+    size_t mask = edge_positions.size() - 1;
+    for (size_t slot = wang_hash<pair<handle_t, handle_t>>()(wanted) & mask; edge_positions[slot] != 0; slot = (slot + 1) & mask) {
+        size_t edge_position = edge_positions[slot] - 1;
+        if (edge_position >= from_start && edge_position < from_end && edge_from_handles(g, edge_position) == wanted) {
             return true;
         }
     }
     return false;
 }
 
-bool XG::has_edge(const Edge& edge) const {
-    auto fixed = canonicalize(edge);
-    return has_edge(fixed.from(), fixed.from_start(), fixed.to(), fixed.to_end());
+void XG::index_edges() {
+    // Every edge is in the edges_from list of exactly one node
+    size_t edges_from_total = 0;
+    for (size_t rank = 1; rank <= node_count; rank++) {
+        edges_from_total += g_iv[g_bv_select(rank) + G_NODE_FROM_COUNT_OFFSET];
+    }
+    
+    // Leave at least a quarter of the slots empty, so probes stay short
+    size_t capacity = 1;
+    while (capacity - capacity / 4 <= edges_from_total) {
+        capacity <<= 1;
+    }
+    int_vector<> positions(capacity, 0, bits::hi(g_iv.size() + 1) + 1);
+    size_t mask = capacity - 1;
+    
+    for (size_t rank = 1; rank <= node_count; rank++) {
+        size_t g = g_bv_select(rank);
+        size_t from_start = g + G_NODE_HEADER_LENGTH + G_EDGE_LENGTH * g_iv[g + G_NODE_TO_COUNT_OFFSET];
+        size_t from_end = from_start + G_EDGE_LENGTH * g_iv[g + G_NODE_FROM_COUNT_OFFSET];
+        for (size_t edge_position = from_start; edge_position < from_end; edge_position += G_EDGE_LENGTH) {
+            size_t slot = wang_hash<pair<handle_t, handle_t>>()(edge_from_handles(g, edge_position)) & mask;
+            while (positions[slot] != 0) {
+                slot = (slot + 1) & mask;
+            }
+            positions[slot] = edge_position + 1;
+        }
+    }
+    
+    edge_positions = std::move(positions);
 }
 
 size_t XG::node_graph_idx(int64_t id) const {
@@ -2459,38 +2936,243 @@ void XG::add_paths_to_graph(map<int64_t, Node*>& nodes, Graph& g) const {
     }
 }
 
-void XG::get_id_range(int64_t id1, int64_t id2, Graph& g) const {
+void XG::get_id_range(int64_t id1, int64_t id2, Graph& g) const {
+    id1 = max(min_id, id1);
+    id2 = min(max_id, id2);
+    for (auto i = id1; i <= id2; ++i) {
+        if(id_to_rank(i) != 0) { 
+            // We actually have a node with that ID.
+            *g.add_node() = node(i);
+        }
+    }
+}
+
+// walk forward in id space, collecting nodes, until at least length bases covered
+// (or end of graph reached).  if forward is false, do go backward
+void XG::get_id_range_by_length(int64_t id, int64_t length, Graph& g, bool forward) const {
+    // find out first base of node's position in the sequence vector
+    size_t rank = id_to_rank(id);
+    size_t start = s_bv_select(rank);
+    size_t end;
+    // jump by length, checking to make sure we stay in bounds
+    if (forward) {
+        end = s_bv_rank(min(s_bv.size() - 1, start + node_length(id) + length));
+    } else {
+        end = s_bv_rank(1 + max((int64_t)0, (int64_t)(start  - length)));
+    }
+    // convert back to id
+    int64_t id2 = rank_to_id(end);
+
+    // get the id range
+    if (!forward) {
+        swap(id, id2);
+    }
+    get_id_range(id, id2, g);
+}
+
+void XG::neighborhood(int64_t id, size_t dist, SubHandleGraph& g, bool use_steps) const {
+    g.add_node(get_handle(id, false));
+    expand_context(g, dist, use_steps);
+}
+
+void XG::expand_context(SubHandleGraph& g, size_t dist, bool use_steps,
+                        bool expand_forward, bool expand_backward,
+                        int64_t until_node) const {
+    if (use_steps) {
+        expand_context_by_steps(g, dist, expand_forward, expand_backward, until_node);
+    } else {
+        expand_context_by_length(g, dist, expand_forward, expand_backward, until_node);
+    }
+}
+
+void XG::for_each_expansion_edge(int64_t id, bool expand_forward, bool expand_backward,
+                                 const function<void(const handle_t&, const handle_t&)>& lambda) const {
+    if (expand_forward && expand_backward) {
+        // Both sides of the node, straight from the edge records
+        handle_t handle = get_handle(id, false);
+        follow_edges(handle, false, [&](const handle_t& next) {
+            lambda(handle, next);
+            return true;
+        });
+        follow_edges(handle, true, [&](const handle_t& prev) {
+            lambda(prev, handle);
+            return true;
+        });
+    } else if (expand_forward || expand_backward) {
+        // Only the edges stored in one direction, as the Graph version does
+        for (auto& edge : expand_forward ? edges_from(id) : edges_to(id)) {
+            lambda(get_handle(edge.from(), edge.from_start()), get_handle(edge.to(), edge.to_end()));
+        }
+    } else {
+        cerr << "[xg] error: Requested neither forward no backward context expansion" << endl;
+        exit(1);
+    }
+}
+
+void XG::expand_context_by_steps(SubHandleGraph& g, size_t steps,
+                                 bool expand_forward, bool expand_backward,
+                                 int64_t until_node) const {
+    // nodes whose edges have been followed, or that we started with
+    unordered_set<int64_t> expanded;
+    vector<int64_t> to_visit;
+    g.for_each_handle([&](const handle_t& handle) {
+        expanded.insert(get_id(handle));
+        to_visit.push_back(get_id(handle));
+    });
+    // and expand
+    for (size_t i = 0; i < steps; ++i) {
+        vector<int64_t> to_visit_next;
+        for (auto id : to_visit) {
+            expanded.insert(id);
+            for_each_expansion_edge(id, expand_forward, expand_backward, [&](const handle_t& left, const handle_t& right) {
+                g.add_edge(left, right);
+                to_visit_next.push_back(get_id(left) == id ? get_id(right) : get_id(left));
+            });
+            if (until_node != 0 && g.has_node(until_node)) {
+                break;
+            }
+        }
+        sort(to_visit_next.begin(), to_visit_next.end());
+        to_visit_next.erase(unique(to_visit_next.begin(), to_visit_next.end()), to_visit_next.end());
+        to_visit = move(to_visit_next);
+    }
+    // The nodes reached on the last step came in with their edges, but we
+    // still need the edges between them to have a useful subgraph.
+    unordered_set<int64_t> last_step_nodes;
+    g.for_each_handle([&](const handle_t& handle) {
+        if (!expanded.count(get_id(handle))) {
+            last_step_nodes.insert(get_id(handle));
+        }
+    });
+    for (auto& n : last_step_nodes) {
+        follow_edges(get_handle(n, false), false, [&](const handle_t& next) {
+            if (last_step_nodes.count(get_id(next))) {
+                g.add_edge(get_handle(n, false), next);
+            }
+            return true;
+        });
+        follow_edges(get_handle(n, false), true, [&](const handle_t& prev) {
+            if (last_step_nodes.count(get_id(prev))) {
+                g.add_edge(prev, get_handle(n, false));
+            }
+            return true;
+        });
+    }
+}
+
+void XG::expand_context_by_length(SubHandleGraph& g, size_t length,
+                                  bool expand_forward, bool expand_backward,
+                                  int64_t until_node) const {
+
+    // map node_id --> min-distance-to-left-side, min-distance-to-right-side
+    // these distances include the length of the node in the table.
+    unordered_map<int64_t, pair<int64_t, int64_t> > node_table;
+    queue<int64_t> to_visit;
+
+    // add starting graph with distance 0
+    g.for_each_handle([&](const handle_t& handle) {
+        node_table[get_id(handle)] = pair<int64_t, int64_t>(0, 0);
+        to_visit.push(get_id(handle));
+    });
+
+    // expand outward breadth-first
+    while (!to_visit.empty() && (until_node == 0 || !g.has_node(until_node))) {
+        int64_t id = to_visit.front();
+        to_visit.pop();
+        pair<int64_t, int64_t> dists = node_table[id];
+        if (dists.first < length || dists.second < length) {
+            // update distance table with other end of edge
+            auto lambda = [&](int64_t other, bool from_start, bool to_end) {
+                int64_t dist = !from_start ? dists.first : dists.second;
+                if (dist < length) {
+                    handle_t other_handle = get_handle(other, false);
+                    int64_t other_dist = dist + get_length(other_handle);
+                    auto it = node_table.find(other);
+                    bool updated = false;
+                    if (it == node_table.end()) {
+                        auto entry = make_pair(numeric_limits<int64_t>::max(),
+                                               numeric_limits<int64_t>::max());
+                        it = node_table.insert(make_pair(other, entry)).first;
+                        updated = true;
+                    }
+                    if (!to_end && other_dist < it->second.first) {
+                        updated = true;
+                        it->second.first = other_dist;
+                    } else if (to_end && other_dist < it->second.second) {
+                        updated = true;
+                        it->second.second = other_dist;
+                    }
+                    if (!g.has_node(other)) {
+                        g.add_node(other_handle);
+                    }
+                    // create all links back to graph, so as not to break paths
+                    follow_edges(other_handle, false, [&](const handle_t& next) {
+                        if (g.has_node(get_id(next))) {
+                            g.add_edge(other_handle, next);
+                        }
+                        return true;
+                    });
+                    follow_edges(other_handle, true, [&](const handle_t& prev) {
+                        if (g.has_node(get_id(prev))) {
+                            g.add_edge(prev, other_handle);
+                        }
+                        return true;
+                    });
+                    // revisit the other node
+                    if (updated) {
+                        to_visit.push(other);
+                    }
+                }
+            };
+            for_each_expansion_edge(id, expand_forward, expand_backward, [&](const handle_t& left, const handle_t& right) {
+                // we can actually do two updates if we have a self loop, hence no else below
+                if (get_id(left) == id) {
+                    lambda(get_id(right), get_is_reverse(left), get_is_reverse(right));
+                }
+                if (get_id(right) == id) {
+                    lambda(get_id(left), !get_is_reverse(right), !get_is_reverse(left));
+                }
+            });
+        }
+    }
+}
+
+void XG::get_id_range(int64_t id1, int64_t id2, SubHandleGraph& g) const {
     id1 = max(min_id, id1);
     id2 = min(max_id, id2);
     for (auto i = id1; i <= id2; ++i) {
-        if(id_to_rank(i) != 0) { 
-            // We actually have a node with that ID.
-            *g.add_node() = node(i);
+        if(id_to_rank(i) != 0) {
+            g.add_node(get_handle(i, false));
         }
     }
 }
 
-// walk forward in id space, collecting nodes, until at least length bases covered
-// (or end of graph reached).  if forward is false, do go backward
-void XG::get_id_range_by_length(int64_t id, int64_t length, Graph& g, bool forward) const {
-    // find out first base of node's position in the sequence vector
-    size_t rank = id_to_rank(id);
-    size_t start = s_bv_select(rank);
-    size_t end;
-    // jump by length, checking to make sure we stay in bounds
-    if (forward) {
-        end = s_bv_rank(min(s_bv.size() - 1, start + node_length(id) + length));
-    } else {
-        end = s_bv_rank(1 + max((int64_t)0, (int64_t)(start  - length)));
-    }
-    // convert back to id
-    int64_t id2 = rank_to_id(end);
-
-    // get the id range
-    if (!forward) {
-        swap(id, id2);
+void XG::graph_context(const pos_t& pos, int64_t length, SubHandleGraph& g) const {
+    unordered_set<handle_t> seen;
+    vector<handle_t> nexts{get_handle(id(pos), is_rev(pos))};
+    int64_t distance = -offset(pos); // don't count what we won't traverse
+    while (!nexts.empty()) {
+        vector<handle_t> todo;
+        int64_t nextd = 0;
+        for (auto& next : nexts) {
+            if (seen.insert(next).second) {
+                g.add_node(next);
+                int64_t next_length = get_length(next);
+                nextd = nextd == 0 ? next_length : min(nextd, next_length);
+                // where to next
+                follow_edges(next, false, [&](const handle_t& n) {
+                    g.add_edge(next, n);
+                    todo.push_back(n);
+                    return true;
+                });
+            }
+        }
+        distance += nextd;
+        if (distance > length) {
+            break;
+        }
+        nexts = move(todo);
     }
-    get_id_range(id, id2, g);
 }
 
 size_t XG::path_length(const string& name) const {
@@ -2952,6 +3634,71 @@ int64_t XG::closest_shared_path_oriented_distance(int64_t id1, size_t offset1, b
         }
     };
     
+    // before searching, try the nearest path nodes to either side of the positions from the path anchor index
+    if (shared_path_strands.empty() && max_search_dist > 0 && path_anchor_search_dist > 0) {
+        auto anchor_strand_dists_1 = path_strand_dists_1;
+        auto anchor_strand_dists_2 = path_strand_dists_2;
+        
+        // add the path strands of the anchors of a position, nearer side first, with the oriented distances
+        // that the search would have recorded for them
+        auto add_anchors = [&](int64_t id, size_t offset, bool rev,
+                               unordered_map<pair<size_t, bool>, tuple<int64_t, bool, int64_t>>& strand_dists) {
+            // (distance searched, anchor, oriented distance)
+            vector<tuple<int64_t, handle_t, int64_t>> anchors;
+            handle_t anchor;
+            int64_t between;
+            if (path_anchor(id, rev, true, anchor, between)) {
+                int64_t dist = (int64_t) offset + between;
+                anchors.emplace_back(dist, anchor, -(dist + (int64_t) get_length(anchor)));
+            }
+            if (path_anchor(id, rev, false, anchor, between)) {
+                int64_t dist = (int64_t) get_length(memoized_get_handle(id, rev, handle_memo)) - (int64_t) offset + between;
+                anchors.emplace_back(dist, anchor, dist);
+            }
+            if (anchors.size() == 2 && get<0>(anchors[1]) < get<0>(anchors[0])) {
+                std::swap(anchors[0], anchors[1]);
+            }
+            for (auto& anchor_record : anchors) {
+                if (get<0>(anchor_record) > (int64_t) max_search_dist) {
+                    continue;
+                }
+                int64_t anchor_id = get_id(get<1>(anchor_record));
+                bool anchor_is_rev = get_is_reverse(get<1>(anchor_record));
+                for (pair<size_t, vector<pair<size_t, bool>>>& oriented_occurrences : memoized_oriented_paths_of_node(anchor_id, paths_of_node_memo, oriented_occurrences_memo)) {
+                    for (const pair<size_t, bool>& occurrence : oriented_occurrences.second) {
+                        pair<size_t, bool> path_orientation(oriented_occurrences.first, occurrence.second != anchor_is_rev);
+                        if (!strand_dists.count(path_orientation)) {
+                            strand_dists[path_orientation] = make_tuple(anchor_id, anchor_is_rev, get<2>(anchor_record));
+                        }
+                    }
+                }
+            }
+        };
+        add_anchors(id1, offset1, rev1, anchor_strand_dists_1);
+        add_anchors(id2, offset2, rev2, anchor_strand_dists_2);
+        
+        for (auto& strand_dist : anchor_strand_dists_2) {
+            if (anchor_strand_dists_1.count(strand_dist.first)) {
+                shared_path_strands.insert(strand_dist.first);
+            }
+        }
+        
+        if (!shared_path_strands.empty()) {
+#ifdef debug_algorithms
+            cerr << "[XG] found " << shared_path_strands.size() << " shared paths from the path anchors" << endl;
+#endif
+            path_strand_dists_1 = std::move(anchor_strand_dists_1);
+            path_strand_dists_2 = std::move(anchor_strand_dists_2);
+        }
+        else if (!anchor_strand_dists_1.empty() && !anchor_strand_dists_2.empty() &&
+                 !paths_on_same_component(anchor_strand_dists_1.begin()->first.first,
+                                          anchor_strand_dists_2.begin()->first.first)) {
+            // the positions are on separate components
+            return numeric_limits<int64_t>::max();
+        }
+        // otherwise fall back on the search
+    }
+    
     // if we already found shared paths on the start nodes, don't search anymore
     if (shared_path_strands.empty() && max_search_dist > 0) {
 #ifdef debug_algorithms
@@ -4203,11 +4950,12 @@ void XG::insert_threads_into_dag(const vector<thread_t>& t, const vector<string>
         
     };
 
-    // We want to go through and insert running forward through the DAG, and
-    // then again backward through the DAG.
-    auto insert_in_direction = [&](bool insert_reverse) {
+    // Before we can go through the DAG, we have to sort out the thread
+    // numbers by the node they start at, in each direction. This has to
+    // happen forward and then backward, in order, because it numbers the
+    // thread orientations.
+    auto start_in_direction = [&](bool insert_reverse) {
 
-        // First sort out the thread numbers by the node they start at.
         // We know all the threads go the same direction through each node.
         map<int64_t, list<size_t>> thread_numbers_by_start_node;
         
@@ -4229,6 +4977,13 @@ void XG::insert_threads_into_dag(const vector<thread_t>& t, const vector<string>
             }
         }
         
+        return thread_numbers_by_start_node;
+    };
+
+    // We want to go through and insert running forward through the DAG, and
+    // then again backward through the DAG.
+    auto insert_in_direction = [&](bool insert_reverse, map<int64_t, list<size_t>>& thread_numbers_by_start_node) {
+        
         // We have this message-passing architecture, where we send groups of
         // threads along edges to destination nodes. This records, by edge rank of
         // the traversed edge (with 0 meaning starting there), the group of threads
@@ -4371,15 +5126,77 @@ void XG::insert_threads_into_dag(const vector<thread_t>& t, const vector<string>
         // in this direction.
     };
     
+    auto forward_starts = start_in_direction(false);
+    auto reverse_starts = start_in_direction(true);
+    
+    // The two directions write to different sides and different edge
+    // orientations, so long as every thread visits each node in the same
+    // orientation, and then they can run at the same time. Check that first,
+    // since nothing stops a caller from claiming a graph is a sorted DAG when
+    // its threads disagree.
+    vector<uint8_t> orientations_seen(max_node_rank() + 1, 0);
+#pragma omp parallel for schedule(dynamic, 1)
+    for(size_t i = 0; i < t.size(); i++) {
+        for(auto& mapping : t[i]) {
+            uint8_t bit = mapping.is_reverse ? 2 : 1;
+#pragma omp atomic
+            orientations_seen[id_to_rank(mapping.node_id)] |= bit;
+        }
+    }
+    bool consistent = true;
+    for(auto seen : orientations_seen) {
+        if(seen == 3) {
+            consistent = false;
+            break;
+        }
+    }
+    orientations_seen.clear();
+    orientations_seen.shrink_to_fit();
+    
     // Actually call the inserts
+    if(consistent) {
+#ifdef VERBOSE_DEBUG
+        cerr << "Inserting threads forwards and backwards..." << endl;
+#endif
+        // Exceptions can't leave an OpenMP section, so carry them out.
+        exception_ptr forward_error;
+        exception_ptr reverse_error;
+#pragma omp parallel sections
+        {
+#pragma omp section
+            {
+                try {
+                    insert_in_direction(false, forward_starts);
+                } catch(...) {
+                    forward_error = current_exception();
+                }
+            }
+#pragma omp section
+            {
+                try {
+                    insert_in_direction(true, reverse_starts);
+                } catch(...) {
+                    reverse_error = current_exception();
+                }
+            }
+        }
+        if(forward_error) {
+            rethrow_exception(forward_error);
+        }
+        if(reverse_error) {
+            rethrow_exception(reverse_error);
+        }
+    } else {
+        // Keep the old serial behavior, where the backward pass wins.
 #ifdef VERBOSE_DEBUG
-    cerr << "Inserting threads forwards..." << endl;
+        cerr << "Inserting threads forwards..." << endl;
 #endif
-    insert_in_direction(false);
+        insert_in_direction(false, forward_starts);
 #ifdef VERBOSE_DEBUG
-    cerr << "Inserting threads backwards..." << endl;
+        cerr << "Inserting threads backwards..." << endl;
 #endif
-    insert_in_direction(true);
+        insert_in_direction(true, reverse_starts);
+    }
     
     // Actually build the B_s arrays for rank and select.
 #ifdef VERBOSE_DEBUG
@@ -4588,6 +5405,96 @@ void XG::insert_thread(const thread_t& t, const string& name) {
     names_str.append("$" + name);
 }
 
+auto XG::extract_thread_at(int64_t side, int64_t offset) const -> thread_t {
+    
+    thread_t path;
+    
+    while(true) {
+        
+        // Unpack the side into a node traversal
+        ThreadMapping m = {rank_to_id(side / 2), (bool) (side % 2)};
+        
+        // Add the mapping to the thread
+        path.push_back(m);
+        
+#ifdef VERBOSE_DEBUG
+        cerr << "At side " << side << endl;
+        
+#endif
+        // Work out where we go
+        
+        // What edge of the available edges do we take?
+        int64_t edge_index = bs_get(side, offset);
+        
+        // If we find a separator, we're very broken.
+        assert(edge_index != BS_SEPARATOR);
+        
+        if(edge_index == BS_NULL) {
+            // Path ends here.
+            break;
+        } else {
+            // Convert to an actual edge index
+            edge_index -= 2;
+        }
+        
+#ifdef VERBOSE_DEBUG
+        cerr << "Taking edge #" << edge_index << " from " << side << endl;
+#endif
+
+        // We also should not have negative edges.
+        assert(edge_index >= 0);
+        
+        // Look at the edges we could have taken next
+        vector<Edge> edges_out = side % 2 ? edges_on_start(rank_to_id(side / 2)) : edges_on_end(rank_to_id(side / 2));
+        
+        assert(edge_index < edges_out.size());
+        
+        Edge& taken = edges_out[edge_index];
+        
+#ifdef VERBOSE_DEBUG
+        cerr << edges_out.size() << " edges possible." << endl;
+#endif
+        // Follow the edge
+        int64_t other_node = taken.from() == rank_to_id(side / 2) ? taken.to() : taken.from();
+        bool other_orientation = (side % 2) != taken.from_start() != taken.to_end();
+        
+        // Get the side 
+        int64_t other_side = id_to_rank(other_node) * 2 + other_orientation;
+        
+#ifdef VERBOSE_DEBUG
+        cerr << "Go to side " << other_side << endl;
+#endif
+        
+        // Go there with where_to
+        offset = where_to(side, offset, other_side);
+        side = other_side;
+
+    }
+    
+    return path;
+}
+
+vector<pair<int64_t, int64_t>> XG::thread_starts(bool extract_reverse) const {
+    vector<pair<int64_t, int64_t>> starts;
+    // We consider "reverse" threads to be those that start on the higher-
+    // numbered sides of their nodes.
+    // We know sides 0 and 1 are unused, so the smallest side is 2.
+    int64_t begin = !extract_reverse ? 2 : 3;
+    int64_t end = !extract_reverse ? ts_civ.size()-1 : ts_civ.size();
+    for(int64_t i = begin; i < end; i+=2) {
+        // For every other real side
+    
+#ifdef VERBOSE_DEBUG
+        cerr << ts_civ[i] << " threads start at side " << i << endl;
+#endif
+        for(int64_t j = 0; j < ts_civ[i]; j++) {
+            // Every thread starting there starts at the next offset
+            starts.emplace_back(i, j);
+        }
+    }
+    return starts;
+}
+
 auto XG::extract_threads_matching(const string& pattern, bool reverse) const -> map<string, list<thread_t>> {
 
     map<string, list<thread_t> > found;
@@ -4596,67 +5503,9 @@ auto XG::extract_threads_matching(const string& pattern, bool reverse) const ->
     // for each thread, get its start position
     vector<int64_t> threads = threads_named_starting(pattern);
     for (auto& id : threads) {
-        // For every thread starting there
-        // make a new thread
-        thread_t path;
-
-        // Get the name of this thread
-        string path_name = thread_name(id);
-
         // Start the side at i and the offset at j
         auto p = thread_start(id, reverse);
-        int64_t side = id_rev_to_side(p.first, reverse);
-        int64_t offset = p.second;
-
-        while(true) {
-                
-            // Unpack the side into a node traversal
-            ThreadMapping m = {rank_to_id(side/2), (bool) (side % 2)};
-
-            // Add the mapping to the thread
-            path.push_back(m);
-                
-            // Work out where we go
-                
-            // What edge of the available edges do we take?
-            int64_t edge_index = bs_get(side, offset);
-                
-            // If we find a separator, we're very broken.
-            assert(edge_index != BS_SEPARATOR);
-                
-            if(edge_index == BS_NULL) {
-                // Path ends here.
-                break;
-            } else {
-                // Convert to an actual edge index
-                edge_index -= 2;
-            }
-                
-            // We also should not have negative edges.
-            assert(edge_index >= 0);
-                
-            // Look at the edges we could have taken next
-            vector<Edge> edges_out = side % 2 ? edges_on_start(rank_to_id(side / 2)) : edges_on_end(rank_to_id(side / 2));
-                
-            assert(edge_index < edges_out.size());
-                
-            Edge& taken = edges_out[edge_index];
-                
-            // Follow the edge
-            int64_t other_node = taken.from() == rank_to_id(side / 2) ? taken.to() : taken.from();
-            bool other_orientation = (side % 2) != taken.from_start() != taken.to_end();
-                
-            // Get the side 
-            int64_t other_side = id_to_rank(other_node) * 2 + other_orientation;
-                
-            // Go there with where_to
-            offset = where_to(side, offset, other_side);
-            side = other_side;
-    
-        }
-            
-        found[path_name].push_back(path);
-            
+        found[thread_name(id)].push_back(extract_thread_at(id_rev_to_side(p.first, reverse), p.second));
     }
     
     return found;
@@ -4671,108 +5520,26 @@ auto XG::extract_threads(bool extract_reverse) const -> map<string, list<thread_
 #ifdef VERBOSE_DEBUG
     cerr << "Extracting threads" << endl;
 #endif
-    // We consider "reverse" threads to be those that start on the higher-
-    // numbered sides of their nodes.
-    // We know sides 0 and 1 are unused, so the smallest side is 2.
-    int64_t begin = !extract_reverse ? 2 : 3;
-    int64_t end = !extract_reverse ? ts_civ.size()-1 : ts_civ.size();
-    for(int64_t i = begin; i < end; i+=2) {
-        // For every other real side
+    for (auto& start : thread_starts(extract_reverse)) {
+        found[thread_name(thread_starting_at(start.first, start.second))].push_back(
+            extract_thread_at(start.first, start.second));
+    }
     
-#ifdef VERBOSE_DEBUG
-        cerr << ts_civ[i] << " threads start at side " << i << endl;
-#endif
-        // For each side
-        if(ts_civ[i] == 0) {
-            // Skip it if no threads start at it
-            continue;
-        }
-
-        for(int64_t j = 0; j < ts_civ[i]; j++) {
-            // For every thread starting there
-      
-#ifdef debug    
-            cerr << "Extracting thread " << j << endl;
-#endif
-            
-            // make a new thread
-            thread_t path;
-            
-            // Start the side at i and the offset at j
-            int64_t side = i;
-            int64_t offset = j;
-
-            // Get the name of this thread
-            string path_name = thread_name(thread_starting_at(side, offset));
-
-            while(true) {
-                
-                // Unpack the side into a node traversal
-                ThreadMapping m = {rank_to_id(side / 2), (bool) (side % 2)};
-                
-                // Add the mapping to the thread
-                path.push_back(m);
-                
-#ifdef VERBOSE_DEBUG
-                cerr << "At side " << side << endl;
-                
-#endif
-                // Work out where we go
-                
-                // What edge of the available edges do we take?
-                int64_t edge_index = bs_get(side, offset);
-                
-                // If we find a separator, we're very broken.
-                assert(edge_index != BS_SEPARATOR);
-                
-                if(edge_index == BS_NULL) {
-                    // Path ends here.
-                    break;
-                } else {
-                    // Convert to an actual edge index
-                    edge_index -= 2;
-                }
-                
-#ifdef VERBOSE_DEBUG
-                cerr << "Taking edge #" << edge_index << " from " << side << endl;
-#endif
+    return found;
+}
 
-                // We also should not have negative edges.
-                assert(edge_index >= 0);
-                
-                // Look at the edges we could have taken next
-                vector<Edge> edges_out = side % 2 ? edges_on_start(rank_to_id(side / 2)) : edges_on_end(rank_to_id(side / 2));
-                
-                assert(edge_index < edges_out.size());
-                
-                Edge& taken = edges_out[edge_index];
-                
-#ifdef VERBOSE_DEBUG
-                cerr << edges_out.size() << " edges possible." << endl;
-#endif
-                // Follow the edge
-                int64_t other_node = taken.from() == rank_to_id(side / 2) ? taken.to() : taken.from();
-                bool other_orientation = (side % 2) != taken.from_start() != taken.to_end();
-                
-                // Get the side 
-                int64_t other_side = id_to_rank(other_node) * 2 + other_orientation;
-                
-#ifdef VERBOSE_DEBUG
-                cerr << "Go to side " << other_side << endl;
-#endif
-                
-                // Go there with where_to
-                offset = where_to(side, offset, other_side);
-                side = other_side;
+void XG::for_each_thread(bool extract_reverse, const function<void(size_t, const string&, thread_t&)>& lambda,
+                         bool parallel) const {
     
-            }
-            
-            found[path_name].push_back(path);
-            
-        }
-    }
+    vector<pair<int64_t, int64_t>> starts = thread_starts(extract_reverse);
     
-    return found;
+    // Threads can be walked independently, since the gPBWT is read only
+#pragma omp parallel for schedule(dynamic, 1) if (parallel)
+    for (size_t i = 0; i < starts.size(); i++) {
+        string name = thread_name(thread_starting_at(starts[i].first, starts[i].second));
+        thread_t thread = extract_thread_at(starts[i].first, starts[i].second);
+        lambda(i, name, thread);
+    }
 }
 
 XG::destination_t XG::bs_get(int64_t side, int64_t offset) const {
@@ -4880,11 +5647,14 @@ void XG::bs_insert(int64_t side, int64_t offset, destination_t value) {
 
 void XG::bs_bake() {
 #if GPBWT_MODE == MODE_SDSL
-    // First pass: determine required size
+    // First pass: determine required size, and where each side's range will
+    // start, so the sides can be copied in parallel.
+    vector<size_t> range_starts(bs_arrays.size());
     size_t total_visits = 1;
-    for(auto& bs_array : bs_arrays) {
+    for(size_t i = 0; i < bs_arrays.size(); i++) {
+        range_starts[i] = total_visits;
         total_visits += 1; // For the separator
-        total_visits += bs_array.size();
+        total_visits += bs_arrays[i].size();
     }
 
 #ifdef VERBOSE_DEBUG
@@ -4893,25 +5663,22 @@ void XG::bs_bake() {
     // Move over to a single array which is big enough to start out with.
     string all_bs_arrays(total_visits, 0);
     
-    // Where are we writing to?
-    size_t pos = 0;
-    
     // Start with a separator for sides 0 and 1.
     // We don't start at run 0 because we can't select(0, BS_SEPARATOR).
-    all_bs_arrays[pos++] = BS_SEPARATOR;
+    all_bs_arrays[0] = BS_SEPARATOR;
     
 #ifdef VERBOSE_DEBUG
     cerr << "Baking " << bs_arrays.size() << " sides' arrays..." << endl;
 #endif
     
-    for(auto& bs_array : bs_arrays) {
+#pragma omp parallel for schedule(dynamic, 1024)
+    for(size_t i = 0; i < bs_arrays.size(); i++) {
         // Stick everything together with a separator at the front of every
         // range.
-        all_bs_arrays[pos++] = BS_SEPARATOR;
-        for(size_t i = 0; i < bs_array.size(); i++) {
-            all_bs_arrays[pos++] = bs_array[i];
-        }
-        bs_array.clear();
+        auto& bs_array = bs_arrays[i];
+        all_bs_arrays[range_starts[i]] = BS_SEPARATOR;
+        copy(bs_array.begin(), bs_array.end(), all_bs_arrays.begin() + range_starts[i] + 1);
+        string().swap(bs_array);
     }
     
 #ifdef VERBOSE_DEBUG
@@ -5038,6 +5805,51 @@ size_t XG::count_matches(const Path& t) const {
     return count_matches(thread);
 }
 
+vector<size_t> XG::count_matches_batch(const vector<thread_t>& threads) const {
+    vector<size_t> counts(threads.size(), 0);
+    
+    // Visit the threads in sorted order, so threads sharing a prefix are next
+    // to each other and we walk the trie of the threads depth first.
+    vector<size_t> order(threads.size());
+    for (size_t i = 0; i < order.size(); i++) {
+        order[i] = i;
+    }
+    stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return threads[a] < threads[b];
+    });
+    
+    // states[i] is the search state after the first i mappings of the
+    // current thread, for as much of it as we have searched.
+    vector<ThreadSearchState> states(1);
+    const thread_t* previous = nullptr;
+    for (size_t k : order) {
+        const thread_t& thread = threads[k];
+        
+        // Backtrack to the longest prefix shared with the last thread
+        size_t shared = 0;
+        if (previous != nullptr) {
+            while (shared < thread.size() && shared < previous->size() &&
+                   thread[shared].node_id == (*previous)[shared].node_id &&
+                   thread[shared].is_reverse == (*previous)[shared].is_reverse) {
+                shared++;
+            }
+        }
+        states.resize(min(states.size(), shared + 1));
+        
+        // Extend through the rest of this thread, stopping once nothing matches
+        while (states.size() <= thread.size() && !states.back().is_empty()) {
+            ThreadSearchState next = states.back();
+            extend_search(next, thread[states.size() - 1]);
+            states.push_back(next);
+        }
+        
+        counts[k] = states.size() > thread.size() ? states.back().count() : 0;
+        previous = &thread;
+    }
+    
+    return counts;
+}
+
 void XG::extend_search(ThreadSearchState& state, const thread_t& t) const {
     
 #ifdef VERBOSE_DEBUG
@@ -5068,55 +5880,59 @@ void XG::extend_search(ThreadSearchState& state, const thread_t& t) const {
             break;
         }
         
-        // TODO: make this mapping to side thing a function
-        int64_t next_id = mapping.node_id;
-        bool next_is_reverse = mapping.is_reverse;
-        int64_t next_side = id_to_rank(next_id) * 2 + next_is_reverse;
-        
+        extend_search(state, mapping);
+    }
+}
+
+void XG::extend_search(ThreadSearchState& state, const ThreadMapping& t) const {
+    if(state.is_empty()) {
+        // Don't bother trying to extend empty things.
+        return;
+    }
+    
+    // TODO: make this mapping to side thing a function
+    int64_t next_id = t.node_id;
+    bool next_is_reverse = t.is_reverse;
+    int64_t next_side = id_to_rank(next_id) * 2 + next_is_reverse;
+    
 #ifdef VERBOSE_DEBUG
-        cerr << "Extend mapping to " << state.current_side << " range " << state.range_start << " to " << state.range_end << " with " << next_side << endl;
+    cerr << "Extend mapping to " << state.current_side << " range " << state.range_start << " to " << state.range_end << " with " << next_side << endl;
 #endif
+    
+    if(state.current_side == 0) {
+        // If the state is a start state, just select the whole node using
+        // the node usage count in this orientation. TODO: orientation not
+        // really important unless we're going to search during a path
+        // addition.
+        state.range_start = 0;
+        state.range_end = h_civ.size() ? h_civ[node_graph_idx(next_id) * 2 + next_is_reverse] : 0;
         
-        if(state.current_side == 0) {
-            // If the state is a start state, just select the whole node using
-            // the node usage count in this orientation. TODO: orientation not
-            // really important unless we're going to search during a path
-            // addition.
-            state.range_start = 0;
-            state.range_end = h_civ.size() ? h_civ[node_graph_idx(next_id) * 2 + next_is_reverse] : 0;
-            
 #ifdef VERBOSE_DEBUG
-            cerr << "\tFound " << state.range_end << " threads present here." << endl;
-            
-            int64_t here = node_graph_idx(next_id) * 2 + next_is_reverse;
-            cerr << here << endl;
-            for(int64_t i = here - 5; i < here + 5; i++) {
-                if(i >= 0) {
-                    cerr << "\t\t" << (i == here ? "*" : " ") << "h_civ[" << i << "] = " << h_civ[i] << endl;
-                }
+        cerr << "\tFound " << state.range_end << " threads present here." << endl;
+        
+        int64_t here = node_graph_idx(next_id) * 2 + next_is_reverse;
+        cerr << here << endl;
+        for(int64_t i = here - 5; i < here + 5; i++) {
+            if(i >= 0) {
+                cerr << "\t\t" << (i == here ? "*" : " ") << "h_civ[" << i << "] = " << h_civ[i] << endl;
             }
-            
+        }
+        
 #endif
-            
-        } else {
-            // Else, look at where the path goes to and apply the where_to function to shrink the range down.
-            state.range_start = where_to(state.current_side, state.range_start, next_side);
-            state.range_end = where_to(state.current_side, state.range_end, next_side);
-            
+        
+    } else {
+        // Else, look at where the path goes to and apply the where_to function to shrink the range down.
+        state.range_start = where_to(state.current_side, state.range_start, next_side);
+        state.range_end = where_to(state.current_side, state.range_end, next_side);
+        
 #ifdef VERBOSE_DEBUG
-            cerr << "\tFound " << state.range_start << " to " << state.range_end << " threads continuing through." << endl;
+        cerr << "\tFound " << state.range_start << " to " << state.range_end << " threads continuing through." << endl;
 #endif
-            
-        }
         
-        // Update the side that the state is on
-        state.current_side = next_side;
     }
-}
-
-void XG::extend_search(ThreadSearchState& state, const ThreadMapping& t) const {
-    // Just make it into a temporary vector
-    extend_search(state, thread_t{t});
+    
+    // Update the side that the state is on
+    state.current_side = next_side;
 }
 
 int64_t XG::threads_starting_on_side(int64_t side) const {
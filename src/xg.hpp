@@ -20,6 +20,7 @@
 #include "graph.hpp"
 #include "path.hpp"
 #include "handle.hpp"
+#include "subhandlegraph.hpp"
 
 // We can have DYNAMIC or SDSL-based gPBWTs
 #define MODE_DYNAMIC 1
@@ -115,13 +116,22 @@ public:
                bool is_sorted_dag);
                
     // What's the maximum XG version number we can read with this code?
-    const static uint32_t MAX_INPUT_VERSION = 10;
+    const static uint32_t MAX_INPUT_VERSION = 12;
     // What's the version we serialize?
-    const static uint32_t OUTPUT_VERSION = 10;
+    const static uint32_t OUTPUT_VERSION = 12;
+    
+    // How far out from each node do we look for the nearest path node when
+    // building the path anchor index?
+    const static size_t PATH_ANCHOR_SEARCH_DIST = 100;
                
     // Load this XG index from a stream. Throw an XGFormatError if the stream
     // does not produce a valid XG file.
     void load(istream& in);
+    // Load this XG index from the named file, reading it through a shared,
+    // read-only memory mapping instead of an ifstream. This avoids read(2)
+    // copies and lets processes on one host share the file's page cache
+    // while loading. Throw an XGFormatError if the file is not a valid XG.
+    void load_mapped(const string& filename);
     size_t serialize(std::ostream& out,
                      sdsl::structure_tree_node* v = NULL,
                      std::string name = "");
@@ -151,6 +161,9 @@ public:
     size_t node_length(int64_t id) const;
     char pos_char(int64_t id, bool is_rev, size_t off) const; // character at position
     string pos_substr(int64_t id, bool is_rev, size_t off, size_t len = 0) const; // substring in range
+    /// Write the same substring as pos_substr() to dest, which must have room
+    /// for it, without allocating. Returns the number of characters written.
+    size_t pos_substr_into(int64_t id, bool is_rev, size_t off, size_t len, char* dest) const;
     // these provide a way to get an index for each node and edge in the g_iv structure and are used by gPBWT
     size_t node_graph_idx(int64_t id) const;
     size_t edge_graph_idx(const Edge& edge) const;
@@ -167,6 +180,17 @@ public:
     bool has_edge(int64_t id1, bool is_start, int64_t id2, bool is_end) const;
     /// Returns true if the given edge is present in either orientation, and false otherwise.
     bool has_edge(const Edge& edge) const;
+    /// Returns true if an edge runs from the right side of the left handle
+    /// to the left side of the right handle. Doesn't allocate, and takes
+    /// constant time once index_edges() has been called.
+    bool has_edge(const handle_t& left, const handle_t& right) const;
+    
+    /// Build a hash index of the g vector positions of all the edges, so
+    /// has_edge() no longer scans the node's edge list. It takes the width of
+    /// a g vector position per slot, at 3/4 load, and is not serialized. Must
+    /// be built after the index is loaded, and before has_edge() is called
+    /// from multiple threads.
+    void index_edges();
     
     vector<Edge> edges_of(int64_t id) const;
     vector<Edge> edges_to(int64_t id) const;
@@ -225,6 +249,10 @@ public:
     /// Get the sequence of a node, presented in the handle's local forward
     /// orientation.
     virtual string get_sequence(const handle_t& handle) const;
+    /// Write the sequence of a node, in the handle's local forward
+    /// orientation, to dest, which must have room for get_length(handle)
+    /// characters. No terminator is written and nothing is allocated.
+    void get_sequence_into(const handle_t& handle, char* dest) const;
     /// Loop over all the handles to next/previous (right/left) nodes. Passes
     /// them to a callback which returns false to stop iterating and true to
     /// continue.
@@ -236,6 +264,29 @@ public:
     using HandleGraph::for_each_handle;
     /// Return the number of nodes in the graph
     virtual size_t node_size() const;
+    
+    ////////////////////////////////////////////////////////////////////////////
+    // Batched handle graph API
+    ////////////////////////////////////////////////////////////////////////////
+    
+    // These fill caller-owned buffers for a whole batch of handles at once.
+    // Handles are visited in g vector order so the walk over g_iv is
+    // sequential, but results are always reported in input order. Output
+    // buffers are cleared first, and keep their capacity between calls, so
+    // reusing them across batches does no per-handle allocation.
+    
+    /// Get the lengths of all the given handles.
+    void get_lengths(const vector<handle_t>& handles, vector<size_t>& lengths_out) const;
+    /// Get the sequences of all the given handles, each in its handle's local
+    /// forward orientation, concatenated into sequences_out. The sequence for
+    /// handle i is at [offsets_out[i], offsets_out[i + 1]).
+    void get_sequences(const vector<handle_t>& handles, string& sequences_out,
+                       vector<size_t>& offsets_out) const;
+    /// Get the handles to the left or right of all the given handles,
+    /// concatenated into neighbors_out. The neighbors of handle i are at
+    /// [offsets_out[i], offsets_out[i + 1]).
+    void follow_edges(const vector<handle_t>& handles, bool go_left, vector<handle_t>& neighbors_out,
+                      vector<size_t>& offsets_out) const;
 
     ////////////////////////////////////////////////////////////////////////////
     // Higher-level graph API
@@ -267,11 +318,36 @@ public:
     // walk forward in id space, collecting nodes, until at least length bases covered
     // (or end of graph reached).  if forward is false, go backwards...
     void get_id_range_by_length(int64_t id1, int64_t length, Graph& g, bool forward) const;
+
+    // The same extractions into a handle-based view over this index, which
+    // doesn't copy sequences or build Protobuf objects. Views carry no paths.
+    void neighborhood(int64_t id, size_t dist, SubHandleGraph& g, bool use_steps = true) const;
+    void expand_context(SubHandleGraph& g, size_t dist, bool use_steps = true,
+                        bool expand_forward = true, bool expand_backward = true,
+                        int64_t until_node = 0) const;
+    void expand_context_by_steps(SubHandleGraph& g, size_t steps,
+                                 bool expand_forward = true, bool expand_backward = true,
+                                 int64_t until_node = 0) const;
+    void expand_context_by_length(SubHandleGraph& g, size_t length,
+                                  bool expand_forward = true, bool expand_backward = true,
+                                  int64_t until_node = 0) const;
+    void get_id_range(int64_t id1, int64_t id2, SubHandleGraph& g) const;
+    /// Walk forward from the position like graph_context_id(), adding the
+    /// nodes walked over and the edges leaving them forward to the view.
+    void graph_context(const pos_t& pos, int64_t length, SubHandleGraph& g) const;
+    /// Call the lambda with the left and right handles of each edge on the
+    /// node in the requested directions, for the SubHandleGraph extractions.
+    void for_each_expansion_edge(int64_t id, bool expand_forward, bool expand_backward,
+                                 const function<void(const handle_t&, const handle_t&)>& lambda) const;
     
     ////////////////////////////////////////////////////////////////////////////
     // Here is the paths API
     ////////////////////////////////////////////////////////////////////////////
 
+    /// Add the given paths to the index, rebuilding only the path indexes and
+    /// leaving the graph and threads alone. The paths must only visit nodes
+    /// already in the graph and must not share names with existing paths.
+    void add_paths(const vector<Path>& new_paths);
     /// Pull out the path with the given name.
     Path path(const string& name) const;
     /// Get the path string
@@ -509,12 +585,22 @@ public:
     thread_t extract_thread(const string& name) const;
     /// Extract a set of threads matching a pattern.
     map<string, list<thread_t> > extract_threads_matching(const string& pattern, bool reverse) const;
+    /// Walk out all the threads embedded in the graph, without collecting
+    /// them, calling the lambda with the thread's number (counting all the
+    /// threads in a fixed order, from 0), its name, and its visits. If parallel
+    /// is set, threads are walked on all OpenMP threads at once, and the lambda
+    /// is called from all of them.
+    void for_each_thread(bool extract_reverse, const function<void(size_t, const string&, thread_t&)>& lambda,
+                         bool parallel = false) const;
     /// Extract a particular thread, referring to it by its offset at node; step
     /// it out to a maximum of max_length
     thread_t extract_thread(xg::XG::ThreadMapping node, int64_t offset, int64_t max_length);
     /// Count matches to a subthread among embedded threads
     size_t count_matches(const thread_t& t) const;
     size_t count_matches(const Path& t) const;
+    /// Count matches to each of a batch of subthreads, in the same order.
+    /// Searches for prefixes the subthreads share are only done once.
+    vector<size_t> count_matches_batch(const vector<thread_t>& threads) const;
     
     /**
      * Represents the search state for the graph PBWT, so that you can continue
@@ -563,6 +649,12 @@ public:
     
     /// Given a side and offset, return the id of the thread starting there (or 0 if none)
     int64_t thread_starting_at(int64_t side, int64_t offset) const;
+    
+    /// Get the side and offset that each thread starts at, for the forward or reverse threads
+    vector<pair<int64_t, int64_t>> thread_starts(bool extract_reverse) const;
+    
+    /// Walk the thread from the given side and offset to its end
+    thread_t extract_thread_at(int64_t side, int64_t offset) const;
 
     /// Given a thread id and the reverse state get the starting side and offset
     pair<int64_t, int64_t> thread_start(int64_t thread_id) const;
@@ -623,6 +715,18 @@ private:
     const static int G_EDGE_TYPE_OFFSET = 1;
     const static int G_EDGE_LENGTH = 2;
     
+    /// Hash table of the g vector positions of the edges in the nodes'
+    /// edges_from lists, plus 1, so that 0 marks an empty slot. Empty unless
+    /// index_edges() has been called.
+    int_vector<> edge_positions;
+    
+    /// Get the handles an edge in a node's edges_from list runs between.
+    pair<handle_t, handle_t> edge_from_handles(size_t g, size_t edge_position) const;
+    
+    /// Return true if the edge is stored in its from handle's edges_from list
+    /// in this orientation, according to the edge_positions index.
+    bool has_indexed_edge(const handle_t& from, const handle_t& to) const;
+    
     // And some masks
     const static size_t HIGH_BIT = (size_t)1 << 63;
     const static size_t LOW_BITS = 0x7FFFFFFFFFFFFFFF;
@@ -641,12 +745,22 @@ private:
     bool do_edges(const size_t& g, const size_t& start, const size_t& count,
         bool is_to, bool want_left, bool is_reverse, const function<bool(const handle_t&)>& iteratee) const;
     
+    /// Get the order in which to visit the given handles so that their g
+    /// vector records are read front to back.
+    vector<size_t> g_order(const vector<handle_t>& handles) const;
+    
     ////////////////////////////////////////////////////////////////////////////
     // Here are the bits we need to keep around to talk about the sequence
     ////////////////////////////////////////////////////////////////////////////
     
-    // sequence/integer vector
-    int_vector<> s_iv;
+    // sequence/integer vector, two bits per base, with N (and anything else
+    // that isn't ACGT) stored as A and listed in sn_bv
+    int_vector<2> s_iv;
+    // positions in s_iv that are really N
+    sd_vector<> sn_bv;
+    sd_vector<>::rank_1_type sn_bv_rank;
+    sd_vector<>::select_1_type sn_bv_select;
+    size_t sn_count = 0;
     // node starts in sequence, provides id schema
     // rank_1(i) = id
     // select_1(id) = i
@@ -775,6 +889,12 @@ private:
     // An index from a path rank to the set of path ranks that occur on the same connected component as it
     vector<size_t> component_path_set_of_path;
 
+    // Build the path names, paths, node to path index, component path sets, and
+    // path anchors from the nodes on each path
+    void index_paths(map<string, vector<trav_t> >& path_nodes,
+                     const unordered_set<string>& circular_paths,
+                     bool store_threads);
+
     // Fill the component path sets indexes
     void index_component_path_sets();
     // Create a representation of the component path set indexes in serializable sdsl types
@@ -782,6 +902,28 @@ private:
     // Convert the serializable sdsl representation of the component path set indexes into the in-memory class members
     void unpack_succinct_component_path_sets(const int_vector<>& path_ranks_iv, const bit_vector& path_ranks_bv);
     
+    // The nearest node on a path to either side of each node, indexed by 2 * (rank - 1) + (1 if to the left of
+    // the forward strand). Anchors are stored as 2 * anchor rank + (1 if reached on its reverse strand), or 0 if
+    // there is no path node within the search distance.
+    int_vector<> path_anchor_iv;
+    // The amount of sequence between each node and its anchor
+    int_vector<> path_anchor_dist_iv;
+    // How far the path anchors were searched for, or 0 if there is no path anchor index
+    size_t path_anchor_search_dist = 0;
+    
+    // Store a sequence encoded as by dna3bit() in s_iv and the N exception list
+    void pack_sequence(const int_vector<>& sequence);
+    // Get the character at a position in s_iv
+    char sequence_char(size_t i) const;
+    // Write the length characters of s_iv from start to dest, reverse complemented if requested
+    void decode_sequence(size_t start, size_t length, bool reverse_complemented, char* dest) const;
+    
+    // Fill the path anchor index, looking up to max_search_dist bases out from each node
+    void index_path_anchors(size_t max_search_dist);
+    // Get the nearest path node reached by leaving a node traversal on the given side, and the amount of sequence
+    // in between. Returns false if there is none in the index.
+    bool path_anchor(int64_t id, bool is_rev, bool search_left, handle_t& anchor_out, int64_t& dist_out) const;
+    
     // A "destination" is either a local edge number + 2, BS_NULL for stopping,
     // or possibly BS_SEPARATOR for cramming multiple Benedict arrays into one.
     using destination_t = size_t;
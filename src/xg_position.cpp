@@ -1,4 +1,5 @@
 #include "xg_position.hpp"
+#include "algorithms/dijkstra.hpp"
 
 namespace vg {
 
@@ -29,7 +30,7 @@ vector<Edge> xg_edges_on_end(id_t id, const xg::XG* xgidx) {
 }
 
 string xg_node_sequence(id_t id, const xg::XG* xgidx) {
-    return xgidx->node(id).sequence();
+    return xgidx->node_sequence(id);
 }
 
 size_t xg_node_length(id_t id, const xg::XG* xgidx) {
@@ -57,37 +58,12 @@ map<pos_t, char> xg_next_pos_chars(pos_t pos, const xg::XG* xgidx) {
         if (is_rev(pos)) c = reverse_complement(c);
         nexts[pos] = c;
     } else {
-        // helper
-        auto is_inverting = [](const Edge& e) {
-            return !(e.from_start() == e.to_end())
-            && (e.from_start() || e.to_end());
-        };
-        // check our cache
-        vector<Edge> edges = xgidx->edges_of(node.id());
-        // look at the next positions we could reach
-        if (!is_rev(pos)) {
-            // we are on the forward strand, the next things from this node come off the end
-            for (auto& edge : edges) {
-                if((edge.to() == id(pos) && edge.to_end()) || (edge.from() == id(pos) && !edge.from_start())) {
-                    id_t nid = (edge.from() == id(pos) ?
-                                edge.to()
-                                : edge.from());
-                    pos_t p = make_pos_t(nid, is_inverting(edge), 0);
-                    nexts[p] = xg_pos_char(p, xgidx);
-                }
-            }
-        } else {
-            // we are on the reverse strand, the next things from this node come off the start
-            for (auto& edge : edges) {
-                if((edge.to() == id(pos) && !edge.to_end()) || (edge.from() == id(pos) && edge.from_start())) {
-                    id_t nid = (edge.to() == id(pos) ?
-                                edge.from()
-                                : edge.to());
-                    pos_t p = make_pos_t(nid, !is_inverting(edge), 0);
-                    nexts[p] = xg_pos_char(p, xgidx);
-                }
-            }
-        }
+        // Follow the edges off the side we are leaving by
+        xgidx->follow_edges(xgidx->get_handle(id(pos), is_rev(pos)), false, [&](const handle_t& next) {
+            pos_t p = make_pos_t(xgidx->get_id(next), xgidx->get_is_reverse(next), 0);
+            nexts[p] = xg_pos_char(p, xgidx);
+            return true;
+        });
     }
     return nexts;
 }
@@ -101,35 +77,12 @@ set<pos_t> xg_next_pos(pos_t pos, bool whole_node, const xg::XG* xgidx) {
         ++get_offset(pos);
         nexts.insert(pos);
     } else {
-        // helper
-        auto is_inverting = [](const Edge& e) {
-            return !(e.from_start() == e.to_end())
-            && (e.from_start() || e.to_end());
-        };
-        // check our cache
-        auto edges = xgidx->edges_of(id(pos));
-        // look at the next positions we could reach
-        if (!is_rev(pos)) {
-            // we are on the forward strand, the next things from this node come off the end
-            for (auto& edge : edges) {
-                if((edge.to() == id(pos) && edge.to_end()) || (edge.from() == id(pos) && !edge.from_start())) {
-                    id_t nid = (edge.from() == id(pos) ?
-                                edge.to()
-                                : edge.from());
-                    nexts.insert(make_pos_t(nid, is_inverting(edge), 0));
-                }
-            }
-        } else {
-            // we are on the reverse strand, the next things from this node come off the start
-            for (auto& edge : edges) {
-                if((edge.to() == id(pos) && !edge.to_end()) || (edge.from() == id(pos) && edge.from_start())) {
-                    id_t nid = (edge.to() == id(pos) ?
-                                edge.from()
-                                : edge.to());
-                    nexts.insert(make_pos_t(nid, !is_inverting(edge), 0));
-                }
-            }
-        }
+        // Follow the edges off the side we are leaving by
+        xgidx->follow_edges(xgidx->get_handle(id(pos), is_rev(pos)), false, [&](const handle_t& next) {
+            pos_t p = make_pos_t(xgidx->get_id(next), xgidx->get_is_reverse(next), 0);
+            nexts.insert(p);
+            return true;
+        });
     }
     return nexts;
 }
@@ -138,33 +91,78 @@ int64_t xg_distance(pos_t pos1, pos_t pos2, int64_t maximum, const xg::XG* xgidx
     //cerr << "distance from " << pos1 << " to " << pos2 << endl;
     if (pos1 == pos2) return 0;
     int64_t adj = (offset(pos1) == xg_node_length(id(pos1), xgidx) ? 0 : 1);
-    set<pos_t> seen;
-    set<pos_t> nexts = xg_next_pos(pos1, false, xgidx);
-    int64_t distance = 0;
-    while (!nexts.empty()) {
-        set<pos_t> todo;
-        for (auto& next : nexts) {
-            if (!seen.count(next)) {
-                seen.insert(next);
-                if (next == pos2) {
-                    return distance+adj;
-                }
-                // handle the edge case that we are looking for the position after the end of this node
-                if (make_pos_t(id(next), is_rev(next), offset(next)+1) == pos2) {
-                    return distance+adj+1;
-                }
-                for (auto& x : xg_next_pos(next, false, xgidx)) {
-                    todo.insert(x);
-                }
+    
+    // This used to be a breadth-first walk one base at a time, over sets of
+    // positions. We get the same answers by searching over whole nodes and
+    // working out the step of that walk that would have found pos2. Step 0
+    // visits the bases right after pos1, and a node first entered at step s
+    // has its base at offset k visited at step s + k.
+    const int64_t unreached = numeric_limits<int64_t>::max();
+    handle_t start = xgidx->get_handle(id(pos1), is_rev(pos1));
+    handle_t target = xgidx->get_handle(id(pos2), is_rev(pos2));
+    int64_t start_length = xgidx->get_length(start);
+    int64_t target_length = xgidx->get_length(target);
+    
+    // Get the step at which the offset on the target node is visited, given
+    // the step at which the target node is entered.
+    auto step_at = [&](int64_t entered, int64_t k) {
+        int64_t step = entered == unreached ? unreached : entered + k;
+        if (target == start && k > offset(pos1)) {
+            // We can get there without leaving the start node
+            step = min(step, k - (int64_t) offset(pos1) - 1);
+        }
+        return step;
+    };
+    
+    // The walk finds pos2 itself, or the base before it, in which case it
+    // reports one more. The base before comes up first at the same step.
+    auto best_step = [&](int64_t entered) {
+        int64_t step = unreached;
+        int64_t found = unreached;
+        if (offset(pos2) >= 1 && offset(pos2) <= target_length) {
+            step = step_at(entered, offset(pos2) - 1);
+            found = step == unreached ? unreached : step + adj + 1;
+        }
+        if (offset(pos2) < target_length) {
+            int64_t main_step = step_at(entered, offset(pos2));
+            if (main_step < step) {
+                step = main_step;
+                found = step + adj;
             }
         }
-        if (distance == maximum) {
-            break;
+        return make_pair(step, found);
+    };
+    
+    // The walk stops after step maximum, unless maximum is negative.
+    size_t max_step = maximum < 0 ? numeric_limits<size_t>::max() : maximum;
+    
+    // We don't need to search past any step where we can already find pos2
+    // without leaving the start node.
+    int64_t in_node_step = best_step(unreached).first;
+    size_t search_max = in_node_step == unreached ? max_step : min(max_step, (size_t) in_node_step);
+    
+    // Everything after the start node is entered at the step after the
+    // start node's last base.
+    size_t first_step = max<int64_t>(0, start_length - 1 - offset(pos1));
+    vector<pair<handle_t, size_t>> starts;
+    xgidx->follow_edges(start, false, [&](const handle_t& next) {
+        starts.emplace_back(next, first_step);
+    });
+    
+    int64_t entered = unreached;
+    algorithms::dijkstra(xgidx, starts, [&](const handle_t& here, size_t step) {
+        if (here == target) {
+            entered = step;
+            return false;
         }
-        nexts = todo;
-        ++distance;
+        return true;
+    }, false, search_max);
+    
+    auto found = best_step(entered);
+    if (found.first == unreached || (size_t) found.first > max_step) {
+        return numeric_limits<int64_t>::max();
     }
-    return numeric_limits<int64_t>::max();
+    return found.second;
 }
 
 set<pos_t> xg_positions_bp_from(pos_t pos, int64_t distance, bool rev, const xg::XG* xgidx) {
@@ -213,11 +211,19 @@ set<pos_t> xg_positions_bp_from(pos_t pos, int64_t distance, bool rev, const xg:
 }
 
 map<string, vector<pair<size_t, bool> > > xg_alignment_path_offsets(const Alignment& aln, bool just_min, bool nearby, const xg::XG* xgidx) {
+    return alignment_path_offsets(aln, just_min, nearby,
+                                  [&](pos_t pos) { return xgidx->offsets_in_paths(pos); },
+                                  [&](pos_t pos, int64_t max_search) { return xgidx->nearest_offsets_in_paths(pos, max_search); });
+}
+
+map<string, vector<pair<size_t, bool> > > alignment_path_offsets(const Alignment& aln, bool just_min, bool nearby,
+    const function<map<string, vector<pair<size_t, bool> > >(pos_t)>& offsets_in_paths,
+    const function<map<string, vector<pair<size_t, bool> > >(pos_t, int64_t)>& nearest_offsets_in_paths) {
     map<string, vector<pair<size_t, bool> > > offsets;
     for (auto& mapping : aln.path().mapping()) {
         auto pos_offs = (nearby ?
-                         xgidx->nearest_offsets_in_paths(make_pos_t(mapping.position()), aln.sequence().size())
-                         : xgidx->offsets_in_paths(make_pos_t(mapping.position())));
+                         nearest_offsets_in_paths(make_pos_t(mapping.position()), aln.sequence().size())
+                         : offsets_in_paths(make_pos_t(mapping.position())));
         for (auto& p : pos_offs) {
             auto& v = offsets[p.first];
             auto& y = p.second;
@@ -227,7 +233,7 @@ map<string, vector<pair<size_t, bool> > > xg_alignment_path_offsets(const Alignm
         //if (just_first && offsets.size()) break; // find a single node that has a path position
     }
     if (!nearby && offsets.empty()) { // find the nearest if we couldn't find any before
-        return xg_alignment_path_offsets(aln, just_min, true, xgidx);
+        return alignment_path_offsets(aln, just_min, true, offsets_in_paths, nearest_offsets_in_paths);
     }
     if (just_min) {
         // take the min offset in each path
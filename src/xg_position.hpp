@@ -37,6 +37,11 @@ Node xg_node(id_t id, const xg::XG* xgidx);
 vector<Edge> xg_edges_on_start(id_t id, const xg::XG* xgidx);
 vector<Edge> xg_edges_on_end(id_t id, const xg::XG* xgidx);
 map<string, vector<pair<size_t, bool> > > xg_alignment_path_offsets(const Alignment& aln, bool just_min, bool nearby, const xg::XG* xgidx);
+/// Like xg_alignment_path_offsets(), but looking up the offsets of a position, or those of the nearest path
+/// position within a number of bases, with the given functions.
+map<string, vector<pair<size_t, bool> > > alignment_path_offsets(const Alignment& aln, bool just_min, bool nearby,
+    const function<map<string, vector<pair<size_t, bool> > >(pos_t)>& offsets_in_paths,
+    const function<map<string, vector<pair<size_t, bool> > >(pos_t, int64_t)>& nearest_offsets_in_paths);
 void xg_annotate_with_initial_path_positions(Alignment& aln, bool just_min, bool nearby, const xg::XG* xgidx);
 
 }
@@ -18,7 +18,7 @@ is "$(samtools view -u minigiab/NA12878.chr22.tiny.bam | vg view -bG - | vg view
 
 # We need to run through GFA because vg construct doesn't necessarily chunk the
 # graph the way vg view wants to.
-vg construct -r small/x.fa -v small/x.vcf.gz | vg view -g - | vg view -Fv - >x.vg
+vg construct -r small/x.fa -v small/x.vcf.gz | vg view -g - | vg view -Fv - | vg view -v - >x.vg
 vg view -j x.vg | jq . | vg view -Jv - | diff x.vg -
 is $? 0 "view can reconstruct a VG graph from JSON"
 
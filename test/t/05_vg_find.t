@@ -5,7 +5,7 @@ BASH_TAP_ROOT=../deps/bash-tap
 
 PATH=../bin:$PATH # for vg
 
-plan tests 25
+plan tests 28
 
 vg construct -r small/x.fa -v small/x.vcf.gz >x.vg
 is $? 0 "construction"
@@ -72,6 +72,7 @@ is $(vg find -A <(vg find -N <(seq 37 52 ) -x x.xg ) -d x.db | vg view -a - | wc
 vg gamsort -i x.sorted.gam.gai x.gam > x.sorted.gam
 is $(vg find -o 127 --sorted-gam x.sorted.gam | vg view -a - | wc -l) 6 "the GAM index can return the set of alignments mapping to a node"
 is $(vg find -A <(vg find -N <(seq 37 52 ) -x x.xg ) --sorted-gam x.sorted.gam | vg view -a - | wc -l) 15 "a subgraph query may be used to obtain a particular subset of alignments from a sorted GAM"
+is $(vg find -O x:100-300 -x x.xg --sorted-gam x.sorted.gam --threads 2 | vg view -a - | wc -l) $(vg find -A <(vg find -p x:100-300 -x x.xg) --sorted-gam x.sorted.gam | vg view -a - | wc -l) "alignments on a path region can be found in a sorted GAM"
 
 rm -rf x.db x.gam x.reads x.sorted.gam x.sorted.gam.gai
 
@@ -87,7 +88,10 @@ echo 12 13 >get.nodes
 echo 14 >>get.nodes
 echo 15 >>get.nodes
 is $(vg find -x tiny.xg -N get.nodes | vg view - | grep ^S | wc -l) 4 "find gets nodes provided in a node file list"
-rm -rf tiny.xg tiny.vg get.nodes
+printf 'x\t0\t10\nx\t5\t20\n' >get.bed
+is "$(vg find -x tiny.xg -b get.bed | vg view - | sort)" "$(vg find -x tiny.xg -p x:0-19 | vg view - | sort)" "find gets nodes in BED regions"
+is "$(vg find -x tiny.xg -n 12 -n 13 -c 1 --per-query --threads 2 | vg view - | grep ^S | sort)" "$(vg find -x tiny.xg -n 12 -n 13 -c 1 | vg view - | grep ^S | sort)" "find can look up the context of each node on its own"
+rm -rf tiny.xg tiny.vg get.nodes get.bed
 
 echo '{"node": [{"id": 1, "sequence": "A"}, {"id": 2, "sequence": "A"}], "edge": [{"from": 1, "to": 2}], "path": [{"name": "ref", "mapping": [{"position": {"node_id": 1}}]}]}' | vg view -Jv - >test.vg
 vg index -x test.xg test.vg
@@ -7,7 +7,7 @@ PATH=../bin:$PATH # for vg
 
 export LC_ALL="en_US.utf8" # force ekg's favorite sort order 
 
-plan tests 52
+plan tests 53
 
 # Single graph without haplotypes
 vg construct -r small/x.fa -v small/x.vcf.gz > x.vg
@@ -230,6 +230,14 @@ is $(vg index -D -d all.vg.aln | wc -l) 101 "index can store alignments to cycli
 
 rm -rf all.vg.aln c.xg c.gcsa
 
+vg construct -r small/x.fa -v small/x.vcf.gz | vg view -g - >x.gfa
+vg view -Fv x.gfa >x.vg
+vg index -x x.gfa.xg x.gfa
+vg index -x x.vg.xg x.vg
+is "$(vg find -x x.gfa.xg -p x:1-1000 -c 2 | vg view -j - | jq -c '.node | sort_by(.id)' | md5sum)" "$(vg find -x x.vg.xg -p x:1-1000 -c 2 | vg view -j - | jq -c '.node | sort_by(.id)' | md5sum)" "xg index can be built directly from GFA"
+
+rm -f x.gfa x.vg x.gfa.xg x.vg.xg
+
 is $(vg index -g x.gcsa -k 16 -V <(vg view -Fv cyclic/two_node.gfa) 2>&1 |  grep 'Index verification complete' | wc -l) 1 "GCSA2 index works on cyclic graphs with heads and tails"
 
 is $(vg index -g x.gcsa -k 16 -V cyclic/no_heads.vg 2>&1 |  grep 'Index verification complete' | wc -l) 1 "GCSA2 index works on cyclic graphs with no heads or tails"
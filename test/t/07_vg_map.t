@@ -5,7 +5,7 @@ BASH_TAP_ROOT=../deps/bash-tap
 
 PATH=../bin:$PATH # for vg
 
-plan tests 52
+plan tests 59
 
 vg construct -r small/x.fa -v small/x.vcf.gz >x.vg
 vg index -x x.xg -g x.gcsa -k 11 x.vg
@@ -107,6 +107,16 @@ is $(vg map -T x.reads -d x -j | jq -r -c '.path.mapping[0].position.node_id' |
 
 is $(vg map -T <(head -1 x.reads) -d x -j -t 1 -Q 30 | jq -r .mapping_quality) 30 "the mapping quality may be capped"
 
+is "$(vg map -T <(head -100 x.reads; head -100 x.reads) -d x -j -t 1 --duplicate-cache 100 | jq -c '.path' | md5sum)" "$(vg map -T <(head -100 x.reads; head -100 x.reads) -d x -j -t 1 | jq -c '.path' | md5sum)" "mapping duplicate reads from the duplicate cache finds the same alignments"
+
+vg map -T <(head -10 x.reads) -d x -t 1 --slow-reads slow.gam --slow-read-ms 0 >/dev/null
+is "$(vg view -a slow.gam | jq -r '.annotation.latency_us' | grep -v null | wc -l)" "10" "reads slower than the threshold are saved with their latency"
+rm -f slow.gam
+
+VG_TIMELINE=timeline.json vg map -T <(head -10 x.reads) -d x -t 1 >/dev/null
+is "$(jq '.traceEvents | map(select(.name == "map read")) | length' timeline.json)" "10" "the timeline holds a span for mapping each read"
+rm -f timeline.json
+
 vg index -x graphs/refonly-lrc_kir.vg.xg -g graphs/refonly-lrc_kir.vg.gcsa -k 16 graphs/refonly-lrc_kir.vg
 
 vg map -x graphs/refonly-lrc_kir.vg.xg -g graphs/refonly-lrc_kir.vg.gcsa -f reads/grch38_lrc_kir_paired.fq -i -u 4 -j  > temp_paired_alignment.json
@@ -152,6 +162,7 @@ is "$(vg map -x x.xg -g x.gcsa --gbwt-name x.gbwt --hap-exp 1 --full-l-bonus 0 -
 is "$(vg map -x x.xg -g x.gcsa --gbwt-name x.gbwt --hap-exp 0 --full-l-bonus 0 -f reads/x.match.fq -j | jq -r '.score')" "36" "mapping a read that matches a haplotype with exponent 0 gets the base score"
 # This read matches no haplotypes but only visits used nodes
 is "$(vg map -x x.xg -g x.gcsa --gbwt-name x.gbwt --hap-exp 1 --full-l-bonus 0 -f reads/x.offhap.fq -j | jq -r '.score')" "21" "mapping a read that matches no haplotypes gets a larger penalty"
+is "$(vg map -x x.xg -g x.gcsa --gbwt-name x.gbwt --haplotype-filter --hap-exp 1 --full-l-bonus 0 -f reads/x.match.fq -j | jq -r '.score')" "35" "filtering MEM hits by haplotype keeps the hits of a read that matches a haplotype"
 
 # Test paired surjected mapping
 vg map -d x -iG <(vg sim -a -s 13241 -n 1 -p 500 -v 300 -x x.xg | vg view -a - | sed 's%_1%/1%' | sed 's%_2%/2%' | vg view -JaG - ) --surject-to SAM >surjected.sam
@@ -174,6 +185,9 @@ rm -f x.vg.idx x.vg.gcsa x.vg.gcsa.lcp x.vg x.reads x.xg x.gcsa x.gcsa.lcp x.gbw
 vg construct -r tiny/tiny.fa -v tiny/tiny.vcf.gz >tiny.vg
 vg index -k 16 -x tiny.xg -g tiny.gcsa tiny.vg
 is $(vg map -d tiny -f tiny/tiny.fa -j | jq -r .identity) 1 "mapper can read FASTA input"
+is $(vg map -d tiny -f tiny/tiny.fa -M 4 --prune-clusters -j | head -n1 | jq -r .identity) 1 "mapper finds the same best alignment when pruning clusters by score bound"
+is $(vg map -d tiny -f tiny/tiny.fa --xdrop-alignment --xdrop-extend -j | jq -r .identity) 1 "X-drop extension straight through the graph aligns a read from the reference"
+is "$(vg map -d tiny -s CAAATAAGGCTTGGAAATTTTCTGGAGTTCTATTATATTGCAACTCTCTG --ungapped-mismatches 2 -j | jq -r .score)" "$(vg map -d tiny -s CAAATAAGGCTTGGAAATTTTCTGGAGTTCTATTATATTGCAACTCTCTG -j | jq -r .score)" "ungapped cluster alignment scores a mismatched read the same as dynamic programming"
 cat <<EOF >t.fa
 >x
 CAAATAAGGCTTGGAAATTTTCTGGA
@@ -5,7 +5,7 @@ BASH_TAP_ROOT=../deps/bash-tap
 
 PATH=../bin:$PATH # for vg
 
-plan tests 7
+plan tests 11
 
 num_nodes=$(vg construct -r small/x.fa -v small/x.vcf.gz | vg ids -c - | vg view -g - | grep ^S | wc -l)
 
@@ -38,6 +38,19 @@ rm sorted.vg
 
 is $(vg ids -s ids/unordered.vg | vg view -j - | jq -r -c '.node[1] == {"id":"2","sequence":"T"}') "true" "sorting assigns node IDs in topological order"
 
+is $(vg ids -se ids/unordered.vg | vg view -j - | jq -r -c '.edge[] | select((.from | tonumber) > (.to | tonumber))' | wc -l) 0 "external sorting removes back-edges in a DAG"
+
+vg ids -se cyclic/all.vg > sorted.vg
+is $(vg view -g sorted.vg | grep ^S | wc -l) $(vg view -g cyclic/all.vg | grep ^S | wc -l) "external sorting keeps every node of a complex cyclic graph"
+rm sorted.vg
+
+vg construct -r small/x.fa -v small/x.vcf.gz >x.vg
+vg ids -se x.vg | vg validate -
+is $? 0 "external sorting renumbers paths along with the graph"
+vg ids -i 1000 x.vg >shifted.vg
+is $(vg ids -c shifted.vg | vg view -g - | grep ^S | cut -f 2 | sort -n | tail -1) $num_nodes "streaming compaction of a file is dense"
+rm x.vg shifted.vg
+
 # this test now breaks under the current VG.paths semantics, which require our paths to record the exact match lengths of the nodes
 #vg ids -s graphs/snp1kg-brca2-unsorted.vg | vg validate -
 #is $? 0 "can handle graphs with out-of-order mappings"
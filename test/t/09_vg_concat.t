@@ -5,7 +5,7 @@ BASH_TAP_ROOT=../deps/bash-tap
 
 PATH=../bin:$PATH # for vg
 
-plan tests 1
+plan tests 4
 
 vg construct -r small/x.fa -v small/x.vcf.gz >x.vg
 
@@ -15,4 +15,11 @@ num_nodes=$(vg view -g x.vg | grep ^S | wc -l)
 
 is $(vg concat x.vg x.vg | vg view -g - | grep ^S | wc -l) $(echo "$num_nodes * 2" | bc) "concat doubles the number of nodes"
 
+is "$(vg concat x.vg x.vg | vg stats -z -)" "$(vg concat - x.vg <x.vg | vg stats -z -)" "streaming concat matches concat in memory"
+
+vg concat x.vg x.vg | vg validate -
+is $? 0 "streaming concat joins paths into a valid graph"
+
+is "$(vg join x.vg | vg stats -z -)" "$(vg join - <x.vg | vg stats -z -)" "streaming join matches join in memory"
+
 rm -f x.vg
@@ -5,7 +5,7 @@ BASH_TAP_ROOT=../deps/bash-tap
 
 PATH=../bin:$PATH # for vg
 
-plan tests 10
+plan tests 12
 
 vg construct -r 1mb1kgp/z.fa -v 1mb1kgp/z.vcf.gz >z.vg
 #is $? 0 "construction of a 1 megabase graph from the 1000 Genomes succeeds"
@@ -41,6 +41,8 @@ vg index -x x.xg -g x.gcsa -k 16 x.vg
 vg sim -s 1337 -n 100 -x x.xg >x.reads
 vg map -x x.xg -g x.gcsa -T x.reads >x.gam
 is "$(vg stats -a x.gam x.vg | md5sum | cut -f 1 -d\ )" "$(md5sum correct/10_vg_stats/15.txt | cut -f 1 -d\ )" "aligned read stats are computed correctly"
+is "$(vg stats -M -x x.xg -g x.gcsa -D 0 | cut -f 1 | tr '\n' ' ')" "component xg gcsa lcp peak_rss " "a memory report covers each index loaded"
+is "$(vg stats -M -x x.xg | awk -F'\t' '$1 == "xg" {print $3}')" "$(wc -c <x.xg | tr -d ' ')" "an xg index takes up as many bytes as it serializes to"
 rm -f x.vg x.xg x.gcsa x.gam x.reads
 
 vg msga -g <(vg msga -f msgas/cycle.fa -b s1 -w 32 -t 1 | vg mod -D - | vg mod -U 10 -) -f msgas/cycle.fa -t 1 | vg mod -N - | vg mod -U 10 - >c.vg
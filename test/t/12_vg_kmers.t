@@ -7,7 +7,7 @@ PATH=../bin:$PATH # for vg
 
 export LC_ALL="C" # force a consistent sort order 
 
-plan tests 11
+plan tests 13
 
 is $(vg construct -r small/x.fa -v small/x.vcf.gz | vg kmers -k 11 - | cut -f 1 | sort | uniq | wc -l) \
     4250 \
@@ -47,3 +47,11 @@ is $(vg construct -r small/x.fa -v small/x.vcf.gz| vg kmers -g -k 11 -t 1 -H 100
 
 vg construct -v tiny/tiny.vcf.gz -r tiny/tiny.fa | vg view - |head -10 | vg view -v - | vg mod -o - | vg kmers -k 16 - >/dev/null
 is $? 0 "attempting to generate kmers longer than the longest path in a graph correctly yields no kmers"
+
+vg construct -r small/xy.fa -v small/xy2.vcf.gz -R x -C -a > x.vg 2> /dev/null
+vg index -G x.gbwt -v small/xy2.vcf.gz x.vg
+vg kmers -k 11 -t 1 x.vg | cut -f 1 | sort | uniq > all.kmers
+vg kmers -k 11 -t 1 -G x.gbwt x.vg | cut -f 1 | sort | uniq > haplotype.kmers
+is $(comm -13 all.kmers haplotype.kmers | wc -l) 0 "haplotype kmers are all graph kmers"
+is $(vg kmers -gB -k 11 -t 2 -G x.gbwt x.vg | wc -c) $(vg kmers -gB -k 11 -t 1 -G x.gbwt x.vg | wc -c) "GCSA2 binary output from haplotype kmers doesn't depend on threads"
+rm -f x.vg x.gbwt all.kmers haplotype.kmers
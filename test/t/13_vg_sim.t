@@ -6,7 +6,7 @@ BASH_TAP_ROOT=../deps/bash-tap
 PATH=../bin:$PATH # for vg
 
 
-plan tests 12
+plan tests 14
 
 vg construct -r small/x.fa -v small/x.vcf.gz >x.vg
 vg index -x x.xg x.vg
@@ -44,4 +44,8 @@ is $(vg sim -s 3145 -N -n 1000 -l 20 -x n.xg | grep N | wc -l) 377 "sim can emit
 
 is $(vg sim -s 3145 -n 1000 -l 2 -p 5 -e 0.1 -x n.xg | grep N | wc -l) 0 "sim doesn't emit Ns even with pair and errors"
 
+is "$(vg sim -s 2718 -n 2500 -l 20 -t 2 -a -x n.xg | vg view -a - | md5sum)" "$(vg sim -s 2718 -n 2500 -l 20 -t 3 -a -x n.xg | vg view -a - | md5sum)" "sim makes the same reads on different numbers of threads"
+
+is $(vg sim -s 2718 -n 2500 -l 20 -p 30 -t 4 -x n.xg | wc -l) 2500 "sim makes the right number of pairs on multiple threads"
+
 rm -f x.vg x.xg n.vg n.fa n.xg
@@ -6,7 +6,7 @@ BASH_TAP_ROOT=../deps/bash-tap
 PATH=../bin:$PATH # for vg
 
 
-plan tests 5
+plan tests 6
 
 vg view -J -v pileup/tiny.json > tiny.vg
 
@@ -17,7 +17,12 @@ vg view -J -a -G pileup/alignment.json > alignment.gam
 vg augment -a pileup tiny.vg alignment.gam -P tiny.gpu > /dev/null
 vg view tiny.gpu -l -j | jq . > tiny.gpu.json
 is $(jq --argfile a tiny.gpu.json --argfile b pileup/truth.json -n '($a == $b)') true "vg augment -P produces the expected output for test case on tiny graph."
-rm -f alignment.gam tiny.gpu tiny.gpu.json
+# Augmenting from a sorted GAM in one pass should call the same graph
+vg gamsort alignment.gam > alignment.sorted.gam
+vg augment -a pileup tiny.vg alignment.gam > augmented.vg
+vg augment -a pileup -s tiny.vg alignment.sorted.gam > augmented.sorted.vg
+is "$(vg stats -N -E -l augmented.sorted.vg)" "$(vg stats -N -E -l augmented.vg)" "vg augment -s makes the same size graph in one pass over a sorted GAM"
+rm -f alignment.gam alignment.sorted.gam tiny.gpu tiny.gpu.json augmented.vg augmented.sorted.vg
 
 # Make sure well-supported edits are augmented in
 vg view -J -a -G pileup/edits.json > edits.gam
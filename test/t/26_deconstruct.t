@@ -5,7 +5,7 @@ BASH_TAP_ROOT=../deps/bash-tap
 
 PATH=../bin:$PATH # for vg
 
-plan tests 0
+plan tests 1
 
 ## Test VG .to_superbubbles()
 #is $(echo 0) 0 "vg deconstruct produces the expected number of superbubbles in a simple graph."
@@ -30,3 +30,13 @@ plan tests 0
 
 ## Test masking a graph with a VCF
 #
+
+vg construct -r tiny/tiny.fa -v tiny/tiny.vcf.gz > tiny.vg
+vg index -x tiny.xg tiny.vg
+vg snarls tiny.vg > tiny.snarls
+vg deconstruct -p x tiny.vg | grep -v "^#" > from_vg.vcf
+vg deconstruct -p x -x tiny.xg -r tiny.snarls -t 2 | grep -v "^#" > from_xg.vcf
+diff from_vg.vcf from_xg.vcf
+is $? 0 "deconstruct from an xg index and snarls matches deconstruct from the graph"
+
+rm -f tiny.vg tiny.xg tiny.snarls from_vg.vcf from_xg.vcf
@@ -5,7 +5,7 @@ BASH_TAP_ROOT=../deps/bash-tap
 
 PATH=../bin:$PATH # for vg
 
-plan tests 9
+plan tests 10
 
 # Make sure there's no existing index or its reads will get scooped up.
 rm -f tiny.gam.index
@@ -23,6 +23,7 @@ is $(cat loci.sorted | wc -l) $(vg stats -R tiny.vg | grep ultrabubble | wc -l)
 is $(head -1 loci.sorted) "1+0_6+0" "the first locus is as expected"
 is $(head -2 loci.sorted | tail -1) "6+0_9+0" "a middle locus is as expected"
 is $(tail -1 loci.sorted) "12+0_15+0" "the last locus is as expected"
+is $(vg locify -G tiny.gam -x tiny.vg.xg -l tiny.loci -f -n -t 2 | vg view -a - | jq -c '[.name, .locus]' | sort | md5sum) $(vg locify -g tiny.gam.index -x tiny.vg.xg -l tiny.loci -f -n | vg view -a - | jq -c '[.name, .locus]' | sort | md5sum) "locify annotates streamed alignments like indexed ones"
 rm -rf tiny.gam.index
 
 vg construct -r tiny/tiny.fa -v tiny/multi.vcf.gz >tiny.vg
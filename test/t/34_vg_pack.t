@@ -5,7 +5,7 @@ BASH_TAP_ROOT=../deps/bash-tap
 
 PATH=../bin:$PATH # for vg
 
-plan tests 6
+plan tests 7
 
 vg construct -r tiny/tiny.fa >flat.vg
 vg view flat.vg| sed 's/CAAATAAGGCTTGGAAATTTTCTGGAGTTCTATTATATTCCAACTCTCTG/CAAATAAGGCTTGGAAATTTTCTGGAGATCTATTATACTCCAACTCTCTG/' | vg view -Fv - >2snp.vg
@@ -39,4 +39,6 @@ y=$(vg pack -x flat.xg -di 2snp.gam.cx.3x | wc -c)
 
 is $x $y "pack index merging produces the expected result"
 
+is $(vg pack -x flat.xg -Di 2snp.gam.cx | awk '$1 == 1 { print $2 }') $(vg pack -x flat.xg -di 2snp.gam.cx | awk '$2 == 1 { s += $4; n++ } END { print s / n }') "node depths are the mean coverage over each node"
+
 rm -f flat.vg 2snp.vg 2snp.xg 2snp.sim flat.gcsa flat.gcsa.lcp flat.xg 2snp.xg 2snp.gam 2snp.gam.cx 2snp.gam.cx.3x 2snp.gam.vgpu
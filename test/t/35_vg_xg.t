@@ -5,7 +5,7 @@ BASH_TAP_ROOT=../deps/bash-tap
 
 PATH=../bin:$PATH # for vg
 
-plan tests 2
+plan tests 4
 
 vg construct -r small/x.fa -v small/x.vcf.gz >x.vg
 vg index -x x.xg x.vg
@@ -19,4 +19,15 @@ diff x.gfa y.gfa
 
 is $? 0 "files are the same"
 
-rm -f x.xg x.vg y.vg x.gfa y.gfa
+vg view x.vg | grep -v ^H | sort > x.gfa
+vg xg -i x.xg -G - | grep -v ^H | sort > y.gfa
+diff x.gfa y.gfa
+
+is $? 0 "xg exports the same GFA as vg"
+
+vg mod -D x.vg > nopaths.vg
+vg xg -v nopaths.vg -o nopaths.xg
+vg xg -i nopaths.xg -A x.vg -o added.xg
+is "$(vg xg -i added.xg -X - | vg view - | grep ^P | sort | md5sum)" "$(vg xg -i x.xg -X - | vg view - | grep ^P | sort | md5sum)" "paths can be added to an existing xg index"
+
+rm -f x.xg x.vg y.vg x.gfa y.gfa nopaths.vg nopaths.xg added.xg
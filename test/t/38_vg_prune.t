@@ -5,7 +5,7 @@ BASH_TAP_ROOT=../deps/bash-tap
 
 PATH=../bin:$PATH # for vg
 
-plan tests 12
+plan tests 13
 
 
 # Build a graph with one path and two threads
@@ -19,6 +19,11 @@ is $(vg stats -N y.vg) 31 "pruning leaves the correct number of nodes"
 is $(vg stats -E y.vg) 31 "pruning leaves the correct number of edges"
 rm -f y.vg
 
+# One-pass pruning leaves a valid graph
+vg prune -O -M 8 -e 1 x.vg > y.vg
+is $(vg validate y.vg && echo valid) valid "one-pass pruning produces a valid graph"
+rm -f y.vg
+
 # Restore paths: 1 component, 44 nodes, 48 edges
 vg prune -r -e 1 x.vg > y.vg
 is $(vg stats -s y.vg | wc -l) 1 "pruning with path restoring produces the correct number of components"
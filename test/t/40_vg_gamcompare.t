@@ -6,7 +6,7 @@ BASH_TAP_ROOT=../deps/bash-tap
 PATH=../bin:$PATH # for vg
 
 
-plan tests 2
+plan tests 5
 
 vg construct -r small/x.fa -v small/x.vcf.gz >s.vg
 vg index -x s.xg -g s.gcsa s.vg
@@ -16,4 +16,12 @@ is $(vg map -x s.xg -g s.gcsa -G s.sim --surject-to sam | vg inject -x s.xg - |
 
 is $(vg gamcompare --range 10 s.sim s.sim | vg view -aj - | jq -c 'select(.correctly_mapped)' | wc -l) 1000 "gamcompare says the truth is correctly mapped"
 
+is $(vg gamcompare --sorted --range 10 s.sim s.sim | vg view -aj - | jq -c 'select(.correctly_mapped)' | wc -l) 1000 "gamcompare can stream co-ordered inputs"
+
+is $(vg gamcompare --partitions 4 --range 10 s.sim s.sim | vg view -aj - | jq -c 'select(.correctly_mapped)' | wc -l) 1000 "gamcompare can join hash-partitioned inputs"
+
+vg gamcompare --range 10 --mapq-table mq.tsv -t 2 s.sim s.sim >/dev/null
+is $(tail -n +2 mq.tsv | awk '{ correct += $2; total += $3 } END { print correct "/" total }') "1000/1000" "gamcompare mapping quality table counts every read"
+
+rm -f mq.tsv
 rm -f s.vg s.xg s.gcsa s.gcsa.lcp s.sim
@@ -6,7 +6,7 @@ BASH_TAP_ROOT=../deps/bash-tap
 PATH=../bin:$PATH # for vg
 
 
-plan tests 1
+plan tests 2
 
 vg construct -r tiny/tiny.fa -v tiny/tiny.vcf.gz >t.vg
 vg index -x t.xg -g t.gcsa t.vg
@@ -15,4 +15,7 @@ vg map -G <(vg sim -l 30 -n 100 -x t.xg -a) -d t | vg pack -x t.xg -o t.cx -g -
 vg viz -x t.xg -o t.svg -i t.cx -n alignments
 is $(echo $(wc -c t.svg | cut -f 1 -d\ )' > 0' | bc) 1 "vg viz runs"
 
-rm -f t.vg t.xg t.gcsa t.gcsa.lcp t.cx
+vg viz -x t.xg -o t.bins.png -i t.cx -n alignments -X 40 -t 2
+is $(echo $(wc -c t.bins.png | cut -f 1 -d\ )' > 0' | bc) 1 "vg viz can summarize graphs too wide to draw base by base"
+
+rm -f t.vg t.xg t.gcsa t.gcsa.lcp t.cx t.svg t.bins.png
@@ -0,0 +1,36 @@
+#!/usr/bin/env bash
+
+BASH_TAP_ROOT=../deps/bash-tap
+. ../deps/bash-tap/bash-tap-bootstrap
+
+PATH=../bin:$PATH # for vg
+
+
+plan tests 4
+
+vg construct -r small/x.fa -v small/x.vcf.gz >x.vg
+vg index -x x.xg -g x.gcsa -k 11 x.vg
+vg sim -s 1337 -n 100 -l 100 -x x.xg >reads.txt
+
+vg server -x x.xg -g x.gcsa -s server.sock -t 2 -j 2 2>/dev/null &
+server_pid=$!
+for i in $(seq 50); do
+    [ -S server.sock ] && break
+    sleep 0.1
+done
+
+vg map -T reads.txt -x x.xg -g x.gcsa | vg view -aj - | jq -r '.score' >direct.txt
+vg server -c server.sock map -T reads.txt -x x.xg -g x.gcsa | vg view -aj - | jq -r '.score' >served.txt
+is "$(md5sum <served.txt)" "$(md5sum <direct.txt)" "jobs on the server map the same as vg map"
+
+vg server -c server.sock -t 2 map -T /dev/stdin -x x.xg -g x.gcsa <reads.txt | vg view -aj - | jq -r '.score' >served.txt
+is "$(md5sum <served.txt)" "$(md5sum <direct.txt)" "jobs on the server read the client's standard input"
+
+vg server -c server.sock view x.vg 2>/dev/null
+isnt $? 0 "the server refuses subcommands other than map and mpmap"
+
+kill $server_pid
+wait $server_pid
+is "$([ -e server.sock ] && echo present || echo removed)" "removed" "the server removes its socket when it stops"
+
+rm -f x.vg x.xg x.gcsa x.gcsa.lcp reads.txt direct.txt served.txt
@@ -0,0 +1,37 @@
+#!/usr/bin/env bash
+
+BASH_TAP_ROOT=../deps/bash-tap
+. ../deps/bash-tap/bash-tap-bootstrap
+
+PATH=../bin:$PATH # for vg
+
+
+plan tests 6
+
+vg construct -r small/x.fa -v small/x.vcf.gz >x.vg
+vg index -x x.xg x.vg
+vg sim -n 1000 -l 100 -e 0.01 -i 0.005 -x x.xg -a -s 13931 >x.gam
+
+vg gamcompress -x x.xg x.gam >x.cgam
+vg gamcompress -x x.xg -d x.cgam >x.expanded.gam
+is "$(vg view -aj x.expanded.gam | md5sum)" "$(vg view -aj x.gam | md5sum)" "compact alignments expand back into the original alignments"
+
+is "$(( $(wc -c <x.cgam) < $(wc -c <x.gam) ))" "1" "compact alignments take less space than the GAM"
+
+vg gamcompress -x x.xg -q x.gam | vg gamcompress -x x.xg -d - >x.expanded.gam
+is "$(vg view -aj x.expanded.gam | jq -c '[.sequence, .path]' | md5sum)" "$(vg view -aj x.gam | jq -c '[.sequence, .path]' | md5sum)" "binning qualities keeps the sequences and paths"
+
+vg gamsort x.gam >x.sorted.gam
+vg gamcompress -x x.xg x.sorted.gam >x.sorted.cgam
+vg index -l --compact-gam x.sorted.cgam
+is "$?" "0" "sorted compact alignments can be indexed"
+
+vg index -g x.gcsa -k 16 x.vg
+vg mpmap -B -x x.xg -g x.gcsa -G x.gam >x.gamp
+vg gamcompress -x x.xg -m x.gamp >x.cgamp
+vg gamcompress -x x.xg -m -d x.cgamp >x.expanded.gamp
+is "$(vg view -K -j x.expanded.gamp | md5sum)" "$(vg view -K -j x.gamp | md5sum)" "compact multipath alignments expand back into the original multipath alignments"
+
+is "$(( $(wc -c <x.cgamp) < $(wc -c <x.gamp) ))" "1" "compact multipath alignments take less space than the originals"
+
+rm -f x.vg x.xg x.gcsa x.gcsa.lcp x.gam x.cgam x.expanded.gam x.sorted.gam x.sorted.cgam x.sorted.cgam.gai x.gamp x.cgamp x.expanded.gamp
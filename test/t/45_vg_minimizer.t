@@ -0,0 +1,26 @@
+#!/usr/bin/env bash
+
+BASH_TAP_ROOT=../deps/bash-tap
+. ../deps/bash-tap/bash-tap-bootstrap
+
+PATH=../bin:$PATH # for vg
+
+
+plan tests 4
+
+vg construct -r small/x.fa -v small/x.vcf.gz >x.vg
+vg index -x x.xg x.vg
+vg sim -n 200 -l 100 -x x.xg -a -s 93 >x.gam
+
+vg minimizer -x x.xg -o x.min
+is "$?" "0" "a minimizer index can be built from the walks through the graph"
+
+is "$(vg map -x x.xg --minimizer-name x.min -G x.gam | vg view -aj - | jq -c 'select(.path.mapping)' | wc -l)" "200" "reads can be mapped from minimizer seeds without a GCSA2 index"
+
+vg minimizer -x x.xg -p -k 15 -w 8 -o x.paths.min
+is "$?" "0" "a minimizer index can be built from the embedded paths"
+
+vg minimizer -x x.xg -k 40 -o x.bad.min 2>/dev/null
+is "$?" "1" "kmers too long to pack are rejected"
+
+rm -f x.vg x.xg x.gam x.min x.paths.min x.bad.min